@@ -29,6 +29,8 @@
 #include <unordered_map>
 #include <list>
 #include <thread>
+#include <atomic>
+#include <vector>
 #include "boost/optional.hpp"
 #include "syncobj.h"
 #include "include_base_utils.h"
@@ -121,6 +123,25 @@ namespace epee
         data.erase(data_it);
         return true;
       }
+
+      // elements count times the average weight of the (up to) max_samples most recently accessed ones, weigher(key, value) returns bytes
+      template<class weigher_t>
+      uint64_t estimate_bytes(size_t max_samples, weigher_t weigher)
+      {
+        CRITICAL_REGION_LOCAL(m_lock);
+        uint64_t sampled_bytes = 0, sampled_count = 0;
+        for (auto it = most_recet_acessed.begin(); it != most_recet_acessed.end() && sampled_count < max_samples; ++it)
+        {
+          auto data_it = data.find(*it);
+          if (data_it == data.end())
+            continue;
+          sampled_bytes += weigher(data_it->first, data_it->second.first);
+          ++sampled_count;
+        }
+        if (!sampled_count)
+          return 0;
+        return sampled_bytes * data.size() / sampled_count;
+      }
     protected:
       void trim()
       {
@@ -141,13 +162,19 @@ namespace epee
       critical_section m_my_lock;
       critical_section& m_lock;
       boost::optional<std::thread::id> m_current_writer_thread;
+      std::atomic<std::thread::id> m_writer_thread_id; // the same as m_current_writer_thread, for lock-free checks
     public:
-      isolation_lock() :m_lock(m_my_lock)
+      isolation_lock() :m_lock(m_my_lock), m_writer_thread_id(std::thread::id())
       {}
 
-      isolation_lock(critical_section& lock) :m_lock(lock)
+      isolation_lock(critical_section& lock) :m_lock(lock), m_writer_thread_id(std::thread::id())
       {}
 
+      bool is_current_thread_writer() const
+      {
+        return m_writer_thread_id.load(std::memory_order_acquire) == std::this_thread::get_id();
+      }
+
       template<typename res_type, typename callback_t>
       res_type isolated_access(callback_t cb) const 
       {
@@ -184,6 +211,7 @@ namespace epee
         CRITICAL_REGION_LOCAL(m_lock);
         CHECK_AND_ASSERT_THROW_MES(!m_current_writer_thread.is_initialized(), "Isolation mode already enabled for cache");
         m_current_writer_thread = std::this_thread::get_id();
+        m_writer_thread_id.store(std::this_thread::get_id(), std::memory_order_release);
       }
 
       void reset_isolation_mode()
@@ -191,6 +219,7 @@ namespace epee
         CRITICAL_REGION_LOCAL(m_lock);
         CHECK_AND_ASSERT_THROW_MES(m_current_writer_thread.is_initialized(), "Isolation mode already disable for cache");
         m_current_writer_thread = boost::optional<std::thread::id>();
+        m_writer_thread_id.store(std::thread::id(), std::memory_order_release);
       }
     };
 
@@ -242,6 +271,246 @@ namespace epee
       }
     };
 
+    /*
+      LRU cache split into shards with separate locks, so readers from different threads rarely wait for each other.
+      Shards keep committed values only, that's why readers don't lose their hits while a writer is active.
+      The writer thread works with its own staging area on top of the shards: changed keys go there and
+      are moved to the shards on commit (see before_commit() and commit()), abort just drops them.
+      Values read from db by other threads are put into the shards only if no commit happened in between (see get_generation()).
+    */
+    template<bool is_ordered_container, typename t_key, typename t_value, uint64_t max_elements, size_t shards_count = 16>
+    class sharded_cache_with_write_isolation
+    {
+    public:
+      struct shard_stats
+      {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t size;
+      };
+
+    private:
+      class shard : public cache_base<is_ordered_container, t_key, t_value, max_elements>
+      {
+        typedef cache_base<is_ordered_container, t_key, t_value, max_elements> base_class;
+      public:
+        std::atomic<uint64_t> hits;
+        std::atomic<uint64_t> misses;
+
+        shard() : hits(0), misses(0)
+        {}
+
+        bool set_if_generation(const t_key& k, const t_value& v, const std::atomic<uint64_t>& generation, uint64_t expected_generation)
+        {
+          CRITICAL_REGION_LOCAL(this->m_lock);
+          if (generation.load(std::memory_order_acquire) != expected_generation)
+            return false;
+          return base_class::set(k, v);
+        }
+      };
+
+      struct staged_entry
+      {
+        bool has_value; // false means the key was changed by the writer and its value should be read from db
+        t_value v;
+      };
+
+      isolation_lock& m_isolation;
+      shard m_shards[shards_count];
+      std::atomic<uint64_t> m_generation;
+      // accessed only by the writer thread
+      typename container_selector<is_ordered_container, t_key, staged_entry>::container m_staged;
+      bool m_staged_cleared;
+
+      shard& get_shard(const t_key& k)
+      {
+        return m_shards[std::hash<t_key>()(k) % shards_count];
+      }
+
+      void stage(const t_key& k, bool has_value, const t_value& v)
+      {
+        if (m_staged.size() >= max_elements && m_staged.find(k) == m_staged.end())
+        {
+          // too many changes to track them one by one, treat everything as changed
+          m_staged.clear();
+          m_staged_cleared = true;
+        }
+        staged_entry& e = m_staged[k];
+        e.has_value = has_value;
+        e.v = v;
+      }
+
+    public:
+      sharded_cache_with_write_isolation(isolation_lock& isolation) : m_isolation(isolation), m_generation(0), m_staged_cleared(false)
+      {
+        set_max_elements(max_elements);
+      }
+
+      void set_max_elements(uint64_t e)
+      {
+        for (auto& s : m_shards)
+          s.set_max_elements((e + shards_count - 1) / shards_count);
+      }
+
+      bool get(const t_key& k, t_value& v)
+      {
+        if (m_isolation.is_current_thread_writer())
+        {
+          auto it = m_staged.find(k);
+          if (it != m_staged.end())
+          {
+            if (!it->second.has_value)
+              return false;
+            v = it->second.v;
+            return true;
+          }
+          if (m_staged_cleared)
+            return false;
+        }
+
+        shard& s = get_shard(k);
+        if (s.get(k, v))
+        {
+          s.hits.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+        s.misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+
+      // to be taken before reading a value from db, then passed to fill()
+      uint64_t get_generation() const
+      {
+        return m_generation.load(std::memory_order_acquire);
+      }
+
+      // the value has just been read from db
+      bool fill(const t_key& k, const t_value& v, uint64_t generation)
+      {
+        if (m_isolation.is_current_thread_writer())
+        {
+          auto it = m_staged.find(k);
+          if (it != m_staged.end())
+          {
+            it->second.has_value = true;
+            it->second.v = v;
+            return true;
+          }
+          if (m_staged_cleared)
+          {
+            stage(k, true, v);
+            return true;
+          }
+        }
+        return get_shard(k).set_if_generation(k, v, m_generation, generation);
+      }
+
+      // the value has just been written to db
+      bool set(const t_key& k, const t_value& v)
+      {
+        if (m_isolation.is_current_thread_writer())
+        {
+          stage(k, true, v);
+          return true;
+        }
+        return get_shard(k).set(k, v);
+      }
+
+      bool erase(const t_key& k)
+      {
+        if (m_isolation.is_current_thread_writer())
+        {
+          stage(k, false, t_value());
+          return true;
+        }
+        return get_shard(k).erase(k);
+      }
+
+      void clear()
+      {
+        if (m_isolation.is_current_thread_writer())
+        {
+          m_staged.clear();
+          m_staged_cleared = true;
+          return;
+        }
+        for (auto& s : m_shards)
+          s.clear();
+      }
+
+      // called by the writer right before db commit: evicts all changed keys, so other threads read them from db, while it's being committed
+      void before_commit()
+      {
+        m_generation.fetch_add(1, std::memory_order_acq_rel);
+        if (m_staged_cleared)
+        {
+          for (auto& s : m_shards)
+            s.clear();
+          return;
+        }
+        for (auto& e : m_staged)
+          get_shard(e.first).erase(e.first);
+      }
+
+      // called by the writer after db commit
+      void commit()
+      {
+        m_generation.fetch_add(1, std::memory_order_acq_rel);
+        if (m_staged_cleared)
+        {
+          for (auto& s : m_shards)
+            s.clear();
+        }
+        for (auto& e : m_staged)
+        {
+          shard& s = get_shard(e.first);
+          if (e.second.has_value)
+            s.set(e.first, e.second.v);
+          else
+            s.erase(e.first);
+        }
+        abort();
+      }
+
+      // the whole write tx has been aborted, shards still contain valid values
+      void abort()
+      {
+        m_staged.clear();
+        m_staged_cleared = false;
+      }
+
+      // nested tx has been aborted: changed keys are still changed, but their values are unknown
+      void nested_abort()
+      {
+        for (auto& e : m_staged)
+        {
+          e.second.has_value = false;
+          e.second.v = t_value();
+        }
+      }
+
+      // values staged by the writer are not counted, they are there for a write transaction only
+      template<class weigher_t>
+      uint64_t estimate_bytes(size_t max_samples_per_shard, weigher_t weigher)
+      {
+        uint64_t r = 0;
+        for (auto& s : m_shards)
+          r += s.estimate_bytes(max_samples_per_shard, weigher);
+        return r;
+      }
+
+      void get_shards_stats(std::vector<shard_stats>& stats)
+      {
+        stats.resize(shards_count);
+        for (size_t i = 0; i != shards_count; ++i)
+        {
+          stats[i].hits = m_shards[i].hits.load(std::memory_order_relaxed);
+          stats[i].misses = m_shards[i].misses.load(std::memory_order_relaxed);
+          stats[i].size = m_shards[i].size();
+        }
+      }
+    };
+
     template<bool is_ordered_container, typename t_key, typename t_value, uint64_t max_elements>
     class cache_dummy : public cache_base<is_ordered_container, t_key, t_value, max_elements>
     {
@@ -30,6 +30,7 @@
 #ifndef _GZIP_ENCODING_H_
 #define _GZIP_ENCODING_H_
 #include "boost/core/ignore_unused.hpp"
+#include "misc_language.h"
 #include "net/http_client_base.h"
 #include "zlib/zlib.h"
 
@@ -46,13 +47,15 @@ namespace net_utils
   public:
     /*! \brief
     *  Function content_encoding_gzip : Constructor
-    *
+    *  max_unpacked_size - update_in() fails once the stream unpacks to more than that (0 - no limit)
     */
     inline 
-      content_encoding_gzip(i_target_handler* powner_filter, bool is_deflate_mode = false, int compression_level = Z_DEFAULT_COMPRESSION) :m_powner_filter(powner_filter),
+      content_encoding_gzip(i_target_handler* powner_filter, bool is_deflate_mode = false, int compression_level = Z_DEFAULT_COMPRESSION, uint64_t max_unpacked_size = 0) :m_powner_filter(powner_filter),
       m_is_stream_ended(false), 
       m_is_deflate_mode(is_deflate_mode),
-      m_is_first_update_in(true)
+      m_is_first_update_in(true),
+      m_max_unpacked_size(max_unpacked_size),
+      m_unpacked_size(0)
     {
       memset(&m_zstream_in, 0, sizeof(m_zstream_in));
       memset(&m_zstream_out, 0, sizeof(m_zstream_out));
@@ -165,6 +168,8 @@ namespace net_utils
 
         //decode_buff currently stores data parts that were unpacked, fix this size
         current_decode_buff.resize(ungzip_size - m_zstream_in.avail_out);
+        m_unpacked_size += current_decode_buff.size();
+        CHECK_AND_ASSERT_MES(!m_max_unpacked_size || m_unpacked_size <= m_max_unpacked_size, false, "content_encoding_gzip::update_in() Unpacked data exceeded the limit of " << m_max_unpacked_size << " bytes");
         if(decode_summary_buff.size())
           decode_summary_buff += current_decode_buff;
         else
@@ -219,6 +224,14 @@ namespace net_utils
     *  Marks that it is a first data packet 
     */
     bool    m_is_first_update_in;
+    /*! \brief
+    *  Limit of the unpacked stream size, 0 - no limit
+    */
+    uint64_t m_max_unpacked_size;
+    /*! \brief
+    *  How many bytes the stream has been unpacked to so far
+    */
+    uint64_t m_unpacked_size;
   }; // class content_encoding_gzip
 
   struct abstract_callback_base
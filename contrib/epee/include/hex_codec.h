@@ -0,0 +1,148 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define EPEE_HEX_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#  include <arm_neon.h>
+#  define EPEE_HEX_NEON
+#endif
+
+// hex blobs (txs, blocks) go through json rpc as is, so they are converted 16 bytes at once
+namespace epee
+{
+namespace hex_codec
+{
+  // writes 2 * size lowercase hex digits to dst
+  inline void encode(const uint8_t* src, size_t size, char* dst)
+  {
+    static const char hex_digits[17] = "0123456789abcdef";
+    size_t i = 0;
+#if defined(EPEE_HEX_SSE2)
+    const __m128i low_nibble_mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero_char = _mm_set1_epi8('0');
+    const __m128i letters_shift = _mm_set1_epi8('a' - '0' - 10);
+    for (; size - i >= 16; i += 16, dst += 32)
+    {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), low_nibble_mask);
+      __m128i lo = _mm_and_si128(x, low_nibble_mask);
+      hi = _mm_add_epi8(_mm_add_epi8(hi, zero_char), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letters_shift));
+      lo = _mm_add_epi8(_mm_add_epi8(lo, zero_char), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letters_shift));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi8(hi, lo));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#elif defined(EPEE_HEX_NEON)
+    const uint8x16_t nine = vdupq_n_u8(9);
+    const uint8x16_t zero_char = vdupq_n_u8('0');
+    const uint8x16_t letters_shift = vdupq_n_u8('a' - '0' - 10);
+    for (; size - i >= 16; i += 16, dst += 32)
+    {
+      uint8x16_t x = vld1q_u8(src + i);
+      uint8x16x2_t r;
+      r.val[0] = vshrq_n_u8(x, 4);
+      r.val[1] = vandq_u8(x, vdupq_n_u8(0x0f));
+      r.val[0] = vaddq_u8(vaddq_u8(r.val[0], zero_char), vandq_u8(vcgtq_u8(r.val[0], nine), letters_shift));
+      r.val[1] = vaddq_u8(vaddq_u8(r.val[1], zero_char), vandq_u8(vcgtq_u8(r.val[1], nine), letters_shift));
+      vst2q_u8(reinterpret_cast<uint8_t*>(dst), r); // interleaved: hi, lo, hi, lo...
+    }
+#endif
+    for (; i != size; ++i)
+    {
+      *dst++ = hex_digits[src[i] >> 4];
+      *dst++ = hex_digits[src[i] & 0x0f];
+    }
+  }
+
+  // -1 for anything but [0-9a-fA-F]
+  inline int get_hex_digit_value(char c)
+  {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
+  }
+
+  // decodes up to pairs_count pairs of hex digits from src into dst, stops at the first pair having anything but [0-9a-fA-F];
+  // returns the number of pairs decoded
+  inline size_t decode_pairs(const char* src, size_t pairs_count, uint8_t* dst)
+  {
+    size_t i = 0;
+#if defined(EPEE_HEX_SSE2)
+    const __m128i zero_char = _mm_set1_epi8('0');
+    const __m128i lowercase_bit = _mm_set1_epi8(0x20);
+    const __m128i a_char = _mm_set1_epi8('a');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i five = _mm_set1_epi8(5);
+    const __m128i ten = _mm_set1_epi8(10);
+    const __m128i low_byte_mask = _mm_set1_epi16(0x00ff);
+    // nibble values of 16 chars, invalid ones are reported in valid_mask (a bit per char)
+    auto to_nibbles = [&](__m128i c, int& valid_mask) -> __m128i
+    {
+      __m128i d = _mm_sub_epi8(c, zero_char);
+      __m128i l = _mm_sub_epi8(_mm_or_si128(c, lowercase_bit), a_char);
+      __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(d, nine), d);
+      __m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(l, five), l);
+      valid_mask = _mm_movemask_epi8(_mm_or_si128(is_digit, is_letter));
+      return _mm_or_si128(_mm_and_si128(is_digit, d), _mm_andnot_si128(is_digit, _mm_add_epi8(l, ten)));
+    };
+    for (; pairs_count - i >= 16; i += 16)
+    {
+      int valid_mask_1 = 0, valid_mask_2 = 0;
+      __m128i v1 = to_nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i)), valid_mask_1);
+      __m128i v2 = to_nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i + 16)), valid_mask_2);
+      if ((valid_mask_1 & valid_mask_2) != 0xffff)
+        break; // the scalar loop finds the exact pair
+      // each 16-bit lane holds the high nibble in its low byte and the low nibble in its high byte
+      __m128i b1 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v1, low_byte_mask), 4), _mm_srli_epi16(v1, 8));
+      __m128i b2 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v2, low_byte_mask), 4), _mm_srli_epi16(v2, 8));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(b1, b2));
+    }
+#elif defined(EPEE_HEX_NEON)
+    const uint8x16_t zero_char = vdupq_n_u8('0');
+    const uint8x16_t lowercase_bit = vdupq_n_u8(0x20);
+    const uint8x16_t a_char = vdupq_n_u8('a');
+    const uint8x16_t nine = vdupq_n_u8(9);
+    const uint8x16_t five = vdupq_n_u8(5);
+    const uint8x16_t ten = vdupq_n_u8(10);
+    auto to_nibbles = [&](uint8x16_t c, uint8x16_t& valid) -> uint8x16_t
+    {
+      uint8x16_t d = vsubq_u8(c, zero_char);
+      uint8x16_t l = vsubq_u8(vorrq_u8(c, lowercase_bit), a_char);
+      uint8x16_t is_digit = vcleq_u8(d, nine);
+      valid = vorrq_u8(is_digit, vcleq_u8(l, five));
+      return vbslq_u8(is_digit, d, vaddq_u8(l, ten));
+    };
+    for (; pairs_count - i >= 16; i += 16)
+    {
+      uint8x16x2_t c = vld2q_u8(reinterpret_cast<const uint8_t*>(src + 2 * i)); // high nibbles' chars, low nibbles' chars
+      uint8x16_t valid_hi, valid_lo;
+      uint8x16_t hi = to_nibbles(c.val[0], valid_hi);
+      uint8x16_t lo = to_nibbles(c.val[1], valid_lo);
+      if (vminvq_u8(vandq_u8(valid_hi, valid_lo)) != 0xff)
+        break;
+      vst1q_u8(dst + i, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    }
+#endif
+    for (; i != pairs_count; ++i)
+    {
+      int hi = get_hex_digit_value(src[2 * i]);
+      int lo = get_hex_digit_value(src[2 * i + 1]);
+      if (hi < 0 || lo < 0)
+        break;
+      dst[i] = static_cast<uint8_t>((hi << 4) | lo);
+    }
+    return i;
+  }
+}
+}
@@ -0,0 +1,245 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// upper bounds of the wait/hold time histogram buckets, in microseconds; the last bucket is unbounded
+#define LOCK_CONTENTION_BUCKETS_COUNT 8
+
+namespace epee
+{
+  struct lock_site_stat
+  {
+    std::string location;
+    std::string lock_name;
+    uint64_t count = 0;
+    uint64_t wait_sum_us = 0;
+    uint64_t wait_max_us = 0;
+    uint64_t hold_sum_us = 0;
+    uint64_t hold_max_us = 0;
+    std::vector<uint64_t> wait_buckets;  // not cumulative, see lock_contention_profiler::get_buckets_us()
+    std::vector<uint64_t> hold_buckets;
+  };
+
+  class lock_contention_site;
+
+  /************************************************************************/
+  /* Per lock site (CRITICAL_REGION_* macro call) wait and hold times.    */
+  /* Off by default: then a region only does one relaxed load for it.     */
+  /************************************************************************/
+  class lock_contention_profiler
+  {
+  public:
+    static bool is_enabled() { return enabled_flag().load(std::memory_order_relaxed); }
+    static void enable(bool enabled) { enabled_flag().store(enabled, std::memory_order_relaxed); }
+
+    static const std::vector<uint64_t>& get_buckets_us()
+    {
+      static const std::vector<uint64_t> buckets = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000 };
+      return buckets;
+    }
+
+    static uint64_t get_time_us()
+    {
+      return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // sites that were entered at least once while the profiler was on, the most waited for first
+    static void get_stats(std::vector<lock_site_stat>& stats);
+    static std::string get_report(size_t max_sites);
+    static void reset();
+
+    static void register_site(lock_contention_site* psite)
+    {
+      std::lock_guard<std::mutex> lk(registry_lock());
+      registry().push_back(psite);
+    }
+    static void unregister_site(lock_contention_site* psite)
+    {
+      std::lock_guard<std::mutex> lk(registry_lock());
+      auto& r = registry();
+      r.erase(std::remove(r.begin(), r.end(), psite), r.end());
+    }
+
+  private:
+    static std::atomic<bool>& enabled_flag()
+    {
+      static std::atomic<bool> enabled(false);
+      return enabled;
+    }
+    static std::mutex& registry_lock()
+    {
+      static std::mutex m;
+      return m;
+    }
+    static std::vector<lock_contention_site*>& registry()
+    {
+      static std::vector<lock_contention_site*> sites;
+      return sites;
+    }
+  };
+
+  class lock_contention_site
+  {
+  public:
+    lock_contention_site(const char* location, const char* lock_name)
+      : m_location(location), m_lock_name(lock_name)
+    {
+      reset();
+      lock_contention_profiler::register_site(this);
+    }
+    ~lock_contention_site()
+    {
+      lock_contention_profiler::unregister_site(this);
+    }
+
+    void add_wait(uint64_t us)
+    {
+      m_count.fetch_add(1, std::memory_order_relaxed);
+      m_wait_sum_us.fetch_add(us, std::memory_order_relaxed);
+      update_max(m_wait_max_us, us);
+      m_wait_buckets[get_bucket(us)].fetch_add(1, std::memory_order_relaxed);
+    }
+    void add_hold(uint64_t us)
+    {
+      m_hold_sum_us.fetch_add(us, std::memory_order_relaxed);
+      update_max(m_hold_max_us, us);
+      m_hold_buckets[get_bucket(us)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void get_stat(lock_site_stat& st) const
+    {
+      st.location = m_location;
+      st.lock_name = m_lock_name;
+      st.count = m_count.load(std::memory_order_relaxed);
+      st.wait_sum_us = m_wait_sum_us.load(std::memory_order_relaxed);
+      st.wait_max_us = m_wait_max_us.load(std::memory_order_relaxed);
+      st.hold_sum_us = m_hold_sum_us.load(std::memory_order_relaxed);
+      st.hold_max_us = m_hold_max_us.load(std::memory_order_relaxed);
+      st.wait_buckets.resize(LOCK_CONTENTION_BUCKETS_COUNT);
+      st.hold_buckets.resize(LOCK_CONTENTION_BUCKETS_COUNT);
+      for (size_t i = 0; i != LOCK_CONTENTION_BUCKETS_COUNT; ++i)
+      {
+        st.wait_buckets[i] = m_wait_buckets[i].load(std::memory_order_relaxed);
+        st.hold_buckets[i] = m_hold_buckets[i].load(std::memory_order_relaxed);
+      }
+    }
+
+    void reset()
+    {
+      m_count = 0;
+      m_wait_sum_us = 0;
+      m_wait_max_us = 0;
+      m_hold_sum_us = 0;
+      m_hold_max_us = 0;
+      for (size_t i = 0; i != LOCK_CONTENTION_BUCKETS_COUNT + 1; ++i)
+      {
+        m_wait_buckets[i] = 0;
+        m_hold_buckets[i] = 0;
+      }
+    }
+
+  private:
+    static size_t get_bucket(uint64_t us)
+    {
+      const std::vector<uint64_t>& b = lock_contention_profiler::get_buckets_us();
+      return std::lower_bound(b.begin(), b.end(), us) - b.begin();
+    }
+    static void update_max(std::atomic<uint64_t>& m, uint64_t v)
+    {
+      uint64_t cur = m.load(std::memory_order_relaxed);
+      while (v > cur && !m.compare_exchange_weak(cur, v, std::memory_order_relaxed));
+    }
+
+    const char* m_location;
+    const char* m_lock_name;
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_wait_sum_us;
+    std::atomic<uint64_t> m_wait_max_us;
+    std::atomic<uint64_t> m_hold_sum_us;
+    std::atomic<uint64_t> m_hold_max_us;
+    std::atomic<uint64_t> m_wait_buckets[LOCK_CONTENTION_BUCKETS_COUNT + 1];  // the last one is above all bounds
+    std::atomic<uint64_t> m_hold_buckets[LOCK_CONTENTION_BUCKETS_COUNT + 1];
+  };
+
+  // measures one region: the wait from the construction till on_locked(), the hold till on_unlocked()
+  class lock_contention_probe
+  {
+  public:
+    explicit lock_contention_probe(lock_contention_site* psite)
+      : m_psite(psite && lock_contention_profiler::is_enabled() ? psite : nullptr)
+      , m_time_us(m_psite ? lock_contention_profiler::get_time_us() : 0)
+    {}
+
+    void on_locked()
+    {
+      if (!m_psite)
+        return;
+      uint64_t now = lock_contention_profiler::get_time_us();
+      m_psite->add_wait(now - m_time_us);
+      m_time_us = now;
+    }
+
+    void on_unlocked()
+    {
+      if (!m_psite)
+        return;
+      m_psite->add_hold(lock_contention_profiler::get_time_us() - m_time_us);
+      m_psite = nullptr;
+    }
+
+  private:
+    lock_contention_site* m_psite;
+    uint64_t m_time_us;
+  };
+
+  inline void lock_contention_profiler::get_stats(std::vector<lock_site_stat>& stats)
+  {
+    stats.clear();
+    {
+      std::lock_guard<std::mutex> lk(registry_lock());
+      for (auto psite : registry())
+      {
+        lock_site_stat st;
+        psite->get_stat(st);
+        if (st.count)
+          stats.push_back(st);
+      }
+    }
+    std::sort(stats.begin(), stats.end(), [](const lock_site_stat& a, const lock_site_stat& b) { return a.wait_sum_us > b.wait_sum_us; });
+  }
+
+  inline void lock_contention_profiler::reset()
+  {
+    std::lock_guard<std::mutex> lk(registry_lock());
+    for (auto psite : registry())
+      psite->reset();
+  }
+
+  inline std::string lock_contention_profiler::get_report(size_t max_sites)
+  {
+    std::vector<lock_site_stat> stats;
+    get_stats(stats);
+    std::stringstream ss;
+    ss << "Lock contention profiler is " << (is_enabled() ? "on" : "off") << ", " << stats.size() << " lock sites entered" << std::endl
+      << std::left << std::setw(30) << "lock" << std::setw(10) << "count" << std::setw(14) << "wait_sum_ms" << std::setw(12) << "wait_avg_us" << std::setw(12) << "wait_max_ms"
+      << std::setw(14) << "hold_sum_ms" << std::setw(12) << "hold_max_ms" << "location" << std::endl;
+    for (size_t i = 0; i != stats.size() && i != max_sites; ++i)
+    {
+      const lock_site_stat& st = stats[i];
+      ss << std::left << std::setw(30) << st.lock_name << std::setw(10) << st.count << std::setw(14) << st.wait_sum_us / 1000 << std::setw(12) << st.wait_sum_us / st.count
+        << std::setw(12) << st.wait_max_us / 1000 << std::setw(14) << st.hold_sum_us / 1000 << std::setw(12) << st.hold_max_us / 1000 << st.location << std::endl;
+    }
+    return ss.str();
+  }
+}
@@ -52,6 +52,7 @@ namespace math_helper
 		{
 			m_base = default_base;
       m_count = 0;
+      m_total = 0;
 		}
 
 		bool set_base()
@@ -73,6 +74,7 @@ namespace math_helper
 
 //#ifndef DEBUG_STUB
       m_count++;
+      m_total += vl;
 			m_list.push_back(vl);
 			if(m_list.size() > m_base )
 				m_list.pop_front();
@@ -113,15 +115,24 @@ namespace math_helper
       return m_count;
     }
 
+    // sum of all the values pushed since the last reset(), not only of the averaged ones
+    value_type get_total() const
+    {
+      CRITICAL_REGION_LOCAL(static_cast<critical_section&>(m_lock));
+      return m_total;
+    }
+
     void reset()
     {
       m_count = 0;
+      m_total = 0;
       m_list.clear();
     }
 
 	private:
 		unsigned int m_base;
     uint64_t m_count;
+    value_type m_total;
 		std::list<value_type> m_list;
 		mutable critical_section m_lock;
 	};
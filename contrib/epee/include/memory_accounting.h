@@ -0,0 +1,112 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace epee
+{
+  /************************************************************************/
+  /* Byte counters of the memory held by subsystems that allocate as they */
+  /* go (send queues, parsed requests), kept up to date by their owners.  */
+  /* Containers that are easier to measure on demand are not here.        */
+  /************************************************************************/
+  class memory_accounting
+  {
+  public:
+    struct counter
+    {
+      std::atomic<int64_t> bytes{0};
+      std::atomic<int64_t> items{0};
+
+      void add(int64_t bytes_delta, int64_t items_delta)
+      {
+        bytes.fetch_add(bytes_delta, std::memory_order_relaxed);
+        items.fetch_add(items_delta, std::memory_order_relaxed);
+      }
+    };
+
+    struct counter_value
+    {
+      uint64_t bytes;
+      uint64_t items;
+    };
+
+    // the returned reference stays valid, callers are expected to keep it in a static
+    static counter& get(const std::string& name)
+    {
+      std::lock_guard<std::mutex> lk(registry_lock());
+      return registry()[name];
+    }
+
+    static void get_all(std::map<std::string, counter_value>& values)
+    {
+      std::lock_guard<std::mutex> lk(registry_lock());
+      for (const auto& c : registry())
+      {
+        int64_t b = c.second.bytes.load(std::memory_order_relaxed);
+        int64_t i = c.second.items.load(std::memory_order_relaxed);
+        values[c.first] = counter_value{ b > 0 ? static_cast<uint64_t>(b) : 0, i > 0 ? static_cast<uint64_t>(i) : 0 };
+      }
+    }
+
+  private:
+    static std::mutex& registry_lock()
+    {
+      static std::mutex lock;
+      return lock;
+    }
+    static std::map<std::string, counter>& registry()
+    {
+      static std::map<std::string, counter> r;
+      return r;
+    }
+  };
+
+  // accounts bytes for the lifetime of the object, copies of it account nothing
+  class memory_accounting_scope
+  {
+  public:
+    memory_accounting_scope()
+      : m_pcounter(nullptr), m_bytes(0)
+    {}
+    memory_accounting_scope(const memory_accounting_scope&)
+      : m_pcounter(nullptr), m_bytes(0)
+    {}
+    memory_accounting_scope& operator=(const memory_accounting_scope&)
+    {
+      return *this;
+    }
+    ~memory_accounting_scope()
+    {
+      reset();
+    }
+
+    void set(memory_accounting::counter& c, int64_t bytes)
+    {
+      reset();
+      m_pcounter = &c;
+      m_bytes = bytes;
+      c.add(bytes, 1);
+    }
+
+    void reset()
+    {
+      if (!m_pcounter)
+        return;
+      m_pcounter->add(-m_bytes, -1);
+      m_pcounter = nullptr;
+      m_bytes = 0;
+    }
+
+  private:
+    memory_accounting::counter* m_pcounter;
+    int64_t m_bytes;
+  };
+}
@@ -42,6 +42,12 @@
 #include <mach/mach.h>
 #endif
 
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #pragma once 
 namespace epee
 {
@@ -100,6 +106,19 @@ namespace misc_utils
 	}
 
 
+	inline bool set_current_thread_low_priority()
+	{
+#if defined(WIN32)
+		return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST) != 0;
+#elif defined(__linux__)
+		// nice value is per thread on linux
+		return setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19) == 0;
+#else
+		return false;
+#endif
+	}
+
+
 	inline std::string get_thread_string_id()
 	{
 #if defined(_MSC_VER)
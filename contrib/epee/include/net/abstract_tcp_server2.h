@@ -31,6 +31,7 @@
 #include <boost/asio.hpp>
 #include <string>
 #include <vector>
+#include <deque>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <atomic>
@@ -43,12 +44,16 @@
 #include <boost/interprocess/detail/atomic.hpp>
 #include <boost/thread/thread.hpp>
 #include "net_utils_base.h"
+#include "send_rate_limiter.h"
 #include "syncobj.h"
+#include "memory_accounting.h"
 
 #undef LOG_DEFAULT_CHANNEL
 #define LOG_DEFAULT_CHANNEL "net_server"
 
 #define ABSTRACT_SERVER_SEND_QUE_MAX_COUNT 1000
+#define ABSTRACT_SERVER_SEND_GATHER_MAX_COUNT 64          // queued buffers written with one async_write
+#define ABSTRACT_SERVER_SEND_GATHER_MAX_SIZE  (256 * 1024) // frames are not added to a write bigger than that, so the next write may take more urgent ones
 
 namespace epee {
 namespace net_utils {
@@ -75,7 +80,8 @@ class connection
   typedef typename t_protocol_handler::connection_context t_connection_context;
   /// Construct a connection with the given io_service.
   explicit connection(boost::asio::io_service& io_service,
-                      typename t_protocol_handler::config_type& config, volatile uint32_t& sock_count, i_connection_filter*& pfilter);
+                      typename t_protocol_handler::config_type& config, volatile uint32_t& sock_count, i_connection_filter*& pfilter, send_shaping& shaping,
+                      const std::atomic<uint64_t>& idle_timeout_ms);
 
   virtual ~connection();
   /// Get the socket associated with the connection.
@@ -99,6 +105,8 @@ class connection
   private:
   //----------------- i_service_endpoint ---------------------
   virtual bool do_send(const void* ptr, size_t cb);
+  virtual bool do_send_buffer(const shared_buffer& buff);
+  virtual bool do_send_frame(const std::vector<shared_buffer>& parts, send_priority priority);
   virtual bool close();
   virtual bool call_run_once_service_io();
   virtual bool request_callback();
@@ -108,6 +116,13 @@ class connection
   //------------------------------------------------------
   boost::shared_ptr<connection<t_protocol_handler>> safe_shared_from_this();
   bool shutdown();
+  /// Write the most urgent queued frames in one operation (or wait for the upload limits), m_send_que_lock should be held.
+  void start_write();
+  void handle_send_timer(const boost::system::error_code& e);
+  size_t get_send_que_size() const { return m_send_que_count + m_frames_in_flight.size(); }
+  /// (Re)start the countdown to closing the connection that receives nothing, does nothing if the server has no idle timeout.
+  void start_idle_timer();
+  void handle_idle_timer(const boost::system::error_code& e);
   /// Handle completion of a read operation.
   void handle_read(const boost::system::error_code& e,
                    std::size_t bytes_transferred);
@@ -129,7 +144,17 @@ class connection
   volatile uint32_t m_want_close_connection;
   std::atomic<bool> m_was_shutdown;
   critical_section m_send_que_lock;
-  std::list<std::string> m_send_que;
+  std::deque<std::vector<shared_buffer>> m_send_ques[send_priority_count];
+  size_t m_send_que_count;                                // frames in m_send_ques
+  std::vector<std::vector<shared_buffer>> m_frames_in_flight; // being written now
+  uint64_t m_send_que_bytes;                              // of the frames in m_send_ques and m_frames_in_flight, accounted as "net_send_queues"
+  uint64_t m_frames_in_flight_bytes;
+  send_shaping& m_send_shaping;
+  send_rate_limiter m_send_limiter;
+  boost::asio::deadline_timer m_send_timer;
+  bool m_send_timer_armed;
+  const std::atomic<uint64_t>& m_idle_timeout_ms;
+  boost::asio::deadline_timer m_idle_timer;
   volatile uint32_t& m_ref_sockets_count;
   i_connection_filter*& m_pfilter;
   volatile bool m_is_multithreaded;
@@ -184,6 +209,17 @@ class boosted_tcp_server
 
   void set_connection_filter(i_connection_filter* pfilter);
 
+  /// Upload limits in bytes per second, 0 means unlimited.
+  void set_send_rate_limits(uint64_t global_rate, uint64_t peer_rate);
+
+  /// Connections that receive nothing for that long (and have nothing left to send) are closed, 0 (default) means never.
+  void set_connection_idle_timeout(uint64_t timeout_ms);
+
+  /// Spreads connections over that many io_services, each run by its own thread, so the handlers of a connection
+  /// don't wait for the ones of others. The acceptor, idle handlers and async_call() stay on the main io_service.
+  /// 0 (default) keeps everything on the main io_service. Should be called before init_server().
+  void set_io_shards_count(size_t count);
+
   bool connect(const std::string& adr, const std::string& port, uint32_t conn_timeot, t_connection_context& cn, const std::string& bind_ip = "0.0.0.0");
   template<class t_callback>
   bool connect_async(const std::string& adr, const std::string& port, uint32_t conn_timeot, const t_callback& cb, const std::string& bind_ip = "0.0.0.0");
@@ -282,7 +318,9 @@ class boosted_tcp_server
 
   private:
   /// Run the server's io_service loop.
-  bool worker_thread();
+  bool worker_thread(boost::asio::io_service* pio_service);
+  /// io_service of the shard the next connection is pinned to
+  boost::asio::io_service& get_connection_io_service();
   /// Handle completion of an asynchronous accept operation.
   void handle_accept(const boost::system::error_code& e);
 
@@ -291,6 +329,9 @@ class boosted_tcp_server
   /// The io_service used to perform asynchronous operations.
   std::unique_ptr<boost::asio::io_service> m_io_service_local_instance;
   boost::asio::io_service& io_service_;
+  /// io_services the connections are spread over, they outlive the connections, new_connection_ included
+  std::vector<std::unique_ptr<boost::asio::io_service>> m_io_shards;
+  std::vector<std::unique_ptr<boost::asio::io_service::work>> m_io_shards_work; // keep the shards running while they have no connections
 
   /// Acceptor used to listen for incoming connections.
   boost::asio::ip::tcp::acceptor acceptor_;
@@ -306,6 +347,9 @@ class boosted_tcp_server
   std::string m_thread_name_prefix;
   size_t m_threads_count;
   i_connection_filter* m_pfilter;
+  send_shaping m_send_shaping;
+  std::atomic<uint64_t> m_idle_timeout_ms{ 0 };
+  std::atomic<size_t> m_next_io_shard;
   std::vector<boost::shared_ptr<boost::thread>> m_threads;
   boost::thread::id m_main_thread_id;
   critical_section m_threads_lock;
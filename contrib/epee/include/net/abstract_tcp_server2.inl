@@ -42,17 +42,33 @@ namespace net_utils {
 /************************************************************************/
 /*                                                                      */
 /************************************************************************/
+// buffers shared by several connections (broadcasts) are counted once per connection
+inline memory_accounting::counter& get_send_queues_memory_counter()
+{
+  static memory_accounting::counter& c = memory_accounting::get("net_send_queues");
+  return c;
+}
+
 DISABLE_VS_WARNINGS(4355)
 
 template<class t_protocol_handler>
 connection<t_protocol_handler>::connection(boost::asio::io_service& io_service,
-                                           typename t_protocol_handler::config_type& config, volatile uint32_t& sock_count, i_connection_filter*& pfilter)
+                                           typename t_protocol_handler::config_type& config, volatile uint32_t& sock_count, i_connection_filter*& pfilter, send_shaping& shaping,
+                                           const std::atomic<uint64_t>& idle_timeout_ms)
     : m_rio_service(io_service),
       strand_(io_service),
       socket_(io_service),
       m_protocol_handler(this, config, context),
       m_want_close_connection(0),
       m_was_shutdown(0),
+      m_send_que_count(0),
+      m_send_que_bytes(0),
+      m_frames_in_flight_bytes(0),
+      m_send_shaping(shaping),
+      m_send_timer(io_service),
+      m_send_timer_armed(false),
+      m_idle_timeout_ms(idle_timeout_ms),
+      m_idle_timer(io_service),
       m_ref_sockets_count(sock_count),
       m_pfilter(pfilter),
       m_is_multithreaded(false)
@@ -73,6 +89,7 @@ connection<t_protocol_handler>::~connection()
 
   LOG_PRINT_L3("[sock " << socket_.native_handle() << "] Socket destroyed");
   boost::interprocess::ipcdetail::atomic_dec32(&m_ref_sockets_count);
+  get_send_queues_memory_counter().add(-static_cast<int64_t>(m_send_que_bytes), -static_cast<int64_t>(get_send_que_size()));
   VALIDATE_MUTEX_IS_FREE(m_send_que_lock);
   VALIDATE_MUTEX_IS_FREE(m_self_refs_lock);
 
@@ -136,6 +153,7 @@ bool connection<t_protocol_handler>::start(bool is_income, bool is_multithreaded
 
   m_protocol_handler.after_init_connection();
 
+  start_idle_timer();
   socket_.async_read_some(boost::asio::buffer(buffer_),
                           strand_.wrap(
                               boost::bind(&connection<t_protocol_handler>::handle_read, self,
@@ -222,6 +240,7 @@ void connection<t_protocol_handler>::handle_read(const boost::system::error_code
     LOG_PRINT("[sock " << socket_.native_handle() << "] RECV " << bytes_transferred, LOG_LEVEL_4);
     context.m_last_recv = time(NULL);
     context.m_recv_cnt += bytes_transferred;
+    start_idle_timer();
     bool recv_res = m_protocol_handler.handle_recv(buffer_.data(), bytes_transferred);
     if(!recv_res) {
       LOG_PRINT("[sock " << socket_.native_handle() << "] protocol_want_close", LOG_LEVEL_4);
@@ -230,7 +249,7 @@ void connection<t_protocol_handler>::handle_read(const boost::system::error_code
       boost::interprocess::ipcdetail::atomic_write32(&m_want_close_connection, 1);
       bool do_shutdown = false;
       CRITICAL_REGION_BEGIN(m_send_que_lock);
-      if(!m_send_que.size())
+      if(!get_send_que_size())
         do_shutdown = true;
       CRITICAL_REGION_END();
       if(do_shutdown)
@@ -287,6 +306,20 @@ bool connection<t_protocol_handler>::call_run_once_service_io()
 //---------------------------------------------------------------------------------
 template<class t_protocol_handler>
 bool connection<t_protocol_handler>::do_send(const void* ptr, size_t cb)
+{
+  TRY_ENTRY();
+  return do_send_buffer(std::make_shared<const std::string>((const char*)ptr, cb));
+  CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
+}
+//---------------------------------------------------------------------------------
+template<class t_protocol_handler>
+bool connection<t_protocol_handler>::do_send_buffer(const shared_buffer& buff)
+{
+  return do_send_frame(std::vector<shared_buffer>(1, buff), send_priority_normal);
+}
+//---------------------------------------------------------------------------------
+template<class t_protocol_handler>
+bool connection<t_protocol_handler>::do_send_frame(const std::vector<shared_buffer>& parts, send_priority priority)
 {
   TRY_ENTRY();
   // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
@@ -295,15 +328,20 @@ bool connection<t_protocol_handler>::do_send(const void* ptr, size_t cb)
     return false;
   if(m_was_shutdown)
     return false;
+  if(priority < send_priority_high || priority >= send_priority_count)
+    priority = send_priority_normal;
 
-  LOG_PRINT("[sock " << socket_.native_handle() << "] SEND " << cb, LOG_LEVEL_4);
+  size_t cb = 0;
+  for(const auto& p : parts)
+    cb += p->size();
+  LOG_PRINT("[sock " << socket_.native_handle() << "] SEND " << cb << ", priority " << priority, LOG_LEVEL_4);
   context.m_last_send = time(NULL);
   context.m_send_cnt += cb;
   //some data should be wrote to stream
   //request complete
 
   CRITICAL_REGION_LOCAL_VAR(m_send_que_lock, send_guard);
-  if(m_send_que.size() > ABSTRACT_SERVER_SEND_QUE_MAX_COUNT) {
+  if(get_send_que_size() > ABSTRACT_SERVER_SEND_QUE_MAX_COUNT) {
     send_guard.unlock();  //manual unlock
     LOG_ERROR("send to [" << print_connection_context_short(context) << ", (" << (void*)this << ")] que size is more than ABSTRACT_SERVER_SEND_QUE_MAX_COUNT(" << ABSTRACT_SERVER_SEND_QUE_MAX_COUNT << "), shutting down connection");
     close();
@@ -311,31 +349,130 @@ bool connection<t_protocol_handler>::do_send(const void* ptr, size_t cb)
     return false;
   }
 
-  m_send_que.resize(m_send_que.size() + 1);
-  m_send_que.back().assign((const char*)ptr, cb);
+  m_send_ques[priority].push_back(parts);
+  ++m_send_que_count;
+  m_send_que_bytes += cb;
+  get_send_queues_memory_counter().add(cb, 1);
 
-  if(m_send_que.size() > 1) {
+  if(m_frames_in_flight.size() || m_send_timer_armed) {
     //active operation should be in progress, nothing to do, just wait last operation callback
+    //(a high priority frame waiting for the upload limits' timer goes with the next write anyway)
+    if(priority == send_priority_high && m_frames_in_flight.empty()) {
+      m_send_timer.cancel();  // handle_send_timer starts the write
+    }
   }
   else {
     //no active operation
-    if(m_send_que.size() != 1) {
-      LOG_ERROR("Looks like no active operations, but send que size != 1!!");
-      return false;
-    }
+    start_write();
+  }
 
-    boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front().data(), m_send_que.front().size()),
-                             //strand_.wrap(
-                             boost::bind(&connection<t_protocol_handler>::handle_write, self, boost::placeholders::_1, boost::placeholders::_2)
-                             //)
-    );
+  return true;
 
-    LOG_PRINT_L4("[sock " << socket_.native_handle() << "] Assync send requested " << m_send_que.front().size());
+  CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send_frame", false);
+}
+//---------------------------------------------------------------------------------
+template<class t_protocol_handler>
+void connection<t_protocol_handler>::start_write()
+{
+  if(m_frames_in_flight.size() || !m_send_que_count || m_was_shutdown)
+    return;
+
+  // frames of high priority go regardless of the upload limits, the rest wait for both limiters
+  uint64_t now_ms = misc_utils::get_tick_count();
+  m_send_limiter.set_rate(m_send_shaping.peer_rate);
+  uint64_t wait_ms = std::max(m_send_limiter.get_wait_time(now_ms), m_send_shaping.global_limiter.get_wait_time(now_ms));
+
+  size_t total_size = 0, buffers_count = 0;
+  for(size_t p = send_priority_high; p != send_priority_count && (p == send_priority_high || !wait_ms); ++p) {
+    auto& que = m_send_ques[p];
+    while(que.size() && buffers_count < ABSTRACT_SERVER_SEND_GATHER_MAX_COUNT && total_size < ABSTRACT_SERVER_SEND_GATHER_MAX_SIZE) {
+      for(const auto& part : que.front())
+        total_size += part->size();
+      buffers_count += que.front().size();
+      m_frames_in_flight.push_back(std::move(que.front()));
+      que.pop_front();
+      --m_send_que_count;
+    }
   }
 
-  return true;
+  if(m_frames_in_flight.empty()) {
+    // nothing may go now
+    m_send_timer_armed = true;
+    m_send_timer.expires_from_now(boost::posix_time::milliseconds(wait_ms));
+    m_send_timer.async_wait(boost::bind(&connection<t_protocol_handler>::handle_send_timer, connection<t_protocol_handler>::shared_from_this(), boost::placeholders::_1));
+    LOG_PRINT_L4("[sock " << socket_.native_handle() << "] Send delayed by upload limits for " << wait_ms << " ms");
+    return;
+  }
+  m_frames_in_flight_bytes = total_size;
+  m_send_limiter.consume(total_size, now_ms);
+  m_send_shaping.global_limiter.consume(total_size, now_ms);
 
-  CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
+  // the frames stay in m_frames_in_flight until handle_write, so the asio buffers refer to live data
+  std::vector<boost::asio::const_buffer> buffers;
+  buffers.reserve(buffers_count);
+  for(const auto& frame : m_frames_in_flight)
+    for(const auto& part : frame)
+      buffers.push_back(boost::asio::buffer(part->data(), part->size()));
+
+  boost::asio::async_write(socket_, buffers,
+                           //strand_.wrap(
+                           boost::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), boost::placeholders::_1, boost::placeholders::_2)
+                           //)
+  );
+
+  LOG_PRINT_L4("[sock " << socket_.native_handle() << "] Assync send requested " << total_size << " in " << buffers.size() << " buffers");
+}
+//---------------------------------------------------------------------------------
+template<class t_protocol_handler>
+void connection<t_protocol_handler>::handle_send_timer(const boost::system::error_code& e)
+{
+  TRY_ENTRY();
+  CRITICAL_REGION_LOCAL(m_send_que_lock);
+  m_send_timer_armed = false;
+  // cancelled by a high priority frame, or time to go
+  start_write();
+  CATCH_ENTRY_L0("connection<t_protocol_handler>::handle_send_timer", void());
+}
+//---------------------------------------------------------------------------------
+template<class t_protocol_handler>
+void connection<t_protocol_handler>::start_idle_timer()
+{
+  uint64_t timeout_ms = m_idle_timeout_ms;
+  if(!timeout_ms || m_was_shutdown)
+    return;
+  // the timer doesn't keep the connection alive, it goes as soon as the rest of its handlers are done
+  boost::weak_ptr<connection<t_protocol_handler>> weak_self = safe_shared_from_this();
+  boost::system::error_code ignored_ec;
+  m_idle_timer.expires_from_now(boost::posix_time::milliseconds(timeout_ms), ignored_ec);
+  m_idle_timer.async_wait(strand_.wrap([weak_self](const boost::system::error_code& e) {
+    auto self = weak_self.lock();
+    if(self)
+      self->handle_idle_timer(e);
+  }));
+}
+//---------------------------------------------------------------------------------
+template<class t_protocol_handler>
+void connection<t_protocol_handler>::handle_idle_timer(const boost::system::error_code& e)
+{
+  TRY_ENTRY();
+  // on the strand, so a request being handled is not cut
+  if(e == boost::asio::error::operation_aborted || m_was_shutdown)
+    return;
+  if(m_idle_timer.expires_at() > boost::asio::deadline_timer::traits_type::now())
+    return; // restarted after this wait was completed
+
+  bool is_sending = false;
+  CRITICAL_REGION_BEGIN(m_send_que_lock);
+  is_sending = get_send_que_size() != 0;
+  CRITICAL_REGION_END();
+  if(is_sending) {
+    // a slow reader of a big response is not idle
+    start_idle_timer();
+    return;
+  }
+  LOG_PRINT_L3("[sock " << socket_.native_handle() << "] nothing received for " << m_idle_timeout_ms << " ms, closing connection");
+  close();
+  CATCH_ENTRY_L0("connection<t_protocol_handler>::handle_idle_timer", void());
 }
 //---------------------------------------------------------------------------------
 template<class t_protocol_handler>
@@ -345,6 +482,8 @@ bool connection<t_protocol_handler>::shutdown()
     return true;
   // Initiate graceful connection closure.
   boost::system::error_code ignored_ec;
+  m_send_timer.cancel(ignored_ec);
+  m_idle_timer.cancel(ignored_ec);
   socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
   m_was_shutdown = true;
   m_protocol_handler.release_protocol();
@@ -358,7 +497,7 @@ bool connection<t_protocol_handler>::close()
   LOG_PRINT_L4("[sock " << socket_.native_handle() << "] Que Shutdown called.");
   size_t send_que_size = 0;
   CRITICAL_REGION_BEGIN(m_send_que_lock);
-  send_que_size = m_send_que.size();
+  send_que_size = get_send_que_size();
   CRITICAL_REGION_END();
   boost::interprocess::ipcdetail::atomic_write32(&m_want_close_connection, 1);
   if(!send_que_size) {
@@ -389,23 +528,23 @@ void connection<t_protocol_handler>::handle_write(const boost::system::error_cod
 
   bool do_shutdown = false;
   CRITICAL_REGION_BEGIN(m_send_que_lock);
-  if(m_send_que.empty()) {
-    LOG_ERROR("[sock " << socket_.native_handle() << "] m_send_que.size() == 0 at handle_write!");
+  if(m_frames_in_flight.empty()) {
+    LOG_ERROR("[sock " << socket_.native_handle() << "] no frames in flight at handle_write!");
     return;
   }
 
-  m_send_que.pop_front();
-  if(m_send_que.empty()) {
+  get_send_queues_memory_counter().add(-static_cast<int64_t>(m_frames_in_flight_bytes), -static_cast<int64_t>(m_frames_in_flight.size()));
+  m_send_que_bytes -= m_frames_in_flight_bytes;
+  m_frames_in_flight_bytes = 0;
+  m_frames_in_flight.clear();
+  if(!m_send_que_count) {
     if(boost::interprocess::ipcdetail::atomic_read32(&m_want_close_connection)) {
       do_shutdown = true;
     }
   }
   else {
     //have more data to send
-    boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front().data(), m_send_que.front().size()),
-                             //strand_.wrap(
-                             boost::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), boost::placeholders::_1, boost::placeholders::_2));
-    //);
+    start_write();
   }
   CRITICAL_REGION_END();
 
@@ -422,8 +561,8 @@ boosted_tcp_server<t_protocol_handler>::boosted_tcp_server()
     : m_io_service_local_instance(new boost::asio::io_service()),
       io_service_(*m_io_service_local_instance.get()),
       acceptor_(io_service_),
-      new_connection_(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter)),
-      m_stop_signal_sent(false), m_port(0), m_sockets_count(0), m_threads_count(0), m_pfilter(NULL), m_thread_index(0)
+      new_connection_(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter, m_send_shaping, m_idle_timeout_ms)),
+      m_stop_signal_sent(false), m_port(0), m_sockets_count(0), m_threads_count(0), m_pfilter(NULL), m_next_io_shard(0), m_thread_index(0)
 {
   m_thread_name_prefix = "NET";
 }
@@ -432,8 +571,8 @@ template<class t_protocol_handler>
 boosted_tcp_server<t_protocol_handler>::boosted_tcp_server(boost::asio::io_service& extarnal_io_service)
     : io_service_(extarnal_io_service),
       acceptor_(io_service_),
-      new_connection_(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter)),
-      m_stop_signal_sent(false), m_port(0), m_sockets_count(0), m_threads_count(0), m_pfilter(NULL), m_thread_index(0)
+      new_connection_(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter, m_send_shaping, m_idle_timeout_ms)),
+      m_stop_signal_sent(false), m_port(0), m_sockets_count(0), m_threads_count(0), m_pfilter(NULL), m_next_io_shard(0), m_thread_index(0)
 {
   m_thread_name_prefix = "NET";
 }
@@ -466,6 +605,8 @@ bool boosted_tcp_server<t_protocol_handler>::init_server(uint32_t port, const st
   acceptor_.listen();
   boost::asio::ip::tcp::endpoint binded_endpoint = acceptor_.local_endpoint();
   m_port                                         = binded_endpoint.port();
+  if(m_io_shards.size())
+    new_connection_.reset(new connection<t_protocol_handler>(get_connection_io_service(), m_config, m_sockets_count, m_pfilter, m_send_shaping, m_idle_timeout_ms));
   acceptor_.async_accept(new_connection_->socket(),
                          boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
                                      boost::asio::placeholders::error));
@@ -490,7 +631,7 @@ bool boosted_tcp_server<t_protocol_handler>::init_server(const std::string port,
 POP_GCC_WARNINGS
 //---------------------------------------------------------------------------------
 template<class t_protocol_handler>
-bool boosted_tcp_server<t_protocol_handler>::worker_thread()
+bool boosted_tcp_server<t_protocol_handler>::worker_thread(boost::asio::io_service* pio_service)
 {
   TRY_ENTRY();
   uint32_t local_thr_index = boost::interprocess::ipcdetail::atomic_inc32(&m_thread_index);
@@ -499,7 +640,7 @@ bool boosted_tcp_server<t_protocol_handler>::worker_thread()
   log_space::log_singletone::set_thread_log_prefix(thread_name);
   while(!m_stop_signal_sent) {
     try {
-      io_service_.run();
+      pio_service->run();
     }
     catch(const std::exception& ex) {
       LOG_ERROR("Exception at server worker thread, what=" << ex.what());
@@ -526,6 +667,37 @@ void boosted_tcp_server<t_protocol_handler>::set_connection_filter(i_connection_
 }
 //---------------------------------------------------------------------------------
 template<class t_protocol_handler>
+void boosted_tcp_server<t_protocol_handler>::set_send_rate_limits(uint64_t global_rate, uint64_t peer_rate)
+{
+  m_send_shaping.global_limiter.set_rate(global_rate);
+  m_send_shaping.peer_rate = peer_rate;
+}
+//---------------------------------------------------------------------------------
+template<class t_protocol_handler>
+void boosted_tcp_server<t_protocol_handler>::set_connection_idle_timeout(uint64_t timeout_ms)
+{
+  m_idle_timeout_ms = timeout_ms;
+}
+//---------------------------------------------------------------------------------
+template<class t_protocol_handler>
+void boosted_tcp_server<t_protocol_handler>::set_io_shards_count(size_t count)
+{
+  CHECK_AND_ASSERT_MES_NO_RET(m_threads.empty() && m_io_shards.empty(), "io shards should be set up once, before the server runs");
+  for(size_t i = 0; i != count; ++i) {
+    m_io_shards.emplace_back(new boost::asio::io_service(1)); // one thread per shard, so no locking inside
+    m_io_shards_work.emplace_back(new boost::asio::io_service::work(*m_io_shards.back()));
+  }
+}
+//---------------------------------------------------------------------------------
+template<class t_protocol_handler>
+boost::asio::io_service& boosted_tcp_server<t_protocol_handler>::get_connection_io_service()
+{
+  if(m_io_shards.empty())
+    return io_service_;
+  return *m_io_shards[m_next_io_shard++ % m_io_shards.size()];
+}
+//---------------------------------------------------------------------------------
+template<class t_protocol_handler>
 bool boosted_tcp_server<t_protocol_handler>::run_server(size_t threads_count, bool wait)
 {
   TRY_ENTRY();
@@ -537,7 +709,12 @@ bool boosted_tcp_server<t_protocol_handler>::run_server(size_t threads_count, bo
     CRITICAL_REGION_BEGIN(m_threads_lock);
     for(std::size_t i = 0; i < threads_count; ++i) {
       boost::shared_ptr<boost::thread> thread(new boost::thread(
-          boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this)));
+          boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this, &io_service_)));
+      m_threads.push_back(thread);
+    }
+    for(auto& shard : m_io_shards) {
+      boost::shared_ptr<boost::thread> thread(new boost::thread(
+          boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this, shard.get())));
       m_threads.push_back(thread);
     }
     CRITICAL_REGION_END();
@@ -613,6 +790,8 @@ void boosted_tcp_server<t_protocol_handler>::send_stop_signal()
   m_config.on_send_stop_signal();
 
   io_service_.stop();
+  for(auto& shard : m_io_shards)
+    shard->stop();
   CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::send_stop_signal()", void());
 }
 //---------------------------------------------------------------------------------
@@ -629,7 +808,7 @@ void boosted_tcp_server<t_protocol_handler>::handle_accept(const boost::system::
   if(!e) {
     connection_ptr conn(std::move(new_connection_));
 
-    new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter));
+    new_connection_.reset(new connection<t_protocol_handler>(get_connection_io_service(), m_config, m_sockets_count, m_pfilter, m_send_shaping, m_idle_timeout_ms));
     acceptor_.async_accept(new_connection_->socket(),
                            boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
                                        boost::asio::placeholders::error));
@@ -647,7 +826,7 @@ bool boosted_tcp_server<t_protocol_handler>::connect(const std::string& adr, con
 {
   TRY_ENTRY();
 
-  connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter));
+  connection_ptr new_connection_l(new connection<t_protocol_handler>(get_connection_io_service(), m_config, m_sockets_count, m_pfilter, m_send_shaping, m_idle_timeout_ms));
   boost::asio::ip::tcp::socket& sock_ = new_connection_l->socket();
 
   //////////////////////////////////////////////////////////////////////////
@@ -724,7 +903,7 @@ bool boosted_tcp_server<t_protocol_handler>::connect(const std::string& adr, con
   bool r = new_connection_l->start(false, 1 < m_threads_count);
   if(r) {
     new_connection_l->get_context(conn_context);
-    //new_connection_l.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter));
+    //new_connection_l.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter, m_send_shaping, m_idle_timeout_ms));
   }
 
   return r;
@@ -737,7 +916,8 @@ template<class t_callback>
 bool boosted_tcp_server<t_protocol_handler>::connect_async(const std::string& adr, const std::string& port, uint32_t conn_timeout, const t_callback& cb, const std::string& bind_ip)
 {
   TRY_ENTRY();
-  connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter));
+  boost::asio::io_service& connection_io_service = get_connection_io_service();
+  connection_ptr new_connection_l(new connection<t_protocol_handler>(connection_io_service, m_config, m_sockets_count, m_pfilter, m_send_shaping, m_idle_timeout_ms));
   boost::asio::ip::tcp::socket& sock_ = new_connection_l->socket();
 
   //////////////////////////////////////////////////////////////////////////
@@ -758,7 +938,7 @@ bool boosted_tcp_server<t_protocol_handler>::connect_async(const std::string& ad
     sock_.bind(local_endpoint);
   }
 
-  boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(io_service_));
+  boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(connection_io_service)); // on the thread of the connection's handlers
   //start deadline
   sh_deadline->expires_from_now(boost::posix_time::milliseconds(conn_timeout));
   sh_deadline->async_wait([=](const boost::system::error_code& error) {
@@ -32,6 +32,9 @@
 #include <boost/regex.hpp>
 
 #include "string_tools.h"
+
+#define HTTP_MAX_UNPACKED_BODY_LEN		       (100 * 1024 * 1024) // a gzip/deflate packed body, request or response, mustn't unpack to more than that
+
 namespace epee
 {
 namespace net_utils
@@ -174,6 +177,7 @@ namespace net_utils
 			http_header_info    m_header_info;
 			int                 m_http_ver_hi;// OUT paramter only
 			int                 m_http_ver_lo;// OUT paramter only
+			std::string         m_call_name; // uri or json rpc method that made it, picks the compression settings
 
 			void clear()
 			{
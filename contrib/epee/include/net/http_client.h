@@ -41,6 +41,7 @@
 //#ifdef HTTP_ENABLE_GZIP
 #include "gzip_encoding.h"
 //#endif 
+#include "zlib_helper.h"
 
 #include "string_tools.h"
 #include "reg_exp_definer.h"
@@ -240,6 +241,9 @@ namespace epee
         reciev_machine_state m_state;
         chunked_state m_chunked_state;
         std::string m_chunked_cache;
+        bool m_response_started = false; // something of the response to the last sent request came
+        bool m_accept_compressed_responses = false;
+        uint64_t m_request_compression_threshold = 0;
         critical_section m_lock;
 
       protected:
@@ -271,6 +275,15 @@ namespace epee
           return true;
         }
 
+        // asks for gzip/deflate packed responses; request bodies of at least request_threshold bytes are gzipped (0 - never),
+        // that's only for the servers known to unpack them, as the epee-based ones do
+        void set_compression(bool accept_compressed_responses, uint64_t request_threshold)
+        {
+          CRITICAL_REGION_LOCAL(m_lock);
+          m_accept_compressed_responses = accept_compressed_responses;
+          m_request_compression_threshold = request_threshold;
+        }
+
         bool connect(const std::string& host, std::string port)
         {
           CRITICAL_REGION_LOCAL(m_lock);
@@ -317,7 +330,8 @@ namespace epee
         inline bool invoke(const std::string& uri, const std::string& method, const std::string& body, const http_response_info** ppresponse_info = NULL, const fields_list& additional_params = fields_list())
         {
           CRITICAL_REGION_LOCAL(m_lock);
-          if (!is_connected())
+          bool is_reused_connection = is_connected();
+          if (!is_reused_connection)
           {
             LOG_PRINT("Reconnecting...", LOG_LEVEL_3);
             if (!connect(m_host_buff, m_port))
@@ -326,10 +340,18 @@ namespace epee
               return false;
             }
           }
-          m_response_info.clear();
+          std::string packed_body;
+          bool is_body_packed = m_request_compression_threshold && body.size() >= m_request_compression_threshold
+            && zlib_helper::pack_http(body, packed_body, Z_DEFAULT_COMPRESSION, true) && packed_body.size() < body.size();
+          const std::string& body_to_send = is_body_packed ? packed_body : body;
+
           std::string req_buff = method + " ";
           req_buff += uri + " HTTP/1.1\r\n" +
-            "Host: " + m_host_buff + "\r\n" + "Content-Length: " + boost::lexical_cast<std::string>(body.size()) + "\r\n";
+            "Host: " + m_host_buff + "\r\n" + "Content-Length: " + boost::lexical_cast<std::string>(body_to_send.size()) + "\r\n";
+          if (is_body_packed)
+            req_buff += "Content-Encoding: gzip\r\n";
+          if (m_accept_compressed_responses)
+            req_buff += "Accept-Encoding: gzip, deflate\r\n";
 
 
           //handle "additional_params"
@@ -338,17 +360,27 @@ namespace epee
           req_buff += "\r\n";
           //--
 
-          bool res = m_net_client.send(req_buff);
-          CHECK_AND_ASSERT_MES(res, false, "HTTP_CLIENT: Failed to SEND");
-          if (body.size())
-            res = m_net_client.send(body);
-          CHECK_AND_ASSERT_MES(res, false, "HTTP_CLIENT: Failed to SEND");
-
           if (ppresponse_info)
             *ppresponse_info = &m_response_info;
 
-          m_state = reciev_machine_state_header;
-          return handle_reciev();
+          if (send_request_and_receive(req_buff, body_to_send))
+            return true;
+          disconnect(); // whatever is left of the failed exchange must not be taken for the next response
+          if (!is_reused_connection || m_response_started)
+            return false;
+
+          // the server closes the kept-alive connections it finds idle, such a request fails before anything of the response comes,
+          // so it wasn't handled and goes once more over a new connection
+          LOG_PRINT_L2("HTTP_CLIENT: kept-alive connection to " << m_host_buff << ":" << m_port << " is lost, sending the request over a new one");
+          if (!connect(m_host_buff, m_port))
+          {
+            LOG_PRINT("Failed to connect to " << m_host_buff << ":" << m_port, LOG_LEVEL_3);
+            return false;
+          }
+          if (send_request_and_receive(req_buff, body_to_send))
+            return true;
+          disconnect();
+          return false;
         }
         //---------------------------------------------------------------------------
         inline bool invoke_post(const std::string& uri, const std::string& body, const http_response_info** ppresponse_info = NULL, const fields_list& additional_params = fields_list())
@@ -357,6 +389,23 @@ namespace epee
           return invoke(uri, "POST", body, ppresponse_info, additional_params);
         }
       private:
+        //---------------------------------------------------------------------------
+        inline bool send_request_and_receive(const std::string& req_buff, const std::string& body)
+        {
+          m_response_info.clear();
+          m_response_started = false;
+          bool res = m_net_client.send(req_buff);
+          if (res && body.size())
+            res = m_net_client.send(body);
+          if (!res)
+          {
+            LOG_PRINT_L1("HTTP_CLIENT: Failed to SEND");
+            return false;
+          }
+
+          m_state = reciev_machine_state_header;
+          return handle_reciev();
+        }
         //---------------------------------------------------------------------------
         inline bool handle_reciev()
         {
@@ -373,6 +422,8 @@ namespace epee
                 LOG_PRINT("Unexpected reciec fail", LOG_LEVEL_3);
                 m_state = reciev_machine_state_error;
               }
+              if (recv_buffer.size())
+                m_response_started = true;
               if (!recv_buffer.size())
               {
                 //connection is going to be closed
@@ -492,8 +543,12 @@ namespace epee
             return true;
           }
           need_more_data = true;
-          m_pcontent_encoding_handler->update_in(recv_buff);
-
+          if (!m_pcontent_encoding_handler->update_in(recv_buff))
+          {
+            m_state = reciev_machine_state_error;
+            disconnect();
+            return false;
+          }
 
           return true;
         }
@@ -647,7 +702,12 @@ namespace epee
                 m_len_in_remain = 0;
               }
 
-              m_pcontent_encoding_handler->update_in(chunk_body);
+              if (!m_pcontent_encoding_handler->update_in(chunk_body))
+              {
+                m_state = reciev_machine_state_error;
+                disconnect();
+                return false;
+              }
 
               if (!m_len_in_remain)
                 m_chunked_state = http_chunked_state_chunk_head;
@@ -757,13 +817,7 @@ namespace epee
           boost::smatch result;						//   12      3
           if (boost::regex_search(m_response_info.m_header_info.m_content_encoding, result, rexp_match_gzip, boost::match_default) && result[0].matched)
           {
-#ifdef HTTP_ENABLE_GZIP
-            m_pcontent_encoding_handler.reset(new content_encoding_gzip(this, result[3].matched));
-#else
-            m_pcontent_encoding_handler.reset(new do_nothing_sub_handler(this));
-            LOG_ERROR("GZIP encoding not supported in this build, please add zlib to your project and define HTTP_ENABLE_GZIP");
-            return false;
-#endif
+            m_pcontent_encoding_handler.reset(new content_encoding_gzip(this, result[3].matched, Z_DEFAULT_COMPRESSION, HTTP_MAX_UNPACKED_BODY_LEN));
           }
           else
           {
@@ -31,6 +31,8 @@
 #define _HTTP_SERVER_H_
 
 #include <string>
+#include <atomic>
+#include <map>
 #include "net_utils_base.h"
 #include "to_nonconst_iterator.h"
 #include "http_base.h"
@@ -51,6 +53,21 @@ namespace net_utils
       void on_send_stop_signal(){}
 			std::string m_folder;
 			critical_section m_lock;
+			uint64_t m_idle_timeout_ms = 0; // reported to keep-alive clients, the server closes idle connections itself
+			// responses at least m_compression_threshold bytes long are packed for the clients sending "Accept-Encoding: gzip" (or deflate),
+			// 0 turns it off; m_compression_per_call overrides both values for particular uris / json rpc methods (level 0 - never packed)
+			struct compression_settings
+			{
+				uint64_t threshold;
+				int level;
+			};
+			uint64_t m_compression_threshold = 0;
+			int m_compression_level = 6;
+			std::map<std::string, compression_settings> m_compression_per_call;
+			// connections reuse stats
+			std::atomic<uint64_t> m_connections_count{ 0 };
+			std::atomic<uint64_t> m_requests_count{ 0 };
+			std::atomic<uint64_t> m_reused_connection_requests_count{ 0 }; // not the first ones of their connections
 		};
 
 		/************************************************************************/
@@ -82,6 +99,7 @@ namespace net_utils
 			}
 			bool after_init_connection()
 			{
+				++m_config.m_connections_count;
 				return true;
 			}
 			virtual bool handle_recv(const void* ptr, size_t cb);
@@ -123,9 +141,11 @@ namespace net_utils
 			bool slash_to_back_slash(std::string& str);
 			std::string get_file_mime_tipe(const std::string& path);
 			std::string get_response_header(const http_response_info& response);
+			bool unpack_request_body(http::http_request_info& query_info, http_response_info& response);
+			void pack_response_body(const http::http_request_info& query_info, http_response_info& response);
 
 			//major function 
-			inline bool handle_request_and_send_response(const http::http_request_info& query_info);
+			inline bool handle_request_and_send_response(http::http_request_info& query_info);
 
 
 			std::string get_not_found_response_body(const std::string& URI);
@@ -140,6 +160,7 @@ namespace net_utils
       size_t m_precommand_line_chars;
 			config_type& m_config;
 			bool m_want_close;
+			uint64_t m_connection_requests_count;
 		protected:
 			i_service_endpoint* m_psnd_hndlr; 
 		};
@@ -197,7 +218,7 @@ namespace net_utils
       {}
 			bool after_init_connection()
 			{
-				return true;
+				return simple_http_connection_handler<t_connection_context>::after_init_connection();
 			}
 
 		private:
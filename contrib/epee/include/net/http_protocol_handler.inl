@@ -27,15 +27,18 @@
 
 #include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
 #include "http_protocol_handler.h"
 #include "reg_exp_definer.h"
 #include "string_tools.h"
 #include "file_io_utils.h"
 #include "net_parse_helpers.h"
+#include "zlib_helper.h"
 
 #define HTTP_MAX_URI_LEN	              	 9000 
 #define HTTP_MAX_PRE_COMMAND_LINE_CHARS		 20 
 #define HTTP_MAX_HEADER_LEN		             100000
+#define HTTP_MAX_PIPELINED_REQUESTS		     100 // handled of one received buffer, a client that sends more is dropped
 
 PUSH_GCC_WARNINGS
 DISABLE_GCC_WARNING(maybe-uninitialized)
@@ -205,6 +208,7 @@ namespace net_utils
 		m_len_remain(0),
 		m_config(config), 
 		m_want_close(false),
+		m_connection_requests_count(0),
     m_psnd_hndlr(psnd_hndlr), 
     m_precommand_line_chars(0)
 	{
@@ -245,6 +249,8 @@ namespace net_utils
 		else
 			m_cache.swap(buf);
 
+		//pipelined requests are handled one after another, but their count is bounded, so that a client doesn't hold the thread
+		uint64_t requests_count_before = m_connection_requests_count;
 		m_is_stop_handling = false;
 		while(!m_is_stop_handling)
 		{
@@ -304,7 +310,9 @@ namespace net_utils
 					break;
 				}
 			case http_state_retriving_body:
-				return handle_retriving_query_body();
+				if(!handle_retriving_query_body())
+					return false;
+				break;
 			case http_state_connection_close:
 				return false;
 			default:
@@ -315,7 +323,14 @@ namespace net_utils
 				return false;
 			}
 
-			if(!m_cache.size())
+			if(m_connection_requests_count - requests_count_before > HTTP_MAX_PIPELINED_REQUESTS)
+			{
+				LOG_ERROR("simple_http_connection_handler::handle_buff_in: Too many pipelined requests");
+				m_state = http_state_error;
+				return false;
+			}
+			//nothing goes after a response that closes the connection
+			if(!m_cache.size() || m_want_close)
 				m_is_stop_handling = true;
 		}
 
@@ -353,7 +368,7 @@ namespace net_utils
 		boost::smatch result;	
 		if(boost::regex_search(m_cache, result, rexp_match_command_line, boost::match_default) && result[0].matched)
 		{
-			analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_hi);
+			analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_lo);
 			m_query_info.m_URI = result[10];
       parse_uri(m_query_info.m_URI, m_query_info.m_uri_content);
 			m_query_info.m_http_method_str = result[2];
@@ -379,6 +394,11 @@ namespace net_utils
 	{
 
     //Here we returning head size, including terminating sequence (\r\n\r\n or \n\n)
+    //a request without header fields has only the empty line, and the next pipelined one may follow it
+		if(!buf.compare(0, 2, "\r\n"))
+			return 2;
+		if(!buf.compare(0, 1, "\n"))
+			return 1;
 		std::string::size_type res = buf.find("\r\n\r\n");
 		if(std::string::npos != res)
 			return res+4;
@@ -549,11 +569,21 @@ namespace net_utils
 	}
 	//-----------------------------------------------------------------------------------
   template<class t_connection_context>
-	bool simple_http_connection_handler<t_connection_context>::handle_request_and_send_response(const http::http_request_info& query_info)
+	bool simple_http_connection_handler<t_connection_context>::handle_request_and_send_response(http::http_request_info& query_info)
 	{
+		++m_connection_requests_count;
+		++m_config.m_requests_count;
+		if(m_connection_requests_count > 1)
+			++m_config.m_reused_connection_requests_count;
+
 		http_response_info response;
-		bool res = handle_request(query_info, response);
-		//CHECK_AND_ASSERT_MES(res, res, "handle_request(query_info, response) returned false" );
+		bool res = true;
+		if(unpack_request_body(query_info, response))
+		{
+			res = handle_request(query_info, response);
+			//CHECK_AND_ASSERT_MES(res, res, "handle_request(query_info, response) returned false" );
+			pack_response_body(query_info, response);
+		}
 
 		std::string response_data = get_response_header(response);
 		
@@ -566,6 +596,88 @@ namespace net_utils
 		return res;
 	}
 	//-----------------------------------------------------------------------------------
+	// tells if a coding is listed in Accept-Encoding without "q=0"
+	inline bool is_encoding_accepted(const std::string& accept_encoding, const char* coding)
+	{
+		std::vector<std::string> items;
+		boost::split(items, accept_encoding, boost::is_any_of(","));
+		for(const std::string& item : items)
+		{
+			std::string::size_type params_pos = item.find(';');
+			std::string name = item.substr(0, params_pos);
+			string_tools::trim(name);
+			if(string_tools::compare_no_case(name, coding) && name != "*")
+				continue;
+			if(params_pos == std::string::npos)
+				return true;
+			std::string::size_type q_pos = item.find("q=", params_pos);
+			return q_pos == std::string::npos || atof(item.c_str() + q_pos + 2) > 0;
+		}
+		return false;
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::unpack_request_body(http::http_request_info& query_info, http_response_info& response)
+	{
+		std::string encoding = query_info.m_header_info.m_content_encoding;
+		string_tools::trim(encoding);
+		if(encoding.empty() || !string_tools::compare_no_case(encoding, "identity"))
+			return true;
+
+		if(string_tools::compare_no_case(encoding, "gzip") && string_tools::compare_no_case(encoding, "deflate"))
+		{
+			response.m_response_code = 415;
+			response.m_response_comment = "Unsupported Media Type";
+			return false;
+		}
+		std::string unpacked;
+		if(!zlib_helper::unpack_http_bounded(query_info.m_body, unpacked, HTTP_MAX_UNPACKED_BODY_LEN))
+		{
+			LOG_PRINT_L1("Failed to unpack " << encoding << " request body of " << query_info.m_body.size() << " bytes, URI " << query_info.m_URI);
+			response.m_response_code = 400;
+			response.m_response_comment = "Bad Request";
+			return false;
+		}
+		query_info.m_body.swap(unpacked);
+		query_info.m_header_info.m_content_encoding.clear();
+		return true;
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	void simple_http_connection_handler<t_connection_context>::pack_response_body(const http::http_request_info& query_info, http_response_info& response)
+	{
+		uint64_t threshold = m_config.m_compression_threshold;
+		int level = m_config.m_compression_level;
+		auto it = m_config.m_compression_per_call.find(response.m_call_name);
+		if(it != m_config.m_compression_per_call.end())
+		{
+			threshold = it->second.threshold;
+			level = it->second.level;
+		}
+		if(!threshold || !level || response.m_body.size() < threshold)
+			return;
+		for(const auto& f : response.m_additional_fields)
+			if(!string_tools::compare_no_case(f.first, "Content-Encoding"))
+				return; // encoded by the handler
+
+		const std::string* paccept_encoding = nullptr;
+		for(const auto& f : query_info.m_header_info.m_etc_fields)
+			if(!string_tools::compare_no_case(f.first, "Accept-Encoding"))
+				paccept_encoding = &f.second;
+		if(!paccept_encoding)
+			return;
+		bool gzip = is_encoding_accepted(*paccept_encoding, "gzip");
+		if(!gzip && !is_encoding_accepted(*paccept_encoding, "deflate"))
+			return;
+
+		std::string packed;
+		if(!zlib_helper::pack_http(response.m_body, packed, level, gzip) || packed.size() >= response.m_body.size())
+			return;
+		response.m_body.swap(packed);
+		response.m_additional_fields.push_back(std::make_pair(std::string("Content-Encoding"), std::string(gzip ? " gzip" : " deflate")));
+		response.m_additional_fields.push_back(std::make_pair(std::string("Vary"), std::string(" Accept-Encoding")));
+	}
+	//-----------------------------------------------------------------------------------
   template<class t_connection_context>
 	bool simple_http_connection_handler<t_connection_context>::handle_request(const http::http_request_info& query_info, http_response_info& response)
 	{
@@ -616,15 +728,23 @@ namespace net_utils
 		//Wed, 01 Dec 2010 03:27:41 GMT"
 
 		string_tools::trim(m_query_info.m_header_info.m_connection);
-		if(m_query_info.m_header_info.m_connection.size())
+		//HTTP/1.1 keeps the connection unless asked to close it, HTTP/1.0 closes it unless asked to keep it
+		bool is_http_1_1 = m_query_info.m_http_ver_hi > 1 || (m_query_info.m_http_ver_hi == 1 && m_query_info.m_http_ver_lo >= 1);
+		bool keep_alive = is_http_1_1 ? string_tools::compare_no_case("close", m_query_info.m_header_info.m_connection)
+			: !string_tools::compare_no_case("keep-alive", m_query_info.m_header_info.m_connection);
+		if(!keep_alive)
 		{
-			if(!string_tools::compare_no_case("close", m_query_info.m_header_info.m_connection))
-			{
-        //closing connection after sending
-				buf += "Connection: close\r\n";
-				m_state = http_state_connection_close;
-				m_want_close = true;
-			}
+      //closing connection after sending
+			buf += "Connection: close\r\n";
+			m_state = http_state_connection_close;
+			m_want_close = true;
+		}
+		else
+		{
+			if(!is_http_1_1)
+				buf += "Connection: keep-alive\r\n";
+			if(m_config.m_idle_timeout_ms)
+				buf += "Keep-Alive: timeout=" + boost::lexical_cast<std::string>(m_config.m_idle_timeout_ms / 1000) + "\r\n";
 		}
 		//add additional fields, if it is
 		for(fields_list::const_iterator it = response.m_additional_fields.begin(); it!=response.m_additional_fields.end(); it++)
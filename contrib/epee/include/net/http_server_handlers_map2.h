@@ -26,11 +26,20 @@
 
 
 #pragma once 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <vector>
 #include "serialization/keyvalue_serialization.h"
 #include "storages/portable_storage_template_helper.h"
 #include "http_base.h"
 #include "net/net_utils_base.h"
 #include "storages/portable_storage_extended_for_doc.h"
+#include "trace_tools.h"
 
 
 
@@ -120,6 +129,344 @@ namespace epee
     };
 
     typedef response<dummy_result, error> error_response;
+
+    // JSON-RPC 2.0 batch: an array of requests in one http request, answered with an array of responses
+    struct batch_config
+    {
+      size_t max_batch_size = 1000;
+      size_t max_parallel = 0;                                 // jobs helping the request thread with a batch, 0 means sequential
+      std::set<std::string> parallel_methods;                 // only batches made of these (read-only) methods go in parallel
+      std::function<void(const std::function<void()>&)> post;  // runs a job on one of the server threads
+    };
+
+    // for the handlers that have no batch_config of their own (see http_server_impl_base)
+    inline const batch_config& get_batch_config(const void* /*phandler*/)
+    {
+      static const batch_config default_config;
+      return default_config;
+    }
+
+    inline bool is_batch_request(const std::string& body)
+    {
+      for (char c : body)
+      {
+        if (c == '[')
+          return true;
+        if (!isspace(static_cast<unsigned char>(c)))
+          return false;
+      }
+      return false;
+    }
+
+    // splits the top level array into its elements, they are left unparsed
+    inline bool split_batch_request(const std::string& body, std::vector<std::string>& items)
+    {
+      items.clear();
+      size_t depth = 0;
+      bool in_string = false, escape = false, closed = false;
+      size_t item_begin = 0;
+      auto push_item = [&](size_t item_end, bool last)
+      {
+        while (item_begin < item_end && isspace(static_cast<unsigned char>(body[item_begin])))
+          ++item_begin;
+        while (item_end > item_begin && isspace(static_cast<unsigned char>(body[item_end - 1])))
+          --item_end;
+        if (last && item_begin == item_end && items.empty())
+          return; // []
+        items.push_back(body.substr(item_begin, item_end - item_begin));
+      };
+
+      for (size_t i = 0; i != body.size(); ++i)
+      {
+        char c = body[i];
+        if (in_string)
+        {
+          if (escape)
+            escape = false;
+          else if (c == '\\')
+            escape = true;
+          else if (c == '"')
+            in_string = false;
+          continue;
+        }
+        if (!depth && c != '[')
+        {
+          if (!isspace(static_cast<unsigned char>(c)))
+            return false;
+          continue;
+        }
+        if (closed)
+          return false;
+        switch (c)
+        {
+        case '"':
+          in_string = true;
+          break;
+        case '[':
+        case '{':
+          if (!depth++)
+            item_begin = i + 1;
+          break;
+        case ']':
+        case '}':
+          if (!--depth)
+          {
+            if (c != ']')
+              return false;
+            push_item(i, true);
+            closed = true;
+          }
+          break;
+        case ',':
+          if (depth == 1)
+          {
+            push_item(i, false);
+            item_begin = i + 1;
+          }
+          break;
+        }
+      }
+      return closed;
+    }
+
+    inline std::string make_error_response_body(const epee::serialization::storage_entry& id, int64_t code, const std::string& message)
+    {
+      error_response rsp = AUTO_VAL_INIT(rsp);
+      rsp.jsonrpc = "2.0";
+      rsp.id = id;
+      rsp.error.code = code;
+      rsp.error.message = message;
+      std::string body;
+      epee::serialization::store_t_to_json_stream(rsp, body);
+      return body;
+    }
+
+    // the same bytes store_t_to_json_stream() gives for a response<> with this id and a result serialized with indent 1
+    inline void make_response_body(const epee::serialization::storage_entry& id, const std::string& result_json, std::string& body)
+    {
+      std::stringstream id_ss;
+      epee::serialization::recursive_visitor<epee::serialization::strategy_json>::dump_as_(id_ss, id, 1);
+      const std::string id_json = id_ss.str();
+      const char* eol = epee::serialization::strategy_json::eol;
+      body.clear();
+      body.reserve(result_json.size() + id_json.size() + 64);
+      body += '{';
+      body += eol;
+      body += "  \"jsonrpc\": \"2.0\",";
+      body += eol;
+      body += "  \"id\": ";
+      body += id_json;
+      body += ',';
+      body += eol;
+      body += "  \"result\": ";
+      body += result_json;
+      body += eol;
+      body += '}';
+    }
+
+    inline bool get_request_id_and_method(const std::string& body, epee::serialization::storage_entry& id, std::string& method)
+    {
+      id = epee::serialization::storage_entry(std::string());
+      epee::serialization::portable_storage ps;
+      if (!ps.load_from_json(body))
+        return false;
+      ps.get_value("id", id, nullptr);
+      return ps.get_value("method", method, nullptr);
+    }
+
+    // one element of a batch goes through the map as a request of its own, whatever happens to it gets into its own response
+    template<class t_item_handler>
+    std::string handle_batch_item(t_item_handler& item_handler, const epee::net_utils::http::http_request_info& batch_query_info, const std::string& item)
+    {
+      epee::serialization::storage_entry id = epee::serialization::storage_entry(std::string());
+      std::string method;
+      if (item.empty() || item[0] != '{')
+        return make_error_response_body(id, -32600, "Invalid Request");
+
+      epee::net_utils::http::http_request_info item_query_info;
+      item_query_info.m_http_method = batch_query_info.m_http_method;
+      item_query_info.m_URI = batch_query_info.m_URI;
+      item_query_info.m_http_method_str = batch_query_info.m_http_method_str;
+      item_query_info.m_http_ver_hi = batch_query_info.m_http_ver_hi;
+      item_query_info.m_http_ver_lo = batch_query_info.m_http_ver_lo;
+      item_query_info.m_header_info = batch_query_info.m_header_info;
+      item_query_info.m_uri_content = batch_query_info.m_uri_content;
+      item_query_info.m_body = item;
+      epee::net_utils::http::http_response_info item_response_info;
+      bool call_found = false;
+      bool res = false;
+      try
+      {
+        res = item_handler(item_query_info, item_response_info, call_found);
+      }
+      catch (const std::exception& e)
+      {
+        LOG_ERROR("exception while handling batch item of " << batch_query_info.m_URI << ": " << e.what());
+      }
+      catch (...)
+      {
+        LOG_ERROR("unknown exception while handling batch item of " << batch_query_info.m_URI);
+      }
+      if (res && item_response_info.m_body.size())
+        return std::move(item_response_info.m_body);
+
+      get_request_id_and_method(item, id, method);
+      return make_error_response_body(id, call_found ? -32603 : -32601, call_found ? "Internal error" : "Method not found");
+    }
+
+    // item_handler(query_info, response_info, call_found) handles a single request, as handle_http_request_map() does
+    template<class t_item_handler>
+    bool handle_batch_request(t_item_handler item_handler, const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info,
+      const batch_config& config)
+    {
+      uint64_t ticks = epee::misc_utils::get_tick_count();
+      response_info.m_mime_tipe = "application/json";
+      response_info.m_header_info.m_content_type = " application/json";
+      std::vector<std::string> items;
+      if (!split_batch_request(query_info.m_body, items))
+      {
+        response_info.m_body = make_error_response_body(epee::serialization::storage_entry(std::string()), -32700, "Parse error");
+        return true;
+      }
+      if (items.empty() || items.size() > config.max_batch_size)
+      {
+        response_info.m_body = make_error_response_body(epee::serialization::storage_entry(std::string()), -32600, "Invalid Request");
+        return true;
+      }
+
+      bool parallel = config.max_parallel && config.post && items.size() > 1;
+      for (size_t i = 0; parallel && i != items.size(); ++i)
+      {
+        epee::serialization::storage_entry id;
+        std::string method;
+        parallel = get_request_id_and_method(items[i], id, method) && config.parallel_methods.count(method);
+      }
+
+      std::vector<std::string> results(items.size());
+      if (!parallel)
+      {
+        for (size_t i = 0; i != items.size(); ++i)
+          results[i] = handle_batch_item(item_handler, query_info, items[i]);
+      }
+      else
+      {
+        // the request thread takes items as well, helpers that start after all of them are taken do nothing
+        // and don't touch the locals that may be gone by then
+        struct batch_state
+        {
+          std::atomic<size_t> next{ 0 };
+          size_t done = 0;
+          std::mutex lock;
+          std::condition_variable done_cv;
+        };
+        std::shared_ptr<batch_state> pstate = std::make_shared<batch_state>();
+        const size_t count = items.size();
+        std::function<void()> worker = [pstate, count, &item_handler, &query_info, &items, &results]()
+        {
+          for (size_t i = pstate->next++; i < count; i = pstate->next++)
+          {
+            results[i] = handle_batch_item(item_handler, query_info, items[i]);
+            std::lock_guard<std::mutex> lk(pstate->lock);
+            if (++pstate->done == count)
+              pstate->done_cv.notify_all();
+          }
+        };
+        for (size_t i = 0; i != std::min(config.max_parallel, count - 1); ++i)
+          config.post(worker);
+        worker();
+        std::unique_lock<std::mutex> lk(pstate->lock);
+        pstate->done_cv.wait(lk, [&]() { return pstate->done == count; });
+      }
+
+      size_t body_size = 2;
+      for (const auto& r : results)
+        body_size += r.size() + 1;
+      response_info.m_body.clear();
+      response_info.m_body.reserve(body_size);
+      response_info.m_body += '[';
+      for (size_t i = 0; i != results.size(); ++i)
+      {
+        if (i)
+          response_info.m_body += ',';
+        response_info.m_body += results[i];
+      }
+      response_info.m_body += ']';
+      LOG_PRINT(query_info.m_URI << "[batch of " << items.size() << (parallel ? ", parallel" : "") << "] processed with " << epee::misc_utils::get_tick_count() - ticks << "ms", LOG_LEVEL_2);
+      return true;
+    }
+  }
+
+  namespace net_utils
+  {
+    namespace http
+    {
+      // admission control of the calls by uri or json rpc method name: enter() is called before the call is handled
+      // (and may wait there for a while), leave() after the admitted one is done
+      struct i_call_admission
+      {
+        enum result { admitted = 0, busy, rate_limited };
+
+        virtual result enter(const std::string& call_name, const connection_context_base& context) = 0;
+        virtual void leave(const std::string& call_name) = 0;
+        virtual ~i_call_admission() {}
+      };
+
+      // for the handlers that have no admission control (see http_server_impl_base)
+      inline i_call_admission* get_call_admission(const void* /*phandler*/)
+      {
+        return nullptr;
+      }
+
+      class call_admission_guard
+      {
+      public:
+        call_admission_guard(i_call_admission* padmission, const std::string& call_name, const connection_context_base& context)
+          : m_padmission(padmission)
+          , m_call_name(call_name)
+          , m_result(padmission ? padmission->enter(call_name, context) : i_call_admission::admitted)
+        {}
+
+        ~call_admission_guard()
+        {
+          if (m_padmission && m_result == i_call_admission::admitted)
+            m_padmission->leave(m_call_name);
+        }
+
+        bool is_admitted() const { return m_result == i_call_admission::admitted; }
+        i_call_admission::result get_result() const { return m_result; }
+
+      private:
+        call_admission_guard(const call_admission_guard&) = delete;
+        call_admission_guard& operator=(const call_admission_guard&) = delete;
+
+        i_call_admission* m_padmission;
+        std::string m_call_name;
+        i_call_admission::result m_result;
+      };
+
+      // both are worth retrying a bit later
+      inline void set_call_rejected_response(i_call_admission::result r, http_response_info& response_info)
+      {
+        if (r == i_call_admission::rate_limited)
+        {
+          response_info.m_response_code = 429;
+          response_info.m_response_comment = "Too Many Requests";
+        }
+        else
+        {
+          response_info.m_response_code = 503;
+          response_info.m_response_comment = "Service Unavailable";
+        }
+        response_info.m_additional_fields.push_back(std::make_pair(std::string("Retry-After"), std::string(" 1")));
+      }
+
+      inline std::string make_call_rejected_json_rpc_body(i_call_admission::result r, const epee::serialization::storage_entry& id)
+      {
+        if (r == i_call_admission::rate_limited)
+          return json_rpc::make_error_response_body(id, -32002, "Too many requests, retry later");
+        return json_rpc::make_error_response_body(id, -32001, "Server is busy, retry later");
+      }
+    }
   }
 }
 
@@ -329,7 +676,15 @@ namespace epee {
     else if(auto_doc<command_type, false>(s_pattern, "", true, docs) && query_info.m_URI == s_pattern) \
     { \
       call_found = true; \
-      uint64_t ticks = misc_utils::get_tick_count(); \
+      response_info.m_call_name = s_pattern; \
+      epee::net_utils::http::call_admission_guard admission_guard(epee::net_utils::http::get_call_admission(this), s_pattern, m_conn_context); \
+      if(!admission_guard.is_admitted()) \
+      { \
+        epee::net_utils::http::set_call_rejected_response(admission_guard.get_result(), response_info); \
+        return true; \
+      } \
+      TRACE_SCOPE("rpc", s_pattern); \
+      uint64_t ticks = epee::misc_utils::get_tick_count(); \
       boost::value_initialized<command_type::request> req; \
       bool res = epee::serialization::load_t_from_json(static_cast<command_type::request&>(req), query_info.m_body); \
       CHECK_AND_ASSERT_MES(res, false, "Failed to parse json: \r\n" << query_info.m_body); \
@@ -338,7 +693,7 @@ namespace epee {
       res = callback_f(static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp), m_conn_context); \
       CHECK_AND_ASSERT_MES(res, false, "Failed to call " << #callback_f << "() while handling " << s_pattern); \
       uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
-      epee::serialization::store_t_to_json(static_cast<command_type::response&>(resp), response_info.m_body); \
+      epee::serialization::store_t_to_json_stream(static_cast<command_type::response&>(resp), response_info.m_body); \
       uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
       response_info.m_mime_tipe = "application/json"; \
       response_info.m_header_info.m_content_type = " application/json"; \
@@ -349,15 +704,23 @@ namespace epee {
     else if(auto_doc<command_type, false>(s_pattern, "", false, docs) && query_info.m_URI == s_pattern) \
     { \
       call_found = true; \
-      uint64_t ticks = misc_utils::get_tick_count(); \
+      response_info.m_call_name = s_pattern; \
+      epee::net_utils::http::call_admission_guard admission_guard(epee::net_utils::http::get_call_admission(this), s_pattern, m_conn_context); \
+      if(!admission_guard.is_admitted()) \
+      { \
+        epee::net_utils::http::set_call_rejected_response(admission_guard.get_result(), response_info); \
+        return true; \
+      } \
+      TRACE_SCOPE("rpc", s_pattern); \
+      uint64_t ticks = epee::misc_utils::get_tick_count(); \
       boost::value_initialized<command_type::request> req; \
       bool res = epee::serialization::load_t_from_binary(static_cast<command_type::request&>(req), query_info.m_body); \
       CHECK_AND_ASSERT_MES(res, false, "Failed to parse bin body data, body size=" << query_info.m_body.size()); \
-      uint64_t ticks1 = misc_utils::get_tick_count(); \
+      uint64_t ticks1 = epee::misc_utils::get_tick_count(); \
       boost::value_initialized<command_type::response> resp;\
       res = callback_f(static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp), m_conn_context); \
       CHECK_AND_ASSERT_MES(res, false, "Failed to call " << #callback_f << "() while handling " << s_pattern); \
-      uint64_t ticks2 = misc_utils::get_tick_count(); \
+      uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
       epee::serialization::store_t_to_binary(static_cast<command_type::response&>(resp), response_info.m_body); \
       uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
       response_info.m_mime_tipe = " application/octet-stream"; \
@@ -365,6 +728,27 @@ namespace epee {
       LOG_PRINT( "[HTTP/BIN][" << epee::string_tools::get_ip_string_from_int32(m_conn_context.m_remote_ip ) << "][" << query_info.m_URI << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms", LOG_LEVEL_2); \
     }
 
+// for plain text responses (like metrics): bool callback_f(const http_request_info& query_info, std::string& body, t_context& context)
+#define MAP_URI_TEXT2(s_pattern, callback_f, content_type) \
+    else if(query_info.m_URI == s_pattern) \
+    { \
+      call_found = true; \
+      response_info.m_call_name = s_pattern; \
+      epee::net_utils::http::call_admission_guard admission_guard(epee::net_utils::http::get_call_admission(this), s_pattern, m_conn_context); \
+      if(!admission_guard.is_admitted()) \
+      { \
+        epee::net_utils::http::set_call_rejected_response(admission_guard.get_result(), response_info); \
+        return true; \
+      } \
+      TRACE_SCOPE("rpc", s_pattern); \
+      uint64_t ticks = epee::misc_utils::get_tick_count(); \
+      bool res = callback_f(query_info, response_info.m_body, m_conn_context); \
+      CHECK_AND_ASSERT_MES(res, false, "Failed to call " << #callback_f << "() while handling " << s_pattern); \
+      response_info.m_mime_tipe = content_type; \
+      response_info.m_header_info.m_content_type = " " content_type; \
+      LOG_PRINT("[HTTP/TEXT][" << epee::string_tools::get_ip_string_from_int32(m_conn_context.m_remote_ip ) << "][" << query_info.m_URI << "] processed with " << epee::misc_utils::get_tick_count() - ticks << "ms", LOG_LEVEL_2); \
+    }
+
 #define CHAIN_TO_PHANDLER(pi_chain_handler) else if (pi_chain_handler && pi_chain_handler->handle_http_request_map(query_info, response_info, m_conn_context, call_found, docs) && call_found) { return true;}
 
 #define CHAIN_URI_MAP2(callback) else {callback(query_info, response_info, m_conn_context);call_found = true;}
@@ -388,6 +772,13 @@ namespace epee {
     { \
     const char* current_zone_json_uri = uri;\
     LOG_PRINT_L4("[JSON_REQUEST_BODY]: " << ENDL << query_info.m_body); \
+    if(!docs.do_generate_documentation && epee::json_rpc::is_batch_request(query_info.m_body)) \
+    { \
+      call_found = true; \
+      return epee::json_rpc::handle_batch_request([&](const epee::net_utils::http::http_request_info& item_query_info, epee::net_utils::http::http_response_info& item_response_info, bool& item_call_found) \
+        { return this->handle_http_request_map(item_query_info, item_response_info, m_conn_context, item_call_found); }, \
+        query_info, response_info, epee::json_rpc::get_batch_config(this)); \
+    } \
     uint64_t ticks = epee::misc_utils::get_tick_count(); \
     epee::serialization::portable_storage ps; \
     if(!ps.load_from_json(query_info.m_body)) \
@@ -395,7 +786,7 @@ namespace epee {
        boost::value_initialized<epee::json_rpc::error_response> rsp; \
        static_cast<epee::json_rpc::error_response&>(rsp).error.code = -32700; \
        static_cast<epee::json_rpc::error_response&>(rsp).error.message = "Parse error"; \
-       epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(rsp), response_info.m_body); \
+       epee::serialization::store_t_to_json_stream(static_cast<epee::json_rpc::error_response&>(rsp), response_info.m_body); \
        return true; \
     } \
     epee::serialization::storage_entry id_; \
@@ -408,9 +799,18 @@ namespace epee {
       rsp.jsonrpc = "2.0"; \
       rsp.error.code = -32600; \
       rsp.error.message = "Invalid Request"; \
-      epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(rsp), response_info.m_body); \
+      epee::serialization::store_t_to_json_stream(static_cast<epee::json_rpc::error_response&>(rsp), response_info.m_body); \
       return true; \
     } \
+    response_info.m_call_name = callback_name; \
+    epee::net_utils::http::call_admission_guard admission_guard(docs.do_generate_documentation ? nullptr : epee::net_utils::http::get_call_admission(this), callback_name, m_conn_context); \
+    if(!admission_guard.is_admitted()) \
+    { \
+      call_found = true; \
+      response_info.m_body = epee::net_utils::http::make_call_rejected_json_rpc_body(admission_guard.get_result(), id_); \
+      return true; \
+    } \
+    TRACE_SCOPE("rpc", callback_name); \
     if(false) return true; //just a stub to have "else if"
 
 
@@ -427,7 +827,7 @@ namespace epee {
     fail_resp.id = req.id; \
     fail_resp.error.code = -32602; \
     fail_resp.error.message = "Invalid params"; \
-    epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+    epee::serialization::store_t_to_json_stream(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
     return true; \
   } \
   uint64_t ticks1 = epee::misc_utils::get_tick_count(); \
@@ -438,7 +838,7 @@ namespace epee {
 
 #define FINALIZE_OBJECTS_TO_JSON(method_name) \
   uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
-  epee::serialization::store_t_to_json(resp, response_info.m_body); \
+  epee::serialization::store_t_to_json_stream(resp, response_info.m_body); \
   uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
   response_info.m_mime_tipe = "application/json"; \
   response_info.m_header_info.m_content_type = " application/json"; \
@@ -455,7 +855,7 @@ namespace epee {
   fail_resp.id = req.id; \
   if(!callback_f(req.params, resp.result, fail_resp.error, m_conn_context)) \
   { \
-    epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+    epee::serialization::store_t_to_json_stream(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
     return true; \
   } \
   FINALIZE_OBJECTS_TO_JSON(method_name) \
@@ -473,7 +873,7 @@ namespace epee {
   fail_resp.id = req.id; \
   if(!callback_f(req.params, resp.result, fail_resp.error, m_conn_context, response_info)) \
   { \
-    epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+    epee::serialization::store_t_to_json_stream(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
     return true; \
   } \
   FINALIZE_OBJECTS_TO_JSON(method_name) \
@@ -493,7 +893,7 @@ namespace epee {
     fail_resp.id = req.id; \
     fail_resp.error.code = -32603; \
     fail_resp.error.message = "Internal error"; \
-    epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+    epee::serialization::store_t_to_json_stream(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
     return true; \
   } \
   FINALIZE_OBJECTS_TO_JSON(method_name) \
@@ -502,6 +902,78 @@ namespace epee {
 
 #define MAP_JON_RPC_N(callback_f, command_type) MAP_JON_RPC(command_type::methodname(), callback_f, command_type)
 
+// cached variants: cache_obj keeps serialized results by method and params,
+//   bool get(const std::string& key, std::string& result_json, uint64_t& generation)
+//   void put(const std::string& key, uint64_t generation, const result_t& result, const std::string& result_json)
+// the generation taken by get() goes back to put(), so results made for an older state are not kept
+#define PREPARE_CACHED_RESULT(method_name, cache_obj) \
+  std::string cache_key = method_name; \
+  { \
+    std::string params_json; \
+    epee::serialization::store_t_to_json_stream(req.params, params_json); \
+    cache_key += ':'; \
+    cache_key += params_json; \
+  } \
+  std::string result_json; \
+  uint64_t cache_generation = 0; \
+  bool cache_hit = cache_obj.get(cache_key, result_json, cache_generation);
+
+#define FINALIZE_CACHED_RESULT_TO_JSON(method_name, cache_obj) \
+  if(!cache_hit) \
+  { \
+    epee::serialization::store_t_to_json_stream(resp.result, result_json, 1); \
+    cache_obj.put(cache_key, cache_generation, resp.result, result_json); \
+  } \
+  uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
+  epee::json_rpc::make_response_body(resp.id, result_json, response_info.m_body); \
+  uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
+  response_info.m_mime_tipe = "application/json"; \
+  response_info.m_header_info.m_content_type = " application/json"; \
+  LOG_PRINT( query_info.m_URI << "[" << method_name << (cache_hit ? ", cached" : "") << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms", LOG_LEVEL_2);
+
+#define MAP_JON_RPC_WE_CACHED(method_name, callback_f, command_type, cache_obj) \
+    else if(auto_doc<command_type, true>(current_zone_json_uri, method_name, true, docs) && callback_name == method_name) \
+{ \
+  call_found = true; \
+  PREPARE_OBJECTS_FROM_JSON(command_type) \
+  PREPARE_CACHED_RESULT(method_name, cache_obj) \
+  if(!cache_hit) \
+  { \
+    epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
+    fail_resp.jsonrpc = "2.0"; \
+    fail_resp.method = req.method; \
+    fail_resp.id = req.id; \
+    if(!callback_f(req.params, resp.result, fail_resp.error, m_conn_context)) \
+    { \
+      epee::serialization::store_t_to_json_stream(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+      return true; \
+    } \
+  } \
+  FINALIZE_CACHED_RESULT_TO_JSON(method_name, cache_obj) \
+  return true;\
+}
+
+#define MAP_JON_RPC_CACHED(method_name, callback_f, command_type, cache_obj) \
+    else if(auto_doc<command_type, true>(current_zone_json_uri, method_name, true, docs) && callback_name == method_name) \
+{ \
+  call_found = true; \
+  PREPARE_OBJECTS_FROM_JSON(command_type) \
+  PREPARE_CACHED_RESULT(method_name, cache_obj) \
+  if(!cache_hit && !callback_f(req.params, resp.result, m_conn_context)) \
+  { \
+    epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
+    fail_resp.jsonrpc = "2.0"; \
+    fail_resp.method = req.method; \
+    fail_resp.id = req.id; \
+    fail_resp.error.code = -32603; \
+    fail_resp.error.message = "Internal error"; \
+    epee::serialization::store_t_to_json_stream(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+    return true; \
+  } \
+  FINALIZE_CACHED_RESULT_TO_JSON(method_name, cache_obj) \
+  return true;\
+}
+
 #define END_JSON_RPC_MAP() \
   epee::json_rpc::error_response rsp; \
   rsp.id = id_; \
@@ -509,7 +981,7 @@ namespace epee {
   rsp.method = callback_name; \
   rsp.error.code = -32601; \
   rsp.error.message = "Method not found"; \
-  epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(rsp), response_info.m_body); \
+  epee::serialization::store_t_to_json_stream(static_cast<epee::json_rpc::error_response&>(rsp), response_info.m_body); \
   LOG_PRINT_L4("[JSON_RESPONSE_BODY]: " << ENDL << query_info.m_body); \
   return true; \
   }
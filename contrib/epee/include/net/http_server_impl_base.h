@@ -61,6 +61,8 @@ namespace epee
       //here set folder for hosting reqests
       m_net_server.get_config_object().m_folder = "";
 
+      m_json_rpc_batch_config.post = [this](const std::function<void()>& job) { m_net_server.async_call(job); };
+
       LOG_PRINT_L0("Binding on " << bind_ip << ":" << bind_port);
       bool res = m_net_server.init_server(bind_port, bind_ip);
       if(!res)
@@ -106,7 +108,79 @@ namespace epee
       return m_net_server.get_binded_port();
     }
 
+    // keep-alive connections that send nothing for that long are closed, 0 means never
+    void set_idle_timeout(uint64_t timeout_ms)
+    {
+      m_net_server.get_config_object().m_idle_timeout_ms = timeout_ms;
+      m_net_server.set_connection_idle_timeout(timeout_ms);
+    }
+
+    // responses at least threshold bytes long are gzipped for the clients that accept it, 0 turns it off;
+    // levels_per_call sets zlib level (0 - never packed) for particular uris / json rpc methods, to be set up before run()
+    void set_response_compression(uint64_t threshold, int level, const std::map<std::string, int>& levels_per_call)
+    {
+      net_utils::http::http_server_config& config = m_net_server.get_config_object();
+      config.m_compression_threshold = threshold;
+      config.m_compression_level = level;
+      config.m_compression_per_call.clear();
+      for (const auto& l : levels_per_call)
+        config.m_compression_per_call[l.first] = net_utils::http::http_server_config::compression_settings{ threshold, l.second };
+    }
+
+    void get_connections_stat(uint64_t& connections_count, uint64_t& requests_count, uint64_t& reused_connection_requests_count)
+    {
+      const net_utils::http::http_server_config& config = m_net_server.get_config_object();
+      connections_count = config.m_connections_count;
+      requests_count = config.m_requests_count;
+      reused_connection_requests_count = config.m_reused_connection_requests_count;
+    }
+
+    // batches of json rpc requests, to be set up before run()
+    json_rpc::batch_config& get_json_rpc_batch_config()
+    {
+      return m_json_rpc_batch_config;
+    }
+
+    const json_rpc::batch_config& get_json_rpc_batch_config() const
+    {
+      return m_json_rpc_batch_config;
+    }
+
+    // admission control of the calls, to be set up before run(), nullptr turns it off
+    void set_call_admission(net_utils::http::i_call_admission* pcall_admission)
+    {
+      m_pcall_admission = pcall_admission;
+    }
+
+    net_utils::http::i_call_admission* get_call_admission() const
+    {
+      return m_pcall_admission;
+    }
+
   protected: 
     net_utils::boosted_tcp_server<net_utils::http::http_custom_handler<t_connection_context> > m_net_server;
+    json_rpc::batch_config m_json_rpc_batch_config;
+    net_utils::http::i_call_admission* m_pcall_admission = nullptr;
   };
+
+  namespace json_rpc
+  {
+    template<class t_child_class, class t_connection_context>
+    const batch_config& get_batch_config(const http_server_impl_base<t_child_class, t_connection_context>* phandler)
+    {
+      return phandler->get_json_rpc_batch_config();
+    }
+  }
+
+  namespace net_utils
+  {
+    namespace http
+    {
+      template<class t_child_class, class t_connection_context>
+      i_call_admission* get_call_admission(const http_server_impl_base<t_child_class, t_connection_context>* phandler)
+      {
+        return phandler->get_call_admission();
+      }
+    }
+  }
 }
\ No newline at end of file
@@ -72,6 +72,9 @@ namespace levin
 
 #define LEVIN_PACKET_REQUEST			0x00000001
 #define LEVIN_PACKET_RESPONSE		0x00000002
+#define LEVIN_PACKET_COMPRESSED		0x00000004  //body is a zlib stream, sent only to the peers that asked for it
+
+#define LEVIN_COMPRESSION_MIN_SIZE   4096  //smaller bodies are not worth packing
   
 
 #define LEVIN_PROTOCOL_VER_0         0
@@ -103,6 +106,7 @@ namespace levin
 #define LEVIN_ERROR_PROTOCOL_INCONSISTENT              -11
 #define LEVIN_ERROR_NET_ERROR                          -12
 #define LEVIN_ERROR_SIGNATURE_MISMATCH                 -13
+#define LEVIN_ERROR_INVOKE_CANCELLED                   -14
 
 #define DESCRIBE_RET_CODE(code) case code: return #code;
   inline
@@ -118,6 +122,7 @@ namespace levin
       DESCRIBE_RET_CODE(LEVIN_ERROR_CONNECTION_NO_DUPLEX_PROTOCOL);
       DESCRIBE_RET_CODE(LEVIN_ERROR_CONNECTION_HANDLER_NOT_DEFINED);
       DESCRIBE_RET_CODE(LEVIN_ERROR_FORMAT);
+      DESCRIBE_RET_CODE(LEVIN_ERROR_INVOKE_CANCELLED);
     default:
       return "unknown code";
     }
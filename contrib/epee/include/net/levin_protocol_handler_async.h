@@ -26,16 +26,20 @@
 // 
 
 #pragma once
+#include <algorithm>
 #include <atomic>
+#include <mutex>
 #include <unordered_map>
 
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/interprocess/detail/atomic.hpp>
 #include <boost/smart_ptr/make_shared.hpp>
+#include <boost/smart_ptr/enable_shared_from_this.hpp>
 
 #include "levin_base.h"
 #include "misc_language.h"
 #include "profile_tools.h"
+#include "zlib_helper.h"
 
 #undef LOG_DEFAULT_CHANNEL 
 #define LOG_DEFAULT_CHANNEL "levin_protocol"
@@ -59,6 +63,7 @@ class async_protocol_handler_config
   critical_section m_connects_lock;
   std::atomic<bool> m_is_in_sendstop_loop;
   connections_map m_connects;
+  std::unordered_map<int, net_utils::send_priority> m_notify_priorities;
 
   void add_connection(async_protocol_handler<t_connection_context>* pc);
   void del_connection(async_protocol_handler<t_connection_context>* pc);
@@ -73,21 +78,34 @@ public:
   levin_commands_handler<t_connection_context>* m_pcommands_handler;
   uint64_t m_max_packet_size; 
   uint64_t m_invoke_timeout;
+  uint64_t m_compression_threshold; // frames smaller than this go uncompressed
 
   void on_send_stop_signal();
   int invoke(int command, const std::string& in_buff, std::string& buff_out, boost::uuids::uuid connection_id);
+  // several invokes may be in flight on a connection, each with its own timeout; when it's shorter than
+  // m_invoke_timeout the callback is told about it but the connection is kept till m_invoke_timeout
   template<class callback_t>
-  int invoke_async(int command, const std::string& in_buff, boost::uuids::uuid connection_id, const callback_t& cb, size_t timeout = LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED);
+  int invoke_async(int command, const std::string& in_buff, boost::uuids::uuid connection_id, const callback_t& cb, size_t timeout = LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED, uint64_t* p_invoke_id = nullptr);
+  bool cancel_invoke(boost::uuids::uuid connection_id, uint64_t invoke_id);
 
   int notify(int command, const std::string& in_buff, boost::uuids::uuid connection_id);
+  int notify(int command, const net_utils::shared_buffer& in_buff, boost::uuids::uuid connection_id);
   bool close(boost::uuids::uuid connection_id);
   bool update_connection_context(const t_connection_context& contxt);
   bool request_callback(boost::uuids::uuid connection_id);
+  bool set_compression(boost::uuids::uuid connection_id, bool compress_outgoing);
+  // should be set up before the connections appear, the rest of notifications are of normal priority
+  void set_notify_priority(int command, net_utils::send_priority priority) { m_notify_priorities[command] = priority; }
+  net_utils::send_priority get_notify_priority(int command) const
+  {
+    auto it = m_notify_priorities.find(command);
+    return it == m_notify_priorities.end() ? net_utils::send_priority_normal : it->second;
+  }
   template<class callback_t>
   bool foreach_connection(callback_t cb);
   size_t get_connections_count();
 
-  async_protocol_handler_config() :m_pcommands_handler(NULL), m_max_packet_size(LEVIN_DEFAULT_MAX_PACKET_SIZE), m_is_in_sendstop_loop(false), m_invoke_timeout{}
+  async_protocol_handler_config() :m_pcommands_handler(NULL), m_max_packet_size(LEVIN_DEFAULT_MAX_PACKET_SIZE), m_is_in_sendstop_loop(false), m_invoke_timeout{}, m_compression_threshold(LEVIN_COMPRESSION_MIN_SIZE)
   {}
   ~async_protocol_handler_config()
   {
@@ -141,52 +159,99 @@ public:
 
   int32_t m_oponent_protocol_ver;
   bool m_connection_initialized;
+  std::atomic<bool> m_compress_outgoing; // set once the other side told it accepts compressed frames
 
+  // Levin frames carry no request id: the other side handles invokes one by one and its responses
+  // come in the order of invokes, so a response belongs to the oldest handler in the queue.
+  // An invoke may be answered to its callback earlier with a timeout or cancellation; its handler
+  // stays in the queue to take the late response, and only when there's no response till
+  // m_invoke_timeout the connection is closed.
   struct invoke_response_handler_base
   {
     virtual bool handle(int res, const std::string& buff, connection_context& context)=0;
     virtual bool is_timer_started() const=0;
     virtual void cancel()=0;
-    virtual bool cancel_timer()=0;
+    virtual bool abandon()=0;
+    virtual uint64_t get_id() const=0;
   };
   template <class callback_t>
-  struct invoke_handler: invoke_response_handler_base
+  struct invoke_handler: invoke_response_handler_base, boost::enable_shared_from_this<invoke_handler<callback_t>>
   {
-    invoke_handler(const callback_t& cb, uint64_t timeout,  async_protocol_handler& con, int command)
+    invoke_handler(const callback_t& cb, uint64_t id, async_protocol_handler& con, int command)
       :m_cb(cb), m_con(con), m_timer(con.m_pservice_endpoint->get_io_service()), m_timer_started(false),
-      m_cancel_timer_called(false), m_timer_cancelled(false), m_command(command)
-    {
-      if(m_con.start_outer_call())
-      {
-        m_timer.expires_from_now(boost::posix_time::milliseconds(timeout));
-        m_timer.async_wait([&con, command, cb](const boost::system::error_code& ec)
-        {
-          if(ec == boost::asio::error::operation_aborted)
-            return;
-          LOG_PRINT_CC(con.get_context_ref(), "Timeout on invoke operation happened, command: " << command, LOG_LEVEL_2);
-          std::string fake;
-          cb(LEVIN_ERROR_CONNECTION_TIMEDOUT, fake, con.get_context_ref());
-          con.close();
-          con.finish_outer_call();
-        });
-        m_timer_started = true;
-      }
-    }
+      m_response_received(false), m_done(false), m_id(id), m_command(command)
+    {}
     virtual ~invoke_handler()
     {}
     callback_t m_cb;
     async_protocol_handler& m_con;
+    std::mutex m_timer_lock;
     boost::asio::deadline_timer m_timer;
     bool m_timer_started;
-    std::atomic<bool> m_cancel_timer_called;
-    bool m_timer_cancelled;
+    std::atomic<bool> m_response_received;
+    std::atomic<bool> m_done;        // the callback has been called
+    uint64_t m_id;
     int m_command;
+
+    // the callback is told about the timeout in `timeout` ms, the response is waited for till `hard_timeout`
+    bool start(uint64_t timeout, uint64_t hard_timeout)
+    {
+      std::lock_guard<std::mutex> lk(m_timer_lock);
+      m_timer_started = arm_timer(timeout, timeout < hard_timeout ? hard_timeout - timeout : 0);
+      return m_timer_started;
+    }
+    bool arm_timer(uint64_t timeout, uint64_t more_till_close)
+    {
+      if(!m_con.start_outer_call())
+        return false;
+      m_timer.expires_from_now(boost::posix_time::milliseconds(timeout));
+      auto self = this->shared_from_this();
+      m_timer.async_wait([self, more_till_close](const boost::system::error_code& ec)
+      {
+        self->on_timer(ec, more_till_close);
+        self->m_con.finish_outer_call();
+      });
+      return true;
+    }
+    void on_timer(const boost::system::error_code& ec, uint64_t more_till_close)
+    {
+      if(ec == boost::asio::error::operation_aborted || m_response_received)
+        return;
+      if(!m_done.exchange(true))
+      {
+        LOG_PRINT_CC(m_con.get_context_ref(), "Timeout on invoke operation happened, command: " << m_command, LOG_LEVEL_2);
+        std::string fake;
+        m_cb(LEVIN_ERROR_CONNECTION_TIMEDOUT, fake, m_con.get_context_ref());
+      }
+      bool close_connection = false;
+      {
+        std::lock_guard<std::mutex> lk(m_timer_lock);
+        if(m_response_received)
+          return;
+        close_connection = !more_till_close || !arm_timer(more_till_close, 0);
+      }
+      if(close_connection)
+      {
+        LOG_PRINT_CC(m_con.get_context_ref(), "No response to invoke, command: " << m_command << ", closing connection", LOG_LEVEL_2);
+        m_con.close();
+      }
+    }
+    void cancel_timer()
+    {
+      std::lock_guard<std::mutex> lk(m_timer_lock);
+      boost::system::error_code ignored_ec;
+      m_timer.cancel(ignored_ec);
+    }
     virtual bool handle(int res, const std::string& buff, typename async_protocol_handler::connection_context& context)
     {
-      if(!cancel_timer())
+      m_response_received = true;
+      cancel_timer();
+      if(m_done.exchange(true))
+      {
+        LOG_PRINT_CC_L3(context, "Late response to timed out or cancelled invoke dropped, command: " << m_command);
         return false;
+      }
       m_cb(res, buff, context);
-      m_con.finish_outer_call();
       return true;
     }
     virtual bool is_timer_started() const
@@ -195,29 +260,33 @@ public:
     }
     virtual void cancel()
     {
-      if(cancel_timer())
+      m_response_received = true; // won't ever come
+      cancel_timer();
+      if(!m_done.exchange(true))
       {
         std::string fake;
         m_cb(LEVIN_ERROR_CONNECTION_DESTROYED, fake, m_con.get_context_ref());
-        m_con.finish_outer_call();
       }
     }
-    virtual bool cancel_timer()
+    virtual bool abandon()
     {
-      if(!m_cancel_timer_called)
-      {
-        m_cancel_timer_called = true;
-        boost::system::error_code ignored_ec;
-        m_timer_cancelled = 1 == m_timer.cancel(ignored_ec);
-      }
-      return m_timer_cancelled;
+      if(m_done.exchange(true))
+        return false;
+      std::string fake;
+      m_cb(LEVIN_ERROR_INVOKE_CANCELLED, fake, m_con.get_context_ref());
+      return true;
+    }
+    virtual uint64_t get_id() const
+    {
+      return m_id;
     }
   };
   critical_section m_invoke_response_handlers_lock;
   std::list<boost::shared_ptr<invoke_response_handler_base> > m_invoke_response_handlers;
+  uint64_t m_last_invoke_id;
   
   template<class callback_t>
-  bool add_invoke_response_handler(const callback_t& cb, uint64_t timeout,  async_protocol_handler& con, int command)
+  bool add_invoke_response_handler(const callback_t& cb, uint64_t timeout,  async_protocol_handler& con, int command, uint64_t& invoke_id)
   {
     CRITICAL_REGION_LOCAL(m_invoke_response_handlers_lock);
     if (m_protocol_released)
@@ -225,10 +294,13 @@ public:
       LOG_PRINT_L0("ERROR: Adding response handler to a released object");
       return false;
     }
-    boost::shared_ptr<invoke_response_handler_base> handler(boost::make_shared<invoke_handler<callback_t>>(cb, timeout, con, command));
+    boost::shared_ptr<invoke_handler<callback_t>> handler(boost::make_shared<invoke_handler<callback_t>>(cb, m_last_invoke_id + 1, con, command));
+    if (!handler->start(timeout, std::max<uint64_t>(timeout, m_config.m_invoke_timeout)))
+      return false;
+    invoke_id = ++m_last_invoke_id;
     m_invoke_response_handlers.push_back(handler);
     LOG_PRINT_L4("[LEVIN_PROTOCOL" << this << "] INVOKE_HANDLER_QUE: PUSH_BACK RESPONSE HANDLER");
-    return handler->is_timer_started();
+    return true;
   }
   template<class callback_t> friend struct invoke_handler;
 public:
@@ -249,6 +321,8 @@ public:
     m_wait_count = 0;
     m_oponent_protocol_ver = 0;
     m_connection_initialized = false;
+    m_compress_outgoing = false;
+    m_last_invoke_id = 0;
     LOG_PRINT_CC(m_connection_context, "[LEVIN_PROTOCOL" << this << "] CONSTRUCTED", LOG_LEVEL_4);
   }
 
@@ -336,6 +410,14 @@ public:
     m_pservice_endpoint->request_callback();
   }
 
+  void set_compression(bool compress_outgoing)
+  {
+    misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
+      boost::bind(&async_protocol_handler::finish_outer_call, this));
+
+    m_compress_outgoing = compress_outgoing;
+  }
+
   void handle_qued_callback()   
   {
     m_config.m_pcommands_handler->callback(m_connection_context);
@@ -390,6 +472,18 @@ public:
             m_cache_in_buffer.erase(0, (std::string::size_type)m_current_head.m_cb);
           }
 
+          if (m_current_head.m_flags & LEVIN_PACKET_COMPRESSED)
+          {
+            std::string unpacked_buff;
+            if (!zlib_helper::unpack_bounded(buff_to_invoke, unpacked_buff, static_cast<size_t>(m_config.m_max_packet_size)))
+            {
+              LOG_ERROR_CC(m_connection_context, "[LEVIN_PROTOCOL" << this << "]Failed to unpack compressed packet, len=" << m_current_head.m_cb
+                << ", cmd = " << m_current_head.m_command << ", connection will be closed.");
+              return false;
+            }
+            buff_to_invoke.swap(unpacked_buff);
+          }
+
           bool is_response = (m_oponent_protocol_ver == LEVIN_PROTOCOL_VER_1 && m_current_head.m_flags&LEVIN_PACKET_RESPONSE);
 
 
@@ -405,17 +499,11 @@ public:
             if(!m_invoke_response_handlers.empty())
             {//async call scenario
               boost::shared_ptr<invoke_response_handler_base> response_handler = m_invoke_response_handlers.front();
-              bool timer_cancelled = response_handler->cancel_timer();
-              
-              if (timer_cancelled)
-              {
-                LOG_PRINT_L4("[LEVIN_PROTOCOL" << this << "] INVOKE_HANDLER_QUE: POP_FRONT");
-                m_invoke_response_handlers.pop_front();                
-              }
+              LOG_PRINT_L4("[LEVIN_PROTOCOL" << this << "] INVOKE_HANDLER_QUE: POP_FRONT");
+              m_invoke_response_handlers.pop_front();
               invoke_response_handlers_guard.unlock();//manual unlock(this type of guard let manual unlock)
 
-              if(timer_cancelled)
-                response_handler->handle(m_current_head.m_return_code, buff_to_invoke, m_connection_context);
+              response_handler->handle(m_current_head.m_return_code, buff_to_invoke, m_connection_context);
             }
             else
             {
@@ -456,12 +544,14 @@ public:
                 LOG_PRINT_CC_RED(m_connection_context, "[LEVIN_PROTOCOL" << this << "] LONG INVOKE HANDLER: " << invoke_handle_time << "ms, command: " << m_current_head.m_command, LOG_LEVEL_0);
               }
 
-              m_current_head.m_cb = return_buff.size();
+              m_current_head.m_flags = LEVIN_PACKET_RESPONSE;
+              std::string packed_buff;
+              const std::string& body = get_frame_body(return_buff, packed_buff, m_current_head.m_flags);
+              m_current_head.m_cb = body.size();
               m_current_head.m_have_to_return_data = false;
               m_current_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
-              m_current_head.m_flags = LEVIN_PACKET_RESPONSE;
               std::string send_buff((const char*)&m_current_head, sizeof(m_current_head));
-              send_buff += return_buff;
+              send_buff += body;
               CRITICAL_REGION_BEGIN(m_send_lock);
               if(!m_pservice_endpoint->do_send(send_buff.data(), send_buff.size()))
                 return false;
@@ -544,7 +634,7 @@ public:
   }
 
   template<class callback_t>
-  bool async_invoke(int command, const std::string& in_buff, const callback_t& cb, size_t timeout = LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED)
+  bool async_invoke(int command, const std::string& in_buff, const callback_t& cb, size_t timeout = LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED, uint64_t* p_invoke_id = nullptr)
   {
     misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
       boost::bind(&async_protocol_handler::finish_outer_call, this));
@@ -571,44 +661,40 @@ public:
 
       bucket_head2 head = {0};
       head.m_signature = LEVIN_SIGNATURE;
-      head.m_cb = in_buff.size();
       head.m_have_to_return_data = true;
 
       head.m_flags = LEVIN_PACKET_REQUEST;
+      std::string packed_buff;
+      const std::string& body = get_frame_body(in_buff, packed_buff, head.m_flags);
+      head.m_cb = body.size();
       head.m_command = command;
       head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
 
       boost::interprocess::ipcdetail::atomic_write32(&m_invoke_buf_ready, 0);
       CRITICAL_REGION_BEGIN(m_send_lock);
       CRITICAL_REGION_LOCAL1(m_invoke_response_handlers_lock);
-      if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
-      {
-        LOG_PRINT_CC_RED(m_connection_context, "[LEVIN_PROTOCOL" << this << "]Failed to do_send", LOG_LEVEL_2);
-        err_code = LEVIN_ERROR_CONNECTION;
-        break;
-      }
-      LOG_PRINT_L4("[LEVIN_PROTOCOL" << this << "] SENT_HEADER(command " << command << ")");
-      
-      
-      //add response handler before do_send of the last 
-      //part of packet, in case if it somehow lead to situation when response 
+      //add response handler before do_send of the 
+      //packet, in case if it somehow lead to situation when response 
       //comes before it return control and response could be handled 
       //by protocol state machine without proper invoke_response_handler
-      if (!add_invoke_response_handler(cb, timeout, *this, command))
+      uint64_t invoke_id = 0;
+      if (!add_invoke_response_handler(cb, timeout, *this, command, invoke_id))
       {
         err_code = LEVIN_ERROR_CONNECTION_DESTROYED;
         break;
       }
+      if (p_invoke_id)
+        *p_invoke_id = invoke_id;
       LOG_PRINT_L4("[LEVIN_PROTOCOL" << this << "] ADD_INVOKE_HANDLER(command " << command << ")");
 
-
-      if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+      // invokes and their responses are of the same priority, so the responses come in the order of invokes
+      if(!m_pservice_endpoint->do_send_frame({ get_head_buffer(head), std::make_shared<const std::string>(body) }, net_utils::send_priority_normal))
       {
         LOG_PRINT_CC_RED(m_connection_context, "Failed to do_send", LOG_LEVEL_2);
         err_code = LEVIN_ERROR_CONNECTION;
         break;
       }
-      LOG_PRINT_L4("[LEVIN_PROTOCOL" << this << "] SENT_BODY(command " << command << ")");
+      LOG_PRINT_L4("[LEVIN_PROTOCOL" << this << "] SENT(command " << command << ")");
 
 
       CRITICAL_REGION_END();
@@ -625,6 +711,30 @@ public:
     return true;
   }
 
+  // the callback of the invoke is called with LEVIN_ERROR_INVOKE_CANCELLED, false if it has been called already
+  bool cancel_invoke(uint64_t invoke_id)
+  {
+    misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
+      boost::bind(&async_protocol_handler::finish_outer_call, this));
+
+    boost::shared_ptr<invoke_response_handler_base> handler;
+    CRITICAL_REGION_BEGIN(m_invoke_response_handlers_lock);
+    auto it = std::find_if(m_invoke_response_handlers.begin(), m_invoke_response_handlers.end(),
+      [invoke_id](const boost::shared_ptr<invoke_response_handler_base>& h) { return h->get_id() == invoke_id; });
+    if (it == m_invoke_response_handlers.end())
+      return false;
+    handler = *it;
+    CRITICAL_REGION_END();
+    // Never call callback inside critical section, that can cause deadlock
+    return handler->abandon();
+  }
+
+  size_t get_invokes_in_flight()
+  {
+    CRITICAL_REGION_LOCAL(m_invoke_response_handlers_lock);
+    return m_invoke_response_handlers.size();
+  }
+
   int invoke(int command, const std::string& in_buff, std::string& buff_out)
   {
     misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
@@ -640,22 +750,19 @@ public:
 
     bucket_head2 head = {0};
     head.m_signature = LEVIN_SIGNATURE;
-    head.m_cb = in_buff.size();
     head.m_have_to_return_data = true;
 
     head.m_flags = LEVIN_PACKET_REQUEST;
+    std::string packed_buff;
+    const std::string& body = get_frame_body(in_buff, packed_buff, head.m_flags);
+    head.m_cb = body.size();
     head.m_command = command;
     head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
 
     boost::interprocess::ipcdetail::atomic_write32(&m_invoke_buf_ready, 0);
     CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
-    {
-      LOG_ERROR_CC(m_connection_context, "[LEVIN_PROTOCOL" << this << "]Failed to do_send");
-      return LEVIN_ERROR_CONNECTION;
-    }
-
-    if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+    // invokes and their responses are of the same priority, so the responses come in the order of invokes
+    if(!m_pservice_endpoint->do_send_frame({ get_head_buffer(head), std::make_shared<const std::string>(body) }, net_utils::send_priority_normal))
     {
       LOG_ERROR_CC(m_connection_context, "[LEVIN_PROTOCOL" << this << "]Failed to do_send");
       return LEVIN_ERROR_CONNECTION;
@@ -694,6 +801,12 @@ public:
   }
 
   int notify(int command, const std::string& in_buff)
+  {
+    return notify(command, std::make_shared<const std::string>(in_buff));
+  }
+
+  // the buffer is queued to the connection as is, so the same one may be sent to many connections without copying
+  int notify(int command, const net_utils::shared_buffer& in_buff)
   {
     misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
                           boost::bind(&async_protocol_handler::finish_outer_call, this));
@@ -709,19 +822,17 @@ public:
     bucket_head2 head = {0};
     head.m_signature = LEVIN_SIGNATURE;
     head.m_have_to_return_data = false;
-    head.m_cb = in_buff.size();
 
     head.m_command = command;
     head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
     head.m_flags = LEVIN_PACKET_REQUEST;
+    std::string packed_buff;
+    net_utils::shared_buffer body = in_buff;
+    if (&get_frame_body(*in_buff, packed_buff, head.m_flags) == &packed_buff)
+      body = std::make_shared<const std::string>(std::move(packed_buff));
+    head.m_cb = body->size();
     CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
-    {
-      LOG_PRINT_CC_RED(m_connection_context, "[LEVIN_PROTOCOL" << this << "]Failed to do_send()", LOG_LEVEL_2);
-      return -1;
-    }
-
-    if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+    if(!m_pservice_endpoint->do_send_frame({ get_head_buffer(head), body }, m_config.get_notify_priority(command)))
     {
       LOG_PRINT_CC_RED(m_connection_context, "[LEVIN_PROTOCOL" << this << "]Failed to do_send()", LOG_LEVEL_2);
       return -1;
@@ -736,6 +847,22 @@ public:
     return 1;
   }
   //------------------------------------------------------------------------------------------
+  static net_utils::shared_buffer get_head_buffer(const bucket_head2& head)
+  {
+    return std::make_shared<const std::string>(reinterpret_cast<const char*>(&head), sizeof(head));
+  }
+  //------------------------------------------------------------------------------------------
+  // returns what goes after the header: in_buff itself, or its packed copy in packed_buff if that is worth it
+  const std::string& get_frame_body(const std::string& in_buff, std::string& packed_buff, uint32_t& flags)
+  {
+    if (!m_compress_outgoing || in_buff.size() < m_config.m_compression_threshold)
+      return in_buff;
+    if (!zlib_helper::pack_fast(in_buff, packed_buff) || packed_buff.size() >= in_buff.size())
+      return in_buff;
+    flags |= LEVIN_PACKET_COMPRESSED;
+    return packed_buff;
+  }
+  //------------------------------------------------------------------------------------------
   boost::uuids::uuid get_connection_id() {return m_connection_context.m_connection_id;}
   //------------------------------------------------------------------------------------------
   t_connection_context& get_context_ref() {return m_connection_context;}
@@ -799,11 +926,19 @@ int async_protocol_handler_config<t_connection_context>::invoke(int command, con
 }
 //------------------------------------------------------------------------------------------
 template<class t_connection_context> template<class callback_t>
-int async_protocol_handler_config<t_connection_context>::invoke_async(int command, const std::string& in_buff, boost::uuids::uuid connection_id, const callback_t& cb, size_t timeout)
+int async_protocol_handler_config<t_connection_context>::invoke_async(int command, const std::string& in_buff, boost::uuids::uuid connection_id, const callback_t& cb, size_t timeout, uint64_t* p_invoke_id)
 {
   async_protocol_handler<t_connection_context>* aph;
   int r = find_and_lock_connection(connection_id, aph);
-  return LEVIN_OK == r ? aph->async_invoke(command, in_buff, cb, timeout) : r;
+  return LEVIN_OK == r ? aph->async_invoke(command, in_buff, cb, timeout, p_invoke_id) : r;
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
+bool async_protocol_handler_config<t_connection_context>::cancel_invoke(boost::uuids::uuid connection_id, uint64_t invoke_id)
+{
+  async_protocol_handler<t_connection_context>* aph;
+  int r = find_and_lock_connection(connection_id, aph);
+  return LEVIN_OK == r ? aph->cancel_invoke(invoke_id) : false;
 }
 //------------------------------------------------------------------------------------------
 template<class t_connection_context> template<class callback_t>
@@ -855,6 +990,14 @@ int async_protocol_handler_config<t_connection_context>::notify(int command, con
 }
 //------------------------------------------------------------------------------------------
 template<class t_connection_context>
+int async_protocol_handler_config<t_connection_context>::notify(int command, const net_utils::shared_buffer& in_buff, boost::uuids::uuid connection_id)
+{
+  async_protocol_handler<t_connection_context>* aph;
+  int r = find_and_lock_connection(connection_id, aph);
+  return LEVIN_OK == r ? aph->notify(command, in_buff) : r;
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
 bool async_protocol_handler_config<t_connection_context>::close(boost::uuids::uuid connection_id)
 {
   CRITICAL_REGION_LOCAL(m_connects_lock);
@@ -888,6 +1031,17 @@ bool async_protocol_handler_config<t_connection_context>::request_callback(boost
     return false;
   }
 }
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
+bool async_protocol_handler_config<t_connection_context>::set_compression(boost::uuids::uuid connection_id, bool compress_outgoing)
+{
+  async_protocol_handler<t_connection_context>* aph;
+  int r = find_and_lock_connection(connection_id, aph);
+  if(LEVIN_OK != r)
+    return false;
+  aph->set_compression(compress_outgoing);
+  return true;
+}
 }
 }
 
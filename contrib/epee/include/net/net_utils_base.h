@@ -30,6 +30,8 @@
 #define _NET_UTILS_BASE_H_
 
 #include <boost/uuid/uuid.hpp>
+#include <memory>
+#include <vector>
 #include "string_tools.h"
 
 #ifndef MAKE_IP
@@ -101,9 +103,32 @@ namespace net_utils
 	/************************************************************************/
 	/*                                                                      */
 	/************************************************************************/
+	// immutable data that may be queued to several connections at once without copying (e.g. a relayed block)
+	typedef std::shared_ptr<const std::string> shared_buffer;
+
+	// classes of outgoing data: a frame waits for all the frames of higher priority queued to the same connection,
+	// frames of the same priority keep their order
+	enum send_priority
+	{
+		send_priority_high = 0,        // not delayed by the upload limits either
+		send_priority_above_normal,
+		send_priority_normal,
+		send_priority_low,
+		send_priority_count
+	};
+
 	struct i_service_endpoint
 	{
 		virtual bool do_send(const void* ptr, size_t cb)=0;
+    virtual bool do_send_buffer(const shared_buffer& buff) { return do_send(buff->data(), buff->size()); }
+    // the parts go to the stream together, nothing is sent between them
+    virtual bool do_send_frame(const std::vector<shared_buffer>& parts, send_priority priority)
+    {
+      for (const auto& p : parts)
+        if (!do_send_buffer(p))
+          return false;
+      return true;
+    }
     virtual bool close()=0;
     virtual bool call_run_once_service_io()=0;
     virtual bool request_callback()=0;
@@ -0,0 +1,87 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+namespace epee
+{
+namespace net_utils
+{
+  // token bucket for outgoing data: the bucket holds up to one second of the rate,
+  // a write may take more than it holds (the rest is paid off by waiting), so frames are never split
+  class send_rate_limiter
+  {
+  public:
+    send_rate_limiter()
+      : m_rate(0)
+      , m_tokens(0)
+      , m_last_update_ms(0)
+    {}
+
+    // bytes per second, 0 means unlimited
+    void set_rate(uint64_t rate)
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      if (m_rate == rate)
+        return;
+      m_rate = rate;
+      m_tokens = std::min<int64_t>(m_tokens, static_cast<int64_t>(rate));
+    }
+
+    uint64_t get_rate() const
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      return m_rate;
+    }
+
+    // milliseconds to wait before the next write, 0 if it may go now
+    uint64_t get_wait_time(uint64_t now_ms)
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      if (!m_rate)
+        return 0;
+      refill(now_ms);
+      if (m_tokens > 0)
+        return 0;
+      return static_cast<uint64_t>(-m_tokens) * 1000 / m_rate + 1;
+    }
+
+    void consume(uint64_t bytes, uint64_t now_ms)
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      if (!m_rate)
+        return;
+      refill(now_ms);
+      m_tokens -= static_cast<int64_t>(bytes);
+    }
+
+  private:
+    void refill(uint64_t now_ms)
+    {
+      if (now_ms > m_last_update_ms)
+      {
+        uint64_t elapsed_ms = std::min<uint64_t>(now_ms - m_last_update_ms, 24 * 60 * 60 * 1000); // no overflow, the bucket is full anyway
+        m_tokens = std::min<int64_t>(m_tokens + static_cast<int64_t>(m_rate * elapsed_ms / 1000), static_cast<int64_t>(m_rate));
+      }
+      m_last_update_ms = now_ms;
+    }
+
+    mutable std::mutex m_lock;
+    uint64_t m_rate;
+    int64_t m_tokens;
+    uint64_t m_last_update_ms;
+  };
+
+  // upload limits of a server, shared by its connections
+  struct send_shaping
+  {
+    send_rate_limiter global_limiter;
+    std::atomic<uint64_t> peer_rate{ 0 };  // bytes per second for each connection, 0 means unlimited
+  };
+}
+}
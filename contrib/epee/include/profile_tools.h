@@ -33,6 +33,7 @@
 #include <atomic>
 #include "misc_log_ex.h"
 #include "print_fixed_point_helper.h"
+#include "trace_tools.h"
 #define ENABLE_PROFILING
 
 namespace epee
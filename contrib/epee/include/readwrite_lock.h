@@ -205,19 +205,21 @@ namespace epee
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
-  //for now ignore shared mutex stuff
+  //for now ignore shared mutex stuff in deadlock guard, contention is still profiled
   template<>
-  class guarded_critical_region_t<epee::shared_recursive_mutex> : public critical_region_t<shared_recursive_mutex>
+  class guarded_critical_region_t<epee::shared_recursive_mutex> : public profiled_critical_region_t<shared_recursive_mutex>
   {
   public:
-    guarded_critical_region_t(epee::shared_recursive_mutex& cs, const char* /*func_name*/, const char* /*location*/, const char* /*lock_name*/, const std::string& /*thread_name*/) : critical_region_t<shared_recursive_mutex>(cs)
+    guarded_critical_region_t(epee::shared_recursive_mutex& cs, const char* /*func_name*/, const char* /*location*/, const char* /*lock_name*/, const std::string& /*thread_name*/, lock_contention_site* psite = nullptr)
+      : profiled_critical_region_t<shared_recursive_mutex>(cs, psite)
     {}
   };
   template<>
-  class guarded_critical_region_t<shared_membership<shared_recursive_mutex> > : public critical_region_t<shared_membership<shared_recursive_mutex>>
+  class guarded_critical_region_t<shared_membership<shared_recursive_mutex> > : public profiled_critical_region_t<shared_membership<shared_recursive_mutex>>
   {
   public:
-    guarded_critical_region_t(shared_membership<shared_recursive_mutex>& cs, const char* /*func_name*/, const char* /*location*/, const char* /*lock_name*/, const std::string& /*thread_name*/) : critical_region_t<epee::shared_membership<shared_recursive_mutex>>(cs)
+    guarded_critical_region_t(shared_membership<shared_recursive_mutex>& cs, const char* /*func_name*/, const char* /*location*/, const char* /*lock_name*/, const std::string& /*thread_name*/, lock_contention_site* psite = nullptr)
+      : profiled_critical_region_t<epee::shared_membership<shared_recursive_mutex>>(cs, psite)
     {}
   };
 
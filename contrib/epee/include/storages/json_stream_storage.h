@@ -0,0 +1,231 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <deque>
+#include <sstream>
+#include <string>
+#include "misc_log_ex.h"
+#include "parserse_base_utils.h"
+#include "portable_storage_base.h"
+#include "portable_storage_to_json.h"
+
+namespace epee
+{
+  namespace serialization
+  {
+    /************************************************************************/
+    /* Store-only storage for KV_SERIALIZE maps that writes json right into */
+    /* the target buffer, without building a portable_storage tree.          */
+    /* The layout is the one of portable_storage::dump_as_json(), but the    */
+    /* entries go in the order the map stores them (the tree sorts them by   */
+    /* name), and an entry stored twice is written twice.                    */
+    /************************************************************************/
+    class json_stream_storage
+    {
+      struct level
+      {
+        size_t depth;   // position in m_levels
+        size_t indent;
+        bool is_array;
+        bool has_entries;
+      };
+
+    public:
+      using use_descriptions = std::false_type;
+      typedef level* hsection;
+      typedef level* harray;
+      typedef storage_entry meta_entry;
+
+      json_stream_storage(std::string& target, size_t indent = 0)
+        : m_target(target)
+      {
+        m_target.clear();
+        open_level(false, indent);
+      }
+
+      hsection open_section(const std::string& section_name, hsection hparent_section, bool /*create_if_notexist*/ = false)
+      {
+        level* pparent = enter(hparent_section);
+        if (!pparent)
+          return nullptr;
+        put_key(*pparent, section_name);
+        return open_level(false, pparent->indent + 1);
+      }
+
+      template<class t_value>
+      bool set_value(const std::string& value_name, const t_value& target, hsection hparent_section)
+      {
+        level* pparent = enter(hparent_section);
+        if (!pparent)
+          return false;
+        put_key(*pparent, value_name);
+        put_value(target, pparent->indent + 1);
+        return true;
+      }
+
+      //arrays of values
+      template<class t_value>
+      harray insert_first_value(const std::string& value_name, const t_value& target, hsection hparent_section)
+      {
+        level* pparent = enter(hparent_section);
+        if (!pparent)
+          return nullptr;
+        put_key(*pparent, value_name);
+        level* parray = open_level(true, pparent->indent + 1);
+        parray->has_entries = true;
+        put_value(target, parray->indent);
+        return parray;
+      }
+
+      template<class t_value>
+      bool insert_next_value(harray hval_array, const t_value& target)
+      {
+        level* parray = enter(hval_array);
+        if (!parray)
+          return false;
+        m_target += ',';
+        put_value(target, parray->indent);
+        return true;
+      }
+
+      //arrays of sections
+      harray insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section)
+      {
+        level* pparent = enter(hparent_section);
+        if (!pparent)
+          return nullptr;
+        put_key(*pparent, section_name);
+        level* parray = open_level(true, pparent->indent + 1);
+        parray->has_entries = true;
+        hinserted_childsection = open_level(false, parray->indent);
+        return parray;
+      }
+
+      bool insert_next_section(harray hsec_array, hsection& hinserted_childsection)
+      {
+        level* parray = enter(hsec_array);
+        if (!parray)
+          return false;
+        m_target += ',';
+        hinserted_childsection = open_level(false, parray->indent);
+        return true;
+      }
+
+      void set_entry_description(hsection /*hparent_section*/, const std::string& /*name*/, const std::string& /*description*/) {}
+
+      // closes everything that is still open, nothing can be stored after that
+      void finalize()
+      {
+        while (m_levels.size())
+          close_level();
+      }
+
+    private:
+      level* open_level(bool is_array, size_t indent)
+      {
+        m_levels.push_back(level{ m_levels.size(), indent, is_array, false });
+        if (is_array)
+          m_target += '[';
+        else
+        {
+          m_target += '{';
+          m_target += strategy_json::eol;
+        }
+        return &m_levels.back();
+      }
+
+      void close_level()
+      {
+        const level& l = m_levels.back();
+        if (l.is_array)
+          m_target += ']';
+        else
+        {
+          if (l.has_entries)
+            m_target += strategy_json::eol;
+          m_target.append(l.indent * 2, ' ');
+          m_target += '}';
+        }
+        m_levels.pop_back();
+      }
+
+      // the maps store depth-first, so whatever was opened after the given level is complete
+      level* enter(level* plevel)
+      {
+        if (!plevel)
+        {
+          CHECK_AND_ASSERT_MES(m_levels.size(), nullptr, "json_stream_storage: storing after finalize()");
+          plevel = &m_levels.front();
+        }
+        CHECK_AND_ASSERT_MES(plevel->depth < m_levels.size() && &m_levels[plevel->depth] == plevel, nullptr, "json_stream_storage: storing to a closed section");
+        while (&m_levels.back() != plevel)
+          close_level();
+        return plevel;
+      }
+
+      void put_key(level& l, const std::string& name)
+      {
+        if (l.has_entries)
+        {
+          m_target += ',';
+          m_target += strategy_json::eol;
+        }
+        l.has_entries = true;
+        m_target.append((l.indent + 1) * 2, ' ');
+        m_target += '"';
+        misc_utils::parse::append_json_escape_sequence(m_target, name);
+        m_target += "\": ";
+      }
+
+      template<class t_int>
+      void put_int(t_int v)
+      {
+        char buff[24];
+        auto res = std::to_chars(buff, buff + sizeof(buff), v);
+        m_target.append(buff, res.ptr);
+      }
+
+      void put_value(const std::string& v, size_t /*indent*/)
+      {
+        m_target += '"';
+        misc_utils::parse::append_json_escape_sequence(m_target, v);
+        m_target += '"';
+      }
+      void put_value(uint64_t v, size_t /*indent*/) { put_int(v); }
+      void put_value(uint32_t v, size_t /*indent*/) { put_int(v); }
+      void put_value(uint16_t v, size_t /*indent*/) { put_int(v); }
+      void put_value(uint8_t v, size_t /*indent*/)  { put_int(static_cast<int32_t>(v)); }
+      void put_value(int64_t v, size_t /*indent*/)  { put_int(v); }
+      void put_value(int32_t v, size_t /*indent*/)  { put_int(v); }
+      void put_value(int16_t v, size_t /*indent*/)  { put_int(v); }
+      void put_value(int8_t v, size_t /*indent*/)   { put_int(static_cast<int32_t>(v)); }
+      void put_value(bool v, size_t /*indent*/)
+      {
+        m_target += v ? "true" : "false";
+      }
+      void put_value(double v, size_t /*indent*/)
+      {
+        char buff[512];
+        int len = snprintf(buff, sizeof(buff), "%.8f", v); // as strategy_json does
+        if (len > 0)
+          m_target.append(buff, std::min<size_t>(len, sizeof(buff) - 1));
+      }
+      void put_value(const storage_entry& v, size_t indent)
+      {
+        // json rpc ids and alike, rare and small
+        std::stringstream ss;
+        recursive_visitor<strategy_json>::dump_as_(ss, v, indent);
+        m_target += ss.str();
+      }
+
+      std::string& m_target;
+      std::deque<level> m_levels; // the open ones, a deque keeps the handles valid while it grows
+    };
+
+  }
+}
@@ -28,6 +28,17 @@
 
 #pragma once 
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define EPEE_JSON_SCAN_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#  include <arm_neon.h>
+#  define EPEE_JSON_SCAN_NEON
+#endif
+#if defined(_MSC_VER) && (defined(EPEE_JSON_SCAN_SSE2) || defined(EPEE_JSON_SCAN_NEON))
+#  include <intrin.h>
+#endif
+
 namespace epee 
 {
 namespace misc_utils
@@ -74,10 +85,8 @@ namespace misc_utils
        from https://www.json.org/ :
        char --  any-Unicode-character-except-"-or-\-or-control-character: \"  \\  \/  \b  \f  \n  \r  \t  \uDDDD
     */
-    inline std::string transform_to_json_escape_sequence(const std::string& str)
+    inline void append_json_escape_sequence(std::string& result, const std::string& str)
     {
-      std::string result;
-
       static const char hex_map[17] = "0123456789abcdef";
       static const std::string su00 = "\\u00";
 
@@ -116,6 +125,12 @@ namespace misc_utils
             result.push_back(c);
         }
       }
+    }
+
+    inline std::string transform_to_json_escape_sequence(const std::string& str)
+    {
+      std::string result;
+      append_json_escape_sequence(result, str);
       return result;
     }
 
@@ -133,80 +148,128 @@ namespace misc_utils
       \u00XY ASCII character with code 0xXY
 
       */
+      inline unsigned get_lowest_set_bit_index(uint64_t v) // v != 0
+      {
+#if defined(_MSC_VER)
+        unsigned long index = 0;
+        if (_BitScanForward(&index, static_cast<unsigned long>(v)))
+          return static_cast<unsigned>(index);
+        _BitScanForward(&index, static_cast<unsigned long>(v >> 32));
+        return static_cast<unsigned>(index) + 32;
+#else
+        return static_cast<unsigned>(__builtin_ctzll(v));
+#endif
+      }
+
+      // the first '"' or '\\' in [p, end), end if there is none;
+      // hex blobs and other long strings are taken 16 bytes at once
+      inline const char* find_json_string_special(const char* p, const char* end)
+      {
+#if defined(EPEE_JSON_SCAN_SSE2)
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        for (; end - p >= 16; p += 16)
+        {
+          __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+          int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+          if (mask)
+            return p + get_lowest_set_bit_index(static_cast<uint64_t>(mask));
+        }
+#elif defined(EPEE_JSON_SCAN_NEON)
+        const uint8x16_t quote = vdupq_n_u8('"');
+        const uint8x16_t backslash = vdupq_n_u8('\\');
+        for (; end - p >= 16; p += 16)
+        {
+          uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+          uint8x16_t matches = vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash));
+          // 4 bits for each byte
+          uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+          if (mask)
+            return p + get_lowest_set_bit_index(mask) / 4;
+        }
+#endif
+        for (; p != end; ++p)
+        {
+          if (*p == '"' || *p == '\\')
+            return p;
+        }
+        return end;
+      }
+
       inline void match_string2(std::string::const_iterator& star_end_string, std::string::const_iterator buf_end, std::string& val)
       {
         val.clear();
-        bool escape_mode = false;
-        val.reserve(buf_end - star_end_string);
         std::string::const_iterator it = star_end_string;
         ++it;
-        for(;it != buf_end;it++)
+        while(it != buf_end)
         {
-          if(escape_mode/*prev_ch == '\\'*/)
+          // copy everything up to the closing quote or the next escape sequence at once
+          const char* run_begin = &*it;
+          const char* run_end = find_json_string_special(run_begin, run_begin + (buf_end - it));
+          val.append(run_begin, run_end);
+          it += run_end - run_begin;
+          if(it == buf_end)
+            break;
+          if(*it == '"')
           {
-            switch(*it)
+            star_end_string = it;
+            return;
+          }
+          // *it == '\\'
+          ++it;
+          if(it == buf_end)
+            break;
+          switch(*it)
+          {
+          case 'b':  //Backspace (ascii code 08)
+            val.push_back(0x08);break;
+          case 'f':  //Form feed (ascii code 0C)
+            val.push_back(0x0C);break;
+          case 'n':  //New line
+            val.push_back('\n');break;
+          case 'r':  //Carriage return
+            val.push_back('\r');break;
+          case 't':  //Tab
+            val.push_back('\t');break;
+          case 'v':  //Vertical tab
+            val.push_back('\v');break;
+          case '\'':  //Apostrophe or single quote
+            val.push_back('\'');break;
+          case '"':  //Double quote
+            val.push_back('"');break;
+          case '\\':  //Backslash character
+            val.push_back('\\');break;
+          case '/':  //Slash character
+            val.push_back('/');break;
+          case 'u':  // \uDDDD sequence
             {
-            case 'b':  //Backspace (ascii code 08)
-              val.push_back(0x08);break;
-            case 'f':  //Form feed (ascii code 0C)
-              val.push_back(0x0C);break;
-            case 'n':  //New line
-              val.push_back('\n');break;
-            case 'r':  //Carriage return
-              val.push_back('\r');break;
-            case 't':  //Tab
-              val.push_back('\t');break;
-            case 'v':  //Vertical tab
-              val.push_back('\v');break;
-            case '\'':  //Apostrophe or single quote
-              val.push_back('\'');break;
-            case '"':  //Double quote
-              val.push_back('"');break;
-            case '\\':  //Backslash character
-              val.push_back('\\');break;
-            case '/':  //Slash character
-              val.push_back('/');break;
-            case 'u':  // \uDDDD sequence
+              bool ok = false;
+              size_t chars_left = buf_end - it - 1;
+              size_t chars_to_get = std::min(static_cast<size_t>(4), chars_left); // in [0, 4]
+              char tmp[10] = {0};
+              memcpy(tmp, &(*(it+1)), chars_to_get);
+              it = it + chars_to_get; // move forward to skip 0..4 digits
+              if (chars_to_get == 4)
               {
-                bool ok = false;
-                size_t chars_left = buf_end - it - 1;
-                size_t chars_to_get = std::min(static_cast<size_t>(4), chars_left); // in [0, 4]
-                char tmp[10] = {0};
-                memcpy(tmp, &(*(it+1)), chars_to_get);
-                it = it + chars_to_get; // move forward to skip 0..4 digits
-                if (chars_to_get == 4)
-                {
-                  char *p_last_decoded_char = nullptr;
-                  unsigned long value = strtoul(tmp, &p_last_decoded_char, 16); // expected value is from 0x0000 (\u0000) to 0x00ff (\u00ff)
-                  if (value <= 0xff && p_last_decoded_char - tmp == 4)
-                  {
-                    val.push_back(static_cast<char>(value));
-                    ok = true;
-                  }
-                }
-                if (!ok)
+                char *p_last_decoded_char = nullptr;
+                unsigned long value = strtoul(tmp, &p_last_decoded_char, 16); // expected value is from 0x0000 (\u0000) to 0x00ff (\u00ff)
+                if (value <= 0xff && p_last_decoded_char - tmp == 4)
                 {
-                  LOG_PRINT_L0("JSON invalid escape sequence: \\u" << tmp);
+                  val.push_back(static_cast<char>(value));
+                  ok = true;
                 }
               }
-              break;
-            default:
-              val.push_back(*it);
-              LOG_PRINT_L0("JSON unknown escape sequence :\"\\" << *it << "\"");
+              if (!ok)
+              {
+                LOG_PRINT_L0("JSON invalid escape sequence: \\u" << tmp);
+              }
             }
-            escape_mode = false;
-          }else if(*it == '"')
-          {
-            star_end_string = it;
-            return;
-          }else if(*it == '\\')
-          {
-            escape_mode = true;
-          }          
-          else
-          {
-            val.push_back(*it); 
+            break;
+          default:
+            val.push_back(*it);
+            LOG_PRINT_L0("JSON unknown escape sequence :\"\\" << *it << "\"");
           }
+          ++it;
         }
         ASSERT_MES_AND_THROW("Failed to match string in json entry: " << std::string(star_end_string, buf_end));
       }
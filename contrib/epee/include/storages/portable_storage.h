@@ -30,6 +30,7 @@
 
 #include <boost/mpl/contains.hpp>
 #include "misc_language.h"
+#include "memory_accounting.h"
 #include "portable_storage_base.h"
 #include "portable_storage_to_bin.h"
 #include "portable_storage_from_bin.h"
@@ -96,6 +97,7 @@ namespace epee
       bool enum_entries(hsection hparent_section, cb_t cb);
     protected:
       section m_root;
+      memory_accounting_scope m_parsed_size_accounting; // size of the source the storage was loaded from, stands for the size of the parsed entries
       hsection	get_root_section() {return &m_root;}
       storage_entry* find_storage_entry(const std::string& pentry_name, hsection psection);
       template<class entry_type>
@@ -130,6 +132,8 @@ namespace epee
     bool portable_storage_base<t_section>::load_from_json(const std::string& source)
     {
       TRY_ENTRY();
+      static memory_accounting::counter& parsed_counter = memory_accounting::get("portable_storage_parsed_json");
+      m_parsed_size_accounting.set(parsed_counter, source.size());
       return json::load_from_json(source, *this);
       CATCH_ENTRY("portable_storage_base<t_section>::load_from_json", false)
     }
@@ -179,6 +183,8 @@ namespace epee
         return false;
       }
       TRY_ENTRY();
+      static memory_accounting::counter& parsed_counter = memory_accounting::get("portable_storage_parsed_bin");
+      m_parsed_size_accounting.set(parsed_counter, source.size());
       throwable_buffer_reader buf_reader(source.data()+sizeof(storage_block_header), source.size()-sizeof(storage_block_header));
       buf_reader.read(m_root);
       return true;//TODO:
@@ -41,6 +41,10 @@ namespace epee
 {
   namespace serialization
   {
+    /*
+      Parses the entries in place: every value is read straight into its final place in the section tree,
+      so no subtree is copied on the way up. Only the calls which can nest are counted by the recursion guard.
+    */
     struct throwable_buffer_reader
     {
       throwable_buffer_reader(const void* ptr, size_t sz);
@@ -51,14 +55,15 @@ namespace epee
       template<class t_type>
       t_type read();
       template<class type_name>
-      storage_entry read_ae();
-      storage_entry load_storage_array_entry(uint8_t type);
+      void read_ae(array_entry& ae);
+      void load_storage_array_entry(uint8_t type, array_entry& ae);
       uint64_t read_varint();
       template<class t_type>
-      storage_entry read_se();
-      storage_entry load_storage_entry();
+      void read_se(storage_entry& se);
+      void load_storage_entry(storage_entry& se);
       void read(section& sec);
       void read(std::string& str);
+      void read(array_entry& ae);
     private:
       struct recursuion_limitation_guard
       {
@@ -94,7 +99,6 @@ namespace epee
     inline 
     void throwable_buffer_reader::read(void* target, size_t count)
     {
-      RECURSION_LIMITATION();
       CHECK_AND_ASSERT_THROW_MES(m_count >= count, " attempt to read " << count << " bytes from buffer with " << m_count << " bytes remained");
       memcpy(target, m_ptr, count);
       m_ptr += count;
@@ -103,24 +107,24 @@ namespace epee
     inline 
     void throwable_buffer_reader::read_sec_name(std::string& sce_name)
     {
-      RECURSION_LIMITATION();
       uint8_t name_len = 0;
       read(name_len);
-      sce_name.resize(name_len);
-      read((void*)sce_name.data(), name_len);
+      CHECK_AND_ASSERT_THROW_MES(m_count >= name_len, " attempt to read " << size_t(name_len) << " bytes from buffer with " << m_count << " bytes remained");
+      sce_name.assign((const char*)m_ptr, name_len);
+      m_ptr += name_len;
+      m_count -= name_len;
     }
 
     template<class t_pod_type>
     void throwable_buffer_reader::read(t_pod_type& pod_val)
     {
-      RECURSION_LIMITATION();
+      static_assert(std::is_arithmetic<t_pod_type>::value, "only the pod types are read as raw bytes");
       read(&pod_val, sizeof(pod_val));
     }
     
     template<class t_type>
     t_type throwable_buffer_reader::read()
     {
-      RECURSION_LIMITATION();
       t_type v;
       read(v);
       return v;
@@ -128,38 +132,40 @@ namespace epee
 
 
     template<class type_name>
-    storage_entry throwable_buffer_reader::read_ae()
+    void throwable_buffer_reader::read_ae(array_entry& ae)
     {
-      RECURSION_LIMITATION();
-      //for pod types
-      array_entry_t<type_name> sa;
+      ae = array_entry_t<type_name>();
+      array_entry_t<type_name>& sa = boost::get<array_entry_t<type_name> >(ae);
       uint64_t size = read_varint();
-      //TODO: add some optimization here later
+      // each element takes at least one byte, so a bogus size fails here rather than after a long loop
+      CHECK_AND_ASSERT_THROW_MES(size <= m_count, "array size " << size << " goes out of remain storage len " << m_count);
       while(size--)
-        sa.m_array.push_back(read<type_name>());        
-      return storage_entry(array_entry(sa));
+      {
+        sa.m_array.emplace_back();
+        read(sa.m_array.back());
+      }
     }
 
     inline 
-    storage_entry throwable_buffer_reader::load_storage_array_entry(uint8_t type)
+    void throwable_buffer_reader::load_storage_array_entry(uint8_t type, array_entry& ae)
     {
       RECURSION_LIMITATION();
       type &= ~SERIALIZE_FLAG_ARRAY;
       switch(type)
       {
-      case SERIALIZE_TYPE_INT64:  return read_ae<int64_t>();
-      case SERIALIZE_TYPE_INT32:  return read_ae<int32_t>();
-      case SERIALIZE_TYPE_INT16:  return read_ae<int16_t>();
-      case SERIALIZE_TYPE_INT8:   return read_ae<int8_t>();
-      case SERIALIZE_TYPE_UINT64: return read_ae<uint64_t>();
-      case SERIALIZE_TYPE_UINT32: return read_ae<uint32_t>();
-      case SERIALIZE_TYPE_UINT16: return read_ae<uint16_t>();
-      case SERIALIZE_TYPE_UINT8:  return read_ae<uint8_t>();
-      case SERIALIZE_TYPE_DUOBLE: return read_ae<double>();
-      case SERIALIZE_TYPE_BOOL:   return read_ae<bool>();
-      case SERIALIZE_TYPE_STRING: return read_ae<std::string>();
-      case SERIALIZE_TYPE_OBJECT: return read_ae<section>();
-      case SERIALIZE_TYPE_ARRAY:  return read_ae<array_entry>();
+      case SERIALIZE_TYPE_INT64:  return read_ae<int64_t>(ae);
+      case SERIALIZE_TYPE_INT32:  return read_ae<int32_t>(ae);
+      case SERIALIZE_TYPE_INT16:  return read_ae<int16_t>(ae);
+      case SERIALIZE_TYPE_INT8:   return read_ae<int8_t>(ae);
+      case SERIALIZE_TYPE_UINT64: return read_ae<uint64_t>(ae);
+      case SERIALIZE_TYPE_UINT32: return read_ae<uint32_t>(ae);
+      case SERIALIZE_TYPE_UINT16: return read_ae<uint16_t>(ae);
+      case SERIALIZE_TYPE_UINT8:  return read_ae<uint8_t>(ae);
+      case SERIALIZE_TYPE_DUOBLE: return read_ae<double>(ae);
+      case SERIALIZE_TYPE_BOOL:   return read_ae<bool>(ae);
+      case SERIALIZE_TYPE_STRING: return read_ae<std::string>(ae);
+      case SERIALIZE_TYPE_OBJECT: return read_ae<section>(ae);
+      case SERIALIZE_TYPE_ARRAY:  return read_ae<array_entry>(ae);
       default: 
         CHECK_AND_ASSERT_THROW_MES(false, "unknown entry_type code = " << type);
       }
@@ -168,7 +174,6 @@ namespace epee
     inline 
     uint64_t throwable_buffer_reader::read_varint()
     {
-      RECURSION_LIMITATION();
       CHECK_AND_ASSERT_THROW_MES(m_count >= 1, "empty buff, expected place for varint");
       uint64_t v = 0;
       uint8_t size_mask = (*(uint8_t*)m_ptr) &PORTABLE_RAW_SIZE_MARK_MASK;
@@ -186,67 +191,46 @@ namespace epee
     }
 
     template<class t_type>
-    storage_entry throwable_buffer_reader::read_se()
-    {
-      RECURSION_LIMITATION();
-      t_type v;
-      read(v);
-      return storage_entry(v);
-    }
-
-    template<>
-    inline storage_entry throwable_buffer_reader::read_se<std::string>()
-    {
-      RECURSION_LIMITATION();
-      return storage_entry(read<std::string>());
-    }
-
-
-    template<>
-    inline storage_entry throwable_buffer_reader::read_se<section>()
+    void throwable_buffer_reader::read_se(storage_entry& se)
     {
-      RECURSION_LIMITATION();
-      section s;//use extra variable due to vs bug, line "storage_entry se(section()); " can't be compiled in visual studio
-      storage_entry se(s);
-      section& section_entry = boost::get<section>(se);
-      read(section_entry);
-      return se;
+      se = t_type();
+      read(boost::get<t_type>(se));
     }
 
     template<>
-    inline storage_entry throwable_buffer_reader::read_se<array_entry>()
+    inline void throwable_buffer_reader::read_se<array_entry>(storage_entry& se)
     {
-      RECURSION_LIMITATION();
-      uint8_t ent_type = 0;
-      read(ent_type);
-      CHECK_AND_ASSERT_THROW_MES(ent_type&SERIALIZE_FLAG_ARRAY, "wrong type sequenses");
-      return load_storage_array_entry(ent_type);
+      se = array_entry();
+      read(boost::get<array_entry>(se));
     }
 
     inline 
-    storage_entry throwable_buffer_reader::load_storage_entry()
+    void throwable_buffer_reader::load_storage_entry(storage_entry& se)
     {
       RECURSION_LIMITATION();
       uint8_t ent_type = 0;
       read(ent_type);
       if(ent_type&SERIALIZE_FLAG_ARRAY)
-        return load_storage_array_entry(ent_type);
+      {
+        se = array_entry();
+        return load_storage_array_entry(ent_type, boost::get<array_entry>(se));
+      }
 
       switch(ent_type)
       {
-      case SERIALIZE_TYPE_INT64:  return read_se<int64_t>();
-      case SERIALIZE_TYPE_INT32:  return read_se<int32_t>();
-      case SERIALIZE_TYPE_INT16:  return read_se<int16_t>();
-      case SERIALIZE_TYPE_INT8:   return read_se<int8_t>();
-      case SERIALIZE_TYPE_UINT64: return read_se<uint64_t>();
-      case SERIALIZE_TYPE_UINT32: return read_se<uint32_t>();
-      case SERIALIZE_TYPE_UINT16: return read_se<uint16_t>();
-      case SERIALIZE_TYPE_UINT8:  return read_se<uint8_t>();
-      case SERIALIZE_TYPE_DUOBLE: return read_se<double>();
-      case SERIALIZE_TYPE_BOOL:   return read_se<bool>();
-      case SERIALIZE_TYPE_STRING: return read_se<std::string>();
-      case SERIALIZE_TYPE_OBJECT: return read_se<section>();
-      case SERIALIZE_TYPE_ARRAY:  return read_se<array_entry>();
+      case SERIALIZE_TYPE_INT64:  return read_se<int64_t>(se);
+      case SERIALIZE_TYPE_INT32:  return read_se<int32_t>(se);
+      case SERIALIZE_TYPE_INT16:  return read_se<int16_t>(se);
+      case SERIALIZE_TYPE_INT8:   return read_se<int8_t>(se);
+      case SERIALIZE_TYPE_UINT64: return read_se<uint64_t>(se);
+      case SERIALIZE_TYPE_UINT32: return read_se<uint32_t>(se);
+      case SERIALIZE_TYPE_UINT16: return read_se<uint16_t>(se);
+      case SERIALIZE_TYPE_UINT8:  return read_se<uint8_t>(se);
+      case SERIALIZE_TYPE_DUOBLE: return read_se<double>(se);
+      case SERIALIZE_TYPE_BOOL:   return read_se<bool>(se);
+      case SERIALIZE_TYPE_STRING: return read_se<std::string>(se);
+      case SERIALIZE_TYPE_OBJECT: return read_se<section>(se);
+      case SERIALIZE_TYPE_ARRAY:  return read_se<array_entry>(se);
       default: 
         CHECK_AND_ASSERT_THROW_MES(false, "unknown entry_type code = " << ent_type);
       }
@@ -257,18 +241,29 @@ namespace epee
       RECURSION_LIMITATION();
       sec.m_entries.clear();
       uint64_t count = read_varint();
+      std::string sec_name;
       while(count--)
       {
         //read section name string
-        std::string sec_name;
         read_sec_name(sec_name);
-        sec.m_entries.insert(std::make_pair(sec_name, load_storage_entry()));
+        // the entries are stored sorted by name, so the end of the map is the right place for the next one
+        size_t entries_count = sec.m_entries.size();
+        auto it = sec.m_entries.emplace_hint(sec.m_entries.end(), std::move(sec_name), storage_entry());
+        if (sec.m_entries.size() != entries_count)
+        {
+          load_storage_entry(it->second);
+        }
+        else
+        {
+          // duplicated name: the first entry is kept, as before
+          storage_entry se;
+          load_storage_entry(se);
+        }
       }
     }
     inline 
     void throwable_buffer_reader::read(std::string& str)
     {
-      RECURSION_LIMITATION();
       size_t len = static_cast<size_t>(read_varint());
       CHECK_AND_ASSERT_THROW_MES(len < MAX_STRING_LEN_POSSIBLE, "to big string len value in storage: " << len);
       CHECK_AND_ASSERT_THROW_MES(m_count >= len, "string len count value " << len << " goes out of remain storage len " << m_count);
@@ -277,5 +272,15 @@ namespace epee
       m_ptr+=len;
       m_count -= len;
     }
+    inline 
+    void throwable_buffer_reader::read(array_entry& ae)
+    {
+      // a nested array is stored with its own type byte, see array_entry_store_visitor
+      RECURSION_LIMITATION();
+      uint8_t ent_type = 0;
+      read(ent_type);
+      CHECK_AND_ASSERT_THROW_MES(ent_type&SERIALIZE_FLAG_ARRAY, "wrong type sequenses");
+      load_storage_array_entry(ent_type, ae);
+    }
   }
 }
\ No newline at end of file
@@ -27,6 +27,7 @@
 #pragma once
 #include "parserse_base_utils.h"
 #include "portable_storage.h"
+#include "json_stream_storage.h"
 #include "file_io_utils.h"
 
 namespace epee
@@ -64,6 +65,16 @@ namespace epee
       return true;
     }
     //-----------------------------------------------------------------------------------------------------------
+    // the same json without the portable_storage tree in between, but with the entries in the order of the map
+    template<class t_struct>
+    bool store_t_to_json_stream(const t_struct& str_in, std::string& json_buff, size_t indent = 0)
+    {
+      json_stream_storage js(json_buff, indent);
+      str_in.store(js);
+      js.finalize();
+      return true;
+    }
+    //-----------------------------------------------------------------------------------------------------------
     template<class t_struct>
     std::string store_t_to_json(const t_struct& str_in, size_t indent = 0)
     {
@@ -39,6 +39,7 @@
 #include "warnings.h"
 #include "auto_val_init.h"
 #include "string_coding.h"
+#include "hex_codec.h"
 
 
 #ifndef OUT
@@ -147,6 +148,12 @@ namespace string_tools
   template<class CharT>
   std::basic_string<CharT> buff_to_hex_nodelimer(const std::basic_string<CharT>& s)
   {
+    if constexpr (sizeof(CharT) == 1)
+    {
+      std::basic_string<CharT> res(s.size() * 2, CharT(0));
+      hex_codec::encode(reinterpret_cast<const uint8_t*>(s.data()), s.size(), reinterpret_cast<char*>(&res[0]));
+      return res;
+    }
     using namespace std;
     basic_stringstream<CharT> hexStream;
     hexStream << hex << noshowbase;
@@ -164,10 +171,18 @@ namespace string_tools
   bool parse_hexstr_to_binbuff(const std::basic_string<CharT>& s, std::basic_string<CharT>& res)
   {
     res.clear();
+    size_t i = 0;
+    if constexpr (sizeof(CharT) == 1)
+    {
+      // plain hex digit pairs are decoded at once, the rest (odd tail, anything strtoul takes otherwise) as before
+      res.resize(s.size() / 2);
+      i = hex_codec::decode_pairs(reinterpret_cast<const char*>(s.data()), s.size() / 2, reinterpret_cast<uint8_t*>(&res[0]));
+      res.resize(i);
+    }
     try
     {
       long v = 0;
-      for(size_t i = 0; i < (s.size() + 1) / 2; i++)
+      for(; i < (s.size() + 1) / 2; i++)
       {
         CharT byte_str[3];
         size_t copied = s.copy(byte_str, 2, 2 * i);
@@ -37,6 +37,7 @@
 #include "singleton.h"
 #include "static_helpers.h"
 #include "misc_helpers.h"
+#include "lock_contention_profiler.h"
 
 //#define DISABLE_DEADLOCK_GUARD
 
@@ -575,14 +576,17 @@ namespace epee
   {
     t_lock&	m_locker;
     std::atomic<bool> m_unlocked;
+    lock_contention_probe m_probe;
 
     guarded_critical_region_t(const guarded_critical_region_t&) {}
 
   public:
-    guarded_critical_region_t(t_lock& cs, const char* func_name, const char* location, const char* lock_name, const std::string& thread_name) : m_locker(cs), m_unlocked(false)
+    guarded_critical_region_t(t_lock& cs, const char* func_name, const char* location, const char* lock_name, const std::string& thread_name, lock_contention_site* psite = nullptr)
+      : m_locker(cs), m_unlocked(false), m_probe(psite)
     {
       deadlock_guard_singleton::on_before_lock(&m_locker, func_name, location, lock_name, thread_name);
       m_locker.lock();
+      m_probe.on_locked();
       deadlock_guard_singleton::on_after_lock(&m_locker);
     }
 
@@ -599,6 +603,40 @@ namespace epee
       {
         deadlock_guard_singleton::on_unlock(&m_locker);
         m_locker.unlock();        
+        m_probe.on_unlocked();
+        m_unlocked = true;
+      }
+    }
+  };
+
+  // lock/unlock with the contention probe only, for the locks the deadlock guard skips (see readwrite_lock.h)
+  template<class t_lock>
+  class profiled_critical_region_t
+  {
+    t_lock&	m_locker;
+    bool m_unlocked;
+    lock_contention_probe m_probe;
+
+    profiled_critical_region_t(const profiled_critical_region_t&) = delete;
+
+  public:
+    profiled_critical_region_t(t_lock& cs, lock_contention_site* psite) : m_locker(cs), m_unlocked(false), m_probe(psite)
+    {
+      m_locker.lock();
+      m_probe.on_locked();
+    }
+
+    ~profiled_critical_region_t()
+    {
+      unlock();
+    }
+
+    void unlock()
+    {
+      if (!m_unlocked)
+      {
+        m_locker.unlock();
+        m_probe.on_unlocked();
         m_unlocked = true;
       }
     }
@@ -650,8 +688,10 @@ namespace epee
 
 
 
-#define DLG_CRITICAL_REGION_LOCAL_VAR(lock, varname)     epee::guarded_critical_region_t<decltype(lock)>   varname(lock, DEADLOCK_FUNCTION_DEF, DEADLOCK_LOCATION, #lock, epee::log_space::log_singletone::get_thread_log_prefix())
-#define DLG_CRITICAL_REGION_BEGIN_VAR(lock, varname)   { epee::guarded_critical_region_t<decltype(lock)>   varname(lock, DEADLOCK_FUNCTION_DEF, DEADLOCK_LOCATION, #lock, epee::log_space::log_singletone::get_thread_log_prefix())
+  // each region gets its own static lock_contention_site, so the profiler sees the wait and hold times per call site
+#define DLG_CRITICAL_REGION_LOCAL_VAR(lock, varname)     static epee::lock_contention_site varname##_lcs(DEADLOCK_LOCATION, #lock); \
+                                                         epee::guarded_critical_region_t<decltype(lock)>   varname(lock, DEADLOCK_FUNCTION_DEF, DEADLOCK_LOCATION, #lock, epee::log_space::log_singletone::get_thread_log_prefix(), &varname##_lcs)
+#define DLG_CRITICAL_REGION_BEGIN_VAR(lock, varname)   { DLG_CRITICAL_REGION_LOCAL_VAR(lock, varname)
 
 #define DLG_CRITICAL_SECTION_LOCK(lck)     epee::deadlock_guard_singleton::on_before_lock(&lck, DEADLOCK_FUNCTION_DEF, DEADLOCK_LOCATION, #lck, epee::log_space::log_singletone::get_thread_log_prefix());\
                                             lck.lock();\
@@ -0,0 +1,269 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "misc_log_ex.h"
+
+// events kept per thread, the oldest ones get overwritten
+#define TRACE_EVENTS_PER_THREAD          16384
+#define TRACE_EVENT_NAME_MAX             64
+// rings of finished threads are dropped once there are more of them
+#define TRACE_MAX_DEAD_THREAD_RINGS      64
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+// scoped spans, recorded only while tracing is on (see epee::trace_tools::tracer), costs one relaxed load when it is off
+#define TRACE_SCOPE(category, name)           epee::trace_tools::scoped_span TRACE_CONCAT(trace_span_, __LINE__)(category, name)
+#define TRACE_SCOPE_ARG(category, name, arg)  epee::trace_tools::scoped_span TRACE_CONCAT(trace_span_, __LINE__)(category, name, arg)
+
+namespace epee
+{
+namespace trace_tools
+{
+  inline uint64_t get_time_us()
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  struct trace_event_data
+  {
+    uint64_t ts_us;
+    uint64_t dur_us;
+    uint64_t arg;
+    bool has_arg;
+    const char* category;
+    char name[TRACE_EVENT_NAME_MAX];
+  };
+
+  /************************************************************************/
+  /* Single writer (the owning thread), any number of readers. Each slot  */
+  /* is guarded by a sequence number (odd while being written), so a      */
+  /* reader drops the slots overwritten while it was copying them.        */
+  /************************************************************************/
+  class thread_ring
+  {
+  public:
+    thread_ring(uint64_t tid, const std::string& thread_name)
+      : m_head(0)
+      , m_tid(tid)
+      , m_thread_name(thread_name)
+      , m_slots(new slot[TRACE_EVENTS_PER_THREAD])
+    {
+      for (size_t i = 0; i != TRACE_EVENTS_PER_THREAD; ++i)
+        m_slots[i].seq.store(0, std::memory_order_relaxed);
+    }
+
+    void push(const char* category, const char* name, uint64_t ts_us, uint64_t dur_us, uint64_t arg, bool has_arg)
+    {
+      uint64_t h = m_head.load(std::memory_order_relaxed);
+      slot& s = m_slots[h % TRACE_EVENTS_PER_THREAD];
+      s.seq.store(2 * h + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      s.data.ts_us = ts_us;
+      s.data.dur_us = dur_us;
+      s.data.arg = arg;
+      s.data.has_arg = has_arg;
+      s.data.category = category;
+      strncpy(s.data.name, name ? name : "", TRACE_EVENT_NAME_MAX - 1);
+      s.data.name[TRACE_EVENT_NAME_MAX - 1] = 0;
+      s.seq.store(2 * h + 2, std::memory_order_release);
+      m_head.store(h + 1, std::memory_order_release);
+    }
+
+    // events that started not earlier than since_us, oldest first
+    void get_events(uint64_t since_us, std::vector<trace_event_data>& events) const
+    {
+      uint64_t h = m_head.load(std::memory_order_acquire);
+      uint64_t i = h > TRACE_EVENTS_PER_THREAD ? h - TRACE_EVENTS_PER_THREAD : 0;
+      for (; i != h; ++i)
+      {
+        const slot& s = m_slots[i % TRACE_EVENTS_PER_THREAD];
+        if (s.seq.load(std::memory_order_acquire) != 2 * i + 2)
+          continue;
+        trace_event_data d = s.data;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.seq.load(std::memory_order_relaxed) != 2 * i + 2)
+          continue;
+        if (d.ts_us >= since_us)
+          events.push_back(d);
+      }
+    }
+
+    uint64_t get_tid() const { return m_tid; }
+    const std::string& get_thread_name() const { return m_thread_name; }
+
+  private:
+    struct slot
+    {
+      std::atomic<uint64_t> seq;
+      trace_event_data data;
+    };
+
+    std::atomic<uint64_t> m_head;
+    const uint64_t m_tid;
+    const std::string m_thread_name;
+    std::unique_ptr<slot[]> m_slots;
+  };
+
+  /************************************************************************/
+  /* Process-wide switch and registry of the per-thread rings. A ring is  */
+  /* allocated for a thread by its first span recorded while tracing is   */
+  /* on; all spans are exported as Chrome trace / Perfetto JSON.          */
+  /************************************************************************/
+  class tracer
+  {
+  public:
+    static tracer& get()
+    {
+      static tracer t;
+      return t;
+    }
+
+    bool is_enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // a new session: the events recorded before start() are not exported anymore
+    void start()
+    {
+      m_session_start_us.store(get_time_us(), std::memory_order_relaxed);
+      m_enabled.store(true, std::memory_order_relaxed);
+    }
+
+    void stop()
+    {
+      m_enabled.store(false, std::memory_order_relaxed);
+    }
+
+    thread_ring* get_thread_ring()
+    {
+      thread_local std::shared_ptr<thread_ring> ptr;
+      if (!ptr)
+      {
+        std::lock_guard<std::mutex> lk(m_lock);
+        size_t dead_rings = 0;
+        for (const auto& r : m_rings)
+          dead_rings += r.use_count() == 1 ? 1 : 0;
+        if (dead_rings > TRACE_MAX_DEAD_THREAD_RINGS)
+        {
+          std::vector<std::shared_ptr<thread_ring>> alive;
+          for (const auto& r : m_rings)
+            if (r.use_count() != 1)
+              alive.push_back(r);
+          m_rings.swap(alive);
+        }
+        ptr = std::make_shared<thread_ring>(++m_last_tid, log_space::log_singletone::get_thread_log_prefix());
+        m_rings.push_back(ptr);
+      }
+      return ptr.get();
+    }
+
+    void export_chrome_trace(std::ostream& out) const
+    {
+      std::vector<std::shared_ptr<thread_ring>> rings;
+      {
+        std::lock_guard<std::mutex> lk(m_lock);
+        rings = m_rings;
+      }
+      const uint64_t since_us = m_session_start_us.load(std::memory_order_relaxed);
+      bool first = true;
+      auto separate = [&]() { if (!first) out << ",\n"; first = false; };
+
+      out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+      std::vector<trace_event_data> events;
+      for (const auto& r : rings)
+      {
+        separate();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << r->get_tid() << ",\"args\":{\"name\":\"" << escape(r->get_thread_name().empty() ? std::string("thread") : r->get_thread_name()) << "\"}}";
+        events.clear();
+        r->get_events(since_us, events);
+        for (const auto& e : events)
+        {
+          separate();
+          out << "{\"name\":\"" << escape(e.name) << "\",\"cat\":\"" << escape(e.category ? e.category : "") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << r->get_tid()
+            << ",\"ts\":" << e.ts_us - since_us << ",\"dur\":" << e.dur_us;
+          if (e.has_arg)
+            out << ",\"args\":{\"arg\":" << e.arg << "}";
+          out << "}";
+        }
+      }
+      out << "\n]}\n";
+    }
+
+    std::string get_chrome_trace() const
+    {
+      std::stringstream ss;
+      export_chrome_trace(ss);
+      return ss.str();
+    }
+
+  private:
+    tracer()
+      : m_enabled(false)
+      , m_session_start_us(0)
+      , m_last_tid(0)
+    {}
+
+    // names may come from the network (rpc method names), so only the plain characters are kept
+    static std::string escape(const std::string& s)
+    {
+      std::string r = s;
+      for (char& c : r)
+      {
+        if (c < 0x20 || c > 0x7e || c == '"' || c == '\\')
+          c = '?';
+      }
+      return r;
+    }
+
+    std::atomic<bool> m_enabled;
+    std::atomic<uint64_t> m_session_start_us;
+    mutable std::mutex m_lock;
+    std::vector<std::shared_ptr<thread_ring>> m_rings;
+    uint64_t m_last_tid;
+  };
+
+  class scoped_span
+  {
+  public:
+    scoped_span(const char* category, const char* name)
+      : m_category(category), m_name(name), m_arg(0), m_has_arg(false), m_start_us(tracer::get().is_enabled() ? get_time_us() : 0)
+    {}
+    scoped_span(const char* category, const std::string& name)
+      : scoped_span(category, name.c_str())
+    {}
+    scoped_span(const char* category, const char* name, uint64_t arg)
+      : m_category(category), m_name(name), m_arg(arg), m_has_arg(true), m_start_us(tracer::get().is_enabled() ? get_time_us() : 0)
+    {}
+
+    ~scoped_span()
+    {
+      if (!m_start_us || !tracer::get().is_enabled())
+        return;
+      uint64_t now = get_time_us();
+      tracer::get().get_thread_ring()->push(m_category, m_name, m_start_us, now - m_start_us, m_arg, m_has_arg);
+    }
+
+  private:
+    scoped_span(const scoped_span&) = delete;
+    scoped_span& operator=(const scoped_span&) = delete;
+
+    const char* m_category;
+    const char* m_name;
+    uint64_t m_arg;
+    bool m_has_arg;
+    uint64_t m_start_us;
+  };
+
+} // namespace trace_tools
+} // namespace epee
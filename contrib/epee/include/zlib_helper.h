@@ -26,6 +26,8 @@
 
 
 #pragma once
+#include <algorithm>
+#include <string>
 extern "C" { 
 #include "zlib/zlib.h"
 }
@@ -137,6 +139,96 @@ namespace zlib_helper
 		return true;
 	}
 
+	// standard zlib stream tuned for speed, for frames that are packed on the fly (see unpack_bounded)
+	inline bool pack_fast(const std::string& target, std::string& result_packed_buff)
+	{
+		result_packed_buff.clear();
+
+		z_stream    zstream = {0};
+		if (deflateInit(&zstream, Z_BEST_SPEED) != Z_OK)
+			return false;
+		result_packed_buff.resize(deflateBound(&zstream, static_cast<uLong>(target.size())), 'X');
+
+		zstream.next_in = (Bytef*)target.data();
+		zstream.avail_in = (uInt)target.size();
+		zstream.next_out = (Bytef*)result_packed_buff.data();
+		zstream.avail_out = (uInt)result_packed_buff.size();
+
+		int ret = deflate(&zstream, Z_FINISH);
+		deflateEnd(&zstream);
+		CHECK_AND_ASSERT_MES(ret == Z_STREAM_END, false, "Failed to deflate. err = " << ret);
+		result_packed_buff.resize(result_packed_buff.size() - zstream.avail_out);
+		return true;
+	}
+
+	// inflates a stream not bigger than max_size, window_bits is as for inflateInit2()
+	inline bool inflate_bounded(const std::string& target, std::string& result_buff, size_t max_size, int window_bits)
+	{
+		result_buff.clear();
+
+		z_stream    zstream = {0};
+		if (inflateInit2(&zstream, window_bits) != Z_OK)
+			return false;
+		zstream.next_in = (Bytef*)target.data();
+		zstream.avail_in = (uInt)target.size();
+
+		int ret = Z_OK;
+		while (ret == Z_OK)
+		{
+			size_t chunk_size = std::min<size_t>(std::max<size_t>(target.size() * 4, 0x10000), max_size + 1 - result_buff.size());
+			size_t offset = result_buff.size();
+			result_buff.resize(offset + chunk_size);
+			zstream.next_out = (Bytef*)&result_buff[offset];
+			zstream.avail_out = (uInt)chunk_size;
+			ret = inflate(&zstream, Z_NO_FLUSH);
+			result_buff.resize(result_buff.size() - zstream.avail_out);
+			if (result_buff.size() > max_size)
+			{
+				ret = Z_BUF_ERROR;
+				break;
+			}
+		}
+		bool r = ret == Z_STREAM_END && zstream.avail_in == 0;
+		inflateEnd(&zstream);
+		if (!r)
+			result_buff.clear();
+		return r;
+	}
+
+	// inflates a pack_fast() stream, fails if the result would be bigger than max_size (the sender is not trusted)
+	inline bool unpack_bounded(const std::string& target, std::string& result_buff, size_t max_size)
+	{
+		return inflate_bounded(target, result_buff, max_size, 15);
+	}
+
+	// packs a http body for "Content-Encoding: gzip" (gzip == true) or "deflate" (zlib stream)
+	inline bool pack_http(const std::string& target, std::string& result_packed_buff, int level, bool gzip)
+	{
+		result_packed_buff.clear();
+
+		z_stream    zstream = {0};
+		if (deflateInit2(&zstream, level, Z_DEFLATED, gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			return false;
+		result_packed_buff.resize(deflateBound(&zstream, static_cast<uLong>(target.size())) + (gzip ? 18 : 0), 'X');
+
+		zstream.next_in = (Bytef*)target.data();
+		zstream.avail_in = (uInt)target.size();
+		zstream.next_out = (Bytef*)result_packed_buff.data();
+		zstream.avail_out = (uInt)result_packed_buff.size();
+
+		int ret = deflate(&zstream, Z_FINISH);
+		deflateEnd(&zstream);
+		CHECK_AND_ASSERT_MES(ret == Z_STREAM_END, false, "Failed to deflate. err = " << ret);
+		result_packed_buff.resize(result_packed_buff.size() - zstream.avail_out);
+		return true;
+	}
+
+	// inflates a gzip or zlib stream (the header tells which), that's how a "Content-Encoding: gzip" or "deflate" http body is unpacked
+	inline bool unpack_http_bounded(const std::string& target, std::string& result_buff, size_t max_size)
+	{
+		return inflate_bounded(target, result_buff, max_size, 15 + 32);
+	}
+
 	inline 	bool unpack(std::string& target)
 	{
 		std::string decode_summary_buff;
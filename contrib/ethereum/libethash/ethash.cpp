@@ -11,10 +11,21 @@
 #include <ethash/keccak.hpp>
 #include <ethash/progpow.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <cstdlib>
 #include <cstring>
 #include <limits>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace ethash
 {
@@ -52,6 +63,99 @@ inline hash512 bitwise_xor(const hash512& x, const hash512& y) noexcept
         z.word64s[i] = x.word64s[i] ^ y.word64s[i];
     return z;
 }
+
+std::atomic<huge_pages_mode> full_dataset_huge_pages{huge_pages_mode::none};
+std::atomic<bool> full_dataset_numa_interleave{false};
+
+/// Kept at the end of the context's first item, tells how the context's memory is to be freed.
+struct context_memory_info
+{
+    size_t size;
+    bool mapped;
+};
+
+#if defined(__linux__)
+constexpr size_t huge_page_size = 2 * 1024 * 1024;  // the x86-64 / aarch64 default one
+
+/// Spreads the pages over the NUMA nodes, each of them gets an equal share of the random reads.
+void interleave_over_numa_nodes(void* p, size_t size) noexcept
+{
+    unsigned long nodes_mask = 0;
+    for (unsigned i = 0; i != sizeof(nodes_mask) * 8; ++i)
+    {
+        const std::string node_dir = "/sys/devices/system/node/node" + std::to_string(i);
+        if (access(node_dir.c_str(), F_OK) == 0)
+            nodes_mask |= 1ul << i;
+    }
+    if ((nodes_mask & (nodes_mask - 1)) == 0)
+        return;  // a single node
+
+    constexpr int mpol_interleave = 3;  // MPOL_INTERLEAVE of <numaif.h>, libnuma is not required for that
+    if (syscall(SYS_mbind, p, size, mpol_interleave, &nodes_mask, sizeof(nodes_mask) * 8 + 1, 0) != 0)
+        LOG_CUSTOM("mbind(MPOL_INTERLEAVE) failed for the full dataset, errno: " << errno, 0);
+}
+
+/// Anonymous mapping of the given memory options, it's zeroed as calloc() memory is.
+/// Must be made before the memory is touched. Null if nothing could be mapped.
+char* map_full_context_memory(size_t& size) noexcept
+{
+    const huge_pages_mode huge_pages = full_dataset_huge_pages;
+    void* p = MAP_FAILED;
+    if (huge_pages == huge_pages_mode::explicit_pages)
+    {
+        const size_t huge_size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+        p = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+            size = huge_size;
+        else
+            LOG_CUSTOM("no " << huge_size << " bytes of explicit huge pages (see vm.nr_hugepages), transparent ones are used for the full dataset", 0);
+    }
+    if (p == MAP_FAILED)
+    {
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return nullptr;
+        if (huge_pages != huge_pages_mode::none && madvise(p, size, MADV_HUGEPAGE) != 0)
+            LOG_CUSTOM("madvise(MADV_HUGEPAGE) failed for the full dataset, errno: " << errno, 0);
+    }
+    if (full_dataset_numa_interleave)
+        interleave_over_numa_nodes(p, size);
+    return static_cast<char*>(p);
+}
+#endif
+
+char* alloc_context_memory(size_t size, bool full, context_memory_info& info) noexcept
+{
+    info = context_memory_info{size, false};
+#if defined(__linux__)
+    if (full && (full_dataset_huge_pages != huge_pages_mode::none || full_dataset_numa_interleave))
+    {
+        char* p = map_full_context_memory(info.size);
+        if (p)
+        {
+            info.mapped = true;
+            return p;
+        }
+    }
+#else
+    (void)full;
+#endif
+    return static_cast<char*>(std::calloc(1, size));
+}
+
+void free_context_memory(void* p, const context_memory_info& info) noexcept
+{
+#if defined(__linux__)
+    if (info.mapped)
+    {
+        munmap(p, info.size);
+        return;
+    }
+#else
+    (void)info;
+#endif
+    std::free(p);
+}
 }  // namespace
 
 int find_epoch_number(const hash256& seed) noexcept
@@ -131,7 +235,7 @@ void build_light_cache(
 epoch_context_full* create_epoch_context(
     build_light_cache_fn build_fn, int epoch_number, bool full) noexcept
 {
-    static_assert(sizeof(epoch_context_full) < sizeof(hash512), "epoch_context too big");
+    static_assert(sizeof(epoch_context_full) + sizeof(context_memory_info) <= sizeof(hash512), "epoch_context too big");
     static constexpr size_t context_alloc_size = sizeof(hash512);
 
     const int light_cache_num_items = calculate_light_cache_num_items(epoch_number);
@@ -143,13 +247,15 @@ epoch_context_full* create_epoch_context(
 
     const size_t alloc_size = context_alloc_size + light_cache_size + full_dataset_size;
 
-    char* const alloc_data = static_cast<char*>(std::calloc(1, alloc_size));
+    context_memory_info memory_info;
+    char* const alloc_data = alloc_context_memory(alloc_size, full, memory_info);
     if (!alloc_data)
     {
       LOG_CUSTOM_WITH_CALLSTACK("CRITICAL: std::calloc(" << alloc_size << ") failed in create_epoch_context()", 0);
       return nullptr;  // Signal out-of-memory by returning null pointer.
     }
-    LOG_CUSTOM("context for epoch " << epoch_number << " allocated, size: " << alloc_size << " bytes, full dataset size: " << full_dataset_size << " bytes", 0);
+    std::memcpy(alloc_data + context_alloc_size - sizeof(memory_info), &memory_info, sizeof(memory_info));
+    LOG_CUSTOM("context for epoch " << epoch_number << " allocated, size: " << alloc_size << " bytes, full dataset size: " << full_dataset_size << " bytes" << (memory_info.mapped ? ", mapped" : ""), 0);
 
     hash512* const light_cache = reinterpret_cast<hash512*>(alloc_data + context_alloc_size);
     const hash256 epoch_seed = calculate_epoch_seed(epoch_number);
@@ -181,6 +287,86 @@ void build_light_cache(hash512 cache[], int num_items, const hash256& seed) noex
     return generic::build_light_cache(keccak512, cache, num_items, seed);
 }
 
+void init_full_dataset_items(epoch_context_full& context, uint32_t begin, uint32_t end) noexcept
+{
+    auto* full_dataset_2048 = reinterpret_cast<hash2048*>(context.full_dataset);
+    const uint32_t num_items = static_cast<uint32_t>(context.full_dataset_num_items / 2);
+    for (uint32_t i = begin; i < end && i < num_items; ++i)
+        full_dataset_2048[i] = calculate_dataset_item_2048(context, i);
+}
+
+bool init_full_dataset(epoch_context_full& context, unsigned num_threads,
+    const std::atomic<bool>* stop_flag, void (*on_thread_start)()) noexcept
+{
+    static constexpr uint32_t items_per_step = 4096;
+    const uint32_t num_items = static_cast<uint32_t>(context.full_dataset_num_items / 2);
+    std::atomic<uint32_t> next_item{0};
+
+    auto worker = [&]() noexcept {
+        if (on_thread_start)
+            on_thread_start();
+        while (!stop_flag || !*stop_flag)
+        {
+            const uint32_t begin = next_item.fetch_add(items_per_step);
+            if (begin >= num_items)
+                break;
+            init_full_dataset_items(context, begin, std::min(begin + items_per_step, num_items));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    try
+    {
+        for (unsigned i = 1; i < num_threads; ++i)
+            threads.emplace_back(worker);
+    }
+    catch (...)
+    {
+        // Go on with the threads that have been started.
+    }
+    worker();
+    for (auto& t : threads)
+        t.join();
+
+    return !stop_flag || !*stop_flag;
+}
+
+void set_full_dataset_memory_options(huge_pages_mode huge_pages, bool numa_interleave) noexcept
+{
+    full_dataset_huge_pages = huge_pages;
+    full_dataset_numa_interleave = numa_interleave;
+}
+
+const void* get_full_dataset_data(const epoch_context_full& context, uint64_t& size) noexcept
+{
+    size = get_full_dataset_size(context.full_dataset_num_items);
+    return context.full_dataset;
+}
+
+std::shared_ptr<epoch_context_full> create_epoch_context_full_external(
+    int epoch_number, void* full_dataset, std::shared_ptr<void> full_dataset_owner)
+{
+    epoch_context_full* const context =
+        generic::create_epoch_context(build_light_cache, epoch_number, false);
+    if (!context)
+        return {};
+    context->full_dataset = static_cast<hash1024*>(full_dataset);
+
+    try
+    {
+        return std::shared_ptr<epoch_context_full>(
+            context, [full_dataset_owner](epoch_context_full* p) mutable {
+                ethash_destroy_epoch_context_full(p);
+                full_dataset_owner.reset();
+            });
+    }
+    catch (...)
+    {
+        ethash_destroy_epoch_context_full(context);
+        return {};
+    }
+}
+
 struct item_state
 {
     const hash512* const cache;
@@ -467,8 +653,10 @@ void ethash_destroy_epoch_context(epoch_context* context) noexcept
 {
     LOG_CUSTOM("context for epoch " << context->epoch_number << " is about to be freed", 0);
 
+    context_memory_info memory_info;
+    std::memcpy(&memory_info, reinterpret_cast<char*>(context) + sizeof(hash512) - sizeof(memory_info), sizeof(memory_info));
     context->~epoch_context();
-    std::free(context);
+    free_context_memory(context, memory_info);
 }
 
 }  // extern "C"
@@ -17,8 +17,10 @@
 #include <ethash/ethash.h>
 #include <ethash/hash_types.hpp>
 
+#include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <functional>
 #include <memory>
 #include <string>
 #include <sstream>
@@ -160,6 +162,53 @@ const epoch_context& get_global_epoch_context(int epoch_number);
 /// Get global shared epoch context with full dataset initialized.
 std::shared_ptr<epoch_context_full> get_global_epoch_context_full(int epoch_number);
 
+/// Makes the context the global shared one for its epoch. The context of the previous epoch is
+/// kept along with the latest one, e.g. for alt chains.
+void set_global_epoch_context_full(std::shared_ptr<epoch_context_full> context);
+
+/// Checks if there's a global shared context with full dataset for the epoch.
+bool has_global_epoch_context_full(int epoch_number);
+
+/// Computes the full dataset items [begin, end) (2048-bit ones, as ProgPoW uses them) so they
+/// aren't computed lazily while hashing. The context must not be used by others meanwhile.
+void init_full_dataset_items(epoch_context_full& context, uint32_t begin, uint32_t end) noexcept;
+
+/// Computes the whole full dataset with num_threads threads (the calling one included), each
+/// of them calls on_thread_start first if it's given. Returns false if stopped by stop_flag.
+bool init_full_dataset(epoch_context_full& context, unsigned num_threads,
+    const std::atomic<bool>* stop_flag = nullptr, void (*on_thread_start)() = nullptr) noexcept;
+
+/// Makes get_global_epoch_context_full() compute the whole dataset of a new context with the
+/// given number of threads before it's used (0 - items are computed lazily while hashing).
+void set_global_full_dataset_init_threads(unsigned num_threads) noexcept;
+
+/// Makes get_global_epoch_context_full() take the contexts of new epochs from the provider instead
+/// of creating them (an empty one restores the default). A null context from it is out of memory.
+void set_global_epoch_context_full_provider(
+    std::function<std::shared_ptr<epoch_context_full>(int epoch_number)> provider);
+
+/// Memory of the full datasets, a dataset is read at random so hashing is bound by TLB misses and,
+/// on multi-socket machines, by the remote memory reads.
+enum class huge_pages_mode
+{
+    none,
+    transparent,     ///< madvise(MADV_HUGEPAGE), needs THP enabled as "madvise" or "always"
+    explicit_pages,  ///< MAP_HUGETLB from the reserved pool (vm.nr_hugepages), transparent ones if it's short
+};
+
+/// Applies to the full datasets created from now on (Linux only, elsewhere they are on the heap).
+/// numa_interleave spreads a dataset's pages over the NUMA nodes, so no socket reads it all remotely.
+void set_full_dataset_memory_options(huge_pages_mode huge_pages, bool numa_interleave) noexcept;
+
+/// The full dataset memory of the context, e.g. to store it.
+const void* get_full_dataset_data(const epoch_context_full& context, uint64_t& size) noexcept;
+
+/// Creates a context with the full dataset, already computed, in the external memory (e.g. a mapped
+/// file) of get_full_dataset_size() bytes. The owner of the memory is released along with the
+/// context. Returns null if out of memory.
+std::shared_ptr<epoch_context_full> create_epoch_context_full_external(
+    int epoch_number, void* full_dataset, std::shared_ptr<void> full_dataset_owner);
+
 typedef int (custom_log_level_function)();
 typedef void (custom_log_function)(const std::string& m, bool add_callstack);
 
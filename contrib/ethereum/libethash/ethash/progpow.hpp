@@ -30,9 +30,25 @@ constexpr size_t l1_cache_num_items = l1_cache_size / sizeof(uint32_t);
 result hash(const epoch_context& context, int block_number, const hash256& header_hash,
     uint64_t nonce) noexcept;
 
+/// Dataset item lookup for the light context, lets the caller keep the items it has computed.
+using dataset_lookup_fn = hash2048 (*)(const epoch_context& context, uint32_t index);
+
+hash2048 calculate_dataset_item(const epoch_context& context, uint32_t index) noexcept;
+
+result hash(const epoch_context& context, int block_number, const hash256& header_hash,
+    uint64_t nonce, dataset_lookup_fn lookup) noexcept;
+
 result hash(const epoch_context_full& context, int block_number, const hash256& header_hash,
     uint64_t nonce) noexcept;
 
+/// The most nonces hash_batch() evaluates together, bigger batches go in several passes.
+constexpr size_t max_hash_batch_size = 8;
+
+/// Gives the same results as hash() for each of the nonces, evaluating up to max_hash_batch_size
+/// of them at once to hide the latency of the dataset accesses.
+void hash_batch(const epoch_context_full& context, int block_number, const hash256& header_hash,
+    const uint64_t* nonces, size_t count, result* results) noexcept;
+
 bool verify(const epoch_context& context, int block_number, const hash256& header_hash,
     const hash256& mix_hash, uint64_t nonce, const hash256& boundary) noexcept;
 
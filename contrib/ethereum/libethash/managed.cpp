@@ -4,6 +4,7 @@
 
 #include "ethash-internal.hpp"
 
+#include <functional>
 #include <memory>
 #include <mutex>
 
@@ -29,8 +30,12 @@ thread_local std::shared_ptr<epoch_context> thread_local_context;
 
 std::mutex shared_context_full_mutex;
 std::shared_ptr<epoch_context_full> shared_context_full;
+std::shared_ptr<epoch_context_full> shared_context_full_previous;
 thread_local std::shared_ptr<epoch_context_full> thread_local_context_full;
 
+std::atomic<unsigned> full_dataset_init_threads{0};
+std::function<std::shared_ptr<epoch_context_full>(int)> context_full_provider;  // under shared_context_full_mutex
+
 /// Update thread local epoch context.
 ///
 /// This function is on the slow path. It's separated to allow inlining the fast
@@ -58,25 +63,71 @@ void update_local_context(int epoch_number)
     thread_local_context = shared_context;
 }
 
+/// Puts the context to the global shared ones, the caller holds shared_context_full_mutex.
+///
+/// The latest epoch's context is kept along with the previous epoch's one, others are released.
+void put_shared_context_full(std::shared_ptr<epoch_context_full> context)
+{
+    const int epoch_number = context->epoch_number;
+    if (!shared_context_full || epoch_number >= shared_context_full->epoch_number)
+    {
+        if (shared_context_full && shared_context_full->epoch_number + 1 == epoch_number)
+            shared_context_full_previous = std::move(shared_context_full);
+        else if (!shared_context_full || shared_context_full->epoch_number != epoch_number)
+            shared_context_full_previous.reset();
+        shared_context_full = std::move(context);
+    }
+    else
+    {
+        shared_context_full_previous = std::move(context);
+    }
+}
+
 ATTRIBUTE_NOINLINE
 void update_local_context_full(int epoch_number)
 {
     // Release the shared pointer of the obsoleted context.
     thread_local_context_full.reset();
 
-    // Local context invalid, check the shared context.
+    // Local context invalid, check the shared contexts.
     std::lock_guard<std::mutex> lock{shared_context_full_mutex};
 
-    if (!shared_context_full || shared_context_full->epoch_number != epoch_number)
+    if (shared_context_full && shared_context_full->epoch_number == epoch_number)
     {
-        // Release the shared pointer of the obsoleted context.
+        thread_local_context_full = shared_context_full;
+        return;
+    }
+    if (shared_context_full_previous && shared_context_full_previous->epoch_number == epoch_number)
+    {
+        thread_local_context_full = shared_context_full_previous;
+        return;
+    }
+
+    // Release the shared pointers of the obsoleted contexts before building the new one.
+    shared_context_full_previous.reset();
+    if (shared_context_full && epoch_number > shared_context_full->epoch_number + 1)
         shared_context_full.reset();
 
-        // Build new context.
-        shared_context_full = create_epoch_context_full(epoch_number);
+    // Build new context.
+    std::shared_ptr<epoch_context_full> context;
+    if (context_full_provider)
+    {
+        context = context_full_provider(epoch_number);
     }
+    else
+    {
+        context = create_epoch_context_full(epoch_number);
+        const unsigned init_threads = full_dataset_init_threads;
+        if (context && init_threads)
+        {
+            LOG_CUSTOM("computing full dataset for epoch " << epoch_number << " with " << init_threads << " thread(s)", 0);
+            init_full_dataset(*context, init_threads);
+        }
+    }
+    if (context)
+        put_shared_context_full(context);
 
-    thread_local_context_full = shared_context_full;
+    thread_local_context_full = context;
 }
 }  // namespace
 
@@ -97,4 +148,32 @@ std::shared_ptr<epoch_context_full> get_global_epoch_context_full(int epoch_numb
 
     return thread_local_context_full;
 }
+
+void set_global_epoch_context_full(std::shared_ptr<epoch_context_full> context)
+{
+    if (!context)
+        return;
+
+    std::lock_guard<std::mutex> lock{shared_context_full_mutex};
+    put_shared_context_full(std::move(context));
+}
+
+void set_global_full_dataset_init_threads(unsigned num_threads) noexcept
+{
+    full_dataset_init_threads = num_threads;
+}
+
+void set_global_epoch_context_full_provider(
+    std::function<std::shared_ptr<epoch_context_full>(int epoch_number)> provider)
+{
+    std::lock_guard<std::mutex> lock{shared_context_full_mutex};
+    context_full_provider = std::move(provider);
+}
+
+bool has_global_epoch_context_full(int epoch_number)
+{
+    std::lock_guard<std::mutex> lock{shared_context_full_mutex};
+    return (shared_context_full && shared_context_full->epoch_number == epoch_number) ||
+           (shared_context_full_previous && shared_context_full_previous->epoch_number == epoch_number);
+}
 }  // namespace ethash
@@ -10,6 +10,7 @@
 #include "kiss99.hpp"
 #include <ethash/keccak.hpp>
 
+#include <algorithm>
 #include <array>
 
 namespace progpow
@@ -255,15 +256,8 @@ mix_array init_mix(uint64_t seed)
     return mix;
 }
 
-hash256 hash_mix(
-    const epoch_context& context, int block_number, uint64_t seed, lookup_fn lookup) noexcept
+hash256 reduce_mix(const mix_array& mix) noexcept
 {
-    auto mix = init_mix(seed);
-    mix_rng_state state{uint64_t(block_number / period_length)};
-
-    for (uint32_t i = 0; i < 64; ++i)
-        round(context, i, mix, state, lookup);
-
     // Reduce mix data to a single per-lane result.
     uint32_t lane_hash[num_lanes];
     for (size_t l = 0; l < num_lanes; ++l)
@@ -282,6 +276,62 @@ hash256 hash_mix(
         mix_hash.word32s[l % num_words] = fnv1a(mix_hash.word32s[l % num_words], lane_hash[l]);
     return le::uint32s(mix_hash);
 }
+
+hash256 hash_mix(
+    const epoch_context& context, int block_number, uint64_t seed, lookup_fn lookup) noexcept
+{
+    auto mix = init_mix(seed);
+    mix_rng_state state{uint64_t(block_number / period_length)};
+
+    for (uint32_t i = 0; i < 64; ++i)
+        round(context, i, mix, state, lookup);
+
+    return reduce_mix(mix);
+}
+
+hash2048 lazy_lookup(const epoch_context& context, uint32_t index) noexcept
+{
+    auto* full_dataset_1024 = static_cast<const epoch_context_full&>(context).full_dataset;
+    auto* full_dataset_2048 = reinterpret_cast<hash2048*>(full_dataset_1024);
+    hash2048& item = full_dataset_2048[index];
+    if (item.word64s[0] == 0)
+    {
+        // TODO: Copy elision here makes it thread-safe?
+        item = calculate_dataset_item_2048(context, index);
+    }
+
+    return item;
+}
+
+/// Same as hash_mix() for up to max_hash_batch_size seeds at once. The rounds of all the seeds
+/// go one after another, and the dataset items of a round are prefetched for all of them first,
+/// so the memory accesses of one mix overlap with the math of the others.
+void hash_mix_batch(const epoch_context_full& context, int block_number, const uint64_t* seeds,
+    size_t count, hash256* mix_hashes) noexcept
+{
+    mix_array mixes[max_hash_batch_size];
+    for (size_t k = 0; k < count; ++k)
+        mixes[k] = init_mix(seeds[k]);
+    const mix_rng_state state{uint64_t(block_number / period_length)};
+
+    const uint32_t num_items = static_cast<uint32_t>(context.full_dataset_num_items / 2);
+    const auto* full_dataset_2048 = reinterpret_cast<const hash2048*>(context.full_dataset);
+    for (uint32_t i = 0; i < 64; ++i)
+    {
+#if defined(__GNUC__)
+        for (size_t k = 0; k < count; ++k)
+            __builtin_prefetch(&full_dataset_2048[mixes[k][i % num_lanes][0] % num_items]);
+#else
+        (void)full_dataset_2048;
+        (void)num_items;
+#endif
+        for (size_t k = 0; k < count; ++k)
+            round(context, i, mixes[k], state, lazy_lookup);
+    }
+
+    for (size_t k = 0; k < count; ++k)
+        mix_hashes[k] = reduce_mix(mixes[k]);
+}
 }  // namespace
 
 result hash(const epoch_context& context, int block_number, const hash256& header_hash,
@@ -293,29 +343,45 @@ result hash(const epoch_context& context, int block_number, const hash256& heade
     return {final_hash, mix_hash};
 }
 
-result hash(const epoch_context_full& context, int block_number, const hash256& header_hash,
-    uint64_t nonce) noexcept
+hash2048 calculate_dataset_item(const epoch_context& context, uint32_t index) noexcept
 {
-    static const auto lazy_lookup = [](const epoch_context& context, uint32_t index) noexcept
-    {
-        auto* full_dataset_1024 = static_cast<const epoch_context_full&>(context).full_dataset;
-        auto* full_dataset_2048 = reinterpret_cast<hash2048*>(full_dataset_1024);
-        hash2048& item = full_dataset_2048[index];
-        if (item.word64s[0] == 0)
-        {
-            // TODO: Copy elision here makes it thread-safe?
-            item = calculate_dataset_item_2048(context, index);
-        }
+    return calculate_dataset_item_2048(context, index);
+}
 
-        return item;
-    };
+result hash(const epoch_context& context, int block_number, const hash256& header_hash,
+    uint64_t nonce, dataset_lookup_fn lookup) noexcept
+{
+    const uint64_t seed = keccak_progpow_64(header_hash, nonce);
+    const hash256 mix_hash = hash_mix(context, block_number, seed, lookup);
+    const hash256 final_hash = keccak_progpow_256(header_hash, seed, mix_hash);
+    return {final_hash, mix_hash};
+}
 
+result hash(const epoch_context_full& context, int block_number, const hash256& header_hash,
+    uint64_t nonce) noexcept
+{
     const uint64_t seed = keccak_progpow_64(header_hash, nonce);
     const hash256 mix_hash = hash_mix(context, block_number, seed, lazy_lookup);
     const hash256 final_hash = keccak_progpow_256(header_hash, seed, mix_hash);
     return {final_hash, mix_hash};
 }
 
+void hash_batch(const epoch_context_full& context, int block_number, const hash256& header_hash,
+    const uint64_t* nonces, size_t count, result* results) noexcept
+{
+    for (size_t done = 0; done < count; done += max_hash_batch_size)
+    {
+        const size_t n = std::min(count - done, max_hash_batch_size);
+        uint64_t seeds[max_hash_batch_size];
+        hash256 mix_hashes[max_hash_batch_size];
+        for (size_t k = 0; k < n; ++k)
+            seeds[k] = keccak_progpow_64(header_hash, nonces[done + k]);
+        hash_mix_batch(context, block_number, seeds, n, mix_hashes);
+        for (size_t k = 0; k < n; ++k)
+            results[done + k] = {keccak_progpow_256(header_hash, seeds[k], mix_hashes[k]), mix_hashes[k]};
+    }
+}
+
 bool verify(const epoch_context& context, int block_number, const hash256& header_hash,
     const hash256& mix_hash, uint64_t nonce, const hash256& boundary) noexcept
 {
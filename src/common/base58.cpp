@@ -4,8 +4,9 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <algorithm>
+#include <cstring>
 #include <boost/config.hpp>
-#include <boost/multiprecision/cpp_int.hpp>
 
 #include "base58.h"
 #include "crypto/hash.h"
@@ -26,29 +27,33 @@ namespace tools
       const size_t full_encoded_block_size = encoded_block_sizes[full_block_size];
       const size_t addr_checksum_size = 4;
 
+      // blocks are handled in chunks of up to 5 digits: 58^5 - 1 fits into 32 bits, so only one 64-bit division
+      // (or multiplication, for decoding) per chunk is needed instead of one per digit
+      const size_t chunk_digits = 5;
+      const uint32_t chunk_orders[] = {1, 58, 58 * 58, 58 * 58 * 58, 58 * 58 * 58 * 58, 58 * 58 * 58 * 58 * 58};
+
       struct reverse_alphabet
       {
         reverse_alphabet()
         {
-          m_data.resize(alphabet[alphabet_size - 1] - alphabet[0] + 1, -1);
+          memset(m_data, -1, sizeof m_data);
 
           for (size_t i = 0; i < alphabet_size; ++i)
           {
-            size_t idx = static_cast<size_t>(alphabet[i] - alphabet[0]);
+            size_t idx = static_cast<unsigned char>(alphabet[i]);
             m_data[idx] = static_cast<int8_t>(i);
           }
         }
 
         int operator()(char letter) const
         {
-          size_t idx = static_cast<size_t>(letter - alphabet[0]);
-          return idx < m_data.size() ? m_data[idx] : -1;
+          return m_data[static_cast<unsigned char>(letter)];
         }
 
         static reverse_alphabet instance;
 
       private:
-        std::vector<int8_t> m_data;
+        int8_t m_data[256];
       };
 
       reverse_alphabet reverse_alphabet::instance;
@@ -107,18 +112,43 @@ namespace tools
         memcpy(data, reinterpret_cast<uint8_t*>(&num_be) + sizeof(uint64_t) - size, size);
       }
 
+      // writes n digits of chunk (chunk < 58^n) right to left, ending at res_end
+      inline void encode_chunk(uint32_t chunk, size_t n, char* res_end)
+      {
+        for (size_t j = 0; j < n; ++j)
+        {
+          *--res_end = alphabet[chunk % alphabet_size];
+          chunk /= alphabet_size;
+        }
+      }
+
       void encode_block(const char* block, size_t size, char* res)
       {
-		assert(1 <= size && size <= full_block_size);
+        assert(1 <= size && size <= full_block_size);
+
+        // all the digits are written, including leading zeros (alphabet[0])
+        if (size == full_block_size)
+        {
+          // 11 digits = 1 + 5 + 5
+          uint64_t num = 0;
+          memcpy(&num, block, sizeof num);
+          num = SWAP64BE(num);
+          encode_chunk(static_cast<uint32_t>(num % chunk_orders[chunk_digits]), chunk_digits, res + full_encoded_block_size);
+          num /= chunk_orders[chunk_digits];
+          encode_chunk(static_cast<uint32_t>(num % chunk_orders[chunk_digits]), chunk_digits, res + full_encoded_block_size - chunk_digits);
+          num /= chunk_orders[chunk_digits];
+          res[0] = alphabet[num];
+          return;
+        }
 
         uint64_t num = uint_8be_to_64(reinterpret_cast<const uint8_t*>(block), size);
-        int i = static_cast<int>(encoded_block_sizes[size]) - 1;
-        while (0 < num)
+        size_t digits_left = encoded_block_sizes[size];
+        while (0 < digits_left)
         {
-          uint64_t remainder = num % alphabet_size;
-          num /= alphabet_size;
-          res[i] = alphabet[remainder];
-          --i;
+          size_t n = std::min(digits_left, chunk_digits);
+          encode_chunk(static_cast<uint32_t>(num % chunk_orders[chunk_digits]), n, res + digits_left);
+          num /= chunk_orders[chunk_digits];
+          digits_left -= n;
         }
       }
 
@@ -130,29 +160,43 @@ namespace tools
         if (res_size <= 0)
           return false; // Invalid block size
 
+        // the leading chunk takes the remainder, so that all the others are exactly chunk_digits long
         uint64_t res_num = 0;
-        uint64_t order = 1;
-        for (size_t i = size - 1; i < size; --i)
+        size_t i = 0;
+        size_t n = size % chunk_digits == 0 ? chunk_digits : size % chunk_digits;
+        while (i < size)
         {
-          int digit = reverse_alphabet::instance(block[i]);
-          if (digit < 0)
-            return false; // Invalid symbol
-
-          //uint64_t product_hi;
-          boost::multiprecision::uint128_t tmp = res_num;
-          tmp += boost::multiprecision::uint128_t(order) * digit;
+          uint32_t chunk = 0;
+          for (size_t j = 0; j < n; ++j, ++i)
+          {
+            int digit = reverse_alphabet::instance(block[i]);
+            if (digit < 0)
+              return false; // Invalid symbol
+            chunk = chunk * alphabet_size + static_cast<uint32_t>(digit);
+          }
 
-          if (tmp < res_num || tmp > std::numeric_limits<uint64_t>::max() )
+          // res_num * order + chunk must fit into 64 bits
+          const uint64_t order = chunk_orders[n];
+          const uint64_t max_hi = UINT64_MAX / order;
+          if (res_num > max_hi || (res_num == max_hi && chunk > UINT64_MAX % order))
             return false; // Overflow
 
-          res_num = tmp.convert_to<uint64_t>();
-          order *= alphabet_size; // Never overflows, 58^10 < 2^64
+          res_num = res_num * order + chunk;
+          n = chunk_digits;
         }
 
         if (static_cast<size_t>(res_size) < full_block_size && (UINT64_C(1) << (8 * res_size)) <= res_num)
           return false; // Overflow
 
-        uint_64_to_8be(res_num, res_size, reinterpret_cast<uint8_t*>(res));
+        if (static_cast<size_t>(res_size) == full_block_size)
+        {
+          res_num = SWAP64BE(res_num);
+          memcpy(res, &res_num, sizeof res_num);
+        }
+        else
+        {
+          uint_64_to_8be(res_num, res_size, reinterpret_cast<uint8_t*>(res));
+        }
 
         return true;
       }
@@ -223,25 +267,22 @@ namespace tools
       return encode(buf);
     }
 
-    bool decode_addr(std::string addr, uint64_t& tag, std::string& data)
+    bool decode_addr(const std::string& addr, uint64_t& tag, std::string& data)
     {
       std::string addr_data;
       bool r = decode(addr, addr_data);
       if (!r) return false;
       if (addr_data.size() <= addr_checksum_size) return false;
 
-      std::string checksum(addr_checksum_size, '\0');
-      checksum = addr_data.substr(addr_data.size() - addr_checksum_size);
-
-      addr_data.resize(addr_data.size() - addr_checksum_size);
-      crypto::hash hash = crypto::cn_fast_hash(addr_data.data(), addr_data.size());
-      std::string expected_checksum(reinterpret_cast<const char*>(&hash), addr_checksum_size);
-      if (expected_checksum != checksum) return false;
+      size_t payload_size = addr_data.size() - addr_checksum_size;
+      crypto::hash hash = crypto::cn_fast_hash(addr_data.data(), payload_size);
+      if (memcmp(&hash, addr_data.data() + payload_size, addr_checksum_size) != 0) return false;
+      addr_data.resize(payload_size);
 
       int read = tools::read_varint(addr_data.begin(), addr_data.end(), tag);
       if (read <= 0) return false;
 
-      data = addr_data.substr(read);
+      data.assign(addr_data, read, std::string::npos);
       return true;
     }
   }
@@ -0,0 +1,112 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <type_traits>
+
+namespace tools
+{
+
+  // insert-only bloom filter, each key sets/checks hashes_count bits of one 512-bit block,
+  // so a lookup touches a single cache line
+  // meant for random-looking POD keys (hashes, key images), so the indexes are taken directly from key bytes mixed with a salt
+  // insert() and may_contain() may be called concurrently (relaxed atomics), reset() may not;
+  // until reset() is called, or when the filter is loaded with more than twice its capacity, may_contain() always returns true
+  template<typename key_t>
+  class blocked_bloom_filter
+  {
+    static_assert(std::is_trivially_copyable<key_t>::value && sizeof(key_t) >= 16, "blocked_bloom_filter supports POD keys of at least 16 bytes");
+
+    enum { words_per_block = 8 }; // 64 bytes
+
+  public:
+    blocked_bloom_filter()
+      : m_capacity(0)
+      , m_blocks_count(0)
+      , m_hashes_count(0)
+      , m_salt(0)
+      , m_count(0)
+    {}
+
+    // bits_per_item = 12 and hashes_count = 8 give about 0.5% false positives when filled up to capacity, hashes_count is up to 8
+    void reset(size_t capacity, uint64_t salt, size_t bits_per_item = 12, size_t hashes_count = 8)
+    {
+      m_capacity = capacity ? capacity : 1;
+      m_blocks_count = (m_capacity * bits_per_item + words_per_block * 64 - 1) / (words_per_block * 64);
+      m_hashes_count = hashes_count;
+      m_salt = salt;
+      m_count = 0;
+      std::vector<std::atomic<uint64_t>> bits(m_blocks_count * words_per_block);
+      m_bits.swap(bits);
+      for (auto& w : m_bits)
+        w.store(0, std::memory_order_relaxed);
+    }
+
+    void insert(const key_t& key)
+    {
+      if (m_bits.empty())
+        return;
+      uint64_t h1 = 0, h2 = 0;
+      get_hashes(key, h1, h2);
+      std::atomic<uint64_t>* block = &m_bits[(h1 % m_blocks_count) * words_per_block];
+      for (size_t i = 0; i != m_hashes_count; ++i)
+      {
+        uint64_t bit = (h2 >> (i * 7)) & 0x1ff; // 9 bits per index, overlapping by two
+        block[bit / 64].fetch_or(uint64_t(1) << (bit % 64), std::memory_order_relaxed);
+      }
+      m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool may_contain(const key_t& key) const
+    {
+      if (m_bits.empty() || m_count.load(std::memory_order_relaxed) > 2 * m_capacity)
+        return true;
+      uint64_t h1 = 0, h2 = 0;
+      get_hashes(key, h1, h2);
+      const std::atomic<uint64_t>* block = &m_bits[(h1 % m_blocks_count) * words_per_block];
+      for (size_t i = 0; i != m_hashes_count; ++i)
+      {
+        uint64_t bit = (h2 >> (i * 7)) & 0x1ff;
+        if ((block[bit / 64].load(std::memory_order_relaxed) & (uint64_t(1) << (bit % 64))) == 0)
+          return false;
+      }
+      return true;
+    }
+
+    size_t get_capacity() const { return m_capacity; }
+    size_t get_count() const { return m_count.load(std::memory_order_relaxed); }
+    size_t get_memory_size() const { return m_bits.size() * sizeof(uint64_t); }
+
+  private:
+    static uint64_t mix(uint64_t x)
+    {
+      x ^= x >> 30;
+      x *= 0xbf58476d1ce4e5b9ULL;
+      x ^= x >> 27;
+      x *= 0x94d049bb133111ebULL;
+      x ^= x >> 31;
+      return x;
+    }
+
+    void get_hashes(const key_t& key, uint64_t& h1, uint64_t& h2) const
+    {
+      uint64_t parts[2] = { 0, 0 };
+      memcpy(parts, &key, sizeof(parts));
+      h1 = mix(parts[0] ^ m_salt);
+      h2 = mix(parts[1] + m_salt);
+    }
+
+    size_t m_capacity;
+    uint64_t m_blocks_count;
+    size_t m_hashes_count;
+    uint64_t m_salt;
+    std::atomic<size_t> m_count;
+    std::vector<std::atomic<uint64_t>> m_bits;
+  };
+
+} // namespace tools
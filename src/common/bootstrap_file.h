@@ -0,0 +1,220 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#pragma once
+
+#include <fstream>
+#include <thread>
+#include "currency_core/currency_core.h"
+#include "currency_protocol/raw_block_entries.h"
+#include "common/threads_pool.h"
+
+#define BOOTSTRAP_FILE_SIGNATURE      "ZANOBOOT"
+#define BOOTSTRAP_FILE_FORMAT_VER     1
+#define BOOTSTRAP_FILE_CHUNK_BLOCKS   200
+#define BOOTSTRAP_FILE_MAX_CHUNK_SIZE (1024 * 1024 * 1024)
+
+namespace tools
+{
+  // Adds consecutive blocks starting at first_height to the core the way the synchronization does it, not through the pool:
+  // bvcs carry the txs of the blocks as onboard transactions, range proofs are verified in a batch, PoW hashes are calculated
+  // in parallel (except for the checkpoints zone, where they aren't checked), then the blocks are added within db write batches.
+  // blobs_sizes are the sizes of the blobs of each block with its txs, they limit the size of the write batches
+  inline bool add_blocks_range_to_core(currency::core& c, std::vector<currency::block>& blocks, const std::vector<crypto::hash>& ids, std::vector<currency::block_verification_context>& bvcs,
+    const std::vector<uint64_t>& blobs_sizes, uint64_t first_height, utils::threads_pool& pool, size_t threads_count)
+  {
+    CHECK_AND_ASSERT_MES(blocks.size() == ids.size() && blocks.size() == bvcs.size() && blocks.size() == blobs_sizes.size(), false, "internal error: sizes mismatch");
+    currency::blockchain_storage& bcs = c.get_blockchain_storage();
+    bcs.batch_verify_range_proofs(blocks, bvcs);
+
+    std::vector<size_t> pow_blocks;
+    for (size_t i = 0; i != blocks.size(); ++i)
+    {
+      if (!currency::is_pos_block(blocks[i]) && !bcs.get_checkpoints().is_in_checkpoint_zone(first_height + i))
+        pow_blocks.push_back(i);
+    }
+    utils::threads_pool::jobs_container jobs;
+    const size_t chunk = (pow_blocks.size() + threads_count - 1) / threads_count;
+    for (size_t from = 0; from < pow_blocks.size(); from += chunk)
+    {
+      const size_t to = std::min(from + chunk, pow_blocks.size());
+      utils::threads_pool::add_job_to_container(jobs, [&, from, to]()
+      {
+        for (size_t i = from; i != to; ++i)
+          bcs.add_precomputed_pow_hash(ids[pow_blocks[i]], currency::get_block_longhash(blocks[pow_blocks[i]]));
+      });
+    }
+    pool.add_batch_and_wait(jobs);
+
+    c.pause_mine();
+    epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler([&c]() { c.resume_mine(); });
+    bcs.begin_blocks_write_batch();
+    epee::misc_utils::auto_scope_leave_caller batch_exit_handler = epee::misc_utils::create_scope_leave_handler([&bcs]() { bcs.end_blocks_write_batch(); });
+    for (size_t i = 0; i != blocks.size(); ++i)
+    {
+      bool r = c.handle_incoming_block(blocks[i], bvcs[i], false);
+      // a block may come from the network meanwhile, if the node is running
+      CHECK_AND_ASSERT_MES(r && (bvcs[i].m_added_to_main_chain || bvcs[i].m_already_exists), false, "Failed to add block " << first_height + i << " (" << ids[i] << ") to core");
+      bcs.on_blocks_write_batch_block_added(blobs_sizes[i]);
+    }
+    return true;
+  }
+
+  // Bootstrap file is a db-engine independent dump of the blockchain:
+  //   signature (8 bytes), format version (1 byte), genesis block id,
+  //   then chunks: height of the first block (uint64), size of the packed blocks (uint64),
+  //   the blocks with their txs packed by pack_raw_block_entries(), cn_fast_hash of the packed blocks
+  inline bool export_bootstrap_file(currency::core& c, const std::string& path, uint64_t start_height, uint64_t& exported_blocks)
+  {
+    exported_blocks = 0;
+    const uint64_t top_height = c.get_current_blockchain_size();
+    CHECK_AND_ASSERT_MES(start_height != 0 && start_height < top_height, false, "wrong start height " << start_height << ", blockchain size is " << top_height);
+
+    std::ofstream fs(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    CHECK_AND_ASSERT_MES(fs.is_open(), false, "Failed to open " << path);
+    const uint8_t ver = BOOTSTRAP_FILE_FORMAT_VER;
+    const crypto::hash genesis_id = c.get_block_id_by_height(0);
+    fs.write(BOOTSTRAP_FILE_SIGNATURE, sizeof(BOOTSTRAP_FILE_SIGNATURE) - 1);
+    fs.write(reinterpret_cast<const char*>(&ver), sizeof(ver));
+    fs.write(reinterpret_cast<const char*>(&genesis_id), sizeof(genesis_id));
+
+    for (uint64_t height = start_height; height < top_height; height += BOOTSTRAP_FILE_CHUNK_BLOCKS)
+    {
+      std::list<currency::block> blocks;
+      std::list<currency::transaction> txs;
+      bool r = c.get_blocks(height, BOOTSTRAP_FILE_CHUNK_BLOCKS, blocks, txs);
+      CHECK_AND_ASSERT_MES(r && !blocks.empty(), false, "Failed to get blocks from height " << height);
+
+      std::list<currency::block_complete_entry> entries;
+      auto tx_it = txs.begin();
+      for (const auto& b : blocks)
+      {
+        entries.emplace_back();
+        entries.back().block = currency::block_to_blob(b);
+        for (size_t i = 0; i != b.tx_hashes.size(); ++i)
+        {
+          CHECK_AND_ASSERT_MES(tx_it != txs.end(), false, "Not all txs of block " << currency::get_block_height(b) << " are found");
+          entries.back().txs.push_back(currency::tx_to_blob(*tx_it++));
+        }
+      }
+      currency::blobdata packed;
+      r = currency::pack_raw_block_entries(entries, packed);
+      CHECK_AND_ASSERT_MES(r, false, "Failed to pack blocks from height " << height);
+
+      const uint64_t packed_size = packed.size();
+      const crypto::hash checksum = crypto::cn_fast_hash(packed.data(), packed.size());
+      fs.write(reinterpret_cast<const char*>(&height), sizeof(height));
+      fs.write(reinterpret_cast<const char*>(&packed_size), sizeof(packed_size));
+      fs.write(packed.data(), packed.size());
+      fs.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+      CHECK_AND_ASSERT_MES(fs, false, "Failed to write to " << path);
+      exported_blocks += blocks.size();
+    }
+    fs.close();
+    CHECK_AND_ASSERT_MES(fs, false, "Failed to write to " << path);
+    return true;
+  }
+
+  // The blocks the core already has are skipped, so an import can be repeated or resumed; it stops at the first block which fails.
+  // Each chunk is checked against its checksum before it's used, the blocks are checked by the core as usual
+  template<class callback_t>
+  bool import_bootstrap_file(currency::core& c, const std::string& path, callback_t cb_should_stop, uint64_t& imported_blocks)
+  {
+    imported_blocks = 0;
+    std::ifstream fs(path, std::ios::binary | std::ios::in);
+    CHECK_AND_ASSERT_MES(fs.is_open(), false, "Failed to open " << path);
+    char signature[sizeof(BOOTSTRAP_FILE_SIGNATURE) - 1] = {};
+    uint8_t ver = 0;
+    crypto::hash genesis_id = currency::null_hash;
+    fs.read(signature, sizeof(signature));
+    fs.read(reinterpret_cast<char*>(&ver), sizeof(ver));
+    fs.read(reinterpret_cast<char*>(&genesis_id), sizeof(genesis_id));
+    CHECK_AND_ASSERT_MES(fs && memcmp(signature, BOOTSTRAP_FILE_SIGNATURE, sizeof(signature)) == 0, false, path << " is not a bootstrap file");
+    CHECK_AND_ASSERT_MES(ver == BOOTSTRAP_FILE_FORMAT_VER, false, "Unsupported bootstrap file format version " << static_cast<int>(ver));
+    CHECK_AND_ASSERT_MES(genesis_id == c.get_block_id_by_height(0), false, "Bootstrap file is for another network, genesis: " << genesis_id);
+
+    const size_t threads_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    utils::threads_pool pool;
+    pool.init(threads_count);
+
+    currency::blobdata packed;
+    while (fs.peek() != std::char_traits<char>::eof())
+    {
+      uint64_t first_height = 0, packed_size = 0;
+      crypto::hash checksum = currency::null_hash;
+      fs.read(reinterpret_cast<char*>(&first_height), sizeof(first_height));
+      fs.read(reinterpret_cast<char*>(&packed_size), sizeof(packed_size));
+      CHECK_AND_ASSERT_MES(fs && packed_size <= BOOTSTRAP_FILE_MAX_CHUNK_SIZE, false, "Wrong chunk header in bootstrap file at offset " << fs.tellg());
+      packed.resize(static_cast<size_t>(packed_size));
+      fs.read(&packed[0], packed.size());
+      fs.read(reinterpret_cast<char*>(&checksum), sizeof(checksum));
+      CHECK_AND_ASSERT_MES(fs, false, "Bootstrap file is truncated in the chunk from height " << first_height);
+      CHECK_AND_ASSERT_MES(crypto::cn_fast_hash(packed.data(), packed.size()) == checksum, false, "Checksum mismatch in the chunk from height " << first_height);
+
+      std::list<currency::block_complete_entry> entries_list;
+      bool r = currency::unpack_raw_block_entries(packed, entries_list);
+      CHECK_AND_ASSERT_MES(r, false, "Failed to unpack the chunk from height " << first_height);
+
+      const uint64_t current_size = c.get_current_blockchain_size();
+      if (first_height + entries_list.size() <= current_size)
+        continue;
+      CHECK_AND_ASSERT_MES(first_height <= current_size, false, "Bootstrap file has a gap: the chunk starts at " << first_height << ", blockchain size is " << current_size);
+      std::vector<currency::block_complete_entry> entries(std::make_move_iterator(entries_list.begin()), std::make_move_iterator(entries_list.end()));
+      entries.erase(entries.begin(), entries.begin() + static_cast<size_t>(current_size - first_height));
+      first_height = current_size;
+
+      // parse on all the threads, the results are checked afterwards in the order of the blocks
+      const size_t count = entries.size();
+      std::vector<currency::block> blocks(count);
+      std::vector<crypto::hash> ids(count, currency::null_hash);
+      std::vector<currency::block_verification_context> bvcs(count, boost::value_initialized<currency::block_verification_context>());
+      std::vector<uint64_t> blobs_sizes(count, 0);
+      std::vector<uint8_t> results(count, 0);
+      utils::threads_pool::jobs_container jobs;
+      const size_t chunk = (count + threads_count - 1) / threads_count;
+      for (size_t from = 0; from < count; from += chunk)
+      {
+        const size_t to = std::min(from + chunk, count);
+        utils::threads_pool::add_job_to_container(jobs, [&, from, to]()
+        {
+          for (size_t i = from; i != to; ++i)
+          {
+            if (!currency::parse_and_validate_block_from_blob(entries[i].block, blocks[i]))
+              continue;
+            ids[i] = currency::get_block_hash(blocks[i]);
+            blobs_sizes[i] = entries[i].block.size();
+            bool txs_ok = true;
+            for (const auto& tx_blob : entries[i].txs)
+            {
+              currency::transaction tx;
+              if (!currency::parse_and_validate_tx_from_blob(tx_blob, tx))
+              {
+                txs_ok = false;
+                break;
+              }
+              blobs_sizes[i] += tx_blob.size();
+              bvcs[i].m_onboard_transactions[currency::get_transaction_hash(tx)] = std::move(tx);
+            }
+            results[i] = txs_ok ? 1 : 0;
+          }
+        });
+      }
+      pool.add_batch_and_wait(jobs);
+      for (size_t i = 0; i != count; ++i)
+        CHECK_AND_ASSERT_MES(results[i], false, "Failed to parse block " << first_height + i << " or its txs from bootstrap file");
+
+      r = add_blocks_range_to_core(c, blocks, ids, bvcs, blobs_sizes, first_height, pool, threads_count);
+      CHECK_AND_ASSERT_MES(r, false, "Failed to import blocks from height " << first_height);
+      imported_blocks += count;
+
+      const uint64_t last_height = first_height + count - 1;
+      std::cout << "Imported blocks up to " << last_height << "\r";
+      if (cb_should_stop(last_height))
+      {
+        LOG_PRINT_MAGENTA(ENDL << "Interrupting bootstrap import...", LOG_LEVEL_0);
+        return false;
+      }
+    }
+    return true;
+  }
+}
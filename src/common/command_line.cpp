@@ -29,17 +29,21 @@ namespace command_line
 
   const arg_descriptor<bool>        arg_disable_upnp  ( "disable-upnp", "Disable UPnP (enhances local network privacy)");
   const arg_descriptor<bool>        arg_disable_ntp  ( "disable-ntp", "Disable NTP, could enhance to time synchronization issue but increase network privacy, consider using disable-stop-if-time-out-of-sync with it");
+  const arg_descriptor<bool>        arg_p2p_compression  ( "p2p-compression", "Ask peers to compress big p2p messages (e.g. blocks during sync), saves bandwidth at the cost of some CPU");
+  const arg_descriptor<bool>        arg_early_block_relay  ( "early-block-relay", "Relay a new block extending the top once its PoW or PoS kernel is checked, while it's fully verified; lowers propagation latency");
 
   const arg_descriptor<bool>        arg_disable_stop_if_time_out_of_sync  ( "disable-stop-if-time-out-of-sync", "Do not stop the daemon if serious time synchronization problem is detected");
   const arg_descriptor<bool>        arg_disable_stop_on_low_free_space    ( "disable-stop-on-low-free-space", "Do not stop the daemon if free space at data dir is critically low");
   const arg_descriptor<bool>        arg_enable_offers_service  ( "enable-offers-service", "Enables marketplace feature", false);
   const arg_descriptor<std::string> arg_db_engine              ( "db-engine", "Specify database engine for storage. May be \"lmdb\"(default) or \"mdbx\"", ARG_DB_ENGINE_LMDB );
+  const arg_descriptor<std::string> arg_db_secondary_of        ( "db-secondary-of", "Run as a read-only secondary instance over the blockchain db of a primary daemon with the given data dir: no p2p, no writes, new blocks of the primary are followed");
 
   const arg_descriptor<bool>        arg_no_predownload        ( "no-predownload", "Do not pre-download blockchain database");
   const arg_descriptor<bool>        arg_force_predownload     ( "force-predownload", "Pre-download blockchain database regardless of it's status");
   const arg_descriptor<std::string> arg_process_predownload_from_path("predownload-from-local-path", "Instead of downloading file use downloaded local file");
   const arg_descriptor<bool>        arg_validate_predownload  ( "validate-predownload", "Paranoid mode, re-validate each block from pre-downloaded database and rebuild own database");
   const arg_descriptor<std::string> arg_predownload_link      ( "predownload-link", "Override url for blockchain database pre-downloading");
+  const arg_descriptor<std::string> arg_import_bootstrap_file ( "import-bootstrap-file", "Import blocks from the given bootstrap file (made by export_bootstrap command) before connecting to the network");
 
   const arg_descriptor<std::string> arg_deeplink  ( "deeplink-params", "Deeplink parameter, in that case app just forward params to running app");
 
@@ -223,15 +223,19 @@ namespace command_line
   //extern const arg_descriptor<bool>        arg_show_rpc_autodoc;
   extern const arg_descriptor<bool>        arg_disable_upnp;
   extern const arg_descriptor<bool>        arg_disable_ntp;
+  extern const arg_descriptor<bool>        arg_p2p_compression;
+  extern const arg_descriptor<bool>        arg_early_block_relay;
   extern const arg_descriptor<bool>        arg_disable_stop_if_time_out_of_sync;
   extern const arg_descriptor<bool>        arg_disable_stop_on_low_free_space;
   extern const arg_descriptor<bool>        arg_enable_offers_service;
   extern const arg_descriptor<std::string> arg_db_engine;
+  extern const arg_descriptor<std::string> arg_db_secondary_of;
   extern const arg_descriptor<bool>        arg_no_predownload;
   extern const arg_descriptor<bool>        arg_force_predownload;
   extern const arg_descriptor<std::string> arg_process_predownload_from_path;
   extern const arg_descriptor<bool>        arg_validate_predownload;
   extern const arg_descriptor<std::string> arg_predownload_link;
+  extern const arg_descriptor<std::string> arg_import_bootstrap_file;
   extern const arg_descriptor<std::string> arg_deeplink;
   extern const arg_descriptor<std::string> arg_generate_rpc_autodoc;
   
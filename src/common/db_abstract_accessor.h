@@ -7,6 +7,7 @@
 #pragma once
 #include <unordered_map>
 #include <set>
+#include <algorithm>
 #include <atomic>
 #include "include_base_utils.h"
 
@@ -54,11 +55,41 @@ namespace tools
       k.assign((const char*)pkey, static_cast<size_t>(ks));
     }
 
+    template<class t_cb>
+    struct value_view_callback : public i_db_value_view_callback
+    {
+      t_cb m_cb;
+      value_view_callback(t_cb cb) : m_cb(cb) {}
+      bool on_value(const void* pv, uint64_t vs) override { return m_cb(pv, vs); }
+    };
+
+    template<class t_cb>
+    value_view_callback<t_cb> make_value_view_callback(t_cb cb)
+    {
+      return value_view_callback<t_cb>(cb);
+    }
+
+    template<class t_cb>
+    struct values_view_callback : public i_db_values_view_callback
+    {
+      t_cb m_cb;
+      values_view_callback(t_cb cb) : m_cb(cb) {}
+      bool on_value(size_t key_index, const void* pv, uint64_t vs) override { return m_cb(key_index, pv, vs); }
+    };
+
+    template<class t_cb>
+    values_view_callback<t_cb> make_values_view_callback(t_cb cb)
+    {
+      return values_view_callback<t_cb>(cb);
+    }
+
     struct i_db_parent_to_container_callabck
     {
       virtual bool on_write_transaction_begin(){ return true; }
+      virtual bool on_write_transaction_before_commit(){ return true; } // outermost write tx is about to be committed
       virtual bool on_write_transaction_commit(){ return true; }
       virtual bool on_write_transaction_abort(){ return true; }
+      virtual bool on_write_transaction_nested_abort(){ return true; } // nested tx aborted, outer write tx is still in progress
     };
 
 
@@ -160,6 +191,7 @@ namespace tools
       }
       void commit_transaction()
       {
+        TRACE_SCOPE("db", "commit_transaction");
         bool r = false;
         bool is_writer_tx = false;
         {
@@ -174,6 +206,18 @@ namespace tools
 
         {
           CRITICAL_REGION_LOCAL(m_transactions_stack_lock);
+          if (is_writer_tx)
+          {
+            std::vector<bool>& this_thread_tx_stack = m_transactions_stack[std::this_thread::get_id()];
+            if (std::count(this_thread_tx_stack.begin(), this_thread_tx_stack.end(), false) == 1)
+            {
+              for (auto cnt_ptr : m_binded_containers)
+              {
+                cnt_ptr->on_write_transaction_before_commit();
+              }
+            }
+          }
+
           r = m_backend->commit_transaction(); //commit first and then switch cache isolation off (via on_write_transaction_commit() below)
 
           std::vector<bool>& this_thread_tx_stack = m_transactions_stack[std::this_thread::get_id()];
@@ -226,6 +270,14 @@ namespace tools
               cnt_ptr->on_write_transaction_abort(); // will cause cache isolation to be switched off
             }
           }
+          else
+          {
+            LOG_PRINT_CYAN("[WRITE_TX_NESTED_ABORT]", LOG_LEVEL_2);
+            for (auto cnt_ptr : m_binded_containers)
+            {
+              cnt_ptr->on_write_transaction_nested_abort(); // caches may contain values written by the aborted tx
+            }
+          }
         }
 
         if (is_writer_tx)
@@ -284,24 +336,33 @@ namespace tools
           return false;
         performance_data& m_performance_data = m_gperformance_data;
         //TRY_ENTRY();
-        std::string res_buff;
         size_t sk = 0;
         const char* pk = key_to_ptr(k, sk);
 
+        // deserialize right from the db memory, without copying the value
+        auto cb = make_value_view_callback([&](const void* pv, uint64_t vs)
+        {
+          TIME_MEASURE_START_PD(get_serialize_t_time);
+          bool r = t_unserializable_object_from_blob(obj, pv, static_cast<size_t>(vs));
+          TIME_MEASURE_FINISH_PD(get_serialize_t_time);
+          return r;
+        });
+
         TIME_MEASURE_START_PD(backend_get_t_time);
-        if (!m_backend->get(h, pk, sk, res_buff))
-          return false;
+        bool res = m_backend->get_view(h, pk, sk, cb);
         TIME_MEASURE_FINISH_PD(backend_get_t_time);
 
-
-        TIME_MEASURE_START_PD(get_serialize_t_time);
-        bool res = t_unserializable_object_from_blob(obj, res_buff);
-        TIME_MEASURE_FINISH_PD(get_serialize_t_time);
-
         return res;
         //CATCH_ENTRY_L0("get_t_object_from_db", false);
       }
 
+      bool get_multiple_views(container_handle h, const std::vector<db_key_ref>& keys, i_db_values_view_callback& cb) const
+      {
+        if (!m_is_open)
+          return false;
+        return m_backend->get_multiple_views(h, keys, cb);
+      }
+
       bool clear(container_handle h)
       {
         return m_backend->clear(h);
@@ -333,21 +394,21 @@ namespace tools
         performance_data& m_performance_data = m_gperformance_data;
 
         //TRY_ENTRY();
-        std::string res_buff;
         size_t sk = 0;
         const char* pk = key_to_ptr(k, sk);
 
+        auto cb = make_value_view_callback([&](const void* pv, uint64_t vs)
+        {
+          CHECK_AND_ASSERT_MES(sizeof(t_pod_object) == vs, false, "sizes missmath at get_pod_object_from_db(). returned size = "
+            << vs << "expected: " << sizeof(t_pod_object));
+          memcpy(&obj, pv, sizeof(t_pod_object)); // db memory is not guaranteed to be aligned
+          return true;
+        });
+
         TIME_MEASURE_START_PD(backend_get_pod_time);
-        if (!m_backend->get(h, pk, sk, res_buff))
-          return false;
+        bool res = m_backend->get_view(h, pk, sk, cb);
         TIME_MEASURE_FINISH_PD(backend_get_pod_time);
-
-
-        CHECK_AND_ASSERT_MES(sizeof(t_pod_object) == res_buff.size(), false, "sizes missmath at get_pod_object_from_db(). returned size = "
-          << res_buff.size() << "expected: " << sizeof(t_pod_object));
-
-        obj = *(t_pod_object*)res_buff.data();
-        return true;
+        return res;
         //CATCH_ENTRY_L0("get_t_object_from_db", false);
       }
 
@@ -387,6 +448,12 @@ namespace tools
         return true;
       }
 
+      template<class t_value>
+      static uint64_t get_value_memory_size(const t_value& v)
+      {
+        return sizeof(t_value);
+      }
+
       template<class t_key, class t_value>
       static void set(container_handle h, basic_db_accessor& bdb, const t_key& k, const t_value& v)
       {
@@ -397,14 +464,10 @@ namespace tools
       static std::shared_ptr<const t_value> get(container_handle h, basic_db_accessor& bdb, const t_key& k)
       {
         static_assert(std::is_pod<t_value>::value, "t_value must be a POD type.");
-        std::shared_ptr<const t_value> res(nullptr);
-        t_value v = AUTO_VAL_INIT(v);
-        if (bdb.get_pod_object(h, k, v))
-        {
-          //TODO: remove one extra copy
-          res.reset(new t_value(v));
-        }
-        return res;
+        std::shared_ptr<t_value> pv = std::make_shared<t_value>(); // value-initialized
+        if (!bdb.get_pod_object(h, k, *pv))
+          return nullptr;
+        return pv;
       }
     };
 
@@ -417,8 +480,16 @@ namespace tools
       template<class t_value>
       static bool from_buff_to_obj(const void* pv, uint64_t vs, t_value& v)
       {
-        std::string src_blob((const char*)pv, static_cast<size_t>(vs));
-        return t_unserializable_object_from_blob(v, src_blob);//::t_serializable_object_to_blob(v, res_buff);
+        return t_unserializable_object_from_blob(v, pv, static_cast<size_t>(vs));
+      }
+
+      // the serialized size stands for the size of the dynamic parts
+      template<class t_value>
+      static uint64_t get_value_memory_size(const t_value& v)
+      {
+        std::string blob;
+        ::t_serializable_object_to_blob(v, blob);
+        return sizeof(t_value) + blob.size();
       }
 
 
@@ -431,14 +502,10 @@ namespace tools
       template<class t_key, class t_value>
       static std::shared_ptr<const t_value> get(container_handle h, basic_db_accessor& bdb, const t_key& k)
       {
-        std::shared_ptr<const t_value> res(nullptr);
-        t_value v = AUTO_VAL_INIT(v);
-        if (bdb.get_t_object(h, k, v))
-        {
-          //TODO: remove one extra copy
-          res.reset(new t_value(v));
-        }
-        return res;
+        std::shared_ptr<t_value> pv = std::make_shared<t_value>(); // value-initialized
+        if (!bdb.get_t_object(h, k, *pv))
+          return nullptr;
+        return pv;
       }
     };
 
@@ -541,6 +608,11 @@ namespace tools
         m_isolation.reset_isolation_mode();
         return true;
       }
+      virtual bool on_write_transaction_nested_abort()
+      {
+        size_cache_valid = false;
+        return true;
+      }
 
       bool begin_transaction(bool read_only = false)
       {
@@ -639,6 +711,34 @@ namespace tools
         return access_strategy_selector<is_t_access_strategy>::template get<t_key, t_value>(m_h, bdb, k);
       }
 
+      // results[i] is set to the value for keys[i], or to nullptr if there's no such key
+      void get_multiple(const std::vector<t_key>& keys, std::vector<std::shared_ptr<const t_value> >& results) const
+      {
+        results.assign(keys.size(), nullptr);
+        std::vector<size_t> indices(keys.size());
+        for (size_t i = 0; i != indices.size(); ++i)
+          indices[i] = i;
+        get_multiple_from_db(keys, indices, results);
+      }
+
+      // the same for keys[indices[i]] only, other results are left untouched
+      void get_multiple_from_db(const std::vector<t_key>& keys, const std::vector<size_t>& indices, std::vector<std::shared_ptr<const t_value> >& results) const
+      {
+        PROFILE_FUNC_ACC(m_get_profiler);
+        std::vector<db_key_ref> key_refs(indices.size());
+        for (size_t i = 0; i != indices.size(); ++i)
+          key_refs[i].pk = key_to_ptr(keys[indices[i]], key_refs[i].ks);
+
+        auto cb = make_values_view_callback([&](size_t key_index, const void* pv, uint64_t vs)
+        {
+          std::shared_ptr<t_value> pval = std::make_shared<t_value>(); // value-initialized
+          if (access_strategy_selector<is_t_access_strategy>::from_buff_to_obj(pv, vs, *pval))
+            results[indices[key_index]] = pval;
+          return true;
+        });
+        bdb.get_multiple_views(m_h, key_refs, cb);
+      }
+
       //find() and end() aliases for make easier porting std stuff
       std::shared_ptr<const t_value> find(const t_key& k) const
       {
@@ -724,18 +824,40 @@ namespace tools
       typedef basic_key_value_accessor<t_key, t_value, is_t_access_strategy> base_class;
 
       
-      typedef epee::misc_utils::cache_with_write_isolation<is_ordered_type, t_key, std::shared_ptr<const t_value>, 10000> cache_container_type;
+      typedef epee::misc_utils::sharded_cache_with_write_isolation<is_ordered_type, t_key, std::shared_ptr<const t_value>, 10000> cache_container_type;
       //typedef epee::misc_utils::cache_dummy<is_ordered_type, t_key, std::shared_ptr<const t_value>, 100000> cache_container_type;
       mutable cache_container_type m_cache;
 
 
+      virtual bool on_write_transaction_begin()
+      {
+        m_cache.abort(); // make sure nothing is left staged
+        return base_class::on_write_transaction_begin();
+      }
+      virtual bool on_write_transaction_before_commit()
+      {
+        m_cache.before_commit();
+        return base_class::on_write_transaction_before_commit();
+      }
+      virtual bool on_write_transaction_commit()
+      {
+        m_cache.commit();
+        return base_class::on_write_transaction_commit();
+      }
       virtual bool on_write_transaction_abort()
       {
-        clear_cache();
+        m_cache.abort();
         return base_class::on_write_transaction_abort();
       }
+      virtual bool on_write_transaction_nested_abort()
+      {
+        m_cache.nested_abort();
+        return base_class::on_write_transaction_nested_abort();
+      }
 
     public:
+      typedef typename cache_container_type::shard_stats cache_shard_stats;
+
       struct performance_data
       {
         epee::math_helper::average<uint64_t, 1000> hit_percent;
@@ -795,18 +917,55 @@ namespace tools
         }
         m_performance_data.hit_percent.push(0);
 
+        uint64_t cache_generation = m_cache.get_generation();
         TIME_MEASURE_START_PD(read_db_microsec);
         res = base_class::get(k);
         TIME_MEASURE_FINISH_PD(read_db_microsec);
         if (res)
         {
           TIME_MEASURE_START_PD(update_cache_microsec);
-          m_cache.set(k, res);
+          m_cache.fill(k, res, cache_generation);
           TIME_MEASURE_FINISH_PD(update_cache_microsec);
         }          
         return res;
       }
 
+      // cache hits are resolved first, the rest is read from the db with one cursor pass
+      void get_multiple(const std::vector<t_key>& keys, std::vector<std::shared_ptr<const t_value> >& results) const
+      {
+        results.assign(keys.size(), nullptr);
+        std::vector<size_t> misses;
+        TIME_MEASURE_START_PD(read_cache_microsec);
+        for (size_t i = 0; i != keys.size(); ++i)
+        {
+          if (m_cache.get(keys[i], results[i]))
+          {
+            m_performance_data.hit_percent.push(100);
+          }
+          else
+          {
+            m_performance_data.hit_percent.push(0);
+            misses.push_back(i);
+          }
+        }
+        TIME_MEASURE_FINISH_PD(read_cache_microsec);
+        if (misses.empty())
+          return;
+
+        uint64_t cache_generation = m_cache.get_generation();
+        TIME_MEASURE_START_PD(read_db_microsec);
+        base_class::get_multiple_from_db(keys, misses, results);
+        TIME_MEASURE_FINISH_PD(read_db_microsec);
+
+        TIME_MEASURE_START_PD(update_cache_microsec);
+        for (size_t i : misses)
+        {
+          if (results[i])
+            m_cache.fill(keys[i], results[i], cache_generation);
+        }
+        TIME_MEASURE_FINISH_PD(update_cache_microsec);
+      }
+
       size_t clear()
       {
         m_cache.clear();
@@ -836,6 +995,20 @@ namespace tools
       {
         return m_performance_data;
       }
+      void get_cache_shards_stats(std::vector<cache_shard_stats>& stats) const
+      {
+        m_cache.get_shards_stats(stats);
+      }
+      // approximate memory taken by the cached values, the sizes of a few most recent values of each shard are extrapolated
+      uint64_t get_cache_estimated_bytes(size_t max_samples_per_shard = 8) const
+      {
+        return m_cache.estimate_bytes(max_samples_per_shard, [](const t_key& k, const std::shared_ptr<const t_value>& v) -> uint64_t
+        {
+          // map and lru list nodes, shared_ptr control block
+          const uint64_t entry_overhead = 2 * sizeof(t_key) + sizeof(std::shared_ptr<const t_value>) + 8 * sizeof(void*);
+          return entry_overhead + (v ? access_strategy_selector<is_t_access_strategy>::get_value_memory_size(*v) : 0);
+        });
+      }
       typename basic_db_accessor::performance_data& get_performance_data_native() const
       {
         return base_class::bdb.get_performance_data_for_handle(base_class::m_h);
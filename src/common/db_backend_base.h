@@ -4,6 +4,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #pragma once
+#include <string>
+#include <vector>
+#include <cstring>
 
 #ifndef ENV32BIT
 #define CACHE_SIZE uint64_t(uint64_t(1UL * 128UL) * 1024UL * 1024UL * 1024UL)
@@ -23,11 +26,37 @@ namespace tools
       virtual bool on_enum_item(uint64_t i, const void* pkey, uint64_t ks, const void* pval, uint64_t vs) = 0;
     };
 
+    struct i_db_value_view_callback
+    {
+      // pv points directly to the db memory and stays valid only during this call
+      virtual bool on_value(const void* pv, uint64_t vs) = 0;
+    };
+
+    struct i_db_values_view_callback
+    {
+      // called for found keys only, key_index is an index in the keys array passed to get_multiple_views()
+      virtual bool on_value(size_t key_index, const void* pv, uint64_t vs) = 0;
+    };
+
+    struct db_key_ref
+    {
+      const char* pk;
+      size_t ks;
+    };
+
+    // order of keys in db containers (default lmdb/mdbx comparator: lexicographical, shorter first)
+    inline bool db_key_ref_less(const db_key_ref& lhs, const db_key_ref& rhs)
+    {
+      int r = memcmp(lhs.pk, rhs.pk, lhs.ks < rhs.ks ? lhs.ks : rhs.ks);
+      return r != 0 ? r < 0 : lhs.ks < rhs.ks;
+    }
+
     struct stat_info
     {
       uint64_t tx_count;
       uint64_t write_tx_count;
       uint64_t map_size;
+      uint64_t last_tx_id;    // id of the last committed write transaction, 0 if not supported
     };
 
     struct i_db_backend
@@ -42,11 +71,36 @@ namespace tools
       virtual bool erase(container_handle h, const char* k, size_t s) = 0;
       virtual uint64_t size(container_handle h) = 0;
       virtual bool get(container_handle h, const char* k, size_t s, std::string& res_buff) = 0;
+      // zero-copy get: returns false if there's no such key, otherwise the result of cb.on_value()
+      virtual bool get_view(container_handle h, const char* k, size_t s, i_db_value_view_callback& cb)
+      {
+        std::string res_buff;
+        if (!get(h, k, s, res_buff))
+          return false;
+        return cb.on_value(res_buff.data(), res_buff.size());
+      }
+      // bulk zero-copy get, walks the keys in the db order; returns false on db error or if cb.on_value() returned false
+      virtual bool get_multiple_views(container_handle h, const std::vector<db_key_ref>& keys, i_db_values_view_callback& cb)
+      {
+        for (size_t i = 0; i != keys.size(); ++i)
+        {
+          std::string res_buff;
+          if (get(h, keys[i].pk, keys[i].ks, res_buff) && !cb.on_value(i, res_buff.data(), res_buff.size()))
+            return false;
+        }
+        return true;
+      }
       virtual bool set(container_handle h, const char* k, size_t s, const char* v, size_t vs) = 0;
       virtual bool clear(container_handle h) = 0;
       virtual bool enumerate(container_handle h, i_db_callback* pcb)=0;
       virtual bool get_stat_info(stat_info& si) = 0;
       virtual const char* name()=0;
+      // online compaction (optional): copy_compacted() writes a consistent compacted snapshot of the whole storage to an empty
+      // folder without blocking writers; replace_storage() swaps it in place of the current storage, no transactions may be open
+      virtual bool copy_compacted(const std::string& target_folder) { return false; }
+      virtual bool replace_storage(const std::string& source_folder) { return false; }
+      // read-only mode (optional): the storage may be shared with another process which writes it; to be called before open()
+      virtual bool set_read_only(bool read_only) { return !read_only; }
       virtual ~i_db_backend(){};
     };
   }
@@ -8,6 +8,7 @@
 #include "string_coding.h"
 #include "profile_tools.h"
 #include "util.h"
+#include <algorithm>
 
 #define BUF_SIZE 1024
 
@@ -23,7 +24,7 @@ namespace tools
 {
   namespace db
   {
-    lmdb_db_backend::lmdb_db_backend() : m_penv(AUTO_VAL_INIT(m_penv))  
+    lmdb_db_backend::lmdb_db_backend() : m_penv(AUTO_VAL_INIT(m_penv)), m_cache_sz(0), m_read_only(false)  
     {
 
     }
@@ -49,9 +50,17 @@ namespace tools
       CHECK_AND_ASSERT_MESS_LMDB_DB(res, false, "Unable to mdb_env_set_mapsize");
       
       m_path = path_;
-      CHECK_AND_ASSERT_MES(tools::create_directories_if_necessary(m_path), false, "create_directories_if_necessary failed: " << m_path);
+      m_cache_sz = cache_sz;
+      if (m_read_only)
+      {
+        CHECK_AND_ASSERT_MES(boost::filesystem::exists(epee::string_encoding::utf8_to_wstring(m_path)), false, "db folder not found: " << m_path);
+      }
+      else
+      {
+        CHECK_AND_ASSERT_MES(tools::create_directories_if_necessary(m_path), false, "create_directories_if_necessary failed: " << m_path);
+      }
 
-      res = mdb_env_open(m_penv, m_path.c_str(), MDB_NORDAHEAD , 0644);
+      res = mdb_env_open(m_penv, m_path.c_str(), MDB_NORDAHEAD | (m_read_only ? MDB_RDONLY : 0), 0644);
       CHECK_AND_ASSERT_MESS_LMDB_DB(res, false, "Unable to mdb_env_open, m_path=" << m_path);
       
       return true;
@@ -60,11 +69,12 @@ namespace tools
     bool lmdb_db_backend::open_container(const std::string& name, container_handle& h)
     {
       MDB_dbi dbi = AUTO_VAL_INIT(dbi);
-      begin_transaction();
-      int res = mdb_dbi_open(get_current_tx(), name.c_str(), MDB_CREATE, &dbi);
+      begin_transaction(m_read_only);
+      int res = mdb_dbi_open(get_current_tx(), name.c_str(), m_read_only ? 0 : MDB_CREATE, &dbi);
       CHECK_AND_ASSERT_MESS_LMDB_DB(res, false, "Unable to mdb_dbi_open with container name: " << name);
       commit_transaction();
       h = static_cast<container_handle>(dbi);
+      m_containers[h] = name;
       return true;
     }
 
@@ -73,9 +83,10 @@ namespace tools
       static const container_handle null_handle = AUTO_VAL_INIT(null_handle);
       CHECK_AND_ASSERT_MES(h != null_handle, false, "close_container is called for null container handle");
       MDB_dbi dbi = static_cast<MDB_dbi>(h);
-      begin_transaction();
+      begin_transaction(m_read_only);
       mdb_dbi_close(m_penv, dbi);
       commit_transaction();
+      m_containers.erase(h);
       h = null_handle;
       return true;
     }
@@ -110,6 +121,7 @@ namespace tools
     {
       if (!read_only)
       {
+        CHECK_AND_ASSERT_THROW_MES(!m_read_only, "[DB " << m_path << "] write transaction requested while the db is opened read-only");
         LOG_PRINT_CYAN("[DB " << m_path << "] WRITE LOCKED", LOG_LEVEL_3);
         CRITICAL_SECTION_LOCK(m_write_exclusive_lock);
       }
@@ -301,6 +313,111 @@ namespace tools
       return true;
     }
 
+    bool lmdb_db_backend::get_view(container_handle h, const char* k, size_t ks, i_db_value_view_callback& cb)
+    {
+      PROFILE_FUNC("lmdb_db_backend::get_view");
+      int res = 0;
+      MDB_val key = AUTO_VAL_INIT(key);
+      MDB_val data = AUTO_VAL_INIT(data);
+      key.mv_data = (void*)k;
+      key.mv_size = ks;
+      bool need_to_commit = false;
+      if (!have_tx())
+      {
+        need_to_commit = true;
+        begin_transaction(true);
+      }
+
+      // data points to the memory map, so the callback should be called while the transaction is alive
+      bool r = false;
+      try
+      {
+        res = mdb_get(get_current_tx(), static_cast<MDB_dbi>(h), &key, &data);
+        if (res == MDB_SUCCESS)
+          r = cb.on_value(data.mv_data, data.mv_size);
+      }
+      catch (...)
+      {
+        if (need_to_commit)
+          commit_transaction();
+        throw;
+      }
+
+      if (need_to_commit)
+        commit_transaction();
+
+      if (res == MDB_NOTFOUND)
+        return false;
+
+      CHECK_AND_ASSERT_MESS_LMDB_DB(res, false, "Unable to mdb_get, h: " << h << ", ks: " << ks);
+      return r;
+    }
+
+    bool lmdb_db_backend::get_multiple_views(container_handle h, const std::vector<db_key_ref>& keys, i_db_values_view_callback& cb)
+    {
+      PROFILE_FUNC("lmdb_db_backend::get_multiple_views");
+      if (keys.empty())
+        return true;
+
+      // walk the keys in the db order, so the cursor mostly moves forward over adjacent pages
+      std::vector<size_t> order(keys.size());
+      for (size_t i = 0; i != order.size(); ++i)
+        order[i] = i;
+      std::sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return db_key_ref_less(keys[a], keys[b]); });
+
+      bool need_to_commit = false;
+      if (!have_tx())
+      {
+        need_to_commit = true;
+        begin_transaction(true);
+      }
+
+      bool r = true;
+      MDB_cursor* cursor_ptr = nullptr;
+      try
+      {
+        int res = mdb_cursor_open(get_current_tx(), static_cast<MDB_dbi>(h), &cursor_ptr);
+        if (res != MDB_SUCCESS || !cursor_ptr)
+        {
+          LOG_ERROR("Unable to mdb_cursor_open, error " << res);
+          r = false;
+        }
+
+        for (size_t i = 0; r && i != order.size(); ++i)
+        {
+          const db_key_ref& k = keys[order[i]];
+          MDB_val key = AUTO_VAL_INIT(key);
+          MDB_val data = AUTO_VAL_INIT(data);
+          key.mv_data = (void*)k.pk;
+          key.mv_size = k.ks;
+          res = mdb_cursor_get(cursor_ptr, &key, &data, MDB_SET);
+          if (res == MDB_NOTFOUND)
+            continue;
+          if (res != MDB_SUCCESS)
+          {
+            LOG_ERROR("Unable to mdb_cursor_get, error " << res);
+            r = false;
+            break;
+          }
+          r = cb.on_value(order[i], data.mv_data, data.mv_size);
+        }
+      }
+      catch (...)
+      {
+        if (cursor_ptr)
+          mdb_cursor_close(cursor_ptr);
+        if (need_to_commit)
+          commit_transaction();
+        throw;
+      }
+
+      if (cursor_ptr)
+        mdb_cursor_close(cursor_ptr);
+      if (need_to_commit)
+        commit_transaction();
+      return r;
+    }
+
     bool lmdb_db_backend::clear(container_handle h)
     {
       int res = mdb_drop(get_current_tx(), static_cast<MDB_dbi>(h), 0);
@@ -381,6 +498,7 @@ namespace tools
       MDB_envinfo ei = AUTO_VAL_INIT(ei);
       mdb_env_info(m_penv, &ei);
       si.map_size = ei.me_mapsize;
+      si.last_tx_id = ei.me_last_txnid;
       
       std::lock_guard<boost::recursive_mutex> lock(m_cs);
       for (auto& e : m_txs)
@@ -394,6 +512,82 @@ namespace tools
       }
       return true;
     }
+    bool lmdb_db_backend::copy_compacted(const std::string& target_folder)
+    {
+      CHECK_AND_ASSERT_MES(m_penv, false, "m_penv==null, db closed");
+      CHECK_AND_ASSERT_MES(tools::create_directories_if_necessary(target_folder), false, "create_directories_if_necessary failed: " << target_folder);
+      // uses its own read-only transaction, so writers may proceed meanwhile
+      int res = mdb_env_copy2(m_penv, target_folder.c_str(), MDB_CP_COMPACT);
+      CHECK_AND_ASSERT_MESS_LMDB_DB(res, false, "Unable to mdb_env_copy2 to " << target_folder);
+      return true;
+    }
+
+    bool lmdb_db_backend::reopen_storage()
+    {
+      std::map<container_handle, std::string> containers;
+      containers.swap(m_containers);
+      if (!open(m_path, m_cache_sz))
+        return false;
+      // handles are kept by the containers' accessors, so containers must get the very same handles
+      for (auto& c : containers)
+      {
+        container_handle h = AUTO_VAL_INIT(h);
+        CHECK_AND_ASSERT_MES(open_container(c.second, h), false, "Unable to reopen container " << c.second);
+        CHECK_AND_ASSERT_MES(h == c.first, false, "container " << c.second << " got handle " << h << " after reopening, expected: " << c.first);
+      }
+      return true;
+    }
+
+    bool lmdb_db_backend::replace_storage(const std::string& source_folder)
+    {
+      CRITICAL_REGION_LOCAL(m_write_exclusive_lock);
+      std::lock_guard<boost::recursive_mutex> lock(m_cs); // new transactions wait on this until the storage is reopened
+      CHECK_AND_ASSERT_MES(m_penv, false, "m_penv==null, db closed");
+      for (auto& e : m_txs)
+      {
+        CHECK_AND_ASSERT_MES(e.second.empty(), false, "replace_storage called while a transaction is open");
+      }
+
+      const boost::filesystem::path data_file = epee::string_encoding::utf8_to_wstring(m_path + "/data.mdb");
+      const boost::filesystem::path backup_file = epee::string_encoding::utf8_to_wstring(m_path + "/data.mdb.old");
+      const boost::filesystem::path new_data_file = epee::string_encoding::utf8_to_wstring(source_folder + "/data.mdb");
+      CHECK_AND_ASSERT_MES(boost::filesystem::exists(new_data_file), false, "file not found: " << new_data_file.string());
+
+      std::map<container_handle, std::string> containers = m_containers;
+      mdb_env_close(m_penv);
+      m_penv = nullptr;
+      m_txs.clear();
+
+      boost::system::error_code ec;
+      boost::filesystem::rename(data_file, backup_file, ec);
+      if (!ec)
+        boost::filesystem::rename(new_data_file, data_file, ec);
+      if (ec || !reopen_storage())
+      {
+        LOG_ERROR("[DB " << m_path << "] failed to replace storage with " << source_folder << (ec ? ": " + ec.message() : std::string()) << ", restoring");
+        if (m_penv)
+        {
+          mdb_env_close(m_penv);
+          m_penv = nullptr;
+        }
+        m_containers = containers;
+        if (boost::filesystem::exists(backup_file))
+          boost::filesystem::rename(backup_file, data_file, ec);
+        CHECK_AND_ASSERT_THROW_MES(reopen_storage(), "[DB " << m_path << "] unable to reopen the original storage");
+        return false;
+      }
+
+      boost::filesystem::remove(backup_file, ec);
+      return true;
+    }
+
+    bool lmdb_db_backend::set_read_only(bool read_only)
+    {
+      CHECK_AND_ASSERT_MES(!m_penv, false, "set_read_only must be called before open()");
+      m_read_only = read_only;
+      return true;
+    }
+
     const char* lmdb_db_backend::name()
     {
       return "lmdb";
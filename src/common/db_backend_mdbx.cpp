@@ -8,6 +8,7 @@
 #include "string_coding.h"
 #include "profile_tools.h"
 #include "util.h"
+#include <algorithm>
 
 
 #define BUF_SIZE 1024
@@ -24,7 +25,7 @@ namespace tools
 {
   namespace db
   {
-    mdbx_db_backend::mdbx_db_backend() : m_penv(AUTO_VAL_INIT(m_penv))  
+    mdbx_db_backend::mdbx_db_backend() : m_penv(AUTO_VAL_INIT(m_penv)), m_cache_sz(0), m_read_only(false)  
     {
 
     }
@@ -49,16 +50,35 @@ namespace tools
       intptr_t size_lower = 0;
       intptr_t size_now = -1;            //don't change current database size
       intptr_t size_upper = 0x10000000000;          //don't set db file size limit
-      intptr_t growth_step = 0x40000000; //increment step 1GB
+      intptr_t growth_step = static_cast<intptr_t>(m_settings.growth_step);
       intptr_t shrink_threshold = -1;
-      intptr_t pagesize = 0x00001000;   //4kb
+      intptr_t pagesize = static_cast<intptr_t>(m_settings.page_size); // used only when a new db is created
       res = mdbx_env_set_geometry(m_penv, size_lower, size_now, size_upper, growth_step, shrink_threshold, pagesize);
       CHECK_AND_ASSERT_MESS_MDBX_DB(res, false, "Unable to mdbx_env_set_mapsize");
       
       m_path = path_;
-      CHECK_AND_ASSERT_MES(tools::create_directories_if_necessary(m_path), false, "create_directories_if_necessary failed: " << m_path);
+      m_cache_sz = cache_sz;
+      if (m_read_only)
+      {
+        CHECK_AND_ASSERT_MES(boost::filesystem::exists(epee::string_encoding::utf8_to_wstring(m_path)), false, "db folder not found: " << m_path);
+      }
+      else
+      {
+        CHECK_AND_ASSERT_MES(tools::create_directories_if_necessary(m_path), false, "create_directories_if_necessary failed: " << m_path);
+      }
 
-      res = mdbx_env_open(m_penv, m_path.c_str(), MDBX_NORDAHEAD , 0644);
+      unsigned int flags = 0;
+      if (!m_settings.readahead)
+        flags |= MDBX_NORDAHEAD;
+      if (m_settings.coalesce)
+        flags |= MDBX_COALESCE;
+      if (m_settings.sync_mode == mdbx_settings::sync_no_meta_sync)
+        flags |= MDBX_NOMETASYNC;   // a system crash may roll back the last committed txs, the db stays consistent
+      else if (m_settings.sync_mode == mdbx_settings::sync_safe_no_sync)
+        flags |= MDBX_NOSYNC;       // data is flushed by the OS only, a system crash may roll back to the last steady commit
+      if (m_read_only)
+        flags |= MDBX_RDONLY;
+      res = mdbx_env_open(m_penv, m_path.c_str(), flags, 0644);
       CHECK_AND_ASSERT_MESS_MDBX_DB(res, false, "Unable to mdbx_env_open, m_path=" << m_path);
       
       return true;
@@ -67,11 +87,12 @@ namespace tools
     bool mdbx_db_backend::open_container(const std::string& name, container_handle& h)
     {
       MDBX_dbi dbi = AUTO_VAL_INIT(dbi);
-      begin_transaction();
-      int res = mdbx_dbi_open(get_current_tx(), name.c_str(), MDBX_CREATE, &dbi);
+      begin_transaction(m_read_only);
+      int res = mdbx_dbi_open(get_current_tx(), name.c_str(), m_read_only ? 0 : MDBX_CREATE, &dbi);
       CHECK_AND_ASSERT_MESS_MDBX_DB(res, false, "Unable to mdbx_dbi_open with container name: " << name);
       commit_transaction();
       h = static_cast<container_handle>(dbi);
+      m_containers[h] = name;
       return true;
     }
 
@@ -81,9 +102,10 @@ namespace tools
       CHECK_AND_ASSERT_MES(h != null_handle, false, "close_container is called for null container handle");
 
       MDBX_dbi dbi = static_cast<MDBX_dbi>(h);
-      begin_transaction();
+      begin_transaction(m_read_only);
       mdbx_dbi_close(m_penv, dbi);
       commit_transaction();
+      m_containers.erase(h);
       h = null_handle;
       return true;
     }
@@ -118,6 +140,7 @@ namespace tools
     {
       if (!read_only)
       {
+        CHECK_AND_ASSERT_THROW_MES(!m_read_only, "[DB " << m_path << "] write transaction requested while the db is opened read-only");
         LOG_PRINT_CYAN("[DB " << m_path << "] WRITE LOCKED", LOG_LEVEL_3);
         CRITICAL_SECTION_LOCK(m_write_exclusive_lock);
       }
@@ -306,6 +329,111 @@ namespace tools
       return true;
     }
 
+    bool mdbx_db_backend::get_view(container_handle h, const char* k, size_t ks, i_db_value_view_callback& cb)
+    {
+      PROFILE_FUNC("mdbx_db_backend::get_view");
+      int res = 0;
+      MDBX_val key = AUTO_VAL_INIT(key);
+      MDBX_val data = AUTO_VAL_INIT(data);
+      key.iov_base = (void*)k;
+      key.iov_len = ks;
+      bool need_to_commit = false;
+      if (!have_tx())
+      {
+        need_to_commit = true;
+        begin_transaction(true);
+      }
+
+      // data points to the memory map, so the callback should be called while the transaction is alive
+      bool r = false;
+      try
+      {
+        res = mdbx_get(get_current_tx(), static_cast<MDBX_dbi>(h), &key, &data);
+        if (res == MDBX_SUCCESS)
+          r = cb.on_value(data.iov_base, data.iov_len);
+      }
+      catch (...)
+      {
+        if (need_to_commit)
+          commit_transaction();
+        throw;
+      }
+
+      if (need_to_commit)
+        commit_transaction();
+
+      if (res == MDBX_NOTFOUND)
+        return false;
+
+      CHECK_AND_ASSERT_MESS_MDBX_DB(res, false, "Unable to mdbx_get, h: " << h << ", ks: " << ks);
+      return r;
+    }
+
+    bool mdbx_db_backend::get_multiple_views(container_handle h, const std::vector<db_key_ref>& keys, i_db_values_view_callback& cb)
+    {
+      PROFILE_FUNC("mdbx_db_backend::get_multiple_views");
+      if (keys.empty())
+        return true;
+
+      // walk the keys in the db order, so the cursor mostly moves forward over adjacent pages
+      std::vector<size_t> order(keys.size());
+      for (size_t i = 0; i != order.size(); ++i)
+        order[i] = i;
+      std::sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return db_key_ref_less(keys[a], keys[b]); });
+
+      bool need_to_commit = false;
+      if (!have_tx())
+      {
+        need_to_commit = true;
+        begin_transaction(true);
+      }
+
+      bool r = true;
+      MDBX_cursor* cursor_ptr = nullptr;
+      try
+      {
+        int res = mdbx_cursor_open(get_current_tx(), static_cast<MDBX_dbi>(h), &cursor_ptr);
+        if (res != MDBX_SUCCESS || !cursor_ptr)
+        {
+          LOG_ERROR("Unable to mdbx_cursor_open, error " << res);
+          r = false;
+        }
+
+        for (size_t i = 0; r && i != order.size(); ++i)
+        {
+          const db_key_ref& k = keys[order[i]];
+          MDBX_val key = AUTO_VAL_INIT(key);
+          MDBX_val data = AUTO_VAL_INIT(data);
+          key.iov_base = (void*)k.pk;
+          key.iov_len = k.ks;
+          res = mdbx_cursor_get(cursor_ptr, &key, &data, MDBX_SET);
+          if (res == MDBX_NOTFOUND)
+            continue;
+          if (res != MDBX_SUCCESS)
+          {
+            LOG_ERROR("Unable to mdbx_cursor_get, error " << res);
+            r = false;
+            break;
+          }
+          r = cb.on_value(order[i], data.iov_base, data.iov_len);
+        }
+      }
+      catch (...)
+      {
+        if (cursor_ptr)
+          mdbx_cursor_close(cursor_ptr);
+        if (need_to_commit)
+          commit_transaction();
+        throw;
+      }
+
+      if (cursor_ptr)
+        mdbx_cursor_close(cursor_ptr);
+      if (need_to_commit)
+        commit_transaction();
+      return r;
+    }
+
     bool mdbx_db_backend::clear(container_handle h)
     {
       int res = mdbx_drop(get_current_tx(), static_cast<MDBX_dbi>(h), 0);
@@ -388,6 +516,7 @@ namespace tools
       MDBX_envinfo ei = AUTO_VAL_INIT(ei);
       mdbx_env_info(m_penv, &ei, sizeof(MDBX_envinfo));
       si.map_size = ei.mi_mapsize;
+      si.last_tx_id = ei.mi_recent_txnid;
       
       std::lock_guard<boost::recursive_mutex> lock(m_cs);
       for (auto& e : m_txs)
@@ -401,6 +530,82 @@ namespace tools
       }
       return true;
     }
+    bool mdbx_db_backend::copy_compacted(const std::string& target_folder)
+    {
+      CHECK_AND_ASSERT_MES(m_penv, false, "m_penv==null, db closed");
+      CHECK_AND_ASSERT_MES(tools::create_directories_if_necessary(target_folder), false, "create_directories_if_necessary failed: " << target_folder);
+      // uses its own read-only transaction, so writers may proceed meanwhile
+      int res = mdbx_env_copy(m_penv, target_folder.c_str(), MDBX_CP_COMPACT);
+      CHECK_AND_ASSERT_MESS_MDBX_DB(res, false, "Unable to mdbx_env_copy to " << target_folder);
+      return true;
+    }
+
+    bool mdbx_db_backend::reopen_storage()
+    {
+      std::map<container_handle, std::string> containers;
+      containers.swap(m_containers);
+      if (!open(m_path, m_cache_sz))
+        return false;
+      // handles are kept by the containers' accessors, so containers must get the very same handles
+      for (auto& c : containers)
+      {
+        container_handle h = AUTO_VAL_INIT(h);
+        CHECK_AND_ASSERT_MES(open_container(c.second, h), false, "Unable to reopen container " << c.second);
+        CHECK_AND_ASSERT_MES(h == c.first, false, "container " << c.second << " got handle " << h << " after reopening, expected: " << c.first);
+      }
+      return true;
+    }
+
+    bool mdbx_db_backend::replace_storage(const std::string& source_folder)
+    {
+      CRITICAL_REGION_LOCAL(m_write_exclusive_lock);
+      std::lock_guard<boost::recursive_mutex> lock(m_cs); // new transactions wait on this until the storage is reopened
+      CHECK_AND_ASSERT_MES(m_penv, false, "m_penv==null, db closed");
+      for (auto& e : m_txs)
+      {
+        CHECK_AND_ASSERT_MES(e.second.empty(), false, "replace_storage called while a transaction is open");
+      }
+
+      const boost::filesystem::path data_file = epee::string_encoding::utf8_to_wstring(m_path + "/mdbx.dat");
+      const boost::filesystem::path backup_file = epee::string_encoding::utf8_to_wstring(m_path + "/mdbx.dat.old");
+      const boost::filesystem::path new_data_file = epee::string_encoding::utf8_to_wstring(source_folder + "/mdbx.dat");
+      CHECK_AND_ASSERT_MES(boost::filesystem::exists(new_data_file), false, "file not found: " << new_data_file.string());
+
+      std::map<container_handle, std::string> containers = m_containers;
+      mdbx_env_close(m_penv);
+      m_penv = nullptr;
+      m_txs.clear();
+
+      boost::system::error_code ec;
+      boost::filesystem::rename(data_file, backup_file, ec);
+      if (!ec)
+        boost::filesystem::rename(new_data_file, data_file, ec);
+      if (ec || !reopen_storage())
+      {
+        LOG_ERROR("[DB " << m_path << "] failed to replace storage with " << source_folder << (ec ? ": " + ec.message() : std::string()) << ", restoring");
+        if (m_penv)
+        {
+          mdbx_env_close(m_penv);
+          m_penv = nullptr;
+        }
+        m_containers = containers;
+        if (boost::filesystem::exists(backup_file))
+          boost::filesystem::rename(backup_file, data_file, ec);
+        CHECK_AND_ASSERT_THROW_MES(reopen_storage(), "[DB " << m_path << "] unable to reopen the original storage");
+        return false;
+      }
+
+      boost::filesystem::remove(backup_file, ec);
+      return true;
+    }
+
+    bool mdbx_db_backend::set_read_only(bool read_only)
+    {
+      CHECK_AND_ASSERT_MES(!m_penv, false, "set_read_only must be called before open()");
+      m_read_only = read_only;
+      return true;
+    }
+
     const char* mdbx_db_backend::name()
     {
       return "mdbx";
@@ -4,6 +4,34 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #pragma once
+#include <cstdint>
+
+namespace tools
+{
+  namespace db
+  {
+    // mdbx environment tuning, see --db-mdbx-* command line options
+    struct mdbx_settings
+    {
+      enum sync_mode_t { sync_durable = 0, sync_no_meta_sync, sync_safe_no_sync };
+
+      uint64_t page_size;       // applied only when the db file is created
+      uint64_t growth_step;
+      bool readahead;
+      bool coalesce;            // merge reclaimed GC records, keeps the file smaller at the cost of some write CPU
+      sync_mode_t sync_mode;
+
+      mdbx_settings()
+        : page_size(0x00001000)   // 4kb
+        , growth_step(0x40000000) // 1GB
+        , readahead(false)
+        , coalesce(false)
+        , sync_mode(sync_durable)
+      {}
+    };
+  }
+}
+
 #ifdef ENABLED_ENGINE_MDBX
 #include  <thread>
 
@@ -35,7 +63,12 @@ namespace tools
       boost::recursive_mutex m_cs;
       boost::recursive_mutex m_write_exclusive_lock;
       std::map<std::thread::id, transactions_list> m_txs; // size_t -> count of nested read_only transactions
+      uint64_t m_cache_sz;
+      bool m_read_only;
+      mdbx_settings m_settings;
+      std::map<container_handle, std::string> m_containers; // opened containers, to reopen them after replace_storage()
       bool pop_tx_entry(tx_entry& txe);
+      bool reopen_storage();
     public:
       mdbx_db_backend();
       ~mdbx_db_backend();
@@ -50,15 +83,21 @@ namespace tools
       bool close_container(container_handle& h) override;
       bool erase(container_handle h, const char* k, size_t s) override;
       bool get(container_handle h, const char* k, size_t s, std::string& res_buff) override;
+      bool get_view(container_handle h, const char* k, size_t s, i_db_value_view_callback& cb) override;
+      bool get_multiple_views(container_handle h, const std::vector<db_key_ref>& keys, i_db_values_view_callback& cb) override;
       bool clear(container_handle h) override;
       uint64_t size(container_handle h) override;
       bool set(container_handle h, const char* k, size_t s, const char* v, size_t vs) override;
       bool enumerate(container_handle h, i_db_callback* pcb) override;
       bool get_stat_info(tools::db::stat_info& si) override;
       const char* name() override;
+      bool copy_compacted(const std::string& target_folder) override;
+      bool replace_storage(const std::string& source_folder) override;
+      bool set_read_only(bool read_only) override;
       //-------------------------------------------------------------------------------------
       bool have_tx();
       MDBX_txn* get_current_tx();
+      void set_settings(const mdbx_settings& settings) { m_settings = settings; } // to be called before open()
 
     };
     
@@ -2,15 +2,62 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <chrono>
+#include <algorithm>
 #include "db_backend_selector.h"
 #include "currency_core/currency_config.h"
 #include "command_line.h"
+#include "string_coding.h"
 #include "db_backend_lmdb.h"
 #include "db_backend_mdbx.h"
 
 #define LMDB_MAIN_FILE_NAME  "data.mdb"
 #define MDBX_MAIN_FILE_NAME  "mdbx.dat"
 
+#define DB_BENCHMARK_FOLDER_SUFFIX         "_benchmark"
+#define DB_BENCHMARK_ITEMS_COUNT           200000
+#define DB_BENCHMARK_ITEMS_PER_COMMIT      1000
+#define DB_BENCHMARK_VALUE_SIZE            256
+#define DB_BENCHMARK_READS_COUNT           100000
+
+namespace
+{
+  const command_line::arg_descriptor<uint32_t>    arg_db_mdbx_page_size       ( "db-mdbx-page-size", "MDBX page size in bytes, a power of 2 from 256 to 65536 (default: 4096). Applied only when a new db is created");
+  const command_line::arg_descriptor<uint32_t>    arg_db_mdbx_growth_step_mb  ( "db-mdbx-growth-step-mb", "MDBX db file growth step in MB (default: 1024)");
+  const command_line::arg_descriptor<bool>        arg_db_mdbx_readahead       ( "db-mdbx-readahead", "Enable OS readahead for MDBX db file (off by default, helps only if the db fits in RAM)");
+  const command_line::arg_descriptor<bool>        arg_db_mdbx_coalesce        ( "db-mdbx-coalesce", "Coalesce reclaimed free pages in MDBX, keeps the db file smaller at the cost of some CPU on writes");
+  const command_line::arg_descriptor<std::string> arg_db_mdbx_sync_mode       ( "db-mdbx-sync-mode", "MDBX durability mode: \"durable\"(default), \"nometasync\"(a system crash may roll back the latest commits) or \"safe-nosync\"(data is flushed by OS, a system crash may roll back to the last flushed state). The db is never corrupted in either mode", "durable");
+  const command_line::arg_descriptor<bool>        arg_db_benchmark            ( "db-benchmark", "Measure commit and random read latency of the selected db engine and settings on a scratch db next to the blockchain db, then exit");
+
+  // bool switches may be not registered at all by some tools
+  bool get_switch(const boost::program_options::variables_map& vm, const command_line::arg_descriptor<bool>& arg)
+  {
+    return vm.count(arg.name) != 0 && command_line::get_arg(vm, arg);
+  }
+
+  uint64_t benchmark_key(uint64_t i)
+  {
+    // splitmix64, spreads keys over the whole key space like hashes do
+    uint64_t z = i + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  std::string latency_stats_str(std::vector<uint64_t>& times_mcs)
+  {
+    if (times_mcs.empty())
+      return "n/a";
+    std::sort(times_mcs.begin(), times_mcs.end());
+    uint64_t total = 0;
+    for (auto t : times_mcs)
+      total += t;
+    std::stringstream ss;
+    ss << "avg " << total / times_mcs.size() << " mcs, p50 " << times_mcs[times_mcs.size() / 2] << " mcs, p99 " << times_mcs[times_mcs.size() * 99 / 100] << " mcs, max " << times_mcs.back() << " mcs";
+    return ss.str();
+  }
+}
+
 namespace tools
 {
 namespace db
@@ -24,6 +71,12 @@ namespace db
   void db_backend_selector::init_options(boost::program_options::options_description& desc)
   {
     command_line::add_arg(desc, command_line::arg_db_engine);
+    command_line::add_arg(desc, arg_db_mdbx_page_size);
+    command_line::add_arg(desc, arg_db_mdbx_growth_step_mb);
+    command_line::add_arg(desc, arg_db_mdbx_readahead);
+    command_line::add_arg(desc, arg_db_mdbx_coalesce);
+    command_line::add_arg(desc, arg_db_mdbx_sync_mode);
+    command_line::add_arg(desc, arg_db_benchmark);
   }
 
   bool db_backend_selector::init(const boost::program_options::variables_map& vm)
@@ -58,6 +111,48 @@ namespace db
     if (m_engine_type == db_none)
       return false;
 
+    return init_mdbx_settings(vm);
+  }
+
+  bool db_backend_selector::init_mdbx_settings(const boost::program_options::variables_map& vm)
+  {
+    try
+    {
+      if (command_line::has_arg(vm, arg_db_mdbx_page_size))
+      {
+        uint64_t page_size = command_line::get_arg(vm, arg_db_mdbx_page_size);
+        CHECK_AND_ASSERT_MES(page_size >= 256 && page_size <= 65536 && (page_size & (page_size - 1)) == 0, false, "Invalid --" << arg_db_mdbx_page_size.name << " = " << page_size << ", must be a power of 2 from 256 to 65536");
+        m_mdbx_settings.page_size = page_size;
+      }
+      if (command_line::has_arg(vm, arg_db_mdbx_growth_step_mb))
+      {
+        uint64_t growth_step_mb = command_line::get_arg(vm, arg_db_mdbx_growth_step_mb);
+        CHECK_AND_ASSERT_MES(growth_step_mb != 0, false, "Invalid --" << arg_db_mdbx_growth_step_mb.name << " = 0");
+        m_mdbx_settings.growth_step = growth_step_mb * 1024 * 1024;
+      }
+      m_mdbx_settings.readahead = get_switch(vm, arg_db_mdbx_readahead);
+      m_mdbx_settings.coalesce = get_switch(vm, arg_db_mdbx_coalesce);
+      if (command_line::has_arg(vm, arg_db_mdbx_sync_mode))
+      {
+        std::string sync_mode = command_line::get_arg(vm, arg_db_mdbx_sync_mode);
+        if (sync_mode == "durable")
+          m_mdbx_settings.sync_mode = mdbx_settings::sync_durable;
+        else if (sync_mode == "nometasync")
+          m_mdbx_settings.sync_mode = mdbx_settings::sync_no_meta_sync;
+        else if (sync_mode == "safe-nosync")
+          m_mdbx_settings.sync_mode = mdbx_settings::sync_safe_no_sync;
+        else
+        {
+          LOG_ERROR("Invalid --" << arg_db_mdbx_sync_mode.name << " = " << sync_mode);
+          return false;
+        }
+      }
+    }
+    catch (std::exception& e)
+    {
+      LOG_ERROR("internal error: db_backend_selector::init_mdbx_settings failed on command-line parsing, exception: " << e.what());
+      return false;
+    }
     return true;
   }
 
@@ -111,8 +206,14 @@ namespace db
     case db_lmdb:
       return std::shared_ptr<tools::db::i_db_backend>(new tools::db::lmdb_db_backend);
 
+#ifdef ENABLED_ENGINE_MDBX
     case db_mdbx:
-      return std::shared_ptr<tools::db::i_db_backend>(new tools::db::mdbx_db_backend);
+    {
+      std::shared_ptr<tools::db::mdbx_db_backend> backend(new tools::db::mdbx_db_backend);
+      backend->set_settings(m_mdbx_settings);
+      return backend;
+    }
+#endif
 
     default:
       LOG_ERROR("db_backend_selector was no inited");
@@ -125,6 +226,77 @@ namespace db
     return m_config_folder + "_TEMP";                                                                  
   }
 
+  bool db_backend_selector::is_benchmark_requested(const boost::program_options::variables_map& vm)
+  {
+    return get_switch(vm, arg_db_benchmark);
+  }
+
+  bool db_backend_selector::run_benchmark()
+  {
+    // a scratch db at the same disk as the blockchain db, so the numbers match its storage
+    const std::string folder = get_db_folder_path() + DB_BENCHMARK_FOLDER_SUFFIX;
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(epee::string_encoding::utf8_to_wstring(folder), ec);
+
+    std::shared_ptr<i_db_backend> backend = create_backend();
+    CHECK_AND_ASSERT_MES(backend, false, "Unable to create db backend");
+    CHECK_AND_ASSERT_MES(backend->open(folder), false, "Unable to open db in " << folder);
+    container_handle h = AUTO_VAL_INIT(h);
+    CHECK_AND_ASSERT_MES(backend->open_container("benchmark", h), false, "Unable to open container");
+
+    static const char* sync_mode_names[] = { "durable", "nometasync", "safe-nosync" };
+    if (m_engine_type == db_mdbx)
+    {
+      LOG_PRINT_L0("DB benchmark: " << get_engine_name() << " in " << folder << ", page size " << m_mdbx_settings.page_size << ", growth step " << m_mdbx_settings.growth_step
+        << ", readahead " << m_mdbx_settings.readahead << ", coalesce " << m_mdbx_settings.coalesce << ", sync mode " << sync_mode_names[m_mdbx_settings.sync_mode]);
+    }
+    else
+    {
+      LOG_PRINT_L0("DB benchmark: " << get_engine_name() << " in " << folder);
+    }
+
+    typedef std::chrono::high_resolution_clock clock_t;
+    auto mcs_since = [](const clock_t::time_point& start) -> uint64_t { return std::chrono::duration_cast<std::chrono::microseconds>(clock_t::now() - start).count(); };
+
+    std::string value(DB_BENCHMARK_VALUE_SIZE, '\0');
+    std::vector<uint64_t> commit_times, read_times;
+    for (uint64_t i = 0; i < DB_BENCHMARK_ITEMS_COUNT; )
+    {
+      backend->begin_transaction();
+      for (size_t j = 0; j != DB_BENCHMARK_ITEMS_PER_COMMIT && i < DB_BENCHMARK_ITEMS_COUNT; ++j, ++i)
+      {
+        uint64_t key = benchmark_key(i);
+        for (size_t k = 0; k + sizeof(uint64_t) <= value.size(); k += sizeof(uint64_t))
+          *reinterpret_cast<uint64_t*>(&value[k]) = benchmark_key(key + k);
+        backend->set(h, reinterpret_cast<const char*>(&key), sizeof(key), value.data(), value.size());
+      }
+      clock_t::time_point commit_start = clock_t::now();
+      CHECK_AND_ASSERT_MES(backend->commit_transaction(), false, "commit_transaction failed");
+      commit_times.push_back(mcs_since(commit_start));
+    }
+
+    uint64_t found = 0;
+    for (uint64_t i = 0; i != DB_BENCHMARK_READS_COUNT; ++i)
+    {
+      uint64_t key = benchmark_key(benchmark_key(i) % DB_BENCHMARK_ITEMS_COUNT);
+      std::string res_buff;
+      clock_t::time_point read_start = clock_t::now();
+      backend->begin_transaction(true);
+      if (backend->get(h, reinterpret_cast<const char*>(&key), sizeof(key), res_buff))
+        ++found;
+      backend->commit_transaction();
+      read_times.push_back(mcs_since(read_start));
+    }
+
+    backend->close();
+    boost::filesystem::remove_all(epee::string_encoding::utf8_to_wstring(folder), ec);
+
+    LOG_PRINT_L0("DB benchmark: commit of " << DB_BENCHMARK_ITEMS_PER_COMMIT << " random-key items of " << DB_BENCHMARK_VALUE_SIZE << " bytes: " << latency_stats_str(commit_times));
+    LOG_PRINT_L0("DB benchmark: random read (found " << found << " of " << DB_BENCHMARK_READS_COUNT << "): " << latency_stats_str(read_times));
+    LOG_PRINT_L0("DB benchmark: note that the scratch db is small, so reads are mostly served from the OS cache; the real db may be slower if it doesn't fit in RAM");
+    return found == DB_BENCHMARK_READS_COUNT;
+  }
+
 
 
 
@@ -7,6 +7,7 @@
 #include <boost/program_options.hpp>
 #include "misc_language.h"
 #include "db_backend_base.h"
+#include "db_backend_mdbx.h"
 
 namespace tools
 {
@@ -27,6 +28,7 @@ namespace tools
       db_engine_type get_engine_type() const { return m_engine_type; }
       std::string get_engine_name() const;
       std::string get_config_folder() const { return m_config_folder; }
+      void set_config_folder(const std::string& config_folder) { m_config_folder = config_folder; }
       std::string get_temp_config_folder() const;
       std::string get_temp_db_folder_path() const;
  
@@ -34,9 +36,16 @@ namespace tools
 
       std::shared_ptr<tools::db::i_db_backend> create_backend();
 
+      // --db-benchmark: measures the selected engine with the selected settings in a scratch db next to the blockchain db
+      static bool is_benchmark_requested(const boost::program_options::variables_map& vm);
+      bool run_benchmark();
+
     private:
+      bool init_mdbx_settings(const boost::program_options::variables_map& vm);
+
       db_engine_type m_engine_type;
       std::string m_config_folder;
+      mdbx_settings m_mdbx_settings;
     };
 
   } // namespace db
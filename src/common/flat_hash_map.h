@@ -0,0 +1,239 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <iterator>
+#include <functional>
+#include <type_traits>
+
+namespace tools
+{
+
+  // open-addressing hash map of POD keys and values, the unique-key counterpart of flat_hash_multimap:
+  // one flat array of entries with a parallel array of one-byte tags, linear probing, backward shift erase
+  // a subset of the std::unordered_map interface (find/count/operator[]/erase/iteration, it->first, it->second),
+  // insert and erase invalidate all iterators and references
+  // no internal locking
+  template<typename key_t, typename value_t, typename hash_t = std::hash<key_t>>
+  class flat_hash_map
+  {
+    static_assert(std::is_trivially_copyable<key_t>::value && std::is_trivially_copyable<value_t>::value, "flat_hash_map supports POD types only");
+
+    enum : uint8_t { tag_empty = 0, tag_used_bit = 0x80 };
+    enum { min_capacity = 16 };
+
+  public:
+    struct entry
+    {
+      key_t first;
+      value_t second;
+    };
+
+    template<bool is_const>
+    class iterator_base
+    {
+      typedef typename std::conditional<is_const, const flat_hash_map, flat_hash_map>::type map_t;
+      typedef typename std::conditional<is_const, const entry, entry>::type entry_t;
+
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef entry value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef entry_t* pointer;
+      typedef entry_t& reference;
+
+      iterator_base() : m_map(nullptr), m_i(0) {}
+      iterator_base(map_t* map, size_t i) : m_map(map), m_i(i) { skip_empty(); }
+      operator iterator_base<true>() const { return iterator_base<true>(m_map, m_i); }
+
+      entry_t& operator*() const { return m_map->m_entries[m_i]; }
+      entry_t* operator->() const { return &m_map->m_entries[m_i]; }
+      iterator_base& operator++() { ++m_i; skip_empty(); return *this; }
+      iterator_base operator++(int) { iterator_base r = *this; ++*this; return r; }
+      bool operator==(const iterator_base& rhs) const { return m_i == rhs.m_i; }
+      bool operator!=(const iterator_base& rhs) const { return m_i != rhs.m_i; }
+
+    private:
+      friend class flat_hash_map;
+
+      void skip_empty()
+      {
+        while (m_i < m_map->m_tags.size() && m_map->m_tags[m_i] == tag_empty)
+          ++m_i;
+      }
+
+      map_t* m_map;
+      size_t m_i;
+    };
+
+    typedef iterator_base<false> iterator;
+    typedef iterator_base<true> const_iterator;
+
+    flat_hash_map()
+      : m_size(0)
+      , m_mask(0)
+    {}
+
+    size_t size() const
+    {
+      return m_size;
+    }
+
+    bool empty() const
+    {
+      return m_size == 0;
+    }
+
+    size_t get_memory_size() const
+    {
+      return m_tags.capacity() * sizeof(uint8_t) + m_entries.capacity() * sizeof(entry);
+    }
+
+    void clear()
+    {
+      m_tags.clear();
+      m_entries.clear();
+      m_size = 0;
+      m_mask = 0;
+    }
+
+    void reserve(size_t count)
+    {
+      size_t capacity = min_capacity;
+      while (capacity - capacity / 4 < count)
+        capacity *= 2;
+      if (capacity > m_tags.size())
+        rehash(capacity);
+    }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, m_tags.size()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_tags.size()); }
+
+    iterator find(const key_t& key)
+    {
+      return iterator(this, find_index(key));
+    }
+
+    const_iterator find(const key_t& key) const
+    {
+      return const_iterator(this, find_index(key));
+    }
+
+    size_t count(const key_t& key) const
+    {
+      return find_index(key) != m_tags.size() ? 1 : 0;
+    }
+
+    // inserts value_t() if there's no such key
+    value_t& operator[](const key_t& key)
+    {
+      size_t i = find_index(key);
+      if (i != m_tags.size())
+        return m_entries[i].second;
+
+      if (m_size + 1 > m_tags.size() - m_tags.size() / 4)
+        rehash(m_tags.empty() ? size_t(min_capacity) : m_tags.size() * 2);
+      size_t h = hash_of(key);
+      for (i = h & m_mask; m_tags[i] != tag_empty; i = (i + 1) & m_mask)
+        ;
+      m_tags[i] = tag_of(h);
+      m_entries[i].first = key;
+      m_entries[i].second = value_t();
+      ++m_size;
+      return m_entries[i].second;
+    }
+
+    void erase(const_iterator it)
+    {
+      erase_at(it.m_i);
+    }
+
+    size_t erase(const key_t& key)
+    {
+      size_t i = find_index(key);
+      if (i == m_tags.size())
+        return 0;
+      erase_at(i);
+      return 1;
+    }
+
+  private:
+    static size_t hash_of(const key_t& key)
+    {
+      // mix, as keys like key images or hashes are often hashed by taking their first bytes as is
+      uint64_t h = static_cast<uint64_t>(hash_t()(key)) * 0x9E3779B97F4A7C15ULL;
+      return static_cast<size_t>(h ^ (h >> 32));
+    }
+
+    static uint8_t tag_of(size_t h)
+    {
+      return static_cast<uint8_t>(tag_used_bit | ((h >> (sizeof(size_t) * 8 - 7)) & 0x7f));
+    }
+
+    // m_tags.size() if not found
+    size_t find_index(const key_t& key) const
+    {
+      if (!m_size)
+        return m_tags.size();
+      size_t h = hash_of(key);
+      uint8_t tag = tag_of(h);
+      for (size_t i = h & m_mask; m_tags[i] != tag_empty; i = (i + 1) & m_mask)
+      {
+        if (m_tags[i] == tag && m_entries[i].first == key)
+          return i;
+      }
+      return m_tags.size();
+    }
+
+    void erase_at(size_t i)
+    {
+      // shift following items of the cluster back if the hole lies between their home slot and their current slot
+      size_t j = i;
+      while (true)
+      {
+        j = (j + 1) & m_mask;
+        if (m_tags[j] == tag_empty)
+          break;
+        size_t home = hash_of(m_entries[j].first) & m_mask;
+        if (((j - home) & m_mask) >= ((j - i) & m_mask))
+        {
+          m_tags[i] = m_tags[j];
+          m_entries[i] = m_entries[j];
+          i = j;
+        }
+      }
+      m_tags[i] = tag_empty;
+      --m_size;
+    }
+
+    void rehash(size_t new_capacity)
+    {
+      std::vector<uint8_t> old_tags(new_capacity, uint8_t(tag_empty));
+      std::vector<entry> old_entries(new_capacity);
+      old_tags.swap(m_tags);
+      old_entries.swap(m_entries);
+      m_mask = new_capacity - 1;
+      for (size_t k = 0; k != old_tags.size(); ++k)
+      {
+        if (old_tags[k] == tag_empty)
+          continue;
+        size_t i = hash_of(old_entries[k].first) & m_mask;
+        while (m_tags[i] != tag_empty)
+          i = (i + 1) & m_mask;
+        m_tags[i] = old_tags[k];
+        m_entries[i] = old_entries[k];
+      }
+    }
+
+    std::vector<uint8_t> m_tags;
+    std::vector<entry> m_entries;
+    size_t m_size;
+    size_t m_mask;
+  };
+
+} // namespace tools
@@ -0,0 +1,209 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <type_traits>
+
+namespace tools
+{
+
+  // open-addressing hash multimap of POD keys and values, both stored inline in one flat array
+  // linear probing over a power-of-two table with a parallel array of one-byte tags (7 bits of the hash),
+  // so a probe compares keys only when the tag matches; erase uses backward shift, so there are no tombstones
+  // the same key may be stored with several different values, a (key, value) pair is stored at most once
+  // no internal locking
+  template<typename key_t, typename value_t, typename hash_t = std::hash<key_t>>
+  class flat_hash_multimap
+  {
+    static_assert(std::is_trivially_copyable<key_t>::value && std::is_trivially_copyable<value_t>::value, "flat_hash_multimap supports POD types only");
+
+    struct slot
+    {
+      key_t key;
+      value_t value;
+    };
+
+    enum : uint8_t { tag_empty = 0, tag_used_bit = 0x80 };
+    enum { min_capacity = 16 };
+
+  public:
+    flat_hash_multimap()
+      : m_size(0)
+      , m_mask(0)
+    {}
+
+    size_t size() const
+    {
+      return m_size;
+    }
+
+    bool empty() const
+    {
+      return m_size == 0;
+    }
+
+    size_t get_memory_size() const
+    {
+      return m_tags.capacity() * sizeof(uint8_t) + m_slots.capacity() * sizeof(slot);
+    }
+
+    void clear()
+    {
+      m_tags.clear();
+      m_slots.clear();
+      m_size = 0;
+      m_mask = 0;
+    }
+
+    void reserve(size_t count)
+    {
+      size_t capacity = min_capacity;
+      while (capacity - capacity / 4 < count)
+        capacity *= 2;
+      if (capacity > m_tags.size())
+        rehash(capacity);
+    }
+
+    // returns false if exactly this pair is already stored
+    bool insert(const key_t& key, const value_t& value)
+    {
+      if (m_size + 1 > m_tags.size() - m_tags.size() / 4)
+        rehash(m_tags.empty() ? size_t(min_capacity) : m_tags.size() * 2);
+
+      size_t h = hash_of(key);
+      uint8_t tag = tag_of(h);
+      size_t i = h & m_mask;
+      for (; m_tags[i] != tag_empty; i = (i + 1) & m_mask)
+      {
+        if (m_tags[i] == tag && m_slots[i].key == key && m_slots[i].value == value)
+          return false;
+      }
+      m_tags[i] = tag;
+      m_slots[i].key = key;
+      m_slots[i].value = value;
+      ++m_size;
+      return true;
+    }
+
+    // returns false if the pair is not stored
+    bool erase(const key_t& key, const value_t& value)
+    {
+      if (!m_size)
+        return false;
+      size_t h = hash_of(key);
+      uint8_t tag = tag_of(h);
+      for (size_t i = h & m_mask; m_tags[i] != tag_empty; i = (i + 1) & m_mask)
+      {
+        if (m_tags[i] == tag && m_slots[i].key == key && m_slots[i].value == value)
+        {
+          erase_at(i);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool contains(const key_t& key) const
+    {
+      bool found = false;
+      for_each_value(key, [&](const value_t&) { found = true; return false; });
+      return found;
+    }
+
+    size_t count(const key_t& key) const
+    {
+      size_t n = 0;
+      for_each_value(key, [&](const value_t&) { ++n; return true; });
+      return n;
+    }
+
+    // cb(const value_t&) returns false to stop
+    template<typename callback_t>
+    void for_each_value(const key_t& key, callback_t cb) const
+    {
+      if (!m_size)
+        return;
+      size_t h = hash_of(key);
+      uint8_t tag = tag_of(h);
+      for (size_t i = h & m_mask; m_tags[i] != tag_empty; i = (i + 1) & m_mask)
+      {
+        if (m_tags[i] == tag && m_slots[i].key == key && !cb(m_slots[i].value))
+          return;
+      }
+    }
+
+    // cb(const key_t&, const value_t&) returns false to stop
+    template<typename callback_t>
+    void for_each(callback_t cb) const
+    {
+      for (size_t i = 0; i != m_tags.size(); ++i)
+      {
+        if (m_tags[i] != tag_empty && !cb(m_slots[i].key, m_slots[i].value))
+          return;
+      }
+    }
+
+  private:
+    static size_t hash_of(const key_t& key)
+    {
+      // mix, as keys like key images or hashes are often hashed by taking their first bytes as is
+      uint64_t h = static_cast<uint64_t>(hash_t()(key)) * 0x9E3779B97F4A7C15ULL;
+      return static_cast<size_t>(h ^ (h >> 32));
+    }
+
+    static uint8_t tag_of(size_t h)
+    {
+      return static_cast<uint8_t>(tag_used_bit | ((h >> (sizeof(size_t) * 8 - 7)) & 0x7f));
+    }
+
+    void erase_at(size_t i)
+    {
+      // shift following items of the cluster back if the hole lies between their home slot and their current slot
+      size_t j = i;
+      while (true)
+      {
+        j = (j + 1) & m_mask;
+        if (m_tags[j] == tag_empty)
+          break;
+        size_t home = hash_of(m_slots[j].key) & m_mask;
+        if (((j - home) & m_mask) >= ((j - i) & m_mask))
+        {
+          m_tags[i] = m_tags[j];
+          m_slots[i] = m_slots[j];
+          i = j;
+        }
+      }
+      m_tags[i] = tag_empty;
+      --m_size;
+    }
+
+    void rehash(size_t new_capacity)
+    {
+      std::vector<uint8_t> old_tags(new_capacity, uint8_t(tag_empty));
+      std::vector<slot> old_slots(new_capacity);
+      old_tags.swap(m_tags);
+      old_slots.swap(m_slots);
+      m_mask = new_capacity - 1;
+      for (size_t k = 0; k != old_tags.size(); ++k)
+      {
+        if (old_tags[k] == tag_empty)
+          continue;
+        size_t i = hash_of(old_slots[k].key) & m_mask;
+        while (m_tags[i] != tag_empty)
+          i = (i + 1) & m_mask;
+        m_tags[i] = old_tags[k];
+        m_slots[i] = old_slots[k];
+      }
+    }
+
+    std::vector<uint8_t> m_tags;
+    std::vector<slot> m_slots;
+    size_t m_size;
+    size_t m_mask;
+  };
+
+} // namespace tools
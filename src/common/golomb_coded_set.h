@@ -0,0 +1,204 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace tools
+{
+
+  // compact probabilistic set of random-looking POD keys (hashes, key images), BIP-158 style:
+  // keys are mapped to [0, N * 2^P), sorted, and the differences are stored Golomb-Rice coded, ~(P + 2) bits per key
+  // the false positive rate of a single key query is 2^-P
+  // blob layout: varint N, then the bit stream, most significant bit first
+  template<typename key_t, size_t P = 20>
+  class golomb_coded_set
+  {
+    static_assert(std::is_trivially_copyable<key_t>::value && sizeof(key_t) >= 16, "golomb_coded_set supports POD keys of at least 16 bytes");
+    static_assert(P > 0 && P < 32, "wrong Golomb-Rice parameter");
+
+  public:
+    static std::string build(const std::vector<key_t>& keys)
+    {
+      std::string result;
+      write_varint(result, keys.size());
+      if (keys.empty())
+        return result;
+
+      std::vector<uint64_t> values = map_keys(keys, range_of(keys.size()));
+      std::sort(values.begin(), values.end());
+
+      bit_writer bw(result);
+      uint64_t prev = 0;
+      for (uint64_t v : values)
+      {
+        uint64_t delta = v - prev;
+        prev = v;
+        for (uint64_t q = delta >> P; q != 0; --q)
+          bw.put(1);
+        bw.put(0);
+        for (size_t i = P; i != 0; --i)
+          bw.put((delta >> (i - 1)) & 1);
+      }
+      return result;
+    }
+
+    // returns true if any of the keys may be in the set; also true for a malformed blob, so a caller doesn't miss anything
+    static bool match_any(const std::string& blob, const std::vector<key_t>& keys)
+    {
+      if (keys.empty())
+        return false;
+      size_t pos = 0;
+      uint64_t n = 0;
+      if (!read_varint(blob, pos, n))
+        return true;
+      if (n == 0)
+        return false;
+      if (n > (blob.size() - pos) * 8)
+        return true; // each item takes at least one bit
+
+      std::vector<uint64_t> queries = map_keys(keys, range_of(n));
+      std::sort(queries.begin(), queries.end());
+
+      bit_reader br(blob, pos);
+      uint64_t value = 0;
+      size_t qi = 0;
+      for (uint64_t i = 0; i != n; ++i)
+      {
+        uint64_t q = 0;
+        int bit = 0;
+        while ((bit = br.get()) == 1)
+          ++q;
+        if (bit < 0)
+          return true;
+        uint64_t r = 0;
+        for (size_t j = 0; j != P; ++j)
+        {
+          bit = br.get();
+          if (bit < 0)
+            return true;
+          r = (r << 1) | static_cast<uint64_t>(bit);
+        }
+        value += (q << P) | r;
+
+        while (qi != queries.size() && queries[qi] < value)
+          ++qi;
+        if (qi == queries.size())
+          return false;
+        if (queries[qi] == value)
+          return true;
+      }
+      return false;
+    }
+
+  private:
+    static uint64_t range_of(uint64_t n)
+    {
+      return n << P;
+    }
+
+    static uint64_t mix(uint64_t x)
+    {
+      x ^= x >> 30;
+      x *= 0xbf58476d1ce4e5b9ULL;
+      x ^= x >> 27;
+      x *= 0x94d049bb133111ebULL;
+      x ^= x >> 31;
+      return x;
+    }
+
+    // high 64 bits of a * b
+    static uint64_t mul_hi(uint64_t a, uint64_t b)
+    {
+#if defined(__SIZEOF_INT128__)
+      return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+      return __umulh(a, b);
+#else
+      uint64_t a_lo = a & 0xffffffff, a_hi = a >> 32, b_lo = b & 0xffffffff, b_hi = b >> 32;
+      uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+      uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+      return hi_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+    }
+
+    static std::vector<uint64_t> map_keys(const std::vector<key_t>& keys, uint64_t range)
+    {
+      std::vector<uint64_t> result;
+      result.reserve(keys.size());
+      for (const auto& k : keys)
+      {
+        uint64_t parts[2] = { 0, 0 };
+        memcpy(parts, &k, sizeof(parts));
+        result.push_back(mul_hi(mix(parts[0] ^ mix(parts[1])), range)); // uniform in [0, range)
+      }
+      return result;
+    }
+
+    static void write_varint(std::string& s, uint64_t v)
+    {
+      while (v >= 0x80)
+      {
+        s.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+      }
+      s.push_back(static_cast<char>(v));
+    }
+
+    static bool read_varint(const std::string& s, size_t& pos, uint64_t& v)
+    {
+      v = 0;
+      for (size_t shift = 0; shift < 64; shift += 7)
+      {
+        if (pos >= s.size())
+          return false;
+        uint8_t b = static_cast<uint8_t>(s[pos++]);
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80))
+          return true;
+      }
+      return false;
+    }
+
+    struct bit_writer
+    {
+      bit_writer(std::string& s) : m_s(s), m_count(0) {}
+      void put(uint64_t bit)
+      {
+        if (m_count % 8 == 0)
+          m_s.push_back(0);
+        if (bit)
+          m_s.back() = static_cast<char>(static_cast<uint8_t>(m_s.back()) | (0x80 >> (m_count % 8)));
+        ++m_count;
+      }
+      std::string& m_s;
+      size_t m_count;
+    };
+
+    struct bit_reader
+    {
+      bit_reader(const std::string& s, size_t pos) : m_s(s), m_bit_pos(pos * 8) {}
+      int get() // -1 at the end
+      {
+        if (m_bit_pos >= m_s.size() * 8)
+          return -1;
+        uint8_t b = static_cast<uint8_t>(m_s[m_bit_pos / 8]);
+        int bit = (b >> (7 - m_bit_pos % 8)) & 1;
+        ++m_bit_pos;
+        return bit;
+      }
+      const std::string& m_s;
+      size_t m_bit_pos;
+    };
+  };
+
+} // namespace tools
@@ -0,0 +1,221 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <string>
+#include <fstream>
+#include <type_traits>
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "string_tools.h"
+
+namespace tools
+{
+
+  // append-only array of POD items in a memory-mapped file: item access is plain pointer arithmetic over the mapping
+  // file layout: [file_header][item 0][item 1]...[unused preallocated space]
+  // no internal locking: writers must be exclusive with respect to readers (remapping invalidates pointers)
+  template<typename pod_t>
+  class mapped_pod_array_file
+  {
+    static_assert(std::is_trivially_copyable<pod_t>::value, "mapped_pod_array_file supports POD types only");
+
+    struct file_header
+    {
+      uint64_t signature;
+      uint64_t item_size;
+      uint64_t items_count;
+      uint64_t reserved[5];
+    };
+    static_assert(sizeof(file_header) == 64, "file_header is expected to be 64 bytes, so items stay aligned");
+
+    enum { grow_min_items = 64 * 1024 };
+
+  public:
+    mapped_pod_array_file()
+      : m_p_header(nullptr)
+      , m_p_items(nullptr)
+      , m_capacity(0)
+    {}
+
+    ~mapped_pod_array_file()
+    {
+      close();
+    }
+
+    // opens existing file or creates a new one; a file with different signature or broken header is recreated empty
+    bool open(const std::wstring& filename, uint64_t signature, std::string* p_reason = nullptr)
+    {
+      close();
+      m_filename = filename;
+
+      bool need_reset = !boost::filesystem::exists(filename);
+      if (!need_reset)
+      {
+        uint64_t file_size = boost::filesystem::file_size(filename);
+        if (file_size < sizeof(file_header) || !map_file(file_size))
+        {
+          need_reset = true;
+          if (p_reason)
+            *p_reason = "file is too small or could not be mapped, recreated";
+        }
+        else if (m_p_header->signature != signature || m_p_header->item_size != sizeof(pod_t))
+        {
+          need_reset = true;
+          if (p_reason)
+            *p_reason = "file has unexpected signature or item size, recreated";
+        }
+        else if (m_p_header->items_count > m_capacity)
+        {
+          need_reset = true;
+          if (p_reason)
+            *p_reason = std::string("file is corrupted: items count ") + epee::string_tools::num_to_string_fast(m_p_header->items_count) + " exceeds capacity " + epee::string_tools::num_to_string_fast(m_capacity) + ", recreated";
+        }
+      }
+
+      if (need_reset)
+      {
+        unmap_file();
+        {
+          std::ofstream fs(boost::filesystem::path(filename).string(), std::ios::binary | std::ios::trunc);
+          if (!fs.is_open())
+          {
+            if (p_reason)
+              *p_reason = "file could not be created";
+            return false;
+          }
+        }
+        uint64_t new_file_size = sizeof(file_header) + sizeof(pod_t) * grow_min_items;
+        boost::filesystem::resize_file(filename, new_file_size);
+        if (!map_file(new_file_size))
+        {
+          if (p_reason)
+            *p_reason = "file could not be mapped";
+          return false;
+        }
+        m_p_header->signature = signature;
+        m_p_header->item_size = sizeof(pod_t);
+        m_p_header->items_count = 0;
+      }
+
+      return true;
+    }
+
+    void close()
+    {
+      if (m_p_header)
+        m_region.flush();
+      unmap_file();
+    }
+
+    bool is_open() const
+    {
+      return m_p_header != nullptr;
+    }
+
+    size_t size() const
+    {
+      return m_p_header ? static_cast<size_t>(m_p_header->items_count) : 0;
+    }
+
+    const pod_t& operator[](size_t index) const
+    {
+      return m_p_items[index];
+    }
+
+    pod_t& operator[](size_t index)
+    {
+      return m_p_items[index];
+    }
+
+    bool push_back(const pod_t& item)
+    {
+      if (!m_p_header)
+        return false;
+
+      if (m_p_header->items_count == m_capacity)
+      {
+        uint64_t new_capacity = m_capacity + std::max<uint64_t>(m_capacity / 2, grow_min_items);
+        if (!remap(new_capacity))
+          return false;
+      }
+
+      m_p_items[m_p_header->items_count] = item;
+      ++m_p_header->items_count; // count is updated only after the item is in place
+      return true;
+    }
+
+    // shrinks the array (space is kept preallocated)
+    bool truncate(size_t new_size)
+    {
+      if (!m_p_header || new_size > m_p_header->items_count)
+        return false;
+      m_p_header->items_count = new_size;
+      return true;
+    }
+
+    bool flush()
+    {
+      if (!m_p_header)
+        return false;
+      return m_region.flush();
+    }
+
+  private:
+    bool map_file(uint64_t file_size)
+    {
+      try
+      {
+        m_mapping = boost::interprocess::file_mapping(boost::filesystem::path(m_filename).string().c_str(), boost::interprocess::read_write);
+        m_region = boost::interprocess::mapped_region(m_mapping, boost::interprocess::read_write, 0, static_cast<size_t>(file_size));
+      }
+      catch (const std::exception& e)
+      {
+        LOG_ERROR("failed to map file " << boost::filesystem::path(m_filename).string() << ": " << e.what());
+        unmap_file();
+        return false;
+      }
+      m_p_header = static_cast<file_header*>(m_region.get_address());
+      m_p_items = reinterpret_cast<pod_t*>(static_cast<char*>(m_region.get_address()) + sizeof(file_header));
+      m_capacity = (file_size - sizeof(file_header)) / sizeof(pod_t);
+      return true;
+    }
+
+    void unmap_file()
+    {
+      m_region = boost::interprocess::mapped_region();
+      m_mapping = boost::interprocess::file_mapping();
+      m_p_header = nullptr;
+      m_p_items = nullptr;
+      m_capacity = 0;
+    }
+
+    bool remap(uint64_t new_capacity)
+    {
+      m_region.flush();
+      unmap_file();
+      uint64_t new_file_size = sizeof(file_header) + sizeof(pod_t) * new_capacity;
+      try
+      {
+        boost::filesystem::resize_file(m_filename, new_file_size);
+      }
+      catch (const std::exception& e)
+      {
+        LOG_ERROR("failed to resize file " << boost::filesystem::path(m_filename).string() << " to " << new_file_size << ": " << e.what());
+        map_file(boost::filesystem::file_size(m_filename));
+        return false;
+      }
+      return map_file(new_file_size);
+    }
+
+    std::wstring m_filename;
+    boost::interprocess::file_mapping m_mapping;
+    boost::interprocess::mapped_region m_region;
+    file_header* m_p_header;
+    pod_t* m_p_items;
+    uint64_t m_capacity;
+  };
+
+} // namespace tools
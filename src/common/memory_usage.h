@@ -0,0 +1,59 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <list>
+#include <map>
+#include <sstream>
+#include <string>
+#include "memory_accounting.h"
+#include "misc_log_ex.h"
+
+namespace tools
+{
+  // memory held by one subsystem (container, cache or queue), bytes are estimated, not taken from the allocator
+  struct memory_usage_entry
+  {
+    std::string name;
+    uint64_t items;
+    uint64_t bytes;
+  };
+
+  // approximate size of an element of a node based container (map, unordered_map, list): the key, the value and the node links
+  template<class t_key, class t_value>
+  uint64_t node_container_entry_size()
+  {
+    return sizeof(t_key) + sizeof(t_value) + 4 * sizeof(void*);
+  }
+
+  inline void add_memory_usage(const std::string& name, uint64_t items, uint64_t bytes, std::list<memory_usage_entry>& usage)
+  {
+    usage.push_back(memory_usage_entry{ name, items, bytes });
+  }
+
+  // counters of the epee subsystems (network send queues, parsed requests), see epee::memory_accounting
+  inline void get_epee_memory_usage(std::list<memory_usage_entry>& usage)
+  {
+    std::map<std::string, epee::memory_accounting::counter_value> values;
+    epee::memory_accounting::get_all(values);
+    for (const auto& v : values)
+      add_memory_usage(v.first, v.second.items, v.second.bytes, usage);
+  }
+
+  inline std::string memory_usage_to_string(const std::list<memory_usage_entry>& usage)
+  {
+    std::stringstream ss;
+    uint64_t total = 0;
+    for (const auto& e : usage)
+    {
+      ss << std::left << std::setw(40) << e.name << std::right << std::setw(12) << e.items << " items " << std::setw(14) << e.bytes << " bytes" << ENDL;
+      total += e.bytes;
+    }
+    ss << std::left << std::setw(40) << "total" << std::right << std::setw(33) << total << " bytes (" << total / (1024 * 1024) << " MB)" << ENDL;
+    return ss.str();
+  }
+}
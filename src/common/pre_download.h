@@ -5,10 +5,14 @@
 #pragma once
 
 #include <boost/program_options.hpp>
+#include <atomic>
+#include <thread>
 #include "net/http_client.h"
+#include "file_io_utils.h"
 #include "db_backend_selector.h"
 #include "crypto/crypto.h"
 #include "currency_core/currency_core.h"
+#include "common/bootstrap_file.h"
 
 namespace tools
 {
@@ -29,6 +33,329 @@ namespace tools
 #endif
 
   static constexpr uint64_t pre_download_min_size_difference = 512 * 1024 * 1024; // minimum difference in size between local DB and the downloadable one to start downloading
+  static constexpr size_t pre_download_connections = 4;
+  static constexpr uint64_t pre_download_part_flush_interval = 16 * 1024 * 1024; // a part's progress is flushed to the disk (and can be resumed from) at least this often
+  static constexpr size_t pre_download_unpack_chunk_size = 1024 * 1024;
+  static constexpr size_t pre_download_validation_range_blocks = 200;
+
+  struct pre_download_part
+  {
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    std::atomic<uint64_t> done{ 0 }; // bytes flushed to the packed file
+  };
+
+  // the first byte of the packed file that is not downloaded yet, everything before it can be unpacked
+  inline uint64_t get_pre_download_contiguous_size(const std::vector<pre_download_part>& parts)
+  {
+    for (const auto& p : parts)
+    {
+      uint64_t done = p.done;
+      if (p.begin + done != p.end)
+        return p.begin + done;
+    }
+    return parts.empty() ? 0 : parts.back().end;
+  }
+
+  // the progress is kept in <packed file>.parts as "packed_size parts_count done_0 done_1 ...", it's used only if it matches
+  inline void load_pre_download_parts(const std::string& state_path, uint64_t packed_size, std::vector<pre_download_part>& parts)
+  {
+    uint64_t part_size = (packed_size + parts.size() - 1) / parts.size();
+    for (size_t i = 0; i != parts.size(); ++i)
+    {
+      parts[i].begin = std::min(packed_size, i * part_size);
+      parts[i].end = std::min(packed_size, (i + 1) * part_size);
+      parts[i].done = 0;
+    }
+
+    std::string state;
+    if (!epee::file_io_utils::load_file_to_string(state_path, state))
+      return;
+    std::istringstream ss(state);
+    uint64_t state_packed_size = 0, state_parts_count = 0;
+    if (!(ss >> state_packed_size >> state_parts_count) || state_packed_size != packed_size || state_parts_count != parts.size())
+      return;
+    std::vector<uint64_t> done(parts.size());
+    for (auto& d : done)
+    {
+      if (!(ss >> d))
+        return;
+    }
+    for (size_t i = 0; i != parts.size(); ++i)
+      parts[i].done = std::min(done[i], parts[i].end - parts[i].begin);
+  }
+
+  inline void save_pre_download_parts(const std::string& state_path, uint64_t packed_size, const std::vector<pre_download_part>& parts)
+  {
+    std::stringstream ss;
+    ss << packed_size << " " << parts.size();
+    for (const auto& p : parts)
+      ss << " " << p.done;
+    epee::file_io_utils::save_string_to_file(state_path, ss.str());
+  }
+
+  // Downloads the packed file with pre_download_connections connections at once, each one gets its own part of the file
+  // by Range requests and writes it right into its place. What's downloaded survives a restart: the packed file and
+  // its .parts progress are removed only once the whole file is unpacked. Meanwhile another thread unpacks and hashes
+  // the downloaded beginning of the file as it grows. The packed file is one gzip stream, so unpacking itself can't be split.
+  template<class callback_t>
+  bool download_and_unpack_in_parallel(const std::string& url, uint64_t packed_size, const std::string& packed_file_path, const std::string& unpacked_file_path,
+    crypto::stream_cn_hash& hash_stream, callback_t cb_should_stop)
+  {
+    CHECK_AND_ASSERT_MES(packed_size != 0, false, "packed size is unknown");
+    const std::string state_path = packed_file_path + ".parts";
+    std::vector<pre_download_part> parts(pre_download_connections);
+    load_pre_download_parts(state_path, packed_size, parts);
+
+    boost::system::error_code ec;
+    if (!boost::filesystem::exists(packed_file_path, ec))
+    {
+      std::ofstream create(packed_file_path, std::ios::binary | std::ios::out | std::ios::trunc);
+      for (auto& p : parts)
+        p.done = 0;
+    }
+    if (boost::filesystem::file_size(packed_file_path, ec) != packed_size || ec)
+    {
+      boost::filesystem::resize_file(packed_file_path, packed_size, ec);
+      CHECK_AND_ASSERT_MES(!ec, false, "Failed to resize " << packed_file_path << " to " << packed_size << " bytes: " << ec.message());
+    }
+    uint64_t resumed_size = 0;
+    for (const auto& p : parts)
+      resumed_size += p.done;
+    if (resumed_size != 0)
+      LOG_PRINT_MAGENTA("Resuming download, " << resumed_size / 1048576 << " MiB of " << packed_size / 1048576 << " MiB are already downloaded", LOG_LEVEL_0);
+
+    std::atomic<bool> stop(false);
+    std::atomic<bool> download_failed(false);
+    std::atomic<bool> download_finished(false);
+
+    auto download_part = [&](pre_download_part& p)
+    {
+      std::fstream fs(packed_file_path, std::ios::binary | std::ios::in | std::ios::out);
+      if (!fs.is_open())
+      {
+        LOG_ERROR("Failed to open " << packed_file_path);
+        download_failed = true;
+        return;
+      }
+      epee::net_utils::http::interruptible_http_client cl;
+      uint64_t pos = p.begin + p.done;
+      const uint64_t fails_count = 30;
+      for (uint64_t fails = 0; pos != p.end && !stop && fails < fails_count; ++fails)
+      {
+        if (fails != 0)
+          boost::this_thread::sleep_for(boost::chrono::milliseconds(2000));
+        fs.seekp(pos);
+        const uint64_t request_size = p.end - pos;
+        uint64_t flushed = pos;
+        bool wrong_response = false;
+        auto cb = [&](const std::string& piece_of_data, uint64_t total_bytes, uint64_t /*received_bytes*/)
+        {
+          if (stop)
+            return false;
+          if (total_bytes != request_size || pos + piece_of_data.size() > p.end)
+          {
+            wrong_response = true; // Range is ignored or the server sends something else
+            return false;
+          }
+          if (!fs.write(piece_of_data.data(), piece_of_data.size()))
+          {
+            wrong_response = true;
+            return false;
+          }
+          pos += piece_of_data.size();
+          if (pos - flushed >= pre_download_part_flush_interval)
+          {
+            fs.flush();
+            flushed = pos;
+            p.done = pos - p.begin;
+          }
+          return true;
+        };
+        epee::net_utils::http::fields_list additional_params;
+        additional_params.push_back(std::make_pair<std::string, std::string>("Range", std::string("bytes=") + std::to_string(pos) + "-" + std::to_string(p.end - 1)));
+        cl.invoke_cb(cb, url, 5000 /* timout */, "GET", std::string(), additional_params);
+        fs.flush();
+        if (!fs)
+        {
+          LOG_ERROR("Failed to write to " << packed_file_path);
+          break;
+        }
+        p.done = pos - p.begin;
+        if (wrong_response)
+        {
+          LOG_ERROR("Wrong response to the range request for bytes " << pos << "-" << p.end - 1 << " from " << url);
+          break;
+        }
+      }
+      if (pos != p.end)
+        download_failed = true;
+    };
+
+    std::atomic<bool> unpack_failed(false);
+    std::atomic<uint64_t> unpacked_size(0);
+    auto unpack = [&]()
+    {
+      std::ifstream in(packed_file_path, std::ios::binary | std::ios::in);
+      std::ofstream out(unpacked_file_path, std::ios::binary | std::ios::out | std::ios::trunc);
+      if (!in.is_open() || !out.is_open())
+      {
+        LOG_ERROR("Failed to open " << packed_file_path << " or " << unpacked_file_path);
+        unpack_failed = true;
+        return;
+      }
+      epee::net_utils::gzip_decoder_lambda zip_decoder;
+      std::string chunk(pre_download_unpack_chunk_size, '\0');
+      std::string buff;
+      uint64_t pos = 0;
+      while (pos != packed_size && !stop)
+      {
+        bool finished = download_finished; // read before the size, so the size read after the download is over is final
+        uint64_t available = get_pre_download_contiguous_size(parts);
+        if (available == pos)
+        {
+          if (finished)
+            break;
+          boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+          continue;
+        }
+        size_t size = static_cast<size_t>(std::min<uint64_t>(available - pos, chunk.size()));
+        in.seekg(pos);
+        if (!in.read(&chunk[0], size))
+        {
+          LOG_ERROR("Failed to read " << packed_file_path);
+          break;
+        }
+        pos += size;
+        buff.append(chunk.data(), size);
+        bool r = zip_decoder.update_in(buff, [&](const std::string& unpacked_buff)
+        {
+          out.write(unpacked_buff.data(), unpacked_buff.size());
+          hash_stream.update(unpacked_buff.data(), unpacked_buff.size());
+          unpacked_size += unpacked_buff.size();
+          return !stop && static_cast<bool>(out);
+        });
+        if (!r || !out)
+        {
+          LOG_ERROR("Failed to unpack " << packed_file_path << " to " << unpacked_file_path << " at offset " << pos);
+          break;
+        }
+      }
+      out.close();
+      if (pos != packed_size || !out)
+        unpack_failed = true;
+    };
+
+    std::vector<std::thread> downloaders;
+    for (auto& p : parts)
+    {
+      if (p.begin + p.done != p.end)
+        downloaders.emplace_back(download_part, std::ref(p));
+    }
+    std::thread unpacker(unpack);
+
+    // let the downloaders finish their parts, while watching the progress and saving it for a restart
+    auto last_update = std::chrono::system_clock::now();
+    while (true)
+    {
+      uint64_t received_bytes = 0;
+      size_t incomplete_parts = 0;
+      for (const auto& p : parts)
+      {
+        received_bytes += p.done;
+        incomplete_parts += p.begin + p.done != p.end ? 1 : 0;
+      }
+      if (!stop && cb_should_stop(packed_size, received_bytes))
+      {
+        LOG_PRINT_MAGENTA(ENDL << "Interrupting download", LOG_LEVEL_0);
+        stop = true;
+      }
+      if (incomplete_parts == 0 || stop || download_failed)
+        break;
+      if (std::chrono::system_clock::now() - last_update >= std::chrono::milliseconds(300))
+      {
+        boost::io::ios_flags_saver ifs(std::cout);
+        std::cout << "Received " << received_bytes / 1048576 << " of " << packed_size / 1048576 << " MiB ( " << std::fixed << std::setprecision(1) << 100.0 * received_bytes / packed_size << " %), unpacked "
+          << unpacked_size / 1048576 << " MiB\r";
+        save_pre_download_parts(state_path, packed_size, parts);
+        last_update = std::chrono::system_clock::now();
+      }
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+    }
+    if (download_failed)
+      stop = true; // what's downloaded is kept for the next attempt, there's no point to go on with the other parts
+    for (auto& t : downloaders)
+      t.join();
+    save_pre_download_parts(state_path, packed_size, parts);
+    download_finished = true;
+    unpacker.join();
+
+    if (stop || download_failed || unpack_failed)
+    {
+      LOG_PRINT_YELLOW("Downloading from " << url << " FAILED, " << get_pre_download_contiguous_size(parts) / 1048576 << " MiB of the beginning are downloaded and kept in " << packed_file_path, LOG_LEVEL_0);
+      if (unpack_failed && !stop && !download_failed)
+      {
+        // the whole file is here but it can't be unpacked, it's broken and shouldn't be resumed
+        boost::filesystem::remove(packed_file_path, ec);
+        boost::filesystem::remove(state_path, ec);
+      }
+      return false;
+    }
+
+    boost::filesystem::remove(packed_file_path, ec);
+    boost::filesystem::remove(state_path, ec);
+    return true;
+  }
+
+
+  // Adds the blocks of source_core to target_core in ranges by add_blocks_range_to_core(), not through the pool
+  template<class callback_t>
+  bool import_blocks_from_core(currency::core& source_core, currency::core& target_core, callback_t cb_should_stop)
+  {
+    const uint64_t total_blocks = source_core.get_current_blockchain_size();
+    utils::threads_pool pool;
+    const size_t threads_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    pool.init(threads_count);
+
+    for (uint64_t start = 1; start < total_blocks; start += pre_download_validation_range_blocks)
+    {
+      const size_t count = static_cast<size_t>(std::min<uint64_t>(pre_download_validation_range_blocks, total_blocks - start));
+      std::list<currency::block> blocks_list;
+      std::list<currency::transaction> txs;
+      bool r = source_core.get_blocks(start, count, blocks_list, txs);
+      CHECK_AND_ASSERT_MES(r && blocks_list.size() == count, false, "Failed to get blocks " << start << "-" << start + count - 1 << " from core");
+
+      std::vector<currency::block> blocks(std::make_move_iterator(blocks_list.begin()), std::make_move_iterator(blocks_list.end()));
+      std::vector<currency::block_verification_context> bvcs(count, boost::value_initialized<currency::block_verification_context>());
+      std::vector<crypto::hash> ids(count);
+      std::vector<uint64_t> blobs_sizes(count);
+      auto tx_it = txs.begin();
+      for (size_t i = 0; i != count; ++i)
+      {
+        ids[i] = currency::get_block_hash(blocks[i]);
+        blobs_sizes[i] = currency::get_object_blobsize(blocks[i]);
+        for (const crypto::hash& tx_id : blocks[i].tx_hashes)
+        {
+          CHECK_AND_ASSERT_MES(tx_it != txs.end(), false, "Not all txs of block " << start + i << " are found in the source core");
+          CHECK_AND_ASSERT_MES(currency::get_transaction_hash(*tx_it) == tx_id, false, "tx " << currency::get_transaction_hash(*tx_it) << " doesn't match id " << tx_id << " in block " << start + i);
+          blobs_sizes[i] += currency::get_object_blobsize(*tx_it);
+          bvcs[i].m_onboard_transactions[tx_id] = std::move(*tx_it++);
+        }
+      }
+
+      r = add_blocks_range_to_core(target_core, blocks, ids, bvcs, blobs_sizes, start, pool, threads_count);
+      CHECK_AND_ASSERT_MES(r, false, "Failed to add blocks from height " << start << " to core");
+
+      const uint64_t last_height = start + count - 1;
+      std::cout << "Block " << last_height << "(" << (last_height * 100) / total_blocks << "%) \r";
+      if (cb_should_stop(total_blocks, last_height))
+      {
+        LOG_PRINT_MAGENTA(ENDL << "Interrupting updating db...", LOG_LEVEL_0);
+        return false;
+      }
+    }
+    return true;
+  }
 
   template<class callback_t>
   bool process_predownload(const boost::program_options::variables_map& vm, callback_t cb_should_stop)
@@ -92,7 +419,11 @@ namespace tools
       };
 
       tools::create_directories_if_necessary(working_folder);
-      r = cl.download_and_unzip(cb, downloading_file_path, url, 5000 /* timout */, "GET", std::string(), 30 /* fails count */);
+      // the size of the packed file is known only for the built-in link, so a custom one is downloaded as a single stream
+      if (pre_download.packed_size != 0 && url == pre_download.url)
+        r = download_and_unpack_in_parallel(url, pre_download.packed_size, downloading_file_path + ".packed", downloading_file_path, hash_stream, cb_should_stop);
+      else
+        r = cl.download_and_unzip(cb, downloading_file_path, url, 5000 /* timout */, "GET", std::string(), 30 /* fails count */);
       if (!r)
       {
         LOG_PRINT_RED("Downloading failed", LOG_LEVEL_0);
@@ -217,31 +548,8 @@ namespace tools
 
     LOG_PRINT_GREEN("Manually processing blocks from 1 to " << total_blocks << "...", LOG_LEVEL_0);
 
-    for (uint64_t i = 1; i != total_blocks; i++)
-    { 
-      std::list<currency::block> blocks;
-      std::list<currency::transaction> txs;
-      bool r = source_core.get_blocks(i, 1, blocks, txs);
-      CHECK_AND_ASSERT_MES(r && blocks.size()==1, false, "Failed to get block " << i << " from core");
-      currency::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      crypto::hash tx_hash = AUTO_VAL_INIT(tx_hash);
-      for (auto& tx : txs)
-      {
-        r = target_core.handle_incoming_tx(tx, tvc, true /* kept_by_block */);
-        CHECK_AND_ASSERT_MES(r && tvc.m_added_to_pool == true, false, "Failed to add a tx from block " << i << " from core");
-      }
-      currency::block_verification_context bvc = AUTO_VAL_INIT(bvc);
-      r = target_core.handle_incoming_block(*blocks.begin(), bvc);
-      CHECK_AND_ASSERT_MES(r && bvc.m_added_to_main_chain == true, false, "Failed to add block " << i << " to core");
-      if (!(i % 100))
-        std::cout << "Block " << i << "(" << (i * 100) / total_blocks << "%) \r";
-
-      if (cb_should_stop(total_blocks, i))
-      {
-        LOG_PRINT_MAGENTA(ENDL << "Interrupting updating db...", LOG_LEVEL_0);
-        return false;
-      }
-    }
+    if (!import_blocks_from_core(source_core, target_core, cb_should_stop))
+      return false;
     
     LOG_PRINT_GREEN("Processing finished, " << total_blocks << " successfully added.", LOG_LEVEL_0);
     target_core.deinit();
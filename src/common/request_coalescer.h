@@ -0,0 +1,77 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "misc_language.h"
+
+namespace tools
+{
+  // identical requests made while one of them is in flight wait for it and share its response instead of being sent too
+  template<class t_key, class t_response>
+  class request_coalescer
+  {
+  public:
+    template<class t_call>
+    bool call(const t_key& key, t_response& rsp, t_call do_call)
+    {
+      std::shared_ptr<in_flight_entry> pentry;
+      bool is_leader = false;
+      {
+        std::lock_guard<std::mutex> lk(m_lock);
+        auto it = m_in_flight.find(key);
+        if (it == m_in_flight.end())
+        {
+          pentry = std::make_shared<in_flight_entry>();
+          m_in_flight[key] = pentry;
+          is_leader = true;
+        }
+        else
+        {
+          pentry = it->second;
+        }
+      }
+
+      if (!is_leader)
+      {
+        std::unique_lock<std::mutex> lk(m_lock);
+        m_condition.wait(lk, [&]() { return pentry->done; });
+        if (pentry->r)
+          rsp = pentry->rsp;
+        return pentry->r;
+      }
+
+      bool r = false;
+      auto finisher = epee::misc_utils::create_scope_leave_handler([&]()
+      {
+        {
+          std::lock_guard<std::mutex> lk(m_lock);
+          pentry->r = r;
+          if (r)
+            pentry->rsp = rsp;
+          pentry->done = true;
+          m_in_flight.erase(key);
+        }
+        m_condition.notify_all();
+      });
+      r = do_call(rsp);
+      return r;
+    }
+
+  private:
+    struct in_flight_entry
+    {
+      bool done = false;
+      bool r = false;
+      t_response rsp;
+    };
+
+    std::mutex m_lock;
+    std::condition_variable m_condition;
+    std::map<t_key, std::shared_ptr<in_flight_entry>> m_in_flight;
+  };
+}
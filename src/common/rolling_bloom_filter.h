@@ -0,0 +1,106 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <type_traits>
+
+namespace tools
+{
+
+  // bloom filter remembering roughly the last [capacity, 2 * capacity] inserted items:
+  // items go to the current generation, when it's full the previous one is dropped and the current becomes previous
+  // meant for random-looking POD keys (hashes), so the indexes are taken directly from key bytes mixed with a salt
+  // no internal locking
+  template<typename key_t>
+  class rolling_bloom_filter
+  {
+    static_assert(std::is_trivially_copyable<key_t>::value && sizeof(key_t) >= 16, "rolling_bloom_filter supports POD keys of at least 16 bytes");
+
+  public:
+    // bits_per_item = 10 and hashes_count = 7 give about 1% false positives for a generation
+    rolling_bloom_filter(size_t capacity, uint64_t salt, size_t bits_per_item = 10, size_t hashes_count = 7)
+      : m_capacity(capacity ? capacity : 1)
+      , m_bits_count((capacity ? capacity : 1) * bits_per_item)
+      , m_hashes_count(hashes_count)
+      , m_salt(salt)
+      , m_current_count(0)
+      , m_current((m_bits_count + 63) / 64, 0)
+      , m_previous((m_bits_count + 63) / 64, 0)
+    {}
+
+    void insert(const key_t& key)
+    {
+      if (m_current_count >= m_capacity)
+      {
+        m_previous.swap(m_current);
+        std::fill(m_current.begin(), m_current.end(), 0);
+        m_current_count = 0;
+      }
+      uint64_t h1 = 0, h2 = 0;
+      get_hashes(key, h1, h2);
+      for (size_t i = 0; i != m_hashes_count; ++i)
+      {
+        uint64_t bit = (h1 + i * h2) % m_bits_count;
+        m_current[bit / 64] |= uint64_t(1) << (bit % 64);
+      }
+      ++m_current_count;
+    }
+
+    bool contains(const key_t& key) const
+    {
+      uint64_t h1 = 0, h2 = 0;
+      get_hashes(key, h1, h2);
+      return contains_in(m_current, h1, h2) || contains_in(m_previous, h1, h2);
+    }
+
+    void clear()
+    {
+      std::fill(m_current.begin(), m_current.end(), 0);
+      std::fill(m_previous.begin(), m_previous.end(), 0);
+      m_current_count = 0;
+    }
+
+  private:
+    static uint64_t mix(uint64_t x)
+    {
+      x ^= x >> 30;
+      x *= 0xbf58476d1ce4e5b9ULL;
+      x ^= x >> 27;
+      x *= 0x94d049bb133111ebULL;
+      x ^= x >> 31;
+      return x;
+    }
+
+    void get_hashes(const key_t& key, uint64_t& h1, uint64_t& h2) const
+    {
+      uint64_t parts[2] = { 0, 0 };
+      memcpy(parts, &key, sizeof(parts));
+      h1 = mix(parts[0] ^ m_salt);
+      h2 = mix(parts[1] + m_salt) | 1;
+    }
+
+    bool contains_in(const std::vector<uint64_t>& bits, uint64_t h1, uint64_t h2) const
+    {
+      for (size_t i = 0; i != m_hashes_count; ++i)
+      {
+        uint64_t bit = (h1 + i * h2) % m_bits_count;
+        if ((bits[bit / 64] & (uint64_t(1) << (bit % 64))) == 0)
+          return false;
+      }
+      return true;
+    }
+
+    size_t m_capacity;
+    uint64_t m_bits_count;
+    size_t m_hashes_count;
+    uint64_t m_salt;
+    size_t m_current_count;
+    std::vector<uint64_t> m_current;
+    std::vector<uint64_t> m_previous;
+  };
+
+} // namespace tools
@@ -0,0 +1,130 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <deque>
+#include <set>
+
+namespace tools
+{
+  /************************************************************************/
+  /* Median of a window of values that grows and shrinks at both ends.    */
+  /* The values are kept in two ordered halves, the lower one holds the   */
+  /* extra value if the count is odd: a push or pop costs O(log N), the   */
+  /* median is read from the halves' borders in O(1). Gives the same      */
+  /* result as epee::misc_utils::median() over the window's values.       */
+  /************************************************************************/
+  template<typename t_value>
+  class sliding_window_median
+  {
+  public:
+    sliding_window_median() : m_sum(0)
+    {}
+
+    void push_back(const t_value& v)
+    {
+      m_values.push_back(v);
+      insert(v);
+    }
+
+    void push_front(const t_value& v)
+    {
+      m_values.push_front(v);
+      insert(v);
+    }
+
+    void pop_back()
+    {
+      if (m_values.empty())
+        return;
+      erase(m_values.back());
+      m_values.pop_back();
+    }
+
+    void pop_front()
+    {
+      if (m_values.empty())
+        return;
+      erase(m_values.front());
+      m_values.pop_front();
+    }
+
+    void clear()
+    {
+      m_values.clear();
+      m_low.clear();
+      m_high.clear();
+      m_sum = 0;
+    }
+
+    size_t size() const
+    {
+      return m_values.size();
+    }
+
+    bool empty() const
+    {
+      return m_values.empty();
+    }
+
+    t_value get_median() const
+    {
+      if (m_low.empty())
+        return t_value{};
+      if (m_low.size() > m_high.size())
+        return *m_low.rbegin();
+      return (*m_low.rbegin() + *m_high.begin()) / 2;
+    }
+
+    t_value get_avg() const
+    {
+      if (m_values.empty())
+        return t_value{};
+      return m_sum / m_values.size();
+    }
+
+  private:
+    void insert(const t_value& v)
+    {
+      if (m_low.empty() || !(*m_low.rbegin() < v))
+        m_low.insert(v);
+      else
+        m_high.insert(v);
+      m_sum += v;
+      rebalance();
+    }
+
+    void erase(const t_value& v)
+    {
+      // all the values not greater than the lower half's max are in the lower half
+      if (!m_low.empty() && !(*m_low.rbegin() < v))
+        m_low.erase(m_low.find(v));
+      else
+        m_high.erase(m_high.find(v));
+      m_sum -= v;
+      rebalance();
+    }
+
+    void rebalance()
+    {
+      while (m_low.size() > m_high.size() + 1)
+      {
+        auto it = std::prev(m_low.end());
+        m_high.insert(*it);
+        m_low.erase(it);
+      }
+      while (m_high.size() > m_low.size())
+      {
+        auto it = m_high.begin();
+        m_low.insert(*it);
+        m_high.erase(it);
+      }
+    }
+
+    std::deque<t_value> m_values; // in the window's order
+    std::multiset<t_value> m_low;
+    std::multiset<t_value> m_high;
+    t_value m_sum;
+  };
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "misc_log_ex.h"
+#include "misc_os_dependent.h"
+
+namespace tools
+{
+  /************************************************************************/
+  /* Timings of the startup phases, printed by the daemon once p2p and    */
+  /* rpc are up. Phases may be nested and may run in parallel threads.    */
+  /************************************************************************/
+  class startup_profile
+  {
+  public:
+    static startup_profile& get()
+    {
+      static startup_profile p;
+      return p;
+    }
+
+    // the phases are reported relative to this moment
+    void start()
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      m_origin_ms = epee::misc_utils::get_tick_count();
+      m_phases.clear();
+    }
+
+    void add_phase(const std::string& name, uint64_t started_ms, uint64_t duration_ms, bool background)
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      m_phases.push_back(phase{ name, started_ms > m_origin_ms ? started_ms - m_origin_ms : 0, duration_ms, background });
+    }
+
+    std::string get_report() const
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      std::stringstream ss;
+      ss << "Startup profile, " << epee::misc_utils::get_tick_count() - m_origin_ms << " ms since the start:" << ENDL
+        << std::left << std::setw(12) << "  start_ms" << std::setw(12) << "duration_ms" << "phase" << ENDL;
+      for (const auto& p : m_phases)
+        ss << "  " << std::left << std::setw(10) << p.started_ms << std::setw(12) << p.duration_ms << p.name << (p.background ? " (in parallel)" : "") << ENDL;
+      return ss.str();
+    }
+
+  private:
+    startup_profile()
+      : m_origin_ms(epee::misc_utils::get_tick_count())
+    {}
+
+    struct phase
+    {
+      std::string name;
+      uint64_t started_ms;
+      uint64_t duration_ms;
+      bool background;
+    };
+
+    mutable std::mutex m_lock;
+    uint64_t m_origin_ms;
+    std::vector<phase> m_phases;
+  };
+
+  // adds the rest of the scope as a startup phase
+  class startup_phase_timer
+  {
+  public:
+    explicit startup_phase_timer(const char* name, bool background = false)
+      : m_name(name), m_background(background), m_started_ms(epee::misc_utils::get_tick_count())
+    {}
+    ~startup_phase_timer()
+    {
+      finish();
+    }
+
+    // ends the phase before the end of the scope
+    void finish()
+    {
+      if (!m_name)
+        return;
+      startup_profile::get().add_phase(m_name, m_started_ms, epee::misc_utils::get_tick_count() - m_started_ms, m_background);
+      m_name = nullptr;
+    }
+
+  private:
+    startup_phase_timer(const startup_phase_timer&) = delete;
+    startup_phase_timer& operator=(const startup_phase_timer&) = delete;
+
+    const char* m_name;
+    bool m_background;
+    uint64_t m_started_ms;
+  };
+}
@@ -2,10 +2,22 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-#pragma once 
+#pragma once
 
 #include <thread>
 #include <string>
+#include <list>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <boost/thread.hpp>
 
 namespace utils
@@ -35,6 +47,132 @@ namespace utils
     return res;
   }
 
+  /************************************************************************/
+  /* Move-only callable. Functors up to inline_size bytes (a lambda with  */
+  /* a few captured pointers) are kept in place, bigger ones on the heap. */
+  /************************************************************************/
+  class pool_task
+  {
+  public:
+    static const size_t inline_size = 6 * sizeof(void*);
+
+    pool_task() : m_ops(nullptr), m_heap(nullptr)
+    {}
+
+    template<typename t_func>
+    explicit pool_task(t_func&& f) : m_ops(nullptr), m_heap(nullptr)
+    {
+      typedef typename std::decay<t_func>::type func_t;
+      if constexpr (fits_inline<func_t>::value)
+      {
+        new (m_buf) func_t(std::forward<t_func>(f));
+        m_ops = &inline_ops<func_t>::ops;
+      }
+      else
+      {
+        m_heap = new func_t(std::forward<t_func>(f));
+        m_ops = &heap_ops<func_t>::ops;
+      }
+    }
+
+    pool_task(pool_task&& other) noexcept : m_ops(nullptr), m_heap(nullptr)
+    {
+      move_from(other);
+    }
+
+    pool_task& operator=(pool_task&& other) noexcept
+    {
+      if (this != &other)
+      {
+        reset();
+        move_from(other);
+      }
+      return *this;
+    }
+
+    ~pool_task()
+    {
+      reset();
+    }
+
+    explicit operator bool() const { return m_ops != nullptr; }
+
+    void operator()()
+    {
+      m_ops->invoke(this);
+    }
+
+  private:
+    pool_task(const pool_task&) = delete;
+    pool_task& operator=(const pool_task&) = delete;
+
+    template<typename func_t>
+    struct fits_inline
+    {
+      static constexpr bool value = sizeof(func_t) <= inline_size && alignof(func_t) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<func_t>::value;
+    };
+
+    struct ops_t
+    {
+      void (*invoke)(pool_task*);
+      void (*move)(pool_task* dst, pool_task* src);
+      void (*destroy)(pool_task*);
+    };
+
+    template<typename func_t>
+    struct inline_ops
+    {
+      static func_t* get(pool_task* t) { return reinterpret_cast<func_t*>(t->m_buf); }
+      static void invoke(pool_task* t) { (*get(t))(); }
+      static void move(pool_task* dst, pool_task* src) { new (dst->m_buf) func_t(std::move(*get(src))); get(src)->~func_t(); }
+      static void destroy(pool_task* t) { get(t)->~func_t(); }
+      static const ops_t ops;
+    };
+
+    template<typename func_t>
+    struct heap_ops
+    {
+      static void invoke(pool_task* t) { (*static_cast<func_t*>(t->m_heap))(); }
+      static void move(pool_task* dst, pool_task* src) { dst->m_heap = src->m_heap; src->m_heap = nullptr; }
+      static void destroy(pool_task* t) { delete static_cast<func_t*>(t->m_heap); t->m_heap = nullptr; }
+      static const ops_t ops;
+    };
+
+    void move_from(pool_task& other)
+    {
+      if (!other.m_ops)
+        return;
+      other.m_ops->move(this, &other);
+      m_ops = other.m_ops;
+      other.m_ops = nullptr;
+    }
+
+    void reset()
+    {
+      if (!m_ops)
+        return;
+      m_ops->destroy(this);
+      m_ops = nullptr;
+    }
+
+    alignas(std::max_align_t) unsigned char m_buf[inline_size];
+    const ops_t* m_ops;
+    void* m_heap;
+  };
+
+  template<typename func_t>
+  const pool_task::ops_t pool_task::inline_ops<func_t>::ops = { &pool_task::inline_ops<func_t>::invoke, &pool_task::inline_ops<func_t>::move, &pool_task::inline_ops<func_t>::destroy };
+  template<typename func_t>
+  const pool_task::ops_t pool_task::heap_ops<func_t>::ops = { &pool_task::heap_ops<func_t>::invoke, &pool_task::heap_ops<func_t>::move, &pool_task::heap_ops<func_t>::destroy };
+
+  /************************************************************************/
+  /* Work-stealing pool: each worker has its own deque, takes its newest  */
+  /* task first and steals the oldest ones of the others when it's idle.  */
+  /* Tasks added by a worker go to its own deque, the rest are spread     */
+  /* over the workers. Batches (add_batch_and_wait, parallel_for) are run */
+  /* by the caller too, so a batch added from inside a job can't stall    */
+  /* the pool and a pool without threads still works, in the caller.     */
+  /************************************************************************/
   class threads_pool
   {
   public:
@@ -51,103 +189,268 @@ namespace utils
       int num_threads = std::thread::hardware_concurrency();
       this->init(num_threads);
     }
+    // to be called once, before any job is added
     void init(size_t num_threads)
     {
       m_is_stop = false;
 
+      // the deques are created before any thread starts and stay put till the destructor
+      for (size_t i = 0; i < num_threads; i++)
+        m_queues.emplace_back(new worker_queue());
+      m_workers_count = m_queues.size();
       for (size_t i = 0; i < num_threads; i++)
       {
-        m_threads.push_back(std::thread([this]() {this->worker_func(); }));
+        m_threads.push_back(std::thread([this, i]() {this->worker_func(i); }));
       }
     }
 
-    threads_pool() : m_is_stop(false), m_threads_counter(0)
+    threads_pool() : m_is_stop(false), m_workers_count(0), m_pending(0), m_next_queue(0)
     {}
 
+    size_t get_threads_count() const
+    {
+      return m_workers_count;
+    }
+
     template<typename t_executor_func>
     bool add_job(t_executor_func func)
     {
-      {
-        std::unique_lock<std::mutex> lock(m_queue_mutex);
-        m_jobs_que.push_back(build_call_executor(func));
-      }
-      m_condition.notify_one();
+      push_task(pool_task(std::move(func)));
       return true;
     }
 
     void add_batch_and_wait(const jobs_container& cntr)
     {
-      std::condition_variable batch_condition;
-      std::mutex batch_mutex;
+      std::vector<call_executor_base*> jobs;
+      jobs.reserve(cntr.size());
+      for (const auto& jb : cntr)
+        jobs.push_back(jb.get());
 
+      parallel_for(jobs.size(), [&jobs](size_t i) { jobs[i]->execute(); });
+      LOG_PRINT_L3("All jobs finished");
+    }
 
-      std::atomic<size_t> cnt(0);
-      for (const auto& jb : cntr)
-      {
-        call_executor_base* pjob = jb.get();
-        add_job([&, pjob]() {
-          pjob->execute();
-          {
-            std::lock_guard<std::mutex> lock(batch_mutex);
-            cnt++;
-          }
-          batch_condition.notify_one();
-        });
-      }
+    // calls f(i) for each i in [0, count), grain indexes at a time, in the pool's threads and in the caller; returns when all are done,
+    // rethrows the first exception thrown by f (the rest of the indexes are still processed)
+    template<typename t_func>
+    void parallel_for(size_t count, const t_func& f, size_t grain = 1)
+    {
+      if (!count)
+        return;
+      if (!grain)
+        grain = 1;
+      size_t chunks = (count + grain - 1) / grain;
 
-      std::unique_lock<std::mutex> lock(batch_mutex);
-      batch_condition.wait(lock, [&]()
+      auto state = std::make_shared<batch_state>(count, grain);
+      state->pfunc = &f;
+      state->run_range = [](const void* pf, size_t from, size_t to)
       {
-        return cnt == cntr.size();
-      });
-      LOG_PRINT_L0("All jobs finiahed");
+        const t_func& func = *static_cast<const t_func*>(pf);
+        for (size_t i = from; i != to; ++i)
+          func(i);
+      };
+
+      // helpers only claim chunks, so there's no point in more of them than chunks left after the caller's own
+      size_t helpers = std::min(chunks - 1, m_workers_count.load());
+      for (size_t i = 0; i != helpers; ++i)
+        push_task(pool_task([state]() { state->run(); }));
+
+      state->run();
+      state->wait();
+      if (state->error)
+        std::rethrow_exception(state->error);
     }
 
-    ~threads_pool()
+    // fork-join: runs a() in the pool (or in the caller, if no worker is free) and b() in the caller, returns when both are done
+    template<typename t_func_a, typename t_func_b>
+    void invoke_both(const t_func_a& a, const t_func_b& b)
     {
-      m_is_stop = true;
+      parallel_for(2, [&](size_t i) { if (i == 0) a(); else b(); });
+    }
+
+    // the workers run the tasks that are left and exit, tasks added once they are gone run in the caller
+    void stop()
+    {
+      {
+        std::lock_guard<std::mutex> lk(m_sleep_mutex);
+        m_is_stop = true;
+      }
       m_condition.notify_all();
       for (auto& th : m_threads)
       {
-        th.join();
+        if (th.joinable())
+          th.join();
       }
+      m_workers_count = 0;
+    }
+
+    ~threads_pool()
+    {
+      stop();
     }
 
   private:
-    void worker_func()
+    struct worker_queue
     {
-      LOG_PRINT_L0("Worker thread is started");
-      while (true)
+      std::mutex lock;
+      std::deque<pool_task> tasks;
+    };
+
+    // a batch is shared by the caller and the helper tasks, which may outlive it if they were late to find any chunks left
+    struct batch_state
+    {
+      batch_state(size_t c, size_t g) : count(c), grain(g), next(0), done(0), pfunc(nullptr), run_range(nullptr)
+      {}
+
+      void run()
       {
-        std::shared_ptr<call_executor_base> job;
+        while (true)
         {
-          std::unique_lock<std::mutex> lock(m_queue_mutex);
-
-          m_condition.wait(lock, [this]()
+          size_t from = next.fetch_add(grain);
+          if (from >= count)
+            return;
+          size_t to = std::min(from + grain, count);
+          try
           {
-            return !m_jobs_que.empty() || m_is_stop;
-          });
-          if (m_is_stop)
+            run_range(pfunc, from, to);
+          }
+          catch (...)
           {
-            LOG_PRINT_L0("Worker thread is finished");
-            return;
+            std::lock_guard<std::mutex> lk(lock);
+            if (!error)
+              error = std::current_exception();
+          }
+          if (done.fetch_add(to - from) + (to - from) == count)
+          {
+            std::lock_guard<std::mutex> lk(lock);
+            condition.notify_all();
           }
-
-          job = m_jobs_que.front();
-          m_jobs_que.pop_front();
         }
+      }
 
-        job->execute();
+      void wait()
+      {
+        std::unique_lock<std::mutex> lk(lock);
+        condition.wait(lk, [this]() { return done.load() == count; });
       }
+
+      const size_t count;
+      const size_t grain;
+      std::atomic<size_t> next;
+      std::atomic<size_t> done;
+      const void* pfunc;
+      void (*run_range)(const void* pf, size_t from, size_t to);
+      std::exception_ptr error;
+      std::mutex lock;
+      std::condition_variable condition;
+    };
+
+    struct worker_slot
+    {
+      threads_pool* ppool;
+      size_t index;
+    };
+
+    static worker_slot& current_worker()
+    {
+      static thread_local worker_slot slot = { nullptr, 0 };
+      return slot;
     }
 
+    void push_task(pool_task&& t)
+    {
+      size_t workers_count = m_workers_count.load();
+      if (!workers_count)
+      {
+        // nobody would ever run it
+        t();
+        return;
+      }
 
+      worker_slot& ws = current_worker();
+      size_t index = ws.ppool == this ? ws.index : m_next_queue.fetch_add(1, std::memory_order_relaxed) % workers_count;
+      {
+        std::lock_guard<std::mutex> lk(m_queues[index]->lock);
+        m_queues[index]->tasks.push_back(std::move(t));
+      }
+      m_pending.fetch_add(1);
+      {
+        // a worker checks m_pending under this lock before it sleeps, so the notification can't get lost
+        std::lock_guard<std::mutex> lk(m_sleep_mutex);
+      }
+      m_condition.notify_one();
+    }
+
+    bool take_task(size_t index, pool_task& t)
+    {
+      {
+        worker_queue& own = *m_queues[index];
+        std::lock_guard<std::mutex> lk(own.lock);
+        if (!own.tasks.empty())
+        {
+          t = std::move(own.tasks.back());
+          own.tasks.pop_back();
+          return true;
+        }
+      }
+      size_t workers_count = m_queues.size();
+      for (size_t n = 1; n < workers_count; ++n)
+      {
+        worker_queue& victim = *m_queues[(index + n) % workers_count];
+        std::lock_guard<std::mutex> lk(victim.lock);
+        if (!victim.tasks.empty())
+        {
+          t = std::move(victim.tasks.front());
+          victim.tasks.pop_front();
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void worker_func(size_t index)
+    {
+      LOG_PRINT_L0("Worker thread is started");
+      current_worker() = worker_slot{ this, index };
+      while (true)
+      {
+        pool_task job;
+        if (take_task(index, job))
+        {
+          m_pending.fetch_sub(1);
+          job();
+          continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_condition.wait(lock, [this]()
+        {
+          return m_pending.load() != 0 || m_is_stop;
+        });
+        if (m_is_stop && m_pending.load() == 0)
+        {
+          LOG_PRINT_L0("Worker thread is finished");
+          return;
+        }
+      }
+    }
 
-    jobs_container m_jobs_que;
+    std::vector<std::unique_ptr<worker_queue>> m_queues;
     std::condition_variable m_condition;
-    std::mutex m_queue_mutex;
+    std::mutex m_sleep_mutex;
     std::vector<std::thread> m_threads;
     std::atomic<bool> m_is_stop;
-    std::atomic<int64_t> m_threads_counter;
+    std::atomic<size_t> m_workers_count;
+    std::atomic<size_t> m_pending;       // tasks in all the deques
+    std::atomic<size_t> m_next_queue;
   };
-}
\ No newline at end of file
+
+  // the process-wide compute pool (one thread per core), for the parallel parts of verification, wallet scanning and proofs
+  inline threads_pool& get_compute_pool()
+  {
+    static threads_pool pool;
+    static std::once_flag init_flag;
+    std::call_once(init_flag, []() { pool.init(); });
+    return pool;
+  }
+}
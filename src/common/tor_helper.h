@@ -4,14 +4,159 @@
 
 #pragma once
 
+#include <atomic>
+#include <ctime>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "tor-connect/torlib/tor_wrapper.h"
+#include "net/levin_client.h"
+#include "storages/levin_abstract_invoke2.h"
+#include "crypto/crypto.h"
+#include "currency_protocol/currency_protocol_defs.h"
 
+#define TOR_RELAY_POOL_SIZE                   3
+#define TOR_RELAY_MAX_TXS_PER_CIRCUIT         4
+#define TOR_RELAY_MAX_CIRCUIT_AGE             600     // seconds
+#define TOR_RELAY_CONNECT_TIMEOUT             10000
+#define TOR_RELAY_ATTEMPTS                    3
 
 
 namespace tools
 {
   typedef epee::levin::levin_client_impl2<tools::tor::tor_transport> levin_over_tor_client;
-  
+
+  /************************************************************************/
+  /* Warm Tor circuits for relaying txs: building one takes seconds, so   */
+  /* up to TOR_RELAY_POOL_SIZE of them are kept connected, each to a node */
+  /* picked at random. A circuit is rebuilt after                         */
+  /* TOR_RELAY_MAX_TXS_PER_CIRCUIT txs or TOR_RELAY_MAX_CIRCUIT_AGE       */
+  /* seconds, so txs can't be linked by the circuit they came over for    */
+  /* long. A batch is spread over the circuits and sent in parallel.      */
+  /************************************************************************/
+  class tor_relay_pool
+  {
+  public:
+    struct relay_node
+    {
+      std::string host;
+      int port;
+    };
+
+    tor_relay_pool(const std::vector<relay_node>& nodes, tools::tor::t_transport_state_notifier* pnotifier)
+      : m_nodes(nodes), m_pnotifier(pnotifier)
+    {}
+
+    bool relay_tx(const currency::blobdata& tx_blob)
+    {
+      for (size_t i = 0; i != TOR_RELAY_ATTEMPTS; i++)
+      {
+        std::unique_ptr<circuit> pc = take_circuit();
+        if (!pc)
+          continue;
+        if (send_over(*pc, tx_blob))
+        {
+          give_back(std::move(pc));
+          return true;
+        }
+        // a failed circuit is not reused
+        pc->client.disconnect();
+      }
+      return false;
+    }
+
+    // results[i] tells if txs[i] was accepted
+    void relay_txs(const std::vector<currency::blobdata>& txs, std::vector<bool>& results)
+    {
+      results.assign(txs.size(), false);
+      std::atomic<size_t> next(0);
+      std::vector<char> ok(txs.size(), 0);
+      auto worker = [&]()
+      {
+        for (size_t i = next++; i < txs.size(); i = next++)
+          ok[i] = relay_tx(txs[i]) ? 1 : 0;
+      };
+
+      std::vector<std::future<void>> helpers;
+      size_t helpers_count = std::min<size_t>(TOR_RELAY_POOL_SIZE, txs.size());
+      for (size_t i = 1; i < helpers_count; i++)
+        helpers.push_back(std::async(std::launch::async, worker));
+      worker();
+      for (auto& h : helpers)
+        h.get();
+      for (size_t i = 0; i != txs.size(); i++)
+        results[i] = ok[i] != 0;
+    }
+
+  private:
+    struct circuit
+    {
+      levin_over_tor_client client;
+      uint64_t txs_sent = 0;
+      time_t created = 0;
+    };
+
+    bool is_worn_out(circuit& c)
+    {
+      return c.txs_sent >= TOR_RELAY_MAX_TXS_PER_CIRCUIT || time(nullptr) - c.created > TOR_RELAY_MAX_CIRCUIT_AGE || !c.client.is_connected();
+    }
+
+    // a warm one if there's any, a new one otherwise; nullptr if it can't be built
+    std::unique_ptr<circuit> take_circuit()
+    {
+      {
+        std::lock_guard<std::mutex> lk(m_lock);
+        while (!m_idle.empty())
+        {
+          std::unique_ptr<circuit> pc = std::move(m_idle.back());
+          m_idle.pop_back();
+          if (!is_worn_out(*pc))
+            return pc;
+          pc->client.disconnect();
+        }
+      }
+
+      if (m_nodes.empty())
+        return nullptr;
+      const relay_node& node = m_nodes[crypto::rand<size_t>() % m_nodes.size()];
+      std::unique_ptr<circuit> pc(new circuit());
+      pc->client.get_transport().set_notifier(m_pnotifier);
+      if (!pc->client.connect(node.host, node.port, TOR_RELAY_CONNECT_TIMEOUT))
+        return nullptr;
+      pc->created = time(nullptr);
+      return pc;
+    }
+
+    void give_back(std::unique_ptr<circuit>&& pc)
+    {
+      if (is_worn_out(*pc))
+      {
+        pc->client.disconnect();
+        return;
+      }
+      std::lock_guard<std::mutex> lk(m_lock);
+      if (m_idle.size() < TOR_RELAY_POOL_SIZE)
+        m_idle.push_back(std::move(pc));
+      else
+        pc->client.disconnect();
+    }
+
+    bool send_over(circuit& c, const currency::blobdata& tx_blob)
+    {
+      currency::NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::request p2p_req = AUTO_VAL_INIT(p2p_req);
+      currency::NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::response p2p_rsp = AUTO_VAL_INIT(p2p_rsp);
+      p2p_req.txs.push_back(tx_blob);
+      epee::net_utils::invoke_remote_command2(currency::NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::ID, p2p_req, p2p_rsp, c.client);
+      ++c.txs_sent;
+      return p2p_rsp.code == API_RETURN_CODE_OK;
+    }
+
+    std::vector<relay_node> m_nodes;
+    tools::tor::t_transport_state_notifier* m_pnotifier;
+    std::mutex m_lock;
+    std::vector<std::unique_ptr<circuit>> m_idle;
+  };
 }
 
 
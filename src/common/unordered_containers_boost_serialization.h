@@ -7,8 +7,10 @@
 #pragma once
 
 #include <boost/serialization/split_free.hpp>
+#include <boost/foreach.hpp>
 #include <unordered_map>
 #include <unordered_set>
+#include "flat_hash_map.h"
 
 namespace boost
 {
@@ -98,6 +100,37 @@ namespace boost
     }
 
 
+    // the same format as std::unordered_map, so they may replace each other
+    template <class Archive, class h_key, class hval, class h_hash>
+    inline void save(Archive &a, const tools::flat_hash_map<h_key, hval, h_hash> &x, const boost::serialization::version_type ver)
+    {
+      size_t s = x.size();
+      a << s;
+      BOOST_FOREACH(auto& v, x)
+      {
+        a << v.first;
+        a << v.second;
+      }
+    }
+
+    template <class Archive, class h_key, class hval, class h_hash>
+    inline void load(Archive &a, tools::flat_hash_map<h_key, hval, h_hash> &x, const boost::serialization::version_type ver)
+    {
+      x.clear();
+      size_t s = 0;
+      a >> s;
+      x.reserve(s);
+      for(size_t i = 0; i != s; i++)
+      {
+        h_key k;
+        hval v;
+        a >> k;
+        a >> v;
+        x[k] = v;
+      }
+    }
+
+
     template <class Archive, class h_key, class hval>
     inline void serialize(Archive &a, std::unordered_map<h_key, hval> &x, const boost::serialization::version_type ver)
     {
@@ -115,5 +148,11 @@ namespace boost
     {
       split_free(a, x, ver);
     }
+
+    template <class Archive, class h_key, class hval, class h_hash>
+    inline void serialize(Archive &a, tools::flat_hash_map<h_key, hval, h_hash> &x, const boost::serialization::version_type ver)
+    {
+      split_free(a, x, ver);
+    }
   }
 }
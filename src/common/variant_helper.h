@@ -3,10 +3,52 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #pragma once
+#include <type_traits>
+#include <typeinfo>
+#include <boost/variant.hpp>
+#include <boost/mpl/find.hpp>
+#include <boost/mpl/distance.hpp>
+
+namespace tools
+{
+  // The index of T among the alternatives of a boost::variant, known at compile time:
+  // checking the type of a variant's value is then a comparison of which() instead of type_info's.
+  template<typename variant_t, typename T>
+  struct variant_type_index
+  {
+    static constexpr bool is_variant = false;
+    static constexpr bool is_alternative = false;
+    static constexpr int value = -1;
+  };
+
+  template<typename T, typename... types_t>
+  struct variant_type_index<boost::variant<types_t...>, T>
+  {
+  private:
+    // variant::types also unfolds variants made with make_variant_over<> and unwraps recursive_wrapper<>
+    typedef typename boost::variant<types_t...>::types types;
+    typedef typename boost::mpl::find<types, T>::type found_t;
+  public:
+    static constexpr bool is_variant = true;
+    static constexpr bool is_alternative = !std::is_same<found_t, typename boost::mpl::end<types>::type>::value;
+    static constexpr int value = is_alternative ? static_cast<int>(boost::mpl::distance<typename boost::mpl::begin<types>::type, found_t>::value) : -1;
+  };
+
+  // same as v.type() == typeid(T), for anything else than boost::variant it's what is done
+  template<typename T, typename variant_t>
+  inline bool is_variant_type(const variant_t& v)
+  {
+    typedef variant_type_index<variant_t, typename std::remove_cv<T>::type> index_t;
+    if constexpr (index_t::is_variant)
+      return index_t::is_alternative && v.which() == index_t::value;
+    else
+      return v.type() == typeid(T);
+  }
+}
 
 #define VARIANT_SWITCH_BEGIN(v_type_obj) {auto & local_reference_eokcmeokmeokcm ATTRIBUTE_UNUSED = v_type_obj; if(false) {;
-#define VARIANT_CASE_CONST(v_type, typed_name) } else if(local_reference_eokcmeokmeokcm.type() == typeid(v_type)) {  const v_type& typed_name ATTRIBUTE_UNUSED = boost::get<v_type>(local_reference_eokcmeokmeokcm);
-#define VARIANT_CASE(v_type, typed_name) } else if(local_reference_eokcmeokmeokcm.type() == typeid(v_type)) {  v_type& typed_name ATTRIBUTE_UNUSED = boost::get<v_type>(local_reference_eokcmeokmeokcm);
+#define VARIANT_CASE_CONST(v_type, typed_name) } else if(tools::is_variant_type<v_type>(local_reference_eokcmeokmeokcm)) {  const v_type& typed_name ATTRIBUTE_UNUSED = boost::get<v_type>(local_reference_eokcmeokmeokcm);
+#define VARIANT_CASE(v_type, typed_name) } else if(tools::is_variant_type<v_type>(local_reference_eokcmeokmeokcm)) {  v_type& typed_name ATTRIBUTE_UNUSED = boost::get<v_type>(local_reference_eokcmeokmeokcm);
 #define VARIANT_CASE_TV(v_type) VARIANT_CASE(v_type, tv) 
 #define VARIANT_CASE_OTHER() } else { 
 #define VARIANT_CASE_THROW_ON_OTHER() } else { ASSERT_MES_AND_THROW("Unknown type in switch statement: " << local_reference_eokcmeokmeokcm.type().name());
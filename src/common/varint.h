@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <iterator>
 #include <limits>
 #include <type_traits>
 #include <utility>
@@ -49,9 +50,9 @@ namespace tools {
     template<typename t_type>
     std::string get_varint_data(const t_type& v)
     {
-      std::stringstream ss;
-      write_varint(std::ostreambuf_iterator<char>(ss), v);
-      return ss.str();
+      std::string s;
+      write_varint(std::back_inserter(s), v);
+      return s;
     }
 
     template<int bits, typename InputIt, typename T>
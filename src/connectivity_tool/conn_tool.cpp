@@ -25,6 +25,7 @@ using namespace epee;
 #include "storages/http_abstract_invoke.h"
 #include "net/http_client.h"
 #include "currency_core/genesis_acc.h"
+#include "network_crawler.h"
 #include <cstdlib>
 
 namespace po = boost::program_options;
@@ -63,6 +64,12 @@ namespace
   const command_line::arg_descriptor<std::string> arg_pack_file           ("pack-file", "perform gzip-packing and calculate hash for a given file");
   const command_line::arg_descriptor<std::string> arg_unpack_file         ("unpack-file", "Perform gzip-unpacking and calculate hash for a given file");
   const command_line::arg_descriptor<std::string> arg_target_file         ("target-file", "Specify target file for pack-file and unpack-file commands");
+  const command_line::arg_descriptor<std::string> arg_crawl               ("crawl", "Crawl the p2p network starting from the given peers, crawl=<ip>:<port>[,<ip>:<port>...]");
+  const command_line::arg_descriptor<std::string> arg_crawl_output        ("crawl-output", "File the crawler writes json lines to", "crawl.jsonl");
+  const command_line::arg_descriptor<size_t>      arg_crawl_threads       ("crawl-threads", "Number of peers handshaked at once", 64);
+  const command_line::arg_descriptor<size_t>      arg_crawl_max_peers     ("crawl-max-peers", "Stop looking for new peers after that many", 10000);
+  const command_line::arg_descriptor<uint64_t>    arg_crawl_watch_seconds ("crawl-watch-blocks-seconds", "After crawling keep connections to some of the peers for that long and log NOTIFY_NEW_BLOCK arrivals", 0);
+  const command_line::arg_descriptor<size_t>      arg_crawl_watch_peers   ("crawl-watch-peers", "Number of the connections kept for crawl-watch-blocks-seconds", 100);
   //const command_line::arg_descriptor<std::string> arg_send_ipc            ("send-ipc", "Send IPC request to UI");
 }
 
@@ -582,6 +589,8 @@ bool handle_get_daemon_info(po::variables_map& vm)
     << "target_calculating_enum_blocks: " << res.performance_data.target_calculating_enum_blocks << ENDL
     << "target_calculating_calc: " << res.performance_data.target_calculating_calc << ENDL
     << "all_txs_insert_time_5: " << res.performance_data.all_txs_insert_time_5 << ENDL
+    << "txs_prevalidation_time: " << res.performance_data.txs_prevalidation_time << ENDL
+    << "batch_verify_range_proofs_time: " << res.performance_data.batch_verify_range_proofs_time << ENDL
     << "tx_add_one_tx_time: " << res.performance_data.tx_add_one_tx_time << ENDL
     << "tx_check_inputs_time: " << res.performance_data.tx_check_inputs_time << ENDL
     << "tx_process_attachment: " << res.performance_data.tx_process_attachment << ENDL
@@ -620,7 +629,16 @@ bool handle_get_daemon_info(po::variables_map& vm)
     PRINT_FIELD_NAME(res.tx_pool_performance_data, "pool_", check_inputs_time)
     PRINT_FIELD_NAME(res.tx_pool_performance_data, "pool_", begin_tx_time)
     PRINT_FIELD_NAME(res.tx_pool_performance_data, "pool_", update_db_time)
-    PRINT_FIELD_NAME(res.tx_pool_performance_data, "pool_", db_commit_time);
+    PRINT_FIELD_NAME(res.tx_pool_performance_data, "pool_", db_commit_time)
+    PRINT_FIELD_NAME(res.tx_pool_performance_data, "pool_", admission_queue_depth)
+    PRINT_FIELD_NAME(res.tx_pool_performance_data, "pool_", admission_verification_time)
+    PRINT_FIELD_NAME(res.rpc_stat, "rpc_", connections_count)
+    PRINT_FIELD_NAME(res.rpc_stat, "rpc_", requests_count)
+    PRINT_FIELD_NAME(res.rpc_stat, "rpc_", reused_connection_requests_count)
+    PRINT_FIELD_NAME(res.rpc_stat, "rpc_", response_cache_hits)
+    PRINT_FIELD_NAME(res.rpc_stat, "rpc_", response_cache_misses)
+    PRINT_FIELD_NAME(res.rpc_stat, "rpc_", response_cache_entries_count)
+    PRINT_FIELD_NAME(res.rpc_stat, "rpc_", response_cache_size);
 
 
   return true;
@@ -1199,6 +1217,27 @@ bool handle_send_ipc(const std::string& parms)
 }
 */
 
+bool handle_crawl(po::variables_map& vm)
+{
+  tools::network_crawler::config cfg = AUTO_VAL_INIT(cfg);
+  boost::split(cfg.seeds, command_line::get_arg(vm, arg_crawl), boost::is_any_of(","), boost::token_compress_on);
+  cfg.seeds.erase(std::remove(cfg.seeds.begin(), cfg.seeds.end(), std::string()), cfg.seeds.end());
+  if (cfg.seeds.empty())
+  {
+    std::cout << "ERROR: no peers to start crawling from" << ENDL;
+    return false;
+  }
+  cfg.threads_count = command_line::get_arg(vm, arg_crawl_threads);
+  cfg.max_peers = command_line::get_arg(vm, arg_crawl_max_peers);
+  cfg.timeout = command_line::get_arg(vm, arg_timeout);
+  cfg.output_path = command_line::get_arg(vm, arg_crawl_output);
+  cfg.watch_seconds = command_line::get_arg(vm, arg_crawl_watch_seconds);
+  cfg.watch_peers_count = command_line::get_arg(vm, arg_crawl_watch_peers);
+
+  tools::network_crawler crawler(cfg);
+  return crawler.run();
+}
+//---------------------------------------------------------------------------------------------------------------
 bool handle_pack_file(po::variables_map& vm)
 {
   bool do_pack = false;
@@ -1297,6 +1336,12 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_params, arg_pack_file);
   command_line::add_arg(desc_params, arg_unpack_file);
   command_line::add_arg(desc_params, arg_target_file);
+  command_line::add_arg(desc_params, arg_crawl);
+  command_line::add_arg(desc_params, arg_crawl_output);
+  command_line::add_arg(desc_params, arg_crawl_threads);
+  command_line::add_arg(desc_params, arg_crawl_max_peers);
+  command_line::add_arg(desc_params, arg_crawl_watch_seconds);
+  command_line::add_arg(desc_params, arg_crawl_watch_peers);
   //command_line::add_arg(desc_params, arg_send_ipc);
   
 
@@ -1375,6 +1420,10 @@ int main(int argc, char* argv[])
   {
     return handle_pack_file(vm) ? EXIT_SUCCESS : EXIT_FAILURE;
   }
+  else if (command_line::has_arg(vm, arg_crawl))
+  {
+    return handle_crawl(vm) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
   /*else if (command_line::has_arg(vm, arg_send_ipc))
   {
     handle_send_ipc(command_line::get_arg(vm, arg_send_ipc)) ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -0,0 +1,396 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <algorithm>
+#include <thread>
+#include "include_base_utils.h"
+#include "version.h"
+#include "network_crawler.h"
+#include "zlib_helper.h"
+#include "net/levin_base.h"
+#include "storages/levin_abstract_invoke2.h"
+#include "storages/portable_storage_template_helper.h"
+#include "p2p/p2p_protocol_defs.h"
+#include "p2p/p2p_networks.h"
+#include "currency_protocol/currency_protocol_defs.h"
+#include "currency_core/currency_format_utils.h"
+
+namespace tools
+{
+  namespace
+  {
+    typedef nodetool::COMMAND_HANDSHAKE_T<currency::CORE_SYNC_DATA> COMMAND_HANDSHAKE;
+    typedef nodetool::COMMAND_TIMED_SYNC_T<currency::CORE_SYNC_DATA> COMMAND_TIMED_SYNC;
+
+    const size_t max_watched_packet_size = 50 * 1024 * 1024;
+
+    struct peer_record
+    {
+      std::string type;
+      std::string address;
+      std::string status;
+      uint64_t connect_ms;
+      uint64_t handshake_ms;
+      std::string peer_id;
+      std::string client_version;
+      uint64_t height;
+      std::string top_id;
+      uint64_t protocol_features;
+      uint64_t pruned_height;
+      int64_t time_delta;
+      uint64_t peers_returned;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(type)
+        KV_SERIALIZE(address)
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(connect_ms)
+        KV_SERIALIZE(handshake_ms)
+        KV_SERIALIZE(peer_id)
+        KV_SERIALIZE(client_version)
+        KV_SERIALIZE(height)
+        KV_SERIALIZE(top_id)
+        KV_SERIALIZE(protocol_features)
+        KV_SERIALIZE(pruned_height)
+        KV_SERIALIZE(time_delta)
+        KV_SERIALIZE(peers_returned)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct block_arrival_record
+    {
+      std::string type;
+      std::string id;
+      uint64_t height;
+      std::string address;
+      uint64_t hop;
+      uint64_t arrival_index;
+      uint64_t delay_ms;        // after the first arrival of this block
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(type)
+        KV_SERIALIZE(id)
+        KV_SERIALIZE(height)
+        KV_SERIALIZE(address)
+        KV_SERIALIZE(hop)
+        KV_SERIALIZE(arrival_index)
+        KV_SERIALIZE(delay_ms)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct block_summary_record
+    {
+      std::string type;
+      std::string id;
+      uint64_t height;
+      uint64_t arrivals;
+      uint64_t watched_peers;
+      uint64_t median_delay_ms;
+      uint64_t p90_delay_ms;
+      uint64_t max_delay_ms;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(type)
+        KV_SERIALIZE(id)
+        KV_SERIALIZE(height)
+        KV_SERIALIZE(arrivals)
+        KV_SERIALIZE(watched_peers)
+        KV_SERIALIZE(median_delay_ms)
+        KV_SERIALIZE(p90_delay_ms)
+        KV_SERIALIZE(max_delay_ms)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    std::string to_json_line(const std::string& json)
+    {
+      // kv json comes with line breaks
+      std::string line;
+      line.reserve(json.size());
+      for (char c : json)
+        if (c != '\r' && c != '\n')
+          line += c;
+      return line;
+    }
+
+    bool parse_address(const std::string& address, std::string& host, uint32_t& port)
+    {
+      size_t pos = address.rfind(':');
+      if (pos == std::string::npos || pos == 0)
+        return false;
+      host = address.substr(0, pos);
+      return epee::string_tools::get_xtype_from_string(port, address.substr(pos + 1)) && port != 0;
+    }
+  }
+  //---------------------------------------------------------------------------------------------------------------
+  network_crawler::network_crawler(const config& cfg)
+    : m_config(cfg)
+    , m_genesis_id(currency::null_hash)
+    , m_in_progress(0)
+    , m_reachable_count(0)
+    , m_unreachable_count(0)
+  {}
+  //---------------------------------------------------------------------------------------------------------------
+  bool network_crawler::run()
+  {
+    currency::block genesis = AUTO_VAL_INIT(genesis);
+    CHECK_AND_ASSERT_MES(currency::generate_genesis_block(genesis), false, "failed to generate genesis block");
+    // the nodes know our "top" block and won't try to sync with us
+    m_genesis_id = currency::get_block_hash(genesis);
+
+    m_output.open(m_config.output_path, std::ios_base::out | std::ios_base::trunc);
+    CHECK_AND_ASSERT_MES(m_output.is_open(), false, "failed to open " << m_config.output_path);
+
+    for (const auto& s : m_config.seeds)
+    {
+      peer_address pa = AUTO_VAL_INIT(pa);
+      CHECK_AND_ASSERT_MES(parse_address(s, pa.host, pa.port), false, "wrong seed address: " << s << ", <host>:<port> expected");
+      if (m_seen.insert(pa.host + ":" + std::to_string(pa.port)).second)
+        m_queue.push_back(pa);
+    }
+
+    uint64_t crawl_start = epee::misc_utils::get_tick_count();
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i != std::max<size_t>(m_config.threads_count, 1); ++i)
+      workers.emplace_back([this]() { crawl_worker(); });
+    for (auto& w : workers)
+      w.join();
+    std::cout << "Crawled " << m_seen.size() << " peers in " << (epee::misc_utils::get_tick_count() - crawl_start) / 1000 << " s: "
+      << m_reachable_count << " reachable, " << m_unreachable_count << " not" << ENDL;
+
+    if (m_watch_connections.empty())
+      return true;
+
+    std::cout << "Watching blocks propagation through " << m_watch_connections.size() << " peers for " << m_config.watch_seconds << " s..." << ENDL;
+    uint64_t deadline = epee::misc_utils::get_tick_count() + m_config.watch_seconds * 1000;
+    workers.clear();
+    for (auto& wc : m_watch_connections)
+    {
+      std::string address = wc.first;
+      epee::net_utils::levin_client2* ptransport = wc.second.release();
+      workers.emplace_back([this, address, ptransport, deadline]() { watch_worker(address, std::unique_ptr<epee::net_utils::levin_client2>(ptransport), deadline); });
+    }
+    for (auto& w : workers)
+      w.join();
+    write_blocks_summary();
+    return true;
+  }
+  //---------------------------------------------------------------------------------------------------------------
+  void network_crawler::crawl_worker()
+  {
+    while (true)
+    {
+      peer_address pa = AUTO_VAL_INIT(pa);
+      {
+        std::unique_lock<std::mutex> lk(m_lock);
+        m_queue_condition.wait(lk, [&]() { return !m_queue.empty() || m_in_progress == 0; });
+        if (m_queue.empty())
+          return; // nothing left and nobody is going to add more
+        pa = m_queue.front();
+        m_queue.pop_front();
+        ++m_in_progress;
+      }
+
+      std::unique_ptr<epee::net_utils::levin_client2> transport;
+      std::list<peer_address> found_peers;
+      std::string result_json;
+      bool reachable = crawl_peer(pa, transport, found_peers, result_json);
+      write_line(result_json);
+
+      std::lock_guard<std::mutex> lk(m_lock);
+      --m_in_progress;
+      ++(reachable ? m_reachable_count : m_unreachable_count);
+      for (const auto& p : found_peers)
+      {
+        if (m_seen.size() >= m_config.max_peers)
+          break;
+        if (m_seen.insert(p.host + ":" + std::to_string(p.port)).second)
+          m_queue.push_back(p);
+      }
+      if (reachable && m_config.watch_seconds && m_watch_connections.size() < m_config.watch_peers_count)
+        m_watch_connections.emplace_back(pa.host + ":" + std::to_string(pa.port), std::move(transport));
+      m_queue_condition.notify_all();
+    }
+  }
+  //---------------------------------------------------------------------------------------------------------------
+  bool network_crawler::crawl_peer(const peer_address& pa, std::unique_ptr<epee::net_utils::levin_client2>& transport, std::list<peer_address>& found_peers, std::string& result_json)
+  {
+    peer_record rec = AUTO_VAL_INIT(rec);
+    rec.type = "peer";
+    rec.address = pa.host + ":" + std::to_string(pa.port);
+
+    transport.reset(new epee::net_utils::levin_client2());
+    uint64_t t_start = epee::misc_utils::get_tick_count();
+    if (!transport->connect(pa.host, static_cast<int>(pa.port), m_config.timeout))
+    {
+      rec.status = "connect failed";
+      result_json = to_json_line(epee::serialization::store_t_to_json(rec));
+      return false;
+    }
+    uint64_t t_connected = epee::misc_utils::get_tick_count();
+    rec.connect_ms = t_connected - t_start;
+
+    COMMAND_HANDSHAKE::request req = AUTO_VAL_INIT(req);
+    req.node_data.network_id = nodetool::P2P_NETWORK_ID;
+    req.node_data.peer_id = crypto::rand<uint64_t>();
+    req.node_data.local_time = time(nullptr);
+    req.node_data.my_port = 0; // not to be added to the peer lists
+    req.payload_data.current_height = 1;
+    req.payload_data.top_id = m_genesis_id;
+    req.payload_data.core_time = time(nullptr);
+    req.payload_data.client_version = PROJECT_VERSION_LONG;
+    COMMAND_HANDSHAKE::response rsp = AUTO_VAL_INIT(rsp);
+    if (!epee::net_utils::invoke_remote_command2(COMMAND_HANDSHAKE::ID, req, rsp, *transport))
+    {
+      rec.status = "handshake failed";
+      result_json = to_json_line(epee::serialization::store_t_to_json(rec));
+      return false;
+    }
+    rec.handshake_ms = epee::misc_utils::get_tick_count() - t_connected;
+
+    if (rsp.node_data.network_id != nodetool::P2P_NETWORK_ID)
+    {
+      rec.status = "wrong network";
+      result_json = to_json_line(epee::serialization::store_t_to_json(rec));
+      return false;
+    }
+
+    rec.status = "OK";
+    rec.peer_id = epee::string_tools::pod_to_hex(rsp.node_data.peer_id);
+    rec.client_version = rsp.payload_data.client_version;
+    rec.height = rsp.payload_data.current_height;
+    rec.top_id = epee::string_tools::pod_to_hex(rsp.payload_data.top_id);
+    rec.protocol_features = rsp.payload_data.protocol_features;
+    rec.pruned_height = rsp.payload_data.pruned_height;
+    rec.time_delta = static_cast<int64_t>(rsp.payload_data.core_time) - static_cast<int64_t>(time(nullptr));
+    rec.peers_returned = rsp.local_peerlist.size();
+    for (const auto& pe : rsp.local_peerlist)
+    {
+      if (pe.adr.ip == 0 || pe.adr.port == 0)
+        continue;
+      found_peers.push_back(peer_address{ epee::string_tools::get_ip_string_from_int32(pe.adr.ip), pe.adr.port });
+    }
+    result_json = to_json_line(epee::serialization::store_t_to_json(rec));
+    return true;
+  }
+  //---------------------------------------------------------------------------------------------------------------
+  void network_crawler::watch_worker(const std::string& address, std::unique_ptr<epee::net_utils::levin_client2> transport, uint64_t deadline)
+  {
+    auto& tr = transport->get_transport();
+    std::string head_buff, body;
+    while (true)
+    {
+      uint64_t now = epee::misc_utils::get_tick_count();
+      if (now >= deadline)
+        break;
+      // the connection is closed by the timeout when the watch is over
+      tr.set_recv_timeout(static_cast<int>(deadline - now));
+      if (!tr.recv_n(head_buff, sizeof(epee::levin::bucket_head2)))
+        break;
+      epee::levin::bucket_head2 head = *reinterpret_cast<const epee::levin::bucket_head2*>(head_buff.data());
+      if (head.m_signature != LEVIN_SIGNATURE || head.m_cb > max_watched_packet_size)
+      {
+        LOG_PRINT_L0("Wrong packet from " << address << ", stop watching it");
+        break;
+      }
+      tr.set_recv_timeout(static_cast<int>(m_config.timeout));
+      if (!tr.recv_n(body, head.m_cb))
+        break;
+      if (head.m_flags & LEVIN_PACKET_COMPRESSED)
+      {
+        std::string unpacked;
+        if (!epee::zlib_helper::unpack_bounded(body, unpacked, max_watched_packet_size))
+          break;
+        body.swap(unpacked);
+      }
+      if (head.m_flags & LEVIN_PACKET_RESPONSE)
+        continue;
+
+      if (!head.m_have_to_return_data)
+      {
+        if (head.m_command == currency::NOTIFY_NEW_BLOCK::ID)
+        {
+          currency::NOTIFY_NEW_BLOCK::request nb = AUTO_VAL_INIT(nb);
+          if (epee::serialization::load_t_from_binary(nb, body))
+            on_block_arrival(address, nb.b.block, nb.hop);
+        }
+        continue;
+      }
+
+      // answer the invokes the way a node that is still at the genesis would, so the peer keeps the connection
+      std::string rsp_buff;
+      head.m_return_code = LEVIN_ERROR_CONNECTION_HANDLER_NOT_DEFINED;
+      if (head.m_command == COMMAND_TIMED_SYNC::ID)
+      {
+        COMMAND_TIMED_SYNC::response ts = AUTO_VAL_INIT(ts);
+        ts.local_time = time(nullptr);
+        ts.payload_data.current_height = 1;
+        ts.payload_data.top_id = m_genesis_id;
+        ts.payload_data.core_time = time(nullptr);
+        ts.payload_data.client_version = PROJECT_VERSION_LONG;
+        epee::serialization::store_t_to_binary(ts, rsp_buff);
+        head.m_return_code = 1;
+      }
+      head.m_cb = rsp_buff.size();
+      head.m_have_to_return_data = false;
+      head.m_flags = LEVIN_PACKET_RESPONSE;
+      head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+      if (!tr.send(&head, sizeof(head)) || !tr.send(rsp_buff))
+        break;
+    }
+  }
+  //---------------------------------------------------------------------------------------------------------------
+  void network_crawler::on_block_arrival(const std::string& address, const std::string& block_blob, uint32_t hop)
+  {
+    uint64_t now = epee::misc_utils::get_tick_count();
+    currency::block b = AUTO_VAL_INIT(b);
+    if (!currency::parse_and_validate_block_from_blob(block_blob, b))
+      return;
+    crypto::hash id = currency::get_block_hash(b);
+
+    block_arrival_record rec = AUTO_VAL_INIT(rec);
+    rec.type = "block";
+    rec.id = epee::string_tools::pod_to_hex(id);
+    rec.height = currency::get_block_height(b);
+    rec.address = address;
+    rec.hop = hop;
+    {
+      std::lock_guard<std::mutex> lk(m_blocks_lock);
+      auto it = m_blocks.find(id);
+      if (it == m_blocks.end())
+        it = m_blocks.emplace(id, block_arrivals{ rec.height, now, std::vector<uint64_t>() }).first;
+      rec.delay_ms = now - it->second.first_arrival;
+      rec.arrival_index = it->second.delays_ms.size();
+      it->second.delays_ms.push_back(rec.delay_ms);
+    }
+    write_line(to_json_line(epee::serialization::store_t_to_json(rec)));
+  }
+  //---------------------------------------------------------------------------------------------------------------
+  void network_crawler::write_blocks_summary()
+  {
+    std::lock_guard<std::mutex> lk(m_blocks_lock);
+    for (const auto& bl : m_blocks)
+    {
+      std::vector<uint64_t> d = bl.second.delays_ms;
+      std::sort(d.begin(), d.end());
+      block_summary_record rec = AUTO_VAL_INIT(rec);
+      rec.type = "block_summary";
+      rec.id = epee::string_tools::pod_to_hex(bl.first);
+      rec.height = bl.second.height;
+      rec.arrivals = d.size();
+      rec.watched_peers = m_watch_connections.size();
+      rec.median_delay_ms = d[d.size() / 2];
+      rec.p90_delay_ms = d[d.size() * 9 / 10];
+      rec.max_delay_ms = d.back();
+      write_line(to_json_line(epee::serialization::store_t_to_json(rec)));
+      std::cout << "block " << rec.height << " " << rec.id.substr(0, 8) << ": " << rec.arrivals << " arrivals, median " << rec.median_delay_ms << " ms, p90 " << rec.p90_delay_ms << " ms, max " << rec.max_delay_ms << " ms" << ENDL;
+    }
+  }
+  //---------------------------------------------------------------------------------------------------------------
+  void network_crawler::write_line(const std::string& json)
+  {
+    std::lock_guard<std::mutex> lk(m_output_lock);
+    m_output << json << "\n";
+    m_output.flush();
+  }
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "net/levin_client.h"
+#include "crypto/hash.h"
+
+namespace tools
+{
+  /************************************************************************/
+  /* Maps the p2p network: starting from the seeds, handshakes every peer */
+  /* found in the peer lists (a number of them at once) and writes a json */
+  /* line per peer with its handshake time, version and height.           */
+  /* Optionally keeps some of the connections open for a while and writes */
+  /* when each of them brings NOTIFY_NEW_BLOCK, to see block propagation. */
+  /************************************************************************/
+  class network_crawler
+  {
+  public:
+    struct config
+    {
+      std::vector<std::string> seeds;     // <host>:<port>
+      size_t threads_count;
+      size_t max_peers;
+      unsigned int timeout;
+      std::string output_path;
+      size_t watch_peers_count;
+      uint64_t watch_seconds;             // 0 - block propagation is not watched
+    };
+
+    explicit network_crawler(const config& cfg);
+    bool run();
+
+  private:
+    struct peer_address
+    {
+      std::string host;
+      uint32_t port;
+    };
+
+    struct block_arrivals
+    {
+      uint64_t height;
+      uint64_t first_arrival;             // ms, get_tick_count()
+      std::vector<uint64_t> delays_ms;    // after the first arrival, in order of arrival
+    };
+
+    void crawl_worker();
+    bool crawl_peer(const peer_address& pa, std::unique_ptr<epee::net_utils::levin_client2>& transport, std::list<peer_address>& found_peers, std::string& result_json);
+    void watch_worker(const std::string& address, std::unique_ptr<epee::net_utils::levin_client2> transport, uint64_t deadline);
+    void on_block_arrival(const std::string& address, const std::string& block_blob, uint32_t hop);
+    void write_blocks_summary();
+    void write_line(const std::string& json);
+
+    config m_config;
+    crypto::hash m_genesis_id;
+
+    std::mutex m_lock;
+    std::condition_variable m_queue_condition;
+    std::deque<peer_address> m_queue;
+    std::set<std::string> m_seen;        // "<host>:<port>"
+    size_t m_in_progress;
+    std::vector<std::pair<std::string, std::unique_ptr<epee::net_utils::levin_client2>>> m_watch_connections;
+
+    std::mutex m_blocks_lock;
+    std::map<crypto::hash, block_arrivals> m_blocks;
+
+    std::mutex m_output_lock;
+    std::ofstream m_output;
+    uint64_t m_reachable_count;
+    uint64_t m_unreachable_count;
+  };
+}
@@ -40,6 +40,127 @@ static const char sigma[] = "expand 32-byte k";
 
 DISABLE_GCC_AND_CLANG_WARNING(strict-aliasing)
 
+static void chacha8_block(uint32_t input[16], const uint8_t* in, uint8_t* out) {
+  uint32_t x[16];
+  int i;
+
+  for (i = 0; i < 16; ++i) x[i] = input[i];
+  for (i = 8; i > 0; i -= 2) {
+    QUARTERROUND(x[0], x[4], x[8],x[12])
+    QUARTERROUND(x[1], x[5], x[9],x[13])
+    QUARTERROUND(x[2], x[6],x[10],x[14])
+    QUARTERROUND(x[3], x[7],x[11],x[15])
+    QUARTERROUND(x[0], x[5],x[10],x[15])
+    QUARTERROUND(x[1], x[6],x[11],x[12])
+    QUARTERROUND(x[2], x[7], x[8],x[13])
+    QUARTERROUND(x[3], x[4], x[9],x[14])
+  }
+  for (i = 0; i < 16; ++i)
+    U32TO8_LITTLE(out + 4 * i, XOR(PLUS(x[i], input[i]), U8TO32_LITTLE(in + 4 * i)));
+
+  input[12] = PLUSONE(input[12]);
+  if (!input[12])
+    input[13] = PLUSONE(input[13]);
+}
+
+/*
+ * Multi-block version: 8 blocks are processed at once, x[i] holds the i-th word of each of them, so that
+ * all the blocks go through the same vector instructions (SSE2 or NEON, AVX2 if it's there).
+ */
+
+#if defined(__GNUC__)
+#define CHACHA8_LANES 8
+
+typedef uint32_t chacha8_v8_t __attribute__((vector_size(32)));
+#define V8_ROTATE(v,c) (((v) << (c)) | ((v) >> (32 - (c))))
+
+#define V8_QUARTERROUND(a,b,c,d) \
+  a += b; d = V8_ROTATE(d ^ a,16); \
+  c += d; b = V8_ROTATE(b ^ c,12); \
+  a += b; d = V8_ROTATE(d ^ a, 8); \
+  c += d; b = V8_ROTATE(b ^ c, 7);
+
+static inline __attribute__((always_inline)) void chacha8_blocks_x8_impl(uint32_t input[16], const uint8_t* in, uint8_t* out, size_t count) {
+  chacha8_v8_t j[16], x[16];
+  uint32_t keystream[16][CHACHA8_LANES] __attribute__((aligned(32)));
+  uint64_t counter;
+  int i, k;
+
+  for (i = 0; i < 16; ++i)
+    for (k = 0; k < CHACHA8_LANES; ++k)
+      j[i][k] = input[i];
+
+  counter = input[12] | ((uint64_t)input[13] << 32);
+  for (; count; --count) {
+    for (k = 0; k < CHACHA8_LANES; ++k) {
+      j[12][k] = (uint32_t)(counter + k);
+      j[13][k] = (uint32_t)((counter + k) >> 32);
+    }
+    for (i = 0; i < 16; ++i) x[i] = j[i];
+    for (i = 8; i > 0; i -= 2) {
+      V8_QUARTERROUND(x[0], x[4], x[8],x[12])
+      V8_QUARTERROUND(x[1], x[5], x[9],x[13])
+      V8_QUARTERROUND(x[2], x[6],x[10],x[14])
+      V8_QUARTERROUND(x[3], x[7],x[11],x[15])
+      V8_QUARTERROUND(x[0], x[5],x[10],x[15])
+      V8_QUARTERROUND(x[1], x[6],x[11],x[12])
+      V8_QUARTERROUND(x[2], x[7], x[8],x[13])
+      V8_QUARTERROUND(x[3], x[4], x[9],x[14])
+    }
+    for (i = 0; i < 16; ++i) {
+      x[i] += j[i];
+      memcpy(keystream[i], &x[i], sizeof(x[i]));
+    }
+    for (k = 0; k < CHACHA8_LANES; ++k, in += 64, out += 64)
+      for (i = 0; i < 16; ++i)
+        U32TO8_LITTLE(out + 4 * i, XOR(keystream[i][k], U8TO32_LITTLE(in + 4 * i)));
+    counter += CHACHA8_LANES;
+  }
+  input[12] = (uint32_t)counter;
+  input[13] = (uint32_t)(counter >> 32);
+}
+
+static void chacha8_blocks_x8_generic(uint32_t input[16], const uint8_t* in, uint8_t* out, size_t count) {
+  chacha8_blocks_x8_impl(input, in, out, count);
+}
+
+#if defined(__x86_64__) && !defined(__AVX2__)
+#define CHACHA8_X8_RUNTIME_AVX2 1
+__attribute__((target("avx2"))) static void chacha8_blocks_x8_avx2(uint32_t input[16], const uint8_t* in, uint8_t* out, size_t count) {
+  chacha8_blocks_x8_impl(input, in, out, count);
+}
+#endif
+
+static void chacha8_blocks_x8(uint32_t input[16], const uint8_t* in, uint8_t* out, size_t count) {
+#if defined(CHACHA8_X8_RUNTIME_AVX2)
+  static int has_avx2 = -1;
+  if (has_avx2 < 0)
+    has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  if (has_avx2) {
+    chacha8_blocks_x8_avx2(input, in, out, count);
+    return;
+  }
+#endif
+  chacha8_blocks_x8_generic(input, in, out, count);
+}
+#endif // defined(__GNUC__)
+
+void chacha8_blocks(uint32_t input[16], const void* data, size_t blocks, char* cipher) {
+  const uint8_t* in = (const uint8_t*)data;
+  uint8_t* out = (uint8_t*)cipher;
+
+#if defined(CHACHA8_LANES)
+  if (blocks >= CHACHA8_LANES) {
+    chacha8_blocks_x8(input, in, out, blocks / CHACHA8_LANES);
+    in += (blocks - blocks % CHACHA8_LANES) * 64;
+    out += (blocks - blocks % CHACHA8_LANES) * 64;
+    blocks %= CHACHA8_LANES;
+  }
+#endif
+  for (; blocks; --blocks, in += 64, out += 64)
+    chacha8_block(input, in, out);
+}
+
 void chacha8(const void* data, size_t length, const uint8_t* key, const uint8_t* iv, char* cipher) {
   uint32_t x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15;
   uint32_t j0, j1, j2, j3, j4, j5, j6, j7, j8, j9, j10, j11, j12, j13, j14, j15;
@@ -66,6 +187,17 @@ void chacha8(const void* data, size_t length, const uint8_t* key, const uint8_t*
   j14 = U8TO32_LITTLE(iv + 0);
   j15 = U8TO32_LITTLE(iv + 4);
 
+  if (length >= 64) {
+    uint32_t input[16] = { j0, j1, j2, j3, j4, j5, j6, j7, j8, j9, j10, j11, j12, j13, j14, j15 };
+    chacha8_blocks(input, data, length / 64, cipher);
+    j12 = input[12];
+    j13 = input[13];
+    data = (const uint8_t*)data + (length - length % 64);
+    cipher += length - length % 64;
+    length %= 64;
+    if (!length) return;
+  }
+
   for (;;) {
     if (length < 64) {
       memcpy(tmp, data, length);
@@ -19,6 +19,8 @@ namespace crypto {
   extern "C" {
 #endif
     void chacha8(const void* data, size_t length, const uint8_t* key, const uint8_t* iv, char* cipher);
+    // encrypts whole 64-byte blocks with the given ChaCha8 state (constants, key, counter, iv) and advances its block counter
+    void chacha8_blocks(uint32_t input[16], const void* data, size_t blocks, char* cipher);
 #if defined(__cplusplus)
   }
 
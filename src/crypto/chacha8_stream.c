@@ -5,6 +5,7 @@ Public domain.
 */
 
 #include "ecrypt-sync.h"
+#include "chacha8.h"
 
 #define ROTATE(v,c) (ROTL32(v,c))
 #define XOR(v,w) ((v) ^ (w))
@@ -84,6 +85,18 @@ void ECRYPT_encrypt_bytes(ECRYPT_ctx *x, const u8 *m, u8 *c, u32 bytes)
   int i;
 
   if (!bytes) return;
+  if (bytes >= 64) {
+    /* the whole blocks go through the multi-block code */
+    uint32_t input[16];
+    for (i = 0; i < 16; ++i) input[i] = x->input[i];
+    chacha8_blocks(input, m, bytes / 64, (char*)c);
+    x->input[12] = input[12];
+    x->input[13] = input[13];
+    m += bytes - bytes % 64;
+    c += bytes - bytes % 64;
+    bytes %= 64;
+    if (!bytes) return;
+  }
   for (;;) {
     salsa20_wordtobyte(output, x->input);
     x->input[12] = PLUSONE(x->input[12]);
@@ -25,11 +25,37 @@ namespace crypto
   static std::ostream &operator <<(std::ostream &o, const crypto::hash &v)       { return o << pod_to_hex(v); }
   static std::ostream &operator <<(std::ostream &o, const crypto::public_key &v) { return o << pod_to_hex(v); }
 
+  struct dsm_precomp_t
+  {
+    explicit dsm_precomp_t(const point_t& p)
+    {
+      ge_dsm_precomp(data, &p.m_p3);
+    }
+    ge_dsmp data;
+  };
+
+  // returns a * A + b * B in compressed form (direct compression of ge_p2 result saves a field inversion in comparison with ge_p2 -> point_t conversion)
+  static public_key double_scalarmult_precomp_vartime(const scalar_t& a, const point_t& A, const scalar_t& b, const dsm_precomp_t& B)
+  {
+    ge_p2 r;
+    ge_double_scalarmult_precomp_vartime(&r, &a.m_s[0], &A.m_p3, &b.m_s[0], B.data);
+    public_key result;
+    ge_tobytes(reinterpret_cast<unsigned char*>(&result), &r);
+    return result;
+  }
+
+  // ge_scalarmult_base and precomp-based multiplications are only valid for scalars < 2^255, while double scalar multiplications accept any 256-bit value
+  static bool is_less_than_2_pow_255(const scalar_t& s)
+  {
+    return s.m_s[31] <= 127;
+  }
+
   bool generate_CLSAG_GG(const hash& m, const std::vector<CLSAG_GG_input_ref_t>& ring, const point_t& pseudo_out_amount_commitment, const key_image& ki,
     const scalar_t& secret_x, const scalar_t& secret_f, uint64_t secret_index, CLSAG_GG_signature& sig)
   {
     DBG_PRINT("generate_CLSAG_GG");
     size_t ring_size = ring.size();
+    scratch_arena_scope scratch_scope;
     CRYPTO_CHECK_AND_THROW_MES(ring_size > 0, "ring size is zero");
     CRYPTO_CHECK_AND_THROW_MES(secret_index < ring_size, "secret_index is out of range");
 
@@ -66,7 +92,7 @@ namespace crypto
     DBG_VAL_PRINT(agg_coeff_1);
 
     // calculate aggregate pub keys
-    std::vector<point_t> W_pub_keys;
+    scratch_point_vec_t W_pub_keys;
     W_pub_keys.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -117,6 +143,7 @@ namespace crypto
   {
     DBG_PRINT("verify_CLSAG_GG");
     size_t ring_size = ring.size();
+    scratch_arena_scope scratch_scope;
     CRYPTO_CHECK_AND_THROW_MES(ring_size > 0, "ring size is zero");
     CRYPTO_CHECK_AND_THROW_MES(ring_size == sig.r.size(), "ring size != r size");
 
@@ -151,7 +178,7 @@ namespace crypto
 
 
     // calculate aggregate pub keys
-    std::vector<point_t> W_pub_keys;
+    scratch_point_vec_t W_pub_keys;
     W_pub_keys.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -191,6 +218,7 @@ namespace crypto
   {
     DBG_PRINT("== generate_CLSAG_GGX ==");
     size_t ring_size = ring.size();
+    scratch_arena_scope scratch_scope;
     CRYPTO_CHECK_AND_THROW_MES(ring_size > 0, "ring size is zero");
     CRYPTO_CHECK_AND_THROW_MES(secret_index < ring_size, "secret_index is out of range");
 
@@ -250,7 +278,7 @@ namespace crypto
     DBG_VAL_PRINT(agg_coeff_2);
 
     // prepare A_i, Q_i
-    std::vector<point_t> A_i, Q_i;
+    scratch_point_vec_t A_i, Q_i;
     A_i.reserve(ring_size), Q_i.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -262,7 +290,7 @@ namespace crypto
     }
 
     // calculate aggregate pub keys (layers 0, 1; G components)
-    std::vector<point_t> W_pub_keys_g;
+    scratch_point_vec_t W_pub_keys_g;
     W_pub_keys_g.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -274,7 +302,7 @@ namespace crypto
     }
 
     // calculate aggregate pub keys (layer 2; X component)
-    std::vector<point_t> W_pub_keys_x;
+    scratch_point_vec_t W_pub_keys_x;
     W_pub_keys_x.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -350,10 +378,11 @@ namespace crypto
   }
 
   bool verify_CLSAG_GGX(const hash& m, const std::vector<CLSAG_GGX_input_ref_t>& ring, const public_key& pseudo_out_amount_commitment,
-    const public_key& pseudo_out_blinded_asset_id, const key_image& ki, const CLSAG_GGX_signature& sig)
+    const public_key& pseudo_out_blinded_asset_id, const key_image& ki, const CLSAG_GGX_signature& sig, CLSAG_ring_members_cache_t* p_cache /* = nullptr */)
   {
     DBG_PRINT("== verify_CLSAG_GGX ==");
     size_t ring_size = ring.size();
+    scratch_arena_scope scratch_scope;
     CRYPTO_CHECK_AND_THROW_MES(ring_size > 0, "ring size is zero");
     CRYPTO_CHECK_AND_THROW_MES(ring_size == sig.r_g.size(), "ring size != r_g size");
     CRYPTO_CHECK_AND_THROW_MES(ring_size == sig.r_x.size(), "ring size != r_x size");
@@ -402,7 +431,7 @@ namespace crypto
     DBG_VAL_PRINT(agg_coeff_2);
 
     // prepare A_i, Q_i
-    std::vector<point_t> A_i, Q_i;
+    scratch_point_vec_t A_i, Q_i;
     A_i.reserve(ring_size), Q_i.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -413,20 +442,30 @@ namespace crypto
       DBG_PRINT("A_i[" << i << "] = " << A_i[i] << "  Q_i[" << i << "] = " << Q_i[i]);
     }
 
+    // decompress stealth addresses and calculate their hash-to-point images (only once per distinct ring member when the cache is provided)
+    CLSAG_ring_members_cache_t local_cache;
+    CLSAG_ring_members_cache_t& cache = p_cache != nullptr ? *p_cache : local_cache;
+    scratch_vector<const CLSAG_ring_members_cache_t::entry_t*> ring_members;
+    ring_members.reserve(ring_size);
+    for(size_t i = 0; i < ring_size; ++i)
+      ring_members.push_back(&cache.get(ring[i].stealth_address));
+
     // calculate aggregate pub keys (layers 0, 1; G components)
-    std::vector<point_t> W_pub_keys_g;
+    scratch_point_vec_t W_pub_keys_g;
     W_pub_keys_g.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
-      W_pub_keys_g.emplace_back(
-        agg_coeff_0 * point_t(ring[i].stealth_address) +
-        agg_coeff_1 * (A_i[i] - pseudo_out_amount_commitment_pt)
-      );
+      // agg_coeff_0 * stealth_address + agg_coeff_1 * (A_i - pseudo_out_amount_commitment), two multiplications sharing the doublings
+      ge_p2 W_p2;
+      ge_double_scalarmult_precomp_vartime(&W_p2, &agg_coeff_0.m_s[0], &ring_members[i]->stealth_address.m_p3, &agg_coeff_1.m_s[0],
+        dsm_precomp_t(A_i[i] - pseudo_out_amount_commitment_pt).data);
+      W_pub_keys_g.emplace_back();
+      ge_p2_to_p3(&W_pub_keys_g.back().m_p3, &W_p2);
       DBG_VAL_PRINT(W_pub_keys_g[i]);
     }
 
     // calculate aggregate pub keys (layer 2; X component)
-    std::vector<point_t> W_pub_keys_x;
+    scratch_point_vec_t W_pub_keys_x;
     W_pub_keys_x.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -450,16 +489,33 @@ namespace crypto
     DBG_VAL_PRINT(W_key_image_x);
 
 
+    // the key images and X are the same for all ring members, so their precomputed data is shared by all the double scalar multiplications below
+    static const dsm_precomp_t X_dsm_precomp(c_point_X);
+    const dsm_precomp_t W_key_image_g_dsm_precomp(W_key_image_g);
+    const dsm_precomp_t W_key_image_x_dsm_precomp(W_key_image_x);
+
     scalar_t c_prev = sig.c;
     DBG_PRINT("c[0] = " << c_prev);
     for(size_t i = 0; i < ring_size; ++i)
     {
+      const point_t& hp_i = ring_members[i]->stealth_address_hp;
       hsc.add_32_chars(CRYPTO_HDS_CLSAG_GGX_CHALLENGE);
       hsc.add_hash(input_hash);
-      hsc.add_point(sig.r_g[i] * c_point_G + c_prev * W_pub_keys_g[i]);
-      hsc.add_point(sig.r_g[i] * hash_helper_t::hp(ring[i].stealth_address) + c_prev * W_key_image_g);
-      hsc.add_point(sig.r_x[i] * c_point_X + c_prev * W_pub_keys_x[i]);
-      hsc.add_point(sig.r_x[i] * hash_helper_t::hp(ring[i].stealth_address) + c_prev * W_key_image_x);
+      if (is_less_than_2_pow_255(sig.r_g[i]) && is_less_than_2_pow_255(sig.r_x[i]))
+      {
+        hsc.add_point(W_pub_keys_g[i].mul_plus_G(c_prev, sig.r_g[i]));                                  // r_g * G + c * W_pub_keys_g
+        hsc.add_pub_key(double_scalarmult_precomp_vartime(sig.r_g[i], hp_i, c_prev, W_key_image_g_dsm_precomp)); // r_g * Hp + c * W_key_image_g
+        hsc.add_pub_key(double_scalarmult_precomp_vartime(c_prev, W_pub_keys_x[i], sig.r_x[i], X_dsm_precomp)); // r_x * X + c * W_pub_keys_x
+        hsc.add_pub_key(double_scalarmult_precomp_vartime(sig.r_x[i], hp_i, c_prev, W_key_image_x_dsm_precomp)); // r_x * Hp + c * W_key_image_x
+      }
+      else
+      {
+        // keep the exact behaviour of single scalar multiplications for non-canonical scalars
+        hsc.add_point(sig.r_g[i] * c_point_G + c_prev * W_pub_keys_g[i]);
+        hsc.add_point(sig.r_g[i] * hp_i + c_prev * W_key_image_g);
+        hsc.add_point(sig.r_x[i] * c_point_X + c_prev * W_pub_keys_x[i]);
+        hsc.add_point(sig.r_x[i] * hp_i + c_prev * W_key_image_x);
+      }
       c_prev = hsc.calc_hash(); // c_{i + 1}
       DBG_PRINT("c[" << i + 1 << "] = " << c_prev);
       //DBG_PRINT("c[" << i + 1 << "] = Hs(ih, " << sig.r_g[i] * c_point_G + c_prev * W_pub_keys_g[i] << ", " << sig.r_g[i] * hash_helper_t::hp(ring[i].stealth_address) + c_prev * W_key_image_g << ", " << sig.r_x[i] * c_point_X + c_prev * W_pub_keys_x[i] << ", " << sig.r_x[i] * hash_helper_t::hp(ring[i].stealth_address) + c_prev * W_key_image_x << ")");
@@ -477,6 +533,7 @@ namespace crypto
   {
     DBG_PRINT("== generate_CLSAG_GGXG ==");
     size_t ring_size = ring.size();
+    scratch_arena_scope scratch_scope;
     CRYPTO_CHECK_AND_THROW_MES(ring_size > 0, "ring size is zero");
     CRYPTO_CHECK_AND_THROW_MES(secret_index < ring_size, "secret_index is out of range");
 
@@ -548,7 +605,7 @@ namespace crypto
     DBG_VAL_PRINT(agg_coeff_3);
 
     // prepare A_i, Q_i
-    std::vector<point_t> A_i, Q_i;
+    scratch_point_vec_t A_i, Q_i;
     A_i.reserve(ring_size), Q_i.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -560,7 +617,7 @@ namespace crypto
     }
 
     // calculate aggregate pub keys (layers 0, 1, 3; G components)
-    std::vector<point_t> W_pub_keys_g;
+    scratch_point_vec_t W_pub_keys_g;
     W_pub_keys_g.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -573,7 +630,7 @@ namespace crypto
     }
 
     // calculate aggregate pub keys (layer 2; X component)
-    std::vector<point_t> W_pub_keys_x;
+    scratch_point_vec_t W_pub_keys_x;
     W_pub_keys_x.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -655,6 +712,7 @@ namespace crypto
   {
     DBG_PRINT("== verify_CLSAG_GGXG ==");
     size_t ring_size = ring.size();
+    scratch_arena_scope scratch_scope;
     CRYPTO_CHECK_AND_THROW_MES(ring_size > 0, "ring size is zero");
     CRYPTO_CHECK_AND_THROW_MES(ring_size == sig.r_g.size(), "ring size != r_g size");
     CRYPTO_CHECK_AND_THROW_MES(ring_size == sig.r_x.size(), "ring size != r_x size");
@@ -709,7 +767,7 @@ namespace crypto
     DBG_VAL_PRINT(agg_coeff_3);
 
     // prepare A_i, Q_i
-    std::vector<point_t> A_i, Q_i;
+    scratch_point_vec_t A_i, Q_i;
     A_i.reserve(ring_size), Q_i.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -721,7 +779,7 @@ namespace crypto
     }
 
     // calculate aggregate pub keys (layers 0, 1, 3; G components)
-    std::vector<point_t> W_pub_keys_g;
+    scratch_point_vec_t W_pub_keys_g;
     W_pub_keys_g.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -734,7 +792,7 @@ namespace crypto
     }
 
     // calculate aggregate pub keys (layer 2; X component)
-    std::vector<point_t> W_pub_keys_x;
+    scratch_point_vec_t W_pub_keys_x;
     W_pub_keys_x.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -788,6 +846,7 @@ namespace crypto
   {
     DBG_PRINT("== generate_CLSAG_GGXXG ==");
     size_t ring_size = ring.size();
+    scratch_arena_scope scratch_scope;
     CRYPTO_CHECK_AND_THROW_MES(ring_size > 0, "ring size is zero");
     CRYPTO_CHECK_AND_THROW_MES(secret_index < ring_size, "secret_index is out of range");
 
@@ -873,7 +932,7 @@ namespace crypto
     DBG_VAL_PRINT(agg_coeff_4);
 
     // prepare A_i, Q_i
-    std::vector<point_t> A_i, P_i, Q_i;
+    scratch_point_vec_t A_i, P_i, Q_i;
     A_i.reserve(ring_size), P_i.reserve(ring_size), Q_i.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -887,7 +946,7 @@ namespace crypto
     }
 
     // calculate aggregate pub keys (layers 0, 1, 4; G components)
-    std::vector<point_t> W_pub_keys_g;
+    scratch_point_vec_t W_pub_keys_g;
     W_pub_keys_g.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -900,7 +959,7 @@ namespace crypto
     }
 
     // calculate aggregate pub keys (layerx 2, 3; X component)
-    std::vector<point_t> W_pub_keys_x;
+    scratch_point_vec_t W_pub_keys_x;
     W_pub_keys_x.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -985,6 +1044,7 @@ namespace crypto
   {
     DBG_PRINT("== verify_CLSAG_GGXXG ==");
     size_t ring_size = ring.size();
+    scratch_arena_scope scratch_scope;
     CRYPTO_CHECK_AND_THROW_MES(ring_size > 0, "ring size is zero");
     CRYPTO_CHECK_AND_THROW_MES(ring_size == sig.r_g.size(), "ring size != r_g size");
     CRYPTO_CHECK_AND_THROW_MES(ring_size == sig.r_x.size(), "ring size != r_x size");
@@ -1050,7 +1110,7 @@ namespace crypto
     DBG_VAL_PRINT(agg_coeff_4);
 
     // prepare A_i, Q_i
-    std::vector<point_t> A_i, P_i, Q_i;
+    scratch_point_vec_t A_i, P_i, Q_i;
     A_i.reserve(ring_size), P_i.reserve(ring_size), Q_i.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -1064,7 +1124,7 @@ namespace crypto
     }
 
     // calculate aggregate pub keys (layers 0, 1, 4; G components)
-    std::vector<point_t> W_pub_keys_g;
+    scratch_point_vec_t W_pub_keys_g;
     W_pub_keys_g.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -1077,7 +1137,7 @@ namespace crypto
     }
 
     // calculate aggregate pub keys (layer 2, 3; X component)
-    std::vector<point_t> W_pub_keys_x;
+    scratch_point_vec_t W_pub_keys_x;
     W_pub_keys_x.reserve(ring_size);
     for(size_t i = 0; i < ring_size; ++i)
     {
@@ -7,6 +7,7 @@
 // and the extended d/v-CLSAG version (s.a. https://github.com/hyle-team/docs/blob/master/zano/dv-CLSAG-extension/ by sowle)
 //
 #pragma once
+#include <unordered_map>
 #include "crypto-sugar.h"
 
 namespace crypto
@@ -88,11 +89,61 @@ namespace crypto
   bool generate_CLSAG_GGX(const hash& m, const std::vector<CLSAG_GGX_input_ref_t>& ring, const point_t& pseudo_out_amount_commitment, const point_t& pseudo_out_asset_id, const key_image& ki,
     const scalar_t& secret_0_xp, const scalar_t& secret_1_f, const scalar_t& secret_2_t, uint64_t secret_index, CLSAG_GGX_signature& sig);
 
+  // Per ring member data which can be shared among several CLSAG_GGX verifications (e.g. all inputs of a transaction or a block,
+  // big consolidation txs often reference the same outputs in different rings), saves point decompression and hash-to-point for repeated ring members.
+  // Optionally backed by a long-living storage shared among threads (see currency::ring_members_points_cache).
+  // Not thread-safe itself, use one instance per thread.
+  struct CLSAG_ring_members_cache_t
+  {
+    struct entry_t
+    {
+      point_t stealth_address;
+      point_t stealth_address_hp; // Hp(stealth_address)
+    };
+
+    // implementation must be thread-safe
+    struct backend_i
+    {
+      virtual bool get(const public_key& stealth_address, entry_t& e) = 0;
+      virtual void set(const public_key& stealth_address, const entry_t& e) = 0;
+      virtual ~backend_i() {}
+    };
+
+    explicit CLSAG_ring_members_cache_t(backend_i* p_backend = nullptr)
+      : m_p_backend(p_backend)
+    {}
+
+    // may throw an exception if stealth_address is not a valid point
+    const entry_t& get(const public_key& stealth_address)
+    {
+      auto it = m_entries.find(stealth_address);
+      if (it != m_entries.end())
+        return it->second;
+      entry_t e;
+      if (m_p_backend == nullptr || !m_p_backend->get(stealth_address, e))
+      {
+        e.stealth_address = point_t(stealth_address);
+        e.stealth_address_hp = hash_helper_t::hp(stealth_address);
+        if (m_p_backend != nullptr)
+          m_p_backend->set(stealth_address, e);
+      }
+      return m_entries.emplace(stealth_address, e).first->second;
+    }
+
+    size_t size() const { return m_entries.size(); }
+    void clear() { m_entries.clear(); }
+
+  private:
+    std::unordered_map<public_key, entry_t> m_entries;
+    backend_i* m_p_backend;
+  };
+
   // pseudo_out_amount_commitment -- premultiplied by 1/8
   // pseudo_out_asset_id         -- premultiplied by 1/8
+  // p_cache                     -- optional ring members cache, shared among verifications
   // may throw an exception TODO @#@# make sure it's okay
   bool verify_CLSAG_GGX(const hash& m, const std::vector<CLSAG_GGX_input_ref_t>& ring, const public_key& pseudo_out_amount_commitment,
-    const public_key& pseudo_out_asset_id, const key_image& ki, const CLSAG_GGX_signature& sig);
+    const public_key& pseudo_out_asset_id, const key_image& ki, const CLSAG_GGX_signature& sig, CLSAG_ring_members_cache_t* p_cache = nullptr);
 
 
   /*
@@ -256,7 +256,7 @@ static void fe_copy(fe h, const fe f) {
 
 /* From fe_invert.c */
 
-void fe_invert(fe out, const fe z) {
+static void fe_invert_ref10(fe out, const fe z) {
   fe t0;
   fe t1;
   fe t2;
@@ -314,6 +314,264 @@ void fe_invert(fe out, const fe z) {
   return;
 }
 
+/* Radix 2^51 field arithmetic */
+
+/*
+The long exponentiation chains (fe_invert, fe_pow22523) may be done in 5 limbs
+of 51 bits with 64x64->128 bit products, where the compiler has them (x86-64,
+ARM64 and the like). That is about 4 times fewer multiplications per fe_mul.
+A chain takes one conversion each way, the rest stays in ref10 representation.
+The backend is chosen at runtime, see crypto_ops_set_fe_backend().
+*/
+
+#if defined(__SIZEOF_INT128__)
+#define CRYPTO_OPS_HAVE_FE51 1
+
+typedef uint64_t fe51[5];
+typedef unsigned __int128 fe51_uint128;
+
+#define FE51_MASK ((((uint64_t) 1) << 51) - 1)
+#define FE51_TWO26 (((int64_t) 1) << 26)
+
+/*
+h = f
+
+Preconditions:
+   |f| bounded by 2^27,2^26,2^27,2^26,etc.
+
+Postconditions:
+   h bounded by 2^51 + 2^10,2^51,2^51,etc.
+*/
+
+static void fe51_from_fe(fe51 h, const fe f) {
+  /* 8p is added to make the values of the signed ref10 limbs positive */
+  uint64_t h0 = (uint64_t) ((int64_t) f[0] + (int64_t) f[1] * FE51_TWO26 + 8 * (int64_t) (FE51_MASK - 18));
+  uint64_t h1 = (uint64_t) ((int64_t) f[2] + (int64_t) f[3] * FE51_TWO26 + 8 * (int64_t) FE51_MASK);
+  uint64_t h2 = (uint64_t) ((int64_t) f[4] + (int64_t) f[5] * FE51_TWO26 + 8 * (int64_t) FE51_MASK);
+  uint64_t h3 = (uint64_t) ((int64_t) f[6] + (int64_t) f[7] * FE51_TWO26 + 8 * (int64_t) FE51_MASK);
+  uint64_t h4 = (uint64_t) ((int64_t) f[8] + (int64_t) f[9] * FE51_TWO26 + 8 * (int64_t) FE51_MASK);
+
+  h1 += h0 >> 51; h0 &= FE51_MASK;
+  h2 += h1 >> 51; h1 &= FE51_MASK;
+  h3 += h2 >> 51; h2 &= FE51_MASK;
+  h4 += h3 >> 51; h3 &= FE51_MASK;
+  h0 += 19 * (h4 >> 51); h4 &= FE51_MASK;
+  h[0] = h0;
+  h[1] = h1;
+  h[2] = h2;
+  h[3] = h3;
+  h[4] = h4;
+}
+
+/*
+h = f
+
+Preconditions:
+   f bounded by 2^51 + 2^15,2^51 + 2^15,2^51,etc.
+
+Postconditions:
+   |h| bounded by 1.01*2^25,1.01*2^24,1.01*2^25,1.01*2^24,etc. (the same as for fe_mul, so h may be summed up before multiplication)
+*/
+
+static void fe51_to_fe(fe h, const fe51 f) {
+  int32_t carry;
+  int i;
+  for (i = 0; i < 5; ++i) {
+    h[2 * i] = (int32_t) (f[i] & ((((uint64_t) 1) << 26) - 1));
+    h[2 * i + 1] = (int32_t) (f[i] >> 26);
+  }
+  /* the limbs are unsigned so far, make them signed */
+  for (i = 0; i < 9; ++i) {
+    if ((i & 1) == 0) {
+      carry = (h[i] + (int32_t) (1 << 25)) >> 26; h[i + 1] += carry; h[i] -= carry << 26;
+    } else {
+      carry = (h[i] + (int32_t) (1 << 24)) >> 25; h[i + 1] += carry; h[i] -= carry << 25;
+    }
+  }
+  carry = (h[9] + (int32_t) (1 << 24)) >> 25; h[0] += carry * 19; h[9] -= carry << 25;
+  carry = (h[0] + (int32_t) (1 << 25)) >> 26; h[1] += carry; h[0] -= carry << 26;
+}
+
+/*
+h = f * g
+Can overlap h with f or g.
+
+Preconditions:
+   f, g bounded by 2^51 + 2^15,2^51 + 2^15,2^51,etc.
+
+Postconditions:
+   h bounded by 2^51 + 2^10,2^51 + 2^15,2^51,etc.
+*/
+
+static void fe51_mul(fe51 h, const fe51 f, const fe51 g) {
+  const uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+  const uint64_t g0 = g[0], g1 = g[1], g2 = g[2], g3 = g[3], g4 = g[4];
+  const uint64_t g1_19 = 19 * g1, g2_19 = 19 * g2, g3_19 = 19 * g3, g4_19 = 19 * g4;
+  fe51_uint128 r0, r1, r2, r3, r4;
+  uint64_t h0, h1, h2, h3, h4;
+
+  r0 = (fe51_uint128) f0 * g0 + (fe51_uint128) f1 * g4_19 + (fe51_uint128) f2 * g3_19 + (fe51_uint128) f3 * g2_19 + (fe51_uint128) f4 * g1_19;
+  r1 = (fe51_uint128) f0 * g1 + (fe51_uint128) f1 * g0 + (fe51_uint128) f2 * g4_19 + (fe51_uint128) f3 * g3_19 + (fe51_uint128) f4 * g2_19;
+  r2 = (fe51_uint128) f0 * g2 + (fe51_uint128) f1 * g1 + (fe51_uint128) f2 * g0 + (fe51_uint128) f3 * g4_19 + (fe51_uint128) f4 * g3_19;
+  r3 = (fe51_uint128) f0 * g3 + (fe51_uint128) f1 * g2 + (fe51_uint128) f2 * g1 + (fe51_uint128) f3 * g0 + (fe51_uint128) f4 * g4_19;
+  r4 = (fe51_uint128) f0 * g4 + (fe51_uint128) f1 * g3 + (fe51_uint128) f2 * g2 + (fe51_uint128) f3 * g1 + (fe51_uint128) f4 * g0;
+
+  r1 += (uint64_t) (r0 >> 51); h0 = (uint64_t) r0 & FE51_MASK;
+  r2 += (uint64_t) (r1 >> 51); h1 = (uint64_t) r1 & FE51_MASK;
+  r3 += (uint64_t) (r2 >> 51); h2 = (uint64_t) r2 & FE51_MASK;
+  r4 += (uint64_t) (r3 >> 51); h3 = (uint64_t) r3 & FE51_MASK;
+  h0 += 19 * (uint64_t) (r4 >> 51); h4 = (uint64_t) r4 & FE51_MASK;
+  h1 += h0 >> 51; h0 &= FE51_MASK;
+
+  h[0] = h0;
+  h[1] = h1;
+  h[2] = h2;
+  h[3] = h3;
+  h[4] = h4;
+}
+
+/*
+h = f * f, n times
+Can overlap h with f.
+
+Preconditions and postconditions are the same as for fe51_mul.
+*/
+
+static void fe51_sq_n(fe51 h, const fe51 f, int n) {
+  uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+  fe51_uint128 r0, r1, r2, r3, r4;
+
+  do {
+    const uint64_t f0_2 = 2 * f0, f1_2 = 2 * f1;
+    const uint64_t f1_38 = 38 * f1, f2_38 = 38 * f2, f3_38 = 38 * f3;
+    const uint64_t f3_19 = 19 * f3, f4_19 = 19 * f4;
+
+    r0 = (fe51_uint128) f0 * f0 + (fe51_uint128) f1_38 * f4 + (fe51_uint128) f2_38 * f3;
+    r1 = (fe51_uint128) f0_2 * f1 + (fe51_uint128) f2_38 * f4 + (fe51_uint128) f3_19 * f3;
+    r2 = (fe51_uint128) f0_2 * f2 + (fe51_uint128) f1 * f1 + (fe51_uint128) f3_38 * f4;
+    r3 = (fe51_uint128) f0_2 * f3 + (fe51_uint128) f1_2 * f2 + (fe51_uint128) f4_19 * f4;
+    r4 = (fe51_uint128) f0_2 * f4 + (fe51_uint128) f1_2 * f3 + (fe51_uint128) f2 * f2;
+
+    r1 += (uint64_t) (r0 >> 51); f0 = (uint64_t) r0 & FE51_MASK;
+    r2 += (uint64_t) (r1 >> 51); f1 = (uint64_t) r1 & FE51_MASK;
+    r3 += (uint64_t) (r2 >> 51); f2 = (uint64_t) r2 & FE51_MASK;
+    r4 += (uint64_t) (r3 >> 51); f3 = (uint64_t) r3 & FE51_MASK;
+    f0 += 19 * (uint64_t) (r4 >> 51); f4 = (uint64_t) r4 & FE51_MASK;
+    f1 += f0 >> 51; f0 &= FE51_MASK;
+  } while (--n > 0);
+
+  h[0] = f0;
+  h[1] = f1;
+  h[2] = f2;
+  h[3] = f3;
+  h[4] = f4;
+}
+
+/* Same chain as fe_invert_ref10 */
+
+static void fe_invert_radix51(fe out, const fe z) {
+  fe51 z51, t0, t1, t2, t3;
+
+  fe51_from_fe(z51, z);
+  fe51_sq_n(t0, z51, 1);
+  fe51_sq_n(t1, t0, 2);
+  fe51_mul(t1, z51, t1);
+  fe51_mul(t0, t0, t1);
+  fe51_sq_n(t2, t0, 1);
+  fe51_mul(t1, t1, t2);
+  fe51_sq_n(t2, t1, 5);
+  fe51_mul(t1, t2, t1);
+  fe51_sq_n(t2, t1, 10);
+  fe51_mul(t2, t2, t1);
+  fe51_sq_n(t3, t2, 20);
+  fe51_mul(t2, t3, t2);
+  fe51_sq_n(t2, t2, 10);
+  fe51_mul(t1, t2, t1);
+  fe51_sq_n(t2, t1, 50);
+  fe51_mul(t2, t2, t1);
+  fe51_sq_n(t3, t2, 100);
+  fe51_mul(t2, t3, t2);
+  fe51_sq_n(t2, t2, 50);
+  fe51_mul(t1, t2, t1);
+  fe51_sq_n(t1, t1, 5);
+  fe51_mul(t0, t1, t0);
+  fe51_to_fe(out, t0);
+}
+
+/* Same chain as fe_pow22523_ref10 */
+
+static void fe_pow22523_radix51(fe out, const fe z) {
+  fe51 z51, t0, t1, t2;
+
+  fe51_from_fe(z51, z);
+  fe51_sq_n(t0, z51, 1);
+  fe51_sq_n(t1, t0, 2);
+  fe51_mul(t1, z51, t1);
+  fe51_mul(t0, t0, t1);
+  fe51_sq_n(t0, t0, 1);
+  fe51_mul(t0, t1, t0);
+  fe51_sq_n(t1, t0, 5);
+  fe51_mul(t0, t1, t0);
+  fe51_sq_n(t1, t0, 10);
+  fe51_mul(t1, t1, t0);
+  fe51_sq_n(t2, t1, 20);
+  fe51_mul(t1, t2, t1);
+  fe51_sq_n(t1, t1, 10);
+  fe51_mul(t0, t1, t0);
+  fe51_sq_n(t1, t0, 50);
+  fe51_mul(t1, t1, t0);
+  fe51_sq_n(t2, t1, 100);
+  fe51_mul(t1, t2, t1);
+  fe51_sq_n(t1, t1, 50);
+  fe51_mul(t0, t1, t0);
+  fe51_sq_n(t0, t0, 2);
+  fe51_mul(t0, t0, z51);
+  fe51_to_fe(out, t0);
+}
+
+#define CRYPTO_OPS_FE_BACKEND_DEFAULT CRYPTO_OPS_FE_BACKEND_RADIX51
+#else
+#define CRYPTO_OPS_FE_BACKEND_DEFAULT CRYPTO_OPS_FE_BACKEND_REF10
+#endif // defined(__SIZEOF_INT128__)
+
+/* Backend selection */
+
+static int fe_backend = CRYPTO_OPS_FE_BACKEND_DEFAULT;
+
+int crypto_ops_fe_backend_available(int backend) {
+  if (backend == CRYPTO_OPS_FE_BACKEND_REF10) {
+    return 1;
+  }
+#if defined(CRYPTO_OPS_HAVE_FE51)
+  if (backend == CRYPTO_OPS_FE_BACKEND_RADIX51) {
+    return 1;
+  }
+#endif
+  return 0;
+}
+
+int crypto_ops_set_fe_backend(int backend) {
+  if (!crypto_ops_fe_backend_available(backend)) {
+    return 0;
+  }
+  fe_backend = backend;
+  return 1;
+}
+
+int crypto_ops_get_fe_backend(void) {
+  return fe_backend;
+}
+
+void fe_invert(fe out, const fe z) {
+#if defined(CRYPTO_OPS_HAVE_FE51)
+  if (fe_backend == CRYPTO_OPS_FE_BACKEND_RADIX51) {
+    fe_invert_radix51(out, z);
+    return;
+  }
+#endif
+  fe_invert_ref10(out, z);
+}
+
 /* From fe_isnegative.c */
 
 /*
@@ -1622,21 +1880,10 @@ static void select(ge_precomp *t, int pos, signed char b) {
   ge_precomp_cmov(t, &minust, bnegative);
 }
 
-/*
-h = a * B
-where a = a[0]+256*a[1]+...+256^31 a[31]
-B is the Ed25519 base point (x,4/5) with x positive.
+/* a => 64 signed radix-16 digits, a[31] <= 127 */
 
-Preconditions:
-  a[31] <= 127
-*/
-
-void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
-  signed char e[64];
+static void ge_scalarmult_base_recode(signed char *e, const unsigned char *a) {
   signed char carry;
-  ge_p1p1 r;
-  ge_p2 s;
-  ge_precomp t;
   int i;
 
   for (i = 0; i < 32; ++i) {
@@ -1655,6 +1902,25 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
   }
   e[63] += carry;
   /* each e[i] is between -8 and 8 */
+}
+
+/*
+h = a * B
+where a = a[0]+256*a[1]+...+256^31 a[31]
+B is the Ed25519 base point (x,4/5) with x positive.
+
+Preconditions:
+  a[31] <= 127
+*/
+
+static void ge_scalarmult_base_ref10(ge_p3 *h, const unsigned char *a) {
+  signed char e[64];
+  ge_p1p1 r;
+  ge_p2 s;
+  ge_precomp t;
+  int i;
+
+  ge_scalarmult_base_recode(e, a);
 
   ge_p3_0(h);
   for (i = 1; i < 64; i += 2) {
@@ -1673,6 +1939,190 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
   }
 }
 
+#if defined(CRYPTO_OPS_HAVE_FE51) && !defined(CRYPTO_OPS_REF10_SCALARMULT_BASE)
+
+/*
+Fixed-base comb in radix 2^51: the table has all the 64 radix-16 positions (ge_base_radix51, 60 kB), so there are
+no doublings at all, only 64 mixed additions. Each addition takes the entry with a constant-time scan of the whole
+row of 8 multiples, that costs 15 64-bit masked moves per entry instead of 30 32-bit ones in ref10 representation.
+*/
+
+typedef struct {
+  fe51 X;
+  fe51 Y;
+  fe51 Z;
+  fe51 T;
+} ge51_p3;
+
+typedef struct {
+  fe51 X;
+  fe51 Y;
+  fe51 Z;
+  fe51 T;
+} ge51_p1p1;
+
+typedef struct {
+  fe51 yplusx;
+  fe51 yminusx;
+  fe51 xy2d;
+} ge51_precomp;
+
+/*
+Preconditions:
+   h bounded by 2^54,2^54,2^54,etc.
+
+Postconditions:
+   h bounded by 2^51 + 2^10,2^51 + 2^3,2^51,etc.
+*/
+
+static void fe51_carry(fe51 h) {
+  h[1] += h[0] >> 51; h[0] &= FE51_MASK;
+  h[2] += h[1] >> 51; h[1] &= FE51_MASK;
+  h[3] += h[2] >> 51; h[2] &= FE51_MASK;
+  h[4] += h[3] >> 51; h[3] &= FE51_MASK;
+  h[0] += 19 * (h[4] >> 51); h[4] &= FE51_MASK;
+}
+
+/*
+h = f + g
+
+Preconditions and postconditions are the same as for fe51_mul.
+*/
+
+static void fe51_add(fe51 h, const fe51 f, const fe51 g) {
+  h[0] = f[0] + g[0];
+  h[1] = f[1] + g[1];
+  h[2] = f[2] + g[2];
+  h[3] = f[3] + g[3];
+  h[4] = f[4] + g[4];
+  fe51_carry(h);
+}
+
+/*
+h = f - g, 2p is added to keep the limbs positive
+
+Preconditions and postconditions are the same as for fe51_mul.
+*/
+
+static void fe51_sub(fe51 h, const fe51 f, const fe51 g) {
+  h[0] = (f[0] + 2 * (FE51_MASK - 18)) - g[0];
+  h[1] = (f[1] + 2 * FE51_MASK) - g[1];
+  h[2] = (f[2] + 2 * FE51_MASK) - g[2];
+  h[3] = (f[3] + 2 * FE51_MASK) - g[3];
+  h[4] = (f[4] + 2 * FE51_MASK) - g[4];
+  fe51_carry(h);
+}
+
+/*
+Replace f with g if b == 1;
+replace f with f if b == 0.
+
+Preconditions: b in {0,1}.
+*/
+
+static void fe51_cmov(fe51 f, const uint64_t *g, unsigned int b) {
+  const uint64_t mask = (uint64_t) 0 - (uint64_t) b;
+  f[0] ^= mask & (f[0] ^ g[0]);
+  f[1] ^= mask & (f[1] ^ g[1]);
+  f[2] ^= mask & (f[2] ^ g[2]);
+  f[3] ^= mask & (f[3] ^ g[3]);
+  f[4] ^= mask & (f[4] ^ g[4]);
+}
+
+static void ge51_p1p1_to_p3(ge51_p3 *r, const ge51_p1p1 *p) {
+  fe51_mul(r->X, p->X, p->T);
+  fe51_mul(r->Y, p->Y, p->Z);
+  fe51_mul(r->Z, p->Z, p->T);
+  fe51_mul(r->T, p->X, p->Y);
+}
+
+static void ge51_madd(ge51_p1p1 *r, const ge51_p3 *p, const ge51_precomp *q) {
+  fe51 t0;
+  fe51_add(r->X, p->Y, p->X);
+  fe51_sub(r->Y, p->Y, p->X);
+  fe51_mul(r->Z, r->X, q->yplusx);
+  fe51_mul(r->Y, r->Y, q->yminusx);
+  fe51_mul(r->T, q->xy2d, p->T);
+  fe51_add(t0, p->Z, p->Z);
+  fe51_sub(r->X, r->Z, r->Y);
+  fe51_add(r->Y, r->Z, r->Y);
+  fe51_add(r->Z, t0, r->T);
+  fe51_sub(r->T, t0, r->T);
+}
+
+/* the same as select(), for ge_base_radix51 */
+
+static void select_radix51(ge51_precomp *t, int pos, signed char b) {
+  static const fe51 zero = {0, 0, 0, 0, 0};
+  unsigned char bnegative = negative(b);
+  unsigned char babs = b - (((-bnegative) & b) << 1);
+  fe51 minus_xy2d;
+  int i;
+
+  memset(t, 0, sizeof *t);
+  t->yplusx[0] = 1;
+  t->yminusx[0] = 1;
+  for (i = 0; i < 8; ++i) {
+    const unsigned int b_eq = equal(babs, i + 1);
+    fe51_cmov(t->yplusx, ge_base_radix51[pos][i][0], b_eq);
+    fe51_cmov(t->yminusx, ge_base_radix51[pos][i][1], b_eq);
+    fe51_cmov(t->xy2d, ge_base_radix51[pos][i][2], b_eq);
+  }
+
+  /* -(x, y) = (-x, y): y+x and y-x swap places, xy2d changes the sign */
+  for (i = 0; i < 5; ++i) {
+    const uint64_t mask = (uint64_t) 0 - (uint64_t) bnegative;
+    const uint64_t d = mask & (t->yplusx[i] ^ t->yminusx[i]);
+    t->yplusx[i] ^= d;
+    t->yminusx[i] ^= d;
+  }
+  fe51_sub(minus_xy2d, zero, t->xy2d);
+  fe51_cmov(t->xy2d, minus_xy2d, bnegative);
+}
+
+static void ge_scalarmult_base_radix51(ge_p3 *h, const unsigned char *a) {
+  signed char e[64];
+  ge51_p3 h51;
+  ge51_p1p1 r;
+  ge51_precomp t;
+  int i;
+
+  ge_scalarmult_base_recode(e, a);
+
+  memset(&h51, 0, sizeof h51);
+  h51.Y[0] = 1;
+  h51.Z[0] = 1;
+  for (i = 0; i < 64; ++i) {
+    select_radix51(&t, i, e[i]);
+    ge51_madd(&r, &h51, &t); ge51_p1p1_to_p3(&h51, &r);
+  }
+
+  fe51_to_fe(h->X, h51.X);
+  fe51_to_fe(h->Y, h51.Y);
+  fe51_to_fe(h->Z, h51.Z);
+  fe51_to_fe(h->T, h51.T);
+}
+
+#endif // defined(CRYPTO_OPS_HAVE_FE51) && !defined(CRYPTO_OPS_REF10_SCALARMULT_BASE)
+
+/*
+h = a * B, constant time
+With the radix 2^51 backend the radix 2^51 comb is used, unless it's disabled at build time with CRYPTO_OPS_REF10_SCALARMULT_BASE.
+
+Preconditions:
+  a[31] <= 127
+*/
+
+void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
+#if defined(CRYPTO_OPS_HAVE_FE51) && !defined(CRYPTO_OPS_REF10_SCALARMULT_BASE)
+  if (fe_backend == CRYPTO_OPS_FE_BACKEND_RADIX51) {
+    ge_scalarmult_base_radix51(h, a);
+    return;
+  }
+#endif
+  ge_scalarmult_base_ref10(h, a);
+}
+
 /* From ge_sub.c */
 
 /*
@@ -1708,6 +2158,100 @@ void ge_tobytes(unsigned char *s, const ge_p2 *h) {
   s[31] ^= fe_isnegative(x) << 7;
 }
 
+/* The same as ge_tobytes() for n points (32 * n bytes of output) with one field inversion instead of n (Montgomery's trick),
+   tmp is a scratch space for n field elements; all the points must have non-zero Z */
+void ge_p2_batch_tobytes(unsigned char *s, const ge_p2 *h, size_t n, fe *tmp) {
+  fe acc;
+  fe recip;
+  fe x;
+  fe y;
+  size_t i;
+
+  if (n == 0)
+    return;
+  fe_copy(tmp[0], h[0].Z);
+  for (i = 1; i < n; i++)
+    fe_mul(tmp[i], tmp[i - 1], h[i].Z); /* tmp[i] = Z_0 * ... * Z_i */
+  fe_invert(acc, tmp[n - 1]);
+  for (i = n - 1; ; i--) {
+    /* acc = 1 / (Z_0 * ... * Z_i) */
+    if (i > 0) {
+      fe_mul(recip, acc, tmp[i - 1]);
+      fe_mul(acc, acc, h[i].Z);
+    } else {
+      fe_copy(recip, acc);
+    }
+    fe_mul(x, h[i].X, recip);
+    fe_mul(y, h[i].Y, recip);
+    fe_tobytes(s + 32 * i, y);
+    s[32 * i + 31] ^= fe_isnegative(x) << 7;
+    if (i == 0)
+      break;
+  }
+}
+
+/*
+h[i] = (X / Z, Y / Z, 1, XY / Z^2) for all the points, with one field inversion.
+tmp should have room for n elements. Z of the points should be non-zero.
+*/
+
+void ge_p3_batch_normalize(ge_p3 *h, size_t n, fe *tmp) {
+  fe acc;
+  fe recip;
+  size_t i;
+
+  if (n == 0)
+    return;
+  fe_copy(tmp[0], h[0].Z);
+  for (i = 1; i < n; i++)
+    fe_mul(tmp[i], tmp[i - 1], h[i].Z); /* tmp[i] = Z_0 * ... * Z_i */
+  fe_invert(acc, tmp[n - 1]);
+  for (i = n - 1; ; i--) {
+    /* acc = 1 / (Z_0 * ... * Z_i) */
+    if (i > 0) {
+      fe_mul(recip, acc, tmp[i - 1]);
+      fe_mul(acc, acc, h[i].Z);
+    } else {
+      fe_copy(recip, acc);
+    }
+    fe_mul(h[i].X, h[i].X, recip);
+    fe_mul(h[i].Y, h[i].Y, recip);
+    fe_1(h[i].Z);
+    fe_mul(h[i].T, h[i].X, h[i].Y);
+    if (i == 0)
+      break;
+  }
+}
+
+void ge_p3_batch_tobytes(unsigned char *s, const ge_p3 *h, size_t n, fe *tmp) {
+  fe acc;
+  fe recip;
+  fe x;
+  fe y;
+  size_t i;
+
+  if (n == 0)
+    return;
+  fe_copy(tmp[0], h[0].Z);
+  for (i = 1; i < n; i++)
+    fe_mul(tmp[i], tmp[i - 1], h[i].Z);
+  fe_invert(acc, tmp[n - 1]);
+  for (i = n - 1; ; i--) {
+    if (i > 0) {
+      fe_mul(recip, acc, tmp[i - 1]);
+      fe_mul(acc, acc, h[i].Z);
+    } else {
+      fe_copy(recip, acc);
+    }
+    fe_mul(x, h[i].X, recip);
+    fe_mul(y, h[i].Y, recip);
+    fe_tobytes(s + 32 * i, y);
+    s[32 * i + 31] ^= fe_isnegative(x) << 7;
+    if (i == 0)
+      break;
+  }
+}
+
 /* From sc_reduce.c */
 
 /*
@@ -1949,26 +2493,16 @@ void sc_reduce(unsigned char *s) {
   s[31] = s11 >> 17;
 }
 
-/* New code */
+/* From fe_pow22523.c */
 
-static void fe_divpowm1(fe r, const fe u, const fe v) {
-  fe v3, uv7, t0, t1, t2;
+static void fe_pow22523_ref10(fe out, const fe z) {
+  fe t0, t1, t2;
   int i;
 
-  fe_sq(v3, v);
-  fe_mul(v3, v3, v); /* v3 = v^3 */
-  fe_sq(uv7, v3);
-  fe_mul(uv7, uv7, v);
-  fe_mul(uv7, uv7, u); /* uv7 = uv^7 */
-
-  /*fe_pow22523(uv7, uv7);*/
-
-  /* From fe_pow22523.c */
-
-  fe_sq(t0, uv7);
+  fe_sq(t0, z);
   fe_sq(t1, t0);
   fe_sq(t1, t1);
-  fe_mul(t1, uv7, t1);
+  fe_mul(t1, z, t1);
   fe_mul(t0, t0, t1);
   fe_sq(t0, t0);
   fe_mul(t0, t1, t0);
@@ -2007,9 +2541,31 @@ static void fe_divpowm1(fe r, const fe u, const fe v) {
   fe_mul(t0, t1, t0);
   fe_sq(t0, t0);
   fe_sq(t0, t0);
-  fe_mul(t0, t0, uv7);
+  fe_mul(out, t0, z);
+}
+
+static void fe_pow22523(fe out, const fe z) {
+#if defined(CRYPTO_OPS_HAVE_FE51)
+  if (fe_backend == CRYPTO_OPS_FE_BACKEND_RADIX51) {
+    fe_pow22523_radix51(out, z);
+    return;
+  }
+#endif
+  fe_pow22523_ref10(out, z);
+}
+
+/* New code */
+
+static void fe_divpowm1(fe r, const fe u, const fe v) {
+  fe v3, uv7, t0;
+
+  fe_sq(v3, v);
+  fe_mul(v3, v3, v); /* v3 = v^3 */
+  fe_sq(uv7, v3);
+  fe_mul(uv7, uv7, v);
+  fe_mul(uv7, uv7, u); /* uv7 = uv^7 */
 
-  /* End fe_pow22523.c */
+  fe_pow22523(t0, uv7);
   /* t0 = (uv^7)^((q-5)/8) */
   fe_mul(t0, t0, v3);
   fe_mul(r, t0, u); /* u^(m+1)v^(-(m+1)) */
@@ -2032,10 +2588,13 @@ static void ge_cached_cmov(ge_cached *t, const ge_cached *u, unsigned char b) {
 /* Assumes that a[31] <= 127 */
 void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
   signed char e[64];
+  ge_scalarmult_recode(e, a);
+  ge_scalarmult_recoded(r, e, A);
+}
+
+/* Recodes the scalar into 64 signed radix-16 digits for ge_scalarmult_recoded(), so it's done once for many points */
+void ge_scalarmult_recode(signed char *e, const unsigned char *a) {
   int carry, carry2, i;
-  ge_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
-  ge_p1p1 t;
-  ge_p3 u;
 
   carry = 0; /* 0..1 */
   for (i = 0; i < 31; i++) {
@@ -2049,6 +2608,13 @@ void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
   carry2 = (carry + 8) >> 4; /* 0..8 */
   e[62] = carry - (carry2 << 4); /* -8..7 */
   e[63] = carry2; /* 0..8 */
+}
+
+void ge_scalarmult_recoded(ge_p2 *r, const signed char *e, const ge_p3 *A) {
+  int i;
+  ge_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
+  ge_p1p1 t;
+  ge_p3 u;
 
   ge_p3_to_cached(&Ai[0], A);
   for (i = 0; i < 7; i++) {
@@ -91,11 +91,17 @@ void ge_p3_tobytes(unsigned char *, const ge_p3 *);
 /* From ge_scalarmult_base.c */
 
 extern const ge_precomp ge_base[32][8];
+#if defined(__SIZEOF_INT128__) && !defined(CRYPTO_OPS_REF10_SCALARMULT_BASE)
+extern const uint64_t ge_base_radix51[64][8][3][5];
+#endif
 void ge_scalarmult_base(ge_p3 *, const unsigned char *);
 
 /* From ge_tobytes.c */
 
 void ge_tobytes(unsigned char *, const ge_p2 *);
+void ge_p2_batch_tobytes(unsigned char *, const ge_p2 *, size_t, fe *);
+void ge_p3_batch_tobytes(unsigned char *, const ge_p3 *, size_t, fe *);
+void ge_p3_batch_normalize(ge_p3 *, size_t, fe *);
 
 /* From sc_reduce.c */
 
@@ -104,6 +110,8 @@ void sc_reduce(unsigned char *);
 /* New code */
 
 void ge_scalarmult(ge_p2 *, const unsigned char *, const ge_p3 *);
+void ge_scalarmult_recode(signed char *, const unsigned char *);
+void ge_scalarmult_recoded(ge_p2 *, const signed char *, const ge_p3 *);
 void ge_scalarmult_p3(ge_p3 *, const unsigned char *, const ge_p3 *);
 void ge_double_scalarmult_precomp_vartime(ge_p2 *, const unsigned char *, const ge_p3 *, const unsigned char *, const ge_dsmp);
 void ge_mul8(ge_p1p1 *, const ge_p2 *);
@@ -145,6 +153,16 @@ int sc_check(const unsigned char *);
 int sc_isnonzero(const unsigned char *); /* Doesn't normalize */
 void sc_invert(unsigned char*, const unsigned char*);
 
+/* Field arithmetic backends, used for the exponentiation chains (fe_invert and the square root) */
+
+#define CRYPTO_OPS_FE_BACKEND_REF10    0  /* 10 limbs of 25.5 bits, portable */
+#define CRYPTO_OPS_FE_BACKEND_RADIX51  1  /* 5 limbs of 51 bits, needs 128-bit integers */
+#define CRYPTO_OPS_FE_BACKEND_COUNT    2
+
+int crypto_ops_fe_backend_available(int backend);
+int crypto_ops_set_fe_backend(int backend); /* returns 0 if the backend isn't available */
+int crypto_ops_get_fe_backend(void);
+
 void fe_sq(fe h, const fe f);
 int fe_isnonzero(const fe f);
 void fe_add(fe h, const fe f, const fe g);
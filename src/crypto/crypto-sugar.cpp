@@ -12,23 +12,119 @@ namespace crypto
 
   void construct_precomp_data(precomp_data_t precomp_data, const point_t& point)
   {
+    // all the multiples are calculated first to be normalized with a single field inversion
+    std::vector<point_t> multiples(32 * 8);
     point_t A = point;
     for(size_t i = 0; i < 32; ++i)
     {
-      point_t B = A;
-      ge_p3_to_precomp(&precomp_data[i][0], &B.m_p3);
+      multiples[i * 8] = A;
       for(size_t j = 1; j < 8; ++j)
-      {
-        B += A; // B = (j+1) * 256^i * point
-        ge_p3_to_precomp(&precomp_data[i][j], &B.m_p3);
-      }
+        multiples[i * 8 + j] = multiples[i * 8 + j - 1] + A; // (j+1) * 256^i * point
 
       if (i != 31)
         A.modify_mul_pow_2(8); // *= 256
     }
+
+    point_t::batch_normalize(multiples.data(), multiples.size());
+    for(size_t i = 0; i < 32; ++i)
+    {
+      for(size_t j = 0; j < 8; ++j)
+      {
+        // the same as ge_p3_to_precomp() for Z = 1
+        const ge_p3& p = multiples[i * 8 + j].m_p3;
+        ge_precomp& r = precomp_data[i][j];
+        fe_sub(r.yminusx, p.Y, p.X);
+        fe_add(r.yplusx, p.Y, p.X);
+        fe_mul(r.xy2d, p.T, fe_d2);
+      }
+    }
+  }
+
+  //---------------------------------------------------------------
+  point_precomp_cache::point_precomp_cache(size_t max_size, size_t build_after_uses)
+    : m_max_size(max_size)
+    , m_build_after_uses(build_after_uses)
+  {}
+
+  bool point_precomp_cache::add(const public_key& pk)
+  {
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      auto it = m_tables.find(pk);
+      if (it != m_tables.end())
+      {
+        it->second.pinned = true;
+        return true;
+      }
+    }
+
+    point_t point;
+    if (!point.from_public_key(pk))
+      return false;
+    std::shared_ptr<const point_precomp_t> table = std::make_shared<point_precomp_t>(point);
+
+    std::lock_guard<std::mutex> lk(m_lock);
+    entry& e = m_tables[pk];
+    e.table = table;
+    e.pinned = true;
+    m_uses.erase(pk);
+    return true;
+  }
+
+  void point_precomp_cache::remove(const public_key& pk)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_tables.erase(pk);
+    m_uses.erase(pk);
+  }
+
+  std::shared_ptr<const point_precomp_t> point_precomp_cache::get(const public_key& pk)
+  {
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      auto it = m_tables.find(pk);
+      if (it != m_tables.end())
+        return it->second.table;
+
+      if (m_uses.size() >= 4 * m_max_size)
+        m_uses.clear(); // the counters of rarely used points are dropped from time to time
+      if (++m_uses[pk] < m_build_after_uses)
+        return nullptr;
+      if (m_tables.size() >= m_max_size && !evict_one_unpinned())
+        return nullptr;
+      m_uses.erase(pk);
+    }
+
+    point_t point;
+    if (!point.from_public_key(pk))
+      return nullptr;
+    std::shared_ptr<const point_precomp_t> table = std::make_shared<point_precomp_t>(point);
+
+    std::lock_guard<std::mutex> lk(m_lock);
+    entry& e = m_tables[pk];
+    if (!e.table)
+      e.table = table;
+    return e.table;
   }
 
+  size_t point_precomp_cache::size() const
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    return m_tables.size();
+  }
 
+  bool point_precomp_cache::evict_one_unpinned()
+  {
+    for (auto it = m_tables.begin(); it != m_tables.end(); ++it)
+    {
+      if (!it->second.pinned)
+      {
+        m_tables.erase(it);
+        return true;
+      }
+    }
+    return false;
+  }
 
   namespace xdetails
   {
@@ -5,9 +5,13 @@
 //
 // Note: This file originates from tests/functional_tests/crypto_tests.cpp 
 #pragma once
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <boost/multiprecision/cpp_int.hpp>
 #include "crypto.h"
+#include "scratch_arena.h"
 
 namespace crypto
 {
@@ -684,6 +688,45 @@ namespace crypto
       return result;
     }
 
+    // Decompresses pks_count public keys, false if any of them is invalid.
+    // Each key still takes its own square root, there's nothing to share between them as the exponent is fixed.
+    static bool from_public_keys(const crypto::public_key* pks, size_t pks_count, point_t* result)
+    {
+      for (size_t i = 0; i < pks_count; ++i)
+      {
+        if (!result[i].from_public_key(pks[i]))
+          return false;
+      }
+      return true;
+    }
+
+    template<typename allocator_t>
+    static bool from_public_keys(const std::vector<crypto::public_key>& pks, std::vector<point_t, allocator_t>& result)
+    {
+      result.resize(pks.size());
+      return from_public_keys(pks.data(), pks.size(), result.data());
+    }
+
+    // Makes Z = 1 for all the points using a single field inversion (Montgomery's trick)
+    static void batch_normalize(point_t* points, size_t points_count)
+    {
+      static_assert(sizeof(point_t) == sizeof(ge_p3), "size missmatch");
+      if (points_count == 0)
+        return;
+      std::unique_ptr<fe[]> tmp(new fe[points_count]);
+      ge_p3_batch_normalize(&points[0].m_p3, points_count, tmp.get());
+    }
+
+    // Compresses all the points using a single field inversion
+    static void batch_to_public_keys(const point_t* points, size_t points_count, crypto::public_key* result)
+    {
+      static_assert(sizeof(point_t) == sizeof(ge_p3), "size missmatch");
+      if (points_count == 0)
+        return;
+      std::unique_ptr<fe[]> tmp(new fe[points_count]);
+      ge_p3_batch_tobytes(reinterpret_cast<unsigned char*>(result), &points[0].m_p3, points_count, tmp.get());
+    }
+
     point_t operator+(const point_t& rhs) const
     {
       point_t result;
@@ -965,16 +1008,94 @@ namespace crypto
   }; // struct point_pc_t
 
 
+  //
+  // point_precomp_t -- the same as point_pc_t for an arbitrary point, the precomputed data is built at runtime (takes ~0.4 ms)
+  // Worth it for the points being multiplied many times. It's 30kB, so better keep it on the heap.
+  //
+  struct point_precomp_t : public point_t
+  {
+    explicit point_precomp_t(const point_t& point)
+      : point_t(point)
+    {
+      construct_precomp_data(m_precomp_data, point);
+    }
+
+    friend point_t operator*(const scalar_t& lhs, const point_precomp_t& self)
+    {
+      point_t result;
+      ge_scalarmult_precomp_vartime(&result.m_p3, self.m_precomp_data, &lhs.m_s[0]);
+      return result;
+    }
+
+    friend point_t operator/(const point_precomp_t& self, const scalar_t& rhs)
+    {
+      point_t result;
+      scalar_t reciprocal;
+      sc_invert(&reciprocal.m_s[0], &rhs.m_s[0]);
+      ge_scalarmult_precomp_vartime(&result.m_p3, self.m_precomp_data, &reciprocal.m_s[0]);
+      return result;
+    }
+
+    // returns a * this + b * G
+    point_t mul_plus_G(const scalar_t& a, const scalar_t& b) const
+    {
+      point_t result, bG;
+      ge_scalarmult_precomp_vartime(&result.m_p3, m_precomp_data, &a.m_s[0]);
+      ge_scalarmult_base_vartime(&bG.m_p3, &b.m_s[0]);
+      return result + bG;
+    }
+
+    precomp_data_t m_precomp_data;
+  }; // struct point_precomp_t
+
+
+  //
+  // point_precomp_cache -- thread-safe cache of point_precomp_t for public keys.
+  // The keys given to add() are kept until removed (e.g. own keys), the rest get their tables built
+  // after being asked for build_after_uses times and may be evicted when the cache is full.
+  //
+  class point_precomp_cache
+  {
+  public:
+    explicit point_precomp_cache(size_t max_size = 256, size_t build_after_uses = 4);
+
+    bool add(const public_key& pk); // false if pk is not a valid point
+    void remove(const public_key& pk);
+    std::shared_ptr<const point_precomp_t> get(const public_key& pk); // nullptr if there's no table (yet)
+    size_t size() const;
+
+  private:
+    struct entry
+    {
+      std::shared_ptr<const point_precomp_t> table;
+      bool pinned = false;
+    };
+
+    bool evict_one_unpinned();
+
+    const size_t m_max_size;
+    const size_t m_build_after_uses;
+    mutable std::mutex m_lock;
+    std::unordered_map<public_key, entry> m_tables;
+    std::unordered_map<public_key, size_t> m_uses;  // for the points having no table yet
+  }; // class point_precomp_cache
+
+
   //
   // vector of scalars
+  // (scalar_vec_t normally, scratch_scalar_vec_t for the temporaries of the proof routines, s.a. scratch_arena)
   //
-  struct scalar_vec_t : public std::vector<scalar_t>
+  template<typename allocator_t>
+  struct scalar_vec_base_t : public std::vector<scalar_t, allocator_t>
   {
-    typedef std::vector<scalar_t> super_t;
+    typedef std::vector<scalar_t, allocator_t> super_t;
+    using super_t::size;
+    using super_t::at;
+    using super_t::data;
 
-    scalar_vec_t() {}
-    scalar_vec_t(size_t n) : super_t(n) {}
-    scalar_vec_t(std::initializer_list<scalar_t> init_list) : super_t(init_list) {}
+    scalar_vec_base_t() {}
+    scalar_vec_base_t(size_t n) : super_t(n) {}
+    scalar_vec_base_t(std::initializer_list<scalar_t> init_list) : super_t(init_list) {}
 
     bool is_reduced() const
     {
@@ -985,36 +1106,36 @@ namespace crypto
     }
 
     // add a scalar rhs to each element
-    scalar_vec_t operator+(const scalar_t& rhs) const
+    scalar_vec_base_t operator+(const scalar_t& rhs) const
     {
-      scalar_vec_t result(size());
+      scalar_vec_base_t result(size());
       for (size_t i = 0, n = size(); i < n; ++i)
         result[i] = at(i) + rhs;
       return result;
     }
 
     // subtract a scalar rhs to each element
-    scalar_vec_t operator-(const scalar_t& rhs) const
+    scalar_vec_base_t operator-(const scalar_t& rhs) const
     {
-      scalar_vec_t result(size());
+      scalar_vec_base_t result(size());
       for (size_t i = 0, n = size(); i < n; ++i)
         result[i] = at(i) - rhs;
       return result;
     }
 
     // multiply each element of the vector by a scalar
-    scalar_vec_t operator*(const scalar_t& rhs) const
+    scalar_vec_base_t operator*(const scalar_t& rhs) const
     {
-      scalar_vec_t result(size());
+      scalar_vec_base_t result(size());
       for (size_t i = 0, n = size(); i < n; ++i)
         result[i] = at(i) * rhs;
       return result;
     }
 
     // component-wise multiplication (a.k.a the Hadamard product) (only if their sizes match)
-    scalar_vec_t operator*(const scalar_vec_t& rhs) const
+    scalar_vec_base_t operator*(const scalar_vec_base_t& rhs) const
     {
-      scalar_vec_t result;
+      scalar_vec_base_t result;
       const size_t n = size();
       if (n != rhs.size())
         return result;
@@ -1026,9 +1147,9 @@ namespace crypto
     }
 
     // add each element of two vectors, but only if their sizes match
-    scalar_vec_t operator+(const scalar_vec_t& rhs) const
+    scalar_vec_base_t operator+(const scalar_vec_base_t& rhs) const
     {
-      scalar_vec_t result;
+      scalar_vec_base_t result;
       const size_t n = size();
       if (n != rhs.size())
         return result;
@@ -1068,7 +1189,7 @@ namespace crypto
         return;
       }
 
-      scalar_vec_t muls(size), muls_rev(size);
+      scalar_vec_base_t<scratch_allocator<scalar_t>> muls(size), muls_rev(size);
       muls[0] = 1;
       for (size_t i = 0; i < size - 1; ++i)
         muls[i + 1] = at(i) * muls[i];
@@ -1098,14 +1219,17 @@ namespace crypto
     }
 
 
-  }; // scalar_vec_t
+  }; // scalar_vec_base_t
+
+  typedef scalar_vec_base_t<std::allocator<scalar_t>> scalar_vec_t;
+  typedef scalar_vec_base_t<scratch_allocator<scalar_t>> scratch_scalar_vec_t;
 
 
   // treats vector of scalars as an M x N matrix just for convenience
-  template<size_t N>
-  struct scalar_mat_t : public scalar_vec_t
+  template<size_t N, typename allocator_t = std::allocator<scalar_t>>
+  struct scalar_mat_t : public scalar_vec_base_t<allocator_t>
   {
-    typedef scalar_vec_t super_t;
+    typedef scalar_vec_base_t<allocator_t> super_t;
     static_assert(N > 0, "invalid N value");
 
     scalar_mat_t() {}
@@ -1115,10 +1239,15 @@ namespace crypto
     // matrix accessor M rows x N cols
     scalar_t& operator()(size_t row, size_t col)
     {
-      return at(row * N + col);
+      return this->at(row * N + col);
     }
   }; // scalar_mat_t
 
+  template<size_t N>
+  using scratch_scalar_mat_t = scalar_mat_t<N, scratch_allocator<scalar_t>>;
+
+  typedef scratch_vector<point_t> scratch_point_vec_t;
+
 
 
   //
@@ -1226,8 +1355,9 @@ namespace crypto
 
       void add_points_array(const std::vector<point_t>& points_array)
       {
-        for (size_t i = 0, size = points_array.size(); i < size; ++i)
-          add_point(points_array[i]);
+        std::vector<crypto::public_key> pub_keys(points_array.size());
+        point_t::batch_to_public_keys(points_array.data(), points_array.size(), pub_keys.data());
+        add_pub_keys_array(pub_keys);
       }
 
       void add_pub_keys_array(const std::vector<crypto::public_key>& pub_keys_array)
@@ -1438,7 +1568,8 @@ namespace crypto
   }; // hash_helper_t struct
 
 
-  inline scalar_t scalar_vec_t::calc_hs() const
+  template<typename allocator_t>
+  inline scalar_t scalar_vec_base_t<allocator_t>::calc_hs() const
   {
     // hs won't touch memory if size is 0, so it's safe
     return hash_helper_t::hs(data(), sizeof(scalar_t) * size());
@@ -187,6 +187,38 @@ namespace crypto {
     return true;
   }
 
+  void crypto_ops::generate_key_derivations(const std::vector<public_key> &keys, const secret_key &key2, std::vector<key_derivation> &derivations, std::vector<bool> &valid) {
+    crypto_assert(sc_check(&key2) == 0);
+    signed char e[64];
+    ge_scalarmult_recode(e, reinterpret_cast<const unsigned char*>(&key2));
+
+    derivations.assign(keys.size(), key_derivation{});
+    valid.assign(keys.size(), false);
+    std::vector<ge_p2> points;
+    std::vector<size_t> points_indices;
+    points.reserve(keys.size());
+    points_indices.reserve(keys.size());
+    for (size_t i = 0; i != keys.size(); ++i) {
+      ge_p3 point;
+      ge_p2 point2;
+      ge_p1p1 point3;
+      if (ge_frombytes_vartime(&point, &keys[i]) != 0)
+        continue;
+      ge_scalarmult_recoded(&point2, e, &point);
+      ge_mul8(&point3, &point2);
+      points.emplace_back();
+      ge_p1p1_to_p2(&points.back(), &point3);
+      points_indices.push_back(i);
+      valid[i] = true;
+    }
+
+    std::vector<key_derivation> compressed(points.size());
+    std::unique_ptr<fe[]> tmp(new fe[points.size() + 1]);
+    ge_p2_batch_tobytes(reinterpret_cast<unsigned char*>(compressed.data()), points.data(), points.size(), tmp.get());
+    for (size_t j = 0; j != points.size(); ++j)
+      derivations[points_indices[j]] = compressed[j];
+  }
+
   void crypto_ops::derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res)
   {
     struct {
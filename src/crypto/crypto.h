@@ -89,6 +89,8 @@ namespace crypto {
     friend bool secret_key_to_public_key(const secret_key &, public_key &);
     static bool generate_key_derivation(const public_key &, const secret_key &, key_derivation &);
     friend bool generate_key_derivation(const public_key &, const secret_key &, key_derivation &);
+    static void generate_key_derivations(const std::vector<public_key> &, const secret_key &, std::vector<key_derivation> &, std::vector<bool> &);
+    friend void generate_key_derivations(const std::vector<public_key> &, const secret_key &, std::vector<key_derivation> &, std::vector<bool> &);
     static void derivation_to_scalar(const key_derivation &, size_t, ec_scalar &);
     friend void derivation_to_scalar(const key_derivation &, size_t, ec_scalar &);
     static bool derive_public_key(const key_derivation &, std::size_t, const public_key &, public_key &);
@@ -124,6 +126,24 @@ namespace crypto {
     return res;
   }
 
+  /* Makes random values on the calling thread come from its own PRNG, seeded with the given value, while the object is alive.
+   */
+  struct thread_prng_scope
+  {
+    template<typename T>
+    explicit thread_prng_scope(const T& seed)
+    {
+      static_assert(std::is_pod<T>::value, "POD seed expected");
+      random_thread_prng_set_seed(&seed, sizeof seed);
+    }
+    ~thread_prng_scope()
+    {
+      random_thread_prng_reset();
+    }
+    thread_prng_scope(const thread_prng_scope&) = delete;
+    thread_prng_scope& operator=(const thread_prng_scope&) = delete;
+  };
+
   /* An adapter, to be used with std::shuffle, etc.
    */
   struct uniform_random_bit_generator
@@ -179,6 +199,13 @@ namespace crypto {
   inline bool generate_key_derivation(const public_key &key1, const secret_key &key2, key_derivation &derivation) {
     return crypto_ops::generate_key_derivation(key1, key2, derivation);
   }
+  /* The same as generate_key_derivation() for many public keys and one secret key (e.g. tx keys of a batch of blocks and the view key):
+   * the secret scalar is recoded once and all the results are compressed with a single field inversion.
+   * valid[i] is false, and derivations[i] is null, if keys[i] is not a valid point.
+   */
+  inline void generate_key_derivations(const std::vector<public_key> &keys, const secret_key &key2, std::vector<key_derivation> &derivations, std::vector<bool> &valid) {
+    crypto_ops::generate_key_derivations(keys, key2, derivations, valid);
+  }
   inline void derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &result) {
     crypto::crypto_ops::derivation_to_scalar(derivation, output_index, result);
   }
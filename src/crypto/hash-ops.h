@@ -54,6 +54,8 @@ void hash_process(union hash_state *state, const uint8_t *buf, size_t count);
 
 void cn_fast_hash_old(const void *data, size_t length, char *hash);
 void cn_fast_hash(const void *data, size_t length, char *hash);
+// count independent messages, hashes are HASH_SIZE each; 4 of them are hashed at once (multi-buffer keccak)
+void cn_fast_hash_batch(const void *const *data, const size_t *lengths, size_t count, char *hashes);
 
 void hash_extra_blake(const void *data, size_t length, char *hash);
 void hash_extra_groestl(const void *data, size_t length, char *hash);
@@ -29,3 +29,16 @@ void cn_fast_hash(const void *data, size_t length, char *hash)
 {
   keccak(data, (int)length, (uint8_t*)hash, HASH_SIZE);
 }
+
+void cn_fast_hash_batch(const void *const *data, const size_t *lengths, size_t count, char *hashes)
+{
+  size_t i;
+  for (i = 0; i + 4 <= count; i += 4)
+  {
+    const uint8_t *in[4] = { data[i], data[i + 1], data[i + 2], data[i + 3] };
+    uint8_t *md[4] = { (uint8_t*)hashes + HASH_SIZE * i, (uint8_t*)hashes + HASH_SIZE * (i + 1), (uint8_t*)hashes + HASH_SIZE * (i + 2), (uint8_t*)hashes + HASH_SIZE * (i + 3) };
+    keccak_x4(in, lengths + i, md, HASH_SIZE);
+  }
+  for (; i < count; ++i)
+    cn_fast_hash(data[i], lengths[i], hashes + HASH_SIZE * i);
+}
@@ -2,6 +2,7 @@
 // 19-Nov-11  Markku-Juhani O. Saarinen <mjos@iki.fi>
 // A baseline Keccak (3rd round) implementation.
 
+#include <assert.h>
 #include "hash-ops.h"
 #include "keccak.h"
 
@@ -73,18 +74,15 @@ void keccakf(uint64_t st[25], int rounds)
 // compute a keccak hash (md) of given byte length from "in"
 typedef uint64_t state_t[25];
 
-int keccak(const uint8_t *in, int inlen, uint8_t *md, int mdlen)
+// absorbs the rest of the input (full blocks, then the last one with padding) into st and squeezes md out
+static void keccak_finish(state_t st, const uint8_t *in, size_t inlen, uint8_t *md, int mdlen, int rsiz)
 {
-    state_t st;
     uint8_t temp[144];
-    int i, rsiz, rsizw;
+    int i, rsizw;
 
-    rsiz = sizeof(state_t) == mdlen ? HASH_DATA_AREA : 200 - 2 * mdlen;
     rsizw = rsiz / 8;
-    
-    memset(st, 0, sizeof(st));
 
-    for ( ; inlen >= rsiz; inlen -= rsiz, in += rsiz) {
+    for ( ; inlen >= (size_t)rsiz; inlen -= rsiz, in += rsiz) {
         for (i = 0; i < rsizw; i++)
             st[i] ^= ((uint64_t *) in)[i];
         keccakf(st, KECCAK_ROUNDS);
@@ -102,10 +100,174 @@ int keccak(const uint8_t *in, int inlen, uint8_t *md, int mdlen)
     keccakf(st, KECCAK_ROUNDS);
 
     memcpy(md, st, mdlen);
+}
+
+int keccak(const uint8_t *in, int inlen, uint8_t *md, int mdlen)
+{
+    state_t st;
+    int rsiz;
+
+    rsiz = sizeof(state_t) == mdlen ? HASH_DATA_AREA : 200 - 2 * mdlen;
+    
+    memset(st, 0, sizeof(st));
+    keccak_finish(st, in, inlen, md, mdlen, rsiz);
 
     return 0;
 }
 
+// 4-way multi-buffer version: 4 independent states are kept interleaved, st[i] holds the i-th word of
+// each of them, so that all the lanes are permuted by the same vector instructions (AVX2 if it's there)
+
+#if defined(__GNUC__)
+typedef uint64_t keccak_v4_t __attribute__((vector_size(32)));
+#define KECCAK_V4_ROTL(x, y) (((x) << (y)) | ((x) >> (64 - (y))))
+
+static inline __attribute__((always_inline)) void keccakf_x4_impl(keccak_v4_t st[25], int rounds)
+{
+    int i, j, round;
+    keccak_v4_t t, bc[5];
+
+    for (round = 0; round < rounds; round++) {
+
+        // Theta
+        for (i = 0; i < 5; i++)     
+            bc[i] = st[i] ^ st[i + 5] ^ st[i + 10] ^ st[i + 15] ^ st[i + 20];
+
+        for (i = 0; i < 5; i++) {
+            t = bc[(i + 4) % 5] ^ KECCAK_V4_ROTL(bc[(i + 1) % 5], 1);
+            for (j = 0; j < 25; j += 5)
+                st[j + i] ^= t;
+        }
+
+        // Rho Pi
+        t = st[1];
+        for (i = 0; i < 24; i++) {
+            j = keccakf_piln[i];
+            bc[0] = st[j];
+            st[j] = KECCAK_V4_ROTL(t, keccakf_rotc[i]);
+            t = bc[0];
+        }
+
+        //  Chi
+        for (j = 0; j < 25; j += 5) {
+            for (i = 0; i < 5; i++)
+                bc[i] = st[j + i];
+            for (i = 0; i < 5; i++)
+                st[j + i] ^= (~bc[(i + 1) % 5]) & bc[(i + 2) % 5];
+        }
+
+        //  Iota
+        st[0] ^= keccakf_rndc[round];
+    }
+}
+
+static void keccakf_x4_generic(keccak_v4_t st[25], int rounds)
+{
+    keccakf_x4_impl(st, rounds);
+}
+
+#if defined(__x86_64__) && !defined(__AVX2__)
+#define KECCAK_X4_RUNTIME_AVX2 1
+__attribute__((target("avx2"))) static void keccakf_x4_avx2(keccak_v4_t st[25], int rounds)
+{
+    keccakf_x4_impl(st, rounds);
+}
+#endif
+
+static void keccakf_x4(keccak_v4_t st[25], int rounds)
+{
+#if defined(KECCAK_X4_RUNTIME_AVX2)
+    static int has_avx2 = -1;
+    if (has_avx2 < 0)
+        has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    if (has_avx2) {
+        keccakf_x4_avx2(st, rounds);
+        return;
+    }
+#endif
+    keccakf_x4_generic(st, rounds);
+}
+
+#else // defined(__GNUC__)
+
+// no vector extensions, the lanes are permuted one by one
+typedef struct { uint64_t v[4]; } keccak_v4_t;
+
+static void keccakf_x4(keccak_v4_t st[25], int rounds)
+{
+    state_t lane;
+    int i, k;
+
+    for (k = 0; k < 4; k++) {
+        for (i = 0; i < 25; i++)
+            lane[i] = st[i].v[k];
+        keccakf(lane, rounds);
+        for (i = 0; i < 25; i++)
+            st[i].v[k] = lane[i];
+    }
+}
+
+#define KECCAK_V4_LANE(x, k) ((x).v[k])
+#endif // defined(__GNUC__)
+
+#ifndef KECCAK_V4_LANE
+#define KECCAK_V4_LANE(x, k) ((x)[k])
+#endif
+
+void keccak_x4(const uint8_t *const in[4], const size_t inlen[4], uint8_t *const md[4], int mdlen)
+{
+    keccak_v4_t st[25];
+    state_t lane;
+    uint8_t temp[144];
+    uint8_t out[4][64];
+    const uint8_t *block;
+    size_t blocks[4], common_blocks, b;
+    int i, k, rsiz, rsizw;
+
+    assert(mdlen > 0 && mdlen <= 64);
+    rsiz = 200 - 2 * mdlen;
+    rsizw = rsiz / 8;
+
+    // the blocks, including the padded last one, all the lanes have are absorbed together
+    common_blocks = SIZE_MAX;
+    for (k = 0; k < 4; k++) {
+        blocks[k] = inlen[k] / rsiz + 1;
+        if (common_blocks > blocks[k])
+            common_blocks = blocks[k];
+    }
+
+    memset(st, 0, sizeof(st));
+    for (b = 0; b < common_blocks; b++) {
+        for (k = 0; k < 4; k++) {
+            if (b + 1 < blocks[k]) {
+                block = in[k] + b * rsiz;
+            } else {
+                size_t rest = inlen[k] - b * rsiz;
+                memcpy(temp, in[k] + b * rsiz, rest);
+                temp[rest++] = 1;
+                memset(temp + rest, 0, rsiz - rest);
+                temp[rsiz - 1] |= 0x80;
+                block = temp;
+            }
+            for (i = 0; i < rsizw; i++)
+                KECCAK_V4_LANE(st[i], k) ^= ((const uint64_t *) block)[i];
+        }
+        keccakf_x4(st, KECCAK_ROUNDS);
+    }
+
+    // the longer ones are finished one by one; md is written at the very end, so it may overlap the input
+    for (k = 0; k < 4; k++) {
+        for (i = 0; i < 25; i++)
+            lane[i] = KECCAK_V4_LANE(st[i], k);
+        if (blocks[k] == common_blocks)
+            memcpy(out[k], lane, mdlen);
+        else
+            keccak_finish(lane, in[k] + common_blocks * rsiz, inlen[k] - common_blocks * rsiz, out[k], mdlen, rsiz);
+    }
+    for (k = 0; k < 4; k++)
+        memcpy(md[k], out[k], mdlen);
+}
+
 void keccak1600(const uint8_t *in, int inlen, uint8_t *md)
 {
     keccak(in, inlen, md, sizeof(state_t));
@@ -5,6 +5,7 @@
 #define KECCAK_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 
 #ifndef KECCAK_ROUNDS
@@ -23,4 +24,7 @@ void keccakf(uint64_t st[25], int norounds);
 
 void keccak1600(const uint8_t *in, int inlen, uint8_t *md);
 
+// the same as keccak() for 4 independent messages at once, mdlen up to 64 (md may overlap in)
+void keccak_x4(const uint8_t *const in[4], const size_t inlen[4], uint8_t *const md[4], int mdlen);
+
 #endif
@@ -12,8 +12,8 @@
 namespace crypto
 {
 
-  template<typename CT>
-  bool msm_and_check_zero_naive(const scalar_vec_t& g_scalars, const scalar_vec_t& h_scalars, const point_t& summand)
+  template<typename CT, typename allocator_t>
+  bool msm_and_check_zero_naive(const scalar_vec_base_t<allocator_t>& g_scalars, const scalar_vec_base_t<allocator_t>& h_scalars, const point_t& summand)
   {
     CHECK_AND_ASSERT_MES(g_scalars.size() <= CT::c_bpp_mn_max, false, "g_scalars oversized");
     CHECK_AND_ASSERT_MES(h_scalars.size() <= CT::c_bpp_mn_max, false, "h_scalars oversized");
@@ -37,8 +37,8 @@ namespace crypto
 
   // https://eprint.iacr.org/2022/999.pdf
   // "Pippenger algorithm [1], and its variant that is widely used in the ZK space is called the bucket method"
-  template<typename CT>
-  bool msm_and_check_zero_pippenger_v3(const scalar_vec_t& g_scalars, const scalar_vec_t& h_scalars, const point_t& summand, uint8_t c)
+  template<typename CT, typename allocator_t>
+  bool msm_and_check_zero_pippenger_v3(const scalar_vec_base_t<allocator_t>& g_scalars, const scalar_vec_base_t<allocator_t>& h_scalars, const point_t& summand, uint8_t c)
   {
     // TODO: with c = 8 and with direct access got much worse result than with c = 7 and get_bits() for N = 128..256, consider checking again for bigger datasets (N>256) 
     // TODO: consider preparing a cached generators' points
@@ -59,12 +59,12 @@ namespace crypto
     const size_t k_max = max_bit_idx / c;
     const size_t K = k_max + 1;
 
-    std::vector<point_t> buckets(C * K);
-    std::vector<bool> buckets_inited(C * K);
-    std::vector<point_t> Sk(K);
-    std::vector<bool> Sk_inited(K);
-    std::vector<point_t> Gk(K);
-    std::vector<bool> Gk_inited(K);
+    scratch_vector<point_t> buckets(C * K);
+    scratch_vector<bool> buckets_inited(C * K);
+    scratch_vector<point_t> Sk(K);
+    scratch_vector<bool> Sk_inited(K);
+    scratch_vector<point_t> Gk(K);
+    scratch_vector<bool> Gk_inited(K);
 
     // first loop, calculate partial bucket sums
     for (size_t n = 0; n < g_scalars.size(); ++n)
@@ -159,13 +159,337 @@ namespace crypto
 
   
 
+  // Precomputed data for the static generators G_i, H_i of a crypto trait CT (see CT::get_generator()).
+  // For each generator P it keeps P, 2P, ..., 8P in ge_cached form, so that neither Pippenger's bucket accumulation
+  // nor fixed-base Straus need to convert generators on each addition. Built once on first use (~6 MB per crypto trait).
+  template<typename CT>
+  struct msm_generators_precomp_t
+  {
+    static constexpr size_t c_multiples_count = 8; // enough for signed radix-16 digits in [-8; 8]
+
+    static const msm_generators_precomp_t& get()
+    {
+      static const msm_generators_precomp_t instance; // thread-safe initialization
+      return instance;
+    }
+
+    const ge_cached& cached(bool select_H, size_t index) const
+    {
+      return m_cached[2 * index + (select_H ? 1 : 0)];
+    }
+
+    // returns pointer to {1 * P, 2 * P, ..., 8 * P}, where P is the generator
+    const ge_cached* multiples(bool select_H, size_t index) const
+    {
+      return &m_multiples[(2 * index + (select_H ? 1 : 0)) * c_multiples_count];
+    }
+
+  private:
+    msm_generators_precomp_t()
+      : m_cached(2 * CT::c_bpp_mn_max)
+      , m_multiples(2 * CT::c_bpp_mn_max * c_multiples_count)
+    {
+      for (size_t i = 0; i < CT::c_bpp_mn_max; ++i)
+      {
+        for (size_t select_H = 0; select_H < 2; ++select_H)
+        {
+          const point_t& P = CT::get_generator(select_H != 0, i);
+          ge_cached* table = &m_multiples[(2 * i + select_H) * c_multiples_count];
+          point_t kP = P;
+          ge_p3_to_cached(&table[0], &kP.m_p3);
+          m_cached[2 * i + select_H] = table[0];
+          for (size_t k = 1; k < c_multiples_count; ++k)
+          {
+            kP += P;
+            ge_p3_to_cached(&table[k], &kP.m_p3);
+          }
+        }
+      }
+    }
+
+    std::vector<ge_cached> m_cached;     // contiguous copy of 1 * P for better locality in Pippenger's method
+    std::vector<ge_cached> m_multiples;
+  };
+
+
+  // Pippenger's bucket method (the same as msm_and_check_zero_pippenger_v3) using generators from the precomputed table
+  template<typename CT, typename allocator_t>
+  bool msm_and_check_zero_pippenger_pc(const scalar_vec_base_t<allocator_t>& g_scalars, const scalar_vec_base_t<allocator_t>& h_scalars, const point_t& summand, uint8_t c)
+  {
+    CHECK_AND_ASSERT_MES(g_scalars.size() <= CT::c_bpp_mn_max, false, "g_scalars oversized");
+    CHECK_AND_ASSERT_MES(h_scalars.size() <= CT::c_bpp_mn_max, false, "h_scalars oversized");
+    CHECK_AND_ASSERT_MES(c > 0 && c < 10, false, "c is out of range");
+
+    const msm_generators_precomp_t<CT>& precomp = msm_generators_precomp_t<CT>::get();
+
+    const size_t C = 1ull << c;
+    const size_t b = 253;
+    const size_t max_bit_idx = b - 1;
+    const size_t k_max = max_bit_idx / c;
+    const size_t K = k_max + 1;
+
+    scratch_vector<point_t> buckets(C * K);
+    scratch_vector<bool> buckets_inited(C * K);
+
+    auto add_to_buckets = [&](const scalar_vec_base_t<allocator_t>& scalars, bool select_H)
+    {
+      ge_p1p1 t;
+      for (size_t n = 0; n < scalars.size(); ++n)
+      {
+        const ge_cached& gen_cached = precomp.cached(select_H, n);
+        for (size_t k = 0; k < K; ++k)
+        {
+          uint64_t l = scalars[n].get_bits((uint8_t)(k * c), c); // l in [0; 2^c-1]
+          if (l != 0)
+          {
+            size_t bucket_id = l * K + k;
+            if (buckets_inited[bucket_id])
+            {
+              ge_add(&t, &buckets[bucket_id].m_p3, &gen_cached);
+              ge_p1p1_to_p3(&buckets[bucket_id].m_p3, &t);
+            }
+            else
+            {
+              buckets[bucket_id] = CT::get_generator(select_H, n);
+              buckets_inited[bucket_id] = true;
+            }
+          }
+        }
+      }
+    };
+    add_to_buckets(g_scalars, false);
+    add_to_buckets(h_scalars, true);
+
+    scratch_vector<point_t> Sk(K);
+    scratch_vector<bool> Sk_inited(K);
+    scratch_vector<point_t> Gk(K);
+    scratch_vector<bool> Gk_inited(K);
+    for (size_t l = C - 1; l > 0; --l)
+    {
+      for (size_t k = 0; k < K; ++k)
+      {
+        size_t bucket_id = l * K + k;
+        if (buckets_inited[bucket_id])
+        {
+          if (Sk_inited[k])
+            Sk[k] += buckets[bucket_id];
+          else
+          {
+            Sk[k] = buckets[bucket_id];
+            Sk_inited[k] = true;
+          }
+        }
+
+        if (Sk_inited[k])
+        {
+          if (Gk_inited[k])
+            Gk[k] += Sk[k];
+          else
+          {
+            Gk[k] = Sk[k];
+            Gk_inited[k] = true;
+          }
+        }
+      }
+    }
+
+    point_t result = Gk_inited[K - 1] ? Gk[K - 1] : c_point_0;
+    for (size_t k = K - 2; k != SIZE_MAX; --k)
+    {
+      result.modify_mul_pow_2(c);
+      if (Gk_inited[k])
+        result += Gk[k];
+    }
+
+    result += summand;
+
+    if (!result.is_zero())
+    {
+      LOG_PRINT_L0("multiexp result is non zero: " << result);
+      return false;
+    }
+
+    return true;
+  }
+
+
+  // Straus' (Shamir's trick) method with fixed-base precomputed tables: all the scalars are represented using signed radix-16 digits
+  // and share 252 doublings, each non-zero digit costs one addition of a precomputed multiple of the generator (64 additions per scalar at most).
+  template<typename CT, typename allocator_t>
+  bool msm_and_check_zero_straus_pc(const scalar_vec_base_t<allocator_t>& g_scalars, const scalar_vec_base_t<allocator_t>& h_scalars, const point_t& summand)
+  {
+    CHECK_AND_ASSERT_MES(g_scalars.size() <= CT::c_bpp_mn_max, false, "g_scalars oversized");
+    CHECK_AND_ASSERT_MES(h_scalars.size() <= CT::c_bpp_mn_max, false, "h_scalars oversized");
+
+    constexpr size_t c_digits_count = 64;
+    const msm_generators_precomp_t<CT>& precomp = msm_generators_precomp_t<CT>::get();
+
+    struct term_t
+    {
+      const ge_cached* multiples;
+      int8_t digits[c_digits_count];
+    };
+    scratch_vector<term_t> terms;
+    terms.reserve(g_scalars.size() + h_scalars.size());
+
+    auto add_terms = [&](const scalar_vec_base_t<allocator_t>& scalars, bool select_H) -> bool
+    {
+      for (size_t n = 0; n < scalars.size(); ++n)
+      {
+        const scalar_t& s = scalars[n];
+        CHECK_AND_ASSERT_MES(s.m_s[31] <= 127, false, "scalar is too big");
+        terms.emplace_back();
+        term_t& t = terms.back();
+        t.multiples = precomp.multiples(select_H, n);
+        for (size_t i = 0; i < 32; ++i)
+        {
+          t.digits[2 * i + 0] = s.m_s[i] & 15;
+          t.digits[2 * i + 1] = (s.m_s[i] >> 4) & 15;
+        }
+        int8_t carry = 0;
+        for (size_t i = 0; i < c_digits_count - 1; ++i)
+        {
+          t.digits[i] += carry;
+          carry = (t.digits[i] + 8) >> 4;
+          t.digits[i] -= carry << 4;
+        }
+        t.digits[c_digits_count - 1] += carry;
+      }
+      return true;
+    };
+    if (!add_terms(g_scalars, false) || !add_terms(h_scalars, true))
+      return false;
+
+    point_t result = c_point_0;
+    ge_p1p1 t;
+    for (size_t i = c_digits_count - 1; i != SIZE_MAX; --i)
+    {
+      if (i != c_digits_count - 1)
+        result.modify_mul_pow_2(4);
+      for (const term_t& term : terms)
+      {
+        int8_t d = term.digits[i];
+        if (d > 0)
+          ge_add(&t, &result.m_p3, &term.multiples[d - 1]);
+        else if (d < 0)
+          ge_sub(&t, &result.m_p3, &term.multiples[-d - 1]);
+        else
+          continue;
+        ge_p1p1_to_p3(&result.m_p3, &t);
+      }
+    }
+
+    result += summand;
+
+    if (!result.is_zero())
+    {
+      LOG_PRINT_L0("multiexp result is non zero: " << result);
+      return false;
+    }
+
+    return true;
+  }
+
+
+  // Straus' method for arbitrary points (no precomputed data): the table of 1P, 2P, ..., 8P is built for each point (7 additions),
+  // then all the scalars, represented using signed radix-16 digits, share 252 doublings.
+  // Checks that sum(scalars[i] * points[i]) + summand == 0. Scalars are expected to be reduced.
+  template<typename scalar_allocator_t, typename point_allocator_t>
+  bool msm_and_check_zero_straus(const scalar_vec_base_t<scalar_allocator_t>& scalars, const std::vector<point_t, point_allocator_t>& points, const point_t& summand)
+  {
+    CHECK_AND_ASSERT_MES(scalars.size() == points.size(), false, "scalars and points size missmatch");
+
+    constexpr size_t c_digits_count = 64;
+    struct term_t
+    {
+      ge_cached multiples[8];
+      signed char digits[c_digits_count];
+    };
+    scratch_vector<term_t> terms;
+    terms.reserve(points.size());
+
+    ge_p1p1 t;
+    for (size_t n = 0; n < points.size(); ++n)
+    {
+      const scalar_t& s = scalars[n];
+      if (s.is_zero())
+        continue;
+      CHECK_AND_ASSERT_MES(s.m_s[31] <= 127, false, "scalar is too big");
+      terms.emplace_back();
+      term_t& term = terms.back();
+      ge_scalarmult_recode(term.digits, &s.m_s[0]);
+      ge_p3_to_cached(&term.multiples[0], &points[n].m_p3);
+      ge_p3 kP;
+      for (size_t k = 1; k < 8; ++k)
+      {
+        ge_add(&t, &points[n].m_p3, &term.multiples[k - 1]);
+        ge_p1p1_to_p3(&kP, &t);
+        ge_p3_to_cached(&term.multiples[k], &kP);
+      }
+    }
+
+    point_t result = c_point_0;
+    for (size_t i = c_digits_count - 1; i != SIZE_MAX; --i)
+    {
+      if (i != c_digits_count - 1)
+        result.modify_mul_pow_2(4);
+      for (const term_t& term : terms)
+      {
+        signed char d = term.digits[i];
+        if (d > 0)
+          ge_add(&t, &result.m_p3, &term.multiples[d - 1]);
+        else if (d < 0)
+          ge_sub(&t, &result.m_p3, &term.multiples[-d - 1]);
+        else
+          continue;
+        ge_p1p1_to_p3(&result.m_p3, &t);
+      }
+    }
+
+    result += summand;
+
+    if (!result.is_zero())
+    {
+      LOG_PRINT_L0("multiexp result is non zero: " << result);
+      return false;
+    }
+
+    return true;
+  }
+
+
+  // returns Pippenger's window size for the given total number of points
+  inline uint8_t msm_pippenger_window(size_t points_count)
+  {
+    if (points_count < 1024)
+      return 7;
+    if (points_count < 4096)
+      return 8;
+    return 9;
+  }
+
+
+  enum msm_method_t { msm_straus_pc, msm_pippenger_pc };
+
+  // returns the fastest method for the given total number of points (see perf.msm test):
+  // fixed-base Straus wins up to a few hundred points (i.e. BP+ proofs with up to 2 outputs), Pippenger wins for bigger inputs
+  inline msm_method_t msm_select_method(size_t points_count)
+  {
+    if (points_count <= 256)
+      return msm_straus_pc;
+    return msm_pippenger_pc;
+  }
+
+
   // Just switcher
 
-  template<typename CT>
-  bool msm_and_check_zero(const scalar_vec_t& g_scalars, const scalar_vec_t& h_scalars, const point_t& summand)
+  template<typename CT, typename allocator_t>
+  bool msm_and_check_zero(const scalar_vec_base_t<allocator_t>& g_scalars, const scalar_vec_base_t<allocator_t>& h_scalars, const point_t& summand)
   {
-    //return msm_and_check_zero_naive<CT>(g_scalars, h_scalars, summand);
-    return msm_and_check_zero_pippenger_v3<CT>(g_scalars, h_scalars, summand, 7);
+    const size_t points_count = g_scalars.size() + h_scalars.size();
+    if (msm_select_method(points_count) == msm_straus_pc)
+      return msm_and_check_zero_straus_pc<CT>(g_scalars, h_scalars, summand);
+    return msm_and_check_zero_pippenger_pc<CT>(g_scalars, h_scalars, summand, msm_pippenger_window(points_count));
   }
 
 
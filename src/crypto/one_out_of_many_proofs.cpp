@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 //
 #include "one_out_of_many_proofs.h"
+#include "msm.h"
 #include "../currency_core/crypto_config.h"
 #include "epee/include/misc_log_ex.h"
 
@@ -76,9 +77,11 @@ namespace crypto
     CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(N <= N_max, 3);
     CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(mn <= mn_max, 4);
 
-    scalar_mat_t<n> a_mat(mn);       // m x n matrix
+    scratch_arena_scope scratch_scope;
+
+    scratch_scalar_mat_t<n> a_mat(mn);       // m x n matrix
     a_mat.zero();
-    std::vector<size_t> l_digits(m); // l => n-ary gidits
+    scratch_vector<size_t> l_digits(m); // l => n-ary gidits
     size_t l = secret_index;
     for(size_t j = 0; j < m; ++j)
     {
@@ -106,7 +109,7 @@ namespace crypto
     //
     // coeffs calculation (naive implementation, consider optimization in future)
     //
-    scalar_vec_t coeffs(N * m);                     // m x N matrix
+    scratch_scalar_vec_t coeffs(N * m);                     // m x N matrix
     coeffs.zero();
     for(size_t i = 0; i < N; ++i)
     {
@@ -142,7 +145,7 @@ namespace crypto
 
     scalar_t r_A = scalar_t::random();
     scalar_t r_B = scalar_t::random();
-    scalar_vec_t ro(m);
+    scratch_scalar_vec_t ro(m);
     ro.make_random();
 
     point_t A = c_point_0;
@@ -239,6 +242,8 @@ namespace crypto
     CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(sig.Pk.size() == m, 1);
     CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(sig.f.size() == m * (n - 1), 2);
 
+    scratch_arena_scope scratch_scope;
+
     hash_helper_t::hs_t hsc(1 + ring_size + 2 + m);
     hsc.add_hash(context_hash);
     for(const public_key* ppk : ring)
@@ -249,7 +254,7 @@ namespace crypto
     scalar_t x = hsc.calc_hash();
     DBG_VAL_PRINT(x);
 
-    scalar_vec_t f0(m); // the first column  f_{i,0} = x - sum{j=1}{n-1}( f_{i,j} )
+    scratch_scalar_vec_t f0(m); // the first column  f_{i,0} = x - sum{j=1}{n-1}( f_{i,j} )
     for(size_t j = 0; j < m; ++j)
     {
       f0[j] = x;
@@ -284,7 +289,7 @@ namespace crypto
     //
     // 2
     //
-    scalar_vec_t p_vec(N);
+    scratch_scalar_vec_t p_vec(N);
     for(size_t i = 0; i < N; ++i)
     {
       p_vec[i] = c_scalar_1;
@@ -317,6 +322,139 @@ namespace crypto
   }
 
 #undef CHECK_AND_FAIL_WITH_ERROR_IF_FALSE
+#define CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(cond, err_code) \
+    if (!(cond)) { LOG_PRINT_RED("verify_BGE_proofs_batch: \"" << #cond << "\" is false at " << LOCATION_SS << ENDL << "error code = " << (int)err_code, LOG_LEVEL_3); \
+    if (p_err) { *p_err = err_code; } return false; }
+
+  bool verify_BGE_proofs_batch(const std::vector<BGE_proof_ref_t>& proofs, uint8_t* p_err /* = nullptr */)
+  {
+    static constexpr size_t n = 4; // TODO: @#@# move it out
+
+    DBG_PRINT(" - - - verify_BGE_proofs_batch - - -");
+    CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(proofs.size() > 0, 0);
+
+    scratch_arena_scope scratch_scope;
+
+    // cumulative scalar multiplicands for the BGE generators and for X across all the proofs
+    scratch_scalar_vec_t gen_scalars(mn_max * 2);
+    gen_scalars.zero();
+    scalar_t X_scalar = c_scalar_0;
+
+    // A, B, ring members and Pk of each proof with their multiplicands
+    // (all of them are premultiplied by 1/8, so the multiplicands are multiplied by 8 instead of the points)
+    scratch_point_vec_t points;
+    scratch_scalar_vec_t scalars;
+
+    const scalar_t c_scalar_8 = 8;
+    for(const BGE_proof_ref_t& proof : proofs)
+    {
+      const std::vector<const public_key*>& ring = proof.ring;
+      const BGE_proof& sig = proof.sig;
+      size_t ring_size = ring.size();
+      CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(ring_size > 0, 0);
+
+      const size_t m = std::max(static_cast<uint64_t>(1), constexpr_ceil_log_n(ring_size, n));
+      const size_t N = constexpr_pow(m, n);
+
+      CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(sig.Pk.size() == m, 1);
+      CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(sig.f.size() == m * (n - 1), 2);
+      CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(m * n <= mn_max, 5);
+
+      hash_helper_t::hs_t hsc(1 + ring_size + 2 + m);
+      hsc.add_hash(proof.context_hash);
+      for(const public_key* ppk : ring)
+        hsc.add_pub_key(*ppk);
+      hsc.add_pub_key(sig.A);
+      hsc.add_pub_key(sig.B);
+      hsc.add_pub_keys_array(sig.Pk);
+      scalar_t x = hsc.calc_hash();
+      DBG_VAL_PRINT(x);
+
+      scratch_scalar_vec_t f0(m); // the first column  f_{i,0} = x - sum{j=1}{n-1}( f_{i,j} )
+      for(size_t j = 0; j < m; ++j)
+      {
+        f0[j] = x;
+        for(size_t i = 1; i < n; ++i)
+          f0[j] -= sig.f[j * (n - 1) + i - 1];
+      }
+
+      // random weights for the two verification equations of this proof
+      const scalar_t w1 = scalar_t::random();
+      const scalar_t w2 = scalar_t::random();
+
+      //
+      // 1:  A + x * B - sum{j,i}( f_ji * gen_1 + f_ji * (x - f_ji) * gen_2 ) - y * X == 0
+      //
+      const scalar_t w1_8 = w1 * c_scalar_8;
+      points.emplace_back(sig.A);
+      scalars.emplace_back(w1_8);
+      points.emplace_back(sig.B);
+      scalars.emplace_back(w1_8 * x);
+
+      for(size_t j = 0; j < m; ++j)
+      {
+        for(size_t i = 0; i < n; ++i)
+        {
+          const scalar_t& f_ji = (i == 0) ? f0[j] : sig.f[j * (n - 1) + i - 1];
+          const scalar_t w1_f_ji = w1 * f_ji;
+          gen_scalars[(j * n + i) * 2 + 0] -= w1_f_ji;
+          gen_scalars[(j * n + i) * 2 + 1] -= w1_f_ji * (x - f_ji);
+        }
+      }
+      X_scalar -= w1 * sig.y;
+
+      //
+      // 2:  sum{i}( p_i * ring_i ) - sum{k}( x^k * Pk_k ) - z * X == 0,  ring is padded with the last member up to N
+      //
+      const scalar_t w2_8 = w2 * c_scalar_8;
+      for(size_t i = 0; i < N; ++i)
+      {
+        scalar_t p_i = w2_8;
+        size_t i_tmp = i;
+        for(size_t j = 0; j < m; ++j)
+        {
+          size_t i_j = i_tmp % n;                     // j-th digit of i
+          i_tmp /= n;
+          const scalar_t& f_jij = (i_j == 0) ? f0[j] : sig.f[j * (n - 1) + i_j - 1];
+          p_i *= f_jij;
+        }
+        if (i < ring_size)
+        {
+          points.emplace_back(*ring[i]);
+          scalars.emplace_back(p_i);
+        }
+        else
+        {
+          scalars.back() += p_i;
+        }
+      }
+
+      scalar_t x_power = w2_8;
+      for(size_t k = 0; k < m; ++k)
+      {
+        points.emplace_back(sig.Pk[k]);
+        scalars.emplace_back(-x_power);
+        x_power *= x;
+      }
+      X_scalar -= w2 * sig.z;
+    }
+
+    bool r = false;
+    for(size_t i = 0; i < gen_scalars.size(); ++i)
+    {
+      if (gen_scalars[i].is_zero())
+        continue;
+      points.emplace_back(get_BGE_generator(i, r));
+      CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(r, 5);
+      scalars.emplace_back(gen_scalars[i]);
+    }
+
+    CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(msm_and_check_zero_straus(scalars, points, X_scalar * c_point_X), 100);
+
+    return true;
+  }
+
+#undef CHECK_AND_FAIL_WITH_ERROR_IF_FALSE
 
 
 } // namespace crypto
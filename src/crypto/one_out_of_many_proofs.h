@@ -44,4 +44,22 @@ namespace crypto
   bool verify_BGE_proof(const hash& context_hash, const std::vector<const public_key*>& ring, const BGE_proof& sig, uint8_t* p_err = nullptr);
 
 
+  struct BGE_proof_ref_t
+  {
+    BGE_proof_ref_t(const hash& context_hash, const std::vector<const public_key*>& ring, const BGE_proof& sig)
+      : context_hash(context_hash)
+      , ring(ring)
+      , sig(sig)
+    {}
+    const hash& context_hash;
+    const std::vector<const public_key*>& ring;
+    const BGE_proof& sig;
+  };
+
+  // verifies all the given proofs at once: both verification equations of each proof are multiplied by random weights
+  // and summed up into a single multi-exponentiation, so the generators' terms are shared among the proofs
+  // (proofs may have different rings and contexts, e.g. all the asset surjection proofs of a tx or of a block)
+  bool verify_BGE_proofs_batch(const std::vector<BGE_proof_ref_t>& proofs, uint8_t* p_err = nullptr);
+
+
 } // namespace crypto
@@ -70,6 +70,16 @@ void generate_system_random_bytes(size_t n, void *result) {
 
 static union hash_state state;
 
+#if defined(_MSC_VER)
+#define RANDOM_THREAD_LOCAL __declspec(thread)
+#else
+#define RANDOM_THREAD_LOCAL __thread
+#endif
+
+// per-thread PRNG, takes over the global one on the calling thread while it is set (see random_thread_prng_set_seed)
+static RANDOM_THREAD_LOCAL union hash_state thread_state;
+static RANDOM_THREAD_LOCAL int thread_state_is_set;
+
 #if !defined(NDEBUG)
 static volatile int curstate; /* To catch thread safety problems. */
 #endif
@@ -156,32 +166,51 @@ void random_prng_set_state(const void *state_buffer, const size_t buffer_size)
 #endif
 }
 
-void generate_random_bytes(size_t n, void *result) {
-  grant_random_initialize();
-#if !defined(NDEBUG)
-  assert(curstate == 1);
-  curstate = 2;
-#endif
-  if (n == 0) {
-#if !defined(NDEBUG)
-    assert(curstate == 2);
-    curstate = 1;
-#endif
-    return;
-  }
+static void squeeze_random_bytes(union hash_state *st, size_t n, void *result)
+{
   for (;;) {
-    hash_permutation(&state);
+    hash_permutation(st);
     if (n <= HASH_DATA_AREA) {
-      memcpy(result, &state, n);
-#if !defined(NDEBUG)
-      assert(curstate == 2);
-      curstate = 1;
-#endif
+      memcpy(result, st, n);
       return;
     } else {
-      memcpy(result, &state, HASH_DATA_AREA);
+      memcpy(result, st, HASH_DATA_AREA);
       result = padd(result, HASH_DATA_AREA);
       n -= HASH_DATA_AREA;
     }
   }
 }
+
+void random_thread_prng_set_seed(const void *seed, size_t seed_size)
+{
+  assert(seed_size <= sizeof thread_state);
+  memset(&thread_state, 0, sizeof thread_state);
+  memcpy(&thread_state, seed, seed_size);
+  hash_permutation(&thread_state);
+  thread_state_is_set = 1;
+}
+
+void random_thread_prng_reset(void)
+{
+  memset(&thread_state, 0, sizeof thread_state);
+  thread_state_is_set = 0;
+}
+
+void generate_random_bytes(size_t n, void *result) {
+  if (thread_state_is_set) {
+    if (n != 0)
+      squeeze_random_bytes(&thread_state, n, result);
+    return;
+  }
+  grant_random_initialize();
+#if !defined(NDEBUG)
+  assert(curstate == 1);
+  curstate = 2;
+#endif
+  if (n != 0)
+    squeeze_random_bytes(&state, n, result);
+#if !defined(NDEBUG)
+  assert(curstate == 2);
+  curstate = 1;
+#endif
+}
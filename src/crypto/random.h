@@ -17,6 +17,12 @@ void generate_random_bytes(size_t n, void *result);
 // checks if PRNG is initialized and initializes it if necessary
 void grant_random_initialize(void);
 
+// makes generate_random_bytes() on the calling thread draw from the thread's own PRNG, initialized with the given seed, until random_thread_prng_reset() is called
+// the result of a computation then doesn't depend on the thread it's run on, nor on the other threads
+// the seed should be taken from generate_random_bytes() itself, so that the output stays as unpredictable as the global PRNG's
+void random_thread_prng_set_seed(const void *seed, size_t seed_size);
+void random_thread_prng_reset(void);
+
 #define RANDOM_STATE_SIZE 200
 
 // explicitly define USE_INSECURE_RANDOM_RPNG_ROUTINES for using random_initialize_with_seed
@@ -45,6 +45,9 @@ namespace crypto
     CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(values.size() > 0 && values.size() <= CT::c_bpp_values_max && values.size() == masks.size() && values.size() == commitments_1div8.size(), 1);
     CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(masks.is_reduced(), 3);
 
+    // all the temporaries below go to the thread's scratch arena
+    scratch_arena_scope scratch_scope;
+
     const size_t c_bpp_log2_m = constexpr_ceil_log2(values.size());
     const size_t c_bpp_m = 1ull << c_bpp_log2_m;
     const size_t c_bpp_mn = c_bpp_m * CT::c_bpp_n;
@@ -67,7 +70,7 @@ namespace crypto
 
     // aLs = (aL_0, aL_1, ..., aL_m-1) -- `bit` matrix of c_bpp_m x c_bpp_n, each element is a scalar
 
-    scalar_mat_t<CT::c_bpp_n> aLs(c_bpp_mn), aRs(c_bpp_mn);
+    scratch_scalar_mat_t<CT::c_bpp_n> aLs(c_bpp_mn), aRs(c_bpp_mn);
     aLs.zero();
     aRs.zero();
     // m >= values.size, first set up [0..values.size-1], then -- [values.size..m-1]  (padding area) 
@@ -131,7 +134,7 @@ namespace crypto
     // Note: sum(d_i) = (2^n - 1) * ((z^2)^1 + (z^2)^2 + ... (z^2)^m)) = (2^n-1) * sum_of_powers(x^2, log(m))
 
     scalar_t z_sq = z * z;
-    scalar_mat_t<CT::c_bpp_n> d(c_bpp_mn);
+    scratch_scalar_mat_t<CT::c_bpp_n> d(c_bpp_mn);
     d(0, 0) = z_sq;
     // first row
     for (size_t i = 1; i < c_bpp_m; ++i)
@@ -145,7 +148,7 @@ namespace crypto
 
     // calculate extended Vandermonde vector y = (1, y, y^2, ..., y^(mn+1))   (BP+ paper, page 18, Fig. 3)
     // (calculate two more elements (1 and y^(mn+1)) for convenience)
-    scalar_vec_t y_powers(c_bpp_mn + 2);
+    scratch_scalar_vec_t y_powers(c_bpp_mn + 2);
     y_powers[0] = 1;
     for (size_t i = 1; i <= c_bpp_mn + 1; ++i)
       y_powers[i] = y_powers[i - 1] * y;
@@ -155,9 +158,9 @@ namespace crypto
     DBG_PRINT("Hs(y_powers): " << y_powers.calc_hs());
 
     // aL_hat = aL - 1*z
-    scalar_vec_t aLs_hat = aLs - z;
+    scratch_scalar_vec_t aLs_hat = aLs - z;
     // aR_hat = aR + d o y^leftarr + 1*z where y^leftarr = (y^n, y^(n-1), ..., y)  (BP+ paper, page 18, Fig. 3)
-    scalar_vec_t aRs_hat = aRs + z;
+    scratch_scalar_vec_t aRs_hat = aRs + z;
     for (size_t i = 0; i < c_bpp_mn; ++i)
       aRs_hat[i] += d[i] * y_powers[c_bpp_mn - i];
 
@@ -176,13 +179,13 @@ namespace crypto
 
     // calculate 1, y^-1, y^-2, ...
     const scalar_t y_inverse = y.reciprocal();
-    scalar_vec_t y_inverse_powers(c_bpp_mn / 2 + 1); // the greatest power we need is c_bpp_mn/2 (at the first reduction round)
+    scratch_scalar_vec_t y_inverse_powers(c_bpp_mn / 2 + 1); // the greatest power we need is c_bpp_mn/2 (at the first reduction round)
     y_inverse_powers[0] = 1;
     for (size_t i = 1, size = y_inverse_powers.size(); i < size; ++i)
       y_inverse_powers[i] = y_inverse_powers[i - 1] * y_inverse;
 
     // prepare generator's vector
-    std::vector<point_t> g(c_bpp_mn), h(c_bpp_mn);
+    scratch_point_vec_t g(c_bpp_mn), h(c_bpp_mn);
     for (size_t i = 0; i < c_bpp_mn; ++i)
     {
       g[i] = CT::get_generator(false, i);
@@ -191,8 +194,8 @@ namespace crypto
 
     // WIP zk-argument called with zk-WIP(g, h, G, H, A_hat, aL_hat, aR_hat, alpha_hat)
 
-    scalar_vec_t& a = aLs_hat;
-    scalar_vec_t& b = aRs_hat;
+    scratch_scalar_vec_t& a = aLs_hat;
+    scratch_scalar_vec_t& b = aRs_hat;
 
     sig.L.resize(c_bpp_log2_mn);
     sig.R.resize(c_bpp_log2_mn);
@@ -379,13 +382,16 @@ namespace crypto
     const size_t kn = sigs.size();
     CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(kn > 0, 1);
 
+    // all the temporaries below go to the thread's scratch arena
+    scratch_arena_scope scratch_scope;
+
     struct intermediate_element_t
     {
       scalar_t y;
       scalar_t z;
       scalar_t z_sq;
-      scalar_vec_t e;
-      scalar_vec_t e_sq;
+      scratch_scalar_vec_t e;
+      scratch_scalar_vec_t e_sq;
       scalar_t e_final;
       scalar_t e_final_sq;
       size_t inv_e_offset; // offset in batch_for_inverse
@@ -396,10 +402,10 @@ namespace crypto
       point_t A;
       point_t A0;
       point_t B;
-      std::vector<point_t> L;
-      std::vector<point_t> R;
+      scratch_point_vec_t L;
+      scratch_point_vec_t R;
     };
-    std::vector<intermediate_element_t> interms(kn);
+    scratch_vector<intermediate_element_t> interms(kn);
 
     size_t c_bpp_log2_m_max = 0;
     for (size_t k = 0; k < kn; ++k)
@@ -423,13 +429,8 @@ namespace crypto
       CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(interm.A0.from_public_key(sig.A0), 6);
       CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(interm.A.from_public_key(sig.A), 7);
       CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(interm.B.from_public_key(sig.B), 8);
-      interm.L.resize(sig.L.size());
-      interm.R.resize(sig.R.size());
-      for (size_t i = 0; i < interm.L.size(); ++i)
-      {
-        CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(interm.L[i].from_public_key(sig.L[i]), 9);
-        CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(interm.R[i].from_public_key(sig.R[i]), 10);
-      }
+      CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(point_t::from_public_keys(sig.L, interm.L), 9);
+      CHECK_AND_FAIL_WITH_ERROR_IF_FALSE(point_t::from_public_keys(sig.R, interm.R), 10);
     }
     const size_t c_bpp_m_max = 1ull << c_bpp_log2_m_max;
     const size_t c_bpp_mn_max = c_bpp_m_max * CT::c_bpp_n;
@@ -448,7 +449,7 @@ namespace crypto
     }
     */
 
-    scalar_vec_t batch_for_inverse;
+    scratch_scalar_vec_t batch_for_inverse;
     batch_for_inverse.reserve(kn + kn * c_bpp_LR_size_max);
 
 
@@ -572,9 +573,9 @@ namespace crypto
     // All (***) will be muptiplied by random weightning factor and then summed up.
 
     // Calculate cummulative sclalar multiplicand for fixed generators across all the sigs.
-    scalar_vec_t g_scalars;
+    scratch_scalar_vec_t g_scalars;
     g_scalars.resize(c_bpp_mn_max, 0);
-    scalar_vec_t h_scalars;
+    scratch_scalar_vec_t h_scalars;
     h_scalars.resize(c_bpp_mn_max, 0);
     scalar_t G_scalar = 0;
     scalar_t H_scalar = 0;
@@ -592,7 +593,7 @@ namespace crypto
       DBG_PRINT("rwf: " << rwf);
 
       // prepare d vector (see also d structure description in proof function)
-      scalar_mat_t<CT::c_bpp_n> d(interm.c_bpp_mn);
+      scratch_scalar_mat_t<CT::c_bpp_n> d(interm.c_bpp_mn);
       d(0, 0) = interm.z_sq;
       // first row
       for (size_t i = 1; i < interm.c_bpp_m; ++i)
@@ -616,7 +617,7 @@ namespace crypto
       // s_vec[00000b] = ... * (e_4)^-1 * (e_3)^-1 * (e_2)^-1 * (e_1)^-1 * (e_0)^-1
       // s_vec[00101b] = ... * (e_4)^-1 * (e_3)^-1 * (e_2)^+1 * (e_1)^-1 * (e_0)^+1
       const size_t log2_mn = sig.L.size(); // at the beginning we made sure that sig.L.size() == c_bpp_log2_m + c_bpp_log2_n
-      scalar_vec_t s_vec(interm.c_bpp_mn);
+      scratch_scalar_vec_t s_vec(interm.c_bpp_mn);
       s_vec[0] = get_e_inv(0);
       for (size_t i = 1; i < log2_mn; ++i)
         s_vec[0] *= get_e_inv(i);          // s_vec[0] = (e_0)^-1 * (e_1)^-1 * .. (e_{log2_mn-1})^-1 
@@ -630,7 +631,7 @@ namespace crypto
       }
 
       // prepare y_inv vector
-      scalar_vec_t y_inverse_powers(interm.c_bpp_mn);
+      scratch_scalar_vec_t y_inverse_powers(interm.c_bpp_mn);
       y_inverse_powers[0] = 1;
       for (size_t i = 1; i < interm.c_bpp_mn; ++i)
         y_inverse_powers[i] = y_inverse_powers[i - 1] * y_inv;
@@ -0,0 +1,32 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "scratch_arena.h"
+
+namespace crypto
+{
+  scratch_arena& scratch_arena::get()
+  {
+    static thread_local scratch_arena arena;
+    return arena;
+  }
+
+  void scratch_arena::close_scope(size_t offset)
+  {
+    m_offset = offset;
+    if (--m_scopes != 0 || m_overflow_size == 0)
+      return;
+
+    // nothing is allocated from the block at this point, so it can be replaced with a bigger one
+    size_t new_size = m_size + m_overflow_size;
+    m_overflow_size = 0;
+    if (new_size > SCRATCH_ARENA_MAX_SIZE)
+      new_size = SCRATCH_ARENA_MAX_SIZE;
+    if (new_size <= m_size)
+      return;
+    new_size = (new_size + 4095) & ~size_t(4095);
+    m_block.reset(new uint8_t[new_size]);
+    m_size = new_size;
+  }
+}
@@ -0,0 +1,140 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#define SCRATCH_ARENA_MAX_SIZE (4 * 1024 * 1024)  // the arena doesn't grow beyond this, the rest goes to the heap
+
+namespace crypto
+{
+  //
+  // scratch_arena -- per-thread bump allocator for the temporaries of the proof routines.
+  // Memory is given out only while a scratch_arena_scope is open on the thread and is taken back all at once
+  // when the scope closes, deallocation itself does nothing. Whatever doesn't fit goes to the heap, and the
+  // arena grows by that much when the outermost scope closes, so the next call of the same kind allocates nothing.
+  // Anything allocated from it must not outlive the scope.
+  //
+  class scratch_arena
+  {
+  public:
+    // the current thread's arena
+    static scratch_arena& get();
+
+    // nullptr if there's no scope open or it doesn't fit
+    void* allocate(size_t size, size_t alignment)
+    {
+      if (m_scopes == 0)
+        return nullptr;
+      size_t offset = (m_offset + alignment - 1) & ~(alignment - 1);
+      if (offset + size > m_size)
+      {
+        m_overflow_size += size + alignment;
+        return nullptr;
+      }
+      m_offset = offset + size;
+      return m_block.get() + offset;
+    }
+
+    bool owns(const void* p) const
+    {
+      const uint8_t* ptr = static_cast<const uint8_t*>(p);
+      return m_block && ptr >= m_block.get() && ptr < m_block.get() + m_size;
+    }
+
+    size_t get_size() const { return m_size; }
+    size_t get_used() const { return m_offset; }
+
+  private:
+    friend class scratch_arena_scope;
+
+    scratch_arena() : m_size(0), m_offset(0), m_overflow_size(0), m_scopes(0) {}
+
+    size_t open_scope()
+    {
+      ++m_scopes;
+      return m_offset;
+    }
+
+    void close_scope(size_t offset);
+
+    std::unique_ptr<uint8_t[]> m_block;
+    size_t m_size;
+    size_t m_offset;
+    size_t m_overflow_size;  // went to the heap since the outermost scope was opened
+    size_t m_scopes;
+  };
+
+  // makes the thread's scratch arena available for the lifetime of the object, scopes may be nested
+  class scratch_arena_scope
+  {
+  public:
+    scratch_arena_scope()
+      : m_arena(scratch_arena::get())
+      , m_offset(m_arena.open_scope())
+    {}
+
+    ~scratch_arena_scope()
+    {
+      m_arena.close_scope(m_offset);
+    }
+
+    scratch_arena_scope(const scratch_arena_scope&) = delete;
+    scratch_arena_scope& operator=(const scratch_arena_scope&) = delete;
+
+  private:
+    scratch_arena& m_arena;
+    size_t m_offset;
+  };
+
+  // allocator for the containers of temporaries: the scratch arena if there's a scope open, the heap otherwise
+  template<typename T>
+  struct scratch_allocator
+  {
+    typedef T value_type;
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::false_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    typedef std::false_type is_always_equal;
+
+    template<typename U>
+    struct rebind { typedef scratch_allocator<U> other; };
+
+    scratch_allocator() : m_arena(&scratch_arena::get()) {}
+
+    template<typename U>
+    scratch_allocator(const scratch_allocator<U>& rhs) : m_arena(rhs.m_arena) {}
+
+    T* allocate(size_t n)
+    {
+      void* p = m_arena->allocate(n * sizeof(T), alignof(T));
+      if (!p)
+        p = ::operator new(n * sizeof(T));
+      return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t /* n */)
+    {
+      if (!m_arena->owns(p))
+        ::operator delete(p);
+    }
+
+    template<typename U>
+    bool operator==(const scratch_allocator<U>& rhs) const { return m_arena == rhs.m_arena; }
+    template<typename U>
+    bool operator!=(const scratch_allocator<U>& rhs) const { return m_arena != rhs.m_arena; }
+
+    scratch_arena* m_arena;
+  };
+
+  template<typename T>
+  using scratch_vector = std::vector<T, scratch_allocator<T>>;
+
+} // namespace crypto
@@ -8,9 +8,25 @@
 #include <string.h>
 
 #include "hash-ops.h"
+#include "keccak.h"
 #ifdef _M_ARM64
   #include "malloc.h"
 #endif 
+
+/* out[j] = H(in[2j] || in[2j+1]) for j < count; 4 pairs are hashed at once. out may be the same as in */
+static void hash_pairs(char (*in)[HASH_SIZE], size_t count, char (*out)[HASH_SIZE]) {
+  static const size_t lengths[4] = { 2 * HASH_SIZE, 2 * HASH_SIZE, 2 * HASH_SIZE, 2 * HASH_SIZE };
+  size_t j;
+  for (j = 0; j + 4 <= count; j += 4) {
+    const uint8_t *data[4] = { (const uint8_t *) in[2 * j], (const uint8_t *) in[2 * j + 2], (const uint8_t *) in[2 * j + 4], (const uint8_t *) in[2 * j + 6] };
+    uint8_t *md[4] = { (uint8_t *) out[j], (uint8_t *) out[j + 1], (uint8_t *) out[j + 2], (uint8_t *) out[j + 3] };
+    keccak_x4(data, lengths, md, HASH_SIZE);
+  }
+  for (; j < count; ++j) {
+    cn_fast_hash(in[2 * j], 2 * HASH_SIZE, out[j]);
+  }
+}
+
 void tree_hash(const char (*hashes)[HASH_SIZE], size_t count, char *root_hash) {
   assert(count > 0);
   if (count == 1) {
@@ -27,15 +43,13 @@ void tree_hash(const char (*hashes)[HASH_SIZE], size_t count, char *root_hash) {
     cnt &= ~(cnt >> 1);
     ints = alloca(cnt * HASH_SIZE);
     memcpy(ints, hashes, (2 * cnt - count) * HASH_SIZE);
-    for (i = 2 * cnt - count, j = 2 * cnt - count; j < cnt; i += 2, ++j) {
-      cn_fast_hash(hashes[i], 64, ints[j]);
-    }
-    assert(i == count);
+    i = 2 * cnt - count;
+    j = 2 * cnt - count;
+    hash_pairs((char (*)[HASH_SIZE]) hashes[i], cnt - j, ints + j);
+    assert(i + 2 * (cnt - j) == count);
     while (cnt > 2) {
       cnt >>= 1;
-      for (i = 0, j = 0; j < cnt; i += 2, ++j) {
-        cn_fast_hash(ints[i], 64, ints[j]);
-      }
+      hash_pairs(ints, cnt, ints);
     }
     cn_fast_hash(ints[0], 64, root_hash);
   }
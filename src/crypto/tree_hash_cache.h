@@ -0,0 +1,120 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include "hash.h"
+
+namespace crypto
+{
+  //
+  // tree_hash_cache -- calculates the same as tree_hash(), keeping the interior nodes of the last calculation
+  // by their children, so only the nodes above the changed leaves are hashed again (which is O(log n) for
+  // a replaced leaf, e.g. a new miner tx in a block template). An inserted or removed leaf shifts the pairing
+  // of the leaves before it, these are hashed again. The nodes to be hashed on each level go in one batch
+  // (multi-buffer keccak). Not thread-safe.
+  //
+  class tree_hash_cache
+  {
+  public:
+    hash calc(const std::vector<hash>& leaves)
+    {
+      const size_t count = leaves.size();
+      if (count == 0)
+        return hash{}; // tree_hash() isn't defined for that
+      if (count == 1)
+        return leaves[0];
+
+      std::unordered_map<node_children, hash, node_children_hasher> nodes;
+      nodes.reserve(count);
+
+      // the same layout as in tree_hash(): the first 2 * cnt - count leaves go to the first level as they are
+      size_t cnt = 1;
+      while (cnt * 2 < count)
+        cnt *= 2;
+      const size_t copied = 2 * cnt - count;
+      std::vector<hash> level(cnt);
+      std::memcpy(level.data(), leaves.data(), copied * sizeof(hash));
+      hash_pairs(leaves.data() + copied, cnt - copied, level.data() + copied, nodes);
+      for (; cnt > 1; cnt /= 2)
+        hash_pairs(level.data(), cnt / 2, level.data(), nodes);
+
+      m_nodes.swap(nodes);
+      return level[0];
+    }
+
+    void clear()
+    {
+      m_nodes.clear();
+    }
+
+    size_t get_nodes_count() const
+    {
+      return m_nodes.size();
+    }
+
+  private:
+    struct node_children
+    {
+      hash left;
+      hash right;
+
+      bool operator==(const node_children& rhs) const
+      {
+        return left == rhs.left && right == rhs.right;
+      }
+    };
+
+    struct node_children_hasher
+    {
+      size_t operator()(const node_children& c) const
+      {
+        size_t l, r;
+        std::memcpy(&l, &c.left, sizeof l);
+        std::memcpy(&r, &c.right, sizeof r);
+        return l ^ (r * 31);
+      }
+    };
+
+    // out[j] = H(in[2j] || in[2j+1]), out may be the same as in
+    void hash_pairs(const hash* in, size_t count, hash* out, std::unordered_map<node_children, hash, node_children_hasher>& nodes)
+    {
+      static_assert(sizeof(node_children) == 2 * sizeof(hash), "size missmatch");
+      std::vector<size_t> missing;
+      for (size_t j = 0; j != count; ++j)
+      {
+        const node_children& c = reinterpret_cast<const node_children&>(in[2 * j]);
+        auto it = m_nodes.find(c);
+        if (it == m_nodes.end())
+          missing.push_back(j);
+      }
+
+      std::vector<const void*> data(missing.size());
+      std::vector<size_t> lengths(missing.size(), 2 * sizeof(hash));
+      std::vector<hash> hashes(missing.size());
+      for (size_t m = 0; m != missing.size(); ++m)
+        data[m] = &in[2 * missing[m]];
+      cn_fast_hash_batch(data.data(), lengths.data(), missing.size(), reinterpret_cast<char*>(hashes.data()));
+
+      // in[2j], in[2j + 1] are read before out[j] is written, j goes up
+      for (size_t j = 0, m = 0; j != count; ++j)
+      {
+        const node_children c = reinterpret_cast<const node_children&>(in[2 * j]);
+        hash h;
+        if (m != missing.size() && missing[m] == j)
+          h = hashes[m++];
+        else
+          h = m_nodes[c];
+        nodes[c] = h;
+        out[j] = h;
+      }
+    }
+
+    std::unordered_map<node_children, hash, node_children_hasher> m_nodes; // the interior nodes of the last calculation
+  }; // class tree_hash_cache
+
+} // namespace crypto
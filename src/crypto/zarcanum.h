@@ -149,6 +149,25 @@ namespace crypto
     }
   }
 
+  // the same as verify_schnorr_sig<gt_G> with A's precomputed data
+  inline bool verify_schnorr_sig(const hash& m, const public_key& A, const point_precomp_t& A_precomp, const generic_schnorr_sig& sig) noexcept
+  {
+    try
+    {
+      if (!sig.c.is_reduced() || !sig.y.is_reduced())
+        return false;
+      hash_helper_t::hs_t hsc(3);
+      hsc.add_hash(m);
+      hsc.add_pub_key(A);
+      hsc.add_point(A_precomp.mul_plus_G(sig.c, sig.y)); // sig.y * G + sig.c * A
+      return sig.c == hsc.calc_hash();
+    }
+    catch(...)
+    {
+      return false;
+    }
+  }
+
   template<>
   inline bool verify_schnorr_sig<gt_X>(const hash& m, const public_key& A, const generic_schnorr_sig& sig) noexcept
   {
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 
+#include <atomic>
 #include "include_base_utils.h"
 using namespace epee;
 
@@ -17,6 +18,7 @@ using namespace epee;
 #include "common/int-util.h"
 #include "ethereum/libethash/ethash/ethash.hpp"
 #include "ethereum/libethash/ethash/progpow.hpp"
+#include "cache_helper.h"
 
 namespace currency
 {
@@ -61,7 +63,53 @@ namespace currency
     return result;
   }
   //--------------------------------------------------------------
-  crypto::hash get_block_longhash(uint64_t height, const crypto::hash& block_header_hash, uint64_t nonce)
+  namespace
+  {
+    // dataset items computed by the light context, the key is epoch << 32 | item index
+    typedef epee::misc_utils::cache_base<false, uint64_t, ethash::hash2048, CURRENCY_POW_DAG_ITEMS_CACHE_MAX_ELEMENTS> dag_items_cache_t;
+
+    std::atomic<bool> pow_light_verification(false);
+    std::atomic<bool> dag_items_cache_enabled(true);
+
+    dag_items_cache_t& get_dag_items_cache()
+    {
+      static dag_items_cache_t cache;
+      return cache;
+    }
+
+    ethash::hash2048 cached_dataset_item_lookup(const ethash::epoch_context& context, uint32_t index) noexcept
+    {
+      const uint64_t key = (static_cast<uint64_t>(context.epoch_number) << 32) | index;
+      ethash::hash2048 item;
+      try
+      {
+        if (get_dag_items_cache().get(key, item))
+          return item;
+        item = progpow::calculate_dataset_item(context, index);
+        get_dag_items_cache().set(key, item);
+      }
+      catch (...)
+      {
+        item = progpow::calculate_dataset_item(context, index);
+      }
+      return item;
+    }
+  }
+  //--------------------------------------------------------------
+  void set_pow_light_verification(bool enabled, uint64_t dag_items_cache_size)
+  {
+    get_dag_items_cache().clear();
+    get_dag_items_cache().set_max_elements(dag_items_cache_size);
+    dag_items_cache_enabled = dag_items_cache_size != 0;
+    pow_light_verification = enabled;
+  }
+  //--------------------------------------------------------------
+  bool is_pow_light_verification()
+  {
+    return pow_light_verification;
+  }
+  //--------------------------------------------------------------
+  crypto::hash get_block_longhash_full(uint64_t height, const crypto::hash& block_header_hash, uint64_t nonce)
   {
     init_ethash_log_if_necessary();
     int epoch = ethash_height_to_epoch(height);
@@ -76,6 +124,45 @@ namespace currency
     memcpy(&result.data, &res_eth.final_hash, sizeof(res_eth.final_hash));
     return result;
   }
+  //--------------------------------------------------------------
+  void get_block_longhashes_full(uint64_t height, const crypto::hash& block_header_hash, const uint64_t* nonces, size_t count, crypto::hash* results)
+  {
+    init_ethash_log_if_necessary();
+    int epoch = ethash_height_to_epoch(height);
+    std::shared_ptr<ethash::epoch_context_full> p_context = progpow::get_global_epoch_context_full(static_cast<int>(epoch));
+    if (!p_context)
+    {
+      LOG_ERROR("fatal error: get_global_epoch_context_full failed, throwing bad_alloc...");
+      throw std::bad_alloc();
+    }
+    progpow::result res_eth[progpow::max_hash_batch_size];
+    for (size_t done = 0; done < count; done += progpow::max_hash_batch_size)
+    {
+      size_t n = std::min(count - done, progpow::max_hash_batch_size);
+      progpow::hash_batch(*p_context, static_cast<int>(height), *(ethash::hash256*)&block_header_hash, nonces + done, n, res_eth);
+      for (size_t i = 0; i != n; i++)
+        memcpy(&results[done + i].data, &res_eth[i].final_hash, sizeof(res_eth[i].final_hash));
+    }
+  }
+  //--------------------------------------------------------------
+  crypto::hash get_block_longhash_light(uint64_t height, const crypto::hash& block_header_hash, uint64_t nonce)
+  {
+    init_ethash_log_if_necessary();
+    int epoch = ethash_height_to_epoch(height);
+    const ethash::epoch_context& context = progpow::get_global_epoch_context(static_cast<int>(epoch));
+    progpow::dataset_lookup_fn lookup = dag_items_cache_enabled ? &cached_dataset_item_lookup : &progpow::calculate_dataset_item;
+    auto res_eth = progpow::hash(context, static_cast<int>(height), *(ethash::hash256*)&block_header_hash, nonce, lookup);
+    crypto::hash result = currency::null_hash;
+    memcpy(&result.data, &res_eth.final_hash, sizeof(res_eth.final_hash));
+    return result;
+  }
+  //--------------------------------------------------------------
+  crypto::hash get_block_longhash(uint64_t height, const crypto::hash& block_header_hash, uint64_t nonce)
+  {
+    if (pow_light_verification)
+      return get_block_longhash_light(height, block_header_hash, nonce);
+    return get_block_longhash_full(height, block_header_hash, nonce);
+  }
   //---------------------------------------------------------------
   crypto::hash get_block_header_mining_hash(const block& b)
   {
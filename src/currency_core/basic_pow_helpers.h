@@ -24,6 +24,7 @@
 #include "blockchain_storage_basic.h"
 
 #define CURRENCY_MINER_BLOCK_BLOB_NONCE_OFFSET    1
+#define CURRENCY_MINER_HASH_BATCH_SIZE            8
 
 namespace currency
 {
@@ -31,6 +32,15 @@ namespace currency
   crypto::hash ethash_epoch_to_seed(int epoch);
   crypto::hash get_block_header_mining_hash(const block& b);
   crypto::hash get_block_longhash(uint64_t h, const crypto::hash& block_header_hash, uint64_t nonce);
+  // always uses the full dataset of the epoch, for mining
+  crypto::hash get_block_longhash_full(uint64_t h, const crypto::hash& block_header_hash, uint64_t nonce);
+  // the same for count nonces at once: the epoch context is taken once and the nonces are hashed in interleaved batches
+  void get_block_longhashes_full(uint64_t h, const crypto::hash& block_header_hash, const uint64_t* nonces, size_t count, crypto::hash* results);
+  // uses the light context only: no full dataset in memory, its items are computed when needed (much slower per hash)
+  crypto::hash get_block_longhash_light(uint64_t h, const crypto::hash& block_header_hash, uint64_t nonce);
+  // makes get_block_longhash() use the light context, keeping up to dag_items_cache_size computed items (0 - no cache)
+  void set_pow_light_verification(bool enabled, uint64_t dag_items_cache_size = CURRENCY_POW_DAG_ITEMS_CACHE_MAX_ELEMENTS);
+  bool is_pow_light_verification();
   void get_block_longhash(const block& b, crypto::hash& res);
   crypto::hash get_block_longhash(const block& b);
 
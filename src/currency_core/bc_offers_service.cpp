@@ -26,6 +26,7 @@ namespace bc_services
     , m_last_seen_block_id(currency::null_hash)
     , m_deinitialized(false)
     , m_disabled(false)
+    , m_expiration_moments_valid(false)
 
   {}
   //------------------------------------------------------------------
@@ -103,7 +104,7 @@ namespace bc_services
       cancel_offer od = AUTO_VAL_INIT(od);
       r = handle_entry_push(json_buff, a, od, i, tx, h, timestamp);
     }
-
+    on_offers_changed();
   }
   //------------------------------------------------------------------
 
@@ -121,6 +122,7 @@ namespace bc_services
       else
         break;
     }
+    on_offers_changed();
     LOG_PRINT_GREEN("TRIM OFFERS: " << size_before - m_offers.size() << " offers removed", LOG_LEVEL_0);
     return true;
   }
@@ -141,6 +143,7 @@ namespace bc_services
     m_last_seen_block_id = currency::null_hash;
     CRITICAL_REGION_LOCAL(m_lock);
     m_offers.clear();
+    on_offers_changed();
     return true;
   }
   //------------------------------------------------------------------
@@ -181,7 +184,7 @@ namespace bc_services
     {
       LOG_ERROR("offers service instruction " << a.instruction << " failed, offer's tx:oid : " << get_transaction_hash(tx) << ":" << i);
     }
-
+    on_offers_changed();
 
     //trim offers once a day
     if (m_last_trimed_height != h && !(h%CURRENCY_BLOCKS_PER_DAY))
@@ -469,11 +472,81 @@ namespace bc_services
     m_core_runtime_config = rtc;
   }
   //------------------------------------------------------------------
+  void bc_offers_service::on_offers_changed()
+  {
+    CRITICAL_REGION_LOCAL(m_lock);
+    m_offers_queries_cache.clear();
+    m_expiration_moments_valid = false;
+    if (m_keyword_search_texts.size() > 2 * m_offers.size() + 100)
+    {
+      // drop the texts of the offers that have gone
+      auto& index_by_id = m_offers.get<by_id>();
+      for (auto it = m_keyword_search_texts.begin(); it != m_keyword_search_texts.end();)
+      {
+        if (index_by_id.find(it->first) == index_by_id.end())
+          it = m_keyword_search_texts.erase(it);
+        else
+          ++it;
+      }
+    }
+  }
+  //------------------------------------------------------------------
+  const std::wstring* bc_offers_service::get_keyword_search_text(const offer_details_ex_with_hash& o)
+  {
+    CRITICAL_REGION_LOCAL(m_lock);
+    auto it = m_keyword_search_texts.find(o.h);
+    if (it == m_keyword_search_texts.end())
+      it = m_keyword_search_texts.emplace(o.h, get_offer_keyword_search_text(o)).first;
+    return &it->second;
+  }
+  //------------------------------------------------------------------
+  uint64_t bc_offers_service::get_next_expiration_moment(uint64_t current_core_time)
+  {
+    CRITICAL_REGION_LOCAL(m_lock);
+    if (!m_expiration_moments_valid)
+    {
+      m_expiration_moments.clear();
+      for (const auto& o : m_offers)
+      {
+        if (o.expiration_time)
+          m_expiration_moments.push_back(o.timestamp + o.expiration_time * SECONDS_IN_ONE_DAY);
+      }
+      std::sort(m_expiration_moments.begin(), m_expiration_moments.end());
+      m_expiration_moments_valid = true;
+    }
+    // an offer is still alive at its expiration moment and is expired right after it
+    auto it = std::lower_bound(m_expiration_moments.begin(), m_expiration_moments.end(), current_core_time);
+    return it == m_expiration_moments.end() ? UINT64_MAX : *it;
+  }
+  //------------------------------------------------------------------
+  namespace
+  {
+    std::string get_offers_query_key(const core_offers_filter& cof)
+    {
+      core_offers_filter f = cof;
+      f.current_time = 0;
+      // the json keeps only 6 digits of rate limits, so they are appended as they are
+      return epee::serialization::store_t_to_json(f) + epee::string_tools::pod_to_hex(cof.rate_low_limit) + epee::string_tools::pod_to_hex(cof.rate_up_limit);
+    }
+  }
+  //------------------------------------------------------------------
   bool bc_offers_service::get_offers_ex(const core_offers_filter& cof, std::list<offer_details_ex>& offers, uint64_t& total_count, uint64_t current_core_time)
   {
     CRITICAL_REGION_LOCAL(m_lock);
     total_count = m_offers.size();
-#define SET_CASE_FOR_ORDER_TYPE(order_type_name) case order_type_name: return get_offers_ex_for_index<sort_id_to_type<order_type_name>::index_type>(cof, offers, current_core_time);
+
+    // the offers set is the same until on_offers_changed(), so the result may change only when some offer expires
+    std::string query_key = get_offers_query_key(cof);
+    auto cache_it = m_offers_queries_cache.find(query_key);
+    if (cache_it != m_offers_queries_cache.end() && cache_it->second.made_at <= current_core_time && current_core_time <= cache_it->second.valid_until)
+    {
+      offers.insert(offers.end(), cache_it->second.offers.begin(), cache_it->second.offers.end());
+      return cache_it->second.result;
+    }
+
+    std::list<offer_details_ex> found_offers;
+    bool r = false;
+#define SET_CASE_FOR_ORDER_TYPE(order_type_name) case order_type_name: r = get_offers_ex_for_index<sort_id_to_type<order_type_name>::index_type>(cof, found_offers, current_core_time); break;
 
     switch (cof.order_by)
     {
@@ -489,7 +562,18 @@ namespace bc_services
       LOG_ERROR("Unknown order_by id: " << cof.order_by);
       return false;
     }
-    return true;
+#undef SET_CASE_FOR_ORDER_TYPE
+
+    if (m_offers_queries_cache.size() >= BC_OFFERS_QUERIES_CACHE_MAX_ENTRIES)
+      m_offers_queries_cache.clear();
+    offers_query_cache_entry& entry = m_offers_queries_cache[query_key];
+    entry.made_at = current_core_time;
+    entry.valid_until = get_next_expiration_moment(current_core_time);
+    entry.result = r;
+    entry.offers = found_offers;
+
+    offers.splice(offers.end(), found_offers);
+    return r;
   }
   //------------------------------------------------------------------
 
@@ -7,6 +7,7 @@
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/version.hpp>
 #include <boost/serialization/list.hpp>
+#include <unordered_map>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/global_fun.hpp>
@@ -62,7 +63,7 @@ namespace bc_services
 
   public:
     // these members are made public only to be accessible from tests
-    offers_container& get_offers_container(){ return m_offers; } //TODO: need refactoring, bad design, atm just for performance tests
+    offers_container& get_offers_container(){ return m_offers; } //TODO: need refactoring, bad design, atm just for performance tests (changes made through it are not seen by the queries cache)
     bool trim_offers();
     crypto::hash get_last_seen_block_id();
     void set_last_seen_block_id(const crypto::hash& h);
@@ -100,6 +101,17 @@ namespace bc_services
     bool validate_modify_order_signature(const offer_details_ex_with_hash &odeh, const t_modify_offer& co);
     template<class market_index_type>
     bool get_offers_ex_for_index(const core_offers_filter& cof, std::list<offer_details_ex>& offers, uint64_t current_core_time);
+    const std::wstring* get_keyword_search_text(const offer_details_ex_with_hash& o);
+    uint64_t get_next_expiration_moment(uint64_t current_core_time);
+    void on_offers_changed();
+
+    struct offers_query_cache_entry
+    {
+      uint64_t made_at;      // core time of the query
+      uint64_t valid_until;  // no offer expires in [made_at, valid_until]
+      bool result;
+      std::list<offer_details_ex> offers;
+    };
 
 
     //offers
@@ -112,6 +124,12 @@ namespace bc_services
     currency::core_runtime_config m_core_runtime_config;
     bool m_deinitialized;
     bool m_disabled;
+
+    // filtering caches, protected by m_lock and dropped by on_offers_changed() whenever the offers set changes
+    std::unordered_map<crypto::hash, std::wstring> m_keyword_search_texts; // offer id -> get_offer_keyword_search_text(), offers are never changed in place, only stopped
+    std::vector<uint64_t> m_expiration_moments; // sorted, timestamp + expiration_time of each offer that has expiration time
+    bool m_expiration_moments_valid;
+    std::unordered_map<std::string, offers_query_cache_entry> m_offers_queries_cache; // get_offers_query_key() -> get_offers_ex() result
     //---------------------------------------------------------------------------------------------------------------------------------------------
 
   };
@@ -184,7 +202,7 @@ namespace bc_services
       if (selected_index >= cof.offset + cof.limit)
         break;
 
-      if (is_offer_matched_by_filter(*it, cof, current_core_time))
+      if (is_offer_matched_by_filter(*it, cof, current_core_time, cof.keyword.empty() ? nullptr : get_keyword_search_text(*it)))
       {
         //if we after offset position
         if (selected_index >= cof.offset)
@@ -242,6 +260,7 @@ namespace bc_services
           m_offers.insert(o);
         CATCH_ENTRY("error while reading market storage ", void());
       }
+      on_offers_changed();
 
     }   
     //ar & m_offers;
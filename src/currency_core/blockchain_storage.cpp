@@ -7,9 +7,11 @@
 
 #include <set>
 #include <unordered_set>
+#include <queue>
 #include <unordered_map>
 #include <algorithm>
 #include <cstdio>
+#include <future>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/algorithm/string/replace.hpp>
@@ -18,6 +20,7 @@
 
 #include "common/db_backend_selector.h"
 #include "common/command_line.h"
+#include "common/startup_profile.h"
 
 #include "blockchain_storage.h"
 #include "currency_format_utils.h"
@@ -33,6 +36,7 @@
 #include "miner_common.h"
 #include "storages/portable_storage_template_helper.h"
 #include "basic_pow_helpers.h"
+#include "ethereum/libethash/ethash/ethash.hpp"
 #include "version.h"
 #include "tx_semantic_validation.h"
 #include "crypto/RIPEMD160_helper.h"
@@ -61,6 +65,15 @@ using namespace currency;
 #define BLOCKCHAIN_STORAGE_CONTAINER_TX_FEE_MEDIAN    "median_fee2"
 #define BLOCKCHAIN_STORAGE_CONTAINER_GINDEX_INCS      "gindex_increments"
 #define BLOCKCHAIN_STORAGE_CONTAINER_ASSETS           "assets"
+#define BLOCKCHAIN_STORAGE_CONTAINER_BLOCK_HEADERS    "block_headers"
+#define BLOCKCHAIN_STORAGE_CONTAINER_BLOCKS_MAX_TIMESTAMPS "blocks_max_timestamps"
+
+#define BLOCKCHAIN_STORAGE_ZC_OUTPUTS_INDEX_FILENAME    "zc_outputs_index.bin"
+#define BLOCKCHAIN_STORAGE_ZC_OUTPUTS_INDEX_SIGNATURE   0x0158444955435a00ULL // change the lowest byte on entry format change
+#define BLOCKCHAIN_STORAGE_ZC_OUTPUTS_INDEX_VERIFY_TAIL 1000                  // number of the latest entries checked against the db on startup
+
+#define BLOCKCHAIN_STORAGE_SPENT_KEYS_FILTER_MIN_CAPACITY (1024 * 1024)        // the filter is sized for twice the spent key images count, but not less than this
+#define BLOCKCHAIN_STORAGE_IDS_FILTER_MIN_CAPACITY        (1024 * 1024)        // the same for the count of blocks, txs and multisig outs
 
 #define BLOCKCHAIN_STORAGE_OPTIONS_ID_CURRENT_BLOCK_CUMUL_SZ_LIMIT          0
 #define BLOCKCHAIN_STORAGE_OPTIONS_ID_CURRENT_PRUNED_RS_HEIGHT              1
@@ -72,21 +85,46 @@ using namespace currency;
 
 #define TARGETDATA_CACHE_SIZE                          DIFFICULTY_WINDOW + 10
 
+#define BLOCKCHAIN_PRUNE_DEPTH_MIN                     CURRENCY_ALT_BLOCK_LIVETIME_COUNT // older blocks can't be popped by a reorganize, so their txs won't need to be re-validated
+#define BLOCKCHAIN_PRUNE_MAX_BLOCKS_PER_NEW_BLOCK      10                                // pruning is spread over incoming blocks to keep write txs short
+
+#define BLOCKCHAIN_DB_COMPACTION_FOLDER_SUFFIX         "_compacted"
+#define BLOCKCHAIN_DB_COMPACTION_MAX_ATTEMPTS          3
+
 DISABLE_VS_WARNINGS(4267)
 
 namespace 
 {
   const command_line::arg_descriptor<uint32_t>      arg_db_cache_l1  ( "db-cache-l1", "Specify size of memory mapped db cache file");
   const command_line::arg_descriptor<uint32_t>      arg_db_cache_l2  ( "db-cache-l2", "Specify cached elements in db helpers");
+  const command_line::arg_descriptor<uint32_t>      arg_sync_range_proofs_batch_blocks  ( "sync-range-proofs-batch-blocks", "Verify range proofs of up to N consecutive blocks at once during synchronization (0 - disabled)");
+  const command_line::arg_descriptor<uint32_t>      arg_db_sync_batch_blocks  ( "db-sync-batch-blocks", "Commit up to N blocks in one db write transaction during synchronization (0 - disabled). In case of a crash the node restarts from the last committed block");
+  const command_line::arg_descriptor<uint32_t>      arg_db_sync_batch_max_mb  ( "db-sync-batch-max-mb", "Max total size (in MB) of blocks committed in one db write transaction during synchronization");
+  const command_line::arg_descriptor<uint32_t>      arg_prune_depth  ( "prune-depth", "Keep signatures, proofs and attachments of transactions only for the latest N blocks (0 - disabled, only the checkpoints zone is pruned)");
+  const command_line::arg_descriptor<uint32_t>      arg_block_tx_verification_threads  ( "block-tx-verification-threads", "Specify number of threads used for parallel verification of block transactions (1 - disable parallel verification)");
+  const command_line::arg_descriptor<bool>          arg_pow_light_verification  ( "pow-light-verification", "Verify PoW of blocks with the light ethash cache instead of the full dataset of the epoch (much less memory and no dataset generation, but slower verification). Local mining still uses the full dataset");
+  const command_line::arg_descriptor<uint64_t>      arg_pow_light_dag_cache_items  ( "pow-light-dag-cache-items", "Number of dataset items computed by PoW light verification to keep in memory, 256 bytes each (0 - disabled)", CURRENCY_POW_DAG_ITEMS_CACHE_MAX_ELEMENTS);
+  const command_line::arg_descriptor<uint64_t>      arg_pow_next_epoch_prepare_blocks  ( "pow-next-epoch-prepare-blocks", "Build the full ethash dataset of the next epoch in the background this many blocks before the epoch starts (0 - disabled)", CURRENCY_POW_NEXT_EPOCH_PREPARE_BLOCKS);
+  const command_line::arg_descriptor<uint32_t>      arg_pow_dataset_threads  ( "pow-dataset-threads", "Number of threads building the full ethash dataset, in the background for the next epoch or with --pow-dataset-full-init (default - half of the cores)");
+  const command_line::arg_descriptor<bool>          arg_pow_dataset_full_init  ( "pow-dataset-full-init", "Compute the whole ethash dataset in parallel when an epoch's context is created, instead of computing its items while hashing (for mining and syncing nodes)");
+  const command_line::arg_descriptor<std::string>   arg_pow_dataset_huge_pages  ( "pow-dataset-huge-pages", "Allocate the computed full ethash datasets with huge pages: \"transparent\" (THP via madvise) or \"explicit\" (MAP_HUGETLB from vm.nr_hugepages, transparent ones if there's not enough), Linux only", "");
+  const command_line::arg_descriptor<bool>          arg_pow_dataset_numa_interleave  ( "pow-dataset-numa-interleave", "Spread the pages of the computed full ethash datasets over the NUMA nodes, so threads of every socket read an equal share of them locally (Linux only)");
+  const command_line::arg_descriptor<bool>          arg_pow_dataset_file  ( "pow-dataset-file", "Keep the full ethash dataset of each epoch in a file of the data folder (the primary's one for a secondary instance) and map it on startup instead of computing it");
+
+  uint64_t get_header_timestamp(const block_header_index_entry& e) { return e.timestamp; }
+  uint64_t get_header_cumulative_size(const block_header_index_entry& e) { return e.block_cumulative_size; }
 }
 
 //------------------------------------------------------------------
 blockchain_storage::blockchain_storage(tx_memory_pool& tx_pool) :m_db(nullptr, m_rw_lock),
                                                                  m_db_blocks(m_db),
+                                                                 m_db_block_headers(m_db),
+                                                                 m_db_blocks_max_timestamps(m_db),
                                                                  m_db_blocks_index(m_db),
                                                                  m_db_transactions(m_db),
                                                                  m_db_spent_keys(m_db),
                                                                  m_db_outputs(m_db),
+                                                                 m_zc_outputs_index(m_db),
                                                                  m_db_multisig_outs(m_db),
                                                                  m_db_solo_options(m_db),
                                                                  m_db_aliases(m_db),
@@ -101,8 +139,16 @@ blockchain_storage::blockchain_storage(tx_memory_pool& tx_pool) :m_db(nullptr, m
                                                                  m_db_major_failure(BLOCKCHAIN_STORAGE_OPTIONS_ID_MAJOR_FAILURE, m_db_solo_options),
                                                                  m_db_per_block_gindex_incs(m_db),
                                                                  m_tx_pool(tx_pool), 
+                                                                 m_alternative_chains_stored_size(0),
+                                                                 m_aliases_index_version(0),
+                                                                 m_aliases_version(1),
+                                                                 m_assets_index_valid(false),
                                                                  m_is_in_checkpoint_zone(false), 
                                                                  m_is_blockchain_storing(false), 
+                                                                 m_is_db_compacting(false),
+                                                                 m_is_secondary(false),
+                                                                 m_ids_filter_ready(false),
+                                                                 m_secondary_last_tx_id(0),
                                                                  m_core_runtime_config(get_default_core_runtime_config()),
                                                                  //m_bei_stub(AUTO_VAL_INIT(m_bei_stub)),
                                                                  m_event_handler(&m_event_handler_stub), 
@@ -110,10 +156,26 @@ blockchain_storage::blockchain_storage(tx_memory_pool& tx_pool) :m_db(nullptr, m
                                                                  m_current_fee_median(0), 
                                                                  m_current_fee_median_effective_index(0), 
                                                                  m_is_reorganize_in_process(false), 
-                                                                 m_deinit_is_done(false), 
+                                                                 m_is_truncation_in_process(false), 
+                                                                 m_deinit_is_done(false),
                                                                  m_cached_next_pow_difficulty(0), 
                                                                  m_cached_next_pos_difficulty(0), 
-                                                                 m_blockchain_launch_timestamp(0)
+                                                                 m_pos_targetdata_window(TARGETDATA_CACHE_SIZE),
+                                                                 m_pow_targetdata_window(TARGETDATA_CACHE_SIZE),
+                                                                 m_block_sizes_median_window(CURRENCY_REWARD_BLOCKS_WINDOW, get_header_cumulative_size),
+                                                                 m_fee_lookup_sizes_median_window(CORE_FEE_BLOCKS_LOOKUP_WINDOW, get_header_cumulative_size),
+                                                                 m_timestamps_median_window(BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW, get_header_timestamp),
+                                                                 m_tx_expiration_median_window(TX_EXPIRATION_TIMESTAMP_CHECK_WINDOW, get_header_timestamp),
+                                                                 m_daily_stat_window(CURRENCY_BLOCKS_PER_DAY),
+                                                                 m_blockchain_launch_timestamp(0),
+                                                                 m_tx_verification_threads(1),
+                                                                 m_range_proofs_batch_blocks(0),
+                                                                 m_db_sync_batch_blocks(0),
+                                                                 m_db_sync_batch_max_bytes(CURRENCY_DB_SYNC_BATCH_DEFAULT_MAX_BYTES),
+                                                                 m_prune_depth(0),
+                                                                 m_blocks_write_batch_active(false),
+                                                                 m_blocks_write_batch_blocks_count(0),
+                                                                 m_blocks_write_batch_bytes(0)
 
 
 {
@@ -136,6 +198,8 @@ bool blockchain_storage::have_tx(const crypto::hash &id) const
 bool blockchain_storage::have_tx_keyimg_as_spent(const crypto::key_image &key_im, uint64_t before_height /* = UINT64_MAX */) const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
+  if (!is_key_image_maybe_spent(key_im))
+    return false;
   auto it_ptr = m_db_spent_keys.get(key_im);
   if (!it_ptr)
     return false;
@@ -156,28 +220,30 @@ void blockchain_storage::init_options(boost::program_options::options_descriptio
 {
   command_line::add_arg(desc, arg_db_cache_l1);
   command_line::add_arg(desc, arg_db_cache_l2);
+  command_line::add_arg(desc, arg_block_tx_verification_threads);
+  command_line::add_arg(desc, arg_sync_range_proofs_batch_blocks);
+  command_line::add_arg(desc, arg_db_sync_batch_blocks);
+  command_line::add_arg(desc, arg_db_sync_batch_max_mb);
+  command_line::add_arg(desc, arg_prune_depth);
+  command_line::add_arg(desc, arg_pow_light_verification);
+  command_line::add_arg(desc, arg_pow_light_dag_cache_items);
+  command_line::add_arg(desc, arg_pow_next_epoch_prepare_blocks);
+  command_line::add_arg(desc, arg_pow_dataset_threads);
+  command_line::add_arg(desc, arg_pow_dataset_full_init);
+  command_line::add_arg(desc, arg_pow_dataset_file);
+  command_line::add_arg(desc, arg_pow_dataset_huge_pages);
+  command_line::add_arg(desc, arg_pow_dataset_numa_interleave);
+  command_line::add_arg(desc, command_line::arg_db_secondary_of);
 }
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_block_h_older_then(uint64_t timestamp) const 
 {
-  // get avarage block position
-  uint64_t last_block_timestamp = m_db_blocks.back()->bl.timestamp;
-  if (timestamp >= last_block_timestamp)
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  if (timestamp >= m_db_block_headers.back()->timestamp)
     return get_top_block_height();
-  uint64_t difference = last_block_timestamp - timestamp;
-  uint64_t n_blocks = difference / (DIFFICULTY_TOTAL_TARGET);
-  if (n_blocks >= get_top_block_height())
-    return 0;
-  uint64_t index = get_top_block_height() - n_blocks;
-  while (true)
-  {
-    if (index == 0)
-      return 0;
-    if (m_db_blocks[index]->bl.timestamp < timestamp)
-      return index;
-    index--;
-  }
-  return 0;
+  // the highest height that all blocks up to it (inclusive) are older than timestamp
+  uint64_t h = get_first_height_with_max_timestamp_not_less(timestamp);
+  return h == 0 ? 0 : h - 1;
 }
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_current_blockchain_size() const
@@ -212,12 +278,23 @@ bool blockchain_storage::init(const std::string& config_folder, const boost::pro
 
   tools::db::db_backend_selector dbbs;
   dbbs.init(vm);
+  if (command_line::has_arg(vm, command_line::arg_db_secondary_of))
+  {
+    // the db of the primary daemon is opened read-only, everything else stays in own data dir
+    m_is_secondary = true;
+    dbbs.set_config_folder(command_line::get_arg(vm, command_line::arg_db_secondary_of));
+  }
   auto p_backend = dbbs.create_backend();
   if (!p_backend)
   {
     LOG_PRINT_RED_L0("Failed to create db engine");
     return false;
   }
+  if (m_is_secondary && !p_backend->set_read_only(true))
+  {
+    LOG_PRINT_RED_L0("DB engine " << p_backend->name() << " doesn't support read-only mode required by secondary instance");
+    return false;
+  }
   m_db.reset_backend(p_backend);
   LOG_PRINT_L0("DB ENGINE USED BY CORE: " << m_db.get_backend()->name());
   
@@ -234,23 +311,115 @@ bool blockchain_storage::init(const std::string& config_folder, const boost::pro
   }
   LOG_PRINT_GREEN("Using db file cache size(L1): " << cache_size_l1, LOG_LEVEL_0);
 
+  m_tx_verification_threads = std::thread::hardware_concurrency();
+  if (command_line::has_arg(vm, arg_block_tx_verification_threads))
+  {
+    m_tx_verification_threads = command_line::get_arg(vm, arg_block_tx_verification_threads);
+  }
+  if (m_tx_verification_threads > 1)
+    m_tx_verification_pool.init(m_tx_verification_threads);
+  LOG_PRINT_L0("Block transactions verification threads: " << m_tx_verification_threads);
+
+  // the miner's datasets are created the same way, so it's set in the light mode too
+  ethash::huge_pages_mode huge_pages = ethash::huge_pages_mode::none;
+  std::string huge_pages_str;
+  if (command_line::has_arg(vm, arg_pow_dataset_huge_pages))
+    huge_pages_str = command_line::get_arg(vm, arg_pow_dataset_huge_pages);
+  if (huge_pages_str == "transparent")
+    huge_pages = ethash::huge_pages_mode::transparent;
+  else if (huge_pages_str == "explicit")
+    huge_pages = ethash::huge_pages_mode::explicit_pages;
+  else
+    CHECK_AND_ASSERT_MES(huge_pages_str.empty(), false, "wrong --" << arg_pow_dataset_huge_pages.name << " value: " << huge_pages_str);
+  bool numa_interleave = command_line::has_arg(vm, arg_pow_dataset_numa_interleave);
+  ethash::set_full_dataset_memory_options(huge_pages, numa_interleave);
+  if (huge_pages != ethash::huge_pages_mode::none || numa_interleave)
+    LOG_PRINT_L0("Full ethash datasets are allocated with " << (huge_pages_str.empty() ? "regular" : huge_pages_str) << " pages" << (numa_interleave ? ", interleaved over the NUMA nodes" : ""));
+
+  if (command_line::has_arg(vm, arg_pow_light_verification))
+  {
+    uint64_t dag_cache_items = command_line::get_arg(vm, arg_pow_light_dag_cache_items);
+    set_pow_light_verification(true, dag_cache_items);
+    LOG_PRINT_L0("PoW is verified with the light ethash cache, computed dataset items kept: " << dag_cache_items);
+  }
+  else
+  {
+    // the full dataset of the next epoch isn't needed in light mode, the miner builds its own when it starts
+    uint64_t prepare_blocks = CURRENCY_POW_NEXT_EPOCH_PREPARE_BLOCKS;
+    if (command_line::has_arg(vm, arg_pow_next_epoch_prepare_blocks))
+      prepare_blocks = command_line::get_arg(vm, arg_pow_next_epoch_prepare_blocks);
+    size_t dataset_threads = std::max<size_t>(std::thread::hardware_concurrency() / 2, 1);
+    if (command_line::has_arg(vm, arg_pow_dataset_threads))
+      dataset_threads = std::max<size_t>(command_line::get_arg(vm, arg_pow_dataset_threads), 1);
+    if (command_line::has_arg(vm, arg_pow_dataset_file))
+    {
+      std::string datasets_folder = m_is_secondary ? command_line::get_arg(vm, command_line::arg_db_secondary_of) : config_folder;
+      datasets_folder += "/" CURRENCY_ETHASH_DATASETS_FOLDERNAME;
+      m_ethash_dataset_files.init(datasets_folder, static_cast<unsigned>(dataset_threads));
+      ethash::set_global_epoch_context_full_provider([this](int epoch) { return m_ethash_dataset_files.get_context(epoch); });
+      LOG_PRINT_L0("Full ethash datasets are kept in " << datasets_folder);
+    }
+    else if (command_line::has_arg(vm, arg_pow_dataset_full_init))
+    {
+      ethash::set_global_full_dataset_init_threads(static_cast<unsigned>(dataset_threads));
+      LOG_PRINT_L0("Full ethash dataset is computed with " << dataset_threads << " thread(s) when an epoch's context is created");
+    }
+    m_ethash_epoch_preparer.init(prepare_blocks, dataset_threads, m_ethash_dataset_files.is_enabled() ? &m_ethash_dataset_files : nullptr);
+  }
+
+  if (command_line::has_arg(vm, arg_sync_range_proofs_batch_blocks))
+  {
+    m_range_proofs_batch_blocks = command_line::get_arg(vm, arg_sync_range_proofs_batch_blocks);
+    LOG_PRINT_L0("Range proofs are verified in batches of up to " << m_range_proofs_batch_blocks << " blocks during synchronization");
+  }
+
+  if (command_line::has_arg(vm, arg_db_sync_batch_max_mb))
+    m_db_sync_batch_max_bytes = static_cast<uint64_t>(command_line::get_arg(vm, arg_db_sync_batch_max_mb)) * 1024 * 1024;
+  if (command_line::has_arg(vm, arg_db_sync_batch_blocks))
+  {
+    m_db_sync_batch_blocks = command_line::get_arg(vm, arg_db_sync_batch_blocks);
+    LOG_PRINT_L0("Blocks are committed to the db in batches of up to " << m_db_sync_batch_blocks << " blocks / " << m_db_sync_batch_max_bytes / (1024 * 1024) << " MB during synchronization");
+  }
+
+  if (command_line::has_arg(vm, arg_prune_depth))
+  {
+    m_prune_depth = command_line::get_arg(vm, arg_prune_depth);
+    if (m_prune_depth != 0 && m_prune_depth < BLOCKCHAIN_PRUNE_DEPTH_MIN)
+    {
+      LOG_PRINT_YELLOW("prune-depth " << m_prune_depth << " is too small, blocks of a possible reorganization must keep their signatures; using " << BLOCKCHAIN_PRUNE_DEPTH_MIN, LOG_LEVEL_0);
+      m_prune_depth = BLOCKCHAIN_PRUNE_DEPTH_MIN;
+    }
+    if (m_prune_depth != 0)
+      LOG_PRINT_L0("Pruned node mode: signatures, proofs and attachments are kept only for the latest " << m_prune_depth << " blocks");
+  }
+
   m_config_folder = config_folder;
 
+  // services (offers) only load their own files, that goes along with the db opening, they're needed since the first block handled
+  std::future<void> services_init = std::async(std::launch::async, [&]()
+  {
+    tools::startup_phase_timer spt("blockchain: services init", true);
+    m_services_mgr.init(config_folder, vm);
+  });
+
   // remove old incompatible DB
   const std::string old_db_folder_path = m_config_folder + "/" CURRENCY_BLOCKCHAINDATA_FOLDERNAME_OLD;
-  if (boost::filesystem::exists(epee::string_encoding::utf8_to_wstring(old_db_folder_path)))
+  if (!m_is_secondary && boost::filesystem::exists(epee::string_encoding::utf8_to_wstring(old_db_folder_path)))
   {
     LOG_PRINT_YELLOW("Removing old DB in " << old_db_folder_path << "...", LOG_LEVEL_0);
     boost::filesystem::remove_all(epee::string_encoding::utf8_to_wstring(old_db_folder_path));
   }
 
   const std::string db_folder_path = dbbs.get_db_folder_path();
-  LOG_PRINT_L0("Loading blockchain from " << db_folder_path);
+  m_db_folder_path = db_folder_path;
+  LOG_PRINT_L0("Loading blockchain from " << db_folder_path << (m_is_secondary ? " (read-only, secondary instance)" : ""));
 
+  tools::startup_phase_timer spt_db_open("blockchain: db open and migrations");
   bool db_opened_okay = false;
   for(size_t loading_attempt_no = 0; loading_attempt_no < 2; ++loading_attempt_no)
   {
     bool res = m_db.open(db_folder_path, cache_size_l1);
+    CHECK_AND_ASSERT_MES(res || !m_is_secondary, false, "Failed to open the primary's database in folder: " << db_folder_path);
     if (!res)
     {
       // if DB could not be opened -- try to remove the whole folder and re-open DB
@@ -262,6 +431,10 @@ bool blockchain_storage::init(const std::string& config_folder, const boost::pro
 
     res = m_db_blocks.init(BLOCKCHAIN_STORAGE_CONTAINER_BLOCKS);
     CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
+    res = m_db_block_headers.init(BLOCKCHAIN_STORAGE_CONTAINER_BLOCK_HEADERS);
+    CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
+    res = m_db_blocks_max_timestamps.init(BLOCKCHAIN_STORAGE_CONTAINER_BLOCKS_MAX_TIMESTAMPS);
+    CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
     res = m_db_blocks_index.init(BLOCKCHAIN_STORAGE_CONTAINER_BLOCKS_INDEX);
     CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
     res = m_db_transactions.init(BLOCKCHAIN_STORAGE_CONTAINER_TRANSACTIONS);
@@ -289,6 +462,8 @@ bool blockchain_storage::init(const std::string& config_folder, const boost::pro
       LOG_PRINT_GREEN("Using db items cache size(L2): " << cache_size, LOG_LEVEL_0);
       m_db_blocks_index.set_cache_size(cache_size);
       m_db_blocks.set_cache_size(cache_size);
+      m_db_block_headers.set_cache_size(cache_size);
+      m_db_blocks_max_timestamps.set_cache_size(cache_size);
       m_db_blocks_index.set_cache_size(cache_size);
       m_db_transactions.set_cache_size(cache_size);
       m_db_spent_keys.set_cache_size(cache_size);
@@ -302,6 +477,18 @@ bool blockchain_storage::init(const std::string& config_folder, const boost::pro
 
     LOG_PRINT_L0("Opened DB ver " << m_db_storage_major_compatibility_version << "." << m_db_storage_minor_compatibility_version);
 
+    if (m_is_secondary)
+    {
+      // nothing can be migrated or rebuilt here, it's up to the primary
+      CHECK_AND_ASSERT_MES(m_db_blocks.size() != 0, false, "Secondary instance: the primary's database is empty");
+      CHECK_AND_ASSERT_MES(m_db_storage_major_compatibility_version == BLOCKCHAIN_STORAGE_MAJOR_COMPATIBILITY_VERSION && m_db_storage_minor_compatibility_version == BLOCKCHAIN_STORAGE_MINOR_COMPATIBILITY_VERSION, false,
+        "Secondary instance: the primary's database ver " << m_db_storage_major_compatibility_version << "." << m_db_storage_minor_compatibility_version << " doesn't match expected "
+        << BLOCKCHAIN_STORAGE_MAJOR_COMPATIBILITY_VERSION << "." << BLOCKCHAIN_STORAGE_MINOR_COMPATIBILITY_VERSION << ", the primary should be of the same version and fully started");
+      CHECK_AND_ASSERT_MES(m_db_block_headers.size() == m_db_blocks.size() && m_db_blocks_max_timestamps.size() == m_db_blocks.size(), false, "Secondary instance: block headers index of the primary's database is not consistent");
+      db_opened_okay = true;
+      break;
+    }
+
     bool need_reinit = false;
     if (m_db_blocks.size() != 0)
     {
@@ -453,10 +640,22 @@ bool blockchain_storage::init(const std::string& config_folder, const boost::pro
       }
     }
 
+    if (!need_reinit && m_db_blocks.size() != 0 && (m_db_block_headers.size() != m_db_blocks.size() || m_db_blocks_max_timestamps.size() != m_db_blocks.size()))
+    {
+      // DB created by an older version or the index is inconsistent: build it from the blocks
+      if (!rebuild_block_headers_index())
+      {
+        LOG_ERROR("Failed to rebuild block headers index, full resync is triggered in attempt to fix this.");
+        need_reinit = true;
+      }
+    }
+
     if (need_reinit)
     {
       LOG_PRINT_L1("DB at " << db_folder_path << " is about to be deleted and re-created...");
       m_db_blocks.deinit();
+      m_db_block_headers.deinit();
+      m_db_blocks_max_timestamps.deinit();
       m_db_blocks_index.deinit();
       m_db_transactions.deinit();
       m_db_spent_keys.deinit();
@@ -480,6 +679,31 @@ bool blockchain_storage::init(const std::string& config_folder, const boost::pro
   }
 
   CHECK_AND_ASSERT_MES(db_opened_okay, false, "All attempts to open DB at " << db_folder_path << " failed");
+  spt_db_open.finish();
+
+  if (m_is_secondary)
+  {
+    // the index file belongs to the primary and is remapped by it while growing, decoys selection uses the db
+    LOG_PRINT_L0("Secondary instance: zc outputs index is not used");
+  }
+  else
+  {
+    tools::startup_phase_timer spt("blockchain: zc outputs index");
+    if (!init_zc_outputs_index(db_folder_path))
+    {
+      // not critical: decoys selection falls back to the db
+      LOG_PRINT_RED_L0("Failed to initialize zc outputs index, random outputs for hidden amounts will be taken from the db");
+      m_zc_outputs_index.deinit();
+    }
+  }
+
+  if (!m_is_secondary)
+  {
+    tools::startup_phase_timer spt("blockchain: spent key images filter");
+    init_spent_keys_filter();
+  }
+
+  services_init.get();
 
   if (!m_db_blocks.size())
   {
@@ -492,18 +716,26 @@ bool blockchain_storage::init(const std::string& config_folder, const boost::pro
     LOG_PRINT_MAGENTA("Storage initialized with genesis", LOG_LEVEL_0);
   } 
 
-  store_db_solo_options_values();
-
-  m_services_mgr.init(config_folder, vm);
+  if (!m_is_secondary)
+    store_db_solo_options_values();
 
   //print information message
   uint64_t timestamp_diff = m_core_runtime_config.get_core_time() - m_db_blocks.back()->bl.timestamp;
   if(!m_db_blocks.back()->bl.timestamp)
     timestamp_diff = m_core_runtime_config.get_core_time() - 1341378000;
 
-  m_db.begin_transaction();
-  set_lost_tx_unmixable();
-  m_db.commit_transaction();
+  if (m_is_secondary)
+  {
+    tools::db::stat_info si = AUTO_VAL_INIT(si);
+    m_db.get_backend()->get_stat_info(si);
+    m_secondary_last_tx_id = si.last_tx_id;
+  }
+  else
+  {
+    m_db.begin_transaction();
+    set_lost_tx_unmixable();
+    m_db.commit_transaction();
+  }
 
   LOG_PRINT_GREEN("Blockchain initialized, ver: " << m_db_storage_major_compatibility_version << "." << m_db_storage_minor_compatibility_version << ", last block: " << m_db_blocks.size() - 1 << ENDL 
     << "  genesis:                " << get_block_hash(m_db_blocks[0]->bl) << ENDL
@@ -516,7 +748,11 @@ bool blockchain_storage::init(const std::string& config_folder, const boost::pro
 
   return true;
 }
-
+//------------------------------------------------------------------
+bool blockchain_storage::prepare_top_ethash_epoch()
+{
+  return m_ethash_epoch_preparer.prepare_epoch_of_height(get_top_block_height());
+}
 //------------------------------------------------------------------
 bool blockchain_storage::set_lost_tx_unmixable_for_height(uint64_t height)
 {
@@ -584,13 +820,17 @@ void blockchain_storage::store_db_solo_options_values()
 //------------------------------------------------------------------
 bool blockchain_storage::deinit()
 {
+  m_ethash_epoch_preparer.deinit();
+  if (m_ethash_dataset_files.is_enabled())
+    ethash::set_global_epoch_context_full_provider(nullptr);
+  m_zc_outputs_index.deinit();
   m_db.close();
   epee::file_io_utils::unlock_and_close_file(m_interprocess_locker_file);
   m_deinit_is_done = true;
   return true;
 }
 //------------------------------------------------------------------
-bool blockchain_storage::pop_block_from_blockchain(transactions_map& onboard_transactions)
+bool blockchain_storage::pop_block_from_blockchain(transactions_map& onboard_transactions, bool move_txs_to_pool)
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
 
@@ -600,7 +840,7 @@ bool blockchain_storage::pop_block_from_blockchain(transactions_map& onboard_tra
   CHECK_AND_ASSERT_MES(bei_ptr.get(), false, "pop_block_from_blockchain: can't pop from blockchain");
 
   uint64_t fee_total = 0;
-  bool r = purge_block_data_from_blockchain(bei_ptr->bl, bei_ptr->bl.tx_hashes.size(), fee_total, onboard_transactions);
+  bool r = purge_block_data_from_blockchain(bei_ptr->bl, bei_ptr->bl.tx_hashes.size(), fee_total, onboard_transactions, move_txs_to_pool);
   CHECK_AND_ASSERT_MES(r, false, "Failed to purge_block_data_from_blockchain for block " << get_block_hash(bei_ptr->bl) << " on height " << h);
 
   pop_block_from_per_block_increments(bei_ptr->height);
@@ -611,6 +851,8 @@ bool blockchain_storage::pop_block_from_blockchain(transactions_map& onboard_tra
 
   //pop block from core
   m_db_blocks.pop_back();
+  m_db_block_headers.pop_back();
+  m_db_blocks_max_timestamps.pop_back();
 
   on_block_removed(*bei_ptr);
   return true;
@@ -619,6 +861,12 @@ bool blockchain_storage::pop_block_from_blockchain(transactions_map& onboard_tra
 bool blockchain_storage::set_checkpoints(checkpoints&& chk_pts) 
 {
   m_checkpoints = chk_pts;
+  if (m_is_secondary)
+  {
+    // pruning is done by the primary
+    m_is_in_checkpoint_zone = m_db_blocks.size() < m_checkpoints.get_top_checkpoint_height();
+    return true;
+  }
   try
   {
     m_db.begin_transaction();
@@ -661,13 +909,18 @@ bool blockchain_storage::prune_ring_signatures_and_attachments(uint64_t height,
       "failed to validate extra check, it->second.m_keeper_block_height = " << it->m_keeper_block_height  << 
       "is mot equal to height = " << height << " in blockchain index, for block on height = " << height);
     
+    if (it->tx.signatures.empty() && it->tx.attachment.empty() && it->tx.proofs.empty())
+      continue; // already pruned (e.g. was added in the checkpoints zone)
+
     transaction_chain_entry lolcal_chain_entry = *it;
-    signatures_pruned = lolcal_chain_entry.tx.signatures.size();
+    signatures_pruned += lolcal_chain_entry.tx.signatures.size();
     lolcal_chain_entry.tx.signatures.clear();
         
     attachments_pruned += lolcal_chain_entry.tx.attachment.size();
     lolcal_chain_entry.tx.attachment.clear();
 
+    lolcal_chain_entry.tx.proofs.clear();
+
     //reassign to db
     m_db_transactions.set(h, lolcal_chain_entry);
 
@@ -676,16 +929,21 @@ bool blockchain_storage::prune_ring_signatures_and_attachments(uint64_t height,
   return true;
 }
 //------------------------------------------------------------------
-bool blockchain_storage::prune_ring_signatures_and_attachments_if_need()
+bool blockchain_storage::prune_ring_signatures_and_attachments_if_need(uint64_t max_blocks_count /* = UINT64_MAX */)
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
 
   uint64_t top_block_height = get_top_block_height();
   uint64_t pruning_end_height = m_checkpoints.get_checkpoint_before_height(top_block_height);
+  if (m_prune_depth != 0 && top_block_height > m_prune_depth)
+    pruning_end_height = std::max(pruning_end_height, top_block_height - m_prune_depth);
   if (pruning_end_height > m_db_current_pruned_rs_height)
   {
+    if (pruning_end_height - m_db_current_pruned_rs_height > max_blocks_count)
+      pruning_end_height = m_db_current_pruned_rs_height + max_blocks_count;
+    int log_level = max_blocks_count == UINT64_MAX ? LOG_LEVEL_0 : LOG_LEVEL_2;
     LOG_PRINT_CYAN("Starting pruning ring signatues and attachments from height " << m_db_current_pruned_rs_height + 1 << " to height " << pruning_end_height
-      << " (" << pruning_end_height - m_db_current_pruned_rs_height << " blocks), top block height is " << top_block_height, LOG_LEVEL_0);
+      << " (" << pruning_end_height - m_db_current_pruned_rs_height << " blocks), top block height is " << top_block_height, log_level);
     uint64_t tx_count = 0, sig_count = 0, attach_count = 0;
     for(uint64_t height = m_db_current_pruned_rs_height + 1; height <= pruning_end_height; height++)
     {
@@ -693,7 +951,7 @@ bool blockchain_storage::prune_ring_signatures_and_attachments_if_need()
       CHECK_AND_ASSERT_MES(res, false, "failed to prune_ring_signatures_and_attachments for height = " << height);
     }
     m_db_current_pruned_rs_height = pruning_end_height;
-    LOG_PRINT_CYAN("Transaction pruning finished: " << sig_count << " signatures and " << attach_count << " attachments released in " << tx_count << " transactions.", LOG_LEVEL_0);
+    LOG_PRINT_CYAN("Transaction pruning finished: " << sig_count << " signatures and " << attach_count << " attachments released in " << tx_count << " transactions.", log_level);
   }
   return true;
 }
@@ -704,19 +962,31 @@ bool blockchain_storage::clear()
   m_db.begin_transaction();
 
   m_db_blocks.clear();
+  m_db_block_headers.clear();
+  m_db_blocks_max_timestamps.clear();
   m_db_blocks_index.clear();
   m_db_transactions.clear();
   m_db_spent_keys.clear();
+  if (!m_is_secondary)
+    m_spent_keys_filter.reset(BLOCKCHAIN_STORAGE_SPENT_KEYS_FILTER_MIN_CAPACITY, crypto::rand<uint64_t>());
+  m_ids_filter_ready = false; // rebuilt on the next search
   m_db_solo_options.clear();
   store_db_solo_options_values();
   m_db_outputs.clear();
+  m_zc_outputs_index.truncate(0);
   m_db_multisig_outs.clear();
   m_db_aliases.clear();
+  ++m_aliases_version;
   m_db_assets.clear();
+  {
+    CRITICAL_REGION_LOCAL(m_assets_index_lock);
+    m_assets_index_valid = false;
+  }
   m_db_addr_to_alias.clear();
   m_db_per_block_gindex_incs.clear();
-  m_pos_targetdata_cache.clear();
-  m_pow_targetdata_cache.clear();
+  m_pos_targetdata_window.invalidate();
+  m_pow_targetdata_window.invalidate();
+  invalidate_stat_windows();
 
   m_db.commit_transaction();
   
@@ -725,12 +995,7 @@ bool blockchain_storage::clear()
     CRITICAL_REGION_LOCAL(m_invalid_blocks_lock);
     m_invalid_blocks.clear();     // crypto::hash -> block_extended_info
   }
-  {
-    CRITICAL_REGION_LOCAL(m_alternative_chains_lock);
-    m_alternative_chains.clear();
-    m_altblocks_keyimages.clear();
-    m_alternative_chains_txs.clear();
-  }
+  clear_altblocks();
   
   
   return true;
@@ -817,7 +1082,7 @@ bool blockchain_storage::purge_transaction_keyimages_from_blockchain(const trans
   return true;
 }
 //------------------------------------------------------------------
-bool blockchain_storage::purge_transaction_from_blockchain(const crypto::hash& tx_id, uint64_t& fee, transaction& tx_)
+bool blockchain_storage::purge_transaction_from_blockchain(const crypto::hash& tx_id, uint64_t& fee, transaction& tx_, bool move_to_pool)
 {
   fee = 0;
   CRITICAL_REGION_LOCAL(m_read_lock);
@@ -836,7 +1101,7 @@ bool blockchain_storage::purge_transaction_from_blockchain(const crypto::hash& t
   r = unprocess_blockchain_tx_attachments(tx, get_current_blockchain_size(), 0/*TODO: add valid timestamp here in future if need*/);
 
   bool added_to_the_pool = false;
-  if(!is_coinbase(tx))
+  if(move_to_pool && !is_coinbase(tx))
   {
     currency::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
     added_to_the_pool = m_tx_pool.add_tx(tx, tvc, true, true);
@@ -860,7 +1125,7 @@ bool blockchain_storage::purge_block_data_from_blockchain(const block& b, size_t
   return purge_block_data_from_blockchain(b, processed_tx_count, total_fee, onboard_transactions);
 }
 //------------------------------------------------------------------
-bool blockchain_storage::purge_block_data_from_blockchain(const block& bl, size_t processed_tx_count, uint64_t& fee_total, transactions_map& onboard_transactions)
+bool blockchain_storage::purge_block_data_from_blockchain(const block& bl, size_t processed_tx_count, uint64_t& fee_total, transactions_map& onboard_transactions, bool move_txs_to_pool)
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
   fee_total = 0;
@@ -870,7 +1135,7 @@ bool blockchain_storage::purge_block_data_from_blockchain(const block& bl, size_
   for(size_t count = 0; count != processed_tx_count; count++)
   {
     transaction tx = AUTO_VAL_INIT(tx);
-    res = purge_transaction_from_blockchain(bl.tx_hashes[(processed_tx_count -1)- count], fee, tx) && res;
+    res = purge_transaction_from_blockchain(bl.tx_hashes[(processed_tx_count -1)- count], fee, tx, move_txs_to_pool) && res;
     fee_total += fee;
     onboard_transactions[bl.tx_hashes[(processed_tx_count - 1) - count]] = tx;
   }
@@ -893,9 +1158,9 @@ crypto::hash blockchain_storage::get_top_block_id() const
   crypto::hash id = null_hash;
   if(m_db_blocks.size())
   {
-    auto val_ptr = m_db_blocks.back();
-    CHECK_AND_ASSERT_MES(val_ptr, null_hash, "m_blocks.back() returned null");
-    get_block_hash(val_ptr->bl, id);
+    auto val_ptr = m_db_block_headers.back();
+    CHECK_AND_ASSERT_MES(val_ptr, null_hash, "m_db_block_headers.back() returned null");
+    id = val_ptr->id;
   }
   return id;
 }
@@ -922,7 +1187,7 @@ bool blockchain_storage::get_short_chain_history(std::list<crypto::hash>& ids)co
   bool genesis_included = false;
   while(current_back_offset < sz)
   {
-    ids.push_back(get_block_hash(m_db_blocks[sz-current_back_offset]->bl));
+    ids.push_back(m_db_block_headers[sz-current_back_offset]->id);
     if(sz-current_back_offset == 0)
       genesis_included = true;
     if(i < 10)
@@ -935,7 +1200,7 @@ bool blockchain_storage::get_short_chain_history(std::list<crypto::hash>& ids)co
     ++i;
   }
   if(!genesis_included)
-    ids.push_back(get_block_hash(m_db_blocks[0]->bl));
+    ids.push_back(m_db_block_headers[0]->id);
 
   return true;
 }
@@ -946,7 +1211,17 @@ crypto::hash blockchain_storage::get_block_id_by_height(uint64_t height) const
   if(height >= m_db_blocks.size())
     return null_hash;
 
-  return get_block_hash(m_db_blocks[height]->bl);
+  return m_db_block_headers[height]->id;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::get_block_header_index_entry(uint64_t height, block_header_index_entry& entry) const
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  auto entry_ptr = m_db_block_headers.get(height);
+  if (!entry_ptr)
+    return false;
+  entry = *entry_ptr;
+  return true;
 }
 //------------------------------------------------------------------
 bool blockchain_storage::get_block_by_hash(const crypto::hash &h, block &blk)  const
@@ -1053,6 +1328,9 @@ bool blockchain_storage::rollback_blockchain_switching(std::list<block_ws_txs>&
   {
     block_verification_context bvc = boost::value_initialized<block_verification_context>();
     bvc.m_onboard_transactions.swap(oce.onboard_transactions);
+    // these blocks were in the main chain on top of the same blocks: range proofs have been verified then,
+    // signatures and PoW hashes are taken from m_verified_txs_cache and m_precomputed_pow_hashes
+    bvc.m_range_proofs_preverified = true;
     bool r = handle_block_to_main_chain(oce.b, bvc);
     CHECK_AND_ASSERT_MES(r && bvc.m_added_to_main_chain, false, "PANIC!!! failed to add (again) block while chain switching during the rollback!");
   }
@@ -1099,11 +1377,75 @@ void blockchain_storage::do_erase_altblock(alt_chain_container::iterator it)
 {
   crypto::hash id = get_block_hash(it->second.bl);
   LOG_PRINT_L1("erasing alt block " << print16(id) << " @ " << get_block_height(it->second.bl));
-  purge_altblock_keyimages_from_big_heap(it->second.bl, id);
   purge_alt_block_txs_hashs(it->second.bl);
+  m_alternative_chains_stored_size -= std::min(m_alternative_chains_stored_size, it->second.stored_size);
   m_alternative_chains.erase(it);
 }
 //------------------------------------------------------------------
+size_t blockchain_storage::erase_altblock_with_descendants(const crypto::hash& id, const std::unordered_multimap<crypto::hash, crypto::hash>& children)
+{
+  // a block left without its parent can never connect to the main chain, so the whole subtree goes
+  size_t erased = 0;
+  std::vector<crypto::hash> to_erase(1, id);
+  while (!to_erase.empty())
+  {
+    crypto::hash h = to_erase.back();
+    to_erase.pop_back();
+    auto it = m_alternative_chains.find(h);
+    if (it == m_alternative_chains.end())
+      continue; // already erased
+    auto range = children.equal_range(h);
+    for (auto ch = range.first; ch != range.second; ++ch)
+      to_erase.push_back(ch->second);
+    do_erase_altblock(it);
+    ++erased;
+  }
+  return erased;
+}
+//------------------------------------------------------------------
+void blockchain_storage::rebuild_altblock_keyimages_with_descendants(const crypto::hash& id)
+{
+  // key image sets are made when a block is added, so the ones of blocks that hung off ex-main blocks
+  // don't have the key images of these blocks: make them again, parents go before their children
+  std::unordered_multimap<crypto::hash, crypto::hash> children; // prev id -> alt block id
+  for (const auto& a : m_alternative_chains)
+    children.emplace(a.second.bl.prev_id, a.first);
+
+  std::vector<crypto::hash> to_rebuild(1, id);
+  while (!to_rebuild.empty())
+  {
+    crypto::hash h = to_rebuild.back();
+    to_rebuild.pop_back();
+    auto it = m_alternative_chains.find(h);
+    if (it == m_alternative_chains.end())
+      continue;
+
+    std::unordered_set<crypto::key_image> block_keyimages;
+    const block& b = it->second.bl;
+    if (is_pos_block(b) && b.miner_tx.vin.size() == 2)
+    {
+      crypto::key_image ki = AUTO_VAL_INIT(ki);
+      if (get_key_image_from_txin_v(b.miner_tx.vin[1], ki))
+        block_keyimages.insert(ki);
+    }
+    for (const auto& otx : it->second.onboard_transactions)
+    {
+      for (const auto& in : otx.second.vin)
+      {
+        crypto::key_image ki = AUTO_VAL_INIT(ki);
+        if (get_key_image_from_txin_v(in, ki))
+          block_keyimages.insert(ki);
+      }
+    }
+    auto it_prev = m_alternative_chains.find(b.prev_id);
+    it->second.keyimages = alt_chain_keyimages::make(it_prev != m_alternative_chains.end() ? it_prev->second.keyimages : alt_chain_keyimages::ptr(), std::move(block_keyimages));
+
+    auto range = children.equal_range(h);
+    for (auto ch = range.first; ch != range.second; ++ch)
+      to_rebuild.push_back(ch->second);
+  }
+}
+//------------------------------------------------------------------
 bool blockchain_storage::switch_to_alternative_blockchain(alt_chain_type& alt_chain)
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
@@ -1175,6 +1517,10 @@ bool blockchain_storage::switch_to_alternative_blockchain(alt_chain_type& alt_ch
     }
   }
 
+  //alt blocks that forked off ex-main blocks now have them in their alt chains
+  if (!disconnected_chain.empty())
+    rebuild_altblock_keyimages_with_descendants(get_block_hash(disconnected_chain.front().b));
+
   //removing all_chain entries from alternative chain
   for(auto ch_ent : alt_chain)
   {
@@ -1190,16 +1536,14 @@ void blockchain_storage::collect_timestamps_and_c_difficulties_main(std::vector<
   CRITICAL_REGION_LOCAL(m_read_lock);
   TIME_MEASURE_START_PD(target_calculating_enum_blocks);
   CRITICAL_REGION_BEGIN(m_targetdata_cache_lock);
-  std::list<std::pair<wide_difficulty_type, uint64_t>>& targetdata_cache = pos ? m_pos_targetdata_cache : m_pow_targetdata_cache;
-  //if (targetdata_cache.empty())
-  load_targetdata_cache(pos);
-
-  size_t count = 0;
-  for (auto it = targetdata_cache.rbegin(); it != targetdata_cache.rend() && count < DIFFICULTY_WINDOW; it++)
+  targetdata_window& window = pos ? m_pos_targetdata_window : m_pow_targetdata_window;
+  if (!window.is_valid_for(get_top_block_id()) || !window.collect(m_db_blocks.size(), DIFFICULTY_WINDOW, timestamps, commulative_difficulties))
   {
-    timestamps.push_back(it->second);
-    commulative_difficulties.push_back(it->first);
-    ++count;
+    load_targetdata_cache(pos);
+    timestamps.clear();
+    commulative_difficulties.clear();
+    bool r = window.collect(m_db_blocks.size(), DIFFICULTY_WINDOW, timestamps, commulative_difficulties);
+    CHECK_AND_ASSERT_MES_NO_RET(r, "internal error: targetdata window is incomplete right after loading");
   }
   CRITICAL_REGION_END();
   TIME_MEASURE_FINISH_PD(target_calculating_enum_blocks);
@@ -1244,22 +1588,46 @@ wide_difficulty_type blockchain_storage::get_next_diff_conditional(bool pos) con
 void blockchain_storage::collect_timestamps_and_c_difficulties_alt(std::vector<uint64_t>& timestamps, std::vector<wide_difficulty_type>& commulative_difficulties, bool pos, const alt_chain_type& alt_chain, uint64_t split_height) const 
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
-  size_t count = 0;
 
-  auto cb = [&](const block_extended_info& bei, bool is_main) {
+  // alt chain part, from the head down to the split point
+  for (auto it = alt_chain.rbegin(); it != alt_chain.rend() && timestamps.size() < DIFFICULTY_WINDOW; it++)
+  {
+    const block_extended_info& bei = (*it)->second;
     if (!bei.height)
-      return false;
-    bool is_pos_bl = is_pos_block(bei.bl);
-    if (pos != is_pos_bl)
-      return true;
+      return;
+    if (pos != is_pos_block(bei.bl))
+      continue;
     timestamps.push_back(bei.bl.timestamp);
     commulative_difficulties.push_back(bei.cumulative_diff_precise);
-    ++count;
-    if (count >= DIFFICULTY_WINDOW)
-      return false;
-    return true;
-    };
-  enum_blockchain(cb, alt_chain, split_height);
+  }
+  if (timestamps.size() >= DIFFICULTY_WINDOW || !m_db_blocks.size())
+    return;
+
+  // main chain part, below the split point
+  uint64_t main_chain_start_offset = 0;
+  if (split_height)
+    main_chain_start_offset = split_height - 1;
+  else
+    main_chain_start_offset = (alt_chain.size() ? alt_chain.front()->second.height : m_db_blocks.size()) - 1;
+
+  size_t need = DIFFICULTY_WINDOW - timestamps.size();
+  {
+    CRITICAL_REGION_LOCAL1(m_targetdata_cache_lock);
+    const targetdata_window& window = pos ? m_pos_targetdata_window : m_pow_targetdata_window;
+    if (window.is_valid_for(get_top_block_id()) && window.collect(main_chain_start_offset + 1, need, timestamps, commulative_difficulties))
+      return;
+  }
+
+  // the split point is too deep for the window, use headers index
+  for (uint64_t i = main_chain_start_offset; i != 0 && need != 0; --i)
+  {
+    auto header_ptr = m_db_block_headers[i];
+    if (pos != header_ptr->is_pos())
+      continue;
+    timestamps.push_back(header_ptr->timestamp);
+    commulative_difficulties.push_back(header_ptr->get_cumulative_diff_precise());
+    --need;
+  }
 }
 //------------------------------------------------------------------
 wide_difficulty_type blockchain_storage::get_next_diff_conditional_alt(bool pos, const alt_chain_type& alt_chain, uint64_t split_height, const alt_block_extended_info& abei) const
@@ -1324,12 +1692,12 @@ wide_difficulty_type blockchain_storage::get_next_difficulty_for_alternative_cha
 
   for (uint64_t i = main_chain_start_offset; i != 0 && timestamps.size() < DIFFICULTY_BLOCKS_COUNT; --i)
   {
-    bool is_pos_bl = is_pos_block(m_db_blocks[i]->bl);
-    if (pos != is_pos_bl)
+    auto header_ptr = m_db_block_headers[i];
+    if (pos != header_ptr->is_pos())
       continue;
 
-    timestamps.push_back(m_db_blocks[i]->bl.timestamp);
-    commulative_difficulties.push_back(m_db_blocks[i]->cumulative_diff_precise);
+    timestamps.push_back(header_ptr->timestamp);
+    commulative_difficulties.push_back(header_ptr->get_cumulative_diff_precise());
   } 
 
   return next_difficulty_1(timestamps, commulative_difficulties, pos ? DIFFICULTY_POS_TARGET:DIFFICULTY_POW_TARGET, pos ? global_difficulty_pos_starter : global_difficulty_pow_starter);
@@ -1338,7 +1706,7 @@ wide_difficulty_type blockchain_storage::get_next_difficulty_for_alternative_cha
 bool blockchain_storage::prevalidate_miner_transaction(const block& b, uint64_t height, bool pos) const
 {
   CHECK_AND_ASSERT_MES((pos ? (b.miner_tx.vin.size() == 2) : (b.miner_tx.vin.size() == 1)), false, "coinbase transaction in the block has incorrect inputs number: " << b.miner_tx.vin.size());
-  CHECK_AND_ASSERT_MES(b.miner_tx.vin[0].type() == typeid(txin_gen), false, "input #0 of the coinbase transaction in the block has the wrong type : " << b.miner_tx.vin[0].type().name());
+  CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_gen>(b.miner_tx.vin[0]), false, "input #0 of the coinbase transaction in the block has the wrong type : " << b.miner_tx.vin[0].type().name());
   if(boost::get<txin_gen>(b.miner_tx.vin[0]).height != height)
   {
     LOG_PRINT_RED_L0("The miner transaction in block has invalid height: " << boost::get<txin_gen>(b.miner_tx.vin[0]).height << ", expected: " << height);
@@ -1347,9 +1715,9 @@ bool blockchain_storage::prevalidate_miner_transaction(const block& b, uint64_t
   if (pos)
   {
     if (is_hardfork_active_for_height(ZANO_HARDFORK_04_ZARCANUM, height)) // TODO @#@# consider moving to validate_tx_for_hardfork_specific_terms
-      CHECK_AND_ASSERT_MES(b.miner_tx.vin[1].type() == typeid(txin_zc_input), false, "coinstake tx has incorrect type of input #1: " << b.miner_tx.vin[1].type().name());
+      CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_zc_input>(b.miner_tx.vin[1]), false, "coinstake tx has incorrect type of input #1: " << b.miner_tx.vin[1].type().name());
     else
-      CHECK_AND_ASSERT_MES(b.miner_tx.vin[1].type() == typeid(txin_to_key), false, "coinstake tx has incorrect type of input #1: " << b.miner_tx.vin[1].type().name());
+      CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_to_key>(b.miner_tx.vin[1]), false, "coinstake tx has incorrect type of input #1: " << b.miner_tx.vin[1].type().name());
   }
 
   if (is_hardfork_active_for_height(ZANO_HARDFORK_01, height))
@@ -1379,9 +1747,9 @@ bool blockchain_storage::prevalidate_miner_transaction(const block& b, uint64_t
   {
     CHECK_AND_ASSERT_MES(b.miner_tx.attachment.empty(), false, "coinbase transaction has attachments; attachments are not allowed for coinbase transactions.");
     CHECK_AND_ASSERT_MES(b.miner_tx.proofs.size() == 3, false, "coinbase transaction has incorrect number of proofs (" << b.miner_tx.proofs.size() << "), expected 3");
-    CHECK_AND_ASSERT_MES(b.miner_tx.proofs[0].type() == typeid(zc_asset_surjection_proof), false, "coinbase transaction has incorrect type of proof #0 (expected: zc_asset_surjection_proof)");
-    CHECK_AND_ASSERT_MES(b.miner_tx.proofs[1].type() == typeid(zc_outs_range_proof), false, "coinbase transaction has incorrect type of proof #1 (expected: zc_outs_range_proof)");
-    CHECK_AND_ASSERT_MES(b.miner_tx.proofs[2].type() == typeid(zc_balance_proof), false, "coinbase transaction has incorrect type of proof #2 (expected: zc_balance_proof)");
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<zc_asset_surjection_proof>(b.miner_tx.proofs[0]), false, "coinbase transaction has incorrect type of proof #0 (expected: zc_asset_surjection_proof)");
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<zc_outs_range_proof>(b.miner_tx.proofs[1]), false, "coinbase transaction has incorrect type of proof #1 (expected: zc_outs_range_proof)");
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<zc_balance_proof>(b.miner_tx.proofs[2]), false, "coinbase transaction has incorrect type of proof #2 (expected: zc_balance_proof)");
   }
   else
   {
@@ -1402,9 +1770,11 @@ bool blockchain_storage::calculate_block_reward_for_next_top_block(size_t next_b
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
 
-  std::vector<size_t> last_blocks_sizes;
-  get_last_n_blocks_sizes(last_blocks_sizes, CURRENCY_REWARD_BLOCKS_WINDOW);
-  size_t blocks_size_median = misc_utils::median(last_blocks_sizes);
+  size_t blocks_size_median = 0;
+  {
+    CRITICAL_REGION_LOCAL1(m_median_windows_lock);
+    blocks_size_median = get_actual_median_window(m_block_sizes_median_window).get_median();
+  }
   LOG_PRINT_MAGENTA("blocks_size_median = " << blocks_size_median, LOG_LEVEL_2);
   block_reward_without_fee = get_block_reward(get_top_block_height() + 1, blocks_size_median, next_block_cumulative_size);
   CHECK_AND_ASSERT_MES(block_reward_without_fee != 0, false, "block size " << next_block_cumulative_size << " is bigger than allowed for this blockchain, blocks_size_median: " << blocks_size_median);
@@ -1452,7 +1822,7 @@ bool blockchain_storage::get_backward_blocks_sizes(size_t from_height, std::vect
 
   size_t start_offset = (from_height+1) - std::min((from_height+1), count);
   for(size_t i = start_offset; i != from_height+1; i++)
-    sz.push_back(m_db_blocks[i]->block_cumulative_size);
+    sz.push_back(m_db_block_headers[i]->block_cumulative_size);
 
   return true;
 }
@@ -1510,25 +1880,61 @@ bool blockchain_storage::create_block_template(const account_public_address& min
 }
 
 bool blockchain_storage::create_block_template(const create_block_template_params& params, create_block_template_response& resp) const
+{
+  block_template_base base = AUTO_VAL_INIT(base);
+  if (!create_block_template_base(params.pos, params.pcustom_fill_block_template_func, params.explicit_txs, base))
+    return false;
+  return create_block_template(params, base, resp);
+}
+//------------------------------------------------------------------
+bool blockchain_storage::create_block_template_base(bool pos, fill_block_template_func_t* pcustom_fill_block_template_func, const std::list<transaction>& explicit_txs, block_template_base& base) const
+{
+  base.pos = pos;
+  base.pool_version = m_tx_pool.get_pool_version();
+
+  CRITICAL_REGION_BEGIN(m_read_lock);
+  base.height = m_db_blocks.size();
+  base.major_version = m_core_runtime_config.hard_forks.get_block_major_version_by_height(base.height);
+  base.prev_id = get_top_block_id();
+
+  base.diffic = get_next_diff_conditional(pos);
+  CHECK_AND_ASSERT_MES(base.diffic, false, "difficulty owverhead.");
+
+  base.median_size = m_db_current_block_cumul_sz_limit / 2;
+  base.already_generated_coins = m_db_blocks.back()->already_generated_coins;
+  CRITICAL_REGION_END();
+
+  block b = AUTO_VAL_INIT(b);
+  base.txs_size = 0;
+  base.txs_fee = 0;
+  bool block_filled = false;
+  if (pcustom_fill_block_template_func == nullptr)
+    block_filled = m_tx_pool.fill_block_template(b, pos, base.median_size, base.already_generated_coins, base.txs_size, base.txs_fee, base.height, explicit_txs);
+  else
+    block_filled = (*pcustom_fill_block_template_func)(b, pos, base.median_size, base.already_generated_coins, base.txs_size, base.txs_fee, base.height);
+
+  if (!block_filled)
+    return false;
+
+  base.tx_hashes.swap(b.tx_hashes);
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::create_block_template(const create_block_template_params& params, const block_template_base& base, create_block_template_response& resp) const
 {
   const account_public_address& miner_address = params.miner_address; 
   const account_public_address& stakeholder_address = params.stakeholder_address;
   const blobdata& ex_nonce = params.ex_nonce;
-  bool pos = params.pos;
+  bool pos = base.pos;
   pos_entry pe = params.pe; 
-
-  fill_block_template_func_t* pcustom_fill_block_template_func = params.pcustom_fill_block_template_func;
+  CHECK_AND_ASSERT_MES(params.pos == base.pos, false, "template base was prepared for " << (base.pos ? "PoS" : "PoW") << " block");
 
   uint64_t& height = resp.height;
   block& b = resp.b;
-  wide_difficulty_type& diffic = resp.diffic;
-
 
-  size_t median_size;
-  boost::multiprecision::uint128_t already_generated_coins;
-  CRITICAL_REGION_BEGIN(m_read_lock);
   if (pe.g_index == WALLET_GLOBAL_OUTPUT_INDEX_UNDEFINED)
   {
+    CRITICAL_REGION_LOCAL(m_read_lock);
     std::vector<uint64_t> indexs;
     if (!get_tx_outputs_gindexs(pe.tx_id, indexs) || pe.tx_out_index >= indexs.size())
     {
@@ -1536,13 +1942,11 @@ bool blockchain_storage::create_block_template(const create_block_template_param
     }
     pe.g_index = indexs[pe.tx_out_index];
   }
-  
-
-  height = m_db_blocks.size();
-  b.major_version = m_core_runtime_config.hard_forks.get_block_major_version_by_height(height);
 
+  height = base.height;
+  b.major_version = base.major_version;
   b.minor_version = CURRENT_BLOCK_MINOR_VERSION;
-  b.prev_id = get_top_block_id();
+  b.prev_id = base.prev_id;
   b.timestamp = m_core_runtime_config.get_core_time();
   b.nonce = 0;
   b.flags = 0;
@@ -1551,39 +1955,17 @@ bool blockchain_storage::create_block_template(const create_block_template_param
     b.flags |= CURRENCY_BLOCK_FLAG_POS_BLOCK;
     b.timestamp = 0;
   }
-
-  diffic = get_next_diff_conditional(pos);
-
-  CHECK_AND_ASSERT_MES(diffic, false, "difficulty owverhead.");
-
-
-  
-
-  median_size = m_db_current_block_cumul_sz_limit / 2;
-  already_generated_coins = m_db_blocks.back()->already_generated_coins;
-
-  CRITICAL_REGION_END();
-
-  size_t txs_size = 0;
-  uint64_t fee = 0;
-  bool block_filled = false;
-  if (pcustom_fill_block_template_func == nullptr)
-    block_filled = m_tx_pool.fill_block_template(b, pos, median_size, already_generated_coins, txs_size, fee, height, params.explicit_txs);
-  else
-    block_filled = (*pcustom_fill_block_template_func)(b, pos, median_size, already_generated_coins, txs_size, fee, height);
-
-  if (!block_filled)
-    return false;
-
-  resp.txs_fee = fee;
+  resp.diffic = base.diffic;
+  b.tx_hashes = base.tx_hashes;
+  resp.txs_fee = base.txs_fee;
 
   /* 
       instead of complicated two-phase template construction and adjustment of cumulative size with block reward we
       use CURRENCY_COINBASE_BLOB_RESERVED_SIZE as penalty-free coinbase transaction reservation.
   */
-  bool r = construct_miner_tx(height, median_size, already_generated_coins,  
-                                                   txs_size, 
-                                                   fee, 
+  bool r = construct_miner_tx(height, base.median_size, base.already_generated_coins,  
+                                                   base.txs_size, 
+                                                   base.txs_fee, 
                                                    miner_address, 
                                                    stakeholder_address,
                                                    b.miner_tx,
@@ -1636,23 +2018,130 @@ bool blockchain_storage::print_transactions_statistics() const
 void blockchain_storage::reset_db_cache() const
 {
   m_db_blocks.clear_cache();
+  m_db_block_headers.clear_cache();
+  m_db_blocks_max_timestamps.clear_cache();
   m_db_blocks_index.clear_cache();
   m_db_transactions.clear_cache();
   m_db_spent_keys.clear_cache();
   m_db_solo_options.clear_cache();
   m_db_multisig_outs.clear_cache();
   m_db_aliases.clear_cache();
+  ++m_aliases_version; // a secondary instance doesn't see which aliases the primary has changed
   m_db_assets.clear_cache();
+  {
+    CRITICAL_REGION_LOCAL(m_assets_index_lock);
+    m_assets_index_valid = false;
+  }
   m_db_addr_to_alias.clear_cache();
 
 }
 //------------------------------------------------------------------
+static uint64_t get_folder_files_size(const std::string& folder)
+{
+  uint64_t total = 0;
+  boost::system::error_code ec;
+  for (boost::filesystem::directory_iterator it(epee::string_encoding::utf8_to_wstring(folder), ec), end; !ec && it != end; it.increment(ec))
+  {
+    if (boost::filesystem::is_regular_file(it->status()))
+      total += boost::filesystem::file_size(it->path(), ec);
+  }
+  return total;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::compact_db(uint64_t& size_before, uint64_t& size_after)
+{
+  CHECK_AND_ASSERT_MES(!m_is_secondary, false, "DB compaction can be done only by the primary instance");
+  bool expected = false;
+  CHECK_AND_ASSERT_MES(m_is_db_compacting.compare_exchange_strong(expected, true), false, "DB compaction is already in progress");
+  auto compaction_flag_reset = epee::misc_utils::create_scope_leave_handler([&]() { m_is_db_compacting = false; });
+
+  std::shared_ptr<tools::db::i_db_backend> backend = m_db.get_backend();
+  const std::string compacted_folder = m_db_folder_path + BLOCKCHAIN_DB_COMPACTION_FOLDER_SUFFIX;
+  const std::wstring compacted_folder_w = epee::string_encoding::utf8_to_wstring(compacted_folder);
+  size_before = get_folder_files_size(m_db_folder_path);
+  size_after = size_before;
+
+  boost::system::error_code ec;
+  boost::filesystem::space_info si = boost::filesystem::space(epee::string_encoding::utf8_to_wstring(m_db_folder_path), ec);
+  CHECK_AND_ASSERT_MES(ec || si.available > size_before, false, "Not enough free disk space for DB compaction: " << si.available << " bytes available, up to " << size_before << " needed");
+
+  // The live data is copied into a fresh file with no locks held, so the daemon keeps working meanwhile. Writes committed during
+  // the copy can't be replayed into it, so the copy is swapped in only if nothing has been committed since it was started,
+  // otherwise it's made again (the next attempt is usually much shorter as the source pages are hot in the OS cache).
+  for (size_t attempt = 1; attempt <= BLOCKCHAIN_DB_COMPACTION_MAX_ATTEMPTS; ++attempt)
+  {
+    boost::filesystem::remove_all(compacted_folder_w, ec);
+    tools::db::stat_info si_before = AUTO_VAL_INIT(si_before);
+    backend->get_stat_info(si_before);
+
+    LOG_PRINT_L0("DB compaction: copying " << m_db_folder_path << " (" << size_before << " bytes) to " << compacted_folder << ", attempt " << attempt << "...");
+    TIME_MEASURE_START_MS(copy_time);
+    if (!backend->copy_compacted(compacted_folder))
+    {
+      LOG_ERROR("DB compaction failed: unable to make a compacted copy (" << backend->name() << " backend)");
+      boost::filesystem::remove_all(compacted_folder_w, ec);
+      return false;
+    }
+    TIME_MEASURE_FINISH_MS(copy_time);
+
+    bool replaced = false;
+    TIME_MEASURE_START_MS(pause_time);
+    {
+      CRITICAL_REGION_LOCAL(m_rw_lock); // exclusive: waits for all readers and writers to leave, this is the only pause
+      tools::db::stat_info si_now = AUTO_VAL_INIT(si_now);
+      backend->get_stat_info(si_now);
+      if (si_now.last_tx_id == si_before.last_tx_id && si_now.tx_count == 0)
+        replaced = backend->replace_storage(compacted_folder);
+    }
+    TIME_MEASURE_FINISH_MS(pause_time);
+
+    if (replaced)
+    {
+      boost::filesystem::remove_all(compacted_folder_w, ec);
+      size_after = get_folder_files_size(m_db_folder_path);
+      LOG_PRINT_GREEN("DB compaction finished: " << size_before << " -> " << size_after << " bytes, copying took " << copy_time << " ms, writes were paused for " << pause_time << " ms", LOG_LEVEL_0);
+      return true;
+    }
+    LOG_PRINT_L0("DB compaction: the DB was modified during copying (or is busy), retrying");
+  }
+
+  boost::filesystem::remove_all(compacted_folder_w, ec);
+  LOG_ERROR("DB compaction failed: the DB kept changing during " << BLOCKCHAIN_DB_COMPACTION_MAX_ATTEMPTS << " attempts, try again when the node is less busy (e.g. after synchronization)");
+  return false;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::follow_primary()
+{
+  if (!m_is_secondary)
+    return false;
+
+  // last committed tx id is read from the shared meta pages, i.e. it's a cheap check
+  tools::db::stat_info si = AUTO_VAL_INIT(si);
+  m_db.get_backend()->get_stat_info(si);
+  if (si.last_tx_id == m_secondary_last_tx_id)
+    return false;
+
+  uint64_t prev_top_height = 0, top_height = 0;
+  {
+    CRITICAL_REGION_LOCAL(m_rw_lock); // exclusive: readers must not mix cached and fresh data
+    prev_top_height = get_top_block_height();
+    reset_db_cache();
+    invalidate_stat_windows();
+    m_secondary_last_tx_id = si.last_tx_id;
+    top_height = get_top_block_height();
+  }
+  LOG_PRINT_L1("Secondary instance: primary's db has changed (tx id " << si.last_tx_id << "), top block " << prev_top_height << " -> " << top_height);
+  rise_core_event(CORE_EVENT_BLOCK_ADDED, void_struct());
+  m_change_notifier.notify();
+  return true;
+}
+//------------------------------------------------------------------
 void blockchain_storage::clear_altblocks()
 {
   CRITICAL_REGION_LOCAL(m_alternative_chains_lock);
   m_alternative_chains.clear();
+  m_alternative_chains_stored_size = 0;
   m_alternative_chains_txs.clear();
-  m_altblocks_keyimages.clear();
 }
 //------------------------------------------------------------------
 bool blockchain_storage::complete_timestamps_vector(uint64_t start_top_height, std::vector<uint64_t>& timestamps)
@@ -1667,7 +2156,7 @@ bool blockchain_storage::complete_timestamps_vector(uint64_t start_top_height, s
   size_t stop_offset = start_top_height > need_elements ? start_top_height - need_elements:0;
   do
   {
-    timestamps.push_back(m_db_blocks[start_top_height]->bl.timestamp);
+    timestamps.push_back(m_db_block_headers[start_top_height]->timestamp);
     if(start_top_height == 0)
       break;
     --start_top_height;
@@ -1684,72 +2173,11 @@ std::string blockchain_storage::print_alt_chain(alt_chain_type alt_chain)
   }
   return ss.str();
 }
-//------------------------------------------------------------------
-bool blockchain_storage::append_altblock_keyimages_to_big_heap(const crypto::hash& block_id, const std::unordered_set<crypto::key_image>& alt_block_keyimages)
-{
-  for (auto& ki : alt_block_keyimages)
-    m_altblocks_keyimages[ki].push_back(block_id);
-  
-  return true;
-}
-//------------------------------------------------------------------
-bool blockchain_storage::purge_keyimage_from_big_heap(const crypto::key_image& ki, const crypto::hash& id)
-{
-  auto it = m_altblocks_keyimages.find(ki);
-  CHECK_AND_ASSERT_MES(it != m_altblocks_keyimages.end(), false, "internal error: keyimage " << ki 
-    << "from altblock " << id << "not found in m_altblocks_keyimages in purge_keyimage_from_big_heap");
-  
-  //TODO: at the moment here is simple liner algo since having the same txs in few altblocks is rare case
-  std::list<crypto::hash>& ki_blocks_ids = it->second;
-  bool found = false;
-  for (auto it_in_blocks = ki_blocks_ids.begin(); it_in_blocks != ki_blocks_ids.end(); it_in_blocks++)
-  {
-    if (*it_in_blocks == id)
-    {
-      //found, erase this entry
-      ki_blocks_ids.erase(it_in_blocks);
-      found = true;
-      break;
-    }
-  }
-  CHECK_AND_ASSERT_MES(found, false, "internal error: keyimage " << ki
-    << "from altblock " << id << "not found in m_altblocks_keyimages in purge_keyimage_from_big_heap");
-  if (!ki_blocks_ids.size())
-    m_altblocks_keyimages.erase(it);
-  return true;
-}
-//------------------------------------------------------------------
-bool blockchain_storage::purge_altblock_keyimages_from_big_heap(const block& b, const crypto::hash& block_id)
-{
-  if (is_pos_block(b))
-  {
-    CHECK_AND_ASSERT_MES(b.miner_tx.vin.size() == 2, false, "paranoid check failed");
-    crypto::key_image ki{};
-    CHECK_AND_ASSERT_MES(get_key_image_from_txin_v(b.miner_tx.vin[1], ki), false, "cannot get key image from input #1");
-    purge_keyimage_from_big_heap(ki, block_id);
-  }
-  for (auto tx_id : b.tx_hashes)
-  {
-    std::shared_ptr<transaction> tx_ptr;
-    if (!get_transaction_from_pool_or_db(tx_id, tx_ptr))
-    {
-      continue;
-    }
-    transaction& tx = *tx_ptr;
-    for (size_t n = 0; n < tx.vin.size(); ++n)
-    {
-      crypto::key_image ki = AUTO_VAL_INIT(ki);
-      if (get_key_image_from_txin_v(tx.vin[n], ki))
-        purge_keyimage_from_big_heap(ki, block_id);
-    }
-  }
-  return true;
-}
-
 //------------------------------------------------------------------
 bool blockchain_storage::handle_alternative_block(const block& b, const crypto::hash& id, block_verification_context& bvc)
 {
   uint64_t coinbase_height = get_block_height(b);
+  TRACE_SCOPE_ARG("block", "handle_alternative_block", coinbase_height);
   if (m_checkpoints.is_height_passed_zone(coinbase_height, get_top_block_height()))
   {
     LOG_PRINT_RED_L0("Block with id: " << id << "[" << coinbase_height << "]" << ENDL << " for alternative chain, is under checkpoint zone, declined");
@@ -1776,20 +2204,13 @@ bool blockchain_storage::handle_alternative_block(const block& b, const crypto::
       //build alternative subchain, front -> mainchain, back -> alternative head
       alt_chain_container::iterator alt_it = it_prev; //m_alternative_chains.find()
       std::vector<uint64_t> timestamps;
-      std::list<alt_chain_container::iterator> temp_container;
       while (alt_it != m_alternative_chains.end())
       {
-        temp_container.push_front(alt_it);
+        alt_chain.push_back(alt_it);
         timestamps.push_back(alt_it->second.bl.timestamp);
         alt_it = m_alternative_chains.find(alt_it->second.bl.prev_id);
       }
-      //TODO: refactoring needed: vector push_front is dramatically ineffective
-      alt_chain.resize(temp_container.size());
-      auto it_vec = alt_chain.begin();
-      for (auto it = temp_container.begin(); it != temp_container.end();it++, it_vec++)
-      {
-        *it_vec = *it;
-      }
+      std::reverse(alt_chain.begin(), alt_chain.end());
 
 
       if (alt_chain.size())
@@ -1802,8 +2223,7 @@ bool blockchain_storage::handle_alternative_block(const block& b, const crypto::
           << " main chain: " << ENDL << get_blockchain_string(m_db_blocks.size() - 10, CURRENCY_MAX_BLOCK_NUMBER)
         );
 
-        crypto::hash h = null_hash;
-        get_block_hash(m_db_blocks[alt_chain.front()->second.height - 1]->bl, h);
+        crypto::hash h = m_db_block_headers[alt_chain.front()->second.height - 1]->id;
         CHECK_AND_ASSERT_MES_CUSTOM(h == alt_chain.front()->second.bl.prev_id, false, bvc.m_verification_failed = true, "alternative chain have wrong connection to main chain");
         complete_timestamps_vector(alt_chain.front()->second.height - 1, timestamps);
       }
@@ -1904,7 +2324,11 @@ bool blockchain_storage::handle_alternative_block(const block& b, const crypto::
     }
     else
     {
-      proof_of_work = get_block_longhash(abei.bl);
+      if (!m_precomputed_pow_hashes.get(id, proof_of_work))
+      {
+        proof_of_work = get_block_longhash(abei.bl);
+        m_precomputed_pow_hashes.set(id, proof_of_work); // needed again if the alt chain becomes the main one
+      }
 
       if (!check_hash(proof_of_work, current_diff))
       {
@@ -1929,6 +2353,7 @@ bool blockchain_storage::handle_alternative_block(const block& b, const crypto::
       bvc.m_verification_failed = true;
       return false;
     }
+    abei.keyimages = alt_chain_keyimages::make(alt_chain.size() ? alt_chain.back()->second.keyimages : alt_chain_keyimages::ptr(), std::move(alt_block_keyimages));
     
     if (pos_block)
       cumulative_diff_delta = get_adjusted_cumulative_difficulty_for_next_alt_pos(alt_chain, abei.height, current_diff, connection_height);
@@ -1961,25 +2386,29 @@ bool blockchain_storage::handle_alternative_block(const block& b, const crypto::
     auto i_dres = m_alternative_chains.find(id);
     CHECK_AND_ASSERT_MES_CUSTOM(i_dres == m_alternative_chains.end(), false, bvc.m_verification_failed = true, "insertion of new alternative block " << id << " returned as it already exist");
 #endif
-    auto i_res = m_alternative_chains.insert(alt_chain_container::value_type(id, abei));
+    abei.stored_size = get_object_blobsize(abei.bl);
+    for (const auto& otx : abei.onboard_transactions)
+      abei.stored_size += get_object_blobsize(otx.second);
+    auto i_res = m_alternative_chains.insert(alt_chain_container::value_type(id, std::move(abei)));
     CHECK_AND_ASSERT_MES_CUSTOM(i_res.second, false, bvc.m_verification_failed = true, "insertion of new alternative block " << id << " returned as it already exist");
-    append_altblock_keyimages_to_big_heap(id, alt_block_keyimages);
     add_alt_block_txs_hashs(i_res.first->second.bl);
+    m_alternative_chains_stored_size += i_res.first->second.stored_size;
     alt_chain.push_back(i_res.first);
+    const alt_block_extended_info& abei_stored = i_res.first->second; // abei has been moved
     //check if difficulty bigger then in main chain
 
-    bvc.m_height_difference = get_top_block_height() >= abei.height ? get_top_block_height() - abei.height : 0;
+    bvc.m_height_difference = get_top_block_height() >= abei_stored.height ? get_top_block_height() - abei_stored.height : 0;
 
     crypto::hash proof = null_hash;
     std::stringstream ss_pow_pos_info;
     if (pos_block)
     {
-      ss_pow_pos_info << "PoS:\t" << abei.stake_hash << ", stake amount: ";
-      if (abei.bl.miner_tx.version >= TRANSACTION_VERSION_POST_HF4)
+      ss_pow_pos_info << "PoS:\t" << abei_stored.stake_hash << ", stake amount: ";
+      if (abei_stored.bl.miner_tx.version >= TRANSACTION_VERSION_POST_HF4)
         ss_pow_pos_info << "hidden";
       else
         ss_pow_pos_info << print_money_brief(pos_amount) << ", final_difficulty: " << pos_diff_final;
-      proof = abei.stake_hash;
+      proof = abei_stored.stake_hash;
     }
     else
     {
@@ -1987,11 +2416,11 @@ bool blockchain_storage::handle_alternative_block(const block& b, const crypto::
       proof = proof_of_work;
     }
         
-    LOG_PRINT_BLUE("----- BLOCK ADDED AS ALTERNATIVE ON HEIGHT " << abei.height << (pos_block ? " [PoS] Sq: " : " [PoW] Sq: ") << sequence_factor << ", altchain sz: " << alt_chain.size() << ", split h: " << connection_height
+    LOG_PRINT_BLUE("----- BLOCK ADDED AS ALTERNATIVE ON HEIGHT " << abei_stored.height << (pos_block ? " [PoS] Sq: " : " [PoW] Sq: ") << sequence_factor << ", altchain sz: " << alt_chain.size() << ", split h: " << connection_height
       << ENDL << "id:\t" << id
-      << ENDL << "prev\t" << abei.bl.prev_id
+      << ENDL << "prev\t" << abei_stored.bl.prev_id
       << ENDL << ss_pow_pos_info.str()
-      << ENDL << "HEIGHT " << abei.height << ", difficulty: " << abei.difficulty << ", cumul_diff_precise: " << abei.cumulative_diff_precise << ", cumul_diff_adj: " << abei.cumulative_diff_adjusted << ", txs: " << abei.bl.tx_hashes.size() << " (current mainchain cumul_diff_adj: " << m_db_blocks.back()->cumulative_diff_adjusted << ", total ki lookups: " << ki_lookup_total <<")"
+      << ENDL << "HEIGHT " << abei_stored.height << ", difficulty: " << abei_stored.difficulty << ", cumul_diff_precise: " << abei_stored.cumulative_diff_precise << ", cumul_diff_adj: " << abei_stored.cumulative_diff_adjusted << ", txs: " << abei_stored.bl.tx_hashes.size() << " (current mainchain cumul_diff_adj: " << m_db_blocks.back()->cumulative_diff_adjusted << ", total ki lookups: " << ki_lookup_total <<")"
       , LOG_LEVEL_0);
 
     if (is_reorganize_required(*m_db_blocks.back(), alt_chain, proof))
@@ -2001,7 +2430,7 @@ bool blockchain_storage::handle_alternative_block(const block& b, const crypto::
       m_is_reorganize_in_process = true;
       //do reorganize!
       LOG_PRINT_GREEN("###### REORGANIZE on height: " << alt_chain.front()->second.height << " of " << m_db_blocks.size() - 1 << " with cumulative_diff_adjusted " << m_db_blocks.back()->cumulative_diff_adjusted
-        << ENDL << " alternative blockchain size: " << alt_chain.size() << " with cumulative_diff_adjusted " << abei.cumulative_diff_adjusted, LOG_LEVEL_0);
+        << ENDL << " alternative blockchain size: " << alt_chain.size() << " with cumulative_diff_adjusted " << abei_stored.cumulative_diff_adjusted, LOG_LEVEL_0);
       bool r = switch_to_alternative_blockchain(alt_chain);
       if(r) 
         bvc.m_added_to_main_chain = true;
@@ -2012,7 +2441,7 @@ bool blockchain_storage::handle_alternative_block(const block& b, const crypto::
     bvc.m_added_to_altchain = true;
 
     //protect ourself from altchains container flood
-    if (m_alternative_chains.size() > m_core_runtime_config.max_alt_blocks)
+    if (m_alternative_chains.size() > m_core_runtime_config.max_alt_blocks || m_alternative_chains_stored_size > m_core_runtime_config.max_alt_blocks_stored_size)
       prune_aged_alt_blocks();
 
     return true;
@@ -2218,9 +2647,10 @@ bool blockchain_storage::pre_validate_relayed_block(block& bl, block_verificatio
         << "	: " << proof_hash << ENDL
         << "unexpected difficulty: " << current_diffic);
       bvc.m_verification_failed = true;
-      bvc.m_added_to_main_chain = true;
       return false;
     }
+    add_precomputed_pow_hash(id, proof_hash); // spares recalculating it on the full check
+    bvc.m_added_to_main_chain = true;
   }
   return true;
 }
@@ -2263,30 +2693,51 @@ bool blockchain_storage::get_tx_rpc_details(const crypto::hash& h, tx_rpc_extend
 //------------------------------------------------------------------
 bool blockchain_storage::search_by_id(const crypto::hash& id, std::list<std::string>& res) const
 {
-  auto block_ptr = m_db_blocks_index.get(id);
-  if (block_ptr)
+  // blocks, txs and multisig outs share one filter, key images have their own, so most ids miss the db entirely
+  bool maybe_in_ids = true;
+  bool maybe_key_image = true;
+  if (!m_is_secondary)
   {
-    res.push_back("block");
+    if (!m_ids_filter_ready)
+      init_ids_filter();
+    maybe_in_ids = m_ids_filter.may_contain(id);
+    maybe_key_image = is_key_image_maybe_spent(*reinterpret_cast<const crypto::key_image*>(&id));
   }
 
-  auto tx_ptr = m_db_transactions.get(id);
-  if (tx_ptr)
+  if (maybe_in_ids)
   {
-    res.push_back("tx");
+    auto block_ptr = m_db_blocks_index.get(id);
+    if (block_ptr)
+    {
+      res.push_back("block");
+    }
+
+    auto tx_ptr = m_db_transactions.get(id);
+    if (tx_ptr)
+    {
+      res.push_back("tx");
+    }
   }
 
-  auto ki_ptr = m_db_spent_keys.get( *reinterpret_cast<const crypto::key_image*>(&id));
-  if (ki_ptr)
+  if (maybe_key_image)
   {
-    res.push_back("key_image");
+    auto ki_ptr = m_db_spent_keys.get( *reinterpret_cast<const crypto::key_image*>(&id));
+    if (ki_ptr)
+    {
+      res.push_back("key_image");
+    }
   }
 
-  auto ms_ptr = m_db_multisig_outs.get(id);
-  if (ms_ptr)
+  if (maybe_in_ids)
   {
-    res.push_back(std::string("multisig_id:") + epee::string_tools::pod_to_hex(ms_ptr->tx_id) + ":" + std::to_string(ms_ptr->out_no));
+    auto ms_ptr = m_db_multisig_outs.get(id);
+    if (ms_ptr)
+    {
+      res.push_back(std::string("multisig_id:") + epee::string_tools::pod_to_hex(ms_ptr->tx_id) + ":" + std::to_string(ms_ptr->out_no));
+    }
   }
 
+  CRITICAL_REGION_LOCAL(m_alternative_chains_lock);
   if (m_alternative_chains.end() != m_alternative_chains.find(id))
   {
     res.push_back("alt_block");
@@ -2476,25 +2927,59 @@ bool blockchain_storage::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request&
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
   rsp.current_blockchain_height = get_current_blockchain_size();
-  std::list<block> blocks;
-  get_blocks(arg.blocks, blocks, rsp.missed_ids);
+  // blocks above the checkpoints zone which txs have been pruned can't be validated by the peer, so they are reported as missed
+  uint64_t top_checkpoint_height = m_checkpoints.get_top_checkpoint_height();
+  bool has_pruned_blocks = false;
 
-  BOOST_FOREACH(const auto& bl, blocks)
+  for (const auto& id : arg.blocks)
   {
-    std::list<transaction> txs;
-    get_transactions(bl.tx_hashes, txs, rsp.missed_ids);
+    auto block_ind_ptr = m_db_blocks_index.find(id);
+    if (!block_ind_ptr)
+    {
+      rsp.missed_ids.push_back(id);
+      continue;
+    }
+
+    std::shared_ptr<const block_complete_entry> e_ptr;
+    if (m_block_blobs_cache.get(id, e_ptr))
+    {
+      if (!has_pruned_blocks)
+        rsp.blocks.push_back(*e_ptr);
+      continue;
+    }
 
-    CHECK_AND_ASSERT_MES(!rsp.missed_ids.size(), false, "Host have requested block with missed transactions missed_tx_id.size()=" << rsp.missed_ids.size()
-      << ENDL << "for block id = " << get_block_hash(bl));
-   rsp.blocks.push_back(block_complete_entry());
-   block_complete_entry& e = rsp.blocks.back();
-   //pack block
-   e.block = t_serializable_object_to_blob(bl);
-   //pack transactions
-   BOOST_FOREACH(transaction& tx, txs)
-     e.txs.push_back(t_serializable_object_to_blob(tx));
+    CHECK_AND_ASSERT_MES(*block_ind_ptr < m_db_blocks.size(), false, "Internal error: bl_id=" << id
+      << " have index record with offset=" << *block_ind_ptr << ", bigger then m_db_blocks.size()=" << m_db_blocks.size());
+    const block& bl = m_db_blocks[*block_ind_ptr]->bl;
+    if (m_prune_depth != 0 && *block_ind_ptr > top_checkpoint_height && *block_ind_ptr <= m_db_current_pruned_rs_height)
+    {
+      rsp.missed_ids.push_back(id);
+      has_pruned_blocks = true;
+      continue;
+    }
+    if (has_pruned_blocks)
+      continue; // the peer can't continue from a missed block anyway
 
+    std::list<transaction> txs;
+    std::list<crypto::hash> missed_txs;
+    get_transactions(bl.tx_hashes, txs, missed_txs);
+    CHECK_AND_ASSERT_MES(!missed_txs.size(), false, "Host have requested block with missed transactions missed_tx_id.size()=" << missed_txs.size()
+      << ENDL << "for block id = " << id);
+    rsp.blocks.push_back(block_complete_entry());
+    block_complete_entry& e = rsp.blocks.back();
+    //pack block
+    e.block = t_serializable_object_to_blob(bl);
+    //pack transactions
+    BOOST_FOREACH(transaction& tx, txs)
+      e.txs.push_back(t_serializable_object_to_blob(tx));
+    cache_block_blobs(id, e);
+  }
+  if (has_pruned_blocks)
+  {
+    rsp.blocks.clear();
+    return true;
   }
+
   //get another transactions, if need
   std::list<transaction> txs;
   get_transactions(arg.txs, txs, rsp.missed_ids);
@@ -2505,38 +2990,114 @@ bool blockchain_storage::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request&
   return true;
 }
 //------------------------------------------------------------------
+std::shared_ptr<const block_complete_entry> blockchain_storage::get_cached_block_blobs(const crypto::hash& id) const
+{
+  std::shared_ptr<const block_complete_entry> e_ptr;
+  m_block_blobs_cache.get(id, e_ptr);
+  return e_ptr;
+}
+//------------------------------------------------------------------
+void blockchain_storage::cache_block_blobs(const crypto::hash& id, const block_complete_entry& e) const
+{
+  std::shared_ptr<const block_complete_entry> e_ptr;
+  if (m_block_blobs_cache.get(id, e_ptr))
+    return; // the same block serializes the same way
+  m_block_blobs_cache.set(id, std::make_shared<const block_complete_entry>(e));
+}
+//------------------------------------------------------------------
+void blockchain_storage::add_precomputed_pow_hash(const crypto::hash& id, const crypto::hash& pow_hash) const
+{
+  m_precomputed_pow_hashes.set(id, pow_hash);
+}
+//------------------------------------------------------------------
+bool blockchain_storage::get_precomputed_pow_hash(const crypto::hash& id, crypto::hash& pow_hash) const
+{
+  return m_precomputed_pow_hashes.get(id, pow_hash);
+}
+//------------------------------------------------------------------
 bool blockchain_storage::get_transactions_daily_stat(uint64_t& daily_cnt, uint64_t& daily_volume) const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
+  CRITICAL_REGION_LOCAL1(m_daily_stat_window_lock);
   daily_cnt = daily_volume = 0;
-  for(size_t i =  (m_db_blocks.size() > CURRENCY_BLOCKS_PER_DAY ? m_db_blocks.size() - CURRENCY_BLOCKS_PER_DAY:0 ); i!=m_db_blocks.size(); i++)
+  if (!m_db_blocks.size())
+    return true;
+  const daily_stat_window& w = get_actual_daily_stat_window();
+  if (!w.is_valid_for(get_top_block_id()))
+    return false;
+  daily_cnt = w.get_tx_count();
+  daily_volume = w.get_tx_volume();
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::get_daily_stat_entry(const block& bl, daily_stat_window::entry& e) const
+{
+  e = AUTO_VAL_INIT_T(daily_stat_window::entry);
+  e.datetime = get_block_datetime(bl);
+  for (auto& h : bl.tx_hashes)
   {
-    auto ptr = m_db_blocks[i];
-    for(auto& h : ptr->bl.tx_hashes)
-    {
-      ++daily_cnt;
-      auto tx_ptr = m_db_transactions.find(h);
-      CHECK_AND_ASSERT_MES(tx_ptr, false, "Wrong transaction hash " << h << " in block on height " << i);
-      uint64_t am = 0;
-      bool r = get_inputs_money_amount(tx_ptr->tx, am);
-      CHECK_AND_ASSERT_MES(r, false, "failed to get_inputs_money_amount");
-      daily_volume += am;
-    }
+    ++e.tx_count;
+    auto tx_ptr = m_db_transactions.find(h);
+    CHECK_AND_ASSERT_MES(tx_ptr, false, "Wrong transaction hash " << h << " in block " << get_block_hash(bl));
+    uint64_t am = 0;
+    bool r = get_inputs_money_amount(tx_ptr->tx, am);
+    CHECK_AND_ASSERT_MES(r, false, "failed to get_inputs_money_amount");
+    e.tx_volume += am;
   }
   return true;
 }
 //------------------------------------------------------------------
+// to be called under m_daily_stat_window_lock, reloads the window if it doesn't correspond to the top block
+const daily_stat_window& blockchain_storage::get_actual_daily_stat_window() const
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  crypto::hash top_id = get_top_block_id();
+  if (m_daily_stat_window.is_valid_for(top_id) || !m_db_blocks.size())
+    return m_daily_stat_window;
+
+  std::vector<daily_stat_window::entry> entries;
+  uint64_t blocks_size = m_db_blocks.size();
+  for (uint64_t i = blocks_size - std::min<uint64_t>(blocks_size, m_daily_stat_window.length()); i != blocks_size; ++i)
+  {
+    auto ptr = m_db_blocks[i];
+    CHECK_AND_ASSERT_MES(ptr, m_daily_stat_window, "internal error: no block " << i);
+    daily_stat_window::entry e = AUTO_VAL_INIT(e);
+    if (!get_daily_stat_entry(ptr->bl, e))
+      return m_daily_stat_window;
+    entries.push_back(e);
+  }
+  m_daily_stat_window.reset(top_id, blocks_size - 1, entries);
+  return m_daily_stat_window;
+}
+//------------------------------------------------------------------
 bool blockchain_storage::check_keyimages(const std::list<crypto::key_image>& images, std::list<uint64_t>& images_stat) const
 {
   //true - unspent, false - spent
   CRITICAL_REGION_LOCAL(m_read_lock);
-  for (auto& ki : images)
-  {
-    auto ki_ptr = m_db_spent_keys.get(ki);
-    if(ki_ptr)
-      images_stat.push_back(*ki_ptr);
-    else
-      images_stat.push_back(0);
+  // only the key images that may be spent are looked up in the db
+  std::vector<crypto::key_image> kis;
+  std::vector<bool> maybe_spent;
+  maybe_spent.reserve(images.size());
+  for (const auto& ki : images)
+  {
+    maybe_spent.push_back(is_key_image_maybe_spent(ki));
+    if (maybe_spent.back())
+      kis.push_back(ki);
+  }
+  std::vector<std::shared_ptr<const uint64_t> > ki_ptrs;
+  if (!kis.empty())
+    m_db_spent_keys.get_multiple(kis, ki_ptrs);
+  auto ki_ptr_it = ki_ptrs.begin();
+  for (bool m : maybe_spent)
+  {
+    uint64_t spent_height = 0;
+    if (m)
+    {
+      const auto& ki_ptr = *ki_ptr_it++;
+      if (ki_ptr)
+        spent_height = *ki_ptr;
+    }
+    images_stat.push_back(spent_height);
   }
   return true;
 }
@@ -2547,8 +3108,16 @@ uint64_t blockchain_storage::get_seconds_between_last_n_block(size_t n) const
   if (m_db_blocks.size() <= n)
     return 0;
 
-  uint64_t top_block_ts = get_block_datetime(m_db_blocks[m_db_blocks.size() - 1]->bl);
-  uint64_t n_block_ts   = get_block_datetime(m_db_blocks[m_db_blocks.size() - 1 - n]->bl);
+  uint64_t top_block_ts = 0, n_block_ts = 0;
+  {
+    CRITICAL_REGION_LOCAL1(m_daily_stat_window_lock);
+    const daily_stat_window& w = get_actual_daily_stat_window();
+    if (w.is_valid_for(get_top_block_id()) && w.get_datetime(0, top_block_ts) && w.get_datetime(n, n_block_ts))
+      return top_block_ts > n_block_ts ? top_block_ts - n_block_ts : 0;
+  }
+
+  top_block_ts = get_block_datetime(m_db_blocks[m_db_blocks.size() - 1]->bl);
+  n_block_ts   = get_block_datetime(m_db_blocks[m_db_blocks.size() - 1 - n]->bl);
 
   return top_block_ts > n_block_ts ? top_block_ts - n_block_ts : 0;
 }
@@ -2559,30 +3128,31 @@ uint64_t blockchain_storage::get_current_hashrate(size_t aprox_count) const
   if (aprox_count == 0 || m_db_blocks.size() <= aprox_count)
     return 0; // incorrect parameters
 
-  uint64_t nearest_front_pow_block_i = m_db_blocks.size() - 1;
+  // the headers index holds all that's needed, blocks are not deserialized
+  uint64_t nearest_front_pow_block_i = m_db_block_headers.size() - 1;
   while (nearest_front_pow_block_i != 0)
   {
-    if (!is_pos_block(m_db_blocks[nearest_front_pow_block_i]->bl))
+    if (!m_db_block_headers[nearest_front_pow_block_i]->is_pos())
       break;
     --nearest_front_pow_block_i;
   }
 
-  uint64_t nearest_back_pow_block_i = m_db_blocks.size() - aprox_count;
+  uint64_t nearest_back_pow_block_i = m_db_block_headers.size() - aprox_count;
   while (nearest_back_pow_block_i != 0)
   {
-    if (!is_pos_block(m_db_blocks[nearest_back_pow_block_i]->bl))
+    if (!m_db_block_headers[nearest_back_pow_block_i]->is_pos())
       break;
     --nearest_back_pow_block_i;
   }
 
-  std::shared_ptr<const block_extended_info> front_blk_ptr = m_db_blocks[nearest_front_pow_block_i];
-  std::shared_ptr<const block_extended_info> back_blk_ptr  = m_db_blocks[nearest_back_pow_block_i];
-  uint64_t front_blk_ts = front_blk_ptr->bl.timestamp;
-  uint64_t back_blk_ts  = back_blk_ptr->bl.timestamp;
+  auto front_hdr_ptr = m_db_block_headers[nearest_front_pow_block_i];
+  auto back_hdr_ptr  = m_db_block_headers[nearest_back_pow_block_i];
+  uint64_t front_blk_ts = front_hdr_ptr->timestamp;
+  uint64_t back_blk_ts  = back_hdr_ptr->timestamp;
   
   uint64_t ts_delta = front_blk_ts > back_blk_ts ? front_blk_ts - back_blk_ts : DIFFICULTY_POW_TARGET;
 
-  wide_difficulty_type w_hr = (front_blk_ptr->cumulative_diff_precise - back_blk_ptr->cumulative_diff_precise) / ts_delta;
+  wide_difficulty_type w_hr = (front_hdr_ptr->get_cumulative_diff_precise() - back_hdr_ptr->get_cumulative_diff_precise()) / ts_delta;
   
   return w_hr.convert_to<uint64_t>();
 }
@@ -2606,86 +3176,96 @@ size_t blockchain_storage::get_alternative_blocks_count() const
 }
 //------------------------------------------------------------------
 bool blockchain_storage::add_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, uint64_t amount, size_t g_index, uint64_t mix_count,
-  bool use_only_forced_to_mix, uint64_t height_upper_limit) const
+  uint64_t cache_generation, bool use_only_forced_to_mix, uint64_t height_upper_limit) const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
-  auto out_ptr = m_db_outputs.get_subitem(amount, g_index);
-  auto tx_ptr = m_db_transactions.find(out_ptr->tx_id);
-  CHECK_AND_ASSERT_MES(tx_ptr, false, "internal error: transaction " << out_ptr->tx_id << " was not found in transaction DB, amount: " << print_money_brief(amount) <<
-    ", g_index: " << g_index);
-  CHECK_AND_ASSERT_MES(tx_ptr->tx.vout.size() > out_ptr->out_no, false, "internal error: in global outs index, transaction out index="
-    << out_ptr->out_no << " is greater than transaction outputs = " << tx_ptr->tx.vout.size() << ", for tx id = " << out_ptr->tx_id);
-
-  //CHECK_AND_ASSERT_MES(amount != 0 || height_upper_limit != 0, false, "height_upper_limit must be nonzero for hidden amounts (amount = 0)");
+  zc_output_index_entry entry = AUTO_VAL_INIT(entry);
+  if (!get_decoy_output_entry(amount, g_index, cache_generation, entry))
+    return false;
+  return add_zc_out_to_get_random_outs(result_outs, entry, g_index, mix_count, use_only_forced_to_mix, height_upper_limit);
+}
+//------------------------------------------------------------------
+// decoy checks for an entry of zc_outputs_index or decoy_outputs_cache, which is made for bare outputs as well
+bool blockchain_storage::add_zc_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, const zc_output_index_entry& entry, size_t g_index, uint64_t mix_count,
+  bool use_only_forced_to_mix, uint64_t height_upper_limit) const
+{
+  if (entry.is_bare())
+    return false;
 
-  if (height_upper_limit != 0 && tx_ptr->m_keeper_block_height > height_upper_limit)
+  if (height_upper_limit != 0 && entry.keeper_block_height > height_upper_limit)
     return false;
-  
-  const transaction& tx = tx_ptr->tx;
-  CHECK_AND_ASSERT_MES(tx_ptr->m_spent_flags.size() == tx.vout.size(), false, "internal error: spent_flag.size()=" << tx_ptr->m_spent_flags.size() << ", tx.vout.size()=" << tx.vout.size());
-  
+
   //do not use outputs that obviously spent for mixins
-  if (tx_ptr->m_spent_flags[out_ptr->out_no])
+  if (entry.is_spent())
     return false;
-  
+
   //check if transaction is unlocked
-  if (!is_tx_spendtime_unlocked(get_tx_unlock_time(tx, out_ptr->out_no)))
+  if (!is_tx_spendtime_unlocked(entry.unlock_time))
     return false;
 
-  const tx_out_v& out_v = tx.vout[out_ptr->out_no];
-  
   // do not use burned coins
-  if (is_out_burned(out_v))
+  if (entry.is_burned())
     return false;
 
   // check mix_attr
-  uint8_t mix_attr = CURRENCY_TO_KEY_OUT_RELAXED;
-  if (!get_mix_attr_from_tx_out_v(out_v, mix_attr))
-    return false; // output has no mix_attr, skip it
-  if (mix_attr == CURRENCY_TO_KEY_OUT_FORCED_NO_MIX)
-    return false; //COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS call means that ring signature will have more than one entry.
-  else if (use_only_forced_to_mix && mix_attr == CURRENCY_TO_KEY_OUT_RELAXED)
-    return false; //relaxed not allowed
-  else if (mix_attr != CURRENCY_TO_KEY_OUT_RELAXED && mix_attr > mix_count)
-    return false; //mix_attr set to specific minimum, and mix_count is less then desired count
-
-  VARIANT_SWITCH_BEGIN(out_v);
-  VARIANT_CASE_CONST(tx_out_bare, o)
-  {
-    CHECK_AND_ASSERT_MES(amount != 0, false, "unexpected amount == 0 for tx_out_bare");
-    if (o.target.type() == typeid(txout_htlc))
-    {
-      //silently return false, it's ok
-      return false;
-    }
-    CHECK_AND_ASSERT_MES(o.target.type() == typeid(txout_to_key), false, "unexpected out target type: " << o.target.type().name());
-    const txout_to_key& otk = boost::get<txout_to_key>(o.target);
+  if (entry.mix_attr == CURRENCY_TO_KEY_OUT_FORCED_NO_MIX)
+    return false;
+  else if (use_only_forced_to_mix && entry.mix_attr == CURRENCY_TO_KEY_OUT_RELAXED)
+    return false;
+  else if (entry.mix_attr != CURRENCY_TO_KEY_OUT_RELAXED && entry.mix_attr > mix_count)
+    return false;
 
-    COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry& oen = *result_outs.outs.insert(result_outs.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry());
-    oen.global_amount_index = g_index;
-    oen.stealth_address = otk.key;
-  }
-  VARIANT_CASE_CONST(tx_out_zarcanum, toz)
+  COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry& oen = *result_outs.outs.insert(result_outs.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry());
+  oen.global_amount_index = g_index;
+  oen.stealth_address     = entry.stealth_address;
+  oen.amount_commitment   = entry.amount_commitment;
+  oen.concealing_point    = entry.concealing_point;
+  oen.blinded_asset_id    = entry.blinded_asset_id;
+  if (entry.flags & ZC_OUTPUT_INDEX_ENTRY_FLAG_COINBASE)
+    oen.flags |= RANDOM_OUTPUTS_FOR_AMOUNTS_FLAGS_COINBASE;
+  if (entry.flags & ZC_OUTPUT_INDEX_ENTRY_FLAG_POS_COINBASE)
+    oen.flags |= RANDOM_OUTPUTS_FOR_AMOUNTS_FLAGS_POS_COINBASE;
+
+  return true;
+}
+//------------------------------------------------------------------
+// picks random distinct gindexes in [0, up_index_limit) until decoys_count good outs are added or all the indexes are tried;
+// each round's picks are looked up in ascending order, so m_db_outputs is read in key order instead of jumping around
+size_t blockchain_storage::add_random_outs_for_amount(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, uint64_t amount, size_t up_index_limit, uint64_t decoys_count,
+  uint64_t cache_generation, bool use_only_forced_to_mix, uint64_t height_upper_limit) const
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  std::unordered_set<size_t> used;
+  std::vector<size_t> round;
+  size_t added = 0;
+  while (added < decoys_count && used.size() < up_index_limit)
   {
-    CHECK_AND_ASSERT_MES(amount == 0, false, "unexpected amount != 0 for tx_out_zarcanum");
-    COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry& oen = *result_outs.outs.insert(result_outs.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry());
-    oen.global_amount_index = g_index;
-    oen.stealth_address     = toz.stealth_address;
-    oen.amount_commitment   = toz.amount_commitment;
-    oen.concealing_point    = toz.concealing_point;
-    oen.blinded_asset_id    = toz.blinded_asset_id;   // TODO @#@# bad design, too much manual coping, consider redesign -- sowle
-    if (is_coinbase(tx_ptr->tx))
-    {
-      oen.flags |= RANDOM_OUTPUTS_FOR_AMOUNTS_FLAGS_COINBASE;
-      if (is_pos_coinbase(tx_ptr->tx))
+    round.clear();
+    while (round.size() < decoys_count - added && used.size() < up_index_limit)
+    {
+      size_t g_index = crypto::rand<size_t>() % up_index_limit;
+      if (used.size() * 2 < up_index_limit)
       {
-        oen.flags |= RANDOM_OUTPUTS_FOR_AMOUNTS_FLAGS_POS_COINBASE;
+        if (used.count(g_index))
+          continue;
       }
+      else
+      {
+        // most of the indexes are used, take the next unused one instead of trying again
+        while (used.count(g_index))
+          g_index = g_index + 1 == up_index_limit ? 0 : g_index + 1;
+      }
+      used.insert(g_index);
+      round.push_back(g_index);
+    }
+    std::sort(round.begin(), round.end());
+    for (size_t g_index : round)
+    {
+      if (add_out_to_get_random_outs(result_outs, amount, g_index, decoys_count, cache_generation, use_only_forced_to_mix, height_upper_limit))
+        ++added;
     }
   }
-  VARIANT_SWITCH_END();
-
-  return true;
+  return added;
 }
 //------------------------------------------------------------------
 size_t blockchain_storage::find_end_of_allowed_index(uint64_t amount) const
@@ -2699,6 +3279,13 @@ size_t blockchain_storage::find_end_of_allowed_index(uint64_t amount) const
   do
   {
     --i;
+    const zc_output_index_entry* p_zc_entry = amount == 0 ? m_zc_outputs_index.get(i) : nullptr;
+    if (p_zc_entry)
+    {
+      if (p_zc_entry->keeper_block_height + CURRENCY_MINED_MONEY_UNLOCK_WINDOW <= get_current_blockchain_size())
+        return i+1;
+      continue;
+    }
     auto out_ptr = m_db_outputs.get_subitem(amount, i);
     auto tx_ptr = m_db_transactions.find(out_ptr->tx_id);
     CHECK_AND_ASSERT_MES(tx_ptr, 0, "internal error: failed to find transaction from outputs index with tx_id=" << out_ptr->tx_id << ", amount: " << print_money_brief(amount));
@@ -2713,6 +3300,7 @@ bool blockchain_storage::get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDO
   CRITICAL_REGION_LOCAL(m_read_lock);
   LOG_PRINT_L3("[get_random_outs_for_amounts] amounts: " << req.amounts.size());
   std::map<uint64_t, uint64_t> amounts_to_up_index_limit_cache;
+  uint64_t cache_generation = m_decoy_outputs_cache.begin_lookups(get_top_block_id());
 
   for(uint64_t amount : req.amounts)
   {
@@ -2731,7 +3319,7 @@ bool blockchain_storage::get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDO
     if (it_limit == amounts_to_up_index_limit_cache.end())
     {
       up_index_limit = find_end_of_allowed_index(amount);
-      amounts_to_up_index_limit_cache[up_index_limit];
+      amounts_to_up_index_limit_cache[amount] = up_index_limit;
     }
     else
     {
@@ -2741,19 +3329,7 @@ bool blockchain_storage::get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDO
     CHECK_AND_ASSERT_MES(up_index_limit <= outs_container_size, false, "internal error: find_end_of_allowed_index returned wrong index=" << up_index_limit << ", with amount_outs.size = " << outs_container_size);
     if (up_index_limit >= req.decoys_count)
     {
-      std::set<size_t> used;
-      size_t try_count = 0;
-      for(uint64_t j = 0; j != req.decoys_count && try_count < up_index_limit;)
-      {
-        size_t g_index = crypto::rand<size_t>() % up_index_limit;
-        if(used.count(g_index))
-          continue;
-        bool added = add_out_to_get_random_outs(result_outs, amount, g_index, req.decoys_count, req.use_forced_mix_outs, req.height_upper_limit);
-        used.insert(g_index);
-        if(added)
-          ++j;
-        ++try_count;
-      }
+      add_random_outs_for_amount(result_outs, amount, up_index_limit, req.decoys_count, cache_generation, req.use_forced_mix_outs, req.height_upper_limit);
       if (result_outs.outs.size() < req.decoys_count)
       {
         LOG_PRINT_YELLOW("Not enough inputs for amount " << print_money_brief(amount) << ", needed " << req.decoys_count << ", added " << result_outs.outs.size() << " good outs from " << up_index_limit << " unlocked of " << outs_container_size << " total", LOG_LEVEL_0);
@@ -2763,14 +3339,14 @@ bool blockchain_storage::get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDO
     {
       size_t added = 0;
       for (size_t i = 0; i != up_index_limit; i++)
-        added += add_out_to_get_random_outs(result_outs, amount, i, req.decoys_count, req.use_forced_mix_outs, req.height_upper_limit) ? 1 : 0;
+        added += add_out_to_get_random_outs(result_outs, amount, i, req.decoys_count, cache_generation, req.use_forced_mix_outs, req.height_upper_limit) ? 1 : 0;
       LOG_PRINT_YELLOW("Not enough inputs for amount " << print_money_brief(amount) << ", needed " << req.decoys_count << ", added " << added << " good outs from " << up_index_limit << " unlocked of " << outs_container_size << " total - respond with all good outs", LOG_LEVEL_0);
     }
   }
   return true;
 }
 //------------------------------------------------------------------
-bool blockchain_storage::get_target_outs_for_amount_prezarcanum(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::request& req, const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::offsets_distribution& details,  COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, std::map<uint64_t, uint64_t>& amounts_to_up_index_limit_cache) const
+bool blockchain_storage::get_target_outs_for_amount_prezarcanum(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::request& req, const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::offsets_distribution& details,  COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, std::map<uint64_t, uint64_t>& amounts_to_up_index_limit_cache, uint64_t cache_generation) const
 {  
   size_t decoys_count = details.global_offsets.size();
   uint64_t amount = details.amount;
@@ -2788,7 +3364,7 @@ bool blockchain_storage::get_target_outs_for_amount_prezarcanum(const COMMAND_RP
   if (it_limit == amounts_to_up_index_limit_cache.end())
   {
     up_index_limit = find_end_of_allowed_index(amount);
-    amounts_to_up_index_limit_cache[up_index_limit];
+    amounts_to_up_index_limit_cache[amount] = up_index_limit;
   }
   else
   {
@@ -2798,34 +3374,7 @@ bool blockchain_storage::get_target_outs_for_amount_prezarcanum(const COMMAND_RP
   CHECK_AND_ASSERT_MES(up_index_limit <= outs_container_size, false, "internal error: find_end_of_allowed_index returned wrong index=" << up_index_limit << ", with amount_outs.size = " << outs_container_size);
   if (up_index_limit >= decoys_count)
   {
-    std::set<size_t> used;
-    //used.insert(details.own_global_index);
-    for (uint64_t j = 0; j != decoys_count || used.size() >= up_index_limit;)
-    {
-      size_t g_index_initial = crypto::rand<size_t>() % up_index_limit;
-      size_t g_index = g_index_initial;
-      //enumerate via whole loop from g_index to up_index_limit and then from 0 to g_index
-      while (true)
-      {
-        if (!used.count(g_index))
-          break;
-        g_index++;
-        
-        if (g_index >= up_index_limit)
-          g_index = 0;
-        if (g_index == g_index_initial)
-        {
-          // we enumerated full circle and couldn't find needed amount of outs
-          LOG_PRINT_YELLOW("Not enough inputs for amount " << print_money_brief(amount) << ", needed " << decoys_count << ", added " << result_outs.outs.size() << " good outs from " << up_index_limit << " unlocked of " << outs_container_size << " total", LOG_LEVEL_0);
-          return true;
-        }
-      }
-
-      bool added = add_out_to_get_random_outs(result_outs, amount, g_index, decoys_count, req.use_forced_mix_outs, req.height_upper_limit);
-      used.insert(g_index);
-      if (added)
-        ++j;      
-    }
+    add_random_outs_for_amount(result_outs, amount, up_index_limit, decoys_count, cache_generation, req.use_forced_mix_outs, req.height_upper_limit);
     if (result_outs.outs.size() < decoys_count)
     {
       LOG_PRINT_YELLOW("Not enough inputs for amount " << print_money_brief(amount) << ", needed " << decoys_count << ", added " << result_outs.outs.size() << " good outs from " << up_index_limit << " unlocked of " << outs_container_size << " total", LOG_LEVEL_0);
@@ -2836,23 +3385,19 @@ bool blockchain_storage::get_target_outs_for_amount_prezarcanum(const COMMAND_RP
   {
     size_t added = 0;
     for (size_t i = 0; i != up_index_limit; i++)
-      added += add_out_to_get_random_outs(result_outs, amount, i, decoys_count, req.use_forced_mix_outs, req.height_upper_limit) ? 1 : 0;
+      added += add_out_to_get_random_outs(result_outs, amount, i, decoys_count, cache_generation, req.use_forced_mix_outs, req.height_upper_limit) ? 1 : 0;
     LOG_PRINT_YELLOW("Not enough inputs for amount " << print_money_brief(amount) << ", needed " << decoys_count << ", added " << added << " good outs from " << up_index_limit << " unlocked of " << outs_container_size << " total - respond with all good outs", LOG_LEVEL_0);
     return true;
   }
 }
 //------------------------------------------------------------------
-bool blockchain_storage::get_target_outs_for_postzarcanum(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::request& req, const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::offsets_distribution& details, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, std::map<uint64_t, uint64_t>& amounts_to_up_index_limit_cache) const 
+bool blockchain_storage::get_target_outs_for_postzarcanum(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::offsets_distribution& details, const std::unordered_map<uint64_t, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry>& resolved_outs, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs) const
 {
   for (auto global_index : details.global_offsets)
   {
-    //pick up a random output from selected_global_indes
-    bool res = add_out_to_get_random_outs(result_outs, details.amount, global_index, this->get_core_runtime_config().hf4_minimum_mixins, false);
-    if (!res)
-    {
-      COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry& oen = *result_outs.outs.insert(result_outs.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry{});
-      oen.flags = RANDOM_OUTPUTS_FOR_AMOUNTS_FLAGS_NOT_ALLOWED;
-    }
+    auto it = resolved_outs.find(global_index);
+    CHECK_AND_ASSERT_MES(it != resolved_outs.end(), false, "internal error: gindex " << global_index << " was not resolved");
+    result_outs.outs.push_back(it->second);
   }
   CHECK_AND_ASSERT_THROW_MES(details.global_offsets.size() == result_outs.outs.size(), "details.global_offsets.size() == result_outs.outs.size() check failed");  
   return true;
@@ -2863,12 +3408,40 @@ bool blockchain_storage::get_random_outs_for_amounts3(const COMMAND_RPC_GET_RAND
   CRITICAL_REGION_LOCAL(m_read_lock);
   LOG_PRINT_L3("[get_random_outs_for_amounts] amounts: " << req.amounts.size());
   std::map<uint64_t, uint64_t> amounts_to_up_index_limit_cache;  
+  uint64_t cache_generation = m_decoy_outputs_cache.begin_lookups(get_top_block_id());
+
+  // post-zarcanum decoys are picked by the wallet from the same distribution for all the inputs, so the inputs of one request
+  // often share them: each gindex is looked up once, in ascending order to keep the lookups local
+  std::vector<uint64_t> zc_gindices;
+  for (const auto& details : req.amounts)
+  {
+    if (details.amount == 0)
+      zc_gindices.insert(zc_gindices.end(), details.global_offsets.begin(), details.global_offsets.end());
+  }
+  std::sort(zc_gindices.begin(), zc_gindices.end());
+  zc_gindices.erase(std::unique(zc_gindices.begin(), zc_gindices.end()), zc_gindices.end());
 
+  std::unordered_map<uint64_t, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry> resolved_outs;
+  resolved_outs.reserve(zc_gindices.size());
+  COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount resolved_out;
+  for (uint64_t gindex : zc_gindices)
+  {
+    COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry& oen = resolved_outs[gindex];
+    if (add_out_to_get_random_outs(resolved_out, 0, gindex, this->get_core_runtime_config().hf4_minimum_mixins, cache_generation, false))
+    {
+      oen = resolved_out.outs.back();
+      resolved_out.outs.clear();
+    }
+    else
+    {
+      oen = COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry{};
+      oen.flags = RANDOM_OUTPUTS_FOR_AMOUNTS_FLAGS_NOT_ALLOWED;
+    }
+  }
 
   for (size_t i = 0; i != req.amounts.size(); i++)
   {
     uint64_t amount = req.amounts[i].amount;
-    //const std::vector<uint64_t>& offsets = req.amounts[i].offsets;
     COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs = *res.outs.insert(res.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount());
     result_outs.amount = amount;
 
@@ -2876,12 +3449,12 @@ bool blockchain_storage::get_random_outs_for_amounts3(const COMMAND_RPC_GET_RAND
     if (amount == 0)
     {
       //zarcanum era inputs
-      r = get_target_outs_for_postzarcanum(req, req.amounts[i], result_outs, amounts_to_up_index_limit_cache);
+      r = get_target_outs_for_postzarcanum(req.amounts[i], resolved_outs, result_outs);
     }
     else
     {
-      //zarcanum era inputs
-      r = get_target_outs_for_amount_prezarcanum(req, req.amounts[i], result_outs, amounts_to_up_index_limit_cache);
+      //pre-zarcanum era inputs
+      r = get_target_outs_for_amount_prezarcanum(req, req.amounts[i], result_outs, amounts_to_up_index_limit_cache, cache_generation);
     }
     if (!r)
       return false;
@@ -2905,9 +3478,9 @@ bool blockchain_storage::is_pos_allowed() const
 //------------------------------------------------------------------
 bool blockchain_storage::update_spent_tx_flags_for_input(uint64_t amount, const txout_ref_v& o, bool spent)
 {
-  if (o.type() == typeid(ref_by_id))
+  if (tools::is_variant_type<ref_by_id>(o))
     return update_spent_tx_flags_for_input(boost::get<ref_by_id>(o).tx_id, boost::get<ref_by_id>(o).n, spent);
-  else if (o.type() == typeid(uint64_t))
+  else if (tools::is_variant_type<uint64_t>(o))
     return update_spent_tx_flags_for_input(amount, boost::get<uint64_t>(o), spent);
 
   LOG_ERROR("Unknown txout_v type");
@@ -2939,6 +3512,9 @@ bool blockchain_storage::update_spent_tx_flags_for_input(const crypto::hash& tx_
   tce_local.m_spent_flags[n] = spent;
   m_db_transactions.set(tx_id, tce_local);
 
+  if (n < tce_local.tx.vout.size() && tools::is_variant_type<tx_out_zarcanum>(tce_local.tx.vout[n]) && n < tce_local.m_global_output_indexes.size())
+    m_zc_outputs_index.set_spent_flag(tce_local.m_global_output_indexes[n], spent);
+
   return true;
 }
 //------------------------------------------------------------------
@@ -3245,10 +3821,21 @@ void blockchain_storage::print_blockchain_index() const
 //   LOG_PRINT_L0("Current blockchain index:" << ENDL << ss.str());
 }
 //------------------------------------------------------------------
+template<class t_container>
+static std::string get_cache_shards_stats_str(const t_container& c)
+{
+  std::vector<typename t_container::cache_shard_stats> stats;
+  c.get_cache_shards_stats(stats);
+  std::stringstream ss;
+  for (const auto& st : stats)
+    ss << " " << st.hits << "/" << st.misses;
+  return ss.str();
+}
+//------------------------------------------------------------------
 void blockchain_storage::print_db_cache_perfeormance_data() const
 {
 #define DB_CONTAINER_PERF_DATA_ENTRY(container_name) \
-  << #container_name << ": hit_percent: " << m_db_blocks.get_performance_data().hit_percent.get_avg() << "%," \
+  << #container_name << ": hit_percent: " << container_name.get_performance_data().hit_percent.get_avg() << "%," \
   << " read_cache: " << container_name.get_performance_data().read_cache_microsec.get_avg() \
     << " read_db: " << container_name.get_performance_data().read_db_microsec.get_avg() \
     << " upd_cache: " << container_name.get_performance_data().update_cache_microsec.get_avg() \
@@ -3256,11 +3843,14 @@ void blockchain_storage::print_db_cache_perfeormance_data() const
     << " write_db: " << container_name.get_performance_data().write_to_db_microsec.get_avg() \
     << " native_db_set_t: " << container_name.get_performance_data_native().backend_set_t_time.get_avg() \
     << " native_db_set_pod: " << container_name.get_performance_data_native().backend_set_pod_time.get_avg() \
-    << " native_db_seriz: " << container_name.get_performance_data_native().set_serialize_t_time.get_avg()
+    << " native_db_seriz: " << container_name.get_performance_data_native().set_serialize_t_time.get_avg() \
+    << " shards hits/misses:" << get_cache_shards_stats_str(container_name)
 
 
   LOG_PRINT_L0("DB_PERFORMANCE_DATA: " << ENDL 
     DB_CONTAINER_PERF_DATA_ENTRY(m_db_blocks) << ENDL
+    DB_CONTAINER_PERF_DATA_ENTRY(m_db_block_headers) << ENDL
+    DB_CONTAINER_PERF_DATA_ENTRY(m_db_blocks_max_timestamps) << ENDL
     DB_CONTAINER_PERF_DATA_ENTRY(m_db_blocks_index) << ENDL
     DB_CONTAINER_PERF_DATA_ENTRY(m_db_transactions) << ENDL
     DB_CONTAINER_PERF_DATA_ENTRY(m_db_spent_keys) << ENDL
@@ -3275,6 +3865,130 @@ void blockchain_storage::print_db_cache_perfeormance_data() const
   );
 }
 //------------------------------------------------------------------
+template<class t_container>
+static void add_db_cache_stat(const char* name, const t_container& c, std::list<blockchain_storage::db_container_cache_stat>& stats)
+{
+  std::vector<typename t_container::cache_shard_stats> shards_stats;
+  c.get_cache_shards_stats(shards_stats);
+  blockchain_storage::db_container_cache_stat st = AUTO_VAL_INIT(st);
+  st.name = name;
+  for (const auto& sh : shards_stats)
+  {
+    st.hits += sh.hits;
+    st.misses += sh.misses;
+  }
+  st.hit_percent_avg = c.get_performance_data().hit_percent.get_avg();
+  stats.push_back(st);
+}
+//------------------------------------------------------------------
+void blockchain_storage::get_db_cache_stats(std::list<db_container_cache_stat>& stats) const
+{
+  add_db_cache_stat("blocks", m_db_blocks, stats);
+  add_db_cache_stat("block_headers", m_db_block_headers, stats);
+  add_db_cache_stat("blocks_max_timestamps", m_db_blocks_max_timestamps, stats);
+  add_db_cache_stat("blocks_index", m_db_blocks_index, stats);
+  add_db_cache_stat("transactions", m_db_transactions, stats);
+  add_db_cache_stat("spent_keys", m_db_spent_keys, stats);
+  add_db_cache_stat("multisig_outs", m_db_multisig_outs, stats);
+  add_db_cache_stat("solo_options", m_db_solo_options, stats);
+  add_db_cache_stat("aliases", m_db_aliases, stats);
+  add_db_cache_stat("assets", m_db_assets, stats);
+  add_db_cache_stat("addr_to_alias", m_db_addr_to_alias, stats);
+}
+//------------------------------------------------------------------
+template<class t_container>
+static void add_db_cache_memory_usage(const char* name, const t_container& c, std::list<tools::memory_usage_entry>& usage)
+{
+  std::vector<typename t_container::cache_shard_stats> shards_stats;
+  c.get_cache_shards_stats(shards_stats);
+  uint64_t items = 0;
+  for (const auto& sh : shards_stats)
+    items += sh.size;
+  tools::add_memory_usage(std::string("db_cache_") + name, items, c.get_cache_estimated_bytes(), usage);
+}
+//------------------------------------------------------------------
+void blockchain_storage::get_memory_usage(std::list<tools::memory_usage_entry>& usage) const
+{
+  add_db_cache_memory_usage("blocks", m_db_blocks, usage);
+  add_db_cache_memory_usage("block_headers", m_db_block_headers, usage);
+  add_db_cache_memory_usage("blocks_max_timestamps", m_db_blocks_max_timestamps, usage);
+  add_db_cache_memory_usage("blocks_index", m_db_blocks_index, usage);
+  add_db_cache_memory_usage("transactions", m_db_transactions, usage);
+  add_db_cache_memory_usage("spent_keys", m_db_spent_keys, usage);
+  add_db_cache_memory_usage("multisig_outs", m_db_multisig_outs, usage);
+  add_db_cache_memory_usage("solo_options", m_db_solo_options, usage);
+  add_db_cache_memory_usage("aliases", m_db_aliases, usage);
+  add_db_cache_memory_usage("assets", m_db_assets, usage);
+  add_db_cache_memory_usage("addr_to_alias", m_db_addr_to_alias, usage);
+
+  // block blobs are what takes place there, the rest is small
+  uint64_t block_blobs_bytes = m_block_blobs_cache.estimate_bytes(64, [](const crypto::hash& id, const std::shared_ptr<const block_complete_entry>& e) -> uint64_t
+  {
+    uint64_t r = tools::node_container_entry_size<crypto::hash, block_complete_entry>();
+    if (!e)
+      return r;
+    r += e->block.size() + e->global_outs.size() * sizeof(uint64_t);
+    for (const auto& tx_blob : e->txs)
+      r += tx_blob.size() + 2 * sizeof(void*);
+    return r;
+  });
+  tools::add_memory_usage("block_blobs_cache", m_block_blobs_cache.size(), block_blobs_bytes, usage);
+  tools::add_memory_usage("precomputed_pow_hashes", m_precomputed_pow_hashes.size(), m_precomputed_pow_hashes.size() * tools::node_container_entry_size<crypto::hash, crypto::hash>(), usage);
+  tools::add_memory_usage("ring_members_points_cache", m_ring_members_points_cache.size(),
+    m_ring_members_points_cache.size() * tools::node_container_entry_size<crypto::public_key, crypto::CLSAG_ring_members_cache_t::entry_t>(), usage);
+  tools::add_memory_usage("verified_txs_cache", m_verified_txs_cache.size(), m_verified_txs_cache.size() * tools::node_container_entry_size<crypto::hash, verified_txs_cache::entry_t>(), usage);
+  tools::add_memory_usage("decoy_outputs_cache", m_decoy_outputs_cache.size(),
+    m_decoy_outputs_cache.size() * tools::node_container_entry_size<std::pair<uint64_t, uint64_t>, zc_output_index_entry>(), usage);
+  tools::add_memory_usage("spent_keys_filter", m_spent_keys_filter.get_count(), m_spent_keys_filter.get_memory_size(), usage);
+  tools::add_memory_usage("ids_filter", m_ids_filter.get_count(), m_ids_filter.get_memory_size(), usage);
+  // memory-mapped, the pages are shared with the page cache
+  tools::add_memory_usage("zc_outputs_index_mapped", m_zc_outputs_index.is_open() ? m_zc_outputs_index.size() : 0,
+    m_zc_outputs_index.is_open() ? m_zc_outputs_index.size() * sizeof(zc_output_index_entry) : 0, usage);
+
+  CRITICAL_REGION_BEGIN(m_alternative_chains_lock);
+  // stored_size covers the blobs of the blocks and their txs, the entries themselves and outputs lookup tables are counted on top
+  uint64_t alt_blocks_bytes = m_alternative_chains_stored_size + m_alternative_chains.size() * tools::node_container_entry_size<crypto::hash, alt_block_extended_info>();
+  for (const auto& a : m_alternative_chains)
+  {
+    alt_blocks_bytes += a.second.gindex_lookup_table.size() * tools::node_container_entry_size<uint64_t, uint64_t>();
+    for (const auto& o : a.second.outputs)
+      alt_blocks_bytes += tools::node_container_entry_size<uint64_t, std::vector<tx_out_v>>() + o.second.size() * sizeof(tx_out_v);
+  }
+  tools::add_memory_usage("alt_blocks", m_alternative_chains.size(), alt_blocks_bytes, usage);
+  tools::add_memory_usage("alt_blocks_txs_index", m_alternative_chains_txs.size(), m_alternative_chains_txs.size() * tools::node_container_entry_size<crypto::hash, size_t>(), usage);
+  std::unordered_set<const alt_chain_keyimages*> alt_key_images_layers;
+  uint64_t alt_key_images_count = 0, alt_key_images_bytes = 0;
+  for (const auto& a : m_alternative_chains)
+  {
+    alt_chain_keyimages::for_each_layer(a.second.keyimages, alt_key_images_layers, [&](const alt_chain_keyimages& l) {
+      alt_key_images_count += l.get_layer_size();
+      alt_key_images_bytes += sizeof(alt_chain_keyimages) + l.get_layer_size() * (sizeof(crypto::key_image) + 3 * sizeof(void*));
+    });
+  }
+  tools::add_memory_usage("alt_blocks_key_images", alt_key_images_count, alt_key_images_bytes, usage);
+  CRITICAL_REGION_END();
+
+  CRITICAL_REGION_BEGIN(m_invalid_blocks_lock);
+  uint64_t invalid_blocks_bytes = 0;
+  for (const auto& b : m_invalid_blocks)
+    invalid_blocks_bytes += tools::node_container_entry_size<crypto::hash, block_extended_info>() + get_object_blobsize(b.second.bl);
+  tools::add_memory_usage("invalid_blocks", m_invalid_blocks.size(), invalid_blocks_bytes, usage);
+  CRITICAL_REGION_END();
+
+  CRITICAL_REGION_BEGIN(m_aliases_index_lock);
+  uint64_t aliases_index_bytes = m_aliases_index.capacity() * sizeof(std::string);
+  for (const auto& a : m_aliases_index)
+    aliases_index_bytes += a.size();
+  tools::add_memory_usage("aliases_index", m_aliases_index.size(), aliases_index_bytes, usage);
+  CRITICAL_REGION_END();
+
+  CRITICAL_REGION_BEGIN(m_assets_index_lock);
+  tools::add_memory_usage("assets_index", m_assets_index.size(),
+    m_assets_index.size() * (tools::node_container_entry_size<crypto::public_key, asset_descriptor_base>() + sizeof(crypto::public_key)
+      + tools::node_container_entry_size<std::string, crypto::public_key>()), usage);
+  CRITICAL_REGION_END();
+}
+//------------------------------------------------------------------
 void blockchain_storage::get_last_n_x_blocks(uint64_t n, bool pos_blocks, std::list<std::shared_ptr<const block_extended_info>>& blocks) const
 {
   uint64_t count = 0;
@@ -3368,11 +4082,11 @@ void blockchain_storage::print_blockchain_outs_stats() const
     if (!spent)
       ++stat.unspent;
       
-    if (!spent)// && p_tx->tx.vout[output_entry.out_no].target.type() == typeid(txout_to_key))
+    if (!spent)// && tools::is_variant_type<txout_to_key>(p_tx->tx.vout[output_entry.out_no].target))
     {
       VARIANT_SWITCH_BEGIN(p_tx->tx.vout[output_entry.out_no]);
       VARIANT_CASE_CONST(tx_out_bare, o)
-        if (o.target.type() == typeid(txout_to_key) && boost::get<txout_to_key>(o.target).mix_attr != CURRENCY_TO_KEY_OUT_FORCED_NO_MIX)
+        if (tools::is_variant_type<txout_to_key>(o.target) && boost::get<txout_to_key>(o.target).mix_attr != CURRENCY_TO_KEY_OUT_FORCED_NO_MIX)
           ++stat.mixable;
       VARIANT_CASE_CONST(tx_out_zarcanum, toz)
         if (toz.mix_attr != CURRENCY_TO_KEY_OUT_FORCED_NO_MIX)
@@ -3436,7 +4150,7 @@ void blockchain_storage::print_blockchain_outs(const std::string& file) const
 //------------------------------------------------------------------
 
 //------------------------------------------------------------------
-bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp)const
+bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, bool with_headers)const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
   if(!find_blockchain_supplement(qblock_ids, resp.start_height))
@@ -3445,19 +4159,15 @@ bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash
   resp.total_height = get_current_blockchain_size();
   size_t count = 0;
   
-  block_context_info* pprevinfo = nullptr;
-  size_t i = 0;
-  for (i = resp.start_height; i != m_db_blocks.size() && count < BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT; i++, count++)
+  for (size_t i = resp.start_height; i != m_db_blocks.size() && count < BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT; i++, count++)
   {
     resp.m_block_ids.push_back(block_context_info());
-    
-    if (pprevinfo)
-      pprevinfo->h = m_db_blocks[i]->bl.prev_id;
-    resp.m_block_ids.back().cumul_size = m_db_blocks[i]->block_cumulative_size;
-    pprevinfo = &resp.m_block_ids.back();
-  }    
-  if (pprevinfo)
-    pprevinfo->h = get_block_hash(m_db_blocks[--i]->bl);
+    auto header_ptr = m_db_block_headers[i];
+    resp.m_block_ids.back().h = header_ptr->id;
+    resp.m_block_ids.back().cumul_size = header_ptr->block_cumulative_size;
+    if (with_headers)
+      resp.m_block_headers.push_back(block_to_blob(m_db_blocks[i]->bl));
+  }
 
   return true;
 }
@@ -3484,96 +4194,33 @@ bool blockchain_storage::get_est_height_from_date(uint64_t date, uint64_t& res_h
   if (date < get_blockchain_launch_timestamp())
   {
     return true;
-  }
-
-
-  uint64_t calculated_estimated_height = (date - get_blockchain_launch_timestamp()) / DIFFICULTY_TOTAL_TARGET;
-  
-  if (date > m_db_blocks[m_db_blocks.size() - 1]->bl.timestamp)
-  {
-    //that suspicious but also could be(in case someone just created wallet offline in
-    //console and then got it synchronyzing and last block had a little timestamp shift)
-    //let's just return 1 day behind for safety reasons. 
-    if (m_db_blocks.size() > 1440)
-    {
-      res_h = m_db_blocks.size() - 1440;
-    }
-    else 
-    {
-      //likely impossible, but just in case
-      res_h = 0;
-    }
-    return true;
-  }
-  if (calculated_estimated_height > m_db_blocks.size() - 1)
-    calculated_estimated_height = m_db_blocks.size() - 1;
-
-  //goal is to get timestamp in window in between 1day+1hour  and 1 hour before target(1 hour is just to be sure that
-  //we didn't miss actual wallet start because of timestamp and difficulty fluctuations)
-  uint64_t low_boundary = date - 90000; //1 day + 1 hour
-  uint64_t high_boundary = date - 3600; //1 hour
-
-  //std::cout << "ENTRY: low_boundary(minutes):" << low_boundary/60 << " high_boundary(minutes): " << high_boundary / 60 << std::endl;
-
-  uint64_t iteration_coun = 0;
-  uint64_t current_low_boundary = 0;
-  uint64_t current_height_boundary = m_db_blocks.size() - 1;
-  while (true)
-  {
-    iteration_coun++;
-    if (iteration_coun > 29) // Log2(CURRENCY_MAX_BLOCK_NUMBER) 
-    {
-      LOG_ERROR("Internal error: too much iterations on get_est_height_from_date, date = " << date);
-      return true;
-    }
-    uint64_t ts = m_db_blocks[calculated_estimated_height]->bl.timestamp;
-    if (ts > high_boundary)
-    {
-      //we moved too much forward
-      
-      current_height_boundary = calculated_estimated_height;
-      CHECK_AND_ASSERT_MES(current_height_boundary >= current_low_boundary, true, 
-        "Internal error: current_hight_boundary(" << current_height_boundary << ") > current_low_boundary("<< current_low_boundary << ")");
-      uint64_t offset = (current_height_boundary - current_low_boundary)/2;
-      if (offset <= 2)
-      {
-        //something really wrong with distribution of blocks, just use current_low_boundary to be sure that we didn't mess any transactions 
-        res_h = current_low_boundary;
-        return true;
-      }
-
-      //std::cout << "est_h:" << calculated_estimated_height << ", ts(min): " << ts / 60 << " distance to RIGHT minutes: " << int64_t((int64_t(ts) - int64_t(high_boundary))) / 60 << std::endl;
-      //std::cout << "OOFFSET: -" << offset << std::endl;
-      calculated_estimated_height -= offset;
-    }
-    else if (ts < low_boundary)
-    {
-      //we too much in past
-      current_low_boundary = calculated_estimated_height;
-      CHECK_AND_ASSERT_MES(current_height_boundary >= current_low_boundary, true,
-        "Internal error: current_hight_boundary(" << current_height_boundary << ") > current_low_boundary(" << current_low_boundary << ")");
-      uint64_t offset = (current_height_boundary - current_low_boundary) / 2;
-      if (offset <= 2)
-      {
-        //something really wrong with distribution of blocks, just use current_low_boundary to be sure that we didn't mess any transactions 
-        res_h = current_low_boundary;
-        return true;
-      }
-      //CHECK_AND_ASSERT_MES(offset > 2, true,
-      //  "offset is too low = " << offset);
+  }
+
 
-      //std::cout << "est_h:" << calculated_estimated_height << ", ts(min): " << ts / 60 << " distance to LEFT minutes: " << int64_t((int64_t(low_boundary) - int64_t(ts))) / 60 << std::endl;
-      //std::cout << "OOFFSET: +" << offset << std::endl;
-      calculated_estimated_height += offset;
+  if (date > m_db_block_headers.back()->timestamp)
+  {
+    //that suspicious but also could be(in case someone just created wallet offline in
+    //console and then got it synchronyzing and last block had a little timestamp shift)
+    //let's just return 1 day behind for safety reasons. 
+    if (m_db_blocks.size() > 1440)
+    {
+      res_h = m_db_blocks.size() - 1440;
     }
-    else
+    else 
     {
-      res_h = calculated_estimated_height;
-      break;
+      //likely impossible, but just in case
+      res_h = 0;
     }
+    return true;
   }
+  //goal is to get timestamp not later than 1 hour before target(1 hour is just to be sure that
+  //we didn't miss actual wallet start because of timestamp and difficulty fluctuations):
+  //the highest height that all blocks up to it (inclusive) have timestamps before that
+  uint64_t high_boundary = date - 3600; //1 hour
+  uint64_t h = get_first_height_with_max_timestamp_not_less(high_boundary + 1);
+  res_h = h == 0 ? 0 : h - 1;
 
-  LOG_PRINT_L0("[get_est_height_from_date] returned " << calculated_estimated_height << " with " << iteration_coun << " iterations");
+  LOG_PRINT_L1("[get_est_height_from_date] returned " << res_h);
   return true;
 }
 //------------------------------------------------------------------
@@ -3596,7 +4243,7 @@ bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash
   return true;
 }
 //------------------------------------------------------------------
-bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, blocks_direct_container& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count, uint64_t minimum_height)const
+bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, blocks_direct_container& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count, uint64_t minimum_height, std::vector<crypto::hash>* pblock_ids)const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
   if (!find_blockchain_supplement(qblock_ids, start_height))
@@ -3614,6 +4261,8 @@ bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash
     get_transactions_direct(m_db_blocks[i]->bl.tx_hashes, blocks.back().second, mis);
     CHECK_AND_ASSERT_MES(!mis.size(), false, "internal error, block " << get_block_hash(m_db_blocks[i]->bl) << " [" << i << "] contains missing transactions: " << mis);
     blocks.back().third = m_db_transactions.find(get_transaction_hash(m_db_blocks[i]->bl.miner_tx));
+    if (pblock_ids)
+      pblock_ids->push_back(m_db_block_headers[i]->id);
   }
   return true;
 }
@@ -3692,24 +4341,25 @@ bool blockchain_storage::push_transaction_to_global_outs_index(const transaction
   {
     VARIANT_SWITCH_BEGIN(otv);
     VARIANT_CASE_CONST(tx_out_bare, ot)
-      if (ot.target.type() == typeid(txout_to_key) || ot.target.type() == typeid(txout_htlc))
+      if (tools::is_variant_type<txout_to_key>(ot.target) || tools::is_variant_type<txout_htlc>(ot.target))
       {
         m_db_outputs.push_back_item(ot.amount, global_output_entry::construct(tx_id, output_index));
         global_indexes.push_back(m_db_outputs.get_item_size(ot.amount) - 1);
 
         // TODO: CZ, consider removing this check
-        if (ot.target.type() == typeid(txout_htlc) && !is_hardfork_active(3))
+        if (tools::is_variant_type<txout_htlc>(ot.target) && !is_hardfork_active(3))
         {
           LOG_ERROR("Error: Transaction with txout_htlc before hardfork 3 (before height " << m_core_runtime_config.hard_forks.get_str_height_the_hardfork_active_after(3) << ")");
           return false;
         }
       }
-      else if (ot.target.type() == typeid(txout_multisig))
+      else if (tools::is_variant_type<txout_multisig>(ot.target))
       {
         crypto::hash multisig_out_id = get_multisig_out_id(tx, output_index);
         CHECK_AND_ASSERT_MES(multisig_out_id != null_hash, false, "internal error during handling get_multisig_out_id() with tx id " << tx_id);
         CHECK_AND_ASSERT_MES(!m_db_multisig_outs.find(multisig_out_id), false, "Internal error: already have multisig_out_id " << multisig_out_id << "in multisig outs index");
         m_db_multisig_outs.set(multisig_out_id, ms_output_entry::construct(tx_id, output_index));
+        add_to_ids_filter(multisig_out_id);
         global_indexes.push_back(0); // just stub to make other code easier
       }
     VARIANT_CASE_CONST(tx_out_zarcanum, toz)
@@ -3744,14 +4394,14 @@ bool blockchain_storage::get_outs(uint64_t amount, std::list<crypto::public_key>
     auto tx_ptr = m_db_transactions.find(out_entry_ptr->tx_id);
     CHECK_AND_ASSERT_MES(tx_ptr, false, "transactions outs global index consistency broken: can't find tx " << out_entry_ptr->tx_id << " in DB, for amount: " << amount << ", gindex: " << i);
     CHECK_AND_ASSERT_MES(tx_ptr->tx.vout.size() > out_entry_ptr->out_no, false, "transactions outs global index consistency broken: index in tx_outx == " << out_entry_ptr->out_no << " is greather than tx.vout size == " << tx_ptr->tx.vout.size() << ", for amount: " << amount << ", gindex: " << i);
-    //CHECK_AND_ASSERT_MES(tx_ptr->tx.vout[out_entry_ptr->out_no].target.type() == typeid(txout_to_key), false, "transactions outs global index consistency broken: out #" << out_entry_ptr->out_no << " in tx " << out_entry_ptr->tx_id << " has wrong type, for amount: " << amount << ", gindex: " << i);
+    //CHECK_AND_ASSERT_MES(tools::is_variant_type<txout_to_key>(tx_ptr->tx.vout[out_entry_ptr->out_no].target), false, "transactions outs global index consistency broken: out #" << out_entry_ptr->out_no << " in tx " << out_entry_ptr->tx_id << " has wrong type, for amount: " << amount << ", gindex: " << i);
     VARIANT_SWITCH_BEGIN(tx_ptr->tx.vout[out_entry_ptr->out_no]);
     VARIANT_CASE_CONST(tx_out_bare, o)
-      if (o.target.type() == typeid(txout_to_key))
+      if (tools::is_variant_type<txout_to_key>(o.target))
       {
         pkeys.push_back(boost::get<txout_to_key>(o.target).key);
       }
-      else if (o.target.type() == typeid(txout_htlc))
+      else if (tools::is_variant_type<txout_htlc>(o.target))
       {
         pkeys.push_back(boost::get<txout_htlc>(o.target).pkey_redeem);
       }
@@ -3775,6 +4425,8 @@ bool blockchain_storage::pop_transaction_from_global_index(const transaction& tx
     CHECK_AND_ASSERT_MES(back_item->tx_id == tx_id, false, "transactions outs global index consistency broken: tx id missmatch");
     CHECK_AND_ASSERT_MES(back_item->out_no == i, false, "transactions outs global index consistency broken: in transaction index missmatch");
     m_db_outputs.pop_back_item(amount);
+    if (amount == 0)
+      m_zc_outputs_index.truncate(sz - 1);
     return true;
   };
 
@@ -3783,12 +4435,12 @@ bool blockchain_storage::pop_transaction_from_global_index(const transaction& tx
   {
     VARIANT_SWITCH_BEGIN(otv);
     VARIANT_CASE_CONST(tx_out_bare, ot)
-      if (ot.target.type() == typeid(txout_to_key) || ot.target.type() == typeid(txout_htlc))
+      if (tools::is_variant_type<txout_to_key>(ot.target) || tools::is_variant_type<txout_htlc>(ot.target))
       {
         if (!do_pop_output(i, ot.amount))
           return false;
       }
-      else if (ot.target.type() == typeid(txout_multisig))
+      else if (tools::is_variant_type<txout_multisig>(ot.target))
       {
         crypto::hash multisig_out_id = get_multisig_out_id(tx, i);
         CHECK_AND_ASSERT_MES(multisig_out_id != null_hash, false, "internal error during handling get_multisig_out_id() with tx id " << tx_id);
@@ -3805,6 +4457,272 @@ bool blockchain_storage::pop_transaction_from_global_index(const transaction& tx
   return true;
 }
 //------------------------------------------------------------------
+static bool fill_zc_output_index_entry(const transaction& tx, size_t out_no, uint64_t keeper_block_height, bool spent, zc_output_index_entry& entry)
+{
+  CHECK_AND_ASSERT_MES(out_no < tx.vout.size(), false, "out_no " << out_no << " is out of bounds, vout size: " << tx.vout.size());
+  entry = zc_output_index_entry();
+  entry.keeper_block_height = keeper_block_height;
+  entry.unlock_time = get_tx_unlock_time(tx, out_no);
+  if (spent)
+    entry.flags |= ZC_OUTPUT_INDEX_ENTRY_FLAG_SPENT;
+
+  VARIANT_SWITCH_BEGIN(tx.vout[out_no]);
+  VARIANT_CASE_CONST(tx_out_bare, o)
+    CHECK_AND_ASSERT_MES(o.amount == 0, false, "bare output with nonzero amount can't be in zc outputs index");
+    entry.flags |= ZC_OUTPUT_INDEX_ENTRY_FLAG_BARE;
+  VARIANT_CASE_CONST(tx_out_zarcanum, toz)
+    entry.stealth_address   = toz.stealth_address;
+    entry.concealing_point  = toz.concealing_point;
+    entry.amount_commitment = toz.amount_commitment;
+    entry.blinded_asset_id  = toz.blinded_asset_id;
+    entry.mix_attr          = toz.mix_attr;
+    if (is_coinbase(tx))
+    {
+      entry.flags |= ZC_OUTPUT_INDEX_ENTRY_FLAG_COINBASE;
+      if (is_pos_coinbase(tx))
+        entry.flags |= ZC_OUTPUT_INDEX_ENTRY_FLAG_POS_COINBASE;
+    }
+  VARIANT_CASE_OTHER()
+    LOG_ERROR("unexpected output type in zc outputs index: " << tx.vout[out_no].type().name());
+    return false;
+  VARIANT_SWITCH_END();
+  return true;
+}
+//------------------------------------------------------------------
+// the same for bare outputs with nonzero amount, they're kept only in decoy_outputs_cache
+static bool fill_bare_output_decoy_entry(const transaction& tx, size_t out_no, uint64_t keeper_block_height, bool spent, zc_output_index_entry& entry)
+{
+  CHECK_AND_ASSERT_MES(out_no < tx.vout.size(), false, "out_no " << out_no << " is out of bounds, vout size: " << tx.vout.size());
+  entry = zc_output_index_entry();
+  entry.keeper_block_height = keeper_block_height;
+  entry.unlock_time = get_tx_unlock_time(tx, out_no);
+  if (spent)
+    entry.flags |= ZC_OUTPUT_INDEX_ENTRY_FLAG_SPENT;
+
+  VARIANT_SWITCH_BEGIN(tx.vout[out_no]);
+  VARIANT_CASE_CONST(tx_out_bare, o)
+    CHECK_AND_ASSERT_MES(o.amount != 0, false, "unexpected amount == 0 for tx_out_bare");
+    if (tools::is_variant_type<txout_to_key>(o.target))
+    {
+      const txout_to_key& otk = boost::get<txout_to_key>(o.target);
+      entry.stealth_address = otk.key;
+      entry.mix_attr        = otk.mix_attr;
+    }
+    else
+    {
+      CHECK_AND_ASSERT_MES(tools::is_variant_type<txout_htlc>(o.target), false, "unexpected out target type: " << o.target.type().name());
+      entry.flags |= ZC_OUTPUT_INDEX_ENTRY_FLAG_BARE; // htlc is never used as a decoy
+    }
+  VARIANT_CASE_OTHER()
+    LOG_ERROR("unexpected output type for nonzero amount: " << tx.vout[out_no].type().name());
+    return false;
+  VARIANT_SWITCH_END();
+  return true;
+}
+//------------------------------------------------------------------
+void blockchain_storage::push_transaction_to_zc_outputs_index(const transaction_chain_entry& tce)
+{
+  if (!m_zc_outputs_index.is_open())
+    return;
+
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  CHECK_AND_ASSERT_MES_NO_RET(tce.m_global_output_indexes.size() == tce.tx.vout.size() && tce.m_spent_flags.size() == tce.tx.vout.size(), "internal error: wrong global indexes or spent flags size for zc outputs index");
+  for (size_t i = 0; i != tce.tx.vout.size(); ++i)
+  {
+    const tx_out_v& out_v = tce.tx.vout[i];
+    bool in_amount_zero_bucket = tools::is_variant_type<tx_out_zarcanum>(out_v);
+    if (tools::is_variant_type<tx_out_bare>(out_v))
+    {
+      const tx_out_bare& ot = boost::get<tx_out_bare>(out_v);
+      in_amount_zero_bucket = ot.amount == 0 && (tools::is_variant_type<txout_to_key>(ot.target) || tools::is_variant_type<txout_htlc>(ot.target));
+    }
+    if (!in_amount_zero_bucket)
+      continue;
+
+    uint64_t gindex = tce.m_global_output_indexes[i];
+    if (m_zc_outputs_index.writer_size() != gindex)
+    {
+      // the index fell behind (or ahead of) the outputs container, e.g. after a nested tx abort
+      m_zc_outputs_index.truncate(gindex);
+      if (!sync_zc_outputs_index(gindex))
+      {
+        LOG_PRINT_YELLOW("zc outputs index couldn't be caught up to gindex " << gindex << ", it stays at " << m_zc_outputs_index.writer_size(), LOG_LEVEL_0);
+        return;
+      }
+    }
+
+    zc_output_index_entry entry = AUTO_VAL_INIT(entry);
+    if (!fill_zc_output_index_entry(tce.tx, i, tce.m_keeper_block_height, tce.m_spent_flags[i], entry) || !m_zc_outputs_index.push_back(gindex, entry))
+    {
+      LOG_PRINT_YELLOW("failed to add gindex " << gindex << " to zc outputs index, it stays at " << m_zc_outputs_index.writer_size(), LOG_LEVEL_0);
+      return;
+    }
+  }
+}
+//------------------------------------------------------------------
+bool blockchain_storage::get_zc_output_index_entry_from_db(uint64_t gindex, zc_output_index_entry& entry) const
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  auto out_ptr = m_db_outputs.get_subitem(0, gindex);
+  CHECK_AND_ASSERT_MES(out_ptr, false, "internal error: gindex " << gindex << " for amount 0 was not found in outputs index");
+  auto tx_ptr = m_db_transactions.find(out_ptr->tx_id);
+  CHECK_AND_ASSERT_MES(tx_ptr, false, "internal error: transaction " << out_ptr->tx_id << " was not found in transaction DB, gindex: " << gindex);
+  CHECK_AND_ASSERT_MES(tx_ptr->m_spent_flags.size() > out_ptr->out_no, false, "internal error: out_no " << out_ptr->out_no << " is out of spent flags bounds for tx " << out_ptr->tx_id);
+  return fill_zc_output_index_entry(tx_ptr->tx, out_ptr->out_no, tx_ptr->m_keeper_block_height, tx_ptr->m_spent_flags[out_ptr->out_no], entry);
+}
+//------------------------------------------------------------------
+bool blockchain_storage::get_decoy_output_entry(uint64_t amount, uint64_t gindex, uint64_t cache_generation, zc_output_index_entry& entry) const
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  if (amount == 0)
+  {
+    const zc_output_index_entry* p_entry = m_zc_outputs_index.get(gindex);
+    if (p_entry)
+    {
+      entry = *p_entry;
+      return true;
+    }
+  }
+  if (m_decoy_outputs_cache.get(amount, gindex, entry))
+    return true;
+
+  if (amount == 0)
+  {
+    if (!get_zc_output_index_entry_from_db(gindex, entry))
+      return false;
+  }
+  else
+  {
+    auto out_ptr = m_db_outputs.get_subitem(amount, gindex);
+    CHECK_AND_ASSERT_MES(out_ptr, false, "internal error: gindex " << gindex << " for amount " << print_money_brief(amount) << " was not found in outputs index");
+    auto tx_ptr = m_db_transactions.find(out_ptr->tx_id);
+    CHECK_AND_ASSERT_MES(tx_ptr, false, "internal error: transaction " << out_ptr->tx_id << " was not found in transaction DB, amount: " << print_money_brief(amount) << ", g_index: " << gindex);
+    CHECK_AND_ASSERT_MES(tx_ptr->tx.vout.size() > out_ptr->out_no, false, "internal error: in global outs index, transaction out index="
+      << out_ptr->out_no << " is greater than transaction outputs = " << tx_ptr->tx.vout.size() << ", for tx id = " << out_ptr->tx_id);
+    CHECK_AND_ASSERT_MES(tx_ptr->m_spent_flags.size() == tx_ptr->tx.vout.size(), false, "internal error: spent_flag.size()=" << tx_ptr->m_spent_flags.size() << ", tx.vout.size()=" << tx_ptr->tx.vout.size());
+    if (!fill_bare_output_decoy_entry(tx_ptr->tx, out_ptr->out_no, tx_ptr->m_keeper_block_height, tx_ptr->m_spent_flags[out_ptr->out_no], entry))
+      return false;
+  }
+  m_decoy_outputs_cache.set(cache_generation, amount, gindex, entry);
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::sync_zc_outputs_index(uint64_t up_to_gindex)
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  uint64_t outs_count = m_db_outputs.get_item_size(0);
+  CHECK_AND_ASSERT_MES(up_to_gindex <= outs_count, false, "zc outputs index can't be synced up to " << up_to_gindex << ", amount 0 outputs count: " << outs_count);
+  for (uint64_t gindex = m_zc_outputs_index.writer_size(); gindex < up_to_gindex; ++gindex)
+  {
+    zc_output_index_entry entry = AUTO_VAL_INIT(entry);
+    if (!get_zc_output_index_entry_from_db(gindex, entry))
+      return false;
+    CHECK_AND_ASSERT_MES(m_zc_outputs_index.push_back(gindex, entry), false, "failed to push gindex " << gindex << " to zc outputs index");
+    if (gindex != 0 && gindex % 100000 == 0)
+      LOG_PRINT_L0("zc outputs index: " << gindex << " / " << up_to_gindex);
+  }
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::init_zc_outputs_index(const std::string& db_folder_path)
+{
+  const std::string filename = db_folder_path + "/" BLOCKCHAIN_STORAGE_ZC_OUTPUTS_INDEX_FILENAME;
+  std::string reason;
+  bool r = m_zc_outputs_index.init(filename, BLOCKCHAIN_STORAGE_ZC_OUTPUTS_INDEX_SIGNATURE, &reason);
+  if (!reason.empty())
+    LOG_PRINT_YELLOW("zc outputs index " << filename << ": " << reason, LOG_LEVEL_0);
+  CHECK_AND_ASSERT_MES(r, false, "failed to open zc outputs index " << filename);
+
+  uint64_t outs_count = m_db_outputs.get_item_size(0);
+  if (m_zc_outputs_index.size() > outs_count)
+  {
+    LOG_PRINT_YELLOW("zc outputs index is ahead of the db: " << m_zc_outputs_index.size() << " > " << outs_count << ", truncated", LOG_LEVEL_0);
+    m_zc_outputs_index.truncate(outs_count);
+  }
+
+  // the file is not covered by db transactions, so make sure the latest entries match the db after a possible crash
+  uint64_t index_size = m_zc_outputs_index.size();
+  for (uint64_t gindex = index_size > BLOCKCHAIN_STORAGE_ZC_OUTPUTS_INDEX_VERIFY_TAIL ? index_size - BLOCKCHAIN_STORAGE_ZC_OUTPUTS_INDEX_VERIFY_TAIL : 0; gindex != index_size; ++gindex)
+  {
+    zc_output_index_entry entry = AUTO_VAL_INIT(entry);
+    CHECK_AND_ASSERT_MES(get_zc_output_index_entry_from_db(gindex, entry), false, "failed to get zc outputs index entry from the db for gindex " << gindex);
+    if (memcmp(&entry, m_zc_outputs_index.get(gindex), sizeof entry) != 0)
+    {
+      LOG_PRINT_YELLOW("zc outputs index doesn't match the db at gindex " << gindex << ", truncated", LOG_LEVEL_0);
+      m_zc_outputs_index.truncate(gindex);
+      break;
+    }
+  }
+
+  if (m_zc_outputs_index.size() < outs_count)
+  {
+    LOG_PRINT_L0("Building zc outputs index: " << m_zc_outputs_index.size() << " -> " << outs_count << "...");
+    CHECK_AND_ASSERT_MES(sync_zc_outputs_index(outs_count), false, "failed to build zc outputs index");
+    m_zc_outputs_index.flush();
+  }
+
+  LOG_PRINT_L0("zc outputs index loaded: " << m_zc_outputs_index.size() << " entries");
+  return true;
+}
+//------------------------------------------------------------------
+void blockchain_storage::init_spent_keys_filter()
+{
+  uint64_t spent_keys_count = m_db_spent_keys.size();
+  m_spent_keys_filter.reset(std::max<uint64_t>(2 * spent_keys_count, BLOCKCHAIN_STORAGE_SPENT_KEYS_FILTER_MIN_CAPACITY), crypto::rand<uint64_t>());
+  TIME_MEASURE_START_MS(filter_time);
+  m_db_spent_keys.enumerate_keys([&](uint64_t i, const crypto::key_image& ki)
+  {
+    m_spent_keys_filter.insert(ki);
+    return true;
+  });
+  TIME_MEASURE_FINISH_MS(filter_time);
+  LOG_PRINT_L0("Spent key images filter built: " << m_spent_keys_filter.get_count() << " key images, capacity " << m_spent_keys_filter.get_capacity()
+    << ", " << m_spent_keys_filter.get_memory_size() / (1024 * 1024) << " MB, " << filter_time << " ms");
+}
+//------------------------------------------------------------------
+void blockchain_storage::init_ids_filter() const
+{
+  // m_read_lock keeps the writers, which add to the filter under it, away while it's being reset and filled
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  if (m_ids_filter_ready)
+    return;
+  uint64_t ids_count = m_db_blocks_index.size() + m_db_transactions.size() + m_db_multisig_outs.size();
+  m_ids_filter.reset(std::max<uint64_t>(2 * ids_count, BLOCKCHAIN_STORAGE_IDS_FILTER_MIN_CAPACITY), crypto::rand<uint64_t>());
+  TIME_MEASURE_START_MS(filter_time);
+  m_db_blocks_index.enumerate_keys([&](uint64_t i, const crypto::hash& id)
+  {
+    m_ids_filter.insert(id);
+    return true;
+  });
+  m_db_transactions.enumerate_keys([&](uint64_t i, const crypto::hash& id)
+  {
+    m_ids_filter.insert(id);
+    return true;
+  });
+  m_db_multisig_outs.enumerate_keys([&](uint64_t i, const crypto::hash& id)
+  {
+    m_ids_filter.insert(id);
+    return true;
+  });
+  TIME_MEASURE_FINISH_MS(filter_time);
+  m_ids_filter_ready = true;
+  LOG_PRINT_L0("Ids filter built: " << m_ids_filter.get_count() << " ids, capacity " << m_ids_filter.get_capacity()
+    << ", " << m_ids_filter.get_memory_size() / (1024 * 1024) << " MB, " << filter_time << " ms");
+}
+//------------------------------------------------------------------
+void blockchain_storage::add_to_ids_filter(const crypto::hash& id)
+{
+  // until the first search the filter is empty and this does nothing
+  m_ids_filter.insert(id);
+}
+//------------------------------------------------------------------
+bool blockchain_storage::is_key_image_maybe_spent(const crypto::key_image& ki) const
+{
+  // false negatives are impossible: every key image is added to the filter before it's written to the db;
+  // once loaded with twice the capacity the filter says yes to everything and gets rebuilt on the next start
+  return m_spent_keys_filter.may_contain(ki);
+}
+//------------------------------------------------------------------
 bool blockchain_storage::unprocess_blockchain_tx_extra(const transaction& tx)
 {
   tx_extra_info ei = AUTO_VAL_INIT(ei);
@@ -3847,6 +4765,29 @@ uint64_t blockchain_storage::get_aliases_count() const
   return m_db_aliases.size();
 }
 //------------------------------------------------------------------
+void blockchain_storage::update_aliases_index() const
+{
+  // the caller holds m_read_lock and m_aliases_index_lock
+  uint64_t version = m_aliases_version;
+  if (m_aliases_index_version == version)
+    return;
+
+  m_aliases_index.clear();
+  m_aliases_index.reserve(m_db_aliases.size());
+  m_db_aliases.enumerate_keys([&](uint64_t i, const std::string& alias)
+  {
+    m_aliases_index.push_back(alias);
+    return true;
+  });
+  std::sort(m_aliases_index.begin(), m_aliases_index.end()); // the same order as in the db, but the backend doesn't promise it
+  m_aliases_index_version = version;
+}
+//------------------------------------------------------------------
+uint64_t blockchain_storage::get_aliases_version() const
+{
+  return m_aliases_version;
+}
+//------------------------------------------------------------------
 bool blockchain_storage::get_asset_history(const crypto::public_key& asset_id, std::list<asset_descriptor_operation>& result) const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
@@ -3861,40 +4802,120 @@ bool blockchain_storage::get_asset_history(const crypto::public_key& asset_id, s
 bool blockchain_storage::get_asset_info(const crypto::public_key& asset_id, asset_descriptor_base& result) const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
-  auto as_ptr = m_db_assets.find(asset_id);
-  if (as_ptr)
+  CRITICAL_REGION_LOCAL1(m_assets_index_lock);
+  update_assets_index();
+  auto it = m_assets_index.find(asset_id);
+  if (it == m_assets_index.end())
+    return false;
+  result = it->second;
+  return true;
+}
+//------------------------------------------------------------------
+uint64_t blockchain_storage::get_assets(uint64_t offset, uint64_t count, std::list<asset_descriptor_with_id>& assets, const std::string& ticker_prefix /* = std::string() */) const
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  CRITICAL_REGION_LOCAL1(m_assets_index_lock);
+  update_assets_index();
+  assets.clear();
+
+  auto add_asset = [&](const crypto::public_key& asset_id)
   {
-    if (as_ptr->size())
+    auto it = m_assets_index.find(asset_id);
+    CHECK_AND_ASSERT_THROW_MES(it != m_assets_index.end(), "internal error: asset " << asset_id << " is missing in the assets index");
+    assets.push_back(asset_descriptor_with_id());
+    static_cast<asset_descriptor_base&>(assets.back()) = it->second;
+    assets.back().asset_id = asset_id;
+  };
+
+  if (ticker_prefix.empty())
+  {
+    // in the order of asset ids, i.e. the same as the db enumerates them
+    for (size_t i = static_cast<size_t>(std::min<uint64_t>(offset, m_assets_index_ids.size())); i < m_assets_index_ids.size() && assets.size() < count; ++i)
+      add_asset(m_assets_index_ids[i]);
+  }
+  else
+  {
+    for (auto it = m_assets_index_tickers.lower_bound(ticker_prefix); it != m_assets_index_tickers.end() && assets.size() < count && it->first.compare(0, ticker_prefix.size(), ticker_prefix) == 0; ++it)
     {
-      result = as_ptr->back().descriptor;
-      return true;
+      if (offset != 0)
+        --offset;
+      else
+        add_asset(it->second);
     }
   }
-  return false;
+  return assets.size();
 }
 //------------------------------------------------------------------
-uint64_t blockchain_storage::get_assets(uint64_t offset, uint64_t count, std::list<asset_descriptor_with_id>& assets) const
+void blockchain_storage::on_asset_changed(const crypto::public_key& asset_id)
 {
-  CRITICAL_REGION_LOCAL(m_read_lock);
-  assets.clear();
-  m_db_assets.enumerate_items([&](uint64_t i, const crypto::public_key& asset_id, const std::list<asset_descriptor_operation>& asset_descriptor_history)
+  CRITICAL_REGION_LOCAL(m_assets_index_lock);
+  m_assets_index_dirty.insert(asset_id);
+}
+//------------------------------------------------------------------
+void blockchain_storage::update_assets_index() const
+{
+  // the caller holds m_read_lock and m_assets_index_lock
+  auto less_id = [](const crypto::public_key& lhs, const crypto::public_key& rhs) { return memcmp(&lhs, &rhs, sizeof lhs) < 0; };
+  auto erase_ticker = [&](const std::string& ticker, const crypto::public_key& asset_id)
   {
-    if (i < offset)
+    auto range = m_assets_index_tickers.equal_range(ticker);
+    for (auto it = range.first; it != range.second; ++it)
     {
-      return true;
+      if (it->second == asset_id)
+      {
+        m_assets_index_tickers.erase(it);
+        break;
+      }
     }
+  };
 
-    CHECK_AND_ASSERT_THROW_MES(asset_descriptor_history.size(), "asset_descriptor_history unexpectedly have 0 size");
-    assets.push_back(asset_descriptor_with_id());
-    static_cast<asset_descriptor_base&>(assets.back()) = asset_descriptor_history.back().descriptor;
-    assets.back().asset_id = asset_id;
-    if (assets.size() >= count)
+  if (!m_assets_index_valid)
+  {
+    m_assets_index.clear();
+    m_assets_index_ids.clear();
+    m_assets_index_tickers.clear();
+    m_db_assets.enumerate_items([&](uint64_t i, const crypto::public_key& asset_id, const std::list<asset_descriptor_operation>& asset_descriptor_history)
     {
-      return false;
+      if (!asset_descriptor_history.empty())
+      {
+        m_assets_index[asset_id] = asset_descriptor_history.back().descriptor;
+        m_assets_index_ids.push_back(asset_id);
+        m_assets_index_tickers.emplace(asset_descriptor_history.back().descriptor.ticker, asset_id);
+      }
+      return true;
+    });
+    std::sort(m_assets_index_ids.begin(), m_assets_index_ids.end(), less_id);
+    m_assets_index_dirty.clear();
+    m_assets_index_valid = true;
+    return;
+  }
+
+  // the changed assets are read again from the db, so an aborted db transaction leaves nothing stale here
+  for (const crypto::public_key& asset_id : m_assets_index_dirty)
+  {
+    auto it = m_assets_index.find(asset_id);
+    if (it != m_assets_index.end())
+      erase_ticker(it->second.ticker, asset_id);
+    auto it_id = std::lower_bound(m_assets_index_ids.begin(), m_assets_index_ids.end(), asset_id, less_id);
+    bool id_indexed = it_id != m_assets_index_ids.end() && *it_id == asset_id;
+
+    auto asset_history_ptr = m_db_assets.find(asset_id);
+    if (asset_history_ptr && !asset_history_ptr->empty())
+    {
+      m_assets_index[asset_id] = asset_history_ptr->back().descriptor;
+      m_assets_index_tickers.emplace(asset_history_ptr->back().descriptor.ticker, asset_id);
+      if (!id_indexed)
+        m_assets_index_ids.insert(it_id, asset_id);
     }
-    return true;
-  });
-  return assets.size();
+    else
+    {
+      if (it != m_assets_index.end())
+        m_assets_index.erase(it);
+      if (id_indexed)
+        m_assets_index_ids.erase(it_id);
+    }
+  }
+  m_assets_index_dirty.clear();
 }
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_assets_count() const
@@ -3928,6 +4949,7 @@ std::set<std::string> blockchain_storage::get_aliases_by_address(const account_p
 bool blockchain_storage::pop_alias_info(const extra_alias_entry& ai)
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
+  ++m_aliases_version;
 
   CHECK_AND_ASSERT_MES(ai.m_alias.size(), false, "empty name in pop_alias_info");
   auto alias_history_ptr = m_db_aliases.find(ai.m_alias);
@@ -3984,6 +5006,7 @@ bool blockchain_storage::pop_alias_info(const extra_alias_entry& ai)
 bool blockchain_storage::put_alias_info(const transaction & tx, extra_alias_entry & ai)
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
+  ++m_aliases_version;
 
   CHECK_AND_ASSERT_MES(ai.m_alias.size(), false, "empty name in put_alias_info");
   aliases_container::t_value_type local_alias_history = AUTO_VAL_INIT(local_alias_history);
@@ -4091,6 +5114,7 @@ bool blockchain_storage::pop_asset_info(const crypto::public_key& asset_id)
 
   auto asset_history_ptr = m_db_assets.find(asset_id);
   CHECK_AND_ASSERT_MES(asset_history_ptr && asset_history_ptr->size(), false, "empty name list in pop_asset_info");
+  on_asset_changed(asset_id);
 
   assets_container::t_value_type local_asset_hist = *asset_history_ptr;
   local_asset_hist.pop_back();
@@ -4103,7 +5127,7 @@ bool blockchain_storage::pop_asset_info(const crypto::public_key& asset_id)
   return true;
 }
 //------------------------------------------------------------------
-bool validate_ado_ownership(asset_op_verification_context& avc)
+bool validate_ado_ownership(asset_op_verification_context& avc, crypto::point_precomp_cache& owner_keys_precomp)
 {
   asset_operation_ownership_proof aoop = AUTO_VAL_INIT(aoop);
   bool r = get_type_in_variant_container(avc.tx.proofs, aoop);
@@ -4112,6 +5136,9 @@ bool validate_ado_ownership(asset_op_verification_context& avc)
   CHECK_AND_ASSERT_MES(avc.asset_op_history->size() != 0, false, "asset with id " << avc.asset_id << " has invalid history size() == 0");
 
   crypto::public_key owner_key = avc.asset_op_history->back().descriptor.owner;
+  std::shared_ptr<const crypto::point_precomp_t> owner_key_precomp = owner_keys_precomp.get(owner_key);
+  if (owner_key_precomp)
+    return crypto::verify_schnorr_sig(avc.tx_id, owner_key, *owner_key_precomp, aoop.gss);
   return crypto::verify_schnorr_sig(avc.tx_id, owner_key, aoop.gss);
 }
 //------------------------------------------------------------------
@@ -4140,7 +5167,7 @@ bool blockchain_storage::validate_asset_operation_against_current_blochain_state
     // check ownership permission
     if (ado.operation_type == ASSET_DESCRIPTOR_OPERATION_EMIT || ado.operation_type == ASSET_DESCRIPTOR_OPERATION_UPDATE /*|| ado.operation_type == ASSET_DESCRIPTOR_OPERATION_PUBLIC_BURN*/)
     {
-      bool r = validate_ado_ownership(avc);
+      bool r = validate_ado_ownership(avc, m_asset_owner_keys_precomp);
       CHECK_AND_ASSERT_MES(r, false, "Faild to validate ownership of asset_descriptor_operation, rejecting");
     }
 
@@ -4195,6 +5222,7 @@ bool blockchain_storage::put_asset_info(const transaction& tx, const crypto::has
     local_asset_history = *avc.asset_op_history;
   local_asset_history.push_back(ado);
   m_db_assets.set(avc.asset_id, local_asset_history);
+  on_asset_changed(avc.asset_id);
 
   switch(ado.operation_type)
   {
@@ -4334,7 +5362,7 @@ bool blockchain_storage::process_blockchain_tx_attachments(const transaction& tx
 
   for (const auto& at : tx.attachment)
   {
-    if (at.type() == typeid(tx_service_attachment))
+    if (tools::is_variant_type<tx_service_attachment>(at))
     {
       m_services_mgr.handle_entry_push(boost::get<tx_service_attachment>(at), count, tx, h, bl_id, timestamp); //handle service
       ++count;
@@ -4377,19 +5405,10 @@ uint64_t blockchain_storage::get_tx_fee_window_value_median() const
   //     it's effective because it's not affect sync time and needed only when node is synced 
   //     and processing transactions
 
-  misc_utils::median_helper<uint64_t, uint64_t> mh;
-  for (uint64_t i = 0; i < CORE_FEE_BLOCKS_LOOKUP_WINDOW; i++)
-  {
-    uint64_t h = m_db_blocks.size() - 1 - i;
-    if (h >= m_db_blocks.size())
-      break;
-
-    auto block_ptr = m_db_blocks[h];
-    CHECK_AND_ASSERT_THROW_MES(block_ptr, "Unexpected missing block " << h << " in get_tx_fee_window_value_median");
-    mh.push_item(block_ptr->block_cumulative_size, 0);
-  }
-
-  return (mh.get_median() + mh.get_avg())/2;
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  CRITICAL_REGION_LOCAL1(m_median_windows_lock);
+  const blocks_median_window& w = get_actual_median_window(m_fee_lookup_sizes_median_window);
+  return (w.get_median() + w.get_avg())/2;
 }
 //------------------------------------------------------------------
 bool blockchain_storage::unprocess_blockchain_tx_attachments(const transaction& tx, uint64_t h, uint64_t timestamp)
@@ -4402,7 +5421,7 @@ bool blockchain_storage::unprocess_blockchain_tx_attachments(const transaction&
   for (auto it = tx.attachment.rbegin(); it != tx.attachment.rend(); it++)
   {
     auto& at = *it;
-    if (at.type() == typeid(tx_service_attachment))
+    if (tools::is_variant_type<tx_service_attachment>(at))
     {
       m_services_mgr.handle_entry_pop(boost::get<tx_service_attachment>(at), cnt_serv_attach, tx, h, timestamp);
       --cnt_serv_attach;
@@ -4445,6 +5464,7 @@ namespace currency
         return false;
       }
       m_db_spent_keys.set(ki, m_bl_height);
+      m_bcs.m_spent_keys_filter.insert(ki);
 
       if (key_offsets.size() == 1)
       {
@@ -4557,11 +5577,13 @@ bool blockchain_storage::add_transaction_from_block(const transaction& tx, const
   ch_e.tx = tx;
   r = push_transaction_to_global_outs_index(tx, tx_id, ch_e.m_global_output_indexes);
   CHECK_AND_ASSERT_MES(r, false, "failed to return push_transaction_to_global_outs_index tx id " << tx_id);
+  push_transaction_to_zc_outputs_index(ch_e);
   TIME_MEASURE_FINISH_PD_COND(need_to_profile, tx_push_global_index);
   
   //store everything to db
   TIME_MEASURE_START_PD(tx_store_db);
   m_db_transactions.set(tx_id, ch_e);
+  add_to_ids_filter(tx_id);
   TIME_MEASURE_FINISH_PD_COND(need_to_profile, tx_store_db);
 
   TIME_MEASURE_START_PD(tx_print_log);
@@ -4600,13 +5622,32 @@ bool blockchain_storage::get_tx_outputs_gindexs(const crypto::hash& tx_id, std::
   return true;
 }
 //------------------------------------------------------------------
+bool blockchain_storage::get_tx_outputs_gindexs(const std::vector<crypto::hash>& tx_ids, std::vector<std::vector<uint64_t> >& indexs)const
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  std::vector<std::shared_ptr<const transaction_chain_entry> > tx_ptrs;
+  m_db_transactions.get_multiple(tx_ids, tx_ptrs);
+  indexs.resize(tx_ids.size());
+  for (size_t i = 0; i != tx_ids.size(); ++i)
+  {
+    if (!tx_ptrs[i])
+    {
+      LOG_PRINT_RED_L0("warning: get_tx_outputs_gindexs failed to find transaction with id = " << tx_ids[i]);
+      return false;
+    }
+    CHECK_AND_ASSERT_MES(tx_ptrs[i]->m_global_output_indexes.size(), false, "internal error: global indexes for transaction " << tx_ids[i] << " is empty");
+    indexs[i] = tx_ptrs[i]->m_global_output_indexes;
+  }
+  return true;
+}
+//------------------------------------------------------------------
 bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash, uint64_t& max_used_block_height, crypto::hash& max_used_block_id) const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
   bool res = check_tx_inputs(tx, tx_prefix_hash, max_used_block_height);
   if(!res) return false;
   CHECK_AND_ASSERT_MES(max_used_block_height < m_db_blocks.size(), false,  "internal error: max used block index=" << max_used_block_height << " is not less than blockchain size = " << m_db_blocks.size());
-  get_block_hash(m_db_blocks[max_used_block_height]->bl, max_used_block_id);
+  max_used_block_id = m_db_block_headers[max_used_block_height]->id;
   return true;
 }
 //------------------------------------------------------------------
@@ -4763,7 +5804,7 @@ bool blockchain_storage::print_tx_outputs_lookup(const crypto::hash& tx_id)const
     VARIANT_SWITCH_BEGIN(tx_ptr->tx.vout[i]);
     VARIANT_CASE_CONST(tx_out_bare, o)
       strm_tx << "[" << i << "]: " << print_money(o.amount) << ENDL;
-      if (o.target.type() != typeid(currency::txout_to_key))
+      if (!tools::is_variant_type<currency::txout_to_key>(o.target))
         continue;
       usage_stat[o.amount][tx_ptr->m_global_output_indexes[i]];
     VARIANT_CASE_CONST(tx_out_zarcanum, toz)
@@ -4781,7 +5822,7 @@ bool blockchain_storage::print_tx_outputs_lookup(const crypto::hash& tx_id)const
       auto block_tx_ptr = m_db_transactions.find(block_tx_id);
       for (auto txi_in : block_tx_ptr->tx.vin)
       {
-        if(txi_in.type() != typeid(currency::txin_to_key))
+        if(!tools::is_variant_type<currency::txin_to_key>(txi_in))
           continue;
         currency::txin_to_key& txi_in_tokey = boost::get<currency::txin_to_key>(txi_in);
         uint64_t amount = txi_in_tokey.amount;
@@ -4791,7 +5832,7 @@ bool blockchain_storage::print_tx_outputs_lookup(const crypto::hash& tx_id)const
 
         for (txout_ref_v& off : txi_in_tokey.key_offsets)
         {
-          if(off.type() != typeid(uint64_t))
+          if(!tools::is_variant_type<uint64_t>(off))
             continue;
           uint64_t index = boost::get<uint64_t>(off);
           auto index_it = amount_it->second.find(index);
@@ -4863,12 +5904,12 @@ bool blockchain_storage::have_tx_keyimges_as_spent(const transaction &tx) const
         return true;
       }        
     }
-    else if (in.type() == typeid(txin_multisig))
+    else if (tools::is_variant_type<txin_multisig>(in))
     {
       if (is_multisig_output_spent(boost::get<const txin_multisig>(in).multisig_out_id))
         return true;
     }
-    else if (in.type() == typeid(txin_gen))
+    else if (tools::is_variant_type<txin_gen>(in))
     {
       // skip txin_gen
     }
@@ -4886,11 +5927,47 @@ bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::ha
   return check_tx_inputs(tx, tx_prefix_hash, stub);
 }
 //------------------------------------------------------------------
+bool blockchain_storage::is_tx_signatures_preverified(const crypto::hash& tx_verification_key, uint64_t split_height) const
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  verified_txs_cache::entry_t e = AUTO_VAL_INIT(e);
+  if (!m_verified_txs_cache.get(tx_verification_key, e))
+    return false;
+
+  // signatures stay valid as long as all the referenced outputs are in the same place, i.e. the chain up to max_used_block_height is the same
+  if (e.max_used_block_height >= split_height || e.max_used_block_height >= m_db_blocks.size())
+    return false;
+  if (get_block_id_by_height(e.max_used_block_height) != e.max_used_block_id)
+  {
+    if (split_height == m_db_blocks.size())
+      m_verified_txs_cache.erase(tx_verification_key); // main chain has changed, entry is stale
+    return false;
+  }
+  return true;
+}
+//------------------------------------------------------------------
 bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash, uint64_t& max_used_block_height) const
 {
+  return check_tx_inputs(tx, tx_prefix_hash, max_used_block_height, nullptr);
+}
+//------------------------------------------------------------------
+bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash, uint64_t& max_used_block_height, const unconfirmed_ms_outs_map* p_unconfirmed_ms_outs) const
+{
+  TRACE_SCOPE_ARG("tx", "check_tx_inputs", tx.vin.size());
   size_t sig_index = 0;
+  bool unconfirmed_sources_used = false;
   max_used_block_height = 0;
   bool all_tx_ins_have_explicit_native_asset_ids = true;
+  crypto::CLSAG_ring_members_cache_t clsag_cache(&m_ring_members_points_cache); // ring members are often shared among inputs of the same tx and among txs
+
+  // the whole tx blob is hashed, as signatures and proofs are not covered by tx id
+  crypto::hash tx_verification_key = null_hash;
+  bool skip_signatures = false;
+  if (!m_is_in_checkpoint_zone)
+  {
+    tx_verification_key = get_blob_hash(t_serializable_object_to_blob(tx));
+    skip_signatures = is_tx_signatures_preverified(tx_verification_key, get_current_blockchain_size());
+  }
 
   auto local_check_key_image = [&](const crypto::key_image& ki) -> bool
   {
@@ -4915,7 +5992,7 @@ bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::ha
         return false;
 
       uint64_t max_unlock_time = 0;
-      if (!check_tx_input(tx, sig_index, in_to_key, tx_prefix_hash, max_used_block_height, max_unlock_time))
+      if (!check_tx_input(tx, sig_index, in_to_key, tx_prefix_hash, max_used_block_height, max_unlock_time, skip_signatures))
       {
         LOG_ERROR("Failed to validate input #" << sig_index << " tx: " << tx_prefix_hash);
         return false;
@@ -4923,7 +6000,18 @@ bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::ha
     }
     VARIANT_CASE_CONST(txin_multisig, in_ms)
     {
-      if (!check_tx_input(tx, sig_index, in_ms, tx_prefix_hash, max_used_block_height))
+      auto it_unconfirmed = p_unconfirmed_ms_outs ? p_unconfirmed_ms_outs->find(in_ms.multisig_out_id) : unconfirmed_ms_outs_map::const_iterator();
+      if (p_unconfirmed_ms_outs && it_unconfirmed != p_unconfirmed_ms_outs->end() && !has_multisig_output(in_ms.multisig_out_id))
+      {
+        // source tx is not in the blockchain yet
+        if (!check_ms_input(tx, sig_index, in_ms, tx_prefix_hash, *it_unconfirmed->second.source_tx, it_unconfirmed->second.out_n))
+        {
+          LOG_ERROR("Failed to validate multisig input #" << sig_index << " (ms out id: " << in_ms.multisig_out_id << ", unconfirmed source) in tx: " << tx_prefix_hash);
+          return false;
+        }
+        unconfirmed_sources_used = true;
+      }
+      else if (!check_tx_input(tx, sig_index, in_ms, tx_prefix_hash, max_used_block_height))
       {
         LOG_ERROR("Failed to validate multisig input #" << sig_index << " (ms out id: " << in_ms.multisig_out_id << ") in tx: " << tx_prefix_hash);
         return false;
@@ -4935,7 +6023,7 @@ bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::ha
       if (!local_check_key_image(in_htlc.k_image))
         return false;
 
-      if (!check_tx_input(tx, sig_index, in_htlc, tx_prefix_hash, max_used_block_height))
+      if (!check_tx_input(tx, sig_index, in_htlc, tx_prefix_hash, max_used_block_height, skip_signatures))
       {
         LOG_ERROR("Failed to validate htlc input #" << sig_index << " in tx: " << tx_prefix_hash << ", htlc json: " << ENDL << obj_to_json_str(in_htlc));
         return false;
@@ -4946,7 +6034,7 @@ bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::ha
       if (!local_check_key_image(in_zc.k_image))
         return false;
 
-      if (!check_tx_input(tx, sig_index, in_zc, tx_prefix_hash, max_used_block_height, all_tx_ins_have_explicit_native_asset_ids))
+      if (!check_tx_input(tx, sig_index, in_zc, tx_prefix_hash, max_used_block_height, all_tx_ins_have_explicit_native_asset_ids, &clsag_cache, skip_signatures))
       {
         LOG_ERROR("Failed to validate zc input #" << sig_index << " in tx: " << tx_prefix_hash);
         return false;
@@ -4970,6 +6058,9 @@ bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::ha
     }
 
     CHECK_AND_ASSERT_MES(check_tx_explicit_asset_id_rules(tx, all_tx_ins_have_explicit_native_asset_ids), false, "tx does not comply with explicit asset id rules");
+
+    if (!skip_signatures && !unconfirmed_sources_used && max_used_block_height < m_db_blocks.size())
+      m_verified_txs_cache.set(tx_verification_key, max_used_block_height, get_block_id_by_height(max_used_block_height));
   }
   TIME_MEASURE_FINISH_PD(tx_check_inputs_attachment_check);
   return true;
@@ -4980,7 +6071,7 @@ bool blockchain_storage::is_tx_spendtime_unlocked(uint64_t unlock_time) const
   return currency::is_tx_spendtime_unlocked(unlock_time, get_current_blockchain_size(), m_core_runtime_config.get_core_time());
 }
 //------------------------------------------------------------------
-bool blockchain_storage::check_tx_input(const transaction& tx, size_t in_index, const txin_to_key& txin, const crypto::hash& tx_prefix_hash, uint64_t& max_related_block_height, uint64_t& source_max_unlock_time_for_pos_coinbase) const
+bool blockchain_storage::check_tx_input(const transaction& tx, size_t in_index, const txin_to_key& txin, const crypto::hash& tx_prefix_hash, uint64_t& max_related_block_height, uint64_t& source_max_unlock_time_for_pos_coinbase, bool skip_signatures /* = false */) const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
 
@@ -5000,6 +6091,9 @@ bool blockchain_storage::check_tx_input(const transaction& tx, size_t in_index,
   for (auto& ptr : output_keys)
     output_keys_ptrs.push_back(&ptr);
 
+  if (skip_signatures)
+    return true;
+
   return check_input_signature(tx, in_index, txin, tx_prefix_hash, output_keys_ptrs);
 }
 //----------------------------------------------------------------
@@ -5119,7 +6213,7 @@ bool blockchain_storage::check_input_signature(const transaction& tx,
 
   CHECK_AND_ASSERT_MES(tx.signatures.size() > actual_sig_index, false, "Failed to check s.size(){" << tx.signatures.size() << "} > actual_sig_index {" << actual_sig_index <<  "}" );
   
-  CHECK_AND_ASSERT_MES(tx.signatures[actual_sig_index].type() == typeid(NLSAG_sig), false, "Unexpected type of sig in check_input_signature: " << tx.signatures[actual_sig_index].type().name());
+  CHECK_AND_ASSERT_MES(tools::is_variant_type<NLSAG_sig>(tx.signatures[actual_sig_index]), false, "Unexpected type of sig in check_input_signature: " << tx.signatures[actual_sig_index].type().name());
   const std::vector<crypto::signature>& sig = boost::get<NLSAG_sig>(tx.signatures[actual_sig_index]).s;
 
   if (get_tx_flags(tx) & TX_FLAG_SIGNATURE_MODE_SEPARATE)
@@ -5179,7 +6273,7 @@ bool blockchain_storage::check_ms_input(const transaction& tx, size_t in_index,
   LOC_CHK(is_tx_spendtime_unlocked(unlock_time), "Source transaction is LOCKED! unlock_time: " << unlock_time << ", now is " << m_core_runtime_config.get_core_time() << ", blockchain size is " << get_current_blockchain_size());
 
   LOC_CHK(source_tx.vout.size() > out_n, "internal error: out_n==" << out_n << " is out-of-bounds of source_tx.vout, size=" << source_tx.vout.size());
-  LOC_CHK(source_tx.vout[out_n].type() == typeid(tx_out_bare), "internal error: out_n==" << out_n << " has unexpected type: " << source_tx.vout[out_n].type().name());
+  LOC_CHK(tools::is_variant_type<tx_out_bare>(source_tx.vout[out_n]), "internal error: out_n==" << out_n << " has unexpected type: " << source_tx.vout[out_n].type().name());
 
   const tx_out_bare& source_tx_out = boost::get<tx_out_bare>(source_tx.vout[out_n]);
   const txout_multisig& source_ms_out_target = boost::get<txout_multisig>(source_tx_out.target);
@@ -5287,8 +6381,8 @@ bool blockchain_storage::check_tx_input(const transaction& tx, size_t in_index,
   auto source_tx_ptr = m_db_transactions.find(source_tx_id);
   LOC_CHK(source_tx_ptr, "Can't find source transaction");
   LOC_CHK(source_tx_ptr->tx.vout.size() > n, "ms output index is incorrect, source tx's vout size is " << source_tx_ptr->tx.vout.size());
-  LOC_CHK(source_tx_ptr->tx.vout[n].type() == typeid(tx_out_bare), "internal error: out_n==" << n << " has unexpected type: " << source_tx_ptr->tx.vout[n].type().name());
-  LOC_CHK(boost::get<tx_out_bare>(source_tx_ptr->tx.vout[n]).target.type() == typeid(txout_multisig), "ms output has wrong type, txout_multisig expected");
+  LOC_CHK(tools::is_variant_type<tx_out_bare>(source_tx_ptr->tx.vout[n]), "internal error: out_n==" << n << " has unexpected type: " << source_tx_ptr->tx.vout[n].type().name());
+  LOC_CHK(tools::is_variant_type<txout_multisig>(boost::get<tx_out_bare>(source_tx_ptr->tx.vout[n]).target), "ms output has wrong type, txout_multisig expected");
   LOC_CHK(source_tx_ptr->m_spent_flags.size() > n, "Internal error, m_spent_flags size (" << source_tx_ptr->m_spent_flags.size() << ") less then expected, n: " << n);
   LOC_CHK(source_tx_ptr->m_spent_flags[n] == false, "Internal error, ms output is already spent"); // should never happen as multisig_ptr->spent_height is checked above
 
@@ -5301,7 +6395,7 @@ bool blockchain_storage::check_tx_input(const transaction& tx, size_t in_index,
 #undef LOC_CHK
 } 
 //------------------------------------------------------------------
-bool blockchain_storage::check_tx_input(const transaction& tx, size_t in_index, const txin_htlc& txin, const crypto::hash& tx_prefix_hash, uint64_t& max_related_block_height)const
+bool blockchain_storage::check_tx_input(const transaction& tx, size_t in_index, const txin_htlc& txin, const crypto::hash& tx_prefix_hash, uint64_t& max_related_block_height, bool skip_signatures /* = false */)const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
 
@@ -5346,12 +6440,14 @@ bool blockchain_storage::check_tx_input(const transaction& tx, size_t in_index,
 
   CHECK_AND_ASSERT_THROW_MES(output_keys_ptrs.size() == 1, "Internal error: output_keys_ptrs.size() is not equal 1  for HTLC");
 
+  if (skip_signatures)
+    return true;
 
   return check_input_signature(tx, in_index, txin.amount, txin.k_image, txin.etc_details, tx_prefix_hash, output_keys_ptrs);
 }
 //------------------------------------------------------------------
 bool blockchain_storage::check_tx_input(const transaction& tx, size_t in_index, const txin_zc_input& zc_in, const crypto::hash& tx_prefix_hash,
-  uint64_t& max_related_block_height, bool& all_tx_ins_have_explicit_native_asset_ids) const
+  uint64_t& max_related_block_height, bool& all_tx_ins_have_explicit_native_asset_ids, crypto::CLSAG_ring_members_cache_t* p_clsag_cache /* = nullptr */, bool skip_signatures /* = false */) const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
 
@@ -5388,6 +6484,9 @@ bool blockchain_storage::check_tx_input(const transaction& tx, size_t in_index,
       all_tx_ins_have_explicit_native_asset_ids = false;
   }
 
+  if (skip_signatures)
+    return true;
+
   // calculate corresponding tx prefix hash
   crypto::hash tx_hash_for_signature = prepare_prefix_hash_for_sign(tx, in_index, tx_prefix_hash);
   CHECK_AND_ASSERT_MES(tx_hash_for_signature != null_hash, false, "prepare_prefix_hash_for_sign failed");
@@ -5396,7 +6495,7 @@ bool blockchain_storage::check_tx_input(const transaction& tx, size_t in_index,
 
   //TIME_MEASURE_START_PD(tx_input_check_clsag_ggx);
 
-  bool r = crypto::verify_CLSAG_GGX(tx_hash_for_signature, ring, sig.pseudo_out_amount_commitment, sig.pseudo_out_blinded_asset_id, zc_in.k_image, sig.clsags_ggx);
+  bool r = crypto::verify_CLSAG_GGX(tx_hash_for_signature, ring, sig.pseudo_out_amount_commitment, sig.pseudo_out_blinded_asset_id, zc_in.k_image, sig.clsags_ggx, p_clsag_cache);
   CHECK_AND_ASSERT_MES(r, false, "verify_CLSAG_GGX failed");
 
   //TIME_MEASURE_FINISH_PD(tx_input_check_clsag_ggx);
@@ -5416,21 +6515,21 @@ std::vector<uint64_t> blockchain_storage::get_last_n_blocks_timestamps(size_t n)
   std::vector<uint64_t> timestamps;
   size_t offset = m_db_blocks.size() <= n ? 0 : m_db_blocks.size() - n;
   for (; offset != m_db_blocks.size(); ++offset)
-    timestamps.push_back(m_db_blocks[offset]->bl.timestamp);
+    timestamps.push_back(m_db_block_headers[offset]->timestamp);
   return timestamps;
 }
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_last_n_blocks_timestamps_median(size_t n) const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
-  auto it = m_timestamps_median_cache.find(n);
-  if (it != m_timestamps_median_cache.end())
-    return it->second;
+  if (n == BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW || n == TX_EXPIRATION_TIMESTAMP_CHECK_WINDOW)
+  {
+    CRITICAL_REGION_LOCAL1(m_median_windows_lock);
+    return get_actual_median_window(n == BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW ? m_timestamps_median_window : m_tx_expiration_median_window).get_median();
+  }
 
   std::vector<uint64_t> timestamps = get_last_n_blocks_timestamps(n);
-  uint64_t median_res = epee::misc_utils::median(timestamps);
-  m_timestamps_median_cache[n] = median_res;
-  return median_res;
+  return epee::misc_utils::median(timestamps);
 }
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_last_timestamps_check_window_median() const
@@ -5491,6 +6590,8 @@ bool blockchain_storage::is_tx_expired(const transaction& tx) const
 std::shared_ptr<const transaction_chain_entry> blockchain_storage::find_key_image_and_related_tx(const crypto::key_image& ki, crypto::hash& id_result) const
 {
   CRITICAL_REGION_LOCAL(m_read_lock);
+  if (!is_key_image_maybe_spent(ki))
+    return std::shared_ptr<transaction_chain_entry>();
   auto ki_index_ptr = m_db_spent_keys.find(ki);
   if (!ki_index_ptr)
     return std::shared_ptr<transaction_chain_entry>();
@@ -5506,7 +6607,7 @@ std::shared_ptr<const transaction_chain_entry> blockchain_storage::find_key_imag
   //look up coinbase
   for (auto& in: block_entry->bl.miner_tx.vin)
   {
-    if (in.type() == typeid(txin_to_key))
+    if (tools::is_variant_type<txin_to_key>(in))
     {
       if (boost::get<txin_to_key>(in).k_image == ki)
       {
@@ -5572,17 +6673,36 @@ bool blockchain_storage::fill_tx_rpc_details(tx_rpc_extended_info& tei, const tr
 //------------------------------------------------------------------
 bool blockchain_storage::fill_tx_rpc_inputs(tx_rpc_extended_info& tei, const transaction& tx) const
 {
+  // ring members referenced by tx id are resolved with one db read per referenced tx, done in the order of the ids
+  // (the db is keyed by them) under one lock, instead of loading the tx entry again for each of its outputs
+  std::map<crypto::hash, std::shared_ptr<const transaction_chain_entry>> referenced_txs;
+  for (const auto& in : tx.vin)
+  {
+    if (!tools::is_variant_type<txin_to_key>(in) && !tools::is_variant_type<txin_htlc>(in) && !tools::is_variant_type<txin_zc_input>(in))
+      continue;
+    for (const auto& ko : get_key_offsets_from_txin_v(in))
+    {
+      if (tools::is_variant_type<ref_by_id>(ko))
+        referenced_txs.emplace(boost::get<ref_by_id>(ko).tx_id, nullptr);
+    }
+  }
+  if (!referenced_txs.empty())
+  {
+    CRITICAL_REGION_LOCAL(m_read_lock);
+    for (auto& rt : referenced_txs)
+      rt.second = m_db_transactions.find(rt.first);
+  }
 
   //handle inputs
-  for (auto in : tx.vin)
+  for (const auto& in : tx.vin)
   {
     tei.ins.push_back(tx_in_rpc_entry());
     tx_in_rpc_entry& entry_to_fill = tei.ins.back();
-    if (in.type() == typeid(txin_gen))
+    if (tools::is_variant_type<txin_gen>(in))
     {
       entry_to_fill.amount = 0;
     }
-    else if (in.type() == typeid(txin_to_key) || in.type() == typeid(txin_htlc) || in.type() == typeid(txin_zc_input))
+    else if (tools::is_variant_type<txin_to_key>(in) || tools::is_variant_type<txin_htlc>(in) || tools::is_variant_type<txin_zc_input>(in))
     {
       //TODO: add htlc info
       entry_to_fill.amount = get_amount_from_variant(in);
@@ -5592,14 +6712,13 @@ bool blockchain_storage::fill_tx_rpc_inputs(tx_rpc_extended_info& tei, const tra
       for (auto& ao : absolute_offsets)
       {
         entry_to_fill.global_indexes.push_back(0);
-        if (ao.type() == typeid(uint64_t))
+        if (tools::is_variant_type<uint64_t>(ao))
         {
           entry_to_fill.global_indexes.back() = boost::get<uint64_t>(ao);
         }
-        else if (ao.type() == typeid(ref_by_id))
+        else if (tools::is_variant_type<ref_by_id>(ao))
         {
-          //disable for the reset at the moment 
-          auto tx_ptr = get_tx_chain_entry(boost::get<ref_by_id>(ao).tx_id);
+          const auto& tx_ptr = referenced_txs[boost::get<ref_by_id>(ao).tx_id];
           if (!tx_ptr || tx_ptr->m_global_output_indexes.size() <= boost::get<ref_by_id>(ao).n)
           {
             tei.ins.back().global_indexes.back() = std::numeric_limits<uint64_t>::max();
@@ -5608,18 +6727,18 @@ bool blockchain_storage::fill_tx_rpc_inputs(tx_rpc_extended_info& tei, const tra
           tei.ins.back().global_indexes.back() = tx_ptr->m_global_output_indexes[boost::get<ref_by_id>(ao).n];
         }
       }
-      if (in.type() == typeid(txin_htlc))
+      if (tools::is_variant_type<txin_htlc>(in))
       {
         entry_to_fill.htlc_origin = epee::string_tools::buff_to_hex_nodelimer(boost::get<txin_htlc>(in).hltc_origin);
       }
     }
-    else if (in.type() == typeid(txin_multisig))
+    else if (tools::is_variant_type<txin_multisig>(in))
     {
-      txin_multisig& tms = boost::get<txin_multisig>(in);
+      const txin_multisig& tms = boost::get<txin_multisig>(in);
       entry_to_fill.amount = tms.amount;
       entry_to_fill.kimage_or_ms_id = epee::string_tools::pod_to_hex(tms.multisig_out_id);
       if (tx.signatures.size() >= tei.ins.size() &&
-        tx.signatures[tei.ins.size() - 1].type() == typeid(NLSAG_sig))
+        tools::is_variant_type<NLSAG_sig>(tx.signatures[tei.ins.size() - 1]))
       {
         entry_to_fill.multisig_count = boost::get<NLSAG_sig>(tx.signatures[tei.ins.size() - 1]).s.size();
       }
@@ -5629,13 +6748,13 @@ bool blockchain_storage::fill_tx_rpc_inputs(tx_rpc_extended_info& tei, const tra
     for (size_t i = 0; i < etc_options.size(); ++i)
     {
       std::stringstream ss;
-      if (etc_options[i].type() == typeid(signed_parts))
+      if (tools::is_variant_type<signed_parts>(etc_options[i]))
       {
         const auto& sp = boost::get<signed_parts>(etc_options[i]);
         ss << "n_outs: " << sp.n_outs << ", n_extras: " << sp.n_extras;
         entry_to_fill.etc_options.push_back(ss.str());
       }
-      else if (etc_options[i].type() == typeid(extra_attachment_info))
+      else if (tools::is_variant_type<extra_attachment_info>(etc_options[i]))
       {
         const auto& eai = boost::get<extra_attachment_info>(etc_options[i]);
         ss << "cnt: " << eai.cnt << ", sz: " << eai.sz << ", hsh: " << eai.hsh;
@@ -5657,43 +6776,56 @@ bool blockchain_storage::prune_aged_alt_blocks()
   CRITICAL_REGION_LOCAL1(m_alternative_chains_lock);
   uint64_t current_height = get_current_blockchain_size();
 
-  size_t count_to_delete = 0;
-  if(m_alternative_chains.size() > m_core_runtime_config.max_alt_blocks)
-    count_to_delete = m_alternative_chains.size() - m_core_runtime_config.max_alt_blocks;
+  std::unordered_multimap<crypto::hash, crypto::hash> children; // prev id -> alt block id
+  std::vector<crypto::hash> aged;
+  for (const auto& a : m_alternative_chains)
+  {
+    children.emplace(a.second.bl.prev_id, a.first);
+    if (current_height > a.second.height && current_height - a.second.height > CURRENCY_ALT_BLOCK_LIVETIME_COUNT)
+      aged.push_back(a.first);
+  }
 
-  std::map<uint64_t, alt_chain_container::iterator> alts_to_delete;
+  size_t erased = 0;
+  for (const auto& id : aged)
+    erased += erase_altblock_with_descendants(id, children);
 
-  for(auto it = m_alternative_chains.begin(); it != m_alternative_chains.end();)
+  // protect ourself from altchains container flood: drop the chain heads received earliest, going down each chain until
+  // it reaches a block other chains are built on, so the chains being extended stay; a bit below the limits is left so
+  // that the next alt blocks don't trigger the scan again right away
+  uint64_t max_count = m_core_runtime_config.max_alt_blocks - m_core_runtime_config.max_alt_blocks / 10;
+  uint64_t max_stored_size = m_core_runtime_config.max_alt_blocks_stored_size - m_core_runtime_config.max_alt_blocks_stored_size / 10;
+  if (m_alternative_chains.size() > m_core_runtime_config.max_alt_blocks || m_alternative_chains_stored_size > m_core_runtime_config.max_alt_blocks_stored_size)
   {
-    if (current_height > it->second.height && current_height - it->second.height > CURRENCY_ALT_BLOCK_LIVETIME_COUNT)
+    std::unordered_map<crypto::hash, size_t> children_count;
+    for (const auto& a : m_alternative_chains)
+      ++children_count[a.second.bl.prev_id];
+
+    typedef std::pair<uint64_t, crypto::hash> arrival_and_id;
+    std::priority_queue<arrival_and_id, std::vector<arrival_and_id>, std::greater<arrival_and_id>> heads;
+    for (const auto& a : m_alternative_chains)
     {
-      do_erase_altblock(it++);
+      if (!children_count.count(a.first))
+        heads.emplace(a.second.timestamp, a.first);
     }
-    else
-    {
-      if (count_to_delete)
-      {
-        if (!alts_to_delete.size())
-          alts_to_delete[it->second.timestamp] = it;
-        else
-        {
-          if (it->second.timestamp >= alts_to_delete.rbegin()->first)
-            alts_to_delete[it->second.timestamp] = it;
 
-          if (alts_to_delete.size() > count_to_delete)
-            alts_to_delete.erase(alts_to_delete.begin());
-        }
-      }
+    while (!heads.empty() && (m_alternative_chains.size() > max_count || m_alternative_chains_stored_size > max_stored_size))
+    {
+      auto it = m_alternative_chains.find(heads.top().second);
+      heads.pop();
+      if (it == m_alternative_chains.end())
+        continue;
+      crypto::hash prev_id = it->second.bl.prev_id;
+      do_erase_altblock(it);
+      ++erased;
 
-      ++it;
+      auto it_prev = m_alternative_chains.find(prev_id);
+      if (it_prev != m_alternative_chains.end() && --children_count[prev_id] == 0)
+        heads.emplace(it_prev->second.timestamp, prev_id);
     }
   }
-  //now, if there was count_to_delete we should erase most oldest entries of altblocks
-  for (auto& itd : alts_to_delete)
-  {
-    m_alternative_chains.erase(itd.second);
-  }
 
+  if (erased)
+    LOG_PRINT_L1("Pruned " << erased << " alt blocks, " << m_alternative_chains.size() << " left (" << m_alternative_chains_stored_size << " bytes)");
   return true;
 }
 //------------------------------------------------------------------
@@ -5732,34 +6864,10 @@ void blockchain_storage::get_pos_mining_estimate(uint64_t amount_coins,
   // 5. estimate PoS minting income for this day as I = C * P
   // 6. amount_coins += I, goto 3
 
-  epee::critical_region_t<decltype(m_read_lock)> read_lock_region(m_read_lock);
-
-  size_t estimated_pos_blocks_count_per_day = CURRENCY_BLOCKS_PER_DAY / 2; // 50% of all blocks in a perfect world
-  
-  uint64_t pos_ts_min = UINT64_MAX, pos_ts_max = 0;
-  size_t pos_blocks_count = 0;
-  uint64_t pos_total_minted_money = 0;
-  wide_difficulty_type pos_avg_difficulty = 0;
-  // scan blockchain backward for PoS blocks and collect data
-  for (size_t h = m_db_blocks.size() - 1; h != 0 && pos_blocks_count < estimated_pos_blocks_count_per_day; --h)
-  {
-    auto bei = m_db_blocks[h];
-    if (!is_pos_block(bei->bl))
-      continue;
-    uint64_t ts = get_block_datetime(bei->bl);
-    pos_ts_min = min(pos_ts_min, ts);
-    pos_ts_max = max(pos_ts_max, ts);
-    pos_total_minted_money += get_reward_from_miner_tx(bei->bl.miner_tx);
-    pos_avg_difficulty += bei->difficulty;
-    ++pos_blocks_count;
-  }
-  if (pos_blocks_count < estimated_pos_blocks_count_per_day || pos_ts_max <= pos_ts_min)
+  uint64_t pos_last_day_total_minted_money = 0;
+  uint64_t estimated_total_minting_coins = 0;
+  if (!get_pos_mining_estimate_data(pos_last_day_total_minted_money, estimated_total_minting_coins))
     return; // too little pos blocks found or invalid ts
-  pos_avg_difficulty /= pos_blocks_count;
-  uint64_t found_blocks_interval = pos_ts_max - pos_ts_min; // will be close to 24 * 60 * 60 in case of PoS/PoW == 50/50
-  uint64_t pos_last_day_total_minted_money = pos_total_minted_money * (24 * 60 * 60) / found_blocks_interval; // total minted money normalized for 1 day interval
-
-  uint64_t estimated_total_minting_coins = static_cast<uint64_t>(pos_avg_difficulty / POS_STAKE_TO_DIFF_COEFF);
 
   uint64_t current_amount = amount_coins;
   uint64_t days_count = time / (60 * 60 * 24);
@@ -5772,6 +6880,53 @@ void blockchain_storage::get_pos_mining_estimate(uint64_t amount_coins,
   estimate_result = current_amount;
 }
 //------------------------------------------------------------------
+bool blockchain_storage::get_pos_mining_estimate_data(uint64_t& last_day_total_minted_money, uint64_t& estimated_total_minting_coins) const
+{
+  // steps 1-3 of get_pos_mining_estimate() take a scan over about a day of blocks, and front-ends ask for estimates often,
+  // so they're done once per top block
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  crypto::hash top_block_id = get_top_block_id();
+  CRITICAL_REGION_LOCAL1(m_pos_mining_estimate_data_lock);
+  pos_mining_estimate_data& ped = m_pos_mining_estimate_data;
+  if (ped.top_block_id != top_block_id)
+  {
+    ped = pos_mining_estimate_data();
+    ped.top_block_id = top_block_id;
+
+    size_t estimated_pos_blocks_count_per_day = CURRENCY_BLOCKS_PER_DAY / 2; // 50% of all blocks in a perfect world
+
+    uint64_t pos_ts_min = UINT64_MAX, pos_ts_max = 0;
+    size_t pos_blocks_count = 0;
+    uint64_t pos_total_minted_money = 0;
+    wide_difficulty_type pos_avg_difficulty = 0;
+    // scan blockchain backward for PoS blocks and collect data
+    for (size_t h = m_db_blocks.size() - 1; h != 0 && pos_blocks_count < estimated_pos_blocks_count_per_day; --h)
+    {
+      auto bei = m_db_blocks[h];
+      if (!is_pos_block(bei->bl))
+        continue;
+      uint64_t ts = get_block_datetime(bei->bl);
+      pos_ts_min = min(pos_ts_min, ts);
+      pos_ts_max = max(pos_ts_max, ts);
+      pos_total_minted_money += get_reward_from_miner_tx(bei->bl.miner_tx);
+      pos_avg_difficulty += bei->difficulty;
+      ++pos_blocks_count;
+    }
+    if (pos_blocks_count >= estimated_pos_blocks_count_per_day && pos_ts_max > pos_ts_min)
+    {
+      pos_avg_difficulty /= pos_blocks_count;
+      uint64_t found_blocks_interval = pos_ts_max - pos_ts_min; // will be close to 24 * 60 * 60 in case of PoS/PoW == 50/50
+      ped.last_day_total_minted_money = pos_total_minted_money * (24 * 60 * 60) / found_blocks_interval; // total minted money normalized for 1 day interval
+      ped.estimated_total_minting_coins = static_cast<uint64_t>(pos_avg_difficulty / POS_STAKE_TO_DIFF_COEFF);
+      ped.is_valid = true;
+    }
+  }
+
+  last_day_total_minted_money = ped.last_day_total_minted_money;
+  estimated_total_minting_coins = ped.estimated_total_minting_coins;
+  return ped.is_valid;
+}
+//------------------------------------------------------------------
 bool blockchain_storage::validate_tx_for_hardfork_specific_terms(const transaction& tx, const crypto::hash& tx_id) const
 {
   if (m_db_major_failure)
@@ -5803,43 +6958,50 @@ bool blockchain_storage::validate_tx_for_hardfork_specific_terms(const transacti
   bool var_is_after_hardfork_2_zone = m_core_runtime_config.is_hardfork_active_for_height(2, block_height);
   bool var_is_after_hardfork_3_zone = m_core_runtime_config.is_hardfork_active_for_height(3, block_height);
   bool var_is_after_hardfork_4_zone = m_core_runtime_config.is_hardfork_active_for_height(4, block_height);
+  bool var_is_after_hardfork_5_zone = m_core_runtime_config.is_hardfork_active_for_height(5, block_height);
 
   auto is_allowed_before_hardfork1 = [&](const auto& el) -> bool
   {
-    CHECK_AND_ASSERT_MES(el.type() != typeid(etc_tx_details_unlock_time2), false, "tx " << tx_id << " contains etc_tx_details_unlock_time2 which is not allowed on height " << block_height);
+    CHECK_AND_ASSERT_MES(!tools::is_variant_type<etc_tx_details_unlock_time2>(el), false, "tx " << tx_id << " contains etc_tx_details_unlock_time2 which is not allowed on height " << block_height);
     return true;
   };
 
   auto is_allowed_before_hardfork2 = [&](const auto& el) -> bool
   {
-    CHECK_AND_ASSERT_MES(el.type() != typeid(tx_payer), false, "tx " << tx_id << " contains tx_payer which is not allowed on height " << block_height);
-    CHECK_AND_ASSERT_MES(el.type() != typeid(tx_receiver), false, "tx " << tx_id << " contains tx_receiver which is not allowed on height " << block_height);
-    CHECK_AND_ASSERT_MES(el.type() != typeid(extra_alias_entry), false, "tx " << tx_id << " contains extra_alias_entry which is not allowed on height " << block_height);
+    CHECK_AND_ASSERT_MES(!tools::is_variant_type<tx_payer>(el), false, "tx " << tx_id << " contains tx_payer which is not allowed on height " << block_height);
+    CHECK_AND_ASSERT_MES(!tools::is_variant_type<tx_receiver>(el), false, "tx " << tx_id << " contains tx_receiver which is not allowed on height " << block_height);
+    CHECK_AND_ASSERT_MES(!tools::is_variant_type<extra_alias_entry>(el), false, "tx " << tx_id << " contains extra_alias_entry which is not allowed on height " << block_height);
     return true;
   }; 
 
   auto is_allowed_before_hardfork3 = [&](const auto& el) -> bool
   {
-    CHECK_AND_ASSERT_MES(el.type() != typeid(txin_htlc), false, "tx " << tx_id << " contains txin_htlc which is not allowed on height " << block_height);
+    CHECK_AND_ASSERT_MES(!tools::is_variant_type<txin_htlc>(el), false, "tx " << tx_id << " contains txin_htlc which is not allowed on height " << block_height);
     const tx_out_bare* pbare = boost::apply_visitor(visitor_proxy<tx_out_bare>(), el);
     if (pbare)
     {
-      CHECK_AND_ASSERT_MES(pbare->target.type() != typeid(txout_htlc), false, "tx " << tx_id << " contains txout_htlc which is not allowed on height " << block_height);
+      CHECK_AND_ASSERT_MES(!tools::is_variant_type<txout_htlc>(pbare->target), false, "tx " << tx_id << " contains txout_htlc which is not allowed on height " << block_height);
     }
     return true;
   };
 
   auto is_allowed_before_hardfork4 = [&](const auto& el) -> bool
   {
-    CHECK_AND_ASSERT_MES(el.type() != typeid(zarcanum_tx_data_v1), false, "tx " << tx_id << " contains zarcanum_tx_data_v1 which is not allowed on height " << block_height);
-    CHECK_AND_ASSERT_MES(el.type() != typeid(txin_zc_input), false, "tx " << tx_id << " contains txin_zc_input which is not allowed on height " << block_height);
-    CHECK_AND_ASSERT_MES(el.type() != typeid(tx_out_zarcanum), false, "tx " << tx_id << " contains tx_out_zarcanum which is not allowed on height " << block_height);
+    CHECK_AND_ASSERT_MES(!tools::is_variant_type<zarcanum_tx_data_v1>(el), false, "tx " << tx_id << " contains zarcanum_tx_data_v1 which is not allowed on height " << block_height);
+    CHECK_AND_ASSERT_MES(!tools::is_variant_type<txin_zc_input>(el), false, "tx " << tx_id << " contains txin_zc_input which is not allowed on height " << block_height);
+    CHECK_AND_ASSERT_MES(!tools::is_variant_type<tx_out_zarcanum>(el), false, "tx " << tx_id << " contains tx_out_zarcanum which is not allowed on height " << block_height);
     return true;
   };
 
   auto is_allowed_after_hardfork4 = [&](const auto& el) -> bool
   {
-    CHECK_AND_ASSERT_MES(el.type() != typeid(tx_out_bare), false, "tx " << tx_id << " contains tx_out_bare which is not allowed on height " << block_height);
+    CHECK_AND_ASSERT_MES(!tools::is_variant_type<tx_out_bare>(el), false, "tx " << tx_id << " contains tx_out_bare which is not allowed on height " << block_height);
+    return true;
+  };
+
+  auto is_allowed_before_hardfork5 = [&](const auto& el) -> bool
+  {
+    CHECK_AND_ASSERT_MES(!tools::is_variant_type<extra_view_tags>(el), false, "tx " << tx_id << " contains extra_view_tags which is not allowed on height " << block_height);
     return true;
   };
   
@@ -5873,11 +7035,19 @@ bool blockchain_storage::validate_tx_for_hardfork_specific_terms(const transacti
   }
 
   size_t count_ado = 0;
+  size_t count_view_tags = 0;
   //extra
   for (const auto& el : tx.extra)
   {
-    if (el.type() == typeid(asset_descriptor_operation))
+    if (tools::is_variant_type<asset_descriptor_operation>(el))
       count_ado++;
+    if (tools::is_variant_type<extra_view_tags>(el))
+    {
+      count_view_tags++;
+      CHECK_AND_ASSERT_MES(boost::get<extra_view_tags>(el).tags.size() == tx.vout.size(), false, "tx " << tx_id << " has " << boost::get<extra_view_tags>(el).tags.size() << " view tags for " << tx.vout.size() << " outputs");
+    }
+    if (!var_is_after_hardfork_5_zone && !is_allowed_before_hardfork5(el))
+      return false;
     if (!var_is_after_hardfork_1_zone && !is_allowed_before_hardfork1(el))
       return false;
     if (!var_is_after_hardfork_2_zone && !is_allowed_before_hardfork2(el))
@@ -5888,6 +7058,8 @@ bool blockchain_storage::validate_tx_for_hardfork_specific_terms(const transacti
       return false;
   }
 
+  CHECK_AND_ASSERT_MES(count_view_tags <= 1, false, "tx " << tx_id << " has more than one extra_view_tags entry");
+
   //attachments
   for (const auto& el : tx.attachment)
   {
@@ -6001,8 +7173,8 @@ bool blockchain_storage::validate_pos_block(const block& b,
   CHECK_AND_ASSERT_MES(b.timestamp%POS_SCAN_STEP == 0, false, "wrong timestamp in PoS block(b.timestamp%POS_SCAN_STEP == 0), b.timestamp = " <<b.timestamp);
 
   CHECK_AND_ASSERT_MES(b.miner_tx.vin.size() == 2, false, "incorrect: miner_tx.vin.size() = " << b.miner_tx.vin.size());
-  CHECK_AND_ASSERT_MES(b.miner_tx.vin[0].type() == typeid(txin_gen), false, "incorrect input 0 type: " << b.miner_tx.vin[0].type().name());
-  CHECK_AND_ASSERT_MES(b.miner_tx.vin[1].type() == typeid(txin_to_key) || b.miner_tx.vin[1].type() == typeid(txin_zc_input), false, "incorrect input 1 type: " << b.miner_tx.vin[1].type().name());
+  CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_gen>(b.miner_tx.vin[0]), false, "incorrect input 0 type: " << b.miner_tx.vin[0].type().name());
+  CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_to_key>(b.miner_tx.vin[1]) || tools::is_variant_type<txin_zc_input>(b.miner_tx.vin[1]), false, "incorrect input 1 type: " << b.miner_tx.vin[1].type().name());
   const crypto::key_image& stake_key_image = get_key_image_from_txin_v(b.miner_tx.vin[1]);
   //check keyimage if it's main chain candidate
   TIME_MEASURE_START_PD(pos_validate_ki_search);
@@ -6040,10 +7212,10 @@ bool blockchain_storage::validate_pos_block(const block& b,
   if (is_hardfork_active(ZANO_HARDFORK_04_ZARCANUM))
   {
     CHECK_AND_ASSERT_MES(b.miner_tx.version > TRANSACTION_VERSION_PRE_HF4, false, "Zarcanum PoS: miner tx with version " << b.miner_tx.version << " is not allowed");
-    CHECK_AND_ASSERT_MES(b.miner_tx.vin[1].type() == typeid(txin_zc_input), false, "incorrect input 1 type: " << b.miner_tx.vin[1].type().name() << ", txin_zc_input expected");
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_zc_input>(b.miner_tx.vin[1]), false, "incorrect input 1 type: " << b.miner_tx.vin[1].type().name() << ", txin_zc_input expected");
     const txin_zc_input& stake_input = boost::get<txin_zc_input>(b.miner_tx.vin[1]);
     CHECK_AND_ASSERT_MES(b.miner_tx.signatures.size() == 1, false, "incorrect number of stake input signatures: " << b.miner_tx.signatures.size());
-    CHECK_AND_ASSERT_MES(b.miner_tx.signatures[0].type() == typeid(zarcanum_sig), false, "incorrect sig 0 type: " << b.miner_tx.signatures[0].type().name());
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<zarcanum_sig>(b.miner_tx.signatures[0]), false, "incorrect sig 0 type: " << b.miner_tx.signatures[0].type().name());
     
     //std::stringstream ss;
     if (!for_altchain)
@@ -6099,7 +7271,7 @@ bool blockchain_storage::validate_pos_block(const block& b,
   {
     // old PoS non-hidden amount scheme
     CHECK_AND_ASSERT_MES(b.miner_tx.version <= TRANSACTION_VERSION_PRE_HF4, false, "PoS miner tx has incorrect version: " << b.miner_tx.version);
-    CHECK_AND_ASSERT_MES(b.miner_tx.vin[1].type() == typeid(txin_to_key), false, "incorrect input 1 type: " << b.miner_tx.vin[1].type().name() << ", txin_to_key expected");
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_to_key>(b.miner_tx.vin[1]), false, "incorrect input 1 type: " << b.miner_tx.vin[1].type().name() << ", txin_to_key expected");
     const txin_to_key& intk = boost::get<txin_to_key>(b.miner_tx.vin[1]);
     amount = intk.amount;
 
@@ -6299,13 +7471,14 @@ bool get_tx_from_cache(const crypto::hash& tx_id, transactions_map& tx_cache, tr
   if (it == tx_cache.end())
     return false;
 
-  tx = it->second;
+  // the cache is given for one handling of the block, so its txs are taken rather than copied
+  tx = std::move(it->second);
   blob_size = get_object_blobsize(tx);
   fee = get_tx_fee(tx);
   return true;
 }
 //------------------------------------------------------------------
-bool blockchain_storage::collect_rangeproofs_data_from_tx(const transaction& tx, const crypto::hash& tx_id, std::vector<zc_outs_range_proofs_with_commitments>& agregated_proofs)
+bool blockchain_storage::collect_rangeproofs_data_from_tx(const transaction& tx, const crypto::hash& tx_id, std::vector<zc_outs_range_proofs_with_commitments>& agregated_proofs, bool verify_aggregation_proof /* = true */) const
 {
   if (tx.version <= TRANSACTION_VERSION_PRE_HF4)
     return true;
@@ -6314,7 +7487,7 @@ bool blockchain_storage::collect_rangeproofs_data_from_tx(const transaction& tx,
   size_t out_index_offset = 0; //Consolidated Transactions have multiple zc_outs_range_proof entries
   for (const auto& a : tx.proofs)
   {
-    if (a.type() == typeid(zc_outs_range_proof))
+    if (tools::is_variant_type<zc_outs_range_proof>(a))
     {
       const zc_outs_range_proof& zcrp = boost::get<zc_outs_range_proof>(a);
 
@@ -6326,9 +7499,12 @@ bool blockchain_storage::collect_rangeproofs_data_from_tx(const transaction& tx,
         amount_commitment_ptrs_1div8.push_back(&zcout.amount_commitment);
         blinded_asset_id_ptrs_1div8.push_back(&zcout.blinded_asset_id);
       }
-      uint8_t err = 0;
-      bool r = crypto::verify_vector_UG_aggregation_proof(tx_id, amount_commitment_ptrs_1div8, blinded_asset_id_ptrs_1div8, zcrp.aggregation_proof, &err);
-      CHECK_AND_ASSERT_MES(r, false, "verify_vector_UG_aggregation_proof failed with err code " << (int)err);
+      if (verify_aggregation_proof)
+      {
+        uint8_t err = 0;
+        bool r = crypto::verify_vector_UG_aggregation_proof(tx_id, amount_commitment_ptrs_1div8, blinded_asset_id_ptrs_1div8, zcrp.aggregation_proof, &err);
+        CHECK_AND_ASSERT_MES(r, false, "verify_vector_UG_aggregation_proof failed with err code " << (int)err);
+      }
 
 
       agregated_proofs.emplace_back(zcrp);
@@ -6350,6 +7526,132 @@ bool blockchain_storage::collect_rangeproofs_data_from_tx(const transaction& tx,
   return true;
 }
 
+void blockchain_storage::batch_verify_range_proofs(const std::vector<block>& blocks, std::vector<block_verification_context>& bvcs) const
+{
+  // Range proofs don't depend on the blockchain state, so proofs of several consecutive blocks can be verified with one bpp_verify call,
+  // which is considerably cheaper than verifying them block by block. If a batch fails, nothing is marked
+  // and each block of this batch gets its range proofs verified individually in handle_block_to_main_chain (which reports the actual culprit).
+  // Aggregation proofs are still verified per block.
+  CHECK_AND_ASSERT_MES(blocks.size() == bvcs.size(), void(), "internal error: blocks.size() = " << blocks.size() << ", bvcs.size() = " << bvcs.size());
+  if (!m_range_proofs_batch_blocks)
+    return;
+
+  for (size_t batch_start = 0; batch_start < blocks.size(); batch_start += m_range_proofs_batch_blocks)
+  {
+    size_t batch_end = std::min(batch_start + m_range_proofs_batch_blocks, blocks.size());
+    std::vector<zc_outs_range_proofs_with_commitments> range_proofs;
+    std::vector<size_t> batch_blocks;
+    bool collected = true;
+    for (size_t i = batch_start; i != batch_end && collected; ++i)
+    {
+      const block& b = blocks[i];
+      if (m_checkpoints.is_in_checkpoint_zone(get_block_height(b)))
+        continue; // proofs are not checked in checkpoint zone at all
+
+      collected = collect_rangeproofs_data_from_tx(b.miner_tx, null_hash, range_proofs, false);
+      for (size_t j = 0; j != b.tx_hashes.size() && collected; ++j)
+      {
+        auto it = bvcs[i].m_onboard_transactions.find(b.tx_hashes[j]);
+        if (it != bvcs[i].m_onboard_transactions.end())
+          collected = collect_rangeproofs_data_from_tx(it->second, null_hash, range_proofs, false);
+      }
+      batch_blocks.push_back(i);
+    }
+    if (!collected || batch_blocks.empty())
+      continue; // malformed data will be reported by regular per-block verification
+
+    TIME_MEASURE_START_PD(batch_verify_range_proofs_time);
+    bool r = verify_multiple_zc_outs_range_proofs(range_proofs);
+    TIME_MEASURE_FINISH_PD(batch_verify_range_proofs_time);
+    if (!r)
+    {
+      LOG_PRINT_L1("batch range proofs verification failed for blocks " << get_block_height(blocks[batch_start]) << " - " << get_block_height(blocks[batch_end - 1]) << ", falling back to per-block verification");
+      continue;
+    }
+    for (size_t i : batch_blocks)
+      bvcs[i].m_range_proofs_preverified = true;
+  }
+}
+//------------------------------------------------------------------
+void blockchain_storage::prevalidate_block_tx(block_tx_prevalidation_entry& e) const
+{
+  // NOTE: this is called from worker threads, so only pure checks that don't touch the db are allowed here
+  tx_semantic_context tsc;
+  if (!validate_tx_semantic(e.tx, e.blob_size, tsc))
+  {
+    e.status = btps_wrong_semantic;
+    return;
+  }
+
+  if (m_is_in_checkpoint_zone)
+    return;
+
+  if (!collect_rangeproofs_data_from_tx(e.tx, e.tx_id, e.range_proofs))
+  {
+    e.status = btps_rangeproofs_failed;
+    return;
+  }
+
+  if (!check_tx_balance(e.tx, e.tx_id, tsc))
+  {
+    e.status = btps_balance_failed;
+    return;
+  }
+
+  if (!verify_asset_surjection_proof(e.tx, e.tx_id))
+  {
+    e.status = btps_surjection_failed;
+    return;
+  }
+}
+//------------------------------------------------------------------
+void blockchain_storage::prevalidate_block_txs(std::vector<block_tx_prevalidation_entry>& txs)
+{
+  if (m_tx_verification_threads < 2 || txs.size() < 2)
+  {
+    for (auto& e : txs)
+      prevalidate_block_tx(e);
+    return;
+  }
+
+  utils::threads_pool::jobs_container jobs;
+  for (auto& e : txs)
+  {
+    block_tx_prevalidation_entry* pe = &e;
+    utils::threads_pool::add_job_to_container(jobs, [this, pe]()
+    {
+      try
+      {
+        prevalidate_block_tx(*pe);
+      }
+      catch (const std::exception& ex)
+      {
+        LOG_ERROR("Exception in prevalidate_block_tx for tx " << pe->tx_id << ": " << ex.what());
+        pe->status = btps_wrong_semantic;
+      }
+      catch (...)
+      {
+        LOG_ERROR("Unknown exception in prevalidate_block_tx for tx " << pe->tx_id);
+        pe->status = btps_wrong_semantic;
+      }
+    });
+  }
+  m_tx_verification_pool.add_batch_and_wait(jobs);
+}
+//------------------------------------------------------------------
+void blockchain_storage::return_block_txs_to_pool(std::vector<block_tx_prevalidation_entry>& txs, size_t start_index, size_t except_index)
+{
+  // put back transactions that were taken from the pool but haven't been added to the blockchain storage yet
+  for (size_t i = start_index; i < txs.size(); ++i)
+  {
+    if (i == except_index || !txs[i].taken_from_pool)
+      continue;
+    currency::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+    bool add_res = m_tx_pool.add_tx(txs[i].tx, tvc, true, true);
+    CHECK_AND_ASSERT_MES_NO_RET(add_res, "return_block_txs_to_pool: failed to add transaction " << txs[i].tx_id << " back to transaction pool");
+  }
+}
+//------------------------------------------------------------------
 bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypto::hash& id, block_verification_context& bvc)
 {
   TIME_MEASURE_START_PD_MS(block_processing_time_0_ms);
@@ -6357,6 +7659,7 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
   TIME_MEASURE_START_PD(block_processing_time_1);
 
   uint64_t height = get_current_blockchain_size(); // height <-> block height correspondence is validated in prevalidate_miner_transaction()
+  TRACE_SCOPE_ARG("block", "handle_block_to_main_chain", height);
 
   if(bl.prev_id != get_top_block_id())
   {
@@ -6416,8 +7719,11 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
   }
   else
   {
-
-    proof_hash = get_block_longhash(bl);
+    if (!m_precomputed_pow_hashes.get(id, proof_hash))
+    {
+      proof_hash = get_block_longhash(bl);
+      m_precomputed_pow_hashes.set(id, proof_hash); // a reorg pushes this block back as alt, then a rollback may re-add it
+    }
 
     if (!check_hash(proof_hash, current_diffic))
     {
@@ -6473,26 +7779,45 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
 
   std::vector<zc_outs_range_proofs_with_commitments> range_proofs_agregated;
 
-  for(const crypto::hash& tx_id : bl.tx_hashes)
-  {
-    transaction tx;
-    size_t blob_size = 0;
-    uint64_t fee = 0;
-
-    bool taken_from_cache = get_tx_from_cache(tx_id, bvc.m_onboard_transactions, tx, blob_size, fee);
-    bool taken_from_pool = m_tx_pool.take_tx(tx_id, tx, blob_size, fee);
-    if(!taken_from_cache && !taken_from_pool)
-    {
-      LOG_PRINT_L0("Block with id: " << id  << " has at least one unknown transaction with id: " << tx_id);
+  // take all block's transactions first, so pure crypto checks could be performed in parallel
+  std::vector<block_tx_prevalidation_entry> block_txs(bl.tx_hashes.size());
+  for(size_t i = 0; i != bl.tx_hashes.size(); ++i)
+  {
+    block_tx_prevalidation_entry& e = block_txs[i];
+    e.tx_id = bl.tx_hashes[i];
+    e.blob_size = 0;
+    e.fee = 0;
+    e.status = btps_ok;
+    bool taken_from_cache = get_tx_from_cache(e.tx_id, bvc.m_onboard_transactions, e.tx, e.blob_size, e.fee);
+    e.taken_from_pool = m_tx_pool.take_tx(e.tx_id, e.tx, e.blob_size, e.fee);
+    if(!taken_from_cache && !e.taken_from_pool)
+    {
+      LOG_PRINT_L0("Block with id: " << id  << " has at least one unknown transaction with id: " << e.tx_id);
+      return_block_txs_to_pool(block_txs, 0, i);
       purge_block_data_from_blockchain(bl, tx_processed_count);
       //add_block_as_invalid(bl, id);
       bvc.m_verification_failed = true;
       return false;
     }
+  }
+
+  TIME_MEASURE_START_PD(txs_prevalidation_time);
+  prevalidate_block_txs(block_txs);
+  TIME_MEASURE_FINISH_PD(txs_prevalidation_time);
 
-    if (!validate_tx_semantic(tx, blob_size))
+  for(size_t i = 0; i != block_txs.size(); ++i)
+  {
+    block_tx_prevalidation_entry& e = block_txs[i];
+    const crypto::hash& tx_id = e.tx_id;
+    transaction& tx = e.tx;
+    const size_t blob_size = e.blob_size;
+    const uint64_t fee = e.fee;
+    const bool taken_from_pool = e.taken_from_pool;
+
+    if (e.status == btps_wrong_semantic)
     {
       LOG_PRINT_L0("Block with id: " << id << " has at least one transaction with wrong semantic, tx_id: " << tx_id);
+      return_block_txs_to_pool(block_txs, i + 1, SIZE_MAX);
       purge_block_data_from_blockchain(bl, tx_processed_count);
       //add_block_as_invalid(bl, id);  
       bvc.m_verification_failed = true;
@@ -6515,18 +7840,23 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
       auto cleanup = [&](){ 
         bool add_res = m_tx_pool.add_tx(tx, tvc, true, true);
         m_tx_pool.add_transaction_to_black_list(tx);
+        return_block_txs_to_pool(block_txs, i + 1, SIZE_MAX);
         purge_block_data_from_blockchain(bl, tx_processed_count); 
         bvc.m_verification_failed = true; 
         };
 
-      CHECK_AND_ASSERT_MES_CUSTOM(collect_rangeproofs_data_from_tx(tx, tx_id, range_proofs_agregated), false, cleanup(),
+      CHECK_AND_ASSERT_MES_CUSTOM(e.status != btps_rangeproofs_failed, false, cleanup(),
         "block " << id << ", tx " << tx_id << ": collect_rangeproofs_data_from_tx failed");
 
-      CHECK_AND_ASSERT_MES_CUSTOM(check_tx_balance(tx, tx_id), false, cleanup(),
+      CHECK_AND_ASSERT_MES_CUSTOM(e.status != btps_balance_failed, false, cleanup(),
         "block " << id << ", tx " << tx_id << ": check_tx_balance failed");
 
-      CHECK_AND_ASSERT_MES_CUSTOM(verify_asset_surjection_proof(tx, tx_id), false, cleanup(),
+      CHECK_AND_ASSERT_MES_CUSTOM(e.status != btps_surjection_failed, false, cleanup(),
         "block " << id << ", tx " << tx_id << ": verify_asset_surjection_proof failed");
+
+      // range proofs of onboard transactions could have been already verified in a batch (the pool may hold a different version of a tx)
+      if (!bvc.m_range_proofs_preverified || taken_from_pool)
+        range_proofs_agregated.insert(range_proofs_agregated.end(), e.range_proofs.begin(), e.range_proofs.end());
     }
 
     TIME_MEASURE_START_PD(tx_add_one_tx_time);
@@ -6540,6 +7870,7 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
         m_tx_pool.add_transaction_to_black_list(tx);
         CHECK_AND_ASSERT_MES_NO_RET(add_res, "handle_block_to_main_chain: failed to add transaction back to transaction pool");
       }
+      return_block_txs_to_pool(block_txs, i + 1, SIZE_MAX);
       purge_block_data_from_blockchain(bl, tx_processed_count);
       add_block_as_invalid(bl, id);
       LOG_PRINT_L0("Block with id " << id << " added as invalid because of wrong inputs in transactions");
@@ -6566,6 +7897,7 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
          m_tx_pool.add_transaction_to_black_list(tx);
          CHECK_AND_ASSERT_MES_NO_RET(add_res, "handle_block_to_main_chain: failed to add transaction back to transaction pool");
        }
+       return_block_txs_to_pool(block_txs, i + 1, SIZE_MAX);
        purge_block_data_from_blockchain(bl, tx_processed_count);
        bvc.m_verification_failed = true;
        return false;
@@ -6617,7 +7949,8 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
     TIME_MEASURE_FINISH_PD(validate_miner_transaction_time);
 
     TIME_MEASURE_START_PD(collect_rangeproofs_data_from_tx_time);
-    if (!collect_rangeproofs_data_from_tx(bl.miner_tx, get_transaction_hash(bl.miner_tx), range_proofs_agregated))
+    std::vector<zc_outs_range_proofs_with_commitments> miner_tx_range_proofs;
+    if (!collect_rangeproofs_data_from_tx(bl.miner_tx, get_transaction_hash(bl.miner_tx), bvc.m_range_proofs_preverified ? miner_tx_range_proofs : range_proofs_agregated))
     {
       LOG_PRINT_L0("Block with id: " << id
         << " have wrong miner tx, failed to collect_rangeproofs_data_from_tx()");
@@ -6749,12 +8082,14 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
   }
 
   m_db_blocks_index.set(id, bei.height);
+  add_to_ids_filter(id);
   push_block_to_per_block_increments(bei.height, gindices);
   TIME_MEASURE_FINISH_PD(etc_stuff_6);
 
 
   TIME_MEASURE_START_PD(insert_time_4);
   m_db_blocks.push_back(bei);
+  push_block_to_headers_index(bei, id);
   TIME_MEASURE_FINISH_PD(insert_time_4);
   TIME_MEASURE_FINISH_PD(block_processing_time_1);
   TIME_MEASURE_FINISH_PD_MS(block_processing_time_0_ms);
@@ -6842,80 +8177,181 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
 //------------------------------------------------------------------
 void blockchain_storage::on_block_added(const block_extended_info& bei, const crypto::hash& id, const std::list<crypto::key_image>& bsk)
 {
+  update_median_windows_on_block_added(bei);
   update_next_comulative_size_limit();
-  m_timestamps_median_cache.clear();
   m_tx_pool.on_blockchain_inc(bei.height, id, bsk);
 
-  update_targetdata_cache_on_block_added(bei);
+  update_targetdata_cache_on_block_added(bei, id);
+
+  if (m_prune_depth != 0)
+    prune_ring_signatures_and_attachments_if_need(BLOCKCHAIN_PRUNE_MAX_BLOCKS_PER_NEW_BLOCK);
+
+  if (!m_is_in_checkpoint_zone && bei.bl.timestamp + CURRENCY_POW_NEXT_EPOCH_PREPARE_MAX_TOP_AGE > m_core_runtime_config.get_core_time())
+    m_ethash_epoch_preparer.on_new_top_height(bei.height);
 
   TIME_MEASURE_START_PD(raise_block_core_event);
   rise_core_event(CORE_EVENT_BLOCK_ADDED, void_struct());
   TIME_MEASURE_FINISH_PD(raise_block_core_event);
+  m_change_notifier.notify();
 
 }
 //------------------------------------------------------------------
 void blockchain_storage::on_block_removed(const block_extended_info& bei)
 {
+  if (m_is_truncation_in_process)
+  {
+    LOG_PRINT_L2("block at height " << bei.height << " was removed from the blockchain");
+    return; // truncate_blockchain() takes care of the caches when it's done
+  }
   m_tx_pool.on_blockchain_dec(m_db_blocks.size() - 1, get_top_block_id());
-  m_timestamps_median_cache.clear();
+  update_median_windows_on_block_removed(bei);
   update_targetdata_cache_on_block_removed(bei);
   LOG_PRINT_L2("block at height " << bei.height << " was removed from the blockchain");
+  m_change_notifier.notify();
 }
 //------------------------------------------------------------------
-void blockchain_storage::update_targetdata_cache_on_block_added(const block_extended_info& bei)
+void blockchain_storage::update_targetdata_cache_on_block_added(const block_extended_info& bei, const crypto::hash& id)
 {
   CRITICAL_REGION_LOCAL(m_targetdata_cache_lock);
-  if (bei.height == 0)
-    return; //skip genesis
-  std::list<std::pair<wide_difficulty_type, uint64_t>>& targetdata_cache = is_pos_block(bei.bl) ? m_pos_targetdata_cache : m_pow_targetdata_cache;
-  targetdata_cache.push_back(std::pair<wide_difficulty_type, uint64_t>(bei.cumulative_diff_precise, bei.bl.timestamp));
-  while (targetdata_cache.size() > TARGETDATA_CACHE_SIZE)
-    targetdata_cache.pop_front();
+  bool is_pos_bl = is_pos_block(bei.bl);
+  targetdata_window::entry e = AUTO_VAL_INIT(e);
+  e.height = bei.height;
+  e.timestamp = bei.bl.timestamp;
+  e.cumulative_diff_precise = bei.cumulative_diff_precise;
+  m_pos_targetdata_window.push_block(id, bei.bl.prev_id, is_pos_bl, e);
+  m_pow_targetdata_window.push_block(id, bei.bl.prev_id, !is_pos_bl, e);
 }
 //------------------------------------------------------------------
 void blockchain_storage::update_targetdata_cache_on_block_removed(const block_extended_info& bei)
 {
   CRITICAL_REGION_LOCAL(m_targetdata_cache_lock);
-  std::list<std::pair<wide_difficulty_type, uint64_t>>& targetdata_cache = is_pos_block(bei.bl) ? m_pos_targetdata_cache : m_pow_targetdata_cache;
-  if (targetdata_cache.size())
-    targetdata_cache.pop_back();
-  if (targetdata_cache.size() < DIFFICULTY_WINDOW)
-    targetdata_cache.clear();
+  bool is_pos_bl = is_pos_block(bei.bl);
+  m_pos_targetdata_window.pop_block(bei.bl.prev_id, bei.height, is_pos_bl);
+  m_pow_targetdata_window.pop_block(bei.bl.prev_id, bei.height, !is_pos_bl);
+}
+//------------------------------------------------------------------
+void blockchain_storage::update_median_windows_on_block_added(const block_extended_info& bei)
+{
+  CRITICAL_REGION_LOCAL(m_median_windows_lock);
+  auto header_ptr = m_db_block_headers[bei.height];
+  CHECK_AND_ASSERT_MES_NO_RET(header_ptr, "internal error: no header for just added block " << bei.height);
+  for (blocks_median_window* pw : { &m_block_sizes_median_window, &m_fee_lookup_sizes_median_window, &m_timestamps_median_window, &m_tx_expiration_median_window })
+    pw->push_block(bei.height, bei.bl.prev_id, *header_ptr);
+
+  CRITICAL_REGION_LOCAL1(m_daily_stat_window_lock);
+  daily_stat_window::entry e = AUTO_VAL_INIT(e);
+  if (!m_daily_stat_window.is_valid_for(bei.bl.prev_id) || !get_daily_stat_entry(bei.bl, e))
+  {
+    m_daily_stat_window.invalidate();
+    return;
+  }
+  m_daily_stat_window.push_block(bei.height, header_ptr->id, bei.bl.prev_id, e);
+}
+//------------------------------------------------------------------
+void blockchain_storage::update_median_windows_on_block_removed(const block_extended_info& bei)
+{
+  CRITICAL_REGION_LOCAL(m_median_windows_lock);
+  for (blocks_median_window* pw : { &m_block_sizes_median_window, &m_fee_lookup_sizes_median_window, &m_timestamps_median_window, &m_tx_expiration_median_window })
+  {
+    if (bei.height < pw->length())
+    {
+      pw->pop_block(bei.height, bei.bl.prev_id, nullptr);
+      continue;
+    }
+    auto entering_ptr = m_db_block_headers[bei.height - pw->length()];
+    CHECK_AND_ASSERT_MES_NO_RET(entering_ptr, "internal error: no header for block " << bei.height - pw->length());
+    pw->pop_block(bei.height, bei.bl.prev_id, entering_ptr.get());
+  }
+
+  CRITICAL_REGION_LOCAL1(m_daily_stat_window_lock);
+  if (!m_daily_stat_window.is_valid_for_height(bei.height))
+  {
+    m_daily_stat_window.invalidate();
+    return;
+  }
+  daily_stat_window::entry entering = AUTO_VAL_INIT(entering);
+  bool has_entering = bei.height >= m_daily_stat_window.length();
+  if (has_entering)
+  {
+    auto entering_ptr = m_db_blocks[bei.height - m_daily_stat_window.length()];
+    if (!entering_ptr || !get_daily_stat_entry(entering_ptr->bl, entering))
+    {
+      m_daily_stat_window.invalidate();
+      return;
+    }
+  }
+  m_daily_stat_window.pop_block(bei.height, bei.bl.prev_id, has_entering ? &entering : nullptr);
+}
+//------------------------------------------------------------------
+void blockchain_storage::invalidate_stat_windows() const
+{
+  CRITICAL_REGION_LOCAL(m_median_windows_lock);
+  m_block_sizes_median_window.invalidate();
+  m_fee_lookup_sizes_median_window.invalidate();
+  m_timestamps_median_window.invalidate();
+  m_tx_expiration_median_window.invalidate();
+  CRITICAL_REGION_LOCAL1(m_daily_stat_window_lock);
+  m_daily_stat_window.invalidate();
+}
+//------------------------------------------------------------------
+// to be called under m_median_windows_lock, reloads the window if it doesn't correspond to the top block
+const blocks_median_window& blockchain_storage::get_actual_median_window(blocks_median_window& window) const
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  uint64_t blocks_size = m_db_block_headers.size();
+  crypto::hash top_id = get_top_block_id();
+  if (window.is_valid_for(top_id) && blocks_size != 0)
+    return window;
+
+  std::vector<block_header_index_entry> headers;
+  for (uint64_t i = blocks_size - std::min<uint64_t>(blocks_size, window.length()); i < blocks_size; ++i)
+  {
+    auto header_ptr = m_db_block_headers[i];
+    CHECK_AND_ASSERT_THROW_MES(header_ptr, "internal error: no header for block " << i);
+    headers.push_back(*header_ptr);
+  }
+  window.reset(blocks_size ? blocks_size - 1 : 0, headers);
+  return window;
 }
 //------------------------------------------------------------------
 void blockchain_storage::load_targetdata_cache(bool is_pos)const
 {
-  CRITICAL_REGION_LOCAL(m_targetdata_cache_lock);
-  std::list<std::pair<wide_difficulty_type, uint64_t>>& targetdata_cache = is_pos? m_pos_targetdata_cache: m_pow_targetdata_cache;
-  targetdata_cache.clear();
-  uint64_t stop_ind = 0;
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  CRITICAL_REGION_LOCAL1(m_targetdata_cache_lock);
+  targetdata_window& window = is_pos ? m_pos_targetdata_window : m_pow_targetdata_window;
+  std::vector<targetdata_window::entry> entries;
   uint64_t blocks_size = m_db_blocks.size();
-  size_t count = 0;
-  for (uint64_t cur_ind = blocks_size - 1; cur_ind != stop_ind && count < DIFFICULTY_WINDOW + 5; cur_ind--)
+  uint64_t cur_ind = blocks_size - 1;
+  for (; cur_ind != 0 && entries.size() < TARGETDATA_CACHE_SIZE; cur_ind--)
   {
-    auto beiptr = m_db_blocks[cur_ind];
-
-    bool is_pos_bl = is_pos_block(beiptr->bl);
-    if (is_pos != is_pos_bl)
+    auto header_ptr = m_db_block_headers[cur_ind];
+    if (is_pos != header_ptr->is_pos())
       continue;
-    targetdata_cache.push_front(std::pair<wide_difficulty_type, uint64_t>(beiptr->cumulative_diff_precise, beiptr->bl.timestamp));
-    ++count;
+    targetdata_window::entry e = AUTO_VAL_INIT(e);
+    e.height = cur_ind;
+    e.timestamp = header_ptr->timestamp;
+    e.cumulative_diff_precise = header_ptr->get_cumulative_diff_precise();
+    entries.push_back(e);
   }
+  std::reverse(entries.begin(), entries.end());
+  window.reset(m_db_block_headers[blocks_size - 1]->id, blocks_size - 1, entries, cur_ind == 0);
 }
 //------------------------------------------------------------------
 void blockchain_storage::on_abort_transaction()
 {
   if (m_event_handler) m_event_handler->on_clear_events();
   CHECK_AND_ASSERT_MES_NO_RET(validate_blockchain_prev_links(), "EPIC FAIL! 4");
-  m_timestamps_median_cache.clear();
+  invalidate_stat_windows();
 }
 //------------------------------------------------------------------
 bool blockchain_storage::update_next_comulative_size_limit()
 {
-  std::vector<size_t> sz;
-  get_last_n_blocks_sizes(sz, CURRENCY_REWARD_BLOCKS_WINDOW);
-
-  uint64_t median = misc_utils::median(sz);
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  uint64_t median = 0;
+  {
+    CRITICAL_REGION_LOCAL1(m_median_windows_lock);
+    median = get_actual_median_window(m_block_sizes_median_window).get_median();
+  }
   if(median <= CURRENCY_BLOCK_GRANTED_FULL_REWARD_ZONE)
     median = CURRENCY_BLOCK_GRANTED_FULL_REWARD_ZONE;
 
@@ -6990,6 +8426,7 @@ bool blockchain_storage::prevalidate_block(const block& bl)
 //------------------------------------------------------------------
 bool blockchain_storage::add_new_block(const block& bl, block_verification_context& bvc)
 {
+  TRACE_SCOPE_ARG("block", "add_new_block", get_block_height(bl));
   try
   {
 
@@ -7089,22 +8526,98 @@ bool blockchain_storage::add_new_block(const block& bl, block_verification_conte
   }
 }
 //------------------------------------------------------------------
-bool blockchain_storage::truncate_blockchain(uint64_t to_height)
+bool blockchain_storage::begin_blocks_write_batch()
+{
+  if (!m_db_sync_batch_blocks)
+    return false;
+
+  // all add_new_block() transactions become nested ones and don't hit the disk until the outer one is committed,
+  // blocks which fail become aborted nested transactions, so the rest of the batch is not affected
+  m_db.begin_transaction();
+  m_blocks_write_batch_active = true;
+  m_blocks_write_batch_blocks_count = 0;
+  m_blocks_write_batch_bytes = 0;
+  return true;
+}
+//------------------------------------------------------------------
+void blockchain_storage::on_blocks_write_batch_block_added(uint64_t block_blobs_size)
 {
+  if (!m_blocks_write_batch_active)
+    return;
+
+  ++m_blocks_write_batch_blocks_count;
+  m_blocks_write_batch_bytes += block_blobs_size;
+  if (m_blocks_write_batch_blocks_count < m_db_sync_batch_blocks && m_blocks_write_batch_bytes < m_db_sync_batch_max_bytes)
+    return;
+
+  LOG_PRINT_L2("Committing blocks write batch: " << m_blocks_write_batch_blocks_count << " blocks, " << m_blocks_write_batch_bytes << " bytes");
+  m_db.commit_transaction();
   m_db.begin_transaction();
+  m_blocks_write_batch_blocks_count = 0;
+  m_blocks_write_batch_bytes = 0;
+}
+//------------------------------------------------------------------
+void blockchain_storage::end_blocks_write_batch()
+{
+  if (!m_blocks_write_batch_active)
+    return;
+
+  LOG_PRINT_L2("Committing blocks write batch: " << m_blocks_write_batch_blocks_count << " blocks, " << m_blocks_write_batch_bytes << " bytes");
+  m_blocks_write_batch_active = false;
+  try
+  {
+    m_db.commit_transaction();
+  }
+  catch (const std::exception& e)
+  {
+    // may be called from a scope leave handler, so don't let it go further
+    LOG_ERROR("Failed to commit blocks write batch: " << e.what());
+  }
+}
+//------------------------------------------------------------------
+bool blockchain_storage::truncate_blockchain(uint64_t to_height, bool move_txs_to_pool)
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
   uint64_t inital_height = get_current_blockchain_size();
-  while (get_current_blockchain_size() > to_height)
+  to_height = std::max<uint64_t>(to_height, 1); // genesis stays
+
+  // the windows get reloaded from the db on demand, the pool is told about the new top once
+  m_is_truncation_in_process = true;
+  auto truncation_flag_reset = epee::misc_utils::create_scope_leave_handler([&]() { m_is_truncation_in_process = false; });
   {
-    transactions_map ot;
-    pop_block_from_blockchain(ot);
+    CRITICAL_REGION_LOCAL1(m_targetdata_cache_lock);
+    m_pos_targetdata_window.invalidate();
+    m_pow_targetdata_window.invalidate();
   }
-  CRITICAL_REGION_LOCAL(m_alternative_chains_lock);
-  m_alternative_chains.clear();
-  m_altblocks_keyimages.clear();
-  m_alternative_chains_txs.clear();
-  LOG_PRINT_MAGENTA("Blockchain truncated from " << inital_height << " to " << get_current_blockchain_size(), LOG_LEVEL_0);
-  m_db.commit_transaction();
-  return true;
+  invalidate_stat_windows();
+
+  bool r = true;
+  while (r && get_current_blockchain_size() > to_height)
+  {
+    m_db.begin_transaction();
+    for (size_t i = 0; r && i != BLOCKCHAIN_TRUNCATION_BLOCKS_PER_DB_TX && get_current_blockchain_size() > to_height; ++i)
+    {
+      transactions_map ot;
+      r = pop_block_from_blockchain(ot, move_txs_to_pool);
+    }
+    if (!r)
+    {
+      m_db.abort_transaction();
+      LOG_ERROR("Failed to pop block at height " << get_current_blockchain_size() - 1 << " while truncating blockchain");
+      break;
+    }
+    m_db.commit_transaction();
+    LOG_PRINT_L1("Blockchain truncation: height " << get_current_blockchain_size() << ", " << get_current_blockchain_size() - to_height << " blocks more to remove");
+  }
+  m_is_truncation_in_process = false;
+
+  clear_altblocks();
+  m_tx_pool.on_blockchain_dec(m_db_blocks.size() - 1, get_top_block_id());
+  get_next_diff_conditional(true);
+  get_next_diff_conditional(false);
+  m_change_notifier.notify();
+  LOG_PRINT_MAGENTA("Blockchain truncated from " << inital_height << " to " << get_current_blockchain_size() << (move_txs_to_pool ? ", transactions moved to the pool" : ""), LOG_LEVEL_0);
+  return r;
 }
 //------------------------------------------------------------------
 bool blockchain_storage::calc_tx_cummulative_blob(const block& bl)const 
@@ -7169,8 +8682,8 @@ bool blockchain_storage::calc_tx_cummulative_blob(const block& bl)const
 bool blockchain_storage::build_kernel(const block& bl, stake_kernel& kernel, uint64_t& amount, const stake_modifier_type& stake_modifier) const
 {
   CHECK_AND_ASSERT_MES(bl.miner_tx.vin.size() == 2, false, "wrong miner transaction");
-  CHECK_AND_ASSERT_MES(bl.miner_tx.vin[0].type() == typeid(txin_gen), false, "wrong miner transaction");
-  CHECK_AND_ASSERT_MES(bl.miner_tx.vin[1].type() == typeid(txin_to_key), false, "wrong miner transaction");
+  CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_gen>(bl.miner_tx.vin[0]), false, "wrong miner transaction");
+  CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_to_key>(bl.miner_tx.vin[1]), false, "wrong miner transaction");
 
   const txin_to_key& txin = boost::get<txin_to_key>(bl.miner_tx.vin[1]);
   CHECK_AND_ASSERT_MES(txin.key_offsets.size(), false, "wrong miner transaction");
@@ -7201,7 +8714,7 @@ bool blockchain_storage::build_stake_modifier(stake_modifier_type& sm, const alt
   sm.last_pow_id = get_block_hash(pbei_last_pow->bl);
 
   if (p_last_block_hash != nullptr)
-    *p_last_block_hash = get_block_hash(m_db_blocks.back()->bl);
+    *p_last_block_hash = m_db_block_headers.back()->id;
 
   if (p_last_pow_block_height != nullptr)
     *p_last_pow_block_height = pbei_last_pow->height;
@@ -7340,6 +8853,68 @@ void blockchain_storage::pop_block_from_per_block_increments(uint64_t height_)
   m_db_per_block_gindex_incs.erase(height);
 }
 //------------------------------------------------------------------
+void blockchain_storage::push_block_to_headers_index(const block_extended_info& bei, const crypto::hash& id)
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  CHECK_AND_ASSERT_THROW_MES(m_db_block_headers.size() == bei.height, "invariant failure: m_db_block_headers.size() == " << m_db_block_headers.size() << ", bei.height == " << bei.height);
+  CHECK_AND_ASSERT_THROW_MES(bei.block_cumulative_size <= UINT32_MAX, "block_cumulative_size " << bei.block_cumulative_size << " doesn't fit block_header_index_entry");
+
+  block_header_index_entry entry = AUTO_VAL_INIT(entry);
+  entry.id = id;
+  entry.set_cumulative_diff_precise(bei.cumulative_diff_precise);
+  entry.timestamp = bei.bl.timestamp;
+  entry.block_cumulative_size = static_cast<uint32_t>(bei.block_cumulative_size);
+  entry.flags = is_pos_block(bei.bl) ? BLOCK_HEADER_INDEX_ENTRY_FLAG_POS : 0;
+  m_db_block_headers.push_back(entry);
+
+  CHECK_AND_ASSERT_THROW_MES(m_db_blocks_max_timestamps.size() == bei.height, "invariant failure: m_db_blocks_max_timestamps.size() == " << m_db_blocks_max_timestamps.size() << ", bei.height == " << bei.height);
+  uint64_t max_timestamp = bei.bl.timestamp;
+  if (bei.height != 0)
+    max_timestamp = std::max(max_timestamp, *m_db_blocks_max_timestamps.back());
+  m_db_blocks_max_timestamps.push_back(max_timestamp);
+}
+//------------------------------------------------------------------
+uint64_t blockchain_storage::get_first_height_with_max_timestamp_not_less(uint64_t timestamp) const
+{
+  CRITICAL_REGION_LOCAL(m_read_lock);
+  // binary search over non-decreasing maximums, returns the blockchain size if all blocks are older than timestamp
+  uint64_t low = 0, high = m_db_blocks_max_timestamps.size();
+  while (low < high)
+  {
+    uint64_t mid = low + (high - low) / 2;
+    if (*m_db_blocks_max_timestamps[mid] < timestamp)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::rebuild_block_headers_index()
+{
+  LOG_PRINT_MAGENTA("Building block headers index for " << m_db_blocks.size() << " blocks...", LOG_LEVEL_0);
+  try
+  {
+    m_db.begin_transaction();
+    m_db_block_headers.clear();
+    m_db_blocks_max_timestamps.clear();
+    for (uint64_t height = 0, size = m_db_blocks.size(); height < size; ++height)
+    {
+      auto bei_ptr = m_db_blocks[height];
+      push_block_to_headers_index(*bei_ptr, get_block_hash(bei_ptr->bl));
+    }
+    m_db.commit_transaction();
+  }
+  catch (const std::exception& e)
+  {
+    LOG_ERROR("Failed to build block headers index: " << e.what());
+    m_db.abort_transaction();
+    return false;
+  }
+  LOG_PRINT_MAGENTA("Block headers index built successfully", LOG_LEVEL_0);
+  return true;
+}
+//------------------------------------------------------------------
 void blockchain_storage::calculate_local_gindex_lookup_table_for_height(uint64_t height, std::map<uint64_t, uint64_t>& gindexes) const
 {
   gindexes.clear();
@@ -7381,11 +8956,11 @@ bool blockchain_storage::validate_alt_block_input(const transaction& input_tx,
   size_t input_index,
   uint64_t split_height,
   const alt_chain_type& alt_chain,
-  const std::unordered_set<crypto::hash>& alt_chain_block_ids,
   const uint64_t pos_block_timestamp,
   const wide_difficulty_type& pos_difficulty,
   uint64_t& ki_lookuptime,
-  uint64_t* p_max_related_block_height /* = nullptr */) const
+  uint64_t* p_max_related_block_height /* = nullptr */,
+  bool skip_signatures /* = false */) const
 {
   // Main and alt chain outline:
   //
@@ -7426,7 +9001,7 @@ bool blockchain_storage::validate_alt_block_input(const transaction& input_tx,
   const uint64_t input_amount = get_amount_from_variant(input_v);
 
   // check case b1: key_image spent status in main chain, should be either non-spent or has spent height >= split_height
-  auto p = m_db_spent_keys.get(input_key_image);
+  auto p = is_key_image_maybe_spent(input_key_image) ? m_db_spent_keys.get(input_key_image) : std::shared_ptr<const uint64_t>();
   CHECK_AND_ASSERT_MES(p == nullptr || *p >= split_height, false, "key image " << input_key_image << " has been already spent in main chain at height " << *p << ", split height: " << split_height);
 
   TIME_MEASURE_START(ki_lookup_time);
@@ -7438,20 +9013,12 @@ bool blockchain_storage::validate_alt_block_input(const transaction& input_tx,
     LOG_ERROR("key image " << input_key_image << " already spent in this alt block");
     return false;
   }
-  auto ki_it = m_altblocks_keyimages.find(input_key_image);
-  if (ki_it != m_altblocks_keyimages.end())
-  {    
-    //have some entry for this key image. Check if this key image belongs to this alt chain
-    const std::list<crypto::hash>& key_image_block_ids = ki_it->second;
-    for (auto& h : key_image_block_ids)
-    {
-      if (alt_chain_block_ids.find(h) != alt_chain_block_ids.end())
-      {
-        // cases b2, b3
-        LOG_ERROR("key image " << input_key_image << " already spent in altchain");
-        return false;
-      }
-    }
+  //then among the ones of the alt blocks of this chain
+  if (!alt_chain.empty() && alt_chain_keyimages::contains(alt_chain.back()->second.keyimages, input_key_image))
+  {
+    // cases b2, b3
+    LOG_ERROR("key image " << input_key_image << " already spent in altchain");
+    return false;
   }
   //update altchain with key image
   collected_keyimages.insert(input_key_image);
@@ -7518,7 +9085,7 @@ bool blockchain_storage::validate_alt_block_input(const transaction& input_tx,
     crypto::hash tx_id = null_hash;
     uint64_t out_n = UINT64_MAX;
     auto &off = abs_key_offsets[pk_n];
-    if (off.type() == typeid(uint64_t))
+    if (tools::is_variant_type<uint64_t>(off))
     {
       uint64_t offset_gindex = boost::get<uint64_t>(off);
       CHECK_AND_ASSERT_MES(amount_touched_altchain || (offset_gindex < global_outs_for_amount), false,
@@ -7571,7 +9138,7 @@ bool blockchain_storage::validate_alt_block_input(const transaction& input_tx,
       tx_id = p->tx_id;
       out_n = p->out_no;
     }
-    else if (off.type() == typeid(ref_by_id))
+    else if (tools::is_variant_type<ref_by_id>(off))
     {
       auto &rbi = boost::get<ref_by_id>(off);
       tx_id = rbi.tx_id;
@@ -7640,6 +9207,8 @@ bool blockchain_storage::validate_alt_block_input(const transaction& input_tx,
 
 
   // do input checks (attachment_info, ring signature and extra signature, etc.)
+  if (!skip_signatures)
+  {
   VARIANT_SWITCH_BEGIN(input_v);
   VARIANT_CASE_CONST(txin_to_key, input_to_key)
     r = check_input_signature(input_tx, input_index, input_to_key, input_tx_hash, pub_key_pointers);
@@ -7661,7 +9230,7 @@ bool blockchain_storage::validate_alt_block_input(const transaction& input_tx,
       crypto::hash kernel_hash = crypto::cn_fast_hash(&sk, sizeof(sk));
       crypto::scalar_t last_pow_block_id_hashed = crypto::hash_helper_t::hs(CRYPTO_HDS_ZARCANUM_LAST_POW_HASH, sm.last_pow_id);
       CHECK_AND_ASSERT_MES(input_tx.signatures.size() != 2, false, "input_tx.signatures has wrong size: " << input_tx.signatures.size());
-      CHECK_AND_ASSERT_MES(input_tx.signatures[0].type() == typeid(zarcanum_sig), false, "input_tx.signatures[" << input_index << "] has wrong type: " << input_tx.signatures[input_index].type().name());
+      CHECK_AND_ASSERT_MES(tools::is_variant_type<zarcanum_sig>(input_tx.signatures[0]), false, "input_tx.signatures[" << input_index << "] has wrong type: " << input_tx.signatures[input_index].type().name());
       const zarcanum_sig& sig = boost::get<zarcanum_sig>(input_tx.signatures[0]);
       uint8_t err = 0;
       r = crypto::zarcanum_verify_proof(bl_id, kernel_hash, zarcanum_input_ring, last_pow_block_id_hashed, input_key_image, pos_difficulty, sig, &err);
@@ -7673,7 +9242,7 @@ bool blockchain_storage::validate_alt_block_input(const transaction& input_tx,
       crypto::hash tx_hash_for_signature = prepare_prefix_hash_for_sign(input_tx, input_index, input_tx_hash);
       CHECK_AND_ASSERT_MES(tx_hash_for_signature != null_hash, false, "prepare_prefix_hash_for_sign failed");
       CHECK_AND_ASSERT_MES(input_index < input_tx.signatures.size(), false, "input_tx.signatures has wrong size: " << input_tx.signatures.size());
-      CHECK_AND_ASSERT_MES(input_tx.signatures[input_index].type() == typeid(ZC_sig), false, "input_tx.signatures[" << input_index << "] has wrong type: " << input_tx.signatures[input_index].type().name());
+      CHECK_AND_ASSERT_MES(tools::is_variant_type<ZC_sig>(input_tx.signatures[input_index]), false, "input_tx.signatures[" << input_index << "] has wrong type: " << input_tx.signatures[input_index].type().name());
       const ZC_sig& sig = boost::get<ZC_sig>(input_tx.signatures[input_index]);
       bool r = crypto::verify_CLSAG_GGX(tx_hash_for_signature, zc_input_ring, sig.pseudo_out_amount_commitment, sig.pseudo_out_blinded_asset_id, input_key_image, sig.clsags_ggx);
       CHECK_AND_ASSERT_MES(r, false, "verify_CLSAG_GGX failed");
@@ -7682,6 +9251,7 @@ bool blockchain_storage::validate_alt_block_input(const transaction& input_tx,
     LOG_ERROR("unexpected input type: " << input_v.type().name());
     return false;
   VARIANT_SWITCH_END();
+  }
 
 
   if (p_max_related_block_height != nullptr)
@@ -7704,11 +9274,11 @@ bool blockchain_storage::validate_alt_block_input(const transaction& input_tx,
 //------------------------------------------------------------------
 bool blockchain_storage::is_output_allowed_for_input(const tx_out_v& out_v, const txin_v& in_v, uint64_t top_minus_source_height) const
 {
-  if (out_v.type() == typeid(tx_out_bare))
+  if (tools::is_variant_type<tx_out_bare>(out_v))
   {
     return is_output_allowed_for_input(boost::get<tx_out_bare>(out_v).target, in_v, top_minus_source_height);
   }
-  else if (out_v.type() == typeid(tx_out_zarcanum))
+  else if (tools::is_variant_type<tx_out_zarcanum>(out_v))
   {
     return is_output_allowed_for_input(boost::get<tx_out_zarcanum>(out_v), in_v);
   }
@@ -7722,11 +9292,11 @@ bool blockchain_storage::is_output_allowed_for_input(const tx_out_v& out_v, cons
 //------------------------------------------------------------------
 bool blockchain_storage::is_output_allowed_for_input(const txout_target_v& out_v, const txin_v& in_v, uint64_t top_minus_source_height)const
 {
-  if (out_v.type() == typeid(txout_to_key))
+  if (tools::is_variant_type<txout_to_key>(out_v))
   {
     return is_output_allowed_for_input(boost::get<txout_to_key>(out_v), in_v);
   }
-  else if (out_v.type() == typeid(txout_htlc))
+  else if (tools::is_variant_type<txout_htlc>(out_v))
   {
     return is_output_allowed_for_input(boost::get<txout_htlc>(out_v), in_v, top_minus_source_height);
   }
@@ -7752,12 +9322,12 @@ bool blockchain_storage::is_output_allowed_for_input(const txout_htlc& out_v, co
   if (!htlc_expired)
   {
     //HTLC IS NOT expired, can be used ONLY by pkey_before_expiration and ONLY by HTLC input
-    CHECK_AND_ASSERT_MES(in_v.type() == typeid(txin_htlc), false, "[TXOUT_HTLC]: Unexpected output type of non-HTLC input");
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_htlc>(in_v), false, "[TXOUT_HTLC]: Unexpected output type of non-HTLC input");
   }
   else
   {
     //HTLC IS expired, can be used ONLY by pkey_after_expiration and ONLY by to_key input
-    CHECK_AND_ASSERT_MES(in_v.type() == typeid(txin_to_key), false, "[TXOUT_HTLC]: Unexpected output type of HTLC input");
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_to_key>(in_v), false, "[TXOUT_HTLC]: Unexpected output type of HTLC input");
   }
   return true;
 }
@@ -7765,13 +9335,13 @@ bool blockchain_storage::is_output_allowed_for_input(const txout_htlc& out_v, co
 bool blockchain_storage::is_output_allowed_for_input(const txout_to_key& out_v, const txin_v& in_v)const
 {
   //HTLC input CAN'T refer to regular to_key output
-  CHECK_AND_ASSERT_MES(in_v.type() != typeid(txin_htlc), false, "[TXOUT_TO_KEY]: Unexpected output type of HTLC input");
+  CHECK_AND_ASSERT_MES(!tools::is_variant_type<txin_htlc>(in_v), false, "[TXOUT_TO_KEY]: Unexpected output type of HTLC input");
   return true;
 }
 //------------------------------------------------------------------
 bool blockchain_storage::is_output_allowed_for_input(const tx_out_zarcanum& out, const txin_v& in_v) const
 {
-  CHECK_AND_ASSERT_MES(in_v.type() == typeid(txin_zc_input), false, "tx_out_zarcanum can only be referenced by txin_zc_input, not by " << in_v.type().name());
+  CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_zc_input>(in_v), false, "tx_out_zarcanum can only be referenced by txin_zc_input, not by " << in_v.type().name());
   return true;
 }
 //------------------------------------------------------------------
@@ -7805,7 +9375,7 @@ bool blockchain_storage::validate_alt_block_ms_input(const transaction& input_tx
   CRITICAL_REGION_LOCAL(m_read_lock);
   bool r = false;
   CHECK_AND_ASSERT_MES(input_index < input_tx.vin.size() 
-    && input_tx.vin[input_index].type() == typeid(txin_multisig), false, "invalid ms input index: " << input_index << " or type");
+    && tools::is_variant_type<txin_multisig>(input_tx.vin[input_index]), false, "invalid ms input index: " << input_index << " or type");
   const txin_multisig& input = boost::get<txin_multisig>(input_tx.vin[input_index]);
 
   // check corresponding ms out in the main chain
@@ -7847,7 +9417,7 @@ bool blockchain_storage::validate_alt_block_ms_input(const transaction& input_tx
       // check ms out being already spent in current alt chain
       for (auto& in : tx.vin)
       {
-        if (in.type() == typeid(txin_multisig))
+        if (tools::is_variant_type<txin_multisig>(in))
         {
           // check cases b2, b3
           CHECK_AND_ASSERT_MES(input.multisig_out_id != boost::get<txin_multisig>(in).multisig_out_id, false, "ms out " << input.multisig_out_id << " has been already spent in altchain by tx " << tx_id << " in block " << get_block_hash(b) << " height " << bei.height);
@@ -7859,7 +9429,7 @@ bool blockchain_storage::validate_alt_block_ms_input(const transaction& input_tx
         VARIANT_SWITCH_BEGIN(tx.vout[out_n]);
         VARIANT_CASE_CONST(tx_out_bare, o)
           const tx_out_bare& out = o;
-          if (out.target.type() == typeid(txout_multisig))
+          if (tools::is_variant_type<txout_multisig>(out.target))
           {
             const crypto::hash& ms_out_id = get_multisig_out_id(tx, out_n);
             if (ms_out_id == input.multisig_out_id)
@@ -7923,7 +9493,7 @@ bool blockchain_storage::update_alt_out_indexes_for_tx_in_block(const transactio
   {
     VARIANT_SWITCH_BEGIN(ov);
     VARIANT_CASE_CONST(tx_out_bare, o)
-      if (o.target.type() == typeid(txout_to_key) || o.target.type() == typeid(txout_htlc))
+      if (tools::is_variant_type<txout_to_key>(o.target) || tools::is_variant_type<txout_htlc>(o.target))
       {
         //LOG_PRINT_MAGENTA("ALT_OUT KEY ON H[" << abei.height << "] AMOUNT: " << o.amount, LOG_LEVEL_0);
         // first, look at local gindexes tables
@@ -7953,11 +9523,8 @@ bool blockchain_storage::validate_alt_block_txs(const block& b, const crypto::ha
 {
   uint64_t height = abei.height;
   bool r = false;
-  std::unordered_set<crypto::hash> alt_chain_block_ids;
   txs_by_id_and_height_altchain alt_chain_tx_ids;
 
-  
-  alt_chain_block_ids.insert(id);
   // prepare data structure for output global indexes tracking within current alt chain
   if (alt_chain.size())
   {
@@ -7973,10 +9540,9 @@ bool blockchain_storage::validate_alt_block_txs(const block& b, const crypto::ha
       //increase index starter for amount of outputs in prev block
       it_amont_in_abs_ind->second += it->second.size();
     }
-    //generate set of alt block ids
+    //collect txs of the alt chain
     for (auto& ch : alt_chain)
     {
-      alt_chain_block_ids.insert(get_block_hash(ch->second.bl));
       for (auto & on_board_tx : ch->second.onboard_transactions)
       {
         alt_chain_tx_ids.insert(txs_by_id_and_height_altchain::value_type(on_board_tx.first, txs_by_id_and_height_altchain::value_type::second_type(on_board_tx.second, ch->second.height)));
@@ -7999,7 +9565,7 @@ bool blockchain_storage::validate_alt_block_txs(const block& b, const crypto::ha
     // check PoS block miner tx in a special way
     CHECK_AND_ASSERT_MES(b.miner_tx.signatures.size() == 1 && b.miner_tx.vin.size() == 2, false, "invalid PoS block's miner_tx, signatures size = " << b.miner_tx.signatures.size() << ", miner_tx.vin.size() = " << b.miner_tx.vin.size());
 
-    r = validate_alt_block_input(b.miner_tx, collected_keyimages, alt_chain_tx_ids, id, get_block_hash(b), 1, split_height, alt_chain, alt_chain_block_ids, b.timestamp, abei.difficulty, ki_lookup, &max_related_block_height);
+    r = validate_alt_block_input(b.miner_tx, collected_keyimages, alt_chain_tx_ids, id, get_block_hash(b), 1, split_height, alt_chain, b.timestamp, abei.difficulty, ki_lookup, &max_related_block_height);
     CHECK_AND_ASSERT_MES(r, false, "miner tx " << get_transaction_hash(b.miner_tx) << ": validation failed");
 
     ki_lookup_time_total += ki_lookup;
@@ -8027,21 +9593,25 @@ bool blockchain_storage::validate_alt_block_txs(const block& b, const crypto::ha
 
     fees.push_back(get_tx_fee(tx));
 
+    // tx verified against the main chain below split height has the same ring members here 
+    const crypto::hash tx_verification_key = get_blob_hash(t_serializable_object_to_blob(tx));
+    bool skip_signatures = is_tx_signatures_preverified(tx_verification_key, split_height);
+
     for (size_t n = 0; n < tx.vin.size(); ++n)
     {
-      if (tx.vin[n].type() == typeid(txin_to_key) || tx.vin[n].type() == typeid(txin_htlc) || tx.vin[n].type() == typeid(txin_zc_input))
+      if (tools::is_variant_type<txin_to_key>(tx.vin[n]) || tools::is_variant_type<txin_htlc>(tx.vin[n]) || tools::is_variant_type<txin_zc_input>(tx.vin[n]))
       {
         uint64_t ki_lookup = 0;
-        r = validate_alt_block_input(tx, collected_keyimages, alt_chain_tx_ids, id, tx_id, n, split_height, alt_chain, alt_chain_block_ids, 0, 0 /* <= both are not required for normal txs*/, ki_lookup);
+        r = validate_alt_block_input(tx, collected_keyimages, alt_chain_tx_ids, id, tx_id, n, split_height, alt_chain, 0, 0 /* <= both are not required for normal txs*/, ki_lookup, nullptr, skip_signatures);
         CHECK_AND_ASSERT_MES(r, false, "tx " << tx_id << ", input #" << n << ": validation failed");
         ki_lookup_time_total += ki_lookup;
       }
-      else if (tx.vin[n].type() == typeid(txin_multisig))
+      else if (tools::is_variant_type<txin_multisig>(tx.vin[n]))
       {
         r = validate_alt_block_ms_input(tx, tx_id, n, split_height, alt_chain);
         CHECK_AND_ASSERT_MES(r, false, "tx " << tx_id << ", input #" << n << " (multisig): validation failed");
       }
-      else if (tx.vin[n].type() == typeid(txin_gen))
+      else if (tools::is_variant_type<txin_gen>(tx.vin[n]))
       {
         // genesis can't be in tx_hashes
         CHECK_AND_ASSERT_MES(false, false, "input #" << n << " has unexpected type (" << tx.vin[n].type().name() << ", genesis can't be in tx_hashes), tx " << tx_id);
@@ -8053,6 +9623,11 @@ bool blockchain_storage::validate_alt_block_txs(const block& b, const crypto::ha
     }
 
     CHECK_AND_ASSERT_MES(validate_tx_for_hardfork_specific_terms(tx, tx_id, height), false, "tx " << tx_id << ": hardfork-specific validation failed");
+
+    // all ring members are below this block, so the signatures hold while the chain up to its prev block is the same,
+    // in particular when the main chain is switched to this alt chain (check_tx_inputs() then skips them)
+    if (!skip_signatures && height > 0)
+      m_verified_txs_cache.set(tx_verification_key, height - 1, b.prev_id);
     
     // Updating abei (and not updating alt_chain) during this cycle is safe because txs in the same block can't reference one another,
     // so only valid references are either to previous alt blocks (accessed via alt_chain) or to main chain blocks.
@@ -25,6 +25,7 @@
 
 #include "tx_pool.h"
 #include "blockchain_storage_basic.h"
+#include "zc_outputs_index.h"
 #include "common/util.h"
 #include "common/db_abstract_accessor.h"
 #include "currency_protocol/currency_protocol_defs.h"
@@ -37,9 +38,14 @@
 #include "checkpoints.h"
 #include "core_runtime_config.h"
 #include "dispatch_core_events.h"
+#include "chain_change_notifier.h"
 #include "bc_attachments_service_manager.h"
 #include "common/median_db_cache.h"
 #include "common/variant_helper.h"
+#include "common/threads_pool.h"
+#include "common/blocked_bloom_filter.h"
+#include "common/memory_usage.h"
+#include "ethash_epoch_preparer.h"
 
 
 MARK_AS_POD_C11(crypto::key_image);
@@ -71,6 +77,8 @@ namespace currency
       epee::math_helper::average<uint64_t, 5> validate_miner_transaction_time;
       epee::math_helper::average<uint64_t, 5> collect_rangeproofs_data_from_tx_time;
       epee::math_helper::average<uint64_t, 5> verify_multiple_zc_outs_range_proofs_time;
+      epee::math_helper::average<uint64_t, 5> txs_prevalidation_time;
+      epee::math_helper::average<uint64_t, 5> batch_verify_range_proofs_time;
       
       
       //target_calculating_time_2
@@ -119,6 +127,14 @@ namespace currency
       tools::db::stat_info si;
     };
 
+    struct db_container_cache_stat
+    {
+      std::string name;
+      uint64_t hits;            // since start, all cache shards together
+      uint64_t misses;
+      double hit_percent_avg;   // over the latest lookups
+    };
+
 
     struct key_images_ptr_compare
     {
@@ -178,6 +194,12 @@ namespace currency
       
       //transactions associated with the block
       transactions_map onboard_transactions;
+
+      //serialized size of the block and its onboard transactions, counted against max_alt_blocks_stored_size
+      uint64_t stored_size;
+
+      //key images spent in this block and its alt ancestors
+      alt_chain_keyimages::ptr keyimages;
     };
     typedef std::unordered_map<crypto::hash, alt_block_extended_info> alt_chain_container;
     typedef std::vector<alt_chain_container::iterator> alt_chain_type; // alternative subchain, front -> mainchain(split point), back -> alternative head
@@ -197,6 +219,8 @@ namespace currency
 
     bool init(const boost::program_options::variables_map& vm) { return init(tools::get_default_data_dir(), vm); }
     bool init(const std::string& config_folder, const boost::program_options::variables_map& vm);
+    // builds the full ethash dataset of the top block's epoch in the background (the first PoW check builds it in place otherwise)
+    bool prepare_top_ethash_epoch();
     bool deinit();
     static void init_options(boost::program_options::options_description& desc);
 
@@ -204,6 +228,8 @@ namespace currency
 
     //TODO: set this method to const
     checkpoints& get_checkpoints() { return m_checkpoints; }
+    uint64_t get_prune_depth() const { return m_prune_depth; }
+    uint64_t get_pruned_rs_height() const { return m_db_current_pruned_rs_height; }
     bool is_in_checkpoint_zone() const { return m_is_in_checkpoint_zone; }
    
     //------------- modifying members --------------
@@ -211,10 +237,15 @@ namespace currency
     bool prevalidate_block(const block& bl);
     bool clear();
     bool reset_and_set_genesis_block(const block& b);
-    //debug function
-    bool truncate_blockchain(uint64_t to_height);
+    //debug function: removes the blocks from to_height up, their transactions go to the pool only if move_txs_to_pool
+    bool truncate_blockchain(uint64_t to_height, bool move_txs_to_pool = false);
     //------------- readers members -----------------
     bool pre_validate_relayed_block(block& b, block_verification_context& bvc, const crypto::hash& id)const ;
+    void batch_verify_range_proofs(const std::vector<block>& blocks, std::vector<block_verification_context>& bvcs) const;
+    //sync blocks write batch: blocks added between begin and end are committed to the db in groups (see --db-sync-batch-blocks)
+    bool begin_blocks_write_batch();
+    void on_blocks_write_batch_block_added(uint64_t block_blobs_size);
+    void end_blocks_write_batch();
     //bool push_new_block();
     bool get_blocks(uint64_t start_offset, size_t count, std::list<block>& blocks, std::list<transaction>& txs) const ;
     bool get_blocks(uint64_t start_offset, size_t count, std::list<block>& blocks) const;
@@ -232,6 +263,7 @@ namespace currency
     bool get_alternative_blocks(std::list<block>& blocks) const;
     size_t get_alternative_blocks_count() const;
     crypto::hash get_block_id_by_height(uint64_t height) const;
+    bool get_block_header_index_entry(uint64_t height, block_header_index_entry& entry) const;
     bool get_block_by_hash(const crypto::hash &h, block &blk) const;
     bool get_block_extended_info_by_height(uint64_t h, block_extended_info &blk) const;
     bool get_block_extended_info_by_hash(const crypto::hash &h, block_extended_info &blk) const;
@@ -275,43 +307,57 @@ namespace currency
     bool create_block_template(const account_public_address& miner_address, const blobdata& ex_nonce, block& b, wide_difficulty_type& di, uint64_t& height) const;
     bool create_block_template(const account_public_address& miner_address, const account_public_address& stakeholder_address, const blobdata& ex_nonce, bool pos, const pos_entry& pe, fill_block_template_func_t custom_fill_block_template_func, block& b, wide_difficulty_type& di, uint64_t& height, tx_generation_context* miner_tx_tgc_ptr = nullptr) const;
     bool create_block_template(const create_block_template_params& params, create_block_template_response& resp) const;
+    bool create_block_template_base(bool pos, fill_block_template_func_t* pcustom_fill_block_template_func, const std::list<transaction>& explicit_txs, block_template_base& base) const;
+    bool create_block_template(const create_block_template_params& params, const block_template_base& base, create_block_template_response& resp) const;
 
     bool have_block(const crypto::hash& id) const;
     size_t get_total_transactions()const;
     bool get_outs(uint64_t amount, std::list<crypto::public_key>& pkeys)const;
     bool get_short_chain_history(std::list<crypto::hash>& ids)const;
-    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp)const;
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, bool with_headers = false)const;
     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, uint64_t& starter_offset)const;
     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<std::pair<block, std::list<transaction> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count, uint64_t minimum_height = 0)const;
-    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, blocks_direct_container& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count, uint64_t minimum_height = 0)const;
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, blocks_direct_container& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count, uint64_t minimum_height = 0, std::vector<crypto::hash>* pblock_ids = nullptr)const;
     //bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<std::pair<block, std::list<transaction> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count)const;
     bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp)const;
+    // serialized block with all its txs, if it was relayed or sent to a peer recently (the block may be not in the main chain anymore)
+    std::shared_ptr<const block_complete_entry> get_cached_block_blobs(const crypto::hash& id) const;
+    // e must hold all the block's txs
+    void cache_block_blobs(const crypto::hash& id, const block_complete_entry& e) const;
+    // PoW hash of a block checked before the block itself came (with the chain headers), not to calculate it again
+    void add_precomputed_pow_hash(const crypto::hash& id, const crypto::hash& pow_hash) const;
+    bool get_precomputed_pow_hash(const crypto::hash& id, crypto::hash& pow_hash) const;
     bool handle_get_objects(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res)const;
     bool get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res)const;
     bool get_random_outs_for_amounts3(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::request& req, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::response& res)const;
     bool get_backward_blocks_sizes(size_t from_height, std::vector<size_t>& sz, size_t count)const;
     bool get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<uint64_t>& indexs)const;
+    bool get_tx_outputs_gindexs(const std::vector<crypto::hash>& tx_ids, std::vector<std::vector<uint64_t> >& indexs)const;
     bool get_alias_info(const std::string& alias, extra_alias_entry_base& info)const;
     std::string get_alias_by_address(const account_public_address& addr)const;
     std::set<std::string> get_aliases_by_address(const account_public_address& addr)const;
     template<typename cb_t>
     bool enumerate_aliases(cb_t cb) const;
     template<typename cb_t>
-    bool get_aliases(cb_t cb, uint64_t offset, uint64_t count) const;
+    bool get_aliases(cb_t cb, uint64_t offset, uint64_t count, const std::string& prefix = std::string()) const;
     uint64_t get_aliases_count()const;
+    uint64_t get_aliases_version()const; // changes whenever any alias may have changed
     uint64_t get_block_h_older_then(uint64_t timestamp) const;
     bool validate_tx_service_attachmens_in_services(const tx_service_attachment& a, size_t i, const transaction& tx)const;
     bool get_asset_history(const crypto::public_key& asset_id, std::list<asset_descriptor_operation>& result) const;
     bool get_asset_info(const crypto::public_key& asset_id, asset_descriptor_base& info)const;
     uint64_t get_assets_count() const;
-    uint64_t get_assets(uint64_t offset, uint64_t count, std::list<asset_descriptor_with_id>& assets) const;
-    bool check_tx_input(const transaction& tx, size_t in_index, const txin_to_key& txin, const crypto::hash& tx_prefix_hash, uint64_t& max_related_block_height, uint64_t& source_max_unlock_time_for_pos_coinbase)const;
+    uint64_t get_assets(uint64_t offset, uint64_t count, std::list<asset_descriptor_with_id>& assets, const std::string& ticker_prefix = std::string()) const;
+    bool check_tx_input(const transaction& tx, size_t in_index, const txin_to_key& txin, const crypto::hash& tx_prefix_hash, uint64_t& max_related_block_height, uint64_t& source_max_unlock_time_for_pos_coinbase, bool skip_signatures = false)const;
     bool check_tx_input(const transaction& tx, size_t in_index, const txin_multisig& txin, const crypto::hash& tx_prefix_hash, uint64_t& max_related_block_height)const;
-    bool check_tx_input(const transaction& tx, size_t in_index, const txin_htlc& txin, const crypto::hash& tx_prefix_hash, uint64_t& max_related_block_height)const;
-    bool check_tx_input(const transaction& tx, size_t in_index, const txin_zc_input& zc_in, const crypto::hash& tx_prefix_hash, uint64_t& max_related_block_height, bool& all_tx_ins_have_explicit_native_asset_ids) const;
+    bool check_tx_input(const transaction& tx, size_t in_index, const txin_htlc& txin, const crypto::hash& tx_prefix_hash, uint64_t& max_related_block_height, bool skip_signatures = false)const;
+    bool check_tx_input(const transaction& tx, size_t in_index, const txin_zc_input& zc_in, const crypto::hash& tx_prefix_hash, uint64_t& max_related_block_height, bool& all_tx_ins_have_explicit_native_asset_ids, crypto::CLSAG_ring_members_cache_t* p_clsag_cache = nullptr, bool skip_signatures = false) const;
     bool check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash, uint64_t& max_used_block_height)const;
+    // multisig inputs may also refer to p_unconfirmed_ms_outs, i.e. to txs going earlier in the same block; results of such checks are not cached
+    bool check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash, uint64_t& max_used_block_height, const unconfirmed_ms_outs_map* p_unconfirmed_ms_outs)const;
     bool check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash) const;
     bool check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash, uint64_t& max_used_block_height, crypto::hash& max_used_block_id)const;
+    bool is_tx_signatures_preverified(const crypto::hash& tx_verification_key, uint64_t split_height) const;
     bool check_ms_input(const transaction& tx, size_t in_index, const txin_multisig& txin, const crypto::hash& tx_prefix_hash, const transaction& source_tx, size_t out_n) const;
     bool validate_tx_for_hardfork_specific_terms(const transaction& tx, const crypto::hash& tx_id, uint64_t block_height) const;
     bool validate_tx_for_hardfork_specific_terms(const transaction& tx, const crypto::hash& tx_id) const;
@@ -339,6 +385,7 @@ namespace currency
     uint64_t validate_alias_reward(const transaction& tx, const std::string& ai)const;
     void set_event_handler(i_core_event_handler* event_handler) const;
     i_core_event_handler* get_event_handler() const;
+    chain_change_notifier& get_change_notifier() const { return m_change_notifier; } // notified on each block added or removed and each pool change
     uint64_t get_last_timestamps_check_window_median() const;
     uint64_t get_last_n_blocks_timestamps_median(size_t n) const;
     bool prevalidate_alias_info(const transaction& tx, const extra_alias_entry& eae);
@@ -435,10 +482,13 @@ namespace currency
     {
       CRITICAL_REGION_LOCAL(m_read_lock);
 
-      BOOST_FOREACH(const auto& tx_id, txs_ids)
+      std::vector<crypto::hash> ids(txs_ids.begin(), txs_ids.end());
+      std::vector<std::shared_ptr<const transaction_chain_entry> > tx_ptrs;
+      m_db_transactions.get_multiple(ids, tx_ptrs);
+      for (size_t i = 0; i != ids.size(); ++i)
       {
-        auto tx_ptr = m_db_transactions.find(tx_id);
-        if (!tx_ptr)
+        const crypto::hash& tx_id = ids[i];
+        if (!tx_ptrs[i])
         {
           transaction tx;
           if (!m_tx_pool.get_transaction(tx_id, tx))
@@ -447,7 +497,7 @@ namespace currency
             txs.push_back(tx);
         }
         else
-          txs.push_back(tx_ptr->tx);
+          txs.push_back(tx_ptrs[i]->tx);
       }
       return true;
     }
@@ -458,20 +508,22 @@ namespace currency
     {
       CRITICAL_REGION_LOCAL(m_read_lock);
 
-      for(const auto& tx_id: txs_ids)
+      std::vector<crypto::hash> ids(txs_ids.begin(), txs_ids.end());
+      std::vector<std::shared_ptr<const transaction_chain_entry> > tx_ptrs;
+      m_db_transactions.get_multiple(ids, tx_ptrs);
+      for (size_t i = 0; i != ids.size(); ++i)
       {
-        auto tx_ptr = m_db_transactions.find(tx_id);
-        if (!tx_ptr)
-          missed_txs.push_back(tx_id);
+        if (!tx_ptrs[i])
+          missed_txs.push_back(ids[i]);
         else
-          txs.push_back(tx_ptr);
+          txs.push_back(tx_ptrs[i]);
       }
       return true;
     }
 
     //TODO: set to const
     void get_alternative_chains(alt_chain_container& ach)  { CRITICAL_REGION_LOCAL(m_alternative_chains_lock); ach = m_alternative_chains; }
-    void set_alternative_chains(const alt_chain_container& ach)  { CRITICAL_REGION_LOCAL(m_alternative_chains_lock); m_alternative_chains = ach; }
+    void set_alternative_chains(const alt_chain_container& ach)  { CRITICAL_REGION_LOCAL(m_alternative_chains_lock); m_alternative_chains = ach; m_alternative_chains_stored_size = 0; for (const auto& a : ach) m_alternative_chains_stored_size += a.second.stored_size; }
 
     template<class archive_t>
     void serialize(archive_t & ar, const unsigned int version);
@@ -489,11 +541,18 @@ namespace currency
     void print_blockchain_outs(const std::string& file) const;
     void print_blockchain_outs_stats() const;
     void print_db_cache_perfeormance_data() const;
+    void get_db_cache_stats(std::list<db_container_cache_stat>& stats) const;
+    // estimated sizes of the caches and in-memory containers
+    void get_memory_usage(std::list<tools::memory_usage_entry>& usage) const;
     void print_last_n_difficulty_numbers(uint64_t n) const;
     bool calc_tx_cummulative_blob(const block& bl)const;
     bool get_outs_index_stat(outs_index_stat& outs_stat)const;
     bool print_lookup_key_image(const crypto::key_image& ki) const;
     void reset_db_cache() const;
+    bool compact_db(uint64_t& size_before, uint64_t& size_after);
+    bool is_secondary() const { return m_is_secondary; }
+    // secondary instance: picks up commits made by the primary daemon, returns true if there were any
+    bool follow_primary();
     void clear_altblocks();
     void inspect_blocks_index() const;
     bool rebuild_tx_fee_medians();
@@ -509,6 +568,8 @@ namespace currency
     typedef tools::db::cached_key_value_accessor<crypto::hash, transaction_chain_entry, true, false> transactions_container; 
     
     typedef tools::db::array_accessor<block_extended_info, true> blocks_container;      
+    typedef tools::db::array_accessor<block_header_index_entry, false> block_headers_container; // height => block_header_index_entry, always in sync with blocks_container
+    typedef tools::db::array_accessor<uint64_t, false> blocks_max_timestamps_container; // height => max timestamp of blocks [0, height], non-decreasing, always in sync with blocks_container
 
     typedef tools::db::cached_key_value_accessor<std::string, std::list<extra_alias_entry_base>, true, true> aliases_container; 
     typedef tools::db::cached_key_value_accessor<account_public_address, std::set<std::string>, true, false> address_to_aliases_container;
@@ -522,6 +583,27 @@ namespace currency
     //-----------------------------------------
 
     typedef std::unordered_map<crypto::hash, std::pair<const transaction&, uint64_t> > txs_by_id_and_height_altchain;
+
+    enum block_tx_prevalidation_status
+    {
+      btps_ok = 0,
+      btps_wrong_semantic,
+      btps_rangeproofs_failed,
+      btps_balance_failed,
+      btps_surjection_failed
+    };
+
+    // state of a block's transaction between taking it from the pool/cache and adding it to the blockchain storage
+    struct block_tx_prevalidation_entry
+    {
+      crypto::hash tx_id;
+      transaction tx;
+      size_t blob_size;
+      uint64_t fee;
+      bool taken_from_pool;
+      block_tx_prevalidation_status status;
+      std::vector<zc_outs_range_proofs_with_commitments> range_proofs;
+    };
     
     tx_memory_pool& m_tx_pool;
     mutable bc_attachment_services_manager m_services_mgr;
@@ -544,9 +626,14 @@ namespace currency
     tools::db::basic_db_accessor m_db;
     //containers
     blocks_container m_db_blocks;
+    block_headers_container m_db_block_headers;
+    blocks_max_timestamps_container m_db_blocks_max_timestamps;
     blocks_by_id_index m_db_blocks_index;
     transactions_container m_db_transactions;
     key_images_container m_db_spent_keys;
+    tools::blocked_bloom_filter<crypto::key_image> m_spent_keys_filter; // all key images of m_db_spent_keys (and maybe some popped ones), lets most lookups of unspent ones skip the db; not used by a secondary instance
+    mutable tools::blocked_bloom_filter<crypto::hash> m_ids_filter; // ids of main chain blocks, txs and multisig outs (and maybe some popped ones) for search_by_id(), built on its first call; not used by a secondary instance
+    mutable std::atomic<bool> m_ids_filter_ready;
     solo_options_container m_db_solo_options;
     tools::db::solo_db_value<uint64_t, uint64_t, solo_options_container> m_db_current_block_cumul_sz_limit;
     tools::db::solo_db_value<uint64_t, uint64_t, solo_options_container> m_db_current_pruned_rs_height;
@@ -556,12 +643,34 @@ namespace currency
     tools::db::solo_db_value<uint64_t, bool, solo_options_container> m_db_major_failure; //safety fuse
 
     outputs_container m_db_outputs;
+    zc_outputs_index m_zc_outputs_index;         // amount 0 gindex => zc_output_index_entry, memory-mapped file derived from m_db_outputs
     multisig_outs_container m_db_multisig_outs;
     aliases_container m_db_aliases;
     address_to_aliases_container m_db_addr_to_alias;
+    mutable epee::critical_section m_aliases_index_lock;
+    mutable std::vector<std::string> m_aliases_index; // sorted names of all the aliases, rebuilt on demand when m_aliases_version changes
+    mutable uint64_t m_aliases_index_version;
+    mutable std::atomic<uint64_t> m_aliases_version;
     per_block_gindex_increments_container m_db_per_block_gindex_incs;
     
     assets_container m_db_assets;
+    mutable epee::critical_section m_assets_index_lock;
+    mutable std::unordered_map<crypto::public_key, asset_descriptor_base> m_assets_index; // asset id -> current descriptor, i.e. m_db_assets[id].back().descriptor
+    mutable std::vector<crypto::public_key> m_assets_index_ids; // sorted, for paging
+    mutable std::multimap<std::string, crypto::public_key> m_assets_index_tickers; // ticker -> asset id, for ticker search
+    mutable std::unordered_set<crypto::public_key> m_assets_index_dirty; // changed since the index was updated
+    mutable bool m_assets_index_valid;
+
+    // last day PoS aggregates for get_pos_mining_estimate(), they depend only on the top block
+    struct pos_mining_estimate_data
+    {
+      crypto::hash top_block_id = null_hash;
+      bool is_valid = false;                        // false if too little PoS blocks were found
+      uint64_t last_day_total_minted_money = 0;
+      uint64_t estimated_total_minting_coins = 0;
+    };
+    mutable epee::critical_section m_pos_mining_estimate_data_lock;
+    mutable pos_mining_estimate_data m_pos_mining_estimate_data;
 
 
 
@@ -570,22 +679,33 @@ namespace currency
     blocks_ext_by_hash m_invalid_blocks;     // crypto::hash -> block_extended_info
     mutable epee::critical_section m_alternative_chains_lock;
     alt_chain_container m_alternative_chains; // crypto::hash -> alt_block_extended_info
+    uint64_t m_alternative_chains_stored_size; // sum of stored_size of all the alt blocks
     std::unordered_map<crypto::hash, size_t> m_alternative_chains_txs; // tx_id -> how many alt blocks it related to (always >= 1)
-    std::unordered_map<crypto::key_image, std::list<crypto::hash>> m_altblocks_keyimages; // key image -> list of alt blocks hashes where it appears in inputs
 
     std::atomic<bool> m_is_in_checkpoint_zone;
     std::atomic<bool> m_is_blockchain_storing;
+    std::atomic<bool> m_is_db_compacting;
+    bool m_is_secondary;                  // read-only instance over the db of another (primary) daemon
+    uint64_t m_secondary_last_tx_id;
 
     std::string m_config_folder;
+    std::string m_db_folder_path;
     //events
     checkpoints m_checkpoints;
     mutable core_runtime_config m_core_runtime_config;
     mutable i_core_event_handler* m_event_handler;
     mutable i_core_event_handler m_event_handler_stub;
+    mutable chain_change_notifier m_change_notifier;
 
     //tools::median_db_cache<uint64_t, uint64_t> m_tx_fee_median;
-    mutable std::unordered_map<size_t, uint64_t> m_timestamps_median_cache;
     mutable performnce_data m_performance_data;
+    mutable ring_members_points_cache m_ring_members_points_cache;
+    mutable verified_txs_cache m_verified_txs_cache;
+    mutable decoy_outputs_cache m_decoy_outputs_cache;
+    mutable crypto::point_precomp_cache m_asset_owner_keys_precomp;  // for the owners of the assets that are emitted/updated often
+    // blocks are relayed, then requested by the peers which missed them and pulled by the wallets, so they are serialized once
+    mutable epee::misc_utils::cache_base<false, crypto::hash, std::shared_ptr<const block_complete_entry>, CURRENCY_BLOCK_BLOBS_CACHE_MAX_ELEMENTS> m_block_blobs_cache;
+    mutable epee::misc_utils::cache_base<false, crypto::hash, crypto::hash, CURRENCY_PRECOMPUTED_POW_HASHES_CACHE_SIZE> m_precomputed_pow_hashes; // block id -> PoW hash
     std::list<core_event> m_core_events_pack;
     mutable epee::file_io_utils::native_filesystem_handle m_interprocess_locker_file;
     //just informational 
@@ -593,14 +713,37 @@ namespace currency
     mutable wide_difficulty_type m_cached_next_pos_difficulty;
 
     mutable epee::critical_section m_targetdata_cache_lock;
-    mutable std::list <std::pair<wide_difficulty_type, uint64_t>> m_pos_targetdata_cache;
-    mutable std::list <std::pair<wide_difficulty_type, uint64_t>> m_pow_targetdata_cache;
+    mutable targetdata_window m_pos_targetdata_window;
+    mutable targetdata_window m_pow_targetdata_window;
+    mutable epee::critical_section m_median_windows_lock;
+    mutable blocks_median_window m_block_sizes_median_window;         // CURRENCY_REWARD_BLOCKS_WINDOW
+    mutable blocks_median_window m_fee_lookup_sizes_median_window;    // CORE_FEE_BLOCKS_LOOKUP_WINDOW
+    mutable blocks_median_window m_timestamps_median_window;          // BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW
+    mutable blocks_median_window m_tx_expiration_median_window;       // TX_EXPIRATION_TIMESTAMP_CHECK_WINDOW
+    mutable epee::critical_section m_daily_stat_window_lock;
+    mutable daily_stat_window m_daily_stat_window;                    // CURRENCY_BLOCKS_PER_DAY
     //work like a cache to avoid recalculation on read operations
     mutable uint64_t m_current_fee_median;
     mutable uint64_t m_current_fee_median_effective_index;
     bool m_is_reorganize_in_process;    
+    bool m_is_truncation_in_process;      // the caches updated on each removed block are invalidated once instead
     mutable std::atomic<bool> m_deinit_is_done;
     mutable uint64_t m_blockchain_launch_timestamp;
+    //pure crypto checks of block's transactions (signatures excluded) are spread over this pool
+    size_t m_tx_verification_threads;
+    //max number of consecutive blocks which range proofs are verified at once during sync (0 - batching is disabled)
+    size_t m_range_proofs_batch_blocks;
+    //max number of blocks / bytes of blocks blobs committed to the db in one write transaction during sync (0 blocks - batching is disabled)
+    size_t m_db_sync_batch_blocks;
+    uint64_t m_db_sync_batch_max_bytes;
+    //signatures, proofs and attachments are kept only for the latest m_prune_depth blocks (0 - only the checkpoints zone is pruned)
+    uint64_t m_prune_depth;
+    bool m_blocks_write_batch_active;
+    size_t m_blocks_write_batch_blocks_count;
+    uint64_t m_blocks_write_batch_bytes;
+    utils::threads_pool m_tx_verification_pool;
+    ethash_dataset_files m_ethash_dataset_files;
+    ethash_epoch_preparer m_ethash_epoch_preparer;
 
     //bool init_tx_fee_median();
     //bool update_tx_fee_median();
@@ -611,22 +754,22 @@ namespace currency
     bool switch_to_alternative_blockchain(alt_chain_type& alt_chain);
     void purge_alt_block_txs_hashs(const block& b);
     void add_alt_block_txs_hashs(const block& b);   
-    bool pop_block_from_blockchain(transactions_map& onboard_transactions);
+    bool pop_block_from_blockchain(transactions_map& onboard_transactions, bool move_txs_to_pool = true);
     bool purge_block_data_from_blockchain(const block& b, size_t processed_tx_count);
-    bool purge_block_data_from_blockchain(const block& b, size_t processed_tx_count, uint64_t& fee, transactions_map& onboard_transactions);
-    bool purge_transaction_from_blockchain(const crypto::hash& tx_id, uint64_t& fee, transaction& tx);
+    bool purge_block_data_from_blockchain(const block& b, size_t processed_tx_count, uint64_t& fee, transactions_map& onboard_transactions, bool move_txs_to_pool = true);
+    bool purge_transaction_from_blockchain(const crypto::hash& tx_id, uint64_t& fee, transaction& tx, bool move_to_pool = true);
     bool purge_transaction_keyimages_from_blockchain(const transaction& tx, bool strict_check);
     wide_difficulty_type get_next_difficulty_for_alternative_chain(const alt_chain_type& alt_chain, block_extended_info& bei, bool pos) const;
     bool handle_block_to_main_chain(const block& bl, block_verification_context& bvc);
     bool handle_block_to_main_chain(const block& bl, const crypto::hash& id, block_verification_context& bvc);
-    bool collect_rangeproofs_data_from_tx(const transaction& tx, const crypto::hash& tx_id, std::vector<zc_outs_range_proofs_with_commitments>& agregated_proofs);
+    bool collect_rangeproofs_data_from_tx(const transaction& tx, const crypto::hash& tx_id, std::vector<zc_outs_range_proofs_with_commitments>& agregated_proofs, bool verify_aggregation_proof = true) const;
+    void prevalidate_block_tx(block_tx_prevalidation_entry& e) const;
+    void prevalidate_block_txs(std::vector<block_tx_prevalidation_entry>& txs);
+    void return_block_txs_to_pool(std::vector<block_tx_prevalidation_entry>& txs, size_t start_index, size_t except_index);
     std::string print_alt_chain(alt_chain_type alt_chain);
     bool handle_alternative_block(const block& b, const crypto::hash& id, block_verification_context& bvc);
     bool is_reorganize_required(const block_extended_info& main_chain_bei, const alt_chain_type& alt_chain, const crypto::hash& proof_alt);
     wide_difficulty_type get_x_difficulty_after_height(uint64_t height, bool is_pos);
-    bool purge_keyimage_from_big_heap(const crypto::key_image& ki, const crypto::hash& block_id);
-    bool purge_altblock_keyimages_from_big_heap(const block& b, const crypto::hash& id);
-    bool append_altblock_keyimages_to_big_heap(const crypto::hash& block_id, const std::unordered_set<crypto::key_image>& alt_block_keyimages);
     bool validate_alt_block_input(const transaction& input_tx, 
       std::unordered_set<crypto::key_image>& collected_keyimages, 
       const txs_by_id_and_height_altchain& alt_chain_tx_ids,
@@ -635,11 +778,11 @@ namespace currency
       size_t input_index, 
       uint64_t split_height, 
       const alt_chain_type& alt_chain, 
-      const std::unordered_set<crypto::hash>& alt_chain_block_ids, 
       const uint64_t pos_block_timestamp,
       const wide_difficulty_type& pos_difficulty,
       uint64_t& ki_lookuptime, 
-      uint64_t* p_max_related_block_height = nullptr) const;
+      uint64_t* p_max_related_block_height = nullptr,
+      bool skip_signatures = false) const;
     bool validate_alt_block_ms_input(const transaction& input_tx, 
       const crypto::hash& input_tx_hash, 
       size_t input_index, 
@@ -655,9 +798,21 @@ namespace currency
     bool add_transaction_from_block(const transaction& tx, const crypto::hash& tx_id, const crypto::hash& bl_id, uint64_t bl_height, uint64_t timestamp);
     bool push_transaction_to_global_outs_index(const transaction& tx, const crypto::hash& tx_id, std::vector<uint64_t>& global_indexes);
     bool pop_transaction_from_global_index(const transaction& tx, const crypto::hash& tx_id);
-    bool add_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, uint64_t amount, size_t i, uint64_t mix_count, bool use_only_forced_to_mix = false, uint64_t height_upper_limit = 0) const;
-    bool get_target_outs_for_amount_prezarcanum(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::request& req, const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::offsets_distribution& details, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, std::map<uint64_t, uint64_t>& amounts_to_up_index_limit_cache) const;
-    bool get_target_outs_for_postzarcanum(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::request& req, const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::offsets_distribution& details, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, std::map<uint64_t, uint64_t>& amounts_to_up_index_limit_cache) const;
+    void push_transaction_to_zc_outputs_index(const transaction_chain_entry& tce);
+    bool get_zc_output_index_entry_from_db(uint64_t gindex, zc_output_index_entry& entry) const;
+    bool get_decoy_output_entry(uint64_t amount, uint64_t gindex, uint64_t cache_generation, zc_output_index_entry& entry) const;
+    bool sync_zc_outputs_index(uint64_t up_to_gindex);
+    bool init_zc_outputs_index(const std::string& db_folder_path);
+    void init_spent_keys_filter();
+    void init_ids_filter() const;
+    bool get_pos_mining_estimate_data(uint64_t& last_day_total_minted_money, uint64_t& estimated_total_minting_coins) const;
+    void add_to_ids_filter(const crypto::hash& id);
+    bool is_key_image_maybe_spent(const crypto::key_image& ki) const;
+    bool add_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, uint64_t amount, size_t i, uint64_t mix_count, uint64_t cache_generation, bool use_only_forced_to_mix = false, uint64_t height_upper_limit = 0) const;
+    size_t add_random_outs_for_amount(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, uint64_t amount, size_t up_index_limit, uint64_t decoys_count, uint64_t cache_generation, bool use_only_forced_to_mix, uint64_t height_upper_limit) const;
+    bool add_zc_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, const zc_output_index_entry& entry, size_t g_index, uint64_t mix_count, bool use_only_forced_to_mix, uint64_t height_upper_limit) const;
+    bool get_target_outs_for_amount_prezarcanum(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::request& req, const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::offsets_distribution& details, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, std::map<uint64_t, uint64_t>& amounts_to_up_index_limit_cache, uint64_t cache_generation) const;
+    bool get_target_outs_for_postzarcanum(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::offsets_distribution& details, const std::unordered_map<uint64_t, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry>& resolved_outs, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs) const;
     bool add_block_as_invalid(const block& bl, const crypto::hash& h);
     bool add_block_as_invalid(const block_extended_info& bei, const crypto::hash& h);
     size_t find_end_of_allowed_index(uint64_t amount)const;
@@ -666,8 +821,14 @@ namespace currency
     std::vector<uint64_t> get_last_n_blocks_timestamps(size_t n)const;
     void on_block_added(const block_extended_info& bei, const crypto::hash& id, const std::list<crypto::key_image>& bsk);
     void on_block_removed(const block_extended_info& bei);
-    void update_targetdata_cache_on_block_added(const block_extended_info& bei);
+    void update_targetdata_cache_on_block_added(const block_extended_info& bei, const crypto::hash& id);
     void update_targetdata_cache_on_block_removed(const block_extended_info& bei);
+    void update_median_windows_on_block_added(const block_extended_info& bei);
+    void update_median_windows_on_block_removed(const block_extended_info& bei);
+    void invalidate_stat_windows() const;
+    const blocks_median_window& get_actual_median_window(blocks_median_window& window) const;
+    bool get_daily_stat_entry(const block& bl, daily_stat_window::entry& e) const;
+    const daily_stat_window& get_actual_daily_stat_window() const;
     uint64_t tx_fee_median_for_height(uint64_t h) const;
     uint64_t get_tx_fee_median_effective_index(uint64_t h) const;    
     void on_abort_transaction();
@@ -688,7 +849,7 @@ namespace currency
     bool put_asset_info(const transaction& tx, const crypto::hash& tx_id, const asset_descriptor_operation& ado);
     void fill_addr_to_alias_dict();
     //bool resync_spent_tx_flags();
-    bool prune_ring_signatures_and_attachments_if_need();
+    bool prune_ring_signatures_and_attachments_if_need(uint64_t max_blocks_count = UINT64_MAX);
     bool prune_ring_signatures_and_attachments(uint64_t height, uint64_t& transactions_pruned, uint64_t& signatures_pruned, uint64_t& attachments_pruned);
 
     template<class visitor_t>
@@ -700,8 +861,16 @@ namespace currency
     
     void push_block_to_per_block_increments(uint64_t height_, std::unordered_map<uint64_t, uint32_t>& gindices);
     void pop_block_from_per_block_increments(uint64_t height_);
+    void push_block_to_headers_index(const block_extended_info& bei, const crypto::hash& id);
+    bool rebuild_block_headers_index();
+    uint64_t get_first_height_with_max_timestamp_not_less(uint64_t timestamp) const;
     void calculate_local_gindex_lookup_table_for_height(uint64_t split_height, std::map<uint64_t, uint64_t>& increments) const;
     void do_erase_altblock(alt_chain_container::iterator it);
+    void update_aliases_index() const;
+    void update_assets_index() const;
+    void on_asset_changed(const crypto::public_key& asset_id);
+    size_t erase_altblock_with_descendants(const crypto::hash& id, const std::unordered_multimap<crypto::hash, crypto::hash>& children);
+    void rebuild_altblock_keyimages_with_descendants(const crypto::hash& id);
     uint64_t get_blockchain_launch_timestamp()const;
     bool is_output_allowed_for_input(const tx_out_v& out_v, const txin_v& in_v, uint64_t top_minus_source_height) const;
     bool is_output_allowed_for_input(const txout_target_v& out_v, const txin_v& in_v, uint64_t top_minus_source_height) const;
@@ -775,12 +944,12 @@ namespace currency
     {
       crypto::hash tx_id = null_hash;
       size_t n = 0;
-      if (o.type() == typeid(ref_by_id))
+      if (tools::is_variant_type<ref_by_id>(o))
       {
         tx_id = boost::get<ref_by_id>(o).tx_id;
         n = boost::get<ref_by_id>(o).n;
       }
-      else if (o.type() == typeid(uint64_t))
+      else if (tools::is_variant_type<uint64_t>(o))
       {
         TIME_MEASURE_START_PD(tx_check_inputs_loop_scan_outputkeys_loop_get_subitem);
         uint64_t i = boost::get<uint64_t>(o);
@@ -820,7 +989,7 @@ namespace currency
         bool r = is_output_allowed_for_input(o.target, verified_input, get_current_blockchain_size() - tx_ptr->m_keeper_block_height);
         CHECK_AND_ASSERT_MES(r, false, "Input and output incompatible type");
 
-        if (o.target.type() == typeid(txout_to_key))
+        if (tools::is_variant_type<txout_to_key>(o.target))
         {
           CHECKED_GET_SPECIFIC_VARIANT(o.target, const txout_to_key, outtk, false);
           //fix for burned money
@@ -834,7 +1003,7 @@ namespace currency
             CHECK_AND_ASSERT_MES(legit_output_key, false, "tx input ref #" << output_index << " violates public key restrictions: tx.version = " << tx_ptr->tx.version << ", outtk.key = " << outtk.key);
           }
         }
-        else if (o.target.type() == typeid(txout_htlc))
+        else if (tools::is_variant_type<txout_htlc>(o.target))
         {
           //check for spend flags
           CHECK_AND_ASSERT_MES(tx_ptr->m_spent_flags.size() > n, false,
@@ -924,32 +1093,31 @@ namespace currency
   }
 
   //------------------------------------------------------------------
+  // callback: (const std::string& alias, const extra_alias_entry_base& alias_entry) -> void
+  // aliases go in the lexicographical order, if prefix isn't empty only the aliases starting with it are counted
   template<typename cb_t>
-  bool blockchain_storage::get_aliases(cb_t cb, uint64_t offset, uint64_t count) const
+  bool blockchain_storage::get_aliases(cb_t cb, uint64_t offset, uint64_t count, const std::string& prefix) const
   {
     CRITICAL_REGION_LOCAL(m_read_lock);
+    CRITICAL_REGION_LOCAL1(m_aliases_index_lock);
+    update_aliases_index();
 
-    uint64_t counter = 0;
+    auto it = prefix.empty() ? m_aliases_index.begin() : std::lower_bound(m_aliases_index.begin(), m_aliases_index.end(), prefix);
+    if (prefix.empty())
+      it += static_cast<size_t>(std::min<uint64_t>(offset, m_aliases_index.size()));
+    else
+      for (; offset != 0 && it != m_aliases_index.end() && it->compare(0, prefix.size(), prefix) == 0; --offset, ++it);
 
-    m_db_aliases.enumerate_items([&](uint64_t i, const std::string& alias, const std::list<extra_alias_entry_base>& alias_entries)
+    for (; count != 0 && it != m_aliases_index.end(); ++it)
     {
-      if (alias_entries.empty())
-        return true; // continue
-
-      if (counter < offset)
-      {
-        ++counter;
-        return true; // continue
-      }
-
-      if (counter >= offset + count)
-        return false; // stop
-
-      ++counter;
-
-      cb(alias, alias_entries.back());
-      return true;
-    });
+      if (!prefix.empty() && it->compare(0, prefix.size(), prefix) != 0)
+        break;
+      auto alias_entries_ptr = m_db_aliases.get(*it);
+      if (!alias_entries_ptr || alias_entries_ptr->empty())
+        continue;
+      cb(*it, alias_entries_ptr->back());
+      --count;
+    }
     return true;
   }
   //------------------------------------------------------------------
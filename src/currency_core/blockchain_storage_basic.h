@@ -7,6 +7,8 @@
 
 #pragma once
 #include <unordered_map>
+#include <unordered_set>
+#include <memory>
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
 
@@ -16,6 +18,8 @@
 #include <boost/serialization/version.hpp>
 #include <boost/serialization/list.hpp>
 
+#include "cache_helper.h"
+#include "common/sliding_window_median.h"
 #include "currency_basic.h"
 #include "difficulty.h"
 #include "currency_protocol/blobdatatype.h"
@@ -75,6 +79,393 @@ namespace currency
     END_SERIALIZE()
   };
 
+#define BLOCK_HEADER_INDEX_ENTRY_FLAG_POS           0x01
+
+  // fixed-width summary of block_extended_info, stored as POD per height alongside the blocks container,
+  // used by hot paths (difficulty, size medians, block ids) to avoid deserializing the whole block
+  struct block_header_index_entry
+  {
+    crypto::hash id;
+    uint64_t cumulative_diff_precise_lo;
+    uint64_t cumulative_diff_precise_hi;
+    uint64_t timestamp;
+    uint32_t block_cumulative_size;
+    uint32_t flags;
+
+    wide_difficulty_type get_cumulative_diff_precise() const
+    {
+      return (wide_difficulty_type(cumulative_diff_precise_hi) << 64) | cumulative_diff_precise_lo;
+    }
+
+    void set_cumulative_diff_precise(const wide_difficulty_type& d)
+    {
+      cumulative_diff_precise_lo = static_cast<uint64_t>(d);
+      cumulative_diff_precise_hi = static_cast<uint64_t>(d >> 64);
+    }
+
+    bool is_pos() const
+    {
+      return (flags & BLOCK_HEADER_INDEX_ENTRY_FLAG_POS) != 0;
+    }
+  };
+  static_assert(sizeof(block_header_index_entry) == 64, "block_header_index_entry is expected to fit one cache line");
+
+  // sliding window over timestamps and cumulative difficulties of the latest main chain blocks of one kind (PoS or PoW),
+  // updated on each block push/pop; remembers the top block it corresponds to, so a mismatch (tx abort, reorg) can be detected
+  class targetdata_window
+  {
+  public:
+    struct entry
+    {
+      uint64_t height;
+      uint64_t timestamp;
+      wide_difficulty_type cumulative_diff_precise;
+    };
+
+    explicit targetdata_window(size_t capacity)
+      : m_entries(capacity)
+      , m_first(0)
+      , m_size(0)
+      , m_has_all_older(false)
+      , m_valid(false)
+      , m_top_height(0)
+      , m_top_id(null_hash)
+    {}
+
+    bool is_valid_for(const crypto::hash& top_id) const
+    {
+      return m_valid && m_top_id == top_id;
+    }
+
+    void invalidate()
+    {
+      m_valid = false;
+    }
+
+    // entries are expected from the oldest to the newest, has_all_older means there are no more blocks of this kind below them
+    void reset(const crypto::hash& top_id, uint64_t top_height, const std::vector<entry>& entries, bool has_all_older)
+    {
+      m_first = 0;
+      m_size = 0;
+      for (const auto& e : entries)
+        push_entry(e);
+      m_has_all_older = has_all_older && entries.size() <= m_entries.size();
+      m_top_id = top_id;
+      m_top_height = top_height;
+      m_valid = true;
+    }
+
+    void push_block(const crypto::hash& id, const crypto::hash& prev_id, bool is_of_this_kind, const entry& e)
+    {
+      if (!m_valid || prev_id != m_top_id || e.height != m_top_height + 1)
+      {
+        m_valid = false;
+        return;
+      }
+      if (is_of_this_kind)
+        push_entry(e);
+      m_top_id = id;
+      m_top_height = e.height;
+    }
+
+    void pop_block(const crypto::hash& prev_id, uint64_t height, bool is_of_this_kind)
+    {
+      if (!m_valid || height != m_top_height || height == 0)
+      {
+        m_valid = false;
+        return;
+      }
+      if (is_of_this_kind)
+      {
+        if (!m_size || at(m_size - 1).height != height)
+        {
+          m_valid = false;
+          return;
+        }
+        --m_size;
+      }
+      m_top_id = prev_id;
+      m_top_height = height - 1;
+    }
+
+    // appends up to count entries with height < before_height, newest first;
+    // returns false if the window doesn't have enough entries for that and it should be collected from db
+    bool collect(uint64_t before_height, size_t count, std::vector<uint64_t>& timestamps, std::vector<wide_difficulty_type>& cumulative_difficulties) const
+    {
+      // entries are sorted by height, find the newest one below before_height
+      size_t lo = 0, hi = m_size;
+      while (lo < hi)
+      {
+        size_t mid = (lo + hi) / 2;
+        if (at(mid).height < before_height)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      if (lo < count && !m_has_all_older)
+        return false;
+
+      for (size_t i = lo; i != 0 && count != 0; --i, --count)
+      {
+        const entry& e = at(i - 1);
+        timestamps.push_back(e.timestamp);
+        cumulative_difficulties.push_back(e.cumulative_diff_precise);
+      }
+      return true;
+    }
+
+    size_t size() const
+    {
+      return m_size;
+    }
+
+  private:
+    const entry& at(size_t i) const
+    {
+      return m_entries[(m_first + i) % m_entries.size()];
+    }
+
+    void push_entry(const entry& e)
+    {
+      if (m_size == m_entries.size())
+      {
+        // overwrite the oldest one
+        m_entries[m_first] = e;
+        m_first = (m_first + 1) % m_entries.size();
+        m_has_all_older = false;
+        return;
+      }
+      m_entries[(m_first + m_size) % m_entries.size()] = e;
+      ++m_size;
+    }
+
+    std::vector<entry> m_entries; // ring buffer
+    size_t m_first;
+    size_t m_size;
+    bool m_has_all_older;
+    bool m_valid;
+    uint64_t m_top_height;
+    crypto::hash m_top_id;
+  };
+
+  // median of a value (timestamp, cumulative size) of the latest main chain blocks, updated on each block push/pop
+  // in O(log N) instead of collecting and sorting the values on each query; like targetdata_window it remembers
+  // the top block it corresponds to, so a mismatch (tx abort, reorg) can be detected
+  class blocks_median_window
+  {
+  public:
+    typedef uint64_t (*value_getter)(const block_header_index_entry& e);
+
+    blocks_median_window(size_t length, value_getter get_value)
+      : m_length(length)
+      , m_get_value(get_value)
+      , m_valid(false)
+      , m_top_height(0)
+      , m_top_id(null_hash)
+    {}
+
+    size_t length() const
+    {
+      return m_length;
+    }
+
+    bool is_valid_for(const crypto::hash& top_id) const
+    {
+      return m_valid && m_top_id == top_id;
+    }
+
+    void invalidate()
+    {
+      m_valid = false;
+    }
+
+    // headers of up to length() latest blocks, from the oldest to the top one
+    void reset(uint64_t top_height, const std::vector<block_header_index_entry>& headers)
+    {
+      m_values.clear();
+      for (const auto& h : headers)
+        m_values.push_back(m_get_value(h));
+      m_top_id = headers.empty() ? null_hash : headers.back().id;
+      m_top_height = top_height;
+      m_valid = true;
+    }
+
+    void push_block(uint64_t height, const crypto::hash& prev_id, const block_header_index_entry& header)
+    {
+      if (!m_valid || prev_id != m_top_id || height != m_top_height + 1)
+      {
+        m_valid = false;
+        return;
+      }
+      m_values.push_back(m_get_value(header));
+      if (m_values.size() > m_length)
+        m_values.pop_front();
+      m_top_id = header.id;
+      m_top_height = height;
+    }
+
+    // p_entering is the header of the block at height - length(), which gets into the window again, if there is such
+    void pop_block(uint64_t height, const crypto::hash& prev_id, const block_header_index_entry* p_entering)
+    {
+      if (!m_valid || height != m_top_height || height == 0 || m_values.empty())
+      {
+        m_valid = false;
+        return;
+      }
+      m_values.pop_back();
+      if (p_entering)
+        m_values.push_front(m_get_value(*p_entering));
+      m_top_id = prev_id;
+      m_top_height = height - 1;
+    }
+
+    uint64_t get_median() const
+    {
+      return m_values.get_median();
+    }
+
+    uint64_t get_avg() const
+    {
+      return m_values.get_avg();
+    }
+
+  private:
+    size_t m_length;
+    value_getter m_get_value;
+    tools::sliding_window_median<uint64_t> m_values;
+    bool m_valid;
+    uint64_t m_top_height;
+    crypto::hash m_top_id;
+  };
+
+  // tx count, tx volume and datetime of each of the latest main chain blocks along with the window's totals, for the
+  // network stats polled over rpc; kept up to date on block push/pop only once it was loaded, so sync doesn't pay for it
+  class daily_stat_window
+  {
+  public:
+    struct entry
+    {
+      uint64_t datetime;
+      uint64_t tx_count;
+      uint64_t tx_volume;
+    };
+
+    explicit daily_stat_window(size_t length)
+      : m_length(length)
+      , m_tx_count(0)
+      , m_tx_volume(0)
+      , m_valid(false)
+      , m_top_height(0)
+      , m_top_id(null_hash)
+    {}
+
+    size_t length() const
+    {
+      return m_length;
+    }
+
+    bool is_valid_for(const crypto::hash& top_id) const
+    {
+      return m_valid && m_top_id == top_id;
+    }
+
+    bool is_valid_for_height(uint64_t top_height) const
+    {
+      return m_valid && m_top_height == top_height;
+    }
+
+    void invalidate()
+    {
+      m_valid = false;
+    }
+
+    // entries of up to length() latest blocks, from the oldest to the top one
+    void reset(const crypto::hash& top_id, uint64_t top_height, const std::vector<entry>& entries)
+    {
+      m_entries.clear();
+      m_tx_count = m_tx_volume = 0;
+      for (const auto& e : entries)
+        push_entry_back(e);
+      m_top_id = top_id;
+      m_top_height = top_height;
+      m_valid = true;
+    }
+
+    void push_block(uint64_t height, const crypto::hash& id, const crypto::hash& prev_id, const entry& e)
+    {
+      if (!m_valid || prev_id != m_top_id || height != m_top_height + 1)
+      {
+        m_valid = false;
+        return;
+      }
+      push_entry_back(e);
+      if (m_entries.size() > m_length)
+      {
+        m_tx_count -= m_entries.front().tx_count;
+        m_tx_volume -= m_entries.front().tx_volume;
+        m_entries.pop_front();
+      }
+      m_top_id = id;
+      m_top_height = height;
+    }
+
+    // p_entering is the entry of the block at height - length(), which gets into the window again, if there is such
+    void pop_block(uint64_t height, const crypto::hash& prev_id, const entry* p_entering)
+    {
+      if (!is_valid_for_height(height) || height == 0 || m_entries.empty())
+      {
+        m_valid = false;
+        return;
+      }
+      m_tx_count -= m_entries.back().tx_count;
+      m_tx_volume -= m_entries.back().tx_volume;
+      m_entries.pop_back();
+      if (p_entering)
+      {
+        m_entries.push_front(*p_entering);
+        m_tx_count += p_entering->tx_count;
+        m_tx_volume += p_entering->tx_volume;
+      }
+      m_top_id = prev_id;
+      m_top_height = height - 1;
+    }
+
+    uint64_t get_tx_count() const
+    {
+      return m_tx_count;
+    }
+
+    uint64_t get_tx_volume() const
+    {
+      return m_tx_volume;
+    }
+
+    // datetime of the block n blocks below the top one; false if it's out of the window
+    bool get_datetime(size_t n, uint64_t& datetime) const
+    {
+      if (n >= m_entries.size())
+        return false;
+      datetime = m_entries[m_entries.size() - 1 - n].datetime;
+      return true;
+    }
+
+  private:
+    void push_entry_back(const entry& e)
+    {
+      m_entries.push_back(e);
+      m_tx_count += e.tx_count;
+      m_tx_volume += e.tx_volume;
+    }
+
+    size_t m_length;
+    std::deque<entry> m_entries;
+    uint64_t m_tx_count;
+    uint64_t m_tx_volume;
+    bool m_valid;
+    uint64_t m_top_height;
+    crypto::hash m_top_id;
+  };
+
   struct gindex_increment
   {
     uint64_t amount;    // the amount in global outputs table
@@ -141,6 +532,31 @@ namespace currency
     fill_block_template_func_t *pcustom_fill_block_template_func;
   };
 
+  // multisig output of a tx that is not in the blockchain yet but precedes the spending tx in the same block (tx packages from the pool)
+  struct unconfirmed_ms_out
+  {
+    std::shared_ptr<const transaction> source_tx;
+    size_t out_n;
+  };
+  typedef std::unordered_map<crypto::hash, unconfirmed_ms_out> unconfirmed_ms_outs_map; // ms out id -> output
+
+  // part of a block template that doesn't depend on who is asking for it (no miner tx, no timestamp),
+  // shared between callers as an immutable snapshot while neither the chain nor the pool changes
+  struct block_template_base
+  {
+    crypto::hash prev_id;
+    uint64_t height;
+    uint8_t major_version;
+    bool pos;
+    wide_difficulty_type diffic;
+    size_t median_size;
+    boost::multiprecision::uint128_t already_generated_coins;
+    std::vector<crypto::hash> tx_hashes;
+    size_t txs_size;
+    uint64_t txs_fee;
+    uint64_t pool_version;  // tx_memory_pool::get_pool_version() at the moment the txs were selected
+  };
+
   struct create_block_template_response
   {
     block b;
@@ -184,4 +600,127 @@ namespace currency
     END_KV_SERIALIZE_MAP()
   };
 
+
+  // Long-living LRU storage of decompressed ring members and their hash-to-point images, shared by all threads which check tx inputs
+  // (both for tx pool and for blocks, so a tx which was already checked by the pool is re-checked faster when its block arrives)
+  class ring_members_points_cache : public crypto::CLSAG_ring_members_cache_t::backend_i
+  {
+  public:
+    virtual bool get(const crypto::public_key& stealth_address, crypto::CLSAG_ring_members_cache_t::entry_t& e) override
+    {
+      return m_cache.get(stealth_address, e);
+    }
+
+    virtual void set(const crypto::public_key& stealth_address, const crypto::CLSAG_ring_members_cache_t::entry_t& e) override
+    {
+      m_cache.set(stealth_address, e);
+    }
+
+    void clear()
+    {
+      m_cache.clear();
+    }
+
+    size_t size()
+    {
+      return m_cache.size();
+    }
+
+  private:
+    epee::misc_utils::cache_base<false, crypto::public_key, crypto::CLSAG_ring_members_cache_t::entry_t, CURRENCY_RING_MEMBERS_POINTS_CACHE_MAX_ELEMENTS> m_cache;
+  };
+
+
+  // Fully verified txs (signatures and proofs were checked against the main chain with the given top referenced block).
+  // Lets a tx which was already verified by the pool skip signatures verification when its block arrives.
+  // Entries are not removed on reorg, instead they're checked against the current chain on lookup (see blockchain_storage::is_tx_signatures_preverified)
+  class verified_txs_cache
+  {
+  public:
+    struct entry_t
+    {
+      uint64_t max_used_block_height;
+      crypto::hash max_used_block_id;
+    };
+
+    bool get(const crypto::hash& tx_verification_key, entry_t& e)
+    {
+      return m_cache.get(tx_verification_key, e);
+    }
+
+    void set(const crypto::hash& tx_verification_key, uint64_t max_used_block_height, const crypto::hash& max_used_block_id)
+    {
+      m_cache.set(tx_verification_key, entry_t{ max_used_block_height, max_used_block_id });
+    }
+
+    void erase(const crypto::hash& tx_verification_key)
+    {
+      m_cache.erase(tx_verification_key);
+    }
+
+    void clear()
+    {
+      m_cache.clear();
+    }
+
+    size_t size()
+    {
+      return m_cache.size();
+    }
+
+  private:
+    epee::misc_utils::cache_base<false, crypto::hash, entry_t, CURRENCY_VERIFIED_TXS_CACHE_MAX_ELEMENTS> m_cache;
+  };
+
+  // Key images spent in an alt block and all its alt ancestors. Immutable once made and shared with the descendants,
+  // so the branches of the alt tree share their common part. A layer is merged with its parent while the parent is not bigger
+  // (as a binary counter), so a branch has O(log n) layers and a lookup doesn't depend on the number of its blocks
+  class alt_chain_keyimages
+  {
+  public:
+    typedef std::shared_ptr<const alt_chain_keyimages> ptr;
+
+    static ptr make(const ptr& parent, std::unordered_set<crypto::key_image>&& block_keyimages)
+    {
+      if (block_keyimages.empty() && parent)
+        return parent;
+      std::shared_ptr<alt_chain_keyimages> layer(new alt_chain_keyimages());
+      layer->m_keyimages.swap(block_keyimages);
+      layer->m_parent = parent;
+      while (layer->m_parent && layer->m_parent->m_keyimages.size() <= layer->m_keyimages.size())
+      {
+        layer->m_keyimages.insert(layer->m_parent->m_keyimages.begin(), layer->m_parent->m_keyimages.end());
+        layer->m_parent = layer->m_parent->m_parent;
+      }
+      layer->m_total_count = layer->m_keyimages.size() + (layer->m_parent ? layer->m_parent->m_total_count : 0);
+      return layer;
+    }
+
+    static bool contains(const ptr& p, const crypto::key_image& ki)
+    {
+      for (const alt_chain_keyimages* l = p.get(); l != nullptr; l = l->m_parent.get())
+        if (l->m_keyimages.count(ki))
+          return true;
+      return false;
+    }
+
+    // the layers of all branches are counted once
+    template<class t_cb>
+    static void for_each_layer(const ptr& p, std::unordered_set<const alt_chain_keyimages*>& visited, t_cb cb)
+    {
+      for (const alt_chain_keyimages* l = p.get(); l != nullptr && visited.insert(l).second; l = l->m_parent.get())
+        cb(*l);
+    }
+
+    size_t get_layer_size() const { return m_keyimages.size(); }
+    size_t get_total_count() const { return m_total_count; }
+
+  private:
+    alt_chain_keyimages() : m_total_count(0) {}
+
+    std::unordered_set<crypto::key_image> m_keyimages;
+    ptr m_parent;
+    size_t m_total_count;
+  };
+
 } // namespace currency
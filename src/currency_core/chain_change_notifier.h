@@ -0,0 +1,46 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace currency
+{
+  // wakes up the threads waiting for the chain or the pool to change (long polling rpc calls and alike);
+  // unlike i_core_event_handler it has any number of listeners, and they don't take time from the notifying thread
+  class chain_change_notifier
+  {
+  public:
+    void notify()
+    {
+      {
+        std::lock_guard<std::mutex> lk(m_lock);
+        ++m_counter;
+      }
+      m_cv.notify_all();
+    }
+
+    uint64_t get_counter() const
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      return m_counter;
+    }
+
+    // waits for a notification made after the counter was seen, false on timeout
+    bool wait(uint64_t seen_counter, uint64_t timeout_ms) const
+    {
+      std::unique_lock<std::mutex> lk(m_lock);
+      return m_cv.wait_for(lk, std::chrono::milliseconds(timeout_ms), [&]() { return m_counter != seen_counter; });
+    }
+
+  private:
+    mutable std::mutex m_lock;
+    mutable std::condition_variable m_cv;
+    uint64_t m_counter = 0;
+  };
+}
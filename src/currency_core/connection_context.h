@@ -6,9 +6,14 @@
 
 #pragma once
 #include <unordered_set>
+#include <unordered_map>
 #include <atomic>
+#include <memory>
+#include <list>
 #include "net/net_utils_base.h"
 #include "copyable_atomic.h"
+#include "syncobj.h"
+#include "common/rolling_bloom_filter.h"
 
 namespace currency
 {
@@ -24,6 +29,50 @@ namespace currency
   };
 
 
+  // compact block waiting for the txs requested from the peer
+  struct pending_compact_block
+  {
+    std::string block_blob;
+    std::list<std::string> txs;
+    std::unordered_set<crypto::hash> missing_txs;
+    uint64_t current_blockchain_height = 0;
+    uint32_t hop = 0;
+    bool prevalidated_only = false;
+  };
+
+  // ids of txs a peer is known to have (it sent or announced them, or they were announced to it),
+  // shared between all copies of the connection context, accessed from network threads and the relay thread
+  struct known_txs_filter
+  {
+    known_txs_filter(size_t capacity, uint64_t salt) : filter(capacity, salt) {}
+
+    bool contains(const crypto::hash& id) const
+    {
+      CRITICAL_REGION_LOCAL(lock);
+      return filter.contains(id);
+    }
+
+    void insert(const crypto::hash& id)
+    {
+      CRITICAL_REGION_LOCAL(lock);
+      filter.insert(id);
+    }
+
+    // returns false if the id was already there
+    bool check_and_insert(const crypto::hash& id)
+    {
+      CRITICAL_REGION_LOCAL(lock);
+      if (filter.contains(id))
+        return false;
+      filter.insert(id);
+      return true;
+    }
+
+  private:
+    mutable epee::critical_section lock;
+    tools::rolling_bloom_filter<crypto::hash> filter;
+  };
+
   struct uncopybale_currency_context
   {
     uncopybale_currency_context() = default;
@@ -32,7 +81,11 @@ namespace currency
     //members that supposed to be accessed only from one thread
     std::list<block_context_info> m_needed_objects;
     std::unordered_set<crypto::hash> m_requested_objects;
+    std::list<std::unordered_set<crypto::hash>> m_requested_batches; //NOTIFY_REQUEST_GET_OBJECTS requests in flight (download-ahead), front is the oldest one
+    size_t m_stale_batches_count = 0; //responses to in-flight requests that should be skipped after connection became idle
+    std::unordered_map<crypto::hash, std::shared_ptr<pending_compact_block>> m_pending_compact_blocks; //compact NOTIFY_NEW_BLOCKs by block id, waiting for NOTIFY_RESPONSE_GET_OBJECTS with missing txs
     std::atomic<uint32_t> m_callback_request_count; //in debug purpose: problem with double callback rise
+    std::atomic<uint32_t> m_prevalidated_failed_blocks{0}; //blocks relayed by the peer as prevalidated_only that failed the full check
 
   };
 
@@ -51,6 +104,9 @@ namespace currency
     uint64_t m_last_response_height;
     int64_t m_time_delta;
     std::string m_remote_version;
+    uint64_t m_remote_protocol_features = 0;
+    uint64_t m_remote_pruned_height = 0;
+    std::shared_ptr<known_txs_filter> m_known_txs; // created on handshake
   private:
     template<class t_core> friend class t_currency_protocol_handler;
     uncopybale_currency_context m_priv;
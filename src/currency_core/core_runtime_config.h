@@ -103,6 +103,7 @@ namespace currency
     uint64_t tx_pool_min_fee;
     uint64_t tx_default_fee;
     uint64_t max_alt_blocks;
+    uint64_t max_alt_blocks_stored_size;
     crypto::public_key alias_validation_pubkey;
     core_time_func_t get_core_time;
     uint64_t hf4_minimum_mixins;
@@ -129,6 +130,7 @@ namespace currency
     pc.tx_pool_min_fee = TX_MINIMUM_FEE;
     pc.tx_default_fee = TX_DEFAULT_FEE;
     pc.max_alt_blocks = CURRENCY_ALT_BLOCK_MAX_COUNT;
+    pc.max_alt_blocks_stored_size = CURRENCY_ALT_BLOCKS_MAX_STORED_SIZE;
     pc.hf4_minimum_mixins = CURRENCY_HF4_MANDATORY_DECOY_SET_SIZE;
     pc.max_pos_difficulty = wide_difficulty_type(POS_MAX_DIFFICULTY_ALLOWED);
     
@@ -11,6 +11,7 @@
 #define CRYPTO_HDS_OUT_AMOUNT_BLINDING_MASK   "ZANO_HDS_OUT_AMOUNT_BLIND_MASK_"
 #define CRYPTO_HDS_OUT_ASSET_BLINDING_MASK    "ZANO_HDS_OUT_ASSET_BLIND_MASK__"
 #define CRYPTO_HDS_OUT_CONCEALING_POINT       "ZANO_HDS_OUT_CONCEALING_POINT__"
+#define CRYPTO_HDS_OUT_VIEW_TAG               "ZANO_HDS_OUT_VIEW_TAG__________"
 
 #define CRYPTO_HDS_CLSAG_GG_LAYER_0           "ZANO_HDS_CLSAG_GG_LAYER_ZERO___"
 #define CRYPTO_HDS_CLSAG_GG_LAYER_1           "ZANO_HDS_CLSAG_GG_LAYER_ONE____"
@@ -41,3 +42,4 @@
 #define CRYPTO_HDS_ASSET_CONTROL_ABM          "ZANO_HDS_ASSET_CONTROL_ABM_____"
 #define CRYPTO_HDS_ASSET_ID                   "ZANO_HDS_ASSET_ID______________"
 #define CRYPTO_HDS_DETERMINISTIC_TX_KEY       "ZANO_HDS_DETERMINISTIC_TX_KEY__"
+#define CRYPTO_HDS_DEPOSIT_ADDRESS            "ZANO_HDS_DEPOSIT_ADDRESS_______"
@@ -897,10 +897,25 @@ namespace currency
     END_SERIALIZE()
   };
 
-  typedef boost::mpl::vector23<
+  // one byte per output (tags[i] is for vout[i]), made of the output's Hs(8 * r * V, i), see also get_output_view_tag()
+  // lets a receiver reject ~255/256 of foreign zarcanum outputs with one hash instead of EC operations; allowed after HF5
+  struct extra_view_tags
+  {
+    std::vector<uint8_t> tags;
+
+    BEGIN_SERIALIZE()
+      FIELD(tags)
+    END_SERIALIZE()
+
+    BEGIN_BOOST_SERIALIZATION()
+      BOOST_SERIALIZE(tags)
+    END_BOOST_SERIALIZATION()
+  };
+
+  typedef boost::mpl::vector24<
     tx_service_attachment, tx_comment, tx_payer_old, tx_receiver_old, tx_derivation_hint, std::string, tx_crypto_checksum, etc_tx_time, etc_tx_details_unlock_time, etc_tx_details_expiration_time,
     etc_tx_details_flags, crypto::public_key, extra_attachment_info, extra_alias_entry_old, extra_user_data, extra_padding, etc_tx_flags16_t, etc_tx_details_unlock_time2,
-    tx_payer, tx_receiver, extra_alias_entry, zarcanum_tx_data_v1, asset_descriptor_operation
+    tx_payer, tx_receiver, extra_alias_entry, zarcanum_tx_data_v1, asset_descriptor_operation, extra_view_tags
   > all_payload_types;
   
   typedef boost::make_variant_over<all_payload_types>::type payload_items_v;
@@ -978,7 +993,22 @@ namespace currency
     std::vector<signature_v> signatures;
     std::vector<proof_v> proofs;
 
+    // Hashing results of a transaction parsed from a blob, so get_transaction_hash() and get_object_blobsize() don't
+    // serialize it again and again. Not serialized; filled only by parse_and_validate_tx_from_blob() (and the block
+    // counterpart), reset by any deserialization. Only the prefix is covered, so pruning signatures, attachments and
+    // proofs keeps it valid, but code modifying the prefix of a parsed transaction must call invalidate_hashes().
+    struct hash_memo_t
+    {
+      bool valid = false;
+      crypto::hash prefix_hash = null_hash;
+      uint64_t prefix_blob_size = 0;
+    };
+    hash_memo_t hash_memo;
+
+    void invalidate_hashes() { hash_memo.valid = false; }
+
     BEGIN_SERIALIZE_OBJECT()
+      if (!W) invalidate_hashes();
       FIELDS(*static_cast<transaction_prefix *>(this))
       CHAIN_TRANSITION_VER(TRANSACTION_VERSION_INITAL, transaction_v1)
       CHAIN_TRANSITION_VER(TRANSACTION_VERSION_PRE_HF4, transaction_v1)
@@ -1019,8 +1049,22 @@ namespace currency
   {
     transaction miner_tx;
     std::vector<crypto::hash> tx_hashes;
+
+    // block id of a block parsed from a blob, see transaction::hash_memo; it's used by get_block_hash() only while
+    // the header (miners change nonce and timestamp in place), the number of tx_hashes and miner_tx's memo are unchanged
+    struct hash_memo_t
+    {
+      bool valid = false;
+      block_header header = {};
+      size_t tx_hashes_count = 0;
+      crypto::hash id = null_hash;
+    };
+    hash_memo_t hash_memo;
+
+    void invalidate_hashes() { hash_memo.valid = false; miner_tx.invalidate_hashes(); }
     
     BEGIN_SERIALIZE_OBJECT()
+      if (!W) invalidate_hashes();
       FIELDS(*static_cast<block_header *>(this))
       FIELD(miner_tx)
       FIELD(tx_hashes)
@@ -1196,6 +1240,8 @@ SET_VARIANT_TAGS(currency::asset_descriptor_operation, 49, "asset_descriptor_bas
 SET_VARIANT_TAGS(currency::asset_operation_proof, 50, "asset_operation_proof");
 SET_VARIANT_TAGS(currency::asset_operation_ownership_proof, 51, "asset_operation_ownership_proof");
 
+SET_VARIANT_TAGS(currency::extra_view_tags, 52, "view_tags");
+
 
 
 
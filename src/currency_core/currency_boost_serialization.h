@@ -225,6 +225,8 @@ namespace boost
     template <class Archive>
     inline void serialize(Archive &a, currency::transaction &x, const boost::serialization::version_type ver)
     {
+      if (Archive::is_loading::value)
+        x.invalidate_hashes();
       a & x.version;
       a & x.vin;
       a & x.vout;
@@ -294,6 +296,8 @@ namespace boost
       {
         throw std::runtime_error("wrong block serialization version");
       }
+      if (Archive::is_loading::value)
+        b.invalidate_hashes();
       a & b.major_version;
       a & b.minor_version;
       a & b.timestamp;
@@ -100,13 +100,42 @@
 #define BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT          2000      //by default, blocks ids count in synchronizing
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT              200       //by default, blocks count in blocks downloading
 #define BLOCKS_SYNCHRONIZING_DEFAULT_SIZE               2000000   //by default keep synchronizing packets not bigger then 2MB
+#define BLOCKS_SYNCHRONIZING_MIN_SIZE                   200000    //batches are sized by the peer's throughput (see BLOCKS_SYNCHRONIZING_BATCH_TARGET_TIME) within these bounds,
+#define BLOCKS_SYNCHRONIZING_MAX_SIZE                   10000000  //the default count and size are used until the throughput is known
+#define BLOCKS_SYNCHRONIZING_BATCH_TARGET_TIME          3000      //ms, a batch is supposed to be downloaded in that time (round trip included)
+#define BLOCKS_SYNCHRONIZING_MAX_BATCHES_IN_FLIGHT      3         //how many NOTIFY_REQUEST_GET_OBJECTS could be requested ahead while previous batch is being processed (limits memory usage)
+#define BLOCKS_SYNCHRONIZING_MAX_READY_SPANS            16        //spans downloaded ahead of the chain that wait for the spans before them (limits memory usage)
+#define BLOCKS_SYNCHRONIZING_SPAN_MIN_TIMEOUT           30000     //ms, a span requested from a peer is given to another one after that, or later if the peer's throughput promises it
+#define BLOCKS_SYNCHRONIZING_SPAN_TIMEOUT_FACTOR        4         //how many times longer than the peer's throughput promises a span is waited for
+#define BLOCKS_SYNCHRONIZING_SLOW_PEER_FACTOR           4         //a peer that many times slower than the fastest one gets one span at a time
+#define BLOCKS_SYNCHRONIZING_WAITING_PEERS_INTERVAL     2         //seconds, how often the peers with nothing to download are woken up
+#define BLOCKCHAIN_TRUNCATION_BLOCKS_PER_DB_TX          1000      //blocks removed in one db write transaction by truncate_blockchain()
 #define CURRENCY_PROTOCOL_MAX_BLOCKS_REQUEST_COUNT      500     
 #define CURRENCY_PROTOCOL_MAX_TXS_REQUEST_COUNT         500    
+#define CURRENCY_PROTOCOL_MAX_TX_INVENTORY_COUNT        5000      //tx ids in one NOTIFY_TX_INVENTORY
+#define CURRENCY_PROTOCOL_KNOWN_TXS_FILTER_CAPACITY     20000     //per connection, ids of txs the peer is known to have
+#define CURRENCY_PROTOCOL_TX_REQUEST_TIMEOUT            30        //seconds, announced tx requested from one peer is not requested from others meanwhile
+#define CURRENCY_PROTOCOL_TX_RELAY_INTERVAL_MS          200       //new txs are collected for that long and then relayed in one batch
+#define CURRENCY_PROTOCOL_BLOCKS_FIRST_SEEN_CACHE_SIZE  100       //ids of recently announced blocks kept to tell how late peers announce them
+#define CURRENCY_PROTOCOL_HEADERS_DIFFICULTY_TOLERANCE  1024      //PoW of a chain header must meet the current difficulty divided by this
+#define CURRENCY_PROTOCOL_MAX_PREVALIDATED_FAILED_BLOCKS 3        //per connection, blocks relayed early that failed the full check before the peer is dropped
+#define CURRENCY_PROTOCOL_MAX_PENDING_COMPACT_BLOCKS    8         //per connection, compact blocks waiting for the txs requested from the peer
+#define CURRENCY_PRECOMPUTED_POW_HASHES_CACHE_SIZE      (BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT * 4) //PoW hashes checked with chain headers, for a few peers' chain entries
 
 
 #define CURRENCY_ALT_BLOCK_LIVETIME_COUNT               (CURRENCY_BLOCKS_PER_DAY*7)//one week
 #define CURRENCY_ALT_BLOCK_MAX_COUNT                    43200 //30 days
+#define CURRENCY_ALT_BLOCKS_MAX_STORED_SIZE             (256 * 1024 * 1024) //bytes of alt blocks with their txs kept in memory
 #define CURRENCY_MEMPOOL_TX_LIVETIME                    345600 //seconds, 4 days
+#define CURRENCY_RING_MEMBERS_POINTS_CACHE_MAX_ELEMENTS 50000  //decoys' points cached for inputs verification, ~400 bytes each
+#define CURRENCY_VERIFIED_TXS_CACHE_MAX_ELEMENTS        100000 //txs which signatures were verified recently (by the pool or in a block)
+#define CURRENCY_BLOCK_BLOBS_CACHE_MAX_ELEMENTS         200    //recently relayed or sent blocks kept serialized with their txs
+#define CURRENCY_SCRATCH_BLOB_MAX_CAPACITY              (CURRENCY_BLOCK_GRANTED_FULL_REWARD_ZONE * 8) //bytes, per-thread serialization buffer of the hashing helpers is released when grown larger
+#define CURRENCY_DECOY_OUTPUTS_CACHE_MAX_ELEMENTS      200000 //outputs recently looked up from the db for get_random_outs* calls, ~250 bytes each
+#define CURRENCY_POW_DAG_ITEMS_CACHE_MAX_ELEMENTS      65536  //dataset items computed by the light ethash context for PoW verification, 256 bytes each
+#define CURRENCY_POW_NEXT_EPOCH_PREPARE_BLOCKS         720    //the full ethash dataset of the next epoch is built in the background this many blocks before it
+#define CURRENCY_POW_NEXT_EPOCH_PREPARE_MAX_TOP_AGE    (60*60) //seconds, no preparation while catching up with the network
+#define CURRENCY_DB_SYNC_BATCH_DEFAULT_MAX_BYTES        (64 * 1024 * 1024) //blocks blobs committed in one db write transaction during sync (if batching is enabled)
 
 
 #ifndef TESTNET
@@ -129,6 +158,19 @@
 #define P2P_NETWORK_ID_VER                              (CURRENCY_FORMATION_VERSION+0)
 
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT           4000
+#define RPC_DEFAULT_THREADS                             2
+#define RPC_DEFAULT_IDLE_TIMEOUT                        120          //seconds, keep-alive rpc connections that send nothing are closed after that
+#define RPC_DEFAULT_BATCH_MAX_SIZE                      1000
+#define RPC_DEFAULT_BATCH_THREADS                       4
+#define RPC_DEFAULT_RESPONSE_CACHE_SIZE                 64           //megabytes
+#define RPC_DEFAULT_MAX_QUEUE_TIME                      1000         //milliseconds a call out of the concurrency limits may wait before it's rejected as busy
+#define RPC_DEFAULT_COMPRESSION_THRESHOLD               (16 * 1024)  //bytes, smaller responses are not worth packing
+#define RPC_DEFAULT_COMPRESSION_LEVEL                   6
+#define RPC_BLOCKS_FEED_DEFAULT_MAX_BYTES               (16 * 1024 * 1024)
+#define RPC_BLOCKS_FEED_MAX_BYTES                       (128 * 1024 * 1024)
+#define RPC_BLOCKS_FEED_MAX_WAIT                        30000        //milliseconds
+#define RPC_BLOCKS_FEED_CHUNK_COUNT                     100
+#define RPC_WAIT_FOR_CHANGES_MAX_WAIT                   60000        //milliseconds
 
 #define P2P_LOCAL_WHITE_PEERLIST_LIMIT                  1000
 #define P2P_LOCAL_GRAY_PEERLIST_LIMIT                   5000
@@ -137,16 +179,32 @@
 #define P2P_DEFAULT_HANDSHAKE_INTERVAL                  60           //seconds
 #define P2P_DEFAULT_PACKET_MAX_SIZE                     50000000     //50000000 bytes maximum packet size
 #define P2P_DEFAULT_PEERS_IN_HANDSHAKE                  250
+#define P2P_MAX_PEERS_TO_MERGE                          P2P_DEFAULT_PEERS_IN_HANDSHAKE //from one handshake or timed sync
+#define P2P_FULL_PEERLIST_EXCHANGE_INTERVAL             (60*30)    //30 minutes, timed sync responses carry only the peers seen since the previous one in between
+#define P2P_PEERLIST_JOURNAL_FLUSH_INTERVAL             60         //seconds
+#define P2P_PEERLIST_JOURNAL_MAX_RECORDS                100000     //the state is rewritten in full once the journal gets longer
 #define P2P_DEFAULT_CONNECTION_TIMEOUT                  5000       //5 seconds
 #define P2P_DEFAULT_PING_CONNECTION_TIMEOUT             2000       //2 seconds
 #define P2P_DEFAULT_INVOKE_TIMEOUT                      60*2*1000  //2 minutes
 #define P2P_DEFAULT_HANDSHAKE_INVOKE_TIMEOUT            10000      //10 seconds
+#define P2P_MIN_INVOKE_TIMEOUT                          10000      //10 seconds, the least of the timeouts derived from a connection's round trip
+#define P2P_INVOKE_TIMEOUT_RTT_MULTIPLIER               20         //an invoke times out when it takes that many round trips of the connection
 #define P2P_DEFAULT_WHITELIST_CONNECTIONS_PERCENT       70
 #define P2P_FAILED_ADDR_FORGET_SECONDS                  (60*5)     //5 minutes
 
 #define P2P_IP_BLOCKTIME                                (60*60*24) //24 hours
 #define P2P_IP_FAILS_BEFOR_BLOCK                        10
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60) //5 minutes
+#define P2P_MAIN_THREADS                                4          //accepting, outgoing connects with handshakes and idle handlers
+#define P2P_MAX_IO_THREADS                              16         //serving the connections, one per CPU core by default
+
+#define P2P_PEER_QUALITY_UNKNOWN_PENALTY                500        //ms, for each of the things not measured yet
+#define P2P_PEER_QUALITY_FAIL_PENALTY                   2000       //ms, for each connection fail in a row
+#define P2P_PEER_QUALITY_REFERENCE_TRANSFER_SIZE        (200*1024) //bytes, sync throughput is counted as time to transfer this much
+#define P2P_PEER_QUALITY_CANDIDATES_COUNT               5          //peers picked from peerlist at once, the best one is tried first
+#define P2P_SLOW_PEER_ROTATION_INTERVAL                 (60*10)    //10 minutes
+#define P2P_SLOW_PEER_PENALTY_FACTOR                    3          //outgoing peer that is that much worse than the median one is replaced
+#define P2P_SLOW_PEER_MIN_PENALTY                       2000       //ms
 
 //PoS definitions
 #define POS_SCAN_WINDOW                                 60*10 //seconds // 10 minutes
@@ -169,6 +227,8 @@
 
 
 #define CORE_FEE_BLOCKS_LOOKUP_WINDOW                   60  //number of blocks used to check if transaction flow is big enought to rise default fee
+#define CURRENCY_TX_MIN_INPUTS_FOR_PARALLEL_SIGNING     4   // ZC inputs of a tx are signed in parallel when there are at least that many of them
+#define CURRENCY_TX_MIN_OUTPUTS_FOR_PARALLEL_CONSTRUCTION 16 // outputs of a tx and their proofs are made in parallel when there are at least that many of them
 
 #define WALLET_FILE_SIGNATURE_OLD                       0x1111012101101011LL  // Bender's nightmare
 #define WALLET_FILE_SIGNATURE_V2                        0x1111011201101011LL  // another Bender's nightmare
@@ -177,6 +237,10 @@
 //#define WALLET_FILE_BINARY_HEADER_VERSION_3             1002
 
 #define WALLET_FILE_MAX_KEYS_SIZE                       10000 //
+#define WALLET_STORE_JOURNAL_SIGNATURE                  0x1111011201101302LL
+#define WALLET_STORE_JOURNAL_MAX_RECORD_SIZE            (1024 * 1024 * 1024)
+#define WALLET_HISTORY_RESIDENT_TXS_COUNT               1000  // the latest transfer history entries keep their txs in memory when history txs offloading is on
+#define WALLET_HISTORY_EXPORT_PART_ENTRIES_COUNT        1000  // transfer history is exported in parts of that many entries, the wallet is not locked in between
 #define WALLET_BRAIN_DATE_OFFSET                        1543622400
 #define WALLET_BRAIN_DATE_QUANTUM                       604800 //by last word we encode a number of week since launch of the project AND password flag, 
                                                                //which let us to address tools::mnemonic_encoding::NUMWORDS weeks after project launch
@@ -230,8 +294,10 @@
 #define CURRENCY_POOLDATA_FOLDERNAME_SUFFIX             "_v1"
 #define CURRENCY_BLOCKCHAINDATA_FOLDERNAME_PREFIX       "blockchain_" 
 #define CURRENCY_BLOCKCHAINDATA_FOLDERNAME_SUFFIX       "_v2"
+#define CURRENCY_ETHASH_DATASETS_FOLDERNAME             "ethash_datasets"
 
 #define P2P_NET_DATA_FILENAME                           "p2pstate.bin"
+#define P2P_NET_JOURNAL_FILENAME                        "p2pstate.log"
 #define MINER_CONFIG_FILENAME                           "miner_conf.json"
 #define GUI_SECURE_CONFIG_FILENAME                      "gui_secure_conf.bin"
 #define GUI_CONFIG_FILENAME                             "gui_settings.json"
@@ -250,9 +316,10 @@
 
 #define BC_OFFERS_CURRENT_OFFERS_SERVICE_ARCHIVE_VER    CURRENCY_FORMATION_VERSION + BLOCKCHAIN_STORAGE_MAJOR_COMPATIBILITY_VERSION + 9
 #define BC_OFFERS_CURRENCY_MARKET_FILENAME              "market.bin"
+#define BC_OFFERS_QUERIES_CACHE_MAX_ENTRIES             256
 
 
-#define WALLET_FILE_SERIALIZATION_VERSION               167
+#define WALLET_FILE_SERIALIZATION_VERSION               169
 #define WALLET_FILE_LAST_SUPPORTED_VERSION              165
 
 #define CURRENT_MEMPOOL_ARCHIVE_VER                     (CURRENCY_FORMATION_VERSION+31)
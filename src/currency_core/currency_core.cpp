@@ -9,10 +9,12 @@
 using namespace epee;
 
 #include <boost/foreach.hpp>
+#include <future>
 #include <unordered_set>
 #include "currency_core.h"
 #include "common/command_line.h"
 #include "common/util.h"
+#include "common/startup_profile.h"
 #include "warnings.h"
 #include "crypto/crypto.h"
 #include "currency_core/currency_config.h"
@@ -22,6 +24,8 @@ using namespace epee;
 #include "tx_semantic_validation.h"
 
 #define MINIMUM_REQUIRED_FREE_SPACE_BYTES (1024 * 1024 * 100)
+#define TX_ADMISSION_QUEUE_MAX_TXS        4096   // beyond that txs are verified right in the network thread, slowing down the sender
+#define TX_ADMISSION_STOP_TIMEOUT_MS      10000
 
 DISABLE_VS_WARNINGS(4355)
 #undef LOG_DEFAULT_CHANNEL 
@@ -29,6 +33,11 @@ DISABLE_VS_WARNINGS(4355)
 ENABLE_CHANNEL_BY_DEFAULT("core");
 namespace currency
 {
+  namespace
+  {
+    const command_line::arg_descriptor<uint32_t> arg_tx_admission_threads("tx-admission-threads", "Number of threads verifying transactions received from the network (1 - verify them in the network thread)");
+  }
+
 
   //-----------------------------------------------------------------------------------------------
   core::core(i_currency_protocol* pprotocol)
@@ -39,6 +48,10 @@ namespace currency
     , m_starter_message_showed(false)
     , m_critical_error_handler(nullptr)
     , m_stop_after_height(0)
+    , m_tx_admission_threads(1)
+    , m_tx_admission_queue_depth(0)
+    , m_tx_admission_jobs_in_flight(0)
+    , m_tx_admission_stopped(false)
   {
     set_currency_protocol(pprotocol);
   }
@@ -66,6 +79,8 @@ namespace currency
   void core::init_options(boost::program_options::options_description& desc)
   {
     blockchain_storage::init_options(desc);
+    tx_memory_pool::init_options(desc);
+    command_line::add_arg(desc, arg_tx_admission_threads);
   }
   //-----------------------------------------------------------------------------------------------
   std::string core::get_config_folder()
@@ -84,6 +99,10 @@ namespace currency
     {
       LOG_PRINT_YELLOW("Daemon will STOP after block " << m_stop_after_height, LOG_LEVEL_0);
     }
+
+    m_tx_admission_threads = std::max<size_t>(std::thread::hardware_concurrency() / 2, 1);
+    if (command_line::has_arg(vm, arg_tx_admission_threads))
+      m_tx_admission_threads = std::max<uint32_t>(command_line::get_arg(vm, arg_tx_admission_threads), 1);
     return true;
   }
   //-----------------------------------------------------------------------------------------------
@@ -157,17 +176,33 @@ namespace currency
     uint64_t available_space = 0;
     CHECK_AND_ASSERT_MES(!check_if_free_space_critically_low(&available_space), false, "free space in data folder is critically low: " << std::fixed << available_space / (1024 * 1024) << " MB");
 
-    r = m_mempool.init(m_config_folder, vm);
-    CHECK_AND_ASSERT_MES(r, false, "Failed to initialize memory pool");
-
-    r = m_blockchain_storage.init(m_config_folder, vm);
+    // the pool and the blockchain have their own dbs, the pool needs the blockchain only since remove_incompatible_txs()
+    std::future<bool> mempool_init = std::async(std::launch::async, [&]()
+    {
+      tools::startup_phase_timer spt("core: tx pool init", true);
+      return m_mempool.init(m_config_folder, vm);
+    });
+    {
+      tools::startup_phase_timer spt("core: blockchain storage init");
+      r = m_blockchain_storage.init(m_config_folder, vm);
+    }
+    bool mempool_r = mempool_init.get();
+    CHECK_AND_ASSERT_MES(mempool_r, false, "Failed to initialize memory pool");
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
 
-    m_mempool.remove_incompatible_txs();
+    {
+      tools::startup_phase_timer spt("core: tx pool hardfork checks");
+      m_mempool.remove_incompatible_txs();
+    }
 
     r = m_miner.init(vm);
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize miner");
 
+    m_tx_admission_stopped = false;
+    if (m_tx_admission_threads > 1)
+      m_tx_admission_pool.init(m_tx_admission_threads);
+    LOG_PRINT_L0("Incoming transactions verification threads: " << m_tx_admission_threads);
+
     //check if tx_pool module synchronized with blockchaine storage
 //     if (m_blockchain_storage.get_top_block_id() != m_mempool.get_last_core_hash())
 //     {
@@ -193,6 +228,7 @@ namespace currency
   {
     //m_mempool.set_last_core_hash(m_blockchain_storage.get_top_block_id());
 
+    stop_tx_admission();
     m_miner.stop();
     m_miner.deinit();
     m_mempool.deinit();
@@ -200,7 +236,7 @@ namespace currency
     return true;
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::handle_incoming_tx(const transaction& tx, tx_verification_context& tvc, bool kept_by_block, const crypto::hash& tx_hash_ /* = null_hash */)
+  bool core::handle_incoming_tx(const transaction& tx, tx_verification_context& tvc, bool kept_by_block, const crypto::hash& tx_hash_ /* = null_hash */, const tx_semantic_context* p_semantic /* = nullptr */)
   {
     TIME_MEASURE_START_MS(wait_lock_time);
     CRITICAL_REGION_LOCAL(m_incoming_tx_lock);
@@ -211,7 +247,7 @@ namespace currency
       tx_hash = get_transaction_hash(tx);
 
     TIME_MEASURE_START_MS(add_new_tx_time);
-    bool r = add_new_tx(tx, tx_hash, get_object_blobsize(tx), tvc, kept_by_block);
+    bool r = add_new_tx(tx, tx_hash, get_object_blobsize(tx), tvc, kept_by_block, p_semantic);
     TIME_MEASURE_FINISH_MS(add_new_tx_time);
 
     if(tvc.m_verification_failed)
@@ -257,7 +293,8 @@ namespace currency
     TIME_MEASURE_FINISH_MS(parse_tx_time);
     
     TIME_MEASURE_START_MS(check_tx_semantic_time);
-    if(!validate_tx_semantic(tx, tx_blob.size()))
+    tx_semantic_context tsc;
+    if(!validate_tx_semantic(tx, tx_blob.size(), tsc))
     {
       LOG_PRINT_L0("WRONG TRANSACTION SEMANTICS, Failed to check tx " << tx_hash << " semantic, rejected");
       tvc.m_verification_failed = true;
@@ -265,13 +302,186 @@ namespace currency
     }
     TIME_MEASURE_FINISH_MS(check_tx_semantic_time);
 
-    bool r = handle_incoming_tx(tx, tvc, kept_by_block, tx_hash);
+    bool r = handle_incoming_tx(tx, tvc, kept_by_block, tx_hash, &tsc);
     LOG_PRINT_L2("[CORE HANDLE_INCOMING_TX2]: timing " << wait_lock_time
       << "/" << parse_tx_time
       << "/" << check_tx_semantic_time);
     return r;
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::tx_admission_stateless_checks(const std::list<blobdata>& tx_blobs, std::vector<tx_admission_entry>& entries, std::vector<tx_verification_context>& tvcs)
+  {
+    tvcs.assign(tx_blobs.size(), tx_verification_context());
+    for (auto& tvc : tvcs)
+      tvc = boost::value_initialized<tx_verification_context>();
+    entries.resize(tx_blobs.size());
+
+    size_t i = 0;
+    for (auto it = tx_blobs.begin(); it != tx_blobs.end(); ++it, ++i)
+    {
+      tx_admission_entry& e = entries[i];
+      e.blob_size = it->size();
+      if (e.blob_size > CURRENCY_MAX_TRANSACTION_BLOB_SIZE)
+      {
+        LOG_PRINT_L0("WRONG TRANSACTION BLOB, too big size " << e.blob_size << ", rejected");
+        tvcs[i].m_verification_failed = true;
+        return false;
+      }
+      if (!parse_tx_from_blob(e.tx, e.id, *it))
+      {
+        LOG_PRINT_L0("WRONG TRANSACTION BLOB, Failed to parse, rejected");
+        tvcs[i].m_verification_failed = true;
+        return false;
+      }
+      if (!validate_tx_semantic(e.tx, e.blob_size, e.semantic))
+      {
+        LOG_PRINT_L0("WRONG TRANSACTION SEMANTICS, Failed to check tx " << e.id << " semantic, rejected");
+        tvcs[i].m_verification_failed = true;
+        return false;
+      }
+      // recently evicted txs are treated as known, so peers re-sending them don't make us verify them again
+      e.already_known = m_mempool.have_tx(e.id) || m_blockchain_storage.have_tx(e.id) || m_mempool.is_tx_recently_evicted(e.id);
+    }
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
+  void core::tx_admission_preverify(tx_admission_entry& e)
+  {
+    if (e.already_known || m_blockchain_storage.is_in_checkpoint_zone())
+    {
+      e.pvi.top_block_id = null_hash; // nothing to verify or add_tx() won't verify it anyway
+      return;
+    }
+    TIME_MEASURE_START(verification_time);
+    m_mempool.preverify_tx(e.tx, e.id, e.pvi, &e.semantic);
+    TIME_MEASURE_FINISH(verification_time);
+    m_tx_admission_verification_time.push(verification_time);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::tx_admission_commit(std::vector<tx_admission_entry>& entries, std::vector<tx_verification_context>& tvcs)
+  {
+    CRITICAL_REGION_LOCAL(m_incoming_tx_lock);
+    for (size_t i = 0; i != entries.size(); ++i)
+    {
+      tx_admission_entry& e = entries[i];
+      if (e.already_known || m_mempool.have_tx(e.id) || m_blockchain_storage.have_tx(e.id))
+        continue;
+
+      m_mempool.add_tx(e.tx, e.id, e.blob_size, tvcs[i], false, false, e.pvi.top_block_id == null_hash ? nullptr : &e.pvi, &e.semantic);
+      if (tvcs[i].m_verification_failed)
+      {
+        LOG_PRINT_RED_L0("Transaction verification failed: " << e.id);
+        return false;
+      }
+      if (tvcs[i].m_verification_impossible)
+      {
+        LOG_PRINT_RED_L0("Transaction verification impossible: " << e.id);
+      }
+      if (tvcs[i].m_added_to_pool)
+      {
+        LOG_PRINT_L2("incoming tx " << e.id << " was added to the pool");
+      }
+    }
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::handle_incoming_txs(const std::list<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvcs)
+  {
+    std::vector<tx_admission_entry> entries;
+    if (!tx_admission_stateless_checks(tx_blobs, entries, tvcs))
+      return false;
+
+    if (m_tx_admission_threads < 2 || entries.size() < 2)
+    {
+      for (auto& e : entries)
+        tx_admission_preverify(e);
+    }
+    else
+    {
+      utils::threads_pool::jobs_container jobs;
+      for (auto& e : entries)
+      {
+        tx_admission_entry* pe = &e;
+        utils::threads_pool::add_job_to_container(jobs, [this, pe]() {
+          try
+          {
+            tx_admission_preverify(*pe);
+          }
+          catch (...)
+          {
+            pe->pvi.top_block_id = null_hash; // add_tx() will do the checks itself
+          }
+        });
+      }
+      m_tx_admission_queue_depth += entries.size();
+      m_tx_admission_pool.add_batch_and_wait(jobs);
+      m_tx_admission_queue_depth -= entries.size();
+    }
+
+    return tx_admission_commit(entries, tvcs);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::handle_incoming_txs_async(const std::list<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvcs, const tx_admission_callback_t& cb)
+  {
+    std::shared_ptr<std::vector<tx_admission_entry>> entries_ptr = std::make_shared<std::vector<tx_admission_entry>>();
+    if (!tx_admission_stateless_checks(tx_blobs, *entries_ptr, tvcs))
+      return false;
+
+    const uint64_t count = entries_ptr->size();
+    if (m_tx_admission_threads < 2 || m_tx_admission_stopped || m_tx_admission_queue_depth + count > TX_ADMISSION_QUEUE_MAX_TXS)
+    {
+      // workers are disabled or overloaded: the caller pays for the verification itself
+      for (auto& e : *entries_ptr)
+        tx_admission_preverify(e);
+      tx_admission_commit(*entries_ptr, tvcs);
+      cb(tvcs);
+      return true;
+    }
+
+    std::shared_ptr<std::vector<tx_verification_context>> tvcs_ptr = std::make_shared<std::vector<tx_verification_context>>(tvcs);
+    m_tx_admission_queue_depth += count;
+    ++m_tx_admission_jobs_in_flight;
+    m_tx_admission_pool.add_job([this, entries_ptr, tvcs_ptr, cb, count]() {
+      try
+      {
+        if (!m_tx_admission_stopped)
+        {
+          for (auto& e : *entries_ptr)
+            tx_admission_preverify(e);
+          tx_admission_commit(*entries_ptr, *tvcs_ptr);
+          cb(*tvcs_ptr);
+        }
+      }
+      catch (const std::exception& ex)
+      {
+        LOG_ERROR("Exception in tx admission job: " << ex.what());
+      }
+      catch (...)
+      {
+        LOG_ERROR("Unknown exception in tx admission job");
+      }
+      m_tx_admission_queue_depth -= count;
+      --m_tx_admission_jobs_in_flight;
+    });
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
+  void core::stop_tx_admission()
+  {
+    m_tx_admission_stopped = true;
+    // queued jobs are skipped, running ones have to finish as they may use the protocol handler
+    uint64_t waited_ms = 0;
+    while (m_tx_admission_jobs_in_flight != 0 && waited_ms < TX_ADMISSION_STOP_TIMEOUT_MS)
+    {
+      epee::misc_utils::sleep_no_w(10);
+      waited_ms += 10;
+    }
+    if (m_tx_admission_jobs_in_flight != 0)
+    {
+      LOG_PRINT_RED_L0("tx admission: " << m_tx_admission_jobs_in_flight << " jobs are still in flight after " << waited_ms << " ms");
+    }
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_stat_info(const core_stat_info::params& pr, core_stat_info& st_inf)
   {
     st_inf.mining_speed = m_miner.get_speed();
@@ -341,7 +551,7 @@ namespace currency
     return m_blockchain_storage.get_outs(amount, pkeys);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::add_new_tx(const transaction& tx, const crypto::hash& tx_hash, size_t blob_size, tx_verification_context& tvc, bool kept_by_block)
+  bool core::add_new_tx(const transaction& tx, const crypto::hash& tx_hash, size_t blob_size, tx_verification_context& tvc, bool kept_by_block, const tx_semantic_context* p_semantic /* = nullptr */)
   {
     if(m_mempool.have_tx(tx_hash))
     {
@@ -355,22 +565,61 @@ namespace currency
       return true;
     }
 
-    return m_mempool.add_tx(tx, tx_hash, blob_size, tvc, kept_by_block);
+    return m_mempool.add_tx(tx, tx_hash, blob_size, tvc, kept_by_block, false, nullptr, p_semantic);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::get_block_template(block& b, const account_public_address& adr, const account_public_address& stakeholder_address, wide_difficulty_type& diffic, uint64_t& height, const blobdata& ex_nonce, bool pos, const pos_entry& pe)
   {
-    return m_blockchain_storage.create_block_template(adr, stakeholder_address, ex_nonce, pos, pe, nullptr, b, diffic, height);
+    create_block_template_params params = AUTO_VAL_INIT(params);
+    params.miner_address = adr;
+    params.stakeholder_address = stakeholder_address;
+    params.ex_nonce = ex_nonce;
+    params.pos = pos;
+    params.pe = pe;
+    params.pcustom_fill_block_template_func = nullptr;
+    create_block_template_response resp = AUTO_VAL_INIT(resp);
+    bool r = get_block_template(params, resp);
+    b = resp.b;
+    diffic = resp.diffic;
+    height = resp.height;
+    return r;
   }
   //-----------------------------------------------------------------------------------------------
   bool core::get_block_template(const create_block_template_params& params, create_block_template_response& resp)
   {
-    return m_blockchain_storage.create_block_template(params, resp);
+    if (params.pcustom_fill_block_template_func != nullptr || !params.explicit_txs.empty())
+      return m_blockchain_storage.create_block_template(params, resp);
+
+    std::shared_ptr<const block_template_base> base_ptr = get_block_template_base(params.pos);
+    if (!base_ptr)
+      return false;
+    return m_blockchain_storage.create_block_template(params, *base_ptr, resp);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const 
+  std::shared_ptr<const block_template_base> core::get_block_template_base(bool pos)
   {
-    return m_blockchain_storage.find_blockchain_supplement(qblock_ids, resp);
+    // read before taking the lock: blockchain and pool locks must never be taken while holding it
+    crypto::hash top_id = m_blockchain_storage.get_top_block_id();
+    uint64_t pool_version = m_mempool.get_pool_version();
+    {
+      CRITICAL_REGION_LOCAL(m_block_template_base_lock);
+      const std::shared_ptr<const block_template_base>& cached = pos ? m_pos_block_template_base : m_pow_block_template_base;
+      if (cached && cached->prev_id == top_id && cached->pool_version == pool_version)
+        return cached;
+    }
+
+    std::shared_ptr<block_template_base> base_ptr = std::make_shared<block_template_base>();
+    if (!m_blockchain_storage.create_block_template_base(pos, nullptr, std::list<transaction>(), *base_ptr))
+      return nullptr;
+
+    CRITICAL_REGION_LOCAL(m_block_template_base_lock);
+    (pos ? m_pos_block_template_base : m_pow_block_template_base) = base_ptr;
+    return base_ptr;
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, bool with_headers) const 
+  {
+    return m_blockchain_storage.find_blockchain_supplement(qblock_ids, resp, with_headers);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<std::pair<block, std::list<transaction> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const 
@@ -403,6 +652,11 @@ namespace currency
     return m_blockchain_storage.get_tx_outputs_gindexs(tx_id, indexs);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::get_tx_outputs_gindexs(const std::vector<crypto::hash>& tx_ids, std::vector<std::vector<uint64_t> >& indexs)
+  {
+    return m_blockchain_storage.get_tx_outputs_gindexs(tx_ids, indexs);
+  }
+  //-----------------------------------------------------------------------------------------------
   void core::pause_mine()
   {
     m_miner.pause();
@@ -481,6 +735,7 @@ namespace currency
         //pack transactions
         for(auto& tx : txs)
           arg.b.txs.push_back(t_serializable_object_to_blob(tx));
+        m_blockchain_storage.cache_block_blobs(get_block_hash(b), arg.b);
 
         TIME_MEASURE_FINISH_MS(time_pack_txs_ms);
 
@@ -638,6 +893,13 @@ namespace currency
     return m_mempool.get_transactions_count();
   }
   //-----------------------------------------------------------------------------------------------
+  void core::get_memory_usage(std::list<tools::memory_usage_entry>& usage) const
+  {
+    m_blockchain_storage.get_memory_usage(usage);
+    m_mempool.get_memory_usage(usage);
+    tools::get_epee_memory_usage(usage);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::have_block(const crypto::hash& id)
   {
     return m_blockchain_storage.have_block(id);
@@ -653,6 +915,11 @@ namespace currency
     return m_mempool.get_transactions(txs);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::get_pool_transactions_blobs(std::list<blobdata>& blobs, uint64_t& pool_version)
+  {
+    return m_mempool.get_transactions_blobs(blobs, pool_version);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_short_chain_history(std::list<crypto::hash>& ids)
   {
     return m_blockchain_storage.get_short_chain_history(ids);
@@ -660,7 +927,27 @@ namespace currency
   //-----------------------------------------------------------------------------------------------
   bool core::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, currency_connection_context& context)const 
   {
-    return m_blockchain_storage.handle_get_objects(arg, rsp);
+    if (!m_blockchain_storage.handle_get_objects(arg, rsp))
+      return false;
+
+    // txs of a relayed compact block may still be in the pool (e.g. if it's an alt block)
+    if (arg.txs.size() && rsp.missed_ids.size())
+    {
+      for (auto it = rsp.missed_ids.begin(); it != rsp.missed_ids.end(); )
+      {
+        transaction tx = AUTO_VAL_INIT(tx);
+        if (m_mempool.get_transaction(*it, tx))
+        {
+          rsp.txs.push_back(t_serializable_object_to_blob(tx));
+          it = rsp.missed_ids.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+    }
+    return true;
   }
   //-----------------------------------------------------------------------------------------------
   crypto::hash core::get_block_id_by_height(uint64_t height)const 
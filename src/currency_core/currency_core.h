@@ -41,8 +41,16 @@ namespace currency
      core(i_currency_protocol* pprotocol);
      bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, currency_connection_context& context)const ;
      bool on_idle();
-     bool handle_incoming_tx(const transaction& tx, tx_verification_context& tvc, bool kept_by_block, const crypto::hash& tx_hash_ = null_hash);
+     bool handle_incoming_tx(const transaction& tx, tx_verification_context& tvc, bool kept_by_block, const crypto::hash& tx_hash_ = null_hash, const tx_semantic_context* p_semantic = nullptr);
      bool handle_incoming_tx(const blobdata& tx_blob, tx_verification_context& tvc, bool kept_by_block);
+     // admission pipeline for txs from the network: stateless checks inline, signatures and proofs on the admission
+     // workers, then the txs are added to the pool one by one in the given order
+     typedef std::function<void(const std::vector<tx_verification_context>& tvcs)> tx_admission_callback_t;
+     bool handle_incoming_txs(const std::list<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvcs);
+     // returns false if stateless checks failed (tvcs tell which one), otherwise cb is called once the txs are processed (possibly before returning)
+     bool handle_incoming_txs_async(const std::list<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvcs, const tx_admission_callback_t& cb);
+     uint64_t get_tx_admission_queue_depth() const { return m_tx_admission_queue_depth; }
+     uint64_t get_tx_admission_verification_time() const { return m_tx_admission_verification_time.get_avg(); }
      bool handle_incoming_block(const blobdata& block_blob, block_verification_context& bvc, bool update_miner_blocktemplate = true);
      bool handle_incoming_block(const block& b, block_verification_context& bvc, bool update_miner_blocktemplate = true);
      bool parse_block(const blobdata& block_blob, block& b, block_verification_context& bvc);
@@ -89,20 +97,26 @@ namespace currency
      bool set_checkpoints(checkpoints&& chk_pts);
 
      bool get_pool_transactions(std::list<transaction>& txs);
+     bool get_pool_transactions_blobs(std::list<blobdata>& blobs, uint64_t& pool_version);
      size_t get_pool_transactions_count();
+     // estimated memory of the blockchain and pool caches and containers, network send queues and parsed requests
+     void get_memory_usage(std::list<tools::memory_usage_entry>& usage) const;
      size_t get_blockchain_total_transactions();
      bool get_outs(uint64_t amount, std::list<crypto::public_key>& pkeys);
      bool have_block(const crypto::hash& id);
      bool get_short_chain_history(std::list<crypto::hash>& ids);
-     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const ;
+     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, bool with_headers = false) const ;
      bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<std::pair<block, std::list<transaction> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count) const ;
      bool get_stat_info(const core_stat_info::params& pr, core_stat_info& st_inf);
      bool get_backward_blocks_sizes(uint64_t from_height, std::vector<size_t>& sizes, size_t count);
      bool get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<uint64_t>& indexs);
+     bool get_tx_outputs_gindexs(const std::vector<crypto::hash>& tx_ids, std::vector<std::vector<uint64_t> >& indexs);
      crypto::hash get_tail_id();
      bool get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res);
      void pause_mine();
      void resume_mine();
+     // the caller-independent part of the next block template, shared while the top block and the pool stay the same
+     std::shared_ptr<const block_template_base> get_block_template_base(bool pos);
      blockchain_storage& get_blockchain_storage() { return m_blockchain_storage; }
      const blockchain_storage& get_blockchain_storage() const { return m_blockchain_storage; }
      //debug functions
@@ -116,7 +130,21 @@ namespace currency
      void remove_blockchain_update_listener(i_blockchain_update_listener *l);
 
    private:
-     bool add_new_tx(const transaction& tx, const crypto::hash& tx_hash, size_t blob_size, tx_verification_context& tvc, bool kept_by_block);
+     struct tx_admission_entry
+     {
+       transaction tx;
+       crypto::hash id;
+       size_t blob_size;
+       bool already_known;
+       tx_semantic_context semantic;
+       tx_memory_pool::tx_preverification_info pvi;
+     };
+     bool tx_admission_stateless_checks(const std::list<blobdata>& tx_blobs, std::vector<tx_admission_entry>& entries, std::vector<tx_verification_context>& tvcs);
+     void tx_admission_preverify(tx_admission_entry& e);
+     bool tx_admission_commit(std::vector<tx_admission_entry>& entries, std::vector<tx_verification_context>& tvcs);
+     void stop_tx_admission();
+
+     bool add_new_tx(const transaction& tx, const crypto::hash& tx_hash, size_t blob_size, tx_verification_context& tvc, bool kept_by_block, const tx_semantic_context* p_semantic = nullptr);
      bool add_new_tx(const transaction& tx, tx_verification_context& tvc, bool kept_by_block);
      bool add_new_block(const block& b, block_verification_context& bvc);
      bool load_state_data();
@@ -153,6 +181,18 @@ namespace currency
 
      epee::critical_section m_blockchain_update_listeners_lock;
      std::vector<i_blockchain_update_listener*> m_blockchain_update_listeners;
+
+     size_t m_tx_admission_threads;
+     utils::threads_pool m_tx_admission_pool;
+     std::atomic<uint64_t> m_tx_admission_queue_depth;     // txs handed to the admission workers and not committed yet
+     std::atomic<uint64_t> m_tx_admission_jobs_in_flight;
+     std::atomic<bool> m_tx_admission_stopped;
+     epee::math_helper::average<uint64_t, 100> m_tx_admission_verification_time; // microseconds per tx
+
+     // caller-independent parts of the last PoW/PoS templates, handed out as immutable snapshots
+     epee::critical_section m_block_template_base_lock;
+     std::shared_ptr<const block_template_base> m_pow_block_template_base;
+     std::shared_ptr<const block_template_base> m_pos_block_template_base;
    };
 }
 
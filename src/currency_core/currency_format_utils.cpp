@@ -32,6 +32,7 @@ using namespace epee;
 #include "genesis_acc.h"
 #include "common/mnemonic-encoding.h"
 #include "crypto/bitcoin/sha256_helper.h"
+#include "common/threads_pool.h"
 #include "crypto_config.h"
 #include "wallet/wallet_debug_events_definitions.h"
 
@@ -48,9 +49,19 @@ namespace currency
     return true;
   }
   //--------------------------------------------------------------------------------
-  bool generate_asset_surjection_proof(const crypto::hash& context_hash, bool has_non_zc_inputs, tx_generation_context& ogc, zc_asset_surjection_proof& result)
+  // BGE proof of an output's asset id, a part of the asset surjection proof
+  // prepare_asset_surjection_proof_jobs() makes the rings and the secrets of all the outputs, generate_asset_surjection_bge_proof() makes a proof
+  struct asset_surjection_bge_job
+  {
+    std::vector<crypto::point_t> ring;
+    crypto::scalar_t secret;
+    size_t secret_index;
+    crypto::hash prng_seed;                           // so the proof is the same whichever thread makes it
+  };
+  //--------------------------------------------------------------------------------
+  // jobs are left empty if there's no ZC inputs, then no proofs are needed
+  bool prepare_asset_surjection_proof_jobs(bool has_non_zc_inputs, const tx_generation_context& ogc, std::vector<asset_surjection_bge_job>& jobs)
   {
-    bool r = false;
     size_t outs_count = ogc.blinded_asset_ids.size();
     CHECK_AND_ASSERT_MES(outs_count > 0, false, "blinded_asset_ids shouldn't be empty");
     CHECK_AND_ASSERT_MES(outs_count == ogc.asset_id_blinding_masks.size(), false, "asset_id_blinding_masks != outs_count");
@@ -80,12 +91,13 @@ namespace currency
     //ogc.blinded_asset_ids;                         // T'_j = H_j + s_j * X
     //ogc.asset_id_blinding_masks;                   // s_j
 
+    jobs.resize(outs_count);
     for(size_t j = 0; j < outs_count; ++j)
     {
       const crypto::public_key H = ogc.asset_ids[j].to_public_key();
       const crypto::point_t& T = ogc.blinded_asset_ids[j];
       
-      std::vector<crypto::point_t> ring;
+      std::vector<crypto::point_t>& ring = jobs[j].ring;
       ring.reserve(zc_ins_count);
       size_t secret_index = SIZE_MAX;
       crypto::scalar_t secret = -ogc.asset_id_blinding_masks[j];
@@ -118,10 +130,34 @@ namespace currency
 
       CHECK_AND_ASSERT_MES(secret_index != SIZE_MAX, false, "out #" << j << ": can't find a corresponding asset id in inputs, asset id: " << H);
 
+      jobs[j].secret = secret;
+      jobs[j].secret_index = secret_index;
+      crypto::generate_random_bytes(sizeof jobs[j].prng_seed, &jobs[j].prng_seed);
+    }
+
+    return true;
+  }
+  //--------------------------------------------------------------------------------
+  bool generate_asset_surjection_bge_proof(const crypto::hash& context_hash, const asset_surjection_bge_job& job, size_t out_index, crypto::BGE_proof_s& proof)
+  {
+    crypto::thread_prng_scope prng_scope(job.prng_seed);
+    uint8_t err = 0;
+    bool r = crypto::generate_BGE_proof(context_hash, job.ring, job.secret, job.secret_index, proof, &err);
+    CHECK_AND_ASSERT_MES(r, false, "out #" << out_index << ": generate_BGE_proof failed with err=" << (int)err);
+    return true;
+  }
+  //--------------------------------------------------------------------------------
+  bool generate_asset_surjection_proof(const crypto::hash& context_hash, bool has_non_zc_inputs, tx_generation_context& ogc, zc_asset_surjection_proof& result)
+  {
+    std::vector<asset_surjection_bge_job> jobs;
+    bool r = prepare_asset_surjection_proof_jobs(has_non_zc_inputs, ogc, jobs);
+    CHECK_AND_ASSERT_MES(r, false, "prepare_asset_surjection_proof_jobs failed");
+
+    for(size_t j = 0; j < jobs.size(); ++j)
+    {
       result.bge_proofs.emplace_back(crypto::BGE_proof_s{});
-      uint8_t err = 0;
-      r = crypto::generate_BGE_proof(context_hash, ring, secret, secret_index, result.bge_proofs.back(), &err);
-      CHECK_AND_ASSERT_MES(r, false, "out #" << j << ": generate_BGE_proof failed with err=" << (int)err);
+      r = generate_asset_surjection_bge_proof(context_hash, jobs[j], j, result.bge_proofs.back());
+      CHECK_AND_ASSERT_MES(r, false, "generate_asset_surjection_bge_proof failed");
     }
 
     return true;
@@ -138,7 +174,7 @@ namespace currency
     bool has_non_ZC_inputs = false;
     for(const auto& in : tx.vin)
     {
-      if (in.type() == typeid(txin_zc_input))
+      if (tools::is_variant_type<txin_zc_input>(in))
         has_ZC_inputs = true;
       else
         has_non_ZC_inputs = true;
@@ -162,7 +198,7 @@ namespace currency
     std::vector<crypto::point_t> pseudo_outs_blinded_asset_ids;
     for(const auto& sig : tx.signatures)
     {
-      if (sig.type() == typeid(ZC_sig))
+      if (tools::is_variant_type<ZC_sig>(sig))
         pseudo_outs_blinded_asset_ids.emplace_back(crypto::point_t(boost::get<ZC_sig>(sig).pseudo_out_blinded_asset_id).modify_mul8());
     }
     if (has_non_ZC_inputs)
@@ -176,24 +212,37 @@ namespace currency
       pseudo_outs_blinded_asset_ids.emplace_back(asset_id_pt); // additional ring member for asset emitting tx
     }
 
+    // all the proofs share the same ring of pseudo outs' blinded asset ids, they are verified in one batch
+    // TODO @#@# remove this redundant conversion to pubkey and back
+    const size_t ring_size = pseudo_outs_blinded_asset_ids.size();
+    std::vector<crypto::point_t> rings_pt(outs_count * ring_size);
     for(size_t j = 0; j < outs_count; ++j)
     {
       crypto::point_t blinded_asset_id(boost::get<tx_out_zarcanum>(tx.vout[j]).blinded_asset_id);
       blinded_asset_id.modify_mul8();
+      for(size_t i = 0; i < ring_size; ++i)
+        rings_pt[j * ring_size + i] = crypto::c_scalar_1div8 * (pseudo_outs_blinded_asset_ids[i] - blinded_asset_id);
+    }
+    std::vector<crypto::public_key> rings(rings_pt.size());
+    crypto::point_t::batch_to_public_keys(rings_pt.data(), rings_pt.size(), rings.data()); // one inversion for all the rings
 
-      // TODO @#@# remove this redundant conversion to pubkey and back
-      std::vector<crypto::public_key> ring(pseudo_outs_blinded_asset_ids.size());
-      std::vector<const crypto::public_key*> ring_pointers(pseudo_outs_blinded_asset_ids.size());
-      for(size_t i = 0, n = pseudo_outs_blinded_asset_ids.size(); i < n; ++i)
-      {
-        ring[i] = ((crypto::c_scalar_1div8 * (pseudo_outs_blinded_asset_ids[i] - blinded_asset_id)).to_public_key());
-        ring_pointers[i] = &ring[i];
-      }
-
-      uint8_t err = 0;
-      CHECK_AND_ASSERT_MES(crypto::verify_BGE_proof(tx_id, ring_pointers, sig.bge_proofs[j], &err), false, "verify_BGE_proof failed, err = " << (int)err);
+    std::vector<std::vector<const crypto::public_key*>> rings_pointers(outs_count);
+    std::vector<crypto::BGE_proof_ref_t> proofs;
+    proofs.reserve(outs_count);
+    for(size_t j = 0; j < outs_count; ++j)
+    {
+      rings_pointers[j].resize(ring_size);
+      for(size_t i = 0; i < ring_size; ++i)
+        rings_pointers[j][i] = &rings[j * ring_size + i];
+      proofs.emplace_back(tx_id, rings_pointers[j], sig.bge_proofs[j]);
     }
 
+    if (proofs.empty())
+      return true;
+
+    uint8_t err = 0;
+    CHECK_AND_ASSERT_MES(crypto::verify_BGE_proofs_batch(proofs, &err), false, "verify_BGE_proofs_batch failed, err = " << (int)err);
+
     return true;
   }
   //--------------------------------------------------------------------------------
@@ -626,16 +675,89 @@ namespace currency
     return true;
   }
   //------------------------------------------------------------------
-  bool check_tx_balance(const transaction& tx, const crypto::hash& tx_id, uint64_t additional_inputs_amount_and_fees_for_mining_tx /* = 0 */)
+  // post-HF4 part of check_tx_balance(), bare_inputs_sum includes additional_inputs_amount_and_fees_for_mining_tx
+  bool check_zc_tx_balance(const transaction& tx, const crypto::hash& tx_id, uint64_t bare_inputs_sum, size_t zc_inputs_count, uint64_t additional_inputs_amount_and_fees_for_mining_tx)
   {
-    if (tx.version > TRANSACTION_VERSION_PRE_HF4)
+    zc_balance_proof balance_proof = AUTO_VAL_INIT(balance_proof);
+    bool r = get_type_in_variant_container<zc_balance_proof>(tx.proofs, balance_proof);
+    CHECK_AND_ASSERT_MES(r, false, "zc_balance_proof is missing in tx proofs");
+
+    crypto::public_key tx_pub_key = get_tx_pub_key_from_extra(tx);
+
+    crypto::point_t outs_commitments_sum = crypto::c_point_0; // TODO: consider adding additional commitments / spends / burns here
+    for(auto& vout : tx.vout)
     {
-      zc_balance_proof balance_proof = AUTO_VAL_INIT(balance_proof);
-      bool r = get_type_in_variant_container<zc_balance_proof>(tx.proofs, balance_proof);
-      CHECK_AND_ASSERT_MES(r, false, "zc_balance_proof is missing in tx proofs");
+      CHECK_AND_ASSERT_MES(tools::is_variant_type<tx_out_zarcanum>(vout), false, "unexpected type in outs: " << vout.type().name());
+      const tx_out_zarcanum& ozc = boost::get<tx_out_zarcanum>(vout);
+      outs_commitments_sum += crypto::point_t(ozc.amount_commitment); // amount_commitment premultiplied by 1/8
+    }
+
+    uint64_t fee = 0;
+    CHECK_AND_ASSERT_MES(get_tx_fee(tx, fee) || additional_inputs_amount_and_fees_for_mining_tx > 0, false, "unable to get fee for a non-mining tx");
 
-      crypto::public_key tx_pub_key = get_tx_pub_key_from_extra(tx);
+    CHECK_AND_ASSERT_MES(additional_inputs_amount_and_fees_for_mining_tx == 0 || fee == 0, false, "invalid tx: fee = " << print_money_brief(fee) <<
+      ", additional inputs + fees = " << print_money_brief(additional_inputs_amount_and_fees_for_mining_tx));
 
+    crypto::point_t sum_of_pseudo_out_amount_commitments = crypto::c_point_0;
+    // take into account generated/burnt assets
+    asset_descriptor_operation ado = AUTO_VAL_INIT(ado);
+    if (get_type_in_variant_container(tx.extra, ado))
+    {
+      if (ado.operation_type == ASSET_DESCRIPTOR_OPERATION_REGISTER || ado.operation_type == ASSET_DESCRIPTOR_OPERATION_EMIT)
+      {
+        // amount_commitment supposed to be validated earlier in validate_asset_operation_amount_commitment()
+        sum_of_pseudo_out_amount_commitments += crypto::point_t(ado.amount_commitment); // *1/8
+      }
+      else if (ado.operation_type == ASSET_DESCRIPTOR_OPERATION_PUBLIC_BURN)
+      {
+        outs_commitments_sum += crypto::point_t(ado.amount_commitment); // *1/8
+      }
+    }
+    size_t zc_sigs_count = 0;
+    for(auto& sig_v : tx.signatures)
+    {
+      VARIANT_SWITCH_BEGIN(sig_v);
+      VARIANT_CASE_CONST(ZC_sig, zc_sig);
+        sum_of_pseudo_out_amount_commitments += crypto::point_t(zc_sig.pseudo_out_amount_commitment); // *1/8
+        ++zc_sigs_count;
+      VARIANT_CASE_CONST(zarcanum_sig, sig);
+        sum_of_pseudo_out_amount_commitments += crypto::point_t(sig.pseudo_out_amount_commitment); // *1/8
+        ++zc_sigs_count;
+      VARIANT_SWITCH_END();
+    }
+
+    outs_commitments_sum.modify_mul8();
+    sum_of_pseudo_out_amount_commitments.modify_mul8();
+
+    // (sum(bare inputs' amounts) - fee) * H + sum(pseudo outs commitments for ZC inputs) - sum(outputs' commitments) = lin(X)  OR  = lin(G)
+    crypto::point_t commitment_to_zero = (crypto::scalar_t(bare_inputs_sum) - crypto::scalar_t(fee)) * currency::native_coin_asset_id_pt + sum_of_pseudo_out_amount_commitments - outs_commitments_sum;
+
+    DBG_VAL_PRINT(tx_id);
+    DBG_VAL_PRINT(tx_pub_key);
+    DBG_VAL_PRINT(bare_inputs_sum);
+    DBG_VAL_PRINT(fee);
+    DBG_VAL_PRINT(sum_of_pseudo_out_amount_commitments);
+    DBG_VAL_PRINT(outs_commitments_sum);
+    DBG_VAL_PRINT(commitment_to_zero);
+
+    CHECK_AND_ASSERT_MES(zc_inputs_count == zc_sigs_count, false, "zc inputs count (" << zc_inputs_count << ") and zc sigs count (" << zc_sigs_count << ") missmatch");
+    if (zc_inputs_count > 0)
+    {
+      r = crypto::verify_double_schnorr_sig<crypto::gt_X, crypto::gt_G>(tx_id, commitment_to_zero, tx_pub_key, balance_proof.dss);
+      CHECK_AND_ASSERT_MES(r, false, "verify_double_schnorr_sig (X, G) is invalid");
+    }
+    else
+    {
+      r = crypto::verify_double_schnorr_sig<crypto::gt_G, crypto::gt_G>(tx_id, commitment_to_zero, tx_pub_key, balance_proof.dss);
+      CHECK_AND_ASSERT_MES(r, false, "verify_double_schnorr_sig (G, G) is invalid");
+    }
+    return true;
+  }
+  //------------------------------------------------------------------
+  bool check_tx_balance(const transaction& tx, const crypto::hash& tx_id, uint64_t additional_inputs_amount_and_fees_for_mining_tx /* = 0 */)
+  {
+    if (tx.version > TRANSACTION_VERSION_PRE_HF4)
+    {
       size_t zc_inputs_count = 0;
       uint64_t bare_inputs_sum = additional_inputs_amount_and_fees_for_mining_tx;
       for(auto& vin : tx.vin)
@@ -651,81 +773,24 @@ namespace currency
           ++zc_inputs_count;
         VARIANT_SWITCH_END();
       }
-
-      crypto::point_t outs_commitments_sum = crypto::c_point_0; // TODO: consider adding additional commitments / spends / burns here
-      for(auto& vout : tx.vout)
-      {
-        CHECK_AND_ASSERT_MES(vout.type() == typeid(tx_out_zarcanum), false, "unexpected type in outs: " << vout.type().name());
-        const tx_out_zarcanum& ozc = boost::get<tx_out_zarcanum>(vout);
-        outs_commitments_sum += crypto::point_t(ozc.amount_commitment); // amount_commitment premultiplied by 1/8
-      }
-
-      uint64_t fee = 0;
-      CHECK_AND_ASSERT_MES(get_tx_fee(tx, fee) || additional_inputs_amount_and_fees_for_mining_tx > 0, false, "unable to get fee for a non-mining tx");
-
-      CHECK_AND_ASSERT_MES(additional_inputs_amount_and_fees_for_mining_tx == 0 || fee == 0, false, "invalid tx: fee = " << print_money_brief(fee) <<
-        ", additional inputs + fees = " << print_money_brief(additional_inputs_amount_and_fees_for_mining_tx));
-
-      crypto::point_t sum_of_pseudo_out_amount_commitments = crypto::c_point_0;
-      // take into account generated/burnt assets
-      asset_descriptor_operation ado = AUTO_VAL_INIT(ado);
-      if (get_type_in_variant_container(tx.extra, ado))
-      {
-        if (ado.operation_type == ASSET_DESCRIPTOR_OPERATION_REGISTER || ado.operation_type == ASSET_DESCRIPTOR_OPERATION_EMIT)
-        {
-          // amount_commitment supposed to be validated earlier in validate_asset_operation_amount_commitment()
-          sum_of_pseudo_out_amount_commitments += crypto::point_t(ado.amount_commitment); // *1/8
-        }
-        else if (ado.operation_type == ASSET_DESCRIPTOR_OPERATION_PUBLIC_BURN)
-        {
-          outs_commitments_sum += crypto::point_t(ado.amount_commitment); // *1/8
-        }
-      }
-      size_t zc_sigs_count = 0;
-      for(auto& sig_v : tx.signatures)
-      {
-        VARIANT_SWITCH_BEGIN(sig_v);
-        VARIANT_CASE_CONST(ZC_sig, zc_sig);
-          sum_of_pseudo_out_amount_commitments += crypto::point_t(zc_sig.pseudo_out_amount_commitment); // *1/8
-          ++zc_sigs_count;
-        VARIANT_CASE_CONST(zarcanum_sig, sig);
-          sum_of_pseudo_out_amount_commitments += crypto::point_t(sig.pseudo_out_amount_commitment); // *1/8
-          ++zc_sigs_count;
-        VARIANT_SWITCH_END();
-      }
-
-      outs_commitments_sum.modify_mul8();
-      sum_of_pseudo_out_amount_commitments.modify_mul8();
-
-      // (sum(bare inputs' amounts) - fee) * H + sum(pseudo outs commitments for ZC inputs) - sum(outputs' commitments) = lin(X)  OR  = lin(G)
-      crypto::point_t commitment_to_zero = (crypto::scalar_t(bare_inputs_sum) - crypto::scalar_t(fee)) * currency::native_coin_asset_id_pt + sum_of_pseudo_out_amount_commitments - outs_commitments_sum;
-
-      DBG_VAL_PRINT(tx_id);
-      DBG_VAL_PRINT(tx_pub_key);
-      DBG_VAL_PRINT(bare_inputs_sum);
-      DBG_VAL_PRINT(fee);
-      DBG_VAL_PRINT(sum_of_pseudo_out_amount_commitments);
-      DBG_VAL_PRINT(outs_commitments_sum);
-      DBG_VAL_PRINT(commitment_to_zero);
-
-      CHECK_AND_ASSERT_MES(zc_inputs_count == zc_sigs_count, false, "zc inputs count (" << zc_inputs_count << ") and zc sigs count (" << zc_sigs_count << ") missmatch");
-      if (zc_inputs_count > 0)
-      {
-        r = crypto::verify_double_schnorr_sig<crypto::gt_X, crypto::gt_G>(tx_id, commitment_to_zero, tx_pub_key, balance_proof.dss);
-        CHECK_AND_ASSERT_MES(r, false, "verify_double_schnorr_sig (X, G) is invalid");
-      }
-      else
-      {
-        r = crypto::verify_double_schnorr_sig<crypto::gt_G, crypto::gt_G>(tx_id, commitment_to_zero, tx_pub_key, balance_proof.dss);
-        CHECK_AND_ASSERT_MES(r, false, "verify_double_schnorr_sig (G, G) is invalid");
-      }
-      return true;
+      return check_zc_tx_balance(tx, tx_id, bare_inputs_sum, zc_inputs_count, additional_inputs_amount_and_fees_for_mining_tx);
     }
     
     // pre-HF4 txs
     return check_tx_bare_balance(tx, additional_inputs_amount_and_fees_for_mining_tx);
   }
   //------------------------------------------------------------------
+  bool check_tx_balance(const transaction& tx, const crypto::hash& tx_id, const tx_semantic_context& tsc)
+  {
+    if (tx.version > TRANSACTION_VERSION_PRE_HF4)
+      return check_zc_tx_balance(tx, tx_id, tsc.bare_inputs_sum, tsc.zc_inputs_count, 0);
+
+    // pre-HF4 txs
+    CHECK_AND_ASSERT_MES(tsc.bare_inputs_sum >= tsc.bare_outputs_sum, false, "tx balance error: the sum of inputs (" << print_money_brief(tsc.bare_inputs_sum)
+      << ") is less than or equal to the sum of outputs (" << print_money_brief(tsc.bare_outputs_sum) << ")");
+    return true;
+  }
+  //------------------------------------------------------------------
   bool derive_ephemeral_key_helper(const account_keys& ack, const crypto::public_key& tx_public_key, size_t real_output_index, keypair& in_ephemeral)
   {
     crypto::key_derivation recv_derivation = AUTO_VAL_INIT(recv_derivation);
@@ -1082,8 +1147,8 @@ namespace currency
     //msg.vin = tx.vin;
     msg.onetime_key = get_tx_pub_key_from_extra(tx);
     CHECK_AND_ASSERT_MES(tx.vout.size() > n, null_hash, "tx.vout.size() > n condition failed ");
-    CHECK_AND_ASSERT_MES(tx.vout[n].type() == typeid(tx_out_bare), null_hash, "Unexpected type of out:" << tx.vout[n].type().name());
-    CHECK_AND_ASSERT_MES(boost::get<tx_out_bare>(tx.vout[n]).target.type() == typeid(txout_multisig), null_hash, "tx.vout[n].target.type() == typeid(txout_multisig) condition failed");
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<tx_out_bare>(tx.vout[n]), null_hash, "Unexpected type of out:" << tx.vout[n].type().name());
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<txout_multisig>(boost::get<tx_out_bare>(tx.vout[n]).target), null_hash, "tools::is_variant_type<txout_multisig>(tx.vout[n].target) condition failed");
     msg.vout.push_back(boost::get<tx_out_bare>(tx.vout[n]));
     return get_object_hash(msg);
   }
@@ -1218,84 +1283,116 @@ namespace currency
     return construct_tx_out(de, tx_sec_key, output_index, tx, deriv_cache, self, asset_blinding_mask, amount_blinding_mask, blinded_asset_id, amount_commitment, result, tx_outs_attr);
   }
   //---------------------------------------------------------------
-  bool construct_tx_out(const tx_destination_entry& de, const crypto::secret_key& tx_sec_key, size_t output_index, transaction& tx, std::set<uint16_t>& deriv_cache,
-    const account_keys& self, crypto::scalar_t& asset_blinding_mask, crypto::scalar_t& amount_blinding_mask, crypto::point_t& blinded_asset_id, crypto::point_t& amount_commitment,
-    finalized_tx& result, uint8_t tx_outs_attr)
+  struct constructed_zc_out
   {
-    if (tx.version > TRANSACTION_VERSION_PRE_HF4)
+    tx_out_zarcanum out{};
+    uint8_t view_tag = 0;                  // burnt outputs have no receiver to filter them
+    bool has_derivation_hint = false;      // nor a derivation hint
+    uint16_t derivation_hint = 0;
+  };
+  // a zarcanum output for the destination; nothing but the arguments is touched, so the outputs of a tx can be made in parallel
+  bool construct_zc_out(const tx_destination_entry& de, const crypto::secret_key& tx_sec_key, size_t output_index, uint8_t tx_outs_attr,
+    crypto::scalar_t& asset_blinding_mask, crypto::scalar_t& amount_blinding_mask, crypto::point_t& blinded_asset_id, crypto::point_t& amount_commitment,
+    constructed_zc_out& zo)
+  {
+    CHECK_AND_ASSERT_MES(de.addr.size() == 1, false, "zarcanum multisig not implemented for tx_out_zarcanum yet");
+    // TODO @#@# implement multisig support
+
+    const account_public_address& apa = de.addr.front();
+    if (apa.spend_public_key == null_pkey && apa.view_public_key == null_pkey)
     {
-      // create tx_out_zarcanum
-      CHECK_AND_ASSERT_MES(de.addr.size() == 1, false, "zarcanum multisig not implemented for tx_out_zarcanum yet");
-      // TODO @#@# implement multisig support
+      // burn money
+      // calculate encrypted_amount and amount_commitment anyway, but using modified derivation
+      crypto::scalar_t h = crypto::hash_helper_t::hs(crypto::scalar_t(tx_sec_key), output_index); // h = Hs(r, i)
 
-      tx_out_zarcanum out = AUTO_VAL_INIT(out);
+      zo.out.stealth_address = null_pkey;
+      zo.out.concealing_point = null_pkey;
 
-      const account_public_address& apa = de.addr.front();
-      if (apa.spend_public_key == null_pkey && apa.view_public_key == null_pkey)
-      {
-        // burn money
-        // calculate encrypted_amount and amount_commitment anyway, but using modified derivation
-        crypto::scalar_t h = crypto::hash_helper_t::hs(crypto::scalar_t(tx_sec_key), output_index); // h = Hs(r, i)
+      crypto::scalar_t amount_mask   = crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_AMOUNT_MASK, h);
+      zo.out.encrypted_amount = de.amount ^ amount_mask.m_u64[0];
+    
+      CHECK_AND_ASSERT_MES(~de.flags & tx_destination_entry_flags::tdef_explicit_native_asset_id || de.asset_id == currency::native_coin_asset_id, false, "explicit_native_asset_id may be used only with native asset id");
+      asset_blinding_mask = de.flags & tx_destination_entry_flags::tdef_explicit_native_asset_id ? 0 : crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_ASSET_BLINDING_MASK, h); // s = Hs(domain_sep, Hs(8 * r * V, i))
+      blinded_asset_id = crypto::point_t(de.asset_id) + asset_blinding_mask * crypto::c_point_X;
+      zo.out.blinded_asset_id = (crypto::c_scalar_1div8 * blinded_asset_id).to_public_key(); // T = 1/8 * (H_asset + s * X)
+      
+      amount_blinding_mask = de.flags & tx_destination_entry_flags::tdef_zero_amount_blinding_mask ? 0 : crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_AMOUNT_BLINDING_MASK, h); // y = Hs(domain_sep, Hs(8 * r * V, i))
+      amount_commitment = de.amount * blinded_asset_id + amount_blinding_mask * crypto::c_point_G;
+      zo.out.amount_commitment = (crypto::c_scalar_1div8 * amount_commitment).to_public_key(); // E = 1/8 * e * T + 1/8 * y * G
 
-        out.stealth_address = null_pkey;
-        out.concealing_point = null_pkey;
+      zo.out.mix_attr = tx_outs_attr; // TODO @#@# @CZ check this
+    }
+    else
+    {
+      // normal output
+      crypto::public_key derivation = (crypto::scalar_t(tx_sec_key) * crypto::point_t(apa.view_public_key)).modify_mul8().to_public_key(); // d = 8 * r * V
+      crypto::scalar_t h = 0;
+      crypto::derivation_to_scalar((const crypto::key_derivation&)derivation, output_index, h.as_secret_key()); // h = Hs(8 * r * V, i)
 
-        crypto::scalar_t amount_mask   = crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_AMOUNT_MASK, h);
-        out.encrypted_amount = de.amount ^ amount_mask.m_u64[0];
+      zo.out.stealth_address = (h * crypto::c_point_G + crypto::point_t(apa.spend_public_key)).to_public_key();
+      zo.out.concealing_point = (crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_CONCEALING_POINT, h) * crypto::point_t(apa.view_public_key)).to_public_key(); // Q = 1/8 * Hs(domain_sep, Hs(8 * r * V, i) ) * 8 * V
+    
+      crypto::scalar_t amount_mask = crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_AMOUNT_MASK, h);
+      zo.out.encrypted_amount = de.amount ^ amount_mask.m_u64[0];
+    
+      CHECK_AND_ASSERT_MES(~de.flags & tx_destination_entry_flags::tdef_explicit_native_asset_id || de.asset_id == currency::native_coin_asset_id, false, "explicit_native_asset_id may be used only with native asset id");
+      asset_blinding_mask = de.flags & tx_destination_entry_flags::tdef_explicit_native_asset_id ? 0 : crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_ASSET_BLINDING_MASK, h); // s = Hs(domain_sep, Hs(8 * r * V, i))
+      blinded_asset_id = crypto::point_t(de.asset_id) + asset_blinding_mask * crypto::c_point_X;
+      zo.out.blinded_asset_id = (crypto::c_scalar_1div8 * blinded_asset_id).to_public_key(); // T = 1/8 * (H_asset + s * X)
+
+      amount_blinding_mask = crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_AMOUNT_BLINDING_MASK, h); // y = Hs(domain_sep, Hs(8 * r * V, i))
+      amount_commitment = de.amount * blinded_asset_id + amount_blinding_mask * crypto::c_point_G;
+      zo.out.amount_commitment = (crypto::c_scalar_1div8 * amount_commitment).to_public_key(); // E = 1/8 * e * T + 1/8 * y * G
+
+      DBG_VAL_PRINT(output_index);
+      DBG_VAL_PRINT(de.amount);
+      DBG_VAL_PRINT(de.asset_id);
+      DBG_VAL_PRINT(amount_mask);
+      DBG_VAL_PRINT(asset_blinding_mask);
+      DBG_VAL_PRINT(blinded_asset_id);
+      DBG_VAL_PRINT(amount_blinding_mask);
+      DBG_VAL_PRINT(amount_mask);
+      DBG_VAL_PRINT(amount_commitment);
       
-        CHECK_AND_ASSERT_MES(~de.flags & tx_destination_entry_flags::tdef_explicit_native_asset_id || de.asset_id == currency::native_coin_asset_id, false, "explicit_native_asset_id may be used only with native asset id");
-        asset_blinding_mask = de.flags & tx_destination_entry_flags::tdef_explicit_native_asset_id ? 0 : crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_ASSET_BLINDING_MASK, h); // s = Hs(domain_sep, Hs(8 * r * V, i))
-        blinded_asset_id = crypto::point_t(de.asset_id) + asset_blinding_mask * crypto::c_point_X;
-        out.blinded_asset_id = (crypto::c_scalar_1div8 * blinded_asset_id).to_public_key(); // T = 1/8 * (H_asset + s * X)
-        
-        amount_blinding_mask = de.flags & tx_destination_entry_flags::tdef_zero_amount_blinding_mask ? 0 : crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_AMOUNT_BLINDING_MASK, h); // y = Hs(domain_sep, Hs(8 * r * V, i))
-        amount_commitment = de.amount * blinded_asset_id + amount_blinding_mask * crypto::c_point_G;
-        out.amount_commitment = (crypto::c_scalar_1div8 * amount_commitment).to_public_key(); // E = 1/8 * e * T + 1/8 * y * G
-
-        out.mix_attr = tx_outs_attr; // TODO @#@# @CZ check this
-      }
+      if (de.addr.front().is_auditable())
+        zo.out.mix_attr = CURRENCY_TO_KEY_OUT_FORCED_NO_MIX; // override mix_attr to 1 for auditable target addresses
       else
-      {
-        // normal output
-        crypto::public_key derivation = (crypto::scalar_t(tx_sec_key) * crypto::point_t(apa.view_public_key)).modify_mul8().to_public_key(); // d = 8 * r * V
-        crypto::scalar_t h = 0;
-        crypto::derivation_to_scalar((const crypto::key_derivation&)derivation, output_index, h.as_secret_key()); // h = Hs(8 * r * V, i)
+        zo.out.mix_attr = tx_outs_attr;
 
-        out.stealth_address = (h * crypto::c_point_G + crypto::point_t(apa.spend_public_key)).to_public_key();
-        out.concealing_point = (crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_CONCEALING_POINT, h) * crypto::point_t(apa.view_public_key)).to_public_key(); // Q = 1/8 * Hs(domain_sep, Hs(8 * r * V, i) ) * 8 * V
-      
-        crypto::scalar_t amount_mask = crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_AMOUNT_MASK, h);
-        out.encrypted_amount = de.amount ^ amount_mask.m_u64[0];
-      
-        CHECK_AND_ASSERT_MES(~de.flags & tx_destination_entry_flags::tdef_explicit_native_asset_id || de.asset_id == currency::native_coin_asset_id, false, "explicit_native_asset_id may be used only with native asset id");
-        asset_blinding_mask = de.flags & tx_destination_entry_flags::tdef_explicit_native_asset_id ? 0 : crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_ASSET_BLINDING_MASK, h); // s = Hs(domain_sep, Hs(8 * r * V, i))
-        blinded_asset_id = crypto::point_t(de.asset_id) + asset_blinding_mask * crypto::c_point_X;
-        out.blinded_asset_id = (crypto::c_scalar_1div8 * blinded_asset_id).to_public_key(); // T = 1/8 * (H_asset + s * X)
-
-        amount_blinding_mask = crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_AMOUNT_BLINDING_MASK, h); // y = Hs(domain_sep, Hs(8 * r * V, i))
-        amount_commitment = de.amount * blinded_asset_id + amount_blinding_mask * crypto::c_point_G;
-        out.amount_commitment = (crypto::c_scalar_1div8 * amount_commitment).to_public_key(); // E = 1/8 * e * T + 1/8 * y * G
-
-        DBG_VAL_PRINT(output_index);
-        DBG_VAL_PRINT(de.amount);
-        DBG_VAL_PRINT(de.asset_id);
-        DBG_VAL_PRINT(amount_mask);
-        DBG_VAL_PRINT(asset_blinding_mask);
-        DBG_VAL_PRINT(blinded_asset_id);
-        DBG_VAL_PRINT(amount_blinding_mask);
-        DBG_VAL_PRINT(amount_mask);
-        DBG_VAL_PRINT(amount_commitment);
-        
-        if (de.addr.front().is_auditable())
-          out.mix_attr = CURRENCY_TO_KEY_OUT_FORCED_NO_MIX; // override mix_attr to 1 for auditable target addresses
-        else
-          out.mix_attr = tx_outs_attr;
+      zo.has_derivation_hint = true;
+      zo.derivation_hint = get_derivation_hint(reinterpret_cast<crypto::key_derivation&>(derivation));
+      zo.view_tag = get_output_view_tag(h);
+    }
+    return true;
+  }
+  //---------------------------------------------------------------
+  void put_zc_out_to_tx(const constructed_zc_out& zo, transaction& tx, std::set<uint16_t>& deriv_cache)
+  {
+    if (zo.has_derivation_hint)
+      deriv_cache.insert(zo.derivation_hint); // won't be inserted if such hint already exists
 
-        uint16_t hint = get_derivation_hint(reinterpret_cast<crypto::key_derivation&>(derivation));
-        deriv_cache.insert(hint); // won't be inserted if such hint already exists
-      }
+    tx.vout.push_back(zo.out);
 
-      tx.vout.push_back(out);
+    // view tags are put only if the caller has requested them by adding an empty extra_view_tags entry
+    extra_view_tags* pvt = get_type_in_variant_container<extra_view_tags>(tx.extra);
+    if (pvt)
+    {
+      pvt->tags.resize(tx.vout.size(), 0);
+      pvt->tags.back() = zo.view_tag;
+    }
+  }
+  //---------------------------------------------------------------
+  bool construct_tx_out(const tx_destination_entry& de, const crypto::secret_key& tx_sec_key, size_t output_index, transaction& tx, std::set<uint16_t>& deriv_cache,
+    const account_keys& self, crypto::scalar_t& asset_blinding_mask, crypto::scalar_t& amount_blinding_mask, crypto::point_t& blinded_asset_id, crypto::point_t& amount_commitment,
+    finalized_tx& result, uint8_t tx_outs_attr)
+  {
+    if (tx.version > TRANSACTION_VERSION_PRE_HF4)
+    {
+      // create tx_out_zarcanum
+      constructed_zc_out zo{};
+      bool r = construct_zc_out(de, tx_sec_key, output_index, tx_outs_attr, asset_blinding_mask, amount_blinding_mask, blinded_asset_id, amount_commitment, zo);
+      CHECK_AND_ASSERT_MES(r, false, "construct_zc_out failed");
+      put_zc_out_to_tx(zo, tx, deriv_cache);
     }
     else
     {
@@ -1401,7 +1498,7 @@ namespace currency
   {
     for (auto& ai : av)
     {
-      if (ai.type() == typeid(tx_service_attachment))
+      if (tools::is_variant_type<tx_service_attachment>(ai))
       {
         const tx_service_attachment& tsa = boost::get<tx_service_attachment>(ai);
         if (tsa.service_id == service_id && tsa.instruction == instruction)
@@ -1418,11 +1515,11 @@ namespace currency
       return;
 
     //put hash into extra
-    std::stringstream ss;
-    binary_archive<true> oar(ss);
+    std::string buff;
+    binary_memory_ostream os(buff);
+    binary_memory_archive<true> oar(os);
     if (!::do_serialize(oar, const_cast<std::vector<attachment_v>&>(attachment)))
       return;
-    std::string buff = ss.str();
     eai.sz = buff.size();
     eai.hsh = get_blob_hash(buff);
     eai.cnt = attachment.size();
@@ -1468,7 +1565,7 @@ namespace currency
       {
         images.push_back(ki);
       }
-      if (in.type() == typeid(txin_gen))
+      if (tools::is_variant_type<txin_gen>(in))
       {
         h = boost::get<txin_gen>(in).height;
         continue;
@@ -1884,7 +1981,7 @@ namespace currency
     {
       VARIANT_SWITCH_BEGIN(ov);
       VARIANT_CASE_CONST(tx_out_bare, o)
-        if (o.target.type() == typeid(txout_htlc))
+        if (tools::is_variant_type<txout_htlc>(o.target))
         {
           htlc_out = o;
           return GUI_TX_TYPE_HTLC_DEPOSIT;
@@ -1916,7 +2013,7 @@ namespace currency
     {
       VARIANT_SWITCH_BEGIN(outs[n]);
       VARIANT_CASE_CONST(tx_out_bare, o)
-        if (o.target.type() == typeid(txout_multisig))
+        if (tools::is_variant_type<txout_multisig>(o.target))
           break;
       VARIANT_CASE_CONST(tx_out_zarcanum, o)
         //@#@
@@ -1930,7 +2027,7 @@ namespace currency
     size_t n = 0;
     for (; n != inputs.size(); n++)
     {
-      if (inputs[n].type() == typeid(txin_multisig))
+      if (tools::is_variant_type<txin_multisig>(inputs[n]))
         break;
     }
     return n;
@@ -1940,7 +2037,7 @@ namespace currency
   {
     for(auto it = tx.extra.begin(); it != tx.extra.end(); ++it)
     {
-      if (it->type() == typeid(tx_derivation_hint))
+      if (tools::is_variant_type<tx_derivation_hint>(*it))
       {
         uint16_t hint = 0;
         if (!get_uint16_from_tx_derivation_hint(boost::get<tx_derivation_hint>(*it), hint))
@@ -2023,14 +2120,160 @@ namespace currency
     size_t real_out_index   = SIZE_MAX;                   // index of real output in local outputs vector
     std::vector<tx_source_entry::output_entry> outputs{}; // sorted by gindex
   };
+  // CLSAG_GGX of a ZC input, the costly part of its signature
+  // generate_ZC_sig() prepares it (all the shared state and the global PRNG are touched there, in inputs order), run_ZC_sig_clsag_jobs() runs them
+  struct zc_sig_clsag_job
+  {
+    crypto::hash hash_for_signature;
+    std::vector<crypto::CLSAG_GGX_input_ref_t> ring; // refers to in_context.outputs
+    crypto::point_t pseudo_out_amount_commitment;
+    crypto::point_t pseudo_out_blinded_asset_id;
+    crypto::key_image k_image;
+    crypto::scalar_t secret_0_xp;
+    crypto::scalar_t secret_1_f;
+    crypto::scalar_t secret_2_t;
+    uint64_t secret_index;
+    size_t signature_index;                           // in tx.signatures
+    crypto::hash prng_seed;                           // so the signature is the same whichever thread makes it
+  };
+  //--------------------------------------------------------------------------------
+  bool generate_ZC_sig_clsag(zc_sig_clsag_job& job, transaction& tx)
+  {
+    crypto::thread_prng_scope prng_scope(job.prng_seed);
+    ZC_sig& sig = boost::get<ZC_sig>(tx.signatures[job.signature_index]);
+    return crypto::generate_CLSAG_GGX(job.hash_for_signature, job.ring, job.pseudo_out_amount_commitment, job.pseudo_out_blinded_asset_id, job.k_image,
+      job.secret_0_xp, job.secret_1_f, job.secret_2_t, job.secret_index, sig.clsags_ggx);
+  }
+  //--------------------------------------------------------------------------------
+  utils::threads_pool& get_tx_signing_threads_pool()
+  {
+    return utils::get_compute_pool();
+  }
+  //--------------------------------------------------------------------------------
+  bool run_ZC_sig_clsag_jobs(std::vector<zc_sig_clsag_job>& jobs, transaction& tx)
+  {
+    if (jobs.size() < CURRENCY_TX_MIN_INPUTS_FOR_PARALLEL_SIGNING || std::thread::hardware_concurrency() < 2)
+    {
+      for (size_t i = 0; i != jobs.size(); ++i)
+        CHECK_AND_ASSERT_MES(generate_ZC_sig_clsag(jobs[i], tx), false, "generate_CLSAG_GGX failed for input #" << i);
+      return true;
+    }
+
+    // each job writes only to its own signature, tx.signatures is not resized until all of them are done
+    std::vector<uint8_t> results(jobs.size(), 0);
+    utils::threads_pool::jobs_container pool_jobs;
+    for (size_t i = 0; i != jobs.size(); ++i)
+    {
+      utils::threads_pool::add_job_to_container(pool_jobs, [&jobs, &tx, &results, i]()
+      {
+        try
+        {
+          results[i] = generate_ZC_sig_clsag(jobs[i], tx) ? 1 : 0;
+        }
+        catch (const std::exception& e)
+        {
+          LOG_ERROR("generate_CLSAG_GGX failed for input #" << i << ": " << e.what());
+        }
+        catch (...)
+        {
+          LOG_ERROR("generate_CLSAG_GGX failed for input #" << i << ": unknown exception");
+        }
+      });
+    }
+    get_tx_signing_threads_pool().add_batch_and_wait(pool_jobs);
+
+    for (size_t i = 0; i != results.size(); ++i)
+      CHECK_AND_ASSERT_MES(results[i] != 0, false, "generate_CLSAG_GGX failed for input #" << i);
+    return true;
+  }
+  //--------------------------------------------------------------------------------
+  // runs job(0), ..., job(count - 1) on the tx signing threads pool, or in place if there are less than min_count_for_parallel of them
+  // a job returns false (or throws) on failure
+  template<typename t_job>
+  bool run_tx_construction_jobs(size_t count, size_t min_count_for_parallel, t_job job, const char* what)
+  {
+    if (count < min_count_for_parallel || std::thread::hardware_concurrency() < 2)
+    {
+      for (size_t i = 0; i != count; ++i)
+        CHECK_AND_ASSERT_MES(job(i), false, what << " failed, job #" << i);
+      return true;
+    }
+
+    std::vector<uint8_t> results(count, 0);
+    utils::threads_pool::jobs_container pool_jobs;
+    for (size_t i = 0; i != count; ++i)
+    {
+      utils::threads_pool::add_job_to_container(pool_jobs, [&job, &results, what, i]()
+      {
+        try
+        {
+          results[i] = job(i) ? 1 : 0;
+        }
+        catch (const std::exception& e)
+        {
+          LOG_ERROR(what << " failed, job #" << i << ": " << e.what());
+        }
+        catch (...)
+        {
+          LOG_ERROR(what << " failed, job #" << i << ": unknown exception");
+        }
+      });
+    }
+    get_tx_signing_threads_pool().add_batch_and_wait(pool_jobs);
+
+    for (size_t i = 0; i != results.size(); ++i)
+      CHECK_AND_ASSERT_MES(results[i] != 0, false, what << " failed, job #" << i);
+    return true;
+  }
+  //--------------------------------------------------------------------------------
+  // the outputs for dsts, starting from #first_output_index, their blinding masks and commitments are put to gen_context (which is sized already)
+  // an output depends only on its destination and index, so each one writes to its own elements only and they're made in parallel
+  bool construct_zc_outs(const std::vector<tx_destination_entry>& dsts, const crypto::secret_key& tx_sec_key, size_t first_output_index, uint8_t tx_outs_attr,
+    tx_generation_context& gen_context, std::vector<constructed_zc_out>& zc_outs)
+  {
+    CHECK_AND_ASSERT_MES(first_output_index + dsts.size() <= gen_context.amount_commitments.size(), false, "gen_context has not been sized for " << first_output_index + dsts.size() << " outputs");
+    zc_outs.assign(dsts.size(), constructed_zc_out{});
+    return run_tx_construction_jobs(dsts.size(), CURRENCY_TX_MIN_OUTPUTS_FOR_PARALLEL_CONSTRUCTION, [&](size_t i)
+    {
+      const size_t output_index = first_output_index + i;
+      return construct_zc_out(dsts[i], tx_sec_key, output_index, tx_outs_attr,
+        gen_context.asset_id_blinding_masks[output_index], gen_context.amount_blinding_masks[output_index],
+        gen_context.blinded_asset_ids[output_index], gen_context.amount_commitments[output_index], zc_outs[i]);
+    }, "construct_zc_out");
+  }
+  //--------------------------------------------------------------------------------
+  // the same as generate_asset_surjection_proof() and generate_zc_outs_range_proof() together, but the aggregated range proof and the outputs' BGE proofs
+  // are made at the same time (the range proof is started first, it's the longest one); each of them runs under its own PRNG, seeded in order,
+  // so the proofs are the same whether they are made in parallel or not
+  bool generate_zc_outs_proofs(const crypto::hash& context_hash, bool has_non_zc_inputs, size_t out_index_start, tx_generation_context& ogc,
+    const std::vector<tx_out_v>& vouts, zc_asset_surjection_proof& asp, zc_outs_range_proof& range_proofs)
+  {
+    std::vector<asset_surjection_bge_job> asp_jobs;
+    bool r = prepare_asset_surjection_proof_jobs(has_non_zc_inputs, ogc, asp_jobs);
+    CHECK_AND_ASSERT_MES(r, false, "prepare_asset_surjection_proof_jobs failed");
+    crypto::hash range_proof_prng_seed{};
+    crypto::generate_random_bytes(sizeof range_proof_prng_seed, &range_proof_prng_seed);
+
+    asp.bge_proofs.resize(asp_jobs.size());
+    return run_tx_construction_jobs(asp_jobs.size() + 1, CURRENCY_TX_MIN_OUTPUTS_FOR_PARALLEL_CONSTRUCTION, [&](size_t i)
+    {
+      if (i == 0)
+      {
+        crypto::thread_prng_scope prng_scope(range_proof_prng_seed);
+        return generate_zc_outs_range_proof(context_hash, out_index_start, ogc, vouts, range_proofs);
+      }
+      return generate_asset_surjection_bge_proof(context_hash, asp_jobs[i - 1], i - 1, asp.bge_proofs[i - 1]);
+    }, "generate_zc_outs_proofs");
+  }
   //--------------------------------------------------------------------------------
   bool generate_ZC_sig(const crypto::hash& tx_hash_for_signature, size_t input_index, const tx_source_entry& se, const input_generation_context_data& in_context,
-    const account_keys& sender_account_keys, const uint64_t tx_flags, tx_generation_context& ogc, transaction& tx, bool last_output, bool separately_signed_tx_complete)
+    const account_keys& sender_account_keys, const uint64_t tx_flags, tx_generation_context& ogc, transaction& tx, bool last_output, bool separately_signed_tx_complete,
+    std::vector<zc_sig_clsag_job>& clsag_jobs)
   {
     bool watch_only_mode = sender_account_keys.spend_secret_key == null_skey;
     CHECK_AND_ASSERT_MES(se.is_zc(), false, "sources contains a non-zc input");
     CHECK_AND_ASSERT_MES(input_index < tx.vin.size(), false, "input_index (" << input_index << ") is out-of-bounds, vin.size = " << tx.vin.size());
-    CHECK_AND_ASSERT_MES(tx.vin[input_index].type() == typeid(txin_zc_input), false, "Unexpected type of input #" << input_index);
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<txin_zc_input>(tx.vin[input_index]), false, "Unexpected type of input #" << input_index);
 
     txin_zc_input& in = boost::get<txin_zc_input>(tx.vin[input_index]);
     tx.signatures.emplace_back(ZC_sig());
@@ -2103,13 +2346,21 @@ namespace currency
     // layer 2 secret (with respect to X)
     //     -pseudo_out_asset_id_blinding_mask;
 
-    std::vector<crypto::CLSAG_GGX_input_ref_t> ring;
+    clsag_jobs.emplace_back();
+    zc_sig_clsag_job& job = clsag_jobs.back();
+    job.hash_for_signature = tx_hash_for_signature;
     for(size_t j = 0; j < in_context.outputs.size(); ++j)
-      ring.emplace_back(in_context.outputs[j].stealth_address, in_context.outputs[j].amount_commitment, in_context.outputs[j].blinded_asset_id);
-
-    return crypto::generate_CLSAG_GGX(tx_hash_for_signature, ring, pseudo_out_amount_commitment, pseudo_out_blinded_asset_id, in.k_image, in_context.in_ephemeral.sec,
-      se.real_out_amount_blinding_mask - pseudo_out_amount_blinding_mask,
-      -pseudo_out_asset_id_blinding_mask, in_context.real_out_index, sig.clsags_ggx);
+      job.ring.emplace_back(in_context.outputs[j].stealth_address, in_context.outputs[j].amount_commitment, in_context.outputs[j].blinded_asset_id);
+    job.pseudo_out_amount_commitment = pseudo_out_amount_commitment;
+    job.pseudo_out_blinded_asset_id = pseudo_out_blinded_asset_id;
+    job.k_image = in.k_image;
+    job.secret_0_xp = in_context.in_ephemeral.sec;
+    job.secret_1_f = se.real_out_amount_blinding_mask - pseudo_out_amount_blinding_mask;
+    job.secret_2_t = -pseudo_out_asset_id_blinding_mask;
+    job.secret_index = in_context.real_out_index;
+    job.signature_index = tx.signatures.size() - 1;
+    crypto::generate_random_bytes(sizeof job.prng_seed, &job.prng_seed);
+    return true;
   }
   //--------------------------------------------------------------------------------
   bool generate_NLSAG_sig(const crypto::hash& tx_hash_for_signature, const crypto::hash& tx_prefix_hash, size_t input_index, const tx_source_entry& src_entr,
@@ -2474,7 +2725,8 @@ namespace currency
           "real_output index (" << in_context.real_out_index << ") greater than or equal to in_context.outputs.size()=" << in_context.outputs.size());
 
         crypto::key_image img;
-        if (!generate_key_image_helper(sender_account_keys, src_entr.real_out_tx_key, src_entr.real_output_in_tx_index, in_context.in_ephemeral, img))
+        const account_keys& src_account_keys = src_entr.deposit_index == 0 ? sender_account_keys : get_deposit_account_keys(sender_account_keys, src_entr.deposit_index);
+        if (!generate_key_image_helper(src_account_keys, src_entr.real_out_tx_key, src_entr.real_output_in_tx_index, in_context.in_ephemeral, img))
           return false;
 
         //check that derivated key is equal with real output key
@@ -2579,7 +2831,7 @@ namespace currency
 
       for (const auto& in : tx.vin)
       {
-        if (in.type() == typeid(txin_zc_input))
+        if (tools::is_variant_type<txin_zc_input>(in))
         {
           zc_inputs_count++;
         }
@@ -2622,16 +2874,33 @@ namespace currency
     uint64_t range_proof_start_index = 0;
     std::set<uint16_t> existing_derivation_hints, new_derivation_hints;
     CHECK_AND_ASSERT_MES(copy_all_derivation_hints_from_tx_to_container(tx, existing_derivation_hints), false, "move_all_derivation_hints_from_tx_to_container failed");
-    for(size_t destination_index = 0; destination_index < shuffled_dsts.size(); ++destination_index, ++output_index)
+    // outputs appended by another party would change the already signed view tags entry
+    CHECK_AND_ASSERT_MES(!(flags & TX_FLAG_SIGNATURE_MODE_SEPARATE) || count_type_in_variant_container<extra_view_tags>(tx.extra) == 0, false, "extra_view_tags is not allowed in tx with TX_FLAG_SIGNATURE_MODE_SEPARATE");
+    for (tx_destination_entry& dst_entr : shuffled_dsts)
     {
-      tx_destination_entry& dst_entr = shuffled_dsts[destination_index];
       if (!(flags & TX_FLAG_SIGNATURE_MODE_SEPARATE) && all_inputs_are_obviously_native_coins && gen_context.ao_asset_id == currency::null_pkey)
         dst_entr.flags |= tx_destination_entry_flags::tdef_explicit_native_asset_id; // all inputs are obviously native coins -- all outputs must have explicit asset ids (unless there's an asset emission)
-
-      r = construct_tx_out(dst_entr, gen_context.tx_key.sec, output_index, tx, new_derivation_hints, sender_account_keys,
-        gen_context.asset_id_blinding_masks[output_index], gen_context.amount_blinding_masks[output_index],
-        gen_context.blinded_asset_ids[output_index], gen_context.amount_commitments[output_index], result, tx_outs_attr);
-      CHECK_AND_ASSERT_MES(r, false, "Failed to construct tx out");
+    }
+    std::vector<constructed_zc_out> zc_outs;
+    if (tx.version > TRANSACTION_VERSION_PRE_HF4)
+    {
+      r = construct_zc_outs(shuffled_dsts, gen_context.tx_key.sec, output_index, tx_outs_attr, gen_context, zc_outs);
+      CHECK_AND_ASSERT_MES(r, false, "Failed to construct tx outs");
+    }
+    for(size_t destination_index = 0; destination_index < shuffled_dsts.size(); ++destination_index, ++output_index)
+    {
+      const tx_destination_entry& dst_entr = shuffled_dsts[destination_index];
+      if (tx.version > TRANSACTION_VERSION_PRE_HF4)
+      {
+        put_zc_out_to_tx(zc_outs[destination_index], tx, new_derivation_hints); // in order, as the view tags and the outputs follow each other
+      }
+      else
+      {
+        r = construct_tx_out(dst_entr, gen_context.tx_key.sec, output_index, tx, new_derivation_hints, sender_account_keys,
+          gen_context.asset_id_blinding_masks[output_index], gen_context.amount_blinding_masks[output_index],
+          gen_context.blinded_asset_ids[output_index], gen_context.amount_commitments[output_index], result, tx_outs_attr);
+        CHECK_AND_ASSERT_MES(r, false, "Failed to construct tx out");
+      }
       gen_context.amounts[output_index] = dst_entr.amount;
       gen_context.asset_ids[output_index] = crypto::point_t(dst_entr.asset_id);
       gen_context.asset_id_blinding_mask_x_amount_sum += gen_context.asset_id_blinding_masks[output_index] * dst_entr.amount;
@@ -2647,7 +2916,7 @@ namespace currency
     uint64_t att_count = 0;
     for (auto& o : tx.attachment)
     {
-      if (o.type() == typeid(tx_service_attachment))
+      if (tools::is_variant_type<tx_service_attachment>(o))
       {
         tx_service_attachment& tsa = boost::get<tx_service_attachment>(o);
         if (tsa.security.size())
@@ -2720,6 +2989,7 @@ namespace currency
     r = false;
     bool separately_signed_tx_complete = !sources.empty() ? sources.back().separately_signed_tx_complete : false;
     size_t zc_input_index = 0;
+    std::vector<zc_sig_clsag_job> zc_sig_clsag_jobs;
     for (size_t i_ = 0; i_ != sources.size(); i_++)
     {
       size_t i_mapped = inputs_mapping[i_];
@@ -2731,7 +3001,7 @@ namespace currency
       if (source_entry.is_zc())
       {
         // ZC
-        r = generate_ZC_sig(tx_hash_for_signature, i_ + input_starter_index, source_entry, in_contexts[i_mapped], sender_account_keys, flags, gen_context, tx, i_ + 1 == sources.size(), separately_signed_tx_complete);
+        r = generate_ZC_sig(tx_hash_for_signature, i_ + input_starter_index, source_entry, in_contexts[i_mapped], sender_account_keys, flags, gen_context, tx, i_ + 1 == sources.size(), separately_signed_tx_complete, zc_sig_clsag_jobs);
         CHECK_AND_ASSERT_MES(r, false, "generate_ZC_sigs failed");
         gen_context.zc_input_amounts[zc_input_index] = source_entry.amount;
         zc_input_index++;
@@ -2745,6 +3015,8 @@ namespace currency
 
       LOG_PRINT2("construct_tx.log", "transaction_created: " << get_transaction_hash(tx) << ENDL << obj_to_json_str(tx) << ENDL << ss_ring_s.str(), LOG_LEVEL_3);
     }
+    r = run_ZC_sig_clsag_jobs(zc_sig_clsag_jobs, tx);
+    CHECK_AND_ASSERT_MES(r, false, "generate_ZC_sigs failed");
 
     //
     // proofs (transaction-wise, not pre-input)
@@ -2752,16 +3024,12 @@ namespace currency
     if (tx.version > TRANSACTION_VERSION_PRE_HF4 &&
       (append_mode || (flags & TX_FLAG_SIGNATURE_MODE_SEPARATE) == 0))
     {
-      // asset surjection proof
+      // asset surjection proof and range proofs
       currency::zc_asset_surjection_proof asp{};
-      bool r = generate_asset_surjection_proof(tx_prefix_hash, has_non_zc_inputs, gen_context, asp);
-      CHECK_AND_ASSERT_MES(r, false, "generete_asset_surjection_proof failed");
-      tx.proofs.emplace_back(std::move(asp));
-
-      // range proofs
       currency::zc_outs_range_proof range_proofs{};
-      r = generate_zc_outs_range_proof(tx_prefix_hash, range_proof_start_index, gen_context, tx.vout, range_proofs);
-      CHECK_AND_ASSERT_MES(r, false, "Failed to generate zc_outs_range_proof()");
+      bool r = generate_zc_outs_proofs(tx_prefix_hash, has_non_zc_inputs, range_proof_start_index, gen_context, tx.vout, asp, range_proofs);
+      CHECK_AND_ASSERT_MES(r, false, "generate_zc_outs_proofs failed");
+      tx.proofs.emplace_back(std::move(asp));
       tx.proofs.emplace_back(std::move(range_proofs));
 
       // balance proof
@@ -2827,11 +3095,11 @@ namespace currency
     uint64_t income = 0;
     for (auto& in : tx.vin)
     {
-      if (in.type() == typeid(txin_gen))
+      if (tools::is_variant_type<txin_gen>(in))
       {
         continue;
       }
-      else if (in.type() == typeid(txin_to_key))
+      else if (tools::is_variant_type<txin_to_key>(in))
       {
         income += boost::get<txin_to_key>(in).amount;
       }
@@ -2897,7 +3165,7 @@ namespace currency
 
 
     auto cb = [&](const std::string& name, const epee::serialization::storage_entry& entry) {
-      if (entry.type() == typeid(uint64_t))
+      if (tools::is_variant_type<uint64_t>(entry))
       {
         bool vote = boost::get<uint64_t>(entry) ? true : false;
         votes.push_back(std::make_pair(epee::string_encoding::toupper(name), vote));
@@ -2917,7 +3185,7 @@ namespace currency
       *p_is_input_fully_signed = false;
 
     LOC_CHK(ms_input_index < tx.vin.size(), "ms input index is out of bounds, vin.size() = " << tx.vin.size());
-    LOC_CHK(tx.vin[ms_input_index].type() == typeid(txin_multisig), "ms input has wrong type, txin_multisig expected");
+    LOC_CHK(tools::is_variant_type<txin_multisig>(tx.vin[ms_input_index]), "ms input has wrong type, txin_multisig expected");
     const txin_multisig& ms_in = boost::get<txin_multisig>(tx.vin[ms_input_index]);
 
     // search ms output in source tx by ms_in.multisig_out_id
@@ -2926,7 +3194,7 @@ namespace currency
     {
       VARIANT_SWITCH_BEGIN(source_tx.vout[i]);
       VARIANT_CASE_CONST(tx_out_bare, o)
-        if (o.target.type() == typeid(txout_multisig) && ms_in.multisig_out_id == get_multisig_out_id(source_tx, i))
+        if (tools::is_variant_type<txout_multisig>(o.target) && ms_in.multisig_out_id == get_multisig_out_id(source_tx, i))
         {
           ms_out_index = i;
           break;
@@ -2946,7 +3214,7 @@ namespace currency
     LOC_CHK(participant_index < out_ms.keys.size(), "Can't find given participant's ms key in ms output keys list");
     LOC_CHK(ms_input_index <  tx.signatures.size(), "transaction does not have signatures vector entry for ms input #" << ms_input_index);
     
-    LOC_CHK(tx.signatures[ms_input_index].type() == typeid(NLSAG_sig), "Wrong type of signature");
+    LOC_CHK(tools::is_variant_type<NLSAG_sig>(tx.signatures[ms_input_index]), "Wrong type of signature");
     auto& sigs = boost::get<NLSAG_sig>(tx.signatures[ms_input_index]).s;
     LOC_CHK(!sigs.empty(), "empty signatures container");
 
@@ -3015,10 +3283,10 @@ namespace currency
     for(const auto& in : tx.vin)
     {
       CHECK_AND_ASSERT_MES(
-        in.type() == typeid(txin_to_key) ||
-        in.type() == typeid(txin_multisig) ||
-        in.type() == typeid(txin_htlc) ||
-        in.type() == typeid(txin_zc_input), 
+        tools::is_variant_type<txin_to_key>(in) ||
+        tools::is_variant_type<txin_multisig>(in) ||
+        tools::is_variant_type<txin_htlc>(in) ||
+        tools::is_variant_type<txin_zc_input>(in), 
         false, "wrong input type: " << in.type().name() << ", in transaction " << get_transaction_hash(tx));
     }
     return true;
@@ -3038,7 +3306,7 @@ namespace currency
 
     for (auto& ex : tx.extra)
     {
-      if (ex.type() == typeid(extra_padding))
+      if (tools::is_variant_type<extra_padding>(ex))
       {
         boost::get<extra_padding>(ex).buff.insert(boost::get<extra_padding>(ex).buff.end(), count, 0);
         return true;
@@ -3056,7 +3324,7 @@ namespace currency
 
     for (auto ex : tx.extra)
     {
-      if (ex.type() == typeid(extra_padding))
+      if (tools::is_variant_type<extra_padding>(ex))
       {
         std::vector<uint8_t>& buff = boost::get<extra_padding>(ex).buff;
         CHECK_AND_ASSERT_MES(buff.size() >= count, false, "Attempt to remove_padding_from_tx for count = " << count << ", while buff.size()=" << buff.size());
@@ -3136,22 +3404,22 @@ namespace currency
     for(const auto& in : tx.vin)
     {
       uint64_t this_amount = 0;
-      if (in.type() == typeid(txin_to_key))
+      if (tools::is_variant_type<txin_to_key>(in))
       {
         CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, tokey_in, false);
         this_amount = tokey_in.amount;
       }
-      else if (in.type() == typeid(txin_multisig))
+      else if (tools::is_variant_type<txin_multisig>(in))
       {
         CHECKED_GET_SPECIFIC_VARIANT(in, const txin_multisig, ms_in, false);
         this_amount = ms_in.amount;
       }
-      else if (in.type() == typeid(txin_htlc))
+      else if (tools::is_variant_type<txin_htlc>(in))
       {
         CHECKED_GET_SPECIFIC_VARIANT(in, const txin_htlc, htlc_in, false);
         this_amount = htlc_in.amount;
       }
-      else if (in.type() == typeid(txin_zc_input))
+      else if (tools::is_variant_type<txin_zc_input>(in))
       {
         // ignore inputs with hidden amounts
       }
@@ -3304,6 +3572,88 @@ namespace currency
     return true;
   } 
   //---------------------------------------------------------------
+  // S' = P - Hs(8 * r * V, i) * G, is either the account's spend key or one of its deposit addresses' ones
+  bool get_out_deposit_index(const account_public_address& addr, const deposit_spend_keys_map& deposit_spend_keys, const crypto::public_key& out_key, const crypto::scalar_t& h, uint32_t& deposit_index)
+  {
+    crypto::point_t P;
+    if (!P.from_public_key(out_key))
+      return false;
+    crypto::public_key spend_pub_key = (P - h * crypto::c_point_G).to_public_key();
+    if (spend_pub_key == addr.spend_public_key)
+    {
+      deposit_index = 0;
+      return true;
+    }
+    auto it = deposit_spend_keys.find(spend_pub_key);
+    if (it == deposit_spend_keys.end())
+      return false;
+    deposit_index = it->second;
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool is_out_to_acc(const account_public_address& addr, const deposit_spend_keys_map& deposit_spend_keys, const txout_to_key& out_key, const crypto::key_derivation& derivation, size_t output_index, uint32_t& deposit_index)
+  {
+    crypto::scalar_t h{};
+    crypto::derivation_to_scalar(derivation, output_index, h.as_secret_key()); // h = Hs(8 * r * V, i)
+    return get_out_deposit_index(addr, deposit_spend_keys, out_key.key, h, deposit_index);
+  }
+  //---------------------------------------------------------------
+  bool is_out_to_acc(const account_public_address& addr, const deposit_spend_keys_map& deposit_spend_keys, const tx_out_zarcanum& zo, const crypto::key_derivation& derivation, size_t output_index, uint64_t& decoded_amount, crypto::public_key& decoded_asset_id,
+    crypto::scalar_t& amount_blinding_mask, crypto::scalar_t& asset_id_blinding_mask, uint32_t& deposit_index)
+  {
+    crypto::scalar_t h{};
+    if (!decode_output_amount_and_asset_id(zo, derivation, output_index, decoded_amount, decoded_asset_id, amount_blinding_mask, asset_id_blinding_mask, &h))
+      return false;
+
+    if (!get_out_deposit_index(addr, deposit_spend_keys, zo.stealth_address, h, deposit_index))
+      return false;
+
+    // deposit addresses have the same view key
+    crypto::point_t Q_prime = crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_CONCEALING_POINT, h) * crypto::point_t(addr.view_public_key).modify_mul8(); // Q' * 8 =? Hs(domain_sep, Hs(8 * r * V, i) ) * 8 * V
+    if (Q_prime != crypto::point_t(zo.concealing_point).modify_mul8())
+      return false;
+
+    return true;
+  }
+  //---------------------------------------------------------------
+  crypto::scalar_t get_deposit_address_key_offset(const account_keys& acc, uint32_t deposit_index)
+  {
+    std::string hashing_buff(CRYPTO_HDS_DEPOSIT_ADDRESS, sizeof(CRYPTO_HDS_DEPOSIT_ADDRESS));
+    epee::string_tools::append_pod_to_strbuff(hashing_buff, acc.view_secret_key);
+    epee::string_tools::append_pod_to_strbuff(hashing_buff, static_cast<uint64_t>(deposit_index));
+    return crypto::hash_helper_t::hs(hashing_buff.data(), hashing_buff.size()); // m = Hs(domain_sep, v, i)
+  }
+  //---------------------------------------------------------------
+  account_public_address get_deposit_address(const account_keys& acc, uint32_t deposit_index)
+  {
+    return get_deposit_account_keys(acc, deposit_index).account_address;
+  }
+  //---------------------------------------------------------------
+  account_keys get_deposit_account_keys(const account_keys& acc, uint32_t deposit_index)
+  {
+    account_keys keys = acc;
+    if (deposit_index == 0)
+      return keys;
+
+    crypto::scalar_t m = get_deposit_address_key_offset(acc, deposit_index);
+    keys.account_address.spend_public_key = (crypto::point_t(acc.account_address.spend_public_key) + m * crypto::c_point_G).to_public_key(); // S_i = S + m * G
+    if (acc.spend_secret_key != null_skey)
+      keys.spend_secret_key = (crypto::scalar_t(acc.spend_secret_key) + m).as_secret_key();                                              // s_i = s + m
+    return keys;
+  }
+  //---------------------------------------------------------------
+  uint8_t get_output_view_tag(const crypto::scalar_t& h)
+  {
+    return static_cast<uint8_t>(crypto::hash_helper_t::hs(CRYPTO_HDS_OUT_VIEW_TAG, h).m_u64[0] & 0xff); // Hs(domain_sep, Hs(8 * r * V, i)), the lowest byte
+  }
+  //---------------------------------------------------------------
+  uint8_t get_output_view_tag(const crypto::key_derivation& derivation, size_t output_index)
+  {
+    crypto::scalar_t h{};
+    crypto::derivation_to_scalar(derivation, output_index, h.as_secret_key()); // h = Hs(8 * r * V, i)
+    return get_output_view_tag(h);
+  }
+  //---------------------------------------------------------------
   bool lookup_acc_outs(const account_keys& acc, const transaction& tx, std::vector<wallet_out_info>& outs, crypto::key_derivation& derivation)
   {
     crypto::public_key tx_pub_key = get_tx_pub_key_from_extra(tx);
@@ -3319,7 +3669,7 @@ namespace currency
     tx_derivation_hint dh = make_tx_derivation_hint_from_uint16(hint);
     for (auto& e : tx.extra)
     {
-      if (e.type() == typeid(tx_derivation_hint))
+      if (tools::is_variant_type<tx_derivation_hint>(e))
       {
         const tx_derivation_hint& tdh = boost::get<tx_derivation_hint>(e);
         if (tdh.msg.size() == sizeof(uint16_t))
@@ -3337,7 +3687,7 @@ namespace currency
     return false;
   }
   //---------------------------------------------------------------
-  bool lookup_acc_outs_genesis(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, std::vector<wallet_out_info>& outs, crypto::key_derivation& derivation)
+  bool lookup_acc_outs_genesis(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, std::vector<wallet_out_info>& outs, const crypto::key_derivation& derivation)
   {
     uint64_t offset = 0;
     bool r = get_account_genesis_offset_by_address(get_account_address_as_str(acc.account_address), offset);
@@ -3346,10 +3696,10 @@ namespace currency
 
     CHECK_AND_ASSERT_MES(offset < tx.vout.size(), false, "condition failed: offset(" << offset << ") < tx.vout.size() (" << tx.vout.size() << ")");
     auto& ov = tx.vout[offset];
-    CHECK_AND_ASSERT_MES(ov.type() == typeid(tx_out_bare), false, "unexpected type id in lookup_acc_outs_genesis:" << ov.type().name());
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<tx_out_bare>(ov), false, "unexpected type id in lookup_acc_outs_genesis:" << ov.type().name());
     const tx_out_bare& o = boost::get<tx_out_bare>(ov);
 
-    CHECK_AND_ASSERT_MES(o.target.type() == typeid(txout_to_key), false, "condition failed: o.target.type() == typeid(txout_to_key)");
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<txout_to_key>(o.target), false, "condition failed: tools::is_variant_type<txout_to_key>(o.target)");
     if (is_out_to_acc(acc.account_address, boost::get<txout_to_key>(o.target), derivation, offset))
     {
       outs.emplace_back(offset, o.amount);
@@ -3363,11 +3713,15 @@ namespace currency
     return lookup_acc_outs(acc, tx, tx_pub_key, outs, derivation, htlc_info_list);
   }
   //---------------------------------------------------------------
-  bool lookup_acc_outs(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, std::vector<wallet_out_info>& outs, crypto::key_derivation& derivation, std::list<htlc_info>& htlc_info_list)
+  bool lookup_acc_outs(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, std::vector<wallet_out_info>& outs, crypto::key_derivation& derivation, std::list<htlc_info>& htlc_info_list, const deposit_spend_keys_map* pdeposit_spend_keys /* = nullptr */)
   {
     bool r = generate_key_derivation(tx_pub_key, acc.view_secret_key, derivation);
     CHECK_AND_ASSERT_MES(r, false, "unable to generate derivation from tx_pub = " << tx_pub_key << " * view_sec, invalid tx_pub?");
-
+    return lookup_acc_outs_by_derivation(acc, tx, tx_pub_key, derivation, outs, htlc_info_list, pdeposit_spend_keys);
+  }
+  //---------------------------------------------------------------
+  bool lookup_acc_outs_by_derivation(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, const crypto::key_derivation& derivation, std::vector<wallet_out_info>& outs, std::list<htlc_info>& htlc_info_list, const deposit_spend_keys_map* pdeposit_spend_keys /* = nullptr */)
+  {
     if (is_coinbase(tx) && get_block_height(tx) == 0 &&  tx_pub_key == ggenesis_tx_pub_key)
     {
       //genesis coinbase
@@ -3377,6 +3731,14 @@ namespace currency
     if (!check_tx_derivation_hint(tx, derivation))
       return true;
 
+    // view tags are used only if present for all the outputs
+    const extra_view_tags* pvt = get_type_in_variant_container<const extra_view_tags>(tx.extra);
+    if (pvt && pvt->tags.size() != tx.vout.size())
+      pvt = nullptr;
+
+    if (pdeposit_spend_keys && pdeposit_spend_keys->empty())
+      pdeposit_spend_keys = nullptr;
+
     size_t output_index = 0;
     for(const auto& ov : tx.vout)
     {
@@ -3385,9 +3747,11 @@ namespace currency
       {
         VARIANT_SWITCH_BEGIN(o.target);
         VARIANT_CASE_CONST(txout_to_key, t)
-          if (is_out_to_acc(acc.account_address, t, derivation, output_index))
+          uint32_t deposit_index = 0;
+          if (pdeposit_spend_keys ? is_out_to_acc(acc.account_address, *pdeposit_spend_keys, t, derivation, output_index, deposit_index) : is_out_to_acc(acc.account_address, t, derivation, output_index))
           {
             outs.emplace_back(output_index, o.amount);
+            outs.back().deposit_index = deposit_index;
           }
         VARIANT_CASE_CONST(txout_multisig, t)
           if (is_out_to_acc(acc.account_address, t, derivation, output_index))
@@ -3423,11 +3787,15 @@ namespace currency
         uint64_t amount = 0;
         crypto::public_key asset_id{};
         crypto::scalar_t amount_blinding_mask = 0, asset_id_blinding_mask = 0;
-        if (is_out_to_acc(acc.account_address, zo, derivation, output_index, amount, asset_id, amount_blinding_mask, asset_id_blinding_mask))
+        uint32_t deposit_index = 0;
+        if ((!pvt || pvt->tags[output_index] == get_output_view_tag(derivation, output_index)) &&
+          (pdeposit_spend_keys ? is_out_to_acc(acc.account_address, *pdeposit_spend_keys, zo, derivation, output_index, amount, asset_id, amount_blinding_mask, asset_id_blinding_mask, deposit_index) :
+            is_out_to_acc(acc.account_address, zo, derivation, output_index, amount, asset_id, amount_blinding_mask, asset_id_blinding_mask)))
         {
           crypto::point_t asset_id_pt = crypto::point_t(zo.blinded_asset_id).modify_mul8() - asset_id_blinding_mask * crypto::c_point_X;
           crypto::public_key asset_id = asset_id_pt.to_public_key();
           outs.emplace_back(output_index, amount, amount_blinding_mask, asset_id_blinding_mask, asset_id);
+          outs.back().deposit_index = deposit_index;
         }
       }
       VARIANT_SWITCH_END();
@@ -3528,7 +3896,25 @@ namespace currency
       {
         CHECK_AND_ASSERT_MES(bl_entry.tx_global_outs.size() == bl_entry.txs.size(), false, "tx_global_outs count " << bl_entry.tx_global_outs.size() << " count missmatch with bl_entry.txs count " << bl_entry.txs.size());
       }
-      if (bl_entry.coinbase_global_outs.size())
+      // compact form: the outputs of the coinbase go first, then the outputs of each tx
+      auto global_outs_it = bl_entry.global_outs.begin();
+      auto take_global_outs = [&](size_t count, std::vector<uint64_t>& target) -> bool
+      {
+        if (static_cast<size_t>(bl_entry.global_outs.end() - global_outs_it) < count)
+          return false;
+        target.assign(global_outs_it, global_outs_it + count);
+        global_outs_it += count;
+        return true;
+      };
+
+      if (bl_entry.global_outs.size())
+      {
+        std::shared_ptr<currency::transaction_chain_entry> tche_ptr(new currency::transaction_chain_entry());
+        r = take_global_outs(blextin_ptr->bl.miner_tx.vout.size(), tche_ptr->m_global_output_indexes);
+        CHECK_AND_ASSERT_MES(r, false, "global_outs count " << bl_entry.global_outs.size() << " is less than coinbase outputs count " << blextin_ptr->bl.miner_tx.vout.size());
+        bdde.coinbase_ptr = tche_ptr;
+      }
+      else if (bl_entry.coinbase_global_outs.size())
       {
         std::shared_ptr<currency::transaction_chain_entry> tche_ptr(new currency::transaction_chain_entry());
         tche_ptr->m_global_output_indexes = bl_entry.coinbase_global_outs;
@@ -3540,13 +3926,19 @@ namespace currency
         r = parse_and_validate_tx_from_blob(tx_blob, tche_ptr->tx);
         CHECK_AND_ASSERT_MES(r, false, "failed to parse tx from blob: " << string_tools::buff_to_hex_nodelimer(tx_blob));
         bdde.txs_ptr.push_back(tche_ptr);
-        if (bl_entry.tx_global_outs.size())
+        if (bl_entry.global_outs.size())
+        {
+          r = take_global_outs(tche_ptr->tx.vout.size(), tche_ptr->m_global_output_indexes);
+          CHECK_AND_ASSERT_MES(r, false, "global_outs count " << bl_entry.global_outs.size() << " is less than outputs count of the block's txs");
+        }
+        else if (bl_entry.tx_global_outs.size())
         {
           CHECK_AND_ASSERT_MES(bl_entry.tx_global_outs[i].v.size() == tche_ptr->tx.vout.size(), false, "tx_global_outs for tx" << bl_entry.tx_global_outs[i].v.size() << " count missmatch with tche_ptr->tx.vout.size() count " << tche_ptr->tx.vout.size());
           tche_ptr->m_global_output_indexes = bl_entry.tx_global_outs[i].v;
         }
         i++;
       }
+      CHECK_AND_ASSERT_MES(global_outs_it == bl_entry.global_outs.end(), false, "global_outs count " << bl_entry.global_outs.size() << " is more than outputs count of the block");
     }
     return true;
   }
@@ -3842,7 +4234,7 @@ namespace currency
     std::vector<txout_ref_v> res = off;
     for (size_t i = 1; i < res.size(); i++)
     {
-      if (res[i].type() == typeid(ref_by_id))
+      if (tools::is_variant_type<ref_by_id>(res[i]))
         break;
       boost::get<uint64_t>(res[i]) += boost::get<uint64_t>(res[i - 1]);
     }
@@ -3856,7 +4248,7 @@ namespace currency
       return true;
 
     size_t i = offsets.size() - 1;
-    while (i != 0 && offsets[i].type() == typeid(ref_by_id))
+    while (i != 0 && tools::is_variant_type<ref_by_id>(offsets[i]))
       --i;
 
     try
@@ -3880,7 +4272,10 @@ namespace currency
   //---------------------------------------------------------------
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b)
   {
-    return parse_and_validate_object_from_blob(b_blob, b);
+    if (!parse_and_validate_object_from_blob(b_blob, b))
+      return false;
+    fill_block_hash_memo(b);
+    return true;
   }
 
   //---------------------------------------------------------------
@@ -3903,7 +4298,7 @@ namespace currency
   {
     for (const auto& e : tx.vin)
     {
-      if (e.type() != typeid(txin_to_key) || e.type() != typeid(txin_multisig) || e.type() != typeid(txin_htlc))
+      if (!tools::is_variant_type<txin_to_key>(e) || !tools::is_variant_type<txin_multisig>(e) || !tools::is_variant_type<txin_htlc>(e))
         return false;
       if (boost::get<txin_to_key>(e).key_offsets.size() < 2)
         return false;
@@ -3921,7 +4316,7 @@ namespace currency
       {
         VARIANT_SWITCH_BEGIN(out);
         VARIANT_CASE_CONST(tx_out_bare, out)
-          if (out.target.type() != typeid(txout_to_key))
+          if (!tools::is_variant_type<txout_to_key>(out.target))
             continue;
         const txout_to_key& o = boost::get<txout_to_key>(out.target);
         if (o.key == null_pkey)
@@ -3959,7 +4354,7 @@ namespace currency
     size_t cnt = 0;
     for (const auto& at : tx.attachment)
     {
-      if (at.type() == typeid(tx_service_attachment))
+      if (tools::is_variant_type<tx_service_attachment>(at))
         ++cnt;
     }
     return cnt;
@@ -4017,11 +4412,11 @@ namespace currency
     {
       tei.ins.push_back(tx_in_rpc_entry());
       tx_in_rpc_entry& entry_to_fill = tei.ins.back();
-      if (in.type() == typeid(txin_gen))
+      if (tools::is_variant_type<txin_gen>(in))
       {
         entry_to_fill.amount = 0;
       }
-      else if (in.type() == typeid(txin_to_key) || in.type() == typeid(txin_htlc) || in.type() == typeid(txin_zc_input))
+      else if (tools::is_variant_type<txin_to_key>(in) || tools::is_variant_type<txin_htlc>(in) || tools::is_variant_type<txin_zc_input>(in))
       {
         //TODO: add htlc info
         entry_to_fill.amount = get_amount_from_variant(in);
@@ -4031,29 +4426,29 @@ namespace currency
         for (auto& ao : absolute_offsets)
         {
           entry_to_fill.global_indexes.push_back(0);
-          if (ao.type() == typeid(uint64_t))
+          if (tools::is_variant_type<uint64_t>(ao))
           {
             entry_to_fill.global_indexes.back() = boost::get<uint64_t>(ao);
           }
-          else// if (ao.type() == typeid(ref_by_id))
+          else// if (tools::is_variant_type<ref_by_id>(ao))
           {
             //disable for the reset at the moment 
             entry_to_fill.global_indexes.back() = std::numeric_limits<uint64_t>::max();
           }
         }
-        if (in.type() == typeid(txin_htlc))
+        if (tools::is_variant_type<txin_htlc>(in))
         {
           entry_to_fill.htlc_origin = epee::string_tools::buff_to_hex_nodelimer(boost::get<txin_htlc>(in).hltc_origin);
         }
         //tk.etc_details -> visualize it may be later
       }
-      else if (in.type() == typeid(txin_multisig))
+      else if (tools::is_variant_type<txin_multisig>(in))
       {
         txin_multisig& tms = boost::get<txin_multisig>(in);
         entry_to_fill.amount = tms.amount;
         entry_to_fill.kimage_or_ms_id = epee::string_tools::pod_to_hex(tms.multisig_out_id);
         if (tx.signatures.size() >= tei.ins.size() &&
-          tx.signatures[tei.ins.size() - 1].type() == typeid(NLSAG_sig))
+          tools::is_variant_type<NLSAG_sig>(tx.signatures[tei.ins.size() - 1]))
         {
           entry_to_fill.multisig_count = boost::get<NLSAG_sig>(tx.signatures[tei.ins.size() - 1]).s.size();
         }
@@ -4098,7 +4493,7 @@ namespace currency
     {
       VARIANT_SWITCH_BEGIN(tx.vout[n]);
       VARIANT_CASE_CONST(tx_out_bare, o)
-        if (o.target.type() == typeid(txout_to_key) || o.target.type() == typeid(txout_htlc))
+        if (tools::is_variant_type<txout_to_key>(o.target) || tools::is_variant_type<txout_htlc>(o.target))
         {
           uint64_t amount = o.amount;
           gindices[amount] += 1;
@@ -4126,9 +4521,9 @@ namespace currency
   bool is_pos_miner_tx(const transaction& tx)
   {
     if (tx.vin.size() == 2 &&
-      tx.vin[0].type() == typeid(txin_gen) &&
-      (tx.vin[1].type() == typeid(txin_to_key) ||
-       tx.vin[1].type() == typeid(txin_zc_input)))
+      tools::is_variant_type<txin_gen>(tx.vin[0]) &&
+      (tools::is_variant_type<txin_to_key>(tx.vin[1]) ||
+       tools::is_variant_type<txin_zc_input>(tx.vin[1])))
       return true;
     return false;
   }
@@ -4203,7 +4598,7 @@ namespace currency
     if (!tx.vin.size() || tx.vin.size() > 2)
       return false;
 
-    if (tx.vin[0].type() != typeid(txin_gen))
+    if (!tools::is_variant_type<txin_gen>(tx.vin[0]))
       return false;
 
     return true;
@@ -27,6 +27,7 @@
 #include "blockchain_storage_basic.h"
 #include "currency_format_utils_blocks.h"
 #include "currency_format_utils_transactions.h"
+#include "tx_semantic_validation.h"
 #include "core_runtime_config.h"
 #include "wallet/wallet_public_structs_defs.h"
 #include "bc_attachments_helpers.h"
@@ -217,6 +218,9 @@ namespace currency
     END_SERIALIZE()
   };
 
+  // derived spend public key -> deposit address index, see get_deposit_address()
+  typedef std::unordered_map<crypto::public_key, uint32_t> deposit_spend_keys_map;
+
   struct wallet_out_info
   {
     wallet_out_info() = default;
@@ -237,6 +241,7 @@ namespace currency
     crypto::scalar_t  amount_blinding_mask = 0;
     crypto::scalar_t  asset_id_blinding_mask = 0;
     crypto::public_key asset_id = currency::native_coin_asset_id; // use point_t instead as this is for internal use only?
+    uint32_t          deposit_index = 0;                          // the deposit address the output is targeted to, 0 stands for the account's own address
 
     bool is_native_coin() const { return asset_id == currency::native_coin_asset_id; }
   };
@@ -275,6 +280,8 @@ namespace currency
     const std::vector<tx_out_v>& vouts, zc_outs_range_proof& result);
   bool check_tx_bare_balance(const transaction& tx, uint64_t additional_inputs_amount_and_fees_for_mining_tx = 0);
   bool check_tx_balance(const transaction& tx, const crypto::hash& tx_id, uint64_t additional_inputs_amount_and_fees_for_mining_tx = 0);
+  // the same for a tx that has passed validate_tx_semantic(), with what it has found
+  bool check_tx_balance(const transaction& tx, const crypto::hash& tx_id, const tx_semantic_context& tsc);
   bool validate_asset_operation_amount_commitment(asset_op_verification_context& context);
   
   const char* get_asset_operation_type_string(size_t asset_operation_type, bool short_name = false);
@@ -363,9 +370,21 @@ namespace currency
   bool is_out_to_acc(const account_public_address& addr, const txout_to_key& out_key, const crypto::key_derivation& derivation, size_t output_index);
   bool is_out_to_acc(const account_public_address& addr, const txout_multisig& out_multisig, const crypto::key_derivation& derivation, size_t output_index);
   bool is_out_to_acc(const account_public_address& addr, const tx_out_zarcanum& zo, const crypto::key_derivation& derivation, size_t output_index, uint64_t& decoded_amount, crypto::public_key& decoded_asset_id, crypto::scalar_t& amount_blinding_mask, crypto::scalar_t& asset_id_blinding_mask);
+  // the same for the account's address and its deposit addresses, deposit_index is set to 0 for the account's address
+  bool is_out_to_acc(const account_public_address& addr, const deposit_spend_keys_map& deposit_spend_keys, const txout_to_key& out_key, const crypto::key_derivation& derivation, size_t output_index, uint32_t& deposit_index);
+  bool is_out_to_acc(const account_public_address& addr, const deposit_spend_keys_map& deposit_spend_keys, const tx_out_zarcanum& zo, const crypto::key_derivation& derivation, size_t output_index, uint64_t& decoded_amount, crypto::public_key& decoded_asset_id, crypto::scalar_t& amount_blinding_mask, crypto::scalar_t& asset_id_blinding_mask, uint32_t& deposit_index);
+  uint8_t get_output_view_tag(const crypto::scalar_t& h);
+  uint8_t get_output_view_tag(const crypto::key_derivation& derivation, size_t output_index);
   bool lookup_acc_outs(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, std::vector<wallet_out_info>& outs, crypto::key_derivation& derivation);
-  bool lookup_acc_outs(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, std::vector<wallet_out_info>& outs, crypto::key_derivation& derivation, std::list<htlc_info>& htlc_info_list);
+  // if pdeposit_spend_keys is given, outputs to the account's deposit addresses are looked up as well, at the same cost per output regardless of their number
+  bool lookup_acc_outs(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, std::vector<wallet_out_info>& outs, crypto::key_derivation& derivation, std::list<htlc_info>& htlc_info_list, const deposit_spend_keys_map* pdeposit_spend_keys = nullptr);
   bool lookup_acc_outs(const account_keys& acc, const transaction& tx, std::vector<wallet_out_info>& outs, crypto::key_derivation& derivation);
+  // the same, with the derivation precomputed by the caller (e.g. by crypto::generate_key_derivations() for many txs at once)
+  bool lookup_acc_outs_by_derivation(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, const crypto::key_derivation& derivation, std::vector<wallet_out_info>& outs, std::list<htlc_info>& htlc_info_list, const deposit_spend_keys_map* pdeposit_spend_keys = nullptr);
+  // deposit addresses: many receiving addresses of an account sharing its view key, S_i = S + Hs(domain_sep, v, i) * G, i > 0
+  // senders treat them as usual addresses, the account finds outputs to them with one view key scan
+  account_public_address get_deposit_address(const account_keys& acc, uint32_t deposit_index);
+  account_keys get_deposit_account_keys(const account_keys& acc, uint32_t deposit_index); // spend secret key is null for watch-only accounts
   bool get_tx_fee(const transaction& tx, uint64_t & fee);
   uint64_t get_tx_fee(const transaction& tx);
   bool derive_ephemeral_key_helper(const account_keys& ack, const crypto::public_key& tx_public_key, size_t real_output_index, keypair& in_ephemeral);
@@ -474,13 +493,13 @@ namespace currency
   {
     static typename std::conditional<std::is_const<t_txin_v>::value, const std::vector<txin_etc_details_v>, std::vector<txin_etc_details_v> >::type stub;
 
-    if (in.type() == typeid(txin_to_key))
+    if (tools::is_variant_type<txin_to_key>(in))
       return boost::get<txin_to_key>(in).etc_details;
-    else if (in.type() == typeid(txin_multisig))
+    else if (tools::is_variant_type<txin_multisig>(in))
       return boost::get<txin_multisig>(in).etc_details;
-    else if (in.type() == typeid(txin_htlc))
+    else if (tools::is_variant_type<txin_htlc>(in))
       return boost::get<txin_htlc>(in).etc_details;
-    else if (in.type() == typeid(txin_zc_input))
+    else if (tools::is_variant_type<txin_zc_input>(in))
       return boost::get<txin_zc_input>(in).etc_details;
     else
        return stub;
@@ -672,7 +691,7 @@ namespace currency
   {
     for (auto& ev : container)
     {
-      if (ev.type() == typeid(add_type_t))
+      if (tools::is_variant_type<add_type_t>(ev))
         return boost::get<add_type_t>(ev);
     }
     container.push_back(add_type_t());
@@ -684,7 +703,7 @@ namespace currency
   {
 //     for (auto& ev : extra)
 //     {
-//       if (ev.type() == typeid(extra_t))
+//       if (tools::is_variant_type<extra_t>(ev))
 //         return boost::get<extra_t>(ev);
 //     }
 //     extra.push_back(extra_t());
@@ -857,13 +876,13 @@ namespace currency
   typename std::conditional<std::is_const<txin_t>::value, const std::vector<txin_etc_details_v>, std::vector<txin_etc_details_v> >::type*
     get_input_etc_details(txin_t& in)
   {
-    if (in.type() == typeid(txin_to_key))
+    if (tools::is_variant_type<txin_to_key>(in))
       return &boost::get<txin_to_key>(in).etc_details;
-    if (in.type() == typeid(txin_multisig))
+    if (tools::is_variant_type<txin_multisig>(in))
       return &boost::get<txin_multisig>(in).etc_details;
-    if (in.type() == typeid(txin_htlc))
+    if (tools::is_variant_type<txin_htlc>(in))
       return &boost::get<txin_htlc>(in).etc_details;
-    if (in.type() == typeid(txin_zc_input))
+    if (tools::is_variant_type<txin_zc_input>(in))
       return &boost::get<txin_zc_input>(in).etc_details;
     return nullptr;
   }
@@ -1187,6 +1206,14 @@ namespace currency
       tv.details_view = tv.short_view;
       return true;
     }
+    bool operator()(const extra_view_tags& vt)
+    {
+      tv.type = "view_tags";
+      tv.short_view = std::to_string(vt.tags.size()) + " tags";
+      if (!vt.tags.empty())
+        tv.details_view = epee::string_tools::buff_to_hex_nodelimer(std::string(reinterpret_cast<const char*>(&vt.tags[0]), vt.tags.size()));
+      return true;
+    }
     bool operator()(const zc_outs_range_proof& rp)
     {
       tv.type = "zc_outs_range_proof";
@@ -19,6 +19,7 @@
 #include "currency_core/currency_basic.h"
 #include "currency_protocol/blobdatatype.h"
 #include "common/crypto_stream_operators.h"
+#include "common/variant_helper.h"
 
 namespace currency
 {
@@ -73,7 +74,7 @@ namespace currency
   {
     for (auto& ai : av)
     {
-      if (ai.type() == typeid(specific_type_t))
+      if (tools::is_variant_type<specific_type_t>(ai))
       {
         return true;
       }
@@ -87,7 +88,7 @@ namespace currency
     size_t result = 0;
     for (auto& ai : av)
     {
-      if (ai.type() == typeid(specific_type_t))
+      if (tools::is_variant_type<specific_type_t>(ai))
         ++result;
     }
     return result;
@@ -98,7 +99,7 @@ namespace currency
   {
     for (auto& ai : av)
     {
-      if (ai.type() == typeid(specific_type_t))
+      if (tools::is_variant_type<specific_type_t>(ai))
       {
         return &boost::get<specific_type_t>(ai);
       }
@@ -124,7 +125,7 @@ namespace currency
   {
     for (auto& ai : av)
     {
-      if (ai.type() == typeid(specific_type_t))
+      if (tools::is_variant_type<specific_type_t>(ai))
       {
         return boost::get<specific_type_t>(ai);
       }
@@ -139,7 +140,7 @@ namespace currency
     bool found = false;
     for (auto& ai : av)
     {
-      if (ai.type() == typeid(specific_type_t))
+      if (tools::is_variant_type<specific_type_t>(ai))
       {
         found = true;
         if (!cb(boost::get<specific_type_t>(ai)))
@@ -158,7 +159,7 @@ namespace currency
     bool found = false;
     for (auto& ai : av)
     {
-      if (ai.type() == typeid(specific_type_t))
+      if (tools::is_variant_type<specific_type_t>(ai))
       {
         if (found)
           return false; // already have it, type in not unique
@@ -179,13 +180,13 @@ namespace currency
     bool found = false;
     for (auto& item : container)
     {
-      if (item.type() == typeid(A))
+      if (tools::is_variant_type<A>(item))
       {
         found = true;
         if (!cb(boost::get<A>(item)))
           break;
       }
-      else if (item.type() == typeid(B))
+      else if (tools::is_variant_type<B>(item))
       {
         found = true;
         if (!cb(boost::get<B>(item)))
@@ -200,19 +201,19 @@ namespace currency
   {
     try
     {
-      if (in_v.type() == typeid(txin_to_key))
+      if (tools::is_variant_type<txin_to_key>(in_v))
       {
         result = boost::get<txin_to_key>(in_v).k_image;
         return true;
       }
     
-      if (in_v.type() == typeid(txin_htlc))
+      if (tools::is_variant_type<txin_htlc>(in_v))
       {
         result = boost::get<txin_htlc>(in_v).k_image;
         return true;
       }
 
-      if (in_v.type() == typeid(txin_zc_input))
+      if (tools::is_variant_type<txin_zc_input>(in_v))
       {
         result = boost::get<txin_zc_input>(in_v).k_image;
         return true;
@@ -229,13 +230,13 @@ namespace currency
   inline
   const crypto::key_image& get_key_image_from_txin_v(const txin_v& in_v)
   {
-    if (in_v.type() == typeid(txin_to_key))
+    if (tools::is_variant_type<txin_to_key>(in_v))
       return boost::get<txin_to_key>(in_v).k_image;
     
-    if (in_v.type() == typeid(txin_htlc))
+    if (tools::is_variant_type<txin_htlc>(in_v))
       return boost::get<txin_htlc>(in_v).k_image;
 
-    if (in_v.type() == typeid(txin_zc_input))
+    if (tools::is_variant_type<txin_zc_input>(in_v))
       return boost::get<txin_zc_input>(in_v).k_image;
 
     CHECK_AND_ASSERT_THROW_MES(false, "[get_key_image_from_txin_v] Wrong type: " << in_v.type().name());
@@ -244,13 +245,13 @@ namespace currency
   inline
   const std::vector<currency::txout_ref_v>& get_key_offsets_from_txin_v(const txin_v& in_v)
   {
-    if (in_v.type() == typeid(txin_to_key))
+    if (tools::is_variant_type<txin_to_key>(in_v))
       return boost::get<txin_to_key>(in_v).key_offsets;
     
-    if (in_v.type() == typeid(txin_htlc))
+    if (tools::is_variant_type<txin_htlc>(in_v))
       return boost::get<txin_htlc>(in_v).key_offsets;
 
-    if (in_v.type() == typeid(txin_zc_input))
+    if (tools::is_variant_type<txin_zc_input>(in_v))
       return boost::get<txin_zc_input>(in_v).key_offsets;
 
     CHECK_AND_ASSERT_THROW_MES(false, "[get_key_offsets_from_txin_v] Wrong type: " << in_v.type().name());
@@ -261,17 +262,17 @@ namespace currency
   {
     try
     {
-      if (out_v.type() == typeid(tx_out_bare))
+      if (tools::is_variant_type<tx_out_bare>(out_v))
       {
         const tx_out_bare& ob = boost::get<tx_out_bare>(out_v);
-        if (ob.target.type() == typeid(txout_to_key))
+        if (tools::is_variant_type<txout_to_key>(ob.target))
         {
           result = boost::get<txout_to_key>(ob.target).mix_attr;
           return true;
         }
       }
     
-      if (out_v.type() == typeid(tx_out_zarcanum))
+      if (tools::is_variant_type<tx_out_zarcanum>(out_v))
       {
         result = boost::get<tx_out_zarcanum>(out_v).mix_attr;
         return true;
@@ -402,10 +403,24 @@ namespace currency
     return h;
   }
 
+  //---------------------------------------------------------------
+  // per-thread buffer for the blobs that are only hashed or measured, it keeps its capacity between the calls
+  // (only the leaf helpers below may use it, as the contents are overwritten by the next call)
+  inline
+    blobdata& get_thread_scratch_blob()
+  {
+    static thread_local blobdata scratch;
+    if (scratch.capacity() > CURRENCY_SCRATCH_BLOB_MAX_CAPACITY)
+      blobdata().swap(scratch);
+    return scratch;
+  }
+  //---------------------------------------------------------------
   template<class t_object>
   bool get_object_hash(const t_object& o, crypto::hash& res)
   {
-    get_blob_hash(t_serializable_object_to_blob(o), res);
+    blobdata& bl = get_thread_scratch_blob();
+    t_serializable_object_to_blob(o, bl);
+    get_blob_hash(bl, res);
     return true;
   }
   //---------------------------------------------------------------
@@ -421,14 +436,16 @@ namespace currency
   template<class t_object>
   size_t get_object_blobsize(const t_object& o)
   {
-    blobdata b = t_serializable_object_to_blob(o);
+    blobdata& b = get_thread_scratch_blob();
+    t_serializable_object_to_blob(o, b);
     return b.size();
   }
   //---------------------------------------------------------------
   template<class t_object>
   bool get_object_hash(const t_object& o, crypto::hash& res, uint64_t& blob_size)
   {
-    blobdata bl = t_serializable_object_to_blob(o);
+    blobdata& bl = get_thread_scratch_blob();
+    t_serializable_object_to_blob(o, bl);
     blob_size = bl.size();
     get_blob_hash(bl, res);
     return true;
@@ -472,7 +489,7 @@ namespace currency
 
 
 #define CHECKED_GET_SPECIFIC_VARIANT(variant_var, specific_type, variable_name, fail_return_val) \
-  CHECK_AND_ASSERT_MES(variant_var.type() == typeid(specific_type), fail_return_val, "wrong variant type: " << variant_var.type().name() << ", expected " << typeid(specific_type).name()); \
+  CHECK_AND_ASSERT_MES(tools::is_variant_type<specific_type>(variant_var), fail_return_val, "wrong variant type: " << variant_var.type().name() << ", expected " << typeid(specific_type).name()); \
   specific_type& variable_name = boost::get<specific_type>(variant_var);
 
 } // namespace currency
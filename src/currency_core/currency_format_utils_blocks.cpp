@@ -14,18 +14,50 @@ namespace currency
   //---------------------------------------------------------------
   blobdata get_block_hashing_blob(const block& b)
   {
-    blobdata blob = t_serializable_object_to_blob(static_cast<block_header>(b));
+    blobdata blob = t_serializable_object_to_blob(static_cast<const block_header&>(b));
     crypto::hash tree_root_hash = get_tx_tree_hash(b);
     blob.append((const char*)&tree_root_hash, sizeof(tree_root_hash));
     blob.append(tools::get_varint_data(b.tx_hashes.size() + 1));
     return blob;
   }
   //---------------------------------------------------------------
+  blobdata get_block_hashing_blob(const block& b, crypto::tree_hash_cache& tree_cache)
+  {
+    blobdata blob = t_serializable_object_to_blob(static_cast<const block_header&>(b));
+    crypto::hash tree_root_hash = get_tx_tree_hash(b, tree_cache);
+    blob.append((const char*)&tree_root_hash, sizeof(tree_root_hash));
+    blob.append(tools::get_varint_data(b.tx_hashes.size() + 1));
+    return blob;
+  }
+  //---------------------------------------------------------------
+  static bool is_block_hash_memo_valid(const block& b)
+  {
+    const block_header& h = b.hash_memo.header;
+    return b.hash_memo.valid && b.miner_tx.hash_memo.valid && b.hash_memo.tx_hashes_count == b.tx_hashes.size() &&
+      h.major_version == b.major_version && h.minor_version == b.minor_version && h.timestamp == b.timestamp &&
+      h.prev_id == b.prev_id && h.nonce == b.nonce && h.flags == b.flags;
+  }
+  //---------------------------------------------------------------
   bool get_block_hash(const block& b, crypto::hash& res)
   {
+    if (is_block_hash_memo_valid(b))
+    {
+      res = b.hash_memo.id;
+      return true;
+    }
     return get_object_hash(get_block_hashing_blob(b), res);
   }
   //---------------------------------------------------------------
+  void fill_block_hash_memo(block& b)
+  {
+    b.invalidate_hashes();
+    fill_transaction_hash_memo(b.miner_tx);
+    get_object_hash(get_block_hashing_blob(b), b.hash_memo.id);
+    b.hash_memo.header = b;
+    b.hash_memo.tx_hashes_count = b.tx_hashes.size();
+    b.hash_memo.valid = true;
+  }
+  //---------------------------------------------------------------
   crypto::hash get_block_hash(const block& b)
   {
     crypto::hash p = null_hash;
@@ -65,4 +97,13 @@ namespace currency
       txs_ids.push_back(th);
     return get_tx_tree_hash(txs_ids);
   }
+  //---------------------------------------------------------------
+  crypto::hash get_tx_tree_hash(const block& b, crypto::tree_hash_cache& tree_cache)
+  {
+    std::vector<crypto::hash> txs_ids;
+    txs_ids.reserve(b.tx_hashes.size() + 1);
+    txs_ids.push_back(get_transaction_hash(b.miner_tx));
+    txs_ids.insert(txs_ids.end(), b.tx_hashes.begin(), b.tx_hashes.end());
+    return tree_cache.calc(txs_ids);
+  }
 }
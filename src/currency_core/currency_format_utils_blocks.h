@@ -7,19 +7,23 @@
 
 #include "include_base_utils.h"
 #include "crypto/crypto.h"
+#include "crypto/tree_hash_cache.h"
 #include "currency_core/currency_basic.h"
 #include "currency_protocol/blobdatatype.h"
 
 namespace currency
 {
   blobdata get_block_hashing_blob(const block& b);
+  blobdata get_block_hashing_blob(const block& b, crypto::tree_hash_cache& tree_cache); // for the templates rebuilt often
   bool get_block_hash(const block& b, crypto::hash& res);
   crypto::hash get_block_hash(const block& b);
+  void fill_block_hash_memo(block& b); // for a block just deserialized, see block::hash_memo
   
   blobdata block_to_blob(const block& b);
   bool block_to_blob(const block& b, blobdata& b_blob);
   void get_tx_tree_hash(const std::vector<crypto::hash>& tx_hashes, crypto::hash& h);
   crypto::hash get_tx_tree_hash(const std::vector<crypto::hash>& tx_hashes);
   crypto::hash get_tx_tree_hash(const block& b);
+  crypto::hash get_tx_tree_hash(const block& b, crypto::tree_hash_cache& tree_cache);
 
 }
@@ -42,7 +42,7 @@ namespace currency
     {
       VARIANT_SWITCH_BEGIN(o);
       VARIANT_CASE_CONST(tx_out_bare, o)
-        if (o.target.type() == typeid(txout_to_key))
+        if (tools::is_variant_type<txout_to_key>(o.target))
         {
           if (boost::get<txout_to_key>(o.target).key == null_pkey)
             res += o.amount;
@@ -139,11 +139,7 @@ namespace currency
   //---------------------------------------------------------------
   void get_transaction_prefix_hash(const transaction_prefix& tx, crypto::hash& h)
   {
-    std::ostringstream s;
-    binary_archive<true> a(s);
-    ::serialization::serialize(a, const_cast<transaction_prefix&>(tx));
-    std::string data = s.str();
-    crypto::cn_fast_hash(data.data(), data.size(), h);
+    get_object_hash(tx, h);
   }
   //---------------------------------------------------------------
   crypto::hash get_transaction_prefix_hash(const transaction_prefix& tx)
@@ -153,37 +149,78 @@ namespace currency
     return h;
   }
   //---------------------------------------------------------------
+  void get_transactions_prefix_hashes(const transaction* txs, size_t count, crypto::hash* hashes)
+  {
+    std::vector<std::string> blobs(count);
+    std::vector<const void*> data(count);
+    std::vector<size_t> lengths(count);
+    for (size_t i = 0; i != count; ++i)
+    {
+      t_serializable_object_to_blob(static_cast<const transaction_prefix&>(txs[i]), blobs[i]);
+      data[i] = blobs[i].data();
+      lengths[i] = blobs[i].size();
+    }
+    crypto::cn_fast_hash_batch(data.data(), lengths.data(), count, reinterpret_cast<char*>(hashes));
+  }
+  //---------------------------------------------------------------
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx)
   {
-    std::stringstream ss;
-    ss << tx_blob;
-    binary_archive<false> ba(ss);
-    bool r = ::serialization::serialize(ba, tx);
-    CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
-    return true;
+    crypto::hash tx_hash_stub = null_hash;
+    return parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash_stub);
   }
   //---------------------------------------------------------------
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash)
   {
-    std::stringstream ss;
-    ss << tx_blob;
-    binary_archive<false> ba(ss);
+    binary_memory_istream is(tx_blob.data(), tx_blob.size());
+    binary_memory_archive<false> ba(is);
     bool r = ::serialization::serialize(ba, tx);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
     //TODO: validate tx
 
-    //crypto::cn_fast_hash(tx_blob.data(), tx_blob.size(), tx_hash);
-    get_transaction_prefix_hash(tx, tx_hash);
+    // the prefix is serialized again rather than hashed right from the blob, so the id doesn't depend on the encoding details of the blob
+    fill_transaction_hash_memo(tx);
+    tx_hash = tx.hash_memo.prefix_hash;
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool parse_tx_prefix_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash)
+  {
+    // attachments, signatures and proofs follow the prefix in the blob, they're not read at all;
+    // the id and get_object_blobsize() depend on the prefix only
+    tx.attachment.clear();
+    tx.signatures.clear();
+    tx.proofs.clear();
+    binary_memory_istream is(tx_blob.data(), tx_blob.size());
+    binary_memory_archive<false> ba(is);
+    bool r = ::serialization::serialize(ba, static_cast<transaction_prefix&>(tx));
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction prefix from blob");
+
+    fill_transaction_hash_memo(tx);
+    tx_hash = tx.hash_memo.prefix_hash;
     return true;
   }
   //---------------------------------------------------------------
+  void fill_transaction_hash_memo(transaction& tx)
+  {
+    tx.invalidate_hashes();
+    get_object_hash(static_cast<const transaction_prefix&>(tx), tx.hash_memo.prefix_hash, tx.hash_memo.prefix_blob_size);
+    tx.hash_memo.valid = true;
+  }
+  //---------------------------------------------------------------
   crypto::hash get_transaction_hash(const transaction& t)
   {
+    if (t.hash_memo.valid)
+      return t.hash_memo.prefix_hash;
     return get_transaction_prefix_hash(t);
   }
   //---------------------------------------------------------------
   bool get_transaction_hash(const transaction& t, crypto::hash& res)
   {
+    if (t.hash_memo.valid)
+    {
+      res = t.hash_memo.prefix_hash;
+      return true;
+    }
     uint64_t blob_size = 0;
     return get_object_hash(static_cast<const transaction_prefix&>(t), res, blob_size);
   }
@@ -191,14 +228,23 @@ namespace currency
   bool get_transaction_hash(const transaction& t, crypto::hash& res, uint64_t& blob_size)
   {
     blob_size = 0;
-    bool r = get_object_hash(static_cast<const transaction_prefix&>(t), res, blob_size);
+    bool r = true;
+    if (t.hash_memo.valid)
+    {
+      res = t.hash_memo.prefix_hash;
+      blob_size = t.hash_memo.prefix_blob_size;
+    }
+    else
+    {
+      r = get_object_hash(static_cast<const transaction_prefix&>(t), res, blob_size);
+    }
     blob_size = get_object_blobsize(t, blob_size);
     return r;
   }
   //---------------------------------------------------------------
   size_t get_object_blobsize(const transaction& t)
   {
-    size_t tx_blob_size = get_object_blobsize(static_cast<const transaction_prefix&>(t));
+    size_t tx_blob_size = t.hash_memo.valid ? t.hash_memo.prefix_blob_size : get_object_blobsize(static_cast<const transaction_prefix&>(t));
     return get_object_blobsize(t, tx_blob_size);
   }
   //---------------------------------------------------------------
@@ -293,7 +339,7 @@ namespace currency
     std::unordered_set<crypto::key_image> ki;
     for(const auto& in : tx.vin)
     {
-      if (in.type() == typeid(txin_to_key) || in.type() == typeid(txin_htlc) || in.type() == typeid(txin_zc_input))
+      if (tools::is_variant_type<txin_to_key>(in) || tools::is_variant_type<txin_htlc>(in) || tools::is_variant_type<txin_zc_input>(in))
       {
          
         if (!ki.insert(get_key_image_from_txin_v(in)).second)
@@ -355,19 +401,19 @@ namespace currency
 
     std::sort(result.begin(), result.end(), [](const tx_source_entry::output_entry& lhs, const tx_source_entry::output_entry& rhs)
     {
-      if (lhs.out_reference.type() == typeid(uint64_t))
+      if (tools::is_variant_type<uint64_t>(lhs.out_reference))
       {
-        if (rhs.out_reference.type() == typeid(uint64_t))
+        if (tools::is_variant_type<uint64_t>(rhs.out_reference))
           return boost::get<uint64_t>(lhs.out_reference) < boost::get<uint64_t>(rhs.out_reference);
-        if (rhs.out_reference.type() == typeid(ref_by_id))
+        if (tools::is_variant_type<ref_by_id>(rhs.out_reference))
           return true;
         CHECK_AND_ASSERT_THROW_MES(false, "unexpected type in out_reference 1: " << rhs.out_reference.type().name());
       }
-      else if (lhs.out_reference.type() == typeid(ref_by_id))
+      else if (tools::is_variant_type<ref_by_id>(lhs.out_reference))
       {
-        if (rhs.out_reference.type() == typeid(uint64_t))
+        if (tools::is_variant_type<uint64_t>(rhs.out_reference))
           return false;
-        if (rhs.out_reference.type() == typeid(ref_by_id))
+        if (tools::is_variant_type<ref_by_id>(rhs.out_reference))
           return false; // don't change the order of ref_by_id elements
         CHECK_AND_ASSERT_THROW_MES(false, "unexpected type in out_reference 2: " << rhs.out_reference.type().name());
       }
@@ -385,7 +431,7 @@ namespace currency
 
     // find the last uint64_t entry - skip ref_by_id entries goint from the end to the beginnning
     size_t i = result.size() - 1;
-    while (i != 0 && result[i].out_reference.type() == typeid(ref_by_id))
+    while (i != 0 && tools::is_variant_type<ref_by_id>(result[i].out_reference))
       --i;
 
     for (; i != 0; i--)
@@ -459,7 +505,7 @@ namespace currency
     for(size_t input_index = 0, zc_input_index = 0; input_index < tx.vin.size(); ++input_index)
     {
       const txin_v& in_v = tx.vin[input_index];
-      if (in_v.type() == typeid(txin_zc_input))
+      if (tools::is_variant_type<txin_zc_input>(in_v))
       {
         CHECK_AND_ASSERT_EQ(tx.signatures[input_index].type(), typeid(ZC_sig));
         const ZC_sig& sig = boost::get<ZC_sig>(tx.signatures[input_index]);
@@ -477,7 +523,7 @@ namespace currency
         pseudo_out_amount_commitments_sum += sig_pseudo_out_amount_commitment;
         ++zc_input_index;
       }
-      else if (in_v.type() == typeid(txin_to_key))
+      else if (tools::is_variant_type<txin_to_key>(in_v))
       {
         // do nothing
       }
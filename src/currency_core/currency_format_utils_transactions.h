@@ -10,6 +10,7 @@
 #include "currency_core/currency_basic.h"
 #include "currency_protocol/blobdatatype.h"
 #include "currency_core/account.h"
+#include "common/variant_helper.h"
 
 
 namespace currency
@@ -58,6 +59,7 @@ namespace currency
     bool separately_signed_tx_complete = false;               //for separately signed tx only: denotes the last source entry in complete tx to explicitly mark the final step of tx creation
     std::string htlc_origin;                                  //for htlc, specify origin
     crypto::public_key asset_id = currency::native_coin_asset_id; //asset id (not blinded, not premultiplied by 1/8) TODO @#@# consider changing to crypto::point_t
+    uint32_t deposit_index = 0;                               //if the real output was received to a deposit address of the sender's account: its index, see get_deposit_address() (not serialized)
 
     bool is_multisig() const    { return ms_sigs_count > 0; }
     bool is_zc() const          { return !real_out_amount_blinding_mask.is_zero(); }
@@ -141,7 +143,7 @@ namespace currency
   {
     for (auto& ev : variant_container)
     {
-      if (ev.type() == typeid(variant_type_t))
+      if (tools::is_variant_type<variant_type_t>(ev))
       {
         boost::get<variant_type_t>(ev) = v;
         return;
@@ -155,7 +157,7 @@ namespace currency
   {
     for (size_t i = 0; i != variant_container.size();)
     {
-      if (variant_container[i].type() == typeid(variant_type_t))
+      if (tools::is_variant_type<variant_type_t>(variant_container[i]))
       {
         variant_container.erase(variant_container.begin()+i);
       }
@@ -198,8 +200,11 @@ namespace currency
   uint64_t get_burned_amount(const transaction& tx);
   void get_transaction_prefix_hash(const transaction_prefix& tx, crypto::hash& h);
   crypto::hash get_transaction_prefix_hash(const transaction_prefix& tx);
+  void get_transactions_prefix_hashes(const transaction* txs, size_t count, crypto::hash* hashes); // hashed in batches, multi-buffer keccak
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash);
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx);
+  bool parse_tx_prefix_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash); // attachments, signatures and proofs are left empty
+  void fill_transaction_hash_memo(transaction& tx); // for a transaction just deserialized, see transaction::hash_memo
   crypto::hash get_transaction_hash(const transaction& t);
   bool get_transaction_hash(const transaction& t, crypto::hash& res);
   bool get_transaction_hash(const transaction& t, crypto::hash& res, uint64_t& blob_size);
@@ -0,0 +1,228 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "include_base_utils.h"
+#include "ethash_dataset_files.h"
+#include "crypto/hash.h"
+#include "string_coding.h"
+
+#define ETHASH_DATASET_FILE_SIGNATURE     0x315453444854455aULL  // "ZETHDST1"
+#define ETHASH_DATASET_FILE_HEADER_SIZE   4096                   // the dataset stays page aligned
+#define ETHASH_DATASET_CHECKSUM_CHUNK     (64 * 1024 * 1024)
+
+namespace currency
+{
+  namespace
+  {
+    struct dataset_file_header
+    {
+      uint64_t signature;
+      uint64_t epoch;
+      uint64_t dataset_size;
+      crypto::hash checksum;
+    };
+
+    struct mapped_dataset_file
+    {
+      boost::interprocess::file_mapping mapping;
+      boost::interprocess::mapped_region region;
+    };
+
+    uint64_t get_epoch_dataset_size(int epoch)
+    {
+      return ethash::get_full_dataset_size(ethash::calculate_full_dataset_num_items(epoch));
+    }
+
+    // hash of the chunks' hashes, so it's computed in parallel
+    crypto::hash get_dataset_checksum(const char* p_data, uint64_t size, unsigned threads_count)
+    {
+      const size_t chunks_count = static_cast<size_t>((size + ETHASH_DATASET_CHECKSUM_CHUNK - 1) / ETHASH_DATASET_CHECKSUM_CHUNK);
+      std::vector<crypto::hash> chunk_hashes(chunks_count);
+      std::atomic<size_t> next_chunk(0);
+      auto worker = [&]()
+      {
+        for (size_t i = next_chunk++; i < chunks_count; i = next_chunk++)
+        {
+          uint64_t offset = static_cast<uint64_t>(i) * ETHASH_DATASET_CHECKSUM_CHUNK;
+          chunk_hashes[i] = crypto::cn_fast_hash(p_data + offset, static_cast<size_t>(std::min<uint64_t>(ETHASH_DATASET_CHECKSUM_CHUNK, size - offset)));
+        }
+      };
+      std::vector<std::thread> workers;
+      for (unsigned i = 1; i < threads_count && i < chunks_count; ++i)
+        workers.emplace_back(worker);
+      worker();
+      for (auto& t : workers)
+        t.join();
+      return crypto::cn_fast_hash(chunk_hashes.data(), chunk_hashes.size() * sizeof(crypto::hash));
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  ethash_dataset_files::ethash_dataset_files()
+    : m_threads_count(1)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  void ethash_dataset_files::init(const std::string& folder, unsigned threads_count)
+  {
+    m_folder = folder;
+    m_threads_count = std::max(threads_count, 1u);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool ethash_dataset_files::is_enabled() const
+  {
+    return !m_folder.empty();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::string ethash_dataset_files::get_file_path(int epoch) const
+  {
+    return m_folder + "/epoch_" + std::to_string(epoch) + ".bin";
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::shared_ptr<ethash::epoch_context_full> ethash_dataset_files::get_context(int epoch, const std::atomic<bool>* p_stop, void (*on_thread_start)())
+  {
+    std::shared_ptr<ethash::epoch_context_full> p_context = load(epoch);
+    if (p_context)
+      return p_context;
+
+    LOG_PRINT_L0("Building ethash dataset for epoch " << epoch << " with " << m_threads_count << " thread(s)...");
+    uint64_t start_ms = epee::misc_utils::get_tick_count();
+    p_context = ethash::create_epoch_context_full(epoch);
+    if (!p_context)
+    {
+      LOG_ERROR("Failed to create ethash context for epoch " << epoch);
+      return p_context;
+    }
+    if (!ethash::init_full_dataset(*p_context, m_threads_count, p_stop, on_thread_start))
+      return nullptr;
+    LOG_PRINT_L0("Ethash dataset for epoch " << epoch << " built in " << (epee::misc_utils::get_tick_count() - start_ms) / 1000 << " s");
+
+    // the mapped copy is used right away, so it's shared with the other daemons
+    if (store(epoch, *p_context))
+    {
+      std::shared_ptr<ethash::epoch_context_full> p_mapped_context = load(epoch);
+      if (p_mapped_context)
+        p_context = p_mapped_context;
+      remove_obsolete_files(epoch);
+    }
+    return p_context;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::shared_ptr<ethash::epoch_context_full> ethash_dataset_files::load(int epoch)
+  {
+    const std::string path = get_file_path(epoch);
+    const uint64_t dataset_size = get_epoch_dataset_size(epoch);
+    std::shared_ptr<mapped_dataset_file> p_file = std::make_shared<mapped_dataset_file>();
+    try
+    {
+      boost::system::error_code ec;
+      uint64_t file_size = boost::filesystem::file_size(epee::string_encoding::utf8_to_wstring(path), ec);
+      if (ec)
+        return nullptr;
+      if (file_size != ETHASH_DATASET_FILE_HEADER_SIZE + dataset_size)
+      {
+        LOG_PRINT_YELLOW("Ethash dataset file " << path << " has wrong size " << file_size << ", ignored", LOG_LEVEL_0);
+        return nullptr;
+      }
+      // copy-on-write: the pages stay shared unless something writes to them
+      p_file->mapping = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+      p_file->region = boost::interprocess::mapped_region(p_file->mapping, boost::interprocess::copy_on_write, 0, static_cast<size_t>(file_size));
+    }
+    catch (const std::exception& e)
+    {
+      LOG_ERROR("Failed to map ethash dataset file " << path << ": " << e.what());
+      return nullptr;
+    }
+
+    char* p_data = static_cast<char*>(p_file->region.get_address());
+    const dataset_file_header& header = *reinterpret_cast<const dataset_file_header*>(p_data);
+    if (header.signature != ETHASH_DATASET_FILE_SIGNATURE || header.epoch != static_cast<uint64_t>(epoch) || header.dataset_size != dataset_size)
+    {
+      LOG_PRINT_YELLOW("Ethash dataset file " << path << " has wrong header, ignored", LOG_LEVEL_0);
+      return nullptr;
+    }
+    uint64_t start_ms = epee::misc_utils::get_tick_count();
+    if (get_dataset_checksum(p_data + ETHASH_DATASET_FILE_HEADER_SIZE, dataset_size, m_threads_count) != header.checksum)
+    {
+      LOG_PRINT_YELLOW("Ethash dataset file " << path << " has wrong checksum, ignored", LOG_LEVEL_0);
+      return nullptr;
+    }
+
+    std::shared_ptr<ethash::epoch_context_full> p_context = ethash::create_epoch_context_full_external(epoch, p_data + ETHASH_DATASET_FILE_HEADER_SIZE, p_file);
+    if (!p_context)
+    {
+      LOG_ERROR("Failed to create ethash context for epoch " << epoch);
+      return nullptr;
+    }
+    LOG_PRINT_L0("Ethash dataset for epoch " << epoch << " loaded from " << path << " in " << epee::misc_utils::get_tick_count() - start_ms << " ms");
+    return p_context;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool ethash_dataset_files::store(int epoch, const ethash::epoch_context_full& context)
+  {
+    uint64_t dataset_size = 0;
+    const char* p_dataset = static_cast<const char*>(ethash::get_full_dataset_data(context, dataset_size));
+    CHECK_AND_ASSERT_MES(p_dataset && dataset_size == get_epoch_dataset_size(epoch), false, "internal error: wrong ethash dataset for epoch " << epoch);
+
+    std::vector<char> header_buff(ETHASH_DATASET_FILE_HEADER_SIZE, 0);
+    dataset_file_header& header = *reinterpret_cast<dataset_file_header*>(header_buff.data());
+    header.signature = ETHASH_DATASET_FILE_SIGNATURE;
+    header.epoch = epoch;
+    header.dataset_size = dataset_size;
+    header.checksum = get_dataset_checksum(p_dataset, dataset_size, m_threads_count);
+
+    const std::string path = get_file_path(epoch);
+    // written aside and renamed, so the other daemons never see a partial file
+    try
+    {
+      boost::filesystem::create_directories(epee::string_encoding::utf8_to_wstring(m_folder));
+      const boost::filesystem::path tmp_path = boost::filesystem::unique_path(epee::string_encoding::utf8_to_wstring(path + ".%%%%%%%%.tmp"));
+      {
+        std::ofstream fs(tmp_path.string(), std::ios::binary | std::ios::trunc);
+        fs.write(header_buff.data(), header_buff.size());
+        fs.write(p_dataset, static_cast<std::streamsize>(dataset_size));
+        if (!fs.good())
+        {
+          fs.close();
+          boost::system::error_code ec;
+          boost::filesystem::remove(tmp_path, ec);
+          LOG_ERROR("Failed to write ethash dataset file " << tmp_path.string());
+          return false;
+        }
+      }
+      boost::filesystem::rename(tmp_path, epee::string_encoding::utf8_to_wstring(path));
+    }
+    catch (const std::exception& e)
+    {
+      LOG_ERROR("Failed to store ethash dataset file " << path << ": " << e.what());
+      return false;
+    }
+    LOG_PRINT_L0("Ethash dataset for epoch " << epoch << " stored to " << path);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void ethash_dataset_files::remove_obsolete_files(int epoch)
+  {
+    std::vector<boost::filesystem::path> obsolete_files;
+    boost::system::error_code ec;
+    boost::filesystem::directory_iterator it(epee::string_encoding::utf8_to_wstring(m_folder), ec), end;
+    for (; !ec && it != end; it.increment(ec))
+    {
+      int file_epoch = 0;
+      char tail = 0;
+      if (sscanf(it->path().filename().string().c_str(), "epoch_%d.bin%c", &file_epoch, &tail) == 1 && file_epoch < epoch - 1)
+        obsolete_files.push_back(it->path());
+    }
+    for (const auto& path : obsolete_files)
+    {
+      boost::filesystem::remove(path, ec);
+      LOG_PRINT_L1("Obsolete ethash dataset file " << path.string() << " removed");
+    }
+  }
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include "ethereum/libethash/ethash/ethash.hpp"
+
+namespace currency
+{
+  /************************************************************************/
+  /* Full ethash datasets kept in files, one per epoch:                   */
+  /* [header: signature, epoch, size, checksum][dataset]                  */
+  /* A file is memory-mapped copy-on-write when loaded, so the daemons of */
+  /* one host (e.g. secondary instances) share its page-cached copy.      */
+  /************************************************************************/
+  class ethash_dataset_files
+  {
+  public:
+    ethash_dataset_files();
+
+    void init(const std::string& folder, unsigned threads_count);
+    bool is_enabled() const;
+    std::string get_file_path(int epoch) const;
+
+    // loads the epoch's dataset from its file, or builds it with threads_count threads and stores it
+    std::shared_ptr<ethash::epoch_context_full> get_context(int epoch, const std::atomic<bool>* p_stop = nullptr, void (*on_thread_start)() = nullptr);
+    std::shared_ptr<ethash::epoch_context_full> load(int epoch);
+    bool store(int epoch, const ethash::epoch_context_full& context);
+    // keeps the files of the previous, given and next epochs
+    void remove_obsolete_files(int epoch);
+
+  private:
+    std::string m_folder;
+    unsigned m_threads_count;
+  };
+}
@@ -0,0 +1,139 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "include_base_utils.h"
+#include "ethash_epoch_preparer.h"
+#include "basic_pow_helpers.h"
+#include "misc_os_dependent.h"
+#include "ethereum/libethash/ethash/ethash.hpp"
+
+namespace currency
+{
+  ethash_epoch_preparer::ethash_epoch_preparer()
+    : m_running(false)
+    , m_stop(false)
+    , m_blocks_ahead(0)
+    , m_threads_count(1)
+    , m_p_files(nullptr)
+    , m_last_prepared_epoch(-1)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  ethash_epoch_preparer::~ethash_epoch_preparer()
+  {
+    deinit();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void ethash_epoch_preparer::init(uint64_t blocks_ahead, size_t threads_count, ethash_dataset_files* p_files)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_blocks_ahead = blocks_ahead;
+    m_threads_count = std::max<size_t>(threads_count, 1);
+    m_p_files = p_files;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void ethash_epoch_preparer::deinit()
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_blocks_ahead = 0;
+    stop_and_join();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool ethash_epoch_preparer::on_new_top_height(uint64_t height)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    if (!m_blocks_ahead || m_running)
+      return false;
+
+    int next_epoch = ethash_height_to_epoch(height) + 1;
+    uint64_t next_epoch_height = static_cast<uint64_t>(next_epoch) * ETHASH_EPOCH_LENGTH;
+    if (next_epoch <= m_last_prepared_epoch || next_epoch_height - height > m_blocks_ahead)
+      return false;
+
+    return start_job(next_epoch);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool ethash_epoch_preparer::prepare_epoch_of_height(uint64_t height)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    if (!m_blocks_ahead || m_running)
+      return false;
+
+    int epoch = ethash_height_to_epoch(height);
+    if (epoch <= m_last_prepared_epoch)
+      return false;
+    return start_job(epoch);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool ethash_epoch_preparer::start_job(int epoch)
+  {
+    // m_lock is held by the caller
+    m_last_prepared_epoch = epoch;
+    if (ethash::has_global_epoch_context_full(epoch))
+      return false;
+
+    if (m_thread.joinable())
+      m_thread.join();
+    m_stop = false;
+    m_running = true;
+    m_thread = std::thread([this, epoch]() { prepare_epoch(epoch); });
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool ethash_epoch_preparer::is_running() const
+  {
+    return m_running;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void ethash_epoch_preparer::wait()
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void ethash_epoch_preparer::stop_and_join()
+  {
+    m_stop = true;
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void ethash_epoch_preparer::prepare_epoch(int epoch)
+  {
+    epee::misc_utils::set_current_thread_low_priority();
+    LOG_PRINT_L0("Preparing ethash dataset for epoch " << epoch << " in the background, " << m_threads_count << " thread(s)...");
+    uint64_t start_ms = epee::misc_utils::get_tick_count();
+
+    auto set_low_priority = []() { epee::misc_utils::set_current_thread_low_priority(); };
+    std::shared_ptr<ethash::epoch_context_full> p_context;
+    if (m_p_files)
+    {
+      p_context = m_p_files->get_context(epoch, &m_stop, set_low_priority);
+    }
+    else
+    {
+      p_context = ethash::create_epoch_context_full(epoch);
+      if (p_context && !ethash::init_full_dataset(*p_context, static_cast<unsigned>(m_threads_count), &m_stop, set_low_priority))
+        p_context.reset();
+    }
+
+    if (!p_context)
+    {
+      if (m_stop)
+      {
+        LOG_PRINT_L1("Preparing ethash dataset for epoch " << epoch << " interrupted");
+      }
+      else
+      {
+        LOG_ERROR("Failed to prepare ethash context for epoch " << epoch << ", it will be created when it's needed");
+      }
+      m_running = false;
+      return;
+    }
+
+    ethash::set_global_epoch_context_full(p_context);
+    LOG_PRINT_L0("Ethash dataset for epoch " << epoch << " prepared in " << (epee::misc_utils::get_tick_count() - start_ms) / 1000 << " s");
+    m_running = false;
+  }
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "ethash_dataset_files.h"
+
+namespace currency
+{
+  /************************************************************************/
+  /* Builds the full ethash dataset of the next epoch in the background   */
+  /* some blocks before the epoch boundary and makes it the global        */
+  /* context once it's complete, so validation, stratum and the miner     */
+  /* don't stall on the first blocks of the new epoch.                    */
+  /************************************************************************/
+  class ethash_epoch_preparer
+  {
+  public:
+    ethash_epoch_preparer();
+    ~ethash_epoch_preparer();
+
+    // blocks_ahead == 0 disables the preparation; the datasets are taken from and stored to p_files if it's given
+    void init(uint64_t blocks_ahead, size_t threads_count, ethash_dataset_files* p_files = nullptr);
+    void deinit();
+    // starts the job if the next epoch is close enough to the given top block, returns true if it was started
+    bool on_new_top_height(uint64_t height);
+    // starts the job for the epoch of the given height itself (after the startup), returns true if it was started
+    bool prepare_epoch_of_height(uint64_t height);
+    bool is_running() const;
+    // waits for the running job, for the tests
+    void wait();
+
+  private:
+    void prepare_epoch(int epoch);
+    bool start_job(int epoch);
+    void stop_and_join();
+
+    mutable std::mutex m_lock;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_stop;
+    uint64_t m_blocks_ahead;
+    size_t m_threads_count;
+    ethash_dataset_files* m_p_files;
+    int m_last_prepared_epoch;
+  };
+}
@@ -72,6 +72,7 @@ namespace currency
   {
     CRITICAL_REGION_LOCAL(m_template_lock);
     m_template = bl;
+    m_template_hashing_blob = get_block_hashing_blob(bl, m_template_tree_hash_cache); // once for all the threads
     m_diffic = di;
     m_height = height;
     ++m_template_no;
@@ -131,12 +132,29 @@ namespace currency
   {
     if(m_last_hr_merge_time && is_mining())
     {
-      m_current_hash_rate = (m_hashes * 1000) / ((misc_utils::get_tick_count() - m_last_hr_merge_time + 1));
+      uint64_t dt = misc_utils::get_tick_count() - m_last_hr_merge_time + 1;
+      m_current_hash_rate = (m_hashes * 1000) / dt;
+      CRITICAL_REGION_LOCAL(m_threads_hr_lock);
+      m_threads_hash_rates.resize(m_threads_hashes.size());
+      for (size_t i = 0; i != m_threads_hashes.size(); i++)
+        m_threads_hash_rates[i] = (m_threads_hashes[i].exchange(0) * 1000) / dt;
     }
     m_last_hr_merge_time = misc_utils::get_tick_count();
     m_hashes = 0;
     if(m_do_print_hashrate && is_mining())
-      std::cout << "hr: " << m_current_hash_rate << ENDL;
+    {
+      std::stringstream ss;
+      ss << "hr: " << m_current_hash_rate;
+      std::vector<uint64_t> threads_hr = get_threads_speed();
+      if (threads_hr.size() > 1)
+      {
+        ss << " (";
+        for (size_t i = 0; i != threads_hr.size(); i++)
+          ss << (i ? ", " : "") << threads_hr[i];
+        ss << ")";
+      }
+      std::cout << ss.str() << ENDL;
+    }
   }
   //-----------------------------------------------------------------------------------------------------
   void miner::init_options(boost::program_options::options_description& desc)
@@ -236,6 +254,11 @@ namespace currency
     if(!m_template_no)
       request_block_template();//lets update block template
 
+    CRITICAL_REGION_BEGIN(m_threads_hr_lock);
+    m_threads_hashes = std::vector<std::atomic<uint64_t>>(threads_count);
+    m_threads_hash_rates.assign(threads_count, 0);
+    CRITICAL_REGION_END();
+
     boost::interprocess::ipcdetail::atomic_write32(&m_stop, 0);
     boost::interprocess::ipcdetail::atomic_write32(&m_thread_index, 0);
 
@@ -254,6 +277,14 @@ namespace currency
       return 0;
   }
   //-----------------------------------------------------------------------------------------------------
+  std::vector<uint64_t> miner::get_threads_speed()
+  {
+    if (!is_mining())
+      return std::vector<uint64_t>();
+    CRITICAL_REGION_LOCAL(m_threads_hr_lock);
+    return m_threads_hash_rates;
+  }
+  //-----------------------------------------------------------------------------------------------------
   void miner::send_stop_signal()
   {
     boost::interprocess::ipcdetail::atomic_write32(&m_stop, 1);
@@ -328,14 +359,15 @@ namespace currency
       {        
         CRITICAL_REGION_BEGIN(m_template_lock);
         b = m_template;
-        b.nonce = 0;
+        local_blob_data = m_template_hashing_blob;
         local_diff = m_diffic;
         local_height = m_height;
         CRITICAL_REGION_END();
         //local_template_height = get_block_height(b);
         local_template_ver = m_template_no;
         nonce = m_starter_nonce + th_local_index;
-        local_blob_data = get_block_hashing_blob(b);
+        b.nonce = 0;
+        access_nonce_in_block_blob(local_blob_data) = 0;
         local_blob_data_hash = crypto::cn_fast_hash(local_blob_data.data(), local_blob_data.size());
       }
 
@@ -347,13 +379,21 @@ namespace currency
       }
       //b.nonce = nonce;
       //access_nonce_in_block_blob(local_blob_data) = b.nonce;
-      crypto::hash h = get_block_longhash(local_height, local_blob_data_hash, nonce);
+      // a batch of nonces at once, the template may change only between the batches
+      uint64_t nonces[CURRENCY_MINER_HASH_BATCH_SIZE];
+      crypto::hash hashes[CURRENCY_MINER_HASH_BATCH_SIZE];
+      for (size_t i = 0; i != CURRENCY_MINER_HASH_BATCH_SIZE; i++)
+        nonces[i] = nonce + i * m_threads_total;
+      get_block_longhashes_full(local_height, local_blob_data_hash, nonces, CURRENCY_MINER_HASH_BATCH_SIZE, hashes);
 
-      if(check_hash(h, local_diff))
+      for (size_t i = 0; i != CURRENCY_MINER_HASH_BATCH_SIZE; i++)
       {
-        b.nonce = nonce;
+        const crypto::hash& h = hashes[i];
+        if (!check_hash(h, local_diff))
+          continue;
+        b.nonce = nonces[i];
         ++m_config.current_extra_message_index;
-        LOG_PRINT_GREEN("Found block for difficulty: " << local_diff << ", height: " << local_height << ", PoW hash: " << h << ", local_blob_data_hash: " << local_blob_data_hash << ", nonce: " << std::hex << nonce, LOG_LEVEL_0);
+        LOG_PRINT_GREEN("Found block for difficulty: " << local_diff << ", height: " << local_height << ", PoW hash: " << h << ", local_blob_data_hash: " << local_blob_data_hash << ", nonce: " << std::hex << b.nonce, LOG_LEVEL_0);
         if(!m_phandler->handle_block_found(b))
         {
           --m_config.current_extra_message_index;
@@ -363,9 +403,13 @@ namespace currency
           //success, let's update config
           epee::serialization::store_t_to_json_file(m_config, m_config_folder + "/" + MINER_CONFIG_FILENAME);
         }
+        // the rest of the batch is for the same height
+        break;
       }
-      nonce+=m_threads_total;
-      ++m_hashes;
+      nonce += CURRENCY_MINER_HASH_BATCH_SIZE * m_threads_total;
+      m_hashes += CURRENCY_MINER_HASH_BATCH_SIZE;
+      if (th_local_index < m_threads_hashes.size())
+        m_threads_hashes[th_local_index] += CURRENCY_MINER_HASH_BATCH_SIZE;
     }
     LOG_PRINT_L0("Miner thread stopped ["<< th_local_index << "]");
     return true;
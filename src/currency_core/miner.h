@@ -44,6 +44,8 @@ namespace currency
     bool on_block_chain_update();
     bool start(const account_public_address& adr, size_t threads_count);
     uint64_t get_speed();
+    // hashes per second of each mining thread
+    std::vector<uint64_t> get_threads_speed();
     void send_stop_signal();
     bool stop();
     bool is_mining();
@@ -65,7 +67,7 @@ namespace currency
 
       for(; bl.nonce != std::numeric_limits<uint64_t>::max(); bl.nonce++)
       {
-        crypto::hash h = get_block_longhash(height, bd_hash, bl.nonce);
+        crypto::hash h = get_block_longhash_full(height, bd_hash, bl.nonce);
         if(check_hash(h, diffic))
         {
           LOG_PRINT_L1("Found nonce for block: " << get_block_hash(bl) << "[" << height << "]: PoW:" << h << " (diff:" << diffic << "), ts: " << bl.timestamp);
@@ -94,6 +96,8 @@ namespace currency
     volatile uint32_t m_stop;
     epee::critical_section m_template_lock;
     block m_template;
+    blobdata m_template_hashing_blob;
+    crypto::tree_hash_cache m_template_tree_hash_cache;
     std::atomic<uint32_t> m_template_no;
     std::atomic<uint32_t> m_starter_nonce;
     wide_difficulty_type m_diffic;
@@ -117,6 +121,9 @@ namespace currency
     std::atomic<uint64_t> m_current_hash_rate;
     std::atomic<uint64_t> m_last_hr_merge_time;
     std::atomic<uint64_t> m_hashes;
+    epee::critical_section m_threads_hr_lock;
+    std::vector<std::atomic<uint64_t>> m_threads_hashes;  // replaced only while there are no mining threads
+    std::vector<uint64_t> m_threads_hash_rates;
     bool m_do_print_hashrate;
     bool m_do_mining;
     
@@ -104,10 +104,22 @@ namespace bc_services
     return ws;
   }
 
-#define SECONDS_IN_ONE_DAY (60*60*24)
-
-
-  bool is_offer_matched_by_filter(const offer_details_ex& o, const core_offers_filter& of, uint64_t current_time)
+  std::wstring get_offer_keyword_search_text(const offer_details_ex& o)
+  {
+    std::wstring all_in_apper;
+    all_in_apper += to_lower_local_w(o.bonus);
+    all_in_apper += to_lower_local_w(o.target);
+    all_in_apper += to_lower_local_w(o.location_country);
+    all_in_apper += to_lower_local_w(o.location_city);
+    all_in_apper += to_lower_local_w(o.contacts);
+    all_in_apper += to_lower_local_w(o.comment);
+    all_in_apper += to_lower_local_w(o.payment_types);
+    all_in_apper += to_lower_local_w(o.deal_option);
+    all_in_apper += to_lower_local_w(o.category);
+    return all_in_apper;
+  }
+  //--------------------------------------------------------------------------------
+  bool is_offer_matched_by_filter(const offer_details_ex& o, const core_offers_filter& of, uint64_t current_time, const std::wstring* p_keyword_search_text /* = nullptr */)
   {
     if (o.stopped)
       return false;
@@ -197,17 +209,13 @@ namespace bc_services
     if (!of.keyword.empty())
     {
       std::wstring all_in_apper;
-      all_in_apper += to_lower_local_w(o.bonus);
-      all_in_apper += to_lower_local_w(o.target);
-      all_in_apper += to_lower_local_w(o.location_country);
-      all_in_apper += to_lower_local_w(o.location_city);
-      all_in_apper += to_lower_local_w(o.contacts);
-      all_in_apper += to_lower_local_w(o.comment);
-      all_in_apper += to_lower_local_w(o.payment_types);
-      all_in_apper += to_lower_local_w(o.deal_option);
-      all_in_apper += to_lower_local_w(o.category);
+      if (!p_keyword_search_text)
+      {
+        all_in_apper = get_offer_keyword_search_text(o);
+        p_keyword_search_text = &all_in_apper;
+      }
       std::wstring keyword_lowcase = to_lower_local_w(of.keyword);
-      if (all_in_apper.find(keyword_lowcase) == std::wstring::npos)
+      if (p_keyword_search_text->find(keyword_lowcase) == std::wstring::npos)
       {
         return false;
       }
@@ -15,6 +15,8 @@
 #include "bc_offers_service_basic.h"
 #include "bc_attachments_helpers.h"
 
+#define SECONDS_IN_ONE_DAY (60*60*24)
+
 namespace bc_services
 {
 
@@ -48,7 +50,9 @@ namespace bc_services
 
   typedef bool(*sort_offers_func_type)(const offer_details_ex* a, const offer_details_ex* b);
   extern std::vector<sort_offers_func_type> gsort_offers_predicates;
-  bool is_offer_matched_by_filter(const offer_details_ex& o, const core_offers_filter& of, uint64_t currnet_time);
+  // p_keyword_search_text, if given, is get_offer_keyword_search_text(o) made beforehand
+  bool is_offer_matched_by_filter(const offer_details_ex& o, const core_offers_filter& of, uint64_t currnet_time, const std::wstring* p_keyword_search_text = nullptr);
+  std::wstring get_offer_keyword_search_text(const offer_details_ex& o);
   bool filter_offers_list(std::list<offer_details_ex>& offers, const core_offers_filter& filter, uint64_t current_core_time);
   crypto::hash offer_id_from_hash_and_index(const crypto::hash& tx_id, uint64_t index);
   crypto::hash offer_id_from_hash_and_index(const offer_id& oid);
@@ -17,6 +17,7 @@
 #include "common/boost_serialization_helper.h"
 #include "common/int-util.h"
 #include "misc_language.h"
+#include "file_io_utils.h"
 #include "warnings.h"
 #include "crypto/hash.h"
 #include "profile_tools.h"
@@ -33,7 +34,23 @@ DISABLE_VS_WARNINGS(4244 4345 4503) //'boost::foreach_detail_::or_' : decorated
 #define TRANSACTION_POOL_CONTAINER_SOLO_OPTIONS           "solo"
 #define TRANSACTION_POOL_OPTIONS_ID_STORAGE_MAJOR_COMPATIBILITY_VERSION 92 // DON'T CHANGE THIS, if you need to resync db! Change TRANSACTION_POOL_MAJOR_COMPATIBILITY_VERSION instead!
 #define TRANSACTION_POOL_MAJOR_COMPATIBILITY_VERSION      BLOCKCHAIN_STORAGE_MAJOR_COMPATIBILITY_VERSION + 1
+#define TRANSACTION_POOL_OPTIONS_ID_INDEXES_SNAPSHOT_NONCE 93 // nonce of the indexes snapshot written on clean shutdown, zero while the pool is in use
 
+#define TX_POOL_INDEXES_SNAPSHOT_FILENAME                 "indexes_snapshot.bin"
+#define TX_POOL_INDEXES_SNAPSHOT_SIGNATURE                0x31544f4e53504f50ULL // "POPSNOT1"
+#define TX_POOL_INDEXES_SNAPSHOT_VERSION                  2
+#define TX_POOL_INDEXES_SNAPSHOT_FLAG_HAS_ALIAS           0x01
+#define TX_POOL_INDEXES_SNAPSHOT_FLAG_ALIAS_UPDATE        0x02
+#define TX_POOL_INDEXES_SNAPSHOT_FLAG_OFFERS_DEL          0x04
+#define TX_POOL_INDEXES_SNAPSHOT_FLAG_KEPT_BY_BLOCK       0x08
+
+
+#define TX_POOL_FEE_INDEX_WALK_CHUNK_SIZE                 256 // fill_block_template() copies the fee index in chunks of that many entries
+#define TX_POOL_DEFAULT_MAX_BYTES                         (512ULL * 1024 * 1024)
+#define TX_POOL_EVICTED_TXS_REMEMBER_SECONDS              (10 * 60)
+#define TX_POOL_EVICTED_TXS_MAX_COUNT                     100000
+#define TX_POOL_CHANGES_LOG_MAX_COUNT                     20000 // added/removed txs remembered for get_transactions_changes()
+#define TX_POOL_MAX_PACKAGE_COUNT                         25 // max number of txs in a package: a tx and all its unconfirmed ancestors
 
 #define CONFLICT_KEY_IMAGE_SPENT_DEPTH_TO_REMOVE_TX_FROM_POOL 50 // if there's a conflict in key images between tx in the pool and in the blockchain this much depth in required to remove correspongin tx from pool
 
@@ -45,6 +62,42 @@ using namespace epee;
 
 namespace currency
 {
+  namespace
+  {
+    const command_line::arg_descriptor<uint64_t> arg_max_txpool_bytes("max-txpool-bytes", "Maximum total size of transactions in the pool, ones with the lowest fee per byte are evicted first (0 - unlimited)", TX_POOL_DEFAULT_MAX_BYTES);
+
+    struct ms_out_info
+    {
+      crypto::hash multisig_id;
+      size_t input_output_index;
+      bool is_input;
+    };
+
+    void collect_multisig_ids_from_tx(const transaction& tx, std::vector<ms_out_info>& result)
+    {
+      result.reserve(tx.vin.size() + tx.vout.size());
+
+      size_t idx = 0;
+      for (const auto& in : tx.vin)
+      {
+        if (tools::is_variant_type<txin_multisig>(in))
+          result.push_back(ms_out_info({ boost::get<txin_multisig>(in).multisig_out_id, idx, true }));
+        ++idx;
+      }
+
+      idx = 0;
+      for (const auto& out : tx.vout)
+      {
+        VARIANT_SWITCH_BEGIN(out);
+        VARIANT_CASE_CONST(tx_out_bare, o)
+          if (tools::is_variant_type<txout_multisig>(o.target))
+            result.push_back(ms_out_info({ get_multisig_out_id(tx, idx), idx, false }));
+        VARIANT_SWITCH_END();
+        ++idx;
+      }
+    }
+  }
+
   //---------------------------------------------------------------------------------
   tx_memory_pool::tx_memory_pool(blockchain_storage& bchs, i_currency_protocol* pprotocol) :
     m_blockchain(bchs),
@@ -56,14 +109,16 @@ namespace currency
 //    m_db_key_images_set(m_db),
     m_db_alias_names(m_db),
     m_db_alias_addresses(m_db),
-    m_db_storage_major_compatibility_version(TRANSACTION_POOL_OPTIONS_ID_STORAGE_MAJOR_COMPATIBILITY_VERSION, m_db_solo_options)
+    m_db_storage_major_compatibility_version(TRANSACTION_POOL_OPTIONS_ID_STORAGE_MAJOR_COMPATIBILITY_VERSION, m_db_solo_options),
+    m_db_indexes_snapshot_nonce(TRANSACTION_POOL_OPTIONS_ID_INDEXES_SNAPSHOT_NONCE, m_db_solo_options),
+    m_pool_instance_id(crypto::rand<uint64_t>() | 1)
   {
 
   }
 
   bool tx_memory_pool::is_valid_contract_finalization_tx(const transaction &tx)const
   {
-    if (tx.vin.size() != 1 || tx.vin[0].type() != typeid(txin_multisig))
+    if (tx.vin.size() != 1 || !tools::is_variant_type<txin_multisig>(tx.vin[0]))
     {
       return false;
     }
@@ -102,8 +157,24 @@ namespace currency
     return true;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::add_tx(const transaction &tx, const crypto::hash &id, uint64_t blob_size, tx_verification_context& tvc, bool kept_by_block, bool from_core)
+  void tx_memory_pool::init_options(boost::program_options::options_description& desc)
+  {
+    command_line::add_arg(desc, arg_max_txpool_bytes);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::preverify_tx(const transaction& tx, const crypto::hash& id, tx_preverification_info& pvi, const tx_semantic_context* p_semantic /* = nullptr */) const
+  {
+    // top block id goes first: if the chain moves on while checking, add_tx() won't trust the results
+    pvi.top_block_id = m_blockchain.get_top_block_id();
+    pvi.max_used_block_height = 0;
+    pvi.max_used_block_id = null_hash;
+    pvi.inputs_ok = m_blockchain.check_tx_inputs(tx, id, pvi.max_used_block_height, pvi.max_used_block_id);
+    pvi.balance_ok = tx.version <= TRANSACTION_VERSION_PRE_HF4 || (p_semantic ? check_tx_balance(tx, id, *p_semantic) : check_tx_balance(tx, id));
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::add_tx(const transaction &tx, const crypto::hash &id, uint64_t blob_size, tx_verification_context& tvc, bool kept_by_block, bool from_core, const tx_preverification_info* p_pvi, const tx_semantic_context* p_semantic)
   {
+    TRACE_SCOPE("tx", "tx_pool_add_tx");
     // ------------------ UNSECURE CODE FOR TESTS ---------------------
     if (m_unsecure_disable_tx_validation_on_addition)
     {
@@ -182,8 +253,8 @@ namespace currency
     //check key images for transaction if it is not kept by block
     if(!from_core && !kept_by_block)
     {
-
-      if(!validate_tx_semantic(tx, blob_size))
+      // p_semantic means the caller has already validated the tx semantics
+      if(!p_semantic && !validate_tx_semantic(tx, blob_size))
       {          
         // tx semantics check failed
         LOG_PRINT_RED_L0("Transaction " << id << " semantics check failed ");
@@ -223,13 +294,67 @@ namespace currency
         tvc.m_verification_failed = true;
         return false;
       }
+
+      // pool size cap, checked here as well to refuse a tx before the expensive checks
+      std::vector<fee_index_entry> victims;
+      if (!select_eviction_victims(blob_size, tx_fee, victims))
+      {
+        LOG_PRINT_L0("Transaction " << id << " rejected: the pool is full (" << get_total_blobs_size() << " bytes) of txs with higher fee per byte");
+        remember_evicted_tx(id);
+        tvc.m_verification_failed = false;
+        tvc.m_should_be_relayed = false;
+        tvc.m_added_to_pool = false;
+        return true;
+      }
     }
     TIME_MEASURE_FINISH_PD(check_keyimages_ws_ms_time);
 
+    bool preverified = p_pvi != nullptr && p_pvi->top_block_id == m_blockchain.get_top_block_id();
+
     TIME_MEASURE_START_PD(check_inputs_time);
     crypto::hash max_used_block_id = null_hash;
     uint64_t max_used_block_height = 0;
-    bool ch_inp_res = m_blockchain.check_tx_inputs(tx, id, max_used_block_height, max_used_block_id);
+    bool ch_inp_res = false;
+    if (preverified)
+    {
+      ch_inp_res = p_pvi->inputs_ok;
+      max_used_block_id = p_pvi->max_used_block_id;
+      max_used_block_height = p_pvi->max_used_block_height;
+    }
+    else
+    {
+      ch_inp_res = m_blockchain.check_tx_inputs(tx, id, max_used_block_height, max_used_block_id);
+    }
+    bool has_pool_parents = false;
+    if (!ch_inp_res)
+    {
+      // multisig inputs may spend outputs of pool txs, such a tx is valid only in the same block with its parents (after them)
+      unconfirmed_ms_outs_map pool_ms_sources;
+      std::vector<crypto::hash> parents;
+      if (get_pool_ms_sources(tx, pool_ms_sources, parents))
+      {
+        has_pool_parents = true;
+        size_t package_count = 1;
+        std::unordered_set<crypto::hash> ancestor_ids(parents.begin(), parents.end());
+        for (const auto& parent_id : parents)
+        {
+          std::vector<fee_index_entry> ancestors;
+          get_unconfirmed_ancestors(parent_id, ancestors);
+          for (const auto& a : ancestors)
+            ancestor_ids.insert(a.id);
+        }
+        package_count += ancestor_ids.size();
+        if (package_count > TX_POOL_MAX_PACKAGE_COUNT)
+        {
+          LOG_PRINT_L0("Transaction " << id << " has too many unconfirmed ancestors in the pool: " << ancestor_ids.size());
+        }
+        else
+        {
+          max_used_block_height = 0;
+          ch_inp_res = m_blockchain.check_tx_inputs(tx, id, max_used_block_height, &pool_ms_sources);
+        }
+      }
+    }
     if (!ch_inp_res && !kept_by_block && !from_core)
     {
       LOG_PRINT_L0("check_tx_inputs failed, tx rejected");
@@ -241,7 +366,7 @@ namespace currency
     if (tx.version > TRANSACTION_VERSION_PRE_HF4)
     {
       TIME_MEASURE_START_PD(check_post_hf4_balance);
-      r = check_tx_balance(tx, id);
+      r = preverified ? p_pvi->balance_ok : (p_semantic ? check_tx_balance(tx, id, *p_semantic) : check_tx_balance(tx, id));
       CHECK_AND_ASSERT_MES_CUSTOM(r, false, { tvc.m_verification_failed = true; }, "post-HF4 tx: balance proof is invalid");
       TIME_MEASURE_FINISH_PD(check_post_hf4_balance);
 
@@ -252,7 +377,18 @@ namespace currency
       CHECK_AND_ASSERT_MES_CUSTOM(r, false, { tvc.m_verification_failed = true; }, "post-HF4 tx: asset operation is invalid");
     }
 
-    do_insert_transaction(tx, id, blob_size, kept_by_block, tx_fee, ch_inp_res ? max_used_block_id : null_hash, ch_inp_res ? max_used_block_height : 0);
+    if (!from_core && !kept_by_block && !make_room_for_tx(id, blob_size, tx_fee))
+    {
+      LOG_PRINT_L0("Transaction " << id << " rejected: the pool is full (" << get_total_blobs_size() << " bytes) of txs with higher fee per byte");
+      tvc.m_verification_failed = false;
+      tvc.m_should_be_relayed = false;
+      tvc.m_added_to_pool = false;
+      return true;
+    }
+
+    // txs depending on pool txs are rechecked each time they get into a block template, as their parents may change
+    bool trusted_inputs = ch_inp_res && !has_pool_parents;
+    do_insert_transaction(tx, id, blob_size, kept_by_block, tx_fee, trusted_inputs ? max_used_block_id : null_hash, trusted_inputs ? max_used_block_height : 0);
     
     TIME_MEASURE_FINISH_PD(tx_processing_time);
     tvc.m_added_to_pool = true;
@@ -312,7 +448,7 @@ namespace currency
     td.receive_time = get_core_time();
 
     m_db_transactions.set(id, td);
-    on_tx_add(id, tx, kept_by_block);
+    on_tx_add(id, tx, blob_size, fee, kept_by_block);
 
     TIME_MEASURE_FINISH_PD(update_db_time);
     return true;
@@ -338,21 +474,9 @@ namespace currency
 //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_aliases_from_tx_pool(std::list<extra_alias_entry>& aliases)const
   {
-
-    //TODO: OPTIMIZATION put cache here!!!!!
-
-    m_db_transactions.enumerate_items([&](uint64_t i, const crypto::hash& h, const tx_details &tx_entry)
-    {
-      tx_extra_info ei = AUTO_VAL_INIT(ei);
-      bool r = parse_and_validate_tx_extra(tx_entry.tx, ei);
-      CHECK_AND_ASSERT_MES(r, false, "failed to validate transaction extra on unprocess_blockchain_tx_extra");
-      if (ei.m_alias.m_alias.size())
-        aliases.push_back(ei.m_alias);
-
-      return true;
-    });
+    pool_snapshot_ptr snapshot = get_snapshot();
+    aliases.insert(aliases.end(), snapshot->aliases.begin(), snapshot->aliases.end());
     return true;
-
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_aliases_from_tx_pool(std::map<std::string, size_t>& aliases)const
@@ -549,54 +673,152 @@ namespace currency
     return m_db_transactions.size();
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::get_transactions(std::list<transaction>& txs) const
+  void tx_memory_pool::get_memory_usage(std::list<tools::memory_usage_entry>& usage) const
+  {
+    std::vector<transactions_container::cache_shard_stats> shards_stats;
+    m_db_transactions.get_cache_shards_stats(shards_stats);
+    uint64_t cached_txs = 0;
+    for (const auto& sh : shards_stats)
+      cached_txs += sh.size;
+    tools::add_memory_usage("tx_pool_db_cache_transactions", cached_txs, m_db_transactions.get_cache_estimated_bytes(), usage);
+
+    CRITICAL_REGION_BEGIN(m_key_images_lock);
+    tools::add_memory_usage("tx_pool_key_images", m_key_images.size(), m_key_images.get_memory_size(), usage);
+    CRITICAL_REGION_END();
+
+    CRITICAL_REGION_BEGIN(m_fee_index_lock);
+    uint64_t fee_index_bytes = m_fee_index.size() * tools::node_container_entry_size<fee_index_entry, char>()
+      + m_fee_index_by_id.size() * tools::node_container_entry_size<crypto::hash, fee_index::const_iterator>()
+      + m_fee_index_offers_del.size() * tools::node_container_entry_size<crypto::hash, char>();
+    tools::add_memory_usage("tx_pool_fee_index", m_fee_index.size(), fee_index_bytes, usage);
+    uint64_t ms_graph_bytes = m_pool_ms_outs.size() * tools::node_container_entry_size<crypto::hash, ms_out_link>()
+      + m_pool_ms_ins.size() * tools::node_container_entry_size<crypto::hash, crypto::hash>()
+      + m_pool_tx_ms_ids.size() * tools::node_container_entry_size<crypto::hash, tx_ms_ids>();
+    for (const auto& ids : m_pool_tx_ms_ids)
+      ms_graph_bytes += (ids.second.ins.capacity() + ids.second.outs.capacity()) * sizeof(crypto::hash);
+    tools::add_memory_usage("tx_pool_ms_graph", m_pool_tx_ms_ids.size(), ms_graph_bytes, usage);
+    CRITICAL_REGION_END();
+
+    CRITICAL_REGION_BEGIN(m_evicted_txs_lock);
+    tools::add_memory_usage("tx_pool_evicted_txs", m_evicted_txs.size(), m_evicted_txs.size() * tools::node_container_entry_size<crypto::hash, uint64_t>(), usage);
+    CRITICAL_REGION_END();
+
+    CRITICAL_REGION_BEGIN(m_changes_log_lock);
+    tools::add_memory_usage("tx_pool_changes_log", m_changes_log.size(), m_changes_log.size() * sizeof(pool_change), usage);
+    CRITICAL_REGION_END();
+
+    CRITICAL_REGION_BEGIN(m_taken_txs_lock);
+    tools::add_memory_usage("tx_pool_taken_txs", m_taken_txs.size(), m_taken_txs.size() * tools::node_container_entry_size<crypto::hash, char>(), usage);
+    CRITICAL_REGION_END();
+
+    // the parsed txs of a snapshot may be shared with the db cache, they are counted by their blob size in both
+    pool_snapshot_ptr snapshot = std::atomic_load(&m_snapshot);
+    uint64_t snapshot_bytes = 0;
+    if (snapshot)
+    {
+      snapshot_bytes = sizeof(pool_snapshot) + snapshot->txs.capacity() * sizeof(pool_snapshot::entry) + snapshot->aliases.capacity() * sizeof(extra_alias_entry);
+      for (const auto& e : snapshot->txs)
+        snapshot_bytes += e.blob.size() + (e.txd ? sizeof(tx_details) + e.txd->blob_size : 0);
+    }
+    tools::add_memory_usage("tx_pool_snapshot", snapshot ? snapshot->txs.size() : 0, snapshot_bytes, usage);
+  }
+  //---------------------------------------------------------------------------------
+  tx_memory_pool::pool_snapshot_ptr tx_memory_pool::get_snapshot() const
   {
+    pool_snapshot_ptr snapshot = std::atomic_load(&m_snapshot);
+    if (snapshot && snapshot->pool_version == m_pool_version)
+      return snapshot;
+
+    // only one reader rebuilds it, the others wait here rather than on the pool db
+    CRITICAL_REGION_LOCAL(m_snapshot_build_lock);
+    uint64_t pool_version = m_pool_version; // taken before reading txs, so changes made meanwhile cause one more rebuild
+    snapshot = std::atomic_load(&m_snapshot);
+    if (snapshot && snapshot->pool_version == pool_version)
+      return snapshot;
+
+    TIME_MEASURE_START_MS(build_time);
+    std::shared_ptr<pool_snapshot> new_snapshot = std::make_shared<pool_snapshot>();
+    new_snapshot->pool_version = pool_version;
+    new_snapshot->txs.reserve(m_db_transactions.size());
     m_db_transactions.enumerate_items([&](uint64_t i, const crypto::hash& h, const tx_details &tx_entry)
     {
-      txs.push_back(tx_entry.tx);
+      new_snapshot->txs.push_back(pool_snapshot::entry());
+      pool_snapshot::entry& e = new_snapshot->txs.back();
+      e.id = h;
+      e.txd = std::make_shared<const tx_details>(tx_entry);
+      e.blob = t_serializable_object_to_blob(tx_entry.tx);
+      tx_extra_info ei = AUTO_VAL_INIT(ei);
+      if (!parse_and_validate_tx_extra(tx_entry.tx, ei))
+      {
+        LOG_ERROR("failed to validate transaction extra for pool tx " << h);
+      }
+      else if (ei.m_alias.m_alias.size())
+      {
+        new_snapshot->aliases.push_back(ei.m_alias);
+      }
       return true;
     });
+    snapshot = new_snapshot;
+    std::atomic_store(&m_snapshot, snapshot);
+    TIME_MEASURE_FINISH_MS(build_time);
+    LOG_PRINT_L2("tx pool: snapshot of " << snapshot->txs.size() << " txs built in " << build_time << " ms");
+    return snapshot;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_transactions(std::list<transaction>& txs) const
+  {
+    pool_snapshot_ptr snapshot = get_snapshot();
+    for (const auto& e : snapshot->txs)
+      txs.push_back(e.txd->tx);
+
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_transactions_blobs(std::list<blobdata>& blobs, uint64_t& pool_version) const
+  {
+    pool_snapshot_ptr snapshot = get_snapshot();
+    for (const auto& e : snapshot->txs)
+      blobs.push_back(e.blob);
+    pool_version = snapshot->pool_version;
 
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_all_transactions_details(std::list<tx_rpc_extended_info>& txs) const
   {
-    m_db_transactions.enumerate_items([&](uint64_t i, const crypto::hash& h, const tx_details &tx_entry)
+    pool_snapshot_ptr snapshot = get_snapshot();
+    for (const auto& e : snapshot->txs)
     {
       txs.push_back(tx_rpc_extended_info());
       tx_rpc_extended_info& trei = txs.back();
-      trei.blob_size = tx_entry.blob_size;
-      m_blockchain.fill_tx_rpc_details(trei, tx_entry.tx, nullptr, h, tx_entry.receive_time, true);
-      return true;
-    });
+      trei.blob_size = e.txd->blob_size;
+      m_blockchain.fill_tx_rpc_details(trei, e.txd->tx, nullptr, e.id, e.txd->receive_time, true);
+    }
 
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_all_transactions_brief_details(std::list<tx_rpc_brief_info>& txs) const
   {
-    m_db_transactions.enumerate_items([&](uint64_t i, const crypto::hash& h, const tx_details &tx_entry)
+    pool_snapshot_ptr snapshot = get_snapshot();
+    for (const auto& e : snapshot->txs)
     {
       txs.push_back(tx_rpc_brief_info());
       tx_rpc_brief_info& trbi = txs.back();
-      trbi.id = epee::string_tools::pod_to_hex(h);
-      trbi.fee = tx_entry.fee;
-      trbi.sz = tx_entry.blob_size;
-      trbi.total_amount = get_outs_money_amount(tx_entry.tx);
-      return true;
-    });
+      trbi.id = epee::string_tools::pod_to_hex(e.id);
+      trbi.fee = e.txd->fee;
+      trbi.sz = e.txd->blob_size;
+      trbi.total_amount = get_outs_money_amount(e.txd->tx);
+    }
 
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_all_transactions_list(std::list<std::string>& txs)const
   {
-    m_db_transactions.enumerate_items([&](uint64_t i, const crypto::hash& h, const tx_details &tx_entry)
-    {
-      txs.push_back(epee::string_tools::pod_to_hex(h));
-      return true;
-    });
+    pool_snapshot_ptr snapshot = get_snapshot();
+    for (const auto& e : snapshot->txs)
+      txs.push_back(epee::string_tools::pod_to_hex(e.id));
 
     return true;
   }
@@ -729,6 +951,8 @@ namespace currency
     m_db.begin_transaction();
     m_db_black_tx_list.set(get_transaction_hash(tx), true);
     m_db.commit_transaction();
+    ++m_pool_version;
+    m_blockchain.get_change_notifier().notify();
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -768,19 +992,20 @@ namespace currency
       crypto::key_image k_image = AUTO_VAL_INIT(k_image);
       if (get_key_image_from_txin_v(in, k_image))
       {
-        auto& id_set = m_key_images[k_image];
-        size_t sz_before = id_set.size();
-        id_set.insert(tx_id);
-        LOG_PRINT_L2("tx pool: key image added: " << k_image << ", from tx " << tx_id << ", counter: " << sz_before << " -> " << id_set.size());
+        m_key_images.insert(k_image, tx_id);
+        LOG_PRINT_L2("tx pool: key image added: " << k_image << ", from tx " << tx_id << ", counter: " << m_key_images.count(k_image));
       }
     }
     return false;
   }
   //--------------------------------------------------------------------------------- 
-  bool tx_memory_pool::on_tx_add(crypto::hash tx_id, const transaction& tx, bool kept_by_block)
+  bool tx_memory_pool::on_tx_add(crypto::hash tx_id, const transaction& tx, uint64_t blob_size, uint64_t fee, bool kept_by_block)
   {
     insert_key_images(tx_id, tx, kept_by_block);
     insert_alias_info(tx);
+    insert_into_fee_index(tx_id, tx, blob_size, fee, kept_by_block);
+    insert_into_dependency_graph(tx_id, tx);
+    log_pool_change(tx_id, true);
     return true;
   }
   //--------------------------------------------------------------------------------- 
@@ -788,7 +1013,701 @@ namespace currency
   {
     remove_key_images(id, tx, kept_by_block);
     remove_alias_info(tx);
+    remove_from_fee_index(id);
+    remove_from_dependency_graph(id);
+    log_pool_change(id, false);
+    return true;
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::insert_into_fee_index(const crypto::hash& tx_id, const transaction& tx, uint64_t blob_size, uint64_t fee, bool kept_by_block)
+  {
+    fee_index_entry e = AUTO_VAL_INIT(e);
+    e.id = tx_id;
+    e.fee = fee;
+    e.blob_size = blob_size;
+    tx_extra_info ei = AUTO_VAL_INIT(ei);
+    if (!parse_and_validate_tx_extra(tx, ei))
+    {
+      LOG_ERROR("parse_and_validate_tx_extra failed for tx " << tx_id << " while adding it to the fee index");
+    }
+    else if (!ei.m_alias.m_alias.empty())
+    {
+      e.has_alias = true;
+      e.alias_update = !ei.m_alias.m_sign.empty();
+    }
+    e.offers_del = have_attachment_service_in_container(tx.attachment, BC_OFFERS_SERVICE_ID, BC_OFFERS_SERVICE_INSTRUCTION_DEL);
+    e.kept_by_block = kept_by_block;
+    insert_fee_index_entry(e);
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::insert_fee_index_entry(const fee_index_entry& e)
+  {
+    remove_from_fee_index(e.id); // the same tx may be re-added with different details
+
+    CRITICAL_REGION_LOCAL(m_fee_index_lock);
+    m_fee_index_by_id[e.id] = m_fee_index.insert(e).first;
+    m_fee_index_total_bytes += e.blob_size;
+    if (e.has_alias && !e.alias_update)
+      ++m_fee_index_alias_regs_count;
+    if (e.offers_del)
+      m_fee_index_offers_del.insert(e.id);
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::remove_from_fee_index(const crypto::hash& tx_id)
+  {
+    CRITICAL_REGION_LOCAL(m_fee_index_lock);
+    auto it = m_fee_index_by_id.find(tx_id);
+    if (it == m_fee_index_by_id.end())
+      return;
+    if (it->second->has_alias && !it->second->alias_update)
+      --m_fee_index_alias_regs_count;
+    m_fee_index_offers_del.erase(tx_id);
+    m_fee_index_total_bytes -= it->second->blob_size;
+    m_fee_index.erase(it->second);
+    m_fee_index_by_id.erase(it);
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::clear_fee_index()
+  {
+    CRITICAL_REGION_LOCAL(m_fee_index_lock);
+    m_fee_index.clear();
+    m_fee_index_by_id.clear();
+    m_fee_index_offers_del.clear();
+    m_fee_index_alias_regs_count = 0;
+    m_fee_index_total_bytes = 0;
+    m_pool_ms_outs.clear();
+    m_pool_ms_ins.clear();
+    m_pool_tx_ms_ids.clear();
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::insert_into_dependency_graph(const crypto::hash& tx_id, const transaction& tx)
+  {
+    std::vector<ms_out_info> ms_ids;
+    collect_multisig_ids_from_tx(tx, ms_ids);
+    remove_from_dependency_graph(tx_id);
+    for (const auto& el : ms_ids)
+      insert_dependency_graph_link(tx_id, el.multisig_id, el.is_input, el.input_output_index);
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::insert_dependency_graph_link(const crypto::hash& tx_id, const crypto::hash& ms_id, bool is_input, uint64_t out_n)
+  {
+    CRITICAL_REGION_LOCAL(m_fee_index_lock);
+    tx_ms_ids& links = m_pool_tx_ms_ids[tx_id];
+    if (is_input)
+    {
+      links.ins.push_back(ms_id);
+      m_pool_ms_ins[ms_id] = tx_id;
+    }
+    else
+    {
+      links.outs.push_back(ms_id);
+      m_pool_ms_outs[ms_id] = ms_out_link({ tx_id, out_n });
+    }
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::remove_from_dependency_graph(const crypto::hash& tx_id)
+  {
+    CRITICAL_REGION_LOCAL(m_fee_index_lock);
+    auto it = m_pool_tx_ms_ids.find(tx_id);
+    if (it == m_pool_tx_ms_ids.end())
+      return;
+    // kept_by_block txs may conflict with others, so a link is removed only if it still belongs to this tx
+    for (const auto& ms_id : it->second.ins)
+    {
+      auto it_in = m_pool_ms_ins.find(ms_id);
+      if (it_in != m_pool_ms_ins.end() && it_in->second == tx_id)
+        m_pool_ms_ins.erase(it_in);
+    }
+    for (const auto& ms_id : it->second.outs)
+    {
+      auto it_out = m_pool_ms_outs.find(ms_id);
+      if (it_out != m_pool_ms_outs.end() && it_out->second.tx_id == tx_id)
+        m_pool_ms_outs.erase(it_out);
+    }
+    m_pool_tx_ms_ids.erase(it);
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::get_unconfirmed_ancestors(const crypto::hash& id, std::vector<fee_index_entry>& ancestors) const
+  {
+    ancestors.clear();
+    CRITICAL_REGION_LOCAL(m_fee_index_lock);
+    // iterative dfs, a tx is put to the result after all its parents, so the result is in a valid in-block order
+    std::unordered_set<crypto::hash> seen({ id });
+    std::vector<std::pair<crypto::hash, size_t>> stack({ { id, 0 } }); // tx id, index of its next input to follow
+    while (!stack.empty())
+    {
+      auto it_links = m_pool_tx_ms_ids.find(stack.back().first);
+      if (it_links != m_pool_tx_ms_ids.end() && stack.back().second < it_links->second.ins.size())
+      {
+        auto it_out = m_pool_ms_outs.find(it_links->second.ins[stack.back().second++]);
+        if (it_out != m_pool_ms_outs.end() && seen.insert(it_out->second.tx_id).second)
+          stack.push_back({ it_out->second.tx_id, 0 });
+        continue;
+      }
+      crypto::hash done_id = stack.back().first;
+      stack.pop_back();
+      if (done_id == id)
+        continue;
+      auto it_entry = m_fee_index_by_id.find(done_id);
+      if (it_entry != m_fee_index_by_id.end())
+        ancestors.push_back(*it_entry->second);
+      if (ancestors.size() >= TX_POOL_MAX_PACKAGE_COUNT)
+        return false;
+    }
+    return true;
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::get_tx_package(const crypto::hash& id, std::vector<crypto::hash>& package) const
+  {
+    package.clear();
+    std::vector<fee_index_entry> ancestors;
+    bool r = get_unconfirmed_ancestors(id, ancestors);
+    for (const auto& e : ancestors)
+      package.push_back(e.id);
+    package.push_back(id);
+    return r;
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::get_tx_descendants(const crypto::hash& id, std::vector<crypto::hash>& descendants) const
+  {
+    descendants.clear();
+    CRITICAL_REGION_LOCAL(m_fee_index_lock);
+    std::unordered_set<crypto::hash> seen({ id });
+    std::vector<crypto::hash> queue({ id });
+    for (size_t i = 0; i != queue.size(); ++i)
+    {
+      auto it_links = m_pool_tx_ms_ids.find(queue[i]);
+      if (it_links == m_pool_tx_ms_ids.end())
+        continue;
+      for (const auto& ms_id : it_links->second.outs)
+      {
+        auto it_in = m_pool_ms_ins.find(ms_id);
+        if (it_in != m_pool_ms_ins.end() && seen.insert(it_in->second).second)
+        {
+          queue.push_back(it_in->second);
+          descendants.push_back(it_in->second);
+        }
+      }
+    }
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::get_tx_package_fee(const crypto::hash& id, uint64_t& package_fee, uint64_t& package_blob_size) const
+  {
+    std::vector<fee_index_entry> ancestors;
+    get_unconfirmed_ancestors(id, ancestors);
+    CRITICAL_REGION_LOCAL(m_fee_index_lock);
+    auto it = m_fee_index_by_id.find(id);
+    if (it == m_fee_index_by_id.end())
+      return false;
+    package_fee = it->second->fee;
+    package_blob_size = it->second->blob_size;
+    for (const auto& e : ancestors)
+    {
+      package_fee += e.fee;
+      package_blob_size += e.blob_size;
+    }
+    return true;
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::get_pool_ms_sources(const transaction& tx, unconfirmed_ms_outs_map& sources, std::vector<crypto::hash>& parents) const
+  {
+    sources.clear();
+    parents.clear();
+    std::vector<std::pair<crypto::hash, ms_out_link>> links;
+    {
+      CRITICAL_REGION_LOCAL(m_fee_index_lock);
+      for (const auto& in : tx.vin)
+      {
+        if (!tools::is_variant_type<txin_multisig>(in))
+          continue;
+        const crypto::hash& ms_id = boost::get<txin_multisig>(in).multisig_out_id;
+        auto it = m_pool_ms_outs.find(ms_id);
+        if (it != m_pool_ms_outs.end())
+          links.push_back(std::make_pair(ms_id, it->second));
+      }
+    }
+    for (const auto& l : links)
+    {
+      std::shared_ptr<const tx_details> txd_ptr = m_db_transactions.get(l.second.tx_id);
+      if (!txd_ptr)
+        continue; // has just been taken
+      sources[l.first] = unconfirmed_ms_out({ std::shared_ptr<const transaction>(txd_ptr, &txd_ptr->tx), static_cast<size_t>(l.second.out_n) });
+      if (std::find(parents.begin(), parents.end(), l.second.tx_id) == parents.end())
+        parents.push_back(l.second.tx_id);
+    }
+    return !sources.empty();
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::load_indexes()
+  {
+    // single pass over the pool db for all the in-memory indexes
+    clear_fee_index();
+    {
+      CRITICAL_REGION_LOCAL(m_key_images_lock);
+      m_key_images.clear();
+      m_key_images.reserve(m_db_transactions.size() * 2);
+    }
+    m_db_transactions.enumerate_items([&](uint64_t i, const crypto::hash& h, const tx_details &tx_entry)
+    {
+      insert_key_images(h, tx_entry.tx, tx_entry.kept_by_block);
+      insert_into_fee_index(h, tx_entry.tx, tx_entry.blob_size, tx_entry.fee, tx_entry.kept_by_block);
+      insert_into_dependency_graph(h, tx_entry.tx);
+      return true;
+    });
+    reset_changes_log();
+    return true;
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::log_pool_change(const crypto::hash& id, bool added)
+  {
+    {
+      CRITICAL_REGION_LOCAL(m_changes_log_lock);
+      m_changes_log.push_back(pool_change({ ++m_pool_version, id, added }));
+      if (m_changes_log.size() > TX_POOL_CHANGES_LOG_MAX_COUNT)
+      {
+        m_changes_log_min_version = m_changes_log.front().version;
+        m_changes_log.pop_front();
+      }
+    }
+    m_blockchain.get_change_notifier().notify();
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::reset_changes_log()
+  {
+    {
+      CRITICAL_REGION_LOCAL(m_changes_log_lock);
+      m_changes_log.clear();
+      m_changes_log_min_version = ++m_pool_version;
+    }
+    m_blockchain.get_change_notifier().notify();
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::get_changes_since(uint64_t pool_instance_id, uint64_t since_version, std::unordered_map<crypto::hash, bool>& changes, uint64_t& pool_version) const
+  {
+    CRITICAL_REGION_LOCAL(m_changes_log_lock);
+    pool_version = m_pool_version;
+    if (pool_instance_id != m_pool_instance_id || since_version < m_changes_log_min_version || since_version > pool_version)
+      return false;
+    // versions are increasing along the log
+    auto it = std::upper_bound(m_changes_log.begin(), m_changes_log.end(), since_version, [](uint64_t v, const pool_change& c) { return v < c.version; });
+    for (; it != m_changes_log.end(); ++it)
+      changes[it->id] = it->added;
+    return true;
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::get_transactions_changes(uint64_t pool_instance_id, uint64_t since_version, std::list<blobdata>& added_blobs, std::list<crypto::hash>& removed_ids, uint64_t& pool_version) const
+  {
+    std::unordered_map<crypto::hash, bool> changes; // tx id -> is in the pool now
+    if (!get_changes_since(pool_instance_id, since_version, changes, pool_version))
+      return false;
+
+    for (const auto& c : changes)
+    {
+      std::shared_ptr<const tx_details> txd_ptr = c.second ? m_db_transactions.get(c.first) : std::shared_ptr<const tx_details>();
+      if (c.second && !txd_ptr)
+        return false; // the change isn't committed yet, such a rare case isn't worth handling
+      if (txd_ptr)
+        added_blobs.push_back(t_serializable_object_to_blob(txd_ptr->tx));
+      else
+        removed_ids.push_back(c.first);
+    }
+    return true;
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::get_transactions_changes_ids(uint64_t pool_instance_id, uint64_t since_version, std::list<crypto::hash>& added_ids, std::list<crypto::hash>& removed_ids, uint64_t& pool_version) const
+  {
+    std::unordered_map<crypto::hash, bool> changes;
+    if (!get_changes_since(pool_instance_id, since_version, changes, pool_version))
+      return false;
+
+    for (const auto& c : changes)
+      (c.second ? added_ids : removed_ids).push_back(c.first);
+    return true;
+  }
+  //--------------------------------------------------------------------------------- 
+  namespace
+  {
+    // indexes snapshot file layout: [header][fee index records][key image records][multisig links records]
+    // it's valid only if its nonce matches the one stored in the pool db by the same clean shutdown
+    struct indexes_snapshot_header
+    {
+      uint64_t signature;
+      uint64_t version;
+      uint64_t nonce;
+      uint64_t txs_count;
+      uint64_t fee_records_count;
+      uint64_t key_image_records_count;
+      uint64_t ms_link_records_count;
+      uint64_t hardfork_id;
+      crypto::hash payload_hash;
+    };
+
+    struct indexes_snapshot_fee_record
+    {
+      crypto::hash id;
+      uint64_t fee;
+      uint64_t blob_size;
+      uint8_t flags;
+      uint8_t reserved[7];
+    };
+
+    struct indexes_snapshot_key_image_record
+    {
+      crypto::key_image k_image;
+      crypto::hash tx_id;
+    };
+
+    struct indexes_snapshot_ms_link_record
+    {
+      crypto::hash tx_id;
+      crypto::hash ms_id;
+      uint64_t out_n;
+      uint8_t is_input;
+      uint8_t reserved[7];
+    };
+
+    static_assert(sizeof(indexes_snapshot_header) == 96 && sizeof(indexes_snapshot_fee_record) == 56 && sizeof(indexes_snapshot_key_image_record) == 64 &&
+      sizeof(indexes_snapshot_ms_link_record) == 80,
+      "indexes snapshot records layout is a part of the file format, change TX_POOL_INDEXES_SNAPSHOT_VERSION if it changes");
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::store_indexes_snapshot()
+  {
+    TRY_ENTRY();
+    TIME_MEASURE_START_MS(store_time);
+    indexes_snapshot_header hdr = AUTO_VAL_INIT(hdr);
+    hdr.signature = TX_POOL_INDEXES_SNAPSHOT_SIGNATURE;
+    hdr.version = TX_POOL_INDEXES_SNAPSHOT_VERSION;
+    hdr.nonce = crypto::rand<uint64_t>() | 1; // never zero
+    hdr.txs_count = m_db_transactions.size();
+    hdr.hardfork_id = UINT64_MAX;
+    if (m_blockchain.get_current_blockchain_size() != 0)
+      hdr.hardfork_id = m_blockchain.get_core_runtime_config().hard_forks.get_the_most_recent_hardfork_id_for_height(m_blockchain.get_top_block_height() + 1);
+
+    std::string buff(sizeof(hdr), '\0');
+    {
+      CRITICAL_REGION_LOCAL(m_fee_index_lock);
+      hdr.fee_records_count = m_fee_index.size();
+      buff.reserve(sizeof(hdr) + m_fee_index.size() * (sizeof(indexes_snapshot_fee_record) + 2 * sizeof(indexes_snapshot_key_image_record)));
+      for (const auto& e : m_fee_index)
+      {
+        indexes_snapshot_fee_record r = AUTO_VAL_INIT(r);
+        r.id = e.id;
+        r.fee = e.fee;
+        r.blob_size = e.blob_size;
+        r.flags = (e.has_alias ? TX_POOL_INDEXES_SNAPSHOT_FLAG_HAS_ALIAS : 0) | (e.alias_update ? TX_POOL_INDEXES_SNAPSHOT_FLAG_ALIAS_UPDATE : 0) |
+          (e.offers_del ? TX_POOL_INDEXES_SNAPSHOT_FLAG_OFFERS_DEL : 0) | (e.kept_by_block ? TX_POOL_INDEXES_SNAPSHOT_FLAG_KEPT_BY_BLOCK : 0);
+        buff.append(reinterpret_cast<const char*>(&r), sizeof(r));
+      }
+    }
+    {
+      CRITICAL_REGION_LOCAL(m_key_images_lock);
+      hdr.key_image_records_count = m_key_images.size();
+      m_key_images.for_each([&](const crypto::key_image& ki, const crypto::hash& tx_id)
+      {
+        indexes_snapshot_key_image_record r = AUTO_VAL_INIT(r);
+        r.k_image = ki;
+        r.tx_id = tx_id;
+        buff.append(reinterpret_cast<const char*>(&r), sizeof(r));
+        return true;
+      });
+    }
+    {
+      CRITICAL_REGION_LOCAL(m_fee_index_lock);
+      for (const auto& links : m_pool_tx_ms_ids)
+      {
+        for (const auto& ms_id : links.second.ins)
+        {
+          indexes_snapshot_ms_link_record r = AUTO_VAL_INIT(r);
+          r.tx_id = links.first;
+          r.ms_id = ms_id;
+          r.is_input = 1;
+          buff.append(reinterpret_cast<const char*>(&r), sizeof(r));
+          ++hdr.ms_link_records_count;
+        }
+        for (const auto& ms_id : links.second.outs)
+        {
+          auto it_out = m_pool_ms_outs.find(ms_id);
+          if (it_out == m_pool_ms_outs.end() || it_out->second.tx_id != links.first)
+            continue;
+          indexes_snapshot_ms_link_record r = AUTO_VAL_INIT(r);
+          r.tx_id = links.first;
+          r.ms_id = ms_id;
+          r.out_n = it_out->second.out_n;
+          buff.append(reinterpret_cast<const char*>(&r), sizeof(r));
+          ++hdr.ms_link_records_count;
+        }
+      }
+    }
+    if (hdr.fee_records_count != hdr.txs_count)
+    {
+      LOG_PRINT_YELLOW("tx pool: indexes snapshot not stored: fee index has " << hdr.fee_records_count << " entries while pool has " << hdr.txs_count << " txs", LOG_LEVEL_0);
+      return false;
+    }
+    hdr.payload_hash = crypto::cn_fast_hash(buff.data() + sizeof(hdr), buff.size() - sizeof(hdr));
+    memcpy(&buff[0], &hdr, sizeof(hdr));
+
+    const std::string snapshot_path = m_db_folder_path + "/" TX_POOL_INDEXES_SNAPSHOT_FILENAME;
+    if (!epee::file_io_utils::save_string_to_file(snapshot_path, buff))
+    {
+      LOG_PRINT_YELLOW("tx pool: failed to store indexes snapshot to " << snapshot_path, LOG_LEVEL_0);
+      return false;
+    }
+    m_db.begin_transaction();
+    m_db_indexes_snapshot_nonce = hdr.nonce;
+    m_db.commit_transaction();
+    TIME_MEASURE_FINISH_MS(store_time);
+    LOG_PRINT_L0("tx pool: indexes snapshot stored (" << hdr.txs_count << " txs, " << buff.size() << " bytes) in " << store_time << " ms");
     return true;
+    CATCH_ENTRY2(false);
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::load_indexes_snapshot()
+  {
+    TRY_ENTRY();
+    m_indexes_snapshot_hardfork_id = UINT64_MAX;
+    const std::string snapshot_path = m_db_folder_path + "/" TX_POOL_INDEXES_SNAPSHOT_FILENAME;
+    if (!boost::filesystem::exists(epee::string_encoding::utf8_to_wstring(snapshot_path)))
+      return false;
+
+    TIME_MEASURE_START_MS(load_time);
+    std::string buff;
+    bool r = epee::file_io_utils::load_file_to_string(snapshot_path, buff);
+    boost::system::error_code ec;
+    boost::filesystem::remove(epee::string_encoding::utf8_to_wstring(snapshot_path), ec); // a snapshot is used once
+    CHECK_AND_ASSERT_MES(r, false, "tx pool: failed to read indexes snapshot " << snapshot_path);
+
+    indexes_snapshot_header hdr = AUTO_VAL_INIT(hdr);
+    if (buff.size() < sizeof(hdr))
+    {
+      LOG_PRINT_YELLOW("tx pool: indexes snapshot is too small, indexes will be rebuilt", LOG_LEVEL_0);
+      return false;
+    }
+    memcpy(&hdr, buff.data(), sizeof(hdr));
+    if (hdr.signature != TX_POOL_INDEXES_SNAPSHOT_SIGNATURE || hdr.version != TX_POOL_INDEXES_SNAPSHOT_VERSION)
+    {
+      LOG_PRINT_YELLOW("tx pool: indexes snapshot has unexpected signature or version " << hdr.version << ", indexes will be rebuilt", LOG_LEVEL_0);
+      return false;
+    }
+    uint64_t expected_nonce = m_db_indexes_snapshot_nonce;
+    if (hdr.nonce != expected_nonce || hdr.txs_count != m_db_transactions.size() || hdr.fee_records_count != hdr.txs_count)
+    {
+      // the pool db was changed after the snapshot had been written (e.g. the daemon wasn't stopped cleanly)
+      LOG_PRINT_YELLOW("tx pool: indexes snapshot is outdated, indexes will be rebuilt", LOG_LEVEL_0);
+      return false;
+    }
+    const uint64_t max_records = buff.size() / sizeof(indexes_snapshot_fee_record);
+    if (hdr.fee_records_count > max_records || hdr.key_image_records_count > max_records || hdr.ms_link_records_count > max_records ||
+      buff.size() != sizeof(hdr) + hdr.fee_records_count * sizeof(indexes_snapshot_fee_record) + hdr.key_image_records_count * sizeof(indexes_snapshot_key_image_record) +
+        hdr.ms_link_records_count * sizeof(indexes_snapshot_ms_link_record) ||
+      hdr.payload_hash != crypto::cn_fast_hash(buff.data() + sizeof(hdr), buff.size() - sizeof(hdr)))
+    {
+      LOG_PRINT_YELLOW("tx pool: indexes snapshot is corrupted, indexes will be rebuilt", LOG_LEVEL_0);
+      return false;
+    }
+
+    clear_fee_index();
+    const char* p = buff.data() + sizeof(hdr);
+    for (uint64_t i = 0; i != hdr.fee_records_count; ++i, p += sizeof(indexes_snapshot_fee_record))
+    {
+      indexes_snapshot_fee_record rec = AUTO_VAL_INIT(rec);
+      memcpy(&rec, p, sizeof(rec));
+      fee_index_entry e = AUTO_VAL_INIT(e);
+      e.id = rec.id;
+      e.fee = rec.fee;
+      e.blob_size = rec.blob_size;
+      e.has_alias = (rec.flags & TX_POOL_INDEXES_SNAPSHOT_FLAG_HAS_ALIAS) != 0;
+      e.alias_update = (rec.flags & TX_POOL_INDEXES_SNAPSHOT_FLAG_ALIAS_UPDATE) != 0;
+      e.offers_del = (rec.flags & TX_POOL_INDEXES_SNAPSHOT_FLAG_OFFERS_DEL) != 0;
+      e.kept_by_block = (rec.flags & TX_POOL_INDEXES_SNAPSHOT_FLAG_KEPT_BY_BLOCK) != 0;
+      insert_fee_index_entry(e);
+    }
+    {
+      CRITICAL_REGION_LOCAL(m_key_images_lock);
+      m_key_images.clear();
+      m_key_images.reserve(static_cast<size_t>(hdr.key_image_records_count));
+      for (uint64_t i = 0; i != hdr.key_image_records_count; ++i, p += sizeof(indexes_snapshot_key_image_record))
+      {
+        indexes_snapshot_key_image_record rec = AUTO_VAL_INIT(rec);
+        memcpy(&rec, p, sizeof(rec));
+        m_key_images.insert(rec.k_image, rec.tx_id);
+      }
+    }
+    for (uint64_t i = 0; i != hdr.ms_link_records_count; ++i, p += sizeof(indexes_snapshot_ms_link_record))
+    {
+      indexes_snapshot_ms_link_record rec = AUTO_VAL_INIT(rec);
+      memcpy(&rec, p, sizeof(rec));
+      insert_dependency_graph_link(rec.tx_id, rec.ms_id, rec.is_input != 0, rec.out_n);
+    }
+    m_indexes_snapshot_hardfork_id = hdr.hardfork_id;
+    reset_changes_log();
+    TIME_MEASURE_FINISH_MS(load_time);
+    LOG_PRINT_L0("tx pool: indexes loaded from snapshot (" << hdr.txs_count << " txs) in " << load_time << " ms");
+    return true;
+    CATCH_ENTRY2(false);
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::get_fee_index_chunk(const fee_index_entry* p_after, size_t max_count, std::vector<fee_index_entry>& result) const
+  {
+    result.clear();
+    CRITICAL_REGION_LOCAL(m_fee_index_lock);
+    auto it = p_after ? m_fee_index.upper_bound(*p_after) : m_fee_index.begin();
+    for (; it != m_fee_index.end() && result.size() < max_count; ++it)
+      result.push_back(*it);
+  }
+  //--------------------------------------------------------------------------------- 
+  uint64_t tx_memory_pool::get_total_blobs_size() const
+  {
+    CRITICAL_REGION_LOCAL(m_fee_index_lock);
+    return m_fee_index_total_bytes;
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::select_eviction_victims(uint64_t blob_size, uint64_t fee, std::vector<fee_index_entry>& victims) const
+  {
+    victims.clear();
+    if (m_max_pool_bytes == 0)
+      return true;
+    uint64_t total_bytes = get_total_blobs_size();
+    if (total_bytes + blob_size <= m_max_pool_bytes)
+      return true;
+    if (blob_size > m_max_pool_bytes)
+      return false;
+    const uint64_t need_bytes = total_bytes + blob_size - m_max_pool_bytes;
+    uint64_t freed_bytes = 0;
+
+    // walk from the lowest fee rate up, in chunks, as the blockchain must not be queried while holding the index lock
+    std::unordered_set<crypto::hash> victim_ids;
+    std::vector<fee_index_entry> chunk;
+    fee_index_entry last_entry = AUTO_VAL_INIT(last_entry);
+    bool has_last = false;
+    while (true)
+    {
+      chunk.clear();
+      {
+        CRITICAL_REGION_LOCAL(m_fee_index_lock);
+        auto it = has_last ? fee_index::const_reverse_iterator(m_fee_index.lower_bound(last_entry)) : m_fee_index.crbegin();
+        for (; it != m_fee_index.crend() && chunk.size() < TX_POOL_FEE_INDEX_WALK_CHUNK_SIZE; ++it)
+          chunk.push_back(*it);
+      }
+      if (chunk.empty())
+        return false;
+      last_entry = chunk.back();
+      has_last = true;
+
+      for (const auto& e : chunk)
+      {
+        if (e.kept_by_block || victim_ids.count(e.id))
+          continue;
+        // a tx is evicted only for one with strictly higher fee per byte, and all the rest have at least the same rate
+        if (boost::multiprecision::uint128_t(fee) * e.blob_size <= boost::multiprecision::uint128_t(e.fee) * blob_size)
+          return false;
+
+        // a tx is evicted together with its descendants, as they are invalid without it
+        std::vector<crypto::hash> descendant_ids;
+        get_tx_descendants(e.id, descendant_ids);
+        std::vector<fee_index_entry> group({ e });
+        {
+          CRITICAL_REGION_LOCAL(m_fee_index_lock);
+          for (const auto& d : descendant_ids)
+          {
+            auto it = m_fee_index_by_id.find(d);
+            if (it != m_fee_index_by_id.end() && !victim_ids.count(d))
+              group.push_back(*it->second);
+          }
+        }
+        uint64_t group_fee = 0, group_bytes = 0;
+        bool group_ok = true;
+        for (const auto& g : group)
+        {
+          //never remove transactions which related to alt blocks (see remove_stuck_transactions)
+          if (g.kept_by_block || m_blockchain.is_tx_related_to_altblock(g.id))
+          {
+            group_ok = false;
+            break;
+          }
+          group_fee += g.fee;
+          group_bytes += g.blob_size;
+        }
+        // descendants may pay for their parent (the same applies to block templates), so compare with the whole group rate
+        if (!group_ok || boost::multiprecision::uint128_t(fee) * group_bytes <= boost::multiprecision::uint128_t(group_fee) * blob_size)
+          continue;
+        for (const auto& g : group)
+        {
+          victim_ids.insert(g.id);
+          victims.push_back(g);
+        }
+        freed_bytes += group_bytes;
+        if (freed_bytes >= need_bytes)
+          return true;
+      }
+    }
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::make_room_for_tx(const crypto::hash& id, uint64_t blob_size, uint64_t fee)
+  {
+    std::vector<fee_index_entry> victims;
+    if (!select_eviction_victims(blob_size, fee, victims))
+    {
+      remember_evicted_tx(id);
+      return false;
+    }
+    if (victims.empty())
+      return true;
+
+    m_db_transactions.begin_transaction();
+    misc_utils::auto_scope_leave_caller seh = misc_utils::create_scope_leave_handler([&](){m_db_transactions.commit_transaction(); });
+    for (const auto& v : victims)
+    {
+      auto txd_ptr = m_db_transactions.get(v.id);
+      if (!txd_ptr)
+        continue; // has just been taken
+      transaction tx = txd_ptr->tx;
+      bool kept_by_block = txd_ptr->kept_by_block;
+      m_db_transactions.erase(v.id);
+      on_tx_remove(v.id, tx, kept_by_block);
+      remember_evicted_tx(v.id);
+      LOG_PRINT_L1("tx " << v.id << " evicted from the pool to make room for " << id << " (fee " << print_money_brief(v.fee) << ", size " << v.blob_size << ")");
+    }
+    return true;
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::remember_evicted_tx(const crypto::hash& id)
+  {
+    uint64_t now = get_core_time();
+    CRITICAL_REGION_LOCAL(m_evicted_txs_lock);
+    if (m_evicted_txs.size() >= TX_POOL_EVICTED_TXS_MAX_COUNT)
+    {
+      for (auto it = m_evicted_txs.begin(); it != m_evicted_txs.end();)
+      {
+        if (it->second + TX_POOL_EVICTED_TXS_REMEMBER_SECONDS < now)
+          it = m_evicted_txs.erase(it);
+        else
+          ++it;
+      }
+      if (m_evicted_txs.size() >= TX_POOL_EVICTED_TXS_MAX_COUNT)
+        m_evicted_txs.clear();
+    }
+    m_evicted_txs[id] = now;
+  }
+  //--------------------------------------------------------------------------------- 
+  bool tx_memory_pool::is_tx_recently_evicted(const crypto::hash& id) const
+  {
+    CRITICAL_REGION_LOCAL(m_evicted_txs_lock);
+    auto it = m_evicted_txs.find(id);
+    return it != m_evicted_txs.end() && it->second + TX_POOL_EVICTED_TXS_REMEMBER_SECONDS >= get_core_time();
+  }
+  //--------------------------------------------------------------------------------- 
+  void tx_memory_pool::get_fee_index_offers_del(std::vector<fee_index_entry>& result) const
+  {
+    result.clear();
+    CRITICAL_REGION_LOCAL(m_fee_index_lock);
+    for (const auto& id : m_fee_index_offers_del)
+    {
+      auto it = m_fee_index_by_id.find(id);
+      if (it != m_fee_index_by_id.end())
+        result.push_back(*it->second);
+    }
+    std::sort(result.begin(), result.end(), fee_index_less());
   }
   //--------------------------------------------------------------------------------- 
   bool tx_memory_pool::insert_alias_info(const transaction& tx)
@@ -827,49 +1746,37 @@ namespace currency
     {
       crypto::key_image k_image = AUTO_VAL_INIT(k_image);
       if (get_key_image_from_txin_v(in, k_image))
-      {        
-        auto it_map = epee::misc_utils::it_get_or_insert_value_initialized(m_key_images, k_image);
-        auto& id_set = it_map->second;
-        size_t count_before = id_set.size();
-        auto it_set =  id_set.find(tx_id);
-        if(it_set != id_set.end())
-          id_set.erase(it_set);
-
-        size_t count_after = id_set.size();
-        if (id_set.size() == 0)
-          m_key_images.erase(it_map);
-
-        LOG_PRINT_L2("tx pool: key image removed: " << k_image << ", from tx " << tx_id << ", counter: " << count_before << " -> " << count_after);
+      {
+        m_key_images.erase(k_image, tx_id);
+        LOG_PRINT_L2("tx pool: key image removed: " << k_image << ", from tx " << tx_id << ", counter: " << m_key_images.count(k_image));
       }
     }
     return false;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::get_key_images_from_tx_pool(key_image_cache& key_images) const
-  {    
-    m_db_transactions.enumerate_items([&](uint64_t i, const crypto::hash& h, const tx_details &tx_entry)
-    {
-      for (auto& in : tx_entry.tx.vin)
-      {
-        crypto::key_image k_image = AUTO_VAL_INIT(k_image);
-        if (get_key_image_from_txin_v(in, k_image))
-        {
-          key_images[k_image].insert(h);
-        }
-      }
-      return true;
-    });
-
-    return true;
+  bool tx_memory_pool::have_tx_keyimg_as_spent(const crypto::key_image& key_im)const
+  {
+    CRITICAL_REGION_LOCAL(m_key_images_lock);
+    return m_key_images.contains(key_im);
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::have_tx_keyimg_as_spent(const crypto::key_image& key_im)const
+  void tx_memory_pool::get_conflicting_txs(const transaction& tx, std::vector<crypto::hash>& conflicting_tx_ids) const
   {
+    conflicting_tx_ids.clear();
+    crypto::hash tx_id = get_transaction_hash(tx);
     CRITICAL_REGION_LOCAL(m_key_images_lock);
-    auto it = m_key_images.find(key_im);
-    if (it != m_key_images.end())
-      return true;
-    return false;
+    for (const auto& in : tx.vin)
+    {
+      crypto::key_image k_image = AUTO_VAL_INIT(k_image);
+      if (!get_key_image_from_txin_v(in, k_image))
+        continue;
+      m_key_images.for_each_value(k_image, [&](const crypto::hash& id)
+      {
+        if (id != tx_id && std::find(conflicting_tx_ids.begin(), conflicting_tx_ids.end(), id) == conflicting_tx_ids.end())
+          conflicting_tx_ids.push_back(id);
+        return true;
+      });
+    }
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::lock()
@@ -890,6 +1797,8 @@ namespace currency
     m_db.commit_transaction();
     // should m_db_black_tx_list be cleared here?
     CIRITCAL_OPERATION(m_key_images,clear());
+    clear_fee_index();
+    reset_changes_log();
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::clear()
@@ -899,15 +1808,28 @@ namespace currency
     m_db_black_tx_list.clear();
     m_db.commit_transaction();
     CIRITCAL_OPERATION(m_key_images,clear());
+    clear_fee_index();
+    reset_changes_log();
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::is_transaction_ready_to_go(tx_details& txd, const crypto::hash& id)const 
+  bool tx_memory_pool::is_transaction_ready_to_go(tx_details& txd, const crypto::hash& id, const unconfirmed_ms_outs_map* p_unconfirmed_ms_outs /* = nullptr */)const 
   {
     //not the best implementation at this time, sorry :(
 
     if (is_tx_blacklisted(get_transaction_hash(txd.tx)))
       return false;
 
+    if (p_unconfirmed_ms_outs)
+    {
+      // a package member: its inputs may refer to txs going earlier in the same block, so it's checked each time and no results are kept
+      uint64_t max_used_block_height = 0;
+      if (!m_blockchain.check_tx_inputs(txd.tx, id, max_used_block_height, p_unconfirmed_ms_outs))
+        return false;
+      if (m_blockchain.have_tx_keyimges_as_spent(txd.tx))
+        return false;
+      return check_tx_multisig_ins_and_outs(txd.tx, false);
+    }
+
     //check is ring_signature already checked ?
     if(txd.max_used_block_id == null_hash)
     {//not checked, lets try to check
@@ -1053,41 +1975,30 @@ namespace currency
   )
   {
     LOCAL_READONLY_TRANSACTION();
-    //typedef transactions_container::value_type txv;
-    typedef std::pair<crypto::hash, std::shared_ptr<const tx_details> > txv;
-    
 
-    std::vector<txv> txs_v;
-    txs_v.reserve(m_db_transactions.size());
-    std::vector<size_t> txs; // selected transactions, vector of indices of txs_v
+    const uint64_t tx_expiration_ts_median = m_blockchain.get_tx_expiration_median();
 
-    
-    //keep getting it as a values cz db items cache will keep it as unserialised object stored by shared ptrs 
-    m_db_transactions.enumerate_keys([&](uint64_t i, crypto::hash& k){txs_v.resize(i + 1); txs_v[i].first = k; return true;});
-    txs.resize(txs_v.size(), SIZE_MAX);
-    
-    for (uint64_t i = 0; i != txs_v.size(); i++)
-    {      
-      auto& k = txs_v[i].first;
-      txs_v[i].second = m_db_transactions.get(k);
-      if (!txs_v[i].second)
+    // fast path: nothing has changed since the previous template
+    block_template_cache request;
+    request.pool_version = m_pool_version;
+    request.top_block_id = m_blockchain.get_top_block_id();
+    request.height = height;
+    request.pos = pos;
+    request.median_size = median_size;
+    request.already_generated_coins = already_generated_coins;
+    request.tx_expiration_ts_median = tx_expiration_ts_median;
+    if (explicit_txs.empty())
+    {
+      CRITICAL_REGION_LOCAL(m_block_template_cache_lock);
+      if (m_block_template_cache.is_same_request(request))
       {
-        LOG_ERROR("Internal tx pool db error: key " << k << " was enumerated as key but couldn't get value");
-        return false;
+        bl.tx_hashes.insert(bl.tx_hashes.end(), m_block_template_cache.tx_hashes.begin(), m_block_template_cache.tx_hashes.end());
+        total_size = m_block_template_cache.total_size;
+        fee = m_block_template_cache.fee;
+        return true;
       }
-      txs[i] = i;
     }
 
-    
-    
-    std::sort(txs.begin(), txs.end(), [&txs_v](size_t a, size_t b) -> bool {
-      boost::multiprecision::uint128_t a_, b_;
-      a_ = boost::multiprecision::uint128_t(txs_v[a].second->fee) * txs_v[b].second->blob_size;
-      b_ = boost::multiprecision::uint128_t(txs_v[b].second->fee) * txs_v[a].second->blob_size;
-      return a_ > b_;
-    });
-
-
     size_t explicit_total_size = get_objects_blobsize(explicit_txs);
     size_t current_size = explicit_total_size;
     uint64_t current_fee = 0;
@@ -1101,104 +2012,189 @@ namespace currency
     fee = 0;
     uint64_t alias_count = 0;
 
-    // scan txs for alias reg requests - if there are such requests, don't process alias updates
+    // if there are alias reg requests, don't process alias updates
     bool alias_regs_exist = false;
-    for (auto txi : txs) 
     {
-      tx_extra_info ei = AUTO_VAL_INIT(ei);
-      bool r = parse_and_validate_tx_extra(txs_v[txi].second->tx, ei);
-      CHECK_AND_ASSERT_MES(r, false, "parse_and_validate_tx_extra failed while looking up the tx pool");
-      if (!ei.m_alias.m_alias.empty() && !ei.m_alias.m_sign.size()) {
-        alias_regs_exist = true;
-        break;
-      }
+      CRITICAL_REGION_LOCAL(m_fee_index_lock);
+      alias_regs_exist = m_fee_index_alias_regs_count != 0;
     }
 
-    const uint64_t tx_expiration_ts_median = m_blockchain.get_tx_expiration_median();
-
     std::unordered_set<crypto::key_image> k_images;
-
-    for (size_t i = 0; i < txs.size(); i++)
+    std::unordered_set<crypto::hash> visited;
+    std::unordered_set<crypto::hash> included;
+    unconfirmed_ms_outs_map template_ms_outs;  // multisig outputs of the txs included so far
+    std::vector<fee_index_entry> passed; // txs passed all the checks, in fee rate order
+
+    // walk the index from the top in chunks (copied under the index lock, so the blockchain is never queried while holding it)
+    // until the block gets too big
+    std::vector<fee_index_entry> chunk;
+    fee_index_entry last_entry = AUTO_VAL_INIT(last_entry);
+    bool size_limit_reached = false;
+    while (!size_limit_reached)
     {
-      txv &tx(txs_v[txs[i]]);
+      get_fee_index_chunk(visited.empty() ? nullptr : &last_entry, TX_POOL_FEE_INDEX_WALK_CHUNK_SIZE, chunk);
+      if (chunk.empty())
+        break;
+      last_entry = chunk.back();
 
-      // expiration time check -- skip expired transactions
-      if (is_tx_expired(tx.second->tx, tx_expiration_ts_median))
+      for (const auto& e : chunk)
       {
-          txs[i] = SIZE_MAX;
+        visited.insert(e.id);
+        if (included.count(e.id))
+          continue; // already included as an ancestor of some other tx
+
+        // a tx goes to the block together with its unconfirmed ancestors not included yet (parents first), all of them or none
+        std::vector<fee_index_entry> package;
+        if (!get_unconfirmed_ancestors(e.id, package))
           continue;
-      } 
-      
-      // alias checks
-      tx_extra_info ei = AUTO_VAL_INIT(ei);
-      bool r = parse_and_validate_tx_extra(tx.second->tx, ei);
-      CHECK_AND_ASSERT_MES(r, false, "failed to validate transaction extra on unprocess_blockchain_tx_extra");
-      if (!ei.m_alias.m_alias.empty())
-      {
-        bool update_an_alias = !ei.m_alias.m_sign.empty();
-        if ((alias_count >= MAX_ALIAS_PER_BLOCK) ||                   // IF this tx registers/updates an alias AND alias per block threshold exceeded
-          (update_an_alias && alias_regs_exist))                      // OR this tx updates an alias AND there are alias reg requests...
+        package.erase(std::remove_if(package.begin(), package.end(), [&](const fee_index_entry& a) { return included.count(a.id) != 0; }), package.end());
+        package.push_back(e);
+
+        std::vector<std::shared_ptr<const tx_details>> package_txs;
+        unconfirmed_ms_outs_map package_ms_outs = template_ms_outs;
+        std::unordered_set<crypto::key_image> package_k_images;
+        uint64_t package_alias_count = 0;
+        bool package_ok = true;
+        for (const auto& m : package)
         {
-          txs[i] = SIZE_MAX;                                          // ...skip this tx
-          continue;
+          // alias checks
+          if (m.has_alias)
+          {
+            if ((alias_count + package_alias_count >= MAX_ALIAS_PER_BLOCK) || // IF this tx registers/updates an alias AND alias per block threshold exceeded
+              (m.alias_update && alias_regs_exist))                           // OR this tx updates an alias AND there are alias reg requests...
+            {
+              package_ok = false;                                             // ...skip this tx
+              break;
+            }
+            ++package_alias_count;
+          }
+
+          //keep getting it as a values cz db items cache will keep it as unserialised object stored by shared ptrs 
+          std::shared_ptr<const tx_details> txd_ptr = m_db_transactions.get(m.id);
+          if (!txd_ptr)
+          {
+            LOG_PRINT_L1("tx " << m.id << " is in the fee index but not in the pool db, skipped");
+            package_ok = false;
+            break;
+          }
+
+          // expiration time check -- skip expired transactions
+          if (is_tx_expired(txd_ptr->tx, tx_expiration_ts_median))
+          {
+            package_ok = false;
+            break;
+          }
+
+          //is_transaction_ready_to_go can change tx_details in case of some errors, so we make local copy, 
+          //do check if it's changed and reassign it to db if needed
+          tx_details local_copy_txd = *txd_ptr;
+          bool spends_unconfirmed = false;
+          for (const auto& in : txd_ptr->tx.vin)
+          {
+            if (tools::is_variant_type<txin_multisig>(in) && package_ms_outs.count(boost::get<txin_multisig>(in).multisig_out_id))
+              spends_unconfirmed = true;
+          }
+          const unconfirmed_ms_outs_map* p_unconfirmed_ms_outs = spends_unconfirmed ? &package_ms_outs : nullptr;
+          bool is_tx_ready_to_go_result = is_transaction_ready_to_go(local_copy_txd, m.id, p_unconfirmed_ms_outs);
+          if (!is_tx_ready_to_go_result && 
+            (local_copy_txd.last_failed_height != txd_ptr->last_failed_height || local_copy_txd.last_failed_id != txd_ptr->last_failed_id))
+          {
+            m_db_transactions.begin_transaction();
+            m_db_transactions.set(get_transaction_hash(local_copy_txd.tx), local_copy_txd);
+            m_db_transactions.commit_transaction();
+          }
+
+          if (!is_tx_ready_to_go_result || have_key_images(k_images, txd_ptr->tx) || have_key_images(package_k_images, txd_ptr->tx))
+          {
+            package_ok = false;
+            break;
+          }
+          append_key_images(package_k_images, txd_ptr->tx);
+
+          // its multisig outputs may be spent by the following package members
+          for (size_t i = 0; i != txd_ptr->tx.vout.size(); ++i)
+          {
+            const auto& out = txd_ptr->tx.vout[i];
+            if (tools::is_variant_type<tx_out_bare>(out) && tools::is_variant_type<txout_multisig>(boost::get<tx_out_bare>(out).target))
+              package_ms_outs[get_multisig_out_id(txd_ptr->tx, i)] = unconfirmed_ms_out({ std::shared_ptr<const transaction>(txd_ptr, &txd_ptr->tx), i });
+          }
+          package_txs.push_back(txd_ptr);
         }
-      }
+        if (!package_ok)
+          continue;
 
-      //is_transaction_ready_to_go can change tx_details in case of some errors, so we make local copy, 
-      //do check if it's changed and reassign it to db if needed
-      tx_details local_copy_txd = *(tx.second);
-      bool is_tx_ready_to_go_result = is_transaction_ready_to_go(local_copy_txd, tx.first);
-      if (!is_tx_ready_to_go_result && 
-        (local_copy_txd.last_failed_height != tx.second->last_failed_height || local_copy_txd.last_failed_id != tx.second->last_failed_id))
-      {
-        m_db_transactions.begin_transaction();
-        m_db_transactions.set(get_transaction_hash(local_copy_txd.tx), local_copy_txd);
-        m_db_transactions.commit_transaction();
-      }
+        for (size_t i = 0; i != package.size(); ++i)
+        {
+          const fee_index_entry& m = package[i];
+          append_key_images(k_images, package_txs[i]->tx);
+          included.insert(m.id);
+          passed.push_back(m);
+
+          current_size += m.blob_size;
+          current_fee += m.fee;
+          if (m.has_alias)
+            ++alias_count;
+
+          uint64_t current_reward;
+          if (!get_block_reward(pos, median_size, current_size + CURRENCY_COINBASE_BLOB_RESERVED_SIZE, already_generated_coins, current_reward, height))
+          {
+            size_limit_reached = true; // current block size is too big
+            break;
+          }
 
-      if (!is_tx_ready_to_go_result || have_key_images(k_images, tx.second->tx)) {
-        txs[i] = SIZE_MAX;
-        continue;
+          // ancestors go first, so any prefix of the passed txs is valid
+          if (best_money < current_reward + current_fee) {
+            best_money = current_reward + current_fee;
+            best_position = passed.size();
+            total_size = current_size;
+            fee = current_fee;
+          }
+        }
+        if (size_limit_reached)
+          break;
+        template_ms_outs.swap(package_ms_outs);
       }
-      append_key_images(k_images, tx.second->tx);
-
-      current_size += tx.second->blob_size;
-      current_fee += tx.second->fee;
+    }
 
-      uint64_t current_reward;
-      if (!get_block_reward(pos, median_size, current_size + CURRENCY_COINBASE_BLOB_RESERVED_SIZE, already_generated_coins, current_reward, height))
+    std::vector<crypto::hash> tx_hashes;
+    for (size_t i = 0; i != passed.size(); i++)
+    {
+      if (i < best_position)
       {
-        break; // current block size is too big
+        tx_hashes.push_back(passed[i].id);
       }
-
-      if (best_money < current_reward + current_fee) {
-        best_money = current_reward + current_fee;
-        best_position = i + 1;
-        total_size = current_size;
-        fee = current_fee;
+      else if (passed[i].offers_del)
+      {
+        // BC_OFFERS_SERVICE_INSTRUCTION_DEL transactions has zero fee, so include them here regardless of reward effectiveness
+        tx_hashes.push_back(passed[i].id);
+        total_size += passed[i].blob_size;
       }
-
-      if (!ei.m_alias.m_alias.empty())
-        ++alias_count;
     }
-
-    for (size_t i = 0; i != txs.size(); i++)
+    if (size_limit_reached)
     {
-      if (txs[i] != SIZE_MAX)
+      // the same for ones the walk hasn't reached
+      std::vector<fee_index_entry> offers_del;
+      get_fee_index_offers_del(offers_del);
+      for (const auto& e : offers_del)
       {
-        txv &tx(txs_v[txs[i]]);
-        if (i < best_position)
+        if (visited.count(e.id) == 0)
         {
-          bl.tx_hashes.push_back(tx.first);
-        }
-        else if (have_attachment_service_in_container(tx.second->tx.attachment, BC_OFFERS_SERVICE_ID, BC_OFFERS_SERVICE_INSTRUCTION_DEL))
-        {
-          // BC_OFFERS_SERVICE_INSTRUCTION_DEL transactions has zero fee, so include them here regardless of reward effectiveness
-          bl.tx_hashes.push_back(tx.first);
-          total_size += tx.second->blob_size;
+          tx_hashes.push_back(e.id);
+          total_size += e.blob_size;
         }
       }
     }
+
+    if (explicit_txs.empty())
+    {
+      CRITICAL_REGION_LOCAL(m_block_template_cache_lock);
+      m_block_template_cache = request;
+      m_block_template_cache.tx_hashes = tx_hashes;
+      m_block_template_cache.total_size = total_size;
+      m_block_template_cache.fee = fee;
+    }
+
+    bl.tx_hashes.insert(bl.tx_hashes.end(), tx_hashes.begin(), tx_hashes.end());
     // add explicit transactions 
     for (const auto& tx : explicit_txs)
     {
@@ -1230,6 +2226,9 @@ namespace currency
 
     m_config_folder = config_folder;
 
+    m_max_pool_bytes = command_line::get_arg(vm, arg_max_txpool_bytes);
+    LOG_PRINT_L0("Tx pool size limit: " << (m_max_pool_bytes ? epee::string_tools::num_to_string_fast(m_max_pool_bytes / (1024 * 1024)) + " MB" : std::string("unlimited")));
+
     uint64_t cache_size_l1 = CACHE_SIZE;
     LOG_PRINT_GREEN("Using pool db file cache size(L1): " << cache_size_l1, LOG_LEVEL_0);
 
@@ -1242,6 +2241,7 @@ namespace currency
     }
 
     const std::string db_folder_path = dbbs.get_pool_db_folder_path();
+    m_db_folder_path = db_folder_path;
     
     LOG_PRINT_L0("Loading blockchain from " << db_folder_path << "...");
 
@@ -1318,13 +2318,27 @@ namespace currency
       LOG_PRINT_L2(ss.str());
     }
 
-    load_keyimages_cache();
+    if (!load_indexes_snapshot())
+      load_indexes();
+
+    // from now on the snapshot (if any) is outdated, until a new one is written by deinit()
+    m_db.begin_transaction();
+    m_db_indexes_snapshot_nonce = 0;
+    m_db.commit_transaction();
 
     return true;
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::remove_incompatible_txs()
   {
+    if (m_indexes_snapshot_hardfork_id != UINT64_MAX && m_blockchain.get_current_blockchain_size() != 0 &&
+      m_indexes_snapshot_hardfork_id == m_blockchain.get_core_runtime_config().hard_forks.get_the_most_recent_hardfork_id_for_height(m_blockchain.get_top_block_height() + 1))
+    {
+      // txs were checked against the same hardfork rules when the pool was stored
+      LOG_PRINT_L1("tx pool: hardfork checks skipped, hardfork " << m_indexes_snapshot_hardfork_id << " is the same as at the moment of the snapshot");
+      return;
+    }
+
     std::vector<crypto::hash> invalid_tx_ids;
 
     m_db_transactions.enumerate_items([&](uint64_t i, const crypto::hash& h, const tx_details &tx_entry)
@@ -1349,14 +2363,11 @@ namespace currency
     return m_db_black_tx_list.get(id) != nullptr;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::load_keyimages_cache()
-  {
-    CRITICAL_REGION_LOCAL(m_key_images_lock);
-    return get_key_images_from_tx_pool(m_key_images);    
-  }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::deinit()
   {
+    if (m_db.is_open())
+      store_indexes_snapshot();
     m_db.close();
     return true;
   }
@@ -1366,62 +2377,6 @@ namespace currency
     return m_blockchain.get_core_runtime_config().get_core_time();
   }
   //---------------------------------------------------------------------------------
-  namespace
-  {
-    struct ms_out_info
-    {
-      crypto::hash multisig_id;
-      size_t input_output_index;
-      bool is_input;
-    };
-  }
-  //---------------------------------------------------------------------------------
-  void collect_multisig_ids_from_tx(const transaction& tx, std::vector<ms_out_info>& result)
-  {
-    result.reserve(tx.vin.size() + tx.vout.size());
-
-    size_t idx = 0;
-    for (const auto& in : tx.vin)
-    {
-      if (in.type() == typeid(txin_multisig))
-        result.push_back(ms_out_info({ boost::get<txin_multisig>(in).multisig_out_id, idx, true }));
-      ++idx;
-    }
-
-    idx = 0;
-    for (const auto& out : tx.vout)
-    {
-      VARIANT_SWITCH_BEGIN(out);
-      VARIANT_CASE_CONST(tx_out_bare, o)
-        if (o.target.type() == typeid(txout_multisig))
-          result.push_back(ms_out_info({ get_multisig_out_id(tx, idx), idx, false }));
-      VARIANT_SWITCH_END();
-      ++idx;
-    }
-  }
-  //---------------------------------------------------------------------------------
-  bool does_tx_have_given_multisig_id(const transaction& tx, const crypto::hash& multisig_id)
-  {
-    for (const auto& in : tx.vin)
-    {
-      if (in.type() == typeid(txin_multisig) && boost::get<txin_multisig>(in).multisig_out_id == multisig_id)
-        return true;
-    }
-
-    size_t idx = 0;
-    for (const auto& out : tx.vout)
-    {
-      VARIANT_SWITCH_BEGIN(out);
-      VARIANT_CASE_CONST(tx_out_bare, o)
-        if (o.target.type() == typeid(txout_multisig) && get_multisig_out_id(tx, idx) == multisig_id)
-          return true;
-      VARIANT_SWITCH_END();
-      ++idx;
-    }
-
-    return false;
-  }
-  //---------------------------------------------------------------------------------
   bool tx_memory_pool::check_tx_multisig_ins_and_outs(const transaction& tx, bool check_against_pool_txs) const 
   {
     
@@ -1438,23 +2393,29 @@ namespace currency
         return false;
       }
 
-      // check given multisig input/output against all transactions in the pool
+      // check given multisig input/output against all transactions in the pool:
+      // an input may spend an output of a pool tx (such a tx gets into a block with its parent), but only one pool tx may spend it
       if (check_against_pool_txs)
       {
-        bool has_found = false;
-        m_db_transactions.enumerate_items([&](uint64_t i, const crypto::hash& h, const tx_details &tx_entry)
+        crypto::hash pool_tx_id = null_hash;
         {
-          if (does_tx_have_given_multisig_id(tx_entry.tx, el.multisig_id))
+          CRITICAL_REGION_LOCAL(m_fee_index_lock);
+          auto it_in = m_pool_ms_ins.find(el.multisig_id);
+          if (it_in != m_pool_ms_ins.end())
+            pool_tx_id = it_in->second;
+          if (!el.is_input)
           {
-            has_found = true;
-            LOG_PRINT_L0("Transaction " << get_transaction_hash(tx) << (el.is_input ? " : input #" : " : output #") << el.input_output_index << " has multisig id " << el.multisig_id <<
-              " that is already in the pool in tx " << get_transaction_hash(tx_entry.tx));
-            return false;
-          }  
-          return true;
-        });
-        if (has_found)
+            auto it_out = m_pool_ms_outs.find(el.multisig_id);
+            if (it_out != m_pool_ms_outs.end())
+              pool_tx_id = it_out->second.tx_id;
+          }
+        }
+        if (pool_tx_id != null_hash)
+        {
+          LOG_PRINT_L0("Transaction " << get_transaction_hash(tx) << (el.is_input ? " : input #" : " : output #") << el.input_output_index << " has multisig id " << el.multisig_id <<
+            " that is already in the pool in tx " << pool_tx_id);
           return false;
+        }
       }
     }
 
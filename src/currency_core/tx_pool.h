@@ -9,6 +9,8 @@
 
 
 #include <set>
+#include <deque>
+#include <atomic>
 #include <unordered_map>
 #include <unordered_set>
 #include <boost/serialization/version.hpp>
@@ -20,9 +22,12 @@
 
 #include "common/db_abstract_accessor.h"
 #include "common/command_line.h"
+#include "common/flat_hash_multimap.h"
+#include "common/memory_usage.h"
 
 #include "currency_format_utils.h"
 #include "verification_context.h"
+#include "blockchain_storage_basic.h"
 #include "crypto/hash.h"
 #include "common/boost_serialization_helper.h"
 #include "currency_protocol/currency_protocol_handler_common.h"
@@ -81,10 +86,64 @@ namespace currency
       epee::math_helper::average<uint64_t, 1> check_post_hf4_balance;
     };
 
-    typedef std::unordered_map<crypto::key_image, std::set<crypto::hash>> key_image_cache;
+    typedef tools::flat_hash_multimap<crypto::key_image, crypto::hash> key_image_cache; // key image -> ids of pool txs spending it
+
+    // results of the expensive add_tx() checks made in advance, without holding any lock;
+    // add_tx() trusts them only if the chain is still at the same top block
+    struct tx_preverification_info
+    {
+      crypto::hash top_block_id;
+      bool inputs_ok;
+      uint64_t max_used_block_height;
+      crypto::hash max_used_block_id;
+      bool balance_ok;
+    };
+
+    // in-memory index of pool txs ordered by fee per byte (highest first), so block templates needn't sort the whole pool
+    struct fee_index_entry
+    {
+      crypto::hash id;
+      uint64_t fee;
+      uint64_t blob_size;
+      bool has_alias;       // registers or updates an alias
+      bool alias_update;
+      bool offers_del;      // zero-fee offer removal, goes to a block regardless of its fee
+      bool kept_by_block;   // never evicted
+    };
+
+    struct fee_index_less
+    {
+      bool operator()(const fee_index_entry& a, const fee_index_entry& b) const
+      {
+        boost::multiprecision::uint128_t a_rate = boost::multiprecision::uint128_t(a.fee) * b.blob_size;
+        boost::multiprecision::uint128_t b_rate = boost::multiprecision::uint128_t(b.fee) * a.blob_size;
+        if (a_rate != b_rate)
+          return a_rate > b_rate;
+        return a.id < b.id;
+      }
+    };
+    typedef std::set<fee_index_entry, fee_index_less> fee_index;
+
+    // immutable view of the pool for readers like RPC: rebuilt by the first reader after the pool has changed,
+    // published by an atomic pointer swap and then shared by all the readers without any locking
+    struct pool_snapshot
+    {
+      struct entry
+      {
+        crypto::hash id;
+        std::shared_ptr<const tx_details> txd;
+        blobdata blob;
+      };
+      uint64_t pool_version = 0;
+      std::vector<entry> txs;
+      std::vector<extra_alias_entry> aliases;
+    };
+    typedef std::shared_ptr<const pool_snapshot> pool_snapshot_ptr;
 
     tx_memory_pool(blockchain_storage& bchs, i_currency_protocol* pprotocol);
-    bool add_tx(const transaction &tx, const crypto::hash &id, uint64_t blob_size, tx_verification_context& tvc, bool kept_by_block, bool from_core = false);
+    static void init_options(boost::program_options::options_description& desc);
+    bool add_tx(const transaction &tx, const crypto::hash &id, uint64_t blob_size, tx_verification_context& tvc, bool kept_by_block, bool from_core = false, const tx_preverification_info* p_pvi = nullptr, const tx_semantic_context* p_semantic = nullptr);
+    void preverify_tx(const transaction& tx, const crypto::hash& id, tx_preverification_info& pvi, const tx_semantic_context* p_semantic = nullptr) const;
     bool add_tx(const transaction &tx, tx_verification_context& tvc, bool kept_by_block, bool from_core = false);
 
     bool do_insert_transaction(const transaction &tx, const crypto::hash &id, uint64_t blob_size, bool kept_by_block, uint64_t fee, const crypto::hash& max_used_block_id, uint64_t max_used_block_height);
@@ -95,6 +154,12 @@ namespace currency
     bool have_tx(const crypto::hash &id)const;
     bool have_tx_keyimg_as_spent(const crypto::key_image& key_im)const;
     bool have_tx_keyimges_as_spent(const transaction& tx, crypto::key_image* p_spent_ki = nullptr) const;
+    // ids of pool txs spending any of the key images of the given tx (the tx itself excluded)
+    void get_conflicting_txs(const transaction& tx, std::vector<crypto::hash>& conflicting_tx_ids) const;
+    // package: unconfirmed ancestors of the tx (pool txs whose multisig outputs it spends, recursively), parents first, and the tx itself last
+    bool get_tx_package(const crypto::hash& id, std::vector<crypto::hash>& package) const;
+    void get_tx_descendants(const crypto::hash& id, std::vector<crypto::hash>& descendants) const;
+    bool get_tx_package_fee(const crypto::hash& id, uint64_t& package_fee, uint64_t& package_blob_size) const;
     const performnce_data& get_performnce_data() const { return m_performance_data; }
 
 
@@ -123,6 +188,13 @@ namespace currency
     bool get_all_transactions_details(std::list<tx_rpc_extended_info>& txs)const;
     bool get_all_transactions_brief_details(std::list<tx_rpc_brief_info>& txs)const;
     bool get_all_transactions_list(std::list<std::string>& txs)const;
+    bool get_transactions_blobs(std::list<blobdata>& blobs, uint64_t& pool_version)const;
+    // txs added and removed since the given version of this pool instance; false if it's unknown or too old, then all txs are to be requested
+    bool get_transactions_changes(uint64_t pool_instance_id, uint64_t since_version, std::list<blobdata>& added_blobs, std::list<crypto::hash>& removed_ids, uint64_t& pool_version)const;
+    // the same by ids only, taken from the changes log, so an added tx may be gone already
+    bool get_transactions_changes_ids(uint64_t pool_instance_id, uint64_t since_version, std::list<crypto::hash>& added_ids, std::list<crypto::hash>& removed_ids, uint64_t& pool_version)const;
+    uint64_t get_pool_instance_id() const { return m_pool_instance_id; }
+    pool_snapshot_ptr get_snapshot()const;
     bool get_transactions_details(const std::list<std::string>& ids, std::list<tx_rpc_extended_info>& txs)const;
     bool get_transactions_brief_details(const std::list<std::string>& ids, std::list<tx_rpc_brief_info>& txs)const;
 
@@ -130,6 +202,9 @@ namespace currency
     bool get_transaction(const crypto::hash& h, transaction& tx)const;
     bool get_transaction(const crypto::hash& h, tx_details& txd)const;
     size_t get_transactions_count() const;
+    // estimated sizes of the pool's db cache and in-memory indexes
+    void get_memory_usage(std::list<tools::memory_usage_entry>& usage) const;
+    uint64_t get_pool_version() const { return m_pool_version; }
     bool have_key_images(const std::unordered_set<crypto::key_image>& kic, const transaction& tx)const;
     bool append_key_images(std::unordered_set<crypto::key_image>& kic, const transaction& tx);
     std::string print_pool(bool short_format)const;
@@ -142,13 +217,15 @@ namespace currency
     void remove_incompatible_txs(); // made public to be called after the BCS is loaded and hardfork info is ready
 
     bool is_tx_blacklisted(const crypto::hash& id) const;
+    bool is_tx_recently_evicted(const crypto::hash& id) const;
+    uint64_t get_total_blobs_size() const;
 
 #ifdef TX_POOL_USE_UNSECURE_TEST_FUNCTIONS
     void unsecure_disable_tx_validation_on_addition(bool validation_disabled) { m_unsecure_disable_tx_validation_on_addition = validation_disabled; }
 #endif
 
   private:
-    bool on_tx_add(crypto::hash tx_id, const transaction& tx, bool kept_by_block);
+    bool on_tx_add(crypto::hash tx_id, const transaction& tx, uint64_t blob_size, uint64_t fee, bool kept_by_block);
     bool on_tx_remove(const crypto::hash &tx_id, const transaction& tx, bool kept_by_block);
     bool insert_key_images(const crypto::hash& tx_id, const transaction& tx, bool kept_by_block);
     bool remove_key_images(const crypto::hash &tx_id, const transaction& tx, bool kept_by_block);
@@ -158,13 +235,53 @@ namespace currency
 
     bool is_valid_contract_finalization_tx(const transaction &tx)const;
     void store_db_solo_options_values();
-    bool is_transaction_ready_to_go(tx_details& txd, const crypto::hash& id)const;
+    bool is_transaction_ready_to_go(tx_details& txd, const crypto::hash& id, const unconfirmed_ms_outs_map* p_unconfirmed_ms_outs = nullptr)const;
     bool validate_alias_info(const transaction& tx, bool is_in_block)const;
-    bool get_key_images_from_tx_pool(key_image_cache& key_images) const;
     bool check_is_taken(const crypto::hash& id) const;
     void set_taken(const crypto::hash& id);
     void reset_all_taken();
-    bool load_keyimages_cache();
+    void insert_into_fee_index(const crypto::hash& tx_id, const transaction& tx, uint64_t blob_size, uint64_t fee, bool kept_by_block);
+    void insert_fee_index_entry(const fee_index_entry& e);
+    void remove_from_fee_index(const crypto::hash& tx_id);
+    void clear_fee_index();
+    bool load_indexes();
+    void log_pool_change(const crypto::hash& id, bool added);
+    void reset_changes_log();
+    bool load_indexes_snapshot();
+    bool store_indexes_snapshot();
+    void get_fee_index_chunk(const fee_index_entry* p_after, size_t max_count, std::vector<fee_index_entry>& result) const;
+    void get_fee_index_offers_del(std::vector<fee_index_entry>& result) const;
+    bool select_eviction_victims(uint64_t blob_size, uint64_t fee, std::vector<fee_index_entry>& victims) const;
+    void insert_into_dependency_graph(const crypto::hash& tx_id, const transaction& tx);
+    void insert_dependency_graph_link(const crypto::hash& tx_id, const crypto::hash& ms_id, bool is_input, uint64_t out_n);
+    void remove_from_dependency_graph(const crypto::hash& tx_id);
+    bool get_unconfirmed_ancestors(const crypto::hash& id, std::vector<fee_index_entry>& ancestors) const; // false if there are too many of them
+    bool get_pool_ms_sources(const transaction& tx, unconfirmed_ms_outs_map& sources, std::vector<crypto::hash>& parents) const;
+    bool make_room_for_tx(const crypto::hash& id, uint64_t blob_size, uint64_t fee);
+    void remember_evicted_tx(const crypto::hash& id);
+    bool get_changes_since(uint64_t pool_instance_id, uint64_t since_version, std::unordered_map<crypto::hash, bool>& changes, uint64_t& pool_version) const; // tx id -> is in the pool now
+
+    // result of the last fill_block_template() call, reused while neither the pool nor the chain has changed
+    struct block_template_cache
+    {
+      uint64_t pool_version = UINT64_MAX;
+      crypto::hash top_block_id = null_hash;
+      uint64_t height = 0;
+      bool pos = false;
+      size_t median_size = 0;
+      boost::multiprecision::uint128_t already_generated_coins = 0;
+      uint64_t tx_expiration_ts_median = 0;
+
+      std::vector<crypto::hash> tx_hashes;
+      size_t total_size = 0;
+      uint64_t fee = 0;
+
+      bool is_same_request(const block_template_cache& other) const
+      {
+        return pool_version == other.pool_version && top_block_id == other.top_block_id && height == other.height && pos == other.pos &&
+          median_size == other.median_size && already_generated_coins == other.already_generated_coins && tx_expiration_ts_median == other.tx_expiration_ts_median;
+      }
+    };
     
     typedef tools::db::cached_key_value_accessor<crypto::hash, tx_details, true, false> transactions_container;
     typedef tools::db::cached_key_value_accessor<crypto::hash, bool, false, false> hash_container; 
@@ -184,12 +301,15 @@ namespace currency
     address_to_aliases_container m_db_alias_addresses;
     solo_options_container m_db_solo_options;
     tools::db::solo_db_value<uint64_t, uint64_t, solo_options_container> m_db_storage_major_compatibility_version;
+    tools::db::solo_db_value<uint64_t, uint64_t, solo_options_container> m_db_indexes_snapshot_nonce;
 
 
     epee::math_helper::once_a_time_seconds<30> m_remove_stuck_tx_interval;
 
     performnce_data m_performance_data;
     std::string m_config_folder;
+    std::string m_db_folder_path;
+    uint64_t m_indexes_snapshot_hardfork_id = UINT64_MAX; // hardfork id at the moment the loaded snapshot was written, UINT64_MAX if indexes were rebuilt
     blockchain_storage& m_blockchain;
     i_currency_protocol* m_pprotocol;
 
@@ -201,6 +321,52 @@ namespace currency
     key_image_cache m_key_images;
     mutable epee::critical_section m_remove_stuck_txs_lock;
 
+    mutable epee::critical_section m_fee_index_lock;
+    fee_index m_fee_index;
+    std::unordered_map<crypto::hash, fee_index::const_iterator> m_fee_index_by_id;
+    std::unordered_set<crypto::hash> m_fee_index_offers_del;
+
+    // dependency graph of pool txs, linked by multisig outputs (escrow contracts and alike), guarded by m_fee_index_lock
+    struct ms_out_link
+    {
+      crypto::hash tx_id;
+      uint64_t out_n;
+    };
+    struct tx_ms_ids
+    {
+      std::vector<crypto::hash> ins;
+      std::vector<crypto::hash> outs;
+    };
+    std::unordered_map<crypto::hash, ms_out_link> m_pool_ms_outs;         // ms out id -> pool tx having this output
+    std::unordered_map<crypto::hash, crypto::hash> m_pool_ms_ins;         // ms out id -> pool tx spending it
+    std::unordered_map<crypto::hash, tx_ms_ids> m_pool_tx_ms_ids;         // for pool txs having ms inputs or outputs
+    uint64_t m_fee_index_alias_regs_count = 0;
+    uint64_t m_fee_index_total_bytes = 0;
+    uint64_t m_max_pool_bytes = 0;                  // 0 - unlimited
+
+    // txs evicted (or refused) for the lack of room, so they aren't verified again each time a peer sends them
+    mutable epee::critical_section m_evicted_txs_lock;
+    std::unordered_map<crypto::hash, uint64_t> m_evicted_txs;  // tx id -> eviction time
+    std::atomic<uint64_t> m_pool_version{0};       // changes whenever the set of pool txs or the blacklist changes
+
+    mutable epee::critical_section m_block_template_cache_lock;
+    block_template_cache m_block_template_cache;
+
+    // added/removed txs, by pool version, for readers fetching only the changes since some version
+    struct pool_change
+    {
+      uint64_t version;
+      crypto::hash id;
+      bool added;
+    };
+    mutable epee::critical_section m_changes_log_lock;
+    std::deque<pool_change> m_changes_log;
+    uint64_t m_changes_log_min_version = 0;          // changes since older versions are unknown
+    const uint64_t m_pool_instance_id;
+
+    mutable pool_snapshot_ptr m_snapshot;            // accessed with std::atomic_load/atomic_store only
+    mutable epee::critical_section m_snapshot_build_lock;
+
     bool m_unsecure_disable_tx_validation_on_addition = false;
   };
 }
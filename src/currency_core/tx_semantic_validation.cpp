@@ -6,6 +6,7 @@
 
 #include "tx_semantic_validation.h"
 #include "currency_format_utils.h"
+#include "common/variant_helper.h"
 
 namespace currency
 {
@@ -19,23 +20,17 @@ namespace currency
     return true;
   }
   //-----------------------------------------------------------------------------------------------
-  bool check_tx_inputs_keyimages_diff(const transaction& tx)
+  bool validate_tx_semantic(const transaction& tx, size_t tx_blob_size)
   {
-    std::unordered_set<crypto::key_image> key_images;
-    crypto::key_image ki{};
-    for(const auto& in_v : tx.vin)
-    {
-      if (get_key_image_from_txin_v(in_v, ki))
-      {
-        if (!key_images.insert(ki).second)
-          return false;
-      }
-    }
-    return true;
+    tx_semantic_context tsc;
+    return validate_tx_semantic(tx, tx_blob_size, tsc);
   }
   //-----------------------------------------------------------------------------------------------
-  bool validate_tx_semantic(const transaction& tx, size_t tx_blob_size)
+  bool validate_tx_semantic(const transaction& tx, size_t tx_blob_size, tx_semantic_context& tsc)
   {
+    // the checks go from the cheapest ones to the ones that decode points, so junk is dropped as early as possible;
+    // inputs and outputs are gone through once, what's found on the way is kept in tsc
+    tsc = tx_semantic_context();
     if (tx_blob_size >= CURRENCY_MAX_TRANSACTION_BLOB_SIZE)
     {
       LOG_PRINT_RED_L0("tx blob size is " << tx_blob_size << ", it is greater than or equal to allowed maximum of " << CURRENCY_MAX_TRANSACTION_BLOB_SIZE);
@@ -48,26 +43,60 @@ namespace currency
       return false;
     }
 
-    if (!check_inputs_types_supported(tx))
+    tsc.key_images.reserve(tx.vin.size());
+    for (const auto& in : tx.vin)
     {
-      LOG_PRINT_RED_L0("unsupported input types for tx id= " << get_transaction_hash(tx));
-      return false;
+      uint64_t amount = 0;
+      VARIANT_SWITCH_BEGIN(in);
+      VARIANT_CASE_CONST(txin_to_key, tk)
+        amount = tk.amount;
+        tsc.key_images.push_back(tk.k_image);
+      VARIANT_CASE_CONST(txin_htlc, htlc)
+        amount = htlc.amount;
+        tsc.key_images.push_back(htlc.k_image);
+      VARIANT_CASE_CONST(txin_multisig, ms)
+        amount = ms.amount;
+      VARIANT_CASE_CONST(txin_zc_input, zc)
+        tsc.key_images.push_back(zc.k_image);
+        ++tsc.zc_inputs_count;
+      VARIANT_CASE_OTHER()
+        LOG_PRINT_RED_L0("unsupported input type " << in.type().name() << " for tx id= " << get_transaction_hash(tx));
+        return false;
+      VARIANT_SWITCH_END();
+      if (tsc.bare_inputs_sum + amount < tsc.bare_inputs_sum)
+      {
+        LOG_PRINT_RED_L0("tx has money overflow in inputs, rejected for tx id= " << get_transaction_hash(tx));
+        return false;
+      }
+      tsc.bare_inputs_sum += amount;
     }
 
-    if (!check_outs_valid(tx))
+    for (const auto& out : tx.vout)
     {
-      LOG_PRINT_RED_L0("tx has invalid outputs, rejected for tx id= " << get_transaction_hash(tx));
-      return false;
+      if (!tools::is_variant_type<tx_out_bare>(out))
+        continue;
+      uint64_t amount = boost::get<tx_out_bare>(out).amount;
+      if (tsc.bare_outputs_sum + amount < tsc.bare_outputs_sum)
+      {
+        LOG_PRINT_RED_L0("tx has money overflow in outputs, rejected for tx id= " << get_transaction_hash(tx));
+        return false;
+      }
+      tsc.bare_outputs_sum += amount;
     }
 
-    if (!check_bare_money_overflow(tx))
+    // inexpensive check for pre-HF4 txs
+    // post-HF4 txs balance are being checked in check_tx_balance()
+    if (tx.version <= TRANSACTION_VERSION_PRE_HF4 && tsc.bare_inputs_sum < tsc.bare_outputs_sum)
     {
-      LOG_PRINT_RED_L0("tx has money overflow, rejected for tx id= " << get_transaction_hash(tx));
+      LOG_PRINT_RED_L0("balance check failed for tx " << get_transaction_hash(tx) << ": the sum of inputs (" << print_money_brief(tsc.bare_inputs_sum)
+        << ") is less than the sum of outputs (" << print_money_brief(tsc.bare_outputs_sum) << ")");
       return false;
     }
 
     //check if tx use different key images
-    if (!check_tx_inputs_keyimages_diff(tx))
+    std::vector<crypto::key_image> sorted_key_images(tsc.key_images);
+    std::sort(sorted_key_images.begin(), sorted_key_images.end());
+    if (std::adjacent_find(sorted_key_images.begin(), sorted_key_images.end()) != sorted_key_images.end())
     {
       LOG_PRINT_RED_L0("tx inputs have the same key images");
       return false;
@@ -79,15 +108,10 @@ namespace currency
       return false;
     }
 
-    // inexpensive check for pre-HF4 txs
-    // post-HF4 txs balance are being checked in check_tx_balance()
-    if (tx.version <= TRANSACTION_VERSION_PRE_HF4)
+    if (!check_outs_valid(tx))
     {
-      if (!check_tx_bare_balance(tx))
-      {
-        LOG_PRINT_RED_L0("balance check failed for tx " << get_transaction_hash(tx));
-        return false;
-      }
+      LOG_PRINT_RED_L0("tx has invalid outputs, rejected for tx id= " << get_transaction_hash(tx));
+      return false;
     }
 
     return true;
@@ -9,6 +9,16 @@
 
 namespace currency
 {
+  // facts found by validate_tx_semantic() on its way through the tx, so the checks after it don't go through the tx to find them once again
+  struct tx_semantic_context
+  {
+    std::vector<crypto::key_image> key_images;  // of the inputs, in their order
+    uint64_t bare_inputs_sum = 0;
+    uint64_t bare_outputs_sum = 0;
+    size_t zc_inputs_count = 0;
+  };
+
   //check correct values, ins and outs types, amounts and all lightweight checks not related to the database
   bool validate_tx_semantic(const transaction& tx, size_t tx_block_size);
+  bool validate_tx_semantic(const transaction& tx, size_t tx_block_size, tx_semantic_context& tsc);
 }
@@ -31,5 +31,7 @@ namespace currency
     //associated with the block to get handled directly to core without being handled by tx_pool(which makes full
     //inputs validation, including signatures check)
     transactions_map m_onboard_transactions;
+    //range proofs of the miner tx and of m_onboard_transactions have already been verified in a batch with other blocks (see blockchain_storage::batch_verify_range_proofs)
+    bool m_range_proofs_preverified;
   };
 }
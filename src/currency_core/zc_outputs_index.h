@@ -0,0 +1,325 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include "string_coding.h"
+#include "common/db_abstract_accessor.h"
+#include "common/mapped_pod_array_file.h"
+#include "currency_basic.h"
+#include "currency_config.h"
+#include "cache_helper.h"
+
+#define ZC_OUTPUT_INDEX_ENTRY_FLAG_SPENT            0x01
+#define ZC_OUTPUT_INDEX_ENTRY_FLAG_COINBASE         0x02
+#define ZC_OUTPUT_INDEX_ENTRY_FLAG_POS_COINBASE     0x04
+#define ZC_OUTPUT_INDEX_ENTRY_FLAG_BARE             0x08  // bare output with zero amount, occupies the gindex but never used as a decoy
+
+namespace currency
+{
+  // everything decoy selection needs to know about a hidden-amount (amount = 0) output, stored per gindex
+  struct zc_output_index_entry
+  {
+    crypto::public_key stealth_address;
+    crypto::public_key concealing_point;
+    crypto::public_key amount_commitment;
+    crypto::public_key blinded_asset_id;
+    uint64_t keeper_block_height;
+    uint64_t unlock_time;
+    uint8_t mix_attr;
+    uint8_t flags;
+    uint8_t reserved[6];
+
+    bool is_spent() const { return (flags & ZC_OUTPUT_INDEX_ENTRY_FLAG_SPENT) != 0; }
+    bool is_burned() const { return stealth_address == null_pkey; }
+    bool is_bare() const { return (flags & ZC_OUTPUT_INDEX_ENTRY_FLAG_BARE) != 0; }
+  };
+  static_assert(sizeof(zc_output_index_entry) == 152, "zc_output_index_entry layout is a part of the file format");
+
+  // memory-mapped flat table of amount-0 outputs, indexed by gindex, derived from (and rebuildable from) the outputs container
+  // Readers see only committed state; changes made within a write db transaction are staged in memory
+  // and applied to the file on commit, when the db accessor holds exclusive lock, so readers never see partial updates.
+  class zc_outputs_index : public tools::db::i_db_parent_to_container_callabck
+  {
+  public:
+    explicit zc_outputs_index(tools::db::basic_db_accessor& db)
+      : m_db(db)
+      , m_is_bound(false)
+      , m_in_tx(false)
+      , m_tx_base(0)
+      , m_tx_touched_min(UINT64_MAX)
+      , m_tx_broken(false)
+    {}
+
+    ~zc_outputs_index()
+    {
+      deinit();
+    }
+
+    bool init(const std::string& filename, uint64_t signature, std::string* p_reason = nullptr)
+    {
+      deinit();
+      if (!m_file.open(epee::string_encoding::utf8_to_wstring(filename), signature, p_reason))
+        return false;
+      m_db.bind_parent_container(this);
+      m_is_bound = true;
+      return true;
+    }
+
+    void deinit()
+    {
+      if (m_is_bound)
+      {
+        m_db.unbind_parent_container(this);
+        m_is_bound = false;
+      }
+      reset_tx_state();
+      m_file.close();
+    }
+
+    bool is_open() const
+    {
+      return m_file.is_open();
+    }
+
+    // readers: committed state
+    uint64_t size() const
+    {
+      return m_file.size();
+    }
+
+    const zc_output_index_entry* get(uint64_t gindex) const
+    {
+      if (gindex >= m_file.size())
+        return nullptr;
+      return &m_file[static_cast<size_t>(gindex)];
+    }
+
+    // writer: state including changes staged by the current write transaction
+    uint64_t writer_size() const
+    {
+      if (!m_in_tx)
+        return m_file.size();
+      return m_tx_base + m_pending.size();
+    }
+
+    // gindex must be equal to writer_size(), otherwise the index is behind the outputs container and should be caught up first
+    bool push_back(uint64_t gindex, const zc_output_index_entry& entry)
+    {
+      if (!m_file.is_open() || gindex != writer_size())
+        return false;
+      if (!m_in_tx)
+        return m_file.push_back(entry);
+      m_pending.push_back(entry);
+      return true;
+    }
+
+    void truncate(uint64_t new_size)
+    {
+      if (!m_file.is_open() || new_size >= writer_size())
+        return;
+      if (!m_in_tx)
+      {
+        m_file.truncate(static_cast<size_t>(new_size));
+        return;
+      }
+      m_tx_touched_min = std::min(m_tx_touched_min, new_size);
+      if (new_size >= m_tx_base)
+      {
+        m_pending.resize(static_cast<size_t>(new_size - m_tx_base));
+      }
+      else
+      {
+        m_tx_base = new_size;
+        m_pending.clear();
+      }
+      m_staged_spent_flags.erase(m_staged_spent_flags.lower_bound(new_size), m_staged_spent_flags.end());
+    }
+
+    void set_spent_flag(uint64_t gindex, bool spent)
+    {
+      if (!m_file.is_open() || gindex >= writer_size())
+        return; // not indexed yet, will be taken from the db on catching up
+      if (!m_in_tx)
+      {
+        set_entry_spent_flag(m_file[static_cast<size_t>(gindex)], spent);
+        return;
+      }
+      m_tx_touched_min = std::min(m_tx_touched_min, gindex);
+      if (gindex >= m_tx_base)
+        set_entry_spent_flag(m_pending[static_cast<size_t>(gindex - m_tx_base)], spent);
+      else
+        m_staged_spent_flags[gindex] = spent;
+    }
+
+    bool flush()
+    {
+      return m_file.flush();
+    }
+
+    // i_db_parent_to_container_callabck
+    virtual bool on_write_transaction_begin() override
+    {
+      reset_tx_state();
+      m_in_tx = true;
+      m_tx_base = m_file.size();
+      return true;
+    }
+
+    virtual bool on_write_transaction_commit() override
+    {
+      // called under exclusive lock after the db has been committed
+      if (!m_in_tx)
+        return true;
+
+      if (m_tx_broken)
+      {
+        // a nested tx was aborted, staged changes can't be trusted: drop everything this tx has touched, it will be caught up from the db
+        if (m_tx_touched_min < m_file.size())
+          m_file.truncate(static_cast<size_t>(m_tx_touched_min));
+        LOG_PRINT_L1("[ZC_OUTPUTS_INDEX]: nested tx abort detected, index truncated to " << m_file.size());
+      }
+      else
+      {
+        if (m_tx_base < m_file.size())
+          m_file.truncate(static_cast<size_t>(m_tx_base));
+        for (const auto& sf : m_staged_spent_flags)
+          set_entry_spent_flag(m_file[static_cast<size_t>(sf.first)], sf.second);
+        for (const auto& e : m_pending)
+        {
+          if (!m_file.push_back(e))
+          {
+            LOG_ERROR("[ZC_OUTPUTS_INDEX]: failed to append to the index file, index stopped at " << m_file.size());
+            break;
+          }
+        }
+      }
+
+      reset_tx_state();
+      return true;
+    }
+
+    virtual bool on_write_transaction_abort() override
+    {
+      reset_tx_state();
+      return true;
+    }
+
+    virtual bool on_write_transaction_nested_abort() override
+    {
+      m_tx_broken = true;
+      return true;
+    }
+
+  private:
+    static void set_entry_spent_flag(zc_output_index_entry& e, bool spent)
+    {
+      if (spent)
+        e.flags |= ZC_OUTPUT_INDEX_ENTRY_FLAG_SPENT;
+      else
+        e.flags &= ~ZC_OUTPUT_INDEX_ENTRY_FLAG_SPENT;
+    }
+
+    void reset_tx_state()
+    {
+      m_in_tx = false;
+      m_tx_base = 0;
+      m_tx_touched_min = UINT64_MAX;
+      m_tx_broken = false;
+      m_pending.clear();
+      m_staged_spent_flags.clear();
+    }
+
+    tools::db::basic_db_accessor& m_db;
+    tools::mapped_pod_array_file<zc_output_index_entry> m_file;
+    bool m_is_bound;
+
+    // write tx staging, accessed by the writer thread only
+    bool m_in_tx;
+    uint64_t m_tx_base;                               // items of the file that are kept by the current tx
+    uint64_t m_tx_touched_min;
+    bool m_tx_broken;
+    std::vector<zc_output_index_entry> m_pending;     // items appended after m_tx_base
+    std::map<uint64_t, bool> m_staged_spent_flags;    // spent flags changes for items below m_tx_base
+  };
+
+  // Recently looked up decoy candidates, (amount, gindex) => entry, for the outputs that are not in zc_outputs_index
+  // (bare amounts, and amount 0 when the index is missing or lags behind). Bare outputs use stealth_address and mix_attr,
+  // ZC_OUTPUT_INDEX_ENTRY_FLAG_BARE marks the ones that can't be decoys at all (htlc and alike).
+  // Entries hold spent flags, so they all go when the top block changes; split into a few independently locked parts,
+  // since all rpc threads of a public node look up decoys at the same time.
+  class decoy_outputs_cache
+  {
+  public:
+    decoy_outputs_cache() : m_top_block_id(null_hash), m_generation(0)
+    {
+      for (auto& p : m_parts)
+        p.set_max_elements(CURRENCY_DECOY_OUTPUTS_CACHE_MAX_ELEMENTS / parts_count);
+    }
+
+    // to be called under the blockchain read lock before the lookups, returns the generation to be given to set()
+    uint64_t begin_lookups(const crypto::hash& top_block_id)
+    {
+      std::lock_guard<std::mutex> lk(m_top_block_id_lock);
+      if (top_block_id != m_top_block_id)
+      {
+        // the generation goes first, so results made for the previous top block don't get in after the parts are cleared
+        ++m_generation;
+        for (auto& p : m_parts)
+          p.clear();
+        m_top_block_id = top_block_id;
+      }
+      return m_generation;
+    }
+
+    bool get(uint64_t amount, uint64_t gindex, zc_output_index_entry& entry)
+    {
+      return get_part(amount, gindex).get(std::make_pair(amount, gindex), entry);
+    }
+
+    void set(uint64_t generation, uint64_t amount, uint64_t gindex, const zc_output_index_entry& entry)
+    {
+      get_part(amount, gindex).set_if_generation(generation, m_generation, std::make_pair(amount, gindex), entry);
+    }
+
+    size_t size()
+    {
+      size_t r = 0;
+      for (auto& p : m_parts)
+        r += p.size();
+      return r;
+    }
+
+  private:
+    static const size_t parts_count = 8;
+    typedef std::pair<uint64_t, uint64_t> key_t;
+
+    class part_t : public epee::misc_utils::cache_base<true, key_t, zc_output_index_entry, CURRENCY_DECOY_OUTPUTS_CACHE_MAX_ELEMENTS>
+    {
+    public:
+      void set_if_generation(uint64_t generation, const std::atomic<uint64_t>& current_generation, const key_t& k, const zc_output_index_entry& entry)
+      {
+        CRITICAL_REGION_LOCAL(m_lock);
+        if (generation == current_generation)
+          set(k, entry);
+      }
+    };
+
+    part_t& get_part(uint64_t amount, uint64_t gindex)
+    {
+      return m_parts[(gindex ^ amount) % parts_count];
+    }
+
+    std::mutex m_top_block_id_lock;
+    crypto::hash m_top_block_id;
+    std::atomic<uint64_t> m_generation;
+    part_t m_parts[parts_count];
+  };
+
+} // namespace currency
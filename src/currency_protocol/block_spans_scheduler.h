@@ -0,0 +1,207 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <mutex>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <boost/uuid/uuid.hpp>
+#include <boost/functional/hash.hpp>
+
+#include "crypto/hash.h"
+#include "currency_core/currency_config.h"
+
+namespace currency
+{
+  // who downloads which blocks during synchronization, shared by all the connections:
+  // each block is given to one peer at a time, so the peers download disjoint spans of the chain in parallel;
+  // a span that takes much longer than its peer's throughput promises is stalled and may be given to another peer;
+  // thread-safe, the time is given by the caller (ms)
+  class block_spans_scheduler
+  {
+  public:
+    typedef boost::uuids::uuid peer_id;
+
+    enum claim_state
+    {
+      claim_free = 0,
+      claim_busy,        // another peer is downloading it, or has it downloaded
+      claim_stalled      // another peer is downloading it for too long
+    };
+
+    claim_state get_claim_state(const peer_id& peer, const crypto::hash& id, uint64_t now) const
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      auto it = m_claims.find(id);
+      if (it == m_claims.end() || it->second->peer == peer)
+        return claim_free;
+      return is_stalled(*it->second, now) ? claim_stalled : claim_busy;
+    }
+
+    // gives the blocks to the peer from the front while they are not busy, returns how many are given
+    size_t claim(const peer_id& peer, const std::vector<crypto::hash>& ids, uint64_t cumul_size, uint64_t now)
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      auto sc = std::make_shared<span_claim>(span_claim{ peer, now, cumul_size, false });
+      size_t count = 0;
+      for (; count != ids.size(); ++count)
+      {
+        auto it = m_claims.find(ids[count]);
+        if (it != m_claims.end() && it->second->peer != peer && !is_stalled(*it->second, now))
+          break;
+      }
+      for (size_t i = 0; i != count; ++i)
+        m_claims[ids[i]] = sc;
+      if (count)
+        m_peers[peer].requests.push_back(now);
+      return count;
+    }
+
+    bool is_claimed_by(const peer_id& peer, const crypto::hash& id) const
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      auto it = m_claims.find(id);
+      return it != m_claims.end() && it->second->peer == peer;
+    }
+
+    // the peer has sent the blocks, they stay its own until released
+    void on_received(const peer_id& peer, const std::vector<crypto::hash>& ids, uint64_t bytes, uint64_t now)
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      for (const auto& id : ids)
+      {
+        auto it = m_claims.find(id);
+        if (it != m_claims.end() && it->second->peer == peer)
+          it->second->received = true;
+      }
+
+      peer_info& pi = m_peers[peer];
+      uint64_t started = pi.last_response_time;
+      if (!pi.requests.empty())
+      {
+        started = std::max(started, pi.requests.front());
+        pi.requests.pop_front();
+      }
+      pi.last_response_time = now;
+      uint64_t speed = bytes / std::max<uint64_t>(now - std::min(started, now), 1); // bytes per ms
+      pi.speed = pi.speed ? (pi.speed * 3 + speed) / 4 : std::max<uint64_t>(speed, 1);
+    }
+
+    // the blocks are in the chain, or should be downloaded again
+    void release(const std::vector<crypto::hash>& ids)
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      for (const auto& id : ids)
+        m_claims.erase(id);
+    }
+
+    // the blocks the peer hasn't sent become free (the ones it has sent are still to be added to the chain)
+    void release_peer(const peer_id& peer)
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      for (auto it = m_claims.begin(); it != m_claims.end();)
+      {
+        if (it->second->peer == peer && !it->second->received)
+          it = m_claims.erase(it);
+        else
+          ++it;
+      }
+      m_peers.erase(peer);
+      m_waiting_peers.erase(peer);
+    }
+
+    // slow peers get one span at a time, so they don't hold back the spans the following ones depend on
+    size_t get_spans_in_flight_limit(const peer_id& peer) const
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      auto it = m_peers.find(peer);
+      if (it == m_peers.end() || !it->second.speed)
+        return BLOCKS_SYNCHRONIZING_MAX_BATCHES_IN_FLIGHT;
+      uint64_t max_speed = 0;
+      for (const auto& p : m_peers)
+        max_speed = std::max(max_speed, p.second.speed);
+      return it->second.speed * BLOCKS_SYNCHRONIZING_SLOW_PEER_FACTOR < max_speed ? 1 : BLOCKS_SYNCHRONIZING_MAX_BATCHES_IN_FLIGHT;
+    }
+
+    // as much as the peer sends in BLOCKS_SYNCHRONIZING_BATCH_TARGET_TIME, so tiny early blocks go in big batches and big ones don't stall slow links;
+    // the throughput is measured with the round trip included, so the batch size settles where the round trip and the transfer take that time together
+    void get_batch_limits(const peer_id& peer, size_t& max_count, uint64_t& max_size) const
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      auto it = m_peers.find(peer);
+      if (it == m_peers.end() || !it->second.speed)
+      {
+        max_count = BLOCKS_SYNCHRONIZING_DEFAULT_COUNT;
+        max_size = BLOCKS_SYNCHRONIZING_DEFAULT_SIZE;
+        return;
+      }
+      max_count = CURRENCY_PROTOCOL_MAX_BLOCKS_REQUEST_COUNT;
+      max_size = std::min<uint64_t>(std::max<uint64_t>(it->second.speed * BLOCKS_SYNCHRONIZING_BATCH_TARGET_TIME, BLOCKS_SYNCHRONIZING_MIN_SIZE), BLOCKS_SYNCHRONIZING_MAX_SIZE);
+    }
+
+    uint64_t get_peer_speed(const peer_id& peer) const // bytes per ms
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      auto it = m_peers.find(peer);
+      return it == m_peers.end() ? 0 : it->second.speed;
+    }
+
+    // a peer that has blocks to download but all of them are busy, it's to be woken up from time to time
+    void set_peer_waiting(const peer_id& peer, bool waiting)
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      if (waiting)
+        m_waiting_peers.insert(peer);
+      else
+        m_waiting_peers.erase(peer);
+    }
+
+    std::unordered_set<peer_id, boost::hash<peer_id>> get_waiting_peers() const
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      return m_waiting_peers;
+    }
+
+    size_t get_claimed_blocks_count() const
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      return m_claims.size();
+    }
+
+  private:
+    struct span_claim
+    {
+      peer_id peer;
+      uint64_t time;
+      uint64_t cumul_size;
+      bool received;
+    };
+
+    struct peer_info
+    {
+      uint64_t speed = 0;                 // bytes per ms, 0 while unknown
+      uint64_t last_response_time = 0;
+      std::deque<uint64_t> requests;      // times of the spans in flight, oldest first
+    };
+
+    bool is_stalled(const span_claim& sc, uint64_t now) const
+    {
+      if (sc.received)
+        return false;
+      uint64_t timeout = BLOCKS_SYNCHRONIZING_SPAN_MIN_TIMEOUT;
+      auto it = m_peers.find(sc.peer);
+      if (it != m_peers.end() && it->second.speed)
+        timeout = std::max<uint64_t>(timeout, sc.cumul_size / it->second.speed * BLOCKS_SYNCHRONIZING_SPAN_TIMEOUT_FACTOR);
+      return now > sc.time + timeout;
+    }
+
+    mutable std::mutex m_lock;
+    std::unordered_map<crypto::hash, std::shared_ptr<span_claim>> m_claims;
+    std::unordered_map<peer_id, peer_info, boost::hash<peer_id>> m_peers;
+    std::unordered_set<peer_id, boost::hash<peer_id>> m_waiting_peers;
+  };
+}
@@ -21,6 +21,15 @@ namespace currency
 
 #define BC_COMMANDS_POOL_BASE 2000
 
+// protocol features, announced via CORE_SYNC_DATA::protocol_features
+#define CURRENCY_PROTOCOL_FEATURE_COMPACT_BLOCKS 0x0000000000000001 // NOTIFY_NEW_BLOCK may come without txs: receiver takes them from its pool and requests the rest with NOTIFY_REQUEST_GET_OBJECTS
+#define CURRENCY_PROTOCOL_FEATURE_PRUNED         0x0000000000000002 // node keeps txs signatures, proofs and attachments only for blocks above CORE_SYNC_DATA::pruned_height
+#define CURRENCY_PROTOCOL_FEATURE_TX_INVENTORY   0x0000000000000004 // new txs are announced with NOTIFY_TX_INVENTORY, receiver requests the ones it lacks with NOTIFY_REQUEST_TXS
+#define CURRENCY_PROTOCOL_FEATURE_COMPRESSED_FRAMES 0x0000000000000008 // node wants big levin frames sent to it compressed (LEVIN_PACKET_COMPRESSED), opt-in with --p2p-compression
+#define CURRENCY_PROTOCOL_FEATURE_CHAIN_HEADERS  0x0000000000000010 // NOTIFY_RESPONSE_CHAIN_ENTRY sent to node carries the headers of the blocks, so it checks them before downloading the blocks
+#define CURRENCY_PROTOCOL_FEATURE_RAW_BLOCKS     0x0000000000000020 // NOTIFY_RESPONSE_GET_OBJECTS sent to node carries the blocks packed into blocks_raw (see raw_block_entries.h)
+#define CURRENCY_PROTOCOL_FEATURE_EARLY_BLOCK_RELAY 0x0000000000000040 // node relays new blocks after the PoW/PoS kernel check only (NOTIFY_NEW_BLOCK::prevalidated_only), opt-in with --early-block-relay
+
   
   /************************************************************************/
   /*                                                                      */
@@ -31,12 +40,14 @@ namespace currency
     std::list<blobdata> txs;
     std::vector<uint64_t> coinbase_global_outs;
     std::vector<struct_with_one_t_type<std::vector<uint64_t> > > tx_global_outs;
+    std::vector<uint64_t> global_outs; // compact form of the two above: outputs of the coinbase, then of each tx, in order
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(block)
       KV_SERIALIZE(txs)
       KV_SERIALIZE(coinbase_global_outs)
       KV_SERIALIZE(tx_global_outs)
+      KV_SERIALIZE_CONTAINER_POD_AS_BLOB(global_outs)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -45,6 +56,9 @@ namespace currency
     std::shared_ptr<const block_extended_info> block_ptr;
     std::shared_ptr<const transaction_chain_entry> coinbase_ptr;
     std::list<std::shared_ptr<const transaction_chain_entry> > txs_ptr;
+    // set only when the entry comes right from the core (in-process wallet): the block's id from the core's index,
+    // and then txs_ptr are known to follow block_ptr->bl.tx_hashes; null_hash for entries parsed from blobs
+    crypto::hash block_id;
   };
 
   /************************************************************************/
@@ -54,16 +68,19 @@ namespace currency
   {
     const static int ID = BC_COMMANDS_POOL_BASE + 1;
 
+    // b.txs may contain only some of the block's txs (or none) if the peer announced CURRENCY_PROTOCOL_FEATURE_COMPACT_BLOCKS
     struct request
     {
       block_complete_entry b;
       uint64_t current_blockchain_height;
       uint32_t hop;
+      bool prevalidated_only; // relayed after the PoW/PoS kernel check only, taken into account from peers with CURRENCY_PROTOCOL_FEATURE_EARLY_BLOCK_RELAY only
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(b)
         KV_SERIALIZE(current_blockchain_height)
         KV_SERIALIZE(hop)
+        KV_SERIALIZE(prevalidated_only)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -123,12 +140,14 @@ namespace currency
       std::list<block_complete_entry>  blocks;
       std::list<crypto::hash>          missed_ids;
       uint64_t                         current_blockchain_height;
+      blobdata                         blocks_raw; // instead of blocks, only to peers with CURRENCY_PROTOCOL_FEATURE_RAW_BLOCKS
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(txs)
         KV_SERIALIZE(blocks)
         KV_SERIALIZE_CONTAINER_POD_AS_BLOB(missed_ids)
         KV_SERIALIZE(current_blockchain_height)
+        KV_SERIALIZE(blocks_raw)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -140,6 +159,8 @@ namespace currency
     uint64_t last_checkpoint_height;
     uint64_t core_time;
     std::string client_version;
+    uint64_t protocol_features;
+    uint64_t pruned_height;   // meaningful only with CURRENCY_PROTOCOL_FEATURE_PRUNED
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(current_height)
@@ -147,6 +168,8 @@ namespace currency
       KV_SERIALIZE(last_checkpoint_height)
       KV_SERIALIZE(core_time)
       KV_SERIALIZE(client_version)
+      KV_SERIALIZE(protocol_features)
+      KV_SERIALIZE(pruned_height)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -175,11 +198,46 @@ namespace currency
       uint64_t start_height;
       uint64_t total_height;
       std::list<block_context_info> m_block_ids;
+      std::list<blobdata> m_block_headers; // blocks without txs, one for each of m_block_ids, only to peers with CURRENCY_PROTOCOL_FEATURE_CHAIN_HEADERS
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(start_height)
         KV_SERIALIZE(total_height)
         KV_SERIALIZE(m_block_ids)
+        KV_SERIALIZE(m_block_headers)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  // sent instead of NOTIFY_OR_INVOKE_NEW_TRANSACTIONS to peers with CURRENCY_PROTOCOL_FEATURE_TX_INVENTORY
+  struct NOTIFY_TX_INVENTORY
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 8;
+
+    struct request
+    {
+      std::list<crypto::hash> txs;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(txs)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  // answered with NOTIFY_OR_INVOKE_NEW_TRANSACTIONS notifications carrying the requested txs that are still in the pool
+  struct NOTIFY_REQUEST_TXS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 9;
+
+    struct request
+    {
+      std::list<crypto::hash> txs;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(txs)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -15,6 +15,11 @@
 #include "currency_core/connection_context.h"
 #include "currency_core/currency_stat_info.h"
 #include "currency_core/verification_context.h"
+#include "common/threads_pool.h"
+#include "math_helper.h"
+#include "cache_helper.h"
+#include "block_spans_scheduler.h"
+#include "raw_block_entries.h"
 
 #undef LOG_DEFAULT_CHANNEL 
 #define LOG_DEFAULT_CHANNEL "currency_protocol" 
@@ -48,6 +53,8 @@ namespace currency
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_GET_OBJECTS, &currency_protocol_handler::handle_response_get_objects)
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_CHAIN, &currency_protocol_handler::handle_request_chain)
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &currency_protocol_handler::handle_response_chain_entry)
+      HANDLE_NOTIFY_T2(NOTIFY_TX_INVENTORY, &currency_protocol_handler::handle_notify_tx_inventory)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_TXS, &currency_protocol_handler::handle_request_txs)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -58,8 +65,10 @@ namespace currency
     bool process_payload_sync_data(const CORE_SYNC_DATA& hshd, currency_connection_context& context, bool is_inital);
     bool get_payload_sync_data(blobdata& data);
     bool get_payload_sync_data(CORE_SYNC_DATA& hshd);
+    void get_notify_priorities(std::map<int, epee::net_utils::send_priority>& priorities);
     bool get_stat_info(const core_stat_info::params& pr, core_stat_info& stat_inf);
     bool on_callback(currency_connection_context& context);
+    void on_connection_close(currency_connection_context& context);
     t_core& get_core(){return m_core;}
     virtual bool is_synchronized(){ return m_synchronized; }
     void log_connections();
@@ -83,6 +92,11 @@ namespace currency
     int handle_response_get_objects(int command, NOTIFY_RESPONSE_GET_OBJECTS::request& arg, currency_connection_context& context);
     int handle_request_chain(int command, NOTIFY_REQUEST_CHAIN::request& arg, currency_connection_context& context);
     int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, currency_connection_context& context);
+    int handle_notify_tx_inventory(int command, NOTIFY_TX_INVENTORY::request& arg, currency_connection_context& context);
+    int handle_request_txs(int command, NOTIFY_REQUEST_TXS::request& arg, currency_connection_context& context);
+    int process_new_block_notification(NOTIFY_NEW_BLOCK::request& arg, currency_connection_context& context, bool allow_requesting_missing_txs);
+    bool take_pending_compact_block(const NOTIFY_RESPONSE_GET_OBJECTS::request& arg, currency_connection_context& context, std::shared_ptr<pending_compact_block>& pcb);
+    void report_block_announcement(const crypto::hash& block_id, currency_connection_context& context);
    
     
 
@@ -92,11 +106,33 @@ namespace currency
     //----------------------------------------------------------------------------------
     //bool get_payload_sync_data(HANDSHAKE_DATA::request& hshd, currency_connection_context& context);
     bool request_missing_objects(currency_connection_context& context, bool check_having_blocks);
+    bool request_next_batch(currency_connection_context& context, bool check_having_blocks);
+    void top_up_requested_batches(currency_connection_context& context, bool check_having_blocks = true);
+    void set_connection_idle(currency_connection_context& context);
+    // a downloaded span of blocks, waiting in m_ready_spans for the spans before it if it's ahead of the chain
+    struct ready_span
+    {
+      std::list<block_complete_entry> blocks;
+      std::vector<block> parsed_blocks; // of blocks, they're given to the core as is, not parsed once again
+      std::vector<block_verification_context> bvcs;
+      std::vector<crypto::hash> ids;
+      currency_connection_context context; // of the peer it came from
+    };
+    bool add_span_to_core(ready_span& rs, currency_connection_context& context, bool is_own_span);
+    size_t get_ready_spans_count();
+    void wake_up_waiting_peers();
+    bool parse_blocks_transactions(const std::list<block_complete_entry>& blocks, const std::vector<block>& parsed_blocks, std::vector<block_verification_context>& bvcs);
+    void precompute_blocks_pow_hashes(const std::vector<block>& blocks, const std::vector<crypto::hash>& ids);
+    bool check_chain_headers(const NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, currency_connection_context& context);
+    void run_in_sync_parse_pool(size_t count, const std::function<void(size_t, size_t)>& range_handler);
     bool on_connection_synchronized(); 
     void relay_que_worker();
+    void new_blocks_que_worker();
+    void verify_new_block(NOTIFY_NEW_BLOCK::request& arg, block& b, block_verification_context& bvc, const crypto::hash& block_id, bool has_block_txs_in_order, currency_connection_context& context, bool is_context_live);
     void process_current_relay_que(const std::list<relay_que_entry>& que);
     bool check_stop_flag_and_drop_cc(currency_connection_context& context);
     int handle_new_transaction_from_net(NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::request& req, NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::response& rsp, currency_connection_context& context, bool is_notify);
+    bool filter_relayed_txs(std::list<blobdata>& txs, const std::vector<currency::tx_verification_context>& tvcs);
     t_core& m_core;
 
     nodetool::p2p_endpoint_stub<connection_context> m_p2p_stub;
@@ -106,8 +142,20 @@ namespace currency
     std::atomic<uint64_t> m_max_height_seen;
     std::atomic<uint64_t> m_core_inital_height;
 
+    // parallel download of the chain from all the synchronizing peers: disjoint spans are given to them,
+    // and the spans that arrive ahead of the chain wait here for the ones before them, so the blocks are added in order
+    block_spans_scheduler m_spans;
+    std::unordered_map<crypto::hash, ready_span> m_ready_spans; // prev id of the first block -> span
+    std::mutex m_ready_spans_lock;                               // also makes the spans being added to the core one at a time
+    epee::math_helper::once_a_time_seconds<BLOCKS_SYNCHRONIZING_WAITING_PEERS_INTERVAL> m_waiting_peers_interval;
+
     std::unordered_set<crypto::hash> m_blocks_id_que;
     std::recursive_mutex m_blocks_id_que_lock;
+    epee::misc_utils::cache_base<false, crypto::hash, uint64_t, CURRENCY_PROTOCOL_BLOCKS_FIRST_SEEN_CACHE_SIZE> m_blocks_first_seen; // block id -> when it was announced first, ms
+
+    utils::threads_pool m_sync_parse_pool;
+    bool m_sync_parse_pool_initialized;
+    epee::critical_section m_sync_parse_pool_lock;
 
     std::list<relay_que_entry> m_relay_que;
     std::mutex m_relay_que_lock;
@@ -115,12 +163,34 @@ namespace currency
     std::thread m_relay_que_thread;
     std::atomic<bool> m_want_stop;
 
+    // new blocks from the network are verified one by one here, so the io threads of the connections don't wait for it
+    struct new_block_que_entry
+    {
+      NOTIFY_NEW_BLOCK::request arg;
+      block b;
+      block_verification_context bvc;
+      crypto::hash block_id;
+      bool has_block_txs_in_order;
+      currency_connection_context context;                              // a copy, the peer may be gone when it's verified
+      epee::misc_utils::auto_scope_leave_caller blocks_id_que_leave;    // keeps the block in m_blocks_id_que meanwhile
+    };
+    std::list<std::shared_ptr<new_block_que_entry>> m_new_blocks_que;
+    std::mutex m_new_blocks_que_lock;
+    std::condition_variable m_new_blocks_que_cv;
+    std::thread m_new_blocks_que_thread;
+
+    // announced txs requested from some peer, not to request them from others until CURRENCY_PROTOCOL_TX_REQUEST_TIMEOUT passes
+    std::unordered_map<crypto::hash, uint64_t> m_inventory_requested_txs; // tx id -> request time
+    std::mutex m_inventory_requested_txs_lock;
+
     std::deque<int64_t> m_time_deltas;
     std::mutex m_time_deltas_lock;
     int64_t m_last_median2local_time_difference;
     int64_t m_last_ntp2local_time_difference;
     uint32_t m_debug_ip_address;
     bool m_disable_ntp;
+    bool m_accept_compressed_frames;
+    bool m_early_block_relay;
 
     template<class t_parametr>
     bool post_notify(typename t_parametr::request& arg, currency_connection_context& context)
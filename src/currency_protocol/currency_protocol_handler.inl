@@ -19,11 +19,14 @@ namespace currency
     , m_have_been_synchronized(false)
     , m_max_height_seen(0)
     , m_core_inital_height(0)
+    , m_sync_parse_pool_initialized(false)
     , m_want_stop(false)
     , m_last_median2local_time_difference(0)
     , m_last_ntp2local_time_difference(0)
     , m_debug_ip_address(0)
     , m_disable_ntp(false)
+    , m_accept_compressed_frames(false)
+    , m_early_block_relay(false)
   {
     if(!m_p2p)
       m_p2p = &m_p2p_stub;
@@ -39,8 +42,13 @@ namespace currency
   bool t_currency_protocol_handler<t_core>::init(const boost::program_options::variables_map& vm)
   {
     m_relay_que_thread = std::thread([this](){relay_que_worker();});
+    m_new_blocks_que_thread = std::thread([this](){new_blocks_que_worker();});
     if (command_line::has_arg(vm, command_line::arg_disable_ntp))
       m_disable_ntp = command_line::get_arg(vm, command_line::arg_disable_ntp);
+    if (command_line::has_arg(vm, command_line::arg_p2p_compression))
+      m_accept_compressed_frames = command_line::get_arg(vm, command_line::arg_p2p_compression);
+    if (command_line::has_arg(vm, command_line::arg_early_block_relay))
+      m_early_block_relay = command_line::get_arg(vm, command_line::arg_early_block_relay);
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------  
@@ -51,6 +59,13 @@ namespace currency
     m_relay_que_cv.notify_all();
     if (m_relay_que_thread.joinable())
       m_relay_que_thread.join();
+    {
+      std::lock_guard<std::mutex> lk(m_new_blocks_que_lock);
+      m_new_blocks_que_cv.notify_all();
+    }
+    if (m_new_blocks_que_thread.joinable())
+      m_new_blocks_que_thread.join();
+    m_new_blocks_que.clear();
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------  
@@ -72,6 +87,12 @@ namespace currency
 
     if(context.m_state == currency_connection_context::state_synchronizing)
     {
+      if (context.m_priv.m_needed_objects.size() || context.m_priv.m_requested_batches.size())
+      {
+        // woken up while the blocks it needs were downloaded by other peers
+        request_missing_objects(context, true);
+        return true;
+      }
       NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
       m_core.get_short_chain_history(r.block_ids);
       LOG_PRINT_L2("[NOTIFY]NOTIFY_REQUEST_CHAIN(on_callback): m_block_ids.size()=" << r.block_ids.size());
@@ -83,6 +104,13 @@ namespace currency
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
+  void t_currency_protocol_handler<t_core>::on_connection_close(currency_connection_context& context)
+  {
+    // the spans it was downloading are given to other peers
+    m_spans.release_peer(context.m_connection_id);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core> 
   bool t_currency_protocol_handler<t_core>::get_stat_info(const core_stat_info::params& pr, core_stat_info& stat_inf)
   {
     return m_core.get_stat_info(pr, stat_inf);
@@ -131,6 +159,12 @@ namespace currency
 
 
     context.m_remote_version = hshd.client_version;
+    context.m_remote_protocol_features = hshd.protocol_features;
+    context.m_remote_pruned_height = (hshd.protocol_features & CURRENCY_PROTOCOL_FEATURE_PRUNED) ? hshd.pruned_height : 0;
+    // compressed frames are always understood, but sent only to the peers that asked for them
+    m_p2p->set_connection_compression(context, (hshd.protocol_features & CURRENCY_PROTOCOL_FEATURE_COMPRESSED_FRAMES) != 0);
+    if (!context.m_known_txs)
+      context.m_known_txs = std::make_shared<known_txs_filter>(CURRENCY_PROTOCOL_KNOWN_TXS_FILTER_CAPACITY, crypto::rand<uint64_t>());
 
     if(context.m_state == currency_connection_context::state_befor_handshake && !is_inital)
       return true;
@@ -200,6 +234,16 @@ namespace currency
         "It means that current software is outdated, please updated it!", LOG_LEVEL_0);
     }
 
+    // a pruned peer can't give blocks above our checkpoints zone that are below its pruned height: they couldn't be validated
+    uint64_t first_height_to_validate = std::max(m_core.get_current_blockchain_size(), m_core.get_blockchain_storage().get_checkpoints().get_top_checkpoint_height() + 1);
+    if (context.m_remote_pruned_height >= first_height_to_validate)
+    {
+      LOG_PRINT_L1("Remote node is pruned up to height " << context.m_remote_pruned_height << " and can't provide blocks from height " << first_height_to_validate << ", not synchronizing from it");
+      context.m_state = currency_connection_context::state_idle;
+      context.m_remote_blockchain_height = hshd.current_height;
+      return true;
+    }
+
     context.m_state = currency_connection_context::state_synchronizing;
     context.m_remote_blockchain_height = hshd.current_height;
     //let the socket to send response to handshake, but request callback, to let send request data after response
@@ -235,8 +279,30 @@ namespace currency
     hshd.last_checkpoint_height = m_core.get_blockchain_storage().get_checkpoints().get_top_checkpoint_height();
     hshd.core_time = m_core.get_blockchain_storage().get_core_runtime_config().get_core_time();
     hshd.client_version = PROJECT_VERSION_LONG;
+    hshd.protocol_features = CURRENCY_PROTOCOL_FEATURE_COMPACT_BLOCKS | CURRENCY_PROTOCOL_FEATURE_TX_INVENTORY | CURRENCY_PROTOCOL_FEATURE_CHAIN_HEADERS | CURRENCY_PROTOCOL_FEATURE_RAW_BLOCKS;
+    if (m_accept_compressed_frames)
+      hshd.protocol_features |= CURRENCY_PROTOCOL_FEATURE_COMPRESSED_FRAMES;
+    if (m_early_block_relay)
+      hshd.protocol_features |= CURRENCY_PROTOCOL_FEATURE_EARLY_BLOCK_RELAY;
+    hshd.pruned_height = 0;
+    if (m_core.get_blockchain_storage().get_prune_depth() != 0)
+    {
+      hshd.protocol_features |= CURRENCY_PROTOCOL_FEATURE_PRUNED;
+      hshd.pruned_height = m_core.get_blockchain_storage().get_pruned_rs_height();
+    }
     return true;
   }
+  //------------------------------------------------------------------------------------------------------------------------  
+  template<class t_core> 
+  void t_currency_protocol_handler<t_core>::get_notify_priorities(std::map<int, epee::net_utils::send_priority>& priorities)
+  {
+    // new blocks go ahead of everything, txs go ahead of the sync traffic, and the blocks for syncing peers go last
+    priorities[NOTIFY_NEW_BLOCK::ID] = epee::net_utils::send_priority_high;
+    priorities[NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::ID] = epee::net_utils::send_priority_above_normal;
+    priorities[NOTIFY_TX_INVENTORY::ID] = epee::net_utils::send_priority_above_normal;
+    priorities[NOTIFY_REQUEST_TXS::ID] = epee::net_utils::send_priority_above_normal;
+    priorities[NOTIFY_RESPONSE_GET_OBJECTS::ID] = epee::net_utils::send_priority_low;
+  }
   //------------------------------------------------------------------------------------------------------------------------  
     template<class t_core> 
     bool t_currency_protocol_handler<t_core>::get_payload_sync_data(blobdata& data)
@@ -249,6 +315,26 @@ namespace currency
   //------------------------------------------------------------------------------------------------------------------------  
     template<class t_core> 
     int t_currency_protocol_handler<t_core>::handle_notify_new_block(int command, NOTIFY_NEW_BLOCK::request& arg, currency_connection_context& context)
+  {
+    return process_new_block_notification(arg, context, true);
+  }
+  //------------------------------------------------------------------------------------------------------------------------  
+  template<class t_core> 
+  void t_currency_protocol_handler<t_core>::report_block_announcement(const crypto::hash& block_id, currency_connection_context& context)
+  {
+    // the peer that announced the block first is not late, the rest are late by the time since then
+    uint64_t now = epee::misc_utils::get_tick_count();
+    uint64_t first_seen = 0;
+    if (!m_blocks_first_seen.get(block_id, first_seen))
+    {
+      first_seen = now;
+      m_blocks_first_seen.set(block_id, first_seen);
+    }
+    m_p2p->report_block_announcement(context, now - std::min(first_seen, now));
+  }
+  //------------------------------------------------------------------------------------------------------------------------  
+  template<class t_core> 
+  int t_currency_protocol_handler<t_core>::process_new_block_notification(NOTIFY_NEW_BLOCK::request& arg, currency_connection_context& context, bool allow_requesting_missing_txs)
   {
     //do not process requests if it comes from node wich is debugged
     if (m_debug_ip_address != 0 && context.m_remote_ip == m_debug_ip_address)
@@ -269,6 +355,8 @@ namespace currency
 
     crypto::hash block_id = get_block_hash(b);
     LOG_PRINT_GREEN("[HANDLE]NOTIFY_NEW_BLOCK " << block_id << " HEIGHT " << get_block_height(b) << " (hop " << arg.hop << ")", LOG_LEVEL_2);
+    if (allow_requesting_missing_txs) // not a compact block completed with the requested txs
+      report_block_announcement(block_id, context);
 
     CRITICAL_REGION_BEGIN(m_blocks_id_que_lock);
     auto it = m_blocks_id_que.find(block_id);
@@ -283,7 +371,7 @@ namespace currency
       m_blocks_id_que.insert(block_id);
     }
     CRITICAL_REGION_END();
-    auto slh = epee::misc_utils::create_scope_leave_handler([&]()
+    auto slh = epee::misc_utils::create_scope_leave_handler([this, block_id]()
     {
       CRITICAL_REGION_LOCAL(m_blocks_id_que_lock);
       auto it = m_blocks_id_que.find(block_id);
@@ -297,24 +385,10 @@ namespace currency
       return 1;
     }
     
-    //pre-validate block here, and propagate it to network asap to avoid latency of handling big block (tx flood)
-    //########################################################
-    /*
-    problem with prevalidation: in case of pre_validate_block() is passed but handle_incoming_tx() is failed
-    network got spammed with notifications about this broken block and then connections got closed.
-    temporary disabled to more investigation
-    bool prevalidate_relayed = false; 
-    if (m_core.pre_validate_block(b, bvc, block_id) && bvc.m_added_to_main_chain)
-    {
-      //not alternative block, relay it
-      ++arg.hop;
-      relay_block(arg, context);
-      prevalidate_relayed = true;
-    }
-    */
-    //########################################################
+    // a block extending the top may be relayed before its full check, see verify_new_block()
 
     //now actually process block
+    std::unordered_map<crypto::hash, std::list<blobdata>::iterator> tx_blobs_by_id;
     for(auto tx_blob_it = arg.b.txs.begin(); tx_blob_it!=arg.b.txs.end();tx_blob_it++)
     {
       if (tx_blob_it->size() > CURRENCY_MAX_TRANSACTION_BLOB_SIZE)
@@ -333,32 +407,237 @@ namespace currency
         return 1;
       }
       bvc.m_onboard_transactions[tx_hash] = tx;
+      tx_blobs_by_id[tx_hash] = tx_blob_it;
+    }
+
+    bool has_block_txs_in_order = false;
+    if (bvc.m_onboard_transactions.size() < b.tx_hashes.size())
+    {
+      // compact block: take the rest of txs from the pool, request the missing ones from the peer
+      std::unordered_set<crypto::hash> missing_txs;
+      for (const crypto::hash& tx_id : b.tx_hashes)
+      {
+        if (bvc.m_onboard_transactions.count(tx_id) != 0)
+          continue;
+        transaction tx = AUTO_VAL_INIT(tx);
+        if (m_core.get_tx_pool().get_transaction(tx_id, tx))
+          bvc.m_onboard_transactions[tx_id] = tx;
+        else
+          missing_txs.insert(tx_id);
+      }
+
+      if (missing_txs.size())
+      {
+        if (!allow_requesting_missing_txs || missing_txs.size() > CURRENCY_PROTOCOL_MAX_TXS_REQUEST_COUNT)
+        {
+          LOG_PRINT_L1("Compact block " << block_id << " can't be reconstructed, " << missing_txs.size() << " txs are still missing, skipped");
+          return 1;
+        }
+        if (context.m_priv.m_pending_compact_blocks.count(block_id))
+        {
+          LOG_PRINT_L2("Compact block " << block_id << " is already waiting for its txs");
+          return 1;
+        }
+        if (context.m_priv.m_pending_compact_blocks.size() >= CURRENCY_PROTOCOL_MAX_PENDING_COMPACT_BLOCKS)
+        {
+          LOG_PRINT_L1("Compact block " << block_id << " skipped, " << context.m_priv.m_pending_compact_blocks.size() << " compact blocks are waiting for their txs already");
+          return 1;
+        }
+
+        std::shared_ptr<pending_compact_block> pcb = std::make_shared<pending_compact_block>();
+        pcb->block_blob = arg.b.block;
+        pcb->txs = arg.b.txs;
+        pcb->missing_txs = missing_txs;
+        pcb->current_blockchain_height = arg.current_blockchain_height;
+        pcb->hop = arg.hop;
+        pcb->prevalidated_only = arg.prevalidated_only;
+        context.m_priv.m_pending_compact_blocks[block_id] = pcb;
+
+        NOTIFY_REQUEST_GET_OBJECTS::request req = AUTO_VAL_INIT(req);
+        req.txs.assign(missing_txs.begin(), missing_txs.end());
+        LOG_PRINT_L2("[NOTIFY]NOTIFY_REQUEST_GET_OBJECTS: " << req.txs.size() << " missing txs for compact block " << block_id);
+        post_notify<NOTIFY_REQUEST_GET_OBJECTS>(req, context);
+        return 1;
+      }
+
+      // keep the full block for relaying to peers which don't support compact blocks
+      arg.b.txs.clear();
+      for (const crypto::hash& tx_id : b.tx_hashes)
+        arg.b.txs.push_back(t_serializable_object_to_blob(bvc.m_onboard_transactions[tx_id]));
+      has_block_txs_in_order = true;
+    }
+    else if (std::all_of(b.tx_hashes.begin(), b.tx_hashes.end(), [&](const crypto::hash& tx_id) { return tx_blobs_by_id.count(tx_id) != 0; }))
+    {
+      // the block's txs are given in the block's order, as they are sent to peers and wallets
+      std::list<blobdata> ordered_txs;
+      for (const crypto::hash& tx_id : b.tx_hashes)
+        ordered_txs.push_back(std::move(*tx_blobs_by_id[tx_id]));
+      arg.b.txs.swap(ordered_txs);
+      has_block_txs_in_order = true;
     }
     
+    if (m_new_blocks_que_thread.joinable())
+    {
+      std::shared_ptr<new_block_que_entry> e = std::make_shared<new_block_que_entry>();
+      e->arg = std::move(arg);
+      e->b = std::move(b);
+      e->bvc = std::move(bvc);
+      e->block_id = block_id;
+      e->has_block_txs_in_order = has_block_txs_in_order;
+      e->context = context;
+      e->blocks_id_que_leave = slh;
+      {
+        std::lock_guard<std::mutex> lk(m_new_blocks_que_lock);
+        m_new_blocks_que.push_back(e);
+      }
+      m_new_blocks_que_cv.notify_one();
+      return 1;
+    }
+
+    verify_new_block(arg, b, bvc, block_id, has_block_txs_in_order, context, true);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_currency_protocol_handler<t_core>::take_pending_compact_block(const NOTIFY_RESPONSE_GET_OBJECTS::request& arg, currency_connection_context& context, std::shared_ptr<pending_compact_block>& pcb)
+  {
+    // the response is for the compact block which missing txs are exactly the given and the missed ones,
+    // pcb is left empty if there's no such block; returns false if the connection was dropped
+    std::unordered_set<crypto::hash> replied_ids(arg.missed_ids.begin(), arg.missed_ids.end());
+    for (const blobdata& tx_blob : arg.txs)
+    {
+      transaction tx = AUTO_VAL_INIT(tx);
+      crypto::hash tx_id = null_hash;
+      if (!parse_and_validate_tx_from_blob(tx_blob, tx, tx_id))
+      {
+        LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: failed to parse tx, dropping connection");
+        m_p2p->drop_connection(context);
+        m_p2p->add_ip_fail(context.m_remote_ip);
+        return false;
+      }
+      replied_ids.insert(tx_id);
+    }
+
+    for (auto it = context.m_priv.m_pending_compact_blocks.begin(); it != context.m_priv.m_pending_compact_blocks.end(); ++it)
+    {
+      if (it->second->missing_txs == replied_ids)
+      {
+        pcb = it->second;
+        context.m_priv.m_pending_compact_blocks.erase(it);
+        break;
+      }
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_currency_protocol_handler<t_core>::verify_new_block(NOTIFY_NEW_BLOCK::request& arg, block& b, block_verification_context& bvc, const crypto::hash& block_id, bool has_block_txs_in_order, currency_connection_context& context, bool is_context_live)
+  {
+    // with --early-block-relay a block extending the top is sent on as soon as its PoW hash or PoS kernel
+    // is checked, in parallel with the full check; it's marked as prevalidated_only so that the peers
+    // count it against us instead of dropping us at once if the full check fails after all
+    bool prevalidated = false;
+    bool early_relayed = false;
+    if (m_early_block_relay && has_block_txs_in_order)
+    {
+      block_verification_context pre_bvc = AUTO_VAL_INIT(pre_bvc);
+      prevalidated = m_core.pre_validate_block(b, pre_bvc, block_id) && !pre_bvc.m_verification_failed && pre_bvc.m_added_to_main_chain;
+      if (prevalidated)
+      {
+        NOTIFY_NEW_BLOCK::request early_arg = arg;
+        ++early_arg.hop;
+        early_arg.prevalidated_only = true;
+        relay_block(early_arg, context);
+        early_relayed = true;
+      }
+    }
+
     m_core.pause_mine();
     m_core.handle_incoming_block(b, bvc);
     m_core.resume_mine();
     if(bvc.m_verification_failed)
     {
+      if (arg.prevalidated_only && (context.m_remote_protocol_features & CURRENCY_PROTOCOL_FEATURE_EARLY_BLOCK_RELAY))
+      {
+        // the relayer couldn't know, only its kernel check is its responsibility; still, it's penalized
+        // and dropped after a few such blocks
+        if (!prevalidated)
+        {
+          block_verification_context pre_bvc = AUTO_VAL_INIT(pre_bvc);
+          prevalidated = m_core.pre_validate_block(b, pre_bvc, block_id) && !pre_bvc.m_verification_failed && pre_bvc.m_added_to_main_chain;
+        }
+        if (prevalidated)
+        {
+          m_p2p->add_ip_fail(context.m_remote_ip);
+          uint32_t failed_count = 0;
+          if (is_context_live)
+          {
+            failed_count = ++context.m_priv.m_prevalidated_failed_blocks;
+          }
+          else
+          {
+            m_p2p->for_each_connection([&](currency_connection_context& cc, nodetool::peerid_type /*peer_id*/)
+            {
+              if (cc.m_connection_id != context.m_connection_id)
+                return true;
+              failed_count = ++cc.m_priv.m_prevalidated_failed_blocks;
+              return false;
+            });
+          }
+          if (failed_count < CURRENCY_PROTOCOL_MAX_PREVALIDATED_FAILED_BLOCKS)
+          {
+            LOG_PRINT_L0("Block " << block_id << " relayed as prevalidated failed verification (" << failed_count << " from this peer), ignored");
+            return;
+          }
+          LOG_PRINT_L0("Block " << block_id << " relayed as prevalidated failed verification, " << failed_count << " such blocks from this peer, dropping connection");
+          m_p2p->drop_connection(context);
+          return;
+        }
+      }
       LOG_PRINT_L0("Block verification failed, dropping connection");
       m_p2p->drop_connection(context);
-      return 1;
+      return;
     }
     LOG_PRINT_GREEN("[HANDLE]NOTIFY_NEW_BLOCK EXTRA " << block_id 
       << " bvc.m_added_to_main_chain=" << bvc.m_added_to_main_chain
-      //<< ", prevalidate_result=" << prevalidate_relayed
+      << ", early_relayed=" << early_relayed
       << ", bvc.added_to_altchain=" << bvc.m_added_to_altchain
       << ", bvc.m_marked_as_orphaned=" << bvc.m_marked_as_orphaned, LOG_LEVEL_2);
 
+    if (bvc.m_added_to_main_chain && has_block_txs_in_order)
+      m_core.get_blockchain_storage().cache_block_blobs(block_id, arg.b); // the peers that missed it will request it soon
+
     if (bvc.m_added_to_main_chain || (bvc.m_added_to_altchain && bvc.m_height_difference < 2))
     { 
-      if (true/*!prevalidate_relayed*/)
+      if (!early_relayed)
       {
-        // pre-validation failed prevoiusly, but complete check was success, not an alternative block
+        // not relayed before the full check: early relay is off, or it's an alternative block
         ++arg.hop;
+        arg.prevalidated_only = false;
         //TODO: Add here announce protocol usage
         relay_block(arg, context);
       }
+    }else if(bvc.m_marked_as_orphaned && !is_context_live)
+    {
+      // the connection is served by its own io thread, on_callback() asks it for the chain there
+      bool found = false;
+      m_p2p->for_each_connection([&](currency_connection_context& cc, nodetool::peerid_type peer_id)
+      {
+        if (cc.m_connection_id != context.m_connection_id)
+          return true;
+        if (cc.m_state == currency_connection_context::state_normal)
+        {
+          cc.m_state = currency_connection_context::state_synchronizing;
+          ++cc.m_priv.m_callback_request_count;
+          found = true;
+        }
+        return false;
+      });
+      if (found)
+      {
+        LOG_PRINT_MAGENTA("State changed to state_synchronizing.", LOG_LEVEL_2);
+        m_p2p->request_callback(context);
+      }
     }else if(bvc.m_marked_as_orphaned)
     {
       context.m_state = currency_connection_context::state_synchronizing;
@@ -369,8 +648,24 @@ namespace currency
       LOG_PRINT_L3("[NOTIFY]NOTIFY_REQUEST_CHAIN(on_orphaned): " << ENDL << print_kv_structure(r));
       post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
     }
-      
-    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_currency_protocol_handler<t_core>::new_blocks_que_worker()
+  {
+    while (!m_want_stop)
+    {
+      std::shared_ptr<new_block_que_entry> e;
+      {
+        std::unique_lock<std::mutex> lk(m_new_blocks_que_lock);
+        m_new_blocks_que_cv.wait(lk, [this]() { return m_want_stop || !m_new_blocks_que.empty(); });
+        if (m_want_stop)
+          return;
+        e = m_new_blocks_que.front();
+        m_new_blocks_que.pop_front();
+      }
+      verify_new_block(e->arg, e->b, e->bvc, e->block_id, e->has_block_txs_in_order, e->context, false);
+    }
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
@@ -415,37 +710,174 @@ namespace currency
     }
 
     TIME_MEASURE_START_MS(new_transactions_handle_time);
-    for (auto tx_blob_it = arg.txs.begin(); tx_blob_it != arg.txs.end();)
+    std::vector<currency::tx_verification_context> tvcs;
+    if (is_notify)
     {
-      currency::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-
-      m_core.handle_incoming_tx(*tx_blob_it, tvc, false);
-      if (tvc.m_verification_failed)
+      // verification goes on the core's admission workers so this network thread is not held up; the rest is done in the callback
+      currency_connection_context context_copy = context;
+      std::list<blobdata> tx_blobs = arg.txs;
+      bool r = m_core.handle_incoming_txs_async(arg.txs, tvcs, [this, context_copy, tx_blobs, inital_tx_count](const std::vector<currency::tx_verification_context>& tvcs_res) mutable
+      {
+        NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::request relay_arg = AUTO_VAL_INIT(relay_arg);
+        relay_arg.txs = std::move(tx_blobs);
+        if (!filter_relayed_txs(relay_arg.txs, tvcs_res))
+        {
+          LOG_PRINT_L0("NOTIFY_NEW_TRANSACTIONS: Tx verification failed, dropping connection");
+          m_p2p->drop_connection(context_copy);
+          return;
+        }
+        if (relay_arg.txs.size())
+          relay_transactions(relay_arg, context_copy);
+        LOG_PRINT_L2("NOTIFY_OR_INVOKE_NEW_TRANSACTIONS(is_notify=1): processed (inital_tx_count: " << inital_tx_count << ", relayed_tx_count: " << relay_arg.txs.size() << ")");
+      });
+      if (!r)
       {
         LOG_PRINT_L0("NOTIFY_NEW_TRANSACTIONS: Tx verification failed, dropping connection");
-        if(is_notify)
-          m_p2p->drop_connection(context);
-        else 
-          rsp.code = API_RETURN_CODE_FAIL;
+        m_p2p->drop_connection(context);
         return 1;
       }
-      if (tvc.m_should_be_relayed)
-        ++tx_blob_it;
-      else
-        arg.txs.erase(tx_blob_it++);
+      TIME_MEASURE_FINISH_MS(new_transactions_handle_time);
+      LOG_PRINT_L2("NOTIFY_OR_INVOKE_NEW_TRANSACTIONS(is_notify=1): " << new_transactions_handle_time << "ms to queue (inital_tx_count: " << inital_tx_count << ")");
+      rsp.code = API_RETURN_CODE_OK;
+      return 1;
     }
 
-    if (arg.txs.size())
+    m_core.handle_incoming_txs(arg.txs, tvcs);
+    if (!filter_relayed_txs(arg.txs, tvcs))
     {
-      //TODO: add announce usage here
-      relay_transactions(arg, context);
+      LOG_PRINT_L0("NOTIFY_NEW_TRANSACTIONS: Tx verification failed");
+      rsp.code = API_RETURN_CODE_FAIL;
+      return 1;
     }
+
+    if (arg.txs.size())
+      relay_transactions(arg, context);
     TIME_MEASURE_FINISH_MS(new_transactions_handle_time);
 
     LOG_PRINT_L2("NOTIFY_OR_INVOKE_NEW_TRANSACTIONS(is_notify=" << is_notify <<"): " << new_transactions_handle_time << "ms (inital_tx_count: " << inital_tx_count << ", relayed_tx_count: " << arg.txs.size() << ")");
     rsp.code = API_RETURN_CODE_OK;
     return 1;
   }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_currency_protocol_handler<t_core>::handle_notify_tx_inventory(int command, NOTIFY_TX_INVENTORY::request& arg, currency_connection_context& context)
+  {
+    //do not process requests if it comes from node wich is debugged
+    if (m_debug_ip_address != 0 && context.m_remote_ip == m_debug_ip_address)
+      return 1;
+
+    if (arg.txs.size() > CURRENCY_PROTOCOL_MAX_TX_INVENTORY_COUNT)
+    {
+      LOG_ERROR_CCONTEXT("NOTIFY_TX_INVENTORY: too many tx ids (" << arg.txs.size() << "), expected not more then " << CURRENCY_PROTOCOL_MAX_TX_INVENTORY_COUNT << ", dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+
+    if (context.m_known_txs)
+    {
+      for (const crypto::hash& id : arg.txs)
+        context.m_known_txs->insert(id);
+    }
+
+    if (!this->is_synchronized())
+      return 1;
+
+    std::list<crypto::hash> wanted_txs;
+    for (const crypto::hash& id : arg.txs)
+    {
+      if (m_core.get_tx_pool().have_tx(id) || m_core.get_tx_pool().is_tx_recently_evicted(id) || m_core.get_blockchain_storage().have_tx(id))
+        continue;
+      wanted_txs.push_back(id);
+    }
+
+    NOTIFY_REQUEST_TXS::request req = AUTO_VAL_INIT(req);
+    {
+      uint64_t now = m_core.get_blockchain_storage().get_core_runtime_config().get_core_time();
+      CRITICAL_REGION_LOCAL(m_inventory_requested_txs_lock);
+      if (m_inventory_requested_txs.size() > CURRENCY_PROTOCOL_KNOWN_TXS_FILTER_CAPACITY)
+      {
+        for (auto it = m_inventory_requested_txs.begin(); it != m_inventory_requested_txs.end();)
+        {
+          if (it->second + CURRENCY_PROTOCOL_TX_REQUEST_TIMEOUT < now)
+            it = m_inventory_requested_txs.erase(it);
+          else
+            ++it;
+        }
+      }
+      for (const crypto::hash& id : wanted_txs)
+      {
+        if (req.txs.size() >= CURRENCY_PROTOCOL_MAX_TXS_REQUEST_COUNT)
+          break;
+        auto it = m_inventory_requested_txs.find(id);
+        if (it != m_inventory_requested_txs.end() && it->second + CURRENCY_PROTOCOL_TX_REQUEST_TIMEOUT >= now)
+          continue; // has been requested from another peer recently
+        m_inventory_requested_txs[id] = now;
+        req.txs.push_back(id);
+      }
+    }
+
+    LOG_PRINT_L2("[HANDLE]NOTIFY_TX_INVENTORY: " << arg.txs.size() << " ids announced, " << req.txs.size() << " requested");
+    if (req.txs.size())
+      post_notify<NOTIFY_REQUEST_TXS>(req, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_currency_protocol_handler<t_core>::handle_request_txs(int command, NOTIFY_REQUEST_TXS::request& arg, currency_connection_context& context)
+  {
+    //do not process requests if it comes from node wich is debugged
+    if (m_debug_ip_address != 0 && context.m_remote_ip == m_debug_ip_address)
+      return 1;
+
+    if (arg.txs.size() > CURRENCY_PROTOCOL_MAX_TXS_REQUEST_COUNT)
+    {
+      LOG_ERROR_CCONTEXT("NOTIFY_REQUEST_TXS: too many txs requested (" << arg.txs.size() << "), expected not more then " << CURRENCY_PROTOCOL_MAX_TXS_REQUEST_COUNT << ", dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+
+    // only pool txs are served: announced ones that got into a block meanwhile will come with the block
+    size_t found_count = 0;
+    NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::request rsp = AUTO_VAL_INIT(rsp);
+    for (const crypto::hash& id : arg.txs)
+    {
+      transaction tx = AUTO_VAL_INIT(tx);
+      if (!m_core.get_tx_pool().get_transaction(id, tx))
+        continue;
+      if (context.m_known_txs)
+        context.m_known_txs->insert(id);
+      rsp.txs.push_back(t_serializable_object_to_blob(tx));
+      ++found_count;
+      // the receiver doesn't take more than CURRENCY_RELAY_TXS_MAX_COUNT txs at once
+      if (rsp.txs.size() == CURRENCY_RELAY_TXS_MAX_COUNT)
+      {
+        post_notify<NOTIFY_OR_INVOKE_NEW_TRANSACTIONS>(rsp, context);
+        rsp.txs.clear();
+      }
+    }
+    if (rsp.txs.size())
+      post_notify<NOTIFY_OR_INVOKE_NEW_TRANSACTIONS>(rsp, context);
+
+    LOG_PRINT_L2("[HANDLE]NOTIFY_REQUEST_TXS: " << arg.txs.size() << " txs requested, " << found_count << " sent");
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_currency_protocol_handler<t_core>::filter_relayed_txs(std::list<blobdata>& txs, const std::vector<currency::tx_verification_context>& tvcs)
+  {
+    // keeps only txs that should be relayed; returns false if any tx failed verification
+    size_t i = 0;
+    for (auto tx_blob_it = txs.begin(); tx_blob_it != txs.end(); ++i)
+    {
+      if (i < tvcs.size() && tvcs[i].m_verification_failed)
+        return false;
+      if (i < tvcs.size() && tvcs[i].m_should_be_relayed)
+        ++tx_blob_it;
+      else
+        txs.erase(tx_blob_it++);
+    }
+    return true;
+  }
 
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
@@ -477,6 +909,8 @@ namespace currency
 
 
     LOG_PRINT_L3("[NOTIFY]NOTIFY_RESPONSE_GET_OBJECTS: " << ENDL << currency::print_kv_structure(rsp));
+    if ((context.m_remote_protocol_features & CURRENCY_PROTOCOL_FEATURE_RAW_BLOCKS) && !rsp.blocks.empty() && pack_raw_block_entries(rsp.blocks, rsp.blocks_raw))
+      rsp.blocks.clear();
     post_notify<NOTIFY_RESPONSE_GET_OBJECTS>(rsp, context);
     return 1;
   }
@@ -504,6 +938,18 @@ namespace currency
     if (m_debug_ip_address != 0 && context.m_remote_ip == m_debug_ip_address)
       return 1;
 
+    if (!arg.blocks_raw.empty())
+    {
+      if (!arg.blocks.empty() || !unpack_raw_block_entries(arg.blocks_raw, arg.blocks))
+      {
+        LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: malformed blocks_raw (" << arg.blocks_raw.size() << " bytes), dropping connection");
+        m_p2p->drop_connection(context);
+        m_p2p->add_ip_fail(context.m_remote_ip);
+        return 1;
+      }
+      blobdata().swap(arg.blocks_raw);
+    }
+
     LOG_PRINT_L2("[HANDLE]NOTIFY_RESPONSE_GET_OBJECTS: arg.blocks.size()=" << arg.blocks.size() << ", arg.missed_ids.size()=" << arg.missed_ids.size() << ", arg.txs.size()=" << arg.txs.size());
     LOG_PRINT_L3("[HANDLE]NOTIFY_RESPONSE_GET_OBJECTS: " << ENDL << currency::print_kv_structure(arg));
     if(context.m_last_response_height > arg.current_blockchain_height)
@@ -516,8 +962,55 @@ namespace currency
 
     context.m_remote_blockchain_height = arg.current_blockchain_height;
 
+    // sync batches and txs requests for compact blocks may be in flight together, the answer to the latter
+    // has no blocks and gives each of the requested txs either in txs or in missed_ids
+    std::shared_ptr<pending_compact_block> pcb;
+    if (arg.blocks.empty() && !context.m_priv.m_pending_compact_blocks.empty() && !take_pending_compact_block(arg, context, pcb))
+      return 1;
+    if (pcb)
+    {
+      if (arg.missed_ids.size())
+        LOG_PRINT_L1("Peer doesn't have " << arg.missed_ids.size() << " of " << pcb->missing_txs.size() << " txs requested for compact block");
+
+      NOTIFY_NEW_BLOCK::request nb = AUTO_VAL_INIT(nb);
+      nb.b.block = pcb->block_blob;
+      nb.b.txs.swap(pcb->txs);
+      nb.b.txs.splice(nb.b.txs.end(), arg.txs);
+      nb.current_blockchain_height = pcb->current_blockchain_height;
+      nb.hop = pcb->hop;
+      nb.prevalidated_only = pcb->prevalidated_only;
+      return process_new_block_notification(nb, context, false);
+    }
+
+    if (context.m_priv.m_stale_batches_count)
+    {
+      // response to a request made ahead before the connection was set to idle state
+      --context.m_priv.m_stale_batches_count;
+      LOG_PRINT_L1("Skipped response to stale NOTIFY_REQUEST_GET_OBJECTS, blocks: " << arg.blocks.size());
+      return 1;
+    }
+
+    if (context.m_priv.m_requested_batches.empty())
+    {
+      LOG_ERROR_CCONTEXT("sent NOTIFY_RESPONSE_GET_OBJECTS while nothing was requested, dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+    std::unordered_set<crypto::hash>& requested_batch = context.m_priv.m_requested_batches.front();
+
     uint64_t total_blocks_parsing_time = 0;
     size_t count = 0;
+    std::vector<block> parsed_blocks;
+    parsed_blocks.reserve(arg.blocks.size());
+    std::vector<crypto::hash> ids;
+    ids.reserve(arg.blocks.size());
+    uint64_t response_size = 0;
+    for (const block_complete_entry& block_entry : arg.blocks)
+    {
+      response_size += block_entry.block.size();
+      for (const auto& tx_blob : block_entry.txs)
+        response_size += tx_blob.size();
+    }
     for (const block_complete_entry& block_entry : arg.blocks)
     {
       CHECK_STOP_FLAG__DROP_AND_RETURN_IF_SET(1, "Blocks processing interrupted, connection dropped");
@@ -535,22 +1028,33 @@ namespace currency
       }      
       TIME_MEASURE_FINISH(block_parsing_time);
       total_blocks_parsing_time += block_parsing_time;
+      crypto::hash id = get_block_hash(b);
+
+      if (count == 1 && !m_spans.is_claimed_by(context.m_connection_id, id))
+      {
+        // the span was stalled and has been given to another peer
+        LOG_PRINT_L1("Span of " << arg.blocks.size() << " blocks from height " << get_block_height(b) << " was given to another peer, the response is skipped");
+        m_spans.on_received(context.m_connection_id, std::vector<crypto::hash>(), response_size, epee::misc_utils::get_tick_count());
+        for (const auto& h : requested_batch)
+          context.m_priv.m_requested_objects.erase(h);
+        context.m_priv.m_requested_batches.pop_front();
+        request_missing_objects(context, true);
+        return 1;
+      }
 
       //to avoid concurrency in core between connections, suspend connections which delivered block later then first one
       if(count == 2)
       { 
-        if(m_core.have_block(get_block_hash(b)))
+        if(m_core.have_block(id))
         {
-          context.m_state = currency_connection_context::state_idle;
-          context.m_priv.m_needed_objects.clear();
-          context.m_priv.m_requested_objects.clear();
-          LOG_PRINT_L1("Connection set to idle state.");
+          context.m_priv.m_requested_batches.pop_front(); // this response has been received, it's not in flight anymore
+          set_connection_idle(context);
           return 1;
         }
       }
       
-      auto req_it = context.m_priv.m_requested_objects.find(get_block_hash(b));
-      if(req_it == context.m_priv.m_requested_objects.end())
+      auto req_it = requested_batch.find(id);
+      if(req_it == requested_batch.end())
       {
         LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: block with id=" << epst::pod_to_hex(get_blob_hash(block_entry.block)) 
           << " wasn't requested, dropping connection");
@@ -565,71 +1069,140 @@ namespace currency
         return 1;
       }
 
-      context.m_priv.m_requested_objects.erase(req_it);
+      context.m_priv.m_requested_objects.erase(*req_it);
+      requested_batch.erase(req_it);
 
-      LOG_PRINT_L4("[NOTIFY_RESPONSE_GET_OBJECTS] BLOCK " << get_block_hash(b) << "[" << get_block_height(b) << "/" << count << "], txs: " << b.tx_hashes.size());
+      LOG_PRINT_L4("[NOTIFY_RESPONSE_GET_OBJECTS] BLOCK " << id << "[" << get_block_height(b) << "/" << count << "], txs: " << b.tx_hashes.size());
+      ids.push_back(id);
+      parsed_blocks.push_back(std::move(b));
     }
 
     LOG_PRINT_CYAN("Block parsing time avr: " << (count > 0 ? total_blocks_parsing_time / count : 0) << " mcs, total for " << count << " blocks: " << total_blocks_parsing_time / 1000 << " ms", LOG_LEVEL_2);
     
-    if(context.m_priv.m_requested_objects.size())
+    if(requested_batch.size())
+    {
+      LOG_PRINT_RED("returned not all requested objects (requested_batch.size()=" 
+        << requested_batch.size() << "), dropping connection", LOG_LEVEL_0);
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+    context.m_priv.m_requested_batches.pop_front();
+    m_spans.on_received(context.m_connection_id, ids, response_size, epee::misc_utils::get_tick_count());
+    LOG_PRINT_L2("Peer throughput: " << m_spans.get_peer_speed(context.m_connection_id) << " bytes/ms");
+    m_p2p->report_sync_speed(context, m_spans.get_peer_speed(context.m_connection_id));
+
+    //deserialize all the transactions of the batch on worker threads
+    TIME_MEASURE_START(transactions_process_time);
+    std::vector<block_verification_context> bvcs(arg.blocks.size(), boost::value_initialized<block_verification_context>());
+    if (!parse_blocks_transactions(arg.blocks, parsed_blocks, bvcs))
     {
-      LOG_PRINT_RED("returned not all requested objects (context.m_priv.m_requested_objects.size()=" 
-        << context.m_priv.m_requested_objects.size() << "), dropping connection", LOG_LEVEL_0);
+      LOG_ERROR_CCONTEXT("failed to parse transactions in NOTIFY_RESPONSE_GET_OBJECTS, dropping connection");
       m_p2p->drop_connection(context);
       return 1;
     }
+    TIME_MEASURE_FINISH(transactions_process_time);
+    LOG_PRINT_L2("Transactions parsing time: " << transactions_process_time / 1000 << " ms for " << arg.blocks.size() << " blocks");
+
+    m_core.get_blockchain_storage().batch_verify_range_proofs(parsed_blocks, bvcs);
+    precompute_blocks_pow_hashes(parsed_blocks, ids);
+
+    //download ahead while this batch is being added to the core
+    top_up_requested_batches(context);
+
+    if (parsed_blocks.empty())
+    {
+      request_missing_objects(context, true);
+      return 1;
+    }
+
+    ready_span rs;
+    rs.blocks.swap(arg.blocks);
+    rs.parsed_blocks.swap(parsed_blocks);
+    rs.bvcs.swap(bvcs);
+    rs.ids.swap(ids);
+    rs.context = context;
+    {
+      std::lock_guard<std::mutex> lock(m_ready_spans_lock);
+      const crypto::hash prev_id = rs.parsed_blocks.front().prev_id;
+      if (!m_core.have_block(prev_id))
+      {
+        // it's ahead of the chain, the spans before it are being downloaded by other peers
+        auto r_it = m_ready_spans.find(prev_id);
+        if (r_it == m_ready_spans.end())
+        {
+          LOG_PRINT_L1("Span of " << rs.ids.size() << " blocks from height " << get_block_height(rs.parsed_blocks.front()) << " is ahead of the chain, ready spans: " << m_ready_spans.size() + 1);
+          m_ready_spans.emplace(prev_id, std::move(rs));
+        }
+        else
+        {
+          // the same height has come from another peer already, the blocks that span doesn't have are to be downloaded again
+          std::unordered_set<crypto::hash> kept(r_it->second.ids.begin(), r_it->second.ids.end());
+          std::vector<crypto::hash> not_kept;
+          for (const auto& h : rs.ids)
+            if (!kept.count(h))
+              not_kept.push_back(h);
+          m_spans.release(not_kept);
+        }
+      }
+      else
+      {
+        crypto::hash last_id = rs.ids.back();
+        bool r = add_span_to_core(rs, context, true);
+        m_spans.release(rs.ids);
+        if (!r)
+          return 1;
+
+        // the spans that were waiting for this one
+        for (auto it = m_ready_spans.find(last_id); it != m_ready_spans.end(); it = m_ready_spans.find(last_id))
+        {
+          ready_span next = std::move(it->second);
+          m_ready_spans.erase(it);
+          last_id = next.ids.back();
+          r = add_span_to_core(next, next.context, false);
+          m_spans.release(next.ids);
+          if (!r)
+            break;
+        }
+      }
+    }
 
+    request_missing_objects(context, true);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_currency_protocol_handler<t_core>::add_span_to_core(ready_span& rs, currency_connection_context& context, bool is_own_span)
+  {
+    // the span is expected to follow a block that is in the core already, the caller holds m_ready_spans_lock
     {
       m_core.pause_mine();
       epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler(
         boost::bind(&t_core::resume_mine, &m_core));
+      auto& bcs = m_core.get_blockchain_storage();
+      bcs.begin_blocks_write_batch();
+      epee::misc_utils::auto_scope_leave_caller batch_exit_handler = epee::misc_utils::create_scope_leave_handler([&bcs]() { bcs.end_blocks_write_batch(); });
       size_t count = 0;
-      for (const block_complete_entry& block_entry : arg.blocks)
+      for (const block_complete_entry& block_entry : rs.blocks)
       {
-        CHECK_STOP_FLAG__DROP_AND_RETURN_IF_SET(1, "Blocks processing interrupted, connection dropped");
-        block_verification_context bvc = boost::value_initialized<block_verification_context>();
-        //process transactions
-        size_t count_txs = 0;
-        TIME_MEASURE_START(transactions_process_time);
-        for (const auto& tx_blob : block_entry.txs)
-        {
-          LOG_PRINT_L4("[NOTIFY_RESPONSE_GET_OBJECTS] BL/TX ["<< count << "/" << count_txs << "]: " << epst::buff_to_hex_nodelimer(tx_blob));
-          CHECK_STOP_FLAG__DROP_AND_RETURN_IF_SET(1, "Block txs processing interrupted, connection dropped");
-          crypto::hash tx_id = null_hash;
-          transaction tx = AUTO_VAL_INIT(tx);
-          if (!parse_and_validate_tx_from_blob(tx_blob, tx, tx_id))
-          {
-            LOG_ERROR_CCONTEXT("failed to parse tx: " 
-              << epst::pod_to_hex(get_blob_hash(tx_blob)) << ", dropping connection");
-            m_p2p->drop_connection(context);
-            return 1;
-          }
-          bvc.m_onboard_transactions[tx_id] = tx;
-          count_txs++;
-//           tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-//           m_core.handle_incoming_tx(tx_blob, tvc, true);
-//           if(tvc.m_verification_failed)
-//           {
-//             LOG_ERROR_CCONTEXT("transaction verification failed on NOTIFY_RESPONSE_GET_OBJECTS, \r\ntx_id = " 
-//               << string_tools::pod_to_hex(get_blob_hash(tx_blob)) << ", dropping connection");
-//             m_p2p->drop_connection(context);
-//             return 1;
-//           }
-        }
-        TIME_MEASURE_FINISH(transactions_process_time);
+        CHECK_STOP_FLAG__DROP_AND_RETURN_IF_SET(false, "Blocks processing interrupted, connection dropped");
+        block_verification_context& bvc = rs.bvcs[count];
 
         //process block
         TIME_MEASURE_START(block_process_time);
 
-        m_core.handle_incoming_block(block_entry.block, bvc, false);
+        if (block_entry.block.size() > get_max_block_size())
+        {
+          LOG_PRINT_L0("Block blob is too big: " << block_entry.block.size() << " bytes, dropping connection, block id: " << rs.ids[count]);
+          m_p2p->drop_connection(context);
+          m_p2p->add_ip_fail(context.m_remote_ip);
+          return false;
+        }
+        m_core.handle_incoming_block(rs.parsed_blocks[count], bvc, false);
         if (count > 2 && bvc.m_already_exists)
         {
-          context.m_state = currency_connection_context::state_idle;
-          context.m_priv.m_needed_objects.clear();
-          context.m_priv.m_requested_objects.clear();
-          LOG_PRINT_L1("Connection set to idle state.");
-          return 1;
+          if (is_own_span)
+            set_connection_idle(context);
+          return false;
         }
 
         if(bvc.m_verification_failed)
@@ -637,31 +1210,34 @@ namespace currency
           LOG_PRINT_L0("Block verification failed, dropping connection");
           m_p2p->drop_connection(context);
           m_p2p->add_ip_fail(context.m_remote_ip);
-          return 1;
+          return false;
         }
         if(bvc.m_marked_as_orphaned)
         {
-          LOG_PRINT_L0("Block received at sync phase was marked as orphaned, dropping connection, details on response: " << ENDL << print_kv_structure(arg));
+          LOG_PRINT_L0("Block received at sync phase was marked as orphaned, dropping connection, block id: " << rs.ids[count]);
           
           m_p2p->drop_connection(context);
           m_p2p->add_ip_fail(context.m_remote_ip);
-          return 1;
+          return false;
         }
 
+        uint64_t block_blobs_size = block_entry.block.size();
+        for (const auto& tx_blob : block_entry.txs)
+          block_blobs_size += tx_blob.size();
+        bcs.on_blocks_write_batch_block_added(block_blobs_size);
+
         TIME_MEASURE_FINISH(block_process_time);
-        LOG_PRINT_L2("Block process time: " << block_process_time + transactions_process_time << "(" << transactions_process_time << "/" << block_process_time << ")ms");
+        LOG_PRINT_L2("Block process time: " << block_process_time << "ms");
         ++count;
       }
     }
     uint64_t current_size = m_core.get_blockchain_storage().get_current_blockchain_size();
-    LOG_PRINT_YELLOW(">>>>>>>>> sync progress: " << arg.blocks.size() << " blocks added, now have "
+    LOG_PRINT_YELLOW(">>>>>>>>> sync progress: " << rs.blocks.size() << " blocks added, now have "
       << current_size << " of " << context.m_remote_blockchain_height
       << " ( " << std::fixed << std::setprecision(2) << current_size * 100.0 / context.m_remote_blockchain_height << "% ) and "
       << context.m_remote_blockchain_height - current_size << " blocks left"
       , LOG_LEVEL_0);
-
-    request_missing_objects(context, true);
-    return 1;
+    return true;
   }
 #undef CHECK_STOP_FLAG__DROP_AND_RETURN_IF_SET
   //------------------------------------------------------------------------------------------------------------------------
@@ -684,6 +1260,8 @@ namespace currency
       m_synchronized = false;
     }
 
+    m_waiting_peers_interval.do_call([this]() { wake_up_waiting_peers(); return true; });
+
     return m_core.on_idle();
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -697,12 +1275,12 @@ namespace currency
     LOG_PRINT_L2("[HANDLE]NOTIFY_REQUEST_CHAIN: block_ids.size()=" << arg.block_ids.size());
     LOG_PRINT_L3("[HANDLE]NOTIFY_REQUEST_CHAIN: " << print_kv_structure(arg));
     NOTIFY_RESPONSE_CHAIN_ENTRY::request r;
-    if(!m_core.find_blockchain_supplement(arg.block_ids, r))
+    if(!m_core.find_blockchain_supplement(arg.block_ids, r, (context.m_remote_protocol_features & CURRENCY_PROTOCOL_FEATURE_CHAIN_HEADERS) != 0))
     {
       LOG_ERROR_CCONTEXT("Failed to handle NOTIFY_REQUEST_CHAIN.");
       return 1;
     }
-    LOG_PRINT_L2("[NOTIFY]NOTIFY_RESPONSE_CHAIN_ENTRY: m_start_height=" << r.start_height << ", m_total_height=" << r.total_height << ", m_block_ids.size()=" << r.m_block_ids.size());
+    LOG_PRINT_L2("[NOTIFY]NOTIFY_RESPONSE_CHAIN_ENTRY: m_start_height=" << r.start_height << ", m_total_height=" << r.total_height << ", m_block_ids.size()=" << r.m_block_ids.size() << ", m_block_headers.size()=" << r.m_block_headers.size());
     LOG_PRINT_L3("[NOTIFY]NOTIFY_RESPONSE_CHAIN_ENTRY: " << print_kv_structure(r));
     post_notify<NOTIFY_RESPONSE_CHAIN_ENTRY>(r, context);
     return 1;
@@ -714,26 +1292,16 @@ namespace currency
     if(context.m_priv.m_needed_objects.size())
     {
       //we know objects that we need, request this objects
-      NOTIFY_REQUEST_GET_OBJECTS::request req;
-      size_t count = 0;
-      auto it = context.m_priv.m_needed_objects.begin();
-      uint64_t requested_cumulative_size = 0;
-
-      while (it != context.m_priv.m_needed_objects.end() && count < BLOCKS_SYNCHRONIZING_DEFAULT_COUNT && requested_cumulative_size < BLOCKS_SYNCHRONIZING_DEFAULT_SIZE)
-      {
-        if( !(check_having_blocks && m_core.have_block(it->h)))
-        {
-          req.blocks.push_back(it->h);
-          requested_cumulative_size += it->cumul_size;
-          ++count;
-          context.m_priv.m_requested_objects.insert(it->h);
-        }
-        context.m_priv.m_needed_objects.erase(it++);
-      }
-
-      LOG_PRINT_L2("[NOTIFY]NOTIFY_REQUEST_GET_OBJECTS(req_missing): requested_cumulative_size=" << requested_cumulative_size << ", blocks.size()=" << req.blocks.size() << ", txs.size()=" << req.txs.size());
-      LOG_PRINT_L3("[NOTIFY]NOTIFY_REQUEST_GET_OBJECTS(req_missing): " << ENDL << currency::print_kv_structure(req));
-      post_notify<NOTIFY_REQUEST_GET_OBJECTS>(req, context);    
+      if (!context.m_priv.m_requested_batches.empty())
+        top_up_requested_batches(context, check_having_blocks);
+      else
+        request_next_batch(context, check_having_blocks);
+      // nothing in flight means that the blocks it needs are being downloaded by other peers, it's woken up later
+      m_spans.set_peer_waiting(context.m_connection_id, context.m_priv.m_requested_batches.empty());
+    }else if(!context.m_priv.m_requested_batches.empty())
+    {
+      //some batches are still in flight, wait for them before asking for more blocks ids
+      LOG_PRINT_L2("[REQUEST_MISSING_OBJECTS]: waiting for " << context.m_priv.m_requested_batches.size() << " batch(es) in flight");
     }else if(context.m_last_response_height < context.m_remote_blockchain_height-1)
     {//we have to fetch more objects ids, request blockchain entry
      
@@ -761,6 +1329,296 @@ namespace currency
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
+  bool t_currency_protocol_handler<t_core>::request_next_batch(currency_connection_context& context, bool check_having_blocks)
+  {
+    // the first span of the needed blocks that isn't downloaded by other peers, or is stalled there;
+    // when too many spans wait for the ones before them, only the stalled spans and the one the chain waits for are taken
+    NOTIFY_REQUEST_GET_OBJECTS::request req;
+    std::vector<crypto::hash> ids;
+    std::vector<std::list<block_context_info>::iterator> its;
+    uint64_t requested_cumulative_size = 0;
+    uint64_t now = epee::misc_utils::get_tick_count();
+    bool only_stalled = get_ready_spans_count() >= BLOCKS_SYNCHRONIZING_MAX_READY_SPANS;
+    bool is_chain_waiting_for_it = true;
+    size_t max_count = 0;
+    uint64_t max_size = 0;
+    m_spans.get_batch_limits(context.m_connection_id, max_count, max_size);
+    auto it = context.m_priv.m_needed_objects.begin();
+
+    while (it != context.m_priv.m_needed_objects.end() && ids.size() < max_count && requested_cumulative_size < max_size)
+    {
+      if (check_having_blocks && m_core.have_block(it->h))
+      {
+        context.m_priv.m_needed_objects.erase(it++);
+        continue;
+      }
+      block_spans_scheduler::claim_state cs = m_spans.get_claim_state(context.m_connection_id, it->h, now);
+      if (cs == block_spans_scheduler::claim_busy || (cs == block_spans_scheduler::claim_free && only_stalled && !is_chain_waiting_for_it))
+      {
+        if (!ids.empty())
+          break;
+        is_chain_waiting_for_it = false;
+        ++it;
+        continue;
+      }
+      ids.push_back(it->h);
+      its.push_back(it);
+      requested_cumulative_size += it->cumul_size;
+      ++it;
+    }
+
+    // another peer may have taken some of them meanwhile
+    size_t count = m_spans.claim(context.m_connection_id, ids, requested_cumulative_size, now);
+    if (!count)
+      return false;
+
+    std::unordered_set<crypto::hash> batch;
+    for (size_t i = 0; i != count; ++i)
+    {
+      req.blocks.push_back(ids[i]);
+      context.m_priv.m_requested_objects.insert(ids[i]);
+      batch.insert(ids[i]);
+      context.m_priv.m_needed_objects.erase(its[i]);
+    }
+
+    context.m_priv.m_requested_batches.push_back(std::move(batch));
+    LOG_PRINT_L2("[NOTIFY]NOTIFY_REQUEST_GET_OBJECTS(req_missing): requested_cumulative_size=" << requested_cumulative_size << ", blocks.size()=" << req.blocks.size() << ", txs.size()=" << req.txs.size()
+      << ", batches in flight: " << context.m_priv.m_requested_batches.size());
+    LOG_PRINT_L3("[NOTIFY]NOTIFY_REQUEST_GET_OBJECTS(req_missing): " << ENDL << currency::print_kv_structure(req));
+    post_notify<NOTIFY_REQUEST_GET_OBJECTS>(req, context);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core> 
+  void t_currency_protocol_handler<t_core>::top_up_requested_batches(currency_connection_context& context, bool check_having_blocks)
+  {
+    // keep up to BLOCKS_SYNCHRONIZING_MAX_BATCHES_IN_FLIGHT requests in flight, so the network keeps working while the core is busy;
+    // each batch is limited with BLOCKS_SYNCHRONIZING_MAX_SIZE, so the memory used for download-ahead is bounded too
+    size_t limit = m_spans.get_spans_in_flight_limit(context.m_connection_id);
+    while (context.m_priv.m_requested_batches.size() < limit && context.m_priv.m_needed_objects.size())
+    {
+      if (!request_next_batch(context, check_having_blocks))
+        break;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core> 
+  void t_currency_protocol_handler<t_core>::set_connection_idle(currency_connection_context& context)
+  {
+    context.m_state = currency_connection_context::state_idle;
+    context.m_priv.m_needed_objects.clear();
+    context.m_priv.m_requested_objects.clear();
+    // responses to the ahead requests are still on their way, they should be ignored
+    context.m_priv.m_stale_batches_count += context.m_priv.m_requested_batches.size();
+    context.m_priv.m_requested_batches.clear();
+    m_spans.release_peer(context.m_connection_id);
+    LOG_PRINT_L1("Connection set to idle state.");
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core> 
+  size_t t_currency_protocol_handler<t_core>::get_ready_spans_count()
+  {
+    std::lock_guard<std::mutex> lock(m_ready_spans_lock);
+    return m_ready_spans.size();
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core> 
+  void t_currency_protocol_handler<t_core>::wake_up_waiting_peers()
+  {
+    auto waiting_peers = m_spans.get_waiting_peers();
+    if (waiting_peers.empty())
+      return;
+
+    // callbacks are requested out of the connections enumeration
+    std::list<connection_context> to_wake_up;
+    m_p2p->for_each_connection([&](connection_context& cc, nodetool::peerid_type /*peer_id*/)
+    {
+      if (cc.m_state == currency_connection_context::state_synchronizing && waiting_peers.count(cc.m_connection_id) && !cc.m_priv.m_callback_request_count)
+      {
+        ++cc.m_priv.m_callback_request_count;
+        to_wake_up.push_back(cc);
+      }
+      return true;
+    });
+    for (const auto& cc : to_wake_up)
+    {
+      m_spans.set_peer_waiting(cc.m_connection_id, false);
+      m_p2p->request_callback(cc);
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_currency_protocol_handler<t_core>::run_in_sync_parse_pool(size_t count, const std::function<void(size_t, size_t)>& range_handler)
+  {
+    const size_t threads_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+    if (threads_count < 2 || count < 2 * threads_count)
+    {
+      range_handler(0, count);
+      return;
+    }
+
+    utils::threads_pool::jobs_container jobs;
+    const size_t chunk = (count + threads_count - 1) / threads_count;
+    for (size_t from = 0; from < count; from += chunk)
+    {
+      size_t to = std::min(from + chunk, count);
+      utils::threads_pool::add_job_to_container(jobs, [&range_handler, from, to]() { range_handler(from, to); });
+    }
+    {
+      CRITICAL_REGION_LOCAL(m_sync_parse_pool_lock);
+      if (!m_sync_parse_pool_initialized)
+      {
+        m_sync_parse_pool.init(threads_count);
+        m_sync_parse_pool_initialized = true;
+      }
+    }
+    m_sync_parse_pool.add_batch_and_wait(jobs);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_currency_protocol_handler<t_core>::check_chain_headers(const NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, currency_connection_context& context)
+  {
+    if (arg.m_block_headers.empty())
+      return true; // an older peer, the blocks are checked as they come
+    CHECK_AND_ASSERT_MES_CC(arg.m_block_headers.size() == arg.m_block_ids.size(), false, "m_block_headers.size()=" << arg.m_block_headers.size() << " doesn't match m_block_ids.size()=" << arg.m_block_ids.size());
+
+    TIME_MEASURE_START_MS(check_time);
+    std::vector<const blobdata*> blobs;
+    std::vector<crypto::hash> ids;
+    blobs.reserve(arg.m_block_headers.size());
+    ids.reserve(arg.m_block_ids.size());
+    for (const auto& h : arg.m_block_headers)
+      blobs.push_back(&h);
+    for (const auto& bci : arg.m_block_ids)
+      ids.push_back(bci.h);
+
+    // PoW is checked against the current difficulty with a big margin: it's enough to reject a made up chain before
+    // downloading it, and the exact difficulty is checked when the blocks come, the hashes calculated here are used then
+    const wide_difficulty_type min_pow_difficulty = std::max<wide_difficulty_type>(1, m_core.get_blockchain_storage().get_cached_next_difficulty(false) / CURRENCY_PROTOCOL_HEADERS_DIFFICULTY_TOLERANCE);
+    std::vector<block> headers(blobs.size());
+    std::vector<uint8_t> results(blobs.size(), 0);
+    std::atomic<size_t> pow_checked_count(0);
+    run_in_sync_parse_pool(blobs.size(), [&](size_t from, size_t to)
+    {
+      for (size_t i = from; i < to; i++)
+      {
+        try
+        {
+          block& b = headers[i];
+          if (!parse_and_validate_block_from_blob(*blobs[i], b) || get_block_hash(b) != ids[i] || get_block_height(b) != arg.start_height + i)
+            continue;
+          if (!is_pos_block(b) && !m_core.have_block(ids[i]))
+          {
+            crypto::hash pow_hash = get_block_longhash(b);
+            if (!check_hash(pow_hash, min_pow_difficulty))
+              continue;
+            m_core.get_blockchain_storage().add_precomputed_pow_hash(ids[i], pow_hash);
+            ++pow_checked_count;
+          }
+          results[i] = 1;
+        }
+        catch (...)
+        {
+        }
+      }
+    });
+
+    for (size_t i = 0; i != headers.size(); i++)
+    {
+      CHECK_AND_ASSERT_MES_CC(results[i], false, "block header " << ids[i] << " at height " << arg.start_height + i << " is wrong");
+      CHECK_AND_ASSERT_MES_CC(i == 0 || headers[i].prev_id == ids[i - 1], false, "block header " << ids[i] << " at height " << arg.start_height + i << " doesn't follow the previous one");
+    }
+    TIME_MEASURE_FINISH_MS(check_time);
+    LOG_PRINT_L2("[NOTIFY_RESPONSE_CHAIN_ENTRY] " << headers.size() << " block headers checked, PoW of " << pow_checked_count << " of them, in " << check_time << " ms");
+    // PoS kernels are checked with the blocks, they refer to the outputs the blocks before them may create
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core> 
+  bool t_currency_protocol_handler<t_core>::parse_blocks_transactions(const std::list<block_complete_entry>& blocks, const std::vector<block>& parsed_blocks, std::vector<block_verification_context>& bvcs)
+  {
+    CHECK_AND_ASSERT_MES(blocks.size() == parsed_blocks.size(), false, "internal error: blocks.size() = " << blocks.size() << ", parsed_blocks.size() = " << parsed_blocks.size());
+    // in checkpoint zone attachments, signatures and proofs are neither checked nor stored, so only prefixes are parsed
+    const auto& cps = m_core.get_blockchain_storage().get_checkpoints();
+    std::vector<const blobdata*> blobs;
+    std::vector<uint8_t> prefix_only;
+    auto it_parsed = parsed_blocks.begin();
+    for (const block_complete_entry& block_entry : blocks)
+    {
+      bool in_checkpoint_zone = cps.is_in_checkpoint_zone(get_block_height(*it_parsed++));
+      for (const auto& tx_blob : block_entry.txs)
+      {
+        blobs.push_back(&tx_blob);
+        prefix_only.push_back(in_checkpoint_zone ? 1 : 0);
+      }
+    }
+
+    std::vector<transaction> txs(blobs.size());
+    std::vector<crypto::hash> tx_ids(blobs.size(), null_hash);
+    std::vector<uint8_t> results(blobs.size(), 0);
+    run_in_sync_parse_pool(blobs.size(), [&](size_t from, size_t to)
+    {
+      for (size_t i = from; i < to; i++)
+        results[i] = (prefix_only[i] ? parse_tx_prefix_from_blob(*blobs[i], txs[i], tx_ids[i]) : parse_and_validate_tx_from_blob(*blobs[i], txs[i])) ? 1 : 0;
+      get_transactions_prefix_hashes(txs.data() + from, to - from, tx_ids.data() + from); // the unparsed ones aren't used
+    });
+
+    size_t i = 0;
+    size_t block_index = 0;
+    for (const block_complete_entry& block_entry : blocks)
+    {
+      for (size_t j = 0; j != block_entry.txs.size(); ++j, ++i)
+      {
+        if (!results[i])
+        {
+          LOG_PRINT_L0("failed to parse tx: " << epst::pod_to_hex(get_blob_hash(*blobs[i])));
+          return false;
+        }
+        bvcs[block_index].m_onboard_transactions[tx_ids[i]] = std::move(txs[i]);
+      }
+      ++block_index;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_currency_protocol_handler<t_core>::precompute_blocks_pow_hashes(const std::vector<block>& blocks, const std::vector<crypto::hash>& ids)
+  {
+    // PoW hashes of the batch are calculated in parallel here, and the blocks are then checked against the target when
+    // they're added one by one (on the main or an alt chain); the ones checked with the chain headers are skipped
+    CHECK_AND_ASSERT_MES(blocks.size() == ids.size(), void(), "internal error: blocks.size() = " << blocks.size() << ", ids.size() = " << ids.size());
+    auto& bcs = m_core.get_blockchain_storage();
+    std::vector<size_t> pow_blocks;
+    for (size_t i = 0; i != blocks.size(); i++)
+    {
+      crypto::hash pow_hash = null_hash;
+      if (!is_pos_block(blocks[i]) && !bcs.get_precomputed_pow_hash(ids[i], pow_hash))
+        pow_blocks.push_back(i);
+    }
+    if (pow_blocks.empty())
+      return;
+
+    TIME_MEASURE_START_MS(pow_time);
+    run_in_sync_parse_pool(pow_blocks.size(), [&](size_t from, size_t to)
+    {
+      for (size_t i = from; i < to; i++)
+      {
+        try
+        {
+          const size_t block_index = pow_blocks[i];
+          bcs.add_precomputed_pow_hash(ids[block_index], get_block_longhash(blocks[block_index]));
+        }
+        catch (...)
+        {
+          // calculated again when the block is handled
+        }
+      }
+    });
+    TIME_MEASURE_FINISH_MS(pow_time);
+    LOG_PRINT_L2("PoW hashes of " << pow_blocks.size() << " blocks calculated in " << pow_time << " ms");
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core> 
   bool t_currency_protocol_handler<t_core>::on_connection_synchronized()
   {
     bool val_expected = false;
@@ -784,7 +1642,7 @@ namespace currency
       if (local_que.size())
         process_current_relay_que(local_que);
       
-      epee::misc_utils::sleep_no_w(500);
+      epee::misc_utils::sleep_no_w(CURRENCY_PROTOCOL_TX_RELAY_INTERVAL_MS);
     }
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -794,30 +1652,72 @@ namespace currency
     if (que.size() > 1){LOG_PRINT_MAGENTA("RELAY_QUE: " << que.size(), LOG_LEVEL_0);}
 
     TIME_MEASURE_START_MS(ms);
+
+    // tx ids are needed to know which txs each peer already has
+    struct relayed_tx
+    {
+      crypto::hash id;
+      const blobdata* p_blob;
+      boost::uuids::uuid sender_connection_id;
+    };
+    std::vector<relayed_tx> relayed_txs;
+    for (auto& qe : que)
+    {
+      for (const blobdata& tx_blob : qe.first.txs)
+      {
+        crypto::hash tx_id = get_blob_hash(tx_blob);
+        transaction tx = AUTO_VAL_INIT(tx);
+        if (!parse_and_validate_tx_from_blob(tx_blob, tx, tx_id))
+          continue;
+        if (qe.second.m_known_txs)
+          qe.second.m_known_txs->insert(tx_id);
+        relayed_txs.push_back(relayed_tx{ tx_id, &tx_blob, qe.second.m_connection_id });
+      }
+    }
+
     std::stringstream debug_ss;
+    size_t announced_count = 0, sent_count = 0;
     std::list<connection_context> connections;
     m_p2p->get_connections(connections);
     for (auto& cc : connections)
     {
+      const bool use_inventory = (cc.m_remote_protocol_features & CURRENCY_PROTOCOL_FEATURE_TX_INVENTORY) != 0 && cc.m_known_txs;
       NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::request req = AUTO_VAL_INIT(req);
-      for (auto& qe : que)
+      NOTIFY_TX_INVENTORY::request inv = AUTO_VAL_INIT(inv);
+      for (const auto& rt : relayed_txs)
       {
-        //exclude relaying to original sender
-        if (qe.second.m_connection_id == cc.m_connection_id)
+        //exclude relaying to original sender and to peers which already have it
+        if (rt.sender_connection_id == cc.m_connection_id)
+          continue;
+        if (cc.m_known_txs && !cc.m_known_txs->check_and_insert(rt.id))
           continue;
-        req.txs.insert(req.txs.begin(), qe.first.txs.begin(), qe.first.txs.end());
+        if (use_inventory)
+          inv.txs.push_back(rt.id);
+        else
+          req.txs.push_back(*rt.p_blob);
       }
-      if (req.txs.size())
+
+      for (auto it = inv.txs.begin(); it != inv.txs.end();)
       {
+        NOTIFY_TX_INVENTORY::request inv_part = AUTO_VAL_INIT(inv_part);
+        for (; it != inv.txs.end() && inv_part.txs.size() < CURRENCY_PROTOCOL_MAX_TX_INVENTORY_COUNT; ++it)
+          inv_part.txs.push_back(*it);
+        post_notify<NOTIFY_TX_INVENTORY>(inv_part, cc);
+      }
+      if (req.txs.size())
         post_notify<NOTIFY_OR_INVOKE_NEW_TRANSACTIONS>(req, cc);
 
+      if (inv.txs.size() || req.txs.size())
+      {
         if (debug_ss.tellp())
           debug_ss << ", ";
-        debug_ss << cc << ": " << req.txs.size();
+        debug_ss << cc << ": " << (use_inventory ? inv.txs.size() : req.txs.size()) << (use_inventory ? " ids" : " txs");
       }
+      announced_count += inv.txs.size();
+      sent_count += req.txs.size();
     }
     TIME_MEASURE_FINISH_MS(ms);
-    LOG_PRINT_GREEN("[POST RELAY] NOTIFY_NEW_TRANSACTIONS relayed (" << ms << "ms) to: " << debug_ss.str(), LOG_LEVEL_2);
+    LOG_PRINT_GREEN("[POST RELAY] " << relayed_txs.size() << " txs relayed (" << ms << "ms), " << announced_count << " announced, " << sent_count << " sent in full, to: " << debug_ss.str(), LOG_LEVEL_2);
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
@@ -970,6 +1870,14 @@ namespace currency
       m_p2p->add_ip_fail(context.m_remote_ip);
     }
 
+    if (!check_chain_headers(arg, context))
+    {
+      LOG_ERROR_CCONTEXT("sent NOTIFY_RESPONSE_CHAIN_ENTRY with wrong block headers, dropping connection");
+      m_p2p->drop_connection(context);
+      m_p2p->add_ip_fail(context.m_remote_ip);
+      return 1;
+    }
+
     BOOST_FOREACH(auto& bl_details, arg.m_block_ids)
     {
       if (!m_core.have_block(bl_details.h))
@@ -983,7 +1891,42 @@ namespace currency
   template<class t_core> 
   bool t_currency_protocol_handler<t_core>::relay_block(NOTIFY_NEW_BLOCK::request& arg, currency_connection_context& exclude_context)
   {
-    return relay_post_notify<NOTIFY_NEW_BLOCK>(arg, exclude_context);
+    // arg is expected to contain all block's txs, peers supporting compact blocks get the block alone
+    NOTIFY_NEW_BLOCK::request compact_arg = AUTO_VAL_INIT(compact_arg);
+    compact_arg.b.block = arg.b.block;
+    compact_arg.current_blockchain_height = arg.current_blockchain_height;
+    compact_arg.hop = arg.hop;
+    compact_arg.prevalidated_only = arg.prevalidated_only;
+
+    // each payload is serialized once and queued to all the peers as is
+    std::string full_buff, compact_buff;
+    epee::serialization::store_t_to_binary(arg, full_buff);
+    epee::serialization::store_t_to_binary(compact_arg, compact_buff);
+    epee::net_utils::shared_buffer full_shared_buff = std::make_shared<const std::string>(std::move(full_buff));
+    epee::net_utils::shared_buffer compact_shared_buff = std::make_shared<const std::string>(std::move(compact_buff));
+
+    std::list<connection_context> connections;
+    m_p2p->get_connections(connections);
+    size_t compact_count = 0, full_count = 0;
+    for (const auto& cc : connections)
+    {
+      if (cc.m_connection_id == exclude_context.m_connection_id || cc.m_state == currency_connection_context::state_befor_handshake)
+        continue;
+
+      if (cc.m_remote_protocol_features & CURRENCY_PROTOCOL_FEATURE_COMPACT_BLOCKS)
+      {
+        m_p2p->invoke_notify_to_peer(NOTIFY_NEW_BLOCK::ID, compact_shared_buff, cc);
+        ++compact_count;
+      }
+      else
+      {
+        m_p2p->invoke_notify_to_peer(NOTIFY_NEW_BLOCK::ID, full_shared_buff, cc);
+        ++full_count;
+      }
+    }
+
+    LOG_PRINT_GREEN("[POST RELAY] NOTIFY_NEW_BLOCK to " << compact_count << " peers as compact (" << compact_shared_buff->size() << " bytes), to " << full_count << " peers as full (" << full_shared_buff->size() << " bytes)", LOG_LEVEL_2);
+    return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
@@ -0,0 +1,114 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <list>
+#include <iterator>
+
+#include "common/varint.h"
+#include "currency_protocol_defs.h"
+
+#define CURRENCY_RAW_BLOCK_ENTRIES_FORMAT_VER 1
+
+namespace currency
+{
+  // NOTIFY_RESPONSE_GET_OBJECTS::blocks_raw, for peers with CURRENCY_PROTOCOL_FEATURE_RAW_BLOCKS:
+  //   version (1 byte), varint blocks count,
+  //   for each block: varint block blob size, varint txs count, varint size of each tx blob,
+  //   then all the blobs concatenated in the same order (block, its txs, next block, ...)
+  // so the blobs are carried by one portable_storage string instead of a section per block and a string per blob;
+  // global outputs indices aren't carried, the entries with them can't be packed
+  inline bool pack_raw_block_entries(const std::list<block_complete_entry>& blocks, blobdata& raw)
+  {
+    raw.clear();
+    size_t blobs_size = 0;
+    for (const block_complete_entry& bce : blocks)
+    {
+      if (!bce.coinbase_global_outs.empty() || !bce.tx_global_outs.empty() || !bce.global_outs.empty())
+        return false;
+      blobs_size += bce.block.size();
+      for (const blobdata& tx : bce.txs)
+        blobs_size += tx.size();
+    }
+
+    auto out = std::back_inserter(raw);
+    raw.push_back(static_cast<char>(CURRENCY_RAW_BLOCK_ENTRIES_FORMAT_VER));
+    tools::write_varint(out, blocks.size());
+    for (const block_complete_entry& bce : blocks)
+    {
+      tools::write_varint(out, bce.block.size());
+      tools::write_varint(out, bce.txs.size());
+      for (const blobdata& tx : bce.txs)
+        tools::write_varint(out, tx.size());
+    }
+
+    raw.reserve(raw.size() + blobs_size);
+    for (const block_complete_entry& bce : blocks)
+    {
+      raw.append(bce.block);
+      for (const blobdata& tx : bce.txs)
+        raw.append(tx);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  // the entries are appended to blocks, nothing is appended unless the whole packet is well-formed
+  inline bool unpack_raw_block_entries(const blobdata& raw, std::list<block_complete_entry>& blocks)
+  {
+    const char* p = raw.data();
+    const char* end = raw.data() + raw.size();
+    CHECK_AND_ASSERT_MES(p != end && static_cast<uint8_t>(*p) == CURRENCY_RAW_BLOCK_ENTRIES_FORMAT_VER, false, "raw block entries: unknown format version");
+    ++p;
+
+    // a size read must fit in the bytes left, so a malformed header can't make the sizes overflow or allocate much
+    auto read_size = [&](size_t& v) -> bool
+    {
+      uint64_t v64 = 0;
+      if (tools::read_varint<64>(p, end, v64) <= 0 || (static_cast<uint8_t>(p[-1]) & 0x80) != 0 || v64 > static_cast<uint64_t>(end - p))
+        return false; // not terminated (read_varint() stops at the end quietly), or too big
+      v = static_cast<size_t>(v64);
+      return true;
+    };
+
+    size_t blocks_count = 0;
+    CHECK_AND_ASSERT_MES(read_size(blocks_count), false, "raw block entries: wrong blocks count");
+    std::vector<size_t> sizes; // block size, txs count, txs sizes, for each block
+    size_t blobs_size = 0;
+    for (size_t i = 0; i != blocks_count; ++i)
+    {
+      size_t block_size = 0, txs_count = 0;
+      CHECK_AND_ASSERT_MES(read_size(block_size) && read_size(txs_count), false, "raw block entries: wrong header of block #" << i);
+      sizes.push_back(block_size);
+      sizes.push_back(txs_count);
+      blobs_size += block_size;
+      for (size_t j = 0; j != txs_count; ++j)
+      {
+        size_t tx_size = 0;
+        CHECK_AND_ASSERT_MES(read_size(tx_size), false, "raw block entries: wrong size of tx #" << j << " of block #" << i);
+        sizes.push_back(tx_size);
+        blobs_size += tx_size;
+      }
+      CHECK_AND_ASSERT_MES(blobs_size <= static_cast<size_t>(end - p), false, "raw block entries: blobs of block #" << i << " go out of the packet");
+    }
+    CHECK_AND_ASSERT_MES(blobs_size == static_cast<size_t>(end - p), false, "raw block entries: " << static_cast<size_t>(end - p) - blobs_size << " extra bytes after the blobs");
+
+    std::list<block_complete_entry> unpacked;
+    auto size_it = sizes.begin();
+    for (size_t i = 0; i != blocks_count; ++i)
+    {
+      unpacked.emplace_back();
+      block_complete_entry& bce = unpacked.back();
+      bce.block.assign(p, *size_it);
+      p += *size_it++;
+      size_t txs_count = *size_it++;
+      for (size_t j = 0; j != txs_count; ++j)
+      {
+        bce.txs.emplace_back(p, *size_it);
+        p += *size_it++;
+      }
+    }
+    blocks.splice(blocks.end(), unpacked);
+    return true;
+  }
+}
@@ -28,8 +28,10 @@ using namespace epee;
 #include "currency_core/core_tools.h"
 #include "common/callstack_helper.h"
 #include "common/pre_download.h"
+#include "common/startup_profile.h"
 
 #include <cstdlib>
+#include <future>
 
 #if defined(WIN32)
 #include <crtdbg.h>
@@ -127,6 +129,7 @@ int main(int argc, char* argv[])
   log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
   log_space::log_singletone::enable_channels("core,currency_protocol,tx_pool,wallet", false);
   LOG_PRINT_L0("Starting...");
+  tools::startup_profile::get().start();
 
   tools::signal_handler::install_fatal([](int sig_number, void* address) {
     LOG_ERROR("\n\nFATAL ERROR\nsig: " << sig_number << ", address: " << address);
@@ -165,7 +168,10 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_cmd_sett, command_line::arg_process_predownload_from_path);
   command_line::add_arg(desc_cmd_sett, command_line::arg_validate_predownload);
   command_line::add_arg(desc_cmd_sett, command_line::arg_predownload_link);
+  command_line::add_arg(desc_cmd_sett, command_line::arg_import_bootstrap_file);
   command_line::add_arg(desc_cmd_sett, command_line::arg_disable_ntp);
+  command_line::add_arg(desc_cmd_sett, command_line::arg_p2p_compression);
+  command_line::add_arg(desc_cmd_sett, command_line::arg_early_block_relay);
 
 
   arg_market_disable.default_value = true;
@@ -238,6 +244,14 @@ int main(int argc, char* argv[])
     return EXIT_SUCCESS;
   }
 
+  if (tools::db::db_backend_selector::is_benchmark_requested(vm))
+  {
+    tools::db::db_backend_selector dbbs;
+    if (!dbbs.init(vm) || !dbbs.run_benchmark())
+      return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+  }
+
 
   // stratum server is enabled if any of its options present
   bool stratum_enabled = currency::stratum_server::should_start(vm);
@@ -285,8 +299,11 @@ int main(int argc, char* argv[])
 
   bool res = false;
 
+  // secondary instance reads the primary's blockchain db and has no p2p of its own
+  bool secondary = command_line::has_arg(vm, command_line::arg_db_secondary_of);
+
   //do pre_download if needed
-  if (!command_line::has_arg(vm, command_line::arg_no_predownload) || command_line::has_arg(vm, command_line::arg_force_predownload))
+  if (!secondary && (!command_line::has_arg(vm, command_line::arg_no_predownload) || command_line::has_arg(vm, command_line::arg_force_predownload)))
   {
     auto is_stop_signal_sent = [&p2psrv]() -> bool {
       return static_cast<nodetool::i_p2p_endpoint<currency::t_currency_protocol_handler<currency::core>::connection_context>*>(&p2psrv)->is_stop_signal_sent();
@@ -303,32 +320,49 @@ int main(int argc, char* argv[])
 
 
   //initialize objects
-  LOG_PRINT_L0("Initializing p2p server...");
-  res = p2psrv.init(vm);
-  CHECK_AND_ASSERT_MES(res, 1, "Failed to initialize p2p server.");
-  LOG_PRINT_L0("P2p server initialized OK on port: " << p2psrv.get_this_peer_port());
-
+  // p2p init (config, peerlist, binding) does not depend on the core, so it runs while the core loads its db
   tools::miniupnp_helper upnp_helper;
-
-  if (!command_line::get_arg(vm, command_line::arg_disable_upnp))
+  std::future<bool> p2p_init;
+  if (!secondary)
   {
-    LOG_PRINT_L0("Starting UPnP");
-    upnp_helper.start_regular_mapping(p2psrv.get_this_peer_port(), p2psrv.get_this_peer_port(), 20*60*1000);
+    p2p_init = std::async(std::launch::async, [&]() -> bool
+    {
+      tools::startup_phase_timer spt("p2p: init and peerlist load", true);
+      LOG_PRINT_L0("Initializing p2p server...");
+      bool r = p2psrv.init(vm);
+      CHECK_AND_ASSERT_MES(r, false, "Failed to initialize p2p server.");
+      LOG_PRINT_L0("P2p server initialized OK on port: " << p2psrv.get_this_peer_port());
+
+      if (!command_line::get_arg(vm, command_line::arg_disable_upnp))
+      {
+        LOG_PRINT_L0("Starting UPnP");
+        upnp_helper.start_regular_mapping(p2psrv.get_this_peer_port(), p2psrv.get_this_peer_port(), 20*60*1000);
+      }
+
+      LOG_PRINT_L0("Initializing currency protocol...");
+      r = cprotocol.init(vm);
+      CHECK_AND_ASSERT_MES(r, false, "Failed to initialize currency protocol.");
+      LOG_PRINT_L0("Currency protocol initialized OK");
+      return true;
+    });
   }
 
-  LOG_PRINT_L0("Initializing currency protocol...");
-  res = cprotocol.init(vm);
-  CHECK_AND_ASSERT_MES(res, 1, "Failed to initialize currency protocol.");
-  LOG_PRINT_L0("Currency protocol initialized OK");
-
   LOG_PRINT_L0("Initializing core rpc server...");
-  res = rpc_server.init(vm);
+  {
+    tools::startup_phase_timer spt("rpc: init");
+    res = rpc_server.init(vm);
+  }
   CHECK_AND_ASSERT_MES(res, 1, "Failed to initialize core rpc server.");
   LOG_PRINT_GREEN("Core rpc server initialized OK on port: " << rpc_server.get_binded_port(), LOG_LEVEL_0);
 
   //initialize core here
   LOG_PRINT_L0("Initializing core...");
-  res = ccore.init(vm);
+  {
+    tools::startup_phase_timer spt("core: init");
+    res = ccore.init(vm);
+  }
+  if (p2p_init.valid() && !p2p_init.get())
+    return 1;
   CHECK_AND_ASSERT_MES(res, 1, "Failed to initialize core");
   LOG_PRINT_L0("Core initialized OK");
 
@@ -344,15 +378,28 @@ int main(int argc, char* argv[])
   auto& bcs = ccore.get_blockchain_storage();
   if (!offers_service.is_disabled() && bcs.get_current_blockchain_size() > 1 && bcs.get_top_block_id() != offers_service.get_last_seen_block_id())
   {
+    tools::startup_phase_timer spt("offers: market resync");
     res = resync_market(bcs, offers_service);
     CHECK_AND_ASSERT_MES(res, 1, "Failed to initialize core: resync_market");
   }
 
+  tools::startup_phase_timer spt_checkpoints("core: checkpoints");
   currency::checkpoints checkpoints;
   res = currency::create_checkpoints(checkpoints);
   CHECK_AND_ASSERT_MES(res, 1, "Failed to initialize checkpoints");
   res = ccore.set_checkpoints(std::move(checkpoints));
   CHECK_AND_ASSERT_MES(res, 1, "Failed to initialize core");
+  spt_checkpoints.finish();
+
+  if (!secondary && command_line::has_arg(vm, command_line::arg_import_bootstrap_file))
+  {
+    std::string bootstrap_path = command_line::get_arg(vm, command_line::arg_import_bootstrap_file);
+    LOG_PRINT_L0("Importing blocks from bootstrap file " << bootstrap_path << "...");
+    uint64_t imported_blocks = 0;
+    res = tools::import_bootstrap_file(ccore, bootstrap_path, [&p2psrv](uint64_t height) { return static_cast<nodetool::i_p2p_endpoint<currency::t_currency_protocol_handler<currency::core>::connection_context>*>(&p2psrv)->is_stop_signal_sent(); }, imported_blocks);
+    LOG_PRINT_L0(imported_blocks << " blocks imported, blockchain height: " << ccore.get_top_block_height());
+    CHECK_AND_ASSERT_MES(res, 1, "Failed to import bootstrap file");
+  }
 
   // start components
   if (!command_line::has_arg(vm, command_line::arg_console))
@@ -361,7 +408,7 @@ int main(int argc, char* argv[])
   }
 
   LOG_PRINT_L0("Starting core rpc server...");
-  res = rpc_server.run(2, false);
+  res = rpc_server.run(rpc_server.get_threads_count(), false);
   CHECK_AND_ASSERT_MES(res, 1, "Failed to initialize core rpc server.");
   LOG_PRINT_L0("Core rpc server started ok");
 
@@ -374,6 +421,10 @@ int main(int argc, char* argv[])
     LOG_PRINT_L0("Stratum server started ok");
   }
 
+  // the first PoW check after the start would otherwise build the DAG of the current epoch in place
+  bcs.prepare_top_ethash_epoch();
+  LOG_PRINT_L0(tools::startup_profile::get().get_report());
+
   tools::signal_handler::install([&dch, &p2psrv, &stratum_server_ptr] {
     dch.stop_handling();
     p2psrv.send_stop_signal();
@@ -381,9 +432,23 @@ int main(int argc, char* argv[])
       stratum_server_ptr->send_stop_signal();
   });
 
-  LOG_PRINT_L0("Starting p2p net loop...");
-  p2psrv.run();
-  LOG_PRINT_L0("p2p net loop stopped");
+  if (secondary)
+  {
+    // p2p is not running, its stop flag is still raised by the signal handler and the 'exit' command
+    LOG_PRINT_L0("Following the primary instance's blockchain db...");
+    while (!static_cast<nodetool::i_p2p_endpoint<currency::t_currency_protocol_handler<currency::core>::connection_context>*>(&p2psrv)->is_stop_signal_sent())
+    {
+      bcs.follow_primary();
+      epee::misc_utils::sleep_no_w(200);
+    }
+    LOG_PRINT_L0("Following stopped");
+  }
+  else
+  {
+    LOG_PRINT_L0("Starting p2p net loop...");
+    p2psrv.run();
+    LOG_PRINT_L0("p2p net loop stopped");
+  }
 
   //stop components
   if (stratum_enabled)
@@ -411,10 +476,13 @@ int main(int argc, char* argv[])
 
   LOG_PRINT_L0("Deinitializing rpc server ...");
   rpc_server.deinit();
-  LOG_PRINT_L0("Deinitializing currency_protocol...");
-  cprotocol.deinit();
-  LOG_PRINT_L0("Deinitializing p2p...");
-  p2psrv.deinit();
+  if (!secondary)
+  {
+    LOG_PRINT_L0("Deinitializing currency_protocol...");
+    cprotocol.deinit();
+    LOG_PRINT_L0("Deinitializing p2p...");
+    p2psrv.deinit();
+  }
 
   ccore.set_critical_error_handler(nullptr);
   ccore.set_currency_protocol(NULL);
@@ -15,9 +15,11 @@
 #include "common/util.h"
 #include "crypto/hash.h"
 #include "warnings.h"
+#include "trace_tools.h"
 #include "currency_core/bc_offers_service.h"
 #include "serialization/binary_utils.h"
 #include "simplewallet/password_container.h"
+#include "common/bootstrap_file.h"
 
 namespace ph = boost::placeholders;
 
@@ -63,14 +65,24 @@ public:
     m_cmd_binder.set_handler("disable_channel", boost::bind(&daemon_commands_handler::disable_channel, this, ph::_1), "Enable specified log channel");
     m_cmd_binder.set_handler("clear_cache", boost::bind(&daemon_commands_handler::clear_cache, this, ph::_1), "Clear blockchain storage cache");
     m_cmd_binder.set_handler("clear_altblocks", boost::bind(&daemon_commands_handler::clear_altblocks, this, ph::_1), "Clear blockchain storage cache");
-    m_cmd_binder.set_handler("truncate_bc", boost::bind(&daemon_commands_handler::truncate_bc, this, ph::_1), "Truncate blockchain to specified height");
+    m_cmd_binder.set_handler("truncate_bc", boost::bind(&daemon_commands_handler::truncate_bc, this, ph::_1), "Truncate blockchain to specified height, truncate_bc <height> [move_txs_to_pool]");
     m_cmd_binder.set_handler("inspect_block_index", boost::bind(&daemon_commands_handler::inspect_block_index, this, ph::_1), "Inspects block index for internal errors");
     m_cmd_binder.set_handler("print_db_performance_data", boost::bind(&daemon_commands_handler::print_db_performance_data, this, ph::_1), "Dumps all db containers performance counters");
+    m_cmd_binder.set_handler("print_mem_usage", boost::bind(&daemon_commands_handler::print_mem_usage, this, ph::_1), "Print estimated memory held by caches, in-memory containers and network send queues");
+    m_cmd_binder.set_handler("export_bootstrap", boost::bind(&daemon_commands_handler::export_bootstrap, this, ph::_1), "Export blockchain to a db-independent bootstrap file, export_bootstrap <path> [<start_height>=1]");
+    m_cmd_binder.set_handler("import_bootstrap", boost::bind(&daemon_commands_handler::import_bootstrap, this, ph::_1), "Import blocks from a bootstrap file, import_bootstrap <path>");
+    m_cmd_binder.set_handler("compact_db", boost::bind(&daemon_commands_handler::compact_db, this, ph::_1), "Compact blockchain db online: copy live data into a fresh file and swap it in (needs free disk space of about the db size)");
     m_cmd_binder.set_handler("search_by_id", boost::bind(&daemon_commands_handler::search_by_id, this, ph::_1), "Search all possible elemets by given id");
     m_cmd_binder.set_handler("find_key_image", boost::bind(&daemon_commands_handler::find_key_image, this, ph::_1), "Try to find tx related to key_image");
     m_cmd_binder.set_handler("rescan_aliases", boost::bind(&daemon_commands_handler::rescan_aliases, this, ph::_1), "Debug function");
     m_cmd_binder.set_handler("forecast_difficulty", boost::bind(&daemon_commands_handler::forecast_difficulty, this, ph::_1), "Prints PoW and PoS difficulties for as many future blocks as possible based on current conditions");
     m_cmd_binder.set_handler("print_deadlock_guard", boost::bind(&daemon_commands_handler::print_deadlock_guard, this, ph::_1), "Print all threads which is blocked or involved in mutex ownership");
+    m_cmd_binder.set_handler("lock_profiler_start", boost::bind(&daemon_commands_handler::lock_profiler_start, this, ph::_1), "Start collecting wait/hold times of CRITICAL_REGION lock sites (collected ones are reset)");
+    m_cmd_binder.set_handler("lock_profiler_stop", boost::bind(&daemon_commands_handler::lock_profiler_stop, this, ph::_1), "Stop collecting lock sites wait/hold times");
+    m_cmd_binder.set_handler("print_lock_contention", boost::bind(&daemon_commands_handler::print_lock_contention, this, ph::_1), "Print the most waited for lock sites, print_lock_contention [<count>=20]");
+    m_cmd_binder.set_handler("trace_start", boost::bind(&daemon_commands_handler::trace_start, this, ph::_1), "Start recording block/tx/db/p2p/rpc spans of all threads (previously recorded ones are discarded)");
+    m_cmd_binder.set_handler("trace_stop", boost::bind(&daemon_commands_handler::trace_stop, this, ph::_1), "Stop recording spans");
+    m_cmd_binder.set_handler("trace_dump", boost::bind(&daemon_commands_handler::trace_dump, this, ph::_1), "Save recorded spans as Chrome trace / Perfetto JSON, trace_dump <path>");
     m_cmd_binder.set_handler("print_block_from_hex_blob", boost::bind(&daemon_commands_handler::print_block_from_hex_blob, this, ph::_1), "Unserialize block from hex binary data to json-like representation");
     m_cmd_binder.set_handler("print_tx_from_hex_blob", boost::bind(&daemon_commands_handler::print_tx_from_hex_blob, this, ph::_1), "Unserialize transaction from hex binary data to json-like representation");
     m_cmd_binder.set_handler("print_tx_outputs_usage", boost::bind(&daemon_commands_handler::print_tx_outputs_usage, this, ph::_1), "Analyse if tx outputs for involved in subsequent transactions");
@@ -273,7 +285,8 @@ private:
       return false;
     }
 
-    m_srv.get_payload_object().get_core().get_blockchain_storage().truncate_blockchain(tr_h);
+    bool move_txs_to_pool = args.size() > 1 && args[1] == "move_txs_to_pool";
+    m_srv.get_payload_object().get_core().get_blockchain_storage().truncate_blockchain(tr_h, move_txs_to_pool);
     return true;
   }
   bool inspect_block_index(const std::vector<std::string>& args)
@@ -287,6 +300,62 @@ private:
     return true;
   }
   //--------------------------------------------------------------------------------
+  bool print_mem_usage(const std::vector<std::string>& args)
+  {
+    std::list<tools::memory_usage_entry> usage;
+    m_srv.get_payload_object().get_core().get_memory_usage(usage);
+    LOG_PRINT_L0("Estimated memory usage:" << ENDL << tools::memory_usage_to_string(usage));
+    return true;
+  }
+  //--------------------------------------------------------------------------------
+  bool compact_db(const std::vector<std::string>& args)
+  {
+    uint64_t size_before = 0, size_after = 0;
+    if (!m_srv.get_payload_object().get_core().get_blockchain_storage().compact_db(size_before, size_after))
+    {
+      std::cout << "DB compaction failed, see the log for details" << ENDL;
+      return true;
+    }
+    std::cout << "DB compacted: " << size_before / (1024 * 1024) << " MB -> " << size_after / (1024 * 1024) << " MB" << ENDL;
+    return true;
+  }
+  //--------------------------------------------------------------------------------
+  bool export_bootstrap(const std::vector<std::string>& args)
+  {
+    if (!args.size())
+    {
+      std::cout << "need path parameter" << ENDL;
+      return false;
+    }
+    uint64_t start_height = 1;
+    if (args.size() > 1 && !string_tools::get_xtype_from_string(start_height, args[1]))
+    {
+      std::cout << "wrong start height: " << args[1] << ENDL;
+      return false;
+    }
+    uint64_t exported_blocks = 0;
+    if (!tools::export_bootstrap_file(m_srv.get_payload_object().get_core(), args[0], start_height, exported_blocks))
+    {
+      std::cout << "Export failed, see the log for details" << ENDL;
+      return true;
+    }
+    std::cout << exported_blocks << " blocks exported to " << args[0] << ENDL;
+    return true;
+  }
+  //--------------------------------------------------------------------------------
+  bool import_bootstrap(const std::vector<std::string>& args)
+  {
+    if (!args.size())
+    {
+      std::cout << "need path parameter" << ENDL;
+      return false;
+    }
+    uint64_t imported_blocks = 0;
+    bool r = tools::import_bootstrap_file(m_srv.get_payload_object().get_core(), args[0], [this](uint64_t height) { return static_cast<nodetool::i_p2p_endpoint<currency::t_currency_protocol_handler<currency::core>::connection_context>*>(&m_srv)->is_stop_signal_sent(); }, imported_blocks);
+    std::cout << imported_blocks << " blocks imported" << (r ? "" : ", import failed, see the log for details") << ENDL;
+    return true;
+  }
+  //--------------------------------------------------------------------------------
   bool search_by_id(const std::vector<std::string>& args)
   {
 
@@ -975,6 +1044,63 @@ private:
     return true;
   }
   //--------------------------------------------------------------------------------
+  bool lock_profiler_start(const std::vector<std::string>& args)
+  {
+    epee::lock_contention_profiler::reset();
+    epee::lock_contention_profiler::enable(true);
+    std::cout << "Lock contention profiler started" << ENDL;
+    return true;
+  }
+  //--------------------------------------------------------------------------------
+  bool lock_profiler_stop(const std::vector<std::string>& args)
+  {
+    epee::lock_contention_profiler::enable(false);
+    std::cout << "Lock contention profiler stopped" << ENDL;
+    return true;
+  }
+  //--------------------------------------------------------------------------------
+  bool print_lock_contention(const std::vector<std::string>& args)
+  {
+    size_t count = 20;
+    if (args.size() && !string_tools::get_xtype_from_string(count, args[0]))
+    {
+      std::cout << "wrong count: " << args[0] << ENDL;
+      return false;
+    }
+    LOG_PRINT_L0(ENDL << epee::lock_contention_profiler::get_report(count));
+    return true;
+  }
+  //--------------------------------------------------------------------------------
+  bool trace_start(const std::vector<std::string>& args)
+  {
+    epee::trace_tools::tracer::get().start();
+    std::cout << "Tracing started, up to " << TRACE_EVENTS_PER_THREAD << " latest spans are kept per thread" << ENDL;
+    return true;
+  }
+  //--------------------------------------------------------------------------------
+  bool trace_stop(const std::vector<std::string>& args)
+  {
+    epee::trace_tools::tracer::get().stop();
+    std::cout << "Tracing stopped" << ENDL;
+    return true;
+  }
+  //--------------------------------------------------------------------------------
+  bool trace_dump(const std::vector<std::string>& args)
+  {
+    if (args.size() != 1)
+    {
+      std::cout << "need path parameter" << ENDL;
+      return false;
+    }
+    if (!epee::file_io_utils::save_string_to_file(args[0], epee::trace_tools::tracer::get().get_chrome_trace()))
+    {
+      std::cout << "failed to save trace to " << args[0] << ENDL;
+      return false;
+    }
+    std::cout << "Trace saved to " << args[0] << ", open it with chrome://tracing or ui.perfetto.dev" << ENDL;
+    return true;
+  }
+  //--------------------------------------------------------------------------------
 #ifdef _DEBUG  
   static std::atomic<int64_t>& debug_core_time_shift_accessor()
   {
@@ -1141,31 +1141,54 @@ bool MainWindow::money_transfer(const view::transfer_event_info& tei)
   LOG_PRINT_L0(get_wallet_log_prefix(tei.wallet_id) + "SENDING SIGNAL -> [money_transfer]" << std::endl << json_str);
   //this->money_transfer(json_str.c_str());
   QMetaObject::invokeMethod(this, "money_transfer", Qt::QueuedConnection, Q_ARG(QString, json_str.c_str()));
+  show_transfer_notification(tei.ti, tei.is_wallet_in_sync_process);
+  return true;
+  CATCH_ENTRY2(false);
+}
+
+bool MainWindow::money_transfers_batch(const view::transfers_batch_event_info& tbi)
+{
+  TRY_ENTRY();
+  // a rescan finds a lot of transfers, they go to the UI in one signal and one JSON
+  std::string json_str;
+  epee::serialization::store_t_to_json(tbi, json_str, 0);
+
+  LOG_PRINT_L0(get_wallet_log_prefix(tbi.wallet_id) + "SENDING SIGNAL -> [money_transfers_batch] " << tbi.transfers.size() << " transfer(s)");
+  LOG_PRINT_L2(json_str);
+  QMetaObject::invokeMethod(this, "money_transfers_batch", Qt::QueuedConnection, Q_ARG(QString, json_str.c_str()));
+  for (const auto& ti : tbi.transfers)
+    show_transfer_notification(ti, tbi.is_wallet_in_sync_process);
+  return true;
+  CATCH_ENTRY2(false);
+}
+
+void MainWindow::show_transfer_notification(const tools::wallet_public::wallet_transfer_info& ti, bool is_wallet_in_sync_process)
+{
   if (m_config.disable_notifications)
-    return true;
+    return;
 
 
   if (!m_tray_icon)
-    return true;
-  if (tei.ti.has_outgoing_entries())
-    return true;
-  if (!tei.ti.get_native_amount())
-    return true;
-//  if (tei.ti.is_mining && m_wallet_states->operator [](tei.wallet_id) != view::wallet_status_info::wallet_state_ready)
-//    return true;
+    return;
+  if (ti.has_outgoing_entries())
+    return;
+  if (!ti.get_native_amount())
+    return;
+//  if (ti.is_mining && m_wallet_states->operator [](tei.wallet_id) != view::wallet_status_info::wallet_state_ready)
+//    return;
 
 //don't show unconfirmed tx
-  if (tei.ti.height == 0)
-    return true;
-  if (tei.is_wallet_in_sync_process)
+  if (ti.height == 0)
+    return;
+  if (is_wallet_in_sync_process)
   {
     //don't show notification if it long sync process(mmight cause system freeze)
-    return true;
+    return;
   }
 
-  auto amount_str = currency::print_money_brief(tei.ti.get_native_amount()); //@#@ add handling of assets
+  auto amount_str = currency::print_money_brief(ti.get_native_amount()); //@#@ add handling of assets
   std::string title, msg;
-  if (tei.ti.height == 0) // unconfirmed tx
+  if (ti.height == 0) // unconfirmed tx
   {
     msg = amount_str + " " + CURRENCY_NAME_ABR + " " + m_localization[localization_id_is_received];
     title = m_localization[localization_id_income_transfer_unconfirmed];
@@ -1175,16 +1198,13 @@ bool MainWindow::money_transfer(const view::transfer_event_info& tei)
     msg = amount_str + " " + CURRENCY_NAME_ABR + " " + m_localization[localization_id_is_confirmed];
     title = m_localization[localization_id_income_transfer_confirmed];
   }
-  if (tei.ti.is_mining)
+  if (ti.is_mining)
     msg += m_localization[localization_id_mined];
-  else if (tei.ti.unlock_time)
+  else if (ti.unlock_time)
     msg += m_localization[localization_id_locked];
 
   
   show_notification(title, msg);
-
-  return true;
-  CATCH_ENTRY2(false);
 }
 
 bool MainWindow::money_transfer_cancel(const view::transfer_event_info& tei)
@@ -209,6 +209,7 @@ signals:
   void update_wallet_status(const QString str);
   void update_wallet_info(const QString str);
   void money_transfer(const QString str);
+  void money_transfers_batch(const QString str);
   void money_transfer_cancel(const QString str);
   void wallet_sync_progress(const QString str);
   void handle_internal_callback(const QString str, const QString callback_name);
@@ -232,6 +233,7 @@ private:
   virtual bool update_wallet_status(const view::wallet_status_info& wsi);
   virtual bool update_wallets_info(const view::wallets_summary_info& wsi);
   virtual bool money_transfer(const view::transfer_event_info& tei);
+  virtual bool money_transfers_batch(const view::transfers_batch_event_info& tbi);
   virtual bool wallet_sync_progress(const view::wallet_sync_progres_param& p);
   virtual bool money_transfer_cancel(const view::transfer_event_info& wsi);
   virtual bool init(const std::string& path);
@@ -253,6 +255,7 @@ private:
   
 
   void init_tray_icon(const std::string& htmlPath);
+  void show_transfer_notification(const tools::wallet_public::wallet_transfer_info& ti, bool is_wallet_in_sync_process);
   bool set_html_path(const std::string& path);
   void load_file(const QString &fileName);
   void store_pos(bool consider_showed = false);
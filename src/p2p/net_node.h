@@ -5,6 +5,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #pragma once
+#include <atomic>
 #include <boost/thread.hpp>
 #include <boost/bind/bind.hpp>
 #include <boost/foreach.hpp>
@@ -45,6 +46,9 @@ namespace nodetool
   struct p2p_connection_context_t: base_type //t_payload_net_handler::connection_context //public net_utils::connection_context_base
   {
     peerid_type peer_id;
+    time_t peerlist_sent_time = 0;          // of the last handshake or timed sync response, the next one has only the peers seen since
+    time_t full_peerlist_sent_time = 0;
+    uint64_t rtt_ms = 0;                    // smoothed round trip of the handshake and timed syncs, 0 while unknown
   };
 
   template<class t_payload_net_handler>
@@ -82,7 +86,10 @@ namespace nodetool
                                                         m_use_only_priority_peers(false),
                                                         m_peer_livetime{},
                                                         m_debug_requests_enabled(false),
-                                                        m_ip_auto_blocking_enabled(false)
+                                                        m_ip_auto_blocking_enabled(false),
+                                                        m_io_threads_count(1),
+                                                        m_closed_connections_recv_bytes(0),
+                                                        m_closed_connections_sent_bytes(0)
     {}
 
     static void init_options(boost::program_options::options_description& desc);
@@ -118,6 +125,7 @@ namespace nodetool
     bool log_connections();
     virtual uint64_t get_connections_count();
     size_t get_outgoing_connections_count();
+    void get_traffic_stat(uint64_t& recv_bytes, uint64_t& sent_bytes); // of all the connections since start
     peerlist_manager& get_peerlist_manager(){return m_peerlist;}
     bool handle_maintainers_entry(const maintainers_entry& me);
     bool get_maintainers_info(maintainers_info_external& me);
@@ -161,6 +169,7 @@ namespace nodetool
     bool init_config();
     bool make_default_config();
     bool store_config();
+    bool flush_peerlist_journal();
     bool check_trust(const proof_of_trust& tr);
 
 
@@ -172,8 +181,12 @@ namespace nodetool
     virtual bool relay_notify_to_all(int command, const std::string& data_buff, const epee::net_utils::connection_context_base& context, std::list<epee::net_utils::connection_context_base>& relayed_peers);
     virtual bool invoke_command_to_peer(int command, const std::string& req_buff, std::string& resp_buff, const epee::net_utils::connection_context_base& context);
     virtual bool invoke_notify_to_peer(int command, const std::string& req_buff, const epee::net_utils::connection_context_base& context);
+    virtual bool invoke_notify_to_peer(int command, const epee::net_utils::shared_buffer& req_buff, const epee::net_utils::connection_context_base& context);
     virtual bool drop_connection(const epee::net_utils::connection_context_base& context);
     virtual void request_callback(const epee::net_utils::connection_context_base& context);
+    virtual void set_connection_compression(const epee::net_utils::connection_context_base& context, bool compress_outgoing);
+    virtual void report_block_announcement(const epee::net_utils::connection_context_base& context, uint64_t delay_ms);
+    virtual void report_sync_speed(const epee::net_utils::connection_context_base& context, uint64_t speed);
     virtual void get_connections(std::list<typename t_payload_net_handler::connection_context>& connections);
     virtual void for_each_connection(std::function<bool(typename t_payload_net_handler::connection_context&, peerid_type)> f);
     virtual bool block_ip(uint32_t adress);
@@ -195,7 +208,9 @@ namespace nodetool
     bool connections_maker();
     bool peer_sync_idle_maker();
     bool do_handshake_with_peer(peerid_type& pi, p2p_connection_context& context, bool just_take_peerlist = false);
-    bool do_peer_timed_sync(const net_utils::connection_context_base& context, peerid_type peer_id);
+    bool do_peer_timed_sync(const net_utils::connection_context_base& context, size_t invoke_timeout);
+    void on_connection_rtt(p2p_connection_context& context, uint64_t rtt_ms);
+    size_t get_invoke_timeout(const p2p_connection_context& context) const;
 
     bool make_new_connection_from_peerlist(bool use_white_list);
     bool try_to_connect_and_handshake_with_new_peer(const net_address& na, bool just_take_peerlist = false, uint64_t last_seen_stamp = 0, bool white = true);
@@ -216,6 +231,7 @@ namespace nodetool
     bool urgent_alert_worker();
     bool critical_alert_worker();
     bool remove_dead_connections();
+    bool rotate_slow_peers();
     bool is_ip_good_for_adding_to_peerlist(uint32_t adress);
     bool is_ip_in_blacklist(uint32_t adress);
 
@@ -249,7 +265,10 @@ namespace nodetool
     bool m_offline_mode;
     bool m_debug_requests_enabled;
     bool m_ip_auto_blocking_enabled;
+    uint32_t m_io_threads_count;
     uint64_t m_startup_time;
+    std::atomic<uint64_t> m_closed_connections_recv_bytes;
+    std::atomic<uint64_t> m_closed_connections_sent_bytes;
 
 
     //critical_section m_connections_lock;
@@ -261,7 +280,9 @@ namespace nodetool
     math_helper::once_a_time_seconds<P2P_DEFAULT_HANDSHAKE_INTERVAL> m_peer_handshake_idle_maker_interval;
     math_helper::once_a_time_seconds<1> m_connections_maker_interval;
     math_helper::once_a_time_seconds<60*30, false> m_peerlist_store_interval;
+    math_helper::once_a_time_seconds<P2P_PEERLIST_JOURNAL_FLUSH_INTERVAL, false> m_peerlist_journal_interval;
     math_helper::once_a_time_seconds<60> m_remove_dead_conn_interval;
+    math_helper::once_a_time_seconds<P2P_SLOW_PEER_ROTATION_INTERVAL, false> m_rotate_slow_peers_interval;
     
     /*this code is temporary here(to show regular message if need), until we get normal GUI*/
     math_helper::once_a_time_seconds<60, false>  m_calm_alert_interval;
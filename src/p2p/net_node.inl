@@ -17,13 +17,11 @@
 #include "net/local_ip.h"
 #include "crypto/crypto.h"
 #include "storages/levin_abstract_invoke2.h"
+#include "p2p_networks.h"
 
 
 namespace nodetool
 {
-  //zero network before launch
-  const static boost::uuids::uuid P2P_NETWORK_ID = { { 0x11, 0x10, 0x01, 0x11, 0x01, 0x01, 0x11, 0x01, 0x10, 0x11, P2P_NETWORK_ID_TESTNET_FLAG, 0x11, 0x01, 0x11, 0x21, P2P_NETWORK_ID_VER} };
-
   namespace
   {
     const command_line::arg_descriptor<std::string>               arg_p2p_bind_ip                    ("p2p-bind-ip", "Interface for p2p network protocol", "0.0.0.0");
@@ -38,6 +36,9 @@ namespace nodetool
     const command_line::arg_descriptor<bool>                      arg_p2p_offline_mode               ( "offline-mode", "Don't connect to any node and reject any connections");
     const command_line::arg_descriptor<bool>                      arg_p2p_disable_debug_reqs         ( "disable-debug-p2p-requests", "Disable p2p debug requests");
     const command_line::arg_descriptor<uint32_t>                  arg_p2p_ip_auto_blocking           ( "p2p-ip-auto-blocking", "Enable (1) or disable (0) peers auto-blocking by IP <0|1>. Default: 0", 1);
+    const command_line::arg_descriptor<uint64_t>                  arg_p2p_limit_rate_up              ( "limit-rate-up", "Limit of the outgoing p2p traffic in kB/s, 0 means unlimited", 0);
+    const command_line::arg_descriptor<uint64_t>                  arg_p2p_limit_rate_up_per_peer     ( "limit-rate-up-per-peer", "Limit of the outgoing traffic to each peer in kB/s, 0 means unlimited", 0);
+    const command_line::arg_descriptor<uint32_t>                  arg_p2p_io_threads                 ( "p2p-io-threads", "Number of threads serving p2p connections, each with its own part of them, 0 means one per CPU core", 0);
   }
 
   //-----------------------------------------------------------------------------------
@@ -56,6 +57,9 @@ namespace nodetool
     command_line::add_arg(desc, arg_p2p_disable_debug_reqs);
     command_line::add_arg(desc, arg_p2p_use_only_priority_nodes);
     command_line::add_arg(desc, arg_p2p_ip_auto_blocking);
+    command_line::add_arg(desc, arg_p2p_limit_rate_up);
+    command_line::add_arg(desc, arg_p2p_limit_rate_up_per_peer);
+    command_line::add_arg(desc, arg_p2p_io_threads);
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
@@ -71,10 +75,13 @@ namespace nodetool
     std::time_t last_update_time  = boost::filesystem::last_write_time(state_file_path, ec);
     //let's assume that if p2p peer list file stored more then 2 weeks ago, 
     //then it outdated and we need to fetch peerlist from seed nodes 
-    if (!ec &&  time(nullptr) - last_update_time < 86400 * 14)
+    bool is_state_actual = !ec && time(nullptr) - last_update_time < 86400 * 14;
+    if (is_state_actual)
     {      
       tools::unserialize_obj_from_file(*this, state_file_path);
     }
+    // the changes made after the state was stored last time
+    m_peerlist.open_journal(m_config_folder + "/" + P2P_NET_JOURNAL_FILENAME, is_state_actual);
 
     //always use new id, to be able differ cloned computers
     m_config.m_peer_id  = crypto::rand<uint64_t>();
@@ -198,6 +205,16 @@ namespace nodetool
 
     LOG_PRINT_L0("p2p peers auto-blocking is " << (m_ip_auto_blocking_enabled ? "enabled" : "disabled"));
 
+    uint64_t limit_rate_up = command_line::get_arg(vm, arg_p2p_limit_rate_up);
+    uint64_t limit_rate_up_per_peer = command_line::get_arg(vm, arg_p2p_limit_rate_up_per_peer);
+    m_net_server.set_send_rate_limits(limit_rate_up * 1024, limit_rate_up_per_peer * 1024);
+    if (limit_rate_up || limit_rate_up_per_peer)
+      LOG_PRINT_L0("p2p upload is limited to " << limit_rate_up << " kB/s, " << limit_rate_up_per_peer << " kB/s per peer (0 is unlimited)");
+
+    m_io_threads_count = command_line::get_arg(vm, arg_p2p_io_threads);
+    if (!m_io_threads_count)
+      m_io_threads_count = std::min<uint32_t>(std::max<uint32_t>(std::thread::hardware_concurrency(), 1), P2P_MAX_IO_THREADS);
+
     if (m_offline_mode)
     {
       LOG_PRINT_CYAN("Daemon running in offline mode", LOG_LEVEL_0);
@@ -353,8 +370,14 @@ namespace nodetool
 
     //configure self
     m_net_server.set_threads_prefix("P2P");
+    // connections are pinned to io threads, the main ones are left with accepting, connecting and idle handlers
+    m_net_server.set_io_shards_count(m_io_threads_count);
     m_net_server.get_config_object().m_pcommands_handler = this;
     m_net_server.get_config_object().m_invoke_timeout = P2P_DEFAULT_INVOKE_TIMEOUT;
+    std::map<int, epee::net_utils::send_priority> notify_priorities;
+    m_payload_handler.get_notify_priorities(notify_priorities);
+    for (const auto& p : notify_priorities)
+      m_net_server.get_config_object().set_notify_priority(p.first, p.second);
     m_net_server.set_connection_filter(this);
 
     //try to bind
@@ -378,14 +401,14 @@ namespace nodetool
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::run(bool sync_call)
   {
-    //here you can set worker threads count
-    int thrds_count = 10;
+    //here you can set worker threads count, connections are served by m_io_threads_count threads besides them
+    int thrds_count = P2P_MAIN_THREADS;
 
     m_net_server.add_idle_handler(boost::bind(&node_server<t_payload_net_handler>::idle_worker, this), 1000);
     m_net_server.add_idle_handler(boost::bind(&t_payload_net_handler::on_idle, &m_payload_handler), 1000);
 
     //go to loop
-    LOG_PRINT("Run net_service loop( " << thrds_count << " threads)...", LOG_LEVEL_0);
+    LOG_PRINT("Run net_service loop( " << thrds_count << " threads, " << m_io_threads_count << " io threads)...", LOG_LEVEL_0);
     if(!m_net_server.run_server(thrds_count, sync_call))
     {
       LOG_ERROR("Failed to run net tcp server!");
@@ -423,12 +446,21 @@ namespace nodetool
     }
 
     std::string state_file_path = m_config_folder + "/" + P2P_NET_DATA_FILENAME;
-    tools::serialize_obj_to_file(*this, state_file_path);    
+    if (tools::serialize_obj_to_file(*this, state_file_path))
+      m_peerlist.reset_journal();
     CATCH_ENTRY_L0("node_server<t_payload_net_handler>::save", false);
     return true;
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::flush_peerlist_journal()
+  {
+    if (m_peerlist.get_journal_records_count() > P2P_PEERLIST_JOURNAL_MAX_RECORDS)
+      return store_config();
+    return m_peerlist.flush_journal();
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::send_stop_signal()
   {
     m_net_server.send_stop_signal();
@@ -505,9 +537,10 @@ namespace nodetool
     
     simple_event ev;
     std::atomic<bool> hsh_result(false);
+    uint64_t invoke_time = misc_utils::get_tick_count();
     
     bool r = net_utils::async_invoke_remote_command2<typename COMMAND_HANDSHAKE::response>(context_.m_connection_id, COMMAND_HANDSHAKE::ID, arg, m_net_server.get_config_object(), 
-      [this, &pi, &ev, &hsh_result, &just_take_peerlist](int code, const typename COMMAND_HANDSHAKE::response& rsp, p2p_connection_context& context)
+      [this, &pi, &ev, &hsh_result, &just_take_peerlist, invoke_time](int code, const typename COMMAND_HANDSHAKE::response& rsp, p2p_connection_context& context)
     {
       misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler([&](){ev.raise();});
 
@@ -560,6 +593,8 @@ namespace nodetool
 
         pi = context.peer_id = rsp.node_data.peer_id;
         m_peerlist.set_peer_just_seen(rsp.node_data.peer_id, context.m_remote_ip, context.m_remote_port);
+        m_peerlist.on_peer_rtt(net_address{ context.m_remote_ip, context.m_remote_port }, misc_utils::get_tick_count() - invoke_time);
+        on_connection_rtt(context, misc_utils::get_tick_count() - invoke_time);
 
         if(rsp.node_data.peer_id == m_config.m_peer_id)
         {
@@ -590,18 +625,21 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
-  bool node_server<t_payload_net_handler>::do_peer_timed_sync(const net_utils::connection_context_base& context_, peerid_type peer_id)
+  bool node_server<t_payload_net_handler>::do_peer_timed_sync(const net_utils::connection_context_base& context_, size_t invoke_timeout)
   {
     typename COMMAND_TIMED_SYNC::request arg = AUTO_VAL_INIT(arg);
     m_payload_handler.get_payload_sync_data(arg.payload_data);
     fill_maintainers_entry(arg.maintrs_entry);
 
+    uint64_t invoke_time = misc_utils::get_tick_count();
     bool r = net_utils::async_invoke_remote_command2<typename COMMAND_TIMED_SYNC::response>(context_.m_connection_id, COMMAND_TIMED_SYNC::ID, arg, m_net_server.get_config_object(), 
-      [this](int code, const typename COMMAND_TIMED_SYNC::response& rsp, p2p_connection_context& context)
+      [this, invoke_time](int code, const typename COMMAND_TIMED_SYNC::response& rsp, p2p_connection_context& context)
     {
       if(code < 0)
       {
         LOG_PRINT_CC_RED(context, "COMMAND_TIMED_SYNC invoke failed. (" << code <<  ", " << levin::get_err_descr(code) << ")", LOG_LEVEL_1);
+        if(code == LEVIN_ERROR_CONNECTION_TIMEDOUT && context.rtt_ms)
+          context.rtt_ms = std::min<uint64_t>(context.rtt_ms * 2, P2P_DEFAULT_INVOKE_TIMEOUT); // the connection is kept, wait longer the next time
         return;
       }
 
@@ -618,9 +656,13 @@ namespace nodetool
         add_ip_fail(context.m_remote_ip);
       }
       if(!context.m_is_income)
+      {
         m_peerlist.set_peer_just_seen(context.peer_id, context.m_remote_ip, context.m_remote_port);
+        m_peerlist.on_peer_rtt(net_address{ context.m_remote_ip, context.m_remote_port }, misc_utils::get_tick_count() - invoke_time);
+      }
+      on_connection_rtt(context, misc_utils::get_tick_count() - invoke_time);
       m_payload_handler.process_payload_sync_data(rsp.payload_data, context, false);
-    });
+    }, invoke_timeout);
 
     if(!r)
     {
@@ -631,6 +673,20 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::on_connection_rtt(p2p_connection_context& context, uint64_t rtt_ms)
+  {
+    context.rtt_ms = context.rtt_ms ? (context.rtt_ms * 3 + rtt_ms) / 4 : rtt_ms;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  size_t node_server<t_payload_net_handler>::get_invoke_timeout(const p2p_connection_context& context) const
+  {
+    if(!context.rtt_ms)
+      return P2P_DEFAULT_INVOKE_TIMEOUT;
+    return static_cast<size_t>(std::min<uint64_t>(std::max<uint64_t>(context.rtt_ms * P2P_INVOKE_TIMEOUT_RTT_MULTIPLIER, P2P_MIN_INVOKE_TIMEOUT), P2P_DEFAULT_INVOKE_TIMEOUT));
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   size_t node_server<t_payload_net_handler>::get_random_index_with_fixed_probability(size_t max_index)
   {
     //divide by zero workaround
@@ -789,7 +845,10 @@ namespace nodetool
     size_t rand_count = 0;
     size_t peer_index = 0;
     size_t peers_count = use_white_list ? m_peerlist.get_white_peers_count() : m_peerlist.get_gray_peers_count();
-    while (rand_count < (max_random_index + 1) * 3 && try_count < 10 && !m_net_server.is_stop_signal_sent() && peer_index < peers_count)
+    // a few usable peers are picked at once, and the one measured as the best of them is tried first
+    std::vector<peerlist_entry> candidates;
+    while (rand_count < (max_random_index + 1) * 3 && try_count < 10 && !m_net_server.is_stop_signal_sent() && peer_index < peers_count
+      && candidates.size() < P2P_PEER_QUALITY_CANDIDATES_COUNT)
     {
 
       ++rand_count;
@@ -807,7 +866,7 @@ namespace nodetool
       tried_peers.insert(peer_index);
       peerlist_entry pe = AUTO_VAL_INIT(pe);
       bool r = use_white_list ? m_peerlist.get_white_peer_by_index(pe, peer_index):m_peerlist.get_gray_peer_by_index(pe, peer_index);
-      if (!r) return true;
+      if (!r) break;
       //CHECK_AND_ASSERT_MES(r, false, "Failed to get random peer from peerlist(white:" << use_white_list << ")");
 
       ++try_count;
@@ -830,15 +889,30 @@ namespace nodetool
         continue;
       }
 
-      LOG_PRINT_L1("Selected peer: " << pe.id << " " << string_tools::get_ip_string_from_int32(pe.adr.ip) << ":" << boost::lexical_cast<std::string>(pe.adr.port) << "[white=" << use_white_list << "] last_seen: " << (pe.last_seen ? misc_utils::get_time_interval_string(time(NULL) - pe.last_seen) : "never"));
+      candidates.push_back(pe);
+      ++peer_index;
+    }
+
+    std::vector<std::pair<uint64_t, size_t>> penalties; // (penalty, index in candidates)
+    for (size_t i = 0; i != candidates.size(); ++i)
+      penalties.push_back(std::make_pair(m_peerlist.get_peer_penalty(candidates[i].adr), i));
+    std::stable_sort(penalties.begin(), penalties.end());
+
+    for (const auto& p : penalties)
+    {
+      if (m_net_server.is_stop_signal_sent())
+        return false;
+      const peerlist_entry& pe = candidates[p.second];
+      LOG_PRINT_L1("Selected peer: " << pe.id << " " << string_tools::get_ip_string_from_int32(pe.adr.ip) << ":" << boost::lexical_cast<std::string>(pe.adr.port) << "[white=" << use_white_list << "] last_seen: " << (pe.last_seen ? misc_utils::get_time_interval_string(time(NULL) - pe.last_seen) : "never") << ", penalty: " << p.first << " ms");
       
       if(!try_to_connect_and_handshake_with_new_peer(pe.adr, false, pe.last_seen, use_white_list))
       {
         cache_connect_fail_info(pe.adr);
-        ++peer_index;
+        m_peerlist.on_peer_connect_failed(pe.adr);
         continue;
       }
 
+      m_peerlist.on_peer_connected(pe.adr);
       return true;
     }
     return false;
@@ -930,6 +1004,19 @@ namespace nodetool
     return true;
   }
 
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::get_traffic_stat(uint64_t& recv_bytes, uint64_t& sent_bytes)
+  {
+    recv_bytes = m_closed_connections_recv_bytes;
+    sent_bytes = m_closed_connections_sent_bytes;
+    m_net_server.get_config_object().foreach_connection([&](const p2p_connection_context& cntxt)
+    {
+      recv_bytes += cntxt.m_recv_cnt;
+      sent_bytes += cntxt.m_send_cnt;
+      return true;
+    });
+  }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
   size_t node_server<t_payload_net_handler>::get_outgoing_connections_count()
@@ -962,12 +1049,57 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::rotate_slow_peers()
+  {
+    if (m_offline_mode || m_use_only_priority_peers)
+      return true;
+
+    // when all the outgoing slots are taken, the worst of the peers that had time to be measured gives its slot
+    // to another one from peerlist, if it's much worse than the usual one
+    uint64_t curr_time = time(nullptr);
+    std::vector<uint64_t> penalties;
+    uint64_t worst_penalty = 0;
+    boost::uuids::uuid worst_connection_id = AUTO_VAL_INIT(worst_connection_id);
+    net_address worst_addr = AUTO_VAL_INIT(worst_addr);
+    m_net_server.get_config_object().foreach_connection([&](const p2p_connection_context& cntxt)
+    {
+      if (cntxt.m_is_income)
+        return true;
+      net_address na{ cntxt.m_remote_ip, cntxt.m_remote_port };
+      uint64_t penalty = m_peerlist.get_peer_penalty(na);
+      penalties.push_back(penalty);
+      bool is_priority = std::find_if(m_priority_peers.begin(), m_priority_peers.end(), [&](const net_address& pa) { return pa.ip == na.ip && pa.port == na.port; }) != m_priority_peers.end();
+      if (!is_priority && curr_time - cntxt.m_started > P2P_SLOW_PEER_ROTATION_INTERVAL && penalty > worst_penalty)
+      {
+        worst_penalty = penalty;
+        worst_connection_id = cntxt.m_connection_id;
+        worst_addr = na;
+      }
+      return true;
+    });
+
+    if (penalties.size() < m_config.m_net_config.connections_count || !worst_penalty)
+      return true;
+    std::nth_element(penalties.begin(), penalties.begin() + penalties.size() / 2, penalties.end());
+    uint64_t median_penalty = penalties[penalties.size() / 2];
+    if (worst_penalty < P2P_SLOW_PEER_MIN_PENALTY || worst_penalty < median_penalty * P2P_SLOW_PEER_PENALTY_FACTOR)
+      return true;
+
+    LOG_PRINT_L0("Dropping slow peer " << string_tools::get_ip_string_from_int32(worst_addr.ip) << ":" << worst_addr.port << ", penalty " << worst_penalty << " ms, median " << median_penalty << " ms");
+    cache_connect_fail_info(worst_addr); // not to get it back with the next connections_maker() call
+    m_net_server.get_config_object().close(worst_connection_id);
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::idle_worker()
   {
     m_peer_handshake_idle_maker_interval.do_call(boost::bind(&node_server<t_payload_net_handler>::peer_sync_idle_maker, this));
     m_connections_maker_interval.do_call(boost::bind(&node_server<t_payload_net_handler>::connections_maker, this));
     m_peerlist_store_interval.do_call(boost::bind(&node_server<t_payload_net_handler>::store_config, this));
+    m_peerlist_journal_interval.do_call([this](){return flush_peerlist_journal();});
     m_remove_dead_conn_interval.do_call([this](){return remove_dead_connections();});
+    m_rotate_slow_peers_interval.do_call([this](){return rotate_slow_peers();});
 
     m_calm_alert_interval.do_call([&](){return calm_alert_worker();});
     m_urgent_alert_interval.do_call([&](){return urgent_alert_worker();});
@@ -1022,12 +1154,12 @@ namespace nodetool
   bool node_server<t_payload_net_handler>::peer_sync_idle_maker()
   {
     LOG_PRINT_L2("STARTED PEERLIST IDLE HANDSHAKE");
-    typedef std::list<std::pair<net_utils::connection_context_base, peerid_type> > local_connects_type;
+    typedef std::list<std::pair<net_utils::connection_context_base, size_t> > local_connects_type;
     local_connects_type cncts;
     m_net_server.get_config_object().foreach_connection([&](const p2p_connection_context& cntxt)
     {
       if(cntxt.peer_id)
-        cncts.push_back(local_connects_type::value_type(cntxt, cntxt.peer_id));//do idle sync only with handshaked connections
+        cncts.push_back(local_connects_type::value_type(cntxt, get_invoke_timeout(cntxt)));//do idle sync only with handshaked connections
       return true;
     });
 
@@ -1061,7 +1193,9 @@ namespace nodetool
   bool node_server<t_payload_net_handler>::handle_remote_peerlist(const std::list<peerlist_entry>& peerlist, time_t local_time, const net_utils::connection_context_base& context)
   {
     int64_t delta = 0;
-    std::list<peerlist_entry> peerlist_ = peerlist;
+    // no more than merge_peerlist() takes
+    auto peerlist_end = peerlist.size() > P2P_MAX_PEERS_TO_MERGE ? std::next(peerlist.begin(), P2P_MAX_PEERS_TO_MERGE) : peerlist.end();
+    std::list<peerlist_entry> peerlist_(peerlist.begin(), peerlist_end);
     if(!fix_time_delta(peerlist_, local_time, delta))
       return false;
     LOG_PRINT_L2("REMOTE PEERLIST: TIME_DELTA: " << delta << ", remote peerlist size=" << peerlist_.size());
@@ -1216,6 +1350,27 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::set_connection_compression(const epee::net_utils::connection_context_base& context, bool compress_outgoing)
+  {
+    m_net_server.get_config_object().set_compression(context.m_connection_id, compress_outgoing);
+  }
+  //-----------------------------------------------------------------------------------
+  // peers are scored by their listening address, so only the outgoing connections are measured
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::report_block_announcement(const epee::net_utils::connection_context_base& context, uint64_t delay_ms)
+  {
+    if (!context.m_is_income)
+      m_peerlist.on_peer_block_announced(net_address{ context.m_remote_ip, context.m_remote_port }, delay_ms);
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::report_sync_speed(const epee::net_utils::connection_context_base& context, uint64_t speed)
+  {
+    if (!context.m_is_income)
+      m_peerlist.on_peer_sync_speed(net_address{ context.m_remote_ip, context.m_remote_port }, speed);
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::relay_notify_to_all(int command, const std::string& data_buff, const epee::net_utils::connection_context_base& context, std::list<epee::net_utils::connection_context_base>& relayed_peers)
   {
     relayed_peers.clear();
@@ -1226,9 +1381,11 @@ namespace nodetool
       return true;
     });
 
+    // one copy of the payload is queued to all the peers
+    epee::net_utils::shared_buffer shared_data = std::make_shared<const std::string>(data_buff);
     BOOST_FOREACH(const auto& cntx, relayed_peers)
     {
-      m_net_server.get_config_object().notify(command, data_buff, cntx.m_connection_id);
+      m_net_server.get_config_object().notify(command, shared_data, cntx.m_connection_id);
     }
     return true;
   }
@@ -1256,6 +1413,13 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::invoke_notify_to_peer(int command, const epee::net_utils::shared_buffer& req_buff, const epee::net_utils::connection_context_base& context)
+  {
+    int res = m_net_server.get_config_object().notify(command, req_buff, context.m_connection_id);
+    return res > 0;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::invoke_command_to_peer(int command, const std::string& req_buff, std::string& resp_buff, const epee::net_utils::connection_context_base& context)
   {
     int res = m_net_server.get_config_object().invoke(command, req_buff, resp_buff, context.m_connection_id);
@@ -1281,7 +1445,8 @@ namespace nodetool
     std::string ip = string_tools::get_ip_string_from_int32(actual_ip);
     std::string port = string_tools::num_to_string_fast(node_data.my_port);
     peerid_type pr = node_data.peer_id;
-    bool r = m_net_server.connect_async(ip, port, m_config.m_net_config.ping_connection_timeout, [cb, /*context,*/ ip, port, pr, this](
+    net_address na{ actual_ip, node_data.my_port };
+    bool r = m_net_server.connect_async(ip, port, m_config.m_net_config.ping_connection_timeout, [cb, /*context,*/ ip, port, pr, na, this](
       const typename net_server::t_connection_context& ping_context,
       const boost::system::error_code& ec)->bool
     {
@@ -1292,6 +1457,7 @@ namespace nodetool
       }
       COMMAND_PING::request req;
       COMMAND_PING::response rsp;
+      uint64_t invoke_time = misc_utils::get_tick_count();
       //vc2010 workaround
       /*std::string ip_ = ip;
       std::string port_=port;
@@ -1314,6 +1480,7 @@ namespace nodetool
           return;
         }
         m_net_server.get_config_object().close(ping_context.m_connection_id);
+        m_peerlist.on_peer_rtt(na, misc_utils::get_tick_count() - invoke_time);
         cb();
       });
 
@@ -1348,12 +1515,17 @@ namespace nodetool
       return 1;
     }
 
-    //fill response
-    rsp.local_time = time(NULL);
-    m_peerlist.get_peerlist_head(rsp.local_peerlist);
+    //fill response, the whole peer list only now and then: the peer has already merged the entries that didn't change
+    time_t now = time(NULL);
+    rsp.local_time = now;
+    bool full_peerlist = now - context.full_peerlist_sent_time >= P2P_FULL_PEERLIST_EXCHANGE_INTERVAL;
+    m_peerlist.get_peerlist_head(rsp.local_peerlist, P2P_DEFAULT_PEERS_IN_HANDSHAKE, full_peerlist ? 0 : context.peerlist_sent_time);
+    context.peerlist_sent_time = now;
+    if (full_peerlist)
+      context.full_peerlist_sent_time = now;
     m_payload_handler.get_payload_sync_data(rsp.payload_data);
     fill_maintainers_entry(rsp.maintrs_entry);
-    LOG_PRINT_L3("COMMAND_TIMED_SYNC");
+    LOG_PRINT_L3("COMMAND_TIMED_SYNC" << (full_peerlist ? " (full peerlist)" : "") << ", peers sent: " << rsp.local_peerlist.size());
     return 1;
   }
   //-----------------------------------------------------------------------------------
@@ -1435,6 +1607,7 @@ namespace nodetool
 
     //fill response
     m_peerlist.get_peerlist_head(rsp.local_peerlist);
+    context.peerlist_sent_time = context.full_peerlist_sent_time = time(NULL);
     get_local_node_data(rsp.node_data);
     m_payload_handler.get_payload_sync_data(rsp.payload_data);
     fill_maintainers_entry(rsp.maintrs_entry);
@@ -1496,6 +1669,9 @@ namespace nodetool
   void node_server<t_payload_net_handler>::on_connection_close(p2p_connection_context& context)
   {
     LOG_PRINT_L2("["<< net_utils::print_connection_context(context) << "] CLOSE CONNECTION");
+    m_closed_connections_recv_bytes += context.m_recv_cnt;
+    m_closed_connections_sent_bytes += context.m_send_cnt;
+    m_payload_handler.on_connection_close(context);
   }
   //-----------------------------------------------------------------------------------
 }
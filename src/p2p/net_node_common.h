@@ -22,8 +22,12 @@ namespace nodetool
     virtual bool relay_notify_to_all(int command, const std::string& data_buff, const epee::net_utils::connection_context_base& context, std::list<epee::net_utils::connection_context_base>& relayed_peers) = 0;
     virtual bool invoke_command_to_peer(int command, const std::string& req_buff, std::string& resp_buff, const epee::net_utils::connection_context_base& context)=0;
     virtual bool invoke_notify_to_peer(int command, const std::string& req_buff, const epee::net_utils::connection_context_base& context)=0;
+    virtual bool invoke_notify_to_peer(int command, const epee::net_utils::shared_buffer& req_buff, const epee::net_utils::connection_context_base& context)=0;
     virtual bool drop_connection(const epee::net_utils::connection_context_base& context)=0;
     virtual void request_callback(const epee::net_utils::connection_context_base& context)=0;
+    virtual void set_connection_compression(const epee::net_utils::connection_context_base& context, bool compress_outgoing)=0;
+    virtual void report_block_announcement(const epee::net_utils::connection_context_base& context, uint64_t delay_ms)=0;
+    virtual void report_sync_speed(const epee::net_utils::connection_context_base& context, uint64_t speed)=0;
     virtual uint64_t get_connections_count()=0;
     virtual void get_connections(std::list<t_connection_context>& connections) = 0;
     virtual void for_each_connection(std::function<bool(t_connection_context&, peerid_type)> f)=0;
@@ -47,6 +51,10 @@ namespace nodetool
     {
       return true;
     }
+    virtual bool invoke_notify_to_peer(int command, const epee::net_utils::shared_buffer& req_buff, const epee::net_utils::connection_context_base& context)
+    {
+      return true;
+    }
     virtual bool drop_connection(const epee::net_utils::connection_context_base& context)
     {
       return false;
@@ -54,6 +62,18 @@ namespace nodetool
     virtual void request_callback(const epee::net_utils::connection_context_base& context)
     {
 
+    }
+    virtual void set_connection_compression(const epee::net_utils::connection_context_base& context, bool compress_outgoing)
+    {
+
+    }
+    virtual void report_block_announcement(const epee::net_utils::connection_context_base& context, uint64_t delay_ms)
+    {
+
+    }
+    virtual void report_sync_speed(const epee::net_utils::connection_context_base& context, uint64_t speed)
+    {
+
     }
     virtual void for_each_connection(std::function<bool(t_connection_context&,peerid_type)> f)
     {
@@ -10,29 +10,86 @@
 #include <set>
 #include <map>
 #include <iterator>
+#include <vector>
 #include <boost/foreach.hpp>
+#include <boost/filesystem/fstream.hpp>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/serialization/version.hpp>
+#include <boost/serialization/map.hpp>
+#include <boost/serialization/vector.hpp>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/identity.hpp>
 #include <boost/multi_index/member.hpp>
 
 
 #include "syncobj.h"
+#include "string_coding.h"
 #include "net/local_ip.h"
 #include "p2p_protocol_defs.h"
 #include "currency_core/currency_config.h"
 #include "net_peerlist_boost_serialization.h"
 #include "common/boost_serialization_helper.h"
 
-#define CURRENT_PEERLIST_STORAGE_ARCHIVE_VER    (CURRENCY_FORMATION_VERSION + 7)
+#define CURRENT_PEERLIST_STORAGE_ARCHIVE_VER    (CURRENCY_FORMATION_VERSION + 9)
+#define PEERLIST_STORAGE_ARCHIVE_VER_INDEXED    (CURRENCY_FORMATION_VERSION + 8)
+#define PEERLIST_STORAGE_ARCHIVE_VER_NO_QUALITY (CURRENCY_FORMATION_VERSION + 7)
 
 namespace nodetool
 {
+  // what was measured about the peer on outgoing connections, values are smoothed over the measurements
+  struct peer_quality
+  {
+    uint64_t rtt_ms = 0;            // round trip of handshakes, timed syncs and pings, 0 while unknown
+    uint64_t block_delay_ms = 0;    // how late the peer announces blocks after the first announcement of them
+    uint64_t blocks_announced = 0;
+    uint64_t sync_speed = 0;        // bytes per ms, 0 while unknown
+    uint32_t fails = 0;             // connection fails in a row
+    uint64_t last_update = 0;
+
+    // expected delay of getting a block from the peer in ms, the lower the better
+    uint64_t get_penalty() const
+    {
+      uint64_t penalty = rtt_ms ? rtt_ms : P2P_PEER_QUALITY_UNKNOWN_PENALTY;
+      penalty += blocks_announced ? block_delay_ms : P2P_PEER_QUALITY_UNKNOWN_PENALTY;
+      penalty += sync_speed ? P2P_PEER_QUALITY_REFERENCE_TRANSFER_SIZE / sync_speed : P2P_PEER_QUALITY_UNKNOWN_PENALTY;
+      penalty += static_cast<uint64_t>(fails) * P2P_PEER_QUALITY_FAIL_PENALTY;
+      return penalty;
+    }
+
+    template <class Archive>
+    void serialize(Archive& a, const unsigned int /*ver*/)
+    {
+      a & rtt_ms;
+      a & block_delay_ms;
+      a & blocks_announced;
+      a & sync_speed;
+      a & fails;
+      a & last_update;
+    }
+  };
+
+#pragma pack(push, 1)
+  // a change of the lists made after the last full store of them
+  struct peerlist_journal_record
+  {
+    uint8_t op;
+    net_address adr;
+    peerid_type id;
+    int64_t last_seen;
+  };
+#pragma pack(pop)
 
+  struct net_address_hash
+  {
+    size_t operator()(const net_address& a) const
+    {
+      return std::hash<uint64_t>()((static_cast<uint64_t>(a.ip) << 32) | a.port);
+    }
+  };
 
   /************************************************************************/
   /*                                                                      */
@@ -45,7 +102,7 @@ namespace nodetool
     size_t get_white_peers_count(){CRITICAL_REGION_LOCAL(m_peerlist_lock); return m_peers_white.size();}
     size_t get_gray_peers_count(){CRITICAL_REGION_LOCAL(m_peerlist_lock); return m_peers_gray.size();}
     bool merge_peerlist(const std::list<peerlist_entry>& outer_bs);
-    bool get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth = P2P_DEFAULT_PEERS_IN_HANDSHAKE);
+    bool get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth = P2P_DEFAULT_PEERS_IN_HANDSHAKE, time_t seen_since = 0);
     bool get_peerlist_full(std::list<peerlist_entry>& pl_gray, std::list<peerlist_entry>& pl_white);
     bool get_white_peer_by_index(peerlist_entry& p, size_t i);
     bool get_gray_peer_by_index(peerlist_entry& p, size_t i);
@@ -57,9 +114,35 @@ namespace nodetool
     void trim_white_peerlist();
     void trim_gray_peerlist();
     bool remove_peers_by_ip_from_all(const uint32_t ip);
+    void on_peer_rtt(const net_address& addr, uint64_t rtt_ms);
+    void on_peer_block_announced(const net_address& addr, uint64_t delay_ms);
+    void on_peer_sync_speed(const net_address& addr, uint64_t speed);
+    void on_peer_connected(const net_address& addr);
+    void on_peer_connect_failed(const net_address& addr);
+    bool get_peer_quality(const net_address& addr, peer_quality& pq);
+    uint64_t get_peer_penalty(const net_address& addr);
+
+    // the changes of the lists made between full stores of the state are appended to the journal,
+    // the journal is applied on top of the stored state when it's loaded
+    bool open_journal(const std::string& path, bool apply_records);
+    bool flush_journal();
+    bool reset_journal(); // the state has just been stored in full
+    uint64_t get_journal_records_count();
 
     
   private:
+    enum journal_op
+    {
+      journal_op_white = 1,
+      journal_op_gray,
+      journal_op_erase
+    };
+
+    static uint64_t smooth(uint64_t prev_value, uint64_t value) { return (prev_value * 3 + value) / 4; }
+    void remove_unlisted_peers_quality();
+    void journal(uint8_t op, const net_address& adr, peerid_type id = 0, time_t last_seen = 0);
+    bool apply_journal_record(const peerlist_journal_record& r);
+
     struct by_time{};
     struct by_id{};
     struct by_addr{};
@@ -102,23 +185,61 @@ namespace nodetool
       peerlist_entry,
       boost::multi_index::indexed_by<
       // access by peerlist_entry::net_adress
-      boost::multi_index::ordered_unique<boost::multi_index::tag<by_addr>, boost::multi_index::member<peerlist_entry,net_address,&peerlist_entry::adr> >,
+      boost::multi_index::hashed_unique<boost::multi_index::tag<by_addr>, boost::multi_index::member<peerlist_entry,net_address,&peerlist_entry::adr>, net_address_hash>,
       // sort by peerlist_entry::last_seen<
       boost::multi_index::ordered_non_unique<boost::multi_index::tag<by_time>, boost::multi_index::member<peerlist_entry,time_t,&peerlist_entry::last_seen> >
       > 
     > peers_indexed;
 
+    // the lists were stored as these containers up to PEERLIST_STORAGE_ARCHIVE_VER_INDEXED
+    typedef boost::multi_index_container<
+      peerlist_entry,
+      boost::multi_index::indexed_by<
+      boost::multi_index::ordered_unique<boost::multi_index::tag<by_addr>, boost::multi_index::member<peerlist_entry,net_address,&peerlist_entry::adr> >,
+      boost::multi_index::ordered_non_unique<boost::multi_index::tag<by_time>, boost::multi_index::member<peerlist_entry,time_t,&peerlist_entry::last_seen> >
+      > 
+    > legacy_peers_indexed;
+
+    void erase_oldest(peers_indexed& peers);
+
   public:    
     
     template <class Archive, class t_version_type>
     void serialize(Archive &ar,  const t_version_type ver)
     {
-      if(ver < CURRENT_PEERLIST_STORAGE_ARCHIVE_VER)
+      if(ver < PEERLIST_STORAGE_ARCHIVE_VER_NO_QUALITY)
         throw std::runtime_error("not supported storage format");
       CHECK_PROJECT_NAME();
       CRITICAL_REGION_LOCAL(m_peerlist_lock);
-      ar & m_peers_white;
-      ar & m_peers_gray;
+      if (ver <= PEERLIST_STORAGE_ARCHIVE_VER_INDEXED)
+      {
+        legacy_peers_indexed white, gray;
+        ar & white;
+        ar & gray;
+        m_peers_white = peers_indexed(white.begin(), white.end());
+        m_peers_gray = peers_indexed(gray.begin(), gray.end());
+      }
+      else
+      {
+        // plain lists don't depend on the indexes' layout
+        std::vector<peerlist_entry> white, gray;
+        if (Archive::is_saving::value)
+        {
+          white.assign(m_peers_white.begin(), m_peers_white.end());
+          gray.assign(m_peers_gray.begin(), m_peers_gray.end());
+        }
+        ar & white;
+        ar & gray;
+        if (Archive::is_loading::value)
+        {
+          m_peers_white = peers_indexed(white.begin(), white.end());
+          m_peers_gray = peers_indexed(gray.begin(), gray.end());
+        }
+      }
+      if (ver > PEERLIST_STORAGE_ARCHIVE_VER_NO_QUALITY)
+        ar & m_peers_quality;
+      if (Archive::is_saving::value)
+        m_journal_pending.clear(); // these changes are in the stored state
     }
 
   private:
@@ -130,6 +251,12 @@ namespace nodetool
 
     peers_indexed m_peers_gray;
     peers_indexed m_peers_white;
+    std::map<net_address, peer_quality> m_peers_quality; // only for the peers in the lists
+
+    boost::filesystem::ofstream m_journal_file;
+    std::string m_journal_path;
+    std::string m_journal_pending;         // records not written to the journal yet
+    uint64_t m_journal_records_count = 0;  // in the journal file
   };
   //--------------------------------------------------------------------------------------------------
   inline
@@ -147,6 +274,8 @@ namespace nodetool
       if (v1.last_seen > now)
       {
         LOG_PRINT_L0("Local m_peers_white entries detected in future, cleaning peerlist.");
+        for (const auto& e : by_time_index)
+          journal(journal_op_erase, e.adr);
         by_time_index.clear();
         break;
       }
@@ -158,6 +287,8 @@ namespace nodetool
       if (v1.last_seen > now)
       {
         LOG_PRINT_L0("Local m_peers_gray entries detected in future, cleaning peerlist.");
+        for (const auto& e : by_time_index_g)
+          journal(journal_op_erase, e.adr);
         by_time_index_g.clear();
         break;
       }
@@ -173,36 +304,40 @@ namespace nodetool
     return true;
   }
   //--------------------------------------------------------------------------------------------------
+  inline void peerlist_manager::erase_oldest(peers_indexed& peers)
+  {
+    peers_indexed::index<by_time>::type& sorted_index = peers.get<by_time>();
+    auto it = sorted_index.begin();
+    journal(journal_op_erase, it->adr);
+    m_peers_quality.erase(it->adr);
+    sorted_index.erase(it);
+  }
+  //--------------------------------------------------------------------------------------------------
   inline void peerlist_manager::trim_white_peerlist()
   {
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
-    while(m_peers_gray.size() > P2P_LOCAL_GRAY_PEERLIST_LIMIT)
-    {
-      peers_indexed::index<by_time>::type& sorted_index=m_peers_gray.get<by_time>();
-      sorted_index.erase(sorted_index.begin());
-    }
+    while(m_peers_white.size() > P2P_LOCAL_WHITE_PEERLIST_LIMIT)
+      erase_oldest(m_peers_white);
   }
   //--------------------------------------------------------------------------------------------------
   inline void peerlist_manager::trim_gray_peerlist()
   {
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
-    while(m_peers_white.size() > P2P_LOCAL_WHITE_PEERLIST_LIMIT)
-    {
-      peers_indexed::index<by_time>::type& sorted_index=m_peers_white.get<by_time>();
-      sorted_index.erase(sorted_index.begin());
-    }
+    while(m_peers_gray.size() > P2P_LOCAL_GRAY_PEERLIST_LIMIT)
+      erase_oldest(m_peers_gray);
   }
   //--------------------------------------------------------------------------------------------------
   inline 
   bool peerlist_manager::merge_peerlist(const std::list<peerlist_entry>& outer_bs)
   {
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    size_t count = 0;
     BOOST_FOREACH(const peerlist_entry& be,  outer_bs)
     {
+      if (count++ >= P2P_MAX_PEERS_TO_MERGE)
+        break; // the rest is not worth the time, other peers will tell about them
       append_with_peer_gray(be);
     }
-    // delete extra elements
-    trim_gray_peerlist();    
     return true;
   }
   //--------------------------------------------------------------------------------------------------
@@ -244,7 +379,7 @@ namespace nodetool
   }
   //--------------------------------------------------------------------------------------------------
   inline 
-  bool peerlist_manager::get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth)
+  bool peerlist_manager::get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth, time_t seen_since)
   {
     
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
@@ -252,6 +387,8 @@ namespace nodetool
     uint32_t cnt = 0;
     BOOST_REVERSE_FOREACH(const peers_indexed::value_type& vl, by_time_index)
     {
+      if(vl.last_seen < seen_since)
+        break; // the rest were seen even earlier
       if(!vl.last_seen)
         continue;
       bs_head.push_back(vl);      
@@ -317,13 +454,15 @@ namespace nodetool
     {
       //put new record into white list
       m_peers_white.insert(ple);
+      journal(journal_op_white, ple.adr, ple.id, ple.last_seen);
       trim_white_peerlist();
     }else
     {
       //update record in white list 
       m_peers_white.replace(by_addr_it_wt, ple);      
+      journal(journal_op_white, ple.adr, ple.id, ple.last_seen);
     }
-    //remove from gray list, if need
+    //remove from gray list, if need (the journal record of white list removes it too)
     auto by_addr_it_gr = m_peers_gray.get<by_addr>().find(ple.adr);
     if(by_addr_it_gr != m_peers_gray.get<by_addr>().end())
     {
@@ -352,11 +491,15 @@ namespace nodetool
     {
       //put new record into white list
       m_peers_gray.insert(ple);
+      journal(journal_op_gray, ple.adr, ple.id, ple.last_seen);
       trim_gray_peerlist();    
     }else
     {
+      if (by_addr_it_gr->id == ple.id && by_addr_it_gr->last_seen >= ple.last_seen)
+        return true; // nothing new, the same peers are told about by everyone
       //update record in white list 
       m_peers_gray.replace(by_addr_it_gr, ple);      
+      journal(journal_op_gray, ple.adr, ple.id, ple.last_seen);
     }
     return true;
     CATCH_ENTRY_L0("peerlist_manager::append_with_peer_gray()", false);
@@ -373,7 +516,10 @@ namespace nodetool
     for (auto it = m_peers_white.begin(); it != m_peers_white.end();)
     {
       if (it->adr.ip == ip)
+      {
+        journal(journal_op_erase, it->adr);
         it = m_peers_white.erase(it);
+      }
       else
         ++it;
     }
@@ -381,15 +527,227 @@ namespace nodetool
     for (auto it = m_peers_gray.begin(); it != m_peers_gray.end();)
     {
       if (it->adr.ip == ip)
+      {
+        journal(journal_op_erase, it->adr);
         it = m_peers_gray.erase(it);
+      }
       else
         ++it;
     }
+    remove_unlisted_peers_quality();
 
     return true;
     CATCH_ENTRY_L0("peerlist_manager::remove_peers_by_ip_from_all()", false);
   }
   //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::remove_unlisted_peers_quality()
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    if (m_peers_quality.size() <= m_peers_white.size() + m_peers_gray.size())
+      return; // stays within the lists' limits, not worth a pass yet
+    for (auto it = m_peers_quality.begin(); it != m_peers_quality.end();)
+    {
+      if (m_peers_white.get<by_addr>().count(it->first) || m_peers_gray.get<by_addr>().count(it->first))
+        ++it;
+      else
+        it = m_peers_quality.erase(it);
+    }
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::on_peer_rtt(const net_address& addr, uint64_t rtt_ms)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peer_quality& pq = m_peers_quality[addr];
+    pq.rtt_ms = pq.rtt_ms ? smooth(pq.rtt_ms, rtt_ms) : std::max<uint64_t>(rtt_ms, 1);
+    pq.last_update = time(nullptr);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::on_peer_block_announced(const net_address& addr, uint64_t delay_ms)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peer_quality& pq = m_peers_quality[addr];
+    pq.block_delay_ms = pq.blocks_announced ? smooth(pq.block_delay_ms, delay_ms) : delay_ms;
+    ++pq.blocks_announced;
+    pq.last_update = time(nullptr);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::on_peer_sync_speed(const net_address& addr, uint64_t speed)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peer_quality& pq = m_peers_quality[addr];
+    pq.sync_speed = pq.sync_speed ? smooth(pq.sync_speed, speed) : std::max<uint64_t>(speed, 1);
+    pq.last_update = time(nullptr);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::on_peer_connected(const net_address& addr)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    auto it = m_peers_quality.find(addr);
+    if (it != m_peers_quality.end())
+      it->second.fails = 0;
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::on_peer_connect_failed(const net_address& addr)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peer_quality& pq = m_peers_quality[addr];
+    ++pq.fails;
+    pq.last_update = time(nullptr);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::get_peer_quality(const net_address& addr, peer_quality& pq)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    auto it = m_peers_quality.find(addr);
+    if (it == m_peers_quality.end())
+      return false;
+    pq = it->second;
+    return true;
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  uint64_t peerlist_manager::get_peer_penalty(const net_address& addr)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    auto it = m_peers_quality.find(addr);
+    return it == m_peers_quality.end() ? peer_quality().get_penalty() : it->second.get_penalty();
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::journal(uint8_t op, const net_address& adr, peerid_type id, time_t last_seen)
+  {
+    peerlist_journal_record r = AUTO_VAL_INIT(r);
+    r.op = op;
+    r.adr = adr;
+    r.id = id;
+    r.last_seen = last_seen;
+    m_journal_pending.append(reinterpret_cast<const char*>(&r), sizeof(r));
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::apply_journal_record(const peerlist_journal_record& r)
+  {
+    peerlist_entry ple = AUTO_VAL_INIT(ple);
+    ple.adr = r.adr;
+    ple.id = r.id;
+    ple.last_seen = static_cast<time_t>(r.last_seen);
+    auto it_wt = m_peers_white.get<by_addr>().find(r.adr);
+    auto it_gr = m_peers_gray.get<by_addr>().find(r.adr);
+    switch (r.op)
+    {
+    case journal_op_white:
+      if (it_gr != m_peers_gray.get<by_addr>().end())
+        m_peers_gray.erase(it_gr);
+      if (it_wt == m_peers_white.get<by_addr>().end())
+        m_peers_white.insert(ple);
+      else if (it_wt->last_seen <= ple.last_seen)
+        m_peers_white.replace(it_wt, ple);
+      return true;
+    case journal_op_gray:
+      if (it_wt != m_peers_white.get<by_addr>().end())
+        return true;
+      if (it_gr == m_peers_gray.get<by_addr>().end())
+        m_peers_gray.insert(ple);
+      else if (it_gr->last_seen <= ple.last_seen)
+        m_peers_gray.replace(it_gr, ple);
+      return true;
+    case journal_op_erase:
+      if (it_wt != m_peers_white.get<by_addr>().end())
+        m_peers_white.erase(it_wt);
+      if (it_gr != m_peers_gray.get<by_addr>().end())
+        m_peers_gray.erase(it_gr);
+      m_peers_quality.erase(r.adr);
+      return true;
+    }
+    LOG_ERROR("unknown peerlist journal record " << static_cast<int>(r.op));
+    return false;
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::open_journal(const std::string& path, bool apply_records)
+  {
+    TRY_ENTRY();
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    m_journal_path = path;
+    m_journal_records_count = 0;
+    if (m_journal_file.is_open())
+      m_journal_file.close();
+
+    std::ios_base::openmode mode = std::ios_base::binary | std::ios_base::out | std::ios_base::trunc;
+    boost::system::error_code ec;
+    if (apply_records && boost::filesystem::exists(epee::string_encoding::utf8_to_wstring(path), ec))
+    {
+      {
+        boost::filesystem::ifstream journal_file;
+        journal_file.open(epee::string_encoding::utf8_to_wstring(path), std::ios_base::binary | std::ios_base::in);
+        peerlist_journal_record r = AUTO_VAL_INIT(r);
+        while (journal_file.read(reinterpret_cast<char*>(&r), sizeof(r)) && apply_journal_record(r))
+          ++m_journal_records_count;
+      }
+      LOG_PRINT_L1("Peerlist journal applied: " << m_journal_records_count << " records");
+      trim_white_peerlist();
+      trim_gray_peerlist();
+      remove_unlisted_peers_quality();
+
+      // a record cut off by a crash is dropped, the next ones are appended after the good ones
+      uint64_t good_size = m_journal_records_count * sizeof(peerlist_journal_record);
+      if (boost::filesystem::file_size(epee::string_encoding::utf8_to_wstring(path), ec) != good_size)
+        boost::filesystem::resize_file(epee::string_encoding::utf8_to_wstring(path), good_size, ec);
+      if (!ec)
+        mode = std::ios_base::binary | std::ios_base::out | std::ios_base::app;
+    }
+    if (mode & std::ios_base::trunc)
+      m_journal_records_count = 0;
+
+    m_journal_file.open(epee::string_encoding::utf8_to_wstring(path), mode);
+    CHECK_AND_ASSERT_MES(!m_journal_file.fail(), false, "failed to open peerlist journal " << path);
+    return true;
+    CATCH_ENTRY_L0("peerlist_manager::open_journal()", false);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::flush_journal()
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    if (!m_journal_file.is_open() || m_journal_pending.empty())
+      return true;
+    m_journal_file.write(m_journal_pending.data(), m_journal_pending.size());
+    m_journal_file.flush();
+    CHECK_AND_ASSERT_MES(!m_journal_file.fail(), false, "failed to write peerlist journal " << m_journal_path);
+    m_journal_records_count += m_journal_pending.size() / sizeof(peerlist_journal_record);
+    m_journal_pending.clear();
+    return true;
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::reset_journal()
+  {
+    TRY_ENTRY();
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    if (!m_journal_file.is_open())
+      return true;
+    m_journal_file.close();
+    m_journal_file.open(epee::string_encoding::utf8_to_wstring(m_journal_path), std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+    CHECK_AND_ASSERT_MES(!m_journal_file.fail(), false, "failed to reset peerlist journal " << m_journal_path);
+    m_journal_records_count = 0;
+    return true;
+    CATCH_ENTRY_L0("peerlist_manager::reset_journal()", false);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  uint64_t peerlist_manager::get_journal_records_count()
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    return m_journal_records_count + m_journal_pending.size() / sizeof(peerlist_journal_record);
+  }
+  //--------------------------------------------------------------------------------------------------
 }
 
 BOOST_CLASS_VERSION(nodetool::peerlist_manager, CURRENT_PEERLIST_STORAGE_ARCHIVE_VER)
@@ -6,16 +6,11 @@
 
 #pragma once
 
-/*
-
-P2P_NETWORK_ID definition moved to net_node.inl
+#include <boost/uuid/uuid.hpp>
+#include "currency_core/currency_config.h"
 
 namespace nodetool
 {
-#ifndef TESTNET
-  const static boost::uuids::uuid P2P_NETWORK_ID = { { 0x11 ,0x10, 0x01, 0x11 , 0x01, 0x20 , 0x01, 0x01, 0x10, 0x11, 0x00, 0x10, 0x11, 0x11, 0x01, 0x10} }; //Bender's nightmare
-#else
-  const static boost::uuids::uuid P2P_NETWORK_ID = { { 0x11 ,0x10, 0x01, 0x11 , 0x01, 0x02 , 0x01, 0x01, 0x10, 0x11, 0x11, 0x10, 0x11, 0x11, 0x01, 0x10} }; //Another Bender's nightmare
-#endif
+  //zero network before launch
+  const static boost::uuids::uuid P2P_NETWORK_ID = { { 0x11, 0x10, 0x01, 0x11, 0x01, 0x01, 0x11, 0x01, 0x10, 0x11, P2P_NETWORK_ID_TESTNET_FLAG, 0x11, 0x01, 0x11, 0x21, P2P_NETWORK_ID_VER} };
 }
-*/
@@ -0,0 +1,53 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <iterator>
+#include <list>
+#include <string>
+#include "include_base_utils.h"
+#include "common/varint.h"
+#include "storages/portable_storage_template_helper.h"
+#include "currency_protocol/currency_protocol_defs.h"
+
+namespace currency
+{
+  // COMMAND_RPC_GET_BLOCKS_FEED frames: varint size, then block_complete_entry in portable storage binary format,
+  // so a reader may take the blocks one by one without parsing the whole response into a tree
+  inline void append_blocks_feed_frame(std::string& frames, const block_complete_entry& bce)
+  {
+    std::string frame;
+    epee::serialization::store_t_to_binary(bce, frame);
+    tools::write_varint(std::back_inserter(frames), frame.size());
+    frames += frame;
+  }
+
+  // reads the frame at pos and moves pos past it
+  inline bool read_blocks_feed_frame(const std::string& frames, size_t& pos, block_complete_entry& bce)
+  {
+    CHECK_AND_ASSERT_MES(pos < frames.size(), false, "blocks feed frame position " << pos << " is out of " << frames.size());
+    uint64_t frame_size = 0;
+    int read = tools::read_varint(frames.begin() + pos, frames.end(), frame_size);
+    CHECK_AND_ASSERT_MES(read > 0, false, "wrong blocks feed frame size at " << pos);
+    pos += read;
+    CHECK_AND_ASSERT_MES(frame_size <= frames.size() - pos, false, "blocks feed frame at " << pos << " of size " << frame_size << " is out of " << frames.size());
+    bce = block_complete_entry();
+    CHECK_AND_ASSERT_MES(epee::serialization::load_t_from_binary(bce, frames.substr(pos, frame_size)), false, "failed to parse blocks feed frame at " << pos);
+    pos += frame_size;
+    return true;
+  }
+
+  inline bool parse_blocks_feed_frames(const std::string& frames, std::list<block_complete_entry>& blocks)
+  {
+    size_t pos = 0;
+    while (pos != frames.size())
+    {
+      blocks.emplace_back();
+      if (!read_blocks_feed_frame(frames, pos, blocks.back()))
+        return false;
+    }
+    return true;
+  }
+}
@@ -8,6 +8,7 @@
 using namespace epee;
 
 #include "core_rpc_server.h"
+#include "metrics_text_writer.h"
 #include "common/command_line.h"
 #include "currency_core/currency_format_utils.h"
 #include "currency_core/account.h"
@@ -15,6 +16,7 @@ using namespace epee;
 #include "misc_language.h"
 #include "crypto/hash.h"
 #include "core_rpc_server_error_codes.h"
+#include "blocks_feed_utils.h"
 
 
 
@@ -25,6 +27,41 @@ namespace currency
     const command_line::arg_descriptor<std::string> arg_rpc_bind_ip    ("rpc-bind-ip", "", "127.0.0.1");
     const command_line::arg_descriptor<std::string> arg_rpc_bind_port  ("rpc-bind-port", "", std::to_string(RPC_DEFAULT_PORT));
     const command_line::arg_descriptor<bool> arg_rpc_ignore_status     ("rpc-ignore-offline", "Let rpc calls despite online/offline status");
+    const command_line::arg_descriptor<uint64_t> arg_rpc_idle_timeout  ("rpc-idle-timeout", "Close keep-alive rpc connections that send nothing for that many seconds, 0 means never", RPC_DEFAULT_IDLE_TIMEOUT);
+    const command_line::arg_descriptor<uint64_t> arg_rpc_batch_max_size("rpc-batch-max-size", "Max number of requests in a json rpc batch", RPC_DEFAULT_BATCH_MAX_SIZE);
+    const command_line::arg_descriptor<uint64_t> arg_rpc_response_cache_size("rpc-response-cache-size", "Size of the cache of block, tx and asset details responses in megabytes, 0 turns it off", RPC_DEFAULT_RESPONSE_CACHE_SIZE);
+    const command_line::arg_descriptor<uint64_t> arg_rpc_threads       ("rpc-threads", "Number of rpc server threads, all but one of them may be taken by long polling calls", RPC_DEFAULT_THREADS);
+    const command_line::arg_descriptor<uint64_t> arg_rpc_batch_threads ("rpc-batch-threads", "Max number of rpc threads helping with a batch of read-only json rpc requests, 0 means batches are handled sequentially", RPC_DEFAULT_BATCH_THREADS);
+    const command_line::arg_descriptor<uint64_t> arg_rpc_reserved_threads("rpc-reserved-threads", "Number of rpc threads reserved for tx and block submission and mining calls", 0);
+    const command_line::arg_descriptor<uint64_t> arg_rpc_heavy_calls_max("rpc-heavy-calls-max", "Max number of heavy rpc calls (blocks, decoys, explorer api and alike) running at once, 0 means no limit", 0);
+    const command_line::arg_descriptor<std::string> arg_rpc_method_limits("rpc-method-limits", "Max number of calls of the given methods running at once, as name:limit,name:limit (json rpc method names or uris like /getblocks.bin)", "");
+    const command_line::arg_descriptor<uint64_t> arg_rpc_max_queue_time("rpc-max-queue-time", "Milliseconds a call out of the limits above may wait before it's rejected as busy", RPC_DEFAULT_MAX_QUEUE_TIME);
+    const command_line::arg_descriptor<uint64_t> arg_rpc_ip_rate       ("rpc-ip-rate", "Max number of rpc requests per second from one ip, 0 means no limit", 0);
+    const command_line::arg_descriptor<uint64_t> arg_rpc_ip_burst      ("rpc-ip-burst", "Number of rpc requests one ip may make at once over rpc-ip-rate", 0);
+    const command_line::arg_descriptor<uint64_t> arg_rpc_compression_threshold("rpc-compression-threshold", "Responses at least that many bytes long are gzipped for the clients accepting it, 0 turns it off", RPC_DEFAULT_COMPRESSION_THRESHOLD);
+    const command_line::arg_descriptor<uint64_t> arg_rpc_compression_level("rpc-compression-level", "zlib compression level (1-9) of the responses", RPC_DEFAULT_COMPRESSION_LEVEL);
+    const command_line::arg_descriptor<std::string> arg_rpc_compression_levels("rpc-compression-levels", "Compression levels of the given methods' responses, as name:level,name:level (json rpc method names or uris, 0 - never packed)", "");
+
+    // getinfo values depending on the chain only, they are served from a snapshot made once per top block
+    const uint64_t INFO_CHAIN_STATS_FLAGS = COMMAND_RPC_GET_INFO_FLAG_POS_DIFFICULTY | COMMAND_RPC_GET_INFO_FLAG_CURRENT_NETWORK_HASHRATE_50 |
+      COMMAND_RPC_GET_INFO_FLAG_CURRENT_NETWORK_HASHRATE_350 | COMMAND_RPC_GET_INFO_FLAG_SECONDS_FOR_10_BLOCKS | COMMAND_RPC_GET_INFO_FLAG_SECONDS_FOR_30_BLOCKS |
+      COMMAND_RPC_GET_INFO_FLAG_TRANSACTIONS_DAILY_STAT | COMMAND_RPC_GET_INFO_FLAG_LAST_POS_TIMESTAMP | COMMAND_RPC_GET_INFO_FLAG_LAST_POW_TIMESTAMP |
+      COMMAND_RPC_GET_INFO_FLAG_TOTAL_COINS | COMMAND_RPC_GET_INFO_FLAG_LAST_BLOCK_SIZE | COMMAND_RPC_GET_INFO_FLAG_TX_COUNT_IN_LAST_BLOCK |
+      COMMAND_RPC_GET_INFO_FLAG_POS_SEQUENCE_FACTOR | COMMAND_RPC_GET_INFO_FLAG_POW_SEQUENCE_FACTOR | COMMAND_RPC_GET_INFO_FLAG_POS_BLOCK_TS_SHIFT_VS_ACTUAL |
+      COMMAND_RPC_GET_INFO_FLAG_OUTS_STAT;
+
+    // the biggest responses are made on every wallet sync, they are packed the fastest way
+    const char* const fast_compression_calls[] = { "/getblocks.bin", "/get_o_indexes.bin", "/getrandom_outs.bin", "/getrandom_outs1.bin", "/getrandom_outs3.bin" };
+
+    // json rpc methods that only read, batches made of them may be handled in parallel
+    const char* const read_only_json_rpc_methods[] = {
+      "getblockcount", "on_getblockhash", "getlastblockheader", "getblockheaderbyhash", "getblockheaderbyheight",
+      "get_alias_details", "get_alias_by_address", "get_alias_reward", "get_est_height_from_date",
+      "get_blocks_details", "get_tx_details", "search_by_id", "getinfo", "get_out_info", "get_multisig_info",
+      "get_all_alias_details", "get_aliases", "get_pool_txs_details", "get_pool_txs_brief_details", "get_all_pool_tx_list",
+      "get_pool_info", "get_votes", "get_asset_info", "get_assets_list",
+      "get_main_block_details", "get_alt_block_details", "get_alt_blocks_details", "get_current_core_tx_expiration_median"
+    };
   }
   //-----------------------------------------------------------------------------------
   void core_rpc_server::init_options(boost::program_options::options_description& desc)
@@ -32,6 +69,20 @@ namespace currency
     command_line::add_arg(desc, arg_rpc_bind_ip);
     command_line::add_arg(desc, arg_rpc_bind_port);
     command_line::add_arg(desc, arg_rpc_ignore_status);
+    command_line::add_arg(desc, arg_rpc_idle_timeout);
+    command_line::add_arg(desc, arg_rpc_batch_max_size);
+    command_line::add_arg(desc, arg_rpc_threads);
+    command_line::add_arg(desc, arg_rpc_batch_threads);
+    command_line::add_arg(desc, arg_rpc_reserved_threads);
+    command_line::add_arg(desc, arg_rpc_heavy_calls_max);
+    command_line::add_arg(desc, arg_rpc_method_limits);
+    command_line::add_arg(desc, arg_rpc_max_queue_time);
+    command_line::add_arg(desc, arg_rpc_ip_rate);
+    command_line::add_arg(desc, arg_rpc_ip_burst);
+    command_line::add_arg(desc, arg_rpc_response_cache_size);
+    command_line::add_arg(desc, arg_rpc_compression_threshold);
+    command_line::add_arg(desc, arg_rpc_compression_level);
+    command_line::add_arg(desc, arg_rpc_compression_levels);
   }
   //------------------------------------------------------------------------------------------------------------------------------
   core_rpc_server::core_rpc_server(core& cr, nodetool::node_server<currency::t_currency_protocol_handler<currency::core> >& p2p,
@@ -40,6 +91,14 @@ namespace currency
     , m_p2p(p2p)
     , m_of(of)
     , m_ignore_status(false)
+    , m_response_cache([&cr]() { return cr.get_blockchain_storage().get_top_block_id(); })
+    , m_all_aliases_cache([&cr]() { return cr.get_blockchain_storage().get_aliases_version(); })
+    , m_threads_count(RPC_DEFAULT_THREADS)
+    , m_waiting_calls(0)
+    , m_info_chain_stats(AUTO_VAL_INIT(m_info_chain_stats))
+    , m_info_chain_stats_top_id(null_hash)
+    , m_info_chain_stats_flags(0)
+    , m_info_chain_stats_requested_flags(0)
   {}
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::handle_command_line(const boost::program_options::variables_map& vm)
@@ -50,6 +109,40 @@ namespace currency
     {
       m_ignore_status = command_line::get_arg(vm, arg_rpc_ignore_status);
     }
+    set_idle_timeout(command_line::get_arg(vm, arg_rpc_idle_timeout) * 1000);
+    m_threads_count = std::max<uint64_t>(command_line::get_arg(vm, arg_rpc_threads), 1);
+    epee::json_rpc::batch_config& batch_cfg = get_json_rpc_batch_config();
+    batch_cfg.max_batch_size = command_line::get_arg(vm, arg_rpc_batch_max_size);
+    batch_cfg.max_parallel = command_line::get_arg(vm, arg_rpc_batch_threads);
+    batch_cfg.parallel_methods.insert(std::begin(read_only_json_rpc_methods), std::end(read_only_json_rpc_methods));
+    m_response_cache.set_max_bytes(command_line::get_arg(vm, arg_rpc_response_cache_size) * 1024 * 1024);
+
+    rpc_admission_control::config admission_cfg;
+    admission_cfg.threads_count = m_threads_count;
+    admission_cfg.reserved_threads = command_line::get_arg(vm, arg_rpc_reserved_threads);
+    admission_cfg.heavy_calls_max = command_line::get_arg(vm, arg_rpc_heavy_calls_max);
+    bool r = rpc_admission_control::parse_method_limits(command_line::get_arg(vm, arg_rpc_method_limits), admission_cfg.method_limits);
+    CHECK_AND_ASSERT_MES(r, false, "wrong --" << arg_rpc_method_limits.name << " value");
+    admission_cfg.max_queue_ms = command_line::get_arg(vm, arg_rpc_max_queue_time);
+    admission_cfg.ip_rate = command_line::get_arg(vm, arg_rpc_ip_rate);
+    admission_cfg.ip_burst = command_line::get_arg(vm, arg_rpc_ip_burst);
+    m_admission_control.set_config(admission_cfg);
+    set_call_admission(&m_admission_control);
+
+    uint64_t compression_level = command_line::get_arg(vm, arg_rpc_compression_level);
+    CHECK_AND_ASSERT_MES(compression_level >= 1 && compression_level <= 9, false, "wrong --" << arg_rpc_compression_level.name << " value");
+    std::map<std::string, size_t> levels;
+    r = rpc_admission_control::parse_method_limits(command_line::get_arg(vm, arg_rpc_compression_levels), levels); // same "name:number" format
+    CHECK_AND_ASSERT_MES(r, false, "wrong --" << arg_rpc_compression_levels.name << " value");
+    std::map<std::string, int> levels_per_call;
+    for (const char* call_name : fast_compression_calls)
+      levels_per_call[call_name] = 1;
+    for (const auto& l : levels)
+    {
+      CHECK_AND_ASSERT_MES(l.second <= 9, false, "wrong --" << arg_rpc_compression_levels.name << " value: " << l.first << ":" << l.second);
+      levels_per_call[l.first] = static_cast<int>(l.second);
+    }
+    set_response_compression(command_line::get_arg(vm, arg_rpc_compression_threshold), static_cast<int>(compression_level), levels_per_call);
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -58,7 +151,23 @@ namespace currency
     m_net_server.set_threads_prefix("RPC");
     bool r = handle_command_line(vm);
     CHECK_AND_ASSERT_MES(r, false, "Failed to process command line in core_rpc_server");
-    return epee::http_server_impl_base<core_rpc_server, connection_context>::init(m_port, m_bind_ip);
+    r = epee::http_server_impl_base<core_rpc_server, connection_context>::init(m_port, m_bind_ip);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to init core_rpc_server");
+    m_info_chain_stats_thread = std::thread([this]() { info_chain_stats_worker(); });
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::send_stop_signal()
+  {
+    epee::http_server_impl_base<core_rpc_server, connection_context>::send_stop_signal();
+    if (m_info_chain_stats_thread.joinable())
+      m_info_chain_stats_thread.join();
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  core_rpc_server::~core_rpc_server()
+  {
+    send_stop_signal();
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::check_core_ready_(const std::string& calling_method)
@@ -66,6 +175,8 @@ namespace currency
 #ifndef TESTNET
     if (m_ignore_status)
       return true;
+    if (m_core.get_blockchain_storage().is_secondary())
+      return true; // as synchronized as the primary is
     if(!m_p2p.get_payload_object().is_synchronized())
     {
       LOG_PRINT_L0("[" << calling_method << "]Core busy cz is_synchronized");
@@ -76,6 +187,9 @@ namespace currency
   }
 #define check_core_ready() check_core_ready_(LOCAL_FUNCTION_DEF__)
 #define CHECK_CORE_READY() if(!check_core_ready()){res.status =  API_RETURN_CODE_BUSY;return true;}
+  // secondary (read-only) instance has no p2p and can't add anything to the blockchain
+#define CHECK_CORE_NOT_SECONDARY() if(m_core.get_blockchain_storage().is_secondary()){res.status = API_RETURN_CODE_ACCESS_DENIED;return true;}
+#define CHECK_CORE_NOT_SECONDARY_JSON_RPC() if(m_core.get_blockchain_storage().is_secondary()){error_resp.code = CORE_RPC_ERROR_CODE_READ_ONLY_INSTANCE;error_resp.message = "Read-only secondary instance";return false;}
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_height(const COMMAND_RPC_GET_HEIGHT::request& req, COMMAND_RPC_GET_HEIGHT::response& res, connection_context& cntx)
   {
@@ -130,69 +244,8 @@ namespace currency
       if (!m_p2p.get_payload_object().get_last_time_sync_difference(last_median2local_time_diff, last_ntp2local_time_diff))
         res.net_time_delta_median = 1;
     }
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_CURRENT_NETWORK_HASHRATE_50)
-      res.current_network_hashrate_50 = m_core.get_blockchain_storage().get_current_hashrate(50);
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_CURRENT_NETWORK_HASHRATE_350)
-      res.current_network_hashrate_350 = m_core.get_blockchain_storage().get_current_hashrate(350);
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_SECONDS_FOR_10_BLOCKS)
-      res.seconds_for_10_blocks = m_core.get_blockchain_storage().get_seconds_between_last_n_block(10);
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_SECONDS_FOR_30_BLOCKS)
-      res.seconds_for_30_blocks = m_core.get_blockchain_storage().get_seconds_between_last_n_block(30);
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_TRANSACTIONS_DAILY_STAT)
-      m_core.get_blockchain_storage().get_transactions_daily_stat(res.transactions_cnt_per_day, res.transactions_volume_per_day);
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_LAST_POS_TIMESTAMP)
-    {
-      auto pos_bl_ptr = m_core.get_blockchain_storage().get_last_block_of_type(true);
-      if (pos_bl_ptr)
-        res.last_pos_timestamp = pos_bl_ptr->bl.timestamp;
-    }
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_LAST_POW_TIMESTAMP)
-    {
-      auto pow_bl_ptr = m_core.get_blockchain_storage().get_last_block_of_type(false);
-      if (pow_bl_ptr)
-        res.last_pow_timestamp = pow_bl_ptr->bl.timestamp;
-    }
-    boost::multiprecision::uint128_t total_coins = 0;
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_TOTAL_COINS)
-    {
-      total_coins = m_core.get_blockchain_storage().total_coins();
-      res.total_coins = boost::lexical_cast<std::string>(total_coins);
-    }
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_LAST_BLOCK_SIZE)
-    {
-      std::vector<size_t> sz;
-      m_core.get_blockchain_storage().get_last_n_blocks_sizes(sz, 1);
-      res.last_block_size = sz.size() ? sz.back() : 0;
-    }
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_TX_COUNT_IN_LAST_BLOCK)
-    {
-      currency::block b = AUTO_VAL_INIT(b);
-      m_core.get_blockchain_storage().get_top_block(b);
-      res.tx_count_in_last_block = b.tx_hashes.size();
-    }
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_POS_SEQUENCE_FACTOR)
-      res.pos_sequence_factor = m_core.get_blockchain_storage().get_current_sequence_factor(true);
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_POW_SEQUENCE_FACTOR)
-      res.pow_sequence_factor = m_core.get_blockchain_storage().get_current_sequence_factor(false);
-    if (req.flags&(COMMAND_RPC_GET_INFO_FLAG_POS_DIFFICULTY | COMMAND_RPC_GET_INFO_FLAG_TOTAL_COINS))
-    {
-      res.block_reward = currency::get_base_block_reward(res.height);
-      currency::block b = AUTO_VAL_INIT(b);
-      m_core.get_blockchain_storage().get_top_block(b);
-      res.last_block_total_reward = currency::get_reward_from_miner_tx(b.miner_tx);
-      res.pos_diff_total_coins_rate = (pos_diff / (total_coins - PREMINE_AMOUNT + 1)).convert_to<uint64_t>();
-      res.last_block_timestamp = b.timestamp;
-      res.last_block_hash = string_tools::pod_to_hex(get_block_hash(b));
-    }
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_POS_BLOCK_TS_SHIFT_VS_ACTUAL)
-    {
-      res.pos_block_ts_shift_vs_actual = 0;
-      auto last_pos_block_ptr = m_core.get_blockchain_storage().get_last_block_of_type(true);
-      if (last_pos_block_ptr)
-        res.pos_block_ts_shift_vs_actual = last_pos_block_ptr->bl.timestamp - get_block_datetime(last_pos_block_ptr->bl);
-    }
-    if (req.flags&COMMAND_RPC_GET_INFO_FLAG_OUTS_STAT)
-      m_core.get_blockchain_storage().get_outs_index_stat(res.outs_stat);
+    if (req.flags&INFO_CHAIN_STATS_FLAGS)
+      get_info_chain_stats(req.flags&INFO_CHAIN_STATS_FLAGS, res);
 
     if (req.flags&COMMAND_RPC_GET_INFO_FLAG_PERFORMANCE)
     {
@@ -208,6 +261,8 @@ namespace currency
       res.performance_data.raise_block_core_event = pd.raise_block_core_event.get_avg();
       res.performance_data.target_calculating_enum_blocks = pd.target_calculating_enum_blocks.get_avg();
       res.performance_data.target_calculating_calc = pd.target_calculating_calc.get_avg();
+      res.performance_data.txs_prevalidation_time = pd.txs_prevalidation_time.get_avg();
+      res.performance_data.batch_verify_range_proofs_time = pd.batch_verify_range_proofs_time.get_avg();
       //tx processing zone
       res.performance_data.tx_check_inputs_time = pd.tx_check_inputs_time.get_avg();
       res.performance_data.tx_add_one_tx_time = pd.tx_add_one_tx_time.get_avg();
@@ -253,11 +308,20 @@ namespace currency
       COPY_AVG_TO_POOL_PERF_DATA(begin_tx_time);
       COPY_AVG_TO_POOL_PERF_DATA(update_db_time);
       COPY_AVG_TO_POOL_PERF_DATA(db_commit_time);
+      res.tx_pool_performance_data.admission_queue_depth = m_core.get_tx_admission_queue_depth();
+      res.tx_pool_performance_data.admission_verification_time = m_core.get_tx_admission_verification_time();
 
     }
     if (req.flags&COMMAND_RPC_GET_INFO_FLAG_PERFORMANCE)
     {
       res.offers_count = m_of.get_offers_container().size();
+      get_connections_stat(res.rpc_stat.connections_count, res.rpc_stat.requests_count, res.rpc_stat.reused_connection_requests_count);
+      rpc_response_cache::stat cache_stat = AUTO_VAL_INIT(cache_stat);
+      m_response_cache.get_stat(cache_stat);
+      res.rpc_stat.response_cache_hits = cache_stat.hits;
+      res.rpc_stat.response_cache_misses = cache_stat.misses;
+      res.rpc_stat.response_cache_entries_count = cache_stat.entries_count;
+      res.rpc_stat.response_cache_size = cache_stat.bytes;
     }
     if (req.flags&COMMAND_RPC_GET_INFO_FLAG_EXPIRATIONS_MEDIAN)
     {
@@ -270,6 +334,287 @@ namespace currency
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_metrics(const epee::net_utils::http::http_request_info& query_info, std::string& body, connection_context& cntx)
+  {
+    metrics_text_writer w;
+    blockchain_storage& bcs = m_core.get_blockchain_storage();
+
+    // chain and pool
+    w.gauge("zano_blockchain_height", "Number of blocks in the main chain", static_cast<double>(m_core.get_current_blockchain_size()));
+    w.gauge("zano_blockchain_alt_blocks", "Number of alternative blocks kept", static_cast<double>(bcs.get_alternative_blocks_count()));
+    w.gauge("zano_tx_pool_transactions", "Number of transactions in the pool", static_cast<double>(m_core.get_pool_transactions_count()));
+    w.gauge("zano_tx_pool_admission_queue_depth", "Number of transactions waiting for the pool admission", static_cast<double>(m_core.get_tx_admission_queue_depth()));
+    w.gauge("zano_tx_pool_admission_verification_time_avg", "Average verification time of a transaction admitted to the pool, microseconds", static_cast<double>(m_core.get_tx_admission_verification_time()));
+
+    // timings collected by blockchain_storage and tx_memory_pool, these are averages of the latest measurements (as getinfo reports them), not histograms
+    const blockchain_storage::performnce_data& pd = bcs.get_performnce_data();
+#define BCS_PERF_DATA_GAUGE(field_name) w.gauge("zano_blockchain_" #field_name "_avg", "Average of the latest " #field_name " measurements", static_cast<double>(pd.field_name.get_avg()));
+    BCS_PERF_DATA_GAUGE(block_processing_time_0_ms);
+    BCS_PERF_DATA_GAUGE(block_processing_time_1);
+    BCS_PERF_DATA_GAUGE(target_calculating_time_2);
+    BCS_PERF_DATA_GAUGE(longhash_calculating_time_3);
+    BCS_PERF_DATA_GAUGE(all_txs_insert_time_5);
+    BCS_PERF_DATA_GAUGE(etc_stuff_6);
+    BCS_PERF_DATA_GAUGE(insert_time_4);
+    BCS_PERF_DATA_GAUGE(raise_block_core_event);
+    BCS_PERF_DATA_GAUGE(validate_miner_transaction_time);
+    BCS_PERF_DATA_GAUGE(collect_rangeproofs_data_from_tx_time);
+    BCS_PERF_DATA_GAUGE(verify_multiple_zc_outs_range_proofs_time);
+    BCS_PERF_DATA_GAUGE(txs_prevalidation_time);
+    BCS_PERF_DATA_GAUGE(batch_verify_range_proofs_time);
+    BCS_PERF_DATA_GAUGE(target_calculating_enum_blocks);
+    BCS_PERF_DATA_GAUGE(target_calculating_calc);
+    BCS_PERF_DATA_GAUGE(pos_validate_ki_search);
+    BCS_PERF_DATA_GAUGE(pos_validate_get_out_keys_for_inputs);
+    BCS_PERF_DATA_GAUGE(pos_validate_zvp);
+    BCS_PERF_DATA_GAUGE(tx_check_inputs_time);
+    BCS_PERF_DATA_GAUGE(tx_add_one_tx_time);
+    BCS_PERF_DATA_GAUGE(tx_process_extra);
+    BCS_PERF_DATA_GAUGE(tx_process_attachment);
+    BCS_PERF_DATA_GAUGE(tx_process_inputs);
+    BCS_PERF_DATA_GAUGE(tx_push_global_index);
+    BCS_PERF_DATA_GAUGE(tx_check_exist);
+    BCS_PERF_DATA_GAUGE(tx_append_time);
+    BCS_PERF_DATA_GAUGE(tx_append_rl_wait);
+    BCS_PERF_DATA_GAUGE(tx_append_is_expired);
+    BCS_PERF_DATA_GAUGE(tx_store_db);
+    BCS_PERF_DATA_GAUGE(tx_check_inputs_prefix_hash);
+    BCS_PERF_DATA_GAUGE(tx_check_inputs_attachment_check);
+    BCS_PERF_DATA_GAUGE(tx_check_inputs_loop);
+    BCS_PERF_DATA_GAUGE(tx_check_inputs_loop_kimage_check);
+    BCS_PERF_DATA_GAUGE(tx_check_inputs_loop_ch_in_val_sig);
+    BCS_PERF_DATA_GAUGE(tx_check_inputs_loop_scan_outputkeys_get_item_size);
+    BCS_PERF_DATA_GAUGE(tx_check_inputs_loop_scan_outputkeys_relative_to_absolute);
+    BCS_PERF_DATA_GAUGE(tx_check_inputs_loop_scan_outputkeys_loop);
+    BCS_PERF_DATA_GAUGE(tx_check_inputs_loop_scan_outputkeys_loop_get_subitem);
+    BCS_PERF_DATA_GAUGE(tx_check_inputs_loop_scan_outputkeys_loop_find_tx);
+    BCS_PERF_DATA_GAUGE(tx_check_inputs_loop_scan_outputkeys_loop_handle_output);
+    BCS_PERF_DATA_GAUGE(tx_mixin_count);
+#undef BCS_PERF_DATA_GAUGE
+    w.gauge("zano_db_map_size_bytes", "Size of the db memory map", static_cast<double>(pd.si.map_size));
+    w.gauge("zano_db_transactions", "Number of db transactions open", static_cast<double>(pd.si.tx_count));
+    w.gauge("zano_db_write_transactions", "Number of db write transactions open", static_cast<double>(pd.si.write_tx_count));
+
+    const tx_memory_pool::performnce_data& pool_pd = m_core.get_tx_pool().get_performnce_data();
+#define POOL_PERF_DATA_GAUGE(field_name) w.gauge("zano_tx_pool_" #field_name "_avg", "Average of the latest " #field_name " measurements", static_cast<double>(pool_pd.field_name.get_avg()));
+    POOL_PERF_DATA_GAUGE(tx_processing_time);
+    POOL_PERF_DATA_GAUGE(check_inputs_types_supported_time);
+    POOL_PERF_DATA_GAUGE(expiration_validate_time);
+    POOL_PERF_DATA_GAUGE(validate_amount_time);
+    POOL_PERF_DATA_GAUGE(validate_alias_time);
+    POOL_PERF_DATA_GAUGE(check_keyimages_ws_ms_time);
+    POOL_PERF_DATA_GAUGE(check_inputs_time);
+    POOL_PERF_DATA_GAUGE(begin_tx_time);
+    POOL_PERF_DATA_GAUGE(update_db_time);
+    POOL_PERF_DATA_GAUGE(db_commit_time);
+    POOL_PERF_DATA_GAUGE(check_post_hf4_balance);
+#undef POOL_PERF_DATA_GAUGE
+
+    // db items caches
+    std::list<blockchain_storage::db_container_cache_stat> db_cache_stats;
+    bcs.get_db_cache_stats(db_cache_stats);
+    for (const auto& st : db_cache_stats)
+      w.counter("zano_db_cache_hits_total", "Lookups of db items found in the cache", st.hits, "container=\"" + st.name + "\"");
+    for (const auto& st : db_cache_stats)
+      w.counter("zano_db_cache_misses_total", "Lookups of db items read from the db", st.misses, "container=\"" + st.name + "\"");
+    for (const auto& st : db_cache_stats)
+      w.gauge("zano_db_cache_hit_percent_avg", "Cache hit percent over the latest lookups", st.hit_percent_avg, "container=\"" + st.name + "\"");
+
+    // memory, estimated by the owners of the containers
+    std::list<tools::memory_usage_entry> memory_usage;
+    m_core.get_memory_usage(memory_usage);
+    for (const auto& mu : memory_usage)
+      w.gauge("zano_memory_bytes", "Estimated memory held by a cache, container or queue", static_cast<double>(mu.bytes), "subsystem=\"" + mu.name + "\"");
+    for (const auto& mu : memory_usage)
+      w.gauge("zano_memory_items", "Number of elements in a cache, container or queue", static_cast<double>(mu.items), "subsystem=\"" + mu.name + "\"");
+
+    // p2p
+    uint64_t total_conn = m_p2p.get_connections_count();
+    uint64_t outgoing_conn = m_p2p.get_outgoing_connections_count();
+    w.gauge("zano_p2p_connections", "Number of p2p connections", static_cast<double>(outgoing_conn), "direction=\"outgoing\"");
+    w.gauge("zano_p2p_connections", "Number of p2p connections", static_cast<double>(total_conn - std::min(total_conn, outgoing_conn)), "direction=\"incoming\"");
+    w.gauge("zano_p2p_synchronized_connections", "Number of p2p connections synchronized with", static_cast<double>(m_p2p.get_payload_object().get_synchronized_connections_count()));
+    uint64_t recv_bytes = 0, sent_bytes = 0;
+    m_p2p.get_traffic_stat(recv_bytes, sent_bytes);
+    w.counter("zano_p2p_received_bytes_total", "Bytes received by p2p connections", recv_bytes);
+    w.counter("zano_p2p_sent_bytes_total", "Bytes sent by p2p connections", sent_bytes);
+
+    // rpc
+    uint64_t rpc_connections_count = 0, rpc_requests_count = 0, rpc_reused_connection_requests_count = 0;
+    get_connections_stat(rpc_connections_count, rpc_requests_count, rpc_reused_connection_requests_count);
+    w.gauge("zano_rpc_connections", "Number of rpc connections", static_cast<double>(rpc_connections_count));
+    w.counter("zano_rpc_requests_total", "Rpc requests", rpc_requests_count);
+    w.counter("zano_rpc_reused_connection_requests_total", "Rpc requests made over kept-alive connections", rpc_reused_connection_requests_count);
+    rpc_admission_control::stat admission_stat = AUTO_VAL_INIT(admission_stat);
+    m_admission_control.get_stat(admission_stat);
+    w.counter("zano_rpc_calls_total", "Rpc calls by admission result", admission_stat.admitted, "result=\"admitted\"");
+    w.counter("zano_rpc_calls_total", "Rpc calls by admission result", admission_stat.rejected_busy, "result=\"busy\"");
+    w.counter("zano_rpc_calls_total", "Rpc calls by admission result", admission_stat.rejected_rate_limited, "result=\"rate_limited\"");
+    rpc_response_cache::stat cache_stat = AUTO_VAL_INIT(cache_stat);
+    m_response_cache.get_stat(cache_stat);
+    w.counter("zano_rpc_response_cache_hits_total", "Rpc responses served from the cache", cache_stat.hits);
+    w.counter("zano_rpc_response_cache_misses_total", "Rpc responses not found in the cache", cache_stat.misses);
+    w.gauge("zano_rpc_response_cache_bytes", "Size of the rpc responses cache", static_cast<double>(cache_stat.bytes));
+    std::map<std::string, rpc_admission_control::call_latency_stat> calls_latency;
+    m_admission_control.get_calls_latency(calls_latency);
+    for (const auto& cl : calls_latency)
+    {
+      w.histogram("zano_rpc_call_duration_seconds", "Time of admitted rpc calls by method (json rpc method or uri)", rpc_admission_control::get_latency_buckets_us(), cl.second.buckets,
+        cl.second.count, cl.second.sum_us / 1e6, "method=\"" + metrics_text_writer::escape_label_value(cl.first) + "\"", 1e-6);
+    }
+
+    // lock sites, only while the contention profiler is (or was) on
+    std::vector<epee::lock_site_stat> lock_stats;
+    epee::lock_contention_profiler::get_stats(lock_stats);
+    for (const auto& ls : lock_stats)
+    {
+      std::string labels = "lock=\"" + metrics_text_writer::escape_label_value(ls.lock_name) + "\",site=\"" + metrics_text_writer::escape_label_value(ls.location) + "\"";
+      w.histogram("zano_lock_wait_seconds", "Time waited for a lock by lock site", epee::lock_contention_profiler::get_buckets_us(), ls.wait_buckets, ls.count, ls.wait_sum_us / 1e6, labels, 1e-6);
+    }
+    for (const auto& ls : lock_stats)
+    {
+      std::string labels = "lock=\"" + metrics_text_writer::escape_label_value(ls.lock_name) + "\",site=\"" + metrics_text_writer::escape_label_value(ls.location) + "\"";
+      w.histogram("zano_lock_hold_seconds", "Time a lock was held by lock site", epee::lock_contention_profiler::get_buckets_us(), ls.hold_buckets, ls.count, ls.hold_sum_us / 1e6, labels, 1e-6);
+    }
+
+    body = w.str();
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::fill_info_chain_stats(uint64_t flags, COMMAND_RPC_GET_INFO::response& res)
+  {
+    blockchain_storage& bcs = m_core.get_blockchain_storage();
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_CURRENT_NETWORK_HASHRATE_50)
+      res.current_network_hashrate_50 = bcs.get_current_hashrate(50);
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_CURRENT_NETWORK_HASHRATE_350)
+      res.current_network_hashrate_350 = bcs.get_current_hashrate(350);
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_SECONDS_FOR_10_BLOCKS)
+      res.seconds_for_10_blocks = bcs.get_seconds_between_last_n_block(10);
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_SECONDS_FOR_30_BLOCKS)
+      res.seconds_for_30_blocks = bcs.get_seconds_between_last_n_block(30);
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_TRANSACTIONS_DAILY_STAT)
+      bcs.get_transactions_daily_stat(res.transactions_cnt_per_day, res.transactions_volume_per_day);
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_LAST_POS_TIMESTAMP)
+    {
+      auto pos_bl_ptr = bcs.get_last_block_of_type(true);
+      if (pos_bl_ptr)
+        res.last_pos_timestamp = pos_bl_ptr->bl.timestamp;
+    }
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_LAST_POW_TIMESTAMP)
+    {
+      auto pow_bl_ptr = bcs.get_last_block_of_type(false);
+      if (pow_bl_ptr)
+        res.last_pow_timestamp = pow_bl_ptr->bl.timestamp;
+    }
+    boost::multiprecision::uint128_t total_coins = 0;
+    if (flags&(COMMAND_RPC_GET_INFO_FLAG_POS_DIFFICULTY | COMMAND_RPC_GET_INFO_FLAG_TOTAL_COINS))
+      total_coins = bcs.total_coins();
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_TOTAL_COINS)
+      res.total_coins = boost::lexical_cast<std::string>(total_coins);
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_LAST_BLOCK_SIZE)
+    {
+      std::vector<size_t> sz;
+      bcs.get_last_n_blocks_sizes(sz, 1);
+      res.last_block_size = sz.size() ? sz.back() : 0;
+    }
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_TX_COUNT_IN_LAST_BLOCK)
+    {
+      currency::block b = AUTO_VAL_INIT(b);
+      bcs.get_top_block(b);
+      res.tx_count_in_last_block = b.tx_hashes.size();
+    }
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_POS_SEQUENCE_FACTOR)
+      res.pos_sequence_factor = bcs.get_current_sequence_factor(true);
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_POW_SEQUENCE_FACTOR)
+      res.pow_sequence_factor = bcs.get_current_sequence_factor(false);
+    if (flags&(COMMAND_RPC_GET_INFO_FLAG_POS_DIFFICULTY | COMMAND_RPC_GET_INFO_FLAG_TOTAL_COINS))
+    {
+      res.block_reward = currency::get_base_block_reward(bcs.get_current_blockchain_size());
+      currency::block b = AUTO_VAL_INIT(b);
+      bcs.get_top_block(b);
+      res.last_block_total_reward = currency::get_reward_from_miner_tx(b.miner_tx);
+      res.pos_diff_total_coins_rate = (bcs.get_cached_next_difficulty(true) / (total_coins - PREMINE_AMOUNT + 1)).convert_to<uint64_t>();
+      res.last_block_timestamp = b.timestamp;
+      res.last_block_hash = string_tools::pod_to_hex(get_block_hash(b));
+    }
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_POS_BLOCK_TS_SHIFT_VS_ACTUAL)
+    {
+      res.pos_block_ts_shift_vs_actual = 0;
+      auto last_pos_block_ptr = bcs.get_last_block_of_type(true);
+      if (last_pos_block_ptr)
+        res.pos_block_ts_shift_vs_actual = last_pos_block_ptr->bl.timestamp - get_block_datetime(last_pos_block_ptr->bl);
+    }
+    if (flags&COMMAND_RPC_GET_INFO_FLAG_OUTS_STAT)
+      bcs.get_outs_index_stat(res.outs_stat);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::copy_info_chain_stats(uint64_t flags, const COMMAND_RPC_GET_INFO::response& from, COMMAND_RPC_GET_INFO::response& to)
+  {
+#define COPY_INFO_CHAIN_STAT_FIELD(flag, field_name)   if (flags&flag) to.field_name = from.field_name;
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_CURRENT_NETWORK_HASHRATE_50, current_network_hashrate_50);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_CURRENT_NETWORK_HASHRATE_350, current_network_hashrate_350);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_SECONDS_FOR_10_BLOCKS, seconds_for_10_blocks);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_SECONDS_FOR_30_BLOCKS, seconds_for_30_blocks);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_TRANSACTIONS_DAILY_STAT, transactions_cnt_per_day);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_TRANSACTIONS_DAILY_STAT, transactions_volume_per_day);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_LAST_POS_TIMESTAMP, last_pos_timestamp);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_LAST_POW_TIMESTAMP, last_pow_timestamp);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_TOTAL_COINS, total_coins);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_LAST_BLOCK_SIZE, last_block_size);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_TX_COUNT_IN_LAST_BLOCK, tx_count_in_last_block);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_POS_SEQUENCE_FACTOR, pos_sequence_factor);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_POW_SEQUENCE_FACTOR, pow_sequence_factor);
+    const uint64_t reward_flags = COMMAND_RPC_GET_INFO_FLAG_POS_DIFFICULTY | COMMAND_RPC_GET_INFO_FLAG_TOTAL_COINS;
+    COPY_INFO_CHAIN_STAT_FIELD(reward_flags, block_reward);
+    COPY_INFO_CHAIN_STAT_FIELD(reward_flags, last_block_total_reward);
+    COPY_INFO_CHAIN_STAT_FIELD(reward_flags, pos_diff_total_coins_rate);
+    COPY_INFO_CHAIN_STAT_FIELD(reward_flags, last_block_timestamp);
+    COPY_INFO_CHAIN_STAT_FIELD(reward_flags, last_block_hash);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_POS_BLOCK_TS_SHIFT_VS_ACTUAL, pos_block_ts_shift_vs_actual);
+    COPY_INFO_CHAIN_STAT_FIELD(COMMAND_RPC_GET_INFO_FLAG_OUTS_STAT, outs_stat);
+#undef COPY_INFO_CHAIN_STAT_FIELD
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::update_info_chain_stats(uint64_t flags)
+  {
+    CRITICAL_REGION_LOCAL(m_info_chain_stats_lock);
+    // the top is taken before the stats, so a block added meanwhile makes the snapshot stale rather than labeled with a wrong block
+    crypto::hash top_id = m_core.get_blockchain_storage().get_top_block_id();
+    if (top_id != m_info_chain_stats_top_id)
+    {
+      m_info_chain_stats = AUTO_VAL_INIT(m_info_chain_stats);
+      m_info_chain_stats_flags = 0;
+      m_info_chain_stats_top_id = top_id;
+    }
+    uint64_t missing_flags = flags & ~m_info_chain_stats_flags;
+    if (!missing_flags)
+      return;
+    fill_info_chain_stats(missing_flags, m_info_chain_stats);
+    m_info_chain_stats_flags |= missing_flags;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::get_info_chain_stats(uint64_t flags, COMMAND_RPC_GET_INFO::response& res)
+  {
+    m_info_chain_stats_requested_flags |= flags;
+    CRITICAL_REGION_LOCAL(m_info_chain_stats_lock);
+    update_info_chain_stats(flags);
+    copy_info_chain_stats(flags, m_info_chain_stats, res);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::info_chain_stats_worker()
+  {
+    // the stats once asked for are made for each new top block before they are asked for again
+    chain_change_notifier& notifier = m_core.get_blockchain_storage().get_change_notifier();
+    while (!m_net_server.is_stop_signal_sent())
+    {
+      uint64_t counter = notifier.get_counter();
+      uint64_t flags = m_info_chain_stats_requested_flags;
+      if (flags && m_p2p.get_payload_object().is_synchronized()) // not while syncing, when blocks go one after another
+        update_info_chain_stats(flags);
+      notifier.wait(counter, 1000);
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_blocks_direct(const COMMAND_RPC_GET_BLOCKS_DIRECT::request& req, COMMAND_RPC_GET_BLOCKS_DIRECT::response& res, connection_context& cntx)
   {
     CHECK_CORE_READY();
@@ -288,19 +633,24 @@ namespace currency
       return true;
     }
 
+    // the objects are handed over as they are kept by the core, along with the ids from its index, so an in-process wallet
+    // neither parses nor hashes anything (prune_txs and key_images_filters only matter for blobs sent over the network)
     blockchain_storage::blocks_direct_container bs;
-    if(!m_core.get_blockchain_storage().find_blockchain_supplement(req.block_ids, bs, res.current_height, res.start_height, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT, req.minimum_height))
+    std::vector<crypto::hash> block_ids;
+    if(!m_core.get_blockchain_storage().find_blockchain_supplement(req.block_ids, bs, res.current_height, res.start_height, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT, req.minimum_height, &block_ids))
     {
       res.status = API_RETURN_CODE_FAIL;
       return false;
     }
 
+    auto it_id = block_ids.begin();
     for(auto& b: bs)
     {
       res.blocks.resize(res.blocks.size()+1);
       res.blocks.back().block_ptr = b.first;
       res.blocks.back().txs_ptr = std::move(b.second);
       res.blocks.back().coinbase_ptr = b.third;
+      res.blocks.back().block_id = *it_id++;
     }
 
     res.status = API_RETURN_CODE_OK;
@@ -337,16 +687,220 @@ namespace currency
       res.blocks.resize(res.blocks.size()+1);
       res.blocks.back().block = block_to_blob(b.first->bl);
       CHECK_AND_ASSERT_MES(b.third.get(), false, "Internal error on handling COMMAND_RPC_GET_BLOCKS_FAST: b.third is empty, ie coinbase info is not prepared");
-      res.blocks.back().coinbase_global_outs = b.third->m_global_output_indexes;
-      res.blocks.back().tx_global_outs.resize(b.second.size());
+      if (req.compact_global_outs)
+      {
+        std::vector<uint64_t>& global_outs = res.blocks.back().global_outs;
+        size_t outs_count = b.third->m_global_output_indexes.size();
+        for (const auto& t : b.second)
+          outs_count += t->m_global_output_indexes.size();
+        global_outs.reserve(outs_count);
+        global_outs.insert(global_outs.end(), b.third->m_global_output_indexes.begin(), b.third->m_global_output_indexes.end());
+        for (const auto& t : b.second)
+          global_outs.insert(global_outs.end(), t->m_global_output_indexes.begin(), t->m_global_output_indexes.end());
+      }
+      else
+      {
+        res.blocks.back().coinbase_global_outs = b.third->m_global_output_indexes;
+        res.blocks.back().tx_global_outs.resize(b.second.size());
+      }
       size_t i = 0;
+      std::vector<crypto::key_image> block_key_images;
+
+      // a recently relayed block has its txs serialized already, the same block blob guarantees they are of this block
+      std::shared_ptr<const block_complete_entry> cached_blobs;
+      if (!req.prune_txs)
+      {
+        cached_blobs = m_core.get_blockchain_storage().get_cached_block_blobs(m_core.get_blockchain_storage().get_block_id_by_height(b.first->height));
+        if (cached_blobs && (cached_blobs->block != res.blocks.back().block || cached_blobs->txs.size() != b.second.size()))
+          cached_blobs.reset();
+      }
+      auto cached_tx_it = cached_blobs ? cached_blobs->txs.begin() : decltype(cached_blobs->txs.begin())();
       
       BOOST_FOREACH(auto& t, b.second)
       {
-        res.blocks.back().txs.push_back(tx_to_blob(t->tx));
-        res.blocks.back().tx_global_outs[i].v = t->m_global_output_indexes;
+        if (req.prune_txs)
+        {
+          // signatures and proofs are the most of a tx size, and they are not needed to find out whether the tx concerns a wallet
+          transaction pruned_tx = t->tx;
+          pruned_tx.signatures.clear();
+          pruned_tx.proofs.clear();
+          if (req.key_images_filters)
+          {
+            // a wallet only needs to know whether any of its key images is spent in the block, so such inputs are replaced by the block's filter
+            // (other inputs are kept, they are matched by other means)
+            std::vector<txin_v> kept_inputs;
+            for (const auto& in : pruned_tx.vin)
+            {
+              if (in.type() == typeid(txin_to_key) || in.type() == typeid(txin_zc_input))
+                block_key_images.push_back(get_key_image_from_txin_v(in));
+              else
+                kept_inputs.push_back(in);
+            }
+            pruned_tx.vin.swap(kept_inputs);
+          }
+          res.blocks.back().txs.push_back(tx_to_blob(pruned_tx));
+        }
+        else if (cached_blobs)
+        {
+          res.blocks.back().txs.push_back(*cached_tx_it++);
+        }
+        else
+        {
+          res.blocks.back().txs.push_back(tx_to_blob(t->tx));
+        }
+        if (!req.compact_global_outs)
+          res.blocks.back().tx_global_outs[i].v = t->m_global_output_indexes;
         i++;
       }
+      if (req.prune_txs && req.key_images_filters)
+        res.key_images_filters.push_back(blocks_key_images_filter::build(block_key_images));
+    }
+
+    res.txs_pruned = req.prune_txs;
+    res.status = API_RETURN_CODE_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  template<class t_is_changed>
+  void core_rpc_server::wait_for_chain_change(uint64_t wait_ms, t_is_changed is_changed)
+  {
+    // a waiting call takes a server thread, so one of them is always left for the other calls
+    if (!wait_ms || is_changed())
+      return;
+    if (++m_waiting_calls >= m_threads_count)
+    {
+      --m_waiting_calls;
+      return;
+    }
+    auto waiting_guard = epee::misc_utils::create_scope_leave_handler([&]() { --m_waiting_calls; });
+
+    chain_change_notifier& notifier = m_core.get_blockchain_storage().get_change_notifier();
+    const uint64_t deadline = epee::misc_utils::get_tick_count() + wait_ms;
+    while (!m_net_server.is_stop_signal_sent())
+    {
+      uint64_t counter = notifier.get_counter();
+      if (is_changed())
+        return;
+      uint64_t now = epee::misc_utils::get_tick_count();
+      if (now >= deadline)
+        return;
+      notifier.wait(counter, std::min<uint64_t>(deadline - now, 1000)); // wakes up now and then to see the stop signal
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_blocks_feed(const COMMAND_RPC_GET_BLOCKS_FEED::request& req, COMMAND_RPC_GET_BLOCKS_FEED::response& res, connection_context& cntx)
+  {
+    CHECK_CORE_READY();
+    blockchain_storage& bcs = m_core.get_blockchain_storage();
+    const crypto::hash genesis_id = bcs.get_block_id_by_height(0);
+
+    res.reorganized = false;
+    res.blocks_count = 0;
+    uint64_t height = req.start_height;
+    if (req.block_ids.size())
+    {
+      if (req.block_ids.back() != genesis_id)
+      {
+        res.status = API_RETURN_CODE_GENESIS_MISMATCH;
+        return true;
+      }
+      uint64_t common_height = 0;
+      if (!bcs.find_blockchain_supplement(req.block_ids, common_height))
+      {
+        res.status = API_RETURN_CODE_FAIL;
+        return true;
+      }
+      res.reorganized = bcs.get_block_id_by_height(common_height) != req.block_ids.front();
+      height = common_height + 1;
+    }
+
+    // a client at the top waits here for the next block
+    wait_for_chain_change(std::min<uint64_t>(req.wait_ms, RPC_BLOCKS_FEED_MAX_WAIT), [&]() { return height < bcs.get_current_blockchain_size(); });
+
+    res.start_height = height;
+    res.current_height = bcs.get_current_blockchain_size();
+    if (height > res.current_height)
+    {
+      res.status = API_RETURN_CODE_BAD_ARG;
+      return true;
+    }
+
+    const uint64_t max_bytes = req.max_bytes ? std::min<uint64_t>(req.max_bytes, RPC_BLOCKS_FEED_MAX_BYTES) : RPC_BLOCKS_FEED_DEFAULT_MAX_BYTES;
+    const std::list<crypto::hash> genesis_ids(1, genesis_id);
+    crypto::hash prev_id = height ? bcs.get_block_id_by_height(height - 1) : null_hash;
+    while (res.blocks_frames.size() < max_bytes)
+    {
+      // chunks are taken under separate locks, a reorganization in between is caught by the prev_id link
+      blockchain_storage::blocks_direct_container bs;
+      uint64_t total_height = 0, chunk_start_height = 0;
+      if (height >= bcs.get_current_blockchain_size() || !bcs.find_blockchain_supplement(genesis_ids, bs, total_height, chunk_start_height, RPC_BLOCKS_FEED_CHUNK_COUNT, height))
+        break;
+
+      bool stop = bs.empty();
+      for (auto& b : bs)
+      {
+        if (b.first->bl.prev_id != prev_id || res.blocks_frames.size() >= max_bytes)
+        {
+          stop = true;
+          break;
+        }
+        block_complete_entry bce = AUTO_VAL_INIT(bce);
+        bce.block = block_to_blob(b.first->bl);
+        CHECK_AND_ASSERT_MES(b.third.get(), false, "Internal error on handling COMMAND_RPC_GET_BLOCKS_FEED: b.third is empty, ie coinbase info is not prepared");
+        bce.coinbase_global_outs = b.third->m_global_output_indexes;
+        for (auto& t : b.second)
+        {
+          bce.txs.push_back(tx_to_blob(t->tx));
+          bce.tx_global_outs.emplace_back();
+          bce.tx_global_outs.back().v = t->m_global_output_indexes;
+        }
+        append_blocks_feed_frame(res.blocks_frames, bce);
+        ++res.blocks_count;
+        prev_id = get_block_hash(b.first->bl);
+        ++height;
+      }
+      if (stop)
+        break;
+    }
+
+    res.current_height = bcs.get_current_blockchain_size();
+    res.status = API_RETURN_CODE_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_wait_for_changes(const COMMAND_RPC_WAIT_FOR_CHANGES::request& req, COMMAND_RPC_WAIT_FOR_CHANGES::response& res, connection_context& cntx)
+  {
+    CHECK_CORE_READY();
+    blockchain_storage& bcs = m_core.get_blockchain_storage();
+    tx_memory_pool& pool = m_core.get_tx_pool();
+    const bool watch_pool = req.pool_instance_id != 0;
+
+    wait_for_chain_change(std::min<uint64_t>(req.wait_ms, RPC_WAIT_FOR_CHANGES_MAX_WAIT), [&]() {
+      return bcs.get_top_block_id() != req.top_block_id || (watch_pool && (pool.get_pool_instance_id() != req.pool_instance_id || pool.get_pool_version() != req.pool_version));
+    });
+
+    res.top_block_id = bcs.get_top_block_id(res.height);
+    ++res.height;
+    res.reorganized = false;
+    if (req.top_block_id != null_hash && res.top_block_id != req.top_block_id)
+    {
+      // an unknown block gives the genesis one
+      uint64_t known_height = 0;
+      std::list<crypto::hash> ids({ req.top_block_id, bcs.get_block_id_by_height(0) });
+      res.reorganized = !bcs.find_blockchain_supplement(ids, known_height) || bcs.get_block_id_by_height(known_height) != req.top_block_id;
+    }
+
+    res.pool_instance_id = pool.get_pool_instance_id();
+    res.pool_version = pool.get_pool_version();
+    res.pool_changes_known = false;
+    if (watch_pool)
+    {
+      std::list<crypto::hash> added_ids, removed_ids;
+      res.pool_changes_known = pool.get_transactions_changes_ids(req.pool_instance_id, req.pool_version, added_ids, removed_ids, res.pool_version);
+      for (const auto& id : added_ids)
+        res.pool_added_tx_ids.push_back(epee::string_tools::pod_to_hex(id));
+      for (const auto& id : removed_ids)
+        res.pool_removed_tx_ids.push_back(epee::string_tools::pod_to_hex(id));
     }
 
     res.status = API_RETURN_CODE_OK;
@@ -434,18 +988,16 @@ namespace currency
   bool core_rpc_server::on_get_indexes(const COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::request& req, COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::response& res, connection_context& cntx)
   {
     CHECK_CORE_READY();
-    res.tx_global_outs.resize(req.txids.size());
-    size_t i = 0;
-    for (auto& txid : req.txids)
+    std::vector<crypto::hash> txids(req.txids.begin(), req.txids.end());
+    std::vector<std::vector<uint64_t> > indexes;
+    if (!m_core.get_tx_outputs_gindexs(txids, indexes))
     {
-      bool r = m_core.get_tx_outputs_gindexs(txid, res.tx_global_outs[i].v);
-      if (!r)
-      {
-        res.status = API_RETURN_CODE_FAIL;
-        return true;
-      }
-      i++;
+      res.status = API_RETURN_CODE_FAIL;
+      return true;
     }
+    res.tx_global_outs.resize(indexes.size());
+    for (size_t i = 0; i != indexes.size(); ++i)
+      res.tx_global_outs[i].v.swap(indexes[i]);
     res.status = API_RETURN_CODE_OK;
     return true;
   }
@@ -465,20 +1017,23 @@ namespace currency
   bool core_rpc_server::on_get_tx_pool(const COMMAND_RPC_GET_TX_POOL::request& req, COMMAND_RPC_GET_TX_POOL::response& res, connection_context& cntx)
   {
     CHECK_CORE_READY();
-    std::list<transaction> txs;
-    if (!m_core.get_pool_transactions(txs))
-    {
-      res.status = "Failed to call get_pool_transactions()";
-      return true;
+    res.pool_instance_id = m_core.get_tx_pool().get_pool_instance_id();
+    res.is_delta = req.pool_instance_id != 0 &&
+      m_core.get_tx_pool().get_transactions_changes(req.pool_instance_id, req.since_version, res.txs, res.removed_tx_ids, res.pool_version);
+    if (!res.is_delta)
+    {
+      res.txs.clear();
+      res.removed_tx_ids.clear();
+      // blobs are serialized once per pool change, in the pool snapshot
+      if (!m_core.get_pool_transactions_blobs(res.txs, res.pool_version))
+      {
+        res.status = "Failed to call get_pool_transactions_blobs()";
+        return true;
+      }
     }
 
     res.tx_expiration_ts_median = m_core.get_blockchain_storage().get_tx_expiration_median();
 
-
-    for(auto& tx: txs)
-    {
-      res.txs.push_back(t_serializable_object_to_blob(tx));
-    }
     res.status = API_RETURN_CODE_OK;
     return true;
   }
@@ -741,7 +1296,7 @@ namespace currency
   bool core_rpc_server::on_get_assets_list(const COMMAND_RPC_GET_ASSETS_LIST::request& req, COMMAND_RPC_GET_ASSETS_LIST::response& res, connection_context& cntx)
   {
     CHECK_CORE_READY();
-    if (!m_core.get_blockchain_storage().get_assets(req.offset, req.count, res.assets))
+    if (!m_core.get_blockchain_storage().get_assets(req.offset, req.count, res.assets, req.ticker_prefix))
     {
       res.status = API_RETURN_CODE_NOT_FOUND;
       return true;
@@ -784,6 +1339,7 @@ namespace currency
   bool core_rpc_server::on_send_raw_tx(const COMMAND_RPC_SEND_RAW_TX::request& req, COMMAND_RPC_SEND_RAW_TX::response& res, connection_context& cntx)
   {
     CHECK_CORE_READY();
+    CHECK_CORE_NOT_SECONDARY();
 
     std::string tx_blob;
     if(!string_tools::parse_hexstr_to_binbuff(req.tx_as_hex, tx_blob))
@@ -835,6 +1391,7 @@ namespace currency
 	bool core_rpc_server::on_force_relaey_raw_txs(const COMMAND_RPC_FORCE_RELAY_RAW_TXS::request& req, COMMAND_RPC_FORCE_RELAY_RAW_TXS::response& res, connection_context& cntx)
 	{
 		CHECK_CORE_READY();
+		CHECK_CORE_NOT_SECONDARY();
 		NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::request r = AUTO_VAL_INIT(r);
 
 		for (const auto& t : req.txs_as_hex)
@@ -859,6 +1416,7 @@ namespace currency
   bool core_rpc_server::on_start_mining(const COMMAND_RPC_START_MINING::request& req, COMMAND_RPC_START_MINING::response& res, connection_context& cntx)
   {
     CHECK_CORE_READY();
+    CHECK_CORE_NOT_SECONDARY();
     account_public_address adr;
     if(!get_account_address_from_str(adr, req.miner_address))
     {
@@ -921,6 +1479,7 @@ namespace currency
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_getblocktemplate(const COMMAND_RPC_GETBLOCKTEMPLATE::request& req, COMMAND_RPC_GETBLOCKTEMPLATE::response& res, epee::json_rpc::error& error_resp, connection_context& cntx)
   {
+    CHECK_CORE_NOT_SECONDARY_JSON_RPC();
     if(!check_core_ready())
     {
       error_resp.code = CORE_RPC_ERROR_CODE_CORE_BUSY;
@@ -1001,6 +1560,7 @@ namespace currency
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_submitblock(const COMMAND_RPC_SUBMITBLOCK::request& req, COMMAND_RPC_SUBMITBLOCK::response& res, epee::json_rpc::error& error_resp, connection_context& cntx)
   {
+    CHECK_CORE_NOT_SECONDARY_JSON_RPC();
     CHECK_CORE_READY();
     if(req.size()!=1)
     {
@@ -1044,6 +1604,7 @@ namespace currency
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_submitblock2(const COMMAND_RPC_SUBMITBLOCK2::request& req, COMMAND_RPC_SUBMITBLOCK2::response& res, epee::json_rpc::error& error_resp, connection_context& cntx)
   {
+    CHECK_CORE_NOT_SECONDARY_JSON_RPC();
     CHECK_CORE_READY();
 
 
@@ -1276,7 +1837,7 @@ namespace currency
     m_core.get_blockchain_storage().get_aliases([&res](const std::string& alias, const currency::extra_alias_entry_base& ai){
       res.aliases.push_back(alias_rpc_details());
       alias_info_to_rpc_alias_info(alias, ai, res.aliases.back());
-    }, req.offset, req.count);
+    }, req.offset, req.count, req.prefix);
 
     res.status = API_RETURN_CODE_OK;
     return true;
@@ -1359,6 +1920,19 @@ namespace currency
     res.status = API_RETURN_CODE_OK;
     return true;
   }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_compact_db(const COMMAND_RPC_COMPACT_DB::request& req, COMMAND_RPC_COMPACT_DB::response& res, connection_context& cntx)
+  {
+    CHECK_CORE_READY();
+    CHECK_CORE_NOT_SECONDARY();
+    if (!m_core.get_blockchain_storage().compact_db(res.size_before, res.size_after))
+    {
+      res.status = API_RETURN_CODE_FAIL;
+      return true;
+    }
+    res.status = API_RETURN_CODE_OK;
+    return true;
+  }
 }
 
 
@@ -6,11 +6,15 @@
 
 #pragma  once 
 
+#include <atomic>
+#include <thread>
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
 
 #include "net/http_server_impl_base.h"
 #include "core_rpc_server_commands_defs.h"
+#include "rpc_response_cache.h"
+#include "rpc_admission_control.h"
 #include "currency_core/currency_core.h"
 #include "p2p/net_node.h"
 #include "currency_protocol/currency_protocol_handler.h"
@@ -33,16 +37,21 @@ namespace currency
     typedef epee::net_utils::connection_context_base connection_context;
 
     core_rpc_server(core& cr, nodetool::node_server<currency::t_currency_protocol_handler<currency::core> >& p2p, bc_services::bc_offers_service& of);
+    ~core_rpc_server();
 
     static void init_options(boost::program_options::options_description& desc);
     bool init(const boost::program_options::variables_map& vm);
+    bool send_stop_signal();
     
     void set_rpc_chain_handler(epee::net_utils::http::i_chain_handler* prpc_chain_handler) { m_prpc_chain_handler = prpc_chain_handler; }
     bool on_get_blocks_direct(const COMMAND_RPC_GET_BLOCKS_DIRECT::request& req, COMMAND_RPC_GET_BLOCKS_DIRECT::response& res, connection_context& cntx);
     void set_ignore_connectivity_status(bool ignore) { m_ignore_status = ignore;}
+    size_t get_threads_count() const { return m_threads_count; }
 
     bool on_get_height(const COMMAND_RPC_GET_HEIGHT::request& req, COMMAND_RPC_GET_HEIGHT::response& res, connection_context& cntx);
     bool on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res, connection_context& cntx);
+    bool on_get_blocks_feed(const COMMAND_RPC_GET_BLOCKS_FEED::request& req, COMMAND_RPC_GET_BLOCKS_FEED::response& res, connection_context& cntx);
+    bool on_wait_for_changes(const COMMAND_RPC_WAIT_FOR_CHANGES::request& req, COMMAND_RPC_WAIT_FOR_CHANGES::response& res, connection_context& cntx);
     bool on_get_transactions(const COMMAND_RPC_GET_TRANSACTIONS::request& req, COMMAND_RPC_GET_TRANSACTIONS::response& res, connection_context& cntx);
     bool on_get_indexes(const COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::request& req, COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::response& res, connection_context& cntx);
     bool on_send_raw_tx(const COMMAND_RPC_SEND_RAW_TX::request& req, COMMAND_RPC_SEND_RAW_TX::response& res, connection_context& cntx);		
@@ -76,6 +85,7 @@ namespace currency
     bool on_get_alias_reward(const COMMAND_RPC_GET_ALIAS_REWARD::request& req, COMMAND_RPC_GET_ALIAS_REWARD::response& res, epee::json_rpc::error& error_resp, connection_context& cntx);  
     bool on_reset_transaction_pool(const COMMAND_RPC_RESET_TX_POOL::request& req, COMMAND_RPC_RESET_TX_POOL::response& res, connection_context& cntx);
     bool on_remove_tx_from_pool(const COMMAND_RPC_REMOVE_TX_FROM_POOL::request& req, COMMAND_RPC_REMOVE_TX_FROM_POOL::response& res, connection_context& cntx);
+    bool on_compact_db(const COMMAND_RPC_COMPACT_DB::request& req, COMMAND_RPC_COMPACT_DB::response& res, connection_context& cntx);
     bool on_get_pos_mining_details(const COMMAND_RPC_GET_POS_MINING_DETAILS::request& req, COMMAND_RPC_GET_POS_MINING_DETAILS::response& res, connection_context& cntx);
     bool on_get_current_core_tx_expiration_median(const COMMAND_RPC_GET_CURRENT_CORE_TX_EXPIRATION_MEDIAN::request& req, COMMAND_RPC_GET_CURRENT_CORE_TX_EXPIRATION_MEDIAN::response& res, connection_context& cntx);
     bool on_get_tx_details(const COMMAND_RPC_GET_TX_DETAILS::request& req, COMMAND_RPC_GET_TX_DETAILS::response& res, epee::json_rpc::error& error_resp, connection_context& cntx);
@@ -95,6 +105,7 @@ namespace currency
     bool on_get_alt_blocks_details(const COMMAND_RPC_GET_ALT_BLOCKS_DETAILS::request& req, COMMAND_RPC_GET_ALT_BLOCKS_DETAILS::response& res, connection_context& cntx);
     bool on_get_est_height_from_date(const COMMAND_RPC_GET_EST_HEIGHT_FROM_DATE::request& req, COMMAND_RPC_GET_EST_HEIGHT_FROM_DATE::response& res, connection_context& cntx);
     bool on_validate_signature(const COMMAND_VALIDATE_SIGNATURE::request& req, COMMAND_VALIDATE_SIGNATURE::response& res, epee::json_rpc::error& er, connection_context& cntx);
+    bool on_get_metrics(const epee::net_utils::http::http_request_info& query_info, std::string& body, connection_context& cntx);
     
     
     
@@ -109,8 +120,11 @@ namespace currency
       MAP_URI_AUTO_JON2("/start_mining",              on_start_mining,                COMMAND_RPC_START_MINING)
       MAP_URI_AUTO_JON2("/stop_mining",               on_stop_mining,                 COMMAND_RPC_STOP_MINING)
       MAP_URI_AUTO_JON2("/getinfo",                   on_get_info,                    COMMAND_RPC_GET_INFO)
+      // Prometheus/OpenMetrics scraping
+      MAP_URI_TEXT2    ("/metrics",                   on_get_metrics,                 "text/plain; version=0.0.4")
       // binary RPCs
       MAP_URI_AUTO_BIN2("/getblocks.bin",             on_get_blocks,                  COMMAND_RPC_GET_BLOCKS_FAST)
+      MAP_URI_AUTO_BIN2("/get_blocks_feed.bin",       on_get_blocks_feed,             COMMAND_RPC_GET_BLOCKS_FEED)
       MAP_URI_AUTO_BIN2("/get_o_indexes.bin",         on_get_indexes,                 COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES)      
       MAP_URI_AUTO_BIN2("/getrandom_outs.bin",        on_get_random_outs,             COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS_LEGACY)
       MAP_URI_AUTO_BIN2("/getrandom_outs1.bin",       on_get_random_outs1,            COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS)
@@ -127,20 +141,21 @@ namespace currency
         MAP_JON_RPC_WE("submitblock",                 on_submitblock,                 COMMAND_RPC_SUBMITBLOCK)
         MAP_JON_RPC_WE("submitblock2",                on_submitblock2,                COMMAND_RPC_SUBMITBLOCK2)
         MAP_JON_RPC_WE("getlastblockheader",          on_get_last_block_header,       COMMAND_RPC_GET_LAST_BLOCK_HEADER)
-        MAP_JON_RPC_WE("getblockheaderbyhash",        on_get_block_header_by_hash,    COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH)
-        MAP_JON_RPC_WE("getblockheaderbyheight",      on_get_block_header_by_height,  COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT)
+        MAP_JON_RPC_WE_CACHED("getblockheaderbyhash",  on_get_block_header_by_hash,    COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH,   m_response_cache)
+        MAP_JON_RPC_WE_CACHED("getblockheaderbyheight",on_get_block_header_by_height,  COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT, m_response_cache)
         MAP_JON_RPC_WE("get_alias_details",           on_get_alias_details,           COMMAND_RPC_GET_ALIAS_DETAILS)
         MAP_JON_RPC_WE("get_alias_by_address",        on_aliases_by_address,          COMMAND_RPC_GET_ALIASES_BY_ADDRESS)
         MAP_JON_RPC_WE("get_alias_reward",            on_get_alias_reward,            COMMAND_RPC_GET_ALIAS_REWARD)
         MAP_JON_RPC   ("get_est_height_from_date",    on_get_est_height_from_date,    COMMAND_RPC_GET_EST_HEIGHT_FROM_DATE)
         //block explorer api
         MAP_JON_RPC   ("get_blocks_details",          on_rpc_get_blocks_details,      COMMAND_RPC_GET_BLOCKS_DETAILS)
-        MAP_JON_RPC_WE("get_tx_details",              on_get_tx_details,              COMMAND_RPC_GET_TX_DETAILS)
+        MAP_JON_RPC_WE_CACHED("get_tx_details",        on_get_tx_details,              COMMAND_RPC_GET_TX_DETAILS,             m_response_cache)
         MAP_JON_RPC   ("search_by_id",                on_search_by_id,                COMMAND_RPC_SERARCH_BY_ID)
         MAP_JON_RPC   ("getinfo",                     on_get_info ,                   COMMAND_RPC_GET_INFO)
+        MAP_JON_RPC   ("wait_for_changes",            on_wait_for_changes,            COMMAND_RPC_WAIT_FOR_CHANGES)
         MAP_JON_RPC   ("get_out_info",                on_get_out_info,                COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES_BY_AMOUNT)
         MAP_JON_RPC   ("get_multisig_info",           on_get_multisig_info,           COMMAND_RPC_GET_MULTISIG_INFO)
-        MAP_JON_RPC_WE("get_all_alias_details",       on_get_all_aliases,             COMMAND_RPC_GET_ALL_ALIASES)
+        MAP_JON_RPC_WE_CACHED("get_all_alias_details",on_get_all_aliases,             COMMAND_RPC_GET_ALL_ALIASES,            m_all_aliases_cache)
         MAP_JON_RPC_WE("get_aliases",                 on_get_aliases,                 COMMAND_RPC_GET_ALIASES)
         MAP_JON_RPC   ("get_pool_txs_details",        on_get_pool_txs_details,        COMMAND_RPC_GET_POOL_TXS_DETAILS)
         MAP_JON_RPC   ("get_pool_txs_brief_details",  on_get_pool_txs_brief_details,  COMMAND_RPC_GET_POOL_TXS_BRIEF_DETAILS)
@@ -151,15 +166,16 @@ namespace currency
         MAP_JON_RPC   ("getrandom_outs3",             on_get_random_outs3,            COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3)
         MAP_JON_RPC   ("get_votes",                   on_get_votes,                   COMMAND_RPC_GET_VOTES)
         //assets api
-        MAP_JON_RPC   ("get_asset_info",              on_get_asset_info,             COMMAND_RPC_GET_ASSET_INFO)
+        MAP_JON_RPC_CACHED("get_asset_info",          on_get_asset_info,             COMMAND_RPC_GET_ASSET_INFO,              m_response_cache)
         MAP_JON_RPC   ("get_assets_list",             on_get_assets_list,            COMMAND_RPC_GET_ASSETS_LIST)
 
-        MAP_JON_RPC_WE("get_main_block_details",      on_get_main_block_details,      COMMAND_RPC_GET_BLOCK_DETAILS)
+        MAP_JON_RPC_WE_CACHED("get_main_block_details",on_get_main_block_details,      COMMAND_RPC_GET_BLOCK_DETAILS,          m_response_cache)
         MAP_JON_RPC_WE("get_alt_block_details",       on_get_alt_block_details,       COMMAND_RPC_GET_BLOCK_DETAILS)
         MAP_JON_RPC   ("get_alt_blocks_details",      on_get_alt_blocks_details,      COMMAND_RPC_GET_ALT_BLOCKS_DETAILS)
         //
         MAP_JON_RPC   ("reset_transaction_pool",      on_reset_transaction_pool,      COMMAND_RPC_RESET_TX_POOL)
         MAP_JON_RPC   ("remove_tx_from_pool",         on_remove_tx_from_pool,         COMMAND_RPC_REMOVE_TX_FROM_POOL)
+        MAP_JON_RPC   ("compact_db",                  on_compact_db,                  COMMAND_RPC_COMPACT_DB)
         MAP_JON_RPC   ("get_current_core_tx_expiration_median", on_get_current_core_tx_expiration_median, COMMAND_RPC_GET_CURRENT_CORE_TX_EXPIRATION_MEDIAN)
         //
         MAP_JON_RPC_WE("marketplace_global_get_offers_ex", on_get_offers_ex,          COMMAND_RPC_GET_OFFERS_EX)        
@@ -180,6 +196,13 @@ namespace currency
     bool fill_block_header_response(const block& blk, bool orphan_status, block_header_response& response);
     void set_session_blob(const std::string& session_id, const currency::block& blob);
     bool get_session_blob(const std::string& session_id, currency::block& blob);
+    template<class t_is_changed>
+    void wait_for_chain_change(uint64_t wait_ms, t_is_changed is_changed);
+    void fill_info_chain_stats(uint64_t flags, COMMAND_RPC_GET_INFO::response& res);
+    static void copy_info_chain_stats(uint64_t flags, const COMMAND_RPC_GET_INFO::response& from, COMMAND_RPC_GET_INFO::response& to);
+    void update_info_chain_stats(uint64_t flags);
+    void get_info_chain_stats(uint64_t flags, COMMAND_RPC_GET_INFO::response& res);
+    void info_chain_stats_worker();
     
     core& m_core;
     nodetool::node_server<currency::t_currency_protocol_handler<currency::core> >& m_p2p;
@@ -188,6 +211,18 @@ namespace currency
     std::string m_bind_ip;
     bool m_ignore_status;
     epee::net_utils::http::i_chain_handler* m_prpc_chain_handler = nullptr;
+    rpc_response_cache m_response_cache;
+    rpc_versioned_response_cache m_all_aliases_cache;
+    rpc_admission_control m_admission_control;
+    size_t m_threads_count;
+    std::atomic<size_t> m_waiting_calls;
+
+    epee::critical_section m_info_chain_stats_lock;
+    COMMAND_RPC_GET_INFO::response m_info_chain_stats;
+    crypto::hash m_info_chain_stats_top_id;
+    uint64_t m_info_chain_stats_flags;                       // the ones m_info_chain_stats holds
+    std::atomic<uint64_t> m_info_chain_stats_requested_flags; // the ones asked for since the start, kept up to date by the worker
+    std::thread m_info_chain_stats_thread;
   };
 }
 
@@ -19,6 +19,7 @@
 #include <currency_core/currency_format_utils_transactions.h>
 #include <currency_protocol/blobdatatype.h>
 #include "common/error_codes.h"
+#include "common/golomb_coded_set.h"
 #include <cstdint>
 #include <list>
 #include <string>
@@ -159,10 +160,12 @@ namespace currency
     {
       uint64_t offset = 0;
       uint64_t count = 100;
+      std::string ticker_prefix;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(offset)                     DOC_DSCR("Offset for the item to start copying") DOC_EXMP(0)     DOC_END
         KV_SERIALIZE(count)                      DOC_DSCR("Number of items to recieve")           DOC_EXMP(100)   DOC_END
+        KV_SERIALIZE(ticker_prefix)              DOC_DSCR("Optional. If set, only the assets with tickers starting with it are returned, in the order of tickers") DOC_EXMP("ZA") DOC_END
       END_KV_SERIALIZE_MAP()
     };
 
@@ -201,6 +204,9 @@ namespace currency
   };
   
 
+  // per-block filter over key images of non-coinbase txs, see COMMAND_RPC_GET_BLOCKS_FAST_T::request::key_images_filters
+  typedef tools::golomb_coded_set<crypto::key_image> blocks_key_images_filter;
+
   template<class t_block_complete_entry>
   struct COMMAND_RPC_GET_BLOCKS_FAST_T
   {
@@ -209,10 +215,16 @@ namespace currency
     {
       uint64_t minimum_height;
       std::list<crypto::hash> block_ids;
+      bool prune_txs;
+      bool key_images_filters;
+      bool compact_global_outs;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(minimum_height)                  DOC_DSCR("The minimum height of the returning buch of blocks.") DOC_EXMP(0) DOC_END
         KV_SERIALIZE_CONTAINER_POD_AS_BLOB(block_ids) /* TODO !!! DOC_DSCR("Current state of the local blockchain. Hashes of the most recent 10 blocks goes first, then each 2nd, then 4th, 8, 16, 32, 64 and so on, and the last one is always hash of the genesis block.") DOC_END */
+        KV_SERIALIZE(prune_txs)                       DOC_DSCR("If true, non-coinbase transactions are returned without signatures and proofs (their ids are not affected).") DOC_EXMP(true) DOC_END
+        KV_SERIALIZE(key_images_filters)              DOC_DSCR("If true along with prune_txs, inputs with key images are also removed from pruned transactions (so their ids can't be calculated), and a filter over the removed key images is returned for each block.") DOC_EXMP(true) DOC_END
+        KV_SERIALIZE(compact_global_outs)             DOC_DSCR("If true, global output indexes of each block are returned in one global_outs blob (coinbase outputs first, then the outputs of each transaction) instead of coinbase_global_outs and tx_global_outs.") DOC_EXMP(true) DOC_END
       END_KV_SERIALIZE_MAP()
     };
 
@@ -221,12 +233,16 @@ namespace currency
       std::list<t_block_complete_entry> blocks;
       uint64_t    start_height;
       uint64_t    current_height;
+      bool        txs_pruned;
+      std::vector<std::string> key_images_filters;
       std::string status;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(blocks)                     DOC_DSCR("Bunch of blocks") DOC_EXMP_AUTO(1) DOC_END
         KV_SERIALIZE(start_height)               DOC_DSCR("Starting height of the resulting bunch of blocks.") DOC_EXMP(2000000) DOC_END
         KV_SERIALIZE(current_height)             DOC_DSCR("Current height of the blockchain.") DOC_EXMP(2555000) DOC_END
+        KV_SERIALIZE(txs_pruned)                 DOC_DSCR("True if non-coinbase transactions are pruned as requested by prune_txs.") DOC_EXMP(true) DOC_END
+        KV_SERIALIZE(key_images_filters)         DOC_DSCR("If requested, blocks_key_images_filter blobs, one for each block. Pruned transactions of the blocks have no inputs with key images then.") DOC_END
         KV_SERIALIZE(status)                     DOC_DSCR("Status of the call.") DOC_EXMP(API_RETURN_CODE_OK) DOC_END
       END_KV_SERIALIZE_MAP()
     };
@@ -234,6 +250,93 @@ namespace currency
 
   typedef COMMAND_RPC_GET_BLOCKS_FAST_T<block_complete_entry> COMMAND_RPC_GET_BLOCKS_FAST;
   typedef COMMAND_RPC_GET_BLOCKS_FAST_T<block_direct_data_entry> COMMAND_RPC_GET_BLOCKS_DIRECT;
+
+  //-----------------------------------------------
+  // bulk blocks export for indexers, see blocks_feed_utils.h for the frames
+  struct COMMAND_RPC_GET_BLOCKS_FEED
+  {
+    DOC_COMMAND("Retrieve blocks with their transactions and global output indexes as a sequence of binary frames, following the top of the chain: when the client is at the top already, the call waits for a new block up to wait_ms.")
+
+    struct request
+    {
+      uint64_t start_height;
+      std::list<crypto::hash> block_ids;
+      uint64_t max_bytes;
+      uint64_t wait_ms;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start_height)                    DOC_DSCR("Height of the first block to return, used when block_ids is empty.") DOC_EXMP(0) DOC_END
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(block_ids) // optional, the client's chain: its top block id first, then sparse ids down to the genesis one, the blocks go from the one after the common block
+        KV_SERIALIZE(max_bytes)                       DOC_DSCR("Limit of the frames size (at least one block is returned anyway), 0 means the default one. The server caps it.") DOC_EXMP(16777216) DOC_END
+        KV_SERIALIZE(wait_ms)                         DOC_DSCR("How long to wait for a new block if there are no blocks to return yet, in milliseconds. The server caps it.") DOC_EXMP(10000) DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      uint64_t    start_height;
+      uint64_t    current_height;
+      bool        reorganized;
+      uint64_t    blocks_count;
+      std::string blocks_frames;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start_height)               DOC_DSCR("Height of the first returned block. The client should drop its blocks from this height on if reorganized is set.") DOC_EXMP(2000000) DOC_END
+        KV_SERIALIZE(current_height)             DOC_DSCR("Current height of the blockchain.") DOC_EXMP(2555000) DOC_END
+        KV_SERIALIZE(reorganized)                DOC_DSCR("True if the top block of the given block_ids is not in the main chain anymore.") DOC_EXMP(false) DOC_END
+        KV_SERIALIZE(blocks_count)               DOC_DSCR("Number of frames in blocks_frames.") DOC_EXMP(100) DOC_END
+        KV_SERIALIZE(blocks_frames)              DOC_DSCR("Frames, each one is a varint size followed by block_complete_entry in portable storage binary format.") DOC_END
+        KV_SERIALIZE(status)                     DOC_DSCR("Status of the call.") DOC_EXMP(API_RETURN_CODE_OK) DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  //-----------------------------------------------
+  struct COMMAND_RPC_WAIT_FOR_CHANGES
+  {
+    DOC_COMMAND("Wait until the top block or the tx pool differ from the given state, up to wait_ms, and return the current state. Meant to replace polling of getinfo by wallets and alike.")
+
+    struct request
+    {
+      crypto::hash top_block_id;
+      uint64_t pool_instance_id;
+      uint64_t pool_version;
+      uint64_t wait_ms;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_POD_AS_HEX_STRING(top_block_id) DOC_DSCR("Top block id known to the client.") DOC_EXMP("a6e8da986858e6825fce7a192097e6afae4e889cabe853a9c29b964985b23da8") DOC_END
+        KV_SERIALIZE(pool_instance_id)           DOC_DSCR("pool_instance_id from a previous response, 0 if the pool is of no interest.") DOC_EXMP(8432075497283548822) DOC_END
+        KV_SERIALIZE(pool_version)               DOC_DSCR("pool_version from a previous response.") DOC_EXMP(1520) DOC_END
+        KV_SERIALIZE(wait_ms)                    DOC_DSCR("How long to wait for a change, in milliseconds. The server caps it, and returns at once if too many calls wait already.") DOC_EXMP(30000) DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      uint64_t height;
+      crypto::hash top_block_id;
+      bool reorganized;
+      uint64_t pool_instance_id;
+      uint64_t pool_version;
+      bool pool_changes_known;
+      std::list<std::string> pool_added_tx_ids;
+      std::list<std::string> pool_removed_tx_ids;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(height)                     DOC_DSCR("Height of the blockchain.") DOC_EXMP(2555000) DOC_END
+        KV_SERIALIZE_POD_AS_HEX_STRING(top_block_id) DOC_DSCR("Current top block id.") DOC_EXMP("a6e8da986858e6825fce7a192097e6afae4e889cabe853a9c29b964985b23da8") DOC_END
+        KV_SERIALIZE(reorganized)                DOC_DSCR("True if the given top block is not in the main chain anymore.") DOC_EXMP(false) DOC_END
+        KV_SERIALIZE(pool_instance_id)           DOC_DSCR("Identifier of the pool instance, changes when the daemon restarts.") DOC_EXMP(8432075497283548822) DOC_END
+        KV_SERIALIZE(pool_version)               DOC_DSCR("Current version of the pool.") DOC_EXMP(1521) DOC_END
+        KV_SERIALIZE(pool_changes_known)         DOC_DSCR("True if pool_added_tx_ids and pool_removed_tx_ids hold all the changes since the given pool version, otherwise the whole pool is to be requested.") DOC_EXMP(true) DOC_END
+        KV_SERIALIZE(pool_added_tx_ids)          DOC_DSCR("Ids of txs added to the pool since the given version.") DOC_EXMP_AUTO(1, "ec4d913a40a9ac1fbd9d33b71ef507b5c85d1f503b89096618a18b08991b5171") DOC_END
+        KV_SERIALIZE(pool_removed_tx_ids)        DOC_DSCR("Ids of txs removed from the pool since the given version.") DOC_EXMP_AUTO(1, "146791c4f5ca94bcf423557e5eb859a3a69991bd33960d52f709d88bf5d1ac6d") DOC_END
+        KV_SERIALIZE(status)                     DOC_DSCR("Status of the call.") DOC_EXMP(API_RETURN_CODE_OK) DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+  };
   
   //-----------------------------------------------
   struct COMMAND_RPC_GET_TRANSACTIONS
@@ -291,23 +394,36 @@ namespace currency
   //-----------------------------------------------
   struct COMMAND_RPC_GET_TX_POOL
   {
-    DOC_COMMAND("Retreives transactions from tx pool (and other information).")
+    DOC_COMMAND("Retreives transactions from tx pool (and other information). If pool_instance_id and since_version from a previous response are given, only the changes made since then may be returned.")
 
     struct request
     {
+      uint64_t pool_instance_id;
+      uint64_t since_version;
+
       BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(pool_instance_id)           DOC_DSCR("pool_instance_id from a previous response, 0 to get the whole pool.") DOC_EXMP(0) DOC_END
+        KV_SERIALIZE(since_version)              DOC_DSCR("pool_version from a previous response.") DOC_EXMP(0) DOC_END
       END_KV_SERIALIZE_MAP()
     };
 
     struct response
     {
       std::list<blobdata> txs;  //transactions blobs
+      std::list<crypto::hash> removed_tx_ids;
       uint64_t tx_expiration_ts_median;
+      uint64_t pool_instance_id;
+      uint64_t pool_version;
+      bool is_delta;
       std::string status;
 
       BEGIN_KV_SERIALIZE_MAP()
-        KV_SERIALIZE(txs)                        DOC_DSCR("Transactions as blobs.") DOC_EXMP_AUTO(1, "7d914497d91442f8f3c2268397d914497d91442f8f3c22683585eaa60b53757d49bf046a96269cef45c1bc9ff7300cc2f8f3c22683585eaa60b53757d49bf046a96269cef45c1bc9ff7300cc") DOC_END
+        KV_SERIALIZE(txs)                        DOC_DSCR("Transactions as blobs (only ones added since the given version if is_delta is true).") DOC_EXMP_AUTO(1, "7d914497d91442f8f3c2268397d914497d91442f8f3c22683585eaa60b53757d49bf046a96269cef45c1bc9ff7300cc2f8f3c22683585eaa60b53757d49bf046a96269cef45c1bc9ff7300cc") DOC_END
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(removed_tx_ids) // ids of txs removed since the given version, if is_delta is true
         KV_SERIALIZE(tx_expiration_ts_median)    DOC_DSCR("Timestamp median value of last TX_EXPIRATION_TIMESTAMP_CHECK_WINDOW blocks.") DOC_EXMP(1711021795) DOC_END
+        KV_SERIALIZE(pool_instance_id)           DOC_DSCR("Identifier of the pool instance, changes when the daemon restarts.") DOC_EXMP(8432075497283548822) DOC_END
+        KV_SERIALIZE(pool_version)               DOC_DSCR("Version of the pool the response corresponds to.") DOC_EXMP(1520) DOC_END
+        KV_SERIALIZE(is_delta)                   DOC_DSCR("If true, txs and removed_tx_ids are the changes since the requested version, otherwise txs is the whole pool.") DOC_EXMP(false) DOC_END
         KV_SERIALIZE(status)                     DOC_DSCR("Status of the call.") DOC_EXMP(API_RETURN_CODE_OK) DOC_END
       END_KV_SERIALIZE_MAP()
     };
@@ -702,6 +818,8 @@ namespace currency
     uint64_t raise_block_core_event;
     uint64_t target_calculating_enum_blocks;
     uint64_t target_calculating_calc;
+    uint64_t txs_prevalidation_time;
+    uint64_t batch_verify_range_proofs_time;
 
     //tx processing zone
     uint64_t tx_check_inputs_time;
@@ -752,6 +870,8 @@ namespace currency
       KV_SERIALIZE(raise_block_core_event)
       KV_SERIALIZE(target_calculating_enum_blocks)
       KV_SERIALIZE(target_calculating_calc)
+      KV_SERIALIZE(txs_prevalidation_time)
+      KV_SERIALIZE(batch_verify_range_proofs_time)
       //tx processing zone
       KV_SERIALIZE(tx_check_inputs_time)
       KV_SERIALIZE(tx_add_one_tx_time)
@@ -799,6 +919,8 @@ namespace currency
     uint64_t begin_tx_time;
     uint64_t update_db_time;
     uint64_t db_commit_time;
+    uint64_t admission_queue_depth;       // txs from the network waiting for verification
+    uint64_t admission_verification_time; // average verification time per tx, microseconds
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(tx_processing_time)
@@ -811,6 +933,29 @@ namespace currency
       KV_SERIALIZE(begin_tx_time)
       KV_SERIALIZE(update_db_time)
       KV_SERIALIZE(db_commit_time)
+      KV_SERIALIZE(admission_queue_depth)
+      KV_SERIALIZE(admission_verification_time)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct rpc_connections_stat
+  {
+    uint64_t connections_count;
+    uint64_t requests_count;
+    uint64_t reused_connection_requests_count; // requests that came over kept-alive connections
+    uint64_t response_cache_hits;
+    uint64_t response_cache_misses;
+    uint64_t response_cache_entries_count;
+    uint64_t response_cache_size;              // bytes
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(connections_count)
+      KV_SERIALIZE(requests_count)
+      KV_SERIALIZE(reused_connection_requests_count)
+      KV_SERIALIZE(response_cache_hits)
+      KV_SERIALIZE(response_cache_misses)
+      KV_SERIALIZE(response_cache_entries_count)
+      KV_SERIALIZE(response_cache_size)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -905,6 +1050,7 @@ namespace currency
       outs_index_stat outs_stat;
       bc_performance_data performance_data;
       pool_performance_data tx_pool_performance_data;
+      rpc_connections_stat rpc_stat;
       bool pos_allowed;
       uint64_t last_block_size;
       uint64_t current_max_allowed_block_size;
@@ -967,6 +1113,7 @@ namespace currency
         KV_SERIALIZE(outs_stat)                  DOC_DSCR("Statistics for the number of outputs that have a specific amount. This information is only provided if the COMMAND_RPC_GET_INFO_FLAG_OUTS_STAT flag is set.") DOC_EXMP_AUTO() DOC_END
         KV_SERIALIZE(performance_data)           DOC_DSCR("Detailed technical performance data intended for developers. This information is only provided if the COMMAND_RPC_GET_INFO_FLAG_PERFORMANCE flag is set.") DOC_EXMP_AUTO() DOC_END
         KV_SERIALIZE(tx_pool_performance_data)   DOC_DSCR("Detailed technical performance data intended for developers. This information is only provided if the COMMAND_RPC_GET_INFO_FLAG_PERFORMANCE flag is set.") DOC_EXMP_AUTO() DOC_END
+        KV_SERIALIZE(rpc_stat)                   DOC_DSCR("Counters of RPC connections and requests made over them, for connections reuse estimation, and of the RPC response cache. This information is only provided if the COMMAND_RPC_GET_INFO_FLAG_PERFORMANCE flag is set.") DOC_EXMP_AUTO() DOC_END
         KV_SERIALIZE(offers_count)               DOC_DSCR("Current number of offers in the offers service. This information is only provided if the COMMAND_RPC_GET_INFO_FLAG_PERFORMANCE flag is set.") DOC_EXMP(0) DOC_END
         KV_SERIALIZE(expiration_median_timestamp)DOC_DSCR("Median of timestamps of the last N blocks, used to determine the expiration status of transactions. This information is only provided if the COMMAND_RPC_GET_INFO_FLAG_EXPIRATIONS_MEDIAN flag is set.") DOC_EXMP(1719585827) DOC_END
       END_KV_SERIALIZE_MAP()
@@ -1315,10 +1462,12 @@ namespace currency
     {
       uint64_t offset; // The starting point from which aliases are to be retrieved.
       uint64_t count;  // The number of aliases to retrieve.
+      std::string prefix; // If not empty, only the aliases starting with it are listed (and counted by offset).
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(offset)                     DOC_DSCR("The offset in the list of all aliases from which to start retrieving.") DOC_EXMP(0) DOC_END
         KV_SERIALIZE(count)                      DOC_DSCR("The number of aliases to retrieve from the specified offset.") DOC_EXMP(2) DOC_END
+        KV_SERIALIZE(prefix)                     DOC_DSCR("Optional. If set, only the aliases starting with it are retrieved, e.g. for autocompletion. Aliases go in the lexicographical order.") DOC_EXMP("zan") DOC_END
       END_KV_SERIALIZE_MAP()
     };
 
@@ -1403,6 +1552,32 @@ namespace currency
 
   //-----------------------------------------------
 
+  struct COMMAND_RPC_COMPACT_DB
+  {
+    DOC_COMMAND("Compacts the blockchain database online: live data is copied into a fresh file which then replaces the database, the daemon pauses only for the swap. May take a long time and needs free disk space of about the database size.");
+
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      uint64_t size_before;
+      uint64_t size_after;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)                     DOC_DSCR("Status of the call.") DOC_EXMP(API_RETURN_CODE_OK) DOC_END
+        KV_SERIALIZE(size_before)                DOC_DSCR("Size of the database files before compaction, in bytes.") DOC_EXMP(21474836480) DOC_END
+        KV_SERIALIZE(size_after)                 DOC_DSCR("Size of the database files after compaction, in bytes.") DOC_EXMP(12884901888) DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  //-----------------------------------------------
+
   struct COMMAND_RPC_GET_POS_MINING_DETAILS
   {
     DOC_COMMAND("Retrieves basic information regarding PoS mining, including current PoS conditions and constraints.");
@@ -20,4 +20,5 @@
 #define CORE_RPC_ERROR_CODE_ALIAS_COMMENT_TO_LONG -12
 #define CORE_RPC_ERROR_CODE_BLOCK_ADDED_AS_ALTERNATIVE -13
 #define CORE_RPC_ERROR_CODE_NOT_FOUND             -14
+#define CORE_RPC_ERROR_CODE_READ_ONLY_INSTANCE    -15
 
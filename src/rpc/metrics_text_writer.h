@@ -0,0 +1,101 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace currency
+{
+  /************************************************************************/
+  /* Prometheus text exposition format (0.0.4), scraped by Prometheus and */
+  /* OpenMetrics collectors alike. The samples of one metric are to be    */
+  /* added one after another: HELP and TYPE are written before the first  */
+  /* of them. Labels are given already formatted: name="value",...        */
+  /************************************************************************/
+  class metrics_text_writer
+  {
+  public:
+    metrics_text_writer()
+    {
+      m_ss.precision(15);
+    }
+
+    void gauge(const std::string& name, const std::string& help, double value, const std::string& labels = std::string())
+    {
+      write_header(name, "gauge", help);
+      write_sample(name, labels, value);
+    }
+
+    void counter(const std::string& name, const std::string& help, uint64_t value, const std::string& labels = std::string())
+    {
+      write_header(name, "counter", help);
+      write_sample(name, labels, value);
+    }
+
+    // buckets[i] is the number of observations in (bounds[i - 1], bounds[i]], not cumulative; the +Inf one is count
+    void histogram(const std::string& name, const std::string& help, const std::vector<uint64_t>& bounds, const std::vector<uint64_t>& buckets,
+      uint64_t count, double sum, const std::string& labels = std::string(), double bounds_scale = 1)
+    {
+      write_header(name, "histogram", help);
+      const std::string sep = labels.empty() ? "" : ",";
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i != bounds.size() && i != buckets.size(); ++i)
+      {
+        cumulative += buckets[i];
+        std::stringstream le;
+        le << bounds[i] * bounds_scale;
+        write_sample(name + "_bucket", labels + sep + "le=\"" + le.str() + "\"", cumulative);
+      }
+      write_sample(name + "_bucket", labels + sep + "le=\"+Inf\"", count);
+      write_sample(name + "_sum", labels, sum);
+      write_sample(name + "_count", labels, count);
+    }
+
+    static std::string escape_label_value(const std::string& v)
+    {
+      std::string r;
+      r.reserve(v.size());
+      for (char c : v)
+      {
+        if (c == '\\' || c == '"')
+          r += '\\';
+        if (c == '\n')
+        {
+          r += "\\n";
+          continue;
+        }
+        r += c;
+      }
+      return r;
+    }
+
+    std::string str() const { return m_ss.str(); }
+
+  private:
+    void write_header(const std::string& name, const char* type, const std::string& help)
+    {
+      if (!m_names.insert(name).second)
+        return;
+      m_ss << "# HELP " << name << " " << help << "\n"
+        << "# TYPE " << name << " " << type << "\n";
+    }
+
+    template<class t_value>
+    void write_sample(const std::string& name, const std::string& labels, const t_value& value)
+    {
+      m_ss << name;
+      if (!labels.empty())
+        m_ss << "{" << labels << "}";
+      m_ss << " " << value << "\n";
+    }
+
+    std::set<std::string> m_names;
+    std::stringstream m_ss;
+  };
+}
@@ -0,0 +1,252 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <boost/algorithm/string.hpp>
+#include "rpc_admission_control.h"
+#include "misc_language.h"
+#include "string_tools.h"
+
+#undef LOG_DEFAULT_CHANNEL
+#define LOG_DEFAULT_CHANNEL "rpc"
+
+#define RPC_ADMISSION_IP_BUCKETS_CLEANUP_SIZE     10000
+#define RPC_ADMISSION_IP_BUCKETS_CLEANUP_INTERVAL 10000  // milliseconds
+
+namespace
+{
+  // start times of the calls admitted on this thread, a json rpc batch call has its methods nested
+  thread_local std::vector<std::chrono::steady_clock::time_point> admitted_calls_start_times;
+}
+
+namespace currency
+{
+  rpc_admission_control::rpc_admission_control()
+    : m_non_critical_calls(0)
+    , m_waiting_calls(0)
+    , m_running_calls(0)
+    , m_heavy_running_calls(0)
+    , m_ip_buckets_cleanup_ms(0)
+    , m_admitted(0)
+    , m_rejected_busy(0)
+    , m_rejected_rate_limited(0)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_admission_control::set_config(const config& cfg)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_config = cfg;
+    m_config.threads_count = std::max<size_t>(m_config.threads_count, 1);
+    m_config.reserved_threads = std::min(m_config.reserved_threads, m_config.threads_count - 1);
+    m_config.ip_burst = std::max(m_config.ip_burst, m_config.ip_rate);
+    m_ip_buckets.clear();
+    m_cv.notify_all();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_admission_control::get_stat(stat& st) const
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    st.admitted = m_admitted;
+    st.rejected_busy = m_rejected_busy;
+    st.rejected_rate_limited = m_rejected_rate_limited;
+    st.running = m_running_calls;
+    st.waiting = m_waiting_calls;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_admission_control::get_calls_latency(std::map<std::string, call_latency_stat>& latency) const
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    latency = m_latency_by_name;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  const std::vector<uint64_t>& rpc_admission_control::get_latency_buckets_us()
+  {
+    static const std::vector<uint64_t> buckets = { 1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000 };
+    return buckets;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_admission_control::add_call_latency(const std::string& call_name, uint64_t us)
+  {
+    const std::vector<uint64_t>& bounds = get_latency_buckets_us();
+    std::lock_guard<std::mutex> lk(m_lock);
+    call_latency_stat& st = m_latency_by_name[call_name];
+    if (st.buckets.empty())
+      st.buckets.resize(bounds.size());
+    ++st.count;
+    st.sum_us += us;
+    auto it = std::lower_bound(bounds.begin(), bounds.end(), us);
+    if (it != bounds.end())
+      ++st.buckets[it - bounds.begin()];
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_admission_control::call_class rpc_admission_control::get_call_class(const std::string& call_name)
+  {
+    // block and tx submission, PoW and PoS mining
+    static const std::set<std::string> critical_calls = {
+      "/sendrawtransaction", "getblocktemplate", "submitblock", "submitblock2", "/get_pos_details.bin"
+    };
+    // the ones that may take a lot of db lookups or big responses
+    static const std::set<std::string> heavy_calls = {
+      "/getblocks.bin", "/get_blocks_feed.bin", "/gettransactions",
+      "/getrandom_outs.bin", "/getrandom_outs1.bin", "/getrandom_outs3.bin", "getrandom_outs", "getrandom_outs1", "getrandom_outs3",
+      "get_blocks_details", "get_alt_blocks_details", "search_by_id", "get_all_alias_details", "get_pool_txs_details",
+      "get_assets_list", "get_votes", "marketplace_global_get_offers_ex"
+    };
+    if (critical_calls.count(call_name))
+      return call_class_critical;
+    if (heavy_calls.count(call_name))
+      return call_class_heavy;
+    return call_class_normal;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_admission_control::parse_method_limits(const std::string& str, std::map<std::string, size_t>& limits)
+  {
+    std::vector<std::string> items;
+    boost::split(items, str, boost::is_any_of(","), boost::token_compress_on);
+    for (std::string item : items)
+    {
+      boost::trim(item);
+      if (item.empty())
+        continue;
+      size_t pos = item.rfind(':');
+      CHECK_AND_ASSERT_MES(pos != std::string::npos && pos != 0, false, "wrong rpc method limit \"" << item << "\", should be name:limit");
+      size_t limit = 0;
+      CHECK_AND_ASSERT_MES(epee::string_tools::get_xtype_from_string(limit, item.substr(pos + 1)), false, "wrong rpc method limit \"" << item << "\", should be name:limit");
+      limits[item.substr(0, pos)] = limit;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_admission_control::result rpc_admission_control::enter(const std::string& call_name, const epee::net_utils::connection_context_base& context)
+  {
+    result r = enter(call_name, context.m_remote_ip, epee::misc_utils::get_tick_count());
+    if (r == admitted)
+      admitted_calls_start_times.push_back(std::chrono::steady_clock::now());
+    return r;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_admission_control::result rpc_admission_control::enter(const std::string& call_name, uint32_t ip, uint64_t now_ms)
+  {
+    call_class cls = get_call_class(call_name);
+    std::unique_lock<std::mutex> lk(m_lock);
+    if (!take_ip_token(ip, now_ms))
+    {
+      ++m_rejected_rate_limited;
+      LOG_PRINT_L2("[RPC][" << epee::string_tools::get_ip_string_from_int32(ip) << "][" << call_name << "] rejected: too many requests");
+      return rate_limited;
+    }
+
+    if (cls != call_class_critical)
+    {
+      // rejected if it would take a thread reserved for the critical ones, or if it's out of the limits for longer than max_queue_ms
+      bool can_go = m_non_critical_calls < get_non_critical_calls_max();
+      if (can_go)
+      {
+        ++m_non_critical_calls;
+        if (!can_run(cls, call_name))
+        {
+          ++m_waiting_calls;
+          can_go = m_cv.wait_for(lk, std::chrono::milliseconds(m_config.max_queue_ms), [&]() { return can_run(cls, call_name); });
+          --m_waiting_calls;
+          if (!can_go)
+            --m_non_critical_calls;
+        }
+      }
+      if (!can_go)
+      {
+        ++m_rejected_busy;
+        LOG_PRINT_L2("[RPC][" << epee::string_tools::get_ip_string_from_int32(ip) << "][" << call_name << "] rejected: busy");
+        return busy;
+      }
+    }
+
+    ++m_running_by_name[call_name];
+    ++m_running_calls;
+    if (cls == call_class_heavy)
+      ++m_heavy_running_calls;
+    ++m_admitted;
+    return admitted;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_admission_control::leave(const std::string& call_name)
+  {
+    call_class cls = get_call_class(call_name);
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      auto it = m_running_by_name.find(call_name);
+      CHECK_AND_ASSERT_MES_NO_RET(it != m_running_by_name.end() && it->second, "internal error: rpc call " << call_name << " leaves while not running");
+      if (!--it->second)
+        m_running_by_name.erase(it);
+      --m_running_calls;
+      if (cls == call_class_heavy)
+        --m_heavy_running_calls;
+      if (cls != call_class_critical)
+        --m_non_critical_calls;
+    }
+    m_cv.notify_all();
+
+    if (!admitted_calls_start_times.empty())
+    {
+      auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - admitted_calls_start_times.back()).count();
+      admitted_calls_start_times.pop_back();
+      add_call_latency(call_name, static_cast<uint64_t>(us));
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_admission_control::take_ip_token(uint32_t ip, uint64_t now_ms)
+  {
+    if (!m_config.ip_rate)
+      return true;
+
+    const uint64_t full_bucket = m_config.ip_burst * 1000;
+    if (m_ip_buckets.size() > RPC_ADMISSION_IP_BUCKETS_CLEANUP_SIZE && now_ms >= m_ip_buckets_cleanup_ms + RPC_ADMISSION_IP_BUCKETS_CLEANUP_INTERVAL)
+    {
+      // full buckets are the same as missing ones
+      for (auto it = m_ip_buckets.begin(); it != m_ip_buckets.end();)
+      {
+        if (it->second.milli_tokens + m_config.ip_rate * (now_ms - std::min(now_ms, it->second.last_update_ms)) >= full_bucket)
+          it = m_ip_buckets.erase(it);
+        else
+          ++it;
+      }
+      m_ip_buckets_cleanup_ms = now_ms;
+    }
+
+    auto it = m_ip_buckets.find(ip);
+    if (it == m_ip_buckets.end())
+      it = m_ip_buckets.insert(std::make_pair(ip, ip_bucket{ full_bucket, now_ms })).first;
+    ip_bucket& b = it->second;
+    if (now_ms > b.last_update_ms)
+    {
+      uint64_t elapsed_ms = std::min<uint64_t>(now_ms - b.last_update_ms, 24 * 60 * 60 * 1000); // no overflow, the bucket is full anyway
+      b.milli_tokens = std::min(b.milli_tokens + m_config.ip_rate * elapsed_ms, full_bucket);
+      b.last_update_ms = now_ms;
+    }
+    if (b.milli_tokens < 1000)
+      return false;
+    b.milli_tokens -= 1000;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_admission_control::can_run(call_class cls, const std::string& call_name) const
+  {
+    if (cls == call_class_heavy && m_config.heavy_calls_max && m_heavy_running_calls >= m_config.heavy_calls_max)
+      return false;
+    auto it_limit = m_config.method_limits.find(call_name);
+    if (it_limit != m_config.method_limits.end())
+    {
+      auto it_running = m_running_by_name.find(call_name);
+      if (it_running != m_running_by_name.end() && it_running->second >= it_limit->second)
+        return false;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  size_t rpc_admission_control::get_non_critical_calls_max() const
+  {
+    return m_config.threads_count - m_config.reserved_threads;
+  }
+}
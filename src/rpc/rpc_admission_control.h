@@ -0,0 +1,107 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "net/http_server_handlers_map2.h"
+
+namespace currency
+{
+  /************************************************************************/
+  /* Admission of rpc calls to the server threads. Block and tx           */
+  /* submission and mining calls always go; the rest may be limited per   */
+  /* method and for the heavy ones as a whole, and are kept off the       */
+  /* threads reserved for the former. A call that can't go waits for a    */
+  /* while and then is rejected as busy. Each ip may also have a request  */
+  /* rate limit (token bucket).                                           */
+  /************************************************************************/
+  class rpc_admission_control : public epee::net_utils::http::i_call_admission
+  {
+  public:
+    enum call_class
+    {
+      call_class_critical = 0,
+      call_class_normal,
+      call_class_heavy
+    };
+
+    struct config
+    {
+      size_t threads_count = 1;
+      size_t reserved_threads = 0;                  // for the critical calls only
+      size_t heavy_calls_max = 0;                   // heavy calls running at once, 0 means no limit
+      std::map<std::string, size_t> method_limits;  // call name => calls running at once
+      uint64_t max_queue_ms = 0;                    // how long a call may wait to go before it's rejected
+      uint64_t ip_rate = 0;                         // requests per second for each ip, 0 means unlimited
+      uint64_t ip_burst = 0;                        // requests an ip may make at once, at least ip_rate
+    };
+
+    struct stat
+    {
+      uint64_t admitted;
+      uint64_t rejected_busy;
+      uint64_t rejected_rate_limited;
+      uint64_t running;
+      uint64_t waiting;
+    };
+
+    // time of the admitted calls from enter() to leave(), without the waiting
+    struct call_latency_stat
+    {
+      uint64_t count = 0;
+      uint64_t sum_us = 0;
+      std::vector<uint64_t> buckets;  // calls that took no longer than get_latency_buckets_us()[i], not cumulative
+    };
+
+    rpc_admission_control();
+
+    void set_config(const config& cfg);
+    void get_stat(stat& st) const;
+    void get_calls_latency(std::map<std::string, call_latency_stat>& latency) const;
+    static const std::vector<uint64_t>& get_latency_buckets_us();
+
+    static call_class get_call_class(const std::string& call_name);
+    // "name:limit,name:limit,..."
+    static bool parse_method_limits(const std::string& str, std::map<std::string, size_t>& limits);
+
+    virtual result enter(const std::string& call_name, const epee::net_utils::connection_context_base& context) override;
+    virtual void leave(const std::string& call_name) override;
+
+    // for the tests, the time is given
+    result enter(const std::string& call_name, uint32_t ip, uint64_t now_ms);
+    void add_call_latency(const std::string& call_name, uint64_t us);
+
+  private:
+    struct ip_bucket
+    {
+      uint64_t milli_tokens;
+      uint64_t last_update_ms;
+    };
+
+    bool take_ip_token(uint32_t ip, uint64_t now_ms);
+    bool can_run(call_class cls, const std::string& call_name) const;
+    size_t get_non_critical_calls_max() const;
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_cv;
+    config m_config;
+    size_t m_non_critical_calls;  // running and waiting
+    size_t m_waiting_calls;
+    size_t m_running_calls;
+    size_t m_heavy_running_calls;
+    std::unordered_map<std::string, size_t> m_running_by_name;
+    std::map<std::string, call_latency_stat> m_latency_by_name;
+    std::unordered_map<uint32_t, ip_bucket> m_ip_buckets;
+    uint64_t m_ip_buckets_cleanup_ms;
+    uint64_t m_admitted;
+    uint64_t m_rejected_busy;
+    uint64_t m_rejected_rate_limited;
+  };
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc_response_cache.h"
+
+namespace currency
+{
+  rpc_response_cache::rpc_response_cache(std::function<crypto::hash()> get_top_block_id, uint64_t max_bytes)
+    : m_get_top_block_id(get_top_block_id)
+    , m_max_bytes(max_bytes)
+    , m_bytes(0)
+    , m_top_block_id(null_hash)
+    , m_generation(0)
+    , m_hits(0)
+    , m_misses(0)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_response_cache::set_max_bytes(uint64_t max_bytes)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_max_bytes = max_bytes;
+    while (m_bytes > m_max_bytes)
+      erase_lru_entry();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_response_cache::get(const std::string& key, std::string& result_json, uint64_t& generation)
+  {
+    crypto::hash top_block_id = m_get_top_block_id();
+    std::lock_guard<std::mutex> lk(m_lock);
+    if (!m_max_bytes)
+      return false;
+    if (top_block_id != m_top_block_id)
+    {
+      clear();
+      m_top_block_id = top_block_id;
+      ++m_generation;
+    }
+    generation = m_generation;
+
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+    {
+      ++m_misses;
+      return false;
+    }
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    result_json = it->second->result_json;
+    ++m_hits;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_response_cache::put_result(const std::string& key, uint64_t generation, const std::string& result_json)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    if (generation != m_generation || !m_max_bytes)
+      return; // made for another top block
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+      return; // another thread was faster
+    entry e{ key, result_json };
+    uint64_t entry_size = get_entry_size(e);
+    if (entry_size > m_max_bytes)
+      return;
+    while (m_bytes + entry_size > m_max_bytes)
+      erase_lru_entry();
+    m_entries.push_front(std::move(e));
+    m_index[key] = m_entries.begin();
+    m_bytes += entry_size;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_response_cache::erase_lru_entry()
+  {
+    const entry& e = m_entries.back();
+    m_bytes -= get_entry_size(e);
+    m_index.erase(e.key);
+    m_entries.pop_back();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_response_cache::clear()
+  {
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_response_cache::get_stat(stat& st) const
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    st.hits = m_hits;
+    st.misses = m_misses;
+    st.entries_count = m_entries.size();
+    st.bytes = m_bytes;
+  }
+}
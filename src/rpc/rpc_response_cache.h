@@ -0,0 +1,126 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "crypto/crypto.h"
+#include "core_rpc_server_commands_defs.h"
+
+namespace currency
+{
+  /************************************************************************/
+  /* Serialized json rpc results by method and params, least recently     */
+  /* used are dropped when it is full. The results hold depth, spent      */
+  /* flags and alike, so all of them go when the top block changes        */
+  /* (a new block or a reorganization).                                   */
+  /************************************************************************/
+  class rpc_response_cache
+  {
+  public:
+    struct stat
+    {
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t entries_count;
+      uint64_t bytes;
+    };
+
+    explicit rpc_response_cache(std::function<crypto::hash()> get_top_block_id, uint64_t max_bytes = 0);
+
+    // 0 turns it off
+    void set_max_bytes(uint64_t max_bytes);
+
+    // generation is to be given to put() for the results made after a miss
+    bool get(const std::string& key, std::string& result_json, uint64_t& generation);
+
+    template<class t_result>
+    void put(const std::string& key, uint64_t generation, const t_result& result, const std::string& result_json)
+    {
+      if (is_cacheable(result))
+        put_result(key, generation, result_json);
+    }
+
+    void get_stat(stat& st) const;
+
+  private:
+    struct entry
+    {
+      std::string key;
+      std::string result_json;
+    };
+    typedef std::list<entry> entries_container;
+
+    template<class t_result>
+    static bool is_cacheable(const t_result& /*result*/) { return true; }
+    // pool txs may go without a new block
+    static bool is_cacheable(const COMMAND_RPC_GET_TX_DETAILS::response& result) { return result.tx_info.keeper_block >= 0; }
+
+    void put_result(const std::string& key, uint64_t generation, const std::string& result_json);
+    void erase_lru_entry();
+    void clear();
+    static uint64_t get_entry_size(const entry& e) { return e.key.size() * 2 + e.result_json.size(); } // the key is in the index as well
+
+    std::function<crypto::hash()> m_get_top_block_id;
+    mutable std::mutex m_lock;
+    uint64_t m_max_bytes;
+    uint64_t m_bytes;
+    entries_container m_entries;   // most recently used first
+    std::unordered_map<std::string, entries_container::iterator> m_index;
+    crypto::hash m_top_block_id;
+    uint64_t m_generation;
+    uint64_t m_hits;
+    uint64_t m_misses;
+  };
+
+  /************************************************************************/
+  /* The last serialized result of one method for a state that is rarely  */
+  /* changed, e.g. the list of all aliases. The same get()/put() as of    */
+  /* rpc_response_cache, so it works with MAP_JON_RPC_WE_CACHED; the      */
+  /* result is dropped once get_version() returns another value.          */
+  /************************************************************************/
+  class rpc_versioned_response_cache
+  {
+  public:
+    explicit rpc_versioned_response_cache(std::function<uint64_t()> get_version)
+      : m_get_version(get_version)
+      , m_version(0)
+      , m_entry_valid(false)
+    {}
+
+    bool get(const std::string& key, std::string& result_json, uint64_t& generation)
+    {
+      generation = m_get_version();
+      std::lock_guard<std::mutex> lk(m_lock);
+      if (!m_entry_valid || m_version != generation || m_key != key)
+        return false;
+      result_json = m_result_json;
+      return true;
+    }
+
+    template<class t_result>
+    void put(const std::string& key, uint64_t generation, const t_result& /*result*/, const std::string& result_json)
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      if (generation != m_get_version())
+        return; // made for another state
+      m_key = key;
+      m_result_json = result_json;
+      m_version = generation;
+      m_entry_valid = true;
+    }
+
+  private:
+    std::function<uint64_t()> m_get_version;
+    std::mutex m_lock;
+    std::string m_key;
+    std::string m_result_json;
+    uint64_t m_version;
+    bool m_entry_valid;
+  };
+}
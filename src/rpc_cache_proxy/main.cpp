@@ -0,0 +1,89 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "include_base_utils.h"
+#include "version.h"
+
+using namespace epee;
+
+#include <boost/program_options.hpp>
+#include "common/command_line.h"
+#include "common/util.h"
+#include "common/callstack_helper.h"
+#include "currency_core/currency_config.h"
+#include "rpc_cache_proxy.h"
+
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  try
+    {
+      TRY_ENTRY();
+
+  string_tools::set_module_name_and_folder(argv[0]);
+  log_space::get_set_log_detalisation_level(true, LOG_LEVEL_0);
+  log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
+  log_space::log_singletone::enable_channels("rpc_cache", false);
+
+  // setup custom callstack retrieving function
+  epee::misc_utils::get_callstack(tools::get_callstack);
+
+  po::options_description desc_options("Allowed options");
+  command_line::add_arg(desc_options, command_line::arg_help);
+  command_line::add_arg(desc_options, command_line::arg_version);
+  command_line::add_arg(desc_options, command_line::arg_log_dir);
+  command_line::add_arg(desc_options, command_line::arg_log_level);
+  currency::rpc_cache_proxy::init_options(desc_options);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return EXIT_FAILURE;
+
+  if (command_line::get_arg(vm, command_line::arg_help) || command_line::get_arg(vm, command_line::arg_version))
+  {
+    std::cout << CURRENCY_NAME << " rpc cache v" << PROJECT_VERSION_LONG << ENDL;
+    if (command_line::get_arg(vm, command_line::arg_help))
+      std::cout << ENDL << desc_options << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  if (command_line::has_arg(vm, command_line::arg_log_dir))
+    log_space::log_singletone::add_logger(LOGGER_FILE, log_space::log_singletone::get_default_log_file().c_str(), command_line::get_arg(vm, command_line::arg_log_dir).c_str());
+  if (command_line::has_arg(vm, command_line::arg_log_level))
+    log_space::get_set_log_detalisation_level(true, command_line::get_arg(vm, command_line::arg_log_level));
+  LOG_PRINT_L0(CURRENCY_NAME << " rpc cache v" << PROJECT_VERSION_LONG);
+
+  currency::rpc_cache_proxy proxy;
+  if (!proxy.init(vm))
+  {
+    LOG_ERROR("Failed to initialize rpc cache");
+    return EXIT_FAILURE;
+  }
+
+  tools::signal_handler::install([&proxy] {
+    proxy.send_stop_signal();
+  });
+
+  LOG_PRINT_L0("Starting rpc cache loop...");
+  proxy.run(proxy.get_threads_count(), true);
+  LOG_PRINT_L0("rpc cache loop stopped");
+
+  proxy.deinit();
+  LOG_PRINT("Stopped.", LOG_LEVEL_0);
+  return EXIT_SUCCESS;
+
+      CATCH_ENTRY_L0(__func__, EXIT_FAILURE);
+    }
+  catch (...)
+    {
+      return EXIT_FAILURE;
+    }
+}
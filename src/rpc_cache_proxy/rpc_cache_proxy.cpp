@@ -0,0 +1,323 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/algorithm/string/predicate.hpp>
+#include "include_base_utils.h"
+#include "rpc_cache_proxy.h"
+#include "common/command_line.h"
+#include "storages/http_abstract_invoke.h"
+#include "storages/portable_storage_template_helper.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+
+#undef LOG_DEFAULT_CHANNEL
+#define LOG_DEFAULT_CHANNEL "rpc_cache"
+ENABLE_CHANNEL_BY_DEFAULT("rpc_cache")
+
+namespace currency
+{
+  namespace
+  {
+    const command_line::arg_descriptor<std::string> arg_upstream_node          ("upstream-node", "Node whose rpc is cached, <host>:<port>", std::string("127.0.0.1:") + std::to_string(RPC_DEFAULT_PORT));
+    const command_line::arg_descriptor<std::string> arg_rpc_bind_ip            ("rpc-bind-ip", "", "127.0.0.1");
+    const command_line::arg_descriptor<std::string> arg_rpc_bind_port          ("rpc-bind-port", "", std::to_string(RPC_DEFAULT_PORT));
+    const command_line::arg_descriptor<size_t>      arg_rpc_threads            ("rpc-threads", "Number of the rpc server threads", 16);
+    const command_line::arg_descriptor<uint64_t>    arg_cache_size             ("cache-size-mb", "Size of the cache of the responses valid till the next block", RPC_CACHE_PROXY_DEFAULT_CACHE_SIZE_MB);
+    const command_line::arg_descriptor<uint64_t>    arg_tip_poll_interval      ("tip-poll-interval-ms", "How often the upstream's top block is checked, getinfo and the pool are cached for that long too", RPC_CACHE_PROXY_DEFAULT_TIP_POLL_INTERVAL_MS);
+    const command_line::arg_descriptor<unsigned int> arg_upstream_timeout      ("upstream-timeout-ms", "", RPC_CACHE_PROXY_DEFAULT_UPSTREAM_TIMEOUT_MS);
+
+    // results of these json rpc methods only change with the top block
+    const char* const tip_cached_json_rpc_methods[] = { "getblockheaderbyhash", "getblockheaderbyheight", "getlastblockheader", "get_blocks_details", "get_main_block_details",
+      "get_est_height_from_date", "get_tx_details", "get_asset_info", "get_all_alias_details", "get_alias_details", "get_alias_by_address", "get_alias_reward",
+      "get_current_core_tx_expiration_median" };
+    const char* const ttl_cached_json_rpc_methods[] = { "getinfo", "get_pool_info" };
+
+    struct json_rpc_method_only
+    {
+      std::string method;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(method)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    bool is_one_of(const std::string& s, const char* const* first, const char* const* last)
+    {
+      return std::find_if(first, last, [&](const char* x) { return s == x; }) != last;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_cache_proxy::rpc_cache_proxy()
+    : m_upstream_timeout(RPC_CACHE_PROXY_DEFAULT_UPSTREAM_TIMEOUT_MS)
+    , m_tip_poll_interval_ms(RPC_CACHE_PROXY_DEFAULT_TIP_POLL_INTERVAL_MS)
+    , m_threads_count(0)
+    , m_connections_count(0)
+    , m_tip_id(null_hash)
+    , m_tip_cache([this]() { return get_tip_id(); })
+    , m_stop(false)
+    , m_requests_count(0)
+    , m_forwarded_count(0)
+    , m_upstream_calls_count(0)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_cache_proxy::~rpc_cache_proxy()
+  {
+    stop_tip_watcher();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_cache_proxy::init_options(boost::program_options::options_description& desc)
+  {
+    command_line::add_arg(desc, arg_upstream_node);
+    command_line::add_arg(desc, arg_rpc_bind_ip);
+    command_line::add_arg(desc, arg_rpc_bind_port);
+    command_line::add_arg(desc, arg_rpc_threads);
+    command_line::add_arg(desc, arg_cache_size);
+    command_line::add_arg(desc, arg_tip_poll_interval);
+    command_line::add_arg(desc, arg_upstream_timeout);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_cache_proxy::init(const boost::program_options::variables_map& vm)
+  {
+    epee::net_utils::http::url_content u = AUTO_VAL_INIT(u);
+    std::string upstream = command_line::get_arg(vm, arg_upstream_node);
+    CHECK_AND_ASSERT_MES(epee::net_utils::parse_url(upstream, u) && !u.host.empty(), false, "wrong upstream node address: " << upstream);
+    m_upstream_host = u.host;
+    m_upstream_port = std::to_string(u.port ? u.port : RPC_DEFAULT_PORT);
+    m_upstream_timeout = command_line::get_arg(vm, arg_upstream_timeout);
+    m_tip_poll_interval_ms = std::max<uint64_t>(command_line::get_arg(vm, arg_tip_poll_interval), 1);
+    m_tip_cache.set_max_bytes(command_line::get_arg(vm, arg_cache_size) * 1024 * 1024);
+
+    if (!update_tip())
+      LOG_PRINT_YELLOW("Upstream node " << m_upstream_host << ":" << m_upstream_port << " is not available yet", LOG_LEVEL_0);
+    m_tip_watcher = std::thread([this]() { tip_watcher_loop(); });
+
+    // the upstream's responses come gzipped and are packed here again for the clients that accept it
+    set_response_compression(RPC_DEFAULT_COMPRESSION_THRESHOLD, 6, std::map<std::string, int>());
+    if (!epee::http_server_impl_base<rpc_cache_proxy>::init(command_line::get_arg(vm, arg_rpc_bind_port), command_line::get_arg(vm, arg_rpc_bind_ip)))
+      return false;
+    m_threads_count = command_line::get_arg(vm, arg_rpc_threads);
+    LOG_PRINT_L0("Caching rpc of " << m_upstream_host << ":" << m_upstream_port);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_cache_proxy::deinit()
+  {
+    stop_tip_watcher();
+    return epee::http_server_impl_base<rpc_cache_proxy>::deinit();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_cache_proxy::stop_tip_watcher()
+  {
+    {
+      std::lock_guard<std::mutex> lk(m_stop_lock);
+      m_stop = true;
+    }
+    m_stop_condition.notify_all();
+    if (m_tip_watcher.joinable())
+      m_tip_watcher.join();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_cache_proxy::cache_policy rpc_cache_proxy::get_cache_policy(const epee::net_utils::http::http_request_info& query_info) const
+  {
+    const std::string& uri = query_info.m_URI;
+    if (uri == "/getblocks.bin" || uri == "/get_o_indexes.bin")
+      return cache_policy_tip;
+    if (uri == "/getinfo" || uri == "/getheight" || uri == "/get_tx_pool.bin")
+      return cache_policy_ttl;
+    if (uri == "/json_rpc")
+    {
+      if (!query_info.m_body.empty() && query_info.m_body.front() != '{')
+        return cache_policy_none; // a batch or garbage
+      json_rpc_method_only req = AUTO_VAL_INIT(req);
+      if (!epee::serialization::load_t_from_json(req, query_info.m_body))
+        return cache_policy_none;
+      if (is_one_of(req.method, std::begin(tip_cached_json_rpc_methods), std::end(tip_cached_json_rpc_methods)))
+        return cache_policy_tip;
+      if (is_one_of(req.method, std::begin(ttl_cached_json_rpc_methods), std::end(ttl_cached_json_rpc_methods)))
+        return cache_policy_ttl;
+    }
+    return cache_policy_none;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_cache_proxy::is_cacheable(const std::string& uri, const upstream_response& rsp)
+  {
+    if (rsp.code != 200)
+      return false;
+    // a busy (syncing) node or a json rpc error is not worth keeping; the binary responses have the strings as they are, so it's the same check
+    if (rsp.body.find(API_RETURN_CODE_BUSY) != std::string::npos)
+      return false;
+    if (uri == "/json_rpc" && rsp.body.find("\"error\"") != std::string::npos)
+      return false;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_cache_proxy::handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& m_conn_context)
+  {
+    ++m_requests_count;
+    cache_policy policy = get_cache_policy(query_info);
+    upstream_response rsp;
+    if (!get_response(policy, query_info, rsp))
+    {
+      response.m_response_code = 502;
+      response.m_response_comment = "Bad Gateway";
+      return true;
+    }
+    response.m_response_code = rsp.code;
+    response.m_response_comment = rsp.comment;
+    response.m_body = std::move(rsp.body);
+    response.m_mime_tipe = boost::algorithm::ends_with(query_info.m_URI, ".bin") ? " application/octet-stream" : "application/json";
+    response.m_call_name = query_info.m_URI;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_cache_proxy::get_response(cache_policy policy, const epee::net_utils::http::http_request_info& query_info, upstream_response& rsp)
+  {
+    if (policy == cache_policy_none)
+    {
+      ++m_forwarded_count;
+      return forward(query_info.m_URI, query_info.m_http_method_str, query_info.m_body, rsp);
+    }
+
+    const std::string key = query_info.m_URI + '\n' + query_info.m_body;
+    uint64_t generation = 0;
+    if (policy == cache_policy_tip)
+    {
+      if (m_tip_cache.get(key, rsp.body, generation))
+      {
+        rsp.code = 200;
+        rsp.comment = "OK";
+        return true;
+      }
+    }
+    else
+    {
+      std::lock_guard<std::mutex> lk(m_ttl_lock);
+      auto it = m_ttl_cache.find(key);
+      if (it != m_ttl_cache.end() && it->second.expires_at > epee::misc_utils::get_tick_count())
+      {
+        rsp = it->second.rsp;
+        return true;
+      }
+    }
+
+    // the wallets ask for the same recent blocks at about the same time, it's one upstream call for all of them
+    return m_coalescer.call(key, rsp, [&](upstream_response& r)
+    {
+      if (!forward(query_info.m_URI, query_info.m_http_method_str, query_info.m_body, r))
+        return false;
+      if (!is_cacheable(query_info.m_URI, r))
+        return true;
+      if (policy == cache_policy_tip)
+      {
+        m_tip_cache.put(key, generation, r.body, r.body);
+      }
+      else
+      {
+        std::lock_guard<std::mutex> lk(m_ttl_lock);
+        if (m_ttl_cache.size() >= RPC_CACHE_PROXY_MAX_TTL_ENTRIES)
+          m_ttl_cache.clear();
+        m_ttl_cache[key] = ttl_entry{ r, epee::misc_utils::get_tick_count() + m_tip_poll_interval_ms };
+      }
+      return true;
+    });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_cache_proxy::forward(const std::string& uri, const std::string& method, const std::string& body, upstream_response& rsp)
+  {
+    ++m_upstream_calls_count;
+    std::unique_ptr<connection> pconnection = acquire_connection();
+    auto releaser = epee::misc_utils::create_scope_leave_handler([&]() { release_connection(std::move(pconnection)); });
+    if (!pconnection->is_connected() && !pconnection->connect(m_upstream_host, m_upstream_port, m_upstream_timeout))
+    {
+      LOG_PRINT_L1("Failed to connect to upstream node " << m_upstream_host << ":" << m_upstream_port);
+      return false;
+    }
+    const epee::net_utils::http::http_response_info* presponse = nullptr;
+    if (!pconnection->invoke(uri, method.empty() ? std::string("POST") : method, body, &presponse) || !presponse)
+    {
+      LOG_PRINT_L1("Upstream call " << uri << " failed");
+      return false;
+    }
+    rsp.code = presponse->m_response_code;
+    rsp.comment = presponse->m_response_comment;
+    rsp.body = presponse->m_body;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::unique_ptr<rpc_cache_proxy::connection> rpc_cache_proxy::acquire_connection()
+  {
+    std::unique_lock<std::mutex> lk(m_connections_lock);
+    m_connections_condition.wait(lk, [&]() { return !m_idle_connections.empty() || m_connections_count < RPC_CACHE_PROXY_MAX_UPSTREAM_CONNECTIONS; });
+    std::unique_ptr<connection> pconnection;
+    if (!m_idle_connections.empty())
+    {
+      pconnection = std::move(m_idle_connections.back());
+      m_idle_connections.pop_back();
+      return pconnection;
+    }
+    ++m_connections_count;
+    lk.unlock();
+    pconnection.reset(new connection());
+    pconnection->set_compression(true, 0);
+    return pconnection;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_cache_proxy::release_connection(std::unique_ptr<connection>&& pconnection)
+  {
+    std::lock_guard<std::mutex> lk(m_connections_lock);
+    m_idle_connections.push_back(std::move(pconnection));
+    m_connections_condition.notify_one();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  crypto::hash rpc_cache_proxy::get_tip_id()
+  {
+    std::lock_guard<std::mutex> lk(m_tip_lock);
+    return m_tip_id;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_cache_proxy::update_tip()
+  {
+    COMMAND_RPC_GET_LAST_BLOCK_HEADER::request req;
+    COMMAND_RPC_GET_LAST_BLOCK_HEADER::response rsp = AUTO_VAL_INIT(rsp);
+    bool r = false;
+    {
+      std::unique_ptr<connection> pconnection = acquire_connection();
+      auto releaser = epee::misc_utils::create_scope_leave_handler([&]() { release_connection(std::move(pconnection)); });
+      r = (pconnection->is_connected() || pconnection->connect(m_upstream_host, m_upstream_port, m_upstream_timeout))
+        && epee::net_utils::invoke_http_json_rpc("/json_rpc", "getlastblockheader", req, rsp, *pconnection, m_upstream_timeout, "POST");
+    }
+    crypto::hash tip_id = null_hash;
+    if (!r || rsp.status != API_RETURN_CODE_OK || !epee::string_tools::parse_tpod_from_hex_string(rsp.block_header.hash, tip_id))
+      return false;
+
+    std::lock_guard<std::mutex> lk(m_tip_lock);
+    if (tip_id != m_tip_id)
+    {
+      LOG_PRINT_L1("Upstream top block: " << rsp.block_header.height << " " << tip_id);
+      m_tip_id = tip_id;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_cache_proxy::tip_watcher_loop()
+  {
+    uint64_t last_stat_time = epee::misc_utils::get_tick_count();
+    std::unique_lock<std::mutex> lk(m_stop_lock);
+    while (!m_stop_condition.wait_for(lk, std::chrono::milliseconds(m_tip_poll_interval_ms), [&]() { return m_stop; }))
+    {
+      lk.unlock();
+      if (!update_tip())
+        LOG_PRINT_L1("Failed to get the upstream's top block");
+
+      uint64_t now = epee::misc_utils::get_tick_count();
+      if (now - last_stat_time >= RPC_CACHE_PROXY_STAT_INTERVAL_MS)
+      {
+        last_stat_time = now;
+        rpc_response_cache::stat st = AUTO_VAL_INIT(st);
+        m_tip_cache.get_stat(st);
+        LOG_PRINT_L0("requests: " << m_requests_count << ", upstream calls: " << m_upstream_calls_count << " (forwarded: " << m_forwarded_count << ")"
+          << ", cache hits/misses: " << st.hits << "/" << st.misses << ", entries: " << st.entries_count << ", " << st.bytes / 1024 << " KB");
+      }
+      lk.lock();
+    }
+  }
+}
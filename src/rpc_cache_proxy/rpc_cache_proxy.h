@@ -0,0 +1,117 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include "net/http_server_impl_base.h"
+#include "net/http_client.h"
+#include "rpc/rpc_response_cache.h"
+#include "common/request_coalescer.h"
+
+#define RPC_CACHE_PROXY_DEFAULT_CACHE_SIZE_MB        256
+#define RPC_CACHE_PROXY_DEFAULT_TIP_POLL_INTERVAL_MS 1000
+#define RPC_CACHE_PROXY_DEFAULT_UPSTREAM_TIMEOUT_MS  20000
+#define RPC_CACHE_PROXY_MAX_UPSTREAM_CONNECTIONS     16
+#define RPC_CACHE_PROXY_MAX_TTL_ENTRIES              1024
+#define RPC_CACHE_PROXY_STAT_INTERVAL_MS             60000
+
+namespace currency
+{
+  /************************************************************************/
+  /* Caching front of a node's rpc, so one full node may back many public */
+  /* remote nodes. The responses that are the same as long as the         */
+  /* upstream's top block is (getblocks.bin, get_o_indexes.bin, block     */
+  /* headers and alike) are kept till it changes, the top block is polled */
+  /* for that; getinfo and the pool are kept for the poll interval.       */
+  /* Identical requests in flight make one upstream call, anything else   */
+  /* (sendrawtransaction, getblocktemplate...) is just forwarded.         */
+  /************************************************************************/
+  class rpc_cache_proxy : public epee::http_server_impl_base<rpc_cache_proxy>
+  {
+  public:
+    typedef epee::net_utils::connection_context_base connection_context;
+
+    rpc_cache_proxy();
+    ~rpc_cache_proxy();
+
+    static void init_options(boost::program_options::options_description& desc);
+    bool init(const boost::program_options::variables_map& vm);
+    bool deinit();
+    size_t get_threads_count() const { return m_threads_count; }
+
+    bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& m_conn_context) override;
+
+  private:
+    enum cache_policy
+    {
+      cache_policy_none,  // forwarded
+      cache_policy_tip,   // kept till the upstream's top block changes
+      cache_policy_ttl    // kept for the tip poll interval
+    };
+
+    struct upstream_response
+    {
+      int code = 0;
+      std::string comment;
+      std::string body;
+    };
+
+    typedef epee::net_utils::http::http_simple_client connection;
+
+    cache_policy get_cache_policy(const epee::net_utils::http::http_request_info& query_info) const;
+    bool get_response(cache_policy policy, const epee::net_utils::http::http_request_info& query_info, upstream_response& rsp);
+    bool forward(const std::string& uri, const std::string& method, const std::string& body, upstream_response& rsp);
+    static bool is_cacheable(const std::string& uri, const upstream_response& rsp);
+
+    std::unique_ptr<connection> acquire_connection();
+    void release_connection(std::unique_ptr<connection>&& pconnection);
+
+    void tip_watcher_loop();
+    void stop_tip_watcher();
+    bool update_tip();
+    crypto::hash get_tip_id();
+
+    std::string m_upstream_host;
+    std::string m_upstream_port;
+    unsigned int m_upstream_timeout;
+    uint64_t m_tip_poll_interval_ms;
+    size_t m_threads_count;
+
+    std::mutex m_connections_lock;
+    std::condition_variable m_connections_condition;
+    std::vector<std::unique_ptr<connection>> m_idle_connections;
+    size_t m_connections_count;
+
+    std::mutex m_tip_lock;
+    crypto::hash m_tip_id;
+    rpc_response_cache m_tip_cache; // by uri and body
+
+    struct ttl_entry
+    {
+      upstream_response rsp;
+      uint64_t expires_at;
+    };
+    std::mutex m_ttl_lock;
+    std::unordered_map<std::string, ttl_entry> m_ttl_cache; // by uri and body
+
+    tools::request_coalescer<std::string, upstream_response> m_coalescer;
+
+    std::thread m_tip_watcher;
+    std::mutex m_stop_lock;
+    std::condition_variable m_stop_condition;
+    bool m_stop;
+
+    std::atomic<uint64_t> m_requests_count;
+    std::atomic<uint64_t> m_forwarded_count;  // uncacheable ones
+    std::atomic<uint64_t> m_upstream_calls_count;
+  };
+}
@@ -9,6 +9,9 @@
 #pragma once
 
 #include <cassert>
+#include <cstring>
+#include <limits>
+#include <string>
 #include <iostream>
 #include <iterator>
 #include <boost/type_traits/make_unsigned.hpp>
@@ -122,6 +125,137 @@ protected:
   std::streamoff eof_pos_;
 };
 
+/*
+  Input from memory without std::istream: a bounds-checked cursor over the blob that also carries the stream state.
+  Only the part of the std::istream interface used by the serializers is provided, with the same semantics
+  (a read past the end sets eofbit and failbit, a truncated varint doesn't change the state).
+*/
+class binary_memory_istream
+{
+public:
+  binary_memory_istream(const void* p, size_t size)
+    : m_pos(static_cast<const uint8_t*>(p))
+    , m_end(static_cast<const uint8_t*>(p) + size)
+    , m_state(std::ios_base::goodbit)
+  {}
+
+  bool good() const { return m_state == std::ios_base::goodbit; }
+  std::ios_base::iostate rdstate() const { return m_state; }
+  void setstate(std::ios_base::iostate s) { m_state |= s; }
+  void clear(std::ios_base::iostate s = std::ios_base::goodbit) { m_state = s; }
+  int peek() const { return m_pos == m_end ? EOF : *m_pos; }
+
+  size_t size_left() const { return static_cast<size_t>(m_end - m_pos); }
+  const uint8_t*& pos() { return m_pos; }
+  const uint8_t* end() const { return m_end; }
+
+  void read(void* buf, size_t len)
+  {
+    if (size_left() < len)
+    {
+      len = size_left();
+      setstate(std::ios_base::eofbit | std::ios_base::failbit);
+    }
+    memcpy(buf, m_pos, len);
+    m_pos += len;
+  }
+
+private:
+  const uint8_t* m_pos;
+  const uint8_t* const m_end;
+  std::ios_base::iostate m_state;
+};
+
+// the same as binary_archive<false>, but reads a blob in place through binary_memory_istream
+template <bool W>
+struct binary_memory_archive;
+
+template <>
+struct binary_memory_archive<false> : public binary_archive_base<binary_memory_istream, false>
+{
+  explicit binary_memory_archive(stream_type &s) : base_type(s) { }
+
+  template <class T>
+  void serialize_int(T &v)
+  {
+    serialize_uint(*(typename boost::make_unsigned<T>::type *)&v);
+  }
+
+  template <class T>
+  void serialize_uint(T &v)
+  {
+    uint8_t buf[sizeof(T)] = {};
+    stream_.read(buf, sizeof(T));
+    T ret = 0;
+    for (size_t i = 0; i < sizeof(T); i++)
+      ret |= static_cast<T>(buf[i]) << (8 * i);
+    v = ret;
+  }
+  void serialize_blob(void *buf, size_t len, const char *delimiter="") {
+    stream_.read(buf, len);
+  }
+
+  template <class T>
+  void serialize_varint(T &v)
+  {
+    serialize_uvarint(*(typename boost::make_unsigned<T>::type *)(&v));
+  }
+
+  template <class T>
+  void serialize_uvarint(T &v)
+  {
+    const uint8_t* end = stream_.end();
+    tools::read_varint<std::numeric_limits<T>::digits>(stream_.pos(), end, v); // XXX handle failure, see binary_archive<false>
+  }
+  void begin_array(size_t &s)
+  {
+    serialize_varint(s);
+  }
+  void begin_array() { }
+
+  void delimit_array() { }
+  void end_array() { }
+
+  void begin_string(const char *delimiter="\"") { }
+  void end_string(const char *delimiter="\"") { }
+
+  void read_variant_tag(variant_tag_type &t) {
+    serialize_int(t);
+  }
+
+  size_t remaining_bytes() {
+    if (!stream_.good())
+      return 0;
+    return stream_.size_left();
+  }
+};
+
+/*
+  Output to memory without std::ostream: appends to a caller's buffer, so a buffer reused between calls
+  keeps its capacity and the result doesn't have to be copied out of a stringstream.
+*/
+class binary_memory_ostream
+{
+public:
+  explicit binary_memory_ostream(std::string& buff)
+    : m_buff(buff)
+    , m_state(std::ios_base::goodbit)
+  {}
+
+  bool good() const { return m_state == std::ios_base::goodbit; }
+  std::ios_base::iostate rdstate() const { return m_state; }
+  void setstate(std::ios_base::iostate s) { m_state |= s; }
+  void clear(std::ios_base::iostate s = std::ios_base::goodbit) { m_state = s; }
+
+  void put(char c) { m_buff.push_back(c); }
+  void write(const char* p, size_t len) { m_buff.append(p, len); }
+  std::string& buffer() { return m_buff; }
+
+private:
+  std::string& m_buff;
+  std::ios_base::iostate m_state;
+};
+
 template <>
 struct binary_archive<true> : public binary_archive_base<std::ostream, true>
 {
@@ -172,4 +306,56 @@ struct binary_archive<true> : public binary_archive_base<std::ostream, true>
   }
 };
 
+// the same as binary_archive<true>, but appends to a std::string through binary_memory_ostream
+template <>
+struct binary_memory_archive<true> : public binary_archive_base<binary_memory_ostream, true>
+{
+  explicit binary_memory_archive(stream_type &s) : base_type(s) { }
+
+  template <class T>
+  void serialize_int(T v)
+  {
+    serialize_uint(static_cast<typename boost::make_unsigned<T>::type>(v));
+  }
+  template <class T>
+  void serialize_uint(T v)
+  {
+    char buf[sizeof(T)];
+    for (size_t i = 0; i < sizeof(T); i++) {
+      buf[i] = (char)(v & 0xff);
+      if (1 < sizeof(T)) {
+        v >>= 8;
+      }
+    }
+    stream_.write(buf, sizeof(T));
+  }
+  void serialize_blob(void *buf, size_t len, const char *delimiter="") { stream_.write((char *)buf, len); }
+
+  template <class T>
+  void serialize_varint(T &v)
+  {
+    serialize_uvarint(*(typename boost::make_unsigned<T>::type *)(&v));
+  }
+
+  template <class T>
+  void serialize_uvarint(T &v)
+  {
+    tools::write_varint(std::back_inserter(stream_.buffer()), v);
+  }
+  void begin_array(size_t s)
+  {
+    serialize_varint(s);
+  }
+  void begin_array() { }
+  void delimit_array() { }
+  void end_array() { }
+
+  void begin_string(const char *delimiter="\"") { }
+  void end_string(const char *delimiter="\"") { }
+
+  void write_variant_tag(variant_tag_type t) {
+    serialize_int(t);
+  }
+};
+
 POP_VS_WARNINGS
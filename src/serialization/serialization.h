@@ -224,25 +224,29 @@ namespace serialization {
 template<class t_object>
 bool t_serializable_object_to_blob(const t_object& to, std::string& b_blob)
 {
-  std::stringstream ss;
-  binary_archive<true> ba(ss);
-  bool r = ::serialization::serialize(ba, const_cast<t_object&>(to));
-  b_blob = ss.str();
-  return r;
+  b_blob.clear(); // keeps the capacity, so a buffer reused by the caller doesn't reallocate
+  binary_memory_ostream os(b_blob);
+  binary_memory_archive<true> ba(os);
+  return ::serialization::serialize(ba, const_cast<t_object&>(to));
 }
 //---------------------------------------------------------------
 template<class t_object>
-bool t_unserializable_object_from_blob(t_object& to, const std::string& blob)
+bool t_unserializable_object_from_blob(t_object& to, const void* p_blob, size_t blob_size)
 {
-  std::stringstream ss;
-  ss << blob;
-  binary_archive<false> ba(ss);
+  binary_memory_istream is(p_blob, blob_size);
+  binary_memory_archive<false> ba(is);
   bool r = ::serialization::serialize(ba, to);
   CHECK_AND_ASSERT_MES(r, false, "Failed to parse block from blob");
   return true;
 }
 //---------------------------------------------------------------
 template<class t_object>
+bool t_unserializable_object_from_blob(t_object& to, const std::string& blob)
+{
+  return t_unserializable_object_from_blob(to, blob.data(), blob.size());
+}
+//---------------------------------------------------------------
+template<class t_object>
 std::string t_serializable_object_to_blob(const t_object& to)
 {
   std::string b;
@@ -31,6 +31,38 @@ namespace serialization
       ar.serialize_varint(e);
       return true;
     }
+
+    template <typename Archive, class T>
+    bool load_vector_elements(Archive& ar, std::vector<T>& v, size_t cnt, boost::false_type /*is_blob_type*/)
+    {
+      v.reserve(cnt);
+      for (size_t i = 0; i < cnt; i++) {
+        if (i > 0)
+          ar.delimit_array();
+
+        T t = T();
+        if (!::serialization::detail::serialize_container_element(ar, t))
+          return false;
+        if (!ar.stream().good())
+          return false;
+        v.push_back(t);
+      }
+      return true;
+    }
+
+    // blob type elements lie back to back, so they are read all at once
+    template <typename Archive, class T>
+    bool load_vector_elements(Archive& ar, std::vector<T>& v, size_t cnt, boost::true_type /*is_blob_type*/)
+    {
+      if (ar.remaining_bytes() / sizeof(T) < cnt) {
+        ar.stream().setstate(std::ios::failbit);
+        return false;
+      }
+      v.resize(cnt);
+      if (cnt != 0)
+        ar.serialize_blob(v.data(), cnt * sizeof(T));
+      return ar.stream().good();
+    }
   }
 }
 
@@ -49,18 +81,8 @@ bool do_serialize(Archive<false> &ar, std::vector<T> &v)
     return false;
   }
 
-  v.reserve(cnt);
-  for (size_t i = 0; i < cnt; i++) {
-    if (i > 0)
-      ar.delimit_array();
-    
-    T t = T();
-    if (!::serialization::detail::serialize_container_element(ar, t))
-      return false;
-    if (!ar.stream().good())
-      return false;
-    v.push_back(t);
-  }
+  if (!::serialization::detail::load_vector_elements(ar, v, cnt, typename is_blob_type<T>::type()))
+    return false;
   ar.end_array();
   return true;
 }
@@ -18,10 +18,9 @@ inline bool do_serialize(Archive<false>& ar, std::string& str)
     return false;
   }
 
-  std::unique_ptr<std::string::value_type[]> buf(new std::string::value_type[size]);
-  ar.serialize_blob(buf.get(), size);
-  str.erase();
-  str.append(buf.get(), size);
+  str.resize(size);
+  if (size)
+    ar.serialize_blob(&str[0], size);
   return true;
 }
 
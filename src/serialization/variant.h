@@ -19,6 +19,12 @@ struct variant_serialization_traits
 {
 };
 
+// binary_memory_archive reads the same format, so it uses the binary_archive tags
+template <bool W, class T>
+struct variant_serialization_traits<binary_memory_archive<W>, T> : public variant_serialization_traits<binary_archive<W>, T>
+{
+};
+
 template <class Archive, class Variant, class TBegin, class TEnd>
 struct variant_reader
 {
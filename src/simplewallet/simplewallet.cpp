@@ -127,7 +127,7 @@ namespace
   const command_line::arg_descriptor<std::string>   arg_wallet_file  ("wallet-file", "Use wallet <arg>", "");
   const command_line::arg_descriptor<std::string>   arg_generate_new_wallet  ("generate-new-wallet", "Generate new wallet and save it to <arg> or <address>.wallet by default", "");
   const command_line::arg_descriptor<std::string>   arg_generate_new_auditable_wallet  ("generate-new-auditable-wallet", "Generate new auditable wallet and store it to <arg>", "");
-  const command_line::arg_descriptor<std::string>   arg_daemon_address  ("daemon-address", "Use daemon instance at <host>:<port>", "");
+  const command_line::arg_descriptor<std::string>   arg_daemon_address  ("daemon-address", "Use daemon instance at <host>:<port>, or several ones separated by commas (the best of them is used)", "");
   const command_line::arg_descriptor<std::string>   arg_daemon_host  ("daemon-host", "Use daemon instance at host <arg> instead of localhost", "");
   const command_line::arg_descriptor<std::string>   arg_password  ("password", "Wallet password");
   const command_line::arg_descriptor<bool>          arg_dont_refresh  ( "no-refresh", "Do not refresh after load");
@@ -137,6 +137,7 @@ namespace
   const command_line::arg_descriptor<std::string>   arg_pos_mining_reward_address  ( "pos-mining-reward-address", "Block reward will be sent to the giving address if specified", "" );
   const command_line::arg_descriptor<std::string>   arg_pos_mining_defrag  ( "pos-mining-defrag", "<min_outs_cnt>,<max_outs_cnt>,<amount_limit>|disable Generate defragmentation tx for small outputs each time a PoS block is found. Disabled by default. If empty string given, the default params used: " STR(DEFAULT_WALLET_MIN_UTXO_COUNT_FOR_DEFRAGMENTATION_TX) "," STR(DEFAULT_WALLET_MAX_UTXO_COUNT_FOR_DEFRAGMENTATION_TX) ",1.0", "disable" );
   const command_line::arg_descriptor<std::string>   arg_restore_wallet  ( "restore-wallet", "Restore wallet from seed phrase or tracking seed and save it to <arg>", "" );
+  const command_line::arg_descriptor<uint64_t>      arg_restore_height  ( "restore-height", "With --restore-wallet: start synchronization from block <arg> instead of the height estimated from the seed's creation date (for seeds without a date or with a wrong one)", 0 );
   const command_line::arg_descriptor<bool>          arg_offline_mode  ( "offline-mode", "Don't connect to daemon, work offline (for cold-signing process)");
   const command_line::arg_descriptor<std::string>   arg_scan_for_wallet  ( "scan-for-wallet", "");
   const command_line::arg_descriptor<std::string>   arg_addr_to_compare  ( "addr-to-compare", "");
@@ -144,6 +145,7 @@ namespace
   const command_line::arg_descriptor<unsigned int>  arg_set_timeout("set-timeout", "Set timeout for the wallet");
   const command_line::arg_descriptor<std::string>   arg_voting_config_file("voting-config-file", "Set voting config instead of getting if from daemon", "");
   const command_line::arg_descriptor<bool>          arg_no_password_confirmations("no-password-confirmation", "Enable/Disable password confirmation for transactions", false);
+  const command_line::arg_descriptor<bool>          arg_use_store_journal("use-store-journal", "Store only the changes of the wallet into a journal file next to it, the wallet file is rewritten in full when the journal grows bigger than it", false);
 
   const command_line::arg_descriptor< std::vector<std::string> > arg_command  ("command", "");
 
@@ -315,6 +317,7 @@ simple_wallet::simple_wallet()
   m_cmd_binder.set_handler("scan_transfers_for_ki", boost::bind(&simple_wallet::scan_transfers_for_ki, this,ph::_1), "Rescan transfers for key image");
   m_cmd_binder.set_handler("print_utxo_distribution", boost::bind(&simple_wallet::print_utxo_distribution, this,ph::_1), "Prints utxo distribution");
   m_cmd_binder.set_handler("sweep_below", boost::bind(&simple_wallet::sweep_below, this,ph::_1), "sweep_below <mixin_count> <address> <amount_lower_limit> [payment_id] -  Tries to transfers all coins with amount below the given limit to the given address");
+  m_cmd_binder.set_handler("consolidate_below", boost::bind(&simple_wallet::consolidate_below, this,ph::_1), "consolidate_below <mixin_count> <address> <amount_lower_limit> [max_txs] -  Transfers coins with amount below the given limit to the given address with up to max_txs (100 by default) transactions, could be called again to go on after interruption");
   m_cmd_binder.set_handler("sweep_bare_outs", boost::bind(&simple_wallet::sweep_bare_outs, this,ph::_1), "sweep_bare_outs - Transfers all bare unspent outputs to itself. Uses several txs if necessary.");
   
   m_cmd_binder.set_handler("address", boost::bind(&simple_wallet::print_address, this,ph::_1), "Show current wallet public address");
@@ -408,6 +411,11 @@ void process_wallet_command_line_params(const po::variables_map& vm, tools::wall
     wal.set_connectivity_options(command_line::get_arg(vm, arg_set_timeout));
   }
 
+  if (command_line::get_arg(vm, arg_use_store_journal))
+  {
+    wal.set_use_store_journal(true);
+  }
+
 }
 //----------------------------------------------------------------------------------------------------
 bool simple_wallet::init(const boost::program_options::variables_map& vm)
@@ -545,6 +553,7 @@ void simple_wallet::handle_command_line(const boost::program_options::variables_
   m_do_not_set_date = command_line::get_arg(vm, arg_dont_set_date);
   m_do_pos_mining   = command_line::get_arg(vm, arg_do_pos_mining);
   m_restore_wallet  = command_line::get_arg(vm, arg_restore_wallet);
+  m_restore_height  = command_line::get_arg(vm, arg_restore_height);
   m_disable_tor     = command_line::get_arg(vm, arg_disable_tor_relay);
   m_voting_config_file = command_line::get_arg(vm, arg_voting_config_file);
   m_no_password_confirmations = command_line::get_arg(vm, arg_no_password_confirmations);  
@@ -653,6 +662,12 @@ bool simple_wallet::restore_wallet(const std::string& wallet_file, const std::st
     display_vote_info(*m_wallet);
     if (m_do_not_set_date)
       m_wallet->reset_creation_time(0);
+    if (m_restore_height != 0)
+    {
+      // blocks below it are neither downloaded nor scanned
+      m_wallet->set_minimum_height(m_restore_height);
+      message_writer() << "Synchronization will start from height " << m_restore_height;
+    }
   }
   catch (const std::exception& e)
   {
@@ -2648,6 +2663,60 @@ bool simple_wallet::sweep_below(const std::vector<std::string> &args)
   return true;
 }
 //----------------------------------------------------------------------------------------------------
+bool simple_wallet::consolidate_below(const std::vector<std::string> &args)
+{
+  CONFIRM_WITH_PASSWORD();
+  SIMPLE_WALLET_BEGIN_TRY_ENTRY();
+  if (args.size() < 3 || args.size() > 4)
+  {
+    fail_msg_writer() << "invalid agruments count: " << args.size() << ", expected 3 or 4";
+    return true;
+  }
+
+  size_t fake_outs_count = 0;
+  if (!string_tools::get_xtype_from_string(fake_outs_count, args[0]))
+  {
+    fail_msg_writer() << "mixin_count should be non-negative integer, got " << args[0];
+    return true;
+  }
+
+  currency::account_public_address addr;
+  currency::payment_id_t integrated_payment_id;
+  if (!m_wallet->get_transfer_address(args[1], addr, integrated_payment_id) || !integrated_payment_id.empty())
+  {
+    fail_msg_writer() << "wrong address: " << args[1] << ", integrated addresses are not supported";
+    return true;
+  }
+
+  uint64_t amount = 0;
+  if (!currency::parse_amount(args[2], amount) || amount == 0)
+  {
+    fail_msg_writer() << "incorrect amount: " << args[2];
+    return true;
+  }
+
+  size_t max_txs = 100;
+  if (args.size() == 4 && (!string_tools::get_xtype_from_string(max_txs, args[3]) || max_txs == 0))
+  {
+    fail_msg_writer() << "max_txs should be positive integer, got " << args[3];
+    return true;
+  }
+
+  uint64_t fee = m_wallet->get_core_runtime_config().tx_default_fee;
+  size_t outs_swept = 0;
+  uint64_t amount_swept = 0;
+  std::vector<crypto::hash> tx_ids;
+  m_wallet->consolidate_outputs_below(fake_outs_count, addr, amount, fee, max_txs, outs_swept, amount_swept, tx_ids);
+
+  success_msg_writer(false) << outs_swept << " outputs (" << print_money_brief(amount_swept) << " coins) below the specified limit of " << print_money_brief(amount)
+    << " were swept with " << tx_ids.size() << " transactions";
+  for (const auto& id : tx_ids)
+    success_msg_writer(true) << "tx: " << id;
+
+  SIMPLE_WALLET_CATCH_TRY_ENTRY();
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
 bool simple_wallet::sweep_bare_outs(const std::vector<std::string> &args)
 {
   CONFIRM_WITH_PASSWORD();
@@ -2927,6 +2996,7 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_params, arg_pos_mining_reward_address);
   command_line::add_arg(desc_params, arg_pos_mining_defrag);
   command_line::add_arg(desc_params, arg_restore_wallet);
+  command_line::add_arg(desc_params, arg_restore_height);
   command_line::add_arg(desc_params, arg_offline_mode);
   command_line::add_arg(desc_params, command_line::arg_log_file);
   command_line::add_arg(desc_params, command_line::arg_log_level);
@@ -2936,6 +3006,7 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_params, arg_set_timeout);
   command_line::add_arg(desc_params, arg_voting_config_file);
   command_line::add_arg(desc_params, arg_no_password_confirmations);
+  command_line::add_arg(desc_params, arg_use_store_journal);
   command_line::add_arg(desc_params, command_line::arg_generate_rpc_autodoc);    
 
   tools::wallet_rpc_server::init_options(desc_params);
@@ -87,6 +87,7 @@ namespace currency
     bool sign_transfer(const std::vector<std::string> &args);
     bool submit_transfer(const std::vector<std::string> &args);
     bool sweep_below(const std::vector<std::string> &args);
+    bool consolidate_below(const std::vector<std::string> &args);
     bool sweep_bare_outs(const std::vector<std::string> &args);
     bool tor_enable(const std::vector<std::string> &args);
     bool tor_disable(const std::vector<std::string> &args);
@@ -192,6 +193,7 @@ namespace currency
     bool m_offline_mode;
     bool m_disable_tor;
     std::string m_restore_wallet;
+    uint64_t m_restore_height = 0;
     std::string m_voting_config_file;
     bool m_no_password_confirmations = false;
     
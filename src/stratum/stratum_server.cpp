@@ -5,13 +5,17 @@
 
 #include "stratum_server.h"
 #include "stratum_helpers.h"
+#include "stratum_vardiff.h"
 #include "net/abstract_tcp_server2.h"
+#include "net/http_server_impl_base.h"
 #include "currency_core/currency_config.h"
 #include "currency_core/currency_core.h"
 #include "common/command_line.h"
 #include "common/int-util.h"
 #include "version.h"
 #include "currency_protocol/currency_protocol_handler.h"
+#include "common/threads_pool.h"
+#include <unordered_set>
 
 #undef LOG_DEFAULT_CHANNEL 
 #define LOG_DEFAULT_CHANNEL "stratum"
@@ -30,7 +34,9 @@ namespace
 
 #define STRATUM_BIND_IP_DEFAULT "0.0.0.0"
 #define STRATUM_THREADS_COUNT_DEFAULT 2
+#define STRATUM_SHARE_VERIFICATION_THREADS_DEFAULT 2
 #define STRATUM_BLOCK_TEMPLATE_UPD_PERIOD_DEFAULT 30 // sec
+#define STRATUM_BLOCK_TEMPLATE_MIN_UPD_INTERVAL_DEFAULT 2000 // ms
 #define STRATUM_TOTAL_HR_PRINT_INTERVAL_S_DEFAULT 60 // sec
 #define VDIFF_TARGET_MIN_DEFAULT 100000000ull // = 100 Mh
 #define VDIFF_TARGET_MAX_DEFAULT 100000000000ull // = 100 Gh
@@ -43,12 +49,15 @@ namespace
   const command_line::arg_descriptor<std::string> arg_stratum_bind_ip        ("stratum-bind-ip",           "Stratum server: IP to bind",                STRATUM_BIND_IP_DEFAULT );
   const command_line::arg_descriptor<std::string> arg_stratum_bind_port      ("stratum-bind-port",         "Stratum server: port to listen at",         std::to_string(STRATUM_DEFAULT_PORT) );
   const command_line::arg_descriptor<size_t>      arg_stratum_threads        ("stratum-threads-count",     "Stratum server: number of server threads",  STRATUM_THREADS_COUNT_DEFAULT );
+  const command_line::arg_descriptor<size_t>      arg_stratum_share_verification_threads ("stratum-share-verification-threads", "Stratum server: number of threads verifying submitted shares (0 - verify on the server threads)", STRATUM_SHARE_VERIFICATION_THREADS_DEFAULT );
   const command_line::arg_descriptor<std::string> arg_stratum_miner_address = {"stratum-miner-address",     "Stratum server: miner address. All workers"
     " will mine to this address. If not set here, ALL workers should use the very same wallet address as username."
     " If set here - they're allowed to log in with username '" WORKER_ALLOWED_USERNAME "' instead of address."};
   
   const command_line::arg_descriptor<size_t>      arg_stratum_block_template_update_period = {"stratum-template-update-period",
     "Stratum server: if there are no new blocks, update block template this often (sec.)",  STRATUM_BLOCK_TEMPLATE_UPD_PERIOD_DEFAULT };
+  const command_line::arg_descriptor<uint64_t>    arg_stratum_block_template_min_update_interval ("stratum-template-min-update-interval",
+    "Stratum server: update block template for better paying pool txs at most this often (ms.), new blocks update it at once",  STRATUM_BLOCK_TEMPLATE_MIN_UPD_INTERVAL_DEFAULT );
   const command_line::arg_descriptor<uint64_t>    arg_stratum_hr_print_interval  ("stratum-hr-print-interval", "Stratum server: how often to print hashrate stats (sec.)", STRATUM_TOTAL_HR_PRINT_INTERVAL_S_DEFAULT );
   
   const command_line::arg_descriptor<uint64_t>    arg_stratum_vdiff_target_min  ("stratum-vdiff-target-min",  "Stratum server: minimum worker difficulty",  VDIFF_TARGET_MIN_DEFAULT );
@@ -57,6 +66,7 @@ namespace
   const command_line::arg_descriptor<uint64_t>    arg_stratum_vdiff_retarget_time  ("stratum-vdiff-retarget-time",  "Stratum server: check to see if we should retarget this often (sec.)",  VDIFF_RETARGET_TIME_DEFAULT );
   const command_line::arg_descriptor<uint64_t>    arg_stratum_vdiff_retarget_shares  ("stratum-vdiff-retarget-shares",  "Stratum server: enforce retargeting if got this many shares",  VDIFF_RETARGET_SHARES_COUNT );
   const command_line::arg_descriptor<uint64_t>    arg_stratum_vdiff_variance_percent   ("stratum-vdiff-variance-percent",  "Stratum server: allow average time to very this % from target without retarget",  VDIFF_VARIANCE_PERCENT_DEFAULT );
+  const command_line::arg_descriptor<std::string> arg_stratum_metrics_bind_port ("stratum-metrics-bind-port", "Stratum server: serve Prometheus metrics at http://<stratum-bind-ip>:<port>/metrics (disabled if not set)" );
   const command_line::arg_descriptor<bool>        arg_stratum_always_online  ( "stratum-always-online",                   "Stratum server consider the core being synchronized regardless of online status, useful for debugging with --offline-mode" );
 
 //==============================================================================================================================
@@ -87,42 +97,12 @@ namespace
 #define DP(x) LOG_PRINT_L0("LINE " STRINGIZE(__LINE__) ":             " #x " = " << x)
 
 //==============================================================================================================================
-  struct vdiff_params_t
-  {
-    explicit vdiff_params_t()
-      : target_min(0)
-      , target_max(0)
-      , target_time_ms(0)
-      , retarget_time_ms(0)
-      , retarget_shares_count(0)
-      , variance_percent(0)
-    {}
-
-    vdiff_params_t(uint64_t target_min, uint64_t target_max, uint64_t target_time_s, uint64_t retarget_time_s, uint64_t retarget_shares_count, uint64_t variance_percent) 
-      : target_min(target_min)
-      , target_max(target_max)
-      , target_time_ms(target_time_s * 1000)
-      , retarget_time_ms(retarget_time_s * 1000)
-      , retarget_shares_count(retarget_shares_count)
-      , variance_percent(variance_percent)
-    {}
-
-    uint64_t target_min;
-    uint64_t target_max;
-    uint64_t target_time_ms;
-    uint64_t retarget_time_ms;
-    uint64_t retarget_shares_count;
-    uint64_t variance_percent;
-  };
-
   struct stratum_connection_context : public epee::net_utils::connection_context_base
   {
     explicit stratum_connection_context()
       : m_worker_name("?")
-      , m_worker_difficulty(1)
+      , m_prev_worker_difficulty(1)
       , m_ts_started(0)
-      , m_ts_share_period_timer(0)
-      , m_ts_difficulty_updated(0)
       , m_valid_shares_count(0)
       , m_wrong_shares_count(0)
       , m_hashes_calculated(0)
@@ -141,12 +121,16 @@ namespace
       return (epee::misc_utils::get_tick_count() - m_ts_started) / 1000;
     }
     
+    // from the recent shares, or from all the work done if there were too few of them
     uint64_t estimate_worker_hashrate()
     {
       CRITICAL_REGION_LOCAL(m_lock);
       if (m_ts_started == 0)
         return 0;
-      uint64_t duration = (epee::misc_utils::get_tick_count() - m_ts_started) / 1000;
+      uint64_t now = epee::misc_utils::get_tick_count();
+      if (m_valid_shares_count > 1)
+        return m_vardiff.get_hashrate(now);
+      uint64_t duration = (now - m_ts_started) / 1000;
       if (duration == 0)
         return 0;
       return (m_hashes_calculated / duration).convert_to<uint64_t>();
@@ -155,26 +139,14 @@ namespace
     uint64_t get_average_share_period_ms()
     {
       CRITICAL_REGION_LOCAL(m_lock);
-      if (m_ts_share_period_timer == 0)
-        return 0;
-      uint64_t duration_ms = (epee::misc_utils::get_tick_count() - m_ts_share_period_timer);
-      if (m_valid_shares_count == 0)
-        return 0;
-      return duration_ms / m_valid_shares_count;
-    }
-
-    void reset_average_share_period_ms()
-    {
-      CRITICAL_REGION_LOCAL(m_lock);
-      m_ts_share_period_timer = epee::misc_utils::get_tick_count();
-      m_valid_shares_count = 0;
+      return m_vardiff.get_share_period_ms(epee::misc_utils::get_tick_count());
     }
 
     void set_worker_difficulty(const wide_difficulty_type& d)
     {
       CRITICAL_REGION_LOCAL(m_lock);
-      m_worker_difficulty = d;
-      m_ts_difficulty_updated = epee::misc_utils::get_tick_count();
+      m_vardiff.set_difficulty(d, epee::misc_utils::get_tick_count());
+      m_prev_worker_difficulty = d;
     }
 
     void init_and_start_timers(const vdiff_params_t& vd_params)
@@ -182,81 +154,68 @@ namespace
       CRITICAL_REGION_LOCAL(m_lock);
       m_ts_started = epee::misc_utils::get_tick_count();
       m_vd_params = vd_params;
-      set_worker_difficulty(m_vd_params.target_min);
-      reset_average_share_period_ms();
+      m_vardiff.init(m_vd_params, m_ts_started);
+      m_prev_worker_difficulty = m_vardiff.get_difficulty();
     }
 
     wide_difficulty_type get_worker_difficulty()
     {
       CRITICAL_REGION_LOCAL(m_lock);
-      return m_worker_difficulty;
+      return m_vardiff.get_difficulty();
+    }
+
+    // the difficulty before the last retarget is still accepted until the worker gets a new job, as some miners
+    // don't take a new target for the same block hash
+    wide_difficulty_type get_min_accepted_difficulty()
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      return std::min(m_vardiff.get_difficulty(), m_prev_worker_difficulty);
+    }
+
+    void on_new_job_sent()
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      m_prev_worker_difficulty = m_vardiff.get_difficulty();
     }
 
     // returns true if worker difficulty has just been changed
     bool adjust_worker_difficulty_if_needed()
     {
       CRITICAL_REGION_LOCAL(m_lock);
+      uint64_t now = epee::misc_utils::get_tick_count();
+      wide_difficulty_type prev_d = m_vardiff.get_difficulty();
+      uint64_t shares = m_vardiff.get_shares_since_retarget();
+      uint64_t share_period_ms = m_vardiff.get_share_period_ms(now);
+      if (!m_vardiff.retarget(now))
+        return false;
 
-      // check retarget condition if 1) there're too many shares received; 2) difficulty was updated long enough time ago
-      if (m_valid_shares_count >= m_vd_params.retarget_shares_count ||
-          epee::misc_utils::get_tick_count() - m_ts_difficulty_updated > m_vd_params.retarget_time_ms)
-      {
-        int64_t average_share_period_ms = 0;
-        wide_difficulty_type new_d = 0;
-        if (m_valid_shares_count != 0)
-        {
-          // there were shares, calculate using average share period
-          average_share_period_ms = static_cast<int64_t>(get_average_share_period_ms());
-          if (average_share_period_ms != 0 &&
-              uint64_t(llabs(average_share_period_ms - int64_t(m_vd_params.target_time_ms))) > m_vd_params.target_time_ms * m_vd_params.variance_percent / 100)
-          {
-            new_d = m_worker_difficulty * m_vd_params.target_time_ms / average_share_period_ms;
-          }
-        }
-        else
-        {
-          // no shares are found during retarget_time_ms, perhaps the difficulty is too high, lower it significantly
-          new_d = (m_vd_params.target_min + m_worker_difficulty) / 4;
-        }
-
-        if (new_d != 0)
-        {
-          if (new_d < m_vd_params.target_min)
-            new_d = m_vd_params.target_min;
-          if (new_d > m_vd_params.target_max)
-            new_d = m_vd_params.target_max;
-          
-          if (new_d != m_worker_difficulty)
-          {
-            LP_CC_WORKER_YELLOW((*this), "difficulty update: " << m_worker_difficulty << " -> " << new_d <<
-              " (av. share pediod was: " << average_share_period_ms << ", target: " << m_vd_params.target_time_ms <<
-              ", shares: " << m_valid_shares_count << ", variance: " << int64_t(100 * average_share_period_ms / m_vd_params.target_time_ms - 100) << "%)", LOG_LEVEL_2);
-            set_worker_difficulty(new_d);
-            reset_average_share_period_ms();
-            return true;
-          }
-        }
-      }
-      return false;
+      LP_CC_WORKER_YELLOW((*this), "difficulty update: " << prev_d << " -> " << m_vardiff.get_difficulty() <<
+        " (share period was: " << share_period_ms << ", target: " << m_vd_params.target_time_ms << ", shares: " << shares <<
+        ", est. hashrate: " << m_vardiff.get_hashrate(now) << ")", LOG_LEVEL_2);
+      return true;
     }
 
-    void increment_normal_shares_count()
+    // difficulty is the one the share was accepted for
+    void increment_normal_shares_count(const wide_difficulty_type& difficulty)
     {
       CRITICAL_REGION_LOCAL(m_lock);
       ++m_valid_shares_count;
-      m_hashes_calculated += m_worker_difficulty;
+      m_hashes_calculated += difficulty;
+      m_vardiff.on_share(difficulty, epee::misc_utils::get_tick_count());
     }
 
     void increment_stale_shares_count()
     {
       CRITICAL_REGION_LOCAL(m_lock);
       ++m_valid_shares_count;
-      m_hashes_calculated += m_worker_difficulty;
+      m_hashes_calculated += m_vardiff.get_difficulty();
+      m_vardiff.on_share(m_vardiff.get_difficulty(), epee::misc_utils::get_tick_count());
     }
 
     void increment_wrong_shares_count()
     {
-      //++m_wrong_shares_count; not implemented yet
+      CRITICAL_REGION_LOCAL(m_lock);
+      ++m_wrong_shares_count;
     }
 
     void increment_blocks_count()
@@ -277,12 +236,17 @@ namespace
       return m_valid_shares_count;
     }
 
+    size_t get_wrong_shares_count()
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      return m_wrong_shares_count;
+    }
+
     mutable epee::critical_section m_lock;
     std::string m_worker_name;
-    wide_difficulty_type m_worker_difficulty;
+    vardiff_controller m_vardiff;
+    wide_difficulty_type m_prev_worker_difficulty;
     uint64_t m_ts_started;
-    uint64_t m_ts_share_period_timer;
-    uint64_t m_ts_difficulty_updated;
     size_t m_valid_shares_count; // number of shares that satisfy worker's difficulty (valid + stale)
     size_t m_wrong_shares_count;
     size_t m_blocks_count;
@@ -300,20 +264,36 @@ namespace
     typedef stratum_protocol_handler_config<connection_context_t> this_t;
     typedef stratum_protocol_handler<connection_context_t> protocol_handler_t;
 
+    // what's needed to verify a share of the current job without the lock
+    struct share_job
+    {
+      std::shared_ptr<const block> p_block;
+      crypto::hash block_ethash;
+      uint64_t height;
+      wide_difficulty_type network_difficulty;
+      wide_difficulty_type worker_difficulty;
+      wide_difficulty_type min_worker_difficulty;  // still accepted after a retarget
+    };
+
     stratum_protocol_handler_config()
       : m_max_packet_size(10240)
       , m_p_core(nullptr)
       , m_network_difficulty(0)
       , m_miner_addr(null_pub_addr)
       , m_block_template_ethash(null_hash)
+      , m_block_template_seed_hash({})
       , m_blockchain_last_block_id(null_hash)
       , m_block_template_height(0)
       , m_block_template_update_ts(0)
       , m_last_ts_total_hr_was_printed(epee::misc_utils::get_tick_count())
       , m_total_hr_print_interval_ms(STRATUM_TOTAL_HR_PRINT_INTERVAL_S_DEFAULT * 1000)
       , m_block_template_update_pediod_ms(STRATUM_BLOCK_TEMPLATE_UPD_PERIOD_DEFAULT * 1000)
+      , m_block_template_min_update_interval_ms(STRATUM_BLOCK_TEMPLATE_MIN_UPD_INTERVAL_DEFAULT)
+      , m_job_txs_fee(0)
+      , m_job_pool_version(UINT64_MAX)
       , m_nameless_worker_id(0)
       , m_total_blocks_found(0)
+      , m_share_verification_threads(0)
       , m_stop_flag(false)
       , m_blocktemplate_update_thread(&this_t::block_template_update_thread, this)
       , m_is_core_always_online(false)
@@ -329,6 +309,8 @@ namespace
 
       m_stop_flag = true;
       m_blocktemplate_update_thread.join();
+      // the shares that weren't verified yet are dropped, the connections they hold are released
+      m_share_verification_pool.reset();
 
       if (m_p_core)
         m_p_core->remove_blockchain_update_listener(this);
@@ -366,20 +348,52 @@ namespace
       //p_ph->handle_recv(test.c_str(), test.size());
     }
 
+    // wakes up on each block and pool change rather than polling the core
     void block_template_update_thread()
     {
       epee::log_space::log_singletone::set_thread_log_prefix("[ST]");
       while (!m_stop_flag)
       {
-        if (is_core_syncronized() && epee::misc_utils::get_tick_count() - m_block_template_update_ts >= m_block_template_update_pediod_ms)
+        if (!m_p_core)
         {
-          update_block_template();
+          epee::misc_utils::sleep_no_w(200);
+          continue;
+        }
+
+        const chain_change_notifier& notifier = m_p_core->get_blockchain_storage().get_change_notifier();
+        uint64_t changes_counter = notifier.get_counter();
+        if (is_core_syncronized())
+        {
+          // new top block or the update period has passed, otherwise maybe there are better paying txs in the pool
+          if (!update_block_template())
+            update_block_template_if_fee_improved();
         }
         print_total_hashrate_if_needed();
-        epee::misc_utils::sleep_no_w(200);
+        notifier.wait(changes_counter, 200);
       }
     }
 
+    bool update_block_template_if_fee_improved()
+    {
+      if (epee::misc_utils::get_tick_count() - m_block_template_update_ts < m_block_template_min_update_interval_ms)
+        return false;
+
+      // the base is built once per pool change and then reused by the template itself, so the check is cheap
+      std::shared_ptr<const block_template_base> base_ptr = m_p_core->get_block_template_base(false);
+      if (!base_ptr)
+        return false;
+
+      CRITICAL_REGION_LOCAL(m_work_change_lock);
+      if (base_ptr->pool_version == m_job_pool_version)
+        return false;
+      m_job_pool_version = base_ptr->pool_version;
+      if (base_ptr->prev_id != m_blockchain_last_block_id || base_ptr->txs_fee <= m_job_txs_fee)
+        return false;
+
+      LOG_PRINT_L2("stratum: pool txs fee improved " << print_money_brief(m_job_txs_fee) << " -> " << print_money_brief(base_ptr->txs_fee) << ", updating block template");
+      return update_block_template(true);
+    }
+
     bool update_block_template(bool enforce_update = false)
     {
       CRITICAL_REGION_LOCAL(m_work_change_lock);
@@ -390,11 +404,17 @@ namespace
         return false;// no new blocks since last update, keep the same work
       
       LOG_PRINT("stratum_protocol_handler_config::update_block_template(" << (enforce_update ? "true" : "false") << ")", LOG_LEVEL_4);
-      m_block_template = AUTO_VAL_INIT(m_block_template);
-      wide_difficulty_type block_template_difficulty;
-      blobdata extra = AUTO_VAL_INIT(extra);
-      bool r = m_p_core->get_block_template(m_block_template, m_miner_addr, m_miner_addr, block_template_difficulty, m_block_template_height, extra);
+      create_block_template_params params = AUTO_VAL_INIT(params);
+      params.miner_address = m_miner_addr;
+      params.stakeholder_address = m_miner_addr;
+      params.pcustom_fill_block_template_func = nullptr;
+      create_block_template_response resp = AUTO_VAL_INIT(resp);
+      bool r = m_p_core->get_block_template(params, resp);
       CHECK_AND_ASSERT_MES(r, false, "get_block_template failed");
+      m_block_template = resp.b;
+      m_block_template_height = resp.height;
+      m_job_txs_fee = resp.txs_fee;
+      const wide_difficulty_type& block_template_difficulty = resp.diffic;
 #if DBG_NETWORK_DIFFICULTY == 0
       m_network_difficulty = block_template_difficulty;
 #else
@@ -402,7 +422,7 @@ namespace
 #endif
       m_blockchain_last_block_id = top_block_id;
 
-      m_block_template_hash_blob = get_block_hashing_blob(m_block_template);
+      m_block_template_hash_blob = get_block_hashing_blob(m_block_template, m_block_template_tree_hash_cache);
       if (access_nonce_in_block_blob(m_block_template_hash_blob) != 0)
       {
         LOG_PRINT_RED("non-zero nonce in generated block template", LOG_LEVEL_0);
@@ -410,6 +430,10 @@ namespace
       }
       m_prev_block_template_ethash = m_block_template_ethash;
       m_block_template_ethash = crypto::cn_fast_hash(m_block_template_hash_blob.data(), m_block_template_hash_blob.size());
+      m_block_template_seed_hash = ethash_calculate_epoch_seed(ethash_height_to_epoch(m_block_template_height));
+      m_job_block = std::make_shared<const block>(m_block_template);
+      m_prev_job_submitted_nonces.swap(m_job_submitted_nonces);
+      m_job_submitted_nonces.clear();
       m_block_template_update_ts = epee::misc_utils::get_tick_count();
 
       set_work_for_all_workers(); // notify all workers of updated work
@@ -420,16 +444,33 @@ namespace
     void set_work_for_all_workers(protocol_handler_t* ph_to_skip = nullptr)
     {
       LOG_PRINT("stratum_protocol_handler_config::set_work_for_all_workers()", LOG_LEVEL_4);
+      // the workers with the same difficulty get the very same job, so it's made and serialized once for each difficulty
+      // and the same buffer is queued to all their connections
+      struct job_message
+      {
+        std::string work_json;
+        epee::net_utils::shared_buffer notification;
+      };
+      std::map<wide_difficulty_type, job_message> job_messages;
+
       CRITICAL_REGION_LOCAL(m_ph_map_lock);
       for (auto& ph : m_protocol_handlers)
       {
         if (ph.second == ph_to_skip)
           continue;
         ph.second->get_context().adjust_worker_difficulty_if_needed(); // some miners seem to not give a f*ck about updated job taget if the block hash wasn't changed, so change difficulty only on work update
-        std::string new_work_json = get_work_json(ph.second->get_context().get_worker_difficulty());
-        ph.second->set_work(new_work_json);
-        ph.second->send_notification(new_work_json);
+        wide_difficulty_type worker_difficulty = ph.second->get_context().get_worker_difficulty();
+        job_message& jm = job_messages[worker_difficulty];
+        if (!jm.notification)
+        {
+          jm.work_json = get_work_json(worker_difficulty);
+          jm.notification = protocol_handler_t::make_notification(jm.work_json);
+        }
+        ph.second->set_work(jm.work_json);
+        ph.second->send_notification(jm.notification);
+        ph.second->get_context().on_new_job_sent();
       }
+      LOG_PRINT("stratum: new job sent to " << m_protocol_handlers.size() << " worker(s), " << job_messages.size() << " distinct difficulties", LOG_LEVEL_3);
     }
 
     std::string get_work_json(const wide_difficulty_type& worker_difficulty)
@@ -441,8 +482,7 @@ namespace
       crypto::hash target_boundary = null_hash;
       difficulty_to_boundary_long(worker_difficulty, target_boundary);
 
-      ethash_hash256 seed_hash = ethash_calculate_epoch_seed(ethash_height_to_epoch(m_block_template_height));
-      return R"("result":[")" + pod_to_net_format(m_block_template_ethash) + R"(",")" + pod_to_net_format(seed_hash) + R"(",")" + pod_to_net_format_reverse(target_boundary) + R"(",")" + pod_to_net_format_reverse(m_block_template_height) + R"("])";
+      return R"("result":[")" + pod_to_net_format(m_block_template_ethash) + R"(",")" + pod_to_net_format(m_block_template_seed_hash) + R"(",")" + pod_to_net_format_reverse(target_boundary) + R"(",")" + pod_to_net_format_reverse(m_block_template_height) + R"("])";
     }
 
     void update_work(protocol_handler_t* p_ph)
@@ -465,7 +505,6 @@ namespace
     bool handle_work(protocol_handler_t* p_ph, const jsonrpc_id_t& id, const std::string& worker, uint64_t nonce, const crypto::hash& block_ethash)
     {
       CRITICAL_REGION_LOCAL(m_work_change_lock);
-      bool r = false;
 
       if (!is_core_syncronized())
       {
@@ -475,43 +514,114 @@ namespace
         return true;
       }
   
-      const uint64_t height = get_block_height(m_block_template);
-
       // make sure worker sent work with correct block ethash
-      if (block_ethash != m_block_template_ethash)
+      if (block_ethash != m_block_template_ethash || !m_job_block)
       {
         if (block_ethash == m_prev_block_template_ethash)
         {
+          if (!m_prev_job_submitted_nonces.insert(nonce).second)
+          {
+            LP_CC_WORKER_RED(p_ph->get_context(), "duplicate stale share, nonce: 0x" << epee::string_tools::pod_to_hex(nonce), LOG_LEVEL_0);
+            p_ph->send_response_error(id, JSONRPC_ERROR_CODE_DEFAULT, "duplicate share");
+            p_ph->get_context().increment_wrong_shares_count();
+            ++m_metrics.shares_duplicate;
+            return false;
+          }
           // Got stale share, do nothing. In future it can be used for more aggressive mining strategies
           LP_CC_WORKER_BLUE(p_ph->get_context(), "got stale share, skip it", LOG_LEVEL_1);
           p_ph->send_response_default(id);
           p_ph->get_context().increment_stale_shares_count();
+          ++m_metrics.shares_stale;
           return true;
         }
 
         LP_CC_WORKER_RED(p_ph->get_context(), "wrong work submitted, ethhash " << block_ethash << ", expected: " << m_block_template_ethash, LOG_LEVEL_0);
         p_ph->send_response_error(id, JSONRPC_ERROR_CODE_DEFAULT, "wrong work");
         p_ph->get_context().increment_wrong_shares_count();
+        ++m_metrics.shares_wrong_work;
         return false;
       }
 
-      crypto::hash block_pow_hash = get_block_longhash(height, m_block_template_ethash, nonce);
-      wide_difficulty_type worker_difficulty = p_ph->get_context().get_worker_difficulty();
+      if (!m_job_submitted_nonces.insert(nonce).second)
+      {
+        LP_CC_WORKER_RED(p_ph->get_context(), "duplicate share, nonce: 0x" << epee::string_tools::pod_to_hex(nonce), LOG_LEVEL_0);
+        p_ph->send_response_error(id, JSONRPC_ERROR_CODE_DEFAULT, "duplicate share");
+        p_ph->get_context().increment_wrong_shares_count();
+        ++m_metrics.shares_duplicate;
+        return false;
+      }
 
-      if (!check_hash(block_pow_hash, worker_difficulty))
+      share_job job = AUTO_VAL_INIT(job);
+      job.p_block = m_job_block;
+      job.block_ethash = m_block_template_ethash;
+      job.height = m_block_template_height;
+      job.network_difficulty = m_network_difficulty;
+      job.worker_difficulty = p_ph->get_context().get_worker_difficulty();
+      job.min_worker_difficulty = p_ph->get_context().get_min_accepted_difficulty();
+
+      if (!m_share_verification_pool)
+        return verify_share(p_ph, id, nonce, job);
+
+      // the connection (and its protocol handler) is kept alive until the share is verified and responded
+      if (!p_ph->add_ref())
+        return true; // the connection is being closed
+      std::shared_ptr<protocol_handler_t> ph_ref(p_ph, [](protocol_handler_t* p) { p->release(); });
+      jsonrpc_id_t id_copy = id;
+      m_share_verification_pool->add_job([this, ph_ref, id_copy, nonce, job]()
       {
-        LP_CC_WORKER_RED(p_ph->get_context(), "block pow hash " << block_pow_hash << " doesn't meet worker difficulty: " << worker_difficulty << ENDL <<
+        NESTED_TRY_ENTRY();
+        verify_share(ph_ref.get(), id_copy, nonce, job);
+        NESTED_CATCH_ENTRY(__func__);
+      });
+      return true;
+    }
+
+    void init_share_verification(size_t threads_count)
+    {
+      m_share_verification_threads = threads_count;
+      if (!threads_count)
+        return;
+      m_share_verification_pool.reset(new utils::threads_pool());
+      m_share_verification_pool->init(threads_count);
+    }
+
+    size_t get_share_verification_threads() const
+    {
+      return m_share_verification_threads;
+    }
+
+    // checks the PoW of the share, responds and pushes the block to the core if it's found; may be called on the verification pool
+    bool verify_share(protocol_handler_t* p_ph, const jsonrpc_id_t& id, uint64_t nonce, const share_job& job)
+    {
+      crypto::hash block_pow_hash = get_block_longhash(job.height, job.block_ethash, nonce);
+
+      if (!check_hash(block_pow_hash, job.min_worker_difficulty))
+      {
+        LP_CC_WORKER_RED(p_ph->get_context(), "block pow hash " << block_pow_hash << " doesn't meet worker difficulty: " << job.min_worker_difficulty << ENDL <<
           "nonce: " << nonce << " (0x" << epee::string_tools::pod_to_hex(nonce) << ")", LOG_LEVEL_0);
         p_ph->send_response_error(id, JSONRPC_ERROR_CODE_DEFAULT, "not enough work was done");
         p_ph->get_context().increment_wrong_shares_count();
+        ++m_metrics.shares_low_difficulty;
         return false;
       }
+      const wide_difficulty_type& worker_difficulty = check_hash(block_pow_hash, job.worker_difficulty) ? job.worker_difficulty : job.min_worker_difficulty;
 
       p_ph->send_response_default(id);
-      p_ph->get_context().increment_normal_shares_count();
+      p_ph->get_context().increment_normal_shares_count(worker_difficulty);
       m_shares_per_minute.chick();
+      ++m_metrics.shares_valid;
+      m_metrics.hashes_valid += worker_difficulty.convert_to<uint64_t>();
 
-      if (!check_hash(block_pow_hash, m_network_difficulty))
+      // the new target goes with the same job, no need to wait for the next one
+      if (p_ph->get_context().adjust_worker_difficulty_if_needed())
+      {
+        ++m_metrics.retargets;
+        std::string work_json = get_work_json(p_ph->get_context().get_worker_difficulty());
+        p_ph->set_work(work_json);
+        p_ph->send_notification(protocol_handler_t::make_notification(work_json));
+      }
+
+      if (!check_hash(block_pow_hash, job.network_difficulty))
       {
         // work is enough for worker difficulty, but not enough for network difficulty -- it's okay, move on!
         LP_CC_WORKER_GREEN(p_ph->get_context(), "share found for difficulty " << worker_difficulty << ", nonce: 0x" << epee::string_tools::pod_to_hex(nonce), LOG_LEVEL_1);
@@ -521,24 +631,28 @@ namespace
       }
 
       // seems we've just found a block!
-      // create a block template and push it to the core
-      m_block_template.nonce = nonce;
-      crypto::hash block_hash = get_block_hash(m_block_template);
+      // take the job's block template and push it to the core
+      CRITICAL_REGION_LOCAL(m_work_change_lock);
+      block b = *job.p_block;
+      b.nonce = nonce;
+      const uint64_t height = job.height;
+      crypto::hash block_hash = get_block_hash(b);
 
-      LP_CC_WORKER_GREEN(p_ph->get_context(), "block found " << block_hash << " at height " << height << " for difficulty " << m_network_difficulty << " pow: " << block_pow_hash << ENDL <<
+      LP_CC_WORKER_GREEN(p_ph->get_context(), "block found " << block_hash << " at height " << height << " for difficulty " << job.network_difficulty << " pow: " << block_pow_hash << ENDL <<
         "nonce: " << nonce << " (0x" << epee::string_tools::pod_to_hex(nonce) << ")", LOG_LEVEL_1);
 
       block_verification_context bvc = AUTO_VAL_INIT(bvc);
-      r = m_p_core->handle_block_found(m_block_template, &bvc, false);
+      bool r = m_p_core->handle_block_found(b, &bvc, false);
       if (r)
       {
         if (!bvc.m_verification_failed && !bvc.m_added_to_altchain && bvc.m_added_to_main_chain && !bvc.m_already_exists && !bvc.m_marked_as_orphaned)
         {
-          LP_CC_WORKER_GREEN(p_ph->get_context(), "found block " << block_hash << " at height " << height << " was successfully added to the blockchain, difficulty " << m_network_difficulty, LOG_LEVEL_0);
+          LP_CC_WORKER_GREEN(p_ph->get_context(), "found block " << block_hash << " at height " << height << " was successfully added to the blockchain, difficulty " << job.network_difficulty, LOG_LEVEL_0);
           r = update_block_template();
           CHECK_AND_ASSERT_MES_NO_RET(r, "Stratum: internal error. Block template wasn't updated as expected after handling found block.");
           p_ph->get_context().increment_blocks_count();
           ++m_total_blocks_found;
+          ++m_metrics.blocks_found;
         }
         else
         {
@@ -632,12 +746,8 @@ namespace
     // i_blockchain_update_listener member
     virtual void on_blockchain_update() override
     {
+      // nothing to do on the core's thread: the template update thread is woken up by the chain change notifier
       LOG_PRINT_L3("stratum_protocol_handler_config::on_blockchain_update()");
-
-      if (!is_core_syncronized())
-        return; // don't notify workers when blockchain is synchronizing
-
-      update_block_template();
     }
 
     void set_core(currency::core* c)
@@ -720,6 +830,71 @@ namespace
       m_last_ts_total_hr_was_printed = epee::misc_utils::get_tick_count();
     }
 
+    // Prometheus text exposition format
+    std::string get_metrics_text()
+    {
+      std::stringstream ss;
+      auto counter = [&ss](const char* name, const char* help, const std::string& labels, uint64_t value)
+      {
+        ss << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n" << name << labels << " " << value << "\n";
+      };
+      counter("zano_stratum_shares_total", "Shares submitted by the workers, by result.", "{result=\"valid\"}", m_metrics.shares_valid);
+      ss << "zano_stratum_shares_total{result=\"stale\"} " << m_metrics.shares_stale << "\n";
+      ss << "zano_stratum_shares_total{result=\"low_difficulty\"} " << m_metrics.shares_low_difficulty << "\n";
+      ss << "zano_stratum_shares_total{result=\"wrong_work\"} " << m_metrics.shares_wrong_work << "\n";
+      ss << "zano_stratum_shares_total{result=\"duplicate\"} " << m_metrics.shares_duplicate << "\n";
+      counter("zano_stratum_valid_shares_difficulty_total", "Sum of the difficulties of the valid shares.", "", m_metrics.hashes_valid);
+      counter("zano_stratum_retargets_total", "Worker difficulty changes made by vardiff.", "", m_metrics.retargets);
+      counter("zano_stratum_blocks_found_total", "Blocks found and added to the blockchain.", "", m_metrics.blocks_found);
+
+      CRITICAL_REGION_BEGIN(m_work_change_lock);
+      ss << "# HELP zano_stratum_network_difficulty Difficulty of the current job.\n# TYPE zano_stratum_network_difficulty gauge\n";
+      ss << "zano_stratum_network_difficulty " << m_network_difficulty << "\n";
+      ss << "# HELP zano_stratum_job_height Height of the current job.\n# TYPE zano_stratum_job_height gauge\n";
+      ss << "zano_stratum_job_height " << m_block_template_height << "\n";
+      CRITICAL_REGION_END();
+
+      CRITICAL_REGION_LOCAL(m_ph_map_lock);
+      ss << "# HELP zano_stratum_workers Connected workers.\n# TYPE zano_stratum_workers gauge\n";
+      ss << "zano_stratum_workers " << m_protocol_handlers.size() << "\n";
+      std::stringstream ss_diff, ss_hr, ss_reported_hr, ss_shares, ss_wrong, ss_blocks;
+      for (auto& ph : m_protocol_handlers)
+      {
+        connection_context_t& ctx = ph.second->get_context();
+        uint64_t reported_hr = 0, estimated_hr = 0;
+        ph.second->get_hashrate(reported_hr, estimated_hr);
+        std::string labels = "{worker=\"" + escape_metrics_label(ctx.m_worker_name) + "\",connection=\"" + epee::string_tools::get_str_from_guid_a(ctx.m_connection_id) + "\"}";
+        ss_diff << "zano_stratum_worker_difficulty" << labels << " " << ctx.get_worker_difficulty() << "\n";
+        ss_hr << "zano_stratum_worker_hashrate" << labels << " " << estimated_hr << "\n";
+        ss_reported_hr << "zano_stratum_worker_reported_hashrate" << labels << " " << reported_hr << "\n";
+        ss_shares << "zano_stratum_worker_valid_shares_total" << labels << " " << ctx.get_current_valid_shares_count() << "\n";
+        ss_wrong << "zano_stratum_worker_rejected_shares_total" << labels << " " << ctx.get_wrong_shares_count() << "\n";
+        ss_blocks << "zano_stratum_worker_blocks_found_total" << labels << " " << ctx.get_blocks_count() << "\n";
+      }
+      ss << "# HELP zano_stratum_worker_difficulty Current share difficulty of the worker.\n# TYPE zano_stratum_worker_difficulty gauge\n" << ss_diff.str();
+      ss << "# HELP zano_stratum_worker_hashrate Hashrate of the worker estimated from its recent shares, H/s.\n# TYPE zano_stratum_worker_hashrate gauge\n" << ss_hr.str();
+      ss << "# HELP zano_stratum_worker_reported_hashrate Hashrate reported by the worker, H/s.\n# TYPE zano_stratum_worker_reported_hashrate gauge\n" << ss_reported_hr.str();
+      ss << "# HELP zano_stratum_worker_valid_shares_total Valid and stale shares of the worker.\n# TYPE zano_stratum_worker_valid_shares_total counter\n" << ss_shares.str();
+      ss << "# HELP zano_stratum_worker_rejected_shares_total Rejected shares of the worker.\n# TYPE zano_stratum_worker_rejected_shares_total counter\n" << ss_wrong.str();
+      ss << "# HELP zano_stratum_worker_blocks_found_total Blocks found by the worker.\n# TYPE zano_stratum_worker_blocks_found_total counter\n" << ss_blocks.str();
+      return ss.str();
+    }
+
+    static std::string escape_metrics_label(const std::string& v)
+    {
+      std::string res;
+      for (char c : v)
+      {
+        if (c == '\\' || c == '"')
+          res += '\\';
+        if (c == '\n')
+          res += "\\n";
+        else
+          res += c;
+      }
+      return res;
+    }
+
     void set_total_hr_print_interval_s(uint64_t s)
     {
       m_total_hr_print_interval_ms = s * 1000;
@@ -730,6 +905,11 @@ namespace
       m_block_template_update_pediod_ms = s * 1000;
     }
 
+    void set_block_template_min_update_interval_ms(uint64_t ms)
+    {
+      m_block_template_min_update_interval_ms = ms;
+    }
+
     size_t get_number_id_for_nameless_worker()
     {
       CRITICAL_REGION_LOCAL(m_generic_lock);
@@ -740,6 +920,18 @@ namespace
     size_t m_max_packet_size;
 
   private:
+    struct server_metrics
+    {
+      std::atomic<uint64_t> shares_valid{0};
+      std::atomic<uint64_t> shares_stale{0};
+      std::atomic<uint64_t> shares_low_difficulty{0};
+      std::atomic<uint64_t> shares_wrong_work{0};
+      std::atomic<uint64_t> shares_duplicate{0};
+      std::atomic<uint64_t> hashes_valid{0};
+      std::atomic<uint64_t> retargets{0};
+      std::atomic<uint64_t> blocks_found{0};
+    };
+
     typedef std::unordered_map<boost::uuids::uuid, protocol_handler_t* , boost::hash<boost::uuids::uuid> > protocol_handlers_map;
     typedef epee::math_helper::speed<60 * 1000 /* ms */> shares_per_minute_rate_t;
 
@@ -751,13 +943,18 @@ namespace
     // job data
     block m_block_template;
     std::string m_block_template_hash_blob;
+    crypto::tree_hash_cache m_block_template_tree_hash_cache;
     crypto::hash m_block_template_ethash;
+    ethash_hash256 m_block_template_seed_hash;
     crypto::hash m_blockchain_last_block_id;
     uint64_t m_block_template_height;
     std::atomic<uint64_t> m_block_template_update_ts;
+    std::shared_ptr<const block> m_job_block;                 // the template shared with the shares being verified
+    std::unordered_set<uint64_t> m_job_submitted_nonces;      // to reject duplicate shares
 
     // previous job (for handling stale shares)
     crypto::hash m_prev_block_template_ethash;
+    std::unordered_set<uint64_t> m_prev_job_submitted_nonces;
 
     vdiff_params_t m_vdiff_params;
     wide_difficulty_type m_network_difficulty;
@@ -767,13 +964,19 @@ namespace
     std::atomic<uint64_t> m_last_ts_total_hr_was_printed;
     uint64_t m_total_hr_print_interval_ms;
     uint64_t m_block_template_update_pediod_ms;
+    uint64_t m_block_template_min_update_interval_ms;
+    uint64_t m_job_txs_fee;
+    uint64_t m_job_pool_version;   // of the last pool change checked for better txs
     size_t m_nameless_worker_id;
     size_t m_total_blocks_found;
     shares_per_minute_rate_t m_shares_per_minute;
+    server_metrics m_metrics;
     bool m_is_core_always_online;
 
     std::atomic<bool> m_stop_flag;
     std::thread m_blocktemplate_update_thread;
+    size_t m_share_verification_threads;
+    std::unique_ptr<utils::threads_pool> m_share_verification_pool;
   }; // struct stratum_protocol_handler_config
 
   //==============================================================================================================================
@@ -981,16 +1184,38 @@ namespace
       return m_config.handle_work(this, id, worker, nonce, header_hash);
     }
 
+    bool add_ref()
+    {
+      return static_cast<epee::net_utils::i_service_endpoint*>(m_p_connection)->add_ref();
+    }
+
+    void release()
+    {
+      static_cast<epee::net_utils::i_service_endpoint*>(m_p_connection)->release();
+    }
+
     void send(const std::string& data)
     {
       static_cast<epee::net_utils::i_service_endpoint*>(m_p_connection)->do_send(data.c_str(), data.size());
       LOG_PRINT_CC(m_context, "DATA sent >>>>>>>>>>>>> " << ENDL << data, LOG_LEVEL_4);
     }
 
-    void send_notification(const std::string& json)
+    static epee::net_utils::shared_buffer make_notification(const std::string& json)
     {
       // JSON-RPC 2.0 spec: "A Notification is a Request object without an "id" member."
-      send(R"({"jsonrpc":"2.0",)" + json + "}" "\n"); // LF character is not specified by JSON-RPC standard, but it is REQUIRED by ethminer 0.12 to work
+      return std::make_shared<const std::string>(R"({"jsonrpc":"2.0",)" + json + "}" "\n"); // LF character is not specified by JSON-RPC standard, but it is REQUIRED by ethminer 0.12 to work
+    }
+
+    void send_notification(const std::string& json)
+    {
+      send_notification(make_notification(json));
+    }
+
+    // new jobs go ahead of anything else queued to the connection
+    void send_notification(const epee::net_utils::shared_buffer& notification)
+    {
+      static_cast<epee::net_utils::i_service_endpoint*>(m_p_connection)->do_send_frame(std::vector<epee::net_utils::shared_buffer>(1, notification), epee::net_utils::send_priority_high);
+      LOG_PRINT_CC(m_context, "DATA sent >>>>>>>>>>>>> " << ENDL << *notification, LOG_LEVEL_4);
     }
     
     void send_response_method(const jsonrpc_id_t& id, const std::string& method, const std::string& response)
@@ -1080,6 +1305,33 @@ namespace
   typedef stratum_protocol_handler<stratum_connection_context> protocol_handler_t;
   typedef epee::net_utils::boosted_tcp_server<protocol_handler_t> tcp_server_t;
 
+  // serves the stratum server's metrics to Prometheus
+  class stratum_metrics_server : public epee::http_server_impl_base<stratum_metrics_server>
+  {
+  public:
+    explicit stratum_metrics_server(const std::function<std::string()>& get_metrics_text)
+      : m_get_metrics_text(get_metrics_text)
+    {}
+
+    virtual bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, epee::net_utils::connection_context_base& conn_context) override
+    {
+      if (query_info.m_URI != "/metrics")
+      {
+        response.m_response_code = 404;
+        response.m_response_comment = "Not found";
+        return true;
+      }
+      response.m_response_code = 200;
+      response.m_response_comment = "OK";
+      response.m_mime_tipe = "text/plain; version=0.0.4";
+      response.m_body = m_get_metrics_text();
+      return true;
+    }
+
+  private:
+    std::function<std::string()> m_get_metrics_text;
+  };
+
   // static memeber definition
   template<typename connection_context_t>
   std::unordered_map<std::string, typename stratum_protocol_handler<connection_context_t>::method_handler_func_t> stratum_protocol_handler<connection_context_t>::m_methods_handlers;
@@ -1091,6 +1343,7 @@ namespace
 struct stratum_server_impl
 {
   tcp_server_t server;
+  std::unique_ptr<stratum_metrics_server> metrics_server;
 };
 //------------------------------------------------------------------------------------------------------------------------------
 stratum_server::stratum_server(core* c)
@@ -1114,6 +1367,7 @@ void stratum_server::init_options(boost::program_options::options_description& d
   command_line::add_arg(desc, arg_stratum_bind_ip);
   command_line::add_arg(desc, arg_stratum_bind_port);
   command_line::add_arg(desc, arg_stratum_threads);
+  command_line::add_arg(desc, arg_stratum_share_verification_threads);
   command_line::add_arg(desc, arg_stratum_miner_address);
   command_line::add_arg(desc, arg_stratum_vdiff_target_min);
   command_line::add_arg(desc, arg_stratum_vdiff_target_max);
@@ -1122,8 +1376,10 @@ void stratum_server::init_options(boost::program_options::options_description& d
   command_line::add_arg(desc, arg_stratum_vdiff_retarget_shares);
   command_line::add_arg(desc, arg_stratum_vdiff_variance_percent);
   command_line::add_arg(desc, arg_stratum_block_template_update_period);
+  command_line::add_arg(desc, arg_stratum_block_template_min_update_interval);
   command_line::add_arg(desc, arg_stratum_hr_print_interval);
   command_line::add_arg(desc, arg_stratum_always_online);
+  command_line::add_arg(desc, arg_stratum_metrics_bind_port);
 
 }
 //------------------------------------------------------------------------------------------------------------------------------
@@ -1171,6 +1427,9 @@ bool stratum_server::init(const boost::program_options::variables_map& vm)
   );
 
   config.set_block_template_update_period(command_line::get_arg(vm, arg_stratum_block_template_update_period));
+  config.set_block_template_min_update_interval_ms(command_line::get_arg(vm, arg_stratum_block_template_min_update_interval));
+
+  config.init_share_verification(command_line::get_arg(vm, arg_stratum_share_verification_threads));
 
   config.set_total_hr_print_interval_s(command_line::get_arg(vm, arg_stratum_hr_print_interval));
 
@@ -1178,6 +1437,16 @@ bool stratum_server::init(const boost::program_options::variables_map& vm)
   r = m_impl->server.init_server(bind_port_str, bind_ip_str);
   CHECK_AND_ASSERT_MES(r, false, "Stratum server: initialization failure");
 
+  if (command_line::has_arg(vm, arg_stratum_metrics_bind_port))
+  {
+    std::string metrics_port_str = command_line::get_arg(vm, arg_stratum_metrics_bind_port);
+    auto* p_config = &config;
+    m_impl->metrics_server.reset(new stratum_metrics_server([p_config]() { return p_config->get_metrics_text(); }));
+    LOG_PRINT_L0("Stratum server: metrics at " << bind_ip_str << ":" << metrics_port_str << "/metrics");
+    r = m_impl->metrics_server->init(metrics_port_str, bind_ip_str);
+    CHECK_AND_ASSERT_MES(r, false, "Stratum server: metrics server initialization failure");
+  }
+
   return true;
 }
 //------------------------------------------------------------------------------------------------------------------------------
@@ -1185,6 +1454,12 @@ bool stratum_server::run(bool wait /* = true */)
 {
   //m_impl->server.get_config_object().test();
 
+  if (m_impl->metrics_server && !m_impl->metrics_server->run(1, false))
+  {
+    LOG_ERROR("Stratum server: metrics server failure");
+    return false;
+  }
+
   LOG_PRINT("Stratum server: start net server with " << m_threads_count << " threads...", LOG_LEVEL_0);
   if (!m_impl->server.run_server(m_threads_count, wait))
   {
@@ -1199,16 +1474,22 @@ bool stratum_server::run(bool wait /* = true */)
 //------------------------------------------------------------------------------------------------------------------------------
 bool stratum_server::deinit()
 {
+  if (m_impl->metrics_server)
+    m_impl->metrics_server->deinit();
   return m_impl->server.deinit_server();
 }
 //------------------------------------------------------------------------------------------------------------------------------
 bool stratum_server::timed_wait_server_stop(uint64_t ms)
 {
+  if (m_impl->metrics_server)
+    m_impl->metrics_server->timed_wait_server_stop(ms);
   return m_impl->server.timed_wait_server_stop(ms);
 }
 //------------------------------------------------------------------------------------------------------------------------------
 bool stratum_server::send_stop_signal()
 {
+  if (m_impl->metrics_server)
+    m_impl->metrics_server->send_stop_signal();
   m_impl->server.send_stop_signal();
   return true;
 }
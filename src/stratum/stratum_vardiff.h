@@ -0,0 +1,154 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include "currency_core/difficulty.h"
+
+#define STRATUM_VARDIFF_EWMA_WEIGHT        0.2   // weight of the latest share in the moving average
+#define STRATUM_VARDIFF_MAX_RETARGET_STEP  4.0   // difficulty changes at most this many times per retarget
+
+namespace stratum
+{
+  using currency::wide_difficulty_type;
+
+  struct vdiff_params_t
+  {
+    explicit vdiff_params_t()
+      : target_min(0)
+      , target_max(0)
+      , target_time_ms(0)
+      , retarget_time_ms(0)
+      , retarget_shares_count(0)
+      , variance_percent(0)
+    {}
+
+    vdiff_params_t(uint64_t target_min, uint64_t target_max, uint64_t target_time_s, uint64_t retarget_time_s, uint64_t retarget_shares_count, uint64_t variance_percent)
+      : target_min(target_min)
+      , target_max(target_max)
+      , target_time_ms(target_time_s * 1000)
+      , retarget_time_ms(retarget_time_s * 1000)
+      , retarget_shares_count(retarget_shares_count)
+      , variance_percent(variance_percent)
+    {}
+
+    uint64_t target_min;
+    uint64_t target_max;
+    uint64_t target_time_ms;
+    uint64_t retarget_time_ms;
+    uint64_t retarget_shares_count;
+    uint64_t variance_percent;
+  };
+
+  // Worker difficulty controller. Keeps an exponentially weighted moving average of the time one unit
+  // of difficulty takes the worker (share period / share difficulty), so the hashrate estimate follows
+  // the recent shares regardless of the difficulty changes. The time since the last share counts too
+  // once it's longer than expected, so a slow worker isn't left waiting for a share to get lowered.
+  // Retargets aim at one share per target_time_ms. Not thread-safe.
+  class vardiff_controller
+  {
+  public:
+    vardiff_controller()
+      : m_difficulty(1)
+      , m_ms_per_difficulty(0)
+      , m_ts_last_share(0)
+      , m_ts_retarget(0)
+      , m_shares_since_retarget(0)
+    {}
+
+    void init(const vdiff_params_t& params, uint64_t now_ms)
+    {
+      m_params = params;
+      m_ms_per_difficulty = 0;
+      m_ts_last_share = now_ms;
+      set_difficulty(std::max<uint64_t>(m_params.target_min, 1), now_ms);
+    }
+
+    void set_difficulty(const wide_difficulty_type& d, uint64_t now_ms)
+    {
+      m_difficulty = d;
+      m_ts_retarget = now_ms;
+      m_shares_since_retarget = 0;
+    }
+
+    const wide_difficulty_type& get_difficulty() const
+    {
+      return m_difficulty;
+    }
+
+    void on_share(const wide_difficulty_type& share_difficulty, uint64_t now_ms)
+    {
+      double sample = static_cast<double>(now_ms - std::min(m_ts_last_share, now_ms)) / std::max(share_difficulty.convert_to<double>(), 1.0);
+      m_ms_per_difficulty = m_ms_per_difficulty == 0 ? sample : m_ms_per_difficulty + STRATUM_VARDIFF_EWMA_WEIGHT * (sample - m_ms_per_difficulty);
+      m_ts_last_share = now_ms;
+      ++m_shares_since_retarget;
+    }
+
+    // 0 if there's nothing to estimate from yet
+    double get_ms_per_difficulty(uint64_t now_ms) const
+    {
+      double open_gap = static_cast<double>(now_ms - std::min(m_ts_last_share, now_ms)) / std::max(m_difficulty.convert_to<double>(), 1.0);
+      return std::max(m_ms_per_difficulty, open_gap);
+    }
+
+    // hashes per second
+    uint64_t get_hashrate(uint64_t now_ms) const
+    {
+      double ms_per_difficulty = get_ms_per_difficulty(now_ms);
+      if (ms_per_difficulty <= 0)
+        return 0;
+      return static_cast<uint64_t>(1000.0 / ms_per_difficulty);
+    }
+
+    // expected share period at the current difficulty
+    uint64_t get_share_period_ms(uint64_t now_ms) const
+    {
+      return static_cast<uint64_t>(get_ms_per_difficulty(now_ms) * m_difficulty.convert_to<double>());
+    }
+
+    uint64_t get_shares_since_retarget() const
+    {
+      return m_shares_since_retarget;
+    }
+
+    // true if the difficulty has just been changed
+    bool retarget(uint64_t now_ms)
+    {
+      if (m_shares_since_retarget < m_params.retarget_shares_count && now_ms - std::min(m_ts_retarget, now_ms) <= m_params.retarget_time_ms)
+        return false;
+
+      double ms_per_difficulty = get_ms_per_difficulty(now_ms);
+      if (ms_per_difficulty <= 0 || m_params.target_time_ms == 0)
+        return false;
+
+      double d = m_difficulty.convert_to<double>();
+      double target_time = static_cast<double>(m_params.target_time_ms);
+      if (std::fabs(d * ms_per_difficulty - target_time) <= target_time * m_params.variance_percent / 100)
+      {
+        set_difficulty(m_difficulty, now_ms); // on target, start over
+        return false;
+      }
+
+      double new_d = target_time / ms_per_difficulty;
+      new_d = std::min(std::max(new_d, d / STRATUM_VARDIFF_MAX_RETARGET_STEP), d * STRATUM_VARDIFF_MAX_RETARGET_STEP);
+      new_d = std::max(new_d, static_cast<double>(std::max<uint64_t>(m_params.target_min, 1)));
+      if (m_params.target_max != 0)
+        new_d = std::min(new_d, static_cast<double>(m_params.target_max));
+      wide_difficulty_type new_difficulty = static_cast<uint64_t>(new_d);
+      bool changed = new_difficulty != m_difficulty;
+      set_difficulty(new_difficulty, now_ms);
+      return changed;
+    }
+
+  private:
+    vdiff_params_t m_params;
+    wide_difficulty_type m_difficulty;
+    double m_ms_per_difficulty;   // the moving average, 0 - no shares yet
+    uint64_t m_ts_last_share;
+    uint64_t m_ts_retarget;
+    uint64_t m_shares_since_retarget;
+  };
+}
@@ -20,10 +20,57 @@ namespace tools
 {
   bool default_http_core_proxy::set_connection_addr(const std::string& url)
   {
+    std::lock_guard<std::mutex> lk(m_connections_lock);
     m_daemon_address = url;
+    // the taken ones are dropped when given back, m_connections_count covers them till then
+    m_connections_count -= m_idle_connections.size();
+    m_idle_connections.clear();
+    ++m_connections_generation;
+    m_connections_condition.notify_all();
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  std::unique_ptr<default_http_core_proxy::connection> default_http_core_proxy::acquire_connection(uint64_t& generation)
+  {
+    std::unique_lock<std::mutex> lk(m_connections_lock);
+    m_connections_condition.wait(lk, [&]() { return !m_idle_connections.empty() || m_connections_count < WALLET_RPC_MAX_CONNECTIONS; });
+    generation = m_connections_generation;
+    std::unique_ptr<connection> pconnection;
+    if (!m_idle_connections.empty())
+    {
+      pconnection = std::move(m_idle_connections.back());
+      m_idle_connections.pop_back();
+      return pconnection;
+    }
+    ++m_connections_count;
+    lk.unlock();
+    pconnection.reset(new connection());
+    pconnection->set_compression(true, 0); // blocks and txs from the daemon come gzipped
+    return pconnection;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void default_http_core_proxy::release_connection(std::unique_ptr<connection>&& pconnection, uint64_t generation)
+  {
+    std::lock_guard<std::mutex> lk(m_connections_lock);
+    if (generation == m_connections_generation)
+      m_idle_connections.push_back(std::move(pconnection));
+    else
+      --m_connections_count; // it's connected to the previous address
+    m_connections_condition.notify_one();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool default_http_core_proxy::connect_if_needed(connection& c)
+  {
+    if (c.is_connected())
+      return true;
+
+    epee::net_utils::http::url_content u;
+    epee::net_utils::parse_url(m_daemon_address, u);
+    if (!u.port)
+      u.port = 8081;
+    return c.connect(u.host, std::to_string(u.port), m_connection_timeout);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool default_http_core_proxy::call_COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES(const currency::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::request& req, currency::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::response& res)
   {
     return invoke_http_bin_remote_command2_update_is_disconnect("/get_o_indexes.bin", req, res);
@@ -35,10 +82,30 @@ namespace tools
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool default_http_core_proxy::call_COMMAND_RPC_GET_BLOCKS_DIRECT(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& rsp)
+  {
+    if (!m_pblocks_cache)
+      return pull_blocks_direct(rqt, rsp);
+
+    if (m_pblocks_cache->get(rqt, rsp))
+      return true;
+    // wallets waiting for the same blocks get them from the cache once the first one has them
+    std::lock_guard<std::mutex> lock(m_blocks_fetch_lock);
+    if (m_pblocks_cache->get(rqt, rsp))
+      return true;
+    bool r = pull_blocks_direct(rqt, rsp);
+    if (r)
+      m_pblocks_cache->put(rqt, rsp);
+    return r;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool default_http_core_proxy::pull_blocks_direct(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& rsp)
   {
     currency::COMMAND_RPC_GET_BLOCKS_FAST::request req;
     req.block_ids = rqt.block_ids;
     req.minimum_height = rqt.minimum_height;
+    req.prune_txs = rqt.prune_txs;
+    req.key_images_filters = rqt.key_images_filters;
+    req.compact_global_outs = true; // older daemons ignore it and return coinbase_global_outs and tx_global_outs
     currency::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
     bool r = call_COMMAND_RPC_GET_BLOCKS_FAST(req, res);
     rsp.status = res.status;
@@ -46,6 +113,8 @@ namespace tools
     {
       rsp.current_height = res.current_height;
       rsp.start_height = res.start_height;
+      rsp.txs_pruned = res.txs_pruned;
+      rsp.key_images_filters = res.key_images_filters;
       r = unserialize_block_complete_entry(res, rsp);
     }
     return r;
@@ -53,13 +122,13 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool default_http_core_proxy::call_COMMAND_RPC_INVOKE(const std::string& uri, const std::string& body, int& response_code, std::string& response_body) 
   {
-    return call_request([&]() {
+    return call_request([&](connection& c) {
 #ifdef MOBILE_WALLET_BUILD
       LOG_PRINT_L0("[INVOKE_PROXY] ---> " << uri)
 #endif
 
       const epee::net_utils::http::http_response_info* response = nullptr;
-      bool res = m_http_client.invoke(uri, "POST", body, &response);
+      bool res = c.invoke(uri, "POST", body, &response);
       if (response)
       {
         response_body = response->m_body;
@@ -79,7 +148,11 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool default_http_core_proxy::call_COMMAND_RPC_GET_INFO(const currency::COMMAND_RPC_GET_INFO::request& req, currency::COMMAND_RPC_GET_INFO::response& res)
   {
-    return invoke_http_json_remote_command2_update_is_disconnect("/getinfo", req, res);
+    // each opened wallet and the wallets manager ask for it on their own, often at the same time
+    return m_getinfo_coalescer.call(req.flags, res, [&](currency::COMMAND_RPC_GET_INFO::response& rsp)
+    {
+      return invoke_http_json_remote_command2_update_is_disconnect("/getinfo", req, rsp);
+    });
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool default_http_core_proxy::call_COMMAND_RPC_GET_TX_POOL(const currency::COMMAND_RPC_GET_TX_POOL::request& req, currency::COMMAND_RPC_GET_TX_POOL::response& res)
@@ -155,15 +228,13 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool default_http_core_proxy::check_connection()
   {
-    CRITICAL_REGION_LOCAL(m_lock);
-    if (m_http_client.is_connected())
+    uint64_t generation = 0;
+    std::unique_ptr<connection> pconnection = acquire_connection(generation);
+    bool was_connected = pconnection->is_connected();
+    bool r = was_connected || connect_if_needed(*pconnection);
+    release_connection(std::move(pconnection), generation);
+    if (was_connected)
       return true;
-
-    epee::net_utils::http::url_content u;
-    epee::net_utils::parse_url(m_daemon_address, u);
-    if (!u.port)
-      u.port = 8081;
-    bool r = m_http_client.connect(u.host, std::to_string(u.port), m_connection_timeout);
     if (r)
     {
       m_pdiganostic_info->last_daemon_is_disconnected = false;
@@ -208,6 +279,12 @@ namespace tools
 //     CRITICAL_REGION_LOCAL(m_lock);
 //     m_plast_daemon_is_disconnected = plast_daemon_is_disconnected ? plast_daemon_is_disconnected : &m_last_daemon_is_disconnected_stub;
 //   }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void default_http_core_proxy::enable_pulled_blocks_cache()
+  {
+    if (!m_pblocks_cache)
+      m_pblocks_cache.reset(new pulled_blocks_cache());
+  }
   //------------------------------------------------------------------------------------------------------------------------------
   void default_http_core_proxy::set_connectivity(unsigned int connection_timeout, size_t repeats_count)
   {
@@ -217,6 +294,8 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   default_http_core_proxy::default_http_core_proxy(): //:m_plast_daemon_is_disconnected(&m_last_daemon_is_disconnected_stub),
     //m_last_success_interract_time(0),
+    m_connections_count(0),
+    m_connections_generation(0),
     m_connection_timeout(WALLET_RCP_CONNECTION_TIMEOUT),
     m_attempts_count(WALLET_RCP_COUNT_ATTEMNTS)
   {
@@ -6,10 +6,16 @@
 
 
 #pragma once
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <vector>
 #include "include_base_utils.h"
 #include "net/http_client.h"
 #include "core_rpc_proxy.h"
 #include "storages/http_abstract_invoke.h"
+#include "pulled_blocks_cache.h"
+#include "common/request_coalescer.h"
 
 #ifdef NDEBUG
 #define WALLET_RCP_CONNECTION_TIMEOUT                          5000
@@ -17,6 +23,7 @@
 #define WALLET_RCP_CONNECTION_TIMEOUT                          100000
 #endif
 #define WALLET_RCP_COUNT_ATTEMNTS                              3
+#define WALLET_RPC_MAX_CONNECTIONS                             4
 
 
 
@@ -29,6 +36,8 @@ namespace tools
 
     bool set_connection_addr(const std::string& url) override;
     void set_connectivity(unsigned int connection_timeout, size_t repeats_count) override;
+    unsigned int get_connection_timeout() const { return m_connection_timeout; }
+    size_t get_attempts_count() const { return m_attempts_count; }
     bool call_COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES(const currency::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::request& rqt, currency::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::response& rsp) override;
     bool call_COMMAND_RPC_GET_BLOCKS_FAST(const currency::COMMAND_RPC_GET_BLOCKS_FAST::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_FAST::response& rsp) override;
     bool call_COMMAND_RPC_GET_BLOCKS_DIRECT(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& rsp) override;
@@ -59,18 +68,31 @@ namespace tools
     bool get_transfer_address(const std::string& adr_str, currency::account_public_address& addr, std::string& payment_id) override;
 
     void set_plast_daemon_is_disconnected(std::atomic<bool> *plast_daemon_is_disconnected);   
+    // for a proxy shared by several wallets: pulled blocks are kept for a while, so the others get them without downloading and parsing again
+    void enable_pulled_blocks_cache();
     default_http_core_proxy();
   private:
+    bool pull_blocks_direct(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& rsp);
+
+    typedef epee::net_utils::http::http_simple_client connection;
+
+    // keep-alive connections to the daemon: a request takes an idle one, or opens a new one while there are less than
+    // WALLET_RPC_MAX_CONNECTIONS, so requests of different threads and wallets go side by side
+    std::unique_ptr<connection> acquire_connection(uint64_t& generation);
+    void release_connection(std::unique_ptr<connection>&& pconnection, uint64_t generation);
+    bool connect_if_needed(connection& c);
 
     template <class t_method>
     bool call_request(t_method request)
     {
-      CRITICAL_REGION_LOCAL(m_lock);
+      uint64_t generation = 0;
+      std::unique_ptr<connection> pconnection = acquire_connection(generation);
+      auto releaser = epee::misc_utils::create_scope_leave_handler([&]() { release_connection(std::move(pconnection), generation); });
 
       bool ret = false;
       for(size_t i = m_attempts_count; i && !ret; --i)
       {
-        ret = request();
+        ret = connect_if_needed(*pconnection) && request(*pconnection);
       }
 
       if (ret)
@@ -86,11 +108,11 @@ namespace tools
     template<class t_request, class t_response>
     inline bool invoke_http_json_rpc_update_is_disconnect(const std::string& method_name, const t_request& req, t_response& res)
     {
-      return call_request([&](){
+      return call_request([&](connection& c){
 #ifdef MOBILE_WALLET_BUILD
         LOG_PRINT_L0("[INVOKE_JSON_METHOD] ---> " << method_name)
 #endif
-        bool r = epee::net_utils::invoke_http_json_rpc("/json_rpc", method_name, req, res, m_http_client);
+        bool r = epee::net_utils::invoke_http_json_rpc("/json_rpc", method_name, req, res, c);
 #ifdef MOBILE_WALLET_BUILD
         LOG_PRINT_L0("[INVOKE_JSON_METHOD] <---" << method_name)
 #endif
@@ -101,11 +123,11 @@ namespace tools
     template<class t_request, class t_response>
     inline bool invoke_http_bin_remote_command2_update_is_disconnect(const std::string& url, const t_request& req, t_response& res)
     {
-      return call_request([&](){
+      return call_request([&](connection& c){
 #ifdef MOBILE_WALLET_BUILD
         LOG_PRINT_L0("[INVOKE_BIN] --->" << typeid(t_request).name())
 #endif
-        bool r = epee::net_utils::invoke_http_bin_remote_command2(m_daemon_address + url, req, res, m_http_client, m_connection_timeout);
+        bool r = epee::net_utils::invoke_http_bin_remote_command2(m_daemon_address + url, req, res, c, m_connection_timeout);
 #ifdef MOBILE_WALLET_BUILD
         LOG_PRINT_L0("[INVOKE_BIN] <---" << typeid(t_request).name())
 #endif
@@ -116,11 +138,11 @@ namespace tools
     template<class t_request, class t_response>
     inline bool invoke_http_json_remote_command2_update_is_disconnect(const std::string& url, const t_request& req, t_response& res)
     {
-      return call_request([&](){
+      return call_request([&](connection& c){
 #ifdef MOBILE_WALLET_BUILD
         LOG_PRINT_L0("[INVOKE_JSON_URL] --->" << typeid(t_request).name() )
 #endif
-        bool r = epee::net_utils::invoke_http_json_remote_command2(m_daemon_address + url, req, res, m_http_client, m_connection_timeout);
+        bool r = epee::net_utils::invoke_http_json_remote_command2(m_daemon_address + url, req, res, c, m_connection_timeout);
 #ifdef MOBILE_WALLET_BUILD
         LOG_PRINT_L0("[INVOKE_JSON_URL] <---" << typeid(t_request).name())
 #endif
@@ -133,13 +155,20 @@ namespace tools
       return m_pdiganostic_info->last_success_interract_time;
     }
 
-    epee::critical_section m_lock;
-    epee::net_utils::http::http_simple_client m_http_client;
+    std::mutex m_connections_lock;
+    std::condition_variable m_connections_condition;
+    std::vector<std::unique_ptr<connection>> m_idle_connections;
+    size_t m_connections_count;        // idle and taken
+    uint64_t m_connections_generation; // connections of older generations were made to a previous address
     std::string m_daemon_address;
 
     unsigned int m_connection_timeout;
     size_t m_attempts_count;
 
+    std::unique_ptr<pulled_blocks_cache> m_pblocks_cache;
+    std::mutex m_blocks_fetch_lock;
+    request_coalescer<uint64_t, currency::COMMAND_RPC_GET_INFO::response> m_getinfo_coalescer; // by flags
+
   };
 }
 
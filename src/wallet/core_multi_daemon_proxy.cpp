@@ -0,0 +1,384 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/algorithm/string.hpp>
+#include "core_multi_daemon_proxy.h"
+#include "currency_core/currency_format_utils.h"
+#include "currency_core/alias_helper.h"
+
+#undef LOG_DEFAULT_CHANNEL
+#define LOG_DEFAULT_CHANNEL "rpc_proxy"
+
+namespace tools
+{
+  multi_daemon_core_proxy::daemon_endpoint::daemon_endpoint()
+    : avg_latency_ms(0)
+    , height(0)
+    , failures_in_row(0)
+    , unavailable_till(0)
+    , last_probe(0)
+    , is_probing(false)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  void multi_daemon_core_proxy::daemon_endpoint::report_success(const std::string& method, uint64_t latency_ms)
+  {
+    failures_in_row = 0;
+    unavailable_till = 0;
+    if (method == "getinfo")
+    {
+      uint64_t avg = avg_latency_ms;
+      avg_latency_ms = avg ? (avg * 7 + latency_ms) / 8 : std::max<uint64_t>(latency_ms, 1);
+    }
+    std::lock_guard<std::mutex> lk(samples_lock);
+    auto& samples = latency_samples[method];
+    samples.push_back(latency_ms);
+    if (samples.size() > MULTI_DAEMON_LATENCY_SAMPLES)
+      samples.pop_front();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void multi_daemon_core_proxy::daemon_endpoint::report_failure()
+  {
+    uint64_t failures = ++failures_in_row;
+    unavailable_till = epee::misc_utils::get_tick_count() + std::min<uint64_t>(MULTI_DAEMON_BACKOFF_MS * failures, MULTI_DAEMON_BACKOFF_MAX_MS);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::daemon_endpoint::is_available(uint64_t now) const
+  {
+    return unavailable_till <= now;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  uint64_t multi_daemon_core_proxy::daemon_endpoint::get_hedge_delay_ms(const std::string& method)
+  {
+    std::vector<uint64_t> samples;
+    {
+      std::lock_guard<std::mutex> lk(samples_lock);
+      auto it = latency_samples.find(method);
+      if (it != latency_samples.end())
+        samples.assign(it->second.begin(), it->second.end());
+    }
+    if (samples.size() < MULTI_DAEMON_HEDGE_MIN_SAMPLES)
+      return MULTI_DAEMON_HEDGE_DEFAULT_DELAY_MS;
+    auto p95 = samples.begin() + samples.size() * 95 / 100;
+    std::nth_element(samples.begin(), p95, samples.end());
+    return std::max<uint64_t>(*p95, MULTI_DAEMON_HEDGE_MIN_DELAY_MS);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  multi_daemon_core_proxy::multi_daemon_core_proxy()
+    : m_connection_timeout(WALLET_RCP_CONNECTION_TIMEOUT)
+    , m_attempts_count(WALLET_RCP_COUNT_ATTEMNTS)
+    , m_use_pulled_blocks_cache(false)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::set_connection_addr(const std::string& urls)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    if (urls == m_addresses && !m_endpoints.empty())
+      return true; // the same daemons, their stats are kept
+
+    std::vector<std::string> addresses;
+    boost::split(addresses, urls, boost::is_any_of(","));
+    std::vector<endpoint_ptr> endpoints;
+    for (auto& a : addresses)
+    {
+      boost::trim(a);
+      if (a.empty())
+        continue;
+      endpoint_ptr pe = std::make_shared<daemon_endpoint>();
+      pe->address = a;
+      pe->proxy = std::make_shared<default_http_core_proxy>();
+      pe->proxy->set_connectivity(m_connection_timeout, m_attempts_count);
+      if (m_use_pulled_blocks_cache)
+        pe->proxy->enable_pulled_blocks_cache();
+      pe->proxy->set_connection_addr(a);
+      endpoints.push_back(pe);
+    }
+    CHECK_AND_ASSERT_MES(!endpoints.empty(), false, "no daemon address in \"" << urls << "\"");
+
+    m_endpoints.swap(endpoints);
+    m_current = m_endpoints.front(); // the first given is used till the others are known better
+    m_addresses = urls;
+    LOG_PRINT_L0("[MULTI_DAEMON] " << m_endpoints.size() << " daemon(s), starting with " << m_current->address);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void multi_daemon_core_proxy::set_connectivity(unsigned int connection_timeout, size_t repeats_count)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_connection_timeout = connection_timeout;
+    m_attempts_count = repeats_count;
+    for (auto& pe : m_endpoints)
+      pe->proxy->set_connectivity(connection_timeout, repeats_count);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void multi_daemon_core_proxy::enable_pulled_blocks_cache()
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_use_pulled_blocks_cache = true;
+    for (auto& pe : m_endpoints)
+      pe->proxy->enable_pulled_blocks_cache();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  size_t multi_daemon_core_proxy::get_endpoints_count()
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    return m_endpoints.size();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  multi_daemon_core_proxy::endpoint_ptr multi_daemon_core_proxy::pick_endpoint(const std::vector<endpoint_ptr>& excluded)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    uint64_t now = epee::misc_utils::get_tick_count();
+    uint64_t top_height = 0;
+    for (const auto& pe : m_endpoints)
+      top_height = std::max<uint64_t>(top_height, pe->height);
+
+    auto is_excluded = [&](const endpoint_ptr& pe) { return std::find(excluded.begin(), excluded.end(), pe) != excluded.end(); };
+    auto is_usable = [&](const endpoint_ptr& pe) { return !is_excluded(pe) && pe->is_available(now) && pe->height + MULTI_DAEMON_HEIGHT_LAG_MAX >= top_height; };
+    // the ones with known latency go first, the rest in the given order
+    auto is_faster = [](const endpoint_ptr& a, const endpoint_ptr& b) { return a->avg_latency_ms != 0 && (b->avg_latency_ms == 0 || a->avg_latency_ms < b->avg_latency_ms); };
+
+    endpoint_ptr best;
+    for (const auto& pe : m_endpoints)
+    {
+      if (is_usable(pe) && (!best || is_faster(pe, best)))
+        best = pe;
+    }
+    if (!best)
+    {
+      // all are failing or behind: the one that's due to be available first
+      for (const auto& pe : m_endpoints)
+      {
+        if (!is_excluded(pe) && (!best || pe->unavailable_till < best->unavailable_till))
+          best = pe;
+      }
+      return best;
+    }
+    if (!excluded.empty())
+      return best; // failover or hedging, the daemon in use stays
+
+    if (m_current && is_usable(m_current))
+    {
+      uint64_t current_latency = m_current->avg_latency_ms, best_latency = best->avg_latency_ms;
+      if (!current_latency || !best_latency || current_latency <= best_latency * MULTI_DAEMON_SWITCH_LATENCY_FACTOR + MULTI_DAEMON_SWITCH_LATENCY_MARGIN_MS)
+        return m_current;
+    }
+    if (m_current != best)
+    {
+      LOG_PRINT_L0("[MULTI_DAEMON] switching to " << best->address << " (height " << best->height << ", latency " << best->avg_latency_ms << " ms)"
+        << (m_current ? std::string(" from ") + m_current->address : std::string()));
+      m_current = best;
+    }
+    return best;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void multi_daemon_core_proxy::update_diagnostic_info(bool success)
+  {
+    if (success)
+    {
+      m_pdiganostic_info->last_success_interract_time = time(nullptr);
+      m_pdiganostic_info->last_daemon_is_disconnected = false;
+    }
+    else
+      m_pdiganostic_info->last_daemon_is_disconnected = true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void multi_daemon_core_proxy::probe_endpoints(const endpoint_ptr& except)
+  {
+    std::vector<endpoint_ptr> endpoints;
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      endpoints = m_endpoints;
+    }
+    uint64_t now = epee::misc_utils::get_tick_count();
+    for (const auto& pe : endpoints)
+    {
+      if (pe == except || pe->last_probe + MULTI_DAEMON_PROBE_INTERVAL_MS > now || pe->is_probing.exchange(true))
+        continue;
+      pe->last_probe = now;
+      std::thread([pe]()
+      {
+        currency::COMMAND_RPC_GET_INFO::request req = AUTO_VAL_INIT(req);
+        currency::COMMAND_RPC_GET_INFO::response rsp = AUTO_VAL_INIT(rsp);
+        uint64_t start = epee::misc_utils::get_tick_count();
+        if (pe->proxy->call_COMMAND_RPC_GET_INFO(req, rsp) && rsp.status == API_RETURN_CODE_OK)
+        {
+          pe->report_success("getinfo", epee::misc_utils::get_tick_count() - start);
+          pe->height = rsp.height;
+        }
+        else
+        {
+          pe->report_failure();
+        }
+        pe->is_probing = false;
+      }).detach();
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_INFO(const currency::COMMAND_RPC_GET_INFO::request& req, currency::COMMAND_RPC_GET_INFO::response& res)
+  {
+    endpoint_ptr used;
+    bool r = call("getinfo", [&](daemon_endpoint& e)
+    {
+      bool r = e.proxy->call_COMMAND_RPC_GET_INFO(req, res);
+      if (r && res.status == API_RETURN_CODE_OK)
+        e.height = res.height;
+      return r;
+    });
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      used = m_current;
+    }
+    // the wallets ask for it regularly, that's when the other daemons are checked
+    probe_endpoints(used);
+    return r;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_BLOCKS_DIRECT(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& rsp)
+  {
+    return call("getblocks", [&](daemon_endpoint& e)
+    {
+      bool r = e.proxy->call_COMMAND_RPC_GET_BLOCKS_DIRECT(rqt, rsp);
+      if (r && rsp.status == API_RETURN_CODE_OK)
+        e.height = rsp.current_height;
+      return r;
+    });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_BLOCKS_FAST(const currency::COMMAND_RPC_GET_BLOCKS_FAST::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_FAST::response& rsp)
+  {
+    return call("getblocks", [&](daemon_endpoint& e)
+    {
+      bool r = e.proxy->call_COMMAND_RPC_GET_BLOCKS_FAST(rqt, rsp);
+      if (r && rsp.status == API_RETURN_CODE_OK)
+        e.height = rsp.current_height;
+      return r;
+    });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3(const currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::request& rqt, currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::response& rsp)
+  {
+    return hedged_call("getrandom_outs3", rqt, rsp, &default_http_core_proxy::call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_SEND_RAW_TX(const currency::COMMAND_RPC_SEND_RAW_TX::request& rqt, currency::COMMAND_RPC_SEND_RAW_TX::response& rsp)
+  {
+    // a tx sent to two daemons is relayed by both, that's harmless
+    return hedged_call("sendrawtransaction", rqt, rsp, &default_http_core_proxy::call_COMMAND_RPC_SEND_RAW_TX);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES(const currency::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::request& rqt, currency::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::response& rsp)
+  {
+    return call("get_o_indexes", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES(rqt, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_EST_HEIGHT_FROM_DATE(const currency::COMMAND_RPC_GET_EST_HEIGHT_FROM_DATE::request& rqt, currency::COMMAND_RPC_GET_EST_HEIGHT_FROM_DATE::response& rsp)
+  {
+    return call("get_est_height_from_date", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_EST_HEIGHT_FROM_DATE(rqt, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_TX_POOL(const currency::COMMAND_RPC_GET_TX_POOL::request& rqt, currency::COMMAND_RPC_GET_TX_POOL::response& rsp)
+  {
+    return call("get_tx_pool", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_TX_POOL(rqt, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_ALIASES_BY_ADDRESS(const currency::COMMAND_RPC_GET_ALIASES_BY_ADDRESS::request& rqt, currency::COMMAND_RPC_GET_ALIASES_BY_ADDRESS::response& rsp)
+  {
+    return call("get_alias_by_address", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_ALIASES_BY_ADDRESS(rqt, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS(const currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& rqt, currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& rsp)
+  {
+    return call("getrandom_outs1", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS(rqt, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_FORCE_RELAY_RAW_TXS(const currency::COMMAND_RPC_FORCE_RELAY_RAW_TXS::request& rqt, currency::COMMAND_RPC_FORCE_RELAY_RAW_TXS::response& rsp)
+  {
+    return call("force_relay", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_FORCE_RELAY_RAW_TXS(rqt, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_ALL_ALIASES(currency::COMMAND_RPC_GET_ALL_ALIASES::response& rsp)
+  {
+    return call("get_all_alias_details", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_ALL_ALIASES(rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_ALIAS_DETAILS(const currency::COMMAND_RPC_GET_ALIAS_DETAILS::request& req, currency::COMMAND_RPC_GET_ALIAS_DETAILS::response& rsp)
+  {
+    return call("get_alias_details", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_ALIAS_DETAILS(req, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_ALIAS_REWARD(const currency::COMMAND_RPC_GET_ALIAS_REWARD::request& req, currency::COMMAND_RPC_GET_ALIAS_REWARD::response& rsp)
+  {
+    return call("get_alias_reward", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_ALIAS_REWARD(req, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_TRANSACTIONS(const currency::COMMAND_RPC_GET_TRANSACTIONS::request& req, currency::COMMAND_RPC_GET_TRANSACTIONS::response& rsp)
+  {
+    return call("gettransactions", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_TRANSACTIONS(req, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_COMMAND_RPC_CHECK_KEYIMAGES(const currency::COMMAND_RPC_CHECK_KEYIMAGES::request& req, currency::COMMAND_RPC_CHECK_KEYIMAGES::response& rsp)
+  {
+    return call("check_keyimages", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_COMMAND_RPC_CHECK_KEYIMAGES(req, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GETBLOCKTEMPLATE(const currency::COMMAND_RPC_GETBLOCKTEMPLATE::request& req, currency::COMMAND_RPC_GETBLOCKTEMPLATE::response& rsp)
+  {
+    return call("getblocktemplate", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GETBLOCKTEMPLATE(req, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_SUBMITBLOCK(const currency::COMMAND_RPC_SUBMITBLOCK::request& req, currency::COMMAND_RPC_SUBMITBLOCK::response& rsp)
+  {
+    return call("submitblock", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_SUBMITBLOCK(req, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_SUBMITBLOCK2(const currency::COMMAND_RPC_SUBMITBLOCK2::request& req, currency::COMMAND_RPC_SUBMITBLOCK2::response& rsp)
+  {
+    return call("submitblock2", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_SUBMITBLOCK2(req, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_POS_MINING_DETAILS(const currency::COMMAND_RPC_GET_POS_MINING_DETAILS::request& req, currency::COMMAND_RPC_GET_POS_MINING_DETAILS::response& rsp)
+  {
+    return call("get_pos_details", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_POS_MINING_DETAILS(req, rsp); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_BLOCKS_DETAILS(const currency::COMMAND_RPC_GET_BLOCKS_DETAILS::request& req, currency::COMMAND_RPC_GET_BLOCKS_DETAILS::response& res)
+  {
+    return call("get_blocks_details", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_BLOCKS_DETAILS(req, res); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_CURRENT_CORE_TX_EXPIRATION_MEDIAN(const currency::COMMAND_RPC_GET_CURRENT_CORE_TX_EXPIRATION_MEDIAN::request& req, currency::COMMAND_RPC_GET_CURRENT_CORE_TX_EXPIRATION_MEDIAN::response& res)
+  {
+    return call("get_current_core_tx_expiration_median", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_CURRENT_CORE_TX_EXPIRATION_MEDIAN(req, res); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_POOL_INFO(const currency::COMMAND_RPC_GET_POOL_INFO::request& req, currency::COMMAND_RPC_GET_POOL_INFO::response& res)
+  {
+    return call("get_pool_info", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_POOL_INFO(req, res); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_GET_ASSET_INFO(const currency::COMMAND_RPC_GET_ASSET_INFO::request& req, currency::COMMAND_RPC_GET_ASSET_INFO::response& res)
+  {
+    return call("get_asset_info", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_GET_ASSET_INFO(req, res); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::call_COMMAND_RPC_INVOKE(const std::string& uri, const std::string& body, int& response_code, std::string& response_body)
+  {
+    return call("invoke", [&](daemon_endpoint& e) { return e.proxy->call_COMMAND_RPC_INVOKE(uri, body, response_code, response_body); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::check_connection()
+  {
+    return call("check_connection", [&](daemon_endpoint& e) { return e.proxy->check_connection(); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  time_t multi_daemon_core_proxy::get_last_success_interract_time()
+  {
+    return m_pdiganostic_info->last_success_interract_time;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool multi_daemon_core_proxy::get_transfer_address(const std::string& adr_str, currency::account_public_address& addr, std::string& payment_id)
+  {
+    return tools::get_transfer_address(adr_str, addr, payment_id, this);
+  }
+}
@@ -0,0 +1,207 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "core_default_rpc_proxy.h"
+
+#define MULTI_DAEMON_HEIGHT_LAG_MAX                 2       // a daemon further behind the highest known one is not used while there are others
+#define MULTI_DAEMON_SWITCH_LATENCY_FACTOR          2       // the daemon in use is left for one that's that many times faster (plus the margin)...
+#define MULTI_DAEMON_SWITCH_LATENCY_MARGIN_MS       50      // ...so that close latencies don't make the wallet jump between daemons
+#define MULTI_DAEMON_LATENCY_SAMPLES                64      // per daemon and method, the p95 hedging delay is taken from them
+#define MULTI_DAEMON_HEDGE_MIN_SAMPLES              10
+#define MULTI_DAEMON_HEDGE_DEFAULT_DELAY_MS         2000    // till there are enough samples
+#define MULTI_DAEMON_HEDGE_MIN_DELAY_MS             50
+#define MULTI_DAEMON_BACKOFF_MS                     2000    // a failed daemon is not used for that long times the failures in a row...
+#define MULTI_DAEMON_BACKOFF_MAX_MS                 60000
+#define MULTI_DAEMON_PROBE_INTERVAL_MS              30000   // the daemons not in use are asked for getinfo that often, for their latency and height
+
+namespace tools
+{
+  /************************************************************************/
+  /* Proxy to several daemons given as a comma separated list of          */
+  /* addresses. Each request goes to the daemon in use, which is kept as  */
+  /* long as it's not failing, not behind the others' height and not much */
+  /* slower than the best one; a failed request is repeated with the next */
+  /* best daemon. getrandom_outs3 and sendrawtransaction are hedged: if   */
+  /* no response comes in the p95 latency of the daemon, the request is   */
+  /* sent to the next best one as well and the first response is taken.  */
+  /************************************************************************/
+  class multi_daemon_core_proxy final : public i_core_proxy
+  {
+  public:
+    multi_daemon_core_proxy();
+
+    bool set_connection_addr(const std::string& urls) override;
+    void set_connectivity(unsigned int connection_timeout, size_t repeats_count) override;
+    bool call_COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES(const currency::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::request& rqt, currency::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::response& rsp) override;
+    bool call_COMMAND_RPC_GET_BLOCKS_FAST(const currency::COMMAND_RPC_GET_BLOCKS_FAST::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_FAST::response& rsp) override;
+    bool call_COMMAND_RPC_GET_BLOCKS_DIRECT(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& rsp) override;
+    bool call_COMMAND_RPC_GET_EST_HEIGHT_FROM_DATE(const currency::COMMAND_RPC_GET_EST_HEIGHT_FROM_DATE::request& rqt, currency::COMMAND_RPC_GET_EST_HEIGHT_FROM_DATE::response& rsp) override;
+    bool call_COMMAND_RPC_GET_INFO(const currency::COMMAND_RPC_GET_INFO::request& rqt, currency::COMMAND_RPC_GET_INFO::response& rsp) override;
+    bool call_COMMAND_RPC_GET_TX_POOL(const currency::COMMAND_RPC_GET_TX_POOL::request& rqt, currency::COMMAND_RPC_GET_TX_POOL::response& rsp) override;
+    bool call_COMMAND_RPC_GET_ALIASES_BY_ADDRESS(const currency::COMMAND_RPC_GET_ALIASES_BY_ADDRESS::request& rqt, currency::COMMAND_RPC_GET_ALIASES_BY_ADDRESS::response& rsp) override;
+    bool call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS(const currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& rqt, currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& rsp) override;
+    bool call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3(const currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::request& rqt, currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::response& rsp) override;
+    bool call_COMMAND_RPC_SEND_RAW_TX(const currency::COMMAND_RPC_SEND_RAW_TX::request& rqt, currency::COMMAND_RPC_SEND_RAW_TX::response& rsp) override;
+    bool call_COMMAND_RPC_FORCE_RELAY_RAW_TXS(const currency::COMMAND_RPC_FORCE_RELAY_RAW_TXS::request& rqt, currency::COMMAND_RPC_FORCE_RELAY_RAW_TXS::response& rsp) override;
+    bool call_COMMAND_RPC_GET_ALL_ALIASES(currency::COMMAND_RPC_GET_ALL_ALIASES::response& rsp) override;
+    bool call_COMMAND_RPC_GET_ALIAS_DETAILS(const currency::COMMAND_RPC_GET_ALIAS_DETAILS::request& req, currency::COMMAND_RPC_GET_ALIAS_DETAILS::response& rsp) override;
+    bool call_COMMAND_RPC_GET_ALIAS_REWARD(const currency::COMMAND_RPC_GET_ALIAS_REWARD::request& req, currency::COMMAND_RPC_GET_ALIAS_REWARD::response& rsp) override;
+    bool call_COMMAND_RPC_GET_TRANSACTIONS(const currency::COMMAND_RPC_GET_TRANSACTIONS::request& req, currency::COMMAND_RPC_GET_TRANSACTIONS::response& rsp) override;
+    bool call_COMMAND_RPC_COMMAND_RPC_CHECK_KEYIMAGES(const currency::COMMAND_RPC_CHECK_KEYIMAGES::request& req, currency::COMMAND_RPC_CHECK_KEYIMAGES::response& rsp) override;
+    bool call_COMMAND_RPC_GETBLOCKTEMPLATE(const currency::COMMAND_RPC_GETBLOCKTEMPLATE::request& req, currency::COMMAND_RPC_GETBLOCKTEMPLATE::response& rsp) override;
+    bool call_COMMAND_RPC_SUBMITBLOCK(const currency::COMMAND_RPC_SUBMITBLOCK::request& req, currency::COMMAND_RPC_SUBMITBLOCK::response& rsp) override;
+    bool call_COMMAND_RPC_SUBMITBLOCK2(const currency::COMMAND_RPC_SUBMITBLOCK2::request& req, currency::COMMAND_RPC_SUBMITBLOCK2::response& rsp) override;
+    bool call_COMMAND_RPC_GET_POS_MINING_DETAILS(const currency::COMMAND_RPC_GET_POS_MINING_DETAILS::request& req, currency::COMMAND_RPC_GET_POS_MINING_DETAILS::response& rsp) override;
+    bool call_COMMAND_RPC_GET_BLOCKS_DETAILS(const currency::COMMAND_RPC_GET_BLOCKS_DETAILS::request& req, currency::COMMAND_RPC_GET_BLOCKS_DETAILS::response& res) override;
+    bool call_COMMAND_RPC_GET_CURRENT_CORE_TX_EXPIRATION_MEDIAN(const currency::COMMAND_RPC_GET_CURRENT_CORE_TX_EXPIRATION_MEDIAN::request& req, currency::COMMAND_RPC_GET_CURRENT_CORE_TX_EXPIRATION_MEDIAN::response& res) override;
+    bool call_COMMAND_RPC_GET_POOL_INFO(const currency::COMMAND_RPC_GET_POOL_INFO::request& req, currency::COMMAND_RPC_GET_POOL_INFO::response& res) override;
+    bool call_COMMAND_RPC_GET_ASSET_INFO(const currency::COMMAND_RPC_GET_ASSET_INFO::request& req, currency::COMMAND_RPC_GET_ASSET_INFO::response& res) override;
+    bool call_COMMAND_RPC_INVOKE(const std::string& uri, const std::string& body, int& response_code, std::string& response_body) override;
+
+    bool check_connection() override;
+    time_t get_last_success_interract_time() override;
+    bool get_transfer_address(const std::string& adr_str, currency::account_public_address& addr, std::string& payment_id) override;
+
+    // see default_http_core_proxy::enable_pulled_blocks_cache(), each daemon has its own
+    void enable_pulled_blocks_cache();
+
+  private:
+    // a daemon with its latency and height as seen by this proxy; shared with the hedged requests and probes, that may outlive a call
+    struct daemon_endpoint
+    {
+      std::string address;
+      std::shared_ptr<default_http_core_proxy> proxy;
+
+      std::atomic<uint64_t> avg_latency_ms;     // of getinfo, comparable between the daemons; 0 till the first one
+      std::atomic<uint64_t> height;
+      std::atomic<uint64_t> failures_in_row;
+      std::atomic<uint64_t> unavailable_till;   // tick count
+      std::atomic<uint64_t> last_probe;         // tick count
+      std::atomic<bool> is_probing;
+
+      std::mutex samples_lock;
+      std::map<std::string, std::deque<uint64_t>> latency_samples; // by method
+
+      daemon_endpoint();
+      void report_success(const std::string& method, uint64_t latency_ms);
+      void report_failure();
+      bool is_available(uint64_t now) const;
+      uint64_t get_hedge_delay_ms(const std::string& method);
+    };
+    typedef std::shared_ptr<daemon_endpoint> endpoint_ptr;
+
+    // picks the daemon for a request: the one in use, if it's still fine, unless some are excluded (tried already)
+    endpoint_ptr pick_endpoint(const std::vector<endpoint_ptr>& excluded = std::vector<endpoint_ptr>());
+    void update_diagnostic_info(bool success);
+    void probe_endpoints(const endpoint_ptr& except);
+
+    template<class t_call>
+    bool call(const std::string& method, t_call do_call)
+    {
+      std::vector<endpoint_ptr> tried;
+      while (true)
+      {
+        endpoint_ptr pe = pick_endpoint(tried);
+        if (!pe)
+          break;
+        uint64_t start = epee::misc_utils::get_tick_count();
+        if (do_call(*pe))
+        {
+          pe->report_success(method, epee::misc_utils::get_tick_count() - start);
+          update_diagnostic_info(true);
+          return true;
+        }
+        pe->report_failure();
+        LOG_PRINT_L1("[MULTI_DAEMON] " << method << " failed at " << pe->address << (tried.size() + 1 < get_endpoints_count() ? ", trying another daemon" : ""));
+        tried.push_back(pe);
+      }
+      update_diagnostic_info(false);
+      return false;
+    }
+
+    template<class t_request, class t_response>
+    bool hedged_call(const std::string& method, const t_request& rqt, t_response& rsp, bool (default_http_core_proxy::*pmethod)(const t_request&, t_response&))
+    {
+      endpoint_ptr primary = pick_endpoint();
+      if (!primary)
+      {
+        update_diagnostic_info(false);
+        return false;
+      }
+      endpoint_ptr secondary = pick_endpoint(std::vector<endpoint_ptr>{ primary });
+
+      struct hedge_state
+      {
+        std::mutex lock;
+        std::condition_variable condition;
+        size_t running = 0;
+        bool done = false;
+        t_request rqt;
+        t_response rsp;
+      };
+      std::shared_ptr<hedge_state> pstate = std::make_shared<hedge_state>();
+      pstate->rqt = rqt;
+
+      auto launch = [pstate, method, pmethod](const endpoint_ptr& pe)
+      {
+        std::thread([pstate, method, pmethod, pe]()
+        {
+          t_response local_rsp = AUTO_VAL_INIT(local_rsp);
+          uint64_t start = epee::misc_utils::get_tick_count();
+          bool r = ((*pe->proxy).*pmethod)(pstate->rqt, local_rsp);
+          if (r)
+            pe->report_success(method, epee::misc_utils::get_tick_count() - start);
+          else
+            pe->report_failure();
+          {
+            std::lock_guard<std::mutex> lk(pstate->lock);
+            --pstate->running;
+            if (r && !pstate->done)
+            {
+              pstate->done = true;
+              pstate->rsp = std::move(local_rsp);
+            }
+          }
+          pstate->condition.notify_all();
+        }).detach();
+      };
+
+      std::unique_lock<std::mutex> lk(pstate->lock);
+      pstate->running = 1;
+      launch(primary);
+      pstate->condition.wait_for(lk, std::chrono::milliseconds(primary->get_hedge_delay_ms(method)), [&]() { return pstate->done || pstate->running == 0; });
+      if (!pstate->done && secondary)
+      {
+        LOG_PRINT_L1("[MULTI_DAEMON] " << method << (pstate->running ? " is slow at " : " failed at ") << primary->address << ", sending it to " << secondary->address << " as well");
+        ++pstate->running;
+        launch(secondary);
+      }
+      pstate->condition.wait(lk, [&]() { return pstate->done || pstate->running == 0; });
+      if (pstate->done)
+        rsp = pstate->rsp;
+      update_diagnostic_info(pstate->done);
+      return pstate->done;
+    }
+
+    size_t get_endpoints_count();
+
+    std::mutex m_lock;
+    std::vector<endpoint_ptr> m_endpoints;
+    endpoint_ptr m_current;
+    std::string m_addresses;
+
+    unsigned int m_connection_timeout;
+    size_t m_attempts_count;
+    bool m_use_pulled_blocks_cache;
+  };
+}
@@ -2,9 +2,11 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <mutex>
 #include "decoy_selection.h"
 #include "decoy_selection_default_distribution.hpp"
 #include "crypto/crypto.h"
+#include "common/flat_hash_multimap.h"
 
 bool scaler::config_scale(uint64_t original, uint64_t scale_to)
 {
@@ -22,10 +24,11 @@ uint64_t scaler::scale(uint64_t h)
   return static_cast<uint64_t>(std::round(y));
 }
 
+#define DECOY_SELECTION_SAMPLING_TABLES_CACHE_SIZE   4
+
 void decoy_selection_generator::init(uint64_t max_h)
 {
-
-  load_distribution(g_default_distribution, max_h);
+  m_ptable = get_sampling_table(max_h);
   m_is_initialized = true;
   m_max = max_h; // distribution INCLUDE m_max, count = m_max + 1
 }
@@ -34,6 +37,30 @@ bool decoy_selection_generator::load_distribution_from_file(const char* path)
   return true;
 }
 
+std::shared_ptr<const decoy_selection_generator::sampling_table> decoy_selection_generator::get_sampling_table(uint64_t max_h)
+{
+  // the table depends on max_h only, so all the inputs of a transfer (and the transfers made till the next zc output) share one
+  static std::mutex tables_lock;
+  static std::map<uint64_t, std::shared_ptr<const sampling_table>> tables;
+
+  {
+    std::lock_guard<std::mutex> lk(tables_lock);
+    auto it = tables.find(max_h);
+    if (it != tables.end())
+      return it->second;
+  }
+
+  std::shared_ptr<sampling_table> ptable = std::make_shared<sampling_table>();
+  load_distribution(g_default_distribution, max_h, *ptable);
+
+  std::lock_guard<std::mutex> lk(tables_lock);
+  auto res = tables.emplace(max_h, ptable);
+  // max_h only grows, the lowest ones are the least likely to be asked for again
+  while (tables.size() > DECOY_SELECTION_SAMPLING_TABLES_CACHE_SIZE)
+    tables.erase(tables.begin());
+  return res.first->second;
+}
+
 #define TWO63 0x8000000000000000u 
 #define TWO64f (TWO63*2.0)
 
@@ -42,58 +69,75 @@ double map_uint_to_double(uint64_t u) {
   return y / TWO64f;
 }
 
+uint64_t decoy_selection_generator::draw_height() const
+{
+  const sampling_table& t = *m_ptable;
+  uint64_t r[3] = { 0 };
+  crypto::generate_random_bytes(sizeof(r), r);
+  size_t i = r[0] % t.h.size();
+  if (map_uint_to_double(r[1]) >= t.prob[i])
+    i = t.alias[i];
+  if (i == 0)
+    return t.h[0];
+  uint64_t h_0 = t.h[i - 1];
+  return h_0 + r[2] % (t.h[i] - h_0) + 1;
+}
+
 std::vector<uint64_t> decoy_selection_generator::generate_distribution(uint64_t count)
 {
   std::vector<uint64_t> res;
+  res.reserve(count);
   for (size_t i = 0; i != count; i++)
   {
-    uint64_t r = 0;
-    crypto::generate_random_bytes(sizeof(r), &r);
-    double r_ = map_uint_to_double(r);
-    auto it = m_distribution_mapping.upper_bound(r_);
-    if (it == m_distribution_mapping.end())
-    {
-      throw(std::runtime_error(std::string("_r not found in m_distribution_mapping: ") + std::to_string(r_) ));
-    }
-    uint64_t h = it->second;
-    if (it != m_distribution_mapping.begin())
-    {
-      uint64_t h_0 = (--it)->second;
-      crypto::generate_random_bytes(sizeof(r), &r);
-      h = h_0 + r % (h - h_0) + 1;
-    }
     //scale from nominal to max_h
-    res.push_back(h);  }
+    res.push_back(draw_height());
+  }
   return res;
 }
 
 
 std::vector<uint64_t> decoy_selection_generator::generate_unique_reversed_distribution(uint64_t count)
 {
-  std::set<uint64_t> set_to_extend;
-  generate_unique_reversed_distribution(count, set_to_extend);
-  return std::vector<uint64_t>(set_to_extend.begin(), set_to_extend.end());
+  std::vector<uint64_t> res;
+  generate_unique_reversed(count, std::vector<uint64_t>(), res);
+  return res;
 }
 
 std::vector<uint64_t> decoy_selection_generator::generate_unique_reversed_distribution(uint64_t count, uint64_t preincluded_item)
 {
-  std::set<uint64_t> set_to_extend;
-  set_to_extend.insert(preincluded_item);
-  generate_unique_reversed_distribution(count, set_to_extend);
-  return std::vector<uint64_t>(set_to_extend.begin(), set_to_extend.end());
+  std::vector<uint64_t> res;
+  generate_unique_reversed(count, std::vector<uint64_t>(1, preincluded_item), res);
+  return res;
+}
+
+void decoy_selection_generator::generate_unique_reversed_distribution(uint64_t count, std::set<uint64_t>& set_to_extend)
+{
+  std::vector<uint64_t> res;
+  generate_unique_reversed(count, std::vector<uint64_t>(set_to_extend.begin(), set_to_extend.end()), res);
+  set_to_extend.insert(res.begin(), res.end());
 }
 
 #define DECOY_SELECTION_GENERATOR_MAX_ITERATIONS   1000000
 
-void decoy_selection_generator::generate_unique_reversed_distribution(uint64_t count, std::set<uint64_t>& set_to_extend)
+void decoy_selection_generator::generate_unique_reversed(uint64_t count, const std::vector<uint64_t>& preincluded, std::vector<uint64_t>& result) const
 {
-  if (count + set_to_extend.size() > m_max)
+  if (count + preincluded.size() > m_max)
+  {
+    throw std::runtime_error(std::string("generate_distribution_set with unexpected count=") + std::to_string(count) + ", set_to_extend.size() = " + std::to_string(preincluded.size()) + ", m_max: " + std::to_string(m_max));
+  }
+
+  tools::flat_hash_multimap<uint64_t, uint8_t> seen;
+  seen.reserve(count);
+  result.clear();
+  result.reserve(count);
+  for (uint64_t item : preincluded)
   {
-    throw std::runtime_error(std::string("generate_distribution_set with unexpected count=") + std::to_string(count) + ", set_to_extend.size() = " + std::to_string(set_to_extend.size()) + ", m_max: " + std::to_string(m_max));
+    if (seen.insert(item, 0))
+      result.push_back(item);
   }
 
   size_t attempt_count = 0;
-  while (set_to_extend.size() != count)
+  while (result.size() != count)
   {
     attempt_count++;
     if (attempt_count > DECOY_SELECTION_GENERATOR_MAX_ITERATIONS)
@@ -101,24 +145,12 @@ void decoy_selection_generator::generate_unique_reversed_distribution(uint64_t c
       throw std::runtime_error("generate_distribution_set: attempt_count hit DECOY_SELECTION_GENERATOR_MAX_ITERATIONS");
     }
 
-    uint64_t r = 0;
-    crypto::generate_random_bytes(sizeof(r), &r);
-    double r_ = map_uint_to_double(r);
-    auto it = m_distribution_mapping.upper_bound(r_);
-    if (it == m_distribution_mapping.end())
-    {
-      throw(std::runtime_error(std::string("_r not found in m_distribution_mapping: ") + std::to_string(r_)));
-    }
-    uint64_t h = it->second;
-    if (it != m_distribution_mapping.begin())
-    {
-      uint64_t h_0 = (--it)->second;
-      crypto::generate_random_bytes(sizeof(r), &r);
-      h = h_0 + r % (h - h_0) + 1;
-    }
     //scale from nominal to max_h
-    set_to_extend.insert(m_max - h);
+    uint64_t item = m_max - draw_height();
+    if (seen.insert(item, 0))
+      result.push_back(item);
   }
+  std::sort(result.begin(), result.end());
 }
 
 uint64_t get_distance(const std::vector<decoy_selection_generator::distribution_entry> entries, size_t i)
@@ -128,7 +160,7 @@ uint64_t get_distance(const std::vector<decoy_selection_generator::distribution_
   return entries[i].h - entries[i - 1].h;
 }
 
-bool decoy_selection_generator::load_distribution(const std::vector<decoy_selection_generator::distribution_entry>& original_distribution, uint64_t max_h)
+bool decoy_selection_generator::load_distribution(const std::vector<decoy_selection_generator::distribution_entry>& original_distribution, uint64_t max_h, sampling_table& table)
 {
 
   //do prescale of distribution
@@ -172,13 +204,39 @@ bool decoy_selection_generator::load_distribution(const std::vector<decoy_select
     total_v += derived_distribution[i].v * get_distance(derived_distribution, i);
   }
 
-  double summ_current = 0;
-  for (size_t i = 0; i != derived_distribution.size(); i++)
+  // Vose's construction of the alias table: buckets over the average weight give their excess to the ones under it
+  size_t n = derived_distribution.size();
+  table.h.resize(n);
+  table.prob.resize(n);
+  table.alias.resize(n);
+  std::vector<double> scaled_weight(n);
+  std::vector<uint32_t> small, large;
+  for (size_t i = 0; i != n; i++)
+  {
+    table.h[i] = derived_distribution[i].h;
+    scaled_weight[i] = (derived_distribution[i].v * get_distance(derived_distribution, i)) / total_v * n;
+    table.alias[i] = static_cast<uint32_t>(i);
+    (scaled_weight[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+  }
+  while (!small.empty() && !large.empty())
   {
-    double k = (derived_distribution[i].v * get_distance(derived_distribution, i))/ total_v;
-    summ_current += k;
-    m_distribution_mapping[summ_current] = derived_distribution[i].h;
+    uint32_t s = small.back();
+    small.pop_back();
+    uint32_t l = large.back();
+    table.prob[s] = scaled_weight[s];
+    table.alias[s] = l;
+    scaled_weight[l] -= 1.0 - scaled_weight[s];
+    if (scaled_weight[l] < 1.0)
+    {
+      large.pop_back();
+      small.push_back(l);
+    }
   }
+  // what's left is 1.0 up to rounding errors
+  for (uint32_t i : large)
+    table.prob[i] = 1.0;
+  for (uint32_t i : small)
+    table.prob[i] = 1.0;
 
   return true;
 }
@@ -40,6 +40,15 @@ public:
     uint64_t h;
     double v;
   };
+
+  // the distribution scaled to max_h as a Walker alias table: a bucket is picked in O(1), then a height within it uniformly;
+  // bucket 0 is the single height h[0], bucket i covers (h[i - 1], h[i]]
+  struct sampling_table
+  {
+    std::vector<uint64_t> h;
+    std::vector<double> prob;     // of taking bucket i itself rather than alias[i]
+    std::vector<uint32_t> alias;
+  };
  
   void init(uint64_t max_h);
   bool load_distribution_from_file(const char* path);
@@ -50,8 +59,13 @@ public:
   bool is_initialized() { return m_is_initialized; }
 
 private: 
-  bool load_distribution(const std::vector<decoy_selection_generator::distribution_entry>& entries, uint64_t max_h);
+  static bool load_distribution(const std::vector<decoy_selection_generator::distribution_entry>& entries, uint64_t max_h, sampling_table& table);
+  static std::shared_ptr<const sampling_table> get_sampling_table(uint64_t max_h);
+  uint64_t draw_height() const;
+  // sorted, count items including the preincluded ones
+  void generate_unique_reversed(uint64_t count, const std::vector<uint64_t>& preincluded, std::vector<uint64_t>& result) const;
+
   bool m_is_initialized = false;
   uint64_t m_max = 0;
-  std::map<double, uint64_t> m_distribution_mapping;
+  std::shared_ptr<const sampling_table> m_ptable;
 };
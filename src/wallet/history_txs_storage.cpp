@@ -0,0 +1,131 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "history_txs_storage.h"
+#include "include_base_utils.h"
+#include "currency_core/currency_format_utils.h"
+
+namespace tools
+{
+  history_txs_storage::history_txs_storage()
+    : m_key(AUTO_VAL_INIT(m_key))
+    , m_end(0)
+  {}
+  //----------------------------------------------------------------------------------------------------
+  history_txs_storage::~history_txs_storage()
+  {
+    close();
+  }
+  //----------------------------------------------------------------------------------------------------
+  bool history_txs_storage::open(const std::wstring& path, bool keep_records)
+  {
+    close();
+    boost::system::error_code ec;
+    if (keep_records && boost::filesystem::exists(path, ec))
+      m_file.open(path, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+    else
+      m_file.open(path, std::ios_base::binary | std::ios_base::in | std::ios_base::out | std::ios_base::trunc);
+    CHECK_AND_ASSERT_MES(!m_file.fail(), false, "failed to open history txs storage " << epee::string_encoding::convert_to_ansii(path));
+    m_file.seekg(0, std::ios_base::end);
+    m_end = static_cast<uint64_t>(m_file.tellg());
+    crypto::generate_random_bytes(sizeof(m_key), &m_key);
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------
+  bool history_txs_storage::open(const std::wstring& path, const state& st)
+  {
+    close();
+    m_file.open(path, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+    CHECK_AND_ASSERT_MES(!m_file.fail(), false, "failed to open history txs storage " << epee::string_encoding::convert_to_ansii(path));
+    m_file.seekg(0, std::ios_base::end);
+    uint64_t file_size = static_cast<uint64_t>(m_file.tellg());
+    for (const auto& rl : st.index)
+    {
+      if (rl.offset + rl.size > file_size || rl.offset + rl.size < rl.offset)
+      {
+        LOG_ERROR("history txs storage " << epee::string_encoding::convert_to_ansii(path) << " is shorter than its index: " << file_size);
+        close();
+        return false;
+      }
+    }
+    m_key = st.key;
+    m_index = st.index;
+    m_end = file_size; // the records after the indexed ones may be referred by nothing, but they are not reused
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------
+  void history_txs_storage::close()
+  {
+    if (m_file.is_open())
+      m_file.close();
+    m_index.clear();
+    m_end = 0;
+  }
+  //----------------------------------------------------------------------------------------------------
+  bool history_txs_storage::is_open() const
+  {
+    return m_file.is_open();
+  }
+  //----------------------------------------------------------------------------------------------------
+  uint64_t history_txs_storage::size() const
+  {
+    return m_index.size();
+  }
+  //----------------------------------------------------------------------------------------------------
+  bool history_txs_storage::push_back(const currency::transaction& tx)
+  {
+    CHECK_AND_ASSERT_MES(m_file.is_open(), false, "history txs storage is not open");
+    std::string blob = currency::tx_to_blob(tx);
+    record_location rl = AUTO_VAL_INIT(rl);
+    rl.offset = m_end;
+    rl.size = blob.size();
+    rl.iv = crypto::rand<crypto::chacha8_iv>();
+    std::string cipher(blob.size(), '\0');
+    crypto::chacha8(blob.data(), blob.size(), m_key, rl.iv, &cipher[0]);
+
+    m_file.clear();
+    m_file.seekp(rl.offset);
+    m_file.write(cipher.data(), cipher.size());
+    CHECK_AND_ASSERT_MES(!m_file.fail(), false, "failed to write to history txs storage");
+    m_index.push_back(rl);
+    m_end += rl.size;
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------
+  bool history_txs_storage::get(uint64_t pos, currency::transaction& tx) const
+  {
+    CHECK_AND_ASSERT_MES(pos < m_index.size(), false, "wrong history txs storage position " << pos << ", size: " << m_index.size());
+    const record_location& rl = m_index[pos];
+    std::string cipher(rl.size, '\0');
+    m_file.clear();
+    m_file.seekg(rl.offset);
+    m_file.read(&cipher[0], cipher.size());
+    CHECK_AND_ASSERT_MES(!m_file.fail(), false, "failed to read history txs storage at position " << pos);
+    std::string blob(cipher.size(), '\0');
+    crypto::chacha8(cipher.data(), cipher.size(), m_key, rl.iv, &blob[0]);
+    CHECK_AND_ASSERT_MES(currency::parse_and_validate_tx_from_blob(blob, tx), false, "failed to parse tx from history txs storage at position " << pos);
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------
+  void history_txs_storage::truncate(uint64_t count)
+  {
+    if (count < m_index.size())
+      m_index.resize(count);
+  }
+  //----------------------------------------------------------------------------------------------------
+  bool history_txs_storage::flush()
+  {
+    if (!m_file.is_open())
+      return true;
+    m_file.flush();
+    CHECK_AND_ASSERT_MES(!m_file.fail(), false, "failed to flush history txs storage");
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------
+  void history_txs_storage::get_state(state& st) const
+  {
+    st.key = m_key;
+    st.index = m_index;
+  }
+}
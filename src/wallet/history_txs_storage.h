@@ -0,0 +1,75 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <string>
+#include <vector>
+#include <boost/filesystem/fstream.hpp>
+
+#include "crypto/chacha8.h"
+#include "currency_core/currency_basic.h"
+
+namespace tools
+{
+
+  // out-of-core storage for txs of old transfer history entries, so they don't stay in memory of an opened wallet
+  // txs are appended to a file kept along with the wallet file as blobs, each one encrypted with the storage key and its own iv, and read back by position
+  // the key and the index are kept in the wallet file (see get_state()), so it doesn't hold these txs and is loaded without parsing them;
+  // records are only appended, so the ones a stored wallet file refers to stay intact whatever happens to the storage afterwards
+  // no internal locking
+  class history_txs_storage
+  {
+  public:
+    struct record_location
+    {
+      uint64_t offset;
+      uint64_t size;
+      crypto::chacha8_iv iv;
+
+      template <class t_archive>
+      void serialize(t_archive& a, const unsigned int ver)
+      {
+        a & offset;
+        a & size;
+        a & reinterpret_cast<char (&)[sizeof(crypto::chacha8_iv)]>(iv);
+      }
+    };
+
+    struct state
+    {
+      crypto::chacha8_key key;
+      std::vector<record_location> index;
+
+      template <class t_archive>
+      void serialize(t_archive& a, const unsigned int ver)
+      {
+        a & reinterpret_cast<char (&)[sizeof(crypto::chacha8_key)]>(key);
+        a & index;
+      }
+    };
+
+    history_txs_storage();
+    ~history_txs_storage();
+
+    // a new, empty storage with a new key; records of the file are kept if a stored wallet file may refer to them
+    bool open(const std::wstring& path, bool keep_records);
+    // the storage as it was when the wallet file was stored
+    bool open(const std::wstring& path, const state& st);
+    void close();
+    bool is_open() const;
+    uint64_t size() const;
+    bool push_back(const currency::transaction& tx);
+    bool get(uint64_t pos, currency::transaction& tx) const;
+    void truncate(uint64_t count);
+    bool flush();
+    void get_state(state& st) const;
+
+  private:
+    mutable boost::filesystem::fstream m_file;
+    crypto::chacha8_key m_key;
+    std::vector<record_location> m_index;
+    uint64_t m_end;
+  };
+
+} // namespace tools
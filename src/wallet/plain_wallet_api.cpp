@@ -17,6 +17,7 @@
 #include "common/config_encrypt_helper.h"
 #include "static_helpers.h"
 #include "wallet_helpers.h"
+#include "common/threads_pool.h"
 
 #define ANDROID_PACKAGE_NAME    "com.zano_mobile"
 
@@ -31,6 +32,8 @@
 #define GENERAL_INTERNAL_ERRROR_INSTANCE "GENERAL_INTERNAL_ERROR: WALLET INSTNACE NOT FOUND"
 #define GENERAL_INTERNAL_ERRROR_INIT "Failed to intialize library"
 
+#define ASYNC_CALL_MAX_THREADS  8
+
 //TODO: global objects, subject to refactoring
 
 
@@ -58,6 +61,13 @@ void static_destroy_handler()
 
 namespace plain_wallet
 {
+  // calls that change a wallet are run one at a time, in the order they came, the rest go to the pool right away
+  struct wallet_calls_queue
+  {
+    std::deque<std::function<void()>> calls;
+    bool running = false;
+  };
+
   struct plain_wallet_instance
   {
     plain_wallet_instance() :initialized(false), gjobs_counter(1)
@@ -66,8 +76,14 @@ namespace plain_wallet
     std::atomic<bool> initialized;
 
     std::atomic<uint64_t> gjobs_counter;
-    std::map<uint64_t, std::string> gjobs;
+    std::unordered_map<uint64_t, std::string> gjobs;
     epee::critical_section gjobs_lock;
+    std::condition_variable_any gjobs_cv;
+
+    std::map<uint64_t, wallet_calls_queue> wallet_queues;
+    std::mutex wallet_queues_lock;
+    //declared last to be stopped first, while the rest is still alive
+    utils::threads_pool async_pool;
   };
 
   std::shared_ptr<plain_wallet::plain_wallet_instance> ginstance_ptr;
@@ -165,8 +181,11 @@ namespace plain_wallet
       //wait other callers finish
       local_ptr->gjobs_lock.lock();
       local_ptr->gjobs_lock.unlock();
+      local_ptr->gjobs_cv.notify_all();
       bool r = local_ptr->gwm.quick_stop_no_save();        
       LOG_PRINT_L0("[QUICK_STOP_NO_SAVE] return " << r);
+      //the calls still queued find no instance and return at once, the workers drop their references here
+      local_ptr->async_pool.stop();
       //let's prepare wallet manager for quick shutdown
       local_ptr.reset();
     }
@@ -196,6 +215,7 @@ namespace plain_wallet
     epee::static_helpers::set_or_call_on_destruct(true, static_destroy_handler);
 
     std::shared_ptr<plain_wallet_instance> ptr(new plain_wallet_instance());
+    ptr->async_pool.init(std::max<size_t>(2, std::min<size_t>(std::thread::hardware_concurrency(), ASYNC_CALL_MAX_THREADS)));
 
     set_bundle_working_dir(working_dir);
 
@@ -526,11 +546,46 @@ namespace plain_wallet
     {
       return;
     }
-    CRITICAL_REGION_LOCAL(inst_ptr->gjobs_lock);
-    inst_ptr->gjobs[job_id] = res;
+    {
+      CRITICAL_REGION_LOCAL(inst_ptr->gjobs_lock);
+      inst_ptr->gjobs[job_id] = res;
+    }
+    inst_ptr->gjobs_cv.notify_all();
     LOG_PRINT_L2("[ASYNC_CALL]: Finished(result put), job id: " << job_id);
   }
 
+  // read-only calls may run side by side with anything, including the calls to the same wallet
+  bool is_read_only_call(const std::string& method_name)
+  {
+    return method_name == "get_wallet_status" || method_name == "get_seed_phrase_info" || method_name == "get_seed_phrases_info";
+  }
+
+  // runs the oldest call of the wallet's queue and schedules the next one, if any, as a separate job
+  // so the queues of different wallets take turns in the pool
+  void run_wallet_queue(plain_wallet_instance* pinst, uint64_t instance_id)
+  {
+    std::function<void()> call;
+    {
+      std::lock_guard<std::mutex> lk(pinst->wallet_queues_lock);
+      wallet_calls_queue& q = pinst->wallet_queues[instance_id];
+      call = std::move(q.calls.front());
+      q.calls.pop_front();
+    }
+
+    call();
+
+    {
+      std::lock_guard<std::mutex> lk(pinst->wallet_queues_lock);
+      auto it = pinst->wallet_queues.find(instance_id);
+      if (it->second.calls.empty())
+      {
+        pinst->wallet_queues.erase(it);
+        return;
+      }
+    }
+    //outside of the lock: a stopped pool runs the job right here
+    pinst->async_pool.add_job([pinst, instance_id]() { run_wallet_queue(pinst, instance_id); });
+  }
 
   std::string async_call(const std::string& method_name, uint64_t instance_id, const std::string& params)
   {
@@ -544,8 +599,25 @@ namespace plain_wallet
       put_result(job_id, res_str);
     };
 
-    std::thread t([async_callback]() {async_callback(); });
-    t.detach();
+    //jobs don't hold the instance: the pool is stopped by the instance's destructor, which must not run in a worker
+    plain_wallet_instance* pinst = inst_ptr.get();
+    if (is_read_only_call(method_name))
+    {
+      pinst->async_pool.add_job(async_callback);
+    }
+    else
+    {
+      bool need_start = false;
+      {
+        std::lock_guard<std::mutex> lk(pinst->wallet_queues_lock);
+        wallet_calls_queue& q = pinst->wallet_queues[instance_id];
+        q.calls.push_back(async_callback);
+        need_start = !q.running;
+        q.running = true;
+      }
+      if (need_start)
+        pinst->async_pool.add_job([pinst, instance_id]() { run_wallet_queue(pinst, instance_id); });
+    }
     LOG_PRINT_L2("[ASYNC_CALL]: started " << method_name << ", job id: " << job_id);
     return std::string("{ \"job_id\": ") + std::to_string(job_id) + "}";
   }
@@ -603,6 +675,23 @@ namespace plain_wallet
         rsp.error_code = tools::get_seed_phrase_info(sip.seed_phrase, sip.seed_password, rsp.response_data);
         res = epee::serialization::store_t_to_json(rsp);
       }
+    }
+    else if (method_name == "get_seed_phrases_info")
+    {
+      tools::wallet_public::COMMAND_RPC_GET_SEED_PHRASES_INFO::request req = AUTO_VAL_INIT(req);
+      if (!epee::serialization::load_t_from_json(req, params))
+      {
+        view::api_response ar = AUTO_VAL_INIT(ar);
+        ar.error_code = "Wrong parameter";
+        res = epee::serialization::store_t_to_json(ar);
+      }
+      else
+      {
+        view::api_response_t<tools::wallet_public::COMMAND_RPC_GET_SEED_PHRASES_INFO::response> rsp = AUTO_VAL_INIT(rsp);
+        tools::get_seed_phrases_info(req.seeds, rsp.response_data.seeds_info);
+        rsp.error_code = API_RETURN_CODE_OK;
+        res = epee::serialization::store_t_to_json(rsp);
+      }
     }    
     else if (method_name == "invoke")
     {
@@ -624,18 +713,27 @@ namespace plain_wallet
 
 
 
-  std::string try_pull_result(uint64_t job_id)
+  std::string wait_result(uint64_t job_id, uint64_t timeout_ms)
   {
     auto inst_ptr = std::atomic_load(&ginstance_ptr);
     if (!inst_ptr)
     { 
       return "{\"status\": \"canceled\"}";
     }
-    //TODO: need refactoring
-    CRITICAL_REGION_LOCAL(inst_ptr->gjobs_lock);
+    std::unique_lock<epee::critical_section> lk(inst_ptr->gjobs_lock);
     auto it = inst_ptr->gjobs.find(job_id);
+    if (it == inst_ptr->gjobs.end() && timeout_ms)
+    {
+      inst_ptr->gjobs_cv.wait_for(lk, std::chrono::milliseconds(timeout_ms), [&]()
+      {
+        it = inst_ptr->gjobs.find(job_id);
+        return it != inst_ptr->gjobs.end() || !std::atomic_load(&ginstance_ptr);
+      });
+    }
     if (it == inst_ptr->gjobs.end())
     {
+      if (!std::atomic_load(&ginstance_ptr))
+        return "{\"status\": \"canceled\"}";
       return "{\"status\": \"idle\"}";
     }
     std::string res = "{\"status\": \"delivered\", \"result\": ";
@@ -645,6 +743,11 @@ namespace plain_wallet
     return res;
   }
 
+  std::string try_pull_result(uint64_t job_id)
+  {
+    return wait_result(job_id, 0);
+  }
+
   struct wallet_extended_info
   {
     view::wallet_info wi;
@@ -41,6 +41,7 @@ namespace plain_wallet
   //async api
   std::string async_call(const std::string& method_name, uint64_t instance_id, const std::string& params);
   std::string try_pull_result(uint64_t);
+  std::string wait_result(uint64_t job_id, uint64_t timeout_ms); // like try_pull_result, but waits up to timeout_ms for the result
   std::string sync_call(const std::string& method_name, uint64_t instance_id, const std::string& params);
 
   //cake wallet api extension
@@ -0,0 +1,122 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <ctime>
+#include "pulled_blocks_cache.h"
+#include "include_base_utils.h"
+#include "currency_core/currency_format_utils.h"
+
+namespace tools
+{
+  size_t pulled_blocks_cache::get_part_index(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& rqt)
+  {
+    return (rqt.prune_txs ? 2 : 0) + (rqt.key_images_filters ? 1 : 0);
+  }
+  //----------------------------------------------------------------------------------------------------
+  void pulled_blocks_cache::clear_part(chain_part& part)
+  {
+    part = chain_part();
+  }
+  //----------------------------------------------------------------------------------------------------
+  bool pulled_blocks_cache::get(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& rsp)
+  {
+    if (rqt.block_ids.empty())
+      return false;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    chain_part& part = m_parts[get_part_index(rqt)];
+    if (part.blocks.empty() || time(nullptr) > part.update_time + WALLET_PULLED_BLOCKS_CACHE_TTL)
+      return false;
+
+    auto it = part.heights.find(rqt.block_ids.front());
+    if (it == part.heights.end())
+      return false;
+    uint64_t top_height = it->second;
+    uint64_t start_height = std::max(top_height, rqt.minimum_height);
+    uint64_t end_height = part.start_height + part.blocks.size();
+    if (start_height >= end_height || (start_height == top_height && start_height + 1 == end_height))
+      return false; // nothing new for this wallet here, the daemon may have more
+
+    rsp.blocks.clear();
+    rsp.key_images_filters.clear();
+    for (uint64_t h = start_height; h != end_height && rsp.blocks.size() < COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT; ++h)
+    {
+      const block_entry& be = part.blocks[h - part.start_height];
+      rsp.blocks.push_back(be.data);
+      if (part.has_key_images_filters)
+        rsp.key_images_filters.push_back(be.key_images_filter);
+    }
+    rsp.start_height = start_height;
+    rsp.current_height = std::max(part.current_height, end_height);
+    rsp.txs_pruned = part.txs_pruned;
+    rsp.status = API_RETURN_CODE_OK;
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------
+  void pulled_blocks_cache::put(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& rqt, const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& rsp)
+  {
+    if (rsp.status != API_RETURN_CODE_OK || rsp.blocks.empty())
+      return;
+    bool has_key_images_filters = !rsp.key_images_filters.empty();
+    if (has_key_images_filters && rsp.key_images_filters.size() != rsp.blocks.size())
+      return; // the wallet reports it
+
+    // block ids are calculated out of the lock
+    std::vector<block_entry> entries;
+    entries.reserve(rsp.blocks.size());
+    auto it_filter = rsp.key_images_filters.begin();
+    for (const auto& b : rsp.blocks)
+    {
+      if (!b.block_ptr)
+        return;
+      entries.push_back(block_entry{ currency::get_block_hash(b.block_ptr->bl), b, has_key_images_filters ? *it_filter++ : std::string() });
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    chain_part& part = m_parts[get_part_index(rqt)];
+    uint64_t end_height = part.start_height + part.blocks.size();
+    bool part_is_fresh = !part.blocks.empty() && time(nullptr) <= part.update_time + WALLET_PULLED_BLOCKS_CACHE_TTL;
+    if (part_is_fresh && rsp.start_height + rsp.blocks.size() < part.start_height)
+      return; // a wallet far behind, keep the top of the chain for the rest
+
+    if (!part_is_fresh || part.txs_pruned != rsp.txs_pruned || part.has_key_images_filters != has_key_images_filters ||
+      rsp.start_height < part.start_height || rsp.start_height > end_height)
+    {
+      clear_part(part);
+      part.start_height = rsp.start_height;
+    }
+    else
+    {
+      // the daemon's response is newer than what it overlaps
+      while (part.start_height + part.blocks.size() > rsp.start_height)
+      {
+        part.heights.erase(part.blocks.back().id);
+        part.blocks.pop_back();
+      }
+    }
+
+    for (auto& e : entries)
+    {
+      part.heights[e.id] = part.start_height + part.blocks.size();
+      part.blocks.push_back(std::move(e));
+    }
+    while (part.blocks.size() > WALLET_PULLED_BLOCKS_CACHE_MAX_BLOCKS)
+    {
+      part.heights.erase(part.blocks.front().id);
+      part.blocks.pop_front();
+      ++part.start_height;
+    }
+    part.current_height = rsp.current_height;
+    part.update_time = time(nullptr);
+    part.txs_pruned = rsp.txs_pruned;
+    part.has_key_images_filters = has_key_images_filters;
+  }
+  //----------------------------------------------------------------------------------------------------
+  void pulled_blocks_cache::clear()
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (auto& part : m_parts)
+      clear_part(part);
+  }
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include "rpc/core_rpc_server_commands_defs.h"
+
+#define WALLET_PULLED_BLOCKS_CACHE_MAX_BLOCKS         (COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT * 2)
+#define WALLET_PULLED_BLOCKS_CACHE_TTL                60 // seconds since the last daemon response, then the cache is not used until the next one
+
+namespace tools
+{
+
+  // recently pulled blocks, already parsed, shared by all the wallets that pull blocks through the same proxy
+  // (e.g. all the wallets of wallets_manager in remote node mode), so each block is downloaded and parsed once
+  // a request is answered from the cache when the wallet's top block is in it and there are blocks after it,
+  // otherwise it goes to the daemon, and the response extends the cache (or replaces the part it overlaps, in case of a reorganization)
+  // block entries are shared with the responses and never modified, thread-safe
+  class pulled_blocks_cache
+  {
+  public:
+    bool get(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& rsp);
+    void put(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& rqt, const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& rsp);
+    void clear();
+
+  private:
+    struct block_entry
+    {
+      crypto::hash id;
+      currency::block_direct_data_entry data;
+      std::string key_images_filter;
+    };
+
+    // blocks pulled with the same request flags
+    struct chain_part
+    {
+      uint64_t start_height = 0;
+      std::deque<block_entry> blocks;                        // [start_height, start_height + blocks.size())
+      std::unordered_map<crypto::hash, uint64_t> heights;
+      uint64_t current_height = 0;                           // as of the last daemon response
+      time_t update_time = 0;
+      bool txs_pruned = false;
+      bool has_key_images_filters = false;
+    };
+
+    static size_t get_part_index(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& rqt);
+    static void clear_part(chain_part& part);
+
+    std::mutex m_lock;
+    chain_part m_parts[4];
+  };
+
+} // namespace tools
@@ -362,6 +362,24 @@ public:
     END_KV_SERIALIZE_MAP()
   };
 
+  // transfers of a synced range of blocks, the balances are the ones after all of them
+  struct transfers_batch_event_info
+  {
+    std::vector<tools::wallet_public::wallet_transfer_info> transfers;
+    std::list<tools::wallet_public::asset_balance_entry> balances;
+    uint64_t total_mined;
+    uint64_t wallet_id;
+    bool is_wallet_in_sync_process;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(transfers)
+      KV_SERIALIZE(balances)
+      KV_SERIALIZE(total_mined)
+      KV_SERIALIZE(wallet_id)
+      KV_SERIALIZE(is_wallet_in_sync_process)
+    END_KV_SERIALIZE_MAP()
+  };
+
   struct transfers_array
   {
     std::vector<tools::wallet_public::wallet_transfer_info> unconfirmed;
@@ -817,6 +835,21 @@ public:
     virtual bool update_wallet_status(const wallet_status_info& wsi){ return true; }
     virtual bool update_wallets_info(const wallets_summary_info& wsi){ return true; }
     virtual bool money_transfer(const transfer_event_info& wsi){ return true; }
+    // a view that doesn't take the batches gets them as separate transfers
+    virtual bool money_transfers_batch(const transfers_batch_event_info& tbi)
+    {
+      transfer_event_info tei = AUTO_VAL_INIT(tei);
+      tei.balances = tbi.balances;
+      tei.total_mined = tbi.total_mined;
+      tei.wallet_id = tbi.wallet_id;
+      tei.is_wallet_in_sync_process = tbi.is_wallet_in_sync_process;
+      for (const auto& ti : tbi.transfers)
+      {
+        tei.ti = ti;
+        money_transfer(tei);
+      }
+      return true;
+    }
     virtual bool wallet_sync_progress(const view::wallet_sync_progres_param& p){ return true; }
     virtual bool init(const std::string& path){ return true; }
     virtual bool pos_block_found(const currency::block& block_found){ return true; }
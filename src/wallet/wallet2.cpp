@@ -19,6 +19,7 @@ using namespace epee;
 #include "string_coding.h"
 #define KEEP_WALLET_LOG_MACROS
 #include "wallet2.h"
+#include "core_multi_daemon_proxy.h"
 #include "currency_core/currency_format_utils.h"
 #include "currency_core/bc_offers_service_basic.h"
 #include "rpc/core_rpc_server_commands_defs.h"
@@ -47,6 +48,7 @@ using namespace epee;
 #include "crypto/zarcanum.h"
 #include "wallet_debug_events_definitions.h"
 #include "decoy_selection.h"
+#include "common/threads_pool.h"
 
 using namespace currency;
 
@@ -59,6 +61,17 @@ using namespace currency;
 #define WALLET_TX_MAX_ALLOWED_FEE                                     (COIN * 100)
 
 #define WALLET_FETCH_RANDOM_OUTS_SIZE                                 200  
+#define WALLET_ZC_DECOYS_POOL_SIZE                                    10    // decoy sets for ZC inputs kept prefetched by refill_zc_decoys_pool()
+#define WALLET_ZC_DECOYS_POOL_MAX_AGE                                 10    // blocks, older sets are dropped so the decoys ages keep following the chain
+
+#define WALLET_PARALLEL_OUTS_LOOKUP_MIN_TXS                           32    // pulled batches with fewer txs are scanned on the refresh thread
+#define WALLET_PARALLEL_OUTS_LOOKUP_JOB_TXS                           16    // txs per thread pool job
+#define WALLET_PARALLEL_POS_SCAN_MIN_ENTRIES                          256   // wallets with fewer stakes are scanned on the mining thread
+#define WALLET_PARALLEL_POS_SCAN_JOB_ENTRIES                          32    // stakes per thread pool job
+
+#define WALLET_CONSOLIDATION_TX_MAX_INPUTS                            100   // inputs of a tx made by consolidate_outputs_below()
+#define WALLET_CONSOLIDATION_TXS_SEND_PAUSE_MS                        200   // between txs sent by consolidate_outputs_below(), not to flood the daemon's pool
+#define WALLET_BATCH_TRANSFER_TXS_SEND_PAUSE_MS                       200   // the same for transfer_batch()
 
 
 
@@ -67,13 +80,25 @@ using namespace currency;
 ENABLE_CHANNEL_BY_DEFAULT("wallet")
 namespace tools
 {
+  namespace
+  {
+    // shared by all the wallets of the process
+    utils::threads_pool& get_threads_pool()
+    {
+      return utils::get_compute_pool();
+    }
+  }
+
   wallet2::wallet2()
     : m_stop(false)
     , m_wcallback(new i_wallet2_callback()) //stub
     , m_core_proxy(new default_http_core_proxy())
     , m_upper_transaction_size_limit(0)
+    , m_found_free_amounts_ready(false)
     , m_fake_outputs_count(0)
     , m_do_rise_transfer(false)
+    , m_batch_transfer_callbacks(false)
+    , m_collecting_transfer_callbacks(false)
     , m_log_prefix("???")
     , m_watch_only(false)
     , m_required_decoys_count(CURRENCY_DEFAULT_DECOY_SET_SIZE)
@@ -83,6 +108,11 @@ namespace tools
     , m_max_utxo_count_for_defragmentation_tx(0)
     , m_decoys_count_for_defragmentation_tx(SIZE_MAX)
     , m_use_deffered_global_outputs(false)
+    , m_use_store_journal(false)
+    , m_offload_history_txs(false)
+    , m_loaded_history_txs_state(AUTO_VAL_INIT(m_loaded_history_txs_state))
+    , m_history_txs_file_referenced(false)
+    , m_store_history_txs_separately(false)
 #ifdef DISABLE_TOR
     , m_disable_tor_relay(true)
 #else
@@ -114,7 +144,7 @@ namespace tools
       CHECK_AND_ASSERT_THROW_MES(ri < tx.vout.size(), "Internal error: wrong tx transfer details: reciev index=" << ri << " is greater than transaction outputs vector " << tx.vout.size());
       VARIANT_SWITCH_BEGIN(tx.vout[ri]);
       VARIANT_CASE_CONST(tx_out_bare, o)
-        if (o.target.type() == typeid(currency::txout_to_key))
+        if (tools::is_variant_type<currency::txout_to_key>(o.target))
         {
           //update unlock_time if needed
           if (ut2.unlock_time_array[ri] > max_unlock_time)
@@ -146,6 +176,14 @@ std::string wallet2::transfer_flags_to_str(uint32_t flags)
 void wallet2::init(const std::string& daemon_address)
 {
   //m_miner_text_info = PROJECT_VERSION_LONG;
+  std::shared_ptr<default_http_core_proxy> pdefault_proxy = std::dynamic_pointer_cast<default_http_core_proxy>(m_core_proxy);
+  if (pdefault_proxy && daemon_address.find(',') != std::string::npos)
+  {
+    // several daemons: each request goes to the best one of them
+    std::shared_ptr<multi_daemon_core_proxy> pmulti_proxy = std::make_shared<multi_daemon_core_proxy>();
+    pmulti_proxy->set_connectivity(pdefault_proxy->get_connection_timeout(), pdefault_proxy->get_attempts_count());
+    m_core_proxy = pmulti_proxy;
+  }
   m_core_proxy->set_connection_addr(daemon_address);
   m_core_proxy->check_connection();
 
@@ -248,6 +286,7 @@ size_t wallet2::fix_collisions()
     {
       m_transfers[*it].m_flags |= WALLET_TRANSFER_DETAIL_FLAG_SPENT;
       m_transfers[*it].m_spent_height = *rsp_ki.images_stat.begin();
+      invalidate_balance_counters();
       WLT_LOG_L0("Fixed collision for key image " << coll_entry.first << " transfer " << count);
       count++;
     }
@@ -317,34 +356,34 @@ void wallet2::fetch_tx_global_indixes(const std::list<std::reference_wrapper<con
 
 bool out_is_to_key(const currency::tx_out_v& out_t)
 {
-  if (out_t.type() == typeid(currency::tx_out_bare))
+  if (tools::is_variant_type<currency::tx_out_bare>(out_t))
   {
-    return boost::get<currency::tx_out_bare>(out_t).target.type() == typeid(currency::txout_to_key);
+    return tools::is_variant_type<currency::txout_to_key>(boost::get<currency::tx_out_bare>(out_t).target);
   }
   return false;
 }
 
 bool out_is_multisig(const currency::tx_out_v& out_t)
 {
-  if (out_t.type() == typeid(currency::tx_out_bare))
+  if (tools::is_variant_type<currency::tx_out_bare>(out_t))
   {
-    return boost::get<currency::tx_out_bare>(out_t).target.type() == typeid(currency::txout_multisig);
+    return tools::is_variant_type<currency::txout_multisig>(boost::get<currency::tx_out_bare>(out_t).target);
   }
   return false;
 }
 
 bool out_is_to_htlc(const currency::tx_out_v& out_t)
 {
-  if (out_t.type() == typeid(currency::tx_out_bare))
+  if (tools::is_variant_type<currency::tx_out_bare>(out_t))
   {
-    return boost::get<currency::tx_out_bare>(out_t).target.type() == typeid(currency::txout_htlc);
+    return tools::is_variant_type<currency::txout_htlc>(boost::get<currency::tx_out_bare>(out_t).target);
   }
   return false;
 }
 
 bool out_is_zc(const currency::tx_out_v& out_t)
 {
-  return out_t.type() == typeid(currency::tx_out_zarcanum);
+  return tools::is_variant_type<currency::tx_out_zarcanum>(out_t);
 }
 
 const currency::txout_htlc& out_get_htlc(const currency::tx_out_v& out_t)
@@ -354,16 +393,16 @@ const currency::txout_htlc& out_get_htlc(const currency::tx_out_v& out_t)
 
 const crypto::public_key& wallet2::out_get_pub_key(const currency::tx_out_v& out_t, std::list<currency::htlc_info>& htlc_info_list)
 {
-  if (out_t.type() == typeid(tx_out_bare))
+  if (tools::is_variant_type<tx_out_bare>(out_t))
   {
     const currency::tx_out_bare& out = boost::get<currency::tx_out_bare>(out_t);
-    if (out.target.type() == typeid(currency::txout_to_key))
+    if (tools::is_variant_type<currency::txout_to_key>(out.target))
     {
       return boost::get<currency::txout_to_key>(out.target).key;
     }
     else
     {
-      THROW_IF_FALSE_WALLET_INT_ERR_EX(out.target.type() == typeid(currency::txout_htlc), "Unexpected out type in target wallet: " << out.target.type().name());
+      THROW_IF_FALSE_WALLET_INT_ERR_EX(tools::is_variant_type<currency::txout_htlc>(out.target), "Unexpected out type in target wallet: " << out.target.type().name());
       THROW_IF_FALSE_WALLET_INT_ERR_EX(htlc_info_list.size() > 0, "Found txout_htlc out but htlc_info_list is empty");
       bool hltc_our_out_is_before_expiration = htlc_info_list.front().hltc_our_out_is_before_expiration;
       htlc_info_list.pop_front();
@@ -379,7 +418,7 @@ const crypto::public_key& wallet2::out_get_pub_key(const currency::tx_out_v& out
   }
   else
   {
-    THROW_IF_FALSE_WALLET_INT_ERR_EX(out_t.type() == typeid(currency::tx_out_zarcanum), "Unexpected out type im wallet: " << out_t.type().name());
+    THROW_IF_FALSE_WALLET_INT_ERR_EX(tools::is_variant_type<currency::tx_out_zarcanum>(out_t), "Unexpected out type im wallet: " << out_t.type().name());
     return boost::get<currency::tx_out_zarcanum>(out_t).stealth_address;
   }
 }
@@ -559,10 +598,10 @@ uint64_t wallet2::get_actual_zc_global_index()
   throw std::runtime_error(""); //mostly to suppress compiler warning 
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t height, const currency::block& b, const std::vector<uint64_t>* pglobal_indexes)
+void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t height, const currency::block& b, const std::vector<uint64_t>* pglobal_indexes, const crypto::hash* ptx_id)
 {
   //check for transaction spends
-  process_transaction_context ptc(tx);
+  process_transaction_context ptc(tx, ptx_id ? *ptx_id : null_hash); // null_hash: to be calculated when needed
 
   process_unconfirmed(tx, ptc.recipients, ptc.remote_aliases);
 
@@ -615,7 +654,7 @@ void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t
         continue;
       }
 
-      if (in_htlc.key_offsets[0].type() != typeid(uint64_t))
+      if (!tools::is_variant_type<uint64_t>(in_htlc.key_offsets[0]))
       {
         LOG_ERROR("HTLC with ref_by_id is not supported by wallet yet");
         continue;
@@ -626,7 +665,7 @@ void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t
       {
         transfer_details& td = m_transfers[it->second];
         WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(td.m_ptx_wallet_info->m_tx.vout.size() > td.m_internal_output_index, "Internal error: wrong td.m_internal_output_index: " << td.m_internal_output_index);
-        WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index].type() == typeid(tx_out_bare), "Internal error: wrong output type: " << td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index].type().name());
+        WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(tools::is_variant_type<tx_out_bare>(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index]), "Internal error: wrong output type: " << td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index].type().name());
         const boost::typeindex::type_info& ti = boost::get<tx_out_bare>(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index]).target.type();
         WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(ti == typeid(txout_htlc), "Internal error: wrong type of output's target: " << ti.name());
         //input spend active htlc
@@ -656,8 +695,25 @@ void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t
   //check for transaction income
   crypto::key_derivation derivation = AUTO_VAL_INIT(derivation);
   std::list<htlc_info> htlc_info_list;
-  r = lookup_acc_outs(m_account.get_keys(), tx, ptc.tx_pub_key, outs, derivation, htlc_info_list);
-  THROW_IF_TRUE_WALLET_EX(!r, error::acc_outs_lookup_error, tx, ptc.tx_pub_key, m_account.get_keys());
+  auto it_lookup = m_pulled_txs_outs_lookup.find(&tx);
+  if (it_lookup != m_pulled_txs_outs_lookup.end() && it_lookup->second.ok)
+  {
+    // already done by lookup_outs_for_pulled_blocks()
+    outs.swap(it_lookup->second.outs);
+    derivation = it_lookup->second.derivation;
+    htlc_info_list.swap(it_lookup->second.htlc_info_list);
+  }
+  else
+  {
+    TIME_MEASURE_START(inline_lookup_time);
+    r = lookup_acc_outs(m_account.get_keys(), tx, ptc.tx_pub_key, outs, derivation, htlc_info_list, &m_deposit_spend_keys);
+    TIME_MEASURE_FINISH(inline_lookup_time);
+    m_scan_stats.inline_lookup_us += inline_lookup_time;
+    THROW_IF_TRUE_WALLET_EX(!r, error::acc_outs_lookup_error, tx, ptc.tx_pub_key, m_account.get_keys());
+  }
+  ++m_scan_stats.txs;
+  m_scan_stats.outputs += tx.vout.size();
+  m_scan_stats.own_outputs += outs.size();
 
   if (!outs.empty())
   {
@@ -731,7 +787,7 @@ void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t
           {
             // normal wallet, calculate and store key images for own outs
             currency::keypair in_ephemeral = AUTO_VAL_INIT(in_ephemeral);
-            currency::generate_key_image_helper(m_account.get_keys(), ptc.tx_pub_key, o, in_ephemeral, ki);
+            currency::generate_key_image_helper(get_deposit_account_keys(out.deposit_index), ptc.tx_pub_key, o, in_ephemeral, ki);
             WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(in_ephemeral.pub == out_key, "key_image generated ephemeral public key that does not match with output_key");
           }
 
@@ -797,14 +853,16 @@ void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t
             continue; // skip the output
           }
 
-          ptc.employed_entries.receive.push_back(wallet_public::employed_tx_entry{ o , out.amount , out.asset_id});
+          ptc.employed_entries.receive.push_back(wallet_public::employed_tx_entry{ o , out.amount , out.asset_id, out.deposit_index });
 
           m_transfers.push_back(boost::value_initialized<transfer_details>());
+          invalidate_balance_counters();
           transfer_details& td = m_transfers.back();
           td.m_ptx_wallet_info = pwallet_info;
           td.m_internal_output_index = o;
           td.m_key_image = ki;
           td.m_amount = out.amount;
+          td.m_deposit_index = out.deposit_index;
           if (m_use_deffered_global_outputs)
           {
             if (pglobal_indexes && pglobal_indexes->size() > o)
@@ -1006,7 +1064,7 @@ void wallet2::prepare_wti_decrypted_attachments(wallet_public::wallet_transfer_i
 
   for (const auto& item : decrypted_att)
   {
-    if (item.type() == typeid(currency::tx_service_attachment))
+    if (tools::is_variant_type<currency::tx_service_attachment>(item))
     {
       wti.service_entries.push_back(boost::get<currency::tx_service_attachment>(item));
     }
@@ -1098,10 +1156,11 @@ void wallet2::accept_proposal(const crypto::hash& contract_id, uint64_t b_accept
   tdb.m_ptx_wallet_info = pwallet_info;
   tdb.m_internal_output_index = n;
   tdb.m_flags &= ~(WALLET_TRANSFER_DETAIL_FLAG_SPENT);
+  invalidate_balance_counters();
   //---------------------------------
   //@#@ todo: proper handling with zarcanum_based stuff
   //figure out fee that was left for release contract 
-  THROW_IF_FALSE_WALLET_INT_ERR_EX(tx.vout[n].type() == typeid(tx_out_bare), "Unexpected output type in accept proposal");
+  THROW_IF_FALSE_WALLET_INT_ERR_EX(tools::is_variant_type<tx_out_bare>(tx.vout[n]), "Unexpected output type in accept proposal");
   THROW_IF_FALSE_WALLET_INT_ERR_EX(boost::get<tx_out_bare>(tx.vout[n]).amount > (contr_it->second.private_detailes.amount_to_pay +
     contr_it->second.private_detailes.amount_b_pledge +
     contr_it->second.private_detailes.amount_a_pledge), "THere is no left money for fee, contract_id: " << contract_id);
@@ -1296,7 +1355,7 @@ void wallet2::scan_tx_to_key_inputs(std::vector<uint64_t>& found_transfers, cons
 {
   for (auto& in : tx.vin)
   {
-    if (in.type() == typeid(currency::txin_to_key))
+    if (tools::is_variant_type<currency::txin_to_key>(in))
     {
       
       auto it = m_key_images.find(boost::get<currency::txin_to_key>(in).k_image);
@@ -1390,7 +1449,10 @@ bool wallet2::handle_release_contract(wallet_public::wallet_transfer_info& wti,
   if (release_instruction == BC_ESCROW_SERVICE_INSTRUCTION_RELEASE_NORMAL)
     change_contract_state(it->second, wallet_public::escrow_contract_details_basic::contract_released_normal, ms_id, wti);
   else if (release_instruction == BC_ESCROW_SERVICE_INSTRUCTION_RELEASE_CANCEL)
+  {
     change_contract_state(it->second, wallet_public::escrow_contract_details_basic::contract_released_cancelled, ms_id, wti);
+    add_contract_expiration_trigger(ms_id, it->second); // an unconfirmed acceptance expires with the cancel template
+  }
   else if (release_instruction == BC_ESCROW_SERVICE_INSTRUCTION_RELEASE_BURN)
   {
     change_contract_state(it->second, wallet_public::escrow_contract_details_basic::contract_released_burned, ms_id, wti);
@@ -1476,7 +1538,7 @@ bool wallet2::handle_cancel_proposal(wallet_public::wallet_transfer_info& wti, c
 {
   PROFILE_FUNC("wallet2::handle_cancel_proposal");
   //validate cancel proposal 
-  WLT_CHECK_AND_ASSERT_MES(ectb.tx_cancel_template.vin.size() && ectb.tx_cancel_template.vin[0].type() == typeid(currency::txin_multisig), false, "Wrong cancel ecrow proposal");
+  WLT_CHECK_AND_ASSERT_MES(ectb.tx_cancel_template.vin.size() && tools::is_variant_type<currency::txin_multisig>(ectb.tx_cancel_template.vin[0]), false, "Wrong cancel ecrow proposal");
   crypto::hash contract_id = boost::get<currency::txin_multisig>(ectb.tx_cancel_template.vin[0]).multisig_out_id;
   auto it = m_contracts.find(contract_id);
   WLT_CHECK_AND_ASSERT_MES(it != m_contracts.end(), false, "Multisig out not found in tx template in proposal");
@@ -1493,6 +1555,7 @@ bool wallet2::handle_cancel_proposal(wallet_public::wallet_transfer_info& wti, c
   case wallet_public::escrow_contract_details::contract_cancel_proposal_sent: // update contract info even if already in that state
     it->second.cancel_body.tx_cancel_template = ectb.tx_cancel_template;
     it->second.cancel_expiration_time = currency::get_tx_expiration_time(ectb.tx_cancel_template);
+    add_contract_expiration_trigger(contract_id, it->second);
     //update wti info to let GUI know
     wti.contract.resize(1);
     static_cast<wallet_public::escrow_contract_details_basic&>(wti.contract.back()) = it->second;
@@ -1511,7 +1574,7 @@ bool wallet2::process_contract_info(wallet_public::wallet_transfer_info& wti, co
   PROFILE_FUNC("wallet2::process_contract_info");
   for (const auto& v : decrypted_attach)
   {
-    if (v.type() == typeid(tx_service_attachment))
+    if (tools::is_variant_type<tx_service_attachment>(v))
     {
       const tx_service_attachment& sa = boost::get<tx_service_attachment>(v);
       if (sa.service_id == BC_ESCROW_SERVICE_ID)
@@ -1657,6 +1720,11 @@ void wallet2::rise_on_transfer2(const wallet_public::wallet_transfer_info& wti)
   PROFILE_FUNC("wallet2::rise_on_transfer2");
   if (!m_do_rise_transfer)
     return;
+  if (m_collecting_transfer_callbacks)
+  {
+    m_collected_transfer_callbacks.push_back(wti);
+    return;
+  }
   std::list<wallet_public::asset_balance_entry> balances;
   uint64_t mined_balance = 0;
   this->balance(balances, mined_balance);
@@ -1665,6 +1733,18 @@ void wallet2::rise_on_transfer2(const wallet_public::wallet_transfer_info& wti)
   //m_wcallback->on_transfer2(wti, balances, mined_balance);
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::flush_transfer_callbacks()
+{
+  if (m_collected_transfer_callbacks.empty())
+    return;
+  std::vector<wallet_public::wallet_transfer_info> wtis;
+  wtis.swap(m_collected_transfer_callbacks);
+  std::list<wallet_public::asset_balance_entry> balances;
+  uint64_t mined_balance = 0;
+  this->balance(balances, mined_balance);
+  m_wcallback->on_transfers_batch(wtis, balances, mined_balance);
+}
+//----------------------------------------------------------------------------------------------------
 /*
 void wallet2::handle_money_spent2(const currency::block& b,
                                   const currency::transaction& in_tx, 
@@ -1772,17 +1852,18 @@ void wallet2::unprocess_htlc_triggers_on_block_removed(uint64_t height)
       //but we keep spend flag anyway
       tr.m_flags |= WALLET_TRANSFER_DETAIL_FLAG_SPENT; //re assure that it has spent flag
       tr.m_spent_height = 0;
+      invalidate_balance_counters();
     }
     else
     {
       // this means that wallet created atomic by itself, and second part didn't redeem it, 
       // so refund money became available, and now we back again to unavailable state
       tr.m_flags |= WALLET_TRANSFER_DETAIL_FLAG_SPENT; //reset spent flag
-      m_found_free_amounts.clear(); //reset free amounts cache 
+      remove_transfer_from_transfers_cache(it->second.transfer_index);
       tr.m_spent_height = 0;
     }
     //re-add to active contracts
-    WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(tr.m_ptx_wallet_info->m_tx.vout[tr.m_internal_output_index].type() == typeid(tx_out_bare), std::string("Unexprected type of out in unprocess_htlc_triggers_on_block_removed : ") + tr.m_ptx_wallet_info->m_tx.vout[tr.m_internal_output_index].type().name());
+    WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(tools::is_variant_type<tx_out_bare>(tr.m_ptx_wallet_info->m_tx.vout[tr.m_internal_output_index]), std::string("Unexprected type of out in unprocess_htlc_triggers_on_block_removed : ") + tr.m_ptx_wallet_info->m_tx.vout[tr.m_internal_output_index].type().name());
     auto pair_key = std::make_pair(tr.m_amount, tr.m_global_output_index);
     auto it_active_htlc = m_active_htlcs.find(pair_key);
     if (it_active_htlc != m_active_htlcs.end())
@@ -1832,20 +1913,18 @@ void wallet2::process_htlc_triggers_on_block_added(uint64_t height)
       // this means that wallet received atomic as proposal but never activated it, money returned to initiator
       tr.m_flags |= WALLET_TRANSFER_DETAIL_FLAG_SPENT; //re assure that it has spent flag
       tr.m_spent_height = height;
+      remove_transfer_from_transfers_cache(it->second.transfer_index);
     }
     else
     {
       // this means that wallet created atomic by itself, and second part didn't redeem it, so refund money should become available
       tr.m_flags &= ~(WALLET_TRANSFER_DETAIL_FLAG_SPENT); //reset spent flag
-      m_found_free_amounts.clear(); //reset free amounts cache 
       tr.m_spent_height = 0;
+      add_transfer_to_transfers_cache(it->second.transfer_index);
     }    
-    
-    //reset cache
-    m_found_free_amounts.clear();
 
     //remove it from active contracts
-    CHECK_AND_ASSERT_MES(tr.m_ptx_wallet_info->m_tx.vout[tr.m_internal_output_index].type() == typeid(tx_out_bare), void(), "Unexpected type out in process_htlc_triggers_on_block_added: " << tr.m_ptx_wallet_info->m_tx.vout[tr.m_internal_output_index].type().name());
+    CHECK_AND_ASSERT_MES(tools::is_variant_type<tx_out_bare>(tr.m_ptx_wallet_info->m_tx.vout[tr.m_internal_output_index]), void(), "Unexpected type out in process_htlc_triggers_on_block_added: " << tr.m_ptx_wallet_info->m_tx.vout[tr.m_internal_output_index].type().name());
     uint64_t amount = tr.m_amount;
 
     auto it_active_htlc = m_active_htlcs.find(std::make_pair(amount, tr.m_global_output_index));
@@ -1871,6 +1950,15 @@ void wallet2::process_htlc_triggers_on_block_added(uint64_t height)
 //----------------------------------------------------------------------------------------------------
 void wallet2::process_new_blockchain_entry(const currency::block& b, const currency::block_direct_data_entry& bche, const crypto::hash& bl_id, uint64_t height)
 {
+  TIME_MEASURE_START(entry_time);
+  const uint64_t inline_lookup_us_before = m_scan_stats.inline_lookup_us;
+  auto scan_stats_updater = epee::misc_utils::create_scope_leave_handler([&]()
+  {
+    TIME_MEASURE_FINISH(entry_time);
+    ++m_scan_stats.blocks;
+    m_scan_stats.state_update_us += entry_time - std::min(entry_time, m_scan_stats.inline_lookup_us - inline_lookup_us_before);
+  });
+
   //handle transactions from new block
   THROW_IF_TRUE_WALLET_EX(height != get_blockchain_current_size() &&
     !(height == m_minimum_height || get_blockchain_current_size() <= 1), error::wallet_internal_error,
@@ -1893,15 +1981,17 @@ void wallet2::process_new_blockchain_entry(const currency::block& b, const curre
     TIME_MEASURE_FINISH(miner_tx_handle_time);
 
     TIME_MEASURE_START(txs_handle_time);
+    // the order doesn't need checking if the entry came right from the core, hashing the txs would be the only serialization left there
+    const bool txs_order_known = bche.block_id != null_hash;
     size_t count = 0;
     for(const auto& tx_entry: bche.txs_ptr)
     {
-      if (b.tx_hashes.size() < count || currency::get_transaction_hash(tx_entry->tx) != b.tx_hashes[count])
+      if (!txs_order_known && (b.tx_hashes.size() < count || (m_pulled_stripped_txs.count(&tx_entry->tx) == 0 && currency::get_transaction_hash(tx_entry->tx) != b.tx_hashes[count])))
       {
         LOG_ERROR("Found tx order fail in process_new_blockchain_entry: count=" << count 
           << ", b.tx_hashes.size() = " << b.tx_hashes.size() << ", tx real id: " << currency::get_transaction_hash(tx_entry->tx) << ", bl_id: " << bl_id);
       }
-      process_new_transaction(tx_entry->tx, height, b, &(tx_entry->m_global_output_indexes));
+      process_new_transaction(tx_entry->tx, height, b, &(tx_entry->m_global_output_indexes), txs_order_known && count < b.tx_hashes.size() ? &b.tx_hashes[count] : nullptr);
       count++;
     }
     TIME_MEASURE_FINISH(txs_handle_time);
@@ -1978,11 +2068,7 @@ void wallet2::pull_blocks(size_t& blocks_added, std::atomic<bool>& stop)
   currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request req = AUTO_VAL_INIT(req);
   currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response res = AUTO_VAL_INIT(res);
 
-  req.minimum_height = get_wallet_minimum_height();
-  if (req.minimum_height > m_height_of_start_sync)
-    m_height_of_start_sync = req.minimum_height;
-
-  m_chain.get_short_chain_history(req.block_ids);
+  make_pull_blocks_request(req);
   bool r = m_core_proxy->call_COMMAND_RPC_GET_BLOCKS_DIRECT(req, res);
   if (!r)
     throw error::no_connection_to_daemon(LOCATION_STR, "getblocks.bin");
@@ -2001,7 +2087,10 @@ void wallet2::pull_blocks(size_t& blocks_added, std::atomic<bool>& stop)
     crypto::hash new_genesis_id = null_hash;
     r = string_tools::parse_tpod_from_hex_string(gbd_res.blocks.back().id, new_genesis_id);
     THROW_IF_TRUE_WALLET_EX(!r, error::no_connection_to_daemon, "get_blocks_details");
+    std::vector<std::string> deposit_addresses = std::move(m_deposit_addresses);
     reset_all();
+    m_deposit_addresses = std::move(deposit_addresses);
+    init_deposit_addresses();
     m_minimum_height = req.minimum_height;
     m_chain.set_genesis(new_genesis_id);
     WLT_LOG_MAGENTA("New genesis set for wallet: " << new_genesis_id, LOG_LEVEL_0);
@@ -2026,10 +2115,332 @@ void wallet2::pull_blocks(size_t& blocks_added, std::atomic<bool>& stop)
   handle_pulled_blocks(blocks_added, stop, res);
 }
 
+//----------------------------------------------------------------------------------------------------
+void wallet2::make_pull_blocks_request(currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& req)
+{
+  req.minimum_height = get_wallet_minimum_height();
+  if (req.minimum_height > m_height_of_start_sync)
+    m_height_of_start_sync = req.minimum_height;
+  req.prune_txs = true; // see fetch_related_pruned_txs()
+  req.key_images_filters = !is_watch_only(); // spends are detected by key images only in non-watch-only wallets
+
+  req.block_ids.clear();
+  m_chain.get_short_chain_history(req.block_ids);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::apply_pulled_blocks_part(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& req, const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& res,
+  size_t& offset, size_t max_blocks, size_t& blocks_added, std::atomic<bool>& stop)
+{
+  blocks_added = 0;
+  THROW_IF_TRUE_WALLET_EX(res.status != API_RETURN_CODE_OK, error::get_blocks_error, res.status);
+  if (offset >= res.blocks.size())
+    return true;
+
+  // the last applied block goes first again, it's matched, and the rest are handled as the next blocks
+  size_t first = offset == 0 ? 0 : offset - 1;
+  size_t end = std::min(res.blocks.size(), offset + max_blocks);
+  auto it_first = std::next(res.blocks.begin(), first);
+
+  // the wallet may have been changed since the request was made, or since the previous part was applied
+  std::list<crypto::hash> block_ids;
+  m_chain.get_short_chain_history(block_ids);
+  if (offset == 0)
+  {
+    if (block_ids != req.block_ids)
+      return false;
+    THROW_IF_TRUE_WALLET_EX(get_blockchain_current_size() && get_blockchain_current_size() <= res.start_height && res.start_height != m_minimum_height, error::wallet_internal_error,
+      "wrong daemon response: m_start_height=" + std::to_string(res.start_height) +
+      " not less than local blockchain size=" + std::to_string(get_blockchain_current_size()));
+  }
+  else
+  {
+    const currency::block& last_applied = it_first->block_ptr->bl;
+    const crypto::hash last_applied_id = it_first->block_id != null_hash ? it_first->block_id : get_block_hash(last_applied);
+    if (get_blockchain_current_size() != get_block_height(last_applied) + 1 || block_ids.empty() || block_ids.front() != last_applied_id)
+      return false;
+  }
+
+  currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response part = AUTO_VAL_INIT(part);
+  part.status = res.status;
+  part.start_height = res.start_height + first;
+  part.current_height = res.current_height;
+  part.txs_pruned = res.txs_pruned;
+  part.blocks.assign(it_first, std::next(it_first, end - first));
+  if (!res.key_images_filters.empty())
+  {
+    THROW_IF_TRUE_WALLET_EX(res.key_images_filters.size() != res.blocks.size(), error::get_blocks_error,
+      "getblocks.bin: " + std::to_string(res.key_images_filters.size()) + " key images filters for " + std::to_string(res.blocks.size()) + " blocks");
+    part.key_images_filters.assign(res.key_images_filters.begin() + first, res.key_images_filters.begin() + end);
+  }
+
+  handle_pulled_blocks(blocks_added, stop, part);
+  offset = end;
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::finish_refresh(size_t blocks_fetched)
+{
+  if (!blocks_fetched)
+    return;
+
+  on_idle();
+
+  uint64_t tx_expiration_ts_median = get_tx_expiration_median();
+  handle_expiration_list(tx_expiration_ts_median);
+  handle_contract_expirations(tx_expiration_ts_median);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::lookup_outs_for_pulled_blocks(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& res)
+{
+  // the expensive part of txs processing (key derivations, outputs ownership and amounts decoding) doesn't depend on the wallet state,
+  // so it's done for the whole batch in parallel, and process_new_transaction() only applies the results
+  m_pulled_txs_outs_lookup.clear();
+  if (std::thread::hardware_concurrency() < 2)
+    return;
+  std::vector<const transaction*> txs;
+  for (const auto& bl_entry : res.blocks)
+  {
+    if (get_block_height(bl_entry.block_ptr->bl) <= get_wallet_minimum_height())
+      continue; // skipped by process_new_blockchain_entry()
+    txs.push_back(&bl_entry.block_ptr->bl.miner_tx);
+    for (const auto& tx_entry : bl_entry.txs_ptr)
+      txs.push_back(&tx_entry->tx);
+  }
+  if (txs.size() < WALLET_PARALLEL_OUTS_LOOKUP_MIN_TXS)
+    return;
+
+  TIME_MEASURE_START_MS(lookup_time);
+  // all the entries are created beforehand, so each job only writes to its own ones
+  m_pulled_txs_outs_lookup.reserve(txs.size());
+  for (const transaction* ptx : txs)
+    m_pulled_txs_outs_lookup[ptx];
+  const account_keys& keys = m_account.get_keys();
+  const deposit_spend_keys_map* pdeposit_spend_keys = &m_deposit_spend_keys;
+  std::atomic<uint64_t> derivation_us(0), ownership_us(0);
+  utils::threads_pool::jobs_container jobs;
+  for (size_t i = 0; i < txs.size(); i += WALLET_PARALLEL_OUTS_LOOKUP_JOB_TXS)
+  {
+    std::vector<std::pair<const transaction*, tx_outs_lookup_result*>> job_txs;
+    for (size_t j = i; j != std::min<size_t>(txs.size(), i + WALLET_PARALLEL_OUTS_LOOKUP_JOB_TXS); ++j)
+      job_txs.push_back(std::make_pair(txs[j], &m_pulled_txs_outs_lookup[txs[j]]));
+    utils::threads_pool::add_job_to_container(jobs, [&keys, pdeposit_spend_keys, job_txs, &derivation_us, &ownership_us]()
+    {
+      // on failure a tx is looked up again by process_new_transaction(), which reports the error
+      try
+      {
+        std::vector<crypto::public_key> tx_pub_keys(job_txs.size(), null_pkey);
+        std::vector<bool> extra_ok(job_txs.size(), false);
+        for (size_t k = 0; k != job_txs.size(); ++k)
+          extra_ok[k] = parse_and_validate_tx_extra(*job_txs[k].first, tx_pub_keys[k]);
+
+        // one batch for all the txs of the job
+        std::vector<crypto::key_derivation> derivations;
+        std::vector<bool> derivation_ok;
+        TIME_MEASURE_START(job_derivation_time);
+        crypto::generate_key_derivations(tx_pub_keys, keys.view_secret_key, derivations, derivation_ok);
+        TIME_MEASURE_FINISH(job_derivation_time);
+
+        TIME_MEASURE_START(job_ownership_time);
+        for (size_t k = 0; k != job_txs.size(); ++k)
+        {
+          if (!extra_ok[k] || !derivation_ok[k])
+            continue;
+          tx_outs_lookup_result& r = *job_txs[k].second;
+          r.tx_pub_key = tx_pub_keys[k];
+          r.derivation = derivations[k];
+          r.ok = lookup_acc_outs_by_derivation(keys, *job_txs[k].first, r.tx_pub_key, r.derivation, r.outs, r.htlc_info_list, pdeposit_spend_keys);
+        }
+        TIME_MEASURE_FINISH(job_ownership_time);
+        derivation_us += job_derivation_time;
+        ownership_us += job_ownership_time;
+      }
+      catch (...)
+      {
+        for (const auto& p : job_txs)
+          p.second->ok = false;
+      }
+    });
+  }
+  get_threads_pool().add_batch_and_wait(jobs);
+  TIME_MEASURE_FINISH_MS(lookup_time);
+  m_scan_stats.derivation_us += derivation_us;
+  m_scan_stats.ownership_us += ownership_us;
+  m_scan_stats.parallel_lookup_wall_us += lookup_time * 1000;
+  WLT_LOG_L2("[PULL BLOCKS] outputs of " << txs.size() << " txs looked up in " << lookup_time << " ms");
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::is_pulled_tx_related(const currency::transaction& tx, const crypto::hash& tx_id, const std::unordered_set<crypto::key_image>& batch_key_images)
+{
+  // own outputs
+  auto it_lookup = m_pulled_txs_outs_lookup.find(&tx);
+  if (it_lookup == m_pulled_txs_outs_lookup.end() || !it_lookup->second.ok)
+  {
+    tx_outs_lookup_result r = AUTO_VAL_INIT(r);
+    r.ok = parse_and_validate_tx_extra(tx, r.tx_pub_key) && lookup_acc_outs(m_account.get_keys(), tx, r.tx_pub_key, r.outs, r.derivation, r.htlc_info_list, &m_deposit_spend_keys);
+    if (!r.ok)
+      return true; // process_new_transaction() will report the error for the full tx
+    it_lookup = m_pulled_txs_outs_lookup.insert_or_assign(&tx, std::move(r)).first;
+  }
+  if (!it_lookup->second.outs.empty())
+    return true;
+
+  // own inputs
+  bool tracking_wallet = is_auditable() && is_watch_only();
+  for (const auto& in : tx.vin)
+  {
+    VARIANT_SWITCH_BEGIN(in);
+    VARIANT_CASE_CONST(txin_to_key, intk)
+      if (tracking_wallet ? get_directly_spent_transfer_index_by_input_in_tracking_wallet(intk) != UINT64_MAX : m_key_images.count(intk.k_image) != 0 || batch_key_images.count(intk.k_image) != 0)
+        return true;
+    VARIANT_CASE_CONST(txin_zc_input, inzc)
+      if (tracking_wallet ? get_directly_spent_transfer_index_by_input_in_tracking_wallet(inzc) != UINT64_MAX : m_key_images.count(inzc.k_image) != 0 || batch_key_images.count(inzc.k_image) != 0)
+        return true;
+    VARIANT_CASE_OTHER()
+      return true; // multisig and htlc inputs are matched by process_new_transaction() itself
+    VARIANT_SWITCH_END();
+  }
+
+  return m_unconfirmed_txs.count(tx_id) != 0;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::fetch_related_pruned_txs(currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& res)
+{
+  // pulled txs have no signatures and proofs, which is enough to find outputs and inputs of this wallet (tx ids are prefix hashes,
+  // so they are the same); txs related to the wallet are requested in full, the rest are processed as is
+  // if key images filters were requested, pruned txs have no inputs with key images either (and so their ids differ from the block's tx_hashes),
+  // then all txs of a block whose filter matches any own key image are requested in full
+  bool inputs_stripped = !res.key_images_filters.empty();
+  THROW_IF_TRUE_WALLET_EX(inputs_stripped && res.key_images_filters.size() != res.blocks.size(), error::get_blocks_error,
+    "getblocks.bin: " + std::to_string(res.key_images_filters.size()) + " key images filters for " + std::to_string(res.blocks.size()) + " blocks");
+  std::vector<crypto::key_image> key_images; // to query the filters
+  if (inputs_stripped)
+  {
+    key_images.reserve(m_key_images.size());
+    for (const auto& ki : m_key_images)
+      key_images.push_back(ki.first);
+  }
+  std::unordered_set<crypto::key_image> batch_key_images; // of own outputs received in this batch, they may be spent in the batch as well
+
+  std::vector<std::pair<std::shared_ptr<const transaction_chain_entry>*, crypto::hash>> related_entries;
+  COMMAND_RPC_GET_TRANSACTIONS::request req = AUTO_VAL_INIT(req);
+  auto it_filter = res.key_images_filters.begin();
+  for (auto& bl_entry : res.blocks)
+  {
+    const block& b = bl_entry.block_ptr->bl;
+    const std::string* pfilter = inputs_stripped ? &*it_filter++ : nullptr;
+    if (get_block_height(b) <= get_wallet_minimum_height())
+      continue; // skipped by process_new_blockchain_entry()
+    THROW_IF_TRUE_WALLET_EX(inputs_stripped && b.tx_hashes.size() != bl_entry.txs_ptr.size(), error::get_blocks_error,
+      "getblocks.bin: " + std::to_string(bl_entry.txs_ptr.size()) + " txs for " + std::to_string(b.tx_hashes.size()) + " tx hashes");
+
+    std::vector<std::pair<std::shared_ptr<const transaction_chain_entry>*, crypto::hash>> block_entries;
+    size_t i = 0;
+    for (auto& tx_entry : bl_entry.txs_ptr)
+    {
+      crypto::hash tx_id = inputs_stripped ? b.tx_hashes[i++] : get_transaction_hash(tx_entry->tx);
+      if (!is_pulled_tx_related(tx_entry->tx, tx_id, batch_key_images))
+      {
+        block_entries.push_back(std::make_pair(&tx_entry, tx_id));
+        continue;
+      }
+      related_entries.push_back(std::make_pair(&tx_entry, tx_id));
+      req.txs_hashes.push_back(epee::string_tools::pod_to_hex(tx_id));
+
+      auto it_lookup = m_pulled_txs_outs_lookup.find(&tx_entry->tx);
+      if (!is_watch_only() && it_lookup != m_pulled_txs_outs_lookup.end() && it_lookup->second.ok)
+      {
+        for (const auto& out : it_lookup->second.outs)
+        {
+          keypair in_ephemeral = AUTO_VAL_INIT(in_ephemeral);
+          crypto::key_image ki = AUTO_VAL_INIT(ki);
+          if (generate_key_image_helper(get_deposit_account_keys(out.deposit_index), it_lookup->second.tx_pub_key, out.index, in_ephemeral, ki) && batch_key_images.insert(ki).second && inputs_stripped)
+            key_images.push_back(ki);
+        }
+      }
+    }
+    if (!inputs_stripped)
+      continue;
+
+    if (blocks_key_images_filter::match_any(*pfilter, key_images))
+    {
+      // an own key image may be spent in any of them (or it's a false positive)
+      for (const auto& e : block_entries)
+      {
+        related_entries.push_back(e);
+        req.txs_hashes.push_back(epee::string_tools::pod_to_hex(e.second));
+      }
+    }
+    else
+    {
+      for (const auto& e : block_entries)
+        m_pulled_stripped_txs.insert(&(*e.first)->tx);
+    }
+  }
+  if (related_entries.empty())
+    return;
+
+  COMMAND_RPC_GET_TRANSACTIONS::response rsp = AUTO_VAL_INIT(rsp);
+  bool r = m_core_proxy->call_COMMAND_RPC_GET_TRANSACTIONS(req, rsp);
+  THROW_IF_TRUE_WALLET_EX(!r, error::no_connection_to_daemon, "gettransactions");
+  THROW_IF_TRUE_WALLET_EX(rsp.status != API_RETURN_CODE_OK, error::get_blocks_error, rsp.status);
+  THROW_IF_TRUE_WALLET_EX(!rsp.missed_tx.empty(), error::get_blocks_error, "gettransactions: " + std::to_string(rsp.missed_tx.size()) + " txs missed");
+
+  std::unordered_map<crypto::hash, transaction> full_txs;
+  for (const auto& tx_hex : rsp.txs_as_hex)
+  {
+    blobdata tx_blob;
+    r = epee::string_tools::parse_hexstr_to_binbuff(tx_hex, tx_blob);
+    THROW_IF_TRUE_WALLET_EX(!r, error::tx_parse_error, tx_hex);
+    transaction tx;
+    r = parse_and_validate_tx_from_blob(tx_blob, tx);
+    THROW_IF_TRUE_WALLET_EX(!r, error::tx_parse_error, tx_blob);
+    crypto::hash tx_id = get_transaction_hash(tx);
+    full_txs.emplace(tx_id, std::move(tx));
+  }
+
+  for (const auto& related : related_entries)
+  {
+    std::shared_ptr<const transaction_chain_entry>* pentry = related.first;
+    const transaction& pruned_tx = (*pentry)->tx;
+    auto it = full_txs.find(related.second);
+    THROW_IF_TRUE_WALLET_EX(it == full_txs.end(), error::get_blocks_error, "gettransactions: tx " + epee::string_tools::pod_to_hex(related.second) + " not returned");
+    auto full_entry = std::make_shared<transaction_chain_entry>(**pentry);
+    full_entry->tx = std::move(it->second);
+    full_txs.erase(it);
+
+    // the outputs and extra are the same, so are the outputs lookup results
+    auto lookup_node = m_pulled_txs_outs_lookup.extract(&pruned_tx);
+    if (!lookup_node.empty())
+    {
+      lookup_node.key() = &full_entry->tx;
+      m_pulled_txs_outs_lookup.insert(std::move(lookup_node));
+    }
+    *pentry = full_entry;
+  }
+  WLT_LOG_L2("[PULL BLOCKS] " << related_entries.size() << " related txs fetched in full");
+}
 //----------------------------------------------------------------------------------------------------
 void wallet2::handle_pulled_blocks(size_t& blocks_added, std::atomic<bool>& stop, 
   currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& res)
 {
+  auto lookup_results_cleaner = epee::misc_utils::create_scope_leave_handler([&]() { m_pulled_txs_outs_lookup.clear(); m_pulled_stripped_txs.clear(); });
+  m_collecting_transfer_callbacks = m_batch_transfer_callbacks;
+  auto transfer_callbacks_flusher = epee::misc_utils::create_scope_leave_handler([&]()
+  {
+    m_collecting_transfer_callbacks = false;
+    try
+    {
+      flush_transfer_callbacks();
+    }
+    catch (const std::exception& e)
+    {
+      WLT_LOG_ERROR("exception in on_transfers_batch(): " << e.what());
+    }
+  });
+  lookup_outs_for_pulled_blocks(res);
+  if (res.txs_pruned)
+    fetch_related_pruned_txs(res);
+
   size_t current_index = res.start_height;
   m_last_known_daemon_height = res.current_height;
   bool been_matched_block = false;
@@ -2054,8 +2465,8 @@ void wallet2::handle_pulled_blocks(size_t& blocks_added, std::atomic<bool>& stop
     uint64_t height = get_block_height(bl);
     uint64_t processed_blocks_count = get_blockchain_current_size();
 
-    //TODO: get_block_hash is slow
-    crypto::hash bl_id = get_block_hash(bl);
+    // an in-process core hands over the id along with the block, get_block_hash() is slow
+    crypto::hash bl_id = bl_entry.block_id != null_hash ? bl_entry.block_id : get_block_hash(bl);
 
     if (processed_blocks_count != 1 && height > processed_blocks_count)
     {
@@ -2447,7 +2858,7 @@ uint64_t wallet2::get_directly_spent_transfer_index_by_input_in_tracking_wallet(
   std::vector<txout_ref_v> abs_key_offsets = relative_output_offsets_to_absolute(key_offsets); // potential speed-up: don't convert to abs offsets as we interested only in direct spends for auditable wallets. Now it's kind a bit paranoid.
   for (auto v : abs_key_offsets)
   {
-    if (v.type() != typeid(uint64_t))
+    if (!tools::is_variant_type<uint64_t>(v))
       continue;
     uint64_t gindex = boost::get<uint64_t>(v);
     auto it = m_amount_gindex_to_transfer_id.find(std::make_pair(amount, gindex));
@@ -2483,7 +2894,6 @@ uint64_t wallet2::get_directly_spent_transfer_index_by_input_in_tracking_wallet(
 void wallet2::handle_unconfirmed_tx(process_transaction_context& ptc)
 {
   const transaction& tx = ptc.tx;
-  ptc.timestamp = m_core_runtime_config.get_core_time();
   // read extra
   std::vector<wallet_out_info> outs;
   //uint64_t sum_of_received_native_outs = 0;
@@ -2492,9 +2902,19 @@ void wallet2::handle_unconfirmed_tx(process_transaction_context& ptc)
   THROW_IF_TRUE_WALLET_EX(!r, error::tx_extra_parse_error, tx);
   //check if we have money
   crypto::key_derivation derivation = AUTO_VAL_INIT(derivation);
-  r = lookup_acc_outs(m_account.get_keys(), tx, tx_pub_key, outs, derivation);
+  std::list<htlc_info> htlc_info_list;
+  r = lookup_acc_outs(m_account.get_keys(), tx, tx_pub_key, outs, derivation, htlc_info_list, &m_deposit_spend_keys);
   THROW_IF_TRUE_WALLET_EX(!r, error::acc_outs_lookup_error, tx, tx_pub_key, m_account.get_keys());
 
+  handle_unconfirmed_tx(ptc, outs, derivation);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::handle_unconfirmed_tx(process_transaction_context& ptc, const std::vector<wallet_out_info>& outs, const crypto::key_derivation& derivation)
+{
+  const transaction& tx = ptc.tx;
+  ptc.timestamp = m_core_runtime_config.get_core_time();
+  bool r = false;
+
   //collect incomes
   for (auto& o : outs)
   {
@@ -2502,7 +2922,7 @@ void wallet2::handle_unconfirmed_tx(process_transaction_context& ptc)
       continue;
 
     ptc.total_balance_change[o.asset_id] += o.amount;
-    ptc.employed_entries.receive.push_back(wallet_public::employed_tx_entry{ o.index, o.amount, o.asset_id });
+    ptc.employed_entries.receive.push_back(wallet_public::employed_tx_entry{ o.index, o.amount, o.asset_id, o.deposit_index });
   }
 
 
@@ -2514,7 +2934,7 @@ void wallet2::handle_unconfirmed_tx(process_transaction_context& ptc)
   for (size_t i = 0; i != tx.vin.size(); i++)
   {
     auto& in = tx.vin[i];
-    if (in.type() == typeid(currency::txin_to_key))
+    if (tools::is_variant_type<currency::txin_to_key>(in))
     {
       const currency::txin_to_key& intk = boost::get<currency::txin_to_key>(in);
       uint64_t tid = UINT64_MAX;
@@ -2543,7 +2963,7 @@ void wallet2::handle_unconfirmed_tx(process_transaction_context& ptc)
         CHECK_AND_ASSERT_THROW_MES(m_transfers[tid].get_asset_id() == currency::native_coin_asset_id, "Unexpected asset id for native txin_to_key");
       }
     }
-    else if (in.type() == typeid(currency::txin_zc_input))
+    else if (tools::is_variant_type<currency::txin_zc_input>(in))
     {
       // bad design -- remove redundancy like using wallet2::process_input_t()
       const currency::txin_zc_input& zc = boost::get<currency::txin_zc_input>(in);
@@ -2570,7 +2990,7 @@ void wallet2::handle_unconfirmed_tx(process_transaction_context& ptc)
         ptc.total_balance_change[m_transfers[tid].get_asset_id()] -= m_transfers[tid].amount();
       }
     }
-    else if (in.type() == typeid(currency::txin_multisig))
+    else if (tools::is_variant_type<currency::txin_multisig>(in))
     {
       crypto::hash multisig_id = boost::get<currency::txin_multisig>(in).multisig_out_id;
       auto it = m_multisig_transfers.find(multisig_id);
@@ -2632,6 +3052,7 @@ void wallet2::handle_unconfirmed_tx(process_transaction_context& ptc)
       }
       uint32_t flags_before = m_transfers[tr_index].m_flags;
       m_transfers[tr_index].m_flags |= WALLET_TRANSFER_DETAIL_FLAG_SPENT;
+      invalidate_balance_counters();
       WLT_LOG_L1("wallet transfer #" << tr_index << " is marked as spent, flags: " << flags_before << " -> " << m_transfers[tr_index].m_flags << ", reason: UNCONFIRMED tx: " << ptc.tx_hash());
       unconfirmed_wti.selected_indicies.push_back(tr_index);
     }
@@ -2642,29 +3063,67 @@ void wallet2::handle_unconfirmed_tx(process_transaction_context& ptc)
 
 void wallet2::scan_tx_pool(bool& has_related_alias_in_unconfirmed)
 {
-  //get transaction pool content 
+  //get transaction pool content, or only its changes since the previous call (daemons not supporting it always return the whole pool)
   currency::COMMAND_RPC_GET_TX_POOL::request req = AUTO_VAL_INIT(req);
   currency::COMMAND_RPC_GET_TX_POOL::response res = AUTO_VAL_INIT(res);
+  req.pool_instance_id = m_pool_scan_instance_id;
+  req.since_version = m_pool_scan_version;
   bool r = m_core_proxy->call_COMMAND_RPC_GET_TX_POOL(req, res);
   if (res.status == API_RETURN_CODE_BUSY)
     throw error::daemon_busy(LOCATION_STR, "get_tx_pool");
   if (!r)
     throw error::no_connection_to_daemon(LOCATION_STR, "get_tx_pool");
   THROW_IF_TRUE_WALLET_EX(res.status != API_RETURN_CODE_OK, error::get_blocks_error, res.status);
-  
 
-  //- @#@ ----- debug 
-#ifdef _DEBUG
-  std::stringstream ss;
-  ss << "TXS FROM POOL: " << ENDL;
+  // update the cache, new txs are scanned for own outputs here, once
+  std::unordered_set<crypto::hash> received_ids;
   for (const auto &tx_blob : res.txs)
   {
-    currency::transaction tx;
-    bool r = parse_and_validate_tx_from_blob(tx_blob, tx);
+    transaction tx;
+    r = parse_and_validate_tx_from_blob(tx_blob, tx);
     THROW_IF_TRUE_WALLET_EX(!r, error::tx_parse_error, tx_blob);
     crypto::hash tx_hash = currency::get_transaction_hash(tx);
+    received_ids.insert(tx_hash);
+    if (m_pool_scan_cache.count(tx_hash))
+      continue;
+
+    pool_tx_scan_entry e = AUTO_VAL_INIT(e);
+    crypto::public_key tx_pub_key = null_pkey;
+    r = parse_and_validate_tx_extra(tx, tx_pub_key);
+    THROW_IF_TRUE_WALLET_EX(!r, error::tx_extra_parse_error, tx);
+    std::list<htlc_info> htlc_info_list;
+    r = lookup_acc_outs(m_account.get_keys(), tx, tx_pub_key, e.outs, e.derivation, htlc_info_list, &m_deposit_spend_keys);
+    THROW_IF_TRUE_WALLET_EX(!r, error::acc_outs_lookup_error, tx, tx_pub_key, m_account.get_keys());
+    e.has_related_alias = has_related_alias_entry_unconfirmed(tx);
+    e.tx = std::move(tx);
+    m_pool_scan_cache.emplace(tx_hash, std::move(e));
+  }
+  if (res.is_delta)
+  {
+    for (const auto& id : res.removed_tx_ids)
+      m_pool_scan_cache.erase(id);
+  }
+  else
+  {
+    for (auto it = m_pool_scan_cache.begin(); it != m_pool_scan_cache.end();)
+    {
+      if (received_ids.count(it->first))
+        ++it;
+      else
+        it = m_pool_scan_cache.erase(it);
+    }
+  }
+  m_pool_scan_instance_id = res.pool_instance_id;
+  m_pool_scan_version = res.pool_version;
+  WLT_LOG_L2("scan_tx_pool: " << (res.is_delta ? "changes: " : "whole pool: ") << res.txs.size() << " txs received, " << res.removed_tx_ids.size() << " removed, " << m_pool_scan_cache.size() << " txs in the pool");
 
-    ss << tx_hash << ENDL;
+  //- @#@ ----- debug 
+#ifdef _DEBUG
+  std::stringstream ss;
+  ss << "TXS FROM POOL: " << ENDL;
+  for (const auto &c : m_pool_scan_cache)
+  {
+    ss << c.first << ENDL;
   }
   ss << "UNCONFIRMED TXS: " << ENDL;
   for (const auto &tx_it : m_unconfirmed_in_transfers)
@@ -2680,18 +3139,14 @@ void wallet2::scan_tx_pool(bool& has_related_alias_in_unconfirmed)
 
   has_related_alias_in_unconfirmed = false;
   uint64_t tx_expiration_ts_median = res.tx_expiration_ts_median; //get_tx_expiration_median();
-  for (const auto &tx_blob : res.txs)
+  for (const auto &c : m_pool_scan_cache)
   {
-    currency::transaction tx;
     //money_transfer2_details td;
-    process_transaction_context ptc(tx);
+    process_transaction_context ptc(c.second.tx, c.first);
     ptc.tx_expiration_ts_median = tx_expiration_ts_median;
     ptc.pmultisig_entries = &unconfirmed_multisig_transfers_from_tx_pool;
-    bool r = parse_and_validate_tx_from_blob(tx_blob, tx);
-    THROW_IF_TRUE_WALLET_EX(!r, error::tx_parse_error, tx_blob);
-    has_related_alias_in_unconfirmed |= has_related_alias_entry_unconfirmed(tx);
+    has_related_alias_in_unconfirmed |= c.second.has_related_alias;
 
-    //crypto::hash tx_hash = currency::get_transaction_hash(tx);
     auto it = unconfirmed_in_transfers_local.find(ptc.tx_hash());
     if (it != unconfirmed_in_transfers_local.end())
     {
@@ -2699,7 +3154,8 @@ void wallet2::scan_tx_pool(bool& has_related_alias_in_unconfirmed)
       continue;
     }
 
-    handle_unconfirmed_tx(ptc);
+    // outputs were looked up once, when the tx had been received; inputs are checked each time as own key images may be learned meanwhile
+    handle_unconfirmed_tx(ptc, c.second.outs, c.second.derivation);
   }
 
   // Compare unconfirmed multisigs containers
@@ -2710,7 +3166,7 @@ void wallet2::scan_tx_pool(bool& has_related_alias_in_unconfirmed)
   std::unordered_set<crypto::hash> unconfirmed_in_multisig_transfers;
   for(auto& el : m_unconfirmed_in_transfers)
     for(auto &in : el.second.vin)
-      if (in.type() == typeid(txin_multisig))
+      if (tools::is_variant_type<txin_multisig>(in))
         unconfirmed_in_multisig_transfers.insert(boost::get<txin_multisig>(in).multisig_out_id);
 
   for (auto& multisig_id : m_unconfirmed_multisig_transfers)
@@ -2788,6 +3244,7 @@ bool wallet2::scan_not_compliant_unconfirmed_txs()
         {
           uint32_t flags_before = m_transfers[i].m_flags;
           m_transfers[i].m_flags &= ~(WALLET_TRANSFER_DETAIL_FLAG_SPENT);  // TODO: consider removing other blocking flags (e.g. for escrow tx) -- sowle
+          add_transfer_to_transfers_cache(i);
           WLT_LOG_BLUE("mark transfer #" << i << " as unspent, flags: " << flags_before << " -> " << m_transfers[i].m_flags << ", reason: removing unconfirmed tx " << it->second.tx_hash, LOG_LEVEL_0);
         }
       }
@@ -2829,6 +3286,7 @@ bool wallet2::scan_not_compliant_unconfirmed_txs()
       {
         uint32_t flags_before = t.m_flags;
         t.m_flags &= ~(WALLET_TRANSFER_DETAIL_FLAG_SPENT);
+        add_transfer_to_transfers_cache(i);
         WLT_LOG_BLUE("Transfer [" << i << "] marked as unspent, flags: " << flags_before << " -> " << t.m_flags << ", reason: there is no unconfirmed tx relataed to this key image", LOG_LEVEL_0);
       }
     }
@@ -2880,16 +3338,7 @@ void wallet2::refresh(size_t & blocks_fetched, bool& received_money, std::atomic
   if(last_tx_hash_id != (m_transfers.size() ? get_transaction_hash(m_transfers.back().m_ptx_wallet_info->m_tx) : null_hash))
     received_money = true;
 
-  if (blocks_fetched)
-  {
-    on_idle();
-
-    uint64_t tx_expiration_ts_median = get_tx_expiration_median();
-    handle_expiration_list(tx_expiration_ts_median);
-    handle_contract_expirations(tx_expiration_ts_median);
-
-    m_found_free_amounts.clear();
-  }
+  finish_refresh(blocks_fetched);
   
 
   WLT_LOG("Refresh done, blocks received: " << blocks_fetched, blocks_fetched > 0 ? LOG_LEVEL_1 : LOG_LEVEL_2);
@@ -2897,40 +3346,49 @@ void wallet2::refresh(size_t & blocks_fetched, bool& received_money, std::atomic
 //----------------------------------------------------------------------------------------------------
 bool wallet2::handle_expiration_list(uint64_t tx_expiration_ts_median)
 {
-  for (auto it = m_money_expirations.begin(); it != m_money_expirations.end(); )
+  prepare_expiration_triggers();
+  auto& triggers = m_expiration_triggers.money_expirations;
+  // the entries expire in the order of their expiration time
+  while (!triggers.empty() && (triggers.begin()->first < TX_EXPIRATION_MEDIAN_SHIFT || tx_expiration_ts_median > triggers.begin()->first - TX_EXPIRATION_MEDIAN_SHIFT))
   {
-    if (it->expiration_time < TX_EXPIRATION_MEDIAN_SHIFT || tx_expiration_ts_median > it->expiration_time - TX_EXPIRATION_MEDIAN_SHIFT)
+    auto it = triggers.begin()->second;
+    triggers.erase(triggers.begin());
+    for (auto tr_ind : it->selected_transfers)
     {
-      for (auto tr_ind : it->selected_transfers)
+      auto &transfer = m_transfers[tr_ind];
+      if (!transfer.m_spent_height)
       {
-        auto &transfer = m_transfers[tr_ind];
-        if (!transfer.m_spent_height)
-        {
-          // Clear WALLET_TRANSFER_DETAIL_FLAG_BLOCKED and WALLET_TRANSFER_DETAIL_FLAG_ESCROW_PROPOSAL_RESERVATION flags only.
-          // Note: transfer may still be marked as spent
-          uint32_t flags_before = transfer.m_flags;
-          transfer.m_flags &= ~(WALLET_TRANSFER_DETAIL_FLAG_BLOCKED);
-          transfer.m_flags &= ~(WALLET_TRANSFER_DETAIL_FLAG_ESCROW_PROPOSAL_RESERVATION);
-          WLT_LOG_GREEN("Unlocked money from expiration_list: transfer #" << tr_ind << ", flags: " << flags_before << " -> " << transfer.m_flags << ", amount: " << print_money(transfer.amount()) << ", tx: " << 
-            (transfer.m_ptx_wallet_info != nullptr ? get_transaction_hash(transfer.m_ptx_wallet_info->m_tx) : null_hash), LOG_LEVEL_0);
-        }
-
+        // Clear WALLET_TRANSFER_DETAIL_FLAG_BLOCKED and WALLET_TRANSFER_DETAIL_FLAG_ESCROW_PROPOSAL_RESERVATION flags only.
+        // Note: transfer may still be marked as spent
+        uint32_t flags_before = transfer.m_flags;
+        transfer.m_flags &= ~(WALLET_TRANSFER_DETAIL_FLAG_BLOCKED);
+        transfer.m_flags &= ~(WALLET_TRANSFER_DETAIL_FLAG_ESCROW_PROPOSAL_RESERVATION);
+        add_transfer_to_transfers_cache(tr_ind);
+        WLT_LOG_GREEN("Unlocked money from expiration_list: transfer #" << tr_ind << ", flags: " << flags_before << " -> " << transfer.m_flags << ", amount: " << print_money(transfer.amount()) << ", tx: " << 
+          (transfer.m_ptx_wallet_info != nullptr ? get_transaction_hash(transfer.m_ptx_wallet_info->m_tx) : null_hash), LOG_LEVEL_0);
       }
-      WLT_LOG_GREEN("expiration_list entry removed by median: " << tx_expiration_ts_median << ",  expiration time: " << it->expiration_time << ", related tx: " << it->related_tx_id, LOG_LEVEL_0);
-      it = m_money_expirations.erase(it);
-    }
-    else
-    {
-      it++;
+
     }
+    WLT_LOG_GREEN("expiration_list entry removed by median: " << tx_expiration_ts_median << ",  expiration time: " << it->expiration_time << ", related tx: " << it->related_tx_id, LOG_LEVEL_0);
+    m_money_expirations.erase(it);
   }
   return true;
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::handle_contract_expirations(uint64_t tx_expiration_ts_median)
 {
-  for (auto& contract : m_contracts)
+  if (tx_expiration_ts_median == 0)
+    return; // nothing is expired, see is_tx_expired()
+  prepare_expiration_triggers();
+  auto& triggers = m_expiration_triggers.contract_expirations;
+  while (!triggers.empty() && triggers.begin()->first <= tx_expiration_ts_median + TX_EXPIRATION_MEDIAN_SHIFT)
   {
+    crypto::hash contract_id = triggers.begin()->second;
+    triggers.erase(triggers.begin());
+    auto it = m_contracts.find(contract_id);
+    if (it == m_contracts.end())
+      continue;
+    auto& contract = *it;
     switch (contract.second.state)
     {
       case tools::wallet_public::escrow_contract_details_basic::contract_cancel_proposal_sent:
@@ -2945,6 +3403,34 @@ void wallet2::handle_contract_expirations(uint64_t tx_expiration_ts_median)
   }
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::invalidate_expiration_triggers()
+{
+  m_expiration_triggers.ready = false;
+  m_expiration_triggers.money_expirations.clear();
+  m_expiration_triggers.contract_expirations.clear();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::prepare_expiration_triggers()
+{
+  if (m_expiration_triggers.ready)
+    return;
+  invalidate_expiration_triggers();
+  for (auto it = m_money_expirations.begin(); it != m_money_expirations.end(); ++it)
+    m_expiration_triggers.money_expirations.emplace(it->expiration_time, it);
+  m_expiration_triggers.ready = true;
+  for (const auto& c : m_contracts)
+    add_contract_expiration_trigger(c.first, c.second);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::add_contract_expiration_trigger(const crypto::hash& contract_id, const wallet_public::escrow_contract_details_basic& contract)
+{
+  if (!m_expiration_triggers.ready)
+    return; // will be added on rebuilding
+  uint64_t expiration_time = get_tx_expiration_time(contract.cancel_body.tx_cancel_template);
+  if (expiration_time != 0) // 0 means it never expires
+    m_expiration_triggers.contract_expirations.emplace(expiration_time, contract_id);
+}
+//----------------------------------------------------------------------------------------------------
 bool wallet2::refresh(size_t & blocks_fetched, bool& received_money, bool& ok, std::atomic<bool>& stop)
 {
   try
@@ -2983,7 +3469,11 @@ void wallet2::remove_transfer_from_amount_gindex_map(uint64_t tid)
 void wallet2::detach_blockchain(uint64_t including_height)
 {
   WLT_LOG_L0("Detaching blockchain on height " << including_height);
+  flush_transfer_callbacks(); // the transfers found before are reported as they were
+  invalidate_expiration_triggers(); // contracts' states may be rolled back
   size_t transfers_detached = 0;
+  m_zc_decoys_pool.clear(); // may refer to outputs of the detached blocks
+  m_pos_stake_decoys = std::make_pair(uint64_t(0), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount());
 
   // rollback incoming transfers from detaching subchain
   {
@@ -2995,8 +3485,8 @@ void wallet2::detach_blockchain(uint64_t including_height)
       for (size_t i = i_start; i != m_transfers.size(); i++)
       {
         //check for htlc
-        if (m_transfers[i].m_ptx_wallet_info->m_tx.vout[m_transfers[i].m_internal_output_index].type() == typeid(tx_out_bare) &&
-            boost::get<tx_out_bare>(m_transfers[i].m_ptx_wallet_info->m_tx.vout[m_transfers[i].m_internal_output_index]).target.type() == typeid(txout_htlc))
+        if (tools::is_variant_type<tx_out_bare>(m_transfers[i].m_ptx_wallet_info->m_tx.vout[m_transfers[i].m_internal_output_index]) &&
+            tools::is_variant_type<txout_htlc>(boost::get<tx_out_bare>(m_transfers[i].m_ptx_wallet_info->m_tx.vout[m_transfers[i].m_internal_output_index]).target))
         {
           //need to find an entry in m_htlc and remove it
           const txout_htlc& hltc = boost::get<txout_htlc>(boost::get<tx_out_bare>(m_transfers[i].m_ptx_wallet_info->m_tx.vout[m_transfers[i].m_internal_output_index]).target);
@@ -3027,6 +3517,8 @@ void wallet2::detach_blockchain(uint64_t including_height)
         ++transfers_detached;
       }
       m_transfers.erase(it, m_transfers.end());
+      invalidate_transfers_cache();
+      m_store_journal.transfers_intact = std::min<uint64_t>(m_store_journal.transfers_intact, m_transfers.size());
     }
   }
  
@@ -3049,6 +3541,7 @@ void wallet2::detach_blockchain(uint64_t including_height)
       //check if it's hltc contract
     }
   }
+  invalidate_balance_counters();
 
   //rollback tranfers history
   auto tr_hist_it = m_transfer_history.rend();
@@ -3062,6 +3555,13 @@ void wallet2::detach_blockchain(uint64_t including_height)
   if (tr_hist_it != m_transfer_history.rend())
   {
     auto it_from = --tr_hist_it.base();
+    uint64_t history_size = it_from - m_transfer_history.begin();
+    for (uint64_t i = history_size; i < m_history_txs.size(); ++i)
+    {
+      bool r = m_history_txs.get(i, m_transfer_history[i].tx);
+      WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(r, "failed to read tx of history entry #" << i);
+    }
+    m_history_txs.truncate(history_size);
     // before removing wti from m_transfer_history put it into m_unconfirmed_txs as txs from detached blocks are most likely be moved into the pool
     for (auto it = it_from; it != m_transfer_history.end(); ++it)
     {
@@ -3077,6 +3577,7 @@ void wallet2::detach_blockchain(uint64_t including_height)
       }
     }
     m_transfer_history.erase(it_from, m_transfer_history.end());
+    m_store_journal.history_intact = std::min<uint64_t>(m_store_journal.history_intact, m_transfer_history.size());
   }
  
   //rollback payments
@@ -3145,6 +3646,10 @@ bool wallet2::reset_all()
   //static_cast<wallet2_base_state&>(*this) = wallet2_base_state{};
   static_cast<wallet2_base_state&>(*this).~wallet2_base_state();
   new (static_cast<wallet2_base_state*>(this)) wallet2_base_state();
+  m_history_txs.close();
+  invalidate_transfers_cache();
+  m_zc_decoys_pool.clear();
+  m_pos_stake_decoys = std::make_pair(uint64_t(0), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount());
   return true;
 }
 //----------------------------------------------------------------------------------------------------
@@ -3186,6 +3691,7 @@ bool wallet2::backup_keys(const std::string& path)
 bool wallet2::reset_password(const std::string& pass)
 {
   m_password = pass;
+  m_store_journal.ready = false; // the keys are to be re-encrypted by a full store
   return true;
 }
 //----------------------------------------------------------------------------------------------------
@@ -3252,6 +3758,8 @@ bool wallet2::prepare_file_names(const std::wstring& file_path)
   m_wallet_file = file_path;
 
   m_pending_ki_file = string_tools::cut_off_extension(m_wallet_file) + L".outkey2ki";
+  m_store_journal_file = string_tools::cut_off_extension(m_wallet_file) + L".journal";
+  m_history_txs_file = string_tools::cut_off_extension(m_wallet_file) + L".history_txs";
 
   // make sure file path is accessible and exists
   boost::filesystem::path pp = boost::filesystem::path(file_path).parent_path();
@@ -3423,8 +3931,24 @@ void wallet2::load(const std::wstring& wallet_, const std::string& password)
     WLT_LOG_L0("Unknown wallet body version(" << wbh.m_ver << "), resync initiated.");
     need_to_resync = true;
   }
-    
-    
+  data_file.close();
+
+  if (!need_to_resync)
+    load_history_txs(need_to_resync);
+  if (!need_to_resync)
+    load_store_journal(kf_data.iv, need_to_resync);
+  if (!need_to_resync)
+  {
+    m_history_txs.truncate(m_transfer_history.size());
+    if (m_offload_history_txs)
+      offload_history_txs();
+    else if (m_history_txs.is_open())
+    {
+      restore_history_txs();
+      m_history_txs.close();
+    }
+  }
+  init_deposit_addresses();
 
   if (m_watch_only && !is_auditable())
     load_keys2ki(true, need_to_resync);
@@ -3466,6 +3990,12 @@ void wallet2::store(const std::wstring& path_to_save, const std::string& passwor
 {
   LOG_PRINT_L0("(before storing: pending_key_images: " << m_pending_key_images.size() << ", pki file elements: " << m_pending_key_images_file_container.size() << ", tx_keys: " << m_tx_keys.size() << ")");
 
+  if (m_use_store_journal && path_to_save == m_wallet_file && password == m_password && store_to_journal())
+  {
+    offload_history_txs();
+    return;
+  }
+
   std::string ascii_path_to_save = epee::string_encoding::convert_to_ansii(path_to_save);
 
   //prepare data
@@ -3500,7 +4030,21 @@ void wallet2::store(const std::wstring& path_to_save, const std::string& passwor
   out.push(decrypt_filter);
   out.push(data_file);
 
-  r = tools::portble_serialize_obj_to_stream(*this, out);
+  // the wallet file refers to the offloaded txs in m_history_txs_file, any other file holds the whole history,
+  // so offloaded txs are put back for the time of serialization
+  bool store_history_txs_separately = path_to_save == m_wallet_file && m_history_txs.is_open() && m_history_txs.flush();
+  if (store_history_txs_separately)
+  {
+    m_store_history_txs_separately = true;
+    auto reset_separately = epee::misc_utils::create_scope_leave_handler([&]() { m_store_history_txs_separately = false; });
+    r = tools::portble_serialize_obj_to_stream(*this, out);
+  }
+  else
+  {
+    restore_history_txs();
+    auto release = epee::misc_utils::create_scope_leave_handler([&]() { release_history_txs(); });
+    r = tools::portble_serialize_obj_to_stream(*this, out);
+  }
   if (!r)
   {
     data_file.close();
@@ -3545,6 +4089,17 @@ void wallet2::store(const std::wstring& path_to_save, const std::string& passwor
 
     WLT_LOG_L0("Wallet was successfully stored to " << ascii_path_to_save << ", file size=" << m_current_wallet_file_size
       << " blockchain_size: " << m_chain.get_blockchain_current_size());
+    if (path_to_save == m_wallet_file)
+    {
+      reset_store_journal(keys_file_data.iv);
+      m_history_txs_file_referenced = store_history_txs_separately;
+      if (!m_history_txs_file_referenced && !m_history_txs.is_open())
+      {
+        boost::system::error_code ec;
+        boost::filesystem::remove(m_history_txs_file, ec);
+      }
+    }
+    offload_history_txs();
   }
   else
   {
@@ -3553,26 +4108,359 @@ void wallet2::store(const std::wstring& path_to_save, const std::string& passwor
   }
 }
 //----------------------------------------------------------------------------------------------------
-uint64_t wallet2::get_wallet_file_size()const
-{
-  return m_current_wallet_file_size;
-}
-//----------------------------------------------------------------------------------------------------
-void wallet2::set_use_deffered_global_outputs(bool use)
-{
-  LOG_PRINT_L0("[DEFFERED_MODE]: " << use);
-  m_use_deffered_global_outputs = use;
-}
-//----------------------------------------------------------------------------------------------------
-void wallet2::set_use_assets_whitelisting(bool use)
+namespace
 {
-  LOG_PRINT_L0("[ASSET_WHITELISTING_MODE]: " << use);
-  m_use_assets_whitelisting = use;
+  // covers everything in a transfer that may change after it's added
+  uint64_t get_transfer_fingerprint(const transfer_details& td)
+  {
+    auto mix = [](uint64_t h, uint64_t v) { return h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)); };
+    uint64_t h = reinterpret_cast<uintptr_t>(td.m_ptx_wallet_info.get());
+    h = mix(h, td.m_internal_output_index);
+    h = mix(h, td.m_flags);
+    h = mix(h, td.m_spent_height);
+    h = mix(h, td.m_global_output_index);
+    h = mix(h, *reinterpret_cast<const uint64_t*>(&td.m_key_image));
+    for (const auto& opt : td.varian_options)
+    {
+      h = mix(h, opt.which());
+      if (tools::is_variant_type<transfer_details_extra_option_htlc_info>(opt))
+      {
+        const transfer_details_extra_option_htlc_info& htlc_info = boost::get<transfer_details_extra_option_htlc_info>(opt);
+        h = mix(h, std::hash<std::string>()(htlc_info.origin));
+        h = mix(h, *reinterpret_cast<const uint64_t*>(&htlc_info.redeem_tx_id));
+      }
+    }
+    return h;
+  }
+
+  void update_store_journal_state(wallet2_base_state& state)
+  {
+    auto& sj = state.m_store_journal;
+    sj.transfers_fingerprints.resize(state.m_transfers.size());
+    for (size_t i = 0; i != state.m_transfers.size(); ++i)
+      sj.transfers_fingerprints[i] = get_transfer_fingerprint(state.m_transfers[i]);
+    sj.transfers_intact = state.m_transfers.size();
+    sj.history_intact = state.m_transfer_history.size();
+  }
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::store_watch_only(const std::wstring& path_to_save, const std::string& password) const
+bool wallet2::store_to_journal()
 {
-  WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(path_to_save != m_wallet_file, "trying to save watch-only wallet to the same wallet file!");
+  // transfers and history entries (which hold whole txs) are the most of a wallet file, so only the changed and added ones
+  // are appended to the journal along with the rest of the state; returns false if the wallet file should be stored in full
+  if (!m_store_journal.ready)
+    return false;
+
+  boost::system::error_code ec;
+  uint64_t journal_size = boost::filesystem::exists(m_store_journal_file, ec) ? boost::filesystem::file_size(m_store_journal_file, ec) : 0;
+  if (ec)
+    return false;
+  if (journal_size > m_current_wallet_file_size)
+  {
+    WLT_LOG_L1("Store journal size " << journal_size << " exceeds the wallet file size " << m_current_wallet_file_size << ", the wallet will be stored in full");
+    return false;
+  }
+
+  TIME_MEASURE_START_MS(journal_store_time);
+  store_journal_record rec(*this);
+  rec.transfers_count = m_transfers.size();
+  uint64_t transfers_intact = std::min<uint64_t>(m_store_journal.transfers_intact, m_store_journal.transfers_fingerprints.size());
+  for (uint64_t i = 0; i != m_transfers.size(); ++i)
+  {
+    if (i >= transfers_intact || get_transfer_fingerprint(m_transfers[i]) != m_store_journal.transfers_fingerprints[i])
+      rec.transfers.push_back(std::make_pair(i, m_transfers[i]));
+  }
+  rec.history_count = std::min<uint64_t>(m_store_journal.history_intact, m_transfer_history.size());
+  rec.history.assign(m_transfer_history.begin() + rec.history_count, m_transfer_history.end());
+
+  std::stringstream ss;
+  bool r = false;
+  {
+    transfer_container transfers;
+    std::vector<wallet_public::wallet_transfer_info> transfer_history;
+    m_transfers.swap(transfers);
+    m_transfer_history.swap(transfer_history);
+    auto put_back = epee::misc_utils::create_scope_leave_handler([&]() { m_transfers.swap(transfers); m_transfer_history.swap(transfer_history); });
+    r = tools::portble_serialize_obj_to_stream(rec, ss);
+  }
+  WLT_CHECK_AND_ASSERT_MES(r, false, "failed to serialize store journal record");
+
+  std::string body = ss.str();
+  crypto::chacha8_key key;
+  crypto::generate_chacha8_key(m_password, key);
+  crypto::chacha8_iv iv = crypto::rand<crypto::chacha8_iv>();
+  std::string cipher(body.size(), '\0');
+  crypto::chacha8(body.data(), body.size(), key, iv, &cipher[0]);
+  uint64_t body_size = body.size();
+
+  boost::filesystem::ofstream journal;
+  journal.open(m_store_journal_file, std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+  WLT_CHECK_AND_ASSERT_MES(!journal.fail(), false, "failed to open store journal " << epee::string_encoding::convert_to_ansii(m_store_journal_file));
+  if (journal_size == 0)
+  {
+    wallet_store_journal_header jh = AUTO_VAL_INIT(jh);
+    jh.m_signature = WALLET_STORE_JOURNAL_SIGNATURE;
+    jh.m_snapshot_iv = m_store_journal.snapshot_iv;
+    journal.write(reinterpret_cast<const char*>(&jh), sizeof(jh));
+  }
+  journal.write(reinterpret_cast<const char*>(&body_size), sizeof(body_size));
+  journal.write(reinterpret_cast<const char*>(&iv), sizeof(iv));
+  journal.write(cipher.data(), cipher.size());
+  journal.flush();
+  if (journal.fail())
+  {
+    // an incomplete record is ignored on load, and the full store starts the journal over
+    WLT_LOG_ERROR("IO error while appending to store journal " << epee::string_encoding::convert_to_ansii(m_store_journal_file));
+    m_store_journal.ready = false;
+    return false;
+  }
+  journal.close();
+
+  update_store_journal_state(*this);
+  TIME_MEASURE_FINISH_MS(journal_store_time);
+  WLT_LOG_L0("Wallet changes were stored to journal " << epee::string_encoding::convert_to_ansii(m_store_journal_file) << ": " << rec.transfers.size() << " transfers, "
+    << rec.history.size() << " history entries, " << body_size << " bytes in " << journal_store_time << " ms, journal size=" << journal_size + body_size
+    << " blockchain_size: " << m_chain.get_blockchain_current_size());
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_store_journal(const crypto::chacha8_iv& snapshot_iv, bool& need_to_resync)
+{
+  boost::system::error_code ec;
+  if (!boost::filesystem::exists(m_store_journal_file, ec))
+  {
+    reset_store_journal(snapshot_iv);
+    return;
+  }
+  std::string ascii_journal_file = epee::string_encoding::convert_to_ansii(m_store_journal_file);
+
+  boost::filesystem::ifstream journal;
+  journal.open(m_store_journal_file, std::ios_base::binary | std::ios_base::in);
+  wallet_store_journal_header jh = AUTO_VAL_INIT(jh);
+  journal.read(reinterpret_cast<char*>(&jh), sizeof(jh));
+  if (journal.fail() || jh.m_signature != WALLET_STORE_JOURNAL_SIGNATURE || memcmp(&jh.m_snapshot_iv, &snapshot_iv, sizeof(snapshot_iv)) != 0)
+  {
+    // left from another wallet file with the same name or from before the wallet file was stored in full by an older build
+    WLT_LOG_YELLOW("Store journal " << ascii_journal_file << " doesn't belong to the wallet file and is ignored", LOG_LEVEL_0);
+    return; // not ready, so the next store is a full one and it removes the journal
+  }
+
+  crypto::chacha8_key key;
+  crypto::generate_chacha8_key(m_password, key);
+  size_t records_count = 0;
+  bool incomplete = false;
+  while (true)
+  {
+    uint64_t body_size = 0;
+    journal.read(reinterpret_cast<char*>(&body_size), sizeof(body_size));
+    if (journal.gcount() == 0 && journal.eof())
+      break;
+    crypto::chacha8_iv iv = AUTO_VAL_INIT(iv);
+    journal.read(reinterpret_cast<char*>(&iv), sizeof(iv));
+    std::string cipher;
+    if (!journal.fail() && body_size <= WALLET_STORE_JOURNAL_MAX_RECORD_SIZE)
+    {
+      cipher.resize(body_size);
+      journal.read(&cipher[0], cipher.size());
+    }
+    if (journal.fail() || body_size > WALLET_STORE_JOURNAL_MAX_RECORD_SIZE)
+    {
+      incomplete = true; // the last append was interrupted, the state of the previous record is consistent
+      break;
+    }
+    std::string body(cipher.size(), '\0');
+    crypto::chacha8(cipher.data(), cipher.size(), key, iv, &body[0]);
+
+    // the rest of the state goes right into the wallet, not into the transfers and history put aside
+    uint64_t transfers_size = m_transfers.size();
+    store_journal_record rec(*this);
+    std::stringstream ss(body);
+    transfer_container transfers;
+    std::vector<wallet_public::wallet_transfer_info> transfer_history;
+    m_transfers.swap(transfers);
+    m_transfer_history.swap(transfer_history);
+    bool r = tools::portable_unserialize_obj_from_stream(rec, ss);
+    m_transfers.swap(transfers);
+    m_transfer_history.swap(transfer_history);
+
+    bool valid = r && rec.history_count <= m_transfer_history.size();
+    uint64_t added_count = 0;
+    for (size_t i = 0; valid && i != rec.transfers.size(); ++i)
+    {
+      valid = rec.transfers[i].first < rec.transfers_count && (i == 0 || rec.transfers[i - 1].first < rec.transfers[i].first) && rec.transfers[i].second.m_ptx_wallet_info;
+      added_count += rec.transfers[i].first >= transfers_size ? 1 : 0;
+    }
+    valid = valid && (rec.transfers_count <= transfers_size || added_count == rec.transfers_count - transfers_size);
+    if (!valid)
+    {
+      WLT_LOG_ERROR("Store journal " << ascii_journal_file << " has a corrupted record #" << records_count);
+      need_to_resync = true;
+      return;
+    }
+
+    m_transfers.resize(rec.transfers_count);
+    invalidate_balance_counters();
+    for (auto& t : rec.transfers)
+      m_transfers[t.first] = std::move(t.second);
+    m_transfer_history.resize(rec.history_count);
+    m_history_txs.truncate(rec.history_count);
+    m_transfer_history.insert(m_transfer_history.end(), std::make_move_iterator(rec.history.begin()), std::make_move_iterator(rec.history.end()));
+    ++records_count;
+  }
+  journal.close();
+
+  if (incomplete)
+  {
+    WLT_LOG_YELLOW("Store journal " << ascii_journal_file << " ends with an incomplete record, it's ignored", LOG_LEVEL_0);
+    // the journal can't be appended, so the next store is a full one
+  }
+  else
+  {
+    m_store_journal.snapshot_iv = snapshot_iv;
+    m_store_journal.ready = true;
+    update_store_journal_state(*this);
+  }
+  WLT_LOG_L0("Applied " << records_count << " records of store journal " << ascii_journal_file);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::reset_store_journal(const crypto::chacha8_iv& snapshot_iv)
+{
+  // the wallet file holds everything now
+  m_store_journal = store_journal_state();
+  boost::system::error_code ec;
+  boost::filesystem::remove(m_store_journal_file, ec);
+  if (ec)
+  {
+    WLT_LOG_ERROR("Failed to remove store journal " << epee::string_encoding::convert_to_ansii(m_store_journal_file) << ": " << ec.message());
+    return;
+  }
+  m_store_journal.snapshot_iv = snapshot_iv;
+  m_store_journal.ready = true;
+  update_store_journal_state(*this);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::offload_history_txs()
+{
+  // txs take the most of history entries, so all but the latest ones are moved out of memory; entries stored
+  // to the journal get their txs back on the next full store, thus only the ones up to history_intact are moved
+  if (!m_offload_history_txs || m_transfer_history.size() <= WALLET_HISTORY_RESIDENT_TXS_COUNT)
+    return;
+  uint64_t count = m_transfer_history.size() - WALLET_HISTORY_RESIDENT_TXS_COUNT;
+  if (m_store_journal.ready)
+    count = std::min<uint64_t>(count, m_store_journal.history_intact);
+  if (count <= m_history_txs.size())
+    return;
+
+  if (!m_history_txs.is_open() && !m_history_txs.open(m_history_txs_file, m_history_txs_file_referenced))
+  {
+    WLT_LOG_ERROR("Failed to open history txs storage, history txs offloading is turned off");
+    m_offload_history_txs = false;
+    return;
+  }
+
+  TIME_MEASURE_START_MS(offload_time);
+  uint64_t offloaded_before = m_history_txs.size();
+  for (uint64_t i = m_history_txs.size(); i < count; ++i)
+  {
+    wallet_public::wallet_transfer_info& wti = m_transfer_history[i];
+    if (!m_history_txs.push_back(wti.tx))
+    {
+      WLT_LOG_ERROR("Failed to offload tx of history entry #" << i);
+      break;
+    }
+    wti.is_mining = currency::is_coinbase(wti.tx); // to filter mining entries without reading their txs back
+    wti.tx = currency::transaction();
+  }
+  TIME_MEASURE_FINISH_MS(offload_time);
+  WLT_LOG_L1("Offloaded txs of " << m_history_txs.size() - offloaded_before << " history entries in " << offload_time << " ms, " << m_history_txs.size() << " of " << m_transfer_history.size() << " offloaded in total");
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_history_txs(bool& need_to_resync)
+{
+  // entries offloaded when the wallet file was stored have no txs in it, they are read from m_history_txs_file by its index
+  history_txs_storage::state st = AUTO_VAL_INIT(st);
+  std::swap(st, m_loaded_history_txs_state);
+  m_history_txs_file_referenced = !st.index.empty();
+  if (st.index.empty())
+    return;
+  if (st.index.size() > m_transfer_history.size() || !m_history_txs.open(m_history_txs_file, st))
+  {
+    WLT_LOG_ERROR("Unable to open history txs storage " << epee::string_encoding::convert_to_ansii(m_history_txs_file) << " for " << st.index.size() << " entries");
+    need_to_resync = true;
+    return;
+  }
+  WLT_LOG_L1("Opened history txs storage with " << m_history_txs.size() << " of " << m_transfer_history.size() << " history entries");
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::restore_history_txs()
+{
+  for (uint64_t i = 0; i != m_history_txs.size(); ++i)
+  {
+    bool r = m_history_txs.get(i, m_transfer_history[i].tx);
+    WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(r, "failed to read tx of history entry #" << i);
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::release_history_txs()
+{
+  // the storage still has them
+  for (uint64_t i = 0; i != m_history_txs.size(); ++i)
+    m_transfer_history[i].tx = currency::transaction();
+}
+//----------------------------------------------------------------------------------------------------
+const wallet_public::wallet_transfer_info& wallet2::get_transfer_history_entry(size_t i, wallet_public::wallet_transfer_info& buff) const
+{
+  const wallet_public::wallet_transfer_info& wti = m_transfer_history[i];
+  if (i >= m_history_txs.size())
+    return wti;
+  buff = wti;
+  bool r = m_history_txs.get(i, buff.tx);
+  WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(r, "failed to read tx of history entry #" << i);
+  return buff;
+}
+//----------------------------------------------------------------------------------------------------
+wallet_public::wallet_transfer_info& wallet2::get_transfer_history_entry(size_t i, wallet_public::wallet_transfer_info& buff)
+{
+  return const_cast<wallet_public::wallet_transfer_info&>(static_cast<const wallet2&>(*this).get_transfer_history_entry(i, buff));
+}
+//----------------------------------------------------------------------------------------------------
+uint64_t wallet2::get_wallet_file_size()const
+{
+  return m_current_wallet_file_size;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::set_offload_history_txs(bool offload)
+{
+  WLT_LOG_L0("[OFFLOAD_HISTORY_TXS]: " << offload);
+  m_offload_history_txs = offload;
+  if (!offload)
+  {
+    restore_history_txs();
+    m_history_txs.close();
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::set_use_deffered_global_outputs(bool use)
+{
+  LOG_PRINT_L0("[DEFFERED_MODE]: " << use);
+  m_use_deffered_global_outputs = use;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::set_use_assets_whitelisting(bool use)
+{
+  LOG_PRINT_L0("[ASSET_WHITELISTING_MODE]: " << use);
+  m_use_assets_whitelisting = use;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::set_use_store_journal(bool use)
+{
+  LOG_PRINT_L0("[STORE_JOURNAL_MODE]: " << use);
+  m_use_store_journal = use;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::store_watch_only(const std::wstring& path_to_save, const std::string& password) const
+{
+  WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(path_to_save != m_wallet_file, "trying to save watch-only wallet to the same wallet file!");
   WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(!m_watch_only, "saving watch-only wallet into a watch-only wallet is not allowed");
 
   // prepare data for watch-only wallet
@@ -3581,6 +4469,11 @@ void wallet2::store_watch_only(const std::wstring& path_to_save, const std::stri
   std::stringstream stream_buffer;
   tools::portble_serialize_obj_to_stream(*this, stream_buffer);
   tools::portable_unserialize_obj_from_stream(wo, stream_buffer);
+  for (uint64_t i = 0; i < m_history_txs.size() && i < wo.m_transfer_history.size(); ++i)
+  {
+    bool r = m_history_txs.get(i, wo.m_transfer_history[i].tx);
+    WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(r, "failed to read tx of history entry #" << i);
+  }
 
   wo.m_watch_only = true;
   wo.m_account = m_account;
@@ -3604,10 +4497,10 @@ void wallet2::store_watch_only(const std::wstring& path_to_save, const std::stri
     if (!td.is_spent())
       continue; // only spent transfers really need to be stored, because watch-only wallet will not be able to figure out they were spent otherwise
     WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(td.m_internal_output_index < td.m_ptx_wallet_info->m_tx.vout.size(), "invalid transfer #" << ti);
-    if(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index].type() != typeid(tx_out_bare))
+    if(!tools::is_variant_type<tx_out_bare>(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index]))
       continue;
     const currency::txout_target_v& out_t = boost::get<tx_out_bare>(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index]).target;
-    if (out_t.type() != typeid(currency::txout_to_key))
+    if (!tools::is_variant_type<currency::txout_to_key>(out_t))
       continue;
     const crypto::public_key& out_key = boost::get<txout_to_key>(out_t).key;
     wo.m_pending_key_images.insert(std::make_pair(out_key, td.m_key_image));
@@ -3674,35 +4567,89 @@ uint64_t wallet2::balance(const crypto::public_key& asset_id) const
   return balance(asset_id, dummy);
 }
 //----------------------------------------------------------------------------------------------------
-bool wallet2::balance(std::unordered_map<crypto::public_key, wallet_public::asset_balance_entry_base>& balances, uint64_t& mined) const
+void wallet2::invalidate_balance_counters()
 {
-  mined = 0;
-  m_has_bare_unspent_outputs = false;
-  
-  for(auto& td : m_transfers)
+  m_balance_counters.ready = false;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::prepare_balance_counters() const
+{
+  balance_counters& bc = m_balance_counters;
+  uint64_t blockchain_size = get_blockchain_current_size();
+  if (bc.ready && bc.transfers_count == m_transfers.size() && bc.blockchain_size <= blockchain_size)
   {
-    if (td.is_spendable() || (td.is_reserved_for_escrow() && !td.is_spent()))
+    // only the blockchain has grown since the last call
+    for (auto it = bc.locked_by_height.begin(); it != bc.locked_by_height.end() && it->first <= blockchain_size; it = bc.locked_by_height.erase(it))
     {
-      wallet_public::asset_balance_entry_base& e = balances[td.get_asset_id()];
-      e.total += td.amount();
-      if (is_transfer_unlocked(td))
-        e.unlocked += td.amount();
-      if (td.m_flags & WALLET_TRANSFER_DETAIL_FLAG_MINED_TRANSFER)
+      const transfer_details& td = m_transfers[it->second];
+      bc.balances[td.get_asset_id()].unlocked += td.amount();
+    }
+    bc.blockchain_size = blockchain_size;
+    return;
+  }
+
+  bc = balance_counters();
+  for (uint64_t i = 0; i != m_transfers.size(); ++i)
+  {
+    const transfer_details& td = m_transfers[i];
+    if (!td.is_spendable() && !(td.is_reserved_for_escrow() && !td.is_spent()))
+      continue;
+
+    wallet_public::asset_balance_entry_base& e = bc.balances[td.get_asset_id()];
+    e.total += td.amount();
+    if (td.m_flags & WALLET_TRANSFER_DETAIL_FLAG_MINED_TRANSFER)
+    {
+      if (td.m_ptx_wallet_info->m_block_height == 0)
       {
-        if (td.m_ptx_wallet_info->m_block_height == 0)
-        {
-          //for genesis block we add actual amounts
-          mined += td.amount();
-        }
-        else {
-          mined += CURRENCY_BLOCK_REWARD; //this code would work only for cases where block reward is full. For reduced block rewards might need more flexible code (TODO)
-        }        
+        //for genesis block we add actual amounts
+        bc.mined += td.amount();
+      }
+      else {
+        bc.mined += CURRENCY_BLOCK_REWARD; //this code would work only for cases where block reward is full. For reduced block rewards might need more flexible code (TODO)
       }
+    }
+    if (!td.is_zc())
+      bc.has_bare_unspent_outputs = true;
 
-      if (!td.is_zc())
-        m_has_bare_unspent_outputs = true;
+    if (td.m_flags & WALLET_TRANSFER_DETAIL_FLAG_BLOCKED)
+      continue; // it can't get unlocked without a flags change, which invalidates the counters
+    // the same conditions as is_transfer_unlocked() has
+    uint64_t unlock_time = get_tx_unlock_time(td.m_ptx_wallet_info->m_tx, td.m_internal_output_index);
+    if (unlock_time >= CURRENCY_MAX_BLOCK_NUMBER)
+    {
+      bc.locked_by_time.push_back(i);
+      continue;
     }
+    uint64_t unlock_size = td.m_ptx_wallet_info->m_block_height + WALLET_DEFAULT_TX_SPENDABLE_AGE;
+    if (unlock_time + 1 > CURRENCY_LOCKED_TX_ALLOWED_DELTA_BLOCKS)
+      unlock_size = std::max(unlock_size, unlock_time + 1 - CURRENCY_LOCKED_TX_ALLOWED_DELTA_BLOCKS);
+    if (unlock_size <= blockchain_size)
+      e.unlocked += td.amount();
+    else
+      bc.locked_by_height.emplace(unlock_size, i);
   }
+  bc.blockchain_size = blockchain_size;
+  bc.transfers_count = m_transfers.size();
+  bc.ready = true;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::balance(std::unordered_map<crypto::public_key, wallet_public::asset_balance_entry_base>& balances, uint64_t& mined) const
+{
+  prepare_balance_counters();
+  for (const auto& bc_entry : m_balance_counters.balances)
+  {
+    wallet_public::asset_balance_entry_base& e = balances[bc_entry.first];
+    e.total += bc_entry.second.total;
+    e.unlocked += bc_entry.second.unlocked;
+  }
+  for (uint64_t i : m_balance_counters.locked_by_time)
+  {
+    const transfer_details& td = m_transfers[i];
+    if (is_transfer_unlocked(td))
+      balances[td.get_asset_id()].unlocked += td.amount();
+  }
+  mined = m_balance_counters.mined;
+  m_has_bare_unspent_outputs = m_balance_counters.has_bare_unspent_outputs;
 
   for(auto& utx : m_unconfirmed_txs)
   {
@@ -4148,6 +5095,42 @@ void wallet2::get_payments(const std::string& payment_id, std::list<payment_deta
   });
 }
 //----------------------------------------------------------------------------------------------------
+uint32_t wallet2::create_deposit_address(const std::string& label)
+{
+  // an auditable wallet is tracked by its address, outputs to deposit addresses would be missed by the tracking wallets
+  WLT_THROW_IF_FALSE_WALLET_CMN_ERR_EX(!is_auditable(), "deposit addresses are not supported by auditable wallets");
+  WLT_THROW_IF_FALSE_WALLET_CMN_ERR_EX(m_deposit_addresses.size() < UINT32_MAX, "too many deposit addresses");
+
+  uint32_t deposit_index = static_cast<uint32_t>(m_deposit_addresses.size() + 1);
+  currency::account_public_address addr = currency::get_deposit_address(m_account.get_keys(), deposit_index);
+  m_deposit_addresses.push_back(label);
+  m_deposit_spend_keys[addr.spend_public_key] = deposit_index;
+  WLT_LOG_L0("Deposit address #" << deposit_index << " created: " << currency::get_account_address_as_str(addr));
+  return deposit_index;
+}
+//----------------------------------------------------------------------------------------------------
+currency::account_public_address wallet2::get_deposit_address(uint32_t deposit_index) const
+{
+  WLT_THROW_IF_FALSE_WALLET_CMN_ERR_EX(deposit_index <= m_deposit_addresses.size(), "deposit address #" << deposit_index << " does not exist");
+  return currency::get_deposit_address(m_account.get_keys(), deposit_index);
+}
+//----------------------------------------------------------------------------------------------------
+currency::account_keys wallet2::get_deposit_account_keys(uint32_t deposit_index) const
+{
+  if (deposit_index == 0)
+    return m_account.get_keys();
+  WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(deposit_index <= m_deposit_addresses.size(), "deposit address #" << deposit_index << " does not exist");
+  return currency::get_deposit_account_keys(m_account.get_keys(), deposit_index);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::init_deposit_addresses()
+{
+  m_deposit_spend_keys.clear();
+  m_deposit_spend_keys.reserve(m_deposit_addresses.size());
+  for (uint32_t deposit_index = 1; deposit_index <= m_deposit_addresses.size(); ++deposit_index)
+    m_deposit_spend_keys[currency::get_deposit_address(m_account.get_keys(), deposit_index).spend_public_key] = deposit_index;
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::sign_transfer(const std::string& tx_sources_blob, std::string& signed_tx_blob, currency::transaction& tx)
 {
   // assumed to be called from normal, non-watch-only wallet
@@ -4182,7 +5165,7 @@ void wallet2::sign_transfer(const std::string& tx_sources_blob, std::string& sig
     VARIANT_SWITCH_BEGIN(ft.tx.vout[i]);
     VARIANT_CASE_CONST(tx_out_bare, out)
     {
-      if (out.target.type() != typeid(txout_to_key))
+      if (!tools::is_variant_type<txout_to_key>(out.target))
         continue;
       const txout_to_key& otk = boost::get<txout_to_key>(out.target);
 
@@ -4281,9 +5264,9 @@ void wallet2::submit_transfer(const std::string& signed_tx_blob, currency::trans
     for (auto& p : ft.outs_key_images)
     {
       THROW_IF_FALSE_WALLET_INT_ERR_EX(p.first < tx.vout.size(), "outs_key_images has invalid out index: " << p.first << ", tx.vout.size() = " << tx.vout.size());
-      THROW_IF_FALSE_WALLET_INT_ERR_EX(tx.vout[p.first].type() == typeid(tx_out_bare), "Unexpected type in submit_transfer: " << tx.vout[p.first].type().name());
+      THROW_IF_FALSE_WALLET_INT_ERR_EX(tools::is_variant_type<tx_out_bare>(tx.vout[p.first]), "Unexpected type in submit_transfer: " << tx.vout[p.first].type().name());
       auto& out = boost::get<tx_out_bare>(tx.vout[p.first]);
-      THROW_IF_FALSE_WALLET_INT_ERR_EX(out.target.type() == typeid(txout_to_key), "outs_key_images has invalid out type, index: " << p.first);
+      THROW_IF_FALSE_WALLET_INT_ERR_EX(tools::is_variant_type<txout_to_key>(out.target), "outs_key_images has invalid out type, index: " << p.first);
       const txout_to_key& otk = boost::get<txout_to_key>(out.target);
       pk_ki_to_be_added.push_back(std::make_pair(otk.key, p.second));
     }
@@ -4292,7 +5275,7 @@ void wallet2::submit_transfer(const std::string& signed_tx_blob, currency::trans
     for (size_t i = 0; i < tx.vin.size(); ++i)
     {
       const txin_v& in = tx.vin[i];
-      THROW_IF_FALSE_WALLET_CMN_ERR_EX(in.type() == typeid(txin_to_key), "tx " << tx_hash << " has a non txin_to_key input");
+      THROW_IF_FALSE_WALLET_CMN_ERR_EX(tools::is_variant_type<txin_to_key>(in), "tx " << tx_hash << " has a non txin_to_key input");
       const crypto::key_image& ki = boost::get<txin_to_key>(in).k_image;
 
       const auto& src = ft.ftp.sources[i];
@@ -4382,8 +5365,13 @@ void wallet2::get_recent_transfers_history(std::vector<wallet_public::wallet_tra
   if (!count || offset >= m_transfer_history.size())
     return;
 
-  auto cb = [&](wallet_public::wallet_transfer_info& wti, size_t local_offset) {
-  
+  wallet_public::wallet_transfer_info buff = AUTO_VAL_INIT(buff);
+  auto cb = [&](wallet_public::wallet_transfer_info& resident_wti, size_t local_offset) {
+    size_t index = start_from_end ? m_transfer_history.size() - 1 - offset - local_offset : offset + local_offset;
+    if (exclude_mining_txs && index < m_history_txs.size() && resident_wti.is_mining)
+      return true;
+    wallet_public::wallet_transfer_info& wti = get_transfer_history_entry(index, buff);
+
     if (exclude_mining_txs)
     {
       if (currency::is_coinbase(wti.tx) || is_defragmentation_transaction(wti))
@@ -4469,6 +5457,12 @@ void wallet2::set_connectivity_options(unsigned int timeout)
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::export_transaction_history(std::ostream& ss, const std::string& format,  bool include_pos_transactions)
+{
+  uint64_t cursor = 0;
+  export_transaction_history_part(ss, format, include_pos_transactions, cursor, UINT64_MAX);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::export_transaction_history_part(std::ostream& ss, const std::string& format, bool include_pos_transactions, uint64_t& cursor, uint64_t max_entries)
 {
   //typedef int(*t_somefunc)(int, int);
   typedef void(*playout_cb_type)(std::ostream&, const wallet_public::wallet_transfer_info&, size_t);
@@ -4479,7 +5473,8 @@ void wallet2::export_transaction_history(std::ostream& ss, const std::string& fo
   playout_cb_type cb = cb_csv;
   if (format == "json")
   {
-    ss << "{ \"history\": [";
+    if (cursor == 0)
+      ss << "{ \"history\": [";
     cb = cb_json;
   }
   else if (format == "text")
@@ -4489,26 +5484,37 @@ void wallet2::export_transaction_history(std::ostream& ss, const std::string& fo
   else
   {
     //csv by default
-    ss << "N, Date, Amount, AssetID, Comment, Address, ID, Height, Unlock timestamp, Tx size, Alias, PaymentID, In/Out, Flags, Type, Fee" << ENDL;
+    if (cursor == 0)
+      ss << "N, Date, Amount, AssetID, Comment, Address, ID, Height, Unlock timestamp, Tx size, Alias, PaymentID, In/Out, Flags, Type, Fee" << ENDL;
   }
 
-
-  enum_container(m_transfer_history.begin(), m_transfer_history.end(), [&](wallet_public::wallet_transfer_info& wti, size_t index) {
+  // entries are taken one by one, so the offloaded ones get their txs only for the time they are written
+  wallet_public::wallet_transfer_info buff = AUTO_VAL_INIT(buff);
+  uint64_t end = m_transfer_history.size();
+  if (cursor < end && end - cursor > max_entries)
+    end = cursor + max_entries;
+  for (; cursor < end; ++cursor)
+  {
+    if (!include_pos_transactions && cursor < m_history_txs.size() && m_transfer_history[cursor].is_mining)
+      continue;
+    wallet_public::wallet_transfer_info& wti = get_transfer_history_entry(cursor, buff);
     if (!include_pos_transactions)
     {
       if (currency::is_coinbase(wti.tx))
-        return true;
+        continue;
     }
     wti.fee = currency::get_tx_fee(wti.tx);
-    cb(ss, wti, index);
-    return true;
-  });
+    cb(ss, wti, cursor);
+  }
+
+  if (cursor < m_transfer_history.size())
+    return false;
 
   if (format == "json")
   {
     ss << "{}]}";
   }
-
+  return true;
 }
 //----------------------------------------------------------------------------------------------------
 bool wallet2::get_transfer_address(const std::string& adr_str, currency::account_public_address& addr, std::string& payment_id)
@@ -4530,6 +5536,10 @@ bool wallet2::is_transfer_okay_for_pos(const transfer_details& tr, bool is_zarca
   if (!tr.is_spendable())
     return false;
 
+  // stake is signed with the wallet's own spend key
+  if (tr.m_deposit_index != 0)
+    return false;
+
   //blockchain conditions
   if (!is_transfer_unlocked(tr, true, stake_unlock_time))
     return false;
@@ -4546,8 +5556,12 @@ bool wallet2::is_transfer_okay_for_pos(const transfer_details& tr, bool is_zarca
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_mining_history(wallet_public::mining_history& hist, uint64_t timestamp_from)
 {
-  for (auto& tr : m_transfer_history)
+  wallet_public::wallet_transfer_info buff = AUTO_VAL_INIT(buff);
+  for (size_t i = 0; i != m_transfer_history.size(); ++i)
   {
+    if (i < m_history_txs.size() && !m_transfer_history[i].is_mining)
+      continue;
+    const wallet_public::wallet_transfer_info& tr = get_transfer_history_entry(i, buff);
     if (currency::is_coinbase(tr.tx) && tr.tx.vin.size() == 2 && tr.timestamp > timestamp_from)
     {
       tools::wallet_public::mining_history_entry mhe = AUTO_VAL_INIT(mhe);
@@ -4632,12 +5646,12 @@ bool wallet2::prepare_and_sign_pos_block(const mining_context& cxt, uint64_t ful
   if (!cxt.zarcanum)
   {
     // old PoS with non-hidden amounts
-    WLT_CHECK_AND_ASSERT_MES(b.miner_tx.vin[0].type() == typeid(currency::txin_gen), false, "Wrong input 0 type in transaction: " << b.miner_tx.vin[0].type().name());
-    WLT_CHECK_AND_ASSERT_MES(b.miner_tx.vin[1].type() == typeid(currency::txin_to_key), false, "Wrong input 1 type in transaction: " << b.miner_tx.vin[1].type().name());
-    WLT_CHECK_AND_ASSERT_MES(b.miner_tx.signatures.size() == 1 && b.miner_tx.signatures[0].type() == typeid(NLSAG_sig), false, "wrong sig prepared in a PoS block");
-    WLT_CHECK_AND_ASSERT_MES(stake_out_v.type() == typeid(tx_out_bare), false, "unexpected stake output type: " << stake_out_v.type().name() << ", expected: tx_out_bare");
+    WLT_CHECK_AND_ASSERT_MES(tools::is_variant_type<currency::txin_gen>(b.miner_tx.vin[0]), false, "Wrong input 0 type in transaction: " << b.miner_tx.vin[0].type().name());
+    WLT_CHECK_AND_ASSERT_MES(tools::is_variant_type<currency::txin_to_key>(b.miner_tx.vin[1]), false, "Wrong input 1 type in transaction: " << b.miner_tx.vin[1].type().name());
+    WLT_CHECK_AND_ASSERT_MES(b.miner_tx.signatures.size() == 1 && tools::is_variant_type<NLSAG_sig>(b.miner_tx.signatures[0]), false, "wrong sig prepared in a PoS block");
+    WLT_CHECK_AND_ASSERT_MES(tools::is_variant_type<tx_out_bare>(stake_out_v), false, "unexpected stake output type: " << stake_out_v.type().name() << ", expected: tx_out_bare");
     const tx_out_bare& stake_out = boost::get<tx_out_bare>(stake_out_v);
-    WLT_CHECK_AND_ASSERT_MES(stake_out.target.type() == typeid(txout_to_key), false, "unexpected stake output target type: " << stake_out.target.type().name() << ", expected: txout_to_key");
+    WLT_CHECK_AND_ASSERT_MES(tools::is_variant_type<txout_to_key>(stake_out.target), false, "unexpected stake output target type: " << stake_out.target.type().name() << ", expected: txout_to_key");
     
     NLSAG_sig& sig = boost::get<NLSAG_sig>(b.miner_tx.signatures[0]);
     txin_to_key& stake_input = boost::get<txin_to_key>(b.miner_tx.vin[1]);
@@ -4744,10 +5758,10 @@ bool wallet2::prepare_and_sign_pos_block(const mining_context& cxt, uint64_t ful
   // Zarcanum
 
   WLT_CHECK_AND_ASSERT_MES(td.is_zc(), false, "the transfer [" << pe.wallet_index << "] is not zc type, which is required for zarcanum");
-  WLT_CHECK_AND_ASSERT_MES(b.miner_tx.vin[0].type() == typeid(currency::txin_gen), false, "Wrong input 0 type in transaction: " << b.miner_tx.vin[0].type().name());
-  WLT_CHECK_AND_ASSERT_MES(b.miner_tx.vin[1].type() == typeid(currency::txin_zc_input), false, "Wrong input 1 type in transaction: " << b.miner_tx.vin[1].type().name());
-  WLT_CHECK_AND_ASSERT_MES(b.miner_tx.signatures.size() == 1 && b.miner_tx.signatures[0].type() == typeid(zarcanum_sig), false, "wrong sig prepared in a PoS block");
-  WLT_CHECK_AND_ASSERT_MES(stake_out_v.type() == typeid(tx_out_zarcanum), false, "unexpected stake output type: " << stake_out_v.type().name() << ", expected: tx_out_zarcanum");
+  WLT_CHECK_AND_ASSERT_MES(tools::is_variant_type<currency::txin_gen>(b.miner_tx.vin[0]), false, "Wrong input 0 type in transaction: " << b.miner_tx.vin[0].type().name());
+  WLT_CHECK_AND_ASSERT_MES(tools::is_variant_type<currency::txin_zc_input>(b.miner_tx.vin[1]), false, "Wrong input 1 type in transaction: " << b.miner_tx.vin[1].type().name());
+  WLT_CHECK_AND_ASSERT_MES(b.miner_tx.signatures.size() == 1 && tools::is_variant_type<zarcanum_sig>(b.miner_tx.signatures[0]), false, "wrong sig prepared in a PoS block");
+  WLT_CHECK_AND_ASSERT_MES(tools::is_variant_type<tx_out_zarcanum>(stake_out_v), false, "unexpected stake output type: " << stake_out_v.type().name() << ", expected: tx_out_zarcanum");
   WLT_CHECK_AND_ASSERT_MES(td.m_zc_info_ptr->asset_id == currency::native_coin_asset_id, false, "attempted to stake an output with a non-native asset id");
 
   zarcanum_sig& sig = boost::get<zarcanum_sig>(b.miner_tx.signatures[0]);
@@ -4759,23 +5773,13 @@ bool wallet2::prepare_and_sign_pos_block(const mining_context& cxt, uint64_t ful
   uint64_t secret_index = 0; // index of the real stake output
 
   // get decoys outputs and construct miner tx
-  const size_t required_decoys_count = m_core_runtime_config.hf4_minimum_mixins == 0 ? 4 /* <-- for tests */ : m_core_runtime_config.hf4_minimum_mixins;
-  static bool use_only_forced_to_mix = false;       // TODO @#@# set them somewhere else
+  const size_t required_decoys_count = get_zc_stake_decoys_count();
   if (required_decoys_count > 0 && !is_auditable())
   {
-    COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request decoys_req = AUTO_VAL_INIT(decoys_req);
-    decoys_req.height_upper_limit = m_last_pow_block_h; // request decoys to be either older than, or the same age as stake output's height
-    decoys_req.use_forced_mix_outs = use_only_forced_to_mix;
-    decoys_req.decoys_count = required_decoys_count + 1; // one more to be able to skip a decoy in case it hits the real output
-    decoys_req.amounts.push_back(0); // request one batch of decoys for hidden amounts
-
-    r = m_core_proxy->call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS(decoys_req, decoys_resp);
-    // TODO @#@# do we need these exceptions?
-    THROW_IF_FALSE_WALLET_EX(r, error::no_connection_to_daemon, "getrandom_outs1.bin");
-    THROW_IF_FALSE_WALLET_EX(decoys_resp.status != API_RETURN_CODE_BUSY, error::daemon_busy, "getrandom_outs1.bin");
-    THROW_IF_FALSE_WALLET_EX(decoys_resp.status == API_RETURN_CODE_OK, error::get_random_outs_error, decoys_resp.status);
-    WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(decoys_resp.outs.size() == 1, "got wrong number of decoys batches: " << decoys_resp.outs.size());
-    WLT_THROW_IF_FALSE_WALLET_CMN_ERR_EX(decoys_resp.outs[0].outs.size() == required_decoys_count + 1, "for PoS stake tx got less decoys to mix than requested: " << decoys_resp.outs[0].outs.size() << " < " << required_decoys_count + 1);
+    if (cxt.stake_decoys.outs.size() == required_decoys_count + 1)
+      decoys_resp.outs.push_back(cxt.stake_decoys); // prefetched by fill_mining_context()
+    else
+      fetch_zc_stake_decoys(decoys_resp);
 
     auto& decoys = decoys_resp.outs[0].outs;
     decoys.emplace_front(td.m_global_output_index, stake_out.stealth_address, stake_out.amount_commitment, stake_out.concealing_point, stake_out.blinded_asset_id);
@@ -4900,9 +5904,60 @@ bool wallet2::fill_mining_context(mining_context& ctx)
   ctx.is_pos_sequence_factor_good = pos_details_resp.pos_sequence_factor_is_good;
   ctx.starter_timestamp           = pos_details_resp.starter_timestamp;
   ctx.status = API_RETURN_CODE_NOT_FOUND;
+  if (ctx.zarcanum && ctx.is_pos_allowed && get_zc_stake_decoys_count() > 0)
+  {
+    refill_pos_stake_decoys();
+    ctx.stake_decoys = m_pos_stake_decoys.second;
+  }
   return true;
 }
 //------------------------------------------------------------------
+size_t wallet2::get_zc_stake_decoys_count() const
+{
+  return m_core_runtime_config.hf4_minimum_mixins == 0 ? 4 /* <-- for tests */ : m_core_runtime_config.hf4_minimum_mixins;
+}
+//------------------------------------------------------------------
+void wallet2::fetch_zc_stake_decoys(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& decoys_resp) const
+{
+  static bool use_only_forced_to_mix = false;       // TODO @#@# set them somewhere else
+  const size_t required_decoys_count = get_zc_stake_decoys_count();
+  COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request decoys_req = AUTO_VAL_INIT(decoys_req);
+  decoys_req.height_upper_limit = m_last_pow_block_h; // request decoys to be either older than, or the same age as stake output's height
+  decoys_req.use_forced_mix_outs = use_only_forced_to_mix;
+  decoys_req.decoys_count = required_decoys_count + 1; // one more to be able to skip a decoy in case it hits the real output
+  decoys_req.amounts.push_back(0); // request one batch of decoys for hidden amounts
+
+  bool r = m_core_proxy->call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS(decoys_req, decoys_resp);
+  // TODO @#@# do we need these exceptions?
+  THROW_IF_FALSE_WALLET_EX(r, error::no_connection_to_daemon, "getrandom_outs1.bin");
+  THROW_IF_FALSE_WALLET_EX(decoys_resp.status != API_RETURN_CODE_BUSY, error::daemon_busy, "getrandom_outs1.bin");
+  THROW_IF_FALSE_WALLET_EX(decoys_resp.status == API_RETURN_CODE_OK, error::get_random_outs_error, decoys_resp.status);
+  WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(decoys_resp.outs.size() == 1, "got wrong number of decoys batches: " << decoys_resp.outs.size());
+  WLT_THROW_IF_FALSE_WALLET_CMN_ERR_EX(decoys_resp.outs[0].outs.size() == required_decoys_count + 1, "for PoS stake tx got less decoys to mix than requested: " << decoys_resp.outs[0].outs.size() << " < " << required_decoys_count + 1);
+}
+//------------------------------------------------------------------
+void wallet2::refill_pos_stake_decoys()
+{
+  // the ring of a Zarcanum stake doesn't depend on the stake, so one is fetched beforehand and kept for a few blocks until a block is made with it;
+  // it's the only daemon request between a found kernel and the block template
+  if (is_auditable())
+    return;
+  uint64_t top_block_height = get_top_block_height();
+  if (!m_pos_stake_decoys.second.outs.empty() && m_pos_stake_decoys.first + WALLET_ZC_DECOYS_POOL_MAX_AGE >= top_block_height && m_pos_stake_decoys.first <= top_block_height)
+    return;
+  m_pos_stake_decoys = std::make_pair(top_block_height, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount());
+  try
+  {
+    COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response decoys_resp = AUTO_VAL_INIT(decoys_resp);
+    fetch_zc_stake_decoys(decoys_resp);
+    m_pos_stake_decoys.second = std::move(decoys_resp.outs.front());
+  }
+  catch (const std::exception& e)
+  {
+    WLT_LOG_L1("PoS stake decoys were not prefetched: " << e.what() << ", they will be requested for a found kernel");
+  }
+}
+//------------------------------------------------------------------
 bool wallet2::try_mint_pos()
 {
   return try_mint_pos(m_account.get_public_address());
@@ -4968,15 +6023,102 @@ bool wallet2::do_pos_mining_iteration(mining_context& context, size_t transfer_i
 {
   return context.do_iteration(ts);
 }
+//------------------------------------------------------------------
+void wallet2::get_pos_scan_timestamps(uint64_t ts_from, uint64_t ts_to, std::vector<uint64_t>& timestamps)
+{
+  // from the middle of the window to its ends, the past one first
+  uint64_t ts_middle = (ts_to + ts_from) / 2;
+  ts_middle -= ts_middle % POS_SCAN_STEP;
+  uint64_t ts_window = std::min(ts_middle - ts_from, ts_to - ts_middle);
+  timestamps.clear();
+  timestamps.push_back(ts_middle);
+  for (uint64_t step = POS_SCAN_STEP; step <= ts_window; step += POS_SCAN_STEP)
+  {
+    timestamps.push_back(ts_middle - step);
+    timestamps.push_back(ts_middle + step);
+  }
+}
+//------------------------------------------------------------------
+size_t wallet2::get_pos_scan_part_size(size_t entries_count)
+{
+  size_t threads_count = std::thread::hardware_concurrency();
+  if (threads_count < 2 || entries_count < WALLET_PARALLEL_POS_SCAN_MIN_ENTRIES)
+    return 1;
+  return threads_count * WALLET_PARALLEL_POS_SCAN_JOB_ENTRIES;
+}
+//------------------------------------------------------------------
+bool wallet2::scan_pos_part(mining_context& cxt, const std::vector<pos_scan_entry>& entries, size_t offset, size_t count, const std::vector<uint64_t>& timestamps, std::atomic<bool>& stop)
+{
+  // each job takes a range of the entries with its own copy of the kernel context, the first kernel found stops them all;
+  // entries are prepared by the jobs too, as it's the costly part for the short windows
+  struct job_result
+  {
+    currency::pos_mining_context pmc;
+    size_t found_entry = SIZE_MAX;
+    uint64_t iterations = 0;
+  };
+  size_t jobs_count = (count + WALLET_PARALLEL_POS_SCAN_JOB_ENTRIES - 1) / WALLET_PARALLEL_POS_SCAN_JOB_ENTRIES;
+  std::vector<job_result> results(jobs_count, job_result{ static_cast<const currency::pos_mining_context&>(cxt) });
+  std::atomic<bool> found(false);
+  const currency::account_keys& keys = m_account.get_keys();
+  utils::threads_pool::jobs_container jobs;
+  for (size_t j = 0; j != jobs_count; ++j)
+  {
+    size_t from = offset + j * WALLET_PARALLEL_POS_SCAN_JOB_ENTRIES, to = std::min(offset + count, from + WALLET_PARALLEL_POS_SCAN_JOB_ENTRIES);
+    utils::threads_pool::add_job_to_container(jobs, [this, &entries, &timestamps, &results, &found, &stop, &keys, j, from, to]()
+    {
+      job_result& r = results[j];
+      for (size_t i = from; i != to && !found && !stop; ++i)
+      {
+        const transfer_details& td = m_transfers[entries[i].transfer_index];
+        r.pmc.prepare_entry(td.amount(), td.m_key_image, get_tx_pub_key_from_extra(td.m_ptx_wallet_info->m_tx), td.m_internal_output_index,
+          td.is_zc() ? td.m_zc_info_ptr->amount_blinding_mask : crypto::scalar_t{}, keys.view_secret_key);
+        for (size_t k = 0; k != timestamps.size() && !found; ++k)
+        {
+          ++r.iterations;
+          if (r.pmc.do_iteration(timestamps[k]))
+          {
+            r.found_entry = i;
+            found = true;
+            return;
+          }
+        }
+      }
+    });
+  }
+  get_threads_pool().add_batch_and_wait(jobs);
+
+  for (size_t i = offset; i != offset + count; ++i)
+  {
+    cxt.total_items_checked++;
+    cxt.total_amount_checked += m_transfers[entries[i].transfer_index].amount();
+  }
+  for (const auto& r : results)
+    cxt.iterations_processed += r.iterations;
+  for (const auto& r : results)
+  {
+    if (r.found_entry == SIZE_MAX)
+      continue;
+    static_cast<currency::pos_mining_context&>(cxt) = r.pmc;
+    cxt.index = entries[r.found_entry].transfer_index;
+    cxt.stake_unlock_time = entries[r.found_entry].stake_unlock_time;
+    cxt.status = API_RETURN_CODE_OK;
+    return true;
+  }
+  return false;
+}
 //-------------------------------
 bool wallet2::reset_history()
 {
   std::string pass = m_password;
   std::wstring file_path = m_wallet_file;
   account_base acc_tmp = m_account;
+  std::vector<std::string> deposit_addresses = std::move(m_deposit_addresses); // not a part of the history, though it's stored with it
   clear();
   m_account = acc_tmp;
   m_password = pass;
+  m_deposit_addresses = std::move(deposit_addresses);
+  init_deposit_addresses();
   prepare_file_names(file_path);
   return true;
 }
@@ -5060,6 +6202,7 @@ bool wallet2::build_minted_block(const mining_context& cxt, const currency::acco
   WLT_CHECK_AND_ASSERT_MES(res, false, "parse_hexstr_to_binbuff() failed after kernel hash found!");
   res = parse_and_validate_block_from_blob(block_blob, b);
   WLT_CHECK_AND_ASSERT_MES(res, false, "parse_and_validate_block_from_blob() failed after kernel hash found!");
+  b.invalidate_hashes(); // the template is completed and signed below
 
   if (cxt.last_block_hash != b.prev_id)
   {
@@ -5074,6 +6217,7 @@ bool wallet2::build_minted_block(const mining_context& cxt, const currency::acco
   WLT_LOG_MAGENTA("Applying actual timestamp: " << current_timestamp, LOG_LEVEL_2);
 
   res = prepare_and_sign_pos_block(cxt, tmpl_rsp.block_reward, tmpl_req.pe, tmpl_rsp.miner_tx_tgc, b);
+  m_pos_stake_decoys = std::make_pair(uint64_t(0), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount()); // the next block gets its own ring
   WLT_CHECK_AND_ASSERT_MES(res, false, "Failed to prepare_and_sign_pos_block");
 
   crypto::hash block_hash = get_block_hash(b);
@@ -5166,12 +6310,13 @@ void wallet2::push_offer(const bc_services::offer_details_ex& od, currency::tran
   transfer(destinations, 0, 0, od.fee, extra, attachments, get_current_split_strategy(), tx_dust_policy(DEFAULT_DUST_THRESHOLD), res_tx);
 }
 //----------------------------------------------------------------------------------------------------
-const transaction& wallet2::get_transaction_by_id(const crypto::hash& tx_hash)
+transaction wallet2::get_transaction_by_id(const crypto::hash& tx_hash)
 {
-  for (auto it = m_transfer_history.rbegin(); it != m_transfer_history.rend(); it++)
+  wallet_public::wallet_transfer_info buff = AUTO_VAL_INIT(buff);
+  for (size_t i = m_transfer_history.size(); i != 0; --i)
   {
-    if (it->tx_hash == tx_hash)
-      return it->tx;
+    if (m_transfer_history[i - 1].tx_hash == tx_hash)
+      return get_transfer_history_entry(i - 1, buff).tx;
   }
   ASSERT_MES_AND_THROW("Tx " << tx_hash << " not found in wallet");
 }
@@ -5783,6 +6928,8 @@ void wallet2::add_transfers_to_expiration_list(const std::vector<uint64_t>& sele
   m_money_expirations.back().selected_transfers = selected_transfers_local;
   m_money_expirations.back().related_tx_id = related_tx_id;
   m_money_expirations.back().receved = received;
+  if (m_expiration_triggers.ready)
+    m_expiration_triggers.money_expirations.emplace(expiration, std::prev(m_money_expirations.end()));
 
   std::stringstream ss;
   for (auto tr_ind : m_money_expirations.back().selected_transfers)
@@ -5791,6 +6938,7 @@ void wallet2::add_transfers_to_expiration_list(const std::vector<uint64_t>& sele
     uint32_t flags_before = m_transfers[tr_ind].m_flags;
     m_transfers[tr_ind].m_flags |= WALLET_TRANSFER_DETAIL_FLAG_BLOCKED;
     m_transfers[tr_ind].m_flags |= WALLET_TRANSFER_DETAIL_FLAG_ESCROW_PROPOSAL_RESERVATION;
+    invalidate_balance_counters();
     ss << " " << std::right << std::setw(4) << tr_ind << "  " << std::setw(21) << print_money(m_transfers[tr_ind].amount()) << "  "
       << std::setw(2) << std::left << flags_before << " -> " << std::setw(2) << std::left << m_transfers[tr_ind].m_flags << "  "
       << get_transaction_hash(m_transfers[tr_ind].m_ptx_wallet_info->m_tx) << std::endl;
@@ -5814,6 +6962,15 @@ void wallet2::remove_transfer_from_expiration_list(uint64_t transfer_index)
       st.erase(jt);
       if (st.empty())
       {
+        auto range = m_expiration_triggers.money_expirations.equal_range(it->expiration_time);
+        for (auto tr_it = range.first; tr_it != range.second; ++tr_it)
+        {
+          if (tr_it->second == it)
+          {
+            m_expiration_triggers.money_expirations.erase(tr_it);
+            break;
+          }
+        }
         it = m_money_expirations.erase(it);
         continue;
       }
@@ -5824,6 +6981,7 @@ void wallet2::remove_transfer_from_expiration_list(uint64_t transfer_index)
   uint32_t flags_before = m_transfers[transfer_index].m_flags;
   m_transfers[transfer_index].m_flags &= ~WALLET_TRANSFER_DETAIL_FLAG_BLOCKED;
   m_transfers[transfer_index].m_flags &= ~WALLET_TRANSFER_DETAIL_FLAG_ESCROW_PROPOSAL_RESERVATION;
+  add_transfer_to_transfers_cache(transfer_index);
   if (flags_before != m_transfers[transfer_index].m_flags)
   {
     WLT_LOG_BLUE("Transfer [" << transfer_index << "] was cleared from escrow proposal reservation, flags: " << flags_before << " -> " << m_transfers[transfer_index].m_flags << ", reason: intentional removing from expiration list", LOG_LEVEL_0);
@@ -5939,7 +7097,7 @@ void wallet2::get_list_of_active_htlc(std::list<wallet_public::htlc_entry_info>&
     }
     wallet_public::htlc_entry_info entry = AUTO_VAL_INIT(entry);
     entry.tx_id = htlc_entry.first;
-    if (td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index].type() != typeid(tx_out_bare))
+    if (!tools::is_variant_type<tx_out_bare>(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index]))
     {
       //@#@
       LOG_ERROR("Unexpected output type in get_list_of_active_htlc:" << td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index].type().name());
@@ -5947,7 +7105,7 @@ void wallet2::get_list_of_active_htlc(std::list<wallet_public::htlc_entry_info>&
     }
     const tx_out_bare out_b = boost::get<tx_out_bare>(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index]);
     entry.amount = out_b.amount;
-    WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(out_b.target.type() == typeid(txout_htlc),
+    WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(tools::is_variant_type<txout_htlc>(out_b.target),
       "[get_list_of_active_htlc]Internal error: unexpected type of out");
     const txout_htlc& htlc = boost::get<txout_htlc>(out_b.target);
     entry.sha256_hash = htlc.htlc_hash;
@@ -6064,6 +7222,7 @@ bool wallet2::build_ionic_swap_template(const wallet_public::ionic_swap_proposal
   finalize_transaction(ftp, finalize_result, false);
   for(uint64_t i: selected_transfers)
     m_transfers[i].m_flags &= ~WALLET_TRANSFER_DETAIL_FLAG_BLOCKED;
+  add_transfers_to_transfers_cache(selected_transfers);
 
   //add_transfers_to_expiration_list(selected_transfers, for_expiration_list, this->get_core_runtime_config().get_core_time() + proposal_detais.expiration_time, currency::null_hash);
 
@@ -6151,14 +7310,14 @@ bool wallet2::get_ionic_swap_proposal_info(const wallet_public::ionic_swap_propo
     //size_t mx = 0;
     uint64_t amount = 0;
     crypto::public_key in_asset_id = currency::native_coin_asset_id;
-    if (tx.vin[i].type() == typeid(txin_zc_input))
+    if (tools::is_variant_type<txin_zc_input>(tx.vin[i]))
     {
       in_asset_id = ionic_context.gen_context.real_zc_ins_asset_ids[zc_current_index].to_public_key();
       amount = ionic_context.gen_context.zc_input_amounts[zc_current_index];
       zc_current_index++;
       //mx = boost::get<currency::txin_zc_input>(tx.vin[i]).key_offsets.size() - 1;
     }
-    else if (tx.vin[i].type() == typeid(txin_to_key))
+    else if (tools::is_variant_type<txin_to_key>(tx.vin[i]))
     {
       amount = boost::get<txin_to_key>(tx.vin[i]).amount;
       //mx = boost::get<currency::txin_to_key>(tx.vin[i]).key_offsets.size() - 1;
@@ -6381,7 +7540,7 @@ bool wallet2::prepare_tx_sources(assets_selection_context& needed_money_map, siz
   {
     // if smth went wrong -- invalidate transfers cache to trigger its regeneration on the next use
     // it is necessary because it may be in invalid state (some items might be erased within select_indices_for_transfer() or expand_selection_with_zc_input())
-    m_found_free_amounts.clear();
+    invalidate_transfers_cache();
     throw;
   }
 }
@@ -6433,6 +7592,7 @@ bool wallet2::prepare_tx_sources(size_t fake_outputs_count_, bool use_all_decoys
     uint64_t current_size = m_chain.get_blockchain_current_size();
 
     bool need_to_request = fake_outputs_count != 0;
+    std::map<size_t, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount> pooled_decoys; // by input index
     COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::request req = AUTO_VAL_INIT(req);
     req.height_upper_limit = m_last_pow_block_h;  // request decoys to be either older than, or the same age as stake output's height
     req.use_forced_mix_outs = false; // TODO: add this feature to UI later
@@ -6455,6 +7615,12 @@ bool wallet2::prepare_tx_sources(size_t fake_outputs_count_, bool use_all_decoys
           continue;
         //Zarcanum era
         rdisttib.amount = 0;
+        COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount pooled_entry{};
+        if (take_zc_decoys_from_pool(pooled_entry))
+        {
+          pooled_decoys[req.amounts.size() - 1] = std::move(pooled_entry);
+          continue; // prefetched, nothing to ask the daemon for
+        }
         //generate distribution in Zarcanum hardfork
         build_distribution_for_input(rdisttib.global_offsets, it->m_global_output_index);
         need_to_request = true;
@@ -6466,7 +7632,7 @@ bool wallet2::prepare_tx_sources(size_t fake_outputs_count_, bool use_all_decoys
         rdisttib.global_offsets.resize(fake_outputs_count + 1, 0);
       }
     }
-    if (need_to_request)
+    if (need_to_request && pooled_decoys.size() != req.amounts.size()) // no need to ask if all the decoys are prefetched
     {
       size_t attempt_count = 0;
       while (true)
@@ -6506,6 +7672,13 @@ bool wallet2::prepare_tx_sources(size_t fake_outputs_count_, bool use_all_decoys
         THROW_IF_FALSE_WALLET_EX(scanty_outs.empty(), error::not_enough_outs_to_mix, scanty_outs, fake_outputs_count);
       }
     }
+
+    if (!pooled_decoys.empty())
+    {
+      daemon_resp.outs.resize(selected_indicies.size());
+      for (auto& pd : pooled_decoys)
+        daemon_resp.outs[pd.first] = std::move(pd.second);
+    }
   }
 
   //lets prefetch m_global_output_index for selected_indicies
@@ -6605,6 +7778,7 @@ bool wallet2::prepare_tx_sources(size_t fake_outputs_count_, bool use_all_decoys
     src.real_out_tx_key = get_tx_pub_key_from_extra(td.m_ptx_wallet_info->m_tx);
     src.real_output = interted_it - src.outputs.begin();
     src.real_output_in_tx_index = td.m_internal_output_index;
+    src.deposit_index = td.m_deposit_index;
     
     if (epee::log_space::get_set_log_detalisation_level() >= LOG_LEVEL_1)
     {
@@ -6678,6 +7852,67 @@ void wallet2::select_decoys(currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS
   amount_entry.outs = local_outs;  
 }
 //----------------------------------------------------------------------------------------------------------------
+bool wallet2::take_zc_decoys_from_pool(currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& amount_entry)
+{
+  uint64_t top_block_height = get_top_block_height();
+  while (!m_zc_decoys_pool.empty() && m_zc_decoys_pool.front().first + WALLET_ZC_DECOYS_POOL_MAX_AGE < top_block_height)
+    m_zc_decoys_pool.pop_front();
+  if (m_zc_decoys_pool.empty())
+    return false;
+
+  // each set is used only once
+  amount_entry = std::move(m_zc_decoys_pool.front().second);
+  m_zc_decoys_pool.pop_front();
+  return true;
+}
+//----------------------------------------------------------------------------------------------------------------
+bool wallet2::refill_zc_decoys_pool()
+{
+  if (is_auditable() || !m_core_runtime_config.hf4_minimum_mixins || !is_in_hardfork_zone(ZANO_HARDFORK_04_ZARCANUM) || m_last_zc_global_indexs.empty())
+    return true; // decoys are not needed, or can't be chosen yet
+
+  uint64_t top_block_height = get_top_block_height();
+  while (!m_zc_decoys_pool.empty() && m_zc_decoys_pool.front().first + WALLET_ZC_DECOYS_POOL_MAX_AGE < top_block_height)
+    m_zc_decoys_pool.pop_front();
+  if (m_zc_decoys_pool.size() >= WALLET_ZC_DECOYS_POOL_SIZE)
+    return true;
+
+  // the same request as prepare_tx_sources() makes for a ZC input, only without the real output among the offsets
+  COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::request req = AUTO_VAL_INIT(req);
+  req.height_upper_limit = m_last_pow_block_h;
+  req.use_forced_mix_outs = false;
+  for (size_t i = m_zc_decoys_pool.size(); i != WALLET_ZC_DECOYS_POOL_SIZE; ++i)
+  {
+    req.amounts.push_back(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::offsets_distribution());
+    req.amounts.back().amount = 0;
+    build_distribution_for_decoys_pool(req.amounts.back().global_offsets);
+  }
+
+  COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response rsp = AUTO_VAL_INIT(rsp);
+  bool r = m_core_proxy->call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3(req, rsp);
+  WLT_CHECK_AND_ASSERT_MES(r && rsp.status == API_RETURN_CODE_OK && rsp.outs.size() == req.amounts.size(), false,
+    "failed to refill ZC decoys pool: getrandom_outs3.bin returned " << (r ? rsp.status : std::string("no connection")) << ", " << rsp.outs.size() << " sets of " << req.amounts.size());
+
+  for (auto& outs : rsp.outs)
+  {
+    if (outs.outs.size() < m_core_runtime_config.hf4_minimum_mixins + 1) // one may be the real output of the input it's taken for
+      continue;
+    m_zc_decoys_pool.emplace_back(top_block_height, std::move(outs));
+  }
+  WLT_LOG_L2("ZC decoys pool refilled, " << m_zc_decoys_pool.size() << " sets");
+  return true;
+}
+//----------------------------------------------------------------------------------------------------------------
+void wallet2::build_distribution_for_decoys_pool(std::vector<uint64_t>& offsets)
+{
+  decoy_selection_generator zarcanum_decoy_set_generator;
+  zarcanum_decoy_set_generator.init(get_actual_zc_global_index());
+
+  THROW_IF_FALSE_WALLET_INT_ERR_EX(zarcanum_decoy_set_generator.is_initialized(), "zarcanum_decoy_set_generator are not initialized");
+  uint64_t actual_zc_index = get_actual_zc_global_index();
+  offsets = zarcanum_decoy_set_generator.generate_unique_reversed_distribution(actual_zc_index - 1 > WALLET_FETCH_RANDOM_OUTS_SIZE ? WALLET_FETCH_RANDOM_OUTS_SIZE : actual_zc_index - 1);
+}
+//----------------------------------------------------------------------------------------------------------------
 void wallet2::build_distribution_for_input(std::vector<uint64_t>& offsets, uint64_t own_index)
 {
   decoy_selection_generator zarcanum_decoy_set_generator;
@@ -6699,9 +7934,9 @@ bool wallet2::prepare_tx_sources(crypto::hash multisig_id, std::vector<currency:
 
   THROW_IF_FALSE_WALLET_INT_ERR_EX(it->second.m_internal_output_index < it->second.m_ptx_wallet_info->m_tx.vout.size(), "it->second.m_internal_output_index < it->second.m_tx.vout.size()");
   //@#@
-  THROW_IF_FALSE_WALLET_INT_ERR_EX(it->second.m_ptx_wallet_info->m_tx.vout[it->second.m_internal_output_index].type() == typeid(tx_out_bare), "Unknown type id in prepare_tx_sources: " << it->second.m_ptx_wallet_info->m_tx.vout[it->second.m_internal_output_index].type().name());
+  THROW_IF_FALSE_WALLET_INT_ERR_EX(tools::is_variant_type<tx_out_bare>(it->second.m_ptx_wallet_info->m_tx.vout[it->second.m_internal_output_index]), "Unknown type id in prepare_tx_sources: " << it->second.m_ptx_wallet_info->m_tx.vout[it->second.m_internal_output_index].type().name());
   const tx_out_bare& out = boost::get<tx_out_bare>(it->second.m_ptx_wallet_info->m_tx.vout[it->second.m_internal_output_index]);
-  THROW_IF_FALSE_WALLET_INT_ERR_EX(out.target.type() == typeid(txout_multisig), "ms out target type is " << out.target.type().name() << ", expected: txout_multisig");
+  THROW_IF_FALSE_WALLET_INT_ERR_EX(tools::is_variant_type<txout_multisig>(out.target), "ms out target type is " << out.target.type().name() << ", expected: txout_multisig");
   const txout_multisig& ms_out = boost::get<txout_multisig>(out.target);
 
   sources.push_back(AUTO_VAL_INIT(currency::tx_source_entry()));
@@ -6731,11 +7966,11 @@ bool wallet2::prepare_tx_sources_htlc(crypto::hash htlc_tx_id, const std::string
 
   const transfer_details& td = m_transfers[it->second];
   //@#@
-  WLT_THROW_IF_FALSE_WITH_CODE(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index].type() == typeid(tx_out_bare),
+  WLT_THROW_IF_FALSE_WITH_CODE(tools::is_variant_type<tx_out_bare>(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index]),
     "Unexpected out type in prepare_tx_sources_htlc:" << td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index].type().name(), API_RETURN_CODE_INTERNAL_ERROR);
 
   const tx_out_bare& out_bare = boost::get<tx_out_bare>(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index]);
-  WLT_THROW_IF_FALSE_WITH_CODE(out_bare.target.type() == typeid(txout_htlc),
+  WLT_THROW_IF_FALSE_WITH_CODE(tools::is_variant_type<txout_htlc>(out_bare.target),
     "Unexpected type in active htlc", API_RETURN_CODE_INTERNAL_ERROR);
 
   const txout_htlc& htlc_out = boost::get<txout_htlc>(out_bare.target);
@@ -6813,41 +8048,17 @@ void wallet2::send_transaction_to_network(const transaction& tx)
   if (!m_disable_tor_relay)
   {
     //TODO check that core synchronized
-    //epee::net_utils::levin_client2 p2p_client;
-    
-    //make few attempts
-    tools::levin_over_tor_client p2p_client;
-    p2p_client.get_transport().set_notifier(this);
-    bool succeseful_sent = false;
-    for (size_t i = 0; i != 3; i++)
-    {
-      if (!p2p_client.connect("144.76.183.143", 2121, 10000))
-      {
-        continue;//THROW_IF_FALSE_WALLET_EX(false, error::no_connection_to_daemon, "Failed to connect to TOR node");
-      }
-
+    if (!m_ptor_relay_pool)
+      m_ptor_relay_pool = std::make_shared<tools::tor_relay_pool>(std::vector<tools::tor_relay_pool::relay_node>{ { "144.76.183.143", 2121 } }, this);
 
-      currency::NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::request p2p_req = AUTO_VAL_INIT(p2p_req);
-      currency::NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::response p2p_rsp = AUTO_VAL_INIT(p2p_rsp);
-      p2p_req.txs.push_back(t_serializable_object_to_blob(tx));
-      this->notify_state_change(WALLET_LIB_STATE_SENDING);
-      epee::net_utils::invoke_remote_command2(NOTIFY_OR_INVOKE_NEW_TRANSACTIONS::ID, p2p_req, p2p_rsp, p2p_client);
-      p2p_client.disconnect();
-      if (p2p_rsp.code == API_RETURN_CODE_OK)
-      {
-        this->notify_state_change(WALLET_LIB_SENT_SUCCESS);
-        succeseful_sent = true;
-        break;
-      }
-      this->notify_state_change(WALLET_LIB_SEND_FAILED);
-      //checking if transaction got relayed to other nodes and 
-      //return;
-    }
+    this->notify_state_change(WALLET_LIB_STATE_SENDING);
+    bool succeseful_sent = m_ptor_relay_pool->relay_tx(t_serializable_object_to_blob(tx));
     if (!succeseful_sent)
     {
       this->notify_state_change(WALLET_LIB_SEND_FAILED);
       THROW_IF_FALSE_WALLET_EX(succeseful_sent, error::no_connection_to_daemon, "Faile to build TOR stream");
     }
+    this->notify_state_change(WALLET_LIB_SENT_SUCCESS);
   }
   else
 #endif //
@@ -6908,6 +8119,9 @@ void wallet2::mark_transfers_with_flag(const std::vector<uint64_t>& selected_tra
   {
     uint32_t flags_before = m_transfers[i].m_flags;
     m_transfers[i].m_flags |= flag;
+    invalidate_balance_counters();
+    if (!m_transfers[i].is_spendable())
+      remove_transfer_from_transfers_cache(i);
     WLT_LOG_L1("marking transfer  #" << std::setfill('0') << std::right << std::setw(3) << i << " with flag " << flag << " : " << flags_before << " -> " << m_transfers[i].m_flags <<
       (reason.empty() ? "" : ", reason: ") << reason);
   }
@@ -6925,6 +8139,7 @@ void wallet2::clear_transfers_from_flag(const std::vector<uint64_t>& selected_tr
     }
     uint32_t flags_before = m_transfers[i].m_flags;
     m_transfers[i].m_flags &= ~flag;
+    add_transfer_to_transfers_cache(i);
     WLT_LOG_L1("clearing transfer #" << std::setfill('0') << std::right << std::setw(3) << i << " from flag " << flag << " : " << flags_before << " -> " << m_transfers[i].m_flags <<
       (reason.empty() ? "" : ", reason: ") << reason);
   }
@@ -6933,7 +8148,7 @@ void wallet2::clear_transfers_from_flag(const std::vector<uint64_t>& selected_tr
 //----------------------------------------------------------------------------------------------------
 void wallet2::exception_handler()
 {
-  m_found_free_amounts.clear();
+  invalidate_transfers_cache();
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::exception_handler() const
@@ -6951,47 +8166,49 @@ void wallet2::mark_transfers_as_spent(const std::vector<uint64_t>& selected_tran
 bool wallet2::extract_offers_from_transfer_entry(size_t i, std::unordered_map<crypto::hash, bc_services::offer_details_ex>& offers_local)
 {
   //TODO: this code supports only one market(offer) instruction per transaction
-  load_wallet_transfer_info_flags(m_transfer_history[i]);
-  switch (m_transfer_history[i].tx_type)
+  wallet_public::wallet_transfer_info buff = AUTO_VAL_INIT(buff);
+  wallet_public::wallet_transfer_info& wti = get_transfer_history_entry(i, buff);
+  load_wallet_transfer_info_flags(wti);
+  switch (wti.tx_type)
   {
     case GUI_TX_TYPE_PUSH_OFFER:
     {
       bc_services::offer_details od;
-      if (!get_type_in_variant_container(m_transfer_history[i].marketplace_entries, od))
+      if (!get_type_in_variant_container(wti.marketplace_entries, od))
       {
-        WLT_LOG_ERROR("Transaction history entry " << i << " market as type " << m_transfer_history[i].tx_type << " but get_type_in_variant_container returned false for bc_services::offer_details");
+        WLT_LOG_ERROR("Transaction history entry " << i << " market as type " << wti.tx_type << " but get_type_in_variant_container returned false for bc_services::offer_details");
         break;
       }
       crypto::hash h = null_hash;
-      h = m_transfer_history[i].tx_hash;
+      h = wti.tx_hash;
       bc_services::offer_details_ex& ode = offers_local[h];
       ode = AUTO_VAL_INIT(bc_services::offer_details_ex());
       static_cast<bc_services::offer_details&>(ode) = od;
       //fill extra fields
-      ode.tx_hash = m_transfer_history[i].tx_hash;
+      ode.tx_hash = wti.tx_hash;
       ode.index_in_tx = 0; // TODO: handle multiple offers in tx, now only one per tx is supported
-      ode.timestamp = m_transfer_history[i].timestamp; 
-      ode.fee = m_transfer_history[i].fee;
+      ode.timestamp = wti.timestamp; 
+      ode.fee = wti.fee;
       ode.stopped = false;
       break;
     }
     case GUI_TX_TYPE_UPDATE_OFFER:
     {
       bc_services::update_offer uo;
-      if (!get_type_in_variant_container(m_transfer_history[i].marketplace_entries, uo))
+      if (!get_type_in_variant_container(wti.marketplace_entries, uo))
       {
-        WLT_LOG_ERROR("Transaction history entry " << i << " market as type " << m_transfer_history[i].tx_type << " but get_type_in_variant_container returned false for update_offer");
+        WLT_LOG_ERROR("Transaction history entry " << i << " market as type " << wti.tx_type << " but get_type_in_variant_container returned false for update_offer");
         break;
       }
       crypto::hash h = null_hash;
-      h = m_transfer_history[i].tx_hash;
+      h = wti.tx_hash;
       bc_services::offer_details_ex& ode = offers_local[h];
       ode = AUTO_VAL_INIT(bc_services::offer_details_ex());
       static_cast<bc_services::offer_details&>(ode) = uo.of;
       //fill extra fields
-      ode.tx_hash = m_transfer_history[i].tx_hash;
+      ode.tx_hash = wti.tx_hash;
       ode.index_in_tx = 0;
-      ode.fee = m_transfer_history[i].fee;
+      ode.fee = wti.fee;
       ode.stopped = false;
       ode.tx_original_hash = uo.tx_id;
       //remove old transaction
@@ -7010,9 +8227,9 @@ bool wallet2::extract_offers_from_transfer_entry(size_t i, std::unordered_map<cr
     case GUI_TX_TYPE_CANCEL_OFFER:
     {
       bc_services::cancel_offer co;
-      if (!get_type_in_variant_container(m_transfer_history[i].marketplace_entries, co))
+      if (!get_type_in_variant_container(wti.marketplace_entries, co))
       {
-        WLT_LOG_ERROR("Transaction history entry " << i << " market as type " << m_transfer_history[i].tx_type << " but get_type_in_variant_container returned false for cancel_offer");
+        WLT_LOG_ERROR("Transaction history entry " << i << " market as type " << wti.tx_type << " but get_type_in_variant_container returned false for cancel_offer");
         break;
       }
       crypto::hash h = co.tx_id;
@@ -7148,6 +8365,7 @@ uint64_t wallet2::select_indices_for_transfer(std::vector<uint64_t>& selected_in
   uint64_t found_money = 0;
   size_t outputs_found = 0;
   std::string selected_amounts_str;
+  std::vector<uint64_t> not_unlocked_yet;
   while (found_money < needed_money && found_free_amounts.size())
   {
     auto it = found_free_amounts.lower_bound(needed_money - found_money);
@@ -7169,11 +8387,18 @@ uint64_t wallet2::select_indices_for_transfer(std::vector<uint64_t>& selected_in
       selected_amounts_str += (selected_amounts_str.empty() ? "" : "+") + print_money_brief(it->first, decimal_point);
       ++outputs_found;
     }
+    else if (is_transfer_able_to_go(m_transfers[*it->second.begin()], fake_outputs_count))
+    {
+      not_unlocked_yet.push_back(*it->second.begin());
+    }
     it->second.erase(it->second.begin());
     if (!it->second.size())
       found_free_amounts.erase(it);
 
   }
+  // locked ones stay in the cache, stale ones (spent or reserved since they were cached) are dropped
+  for (uint64_t i : not_unlocked_yet)
+    found_free_amounts[m_transfers[i].amount()].insert(i);
   
   WLT_LOG_GREEN("Found " << print_money_brief(found_money, decimal_point) << " as " << outputs_found << " out(s): " << selected_amounts_str << ", found_free_amounts.size()=" << found_free_amounts.size() <<
     (asset_id == native_coin_asset_id ? std::string() : std::string(", asset_id: ") + crypto::pod_to_hex(asset_id)), LOG_LEVEL_0);
@@ -7205,7 +8430,7 @@ bool wallet2::is_transfer_able_to_go(const transfer_details& td, uint64_t fake_o
 
   VARIANT_SWITCH_BEGIN(out_v);
   VARIANT_CASE_CONST(tx_out_bare, o);
-    if (o.target.type() == typeid(txout_htlc))
+    if (tools::is_variant_type<txout_htlc>(o.target))
     {
       if (fake_outputs_count != 0)
         return false;
@@ -7217,48 +8442,105 @@ bool wallet2::is_transfer_able_to_go(const transfer_details& td, uint64_t fake_o
 //----------------------------------------------------------------------------------------------------
 bool wallet2::prepare_free_transfers_cache(uint64_t fake_outputs_count)
 {
+  // the cache is built once and then kept up to date on receiving, spending and unblocking transfers
+  if (m_found_free_amounts_ready && fake_outputs_count == m_fake_outputs_count)
+    return true;
+
   WLT_LOG_L2("Preparing transfers_cache...");
   uint64_t count = 0;
-  if (!m_found_free_amounts.size() || fake_outputs_count != m_fake_outputs_count)
+  m_found_free_amounts.clear();
+  m_fake_outputs_count = fake_outputs_count;
+  m_found_free_amounts_ready = true;
+  for (size_t i = 0; i < m_transfers.size(); ++i)
   {
-    m_found_free_amounts.clear();
-    for (size_t i = 0; i < m_transfers.size(); ++i)
+    if (is_transfer_able_to_go(m_transfers[i], get_fake_outputs_count_for_transfers_cache(m_transfers[i])))
     {
-      const transfer_details& td = m_transfers[i];
-      uint64_t fake_outputs_count_local = fake_outputs_count;
-      if (td.m_zc_info_ptr)
-      {
-        //zarcanum out, redefine fake_outputs_count
-        fake_outputs_count_local = this->is_auditable() ? 0 : m_core_runtime_config.hf4_minimum_mixins;
-      }
-      if (is_transfer_able_to_go(td, fake_outputs_count_local))
-      {
-        //@#@
-        m_found_free_amounts[td.get_asset_id()][td.amount()].insert(i);
-        count++;
-      }
+      m_found_free_amounts[m_transfers[i].get_asset_id()][m_transfers[i].amount()].insert(i);
+      count++;
     }
-    m_fake_outputs_count = fake_outputs_count;
   }
 
   WLT_LOG_L2("Transfers_cache prepared. " << count << " items cached for " << m_found_free_amounts.size() << " amounts");
   return true;
 }
 //----------------------------------------------------------------------------------------------------
+uint64_t wallet2::get_fake_outputs_count_for_transfers_cache(const transfer_details& td) const
+{
+  if (td.m_zc_info_ptr)
+  {
+    //zarcanum out, redefine fake_outputs_count
+    return this->is_auditable() ? 0 : m_core_runtime_config.hf4_minimum_mixins;
+  }
+  return m_fake_outputs_count;
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::add_transfers_to_transfers_cache(const std::vector<uint64_t>& indexs)
 {
-  //@#@
   for (auto i : indexs)
-    add_transfer_to_transfers_cache(m_transfers[i].amount(), i, m_transfers[i].get_asset_id());
+    add_transfer_to_transfers_cache(i);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::add_transfer_to_transfers_cache(uint64_t amount, uint64_t index, const crypto::public_key& asset_id /* = currency::native_coin_asset_id */)
 {
+  invalidate_balance_counters();
+  if (!m_found_free_amounts_ready)
+    return; // it will be built in full on the next use
   m_found_free_amounts[asset_id][amount].insert(index);
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::add_transfer_to_transfers_cache(uint64_t index)
+{
+  invalidate_balance_counters();
+  if (!m_found_free_amounts_ready || index >= m_transfers.size())
+    return;
+  const transfer_details& td = m_transfers[index];
+  if (is_transfer_able_to_go(td, get_fake_outputs_count_for_transfers_cache(td)))
+    m_found_free_amounts[td.get_asset_id()][td.amount()].insert(index);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::remove_transfer_from_transfers_cache(uint64_t index)
+{
+  invalidate_balance_counters();
+  if (!m_found_free_amounts_ready || index >= m_transfers.size())
+    return;
+  const transfer_details& td = m_transfers[index];
+  auto asset_it = m_found_free_amounts.find(td.get_asset_id());
+  if (asset_it == m_found_free_amounts.end())
+    return;
+  auto amount_it = asset_it->second.find(td.amount());
+  if (amount_it == asset_it->second.end())
+    return;
+  amount_it->second.erase(index);
+  if (amount_it->second.empty())
+    asset_it->second.erase(amount_it);
+  if (asset_it->second.empty())
+    m_found_free_amounts.erase(asset_it);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::invalidate_transfers_cache()
+{
+  invalidate_balance_counters();
+  m_found_free_amounts.clear();
+  m_found_free_amounts_ready = false;
+}
+//----------------------------------------------------------------------------------------------------
 bool wallet2::select_transfers(assets_selection_context& needed_money_map, size_t fake_outputs_count, uint64_t /*dust_threshold*/, std::vector<uint64_t>& selected_indicies)
 {
+  size_t selected_count_before = selected_indicies.size();
+  prepare_free_transfers_cache(fake_outputs_count);
+  try
+  {
+    return select_indices_for_transfer(needed_money_map, fake_outputs_count, selected_indicies);
+  }
+  catch (const error::not_enough_money&)
+  {
+    // the cache is kept up to date incrementally, so before giving up give it one more try with the cache built from scratch
+    WLT_LOG_L1("Not enough money found in transfers cache, rebuilding it and trying again");
+  }
+  selected_indicies.resize(selected_count_before);
+  for (auto& item : needed_money_map)
+    item.second.found_amount = 0;
+  invalidate_transfers_cache();
   prepare_free_transfers_cache(fake_outputs_count);
   return select_indices_for_transfer(needed_money_map, fake_outputs_count, selected_indicies);
 }
@@ -7619,6 +8901,8 @@ bool wallet2::prepare_transaction(construct_tx_param& ctp, currency::finalize_tx
   ftp.flags = ctp.flags;
   ftp.multisig_id = ctp.multisig_id;
   ftp.spend_pub_key = m_account.get_public_address().spend_public_key;
+  if (ftp.tx_version > TRANSACTION_VERSION_PRE_HF4 && !(ftp.flags & TX_FLAG_SIGNATURE_MODE_SEPARATE) && is_in_hardfork_zone(ZANO_HARDFORK_05))
+    ftp.extra.push_back(extra_view_tags()); // filled by construct_tx_out()
 
   /* TODO
   WLT_LOG_GREEN("[prepare_transaction]: get_needed_money_time: " << get_needed_money_time << " ms"
@@ -7994,63 +9278,8 @@ void wallet2::sweep_below(size_t fake_outs_count, const currency::account_public
     for (size_t st_index = 0; st_index < st_index_upper_boundary; ++st_index)
     {
       currency::tx_source_entry& src = ftp.sources[st_index];
-      uint64_t tr_index = selected_transfers[st_index];
-      transfer_details& td = m_transfers[tr_index];
-      src.transfer_index = tr_index;
-      src.amount = td.amount();
+      prepare_sweep_tx_source(selected_transfers[st_index], rpc_get_random_outs_resp.outs.size() ? &rpc_get_random_outs_resp.outs[st_index] : nullptr, fake_outs_count, src);
       amount_swept += src.amount;
-      
-      // populate src.outputs with mix-ins
-      if (rpc_get_random_outs_resp.outs.size())
-      {
-        rpc_get_random_outs_resp.outs[st_index].outs.sort([](const out_entry& a, const out_entry& b) { return a.global_amount_index < b.global_amount_index; });
-        for (out_entry& daemon_oe : rpc_get_random_outs_resp.outs[st_index].outs)
-        {
-          if (td.m_global_output_index == daemon_oe.global_amount_index)
-            continue;
-          src.outputs.emplace_back(daemon_oe.global_amount_index, daemon_oe.stealth_address, daemon_oe.concealing_point, daemon_oe.amount_commitment, daemon_oe.blinded_asset_id);
-          if (src.outputs.size() >= fake_outs_count)
-            break;
-        }
-      }
-
-      // insert real output into src.outputs
-      // TODO: bad design, we need to get rid of code duplicates below -- sowle
-      auto it_to_insert = std::find_if(src.outputs.begin(), src.outputs.end(), [&](const tx_output_entry& a)
-      {
-        if (a.out_reference.type().hash_code() == typeid(uint64_t).hash_code())
-          return static_cast<bool>(boost::get<uint64_t>(a.out_reference) >= td.m_global_output_index);
-        return false; // TODO: implement deterministics real output placement in case there're ref_by_id outs
-      });
-      tx_output_entry real_oe = AUTO_VAL_INIT(real_oe);
-      txout_ref_v out_reference = td.m_global_output_index; // TODO: use ref_by_id when neccessary
-      std::vector<tx_output_entry>::iterator interted_it  = src.outputs.end();
-      VARIANT_SWITCH_BEGIN(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index]);
-      VARIANT_CASE_CONST(tx_out_bare, o)
-      {
-        VARIANT_SWITCH_BEGIN(o.target);
-        VARIANT_CASE_CONST(txout_to_key, o)
-          interted_it = src.outputs.emplace(it_to_insert, out_reference, o.key);
-        VARIANT_CASE_CONST(txout_htlc, htlc)
-          interted_it = src.outputs.emplace(it_to_insert, out_reference, htlc.pkey_refund);
-        VARIANT_CASE_OTHER()
-        {
-          WLT_THROW_IF_FALSE_WITH_CODE(false,
-            "Internal error: unexpected type of target: " << o.target.type().name(),
-            API_RETURN_CODE_INTERNAL_ERROR);
-        }
-        VARIANT_SWITCH_END();
-      }
-      VARIANT_CASE_CONST(tx_out_zarcanum, o);
-        interted_it = src.outputs.emplace(it_to_insert, out_reference, o.stealth_address, o.concealing_point, o.amount_commitment, o.blinded_asset_id);
-        WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(td.is_zc(), "transfer #" << tr_index << ", amount: " << print_money_brief(td.amount()) << " is not a ZC"); 
-        src.real_out_amount_blinding_mask   = td.m_zc_info_ptr->amount_blinding_mask;
-        src.real_out_asset_id_blinding_mask = td.m_zc_info_ptr->asset_id_blinding_mask;
-        src.asset_id                        = td.m_zc_info_ptr->asset_id;
-      VARIANT_SWITCH_END();
-      src.real_out_tx_key = get_tx_pub_key_from_extra(td.m_ptx_wallet_info->m_tx);
-      src.real_output = interted_it - src.outputs.begin();
-      src.real_output_in_tx_index = td.m_internal_output_index;
     }
 
     if (amount_swept <= fee)
@@ -8172,4 +9401,408 @@ void wallet2::sweep_below(size_t fake_outs_count, const currency::account_public
 
 }
 
+//----------------------------------------------------------------------------------------------------
+void wallet2::prepare_sweep_tx_source(uint64_t tr_index, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount* p_decoys, size_t fake_outs_count, currency::tx_source_entry& src) const
+{
+  typedef COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry out_entry;
+  typedef currency::tx_source_entry::output_entry tx_output_entry;
+
+    const transfer_details& td = m_transfers[tr_index];
+  src.transfer_index = tr_index;
+  src.amount = td.amount();
+  
+  // populate src.outputs with mix-ins
+  if (p_decoys != nullptr)
+  {
+    p_decoys->outs.sort([](const out_entry& a, const out_entry& b) { return a.global_amount_index < b.global_amount_index; });
+    for (out_entry& daemon_oe : p_decoys->outs)
+    {
+      if (td.m_global_output_index == daemon_oe.global_amount_index)
+        continue;
+      src.outputs.emplace_back(daemon_oe.global_amount_index, daemon_oe.stealth_address, daemon_oe.concealing_point, daemon_oe.amount_commitment, daemon_oe.blinded_asset_id);
+      if (src.outputs.size() >= fake_outs_count)
+        break;
+    }
+  }
+
+  // insert real output into src.outputs
+  // TODO: bad design, we need to get rid of code duplicates below -- sowle
+  auto it_to_insert = std::find_if(src.outputs.begin(), src.outputs.end(), [&](const tx_output_entry& a)
+  {
+    if (a.out_reference.type().hash_code() == typeid(uint64_t).hash_code())
+      return static_cast<bool>(boost::get<uint64_t>(a.out_reference) >= td.m_global_output_index);
+    return false; // TODO: implement deterministics real output placement in case there're ref_by_id outs
+  });
+  tx_output_entry real_oe = AUTO_VAL_INIT(real_oe);
+  txout_ref_v out_reference = td.m_global_output_index; // TODO: use ref_by_id when neccessary
+  std::vector<tx_output_entry>::iterator interted_it  = src.outputs.end();
+  VARIANT_SWITCH_BEGIN(td.m_ptx_wallet_info->m_tx.vout[td.m_internal_output_index]);
+  VARIANT_CASE_CONST(tx_out_bare, o)
+  {
+    VARIANT_SWITCH_BEGIN(o.target);
+    VARIANT_CASE_CONST(txout_to_key, o)
+      interted_it = src.outputs.emplace(it_to_insert, out_reference, o.key);
+    VARIANT_CASE_CONST(txout_htlc, htlc)
+      interted_it = src.outputs.emplace(it_to_insert, out_reference, htlc.pkey_refund);
+    VARIANT_CASE_OTHER()
+    {
+      WLT_THROW_IF_FALSE_WITH_CODE(false,
+        "Internal error: unexpected type of target: " << o.target.type().name(),
+        API_RETURN_CODE_INTERNAL_ERROR);
+    }
+    VARIANT_SWITCH_END();
+  }
+  VARIANT_CASE_CONST(tx_out_zarcanum, o);
+    interted_it = src.outputs.emplace(it_to_insert, out_reference, o.stealth_address, o.concealing_point, o.amount_commitment, o.blinded_asset_id);
+    WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(td.is_zc(), "transfer #" << tr_index << ", amount: " << print_money_brief(td.amount()) << " is not a ZC"); 
+    src.real_out_amount_blinding_mask   = td.m_zc_info_ptr->amount_blinding_mask;
+    src.real_out_asset_id_blinding_mask = td.m_zc_info_ptr->asset_id_blinding_mask;
+    src.asset_id                        = td.m_zc_info_ptr->asset_id;
+  VARIANT_SWITCH_END();
+  src.real_out_tx_key = get_tx_pub_key_from_extra(td.m_ptx_wallet_info->m_tx);
+  src.real_output = interted_it - src.outputs.begin();
+  src.real_output_in_tx_index = td.m_internal_output_index;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::consolidate_outputs_below(size_t fake_outs_count, const currency::account_public_address& destination_addr, uint64_t threshold_amount, uint64_t fee,
+  size_t max_txs, size_t& outs_swept, uint64_t& amount_swept, std::vector<crypto::hash>& tx_ids)
+{
+  // sweep_below() with many independent txs: decoys for all of them are requested at once, the txs are constructed in parallel and sent one by one
+  // with a pause in between; outputs of a tx are spent only once it's sent, so an interrupted consolidation goes on with the rest when it's called again
+  WLT_THROW_IF_FALSE_WALLET_CMN_ERR_EX(!m_watch_only, "outputs consolidation is not available for watch-only wallets, use sweep_below");
+  static const size_t estimated_bytes_per_input = 85;
+  const size_t estimated_max_inputs = static_cast<size_t>(CURRENCY_MAX_TRANSACTION_BLOB_SIZE / (estimated_bytes_per_input * (fake_outs_count + 1.5)));
+  const size_t inputs_per_tx = std::max<size_t>(1, std::min<size_t>(WALLET_CONSOLIDATION_TX_MAX_INPUTS, estimated_max_inputs / 2)); // leaves room for the mistakes of the estimation, a tx can't be shrinked here
+  outs_swept = 0;
+  amount_swept = 0;
+  tx_ids.clear();
+
+  std::vector<uint64_t> selected_transfers;
+  for (uint64_t i = 0; i < m_transfers.size(); ++i)
+  {
+    const transfer_details& td = m_transfers[i];
+    size_t fake_outs_count_for_td = is_auditable() ? 0 : (td.is_zc() ? m_core_runtime_config.hf4_minimum_mixins : fake_outs_count);
+    if (td.amount() < threshold_amount && td.is_native_coin() && is_transfer_ready_to_go(td, fake_outs_count_for_td))
+      selected_transfers.push_back(i);
+  }
+  WLT_THROW_IF_FALSE_WALLET_CMN_ERR_EX(!selected_transfers.empty(), "No spendable outputs meet the criterion");
+
+  // bigger outputs first, so each tx pays its fee with fewer of them
+  std::sort(selected_transfers.begin(), selected_transfers.end(), [this](uint64_t a, uint64_t b) { return m_transfers[b].amount() < m_transfers[a].amount(); });
+  if (selected_transfers.size() > max_txs * inputs_per_tx)
+    selected_transfers.resize(max_txs * inputs_per_tx);
+
+  prefetch_global_indicies_if_needed(selected_transfers);
+
+  COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response decoys_resp = AUTO_VAL_INIT(decoys_resp);
+  if (fake_outs_count > 0)
+  {
+    COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request req = AUTO_VAL_INIT(req);
+    req.height_upper_limit = m_last_pow_block_h;
+    req.use_forced_mix_outs = false;
+    req.decoys_count = fake_outs_count + 1;
+    for (uint64_t i : selected_transfers)
+      req.amounts.push_back(m_transfers[i].is_zc() ? 0 : m_transfers[i].m_amount);
+
+    bool r = m_core_proxy->call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS(req, decoys_resp);
+    THROW_IF_FALSE_WALLET_EX(r, error::no_connection_to_daemon, "getrandom_outs1.bin");
+    THROW_IF_FALSE_WALLET_EX(decoys_resp.status != API_RETURN_CODE_BUSY, error::daemon_busy, "getrandom_outs1.bin");
+    THROW_IF_FALSE_WALLET_EX(decoys_resp.status == API_RETURN_CODE_OK, error::get_random_outs_error, decoys_resp.status);
+    WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(decoys_resp.outs.size() == selected_transfers.size(),
+      "daemon returned wrong number of amounts for getrandom_outs1.bin: " << decoys_resp.outs.size() << ", requested: " << selected_transfers.size());
+
+    std::vector<COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount> scanty_outs;
+    for (COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& amount_outs : decoys_resp.outs)
+    {
+      if (amount_outs.outs.size() < fake_outs_count)
+        scanty_outs.push_back(amount_outs);
+    }
+    THROW_IF_FALSE_WALLET_EX(scanty_outs.empty(), error::not_enough_outs_to_mix, scanty_outs, fake_outs_count);
+  }
+
+  // everything that depends on the wallet state is prepared here, so the jobs only construct txs
+  std::vector<currency::finalize_tx_param> ftps;
+  for (size_t offset = 0; offset < selected_transfers.size(); offset += inputs_per_tx)
+  {
+    currency::finalize_tx_param ftp = AUTO_VAL_INIT(ftp);
+    ftp.tx_version = get_current_tx_version();
+    ftp.crypt_address = destination_addr;
+    currency::create_and_add_tx_payer_to_container_from_address(ftp.extra, m_account.get_public_address(), get_top_block_height(), m_core_runtime_config);
+    if (ftp.tx_version > TRANSACTION_VERSION_PRE_HF4 && is_in_hardfork_zone(ZANO_HARDFORK_05))
+      ftp.extra.push_back(extra_view_tags()); // filled by construct_tx_out()
+    ftp.flags = 0;
+    ftp.shuffle = false;
+    ftp.spend_pub_key = m_account.get_public_address().spend_public_key;
+    ftp.tx_outs_attr = CURRENCY_TO_KEY_OUT_RELAXED;
+    ftp.unlock_time = 0;
+
+    uint64_t amount = 0;
+    for (size_t i = offset; i != std::min(selected_transfers.size(), offset + inputs_per_tx); ++i)
+    {
+      ftp.sources.emplace_back();
+      prepare_sweep_tx_source(selected_transfers[i], decoys_resp.outs.size() ? &decoys_resp.outs[i] : nullptr, fake_outs_count, ftp.sources.back());
+      ftp.selected_transfers.push_back(selected_transfers[i]);
+      amount += ftp.sources.back().amount;
+    }
+    if (amount <= fee)
+      break; // the rest are even smaller
+
+    assets_selection_context needed_money_map;
+    needed_money_map[currency::native_coin_asset_id] = {};
+    const std::vector<currency::tx_destination_entry> dsts({ tx_destination_entry(amount - fee, destination_addr) });
+    prepare_tx_destinations(needed_money_map, get_current_split_strategy(), tools::tx_dust_policy(), dsts, ftp.flags, ftp.prepared_destinations);
+    ftps.push_back(std::move(ftp));
+  }
+  WLT_THROW_IF_FALSE_WALLET_CMN_ERR_EX(!ftps.empty(), inputs_per_tx << " biggest unspent outputs have total amount less than required fee: " << print_money_brief(fee) << ", transaction cannot be constructed");
+
+  TIME_MEASURE_START_MS(construct_time);
+  std::vector<currency::finalized_tx> results(ftps.size());
+  std::vector<char> constructed(ftps.size(), 0);
+  const account_keys& keys = m_account.get_keys();
+  utils::threads_pool::jobs_container jobs;
+  for (size_t i = 0; i != ftps.size(); ++i)
+  {
+    utils::threads_pool::add_job_to_container(jobs, [&keys, &ftps, &results, &constructed, i]()
+    {
+      try
+      {
+        constructed[i] = currency::construct_tx(keys, ftps[i], results[i]) && tx_to_blob(results[i].tx).size() < CURRENCY_MAX_TRANSACTION_BLOB_SIZE;
+      }
+      catch (...)
+      {
+        constructed[i] = 0;
+      }
+    });
+  }
+  get_threads_pool().add_batch_and_wait(jobs);
+  TIME_MEASURE_FINISH_MS(construct_time);
+  WLT_LOG_L0("consolidate_outputs_below: " << ftps.size() << " txs of up to " << inputs_per_tx << " inputs constructed in " << construct_time << " ms");
+
+  for (size_t i = 0; i != ftps.size(); ++i)
+  {
+    if (m_stop)
+    {
+      WLT_LOG_L0("consolidate_outputs_below: interrupted, " << tx_ids.size() << " of " << ftps.size() << " txs sent");
+      break;
+    }
+    if (!constructed[i])
+    {
+      WLT_LOG_ERROR("consolidate_outputs_below: tx #" << i << " with " << ftps[i].sources.size() << " inputs can't be constructed, skipped");
+      continue;
+    }
+    if (!tx_ids.empty())
+      epee::misc_utils::sleep_no_w(WALLET_CONSOLIDATION_TXS_SEND_PAUSE_MS);
+
+    mark_transfers_as_spent(ftps[i].selected_transfers, "consolidate_outputs_below");
+    try
+    {
+      m_tx_keys.insert(std::make_pair(get_transaction_hash(results[i].tx), results[i].one_time_key));
+      send_transaction_to_network(results[i].tx);
+      add_sent_tx_detailed_info(results[i].tx, ftps[i].attachments, ftps[i].prepared_destinations, ftps[i].selected_transfers);
+    }
+    catch (...)
+    {
+      clear_transfers_from_flag(ftps[i].selected_transfers, WALLET_TRANSFER_DETAIL_FLAG_SPENT, std::string("exception on consolidate_outputs_below, tx id: ") + epee::string_tools::pod_to_hex(get_transaction_hash(results[i].tx)));
+      throw;
+    }
+    tx_ids.push_back(get_transaction_hash(results[i].tx));
+    outs_swept += ftps[i].sources.size();
+    for (const auto& src : ftps[i].sources)
+      amount_swept += src.amount;
+    WLT_LOG_L0("consolidate_outputs_below: tx " << i + 1 << "/" << ftps.size() << " " << tx_ids.back() << " sent, " << ftps[i].sources.size() << " inputs");
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::transfer_batch(const std::vector<batch_transfer_destination>& dsts, uint64_t fee, size_t fake_outs_count, bool push_payer, std::vector<batch_transfer_result>& results)
+{
+  // the destinations are packed into as few txs as the range proof allows (it covers all the outputs of a tx, the change ones included);
+  // inputs are selected for one tx after another and reserved right away, so the txs never share them, decoys for all of them are requested at once,
+  // the txs are constructed in parallel and sent one by one; a destination whose tx can't be made or sent gets the error, the others are paid anyway
+  WLT_THROW_IF_FALSE_WALLET_CMN_ERR_EX(!m_watch_only, "batch transfers are not available for watch-only wallets");
+  WLT_THROW_IF_FALSE_WALLET_CMN_ERR_EX(get_current_tx_version() > TRANSACTION_VERSION_PRE_HF4, "batch transfers are available only after the Zarcanum hardfork");
+  const size_t max_outs_per_tx = crypto::bpp_crypto_trait_ZC_out::c_bpp_values_max;
+  results.assign(dsts.size(), batch_transfer_result());
+
+  struct batch_tx
+  {
+    std::string payment_id;
+    std::vector<size_t> dst_indices;
+    std::vector<currency::tx_destination_entry> dsts;
+    std::unordered_set<crypto::public_key> assets{ currency::native_coin_asset_id }; // each of them may take a change output
+    assets_selection_context needed_money_map;
+    currency::finalize_tx_param ftp{};
+    currency::finalized_tx result{};
+    bool reserved = false;
+    bool constructed = false;
+  };
+  std::vector<batch_tx> txs;
+  std::map<std::string, size_t> filled_tx_by_payment_id; // a payment id goes to the attachments, so it can't be shared by destinations with different ones
+  for (size_t i = 0; i != dsts.size(); ++i)
+  {
+    const currency::tx_destination_entry& de = dsts[i].dst;
+    if (de.amount == 0 || de.addr.size() != 1 || de.asset_id == currency::null_pkey)
+    {
+      results[i].error = "invalid destination: zero amount, wrong address or asset id";
+      continue;
+    }
+    auto it = filled_tx_by_payment_id.find(dsts[i].payment_id);
+    if (it != filled_tx_by_payment_id.end())
+    {
+      const batch_tx& btx = txs[it->second];
+      if (btx.dsts.size() + 1 + btx.assets.size() + (btx.assets.count(de.asset_id) ? 0 : 1) > max_outs_per_tx)
+        it = filled_tx_by_payment_id.end();
+    }
+    if (it == filled_tx_by_payment_id.end())
+    {
+      txs.emplace_back();
+      txs.back().payment_id = dsts[i].payment_id;
+      if (!dsts[i].payment_id.empty() && !currency::set_payment_id_to_tx(txs.back().ftp.attachments, dsts[i].payment_id, true))
+      {
+        txs.pop_back();
+        results[i].error = "payment id is invalid and can't be set";
+        continue;
+      }
+      it = filled_tx_by_payment_id.insert_or_assign(dsts[i].payment_id, txs.size() - 1).first;
+    }
+    batch_tx& btx = txs[it->second];
+    btx.dst_indices.push_back(i);
+    btx.dsts.push_back(de);
+    btx.assets.insert(de.asset_id);
+  }
+
+  auto fail_tx = [&results](const batch_tx& btx, const std::string& error)
+  {
+    for (size_t i : btx.dst_indices)
+      results[i].error = error;
+  };
+  auto release_tx = [this](batch_tx& btx, const std::string& reason)
+  {
+    if (btx.reserved)
+      clear_transfers_from_flag(btx.ftp.selected_transfers, WALLET_TRANSFER_DETAIL_FLAG_SPENT, reason);
+    btx.reserved = false;
+  };
+
+  try
+  {
+    std::vector<uint64_t> selected_transfers;
+    for (batch_tx& btx : txs)
+    {
+      try
+      {
+        btx.needed_money_map = get_needed_money(fee, btx.dsts);
+        select_transfers(btx.needed_money_map, fake_outs_count, 0, btx.ftp.selected_transfers);
+      }
+      catch (const error::wallet_error& e)
+      {
+        // the outputs taken out of the cache by a failed selection aren't reserved, get them back
+        invalidate_transfers_cache();
+        btx.ftp.selected_transfers.clear();
+        fail_tx(btx, e.what());
+        continue;
+      }
+      mark_transfers_as_spent(btx.ftp.selected_transfers, "transfer_batch");
+      btx.reserved = true;
+      selected_transfers.insert(selected_transfers.end(), btx.ftp.selected_transfers.begin(), btx.ftp.selected_transfers.end());
+    }
+
+    std::vector<currency::tx_source_entry> sources;
+    if (!selected_transfers.empty())
+      prepare_tx_sources(fake_outs_count, sources, selected_transfers); // one getrandom_outs3.bin for all the txs
+    WLT_THROW_IF_FALSE_WALLET_INT_ERR_EX(sources.size() == selected_transfers.size(), "sources.size() = " << sources.size() << ", expected: " << selected_transfers.size());
+
+    auto source_it = sources.begin();
+    const construct_tx_param ctp = get_default_construct_tx_param();
+    for (batch_tx& btx : txs)
+    {
+      if (!btx.reserved)
+        continue;
+      currency::finalize_tx_param& ftp = btx.ftp;
+      ftp.sources.assign(source_it, source_it + ftp.selected_transfers.size());
+      source_it += ftp.selected_transfers.size();
+      ftp.tx_version = get_current_tx_version();
+      ftp.crypt_address = currency::get_crypt_address_from_destinations(m_account.get_keys(), btx.dsts);
+      if (push_payer)
+        currency::create_and_add_tx_payer_to_container_from_address(ftp.extra, m_account.get_public_address(), get_top_block_height(), m_core_runtime_config);
+      if (is_in_hardfork_zone(ZANO_HARDFORK_05))
+        ftp.extra.push_back(extra_view_tags()); // filled by construct_tx_out()
+      ftp.flags = ctp.flags;
+      ftp.shuffle = ctp.shuffle;
+      ftp.spend_pub_key = m_account.get_public_address().spend_public_key;
+      ftp.tx_outs_attr = ctp.tx_outs_attr;
+      ftp.unlock_time = 0;
+      prepare_tx_destinations(btx.needed_money_map, static_cast<detail::split_strategy_id_t>(ctp.split_strategy_id), ctp.dust_policy, btx.dsts, ftp.flags, ftp.prepared_destinations);
+    }
+
+    TIME_MEASURE_START_MS(construct_time);
+    const account_keys& keys = m_account.get_keys();
+    utils::threads_pool::jobs_container jobs;
+    for (batch_tx& btx : txs)
+    {
+      if (!btx.reserved)
+        continue;
+      utils::threads_pool::add_job_to_container(jobs, [&keys, &btx]()
+      {
+        try
+        {
+          btx.constructed = currency::construct_tx(keys, btx.ftp, btx.result) && tx_to_blob(btx.result.tx).size() < CURRENCY_MAX_TRANSACTION_BLOB_SIZE;
+        }
+        catch (...)
+        {
+          btx.constructed = false;
+        }
+      });
+    }
+    get_threads_pool().add_batch_and_wait(jobs);
+    TIME_MEASURE_FINISH_MS(construct_time);
+    WLT_LOG_L0("transfer_batch: " << jobs.size() << " txs for " << dsts.size() << " destinations constructed in " << construct_time << " ms");
+
+    size_t txs_sent = 0;
+    for (batch_tx& btx : txs)
+    {
+      if (!btx.reserved)
+        continue;
+      if (m_stop)
+      {
+        release_tx(btx, "transfer_batch interrupted");
+        fail_tx(btx, "interrupted");
+        continue;
+      }
+      if (!btx.constructed)
+      {
+        release_tx(btx, "transfer_batch: tx can't be constructed");
+        fail_tx(btx, "tx with " + std::to_string(btx.ftp.sources.size()) + " inputs can't be constructed");
+        continue;
+      }
+      if (txs_sent != 0)
+        epee::misc_utils::sleep_no_w(WALLET_BATCH_TRANSFER_TXS_SEND_PAUSE_MS);
+
+      const crypto::hash tx_id = get_transaction_hash(btx.result.tx);
+      try
+      {
+        m_tx_keys.insert(std::make_pair(tx_id, btx.result.one_time_key));
+        send_transaction_to_network(btx.result.tx);
+        add_sent_tx_detailed_info(btx.result.tx, btx.ftp.attachments, btx.ftp.prepared_destinations, btx.ftp.selected_transfers);
+      }
+      catch (const std::exception& e)
+      {
+        release_tx(btx, std::string("exception on transfer_batch, tx id: ") + epee::string_tools::pod_to_hex(tx_id));
+        fail_tx(btx, e.what());
+        continue;
+      }
+      btx.reserved = false; // spent for good
+      for (size_t i : btx.dst_indices)
+        results[i].tx_id = tx_id;
+      ++txs_sent;
+      WLT_LOG_L0("transfer_batch: tx " << tx_id << " sent, " << btx.dsts.size() << " destinations, " << btx.ftp.sources.size() << " inputs");
+    }
+  }
+  catch (...)
+  {
+    for (batch_tx& btx : txs)
+      release_tx(btx, "exception on transfer_batch");
+    invalidate_transfers_cache();
+    throw;
+  }
+}
+
 } // namespace tools
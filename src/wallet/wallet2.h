@@ -47,6 +47,7 @@
 #include "view_iface.h"
 #include "wallet2_base.h"
 #include "decoy_selection.h"
+#include "history_txs_storage.h"
 
 #define WALLET_DEFAULT_TX_SPENDABLE_AGE                               CURRENCY_HF4_MANDATORY_MIN_COINAGE
 #define WALLET_POS_MINT_CHECK_HEIGHT_INTERVAL                         1
@@ -82,6 +83,8 @@ class test_generator;
 
 namespace tools
 {
+  class tor_relay_pool;
+
 #pragma pack(push, 1)
   struct wallet_file_binary_header
   {
@@ -91,6 +94,13 @@ namespace tools
     uint32_t m_ver;
     uint32_t m_reserved; //for future use
   };
+
+  // header of the store journal file, followed by records: uint64_t plain size, crypto::chacha8_iv, encrypted body
+  struct wallet_store_journal_header
+  {
+    uint64_t m_signature;
+    crypto::chacha8_iv m_snapshot_iv; // keys iv of the wallet file the journal belongs to
+  };
 #pragma pack (pop)
 
 
@@ -104,6 +114,13 @@ namespace tools
 
     virtual void on_new_block(uint64_t /*height*/, const currency::block& /*block*/) {}
     virtual void on_transfer2(const wallet_public::wallet_transfer_info& wti, const std::list<wallet_public::asset_balance_entry>& balances, uint64_t total_mined) {}
+    // transfers of a pulled range of blocks with the balances after all of them, called instead of on_transfer2() by a wallet
+    // with set_batch_transfer_callbacks(true)
+    virtual void on_transfers_batch(const std::vector<wallet_public::wallet_transfer_info>& wtis, const std::list<wallet_public::asset_balance_entry>& balances, uint64_t total_mined)
+    {
+      for (const auto& wti : wtis)
+        on_transfer2(wti, balances, total_mined);
+    }
     virtual void on_pos_block_found(const currency::block& /*block*/) {}
     virtual void on_sync_progress(const uint64_t& /*percents*/) {}
     virtual void on_transfer_canceled(const wallet_public::wallet_transfer_info& wti) {}
@@ -131,7 +148,7 @@ namespace tools
     transfer_container m_transfers;
     multisig_transfer_container m_multisig_transfers;
     payment_container m_payments;
-    std::unordered_map<crypto::key_image, size_t> m_key_images;
+    tools::flat_hash_map<crypto::key_image, size_t> m_key_images; // key image -> index in m_transfers, stored as std::unordered_map
     std::vector<wallet_public::wallet_transfer_info> m_transfer_history;
     std::unordered_map<crypto::hash, currency::transaction> m_unconfirmed_in_transfers;
     std::unordered_map<crypto::hash, tools::wallet_public::wallet_transfer_info> m_unconfirmed_txs;
@@ -148,7 +165,21 @@ namespace tools
     std::unordered_map<crypto::public_key, crypto::key_image> m_pending_key_images; // (out_pk -> ki) pairs of change outputs to be added in watch-only wallet without spend sec key
     uint64_t m_last_pow_block_h = 0;
     std::list<std::pair<uint64_t, wallet_event_t>> m_rollback_events;
+
+    // pool txs as of the last scan_tx_pool() with their outputs lookup results, so each pool tx is scanned once;
+    // updated by the changes since m_pool_scan_version of the daemon's pool instance, not stored
+    struct pool_tx_scan_entry
+    {
+      currency::transaction tx;
+      std::vector<currency::wallet_out_info> outs;
+      crypto::key_derivation derivation;
+      bool has_related_alias;
+    };
+    std::unordered_map<crypto::hash, pool_tx_scan_entry> m_pool_scan_cache;
+    uint64_t m_pool_scan_instance_id = 0;
+    uint64_t m_pool_scan_version = 0;
     std::list<std::pair<uint64_t, uint64_t> > m_last_zc_global_indexs; // <height, last_zc_global_indexs>, biggest height comes in front
+    std::vector<std::string> m_deposit_addresses; // labels of the deposit addresses, the i-th one has deposit index i + 1, see create_deposit_address()
 
     //variables that not being serialized
     std::atomic<uint64_t> m_last_bc_timestamp = 0;
@@ -158,8 +189,46 @@ namespace tools
     bool m_use_assets_whitelisting = true;
     mutable std::optional<bool> m_has_bare_unspent_outputs; // recalculated each time the balance() is called
 
+    // what balance() sums up over m_transfers, kept between the calls and rebuilt in full after m_transfers is changed (see invalidate_balance_counters());
+    // transfers locked by height are queued by the blockchain size they get unlocked at, so a new block only moves some of them to unlocked
+    struct balance_counters
+    {
+      bool ready = false;
+      uint64_t blockchain_size = 0;                  // the queue is processed up to it
+      uint64_t transfers_count = 0;
+      std::unordered_map<crypto::public_key, wallet_public::asset_balance_entry_base> balances; // total and unlocked only
+      uint64_t mined = 0;
+      bool has_bare_unspent_outputs = false;
+      std::multimap<uint64_t, uint64_t> locked_by_height; // blockchain size -> transfer index
+      std::vector<uint64_t> locked_by_time;          // rare, checked on each call as the unlocking depends on the core time
+    };
+    mutable balance_counters m_balance_counters;
+
+    // m_money_expirations entries and the contracts' cancel templates ordered by their expiration time, so a new block only looks at the ones that expire;
+    // rebuilt in full when needed after a reset or detach (see invalidate_expiration_triggers()), the contracts' entries are rechecked when they fire
+    struct expiration_triggers
+    {
+      bool ready = false;
+      std::multimap<uint64_t, std::list<expiration_entry_info>::iterator> money_expirations; // expiration_time -> entry
+      std::multimap<uint64_t, crypto::hash> contract_expirations;                               // cancel template's expiration time -> contract id
+    };
+    expiration_triggers m_expiration_triggers;
+    currency::deposit_spend_keys_map m_deposit_spend_keys; // spend public keys of m_deposit_addresses, rebuilt on load
+
     // variables that should be part of state data object but should not be stored during serialization
     mutable std::atomic<bool> m_whitelist_updated = false;
+
+    // what the wallet file and its store journal hold as of the last store, see wallet2::store_to_journal();
+    // being part of the state, it's invalidated by any reset, so the next store is a full one
+    struct store_journal_state
+    {
+      bool ready = false;                           // the journal belongs to the wallet file and it may be appended
+      crypto::chacha8_iv snapshot_iv = AUTO_VAL_INIT(snapshot_iv);
+      std::vector<uint64_t> transfers_fingerprints; // of m_transfers
+      uint64_t transfers_intact = 0;                // m_transfers below this index haven't been removed since then
+      uint64_t history_intact = 0;                  // the same for m_transfer_history
+    };
+    store_journal_state m_store_journal;
     //===============================================================
     template <class t_archive>
     inline void serialize(t_archive &a, const unsigned int ver)
@@ -235,6 +304,9 @@ namespace tools
         //workaround for m_last_zc_global_indexs holding invalid index for last item
         m_last_zc_global_indexs.pop_front();
       }      
+      if (ver < 168)
+        return;
+      a & m_deposit_addresses;
     }
   };
   
@@ -266,6 +338,8 @@ namespace tools
       uint64_t      iterations_processed = 0;
       uint64_t      total_items_checked = 0;
       uint64_t      total_amount_checked = 0;
+
+      currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount stake_decoys; // prefetched for a Zarcanum stake, so a found kernel doesn't wait for the daemon
     };
 
 
@@ -323,6 +397,7 @@ namespace tools
     struct process_transaction_context
     {
       process_transaction_context(const currency::transaction& t) : tx(t) {}
+      process_transaction_context(const currency::transaction& t, const crypto::hash& t_hash) : tx(t), tx_hash_(t_hash) {}
       const currency::transaction& tx;
       bool spent_own_native_inputs = false; 
       // check all outputs for spending (compare key images)
@@ -395,6 +470,8 @@ namespace tools
     void callback(std::shared_ptr<i_wallet2_callback> callback) { m_wcallback = callback; m_do_rise_transfer = (callback != nullptr); }
     i_wallet2_callback* get_callback() { return m_wcallback.get(); }
     void set_do_rise_transfer(bool do_rise) { m_do_rise_transfer = do_rise; }
+    // transfers found while blocks are synced are reported with on_transfers_batch() once per pulled range, the balance is computed once for them
+    void set_batch_transfer_callbacks(bool batch) { m_batch_transfer_callbacks = batch; }
 
     bool has_related_alias_entry_unconfirmed(const currency::transaction& tx);
     bool has_bare_unspent_outputs() const;
@@ -404,14 +481,39 @@ namespace tools
     bool sweep_bare_unspent_outputs(const currency::account_public_address& target_address, const std::vector<batch_of_bare_unspent_outs>& tids_grouped_by_txs,
       size_t& total_txs_sent, uint64_t& total_amount_sent, uint64_t& total_fee, uint64_t& total_bare_outs_sent);
     void handle_unconfirmed_tx(process_transaction_context& ptc);
+    void handle_unconfirmed_tx(process_transaction_context& ptc, const std::vector<currency::wallet_out_info>& outs, const crypto::key_derivation& derivation);
     void scan_tx_pool(bool& has_related_alias_in_unconfirmed);
     void refresh();
     void refresh(size_t & blocks_fetched);
     void refresh(size_t & blocks_fetched, bool& received_money, std::atomic<bool>& stop);
     bool refresh(size_t & blocks_fetched, bool& received_money, bool& ok, std::atomic<bool>& stop);
     void refresh(std::atomic<bool>& stop);
+    // refresh of a wallet shared with other threads (see wallet_rpc_server): the request is made and the pulled blocks are applied
+    // with the wallet's lock, the daemon is asked without it; blocks are applied a part at a time, so the lock is never taken for a whole batch
+    void make_pull_blocks_request(currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& req);
+    bool apply_pulled_blocks_part(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request& req, const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& res,
+      size_t& offset, size_t max_blocks, size_t& blocks_added, std::atomic<bool>& stop);
+    void finish_refresh(size_t blocks_fetched);
+
+    // pulled blocks scanning totals since the wallet object was created or reset_scan_stats() was called, times are in microseconds
+    struct scan_stats
+    {
+      uint64_t blocks = 0;
+      uint64_t txs = 0;
+      uint64_t outputs = 0;
+      uint64_t own_outputs = 0;
+      uint64_t derivation_us = 0;            // key derivations of the parallel lookup, summed over its threads
+      uint64_t ownership_us = 0;             // outputs ownership checks and amounts decoding of the parallel lookup, summed over its threads
+      uint64_t parallel_lookup_wall_us = 0;
+      uint64_t inline_lookup_us = 0;         // derivations and ownership checks done by process_new_transaction() itself (small batches, one core)
+      uint64_t state_update_us = 0;          // process_new_blockchain_entry() without the inline lookups
+    };
+    const scan_stats& get_scan_stats() const { return m_scan_stats; }
+    void reset_scan_stats() { m_scan_stats = scan_stats(); }
     
     void resend_unconfirmed();
+    // keeps a few decoy sets for ZC inputs prefetched, so a transfer doesn't wait for getrandom_outs3 (call it between transfers, e.g. after refresh)
+    bool refill_zc_decoys_pool();
     void push_offer(const bc_services::offer_details_ex& od, currency::transaction& res_tx);
     void cancel_offer_by_id(const crypto::hash& tx_id, uint64_t of_ind, uint64_t fee, currency::transaction& tx);
     void update_offer_by_id(const crypto::hash& tx_id, uint64_t of_ind, const bc_services::offer_details_ex& od, currency::transaction& res_tx);
@@ -563,6 +665,14 @@ namespace tools
     // PoS mining
     void do_pos_mining_prepare_entry(mining_context& cxt, size_t transfer_index);
     bool do_pos_mining_iteration(mining_context& cxt, size_t transfer_index, uint64_t ts);
+    struct pos_scan_entry
+    {
+      size_t transfer_index;
+      uint64_t stake_unlock_time;
+    };
+    static void get_pos_scan_timestamps(uint64_t ts_from, uint64_t ts_to, std::vector<uint64_t>& timestamps);
+    static size_t get_pos_scan_part_size(size_t entries_count);
+    bool scan_pos_part(mining_context& cxt, const std::vector<pos_scan_entry>& entries, size_t offset, size_t count, const std::vector<uint64_t>& timestamps, std::atomic<bool>& stop);
     template<typename idle_condition_cb_t> //do refresh as external callback
     bool scan_pos(mining_context& cxt, std::atomic<bool>& stop, idle_condition_cb_t idle_condition_cb, const currency::core_runtime_config &runtime_config);
     bool fill_mining_context(mining_context& ctx);
@@ -575,6 +685,12 @@ namespace tools
     // Returns all payments by given id in unspecified order
     void get_payments(const std::string& payment_id, std::list<payment_details>& payments, uint64_t min_height = 0) const;
 
+    // deposit addresses: receiving addresses sharing the wallet's view key, so they all are found by one scan; the index 0 stands for the wallet's own address
+    // they are derived from the keys, so the same index gives the same address for a restored wallet (create them again before resync)
+    uint32_t create_deposit_address(const std::string& label);
+    currency::account_public_address get_deposit_address(uint32_t deposit_index) const;
+    const std::vector<std::string>& get_deposit_addresses_labels() const { return m_deposit_addresses; } // [deposit index - 1]
+
     // callback: (const wallet_public::wallet_transfer_info& wti) -> bool, true -- continue, false -- stop
     template<typename callback_t>
     void enumerate_transfers_history(callback_t cb, bool enumerate_forward) const;
@@ -592,6 +708,11 @@ namespace tools
 
     void sweep_below(size_t fake_outs_count, const currency::account_public_address& destination_addr, uint64_t threshold_amount, const currency::payment_id_t& payment_id,
       uint64_t fee, size_t& outs_total, uint64_t& amount_total, size_t& outs_swept, uint64_t& amount_swept, currency::transaction* p_result_tx = nullptr, std::string* p_filename_or_unsigned_tx_blob_str = nullptr);
+    // sweeps outputs below threshold_amount with up to max_txs independent txs, see the implementation
+    void consolidate_outputs_below(size_t fake_outs_count, const currency::account_public_address& destination_addr, uint64_t threshold_amount, uint64_t fee,
+      size_t max_txs, size_t& outs_swept, uint64_t& amount_swept, std::vector<crypto::hash>& tx_ids);
+    // pays many destinations with as few txs as possible, see the implementation; results has an entry per destination
+    void transfer_batch(const std::vector<batch_transfer_destination>& dsts, uint64_t fee, size_t fake_outs_count, bool push_payer, std::vector<batch_transfer_result>& results);
 
     bool get_transfer_address(const std::string& adr_str, currency::account_public_address& addr, std::string& payment_id);
     inline uint64_t get_blockchain_current_size() const {
@@ -605,6 +726,20 @@ namespace tools
     inline void serialize(t_archive &a, const unsigned int ver)
     {
       wallet2_base_state::serialize(a, ver);
+      if (ver < 169 || ver > WALLET_FILE_SERIALIZATION_VERSION)
+        return;
+      // offloaded history txs are kept in m_history_txs_file when the wallet file is stored with their storage
+      if (t_archive::is_saving::value)
+      {
+        history_txs_storage::state history_txs_state = AUTO_VAL_INIT(history_txs_state);
+        if (m_store_history_txs_separately)
+          m_history_txs.get_state(history_txs_state);
+        a & history_txs_state;
+      }
+      else
+      {
+        a & m_loaded_history_txs_state;
+      }
     }
 
     bool is_transfer_ready_to_go(const transfer_details& td, uint64_t fake_outputs_count) const;
@@ -683,11 +818,15 @@ namespace tools
     uint64_t get_wallet_file_size()const;
     void set_use_deffered_global_outputs(bool use);
     void set_use_assets_whitelisting(bool use);
+    void set_use_store_journal(bool use);
+    void set_offload_history_txs(bool offload);
     construct_tx_param get_default_construct_tx_param_inital();
     void set_disable_tor_relay(bool disable);
     uint64_t get_default_fee() {return TX_DEFAULT_FEE;}
     uint64_t get_current_minimum_network_fee() { return TX_DEFAULT_FEE; }
     void export_transaction_history(std::ostream& ss, const std::string& format, bool include_pos_transactions = true);
+    // exports up to max_entries history entries starting from cursor (0 for the beginning), moves cursor past them; returns true when the whole history is exported
+    bool export_transaction_history_part(std::ostream& ss, const std::string& format, bool include_pos_transactions, uint64_t& cursor, uint64_t max_entries);
 
     bool add_custom_asset_id(const crypto::public_key& asset_id, currency::asset_descriptor_base& asset_descriptor);
     bool delete_custom_asset_id(const crypto::public_key& asset_id);
@@ -756,7 +895,7 @@ private:
     void remove_transfer_from_expiration_list(uint64_t transfer_index);
     void load_keys(const std::string& keys_file_name, const std::string& password, uint64_t file_signature, keys_file_data& kf_data);
     void process_ado_in_new_transaction(const currency::asset_descriptor_operation& ado, process_transaction_context& ptc);
-    void process_new_transaction(const currency::transaction& tx, uint64_t height, const currency::block& b, const std::vector<uint64_t>* pglobal_indexes);
+    void process_new_transaction(const currency::transaction& tx, uint64_t height, const currency::block& b, const std::vector<uint64_t>* pglobal_indexes, const crypto::hash* ptx_id = nullptr);
     void fetch_tx_global_indixes(const currency::transaction& tx, std::vector<uint64_t>& goutputs_indexes);
     void fetch_tx_global_indixes(const std::list<std::reference_wrapper<const currency::transaction>>& txs, std::vector<std::vector<uint64_t>>& goutputs_indexes);
     void detach_blockchain(uint64_t including_height);
@@ -772,6 +911,12 @@ private:
     bool select_transfers(assets_selection_context& needed_money_map, size_t fake_outputs_count, uint64_t dust, std::vector<uint64_t>& selected_indicies);
     void add_transfers_to_transfers_cache(const std::vector<uint64_t>& indexs);
     void add_transfer_to_transfers_cache(uint64_t amount, uint64_t index, const crypto::public_key& asset_id = currency::native_coin_asset_id);
+    void add_transfer_to_transfers_cache(uint64_t index);
+    void remove_transfer_from_transfers_cache(uint64_t index);
+    void invalidate_transfers_cache();
+    void invalidate_balance_counters();
+    void prepare_balance_counters() const;
+    uint64_t get_fake_outputs_count_for_transfers_cache(const transfer_details& td) const;
     bool prepare_file_names(const std::wstring& file_path);
     void process_unconfirmed(const currency::transaction& tx, std::vector<std::string>& recipients, std::vector<std::string>& recipients_aliases);
     void add_sent_unconfirmed_tx(const currency::transaction& tx,
@@ -789,13 +934,17 @@ private:
     uint64_t get_actual_zc_global_index();
     void handle_pulled_blocks(size_t& blocks_added, std::atomic<bool>& stop,
       currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& blocks);
+    void lookup_outs_for_pulled_blocks(const currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& blocks);
+    void fetch_related_pruned_txs(currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response& blocks);
+    bool is_pulled_tx_related(const currency::transaction& tx, const crypto::hash& tx_id, const std::unordered_set<crypto::key_image>& batch_key_images);
     std::string get_alias_for_address(const std::string& addr);
     std::vector<std::string> get_aliases_for_address(const std::string& addr);
     bool is_connected_to_net();
     bool is_transfer_okay_for_pos(const transfer_details& tr, bool is_zarcanum_hf, uint64_t& stake_unlock_time) const;
     bool scan_not_compliant_unconfirmed_txs();
-    const currency::transaction& get_transaction_by_id(const crypto::hash& tx_hash);
+    currency::transaction get_transaction_by_id(const crypto::hash& tx_hash);
     void rise_on_transfer2(const wallet_public::wallet_transfer_info& wti);
+    void flush_transfer_callbacks();
     void process_genesis_if_needed(const currency::block& genesis, const std::vector<uint64_t>* pglobal_indexes);
     bool build_escrow_proposal(bc_services::contract_private_details& ecrow_details, uint64_t fee, uint64_t unlock_time, currency::tx_service_attachment& att, std::vector<uint64_t>& selected_indicies);
     bool prepare_tx_sources(assets_selection_context& needed_money_map, size_t fake_outputs_count, uint64_t dust_threshold, std::vector<currency::tx_source_entry>& sources, std::vector<uint64_t>& selected_indicies);
@@ -805,6 +954,7 @@ private:
     bool prepare_tx_sources_htlc(crypto::hash htlc_tx_id, const std::string& origin, std::vector<currency::tx_source_entry>& sources, uint64_t& found_money);
     bool prepare_tx_sources_for_defragmentation_tx(std::vector<currency::tx_source_entry>& sources, std::vector<uint64_t>& selected_indicies, uint64_t& found_money);
     void prefetch_global_indicies_if_needed(const std::vector<uint64_t>& selected_indicies);
+    void prepare_sweep_tx_source(uint64_t tr_index, currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount* p_decoys, size_t fake_outs_count, currency::tx_source_entry& src) const;
     assets_selection_context get_needed_money(uint64_t fee, const std::vector<currency::tx_destination_entry>& dsts);
     void prepare_tx_destinations(const assets_selection_context& needed_money_map,
       detail::split_strategy_id_t destination_split_strategy_id,
@@ -824,6 +974,9 @@ private:
     bool handle_cancel_proposal(wallet_public::wallet_transfer_info& wti, const bc_services::escrow_cancel_templates_body& ectb, const std::vector<currency::payload_items_v>& decrypted_attach);
     bool handle_expiration_list(uint64_t tx_expiration_ts_median);
     void handle_contract_expirations(uint64_t tx_expiration_ts_median);
+    void invalidate_expiration_triggers();
+    void prepare_expiration_triggers();
+    void add_contract_expiration_trigger(const crypto::hash& contract_id, const wallet_public::escrow_contract_details_basic& contract);
     uint64_t get_current_tx_version();
     void change_contract_state(wallet_public::escrow_contract_details_basic& contract, uint32_t new_state, const crypto::hash& contract_id, const wallet_public::wallet_transfer_info& wti) const;
     void change_contract_state(wallet_public::escrow_contract_details_basic& contract, uint32_t new_state, const crypto::hash& contract_id, const std::string& reason = "internal intention") const;
@@ -860,7 +1013,18 @@ private:
 
 
     void init_log_prefix();
+    void init_deposit_addresses();
+    currency::account_keys get_deposit_account_keys(uint32_t deposit_index) const;
     void load_keys2ki(bool create_if_not_exist, bool& need_to_resync);
+    bool store_to_journal();
+    void load_store_journal(const crypto::chacha8_iv& snapshot_iv, bool& need_to_resync);
+    void reset_store_journal(const crypto::chacha8_iv& snapshot_iv);
+    void load_history_txs(bool& need_to_resync);
+    void offload_history_txs();
+    void restore_history_txs();
+    void release_history_txs();
+    const wallet_public::wallet_transfer_info& get_transfer_history_entry(size_t i, wallet_public::wallet_transfer_info& buff) const;
+    wallet_public::wallet_transfer_info& get_transfer_history_entry(size_t i, wallet_public::wallet_transfer_info& buff);
 
     void send_transaction_to_network(const currency::transaction& tx);
     void add_sent_tx_detailed_info(const currency::transaction& tx, 
@@ -894,6 +1058,11 @@ private:
     uint64_t get_alias_cost(const std::string& alias);
     detail::split_strategy_id_t get_current_split_strategy();
     void build_distribution_for_input(std::vector<uint64_t>& offsets, uint64_t own_index);
+    void build_distribution_for_decoys_pool(std::vector<uint64_t>& offsets);
+    size_t get_zc_stake_decoys_count() const;
+    void fetch_zc_stake_decoys(currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& decoys_resp) const;
+    void refill_pos_stake_decoys();
+    bool take_zc_decoys_from_pool(currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& amount_entry);
     void select_decoys(currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount & amount_entry, uint64_t own_g_index);
 
     static void wti_to_csv_entry(std::ostream& ss, const wallet_public::wallet_transfer_info& wti, size_t index);
@@ -918,10 +1087,15 @@ private:
     std::string m_log_prefix; // part of pub address, prefix for logging functions
     std::wstring m_wallet_file;
     std::wstring m_pending_ki_file;
+    std::wstring m_store_journal_file;
+    std::wstring m_history_txs_file;
     std::string m_password;
    
 
     bool m_do_rise_transfer;
+    bool m_batch_transfer_callbacks;
+    bool m_collecting_transfer_callbacks;
+    std::vector<wallet_public::wallet_transfer_info> m_collected_transfer_callbacks;
     
     bool m_defragmentation_tx_enabled;
     uint64_t m_max_allowed_output_amount_for_defragmentation_tx;
@@ -940,12 +1114,22 @@ private:
 
     currency::core_runtime_config m_core_runtime_config;    
     //optimization for big wallets and batch tx
-    free_assets_amounts_cache_type m_found_free_amounts;
+    free_assets_amounts_cache_type m_found_free_amounts; // spendable transfers by asset and amount, kept up to date once prepared; may have stale entries, they are checked on selection
+    bool m_found_free_amounts_ready;
     uint64_t m_fake_outputs_count;
     std::string m_miner_text_info;
 
     bool m_use_deffered_global_outputs;
+    bool m_use_store_journal;
+    bool m_offload_history_txs;
+    history_txs_storage m_history_txs; // txs of m_transfer_history[0, m_history_txs.size()), they are cleared in the entries
+    history_txs_storage::state m_loaded_history_txs_state;
+    bool m_history_txs_file_referenced;  // the stored wallet file has entries with txs in m_history_txs_file
+    bool m_store_history_txs_separately; // for the time of serialization
+    std::deque<std::pair<uint64_t, currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount>> m_zc_decoys_pool; // (top block height when fetched, decoys), see refill_zc_decoys_pool()
+    std::pair<uint64_t, currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount> m_pos_stake_decoys; // (top block height when fetched, decoys), see refill_pos_stake_decoys()
     bool m_disable_tor_relay;
+    std::shared_ptr<tor_relay_pool> m_ptor_relay_pool; // warm circuits, created on first send
     mutable current_operation_context m_current_context;
 
     std::string m_votes_config_path;
@@ -953,6 +1137,42 @@ private:
 
     uint64_t m_last_known_daemon_height = 0;
 
+    // own outputs lookup results for txs of the blocks being handled by handle_pulled_blocks(), computed by a thread pool in advance
+    struct tx_outs_lookup_result
+    {
+      bool ok = false;
+      crypto::public_key tx_pub_key = currency::null_pkey;
+      std::vector<currency::wallet_out_info> outs;
+      crypto::key_derivation derivation = AUTO_VAL_INIT(derivation);
+      std::list<currency::htlc_info> htlc_info_list;
+    };
+    std::unordered_map<const currency::transaction*, tx_outs_lookup_result> m_pulled_txs_outs_lookup;
+    std::unordered_set<const currency::transaction*> m_pulled_stripped_txs; // pulled txs without key image inputs, see fetch_related_pruned_txs()
+    scan_stats m_scan_stats;
+
+    // a store journal record: the changes of m_transfers and m_transfer_history since the previous store and the rest of the state in full
+    struct store_journal_record
+    {
+      store_journal_record(wallet2_base_state& state) : state(state) {}
+      wallet2_base_state& state;                                    // with m_transfers and m_transfer_history put aside
+      uint64_t transfers_count = 0;
+      std::vector<std::pair<uint64_t, transfer_details>> transfers; // changed and added ones
+      uint64_t history_count = 0;                                   // entries kept
+      std::vector<wallet_public::wallet_transfer_info> history;     // added after them
+
+      template <class t_archive>
+      inline void serialize(t_archive &a, const unsigned int ver)
+      {
+        uint32_t state_ver = WALLET_FILE_SERIALIZATION_VERSION; // the journal may be appended by another build than the one that started it
+        a & state_ver;
+        a & transfers_count;
+        a & transfers;
+        a & history_count;
+        a & history;
+        state.serialize(a, state_ver);
+      }
+    };
+
     //this needed to access wallets state in coretests, for creating abnormal blocks and tranmsactions
     friend class test_generator;
   }; // class wallet2
@@ -961,7 +1181,8 @@ private:
 
 BOOST_CLASS_VERSION(tools::wallet2, WALLET_FILE_SERIALIZATION_VERSION)
 
-BOOST_CLASS_VERSION(tools::wallet_public::wallet_transfer_info, 12)
+BOOST_CLASS_VERSION(tools::wallet_public::wallet_transfer_info, 13)
+BOOST_CLASS_VERSION(tools::wallet_public::employed_tx_entry, 1)
 
 namespace boost
 {
@@ -1073,6 +1294,7 @@ namespace tools
       uint32_t flags_before = td.m_flags;
       td.m_flags |= WALLET_TRANSFER_DETAIL_FLAG_SPENT;
       td.m_spent_height = ptc.height;
+      remove_transfer_from_transfers_cache(tr_index);
       if (ptc.coin_base_tx && td.m_flags&WALLET_TRANSFER_DETAIL_FLAG_MINED_TRANSFER)
         ptc.is_derived_from_coinbase = true;
       else
@@ -1110,76 +1332,66 @@ namespace tools
     uint64_t ts_to = runtime_config.get_core_time() + CURRENCY_POS_BLOCK_FUTURE_TIME_LIMIT - 5;
     ts_to = ts_to - (ts_to % POS_SCAN_STEP);
     CHECK_AND_ASSERT_MES(ts_to > ts_from, false, "scan_pos: ts_to <= ts_from: " << ts_to << ", " << ts_from);
-    uint64_t ts_middle = (ts_to + ts_from) / 2;
-    ts_middle -= ts_middle % POS_SCAN_STEP;
-    uint64_t ts_window = std::min(ts_middle - ts_from, ts_to - ts_middle);
+    std::vector<uint64_t> timestamps;
+    get_pos_scan_timestamps(ts_from, ts_to, timestamps);
 
+    std::vector<pos_scan_entry> entries;
     for (size_t transfer_index = 0; transfer_index != m_transfers.size(); transfer_index++)
     {
-      auto& tr = m_transfers[transfer_index];
-
       uint64_t stake_unlock_time = 0;
-      if (!is_transfer_okay_for_pos(tr, cxt.zarcanum, stake_unlock_time))
-        continue;
-
-      
-      bool go_past = true;
-      uint64_t step = 0;
-      
-      auto next_turn = [&](){
-        if (!step)
-        {
-          step += POS_SCAN_STEP;
-        }
-        else if (go_past)
-        {
-          go_past = false;
-        }
-        else
-        {
-          go_past = true;
-          step += POS_SCAN_STEP;
-        }
-      };
+      if (is_transfer_okay_for_pos(m_transfers[transfer_index], cxt.zarcanum, stake_unlock_time))
+        entries.push_back(pos_scan_entry{ transfer_index, stake_unlock_time });
+    }
 
-      do_pos_mining_prepare_entry(cxt, transfer_index);
-      cxt.total_items_checked++;
-      cxt.total_amount_checked += tr.amount();
-      while(step <= ts_window)
+    auto is_interrupted = [&]() -> bool
+    {
+      //check every WALLET_POS_MINT_CHECK_HEIGHT_INTERVAL seconds wheither top block changed, if so - break the loop 
+      if (runtime_config.get_core_time() - timstamp_last_idle_call > WALLET_POS_MINT_CHECK_HEIGHT_INTERVAL)
       {
-        //check every WALLET_POS_MINT_CHECK_HEIGHT_INTERVAL seconds wheither top block changed, if so - break the loop 
-        if (runtime_config.get_core_time() - timstamp_last_idle_call > WALLET_POS_MINT_CHECK_HEIGHT_INTERVAL)
+        if (!idle_condition_cb())
         {
-          if (!idle_condition_cb())
-          {
-            LOG_PRINT_L0("Detected new block, minting interrupted");
-            cxt.status = API_RETURN_CODE_NOT_FOUND;
-            return false;
-          }
-          timstamp_last_idle_call = runtime_config.get_core_time();
+          LOG_PRINT_L0("Detected new block, minting interrupted");
+          cxt.status = API_RETURN_CODE_NOT_FOUND;
+          return true;
         }
+        timstamp_last_idle_call = runtime_config.get_core_time();
+      }
+      return stop;
+    };
 
+    // lots of stakes are scanned by parts, each one in parallel, and the top block is checked between the parts
+    size_t part_size = get_pos_scan_part_size(entries.size());
+    if (part_size > 1)
+    {
+      for (size_t offset = 0; offset < entries.size(); offset += part_size)
+      {
+        if (is_interrupted())
+          return false;
+        if (scan_pos_part(cxt, entries, offset, std::min(part_size, entries.size() - offset), timestamps, stop))
+          return true;
+      }
+      return false;
+    }
 
-        uint64_t ts = go_past ? ts_middle - step : ts_middle + step;
-        if (ts < ts_from || ts > ts_to)
-        {
-          next_turn();
-          continue;
-        }
-        PROFILE_FUNC("general_mining_iteration");
-        if (stop)
+    for (const pos_scan_entry& e : entries)
+    {
+      do_pos_mining_prepare_entry(cxt, e.transfer_index);
+      cxt.total_items_checked++;
+      cxt.total_amount_checked += m_transfers[e.transfer_index].amount();
+      for (uint64_t ts : timestamps)
+      {
+        if (is_interrupted())
           return false;
 
+        PROFILE_FUNC("general_mining_iteration");
         cxt.iterations_processed++;
-        if (do_pos_mining_iteration(cxt, transfer_index, ts))
+        if (do_pos_mining_iteration(cxt, e.transfer_index, ts))
         {
-          cxt.index = transfer_index;
-          cxt.stake_unlock_time = stake_unlock_time;
+          cxt.index = e.transfer_index;
+          cxt.stake_unlock_time = e.stake_unlock_time;
           cxt.status = API_RETURN_CODE_OK;
           return true;
         }
-        
-        next_turn();
       }
     }
     cxt.status = API_RETURN_CODE_NOT_FOUND;
@@ -1189,16 +1401,17 @@ namespace tools
   template<typename callback_t>
   void wallet2::enumerate_transfers_history(callback_t cb, bool enumerate_forward) const
   {
+    wallet_public::wallet_transfer_info buff = AUTO_VAL_INIT(buff);
     if (enumerate_forward)
     {
-      for(auto it = m_transfer_history.begin(); it != m_transfer_history.end(); ++it)
-        if (!cb(*it))
+      for (size_t i = 0; i != m_transfer_history.size(); ++i)
+        if (!cb(get_transfer_history_entry(i, buff)))
           break;
     }
     else
     {
-      for(auto it = m_transfer_history.rbegin(); it != m_transfer_history.rend(); ++it)
-        if (!cb(*it))
+      for (size_t i = m_transfer_history.size(); i != 0; --i)
+        if (!cb(get_transfer_history_entry(i - 1, buff)))
           break;
     }
   }
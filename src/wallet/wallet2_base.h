@@ -229,6 +229,19 @@ namespace tools
     crypto::public_key ado_current_asset_owner = currency::null_pkey;
   };
 
+  // a destination of wallet2::transfer_batch(), the ones with the same payment id may share a tx
+  struct batch_transfer_destination
+  {
+    currency::tx_destination_entry dst;
+    std::string payment_id;
+  };
+
+  struct batch_transfer_result
+  {
+    crypto::hash tx_id = currency::null_hash; // null when the destination isn't paid, see error
+    std::string error;
+  };
+
   struct mode_separate_context
   {
     currency::transaction tx_for_mode_separate;
@@ -436,11 +449,13 @@ namespace tools
     uint64_t m_global_output_index = 0;
     crypto::key_image m_key_image; //TODO: key_image stored twice :(
     std::vector<transfer_details_extra_options_v> varian_options;
+    uint32_t m_deposit_index = 0; // the deposit address the output was received to, 0 stands for the wallet's own address
 
     //v2
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(m_global_output_index)
       KV_SERIALIZE_POD_AS_HEX_STRING(m_key_image)
+      KV_SERIALIZE(m_deposit_index)
       KV_CHAIN_BASE(transfer_details_base)
     END_KV_SERIALIZE_MAP()
 
@@ -449,6 +464,8 @@ namespace tools
       BOOST_SERIALIZE(m_key_image)
       BOOST_SERIALIZE_BASE_CLASS(transfer_details_base)
       BOOST_SERIALIZE(varian_options)
+      BOOST_END_VERSION_UNDER(4)
+      BOOST_SERIALIZE(m_deposit_index)
     END_BOOST_SERIALIZATION()
   };
 
@@ -519,5 +536,5 @@ namespace tools
 
 }// namespace tools
 
-BOOST_CLASS_VERSION(tools::transfer_details, 3)
+BOOST_CLASS_VERSION(tools::transfer_details, 4)
 BOOST_CLASS_VERSION(tools::transfer_details_base, 2)
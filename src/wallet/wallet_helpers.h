@@ -7,6 +7,7 @@
 
 #include "wallet2.h"
 #include "view_iface.h"
+#include "common/threads_pool.h"
 
 
 namespace tools
@@ -83,4 +84,14 @@ namespace tools
       return API_RETURN_CODE_OK;
     }
   }
-}
\ No newline at end of file
+
+  // seeds are independent, so they're checked on the compute pool (key derivation is the most of the work)
+  inline void get_seed_phrases_info(const std::vector<view::seed_info_param>& seeds, std::vector<view::seed_phrase_info>& results)
+  {
+    results.assign(seeds.size(), AUTO_VAL_INIT_T(view::seed_phrase_info));
+    utils::get_compute_pool().parallel_for(seeds.size(), [&](size_t i)
+    {
+      get_seed_phrase_info(seeds[i].seed_phrase, seeds[i].seed_password, results[i]);
+    });
+  }
+}
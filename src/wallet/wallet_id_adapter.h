@@ -13,6 +13,11 @@ class i_backend_wallet_callback
 public:
   virtual void on_new_block(size_t wallet_id, uint64_t /*height*/, const currency::block& /*block*/) {}
 	virtual void on_transfer2(size_t wallet_id, const tools::wallet_public::wallet_transfer_info& wti, const std::list<tools::wallet_public::asset_balance_entry>& balances, uint64_t total_mined) {}
+  virtual void on_transfers_batch(size_t wallet_id, const std::vector<tools::wallet_public::wallet_transfer_info>& wtis, const std::list<tools::wallet_public::asset_balance_entry>& balances, uint64_t total_mined)
+  {
+    for (const auto& wti : wtis)
+      on_transfer2(wallet_id, wti, balances, total_mined);
+  }
   virtual void on_pos_block_found(size_t wallet_id, const currency::block& /*block*/) {}
   virtual void on_sync_progress(size_t wallet_id, const uint64_t& /*percents*/) {}
   virtual void on_transfer_canceled(size_t wallet_id, const tools::wallet_public::wallet_transfer_info& wti) {}
@@ -35,6 +40,9 @@ struct i_wallet_to_i_backend_adapter: public tools::i_wallet2_callback
 	virtual void on_transfer2(const tools::wallet_public::wallet_transfer_info& wti, const std::list<tools::wallet_public::asset_balance_entry>& balances, uint64_t total_mined) {
 		m_pbackend->on_transfer2(m_wallet_id, wti, balances, total_mined);
   }
+  virtual void on_transfers_batch(const std::vector<tools::wallet_public::wallet_transfer_info>& wtis, const std::list<tools::wallet_public::asset_balance_entry>& balances, uint64_t total_mined) {
+    m_pbackend->on_transfers_batch(m_wallet_id, wtis, balances, total_mined);
+  }
   virtual void on_pos_block_found(const currency::block& wti) {
     m_pbackend->on_pos_block_found(m_wallet_id, wti);
   }
@@ -32,17 +32,21 @@ namespace wallet_public
     uint64_t index = 0;
     uint64_t amount = 0;
     crypto::public_key asset_id = currency::native_coin_asset_id;
+    uint64_t deposit_index = 0; // for received entries: the deposit address they were sent to, 0 stands for the wallet's own address
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(index)
       KV_SERIALIZE(amount)
       KV_SERIALIZE_POD_AS_HEX_STRING(asset_id)
+      KV_SERIALIZE(deposit_index)
     END_KV_SERIALIZE_MAP()
 
     BEGIN_BOOST_SERIALIZATION()
       BOOST_SERIALIZE(index)
       BOOST_SERIALIZE(amount)
       BOOST_SERIALIZE(asset_id)
+      BOOST_END_VERSION_UNDER(1)
+      BOOST_SERIALIZE(deposit_index)
     END_BOOST_SERIALIZATION()
 
   };
@@ -210,6 +214,8 @@ namespace wallet_public
       BOOST_SERIALIZE(unlock_time)
       BOOST_SERIALIZE(service_entries)
       BOOST_SERIALIZE(subtransfers)
+      BOOST_END_VERSION_UNDER(13)
+      BOOST_SERIALIZE(is_mining)
     END_BOOST_SERIALIZATION()
 
     bool is_income_mode_encryption() const 
@@ -358,8 +364,10 @@ namespace wallet_public
   struct mining_history
   {
     std::vector<mining_history_entry> mined_entries;
+    bool from_cache = false;
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(mined_entries) DOC_DSCR("Mined blocks entries.") DOC_EXMP_AUTO(1) DOC_END
+      KV_SERIALIZE(from_cache)    DOC_DSCR("True if the wallet was busy and the response was given from the cache of read-only calls, as it was the last time the same call was made") DOC_EXMP(false) DOC_END
     END_KV_SERIALIZE_MAP()
   };
 
@@ -407,11 +415,13 @@ namespace wallet_public
       uint64_t 	 balance;
       uint64_t 	 unlocked_balance;
       std::list<asset_balance_entry> balances;
+      bool from_cache = false;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(balance)           DOC_DSCR("Native coins total amount")           DOC_EXMP(10000000000)               DOC_END
         KV_SERIALIZE(unlocked_balance)  DOC_DSCR("Native coins total unlocked amount")  DOC_EXMP(11000000000)               DOC_END
         KV_SERIALIZE(balances)          DOC_DSCR("Balances groupped by it's asset_id")  DOC_EXMP_AUTO(1)                    DOC_END
+        KV_SERIALIZE(from_cache)        DOC_DSCR("True if the wallet was busy and the response was given from the cache of read-only calls, as it was the last time the same call was made") DOC_EXMP(false) DOC_END
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -429,9 +439,11 @@ namespace wallet_public
     struct response
     {
       std::string   address;
+      bool          from_cache = false;
 
       BEGIN_KV_SERIALIZE_MAP()
-        KV_SERIALIZE(address)  DOC_DSCR("string; standard public address of the wallet.")  DOC_EXMP("ZxDNaMeZjwCjnHuU5gUNyrP1pM3U5vckbakzzV6dEHyDYeCpW8XGLBFTshcaY8LkG9RQn7FsQx8w2JeJzJwPwuDm2NfixPAXf") DOC_END
+        KV_SERIALIZE(address)     DOC_DSCR("string; standard public address of the wallet.")  DOC_EXMP("ZxDNaMeZjwCjnHuU5gUNyrP1pM3U5vckbakzzV6dEHyDYeCpW8XGLBFTshcaY8LkG9RQn7FsQx8w2JeJzJwPwuDm2NfixPAXf") DOC_END
+        KV_SERIALIZE(from_cache)  DOC_DSCR("True if the wallet was busy and the response was given from the cache of read-only calls, as it was the last time the same call was made") DOC_EXMP(false) DOC_END
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -458,6 +470,7 @@ namespace wallet_public
       bool                      has_bare_unspent_outputs;
       std::vector<std::string>  utxo_distribution;
       uint64_t                  current_height;
+      bool                      from_cache = false;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(address)                  DOC_DSCR("string; standard public address of the wallet.")  DOC_EXMP("ZxDNaMeZjwCjnHuU5gUNyrP1pM3U5vckbakzzV6dEHyDYeCpW8XGLBFTshcaY8LkG9RQn7FsQx8w2JeJzJwPwuDm2NfixPAXf") DOC_END
@@ -468,6 +481,7 @@ namespace wallet_public
         KV_SERIALIZE(has_bare_unspent_outputs) DOC_DSCR("Shows if the wallet still has UTXO from pre-zarcanum era")  DOC_EXMP(false) DOC_END
         KV_SERIALIZE(utxo_distribution)        DOC_DSCR("UTXO distribution for this particular wallet: disabled right now")  DOC_EXMP_AUTO(1, "1") DOC_END
         KV_SERIALIZE(current_height)           DOC_DSCR("Current wallet/daemon height")  DOC_EXMP(112132) DOC_END
+        KV_SERIALIZE(from_cache)               DOC_DSCR("True if the wallet was busy and the response was given from the cache of read-only calls, as it was the last time the same call was made") DOC_EXMP(false) DOC_END
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -503,6 +517,29 @@ namespace wallet_public
     typedef seed_phrase_info response;
   };
 
+  struct COMMAND_RPC_GET_SEED_PHRASES_INFO
+  {
+    DOC_COMMAND("Batch version of get_seed_phrase_info: validates many seed phrases at once, in parallel");
+
+    struct request
+    {
+      std::vector<seed_info_param> seeds;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(seeds)        DOC_DSCR("Seed phrases with their passwords, if applicable.") DOC_EXMP_AUTO(1) DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::vector<seed_phrase_info> seeds_info;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(seeds_info)   DOC_DSCR("Information about each of the given seed phrases, in the same order.") DOC_EXMP_AUTO(1) DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct wallet_provision_info
   {
     uint64_t                  transfers_count;
@@ -575,12 +612,14 @@ namespace wallet_public
       std::vector<wallet_transfer_info> transfers;
       uint64_t total_transfers;
       uint64_t last_item_index;
+      bool from_cache = false;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(pi)               DOC_DSCR("Details on wallet balance etc") DOC_END
         KV_SERIALIZE(transfers)        DOC_DSCR("Transfers")                     DOC_EXMP_AUTO(1) DOC_END
         KV_SERIALIZE(total_transfers)  DOC_DSCR("Total transfers")               DOC_EXMP(1) DOC_END
         KV_SERIALIZE(last_item_index)  DOC_DSCR("Last item index")               DOC_EXMP(1) DOC_END
+        KV_SERIALIZE(from_cache)       DOC_DSCR("True if the wallet was busy and the response was given from the cache of read-only calls, as it was the last time the same call was made") DOC_EXMP(false) DOC_END
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -598,12 +637,14 @@ namespace wallet_public
       std::vector<wallet_transfer_info_old> transfers;
       uint64_t total_transfers;
       uint64_t last_item_index;
+      bool from_cache = false;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(pi)              DOC_DSCR("Additiona details about balance state")                                               DOC_END
         KV_SERIALIZE(transfers)       DOC_DSCR("Transfers history array")                                           DOC_EXMP_AUTO(1)  DOC_END
         KV_SERIALIZE(total_transfers) DOC_DSCR("Total number of transfers in the tx history")                       DOC_EXMP(1)       DOC_END
         KV_SERIALIZE(last_item_index) DOC_DSCR("Index of last returned item(might be needed if filters are used)")  DOC_EXMP(1)       DOC_END
+        KV_SERIALIZE(from_cache)      DOC_DSCR("True if the wallet was busy and the response was given from the cache of read-only calls, as it was the last time the same call was made") DOC_EXMP(false) DOC_END
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -713,6 +754,93 @@ namespace wallet_public
     };
   };
 
+  struct COMMAND_RPC_TRANSFER_ASYNC
+  {
+    DOC_COMMAND("Queue a payment transaction to be made in the background, returns immediately with the job id to poll with get_async_job_status");
+
+    typedef COMMAND_RPC_TRANSFER::request request;
+
+    struct response
+    {
+      uint64_t job_id;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(job_id)           DOC_DSCR("Id of the job, valid until an hour after the job is finished") DOC_EXMP(1)     DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_ASYNC_JOB_STATUS
+  {
+    DOC_COMMAND("Get status and result of a job queued with transfer_async");
+
+    struct request
+    {
+      uint64_t job_id;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(job_id)           DOC_DSCR("Id of the job, as returned by transfer_async") DOC_EXMP(1)     DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      COMMAND_RPC_TRANSFER::response result;
+      int64_t error_code;
+      std::string error_message;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)           DOC_DSCR("Status of the job: queued, in_progress, done or failed") DOC_EXMP("done")     DOC_END
+        KV_SERIALIZE(result)           DOC_DSCR("Result of the transfer, if the job is done, same as the one given by transfer") DOC_END
+        KV_SERIALIZE(error_code)       DOC_DSCR("Error code of the transfer, if the job is failed, same as the one given by transfer") DOC_EXMP(-7)     DOC_END
+        KV_SERIALIZE(error_message)    DOC_DSCR("Error message of the transfer, if the job is failed") DOC_EXMP("WALLET_RPC_ERROR_CODE_NOT_ENOUGH_MONEY")     DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct batch_transfer_entry
+  {
+    std::string tx_hash;
+    std::string error;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(tx_hash)            DOC_DSCR("Hash of the transaction that pays the destination, empty if it isn't paid") DOC_EXMP("ef6c4bbd3b2c8ee55f7c0c539faea70c2e1b0cdb2c52e20c0d128e7153b8a636")     DOC_END
+      KV_SERIALIZE(error)              DOC_DSCR("Why the destination isn't paid, empty if it is") DOC_EXMP("")     DOC_END
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct COMMAND_RPC_TRANSFER_BATCH
+  {
+    DOC_COMMAND("Pay many destinations at once: they're packed into as few transactions as possible, the transactions are constructed in parallel and sent one by one");
+
+    struct request
+    {
+      std::list<transfer_destination> destinations;
+      uint64_t fee;
+      uint64_t mixin;
+      bool push_payer;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(destinations)     DOC_DSCR("List of destinations, integrated addresses are allowed, destinations with different payment ids are paid by different transactions") DOC_EXMP_AUTO(1)     DOC_END
+        KV_SERIALIZE(fee)              DOC_DSCR("Fee of each transaction (paid in native coins)") DOC_EXMP_AUTO(10000000000)     DOC_END
+        KV_SERIALIZE(mixin)            DOC_DSCR("Number of mixins(decoys) for pre-zarcanum inputs, the same as in transfer") DOC_EXMP(15)     DOC_END
+        KV_SERIALIZE(push_payer)       DOC_DSCR("Reveal the sender address to the receivers, the same as in transfer") DOC_EXMP(false)     DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::list<batch_transfer_entry> results;
+      std::list<std::string> tx_hashes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(results)          DOC_DSCR("Result for each destination, in the order of the request") DOC_EXMP_AUTO(1)     DOC_END
+        KV_SERIALIZE(tx_hashes)        DOC_DSCR("Hashes of all the transactions sent") DOC_EXMP_AUTO(1, "ef6c4bbd3b2c8ee55f7c0c539faea70c2e1b0cdb2c52e20c0d128e7153b8a636")     DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_STORE
   {
     DOC_COMMAND("Store wallet's data to file");
@@ -769,9 +897,11 @@ namespace wallet_public
     struct response
     {
       std::list<payment_details> payments;
+      bool from_cache = false;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(payments)        DOC_DSCR("Array of payments that connected to given payment_id") DOC_EXMP_AUTO(1)     DOC_END
+        KV_SERIALIZE(from_cache)      DOC_DSCR("True if the wallet was busy and the response was given from the cache of read-only calls, as it was the last time the same call was made") DOC_EXMP(false) DOC_END
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -847,6 +977,73 @@ namespace wallet_public
     };
   };
 
+  struct COMMAND_RPC_CREATE_DEPOSIT_ADDRESS
+  {
+    DOC_COMMAND("Create a deposit address: a standard address sharing the wallet's view key, so the wallet finds the payments to any number of deposit addresses at the cost of one. Received transfers are told apart by deposit_index of their employed_entries.receive items. Not supported by auditable wallets.");
+
+    struct request
+    {
+      std::string label;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(label) DOC_DSCR("Arbitrary text stored with the address, e.g. a customer's id.") DOC_EXMP("customer 1025")  DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      uint64_t deposit_index;
+      std::string address;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(deposit_index) DOC_DSCR("Index of the deposit address, starting from 1 (0 stands for the wallet's own address). The same index gives the same address for the wallet restored from its seed.") DOC_EXMP(1) DOC_END
+        KV_SERIALIZE(address)       DOC_DSCR("Deposit address.") DOC_EXMP("ZxBvJDuQjMG9R2j4WnYUhBYNrwZPwuyXrC7FHdVmWqaESgowDvgfWtiXeNGu8Px9B24pkmjsA39fzSSiEQG1ekB225ZnrMTBp") DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct deposit_address_details
+  {
+    uint64_t deposit_index = 0;
+    std::string address;
+    std::string label;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(deposit_index) DOC_DSCR("Index of the deposit address.") DOC_EXMP(1) DOC_END
+      KV_SERIALIZE(address)       DOC_DSCR("Deposit address.") DOC_EXMP("ZxBvJDuQjMG9R2j4WnYUhBYNrwZPwuyXrC7FHdVmWqaESgowDvgfWtiXeNGu8Px9B24pkmjsA39fzSSiEQG1ekB225ZnrMTBp") DOC_END
+      KV_SERIALIZE(label)         DOC_DSCR("Label given on creation.") DOC_EXMP("customer 1025") DOC_END
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct COMMAND_RPC_GET_DEPOSIT_ADDRESSES
+  {
+    DOC_COMMAND("List deposit addresses of the wallet, see create_deposit_address");
+
+    struct request
+    {
+      uint64_t offset = 0;
+      uint64_t count = 0;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(offset) DOC_DSCR("Number of deposit addresses to skip, starting from index 1.") DOC_EXMP(0) DOC_END
+        KV_SERIALIZE(count)  DOC_DSCR("Maximum number of deposit addresses to return, 0 means all.") DOC_EXMP(100) DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::vector<deposit_address_details> addresses;
+      uint64_t total_count = 0;
+      bool from_cache = false;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(addresses)   DOC_DSCR("Deposit addresses in the order of their indices.") DOC_EXMP_AUTO(1) DOC_END
+        KV_SERIALIZE(total_count) DOC_DSCR("Total number of deposit addresses of the wallet.") DOC_EXMP(1) DOC_END
+        KV_SERIALIZE(from_cache)  DOC_DSCR("True if the wallet was busy and the response was given from the cache of read-only calls, as it was the last time the same call was made") DOC_EXMP(false) DOC_END
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_SWEEP_BELOW
   {
     DOC_COMMAND("Tries to transfer all coins with amount below the given limit to the given address");
@@ -1346,11 +1543,13 @@ namespace wallet_public
       std::list<wallet_transfer_info> in;
       std::list<wallet_transfer_info> out;
       std::list<wallet_transfer_info> pool;
+      bool from_cache = false;
 
       BEGIN_KV_SERIALIZE_MAP()
-        KV_SERIALIZE(in)      DOC_DSCR("List of incoming transactions.")                  DOC_EXMP_AUTO(1)  DOC_END
-        KV_SERIALIZE(out)     DOC_DSCR("List of outgoing transactions.")                  DOC_EXMP_AUTO(1)  DOC_END
-        KV_SERIALIZE(pool)    DOC_DSCR("List of pool transactions.")                      DOC_EXMP_AUTO(1)  DOC_END
+        KV_SERIALIZE(in)          DOC_DSCR("List of incoming transactions.")                  DOC_EXMP_AUTO(1)  DOC_END
+        KV_SERIALIZE(out)         DOC_DSCR("List of outgoing transactions.")                  DOC_EXMP_AUTO(1)  DOC_END
+        KV_SERIALIZE(pool)        DOC_DSCR("List of pool transactions.")                      DOC_EXMP_AUTO(1)  DOC_END
+        KV_SERIALIZE(from_cache)  DOC_DSCR("True if the wallet was busy and the response was given from the cache of read-only calls, as it was the last time the same call was made") DOC_EXMP(false) DOC_END
       END_KV_SERIALIZE_MAP()
     };
   };
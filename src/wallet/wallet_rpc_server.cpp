@@ -33,7 +33,11 @@ POP_VS_WARNINGS
 
 #define GET_WALLET()   wallet_rpc_locker w(m_pwallet_provider);
 
-#define WALLET_RPC_BEGIN_TRY_ENTRY()     try { GET_WALLET();
+// the cached responses to read-only calls are dropped when the wallet may have changed, it's done while the lock is still taken
+#define CLEAR_READ_ONLY_CALLS_CACHE_ON_LEAVE()  auto read_only_calls_cache_clear = epee::misc_utils::create_scope_leave_handler([&]() { m_read_only_calls_cache.clear(); });
+
+// calls other than read-only ones are taken as mutating
+#define WALLET_RPC_BEGIN_TRY_ENTRY()     try { GET_WALLET(); CLEAR_READ_ONLY_CALLS_CACHE_ON_LEAVE();
 #define WALLET_RPC_CATCH_TRY_ENTRY()     } \
         catch (const tools::error::daemon_busy& e) \
         { \
@@ -66,6 +70,28 @@ POP_VS_WARNINGS
           return false; \
         } 
 
+// read-only calls don't wait for the wallet while it's busy with a refresh or a mutating call, if the same call was made since
+// the wallet last changed, the response given to it then is given again with from_cache set, otherwise they wait;
+// ends with WALLET_RPC_CATCH_TRY_ENTRY()
+#define WALLET_RPC_BEGIN_READ_ONLY_TRY_ENTRY(call_name) \
+  std::string read_only_call_id = m_read_only_calls_cache_enabled ? std::string(call_name) + epee::serialization::store_t_to_json(req) : std::string(); \
+  try { \
+    std::unique_ptr<wallet_rpc_locker> wallet_locker_ptr(new wallet_rpc_locker(m_pwallet_provider, m_read_only_calls_cache_enabled)); \
+    if (!wallet_locker_ptr->is_locked()) \
+    { \
+      if (m_read_only_calls_cache.get(read_only_call_id, res)) \
+      { \
+        res.from_cache = true; \
+        return true; \
+      } \
+      wallet_locker_ptr.reset(new wallet_rpc_locker(m_pwallet_provider)); \
+    } \
+    wallet_rpc_locker& w = *wallet_locker_ptr; \
+    auto read_only_call_cache_update = epee::misc_utils::create_scope_leave_handler([&]() { \
+      if (m_read_only_calls_cache_enabled && !er.code && std::uncaught_exceptions() == 0) \
+        m_read_only_calls_cache.put(read_only_call_id, res); \
+    });
+
 
 void exception_handler()
 {}
@@ -78,6 +104,7 @@ namespace tools
   const command_line::arg_descriptor<std::string> wallet_rpc_server::arg_miner_text_info  ( "miner-text-info", "Wallet password");
   const command_line::arg_descriptor<bool>        wallet_rpc_server::arg_deaf_mode  ( "deaf", "Put wallet into 'deaf' mode make it ignore any rpc commands(usable for safe PoS mining)");
   const command_line::arg_descriptor<std::string> wallet_rpc_server::arg_jwt_secret("jwt-secret", "Enables JWT auth over secret string provided");
+  const command_line::arg_descriptor<size_t>      wallet_rpc_server::arg_rpc_threads("rpc-threads-count", "Number of threads serving rpc requests, read-only calls are served in parallel", WALLET_RPC_THREADS_COUNT_DEFAULT);
 
   void wallet_rpc_server::init_options(boost::program_options::options_description& desc)
   {
@@ -86,6 +113,7 @@ namespace tools
     command_line::add_arg(desc, arg_miner_text_info);
     command_line::add_arg(desc, arg_deaf_mode);
     command_line::add_arg(desc, arg_jwt_secret);
+    command_line::add_arg(desc, arg_rpc_threads);
   }
   //------------------------------------------------------------------------------------------------------------------------------
   wallet_rpc_server::wallet_rpc_server(std::shared_ptr<wallet2> wptr):
@@ -94,6 +122,11 @@ namespace tools
     , m_do_mint(false)
     , m_deaf(false)
     , m_last_wallet_store_height(0)
+    , m_threads_count(1)
+    , m_read_only_calls_cache_enabled(false)
+    , m_async_jobs_last_id(0)
+    , m_async_jobs_stop(false)
+    , m_refresh_stop(false)
   {}
   //------------------------------------------------------------------------------------------------------------------------------
   wallet_rpc_server::wallet_rpc_server(i_wallet_provider* provider_ptr):
@@ -101,8 +134,19 @@ namespace tools
     , m_do_mint(false)
     , m_deaf(false)
     , m_last_wallet_store_height(0)
+    , m_threads_count(1)
+    , m_read_only_calls_cache_enabled(false)
+    , m_async_jobs_last_id(0)
+    , m_async_jobs_stop(false)
+    , m_refresh_stop(false)
   {}
   //------------------------------------------------------------------------------------------------------------------------------
+  wallet_rpc_server::~wallet_rpc_server()
+  {
+    stop_refresh_worker();
+    stop_async_jobs_worker();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
 //   std::shared_ptr<wallet2> wallet_rpc_server::get_wallet()
 //   {
 //     return std::shared_ptr<wallet2>(m_pwallet);
@@ -118,63 +162,159 @@ namespace tools
 
     if (!offline_mode)
     {
-      m_net_server.add_idle_handler([this, &miner_address]() -> bool
+      m_refresh_stop = false;
+      m_refresh_thread = std::thread([this, &miner_address]() { refresh_worker(miner_address); });
+    }
+
+    // every call (as well as the refresh worker) takes the wallet lock, read-only ones are given from the cache while it's taken
+    m_read_only_calls_cache_enabled = m_threads_count > 1;
+    bool r = epee::http_server_impl_base<wallet_rpc_server, connection_context>::run(m_threads_count, true);
+    stop_refresh_worker();
+    stop_async_jobs_worker();
+    return r;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void wallet_rpc_server::refresh_worker(const currency::account_public_address& miner_address)
+  {
+    static const uint64_t wallet_rpc_idle_work_period_ms = 2000;
+
+    while (!m_refresh_stop)
+    {
+      try
       {
-        try
+        LOG_PRINT_L2("wallet RPC refresh: refreshing...");
+        if (!refresh_wallet_in_parts())
+          LOG_PRINT_L1("wallet RPC refresh: refresh failed");
+
+        GET_WALLET();
+        CLEAR_READ_ONLY_CALLS_CACHE_ON_LEAVE();
+        bool has_related_alias_in_unconfirmed = false;
+        LOG_PRINT_L2("wallet RPC refresh: scanning tx pool...");
+        w.get_wallet()->scan_tx_pool(has_related_alias_in_unconfirmed);
+
+        LOG_PRINT_L2("wallet RPC refresh: refilling decoys pool...");
+        w.get_wallet()->refill_zc_decoys_pool();
+
+        if (m_do_mint)
         {
-          GET_WALLET();          
-          size_t blocks_fetched = 0;
-          bool received_money = false, ok = false;
-          std::atomic<bool> stop(false);
-          LOG_PRINT_L2("wallet RPC idle: refreshing...");
-          w.get_wallet()->refresh(blocks_fetched, received_money, ok, stop);
-          if (stop)
-          {
-            LOG_PRINT_L1("wallet RPC idle: refresh failed");
-            return true;
-          }
-
-          bool has_related_alias_in_unconfirmed = false;
-          LOG_PRINT_L2("wallet RPC idle: scanning tx pool...");
-          w.get_wallet()->scan_tx_pool(has_related_alias_in_unconfirmed);
-
-          if (m_do_mint)
-          {
-            LOG_PRINT_L2("wallet RPC idle: trying to do PoS iteration...");
-            w.get_wallet()->try_mint_pos(miner_address);
-          }
-
-          //auto-store wallet in server mode, let's do it every 24-hour
-          if (w.get_wallet()->get_top_block_height() < m_last_wallet_store_height)
-          {
-            LOG_ERROR("Unexpected m_last_wallet_store_height = " << m_last_wallet_store_height << " or " << w.get_wallet()->get_top_block_height());
-          }
-          else if (w.get_wallet()->get_top_block_height() - m_last_wallet_store_height > CURRENCY_BLOCKS_PER_DAY)
-          {
-            //store wallet
-            w.get_wallet()->store();
-            m_last_wallet_store_height = w.get_wallet()->get_top_block_height();
-          }
+          LOG_PRINT_L2("wallet RPC refresh: trying to do PoS iteration...");
+          w.get_wallet()->try_mint_pos(miner_address);
         }
-        catch (error::no_connection_to_daemon&)
+
+        //auto-store wallet in server mode, let's do it every 24-hour
+        if (w.get_wallet()->get_top_block_height() < m_last_wallet_store_height)
         {
-          LOG_PRINT_RED("no connection to the daemon", LOG_LEVEL_0);
+          LOG_ERROR("Unexpected m_last_wallet_store_height = " << m_last_wallet_store_height << " or " << w.get_wallet()->get_top_block_height());
         }
-        catch (std::exception& e)
+        else if (w.get_wallet()->get_top_block_height() - m_last_wallet_store_height > CURRENCY_BLOCKS_PER_DAY)
         {
-          LOG_ERROR("exeption caught in wallet_rpc_server::idle_handler: " << e.what());
+          //store wallet
+          w.get_wallet()->store();
+          m_last_wallet_store_height = w.get_wallet()->get_top_block_height();
         }
-        catch (...)
+      }
+      catch (error::no_connection_to_daemon&)
+      {
+        LOG_PRINT_RED("no connection to the daemon", LOG_LEVEL_0);
+      }
+      catch (std::exception& e)
+      {
+        LOG_ERROR("exeption caught in wallet_rpc_server::refresh_worker: " << e.what());
+      }
+      catch (...)
+      {
+        LOG_ERROR("unknown exeption caught in wallet_rpc_server::refresh_worker");
+      }
+
+      std::unique_lock<std::mutex> lock(m_refresh_lock);
+      m_refresh_cv.wait_for(lock, std::chrono::milliseconds(wallet_rpc_idle_work_period_ms), [this]() { return m_refresh_stop.load(); });
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::refresh_wallet_in_parts()
+  {
+    // blocks are pulled from the daemon without the wallet's lock, then applied with it, a part at a time,
+    // so calls wait for one part at most, and see the wallet's state as of some block
+    size_t blocks_fetched = 0;
+    size_t changed_count = 0;
+    while (!m_refresh_stop)
+    {
+      currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request req = AUTO_VAL_INIT(req);
+      currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response res = AUTO_VAL_INIT(res);
+      std::shared_ptr<i_core_proxy> core_proxy;
+      {
+        GET_WALLET();
+        w.get_wallet()->load_whitelisted_tokens_if_not_loaded();
+        w.get_wallet()->make_pull_blocks_request(req);
+        core_proxy = w.get_wallet()->get_core_proxy();
+      }
+
+      bool r = core_proxy->call_COMMAND_RPC_GET_BLOCKS_DIRECT(req, res);
+      if (!r)
+        throw error::no_connection_to_daemon(LOCATION_STR, "getblocks.bin");
+      if (res.status == API_RETURN_CODE_BUSY)
+      {
+        LOG_PRINT_L1("wallet RPC refresh: core is busy, pull cancelled");
+        break;
+      }
+      if (res.status == API_RETURN_CODE_GENESIS_MISMATCH || changed_count > WALLET_RPC_REFRESH_MAX_RETRIES)
+      {
+        // rare cases, the wallet is refreshed as a whole
+        GET_WALLET();
+        CLEAR_READ_ONLY_CALLS_CACHE_ON_LEAVE();
+        size_t blocks_fetched_in_whole = 0;
+        bool received_money = false, ok = false;
+        std::atomic<bool> stop(false);
+        w.get_wallet()->refresh(blocks_fetched_in_whole, received_money, ok, stop);
+        return ok && !stop;
+      }
+
+      size_t offset = 0;
+      size_t blocks_added = 0;
+      bool changed = false;
+      while (offset < res.blocks.size() && !m_refresh_stop)
+      {
         {
-          LOG_ERROR("unknown exeption caught in wallet_rpc_server::idle_handler");
+          GET_WALLET();
+          CLEAR_READ_ONLY_CALLS_CACHE_ON_LEAVE();
+          size_t part_blocks_added = 0;
+          changed = !w.get_wallet()->apply_pulled_blocks_part(req, res, offset, WALLET_RPC_REFRESH_BLOCKS_PER_PART, part_blocks_added, m_refresh_stop);
+          blocks_added += part_blocks_added;
         }
-
-        return true;
-      }, wallet_rpc_idle_work_period_ms);
+        if (changed)
+          break;
+        // calls waiting for the wallet take it before the next part
+        std::this_thread::sleep_for(std::chrono::milliseconds(WALLET_RPC_REFRESH_PAUSE_BETWEEN_PARTS_MS));
+      }
+      blocks_fetched += blocks_added;
+      if (changed)
+      {
+        ++changed_count; // by a call meanwhile, ask the daemon again
+        continue;
+      }
+      if (!blocks_added)
+        break;
     }
 
-    //DO NOT START THIS SERVER IN MORE THEN 1 THREADS WITHOUT REFACTORING
-    return epee::http_server_impl_base<wallet_rpc_server, connection_context>::run(1, true);
+    if (blocks_fetched)
+    {
+      GET_WALLET();
+      CLEAR_READ_ONLY_CALLS_CACHE_ON_LEAVE();
+      w.get_wallet()->finish_refresh(blocks_fetched);
+      LOG_PRINT_L1("wallet RPC refresh: done, blocks received: " << blocks_fetched);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void wallet_rpc_server::stop_refresh_worker()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_refresh_lock);
+      m_refresh_stop = true;
+    }
+    m_refresh_cv.notify_all();
+    if (m_refresh_thread.joinable())
+      m_refresh_thread.join();
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::handle_command_line(const boost::program_options::variables_map& vm)
@@ -183,6 +323,7 @@ namespace tools
     m_bind_ip = command_line::get_arg(vm, arg_rpc_bind_ip);
     m_port = command_line::get_arg(vm, arg_rpc_bind_port);
     m_deaf = command_line::get_arg(vm, arg_deaf_mode);
+    m_threads_count = std::max<size_t>(command_line::get_arg(vm, arg_rpc_threads), 1);
     if (m_deaf)
     {
       LOG_PRINT_MAGENTA("Wallet launched in 'deaf' mode", LOG_LEVEL_0);
@@ -222,6 +363,7 @@ namespace tools
     
     try
     {
+      std::lock_guard<std::mutex> salts_lock(m_jwt_used_salts_lock);
       if(m_jwt_used_salts.get_set().size() > JWT_TOKEN_OVERWHELM_LIMIT)
       {
         throw std::runtime_error("Salt is overwhelmed");
@@ -315,7 +457,7 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_getbalance(const wallet_public::COMMAND_RPC_GET_BALANCE::request& req, wallet_public::COMMAND_RPC_GET_BALANCE::response& res, epee::json_rpc::error& er, connection_context& cntx)
   {
-    WALLET_RPC_BEGIN_TRY_ENTRY();
+    WALLET_RPC_BEGIN_READ_ONLY_TRY_ENTRY("getbalance");
     uint64_t stub_mined = 0; // unused
     bool r = w.get_wallet()->balance(res.balances, stub_mined);
     CHECK_AND_ASSERT_THROW_MES(r, "m_wallet.balance failed");
@@ -334,7 +476,7 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_getaddress(const wallet_public::COMMAND_RPC_GET_ADDRESS::request& req, wallet_public::COMMAND_RPC_GET_ADDRESS::response& res, epee::json_rpc::error& er, connection_context& cntx)
   {
-    WALLET_RPC_BEGIN_TRY_ENTRY();
+    WALLET_RPC_BEGIN_READ_ONLY_TRY_ENTRY("getaddress");
     res.address = w.get_wallet()->get_account().get_public_address_str();
     WALLET_RPC_CATCH_TRY_ENTRY();
     return true;
@@ -342,7 +484,7 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_getwallet_info(const wallet_public::COMMAND_RPC_GET_WALLET_INFO::request& req, wallet_public::COMMAND_RPC_GET_WALLET_INFO::response& res, epee::json_rpc::error& er, connection_context& cntx)
   {
-    WALLET_RPC_BEGIN_TRY_ENTRY();
+    WALLET_RPC_BEGIN_READ_ONLY_TRY_ENTRY("get_wallet_info");
 
     res.address = w.get_wallet()->get_account().get_public_address_str();
     res.is_whatch_only = w.get_wallet()->is_watch_only();
@@ -376,6 +518,14 @@ namespace tools
     WALLET_RPC_CATCH_TRY_ENTRY();
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_get_seed_phrases_info(const wallet_public::COMMAND_RPC_GET_SEED_PHRASES_INFO::request& req, wallet_public::COMMAND_RPC_GET_SEED_PHRASES_INFO::response& res, epee::json_rpc::error& er, connection_context& cntx)
+  {
+    WALLET_RPC_BEGIN_TRY_ENTRY();
+    tools::get_seed_phrases_info(req.seeds, res.seeds_info);
+    return true;
+    WALLET_RPC_CATCH_TRY_ENTRY();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   template<typename t_from, typename t_to>
   void copy_wallet_transfer_info_old_container(const t_from& from_c, t_to& to_c)
   {
@@ -390,7 +540,7 @@ namespace tools
   {
     //this is legacy api, should be removed after successful transition to HF4 
     wallet_public::COMMAND_RPC_GET_RECENT_TXS_AND_INFO2::response rsp2 = AUTO_VAL_INIT(rsp2);
-    WALLET_RPC_BEGIN_TRY_ENTRY();
+    WALLET_RPC_BEGIN_READ_ONLY_TRY_ENTRY("get_recent_txs_and_info");
     
     on_get_recent_txs_and_info2(req, rsp2, er, cntx);
     res.pi = rsp2.pi;
@@ -403,7 +553,7 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_get_recent_txs_and_info2(const wallet_public::COMMAND_RPC_GET_RECENT_TXS_AND_INFO2::request& req, wallet_public::COMMAND_RPC_GET_RECENT_TXS_AND_INFO2::response& res, epee::json_rpc::error& er, connection_context& cntx)
   {
-    WALLET_RPC_BEGIN_TRY_ENTRY();
+    WALLET_RPC_BEGIN_READ_ONLY_TRY_ENTRY("get_recent_txs_and_info2");
     if (req.update_provision_info)
     {
       res.pi.balance = w.get_wallet()->balance(res.pi.unlocked_balance);
@@ -559,6 +709,150 @@ namespace tools
     WALLET_RPC_CATCH_TRY_ENTRY();
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_transfer_async(const wallet_public::COMMAND_RPC_TRANSFER_ASYNC::request& req, wallet_public::COMMAND_RPC_TRANSFER_ASYNC::response& res, epee::json_rpc::error& er, connection_context& cntx)
+  {
+    std::lock_guard<std::mutex> lock(m_async_jobs_lock);
+    if (m_async_jobs_stop)
+    {
+      er.code = WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR;
+      er.message = "WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR: server is stopping";
+      return false;
+    }
+
+    time_t now = time(nullptr);
+    for (auto it = m_async_jobs.begin(); it != m_async_jobs.end(); )
+    {
+      if (it->second.finish_time && now > it->second.finish_time + WALLET_RPC_ASYNC_JOB_RESULT_TTL)
+        it = m_async_jobs.erase(it);
+      else
+        ++it;
+    }
+
+    res.job_id = ++m_async_jobs_last_id;
+    async_transfer_job& job = m_async_jobs[res.job_id];
+    job.req = req;
+    job.status = WALLET_RPC_ASYNC_JOB_STATUS_QUEUED;
+    m_async_jobs_queue.push_back(res.job_id);
+    if (!m_async_jobs_thread.joinable())
+      m_async_jobs_thread = std::thread([this]() { async_jobs_worker(); });
+    m_async_jobs_cv.notify_one();
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_get_async_job_status(const wallet_public::COMMAND_RPC_GET_ASYNC_JOB_STATUS::request& req, wallet_public::COMMAND_RPC_GET_ASYNC_JOB_STATUS::response& res, epee::json_rpc::error& er, connection_context& cntx)
+  {
+    std::lock_guard<std::mutex> lock(m_async_jobs_lock);
+    auto it = m_async_jobs.find(req.job_id);
+    if (it == m_async_jobs.end())
+    {
+      er.code = WALLET_RPC_ERROR_CODE_WRONG_ARGUMENT;
+      er.message = std::string("WALLET_RPC_ERROR_CODE_WRONG_ARGUMENT: unknown job id ") + epee::string_tools::num_to_string_fast(req.job_id);
+      return false;
+    }
+    res.status = it->second.status;
+    res.result = it->second.res;
+    res.error_code = it->second.er.code;
+    res.error_message = it->second.er.message;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_transfer_batch(const wallet_public::COMMAND_RPC_TRANSFER_BATCH::request& req, wallet_public::COMMAND_RPC_TRANSFER_BATCH::response& res, epee::json_rpc::error& er, connection_context& cntx)
+  {
+    WALLET_RPC_BEGIN_TRY_ENTRY();
+    if (req.fee < w.get_wallet()->get_core_runtime_config().tx_pool_min_fee)
+    {
+      er.code = WALLET_RPC_ERROR_CODE_WRONG_ARGUMENT;
+      er.message = std::string("Given fee is too low: ") + epee::string_tools::num_to_string_fast(req.fee) + ", minimum is: " + epee::string_tools::num_to_string_fast(w.get_wallet()->get_core_runtime_config().tx_pool_min_fee);
+      return false;
+    }
+
+    // a wrong address fails only its own destination, like anything else that prevents paying it
+    std::vector<tools::batch_transfer_destination> dsts;
+    std::vector<size_t> wrong_addresses;
+    for (const auto& d : req.destinations)
+    {
+      dsts.emplace_back();
+      tools::batch_transfer_destination& bd = dsts.back();
+      bd.dst.amount = d.amount;
+      bd.dst.asset_id = (d.asset_id == currency::null_pkey ? currency::native_coin_asset_id : d.asset_id);
+      currency::account_public_address addr = AUTO_VAL_INIT(addr);
+      if (currency::is_address_like_wrapped(d.address) || !w.get_wallet()->get_transfer_address(d.address, addr, bd.payment_id))
+      {
+        wrong_addresses.push_back(dsts.size() - 1);
+        continue;
+      }
+      bd.dst.addr.push_back(addr);
+    }
+
+    std::vector<tools::batch_transfer_result> results;
+    w.get_wallet()->transfer_batch(dsts, req.fee, req.mixin, req.push_payer, results);
+    for (size_t i : wrong_addresses)
+      results[i].error = std::string("WALLET_RPC_ERROR_CODE_WRONG_ADDRESS: ") + std::next(req.destinations.begin(), i)->address;
+
+    std::unordered_set<crypto::hash> tx_ids;
+    for (const tools::batch_transfer_result& r : results)
+    {
+      res.results.emplace_back();
+      res.results.back().error = r.error;
+      if (r.tx_id == currency::null_hash)
+        continue;
+      res.results.back().tx_hash = epee::string_tools::pod_to_hex(r.tx_id);
+      if (tx_ids.insert(r.tx_id).second)
+        res.tx_hashes.push_back(res.results.back().tx_hash);
+    }
+    return true;
+    WALLET_RPC_CATCH_TRY_ENTRY();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void wallet_rpc_server::async_jobs_worker()
+  {
+    std::unique_lock<std::mutex> lock(m_async_jobs_lock);
+    while (true)
+    {
+      m_async_jobs_cv.wait(lock, [this]() { return m_async_jobs_stop || !m_async_jobs_queue.empty(); });
+      if (m_async_jobs_stop)
+        return;
+
+      uint64_t job_id = m_async_jobs_queue.front();
+      m_async_jobs_queue.pop_front();
+      auto it = m_async_jobs.find(job_id);
+      if (it == m_async_jobs.end())
+        continue;
+      it->second.status = WALLET_RPC_ASYNC_JOB_STATUS_IN_PROGRESS;
+      wallet_public::COMMAND_RPC_TRANSFER::request req = it->second.req;
+      lock.unlock();
+
+      // the same as a synchronous call, it waits for the wallet lock like any other mutating call
+      wallet_public::COMMAND_RPC_TRANSFER::response res = AUTO_VAL_INIT(res);
+      epee::json_rpc::error er = AUTO_VAL_INIT(er);
+      connection_context cntx(RPC_INTERNAL_UI_CONTEXT, 0, 0, false);
+      bool r = on_transfer(req, res, er, cntx);
+      if (!r && !er.code)
+        er.code = WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR;
+      LOG_PRINT_L1("async transfer job " << job_id << (r ? " done" : " failed: ") << er.message);
+
+      lock.lock();
+      it = m_async_jobs.find(job_id);
+      if (it == m_async_jobs.end())
+        continue;
+      it->second.status = r ? WALLET_RPC_ASYNC_JOB_STATUS_DONE : WALLET_RPC_ASYNC_JOB_STATUS_FAILED;
+      it->second.res = res;
+      it->second.er = er;
+      it->second.finish_time = time(nullptr);
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void wallet_rpc_server::stop_async_jobs_worker()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_async_jobs_lock);
+      m_async_jobs_stop = true;
+    }
+    m_async_jobs_cv.notify_all();
+    if (m_async_jobs_thread.joinable())
+      m_async_jobs_thread.join();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_store(const wallet_public::COMMAND_RPC_STORE::request& req, wallet_public::COMMAND_RPC_STORE::response& res, epee::json_rpc::error& er, connection_context& cntx)
   {
     WALLET_RPC_BEGIN_TRY_ENTRY();
@@ -571,7 +865,7 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_get_payments(const wallet_public::COMMAND_RPC_GET_PAYMENTS::request& req, wallet_public::COMMAND_RPC_GET_PAYMENTS::response& res, epee::json_rpc::error& er, connection_context& cntx)
   {
-    WALLET_RPC_BEGIN_TRY_ENTRY();
+    WALLET_RPC_BEGIN_READ_ONLY_TRY_ENTRY("get_payments");
     std::string payment_id;
     if (!currency::parse_payment_id_from_hex_str(req.payment_id, payment_id))
     {
@@ -606,7 +900,7 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_get_bulk_payments(const wallet_public::COMMAND_RPC_GET_BULK_PAYMENTS::request& req, wallet_public::COMMAND_RPC_GET_BULK_PAYMENTS::response& res, epee::json_rpc::error& er, connection_context& cntx)
   {
-    WALLET_RPC_BEGIN_TRY_ENTRY();
+    WALLET_RPC_BEGIN_READ_ONLY_TRY_ENTRY("get_bulk_payments");
     res.payments.clear();
 
     for (auto & payment_id_str : req.payment_ids)
@@ -693,6 +987,33 @@ namespace tools
     WALLET_RPC_CATCH_TRY_ENTRY();
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_create_deposit_address(const wallet_public::COMMAND_RPC_CREATE_DEPOSIT_ADDRESS::request& req, wallet_public::COMMAND_RPC_CREATE_DEPOSIT_ADDRESS::response& res, epee::json_rpc::error& er, connection_context& cntx)
+  {
+    WALLET_RPC_BEGIN_TRY_ENTRY();
+    uint32_t deposit_index = w.get_wallet()->create_deposit_address(req.label);
+    res.deposit_index = deposit_index;
+    res.address = currency::get_account_address_as_str(w.get_wallet()->get_deposit_address(deposit_index));
+    return true;
+    WALLET_RPC_CATCH_TRY_ENTRY();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_get_deposit_addresses(const wallet_public::COMMAND_RPC_GET_DEPOSIT_ADDRESSES::request& req, wallet_public::COMMAND_RPC_GET_DEPOSIT_ADDRESSES::response& res, epee::json_rpc::error& er, connection_context& cntx)
+  {
+    WALLET_RPC_BEGIN_READ_ONLY_TRY_ENTRY("get_deposit_addresses");
+    const std::vector<std::string>& labels = w.get_wallet()->get_deposit_addresses_labels();
+    res.total_count = labels.size();
+    for (uint64_t i = req.offset; i < labels.size() && (req.count == 0 || res.addresses.size() < req.count); ++i)
+    {
+      wallet_public::deposit_address_details dad = AUTO_VAL_INIT(dad);
+      dad.deposit_index = i + 1;
+      dad.address = currency::get_account_address_as_str(w.get_wallet()->get_deposit_address(static_cast<uint32_t>(i + 1)));
+      dad.label = labels[i];
+      res.addresses.push_back(dad);
+    }
+    return true;
+    WALLET_RPC_CATCH_TRY_ENTRY();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_sweep_below(const wallet_public::COMMAND_SWEEP_BELOW::request& req, wallet_public::COMMAND_SWEEP_BELOW::response& res, epee::json_rpc::error& er, connection_context& cntx)
   {
     WALLET_RPC_BEGIN_TRY_ENTRY();
@@ -883,7 +1204,7 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_search_for_transactions2(const wallet_public::COMMAND_RPC_SEARCH_FOR_TRANSACTIONS::request& req, wallet_public::COMMAND_RPC_SEARCH_FOR_TRANSACTIONS::response& res, epee::json_rpc::error& er, connection_context& cntx)
   {
-    WALLET_RPC_BEGIN_TRY_ENTRY();
+    WALLET_RPC_BEGIN_READ_ONLY_TRY_ENTRY("search_for_transactions2");
     bool tx_id_specified = req.tx_id != currency::null_hash;
 
     // process confirmed txs
@@ -937,7 +1258,7 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_get_mining_history(const wallet_public::COMMAND_RPC_GET_MINING_HISTORY::request& req, wallet_public::COMMAND_RPC_GET_MINING_HISTORY::response& res, epee::json_rpc::error& er, connection_context& cntx)
   {
-    WALLET_RPC_BEGIN_TRY_ENTRY();
+    WALLET_RPC_BEGIN_READ_ONLY_TRY_ENTRY("get_mining_history");
     w.get_wallet()->get_mining_history(res, req.v);
     return true;
     WALLET_RPC_CATCH_TRY_ENTRY();
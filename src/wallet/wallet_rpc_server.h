@@ -6,6 +6,10 @@
 
 #pragma  once 
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
 #include "net/http_server_impl_base.h"
@@ -15,11 +19,24 @@
 
 #define ZANO_ACCESS_TOKEN "Zano-Access-Token"
 
+#define WALLET_RPC_THREADS_COUNT_DEFAULT                  4
+#define WALLET_RPC_READ_ONLY_CALLS_CACHE_MAX_ENTRIES      100
+#define WALLET_RPC_REFRESH_BLOCKS_PER_PART                100       // blocks applied at once while the wallet's lock is taken by the refresh worker
+#define WALLET_RPC_REFRESH_PAUSE_BETWEEN_PARTS_MS         2
+#define WALLET_RPC_REFRESH_MAX_RETRIES                    3         // pulled blocks not applied as the wallet was changed meanwhile, then it's refreshed as a whole
+#define WALLET_RPC_ASYNC_JOB_RESULT_TTL                   (60 * 60) // seconds a finished job can be polled for
+
+#define WALLET_RPC_ASYNC_JOB_STATUS_QUEUED                "queued"
+#define WALLET_RPC_ASYNC_JOB_STATUS_IN_PROGRESS           "in_progress"
+#define WALLET_RPC_ASYNC_JOB_STATUS_DONE                  "done"
+#define WALLET_RPC_ASYNC_JOB_STATUS_FAILED                "failed"
+
 namespace tools
 {
   struct i_wallet_provider
   {
     virtual void lock() {};
+    virtual bool try_lock() { lock(); return true; };
     virtual void unlock() {};
 //#ifndef MOBILE_WALLET_BUILD
     virtual std::shared_ptr<wallet2> get_wallet() = 0;
@@ -28,28 +45,42 @@ namespace tools
 
   struct wallet_rpc_locker
   {
-    wallet_rpc_locker(i_wallet_provider* wallet_provider) :m_pwallet_provider(wallet_provider)
+    // if only_if_free is set, the wallet is not waited for, is_locked() tells if it was taken
+    wallet_rpc_locker(i_wallet_provider* wallet_provider, bool only_if_free = false) :m_pwallet_provider(wallet_provider), m_locked(false)
     {
-      m_pwallet_provider->lock();
+      if (only_if_free)
+      {
+        if (!m_pwallet_provider->try_lock())
+          return;
+      }
+      else
+      {
+        m_pwallet_provider->lock();
+      }
+      m_locked = true;
 //#ifndef MOBILE_WALLET_BUILD
       m_wallet_ptr = m_pwallet_provider->get_wallet();
 //#endif   
       if (!m_wallet_ptr.get())
       {
+        m_pwallet_provider->unlock();
         throw std::runtime_error("Wallet object closed");
       }
     }
 
     std::shared_ptr<wallet2> get_wallet() { return m_wallet_ptr; }
+    bool is_locked() const { return m_locked; }
 
     ~wallet_rpc_locker()
     {
-      m_pwallet_provider->unlock();
+      if (m_locked)
+        m_pwallet_provider->unlock();
     }
 
   private:
     std::shared_ptr<wallet2> m_wallet_ptr;
     i_wallet_provider* m_pwallet_provider;
+    bool m_locked;
   };
 
 
@@ -57,6 +88,18 @@ namespace tools
   {
     wallet_provider_simple(std::shared_ptr<wallet2> wallet_ptr) : m_wallet_ptr(wallet_ptr)
     {}
+    virtual void lock()
+    {
+      m_lock.lock();
+    }
+    virtual bool try_lock()
+    {
+      return m_lock.try_lock();
+    }
+    virtual void unlock()
+    {
+      m_lock.unlock();
+    }
     virtual std::shared_ptr<wallet2> get_wallet()
     {
       return m_wallet_ptr;
@@ -64,6 +107,50 @@ namespace tools
 
   private:
     std::shared_ptr<wallet2> m_wallet_ptr;
+    std::recursive_mutex m_lock; // calls are served in several threads, and some of them make other calls
+  };
+
+
+  // last responses to read-only calls, given instead of waiting when the wallet is busy with a refresh or a mutating call,
+  // each one is a consistent state of the wallet as of the moment it was made
+  class read_only_calls_cache
+  {
+  public:
+    template<typename t_response>
+    bool get(const std::string& call_id, t_response& res)
+    {
+      std::shared_ptr<const void> res_ptr;
+      {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = m_responses.find(call_id);
+        if (it == m_responses.end())
+          return false;
+        res_ptr = it->second;
+      }
+      // call id starts with the call name, so it's always the same type
+      res = *std::static_pointer_cast<const t_response>(res_ptr);
+      return true;
+    }
+
+    template<typename t_response>
+    void put(const std::string& call_id, const t_response& res)
+    {
+      std::shared_ptr<const void> res_ptr = std::make_shared<t_response>(res);
+      std::lock_guard<std::mutex> lock(m_lock);
+      if (m_responses.size() >= WALLET_RPC_READ_ONLY_CALLS_CACHE_MAX_ENTRIES && !m_responses.count(call_id))
+        m_responses.clear();
+      m_responses[call_id] = res_ptr;
+    }
+
+    void clear()
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      m_responses.clear();
+    }
+
+  private:
+    std::mutex m_lock;
+    std::unordered_map<std::string, std::shared_ptr<const void>> m_responses;
   };
 
 
@@ -77,12 +164,14 @@ namespace tools
 
     wallet_rpc_server(std::shared_ptr<wallet2> wptr);
     wallet_rpc_server(i_wallet_provider* provider_ptr);
+    ~wallet_rpc_server();
 
     const static command_line::arg_descriptor<std::string> arg_rpc_bind_port;
     const static command_line::arg_descriptor<std::string> arg_rpc_bind_ip;
     const static command_line::arg_descriptor<std::string> arg_miner_text_info;
     const static command_line::arg_descriptor<bool>        arg_deaf_mode;
     const static command_line::arg_descriptor<std::string> arg_jwt_secret;
+    const static command_line::arg_descriptor<size_t>      arg_rpc_threads;
 
 
     static void init_options(boost::program_options::options_description& desc);
@@ -100,11 +189,16 @@ namespace tools
         MAP_JON_RPC_WE("get_recent_txs_and_info",   on_get_recent_txs_and_info,   wallet_public::COMMAND_RPC_GET_RECENT_TXS_AND_INFO) //LEGACY
         MAP_JON_RPC_WE("get_recent_txs_and_info2",  on_get_recent_txs_and_info2,  wallet_public::COMMAND_RPC_GET_RECENT_TXS_AND_INFO2)
         MAP_JON_RPC_WE("transfer",                  on_transfer,                  wallet_public::COMMAND_RPC_TRANSFER)
+        MAP_JON_RPC_WE("transfer_async",            on_transfer_async,            wallet_public::COMMAND_RPC_TRANSFER_ASYNC)
+        MAP_JON_RPC_WE("get_async_job_status",      on_get_async_job_status,      wallet_public::COMMAND_RPC_GET_ASYNC_JOB_STATUS)
+        MAP_JON_RPC_WE("transfer_batch",            on_transfer_batch,            wallet_public::COMMAND_RPC_TRANSFER_BATCH)
         MAP_JON_RPC_WE("store",                     on_store,                     wallet_public::COMMAND_RPC_STORE)
         MAP_JON_RPC_WE("get_payments",              on_get_payments,              wallet_public::COMMAND_RPC_GET_PAYMENTS)
         MAP_JON_RPC_WE("get_bulk_payments",         on_get_bulk_payments,         wallet_public::COMMAND_RPC_GET_BULK_PAYMENTS)
         MAP_JON_RPC_WE("make_integrated_address",   on_make_integrated_address,   wallet_public::COMMAND_RPC_MAKE_INTEGRATED_ADDRESS)
         MAP_JON_RPC_WE("split_integrated_address",  on_split_integrated_address,  wallet_public::COMMAND_RPC_SPLIT_INTEGRATED_ADDRESS)
+        MAP_JON_RPC_WE("create_deposit_address",    on_create_deposit_address,    wallet_public::COMMAND_RPC_CREATE_DEPOSIT_ADDRESS)
+        MAP_JON_RPC_WE("get_deposit_addresses",     on_get_deposit_addresses,     wallet_public::COMMAND_RPC_GET_DEPOSIT_ADDRESSES)
         MAP_JON_RPC_WE("sweep_below",               on_sweep_below,               wallet_public::COMMAND_SWEEP_BELOW)
         MAP_JON_RPC_WE("get_bare_outs_stats",       on_get_bare_outs_stats,       wallet_public::COMMAND_RPC_GET_BARE_OUTS_STATS)
         MAP_JON_RPC_WE("sweep_bare_outs",           on_sweep_bare_outs,           wallet_public::COMMAND_RPC_SWEEP_BARE_OUTS)
@@ -114,6 +208,7 @@ namespace tools
         MAP_JON_RPC_WE("search_for_transactions2",  on_search_for_transactions2,  wallet_public::COMMAND_RPC_SEARCH_FOR_TRANSACTIONS)
         MAP_JON_RPC_WE("get_restore_info",          on_getwallet_restore_info,    wallet_public::COMMAND_RPC_GET_WALLET_RESTORE_INFO)
         MAP_JON_RPC_WE("get_seed_phrase_info",      on_get_seed_phrase_info,      wallet_public::COMMAND_RPC_GET_SEED_PHRASE_INFO)
+        MAP_JON_RPC_WE("get_seed_phrases_info",     on_get_seed_phrases_info,     wallet_public::COMMAND_RPC_GET_SEED_PHRASES_INFO)
         MAP_JON_RPC_WE("get_mining_history",        on_get_mining_history,        wallet_public::COMMAND_RPC_GET_MINING_HISTORY)
         MAP_JON_RPC_WE("register_alias",            on_register_alias,            wallet_public::COMMAND_RPC_REGISTER_ALIAS)
         MAP_JON_RPC_WE("update_alias",              on_update_alias,              wallet_public::COMMAND_RPC_UPDATE_ALIAS)
@@ -173,14 +268,20 @@ namespace tools
     bool on_getwallet_info(const wallet_public::COMMAND_RPC_GET_WALLET_INFO::request& req, wallet_public::COMMAND_RPC_GET_WALLET_INFO::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_getwallet_restore_info(const wallet_public::COMMAND_RPC_GET_WALLET_RESTORE_INFO::request& req, wallet_public::COMMAND_RPC_GET_WALLET_RESTORE_INFO::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_get_seed_phrase_info(const wallet_public::COMMAND_RPC_GET_SEED_PHRASE_INFO::request& req, wallet_public::COMMAND_RPC_GET_SEED_PHRASE_INFO::response& res, epee::json_rpc::error& er, connection_context& cntx);
+    bool on_get_seed_phrases_info(const wallet_public::COMMAND_RPC_GET_SEED_PHRASES_INFO::request& req, wallet_public::COMMAND_RPC_GET_SEED_PHRASES_INFO::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_get_recent_txs_and_info(const wallet_public::COMMAND_RPC_GET_RECENT_TXS_AND_INFO::request& req, wallet_public::COMMAND_RPC_GET_RECENT_TXS_AND_INFO::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_get_recent_txs_and_info2(const wallet_public::COMMAND_RPC_GET_RECENT_TXS_AND_INFO2::request& req, wallet_public::COMMAND_RPC_GET_RECENT_TXS_AND_INFO2::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_transfer(const wallet_public::COMMAND_RPC_TRANSFER::request& req, wallet_public::COMMAND_RPC_TRANSFER::response& res, epee::json_rpc::error& er, connection_context& cntx);
+    bool on_transfer_async(const wallet_public::COMMAND_RPC_TRANSFER_ASYNC::request& req, wallet_public::COMMAND_RPC_TRANSFER_ASYNC::response& res, epee::json_rpc::error& er, connection_context& cntx);
+    bool on_get_async_job_status(const wallet_public::COMMAND_RPC_GET_ASYNC_JOB_STATUS::request& req, wallet_public::COMMAND_RPC_GET_ASYNC_JOB_STATUS::response& res, epee::json_rpc::error& er, connection_context& cntx);
+    bool on_transfer_batch(const wallet_public::COMMAND_RPC_TRANSFER_BATCH::request& req, wallet_public::COMMAND_RPC_TRANSFER_BATCH::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_store(const wallet_public::COMMAND_RPC_STORE::request& req, wallet_public::COMMAND_RPC_STORE::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_get_payments(const wallet_public::COMMAND_RPC_GET_PAYMENTS::request& req, wallet_public::COMMAND_RPC_GET_PAYMENTS::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_get_bulk_payments(const wallet_public::COMMAND_RPC_GET_BULK_PAYMENTS::request& req, wallet_public::COMMAND_RPC_GET_BULK_PAYMENTS::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_make_integrated_address(const wallet_public::COMMAND_RPC_MAKE_INTEGRATED_ADDRESS::request& req, wallet_public::COMMAND_RPC_MAKE_INTEGRATED_ADDRESS::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_split_integrated_address(const wallet_public::COMMAND_RPC_SPLIT_INTEGRATED_ADDRESS::request& req, wallet_public::COMMAND_RPC_SPLIT_INTEGRATED_ADDRESS::response& res, epee::json_rpc::error& er, connection_context& cntx);
+    bool on_create_deposit_address(const wallet_public::COMMAND_RPC_CREATE_DEPOSIT_ADDRESS::request& req, wallet_public::COMMAND_RPC_CREATE_DEPOSIT_ADDRESS::response& res, epee::json_rpc::error& er, connection_context& cntx);
+    bool on_get_deposit_addresses(const wallet_public::COMMAND_RPC_GET_DEPOSIT_ADDRESSES::request& req, wallet_public::COMMAND_RPC_GET_DEPOSIT_ADDRESSES::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_sweep_below(const wallet_public::COMMAND_SWEEP_BELOW::request& req, wallet_public::COMMAND_SWEEP_BELOW::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_get_bare_outs_stats(const wallet_public::COMMAND_RPC_GET_BARE_OUTS_STATS ::request& req, wallet_public::COMMAND_RPC_GET_BARE_OUTS_STATS::response& res, epee::json_rpc::error& er, connection_context& cntx);
     bool on_sweep_bare_outs(const wallet_public::COMMAND_RPC_SWEEP_BARE_OUTS::request& req, wallet_public::COMMAND_RPC_SWEEP_BARE_OUTS::response& res, epee::json_rpc::error& er, connection_context& cntx);
@@ -241,6 +342,22 @@ namespace tools
     void rpc_destinations_to_currency_destination(const std::list<wallet_public::transfer_destination>& rpc_destinations, std::vector<currency::tx_destination_entry>& currency_destinations);
 
   private:
+    // transfers made in the background, in the order they were asked for, one by one
+    struct async_transfer_job
+    {
+      wallet_public::COMMAND_RPC_TRANSFER::request req;
+      wallet_public::COMMAND_RPC_TRANSFER::response res;
+      epee::json_rpc::error er;
+      std::string status;
+      time_t finish_time;
+    };
+
+    void async_jobs_worker();
+    void stop_async_jobs_worker();
+    void refresh_worker(const currency::account_public_address& miner_address);
+    bool refresh_wallet_in_parts();
+    void stop_refresh_worker();
+
     std::shared_ptr<i_wallet_provider> m_pwallet_provider_sh_ptr;
     i_wallet_provider* m_pwallet_provider;
     std::string m_port;
@@ -250,6 +367,23 @@ namespace tools
     uint64_t m_last_wallet_store_height;
     std::string m_jwt_secret;
     epee::misc_utils::expirating_set<std::string, uint64_t> m_jwt_used_salts;
+    std::mutex m_jwt_used_salts_lock;
+    size_t m_threads_count;
+    bool m_read_only_calls_cache_enabled;
+    read_only_calls_cache m_read_only_calls_cache;
+
+    std::mutex m_async_jobs_lock;
+    std::condition_variable m_async_jobs_cv;
+    std::map<uint64_t, async_transfer_job> m_async_jobs;
+    std::deque<uint64_t> m_async_jobs_queue;
+    uint64_t m_async_jobs_last_id;
+    bool m_async_jobs_stop;
+    std::thread m_async_jobs_thread;
+
+    std::mutex m_refresh_lock;
+    std::condition_variable m_refresh_cv;
+    std::atomic<bool> m_refresh_stop;
+    std::thread m_refresh_thread;
   };
 
 } // namespace tools
@@ -15,6 +15,7 @@
 #include "string_coding.h"
 #include "wallet_helpers.h"
 #include "core_default_rpc_proxy.h"
+#include "core_multi_daemon_proxy.h"
 #include "common/db_backend_selector.h"
 #include "common/pre_download.h"
 #include "wallet/wrap_service.h"
@@ -40,6 +41,8 @@
     return; \
   auto& name = it->second;
 
+#define WALLETS_MANAGER_TRANSFERS_DELIVERY_INTERVAL   500   // ms
+
 #ifdef MOBILE_WALLET_BUILD
   #define DAEMON_IDLE_UPDATE_TIME_MS        10000
   #define TX_POOL_SCAN_INTERVAL             5
@@ -55,7 +58,7 @@ const command_line::arg_descriptor<bool> arg_alloc_win_console  ( "alloc-win-con
 const command_line::arg_descriptor<std::string> arg_html_folder  ( "html-path", "Manually set GUI html folder path");
 const command_line::arg_descriptor<bool> arg_enable_gui_debug_mode  ( "gui-debug-mode", "Enable debug options in GUI");
 const command_line::arg_descriptor<uint32_t> arg_qt_remote_debugging_port  ( "remote-debugging-port", "Specify port for Qt remote debugging");
-const command_line::arg_descriptor<std::string> arg_remote_node  ( "remote-node", "Switch GUI to work with remote node instead of local daemon");
+const command_line::arg_descriptor<std::string> arg_remote_node  ( "remote-node", "Switch GUI to work with remote node instead of local daemon, several nodes may be given separated by commas");
 const command_line::arg_descriptor<bool> arg_enable_qt_logs  ( "enable-qt-logs", "Forward Qt log messages into main log");
 const command_line::arg_descriptor<bool> arg_disable_logs_init("disable-logs-init", "Disable log initialization in GUI");
 const command_line::arg_descriptor<std::string> arg_qt_dev_tools  ( "qt-dev-tools", "Enable main web page inspection with Chromium DevTools, <vertical|horizontal>[,scale], e.g. \"horizontal,1.3\"", "");
@@ -193,6 +196,7 @@ bool wallets_manager::init_command_line(int argc, char* argv[], std::string& fai
   command_line::add_arg(desc_cmd_sett, command_line::arg_predownload_link);
   command_line::add_arg(desc_cmd_only, command_line::arg_deeplink);
   command_line::add_arg(desc_cmd_sett, command_line::arg_disable_ntp);
+  command_line::add_arg(desc_cmd_sett, command_line::arg_p2p_compression);
   command_line::add_arg(desc_cmd_sett, arg_disable_price_fetch);
   
 
@@ -365,9 +369,21 @@ bool wallets_manager::init(view::i_view* pview_handler)
   if (command_line::has_arg(m_vm, arg_remote_node))
   {
     m_remote_node_mode = true;
-    auto proxy_ptr = new tools::default_http_core_proxy();
-    proxy_ptr->set_connectivity(HTTP_PROXY_TIMEOUT,  HTTP_PROXY_ATTEMPTS_COUNT);
-    m_rpc_proxy.reset(proxy_ptr);    
+    if (command_line::get_arg(m_vm, arg_remote_node).find(',') != std::string::npos)
+    {
+      // several nodes: each request goes to the best one of them
+      auto proxy_ptr = new tools::multi_daemon_core_proxy();
+      proxy_ptr->set_connectivity(HTTP_PROXY_TIMEOUT, HTTP_PROXY_ATTEMPTS_COUNT);
+      proxy_ptr->enable_pulled_blocks_cache();
+      m_rpc_proxy.reset(proxy_ptr);
+    }
+    else
+    {
+      auto proxy_ptr = new tools::default_http_core_proxy();
+      proxy_ptr->set_connectivity(HTTP_PROXY_TIMEOUT,  HTTP_PROXY_ATTEMPTS_COUNT);
+      proxy_ptr->enable_pulled_blocks_cache(); // shared by all the opened wallets
+      m_rpc_proxy.reset(proxy_ptr);
+    }
     m_rpc_proxy->set_connection_addr(command_line::get_arg(m_vm, arg_remote_node));
     m_pproxy_diganostic_info = m_rpc_proxy->get_proxy_diagnostic_info();
   }
@@ -556,7 +572,7 @@ bool wallets_manager::init_local_daemon()
   LOG_PRINT_L0("Starting core rpc server...");
   //dsi.text_state = "Starting core rpc server";
   m_pview->update_daemon_status(dsi);
-  res = m_rpc_server.run(2, false);
+  res = m_rpc_server.run(m_rpc_server.get_threads_count(), false);
   CHECK_AND_ASSERT_AND_SET_GUI(res, "Failed to initialize core rpc server.");
   LOG_PRINT_L0("Core rpc server started ok");
 
@@ -875,7 +891,10 @@ std::string wallets_manager::export_wallet_history(const view::export_wallet_inf
     boost::filesystem::ofstream fstream;
     fstream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
     fstream.open(ewi.path, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
-    wo.w->get()->export_transaction_history(fstream, ewi.format, ewi.include_pos_transactions);
+    // the wallet is locked for a part at a time, so the big ones keep working during export
+    uint64_t cursor = 0;
+    while (!wo.w->get()->export_transaction_history_part(fstream, ewi.format, ewi.include_pos_transactions, cursor, WALLET_HISTORY_EXPORT_PART_ENTRIES_COUNT))
+      fstream.flush();
     fstream.close();
   }
   catch (...)
@@ -1043,9 +1062,11 @@ std::string wallets_manager::open_wallet(const std::wstring& path, const std::st
 
   std::shared_ptr<tools::wallet2> w(new tools::wallet2());
   w->set_use_deffered_global_outputs(m_use_deffered_global_outputs);
+  w->set_offload_history_txs(true);
   owr.wallet_id = m_wallet_id_counter++;
 
   w->callback(std::shared_ptr<tools::i_wallet2_callback>(new i_wallet_to_i_backend_adapter(this, owr.wallet_id)));
+  w->set_batch_transfer_callbacks(true);
   if (m_remote_node_mode)
   {
     w->set_core_proxy(m_rpc_proxy);
@@ -1168,9 +1189,11 @@ std::string wallets_manager::generate_wallet(const std::wstring& path, const std
 {
   std::shared_ptr<tools::wallet2> w(new tools::wallet2());
   w->set_use_deffered_global_outputs(m_use_deffered_global_outputs);
+  w->set_offload_history_txs(true);
   w->set_votes_config_path(m_data_dir + "/" + CURRENCY_VOTING_CONFIG_DEFAULT_FILENAME);
   owr.wallet_id = m_wallet_id_counter++;
   w->callback(std::shared_ptr<tools::i_wallet2_callback>(new i_wallet_to_i_backend_adapter(this, owr.wallet_id)));
+  w->set_batch_transfer_callbacks(true);
   if (m_remote_node_mode)
   {
     w->set_core_proxy(m_rpc_proxy);
@@ -1275,9 +1298,11 @@ std::string wallets_manager::restore_wallet(const std::wstring& path, const std:
 {
   std::shared_ptr<tools::wallet2> w(new tools::wallet2());
   w->set_use_deffered_global_outputs(m_use_deffered_global_outputs);
+  w->set_offload_history_txs(true);
   w->set_votes_config_path(m_data_dir + "/" + CURRENCY_VOTING_CONFIG_DEFAULT_FILENAME);
   owr.wallet_id = m_wallet_id_counter++;
   w->callback(std::shared_ptr<tools::i_wallet2_callback>(new i_wallet_to_i_backend_adapter(this, owr.wallet_id)));
+  w->set_batch_transfer_callbacks(true);
   if (m_remote_node_mode)
   {
     w->set_core_proxy(m_rpc_proxy);
@@ -2030,6 +2055,24 @@ void wallets_manager::on_transfer2(size_t wallet_id, const tools::wallet_public:
     m_pview->money_transfer(tei);
   }
 }
+void wallets_manager::on_transfers_batch(size_t wallet_id, const std::vector<tools::wallet_public::wallet_transfer_info>& wtis, const std::list<tools::wallet_public::asset_balance_entry>& balances, uint64_t total_mined)
+{
+  GET_WALLET_OPTIONS_BY_ID_VOID_RET(wallet_id, w);
+  if (w.w->get()->is_watch_only())
+    return;
+
+  CRITICAL_REGION_LOCAL1(w.pending_transfers_lock);
+  view::transfers_batch_event_info& tbi = w.pending_transfers;
+  tbi.transfers.insert(tbi.transfers.end(), wtis.begin(), wtis.end());
+  tbi.balances = balances;
+  tbi.total_mined = total_mined;
+  tbi.wallet_id = wallet_id;
+  tbi.is_wallet_in_sync_process = w.long_refresh_in_progress;
+  // batches of a rescan are coalesced, the rest is given at the end of the refresh
+  if (tbi.is_wallet_in_sync_process && epee::misc_utils::get_tick_count() - w.last_transfers_delivery_ms < WALLETS_MANAGER_TRANSFERS_DELIVERY_INTERVAL)
+    return;
+  w.deliver_pending_transfers();
+}
 void wallets_manager::on_pos_block_found(size_t wallet_id, const currency::block& b)
 {
   m_pview->pos_block_found(b);
@@ -2206,7 +2249,12 @@ void wallets_manager::wallet_vs_options::worker_func()
           }
           w->get()->refresh(stop_for_refresh);
           long_refresh_in_progress = false;
+          {
+            CRITICAL_REGION_LOCAL(pending_transfers_lock);
+            deliver_pending_transfers();
+          }
           w->get()->resend_unconfirmed();
+          w->get()->refill_zc_decoys_pool();
           {
             auto w_ptr = *w; // get locked exclusive access to the wallet first (it's more likely that wallet is locked for a long time than 'offers')
             auto offers_list_proxy = *offers; // than get locked exclusive access to offers
@@ -2300,6 +2348,16 @@ void wallets_manager::wallet_vs_options::worker_func()
   }
   LOG_PRINT_GREEN("[WALLET_HANDLER] Wallet thread thread stopped", LOG_LEVEL_0);
 }
+// pending_transfers_lock is to be held
+void wallets_manager::wallet_vs_options::deliver_pending_transfers()
+{
+  if (pending_transfers.transfers.empty())
+    return;
+  last_transfers_delivery_ms = epee::misc_utils::get_tick_count();
+  pview->money_transfers_batch(pending_transfers);
+  pending_transfers.transfers.clear();
+}
+
 void wallets_manager::wallet_vs_options::stop(bool wait)
 {
   w.unlocked_get()->stop();
@@ -74,6 +74,11 @@ public:
     std::atomic<bool> need_to_update_wallet_info;
     std::atomic<bool> long_refresh_in_progress;
     epee::critical_section long_refresh_in_progress_lock; //secure wallet state and prevent from long wait while long refresh is in work
+    // transfer batches of a long refresh are given to the view once in WALLETS_MANAGER_TRANSFERS_DELIVERY_INTERVAL ms at most
+    view::transfers_batch_event_info pending_transfers;
+    uint64_t last_transfers_delivery_ms = 0;
+    epee::critical_section pending_transfers_lock;
+    void deliver_pending_transfers();
 
     view::i_view* pview;
     uint64_t wallet_id;
@@ -197,6 +202,7 @@ private:
   //----- i_backend_wallet_callback ------
   virtual void on_new_block(size_t wallet_id, uint64_t height, const currency::block& block) override;
   virtual void on_transfer2(size_t wallet_id, const tools::wallet_public::wallet_transfer_info& wti, const std::list<tools::wallet_public::asset_balance_entry>& balances, uint64_t total_mined) override;
+  virtual void on_transfers_batch(size_t wallet_id, const std::vector<tools::wallet_public::wallet_transfer_info>& wtis, const std::list<tools::wallet_public::asset_balance_entry>& balances, uint64_t total_mined) override;
   virtual void on_pos_block_found(size_t wallet_id, const currency::block& /*block*/) override;
   virtual void on_sync_progress(size_t wallet_id, const uint64_t& /*percents*/) override;
   virtual void on_transfer_canceled(size_t wallet_id, const tools::wallet_public::wallet_transfer_info& wti) override;
@@ -401,7 +401,7 @@ bool atomic_test_wrong_redeem_wrong_refund::c1(currency::core& c, size_t ev_inde
 
   //truncte blockchain
   c.get_tx_pool().clear();
-  c.get_blockchain_storage().truncate_blockchain(c.get_blockchain_storage().get_current_blockchain_size() - 8);
+  c.get_blockchain_storage().truncate_blockchain(c.get_blockchain_storage().get_current_blockchain_size() - 8, true);
 
 
   double_spend_test_instance_2->refresh();
@@ -583,7 +583,7 @@ bool atomic_test_altchain_simple::c1(currency::core& c, size_t ev_index, const s
   r = mine_next_pow_blocks_in_playtime_with_given_txs(m_mining_accunt.get_public_address(), txs, c, 4, split_id_2);
   CHECK_AND_ASSERT_MES(r, false, "mine_next_pow_blocks_in_playtime failed");
 
-  c.get_blockchain_storage().truncate_blockchain(c.get_top_block_height() - 2);
+  c.get_blockchain_storage().truncate_blockchain(c.get_top_block_height() - 2, true);
 
   //make sure reorganize happened
   crypto::hash id_new_chain_2 = c.get_blockchain_storage().get_block_id_by_height(split_height_2 + 1);
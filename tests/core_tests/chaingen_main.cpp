@@ -1174,6 +1174,8 @@ int main(int argc, char* argv[])
     GENERATE_AND_PLAY_HF(gen_block_unlock_time_is_high, "0,3");
     GENERATE_AND_PLAY_HF(gen_block_unlock_time_is_timestamp_in_past, "0,3");
     GENERATE_AND_PLAY_HF(gen_block_unlock_time_is_timestamp_in_future, "0,3");
+    GENERATE_AND_PLAY_HF(early_block_relay_test, "0,3");
+    GENERATE_AND_PLAY_HF(compact_blocks_and_sync_batch_in_flight, "0,3");
     GENERATE_AND_PLAY_HF(gen_block_height_is_low, "0,3");
     GENERATE_AND_PLAY_HF(gen_block_height_is_high, "0,3");
     GENERATE_AND_PLAY_HF(gen_block_miner_tx_has_2_tx_gen_in, "0,3");
@@ -1229,6 +1231,7 @@ int main(int argc, char* argv[])
     GENERATE_AND_PLAY(gen_double_spend_in_alt_chain_in_the_same_block<true>);
     GENERATE_AND_PLAY(gen_double_spend_in_alt_chain_in_different_blocks<false>);
     GENERATE_AND_PLAY(gen_double_spend_in_alt_chain_in_different_blocks<true>);
+    GENERATE_AND_PLAY(gen_double_spend_in_alt_chain_after_reorg);
 
     GENERATE_AND_PLAY(gen_uint_overflow_1);
     GENERATE_AND_PLAY(gen_uint_overflow_2);
@@ -45,4 +45,6 @@
 #include "multiassets_test.h"
 #include "ionic_swap_tests.h"
 #include "attachment_isolation_encryption_test.h"
-#include "pos_fuse_test.h"
\ No newline at end of file
+#include "pos_fuse_test.h"
+#include "early_block_relay.h"
+#include "compact_blocks.h"
\ No newline at end of file
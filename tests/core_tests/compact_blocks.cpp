@@ -0,0 +1,151 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chaingen.h"
+#include "compact_blocks.h"
+#include "version.h"
+#include "currency_protocol/currency_protocol_handler.h"
+
+#include <boost/uuid/uuid_generators.hpp>
+
+using namespace currency;
+
+namespace
+{
+  // keeps the requests made to the peer
+  struct requests_p2p_stub : public nodetool::p2p_endpoint_stub<currency_connection_context>
+  {
+    requests_p2p_stub()
+      : drops_count(0)
+    {}
+
+    using nodetool::p2p_endpoint_stub<currency_connection_context>::invoke_notify_to_peer;
+    virtual bool invoke_notify_to_peer(int command, const std::string& req_buff, const epee::net_utils::connection_context_base& context)
+    {
+      if (command == NOTIFY_REQUEST_GET_OBJECTS::ID)
+      {
+        NOTIFY_REQUEST_GET_OBJECTS::request req = AUTO_VAL_INIT(req);
+        if (epee::serialization::load_t_from_binary(req, req_buff))
+          get_objects_requests.push_back(req);
+      }
+      return true;
+    }
+    virtual bool drop_connection(const epee::net_utils::connection_context_base& context)
+    {
+      ++drops_count;
+      return true;
+    }
+
+    std::list<NOTIFY_REQUEST_GET_OBJECTS::request> get_objects_requests;
+    size_t drops_count;
+  };
+
+  template<class t_command>
+  bool notify(t_currency_protocol_handler<core>& handler, typename t_command::request& arg, currency_connection_context& context)
+  {
+    std::string buff, buff_out;
+    epee::serialization::store_t_to_binary(arg, buff);
+    bool handled = false;
+    handler.handle_invoke_map(true, t_command::ID, buff, buff_out, context, handled);
+    return handled;
+  }
+}
+
+compact_blocks_and_sync_batch_in_flight::compact_blocks_and_sync_batch_in_flight()
+{
+  REGISTER_CALLBACK_METHOD(compact_blocks_and_sync_batch_in_flight, c1);
+}
+
+bool compact_blocks_and_sync_batch_in_flight::generate(std::vector<test_event_entry>& events) const
+{
+  GENERATE_ACCOUNT(miner_account);
+  GENERATE_ACCOUNT(alice_account);
+  MAKE_GENESIS_BLOCK(events, blk_0, miner_account, 1338224400);
+  DO_CALLBACK(events, "configure_core");
+  REWIND_BLOCKS_N(events, blk_0r, blk_0, miner_account, CURRENCY_MINED_MONEY_UNLOCK_WINDOW);
+
+  // the rest comes over the protocol only: two compact blocks, each with a tx the core's pool doesn't have,
+  // and a longer chain to be synchronized, all of them on top of blk_0r
+  MAKE_TX(events, tx_1, miner_account, alice_account, MK_TEST_COINS(1), blk_0r);
+  events.pop_back();
+  MAKE_TX(events, tx_2, miner_account, alice_account, MK_TEST_COINS(2), blk_0r);
+  events.pop_back();
+  MAKE_NEXT_BLOCK_TX1(events, blk_1a, blk_0r, miner_account, tx_1);
+  events.pop_back();
+  MAKE_NEXT_BLOCK_TX1(events, blk_1b, blk_0r, miner_account, tx_2);
+  events.pop_back();
+  m_compact_blocks = { blk_1a, blk_1b };
+  m_compact_blocks_txs = { tx_1, tx_2 };
+
+  MAKE_NEXT_BLOCK(events, blk_1, blk_0r, miner_account);
+  MAKE_NEXT_BLOCK(events, blk_2, blk_1, miner_account);
+  MAKE_NEXT_BLOCK(events, blk_3, blk_2, miner_account);
+  events.pop_back();
+  events.pop_back();
+  events.pop_back();
+  m_sync_blocks = { blk_0r, blk_1, blk_2, blk_3 };
+
+  DO_CALLBACK(events, "c1");
+  DO_CALLBACK_PARAMS(events, "check_top_block", params_top_block(blk_3));
+
+  return true;
+}
+
+bool compact_blocks_and_sync_batch_in_flight::c1(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  requests_p2p_stub p2p;
+  t_currency_protocol_handler<core> handler(c, &p2p);
+
+  currency_connection_context peer;
+  static_cast<epee::net_utils::connection_context_base&>(peer) = epee::net_utils::connection_context_base(boost::uuids::random_generator()(), 0, 0, false);
+  peer.m_state = currency_connection_context::state_synchronizing;
+  peer.m_remote_protocol_features = CURRENCY_PROTOCOL_FEATURE_COMPACT_BLOCKS;
+
+  // the sync batch
+  NOTIFY_RESPONSE_CHAIN_ENTRY::request chain_entry = AUTO_VAL_INIT(chain_entry);
+  chain_entry.start_height = get_block_height(m_sync_blocks.front());
+  chain_entry.total_height = get_block_height(m_sync_blocks.back()) + 1;
+  for (const block& b : m_sync_blocks)
+    chain_entry.m_block_ids.push_back(block_context_info{ get_block_hash(b), get_object_blobsize(b) });
+  CHECK_TEST_CONDITION(notify<NOTIFY_RESPONSE_CHAIN_ENTRY>(handler, chain_entry, peer));
+  CHECK_EQ(1, p2p.get_objects_requests.size());
+  CHECK_EQ(m_sync_blocks.size() - 1, p2p.get_objects_requests.back().blocks.size());
+
+  // the compact blocks, their txs are requested while the batch is still in flight
+  peer.m_state = currency_connection_context::state_normal;
+  for (const block& b : m_compact_blocks)
+  {
+    NOTIFY_NEW_BLOCK::request nb = AUTO_VAL_INIT(nb);
+    nb.b.block = t_serializable_object_to_blob(b);
+    nb.current_blockchain_height = chain_entry.total_height;
+    CHECK_TEST_CONDITION(notify<NOTIFY_NEW_BLOCK>(handler, nb, peer));
+  }
+  CHECK_EQ(3, p2p.get_objects_requests.size());
+  CHECK_EQ(1, p2p.get_objects_requests.back().txs.size());
+  CHECK_EQ(0, p2p.drops_count);
+
+  // responses to the txs requests come in the reverse order, then the one to the sync batch
+  for (size_t i = m_compact_blocks.size(); i-- != 0; )
+  {
+    NOTIFY_RESPONSE_GET_OBJECTS::request rsp = AUTO_VAL_INIT(rsp);
+    rsp.txs.push_back(t_serializable_object_to_blob(m_compact_blocks_txs[i]));
+    rsp.current_blockchain_height = chain_entry.total_height;
+    CHECK_TEST_CONDITION(notify<NOTIFY_RESPONSE_GET_OBJECTS>(handler, rsp, peer));
+    CHECK_TEST_CONDITION(c.get_blockchain_storage().have_block(get_block_hash(m_compact_blocks[i])));
+  }
+  CHECK_EQ(0, p2p.drops_count);
+
+  NOTIFY_RESPONSE_GET_OBJECTS::request rsp = AUTO_VAL_INIT(rsp);
+  for (size_t i = 1; i < m_sync_blocks.size(); ++i)
+  {
+    rsp.blocks.push_back(block_complete_entry());
+    rsp.blocks.back().block = t_serializable_object_to_blob(m_sync_blocks[i]);
+  }
+  rsp.current_blockchain_height = chain_entry.total_height;
+  CHECK_TEST_CONDITION(notify<NOTIFY_RESPONSE_GET_OBJECTS>(handler, rsp, peer));
+  CHECK_EQ(0, p2p.drops_count);
+  CHECK_EQ(get_block_hash(m_sync_blocks.back()), c.get_blockchain_storage().get_top_block_id());
+
+  return true;
+}
@@ -0,0 +1,19 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#pragma once
+#include "chaingen.h"
+
+// compact NOTIFY_NEW_BLOCKs waiting for their missing txs and a sync batch are in flight on the same connection,
+// each NOTIFY_RESPONSE_GET_OBJECTS is to be matched with its own request whatever the order they come in
+struct compact_blocks_and_sync_batch_in_flight : public test_chain_unit_enchanced
+{
+  compact_blocks_and_sync_batch_in_flight();
+  bool generate(std::vector<test_event_entry>& events) const;
+  bool c1(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+
+private:
+  mutable std::vector<currency::block> m_sync_blocks;
+  mutable std::vector<currency::block> m_compact_blocks;
+  mutable std::vector<currency::transaction> m_compact_blocks_txs;
+};
@@ -69,3 +69,65 @@ bool gen_double_spend_in_different_chains::check_double_spend(currency::core& c,
 
   return true;
 }
+
+//======================================================================================================================
+
+gen_double_spend_in_alt_chain_after_reorg::gen_double_spend_in_alt_chain_after_reorg()
+{
+  REGISTER_CALLBACK_METHOD(gen_double_spend_in_alt_chain_after_reorg, check_alt_blocks);
+}
+
+bool gen_double_spend_in_alt_chain_after_reorg::generate(std::vector<test_event_entry>& events) const
+{
+  // An alt block (4a) forks off the main chain above a block with tx_1 (2). Then the chain is switched to (2b)-...-(5b),
+  // so (2)-(3)-(4) become alt blocks, and (4a) now has them in its alt chain.
+  // A block on top of (4a) that spends the same input as tx_1 has to be rejected.
+  //
+  // ... (1r)-   (2 )-   (3 )-   (4 )-              <- main chain before the switch
+  //       |     tx_1      |
+  //       |               \-    (4a)-   (5a)      <- 5a is invalid: tx_2 spends the same input as tx_1
+  //       |                             tx_2
+  //       \-   (2b)-   (3b)-   (4b)-   (5b)      <- main chain after the switch
+
+  INIT_DOUBLE_SPEND_TEST();
+
+  SET_EVENT_VISITOR_SETT(events, event_visitor_settings::set_txs_kept_by_block, true);
+  MAKE_TX(events, tx_1, bob_account, alice_account, send_amount - TESTS_DEFAULT_FEE, blk_1);
+  events.pop_back();
+  MAKE_TX(events, tx_2, bob_account, alice_account, send_amount - TESTS_DEFAULT_FEE, blk_1);
+  events.pop_back();
+
+  // Main chain
+  events.push_back(tx_1);
+  MAKE_NEXT_BLOCK_TX1(events, blk_2, blk_1r, miner_account, tx_1);
+  MAKE_NEXT_BLOCK(events, blk_3, blk_2, miner_account);
+  MAKE_NEXT_BLOCK(events, blk_4, blk_3, miner_account);
+
+  // Alt block on top of blk_3
+  MAKE_NEXT_BLOCK(events, blk_4a, blk_3, miner_account);
+  DO_CALLBACK_PARAMS(events, "check_top_block", params_top_block(blk_4));
+
+  // Switch to another chain
+  MAKE_NEXT_BLOCK(events, blk_2b, blk_1r, miner_account);
+  MAKE_NEXT_BLOCK(events, blk_3b, blk_2b, miner_account);
+  MAKE_NEXT_BLOCK(events, blk_4b, blk_3b, miner_account);
+  MAKE_NEXT_BLOCK(events, blk_5b, blk_4b, miner_account);
+  DO_CALLBACK_PARAMS(events, "check_top_block", params_top_block(blk_5b));
+
+  // Extend blk_4a with a double spend of tx_1's input
+  events.push_back(tx_2);
+  DO_CALLBACK(events, "mark_invalid_block");
+  MAKE_NEXT_BLOCK_TX1(events, blk_5a, blk_4a, miner_account, tx_2);
+
+  DO_CALLBACK_PARAMS(events, "check_top_block", params_top_block(blk_5b));
+  DO_CALLBACK(events, "check_alt_blocks");
+
+  return true;
+}
+
+bool gen_double_spend_in_alt_chain_after_reorg::check_alt_blocks(currency::core& c, size_t /*ev_index*/, const std::vector<test_event_entry>& /*events*/)
+{
+  // blk_2, blk_3, blk_4 and blk_4a
+  CHECK_EQ(4, c.get_alternative_blocks_count());
+  return true;
+}
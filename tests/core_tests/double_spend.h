@@ -100,6 +100,17 @@ public:
   bool check_double_spend(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
 };
 
+struct gen_double_spend_in_alt_chain_after_reorg : public test_chain_unit_enchanced
+{
+  static const uint64_t send_amount = MK_TEST_COINS(10);
+
+  gen_double_spend_in_alt_chain_after_reorg();
+
+  bool generate(std::vector<test_event_entry>& events) const;
+
+  bool check_alt_blocks(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+};
+
 
 #define INIT_DOUBLE_SPEND_TEST()                                           \
   uint64_t ts_start = 1338224400;                                          \
@@ -0,0 +1,184 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chaingen.h"
+#include "early_block_relay.h"
+#include "version.h"
+#include "currency_protocol/currency_protocol_handler.h"
+
+#include <boost/uuid/uuid_generators.hpp>
+
+using namespace currency;
+
+namespace
+{
+  // one peer to relay to, keeps what was sent to it and how the sender was treated
+  struct early_relay_p2p_stub : public nodetool::p2p_endpoint_stub<currency_connection_context>
+  {
+    early_relay_p2p_stub()
+      : drops_count(0)
+      , ip_fails_count(0)
+    {
+      static_cast<epee::net_utils::connection_context_base&>(peer) = epee::net_utils::connection_context_base(boost::uuids::random_generator()(), 0, 0, false);
+      peer.m_state = currency_connection_context::state_normal;
+      peer.m_remote_protocol_features = CURRENCY_PROTOCOL_FEATURE_COMPACT_BLOCKS;
+    }
+
+    virtual bool invoke_notify_to_peer(int command, const epee::net_utils::shared_buffer& req_buff, const epee::net_utils::connection_context_base& context)
+    {
+      if (command == NOTIFY_NEW_BLOCK::ID)
+        relayed_blocks.push_back(*req_buff);
+      return true;
+    }
+    virtual bool drop_connection(const epee::net_utils::connection_context_base& context)
+    {
+      ++drops_count;
+      return true;
+    }
+    virtual bool add_ip_fail(uint32_t adress)
+    {
+      ++ip_fails_count;
+      return true;
+    }
+    virtual void get_connections(std::list<currency_connection_context>& connections)
+    {
+      connections.push_back(peer);
+    }
+
+    currency_connection_context peer;
+    std::list<std::string> relayed_blocks;
+    size_t drops_count;
+    size_t ip_fails_count;
+  };
+
+  bool notify_new_block(t_currency_protocol_handler<core>& handler, const blobdata& block_blob, bool prevalidated_only, currency_connection_context& context)
+  {
+    NOTIFY_NEW_BLOCK::request arg = AUTO_VAL_INIT(arg);
+    arg.b.block = block_blob;
+    arg.prevalidated_only = prevalidated_only;
+    std::string buff, buff_out;
+    epee::serialization::store_t_to_binary(arg, buff);
+    bool handled = false;
+    handler.handle_invoke_map(true, NOTIFY_NEW_BLOCK::ID, buff, buff_out, context, handled);
+    return handled;
+  }
+}
+
+early_block_relay_test::early_block_relay_test()
+  : m_invalid_blocks_relayed(0)
+{
+  REGISTER_CALLBACK_METHOD(early_block_relay_test, relay_block_early);
+  REGISTER_CALLBACK_METHOD(early_block_relay_test, relay_invalid_block_with_feature);
+  REGISTER_CALLBACK_METHOD(early_block_relay_test, relay_invalid_block_without_feature);
+
+  m_relayer_context.m_state = currency_connection_context::state_normal;
+  m_relayer_context.m_remote_protocol_features = CURRENCY_PROTOCOL_FEATURE_COMPACT_BLOCKS | CURRENCY_PROTOCOL_FEATURE_EARLY_BLOCK_RELAY;
+}
+
+bool early_block_relay_test::generate(std::vector<test_event_entry>& events) const
+{
+  GENERATE_ACCOUNT(miner_account);
+  MAKE_GENESIS_BLOCK(events, blk_0, miner_account, 1338224400);
+  DO_CALLBACK(events, "configure_core");
+
+  // blk_1 comes over the protocol only
+  MAKE_NEXT_BLOCK(events, blk_1, blk_0, miner_account);
+  events.pop_back();
+  DO_CALLBACK_PARAMS_STR(events, "relay_block_early", t_serializable_object_to_blob(blk_1));
+
+  // blocks with a valid PoW and an invalid miner tx (its unlock time is too low): the kernel check passes, the full one doesn't
+  std::vector<block> invalid_blocks;
+  for (size_t i = 0; i <= CURRENCY_PROTOCOL_MAX_PREVALIDATED_FAILED_BLOCKS; ++i)
+  {
+    MAKE_MINER_TX_MANUALLY(miner_tx, blk_1);
+    set_tx_unlock_time(miner_tx, get_tx_max_unlock_time(miner_tx) - 1 - i);
+    block blk_2 = AUTO_VAL_INIT(blk_2);
+    generator.construct_block_manually(blk_2, blk_1, miner_account, test_generator::bf_miner_tx, 0, 0, 0, crypto::hash(), 0, miner_tx);
+    invalid_blocks.push_back(blk_2);
+  }
+
+  // a peer that doesn't announce early relay is dropped right away, even if it says the block is prevalidated only
+  DO_CALLBACK_PARAMS_STR(events, "relay_invalid_block_without_feature", t_serializable_object_to_blob(invalid_blocks.back()));
+  invalid_blocks.pop_back();
+
+  // a peer that does is penalized for each such block and dropped after CURRENCY_PROTOCOL_MAX_PREVALIDATED_FAILED_BLOCKS of them
+  for (const block& b : invalid_blocks)
+    DO_CALLBACK_PARAMS_STR(events, "relay_invalid_block_with_feature", t_serializable_object_to_blob(b));
+
+  DO_CALLBACK_PARAMS(events, "check_top_block", params_top_block(blk_1));
+
+  return true;
+}
+
+bool early_block_relay_test::relay_block_early(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  const blobdata& blob = boost::get<callback_entry>(events[ev_index]).callback_params;
+  block b = AUTO_VAL_INIT(b);
+  CHECK_TEST_CONDITION(parse_and_validate_block_from_blob(blob, b));
+
+  namespace po = boost::program_options;
+  po::variables_map vm;
+  vm.insert(std::make_pair(command_line::arg_disable_ntp.name, po::variable_value(false, false)));
+  vm.insert(std::make_pair(command_line::arg_p2p_compression.name, po::variable_value(false, false)));
+  vm.insert(std::make_pair(command_line::arg_early_block_relay.name, po::variable_value(true, false)));
+
+  early_relay_p2p_stub p2p;
+  t_currency_protocol_handler<core> handler(c, &p2p);
+  handler.init(vm);
+  CORE_SYNC_DATA hshd = AUTO_VAL_INIT(hshd);
+  handler.get_payload_sync_data(hshd);
+  CHECK_TEST_CONDITION((hshd.protocol_features & CURRENCY_PROTOCOL_FEATURE_EARLY_BLOCK_RELAY) != 0);
+
+  currency_connection_context sender;
+  sender.m_state = currency_connection_context::state_normal;
+  CHECK_TEST_CONDITION(notify_new_block(handler, blob, false, sender));
+
+  // the block is verified by the handler's own thread
+  for (size_t i = 0; i < 100 && c.get_blockchain_storage().get_top_block_id() != get_block_hash(b); ++i)
+    epee::misc_utils::sleep_no_w(100);
+  handler.deinit();
+  CHECK_EQ(get_block_hash(b), c.get_blockchain_storage().get_top_block_id());
+  CHECK_EQ(0, p2p.drops_count);
+
+  // relayed once, before the full check
+  CHECK_EQ(1, p2p.relayed_blocks.size());
+  NOTIFY_NEW_BLOCK::request relayed = AUTO_VAL_INIT(relayed);
+  CHECK_TEST_CONDITION(epee::serialization::load_t_from_binary(relayed, p2p.relayed_blocks.front()));
+  CHECK_TEST_CONDITION(relayed.prevalidated_only);
+  CHECK_TEST_CONDITION(relayed.b.block == blob);
+  return true;
+}
+
+bool early_block_relay_test::relay_invalid_block_with_feature(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  const blobdata& blob = boost::get<callback_entry>(events[ev_index]).callback_params;
+
+  early_relay_p2p_stub p2p;
+  t_currency_protocol_handler<core> handler(c, &p2p);
+  CHECK_TEST_CONDITION(notify_new_block(handler, blob, true, m_relayer_context));
+  ++m_invalid_blocks_relayed;
+
+  size_t expected_drops_count = m_invalid_blocks_relayed < CURRENCY_PROTOCOL_MAX_PREVALIDATED_FAILED_BLOCKS ? 0 : 1;
+  CHECK_EQ(1, p2p.ip_fails_count);
+  CHECK_EQ(expected_drops_count, p2p.drops_count);
+  CHECK_EQ(0, p2p.relayed_blocks.size());
+  return true;
+}
+
+bool early_block_relay_test::relay_invalid_block_without_feature(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  const blobdata& blob = boost::get<callback_entry>(events[ev_index]).callback_params;
+
+  early_relay_p2p_stub p2p;
+  t_currency_protocol_handler<core> handler(c, &p2p);
+  currency_connection_context relayer;
+  relayer.m_state = currency_connection_context::state_normal;
+  relayer.m_remote_protocol_features = CURRENCY_PROTOCOL_FEATURE_COMPACT_BLOCKS;
+  CHECK_TEST_CONDITION(notify_new_block(handler, blob, true, relayer));
+
+  CHECK_EQ(0, p2p.ip_fails_count);
+  CHECK_EQ(1, p2p.drops_count);
+  CHECK_EQ(0, p2p.relayed_blocks.size());
+  return true;
+}
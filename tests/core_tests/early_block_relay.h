@@ -0,0 +1,20 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#pragma once
+#include "chaingen.h"
+
+// NOTIFY_NEW_BLOCK with prevalidated_only: a node with --early-block-relay relays a new block before its full check,
+// a receiver counts blocks that fail the full check against the relayer only if it announced CURRENCY_PROTOCOL_FEATURE_EARLY_BLOCK_RELAY
+struct early_block_relay_test : public test_chain_unit_enchanced
+{
+  early_block_relay_test();
+  bool generate(std::vector<test_event_entry>& events) const;
+  bool relay_block_early(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+  bool relay_invalid_block_with_feature(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+  bool relay_invalid_block_without_feature(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+
+private:
+  currency::currency_connection_context m_relayer_context;
+  uint32_t m_invalid_blocks_relayed;
+};
@@ -11,6 +11,9 @@
 #include "warnings.h"
 #include "crypto/crypto.h"
 #include "crypto/hash.h"
+extern "C" {
+#include "crypto/crypto-ops.h"
+}
 #include "crypto-tests.h"
 #include "../io.h"
 #include "warnings.h"
@@ -41,17 +44,13 @@ bool operator !=(const key_derivation &a, const key_derivation &b) {
 
 
 
-int main(int argc, char *argv[]) {
+static bool run_tests(const char *path) {
   fstream input;
   string cmd;
   size_t test = 0;
   bool error = false;
   setup_random();
-  if (argc != 2) {
-    cerr << "invalid arguments" << endl;
-    return 1;
-  }
-  input.open(argv[1], ios_base::in);
+  input.open(path, ios_base::in);
   for (;;) {
     ++test;
     input.exceptions(ios_base::badbit);
@@ -248,6 +247,25 @@ error:
     cerr << "Wrong result on test " << test << endl;
     error = true;
   }
+  return !error;
+}
+
+int main(int argc, char *argv[]) {
+  bool error = false;
+  if (argc != 2) {
+    cerr << "invalid arguments" << endl;
+    return 1;
+  }
+  // the same vectors for each field arithmetic backend
+  for (int backend = 0; backend != CRYPTO_OPS_FE_BACKEND_COUNT; ++backend) {
+    if (!crypto_ops_set_fe_backend(backend)) {
+      continue;
+    }
+    if (!run_tests(argv[1])) {
+      cerr << "Failed with field arithmetic backend " << backend << endl;
+      error = true;
+    }
+  }
   return error ? 1 : 0;
 }
 POP_GCC_WARNINGS
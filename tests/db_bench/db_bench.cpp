@@ -0,0 +1,364 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Drives tools::db::basic_db_accessor with the access patterns of blockchain_storage (block append with batch commits,
+// key image lookups, random output fetches, readers running while blocks are written) over each of the given engines,
+// so db engines and their settings can be compared on the target hardware.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <random>
+#include <thread>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "include_base_utils.h"
+#include "common/command_line.h"
+#include "common/db_abstract_accessor.h"
+#include "common/db_backend_selector.h"
+#include "common/util.h"
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+
+#define DB_BENCH_SUB_DIR_PREFIX                   "db_bench_"
+#define DB_BENCH_CONTAINER_BLOCKS                 "blocks"
+#define DB_BENCH_CONTAINER_KEY_IMAGES             "spent_keys"
+#define DB_BENCH_CONTAINER_OUTPUTS                "outputs"
+
+namespace
+{
+  const command_line::arg_descriptor<std::string> arg_engines               ("engines", "Comma-separated db engines to measure: lmdb, mdbx", "lmdb,mdbx");
+  const command_line::arg_descriptor<uint64_t>    arg_blocks                ("blocks", "Blocks to append before the lookups", 20000);
+  const command_line::arg_descriptor<uint64_t>    arg_block_size            ("block-size", "Block blob size in bytes", 2048);
+  const command_line::arg_descriptor<uint64_t>    arg_key_images_per_block  ("key-images-per-block", "Spent key images added by each block", 20);
+  const command_line::arg_descriptor<uint64_t>    arg_outputs_per_block     ("outputs-per-block", "Outputs added by each block", 30);
+  const command_line::arg_descriptor<uint64_t>    arg_blocks_per_commit     ("blocks-per-commit", "Blocks appended in one db transaction", 100);
+  const command_line::arg_descriptor<uint64_t>    arg_lookups               ("lookups", "Lookups per read-only stage", 200000);
+  const command_line::arg_descriptor<uint64_t>    arg_readers               ("readers", "Reader threads running while blocks are being written", 4);
+  const command_line::arg_descriptor<bool>        arg_keep_db               ("keep-db", "Don't remove the scratch dbs after the run", false);
+
+  // the same layout as global_output_entry, amount-0 (confidential) outputs are all kept under one key
+  struct output_entry
+  {
+    crypto::hash tx_id;
+    uint32_t out_no;
+  };
+
+  typedef tools::db::array_accessor<std::string, true> blocks_container;
+  typedef tools::db::basic_key_value_accessor<crypto::key_image, uint64_t, false> key_images_container;
+  typedef tools::db::basic_key_to_array_accessor<uint64_t, output_entry, false> outputs_container;
+
+  struct bench_params
+  {
+    uint64_t blocks;
+    uint64_t block_size;
+    uint64_t key_images_per_block;
+    uint64_t outputs_per_block;
+    uint64_t blocks_per_commit;
+    uint64_t lookups;
+    uint64_t readers;
+  };
+
+  crypto::key_image make_key_image(uint64_t n)
+  {
+    crypto::hash h = crypto::cn_fast_hash(&n, sizeof(n));
+    return *reinterpret_cast<const crypto::key_image*>(&h);
+  }
+
+  uint64_t get_time_ns()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  uint64_t get_directory_size(const std::string& path)
+  {
+    uint64_t size = 0;
+    boost::system::error_code ec;
+    for (boost::filesystem::recursive_directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec))
+    {
+      if (boost::filesystem::is_regular_file(it->status()))
+        size += boost::filesystem::file_size(it->path(), ec);
+    }
+    return size;
+  }
+
+  void print_stage(const std::string& engine, const std::string& stage, std::vector<uint64_t>& latencies_ns, uint64_t ops, uint64_t wall_ns)
+  {
+    std::sort(latencies_ns.begin(), latencies_ns.end());
+    auto pct_us = [&](size_t pct) { return latencies_ns.empty() ? 0.0 : latencies_ns[std::min(latencies_ns.size() - 1, latencies_ns.size() * pct / 1000)] / 1000.0; };
+    std::cout << std::left << std::setw(8) << engine << std::setw(26) << stage << std::right << std::fixed << std::setprecision(1)
+      << std::setw(14) << (wall_ns ? ops * 1e9 / wall_ns : 0) << std::setw(11) << pct_us(500) << std::setw(11) << pct_us(900) << std::setw(11) << pct_us(990)
+      << std::setw(11) << pct_us(999) << std::setw(12) << (latencies_ns.empty() ? 0.0 : latencies_ns.back() / 1000.0) << ENDL;
+  }
+
+  class db_bench
+  {
+  public:
+    db_bench(const std::string& engine, std::shared_ptr<tools::db::i_db_backend> backend, const bench_params& p)
+      : m_engine(engine)
+      , m_p(p)
+      , m_db(backend, m_rw_lock)
+      , m_read_lock(m_rw_lock)
+      , m_blocks(m_db)
+      , m_key_images(m_db)
+      , m_outputs(m_db)
+      , m_key_images_count(0)
+      , m_outputs_count(0)
+    {}
+
+    bool open(const std::string& path)
+    {
+      CHECK_AND_ASSERT_MES(m_db.open(path), false, "Failed to open " << m_engine << " db in " << path);
+      CHECK_AND_ASSERT_MES(m_blocks.init(DB_BENCH_CONTAINER_BLOCKS), false, "Failed to init blocks container");
+      CHECK_AND_ASSERT_MES(m_key_images.init(DB_BENCH_CONTAINER_KEY_IMAGES), false, "Failed to init key images container");
+      CHECK_AND_ASSERT_MES(m_outputs.init(DB_BENCH_CONTAINER_OUTPUTS), false, "Failed to init outputs container");
+      return true;
+    }
+
+    void close()
+    {
+      m_db.close();
+    }
+
+    // blocks_per_commit blocks per write transaction, as the core does while syncing; one latency sample per commit
+    bool append_blocks(uint64_t count, const std::string& stage)
+    {
+      std::vector<uint64_t> latencies;
+      std::string blob(m_p.block_size, '\0');
+      const uint64_t started = get_time_ns();
+      for (uint64_t i = 0; i < count; i += m_p.blocks_per_commit)
+      {
+        const uint64_t batch_started = get_time_ns();
+        uint64_t batch_key_images = 0, batch_outputs = 0;
+        m_db.begin_transaction();
+        for (uint64_t j = i; j < count && j < i + m_p.blocks_per_commit; ++j)
+        {
+          const uint64_t height = m_blocks.size();
+          memcpy(&blob[0], &height, std::min<size_t>(sizeof(height), blob.size()));
+          m_blocks.push_back(blob);
+          for (uint64_t k = 0; k != m_p.key_images_per_block; ++k)
+            m_key_images.set(make_key_image(m_key_images_count + batch_key_images + k), height);
+          for (uint64_t k = 0; k != m_p.outputs_per_block; ++k)
+          {
+            output_entry oe = AUTO_VAL_INIT(oe);
+            oe.tx_id = crypto::cn_fast_hash(&height, sizeof(height));
+            oe.out_no = static_cast<uint32_t>(k);
+            m_outputs.push_back_item(0, oe);
+          }
+          batch_key_images += m_p.key_images_per_block;
+          batch_outputs += m_p.outputs_per_block;
+        }
+        m_db.commit_transaction();
+        // readers pick only the committed items
+        m_key_images_count += batch_key_images;
+        m_outputs_count += batch_outputs;
+        latencies.push_back(get_time_ns() - batch_started);
+      }
+      print_stage(m_engine, stage, latencies, count, get_time_ns() - started);
+      return true;
+    }
+
+    // half of the lookups hit a spent key image, the other half miss (the usual case for a new tx)
+    bool key_image_lookup(std::mt19937_64& rng, uint64_t& failures)
+    {
+      const uint64_t n = rng();
+      const bool spent = n & 1;
+      const uint64_t ki_index = spent ? (n >> 1) % m_key_images_count.load() : m_key_images_count.load() + (n >> 1);
+      CRITICAL_REGION_LOCAL(m_read_lock);
+      bool found = static_cast<bool>(m_key_images.get(make_key_image(ki_index)));
+      failures += found != spent ? 1 : 0;
+      return true;
+    }
+
+    // a ring member fetch by its global index
+    bool output_fetch(std::mt19937_64& rng, uint64_t& failures)
+    {
+      const uint64_t gindex = rng() % m_outputs_count.load();
+      CRITICAL_REGION_LOCAL(m_read_lock);
+      failures += m_outputs.get_subitem(0, gindex) ? 0 : 1;
+      return true;
+    }
+
+    template<class t_cb>
+    bool run_lookups(const std::string& stage, t_cb cb)
+    {
+      std::mt19937_64 rng(0x1234);
+      std::vector<uint64_t> latencies;
+      latencies.reserve(m_p.lookups);
+      uint64_t failures = 0;
+      const uint64_t started = get_time_ns();
+      for (uint64_t i = 0; i != m_p.lookups; ++i)
+      {
+        const uint64_t op_started = get_time_ns();
+        cb(rng, failures);
+        latencies.push_back(get_time_ns() - op_started);
+      }
+      print_stage(m_engine, stage, latencies, m_p.lookups, get_time_ns() - started);
+      CHECK_AND_ASSERT_MES(failures == 0, false, stage << ": " << failures << " lookups returned unexpected results");
+      return true;
+    }
+
+    // readers do mixed key image lookups and output fetches until the writer is done with its blocks
+    bool run_readers_during_writes()
+    {
+      std::atomic<bool> stop(false);
+      std::vector<std::vector<uint64_t>> latencies(m_p.readers);
+      std::vector<uint64_t> failures(m_p.readers, 0);
+      std::vector<std::thread> readers;
+      const uint64_t started = get_time_ns();
+      for (size_t t = 0; t != m_p.readers; ++t)
+      {
+        readers.emplace_back([&, t]()
+        {
+          std::mt19937_64 rng(0x5678 + t);
+          while (!stop.load(std::memory_order_relaxed))
+          {
+            const uint64_t op_started = get_time_ns();
+            if (rng() & 1)
+              key_image_lookup(rng, failures[t]);
+            else
+              output_fetch(rng, failures[t]);
+            latencies[t].push_back(get_time_ns() - op_started);
+          }
+        });
+      }
+
+      bool r = append_blocks(std::max<uint64_t>(m_p.blocks / 4, m_p.blocks_per_commit), "append_under_readers");
+      stop = true;
+      for (auto& th : readers)
+        th.join();
+      const uint64_t wall = get_time_ns() - started;
+      CHECK_AND_ASSERT_MES(r, false, "append_blocks failed");
+
+      std::vector<uint64_t> all;
+      uint64_t total_failures = 0;
+      for (size_t t = 0; t != m_p.readers; ++t)
+      {
+        all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+        total_failures += failures[t];
+      }
+      const uint64_t ops = all.size();
+      print_stage(m_engine, "reads_under_writes", all, ops, wall);
+      CHECK_AND_ASSERT_MES(total_failures == 0, false, "reads_under_writes: " << total_failures << " lookups returned unexpected results");
+      return true;
+    }
+
+    bool run()
+    {
+      if (!append_blocks(m_p.blocks, "append_blocks"))
+        return false;
+      if (!run_lookups("key_image_lookup", [&](std::mt19937_64& rng, uint64_t& failures) { return key_image_lookup(rng, failures); }))
+        return false;
+      if (!run_lookups("output_fetch", [&](std::mt19937_64& rng, uint64_t& failures) { return output_fetch(rng, failures); }))
+        return false;
+      return m_p.readers == 0 || run_readers_during_writes();
+    }
+
+  private:
+    const std::string m_engine;
+    const bench_params m_p;
+    epee::shared_recursive_mutex m_rw_lock;
+    tools::db::basic_db_accessor m_db;
+    mutable epee::shared_membership<epee::shared_recursive_mutex> m_read_lock;
+    blocks_container m_blocks;
+    key_images_container m_key_images;
+    outputs_container m_outputs;
+    std::atomic<uint64_t> m_key_images_count;
+    std::atomic<uint64_t> m_outputs_count;
+  };
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+  epee::log_space::get_set_log_detalisation_level(true, LOG_LEVEL_0);
+  epee::log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL, LOG_LEVEL_0);
+
+  boost::program_options::options_description desc("db_bench options");
+  command_line::add_arg(desc, command_line::arg_help);
+  command_line::add_arg(desc, command_line::arg_data_dir, epee::string_tools::get_current_module_folder());
+  command_line::add_arg(desc, arg_engines);
+  command_line::add_arg(desc, arg_blocks);
+  command_line::add_arg(desc, arg_block_size);
+  command_line::add_arg(desc, arg_key_images_per_block);
+  command_line::add_arg(desc, arg_outputs_per_block);
+  command_line::add_arg(desc, arg_blocks_per_commit);
+  command_line::add_arg(desc, arg_lookups);
+  command_line::add_arg(desc, arg_readers);
+  command_line::add_arg(desc, arg_keep_db);
+  tools::db::db_backend_selector::init_options(desc);
+
+  boost::program_options::variables_map vm;
+  bool r = command_line::handle_error_helper(desc, [&]()
+  {
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
+    boost::program_options::notify(vm);
+    return true;
+  });
+  if (!r || command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << desc << ENDL;
+    return r ? 0 : 1;
+  }
+
+  bench_params p = AUTO_VAL_INIT(p);
+  p.blocks = command_line::get_arg(vm, arg_blocks);
+  p.block_size = command_line::get_arg(vm, arg_block_size);
+  p.key_images_per_block = command_line::get_arg(vm, arg_key_images_per_block);
+  p.outputs_per_block = command_line::get_arg(vm, arg_outputs_per_block);
+  p.blocks_per_commit = command_line::get_arg(vm, arg_blocks_per_commit);
+  p.lookups = command_line::get_arg(vm, arg_lookups);
+  p.readers = command_line::get_arg(vm, arg_readers);
+  CHECK_AND_ASSERT_MES(p.blocks != 0 && p.blocks_per_commit != 0 && p.key_images_per_block != 0 && p.outputs_per_block != 0, 1,
+    "--blocks, --blocks-per-commit, --key-images-per-block and --outputs-per-block must not be zero");
+
+  std::vector<std::string> engines;
+  boost::split(engines, command_line::get_arg(vm, arg_engines), boost::is_any_of(","), boost::token_compress_on);
+
+  std::cout << "blocks: " << p.blocks << " x " << p.block_size << " bytes, " << p.key_images_per_block << " key images and " << p.outputs_per_block << " outputs per block, "
+    << p.blocks_per_commit << " blocks per commit, " << p.lookups << " lookups, " << p.readers << " readers" << ENDL
+    << "append stages: one latency sample per commit; throughput is blocks/s for them and ops/s for the others" << ENDL << ENDL
+    << std::left << std::setw(8) << "engine" << std::setw(26) << "stage" << std::right << std::setw(14) << "per_sec" << std::setw(11) << "p50_us"
+    << std::setw(11) << "p90_us" << std::setw(11) << "p99_us" << std::setw(11) << "p99.9_us" << std::setw(12) << "max_us" << ENDL;
+
+  const std::string data_dir = command_line::get_arg(vm, command_line::arg_data_dir);
+  int result = 0;
+  for (const auto& engine : engines)
+  {
+    // the engine settings (--db-mdbx-*) come from the command line, only the engine itself is overridden
+    boost::program_options::variables_map engine_vm = vm;
+    engine_vm.erase(command_line::arg_db_engine.name);
+    engine_vm.insert(std::make_pair(std::string(command_line::arg_db_engine.name), boost::program_options::variable_value(engine, false)));
+    tools::db::db_backend_selector dbbs;
+    if (!dbbs.init(engine_vm))
+    {
+      LOG_ERROR("Unsupported db engine: " << engine);
+      result = 1;
+      continue;
+    }
+
+    const std::string path = data_dir + "/" DB_BENCH_SUB_DIR_PREFIX + engine;
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(path, ec);
+    CHECK_AND_ASSERT_MES(!ec, 1, "Failed to empty " << path << ": " << ec.message());
+    tools::create_directories_if_necessary(path);
+
+    {
+      db_bench bench(engine, dbbs.create_backend(), p);
+      if (!bench.open(path) || !bench.run())
+        result = 1;
+      bench.close();
+    }
+    std::cout << std::left << std::setw(8) << engine << "db size: " << get_directory_size(path) / (1024 * 1024) << " MB" << ENDL;
+
+    if (!command_line::get_arg(vm, arg_keep_db))
+      boost::filesystem::remove_all(path, ec);
+  }
+  return result;
+  CATCH_ENTRY_L0("main", 1);
+}
@@ -5,6 +5,7 @@
 
 #define USE_INSECURE_RANDOM_RPNG_ROUTINES // turns on random manupulation for tests
 #include <utility>
+#include <thread>
 #include <boost/multiprecision/cpp_int.hpp>
 #include "crypto/crypto.h"
 #include "epee/include/misc_log_ex.h"
@@ -609,6 +610,7 @@ TEST(crypto, constants)
 
 
 #include "crypto_tests_performance.h"
+#include "crypto_tests_benchmarks.h"
 
 TEST(crypto, ge_scalarmult_vartime_p3)
 {
@@ -909,6 +911,184 @@ TEST(crypto, keys)
   return true;
 }
 
+TEST(crypto, key_derivations_batch)
+{
+  crypto::public_key view_pk;
+  crypto::secret_key view_sk;
+  crypto::generate_keys(view_pk, view_sk);
+
+  for (size_t n : { 0, 1, 2, 17 })
+  {
+    std::vector<crypto::public_key> keys(n);
+    for (auto& k : keys)
+    {
+      crypto::secret_key sk;
+      crypto::generate_keys(k, sk);
+    }
+    if (n > 1)
+      memset(&keys[1], 0xff, sizeof keys[1]); // not a valid point
+
+    std::vector<crypto::key_derivation> derivations;
+    std::vector<bool> valid;
+    crypto::generate_key_derivations(keys, view_sk, derivations, valid);
+    ASSERT_EQ(derivations.size(), n);
+    ASSERT_EQ(valid.size(), n);
+    for (size_t i = 0; i != n; ++i)
+    {
+      crypto::key_derivation d = AUTO_VAL_INIT(d);
+      bool r = crypto::generate_key_derivation(keys[i], view_sk, d);
+      ASSERT_EQ(valid[i], r);
+      if (r)
+        ASSERT_EQ(derivations[i], d);
+    }
+  }
+
+  return true;
+}
+
+
+TEST(crypto, point_batch_helpers)
+{
+  for (size_t n : { 0, 1, 2, 17 })
+  {
+    std::vector<point_t> points(n);
+    std::vector<crypto::public_key> pks(n);
+    for (size_t i = 0; i != n; ++i)
+    {
+      points[i] = scalar_t::random() * c_point_G + scalar_t::random() * c_point_H; // Z != 1
+      pks[i] = points[i].to_public_key();
+    }
+
+    std::vector<crypto::public_key> pks_batch(n);
+    point_t::batch_to_public_keys(points.data(), n, pks_batch.data());
+    ASSERT_TRUE(pks_batch == pks);
+
+    std::vector<point_t> decompressed;
+    ASSERT_TRUE(point_t::from_public_keys(pks, decompressed));
+    ASSERT_EQ(decompressed.size(), n);
+
+    std::vector<point_t> normalized = points;
+    point_t::batch_normalize(normalized.data(), n);
+    for (size_t i = 0; i != n; ++i)
+    {
+      ASSERT_EQ(decompressed[i], points[i]);
+      ASSERT_EQ(normalized[i], points[i]);
+      ASSERT_EQ(normalized[i].to_public_key(), pks[i]);
+      fe z_minus_1, one = { 1 };
+      fe_sub(z_minus_1, normalized[i].m_p3.Z, one);
+      ASSERT_EQ(fe_isnonzero(z_minus_1), 0);
+      // T is still usable
+      ASSERT_EQ(normalized[i] + c_point_G, points[i] + c_point_G);
+    }
+
+    if (n > 1)
+    {
+      memset(&pks[1], 0xff, sizeof pks[1]); // not a valid point
+      ASSERT_FALSE(point_t::from_public_keys(pks, decompressed));
+    }
+  }
+
+  return true;
+}
+
+
+TEST(crypto, point_precomp)
+{
+  point_t A = hash_helper_t::hp(scalar_t::random());
+  point_precomp_t A_pc(A);
+  ASSERT_EQ(A_pc, A);
+  for (size_t i = 0; i < 50; ++i)
+  {
+    scalar_t a = scalar_t::random(), b = scalar_t::random();
+    ASSERT_EQ(a * A_pc, a * A);
+    ASSERT_EQ(A_pc / a, A / a);
+    ASSERT_EQ(A_pc.mul_plus_G(a, b), A.mul_plus_G(a, b));
+  }
+  ASSERT_EQ(scalar_t(0) * A_pc, c_point_0);
+  ASSERT_EQ(c_scalar_Lm1 * A_pc, -A);
+
+  point_precomp_cache cache(2, 3);
+  crypto::public_key pks[3] = { A.to_public_key(), (2 * A).to_public_key(), (3 * A).to_public_key() };
+  ASSERT_TRUE(cache.get(pks[0]) == nullptr);
+  ASSERT_TRUE(cache.get(pks[0]) == nullptr);
+  std::shared_ptr<const point_precomp_t> p0 = cache.get(pks[0]); // third time
+  ASSERT_TRUE(p0 != nullptr);
+  ASSERT_EQ(*p0, A);
+  ASSERT_TRUE(cache.get(pks[0]) == p0);
+
+  // pinned ones are never evicted
+  ASSERT_TRUE(cache.add(pks[1]));
+  ASSERT_EQ(cache.size(), 2);
+  for (size_t i = 0; i < 3; ++i)
+    cache.get(pks[2]);
+  ASSERT_EQ(cache.size(), 2);
+  ASSERT_TRUE(cache.get(pks[2]) != nullptr);
+  ASSERT_TRUE(cache.get(pks[1]) != nullptr);
+  ASSERT_EQ(*cache.get(pks[1]), 2 * A);
+  ASSERT_EQ(*cache.get(pks[2]), 3 * A);
+  ASSERT_EQ(*p0, A); // still usable after eviction
+
+  crypto::public_key invalid_pk;
+  memset(&invalid_pk, 0xff, sizeof invalid_pk);
+  ASSERT_FALSE(cache.add(invalid_pk));
+  cache.remove(pks[1]);
+  ASSERT_EQ(cache.size(), 1);
+
+  return true;
+}
+
+
+TEST(crypto, scratch_arena)
+{
+  scratch_arena& arena = scratch_arena::get();
+
+  // no scope -- the heap
+  {
+    scratch_scalar_vec_t v(10);
+    ASSERT_FALSE(arena.owns(v.data()));
+  }
+
+  // the first run doesn't fit, the arena grows on the outermost scope exit, and the second one goes to the arena
+  const size_t n = arena.get_size() / sizeof(scalar_t) + 100;
+  for (size_t run = 0; run != 2; ++run)
+  {
+    scratch_arena_scope scope;
+    scratch_scalar_vec_t v(n);
+    ASSERT_EQ(arena.owns(v.data()), (run == 1));
+    {
+      scratch_arena_scope nested_scope;
+      size_t used = arena.get_used();
+      scratch_point_vec_t points(1, c_point_G);
+      ASSERT_EQ(points[0], c_point_G);
+      ASSERT_TRUE(arena.get_used() > used || !arena.owns(points.data()));
+    }
+  }
+  ASSERT_EQ(arena.get_used(), 0);
+
+  // scratch vectors compute the same as the regular ones
+  scalar_vec_t a(33), a_inv;
+  a.make_random();
+  a_inv = a;
+  a_inv.invert();
+  {
+    scratch_arena_scope scope;
+    scratch_scalar_vec_t b(a.size());
+    for (size_t i = 0; i < a.size(); ++i)
+      b[i] = a[i];
+    scratch_scalar_vec_t b_inv = b;
+    b_inv.invert();
+    scratch_scalar_vec_t c = b * b_inv + c_scalar_1;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+      ASSERT_EQ(b_inv[i], a_inv[i]);
+      ASSERT_EQ(c[i], scalar_t(2));
+    }
+    ASSERT_EQ(b.calc_hs(), a.calc_hs());
+  }
+
+  return true;
+}
+
 
 TEST(crypto, scalar_basics)
 {
@@ -1930,7 +2110,7 @@ bool wildcard_match(const std::string& needle, const std::string& haystack)
   return h == haystack.size();
 }
 
-int crypto_tests(const std::string& cmd_line_param)
+int crypto_tests(const std::string& cmd_line_param, const std::string& bench_json_path)
 {
   epee::log_space::get_set_log_detalisation_level(true, LOG_LEVEL_3);
   epee::log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL, LOG_LEVEL_3);
@@ -1985,6 +2165,13 @@ int crypto_tests(const std::string& cmd_line_param)
     return 1;
   }
 
+  if (!g_bench_results.empty())
+  {
+    LOG_PRINT_L0(ENDL << bench_results_to_json());
+    if (!bench_json_path.empty() && !bench_store_results_json(bench_json_path))
+      LOG_PRINT_RED_L0("Failed to store benchmark results to " << bench_json_path);
+  }
+
   if (failed_tests.empty())
   {
     LOG_PRINT_GREEN(ENDL, LOG_LEVEL_0);
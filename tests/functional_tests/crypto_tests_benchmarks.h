@@ -0,0 +1,305 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#pragma once
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <crypto/zarcanum.h>
+#include <crypto/msm.h>
+
+//
+// Micro-benchmarks of the primitives used by Zarcanum-era transactions and blocks.
+// Run with --crypto-tests=bench_* (or bench_clsag*, etc.), add --crypto-bench-json=<path> to store the results.
+//
+
+// each case runs for at least this time (after a warm-up) and at least min_ops times
+#define CRYPTO_BENCH_MIN_TIME_MS      300
+
+// counts all the allocations made by the process, so the allocations done by a benchmarked call can be told
+static std::atomic<uint64_t> g_bench_allocs_count(0);
+
+void* operator new(std::size_t size)
+{
+  g_bench_allocs_count.fetch_add(1, std::memory_order_relaxed);
+  void* p = std::malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+
+struct bench_result_t
+{
+  std::string name;
+  std::vector<std::pair<std::string, uint64_t>> params;
+  uint64_t ops;
+  double ns_per_op;
+  double ops_per_sec;
+  double allocs_per_op;
+};
+
+static std::vector<bench_result_t> g_bench_results;
+
+template<typename callback_t>
+bool bench_run(const std::string& name, const std::vector<std::pair<std::string, uint64_t>>& params, size_t min_ops, callback_t cb)
+{
+  std::stringstream ss_params;
+  for(auto& p : params)
+    ss_params << p.first << "=" << p.second << " ";
+
+  for(size_t i = 0, warmup_ops = std::max<size_t>(1, min_ops / 10); i < warmup_ops; ++i)
+    CHECK_AND_ASSERT_MES(cb(), false, name << " " << ss_params.str() << "failed (warm-up)");
+
+  const uint64_t min_time_ns = CRYPTO_BENCH_MIN_TIME_MS * 1000000ull;
+  uint64_t ops = 0, time_ns = 0;
+  const uint64_t allocs_before = g_bench_allocs_count.load(std::memory_order_relaxed);
+  const auto start = std::chrono::steady_clock::now();
+  while (ops < min_ops || time_ns < min_time_ns)
+  {
+    CHECK_AND_ASSERT_MES(cb(), false, name << " " << ss_params.str() << "failed");
+    ++ops;
+    time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  }
+  const uint64_t allocs = g_bench_allocs_count.load(std::memory_order_relaxed) - allocs_before;
+
+  bench_result_t res{name, params, ops, double(time_ns) / ops, 1e9 * ops / double(time_ns), double(allocs) / ops};
+  LOG_PRINT_L0(std::left << std::setw(20) << name << std::setw(36) << ss_params.str() << std::right << std::fixed << std::setprecision(1)
+    << std::setw(12) << res.ns_per_op / 1000.0 << " mcs/op " << std::setw(10) << res.ops_per_sec << " op/s " << std::setw(10) << res.allocs_per_op << " allocs/op");
+  g_bench_results.push_back(res);
+  return true;
+}
+
+inline std::string bench_results_to_json()
+{
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(2);
+  ss << "{\n  \"benchmarks\": [";
+  for(size_t i = 0; i < g_bench_results.size(); ++i)
+  {
+    const bench_result_t& r = g_bench_results[i];
+    ss << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << r.name << "\", \"params\": {";
+    for(size_t j = 0; j < r.params.size(); ++j)
+      ss << (j == 0 ? "" : ", ") << "\"" << r.params[j].first << "\": " << r.params[j].second;
+    ss << "}, \"ops\": " << r.ops << ", \"ns_per_op\": " << r.ns_per_op << ", \"ops_per_sec\": " << r.ops_per_sec << ", \"allocs_per_op\": " << r.allocs_per_op << "}";
+  }
+  ss << "\n  ]\n}\n";
+  return ss.str();
+}
+
+inline bool bench_store_results_json(const std::string& path)
+{
+  std::ofstream f(path, std::ios::out | std::ios::trunc);
+  CHECK_AND_ASSERT_MES(f.is_open(), false, "can't open " << path);
+  f << bench_results_to_json();
+  return f.good();
+}
+
+
+static const size_t c_bench_ring_sizes[]     = { 2, 16, 32 };
+static const size_t c_bench_outputs_counts[] = { 1, 2, 4, 8, 16 };
+
+
+TEST(bench, clsag_gg)
+{
+  for(size_t ring_size : c_bench_ring_sizes)
+  {
+    clsag_gg_sig_check_t cc;
+    cc.prepare_random_data(ring_size);
+    ASSERT_TRUE(bench_run("clsag_gg_gen",    {{"ring_size", ring_size}}, 20, [&](){ return cc.generate(); }));
+    ASSERT_TRUE(bench_run("clsag_gg_verify", {{"ring_size", ring_size}}, 20, [&](){ return cc.verify(); }));
+  }
+  return true;
+}
+
+TEST(bench, clsag_ggx)
+{
+  for(size_t ring_size : c_bench_ring_sizes)
+  {
+    clsag_ggx_sig_check_t cc;
+    cc.prepare_random_data(ring_size);
+    ASSERT_TRUE(bench_run("clsag_ggx_gen",    {{"ring_size", ring_size}}, 20, [&](){ return cc.generate(); }));
+    ASSERT_TRUE(bench_run("clsag_ggx_verify", {{"ring_size", ring_size}}, 20, [&](){ return cc.verify(); }));
+  }
+  return true;
+}
+
+TEST(bench, clsag_ggxxg)
+{
+  for(size_t ring_size : c_bench_ring_sizes)
+  {
+    clsag_ggxxg_sig_check_t cc;
+    cc.prepare_random_data(ring_size);
+    ASSERT_TRUE(bench_run("clsag_ggxxg_gen",    {{"ring_size", ring_size}}, 20, [&](){ return cc.generate(); }));
+    ASSERT_TRUE(bench_run("clsag_ggxxg_verify", {{"ring_size", ring_size}}, 20, [&](){ return cc.verify(); }));
+  }
+  return true;
+}
+
+TEST(bench, bpp)
+{
+  for(size_t n : c_bench_outputs_counts)
+  {
+    scalar_vec_t values, masks;
+    for(size_t i = 0; i < n; ++i)
+      values.emplace_back(crypto::rand<uint64_t>());
+    masks.resize_and_make_random(n);
+    bpp_signature sig;
+    std::vector<point_t> commitments_1div8;
+
+    ASSERT_TRUE(bench_run("bpp_gen", {{"outputs", n}}, 10, [&](){
+      commitments_1div8.clear();
+      return bpp_gen<bpp_crypto_trait_ZC_out>(values, masks, sig, commitments_1div8);
+    }));
+
+    std::vector<bpp_sig_commit_ref_t> sigs = { bpp_sig_commit_ref_t(sig, commitments_1div8) };
+    ASSERT_TRUE(bench_run("bpp_verify", {{"outputs", n}}, 10, [&](){ return bpp_verify<bpp_crypto_trait_ZC_out>(sigs); }));
+  }
+  return true;
+}
+
+TEST(bench, bppe)
+{
+  for(size_t n : c_bench_outputs_counts)
+  {
+    scalar_vec_t values, masks, masks2;
+    for(size_t i = 0; i < n; ++i)
+      values.emplace_back(crypto::rand<uint64_t>());
+    masks.resize_and_make_random(n);
+    masks2.resize_and_make_random(n);
+    bppe_signature sig;
+    std::vector<point_t> commitments_1div8;
+
+    ASSERT_TRUE(bench_run("bppe_gen", {{"outputs", n}}, 10, [&](){
+      commitments_1div8.clear();
+      return bppe_gen<bpp_crypto_trait_Zarcanum>(values, masks, masks2, sig, commitments_1div8);
+    }));
+
+    std::vector<bppe_sig_commit_ref_t> sigs = { bppe_sig_commit_ref_t(sig, commitments_1div8) };
+    ASSERT_TRUE(bench_run("bppe_verify", {{"outputs", n}}, 10, [&](){ return bppe_verify<bpp_crypto_trait_Zarcanum>(sigs); }));
+  }
+  return true;
+}
+
+TEST(bench, bge)
+{
+  for(size_t ring_size : { 2, 16, 64, 256 })
+  {
+    BGE_proff_check_t cc;
+    cc.prepare_random_data(ring_size);
+    ASSERT_TRUE(bench_run("bge_gen",    {{"ring_size", ring_size}}, 10, [&](){ return cc.generate(); }));
+    ASSERT_TRUE(bench_run("bge_verify", {{"ring_size", ring_size}}, 10, [&](){ return cc.verify(); }));
+  }
+  return true;
+}
+
+
+// a staked output at secret_index and random decoys, as it comes to zarcanum_generate_proof() from the wallet
+struct zarcanum_proof_check_t
+{
+  crypto::hash m;
+  crypto::hash kernel_hash;
+  scalar_t last_pow_block_id_hashed;
+  crypto::key_image stake_ki;
+  std::vector<public_key> stealth_addresses;
+  std::vector<public_key> amount_commitments;     // div 8
+  std::vector<public_key> blinded_asset_ids;      // div 8
+  std::vector<public_key> concealing_points;      // div 8
+  std::vector<CLSAG_GGXXG_input_ref_t> ring;
+  scalar_t secret_x;
+  scalar_t secret_q;
+  size_t secret_index;
+  uint64_t stake_amount;
+  scalar_t stake_out_asset_id_blinding_mask;
+  scalar_t stake_out_amount_blinding_mask;
+  scalar_t pseudo_out_amount_blinding_mask;
+  mp::uint128_t pos_difficulty;
+  zarcanum_proof sig;
+
+  void prepare_random_data(size_t ring_size)
+  {
+    stealth_addresses.clear();
+    amount_commitments.clear();
+    blinded_asset_ids.clear();
+    concealing_points.clear();
+    ring.clear();
+
+    crypto::generate_random_bytes(sizeof m, &m);
+    crypto::generate_random_bytes(sizeof kernel_hash, &kernel_hash);
+    last_pow_block_id_hashed = scalar_t::random();
+
+    for(size_t i = 0; i < ring_size; ++i)
+    {
+      stealth_addresses.push_back(hash_helper_t::hp(scalar_t::random()).to_public_key());
+      amount_commitments.push_back(hash_helper_t::hp(scalar_t::random()).to_public_key());
+      blinded_asset_ids.push_back(hash_helper_t::hp(scalar_t::random()).to_public_key());
+      concealing_points.push_back(hash_helper_t::hp(scalar_t::random()).to_public_key());
+    }
+
+    secret_x = scalar_t::random();
+    secret_q = scalar_t::random();
+    secret_index = random_in_range(0, ring_size - 1);
+    stake_amount = 1000000000000ull;
+    stake_out_asset_id_blinding_mask = scalar_t::random();
+    stake_out_amount_blinding_mask = scalar_t::random();
+    pseudo_out_amount_blinding_mask = scalar_t::random();
+    pos_difficulty = 1;
+
+    const point_t stake_out_asset_id = c_point_H + stake_out_asset_id_blinding_mask * c_point_X;
+    stealth_addresses[secret_index]  = (secret_x * c_point_G).to_public_key();
+    amount_commitments[secret_index] = (c_scalar_1div8 * (scalar_t(stake_amount) * stake_out_asset_id + stake_out_amount_blinding_mask * c_point_G)).to_public_key();
+    blinded_asset_ids[secret_index]  = (c_scalar_1div8 * stake_out_asset_id).to_public_key();
+    concealing_points[secret_index]  = (c_scalar_1div8 * secret_q * c_point_G).to_public_key();
+    stake_ki = (secret_x * hash_helper_t::hp(stealth_addresses[secret_index])).to_key_image();
+
+    for(size_t i = 0; i < ring_size; ++i)
+      ring.emplace_back(stealth_addresses[i], amount_commitments[i], blinded_asset_ids[i], concealing_points[i]);
+  }
+
+  bool generate()
+  {
+    return zarcanum_generate_proof(m, kernel_hash, ring, last_pow_block_id_hashed, stake_ki, secret_x, secret_q, secret_index, stake_amount,
+      stake_out_asset_id_blinding_mask, stake_out_amount_blinding_mask, pseudo_out_amount_blinding_mask, sig);
+  }
+
+  bool verify()
+  {
+    return zarcanum_verify_proof(m, kernel_hash, ring, last_pow_block_id_hashed, stake_ki, pos_difficulty, sig);
+  }
+};
+
+TEST(bench, zarcanum)
+{
+  for(size_t ring_size : c_bench_ring_sizes)
+  {
+    zarcanum_proof_check_t cc;
+    cc.prepare_random_data(ring_size);
+    ASSERT_TRUE(bench_run("zarcanum_gen",    {{"ring_size", ring_size}}, 10, [&](){ return cc.generate(); }));
+    ASSERT_TRUE(bench_run("zarcanum_verify", {{"ring_size", ring_size}}, 10, [&](){ return cc.verify(); }));
+  }
+  return true;
+}
+
+TEST(bench, msm)
+{
+  // the sizes the range proofs' verification comes down to: 2 * 64 * (outputs count, rounded up to a power of 2) points for BP+
+  for(size_t n : { 64, 128, 256, 512, 1024 })
+  {
+    scalar_vec_t g_scalars, h_scalars;
+    g_scalars.resize_and_make_random(n);
+    h_scalars.resize_and_make_random(n);
+    point_t sum = c_point_0;
+    for(size_t i = 0; i < n; ++i)
+      sum += g_scalars[i] * bpp_crypto_trait_ZC_out::get_generator(false, i) + h_scalars[i] * bpp_crypto_trait_ZC_out::get_generator(true, i);
+    const point_t summand = -sum;
+
+    ASSERT_TRUE(bench_run("msm", {{"points", 2 * n}}, 10, [&](){ return msm_and_check_zero<bpp_crypto_trait_ZC_out>(g_scalars, h_scalars, summand); }));
+  }
+  return true;
+}
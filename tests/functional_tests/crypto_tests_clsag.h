@@ -342,11 +342,11 @@ struct clsag_ggx_sig_check_t
     }
   }
 
-  bool verify()
+  bool verify(CLSAG_ring_members_cache_t* p_cache = nullptr)
   {
     try
     {
-      return verify_CLSAG_GGX(prefix_hash, ring, pseudo_output_commitment, pseudo_out_asset_id, ki, sig);
+      return verify_CLSAG_GGX(prefix_hash, ring, pseudo_output_commitment, pseudo_out_asset_id, ki, sig, p_cache);
     }
     catch(std::exception& e)
     {
@@ -396,6 +396,110 @@ TEST(clsag_ggx, basics)
 }
 
 
+TEST(clsag_ggx, ring_members_cache)
+{
+  // two signatures with the same decoys, as inputs of one transaction may have
+  clsag_ggx_sig_check_t cc1, cc2;
+  cc1.prepare_random_data(16);
+  ASSERT_TRUE(cc1.generate());
+
+  cc2 = cc1;
+  cc2.secret_0_xp = scalar_t::random();
+  cc2.secret_index = (cc1.secret_index + 1) % 16;
+  cc2.stealth_addresses[cc2.secret_index] = (cc2.secret_0_xp * c_point_G).to_public_key();
+  cc2.ki = (cc2.secret_0_xp * hash_helper_t::hp(cc2.stealth_addresses[cc2.secret_index])).to_key_image();
+  cc2.pseudo_output_commitment = (point_t(cc2.amount_commitments[cc2.secret_index]) - c_scalar_1div8 * cc2.secret_1_f * c_point_G).to_public_key();
+  cc2.pseudo_out_asset_id      = (point_t(cc2.blinded_asset_ids[cc2.secret_index])  - c_scalar_1div8 * cc2.secret_2_t * c_point_X).to_public_key();
+  cc2.rebuild_ring();
+  ASSERT_TRUE(cc2.generate());
+
+  CLSAG_ring_members_cache_t cache;
+  ASSERT_TRUE(cc1.verify(&cache));
+  ASSERT_EQ(cache.size(), 16);
+  ASSERT_TRUE(cc2.verify(&cache));
+  ASSERT_EQ(cache.size(), 17);
+  ASSERT_TRUE(cc1.verify(&cache));
+
+  // a signature is invalid regardless of the cache
+  CLSAG_GGX_signature_serialized sig_copy = cc2.sig;
+  cc2.sig.r_x[3] = scalar_t::random();
+  ASSERT_FALSE(cc2.verify(&cache));
+  ASSERT_FALSE(cc2.verify());
+
+  // non-canonical scalar (>= 2^255) must be handled in the same way as before
+  cc2.sig = sig_copy;
+  cc2.sig.r_g[0].m_s[31] |= 0x80;
+  ASSERT_FALSE(cc2.verify(&cache));
+
+  // second-level storage is filled by the first verification and used by the following ones
+  struct backend_t : public CLSAG_ring_members_cache_t::backend_i
+  {
+    virtual bool get(const public_key& pk, CLSAG_ring_members_cache_t::entry_t& e) override
+    {
+      auto it = entries.find(pk);
+      if (it == entries.end())
+        return false;
+      e = it->second;
+      ++hits;
+      return true;
+    }
+    virtual void set(const public_key& pk, const CLSAG_ring_members_cache_t::entry_t& e) override
+    {
+      entries[pk] = e;
+    }
+    std::unordered_map<public_key, CLSAG_ring_members_cache_t::entry_t> entries;
+    size_t hits = 0;
+  } backend;
+
+  CLSAG_ring_members_cache_t cache_a(&backend);
+  ASSERT_TRUE(cc1.verify(&cache_a));
+  ASSERT_EQ(backend.entries.size(), 16);
+  ASSERT_EQ(backend.hits, 0);
+  CLSAG_ring_members_cache_t cache_b(&backend);
+  ASSERT_TRUE(cc1.verify(&cache_b));
+  ASSERT_EQ(backend.hits, 16);
+
+  return true;
+}
+
+
+TEST(clsag_ggx, thread_prng)
+{
+  // with the same per-thread seed a signature doesn't depend on the thread it's made on, nor on the global PRNG usage meanwhile
+  clsag_ggx_sig_check_t cc;
+  cc.prepare_random_data(16);
+  crypto::hash seed{};
+  generate_random_bytes(sizeof seed, &seed);
+
+  std::string blob_main;
+  {
+    crypto::thread_prng_scope prng_scope(seed);
+    ASSERT_TRUE(cc.generate());
+    blob_main = t_serializable_object_to_blob(cc.sig);
+  }
+  ASSERT_TRUE(cc.verify());
+
+  std::string blob_thread;
+  bool r = false;
+  std::thread th([&]() {
+    crypto::thread_prng_scope prng_scope(seed);
+    r = cc.generate();
+    blob_thread = t_serializable_object_to_blob(cc.sig);
+  });
+  scalar_t::random();
+  th.join();
+  ASSERT_TRUE(r);
+  ASSERT_EQ(blob_main, blob_thread);
+
+  // and the global PRNG is back in charge afterwards
+  ASSERT_TRUE(cc.generate());
+  ASSERT_NEQ(blob_main, t_serializable_object_to_blob(cc.sig));
+  ASSERT_TRUE(cc.verify());
+
+  return true;
+}
+
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 //
@@ -132,3 +132,59 @@ TEST(BGE_proof, negative)
 
   return true;
 }
+
+TEST(BGE_proof, batch_verification)
+{
+  // proofs with different ring sizes and contexts
+  std::vector<BGE_proff_check_t> cc(16);
+  for(size_t i = 0; i < cc.size(); ++i)
+  {
+    cc[i].prepare_random_data(1 + i * 7);
+    ASSERT_TRUE(cc[i].generate());
+  }
+
+  std::vector<std::vector<const public_key*>> rings_ptr(cc.size());
+  for(size_t i = 0; i < cc.size(); ++i)
+    for(auto& el : cc[i].ring)
+      rings_ptr[i].emplace_back(&el);
+
+  auto verify_batch = [&](size_t count) -> bool
+  {
+    try
+    {
+      std::vector<BGE_proof_ref_t> proofs;
+      for(size_t i = 0; i < count; ++i)
+        proofs.emplace_back(cc[i].context_hash, rings_ptr[i], cc[i].sig);
+      uint8_t err = 0;
+      return verify_BGE_proofs_batch(proofs, &err) && err == 0;
+    }
+    catch(...)
+    {
+      return false;
+    }
+  };
+
+  ASSERT_FALSE(verify_batch(0));
+  for(size_t count = 1; count <= cc.size(); ++count)
+    ASSERT_TRUE(verify_batch(count));
+
+  // a single invalid proof spoils the whole batch
+  for(size_t k : {size_t(0), cc.size() / 2, cc.size() - 1})
+  {
+    for(size_t i = 0; true; ++i)
+    {
+      BGE_proof good_sig = cc[k].sig;
+      if (!invalidate_BGE_proof(i, cc[k].sig))
+        break;
+      ASSERT_FALSE(verify_batch(cc.size()));
+      cc[k].sig = good_sig;
+    }
+    ASSERT_TRUE(verify_batch(cc.size()));
+  }
+
+  // a proof checked against another context
+  std::swap(cc[3].context_hash, cc[4].context_hash);
+  ASSERT_FALSE(verify_batch(cc.size()));
+
+  return true;
+}
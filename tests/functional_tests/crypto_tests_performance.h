@@ -56,6 +56,102 @@ TEST(crypto, ge_precomp)
 
 
 
+// ge_scalarmult_base gives the same results with all the available field arithmetic backends
+TEST(crypto, ge_scalarmult_base)
+{
+  std::vector<scalar_t> scalars = { c_scalar_0, c_scalar_1, c_scalar_1div8, c_scalar_Lm1, scalar_t(8), scalar_t(0x8888888888888888ull) };
+  for (uint8_t nibble : { 0x77, 0x88, 0xff, 0x0f, 0xf0 })
+  {
+    scalar_t s;
+    memset(s.m_s, nibble, sizeof s.m_s);  // all the signed radix-16 digits are extreme: +-8, +-7, -1
+    s.m_s[31] &= 0x7f;
+    scalars.push_back(s);
+  }
+  for (size_t i = 0; i < 1000; ++i)
+    scalars.push_back(scalar_t::random());
+
+  const int initial_backend = crypto_ops_get_fe_backend();
+  for (const scalar_t& s : scalars)
+  {
+    point_t reference;
+    bool reference_set = false;
+    for (int backend = 0; backend != CRYPTO_OPS_FE_BACKEND_COUNT; ++backend)
+    {
+      if (!crypto_ops_set_fe_backend(backend))
+        continue;
+      point_t P;
+      ge_scalarmult_base(&P.m_p3, s.m_s);
+      if (!reference_set)
+      {
+        reference = P;
+        reference_set = true;
+      }
+      ASSERT_EQ(P, reference);
+    }
+    if (s.m_s[31] <= 0x10) // reduced
+      ASSERT_EQ(reference, s * c_point_G);
+  }
+  crypto_ops_set_fe_backend(initial_backend);
+
+  return true;
+}
+
+// ge_scalarmult_base timings for all the available backends, for random and for sparse scalars (zero, one, +-8 in each digit)
+TEST(perf, ge_scalarmult_base)
+{
+  const size_t rounds = 50, batch = 200;
+  std::vector<scalar_t> random_scalars(batch), sparse_scalars(batch);
+  for (size_t i = 0; i < batch; ++i)
+  {
+    random_scalars[i].make_random();
+    if (i % 3 == 0)
+      sparse_scalars[i] = c_scalar_0;
+    else if (i % 3 == 1)
+      sparse_scalars[i] = c_scalar_1;
+    else
+    {
+      memset(sparse_scalars[i].m_s, 0x88, sizeof sparse_scalars[i].m_s);
+      sparse_scalars[i].m_s[31] = 0x08;
+    }
+  }
+
+  auto run = [&](const std::vector<scalar_t>& scalars) -> uint64_t
+  {
+    ge_p3 P;
+    TIME_MEASURE_START(t);
+    for (size_t i = 0; i < batch; ++i)
+      ge_scalarmult_base(&P, scalars[i].m_s);
+    TIME_MEASURE_FINISH(t);
+    return t;
+  };
+
+  const int initial_backend = crypto_ops_get_fe_backend();
+  for (int backend = 0; backend != CRYPTO_OPS_FE_BACKEND_COUNT; ++backend)
+  {
+    if (!crypto_ops_set_fe_backend(backend))
+      continue;
+
+    // interleave the classes, so that the frequency scaling and the like affect both equally
+    std::vector<uint64_t> t_random, t_sparse;
+    for (size_t r = 0; r < rounds; ++r)
+    {
+      t_random.push_back(run(random_scalars));
+      t_sparse.push_back(run(sparse_scalars));
+    }
+    std::sort(t_random.begin(), t_random.end());
+    std::sort(t_sparse.begin(), t_sparse.end());
+    double median_random = double(t_random[rounds / 2]) / batch;
+    double median_sparse = double(t_sparse[rounds / 2]) / batch;
+    LOG_PRINT_L0("ge_scalarmult_base, fe backend " << backend << ": " << std::fixed << std::setprecision(3) << median_random << " mcs random, "
+      << median_sparse << " mcs sparse");
+  }
+  crypto_ops_set_fe_backend(initial_backend);
+
+  return true;
+}
+
+
+
 TEST(perf, primitives)
 {
   struct helper
@@ -1035,6 +1131,33 @@ struct mes_msm_and_check_zero_pippenger_v4
 };
 
 
+template<typename CT>
+struct mes_msm_and_check_zero_straus_pc
+{
+  static bool msm_and_check_zero(const scalar_vec_t& g_scalars, const scalar_vec_t& h_scalars, const point_t& summand, size_t c)
+  {
+    return msm_and_check_zero_straus_pc<CT>(g_scalars, h_scalars, summand);
+  }
+};
+
+template<typename CT>
+struct mes_msm_and_check_zero_pippenger_pc
+{
+  static bool msm_and_check_zero(const scalar_vec_t& g_scalars, const scalar_vec_t& h_scalars, const point_t& summand, size_t c)
+  {
+    return msm_and_check_zero_pippenger_pc<CT>(g_scalars, h_scalars, summand, (uint8_t)c);
+  }
+};
+
+template<typename CT>
+struct mes_msm_and_check_zero_default
+{
+  static bool msm_and_check_zero(const scalar_vec_t& g_scalars, const scalar_vec_t& h_scalars, const point_t& summand, size_t c)
+  {
+    return crypto::msm_and_check_zero<CT>(g_scalars, h_scalars, summand);
+  }
+};
+
 
 struct pme_runner_i
 {
@@ -1180,6 +1303,38 @@ TEST(perf, msm)
   return true;
 }
 
+TEST(perf, msm_pc)
+{
+  // compares the former default (Pippenger, c = 7) with the methods using the precomputed generators tables on 64, 128 and 1024 points (N is the size of g_scalars and h_scalars each)
+  std::deque<std::unique_ptr<pme_runner_i>> runners;
+  runners.emplace_back(std::make_unique< pme_runner_t<32,  bpp_crypto_trait_ZC_out, mes_msm_and_check_zero_pippenger_v3> >("ZC out, BPP,   64 points", 7));
+  runners.emplace_back(std::make_unique< pme_runner_t<32,  bpp_crypto_trait_ZC_out, mes_msm_and_check_zero_straus_pc>    >("ZC out, BPP,   64 points", 0));
+  runners.emplace_back(std::make_unique< pme_runner_t<32,  bpp_crypto_trait_ZC_out, mes_msm_and_check_zero_default>      >("ZC out, BPP,   64 points", 0));
+  runners.emplace_back(std::make_unique< pme_runner_t<64,  bpp_crypto_trait_ZC_out, mes_msm_and_check_zero_pippenger_v3> >("ZC out, BPP,  128 points", 7));
+  runners.emplace_back(std::make_unique< pme_runner_t<64,  bpp_crypto_trait_ZC_out, mes_msm_and_check_zero_straus_pc>    >("ZC out, BPP,  128 points", 0));
+  runners.emplace_back(std::make_unique< pme_runner_t<64,  bpp_crypto_trait_ZC_out, mes_msm_and_check_zero_default>      >("ZC out, BPP,  128 points", 0));
+  runners.emplace_back(std::make_unique< pme_runner_t<512, bpp_crypto_trait_ZC_out, mes_msm_and_check_zero_pippenger_v3> >("ZC out, BPP, 1024 points", 7));
+  runners.emplace_back(std::make_unique< pme_runner_t<512, bpp_crypto_trait_ZC_out, mes_msm_and_check_zero_straus_pc>    >("ZC out, BPP, 1024 points", 0));
+  for(uint8_t c = 6; c <= 9; ++c)
+    runners.emplace_back(std::make_unique< pme_runner_t<512, bpp_crypto_trait_ZC_out, mes_msm_and_check_zero_pippenger_pc> >("ZC out, BPP, 1024 points", c));
+  runners.emplace_back(std::make_unique< pme_runner_t<512, bpp_crypto_trait_ZC_out, mes_msm_and_check_zero_default>      >("ZC out, BPP, 1024 points", 0));
+
+  std::cout << "warm up..." << ENDL;
+  for(size_t k = 0; k < 10; ++k)
+  {
+    for(auto& runner : runners)
+      ASSERT_TRUE(runner->iteration(true));
+  }
+
+  size_t runs_count = 100;
+  for(size_t k = 0; k < runs_count; ++k)
+  {
+    for(auto& runner : runners)
+      ASSERT_TRUE(runner->iteration(false));
+  }
+
+  return true;
+}
 
 
 template<typename T>
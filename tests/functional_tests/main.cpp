@@ -57,6 +57,7 @@ namespace
   const command_line::arg_descriptor<std::string>   arg_difficulty_analysis  ( "difficulty-analysis", "Do difficulty analysis");
   const command_line::arg_descriptor<bool>   arg_test_plain_wallet  ( "test-plainwallet", "Do testing of plain wallet interface");
   const command_line::arg_descriptor<std::string> arg_crypto_tests  ( "crypto-tests", "Run experimental crypto tests");
+  const command_line::arg_descriptor<std::string> arg_crypto_bench_json  ( "crypto-bench-json", "Store results of crypto benchmarks (--crypto-tests=bench_*) to the given JSON file", "");
 
 }
 
@@ -107,6 +108,7 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_options, arg_difficulty_analysis);
   command_line::add_arg(desc_options, arg_test_plain_wallet);
   command_line::add_arg(desc_options, arg_crypto_tests);
+  command_line::add_arg(desc_options, arg_crypto_bench_json);
   
   
   test_serialization2();
@@ -211,7 +213,7 @@ int main(int argc, char* argv[])
   }
   else if (command_line::has_arg(vm, arg_crypto_tests))
   {
-    return crypto_tests(command_line::get_arg(vm, arg_crypto_tests));
+    return crypto_tests(command_line::get_arg(vm, arg_crypto_tests), command_line::get_arg(vm, arg_crypto_bench_json));
   }
   else
   {
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <ios>
@@ -25,6 +26,22 @@ extern "C" {
     }
     tree_hash((const char (*)[32]) data, length >> 5, hash);
   }
+
+  // the message goes to a batch with some of its parts, these are checked against the single-message hash
+  static void hash_fast_batch(const void *data, size_t length, char *hash) {
+    const char *p = static_cast<const char *>(data);
+    const size_t count = 7;
+    const void *parts[count] = { p, p, p + length / 2, p, p + length / 3, p, p + length - length / 5 };
+    size_t lengths[count] = { length, length / 3, length - length / 2, length, length - length / 3, 0, length / 5 };
+    vector<chash> hashes(count);
+    cn_fast_hash_batch(parts, lengths, count, reinterpret_cast<char *>(hashes.data()));
+    for (size_t i = 0; i != count; ++i) {
+      if (hashes[i] != cn_fast_hash(parts[i], lengths[i])) {
+        throw ios_base::failure("cn_fast_hash_batch mismatch");
+      }
+    }
+    memcpy(hash, &hashes[0], sizeof hashes[0]);
+  }
 }
 POP_VS_WARNINGS
 
@@ -32,7 +49,7 @@ extern "C" typedef void hash_f(const void *, size_t, char *);
 struct hash_func {
   const string name;
   hash_f &f;
-} hashes[] = {{"fast", cn_fast_hash}, /*{"slow", cn_slow_hash}, */{"tree", hash_tree},
+} hashes[] = {{"fast", cn_fast_hash}, {"fast-batch", hash_fast_batch}, /*{"slow", cn_slow_hash}, */{"tree", hash_tree},
   /*{"extra-blake", hash_extra_blake}, {"extra-groestl", hash_extra_groestl},
   {"extra-jh", hash_extra_jh}, {"extra-skein", hash_extra_skein}*/};
 
@@ -0,0 +1,55 @@
+// Copyright (c) 2014-2018 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include "common/base58.h"
+#include "currency_core/account.h"
+#include "currency_core/currency_format_utils.h"
+
+// address (72 bytes of data, 9 full blocks) encoding and parsing, as done for each destination of a batch transfer
+class test_base58_encode_addr
+{
+public:
+  static const size_t loop_count = 100000;
+
+  bool init()
+  {
+    m_acc.generate();
+    m_addr_str = currency::get_account_address_as_str(m_acc.get_public_address());
+    return true;
+  }
+
+  bool test()
+  {
+    return currency::get_account_address_as_str(m_acc.get_public_address()) == m_addr_str;
+  }
+
+private:
+  currency::account_base m_acc;
+  std::string m_addr_str;
+};
+
+class test_base58_decode_addr
+{
+public:
+  static const size_t loop_count = 100000;
+
+  bool init()
+  {
+    currency::account_base acc;
+    acc.generate();
+    m_addr_str = currency::get_account_address_as_str(acc.get_public_address());
+    return true;
+  }
+
+  bool test()
+  {
+    currency::account_public_address addr = AUTO_VAL_INIT(addr);
+    return currency::get_account_address_from_str(addr, m_addr_str);
+  }
+
+private:
+  std::string m_addr_str;
+};
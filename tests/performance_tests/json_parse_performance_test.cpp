@@ -0,0 +1,110 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <iostream>
+#include <random>
+#include "json_parse_performance_test.h"
+#include "performance_tests.h"
+#include "include_base_utils.h"
+#include "storages/portable_storage_template_helper.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+
+namespace
+{
+  // the string matching as it was before the block scanning, byte by byte
+  void match_string_bytewise(std::string::const_iterator& star_end_string, std::string::const_iterator buf_end, std::string& val)
+  {
+    val.clear();
+    bool escape_mode = false;
+    std::string::const_iterator it = star_end_string;
+    ++it;
+    for (; it != buf_end; it++)
+    {
+      if (escape_mode)
+      {
+        switch (*it)
+        {
+        case 'n': val.push_back('\n'); break;
+        case 'r': val.push_back('\r'); break;
+        case 't': val.push_back('\t'); break;
+        default:  val.push_back(*it);
+        }
+        escape_mode = false;
+      }
+      else if (*it == '"')
+      {
+        star_end_string = it;
+        return;
+      }
+      else if (*it == '\\')
+      {
+        escape_mode = true;
+      }
+      else
+      {
+        val.push_back(*it);
+      }
+    }
+    ASSERT_MES_AND_THROW("Failed to match string");
+  }
+
+  template<class t_matcher>
+  uint64_t measure_string_matching(const std::string& json_str, size_t iterations, t_matcher matcher)
+  {
+    std::string val;
+    performance_timer timer;
+    timer.start();
+    for (size_t i = 0; i != iterations; ++i)
+    {
+      std::string::const_iterator it = json_str.cbegin();
+      matcher(it, json_str.cend(), val);
+    }
+    return timer.elapsed_ms();
+  }
+}
+
+bool run_json_parse_performance_test()
+{
+  // sendrawtransaction-like request: one big hex blob
+  std::mt19937 gen(42);
+  std::string blob(100 * 1024, '\0');
+  for (char& c : blob)
+    c = static_cast<char>(gen());
+  currency::COMMAND_RPC_SEND_RAW_TX::request req = AUTO_VAL_INIT(req);
+  req.tx_as_hex = epee::string_tools::buff_to_hex_nodelimer(blob);
+  std::string req_json = epee::serialization::store_t_to_json(req);
+  std::string hex_json_str = std::string("\"") + req.tx_as_hex + "\"";
+
+  // text with escapes here and there, like comments in wallet batch calls
+  std::string text_json_str = "\"";
+  for (size_t i = 0; i != 20000; ++i)
+    text_json_str += "some comment text\\n";
+  text_json_str += "\"";
+
+  const size_t iterations = 500;
+  uint64_t hex_bytewise_ms = measure_string_matching(hex_json_str, iterations, match_string_bytewise);
+  uint64_t hex_ms = measure_string_matching(hex_json_str, iterations, epee::misc_utils::parse::match_string2);
+  uint64_t text_bytewise_ms = measure_string_matching(text_json_str, iterations, match_string_bytewise);
+  uint64_t text_ms = measure_string_matching(text_json_str, iterations, epee::misc_utils::parse::match_string2);
+
+  performance_timer timer;
+  timer.start();
+  for (size_t i = 0; i != iterations; ++i)
+  {
+    currency::COMMAND_RPC_SEND_RAW_TX::request req2 = AUTO_VAL_INIT(req2);
+    bool r = epee::serialization::load_t_from_json(req2, req_json);
+    CHECK_AND_ASSERT_MES(r && req2.tx_as_hex == req.tx_as_hex, false, "load_t_from_json failed");
+  }
+  uint64_t load_ms = timer.elapsed_ms();
+
+  const double mb = static_cast<double>(iterations) / (1024 * 1024);
+  std::cout << "hex string, " << hex_json_str.size() << " bytes x " << iterations << ":" << ENDL
+    << "  bytewise:  " << hex_bytewise_ms << " ms (" << hex_json_str.size() * mb * 1000 / std::max<uint64_t>(hex_bytewise_ms, 1) << " MB/s)" << ENDL
+    << "  scanning:  " << hex_ms << " ms (" << hex_json_str.size() * mb * 1000 / std::max<uint64_t>(hex_ms, 1) << " MB/s)" << ENDL;
+  std::cout << "escaped text, " << text_json_str.size() << " bytes x " << iterations << ":" << ENDL
+    << "  bytewise:  " << text_bytewise_ms << " ms (" << text_json_str.size() * mb * 1000 / std::max<uint64_t>(text_bytewise_ms, 1) << " MB/s)" << ENDL
+    << "  scanning:  " << text_ms << " ms (" << text_json_str.size() * mb * 1000 / std::max<uint64_t>(text_ms, 1) << " MB/s)" << ENDL;
+  std::cout << "COMMAND_RPC_SEND_RAW_TX::request load_t_from_json x " << iterations << ": " << load_ms << " ms" << ENDL;
+  return true;
+}
@@ -17,6 +17,7 @@
 #include "is_out_to_acc.h"
 #include "core_market_performance_test.h"
 #include "serialization_performance_test.h"
+#include "json_parse_performance_test.h"
 #include "chacha_stream_performance_test.h"
 #include "keccak_test.h"
 #include "blake2_test.h"
@@ -24,6 +25,9 @@
 #include "free_space_check.h"
 #include "htlc_hash_tests.h"
 #include "threads_pool_tests.h"
+#include "base58.h"
+#include "sync_replay_benchmark.h"
+#include "wallet_sync_benchmark.h"
 #include "wallet/plain_wallet_api.h"
 #include "wallet/view_iface.h"
 
@@ -107,6 +111,11 @@ int main(int argc, char** argv)
 {
   epee::string_tools::set_module_name_and_folder(argv[0]);
   epee::log_space::get_set_log_detalisation_level(true, LOG_LEVEL_2);
+
+  if (argc > 1 && std::string(argv[1]) == "sync_replay")
+    return run_sync_replay_benchmark(argc - 1, argv + 1);
+  if (argc > 1 && std::string(argv[1]) == "wallet_sync")
+    return run_wallet_sync_benchmark(argc - 1, argv + 1);
   //epee::log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL, LOG_LEVEL_2);
   //epee::log_space::log_singletone::add_logger(LOGGER_FILE,
   //  epee::log_space::log_singletone::get_default_log_file().c_str(),
@@ -131,6 +140,7 @@ int main(int argc, char** argv)
 //   
   //do_htlc_hash_tests();
   //run_serialization_performance_test();
+  //run_json_parse_performance_test();
   //return 1;
   //run_core_market_performance_tests(100000);
 
@@ -184,6 +194,8 @@ int main(int argc, char** argv)
   //TEST_PERFORMANCE0(test_generate_key_image);
   //TEST_PERFORMANCE0(test_derive_public_key);
   //TEST_PERFORMANCE0(test_derive_secret_key);
+  //TEST_PERFORMANCE0(test_base58_encode_addr);
+  //TEST_PERFORMANCE0(test_base58_decode_addr);
   
   //std::cout << "Tests finished. Elapsed time: " << timer.elapsed_ms() / 1000 << " sec" << std::endl;
 
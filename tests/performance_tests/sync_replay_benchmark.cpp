@@ -0,0 +1,218 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <iomanip>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "include_base_utils.h"
+#include "common/command_line.h"
+#include "common/db_backend_selector.h"
+#include "common/bootstrap_file.h"
+#include "currency_core/currency_core.h"
+#include "currency_core/checkpoints_create.h"
+#include "sync_replay_benchmark.h"
+
+#if defined(WIN32)
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+  const command_line::arg_descriptor<std::string> arg_bootstrap_file("bootstrap-file", "Bootstrap file with the blocks to replay (made by export_bootstrap)");
+  const command_line::arg_descriptor<std::string> arg_base_data_dir("base-data-dir", "Data dir with the chain the bootstrap file continues, it's copied into data-dir before the replay");
+  const command_line::arg_descriptor<uint64_t> arg_max_blocks("max-blocks", "Stop after this many blocks (rounded up to the file chunk), 0 - replay the whole file", 0);
+  const command_line::arg_descriptor<bool> arg_no_checkpoints("no-checkpoints", "Don't set the checkpoints, so all the blocks get fully verified", false);
+
+  uint64_t get_peak_rss()
+  {
+#if defined(WIN32)
+    PROCESS_MEMORY_COUNTERS pmc = AUTO_VAL_INIT(pmc);
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+      return pmc.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage ru = AUTO_VAL_INIT(ru);
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+      return 0;
+#if defined(__APPLE__)
+    return ru.ru_maxrss;
+#else
+    return static_cast<uint64_t>(ru.ru_maxrss) * 1024;
+#endif
+#endif
+  }
+
+  uint64_t get_directory_size(const std::string& path)
+  {
+    uint64_t size = 0;
+    boost::system::error_code ec;
+    for (boost::filesystem::recursive_directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec))
+    {
+      if (boost::filesystem::is_regular_file(it->status()))
+        size += boost::filesystem::file_size(it->path(), ec);
+    }
+    return size;
+  }
+
+  bool copy_data_directory(const boost::filesystem::path& from, const boost::filesystem::path& to)
+  {
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(to, ec);
+    CHECK_AND_ASSERT_MES(!ec, false, "Failed to create " << to.string() << ": " << ec.message());
+    for (boost::filesystem::directory_iterator it(from), end; it != end; ++it)
+    {
+      const boost::filesystem::path target = to / it->path().filename();
+      if (boost::filesystem::is_directory(it->status()))
+      {
+        if (!copy_data_directory(it->path(), target))
+          return false;
+        continue;
+      }
+      boost::filesystem::copy_file(it->path(), target, ec);
+      CHECK_AND_ASSERT_MES(!ec, false, "Failed to copy " << it->path().string() << ": " << ec.message());
+    }
+    return true;
+  }
+
+  struct stage_line
+  {
+    const char* name;
+    uint64_t count;
+    uint64_t total;
+    bool in_ms;
+  };
+
+  // blocks stages are pushed once per block, tx ones once per tx; the totals are the sums over the whole replay
+  void print_stages(currency::blockchain_storage::performnce_data& pd, double wall_s)
+  {
+    std::vector<stage_line> lines;
+#define SYNC_REPLAY_STAGE(field_name, in_ms) lines.push_back(stage_line{ #field_name, pd.field_name.get_count(), pd.field_name.get_total(), in_ms });
+    SYNC_REPLAY_STAGE(block_processing_time_0_ms, true);
+    SYNC_REPLAY_STAGE(block_processing_time_1, false);
+    SYNC_REPLAY_STAGE(target_calculating_time_2, false);
+    SYNC_REPLAY_STAGE(target_calculating_enum_blocks, false);
+    SYNC_REPLAY_STAGE(target_calculating_calc, false);
+    SYNC_REPLAY_STAGE(longhash_calculating_time_3, false);
+    SYNC_REPLAY_STAGE(pos_validate_ki_search, false);
+    SYNC_REPLAY_STAGE(pos_validate_get_out_keys_for_inputs, false);
+    SYNC_REPLAY_STAGE(pos_validate_zvp, false);
+    SYNC_REPLAY_STAGE(validate_miner_transaction_time, false);
+    SYNC_REPLAY_STAGE(txs_prevalidation_time, false);
+    SYNC_REPLAY_STAGE(collect_rangeproofs_data_from_tx_time, false);
+    SYNC_REPLAY_STAGE(verify_multiple_zc_outs_range_proofs_time, false);
+    SYNC_REPLAY_STAGE(batch_verify_range_proofs_time, false);
+    SYNC_REPLAY_STAGE(all_txs_insert_time_5, false);
+    SYNC_REPLAY_STAGE(insert_time_4, false);
+    SYNC_REPLAY_STAGE(raise_block_core_event, false);
+    SYNC_REPLAY_STAGE(etc_stuff_6, false);
+    SYNC_REPLAY_STAGE(tx_add_one_tx_time, false);
+    SYNC_REPLAY_STAGE(tx_check_inputs_time, false);
+    SYNC_REPLAY_STAGE(tx_check_inputs_prefix_hash, false);
+    SYNC_REPLAY_STAGE(tx_check_inputs_attachment_check, false);
+    SYNC_REPLAY_STAGE(tx_check_inputs_loop, false);
+    SYNC_REPLAY_STAGE(tx_check_inputs_loop_kimage_check, false);
+    SYNC_REPLAY_STAGE(tx_check_inputs_loop_ch_in_val_sig, false);
+    SYNC_REPLAY_STAGE(tx_check_inputs_loop_scan_outputkeys_get_item_size, false);
+    SYNC_REPLAY_STAGE(tx_check_inputs_loop_scan_outputkeys_relative_to_absolute, false);
+    SYNC_REPLAY_STAGE(tx_check_inputs_loop_scan_outputkeys_loop, false);
+    SYNC_REPLAY_STAGE(tx_check_inputs_loop_scan_outputkeys_loop_get_subitem, false);
+    SYNC_REPLAY_STAGE(tx_check_inputs_loop_scan_outputkeys_loop_find_tx, false);
+    SYNC_REPLAY_STAGE(tx_check_inputs_loop_scan_outputkeys_loop_handle_output, false);
+    SYNC_REPLAY_STAGE(tx_process_extra, false);
+    SYNC_REPLAY_STAGE(tx_process_attachment, false);
+    SYNC_REPLAY_STAGE(tx_process_inputs, false);
+    SYNC_REPLAY_STAGE(tx_push_global_index, false);
+    SYNC_REPLAY_STAGE(tx_check_exist, false);
+    SYNC_REPLAY_STAGE(tx_append_time, false);
+    SYNC_REPLAY_STAGE(tx_append_rl_wait, false);
+    SYNC_REPLAY_STAGE(tx_append_is_expired, false);
+    SYNC_REPLAY_STAGE(tx_store_db, false);
+#undef SYNC_REPLAY_STAGE
+
+    std::cout << std::left << std::setw(64) << "stage" << std::setw(12) << "count" << std::setw(14) << "total_ms" << std::setw(12) << "avg_us" << "of_wall" << ENDL;
+    for (const auto& l : lines)
+    {
+      const double total_ms = l.in_ms ? static_cast<double>(l.total) : l.total / 1000.0;
+      std::cout << std::left << std::setw(64) << l.name << std::setw(12) << l.count << std::setw(14) << std::fixed << std::setprecision(1) << total_ms
+        << std::setw(12) << (l.count ? total_ms * 1000 / l.count : 0) << std::setprecision(1) << (wall_s > 0 ? total_ms / 10 / wall_s : 0) << "%" << ENDL;
+    }
+  }
+}
+
+int run_sync_replay_benchmark(int argc, char** argv)
+{
+  boost::program_options::options_description desc("sync_replay options");
+  command_line::add_arg(desc, arg_bootstrap_file);
+  command_line::add_arg(desc, arg_base_data_dir);
+  command_line::add_arg(desc, arg_max_blocks);
+  command_line::add_arg(desc, arg_no_checkpoints);
+  command_line::add_arg(desc, command_line::arg_data_dir);
+  currency::core::init_options(desc);
+  tools::db::db_backend_selector::init_options(desc);
+
+  boost::program_options::variables_map vm;
+  bool r = command_line::handle_error_helper(desc, [&]()
+  {
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
+    boost::program_options::notify(vm);
+    return true;
+  });
+  if (!r || !command_line::has_arg(vm, arg_bootstrap_file))
+  {
+    std::cout << desc << ENDL;
+    return 1;
+  }
+
+  // fresh data dir only, otherwise the numbers aren't comparable
+  const std::string data_dir = command_line::get_arg(vm, command_line::arg_data_dir);
+  boost::system::error_code ec;
+  CHECK_AND_ASSERT_MES(!boost::filesystem::exists(data_dir, ec) || boost::filesystem::is_empty(data_dir, ec), 1, "data-dir " << data_dir << " is not empty, give a fresh one");
+  if (command_line::has_arg(vm, arg_base_data_dir))
+  {
+    const std::string base_dir = command_line::get_arg(vm, arg_base_data_dir);
+    LOG_PRINT_L0("Copying " << base_dir << " into " << data_dir << "...");
+    CHECK_AND_ASSERT_MES(copy_data_directory(base_dir, data_dir), 1, "Failed to copy base data dir");
+  }
+
+  currency::core c(nullptr);
+  r = c.init(vm);
+  CHECK_AND_ASSERT_MES(r, 1, "Failed to init core");
+  epee::misc_utils::auto_scope_leave_caller deinit_handler = epee::misc_utils::create_scope_leave_handler([&c]() { c.deinit(); });
+  if (!command_line::get_arg(vm, arg_no_checkpoints))
+  {
+    currency::checkpoints checkpoints;
+    CHECK_AND_ASSERT_MES(currency::create_checkpoints(checkpoints) && c.set_checkpoints(std::move(checkpoints)), 1, "Failed to set checkpoints");
+  }
+
+  currency::blockchain_storage& bcs = c.get_blockchain_storage();
+  const uint64_t start_size = bcs.get_current_blockchain_size();
+  const uint64_t start_txs = bcs.get_total_transactions();
+  const uint64_t max_blocks = command_line::get_arg(vm, arg_max_blocks);
+  const uint64_t start_db_size = get_directory_size(data_dir);
+  LOG_PRINT_L0("Replaying " << command_line::get_arg(vm, arg_bootstrap_file) << " from height " << start_size << "...");
+
+  bool stopped_by_limit = false;
+  uint64_t imported_blocks = 0;
+  const uint64_t started_at = epee::misc_utils::get_tick_count();
+  r = tools::import_bootstrap_file(c, command_line::get_arg(vm, arg_bootstrap_file), [&](uint64_t height)
+  {
+    stopped_by_limit = max_blocks != 0 && height + 1 - start_size >= max_blocks;
+    return stopped_by_limit;
+  }, imported_blocks);
+  const double wall_s = (epee::misc_utils::get_tick_count() - started_at) / 1000.0;
+  CHECK_AND_ASSERT_MES(r || stopped_by_limit, 1, "Replay failed at height " << bcs.get_current_blockchain_size());
+
+  const uint64_t blocks = bcs.get_current_blockchain_size() - start_size;
+  const uint64_t txs = bcs.get_total_transactions() - start_txs;
+  std::cout << ENDL << "Replayed " << blocks << " blocks (" << start_size << " - " << start_size + blocks - 1 << "), " << txs << " txs in " << std::fixed << std::setprecision(2) << wall_s << " s: "
+    << (wall_s > 0 ? blocks / wall_s : 0) << " blocks/s, " << (wall_s > 0 ? txs / wall_s : 0) << " txs/s" << ENDL
+    << "Peak RSS: " << get_peak_rss() / (1024 * 1024) << " MB, db size: " << get_directory_size(data_dir) / (1024 * 1024) << " MB (" << start_db_size / (1024 * 1024) << " MB before)" << ENDL << ENDL;
+  print_stages(bcs.get_performnce_data(), wall_s);
+  return 0;
+}
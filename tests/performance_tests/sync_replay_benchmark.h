@@ -0,0 +1,9 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+// performance_tests sync_replay --bootstrap-file=<path> --data-dir=<fresh dir> [--base-data-dir=<dir>] [--max-blocks=<n>] [--no-checkpoints]
+// replays the blocks of a bootstrap file (see export_bootstrap daemon command) through the same path the synchronization uses
+int run_sync_replay_benchmark(int argc, char** argv);
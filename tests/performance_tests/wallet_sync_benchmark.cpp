@@ -0,0 +1,241 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <boost/program_options.hpp>
+
+#include "include_base_utils.h"
+#include "common/command_line.h"
+#include "currency_core/currency_format_utils.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "storages/http_abstract_invoke.h"
+#include "storages/portable_storage_template_helper.h"
+#include "net/http_client.h"
+#include "wallet/wallet2.h"
+#include "wallet_sync_benchmark.h"
+
+// counts all the allocations made by the process, so the ones made by the scan can be told
+static std::atomic<uint64_t> g_wallet_sync_allocs_count(0);
+
+void* operator new(std::size_t size)
+{
+  g_wallet_sync_allocs_count.fetch_add(1, std::memory_order_relaxed);
+  void* p = std::malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+namespace
+{
+  const command_line::arg_descriptor<std::string> arg_blocks_file("blocks-file", "File with the recorded getblocks.bin responses");
+  const command_line::arg_descriptor<std::string> arg_record_from_daemon("record-from-daemon", "Daemon RPC address to record the responses from, e.g. http://127.0.0.1:11211");
+  const command_line::arg_descriptor<uint64_t> arg_max_blocks("max-blocks", "Stop recording after this many blocks (rounded up to the response), 0 - up to the top", 0);
+  const command_line::arg_descriptor<std::string> arg_seed("seed", "Seed phrase or tracking seed of the account to scan for");
+  const command_line::arg_descriptor<std::string> arg_seed_password("seed-password", "Password of the seed phrase, if it has one", "");
+  const command_line::arg_descriptor<uint64_t> arg_min_height("min-height", "Blocks up to this height are not scanned, as for a wallet created later", 0);
+
+  const unsigned int g_record_timeout_ms = 60000;
+
+  // the file is a sequence of [uint64_t size][COMMAND_RPC_GET_BLOCKS_FAST::response in binary portable storage]
+  bool read_response_blob(std::ifstream& in, std::string& blob)
+  {
+    uint64_t size = 0;
+    if (!in.read(reinterpret_cast<char*>(&size), sizeof(size)))
+      return false;
+    blob.resize(size);
+    return static_cast<bool>(in.read(&blob[0], size));
+  }
+
+  bool get_block_id(const currency::block_complete_entry& bce, crypto::hash& id)
+  {
+    currency::block b = AUTO_VAL_INIT(b);
+    CHECK_AND_ASSERT_MES(currency::parse_and_validate_block_from_blob(bce.block, b), false, "Failed to parse a block");
+    id = currency::get_block_hash(b);
+    return true;
+  }
+
+  // requests the blocks the way a wallet does, only without pruning, so the replay never needs the daemon
+  int record_responses(const std::string& daemon_address, const std::string& path, uint64_t max_blocks)
+  {
+    epee::net_utils::http::http_simple_client http_client;
+
+    currency::COMMAND_RPC_GET_BLOCKS_DETAILS::request gbd_req = AUTO_VAL_INIT(gbd_req);
+    currency::COMMAND_RPC_GET_BLOCKS_DETAILS::response gbd_res = AUTO_VAL_INIT(gbd_res);
+    gbd_req.height_start = 0;
+    gbd_req.count = 1;
+    gbd_req.ignore_transactions = true;
+    bool r = epee::net_utils::invoke_http_json_rpc(daemon_address + "/json_rpc", "get_blocks_details", gbd_req, gbd_res, http_client, g_record_timeout_ms);
+    CHECK_AND_ASSERT_MES(r && gbd_res.status == API_RETURN_CODE_OK && !gbd_res.blocks.empty(), 1, "Failed to get the genesis from " << daemon_address);
+    crypto::hash genesis_id = currency::null_hash;
+    CHECK_AND_ASSERT_MES(epee::string_tools::parse_tpod_from_hex_string(gbd_res.blocks.front().id, genesis_id), 1, "Wrong genesis id: " << gbd_res.blocks.front().id);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    CHECK_AND_ASSERT_MES(out.is_open(), 1, "Failed to open " << path);
+
+    crypto::hash last_id = genesis_id;
+    uint64_t blocks_recorded = 0, responses = 0, bytes = 0;
+    while (!max_blocks || blocks_recorded < max_blocks)
+    {
+      currency::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
+      currency::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
+      req.block_ids.push_back(last_id);
+      if (last_id != genesis_id)
+        req.block_ids.push_back(genesis_id);
+      req.minimum_height = 0;
+      req.prune_txs = false;
+      r = epee::net_utils::invoke_http_bin_remote_command2(daemon_address + "/getblocks.bin", req, res, http_client, g_record_timeout_ms);
+      CHECK_AND_ASSERT_MES(r, 1, "Failed to get blocks from " << daemon_address);
+      CHECK_AND_ASSERT_MES(res.status == API_RETURN_CODE_OK, 1, "getblocks.bin returned " << res.status);
+      // a response always starts with the last known block, nothing new then
+      const uint64_t new_blocks = last_id == genesis_id ? res.blocks.size() : res.blocks.size() - std::min<size_t>(res.blocks.size(), 1);
+      if (!new_blocks)
+        break;
+
+      std::string blob;
+      CHECK_AND_ASSERT_MES(epee::serialization::store_t_to_binary(res, blob), 1, "Failed to store a response");
+      const uint64_t size = blob.size();
+      out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+      out.write(blob.data(), blob.size());
+      CHECK_AND_ASSERT_MES(out.good(), 1, "Failed to write " << path);
+      CHECK_AND_ASSERT_MES(get_block_id(res.blocks.back(), last_id), 1, "Failed to get the last block id");
+
+      blocks_recorded += new_blocks;
+      bytes += blob.size();
+      ++responses;
+      LOG_PRINT_L0("Recorded " << blocks_recorded << " blocks (" << responses << " responses, " << bytes / 1024 / 1024 << " MB), top " << res.current_height);
+    }
+    LOG_PRINT_L0("Done: " << blocks_recorded << " blocks in " << responses << " responses written to " << path);
+    return 0;
+  }
+
+  int replay_responses(const std::string& path, const std::string& seed, const std::string& seed_password, uint64_t min_height)
+  {
+    currency::account_base acc;
+    bool r = currency::account_base::is_seed_tracking(seed) ? acc.restore_from_tracking_seed(seed) : acc.restore_from_seed_phrase(seed, seed_password);
+    CHECK_AND_ASSERT_MES(r, 1, "Failed to restore the account from the seed");
+
+    std::ifstream in(path, std::ios::binary);
+    CHECK_AND_ASSERT_MES(in.is_open(), 1, "Failed to open " << path);
+
+    std::shared_ptr<tools::wallet2> w(new tools::wallet2());
+    w->assign_account(acc);
+    w->set_core_proxy(std::make_shared<tools::i_core_proxy>());
+    w->set_minimum_height(min_height);
+    LOG_PRINT_L0("Scanning " << path << " for " << w->get_account().get_public_address_str() << (w->is_watch_only() ? " (watch-only)" : ""));
+
+    uint64_t read_us = 0, parse_us = 0, scan_us = 0, responses = 0, bytes = 0;
+    bool genesis_set = false;
+    const uint64_t allocs_before = g_wallet_sync_allocs_count.load(std::memory_order_relaxed);
+    TIME_MEASURE_START(wall_time);
+    while (true)
+    {
+      std::string blob;
+      TIME_MEASURE_START(read_time);
+      if (!read_response_blob(in, blob))
+        break;
+      TIME_MEASURE_FINISH(read_time);
+
+      TIME_MEASURE_START(parse_time);
+      currency::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
+      CHECK_AND_ASSERT_MES(epee::serialization::load_t_from_binary(res, blob), 1, "Failed to parse response #" << responses);
+      currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response direct = AUTO_VAL_INIT(direct);
+      direct.status = res.status;
+      direct.start_height = res.start_height;
+      direct.current_height = res.current_height;
+      direct.txs_pruned = res.txs_pruned;
+      CHECK_AND_ASSERT_MES(currency::unserialize_block_complete_entry(res, direct), 1, "Failed to unserialize the blocks of response #" << responses);
+      TIME_MEASURE_FINISH(parse_time);
+
+      if (!genesis_set)
+      {
+        CHECK_AND_ASSERT_MES(res.start_height == 0 && !res.blocks.empty(), 1, "The first response doesn't start with the genesis");
+        w->set_genesis(currency::get_block_hash(direct.blocks.front().block_ptr->bl));
+        genesis_set = true;
+      }
+
+      TIME_MEASURE_START(scan_time);
+      currency::COMMAND_RPC_GET_BLOCKS_DIRECT::request req = AUTO_VAL_INIT(req);
+      w->make_pull_blocks_request(req);
+      size_t offset = 0, blocks_added = 0;
+      std::atomic<bool> stop(false);
+      r = w->apply_pulled_blocks_part(req, direct, offset, direct.blocks.size(), blocks_added, stop);
+      TIME_MEASURE_FINISH(scan_time);
+      CHECK_AND_ASSERT_MES(r, 1, "Response #" << responses << " doesn't continue the previous one");
+
+      read_us += read_time;
+      parse_us += parse_time;
+      scan_us += scan_time;
+      bytes += blob.size();
+      ++responses;
+    }
+    TIME_MEASURE_FINISH(wall_time);
+    const uint64_t allocs = g_wallet_sync_allocs_count.load(std::memory_order_relaxed) - allocs_before;
+    CHECK_AND_ASSERT_MES(responses != 0, 1, "No responses in " << path);
+
+    const tools::wallet2::scan_stats& st = w->get_scan_stats();
+    const double wall_s = wall_time / 1e6;
+    auto line = [&](const char* name, uint64_t us)
+    {
+      std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(1) << std::setw(12) << us / 1000.0 << " ms"
+        << std::setw(8) << (wall_time ? us * 100.0 / wall_time : 0) << "%" << ENDL;
+    };
+
+    std::cout << ENDL << responses << " responses (" << bytes / 1024 / 1024 << " MB), " << st.blocks << " blocks, " << st.txs << " txs, " << st.outputs << " outputs, "
+      << st.own_outputs << " own outputs, height " << w->get_blockchain_current_size() - 1 << ENDL
+      << std::fixed << std::setprecision(1) << "wall " << wall_s << " s: " << (wall_s > 0 ? st.outputs / wall_s : 0) << " outputs/s, " << (wall_s > 0 ? st.blocks / wall_s : 0) << " blocks/s" << ENDL
+      << "allocations: " << allocs << ", " << std::setprecision(2) << (st.outputs ? double(allocs) / st.outputs : 0) << " per output" << ENDL << ENDL;
+    line("file read", read_us);
+    line("parsing (portable storage, blobs)", parse_us);
+    line("scan, apply_pulled_blocks_part()", scan_us);
+    line("  parallel outs lookup, wall", st.parallel_lookup_wall_us);
+    line("    derivations, summed over threads", st.derivation_us);
+    line("    ownership checks, summed over threads", st.ownership_us);
+    line("  inline lookups (derivation + ownership)", st.inline_lookup_us);
+    line("  state update", st.state_update_us);
+
+    std::list<tools::wallet_public::asset_balance_entry> balances;
+    uint64_t mined = 0;
+    w->balance(balances, mined);
+    for (const auto& b : balances)
+      std::cout << "balance " << currency::print_money_brief(b.total, b.asset_info.decimal_point) << " " << b.asset_info.ticker << ENDL;
+    return 0;
+  }
+}
+
+int run_wallet_sync_benchmark(int argc, char** argv)
+{
+  boost::program_options::options_description desc("wallet_sync options");
+  command_line::add_arg(desc, arg_blocks_file);
+  command_line::add_arg(desc, arg_record_from_daemon);
+  command_line::add_arg(desc, arg_max_blocks);
+  command_line::add_arg(desc, arg_seed);
+  command_line::add_arg(desc, arg_seed_password);
+  command_line::add_arg(desc, arg_min_height);
+
+  boost::program_options::variables_map vm;
+  bool r = command_line::handle_error_helper(desc, [&]()
+  {
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
+    boost::program_options::notify(vm);
+    return true;
+  });
+  if (!r || !command_line::has_arg(vm, arg_blocks_file) || (!command_line::has_arg(vm, arg_record_from_daemon) && !command_line::has_arg(vm, arg_seed)))
+  {
+    std::cout << desc << ENDL;
+    return 1;
+  }
+
+  const std::string path = command_line::get_arg(vm, arg_blocks_file);
+  if (command_line::has_arg(vm, arg_record_from_daemon))
+    return record_responses(command_line::get_arg(vm, arg_record_from_daemon), path, command_line::get_arg(vm, arg_max_blocks));
+  return replay_responses(path, command_line::get_arg(vm, arg_seed), command_line::get_arg(vm, arg_seed_password), command_line::get_arg(vm, arg_min_height));
+}
@@ -0,0 +1,11 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+// performance_tests wallet_sync --blocks-file=<path> --record-from-daemon=<address> [--max-blocks=<n>]
+//   records the getblocks.bin responses a wallet syncing from the genesis gets (txs not pruned) into blocks-file
+// performance_tests wallet_sync --blocks-file=<path> --seed=<seed or tracking seed> [--seed-password=<pass>] [--min-height=<h>]
+//   scans the recorded responses with the given account, without a daemon, and prints where the time went
+int run_wallet_sync_benchmark(int argc, char** argv);
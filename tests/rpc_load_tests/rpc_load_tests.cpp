@@ -0,0 +1,526 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Load generator for core_rpc_server and wallet_rpc_server: replays weighted request mixes (wallet sync, explorer,
+// wallet rpc) over concurrent keep-alive connections, in closed loop (each connection sends its next request as soon as
+// the previous one is answered) or open loop (requests are scheduled at a fixed rate and latency counts from the
+// scheduled time, so a stalled server is not hidden by the generator slowing down), and prints per-method latencies.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <random>
+#include <thread>
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include "include_base_utils.h"
+#include "common/command_line.h"
+#include "currency_core/currency_config.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "wallet/wallet_public_structs_defs.h"
+#include "storages/http_abstract_invoke.h"
+#include "net/http_client.h"
+
+#define RPC_LOAD_PREPARE_WINDOWS                  20
+#define RPC_LOAD_PREPARE_WINDOW_BLOCKS            50
+#define RPC_LOAD_PREPARE_MAX_RAW_TXS              50
+#define RPC_LOAD_DECOYS_PER_REQUEST               16
+
+namespace
+{
+  const command_line::arg_descriptor<std::string> arg_daemon_address  ("daemon-address", "Daemon RPC address", std::string("http://127.0.0.1:") + std::to_string(RPC_DEFAULT_PORT));
+  const command_line::arg_descriptor<std::string> arg_wallet_address  ("wallet-address", "Wallet RPC address, used by the wallet methods", "http://127.0.0.1:12233");
+  const command_line::arg_descriptor<std::string> arg_mix             ("mix", "wallet-sync, explorer, wallet, or a custom mix as method:weight,...", "wallet-sync");
+  const command_line::arg_descriptor<uint64_t>    arg_concurrency     ("concurrency", "Concurrent connections", 8);
+  const command_line::arg_descriptor<uint64_t>    arg_duration        ("duration", "Test duration in seconds", 30);
+  const command_line::arg_descriptor<std::string> arg_mode            ("mode", "closed (back-to-back requests per connection) or open (fixed --rate)", "closed");
+  const command_line::arg_descriptor<uint64_t>    arg_rate            ("rate", "Requests per second in total, for the open loop mode", 100);
+  const command_line::arg_descriptor<uint64_t>    arg_timeout         ("timeout", "Request timeout in milliseconds", 10000);
+
+  enum rpc_method
+  {
+    method_getblocks_bin = 0,
+    method_getrandom_outs3_bin,
+    method_get_tx_details,
+    method_sendrawtransaction,
+    method_getinfo,
+    method_get_blocks_details,
+    method_get_main_block_details,
+    method_wallet_getbalance,
+    method_wallet_get_wallet_info,
+    method_wallet_get_recent_txs,
+    methods_count
+  };
+
+  const char* const g_method_names[methods_count] = {
+    "getblocks.bin",
+    "getrandom_outs3.bin",
+    "get_tx_details",
+    "sendrawtransaction",
+    "getinfo",
+    "get_blocks_details",
+    "get_main_block_details",
+    "wallet.getbalance",
+    "wallet.get_wallet_info",
+    "wallet.get_recent_txs_and_info2"
+  };
+
+  // weights of the mix presets, close to what a syncing wallet and a block explorer send to a remote node
+  const char* const g_mix_wallet_sync = "getblocks.bin:60,getrandom_outs3.bin:20,getinfo:15,sendrawtransaction:5";
+  const char* const g_mix_explorer = "get_tx_details:40,get_blocks_details:25,get_main_block_details:20,getinfo:15";
+  const char* const g_mix_wallet = "wallet.getbalance:40,wallet.get_wallet_info:20,wallet.get_recent_txs_and_info2:40";
+
+  // upper bounds of the latency histogram buckets, in milliseconds; the last bucket is unbounded
+  const uint64_t g_buckets_ms[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 };
+  const size_t g_buckets_count = sizeof(g_buckets_ms) / sizeof(g_buckets_ms[0]);
+
+  uint64_t get_time_us()
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // the chain data the requests are made of, collected once before the run
+  struct chain_sample
+  {
+    uint64_t height = 0;
+    crypto::hash genesis_id = currency::null_hash;
+    std::vector<crypto::hash> block_ids;
+    std::vector<std::string> tx_ids;
+    std::vector<std::string> txs_as_hex;
+    std::vector<uint64_t> zc_global_indexes;
+  };
+
+  enum call_result
+  {
+    call_ok = 0,
+    call_not_ok,    // answered, but with an error status or a json-rpc error
+    call_failed     // transport error or timeout
+  };
+
+  struct method_stat
+  {
+    uint64_t not_ok = 0;
+    uint64_t failed = 0;
+    std::vector<uint64_t> latencies_us;
+  };
+
+  struct load_params
+  {
+    std::string daemon_address;
+    std::string wallet_address;
+    uint64_t concurrency;
+    uint64_t duration_s;
+    bool open_loop;
+    uint64_t rate;
+    unsigned int timeout_ms;
+  };
+
+  bool parse_mix(const std::string& mix, std::vector<std::pair<rpc_method, uint64_t>>& weights)
+  {
+    std::string m = mix;
+    if (m == "wallet-sync")
+      m = g_mix_wallet_sync;
+    else if (m == "explorer")
+      m = g_mix_explorer;
+    else if (m == "wallet")
+      m = g_mix_wallet;
+
+    std::vector<std::string> entries;
+    boost::split(entries, m, boost::is_any_of(","), boost::token_compress_on);
+    for (const auto& e : entries)
+    {
+      std::vector<std::string> parts;
+      boost::split(parts, e, boost::is_any_of(":"));
+      CHECK_AND_ASSERT_MES(parts.size() == 2, false, "Wrong mix entry: " << e << ", expected method:weight");
+      const char* const* it = std::find(g_method_names, g_method_names + methods_count, parts[0]);
+      CHECK_AND_ASSERT_MES(it != g_method_names + methods_count, false, "Unknown method in the mix: " << parts[0]);
+      uint64_t weight = 0;
+      CHECK_AND_ASSERT_MES(epee::string_tools::get_xtype_from_string(weight, parts[1]) && weight != 0, false, "Wrong weight in the mix entry: " << e);
+      weights.push_back(std::make_pair(static_cast<rpc_method>(it - g_method_names), weight));
+    }
+    return !weights.empty();
+  }
+
+  bool mix_needs_daemon(const std::vector<std::pair<rpc_method, uint64_t>>& weights)
+  {
+    for (const auto& w : weights)
+    {
+      if (w.first < method_wallet_getbalance)
+        return true;
+    }
+    return false;
+  }
+
+  // block ids, tx ids, raw txs and ZC output indexes from a few windows of recent blocks
+  bool prepare_chain_sample(const load_params& p, chain_sample& cs)
+  {
+    epee::net_utils::http::http_simple_client http_client;
+    const std::string json_rpc_url = p.daemon_address + "/json_rpc";
+
+    currency::COMMAND_RPC_GET_INFO::request info_req = AUTO_VAL_INIT(info_req);
+    currency::COMMAND_RPC_GET_INFO::response info_res = AUTO_VAL_INIT(info_res);
+    bool r = epee::net_utils::invoke_http_json_remote_command2(p.daemon_address + "/getinfo", info_req, info_res, http_client, p.timeout_ms);
+    CHECK_AND_ASSERT_MES(r && info_res.status == API_RETURN_CODE_OK, false, "Failed to get daemon info from " << p.daemon_address);
+    CHECK_AND_ASSERT_MES(info_res.height > 1, false, "The daemon has no blocks to request");
+    cs.height = info_res.height;
+
+    std::mt19937_64 rng(cs.height);
+    for (size_t w = 0; w != RPC_LOAD_PREPARE_WINDOWS; ++w)
+    {
+      currency::COMMAND_RPC_GET_BLOCKS_DETAILS::request req = AUTO_VAL_INIT(req);
+      currency::COMMAND_RPC_GET_BLOCKS_DETAILS::response res = AUTO_VAL_INIT(res);
+      req.height_start = w == 0 ? 0 : rng() % cs.height;
+      req.count = RPC_LOAD_PREPARE_WINDOW_BLOCKS;
+      req.ignore_transactions = false;
+      r = epee::net_utils::invoke_http_json_rpc(json_rpc_url, "get_blocks_details", req, res, http_client, p.timeout_ms);
+      CHECK_AND_ASSERT_MES(r && res.status == API_RETURN_CODE_OK, false, "Failed to get blocks details from " << p.daemon_address);
+      for (const auto& b : res.blocks)
+      {
+        crypto::hash id = currency::null_hash;
+        if (!epee::string_tools::hex_to_pod(b.id, id))
+          continue;
+        if (b.height == 0)
+          cs.genesis_id = id;
+        cs.block_ids.push_back(id);
+        for (const auto& tx : b.transactions_details)
+        {
+          // the first tx of a block is its coinbase, it can't be relayed
+          if (&tx != &b.transactions_details.front())
+            cs.tx_ids.push_back(tx.id);
+          for (const auto& out : tx.outs)
+          {
+            if (out.amount == 0)
+              cs.zc_global_indexes.push_back(out.global_index);
+          }
+        }
+      }
+    }
+    CHECK_AND_ASSERT_MES(cs.genesis_id != currency::null_hash, false, "Failed to get the genesis block id");
+
+    if (!cs.tx_ids.empty())
+    {
+      currency::COMMAND_RPC_GET_TRANSACTIONS::request req = AUTO_VAL_INIT(req);
+      currency::COMMAND_RPC_GET_TRANSACTIONS::response res = AUTO_VAL_INIT(res);
+      for (size_t i = 0; i != cs.tx_ids.size() && i != RPC_LOAD_PREPARE_MAX_RAW_TXS; ++i)
+        req.txs_hashes.push_back(cs.tx_ids[i]);
+      r = epee::net_utils::invoke_http_json_remote_command2(p.daemon_address + "/gettransactions", req, res, http_client, p.timeout_ms);
+      CHECK_AND_ASSERT_MES(r && res.status == API_RETURN_CODE_OK, false, "Failed to get transactions from " << p.daemon_address);
+      cs.txs_as_hex.assign(res.txs_as_hex.begin(), res.txs_as_hex.end());
+    }
+
+    LOG_PRINT_L0("Chain sample: height " << cs.height << ", " << cs.block_ids.size() << " blocks, " << cs.tx_ids.size() << " txs, "
+      << cs.zc_global_indexes.size() << " ZC outputs");
+    return true;
+  }
+
+  class load_worker
+  {
+  public:
+    load_worker(const load_params& p, const chain_sample& cs, const std::vector<std::pair<rpc_method, uint64_t>>& weights, uint64_t seed)
+      : m_p(p)
+      , m_cs(cs)
+      , m_weights(weights)
+      , m_weights_sum(0)
+      , m_rng(seed)
+      , m_stats(methods_count)
+    {
+      for (const auto& w : m_weights)
+        m_weights_sum += w.second;
+    }
+
+    // closed loop when schedule_step_us is 0, otherwise each request is taken from the shared schedule
+    void run(uint64_t start_us, uint64_t stop_us, uint64_t schedule_step_us, std::atomic<uint64_t>& schedule_pos)
+    {
+      while (true)
+      {
+        uint64_t started_us = get_time_us();
+        if (schedule_step_us)
+        {
+          started_us = start_us + schedule_pos.fetch_add(1) * schedule_step_us;
+          uint64_t now = get_time_us();
+          if (started_us > now)
+            std::this_thread::sleep_for(std::chrono::microseconds(started_us - now));
+        }
+        if (started_us >= stop_us)
+          break;
+
+        rpc_method m = pick_method();
+        call_result cr = invoke(m);
+        method_stat& st = m_stats[m];
+        st.latencies_us.push_back(get_time_us() - started_us);
+        st.not_ok += cr == call_not_ok ? 1 : 0;
+        st.failed += cr == call_failed ? 1 : 0;
+      }
+    }
+
+    const std::vector<method_stat>& get_stats() const { return m_stats; }
+
+  private:
+    rpc_method pick_method()
+    {
+      uint64_t v = m_rng() % m_weights_sum;
+      for (const auto& w : m_weights)
+      {
+        if (v < w.second)
+          return w.first;
+        v -= w.second;
+      }
+      return m_weights.back().first;
+    }
+
+    template<class t_container>
+    const typename t_container::value_type& pick(const t_container& c)
+    {
+      return c[m_rng() % c.size()];
+    }
+
+    template<class t_response>
+    static call_result status_result(bool r, const t_response& res)
+    {
+      return !r ? call_failed : res.status == API_RETURN_CODE_OK ? call_ok : call_not_ok;
+    }
+
+    template<class t_request, class t_response>
+    call_result invoke_json_rpc(const std::string& address, const char* method_name, const t_request& req, t_response& res)
+    {
+      epee::json_rpc::error err = AUTO_VAL_INIT(err);
+      bool r = epee::net_utils::invoke_http_json_rpc(address + "/json_rpc", method_name, req, res, get_client(address), err, m_p.timeout_ms);
+      return !r ? call_failed : err.code || !err.message.empty() ? call_not_ok : call_ok;
+    }
+
+    epee::net_utils::http::http_simple_client& get_client(const std::string& address)
+    {
+      return address == m_p.daemon_address ? m_daemon_client : m_wallet_client;
+    }
+
+    call_result invoke(rpc_method m)
+    {
+      switch (m)
+      {
+      case method_getblocks_bin:
+      {
+        // a wallet that is behind: only the genesis is known, the daemon picks the start by minimum_height
+        currency::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
+        currency::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
+        req.block_ids.push_back(m_cs.genesis_id);
+        req.minimum_height = m_rng() % m_cs.height;
+        req.prune_txs = true;
+        bool r = epee::net_utils::invoke_http_bin_remote_command2(m_p.daemon_address + "/getblocks.bin", req, res, m_daemon_client, m_p.timeout_ms);
+        return status_result(r, res);
+      }
+      case method_getrandom_outs3_bin:
+      {
+        currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::request req = AUTO_VAL_INIT(req);
+        currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::response res = AUTO_VAL_INIT(res);
+        currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS3::offsets_distribution od = AUTO_VAL_INIT(od);
+        od.amount = 0;
+        for (size_t i = 0; i != RPC_LOAD_DECOYS_PER_REQUEST; ++i)
+          od.global_offsets.push_back(m_cs.zc_global_indexes.empty() ? 0 : pick(m_cs.zc_global_indexes));
+        req.amounts.push_back(od);
+        req.height_upper_limit = m_cs.height;
+        req.use_forced_mix_outs = false;
+        req.coinbase_percents = 10;
+        bool r = epee::net_utils::invoke_http_bin_remote_command2(m_p.daemon_address + "/getrandom_outs3.bin", req, res, m_daemon_client, m_p.timeout_ms);
+        return status_result(r, res);
+      }
+      case method_get_tx_details:
+      {
+        currency::COMMAND_RPC_GET_TX_DETAILS::request req = AUTO_VAL_INIT(req);
+        currency::COMMAND_RPC_GET_TX_DETAILS::response res = AUTO_VAL_INIT(res);
+        if (m_cs.tx_ids.empty())
+          return call_not_ok;
+        req.tx_hash = pick(m_cs.tx_ids);
+        return invoke_json_rpc(m_p.daemon_address, "get_tx_details", req, res);
+      }
+      case method_sendrawtransaction:
+      {
+        // replays of confirmed txs: they get rejected, but only after being parsed and checked against the chain
+        currency::COMMAND_RPC_SEND_RAW_TX::request req = AUTO_VAL_INIT(req);
+        currency::COMMAND_RPC_SEND_RAW_TX::response res = AUTO_VAL_INIT(res);
+        if (m_cs.txs_as_hex.empty())
+          return call_not_ok;
+        req.tx_as_hex = pick(m_cs.txs_as_hex);
+        bool r = epee::net_utils::invoke_http_json_remote_command2(m_p.daemon_address + "/sendrawtransaction", req, res, m_daemon_client, m_p.timeout_ms);
+        return status_result(r, res);
+      }
+      case method_getinfo:
+      {
+        currency::COMMAND_RPC_GET_INFO::request req = AUTO_VAL_INIT(req);
+        currency::COMMAND_RPC_GET_INFO::response res = AUTO_VAL_INIT(res);
+        return invoke_json_rpc(m_p.daemon_address, "getinfo", req, res);
+      }
+      case method_get_blocks_details:
+      {
+        currency::COMMAND_RPC_GET_BLOCKS_DETAILS::request req = AUTO_VAL_INIT(req);
+        currency::COMMAND_RPC_GET_BLOCKS_DETAILS::response res = AUTO_VAL_INIT(res);
+        req.height_start = m_rng() % m_cs.height;
+        req.count = 10;
+        req.ignore_transactions = false;
+        return invoke_json_rpc(m_p.daemon_address, "get_blocks_details", req, res);
+      }
+      case method_get_main_block_details:
+      {
+        currency::COMMAND_RPC_GET_BLOCK_DETAILS::request req = AUTO_VAL_INIT(req);
+        currency::COMMAND_RPC_GET_BLOCK_DETAILS::response res = AUTO_VAL_INIT(res);
+        req.id = pick(m_cs.block_ids);
+        return invoke_json_rpc(m_p.daemon_address, "get_main_block_details", req, res);
+      }
+      case method_wallet_getbalance:
+      {
+        tools::wallet_public::COMMAND_RPC_GET_BALANCE::request req = AUTO_VAL_INIT(req);
+        tools::wallet_public::COMMAND_RPC_GET_BALANCE::response res = AUTO_VAL_INIT(res);
+        return invoke_json_rpc(m_p.wallet_address, "getbalance", req, res);
+      }
+      case method_wallet_get_wallet_info:
+      {
+        tools::wallet_public::COMMAND_RPC_GET_WALLET_INFO::request req = AUTO_VAL_INIT(req);
+        tools::wallet_public::COMMAND_RPC_GET_WALLET_INFO::response res = AUTO_VAL_INIT(res);
+        return invoke_json_rpc(m_p.wallet_address, "get_wallet_info", req, res);
+      }
+      case method_wallet_get_recent_txs:
+      {
+        tools::wallet_public::COMMAND_RPC_GET_RECENT_TXS_AND_INFO2::request req = AUTO_VAL_INIT(req);
+        tools::wallet_public::COMMAND_RPC_GET_RECENT_TXS_AND_INFO2::response res = AUTO_VAL_INIT(res);
+        req.offset = m_rng() % 100;
+        req.count = 20;
+        req.update_provision_info = true;
+        return invoke_json_rpc(m_p.wallet_address, "get_recent_txs_and_info2", req, res);
+      }
+      default:
+        return call_failed;
+      }
+    }
+
+    const load_params& m_p;
+    const chain_sample& m_cs;
+    const std::vector<std::pair<rpc_method, uint64_t>>& m_weights;
+    uint64_t m_weights_sum;
+    std::mt19937_64 m_rng;
+    std::vector<method_stat> m_stats;
+    epee::net_utils::http::http_simple_client m_daemon_client;
+    epee::net_utils::http::http_simple_client m_wallet_client;
+  };
+
+  void print_stats(std::vector<method_stat>& stats, uint64_t wall_us)
+  {
+    std::cout << std::left << std::setw(34) << "method" << std::right << std::setw(10) << "count" << std::setw(10) << "not_ok" << std::setw(10) << "failed"
+      << std::setw(11) << "per_sec" << std::setw(10) << "p50_ms" << std::setw(10) << "p90_ms" << std::setw(10) << "p99_ms" << std::setw(10) << "p99.9_ms" << std::setw(10) << "max_ms" << ENDL;
+    for (size_t m = 0; m != methods_count; ++m)
+    {
+      std::vector<uint64_t>& l = stats[m].latencies_us;
+      if (l.empty())
+        continue;
+      std::sort(l.begin(), l.end());
+      auto pct_ms = [&](size_t pct) { return l[std::min(l.size() - 1, l.size() * pct / 1000)] / 1000.0; };
+      std::cout << std::left << std::setw(34) << g_method_names[m] << std::right << std::setw(10) << l.size() << std::setw(10) << stats[m].not_ok << std::setw(10) << stats[m].failed
+        << std::fixed << std::setprecision(1) << std::setw(11) << (wall_us ? l.size() * 1e6 / wall_us : 0) << std::setprecision(2) << std::setw(10) << pct_ms(500) << std::setw(10) << pct_ms(900)
+        << std::setw(10) << pct_ms(990) << std::setw(10) << pct_ms(999) << std::setw(10) << l.back() / 1000.0 << ENDL;
+    }
+
+    std::cout << ENDL << "latency histogram, requests per bucket (upper bound in ms)" << ENDL << std::left << std::setw(34) << "method" << std::right;
+    for (size_t b = 0; b != g_buckets_count; ++b)
+      std::cout << std::setw(8) << g_buckets_ms[b];
+    std::cout << std::setw(8) << "inf" << ENDL;
+    for (size_t m = 0; m != methods_count; ++m)
+    {
+      const std::vector<uint64_t>& l = stats[m].latencies_us;
+      if (l.empty())
+        continue;
+      std::vector<uint64_t> buckets(g_buckets_count + 1, 0);
+      for (uint64_t us : l)
+        ++buckets[std::lower_bound(g_buckets_ms, g_buckets_ms + g_buckets_count, (us + 999) / 1000) - g_buckets_ms];
+      std::cout << std::left << std::setw(34) << g_method_names[m] << std::right;
+      for (uint64_t c : buckets)
+        std::cout << std::setw(8) << c;
+      std::cout << ENDL;
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+  epee::log_space::get_set_log_detalisation_level(true, LOG_LEVEL_0);
+  epee::log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL, LOG_LEVEL_0);
+
+  boost::program_options::options_description desc("rpc_load_tests options");
+  command_line::add_arg(desc, command_line::arg_help);
+  command_line::add_arg(desc, arg_daemon_address);
+  command_line::add_arg(desc, arg_wallet_address);
+  command_line::add_arg(desc, arg_mix);
+  command_line::add_arg(desc, arg_concurrency);
+  command_line::add_arg(desc, arg_duration);
+  command_line::add_arg(desc, arg_mode);
+  command_line::add_arg(desc, arg_rate);
+  command_line::add_arg(desc, arg_timeout);
+
+  boost::program_options::variables_map vm;
+  bool r = command_line::handle_error_helper(desc, [&]()
+  {
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
+    boost::program_options::notify(vm);
+    return true;
+  });
+  if (!r || command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << desc << ENDL;
+    return r ? 0 : 1;
+  }
+
+  load_params p = AUTO_VAL_INIT(p);
+  p.daemon_address = command_line::get_arg(vm, arg_daemon_address);
+  p.wallet_address = command_line::get_arg(vm, arg_wallet_address);
+  p.concurrency = command_line::get_arg(vm, arg_concurrency);
+  p.duration_s = command_line::get_arg(vm, arg_duration);
+  p.rate = command_line::get_arg(vm, arg_rate);
+  p.timeout_ms = static_cast<unsigned int>(command_line::get_arg(vm, arg_timeout));
+  const std::string mode = command_line::get_arg(vm, arg_mode);
+  CHECK_AND_ASSERT_MES(mode == "closed" || mode == "open", 1, "Wrong --mode: " << mode << ", expected closed or open");
+  p.open_loop = mode == "open";
+  CHECK_AND_ASSERT_MES(p.concurrency != 0 && p.duration_s != 0 && (!p.open_loop || p.rate != 0), 1, "--concurrency, --duration and --rate must not be zero");
+
+  std::vector<std::pair<rpc_method, uint64_t>> weights;
+  CHECK_AND_ASSERT_MES(parse_mix(command_line::get_arg(vm, arg_mix), weights), 1, "Wrong --mix");
+
+  chain_sample cs;
+  if (mix_needs_daemon(weights))
+    CHECK_AND_ASSERT_MES(prepare_chain_sample(p, cs), 1, "Failed to prepare requests data");
+
+  std::cout << "mix: " << command_line::get_arg(vm, arg_mix) << ", " << p.concurrency << " connections, " << p.duration_s << " s, "
+    << (p.open_loop ? "open loop at " + std::to_string(p.rate) + " req/s (latency counts from the scheduled send time)" : std::string("closed loop")) << ENDL;
+
+  std::vector<std::unique_ptr<load_worker>> workers;
+  for (uint64_t i = 0; i != p.concurrency; ++i)
+    workers.emplace_back(new load_worker(p, cs, weights, i + 1));
+
+  std::atomic<uint64_t> schedule_pos(0);
+  const uint64_t schedule_step_us = p.open_loop ? std::max<uint64_t>(1000000 / p.rate, 1) : 0;
+  const uint64_t start_us = get_time_us();
+  const uint64_t stop_us = start_us + p.duration_s * 1000000;
+  std::vector<std::thread> threads;
+  for (auto& w : workers)
+    threads.emplace_back([&, pw = w.get()]() { pw->run(start_us, stop_us, schedule_step_us, schedule_pos); });
+  for (auto& t : threads)
+    t.join();
+  const uint64_t wall_us = get_time_us() - start_us;
+
+  std::vector<method_stat> total(methods_count);
+  for (const auto& w : workers)
+  {
+    for (size_t m = 0; m != methods_count; ++m)
+    {
+      const method_stat& st = w->get_stats()[m];
+      total[m].not_ok += st.not_ok;
+      total[m].failed += st.failed;
+      total[m].latencies_us.insert(total[m].latencies_us.end(), st.latencies_us.begin(), st.latencies_us.end());
+    }
+  }
+  std::cout << ENDL;
+  print_stats(total, wall_us);
+  return 0;
+  CATCH_ENTRY_L0("main", 1);
+}
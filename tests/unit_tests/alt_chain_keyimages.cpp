@@ -0,0 +1,63 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "currency_core/currency_format_utils.h"
+#include "currency_core/blockchain_storage_basic.h"
+
+using currency::alt_chain_keyimages;
+
+namespace
+{
+  crypto::key_image ki_for(uint64_t n)
+  {
+    crypto::key_image ki = AUTO_VAL_INIT(ki);
+    *reinterpret_cast<uint64_t*>(&ki) = n + 1;
+    return ki;
+  }
+
+  size_t layers_count(const alt_chain_keyimages::ptr& p)
+  {
+    std::unordered_set<const alt_chain_keyimages*> visited;
+    size_t count = 0;
+    alt_chain_keyimages::for_each_layer(p, visited, [&](const alt_chain_keyimages&) { ++count; });
+    return count;
+  }
+}
+
+TEST(alt_chain_keyimages, branches)
+{
+  // the common part of two branches: blocks with 1..5 key images each
+  alt_chain_keyimages::ptr common;
+  uint64_t n = 0;
+  for (size_t i = 0; i < 200; ++i)
+  {
+    std::unordered_set<crypto::key_image> kis;
+    for (size_t j = 0; j <= i % 5; ++j)
+      kis.insert(ki_for(n++));
+    common = alt_chain_keyimages::make(common, std::move(kis));
+  }
+  const uint64_t common_count = n;
+  ASSERT_EQ(common->get_total_count(), common_count);
+  ASSERT_LE(layers_count(common), 12);
+
+  alt_chain_keyimages::ptr a = alt_chain_keyimages::make(common, std::unordered_set<crypto::key_image>{ ki_for(1000000) });
+  alt_chain_keyimages::ptr b = alt_chain_keyimages::make(common, std::unordered_set<crypto::key_image>{ ki_for(2000000) });
+  for (uint64_t i = 0; i < common_count; ++i)
+  {
+    ASSERT_TRUE(alt_chain_keyimages::contains(a, ki_for(i)));
+    ASSERT_TRUE(alt_chain_keyimages::contains(b, ki_for(i)));
+  }
+  ASSERT_TRUE(alt_chain_keyimages::contains(a, ki_for(1000000)));
+  ASSERT_FALSE(alt_chain_keyimages::contains(a, ki_for(2000000)));
+  ASSERT_TRUE(alt_chain_keyimages::contains(b, ki_for(2000000)));
+  ASSERT_FALSE(alt_chain_keyimages::contains(b, ki_for(1000000)));
+  ASSERT_FALSE(alt_chain_keyimages::contains(common, ki_for(1000000)));
+  ASSERT_FALSE(alt_chain_keyimages::contains(alt_chain_keyimages::ptr(), ki_for(0)));
+
+  // a block without key images shares its parent's set
+  ASSERT_EQ(alt_chain_keyimages::make(a, std::unordered_set<crypto::key_image>()), a);
+}
@@ -5,6 +5,7 @@
 #include "gtest/gtest.h"
 
 #include <cstdint>
+#include <boost/multiprecision/cpp_int.hpp>
 
 #include "common/base58.cpp"
 #include "currency_core/currency_format_utils.h"
@@ -433,6 +434,80 @@ TEST_decode_addr_neg("111111", decode_fails_due_address_too_short_3);
 TEST_decode_addr_neg("999999", decode_fails_due_address_too_short_4);
 TEST_decode_addr_neg("ZZZZZZ", decode_fails_due_address_too_short_5);
 
+namespace
+{
+  // the original digit-at-a-time block codec, the chunked one must match it bit by bit
+  void ref_encode_block(const char* block, size_t size, char* res)
+  {
+    uint64_t num = base58::uint_8be_to_64(reinterpret_cast<const uint8_t*>(block), size);
+    int i = static_cast<int>(base58::encoded_block_sizes[size]) - 1;
+    for (; 0 < num; --i, num /= base58::alphabet_size)
+      res[i] = base58::alphabet[num % base58::alphabet_size];
+  }
+
+  bool ref_decode_block(const char* block, size_t size, char* res)
+  {
+    int res_size = base58::decoded_block_sizes::instance(size);
+    if (res_size <= 0)
+      return false;
+
+    boost::multiprecision::uint128_t res_num = 0, order = 1;
+    for (size_t i = size - 1; i < size; --i, order *= base58::alphabet_size)
+    {
+      int digit = base58::reverse_alphabet::instance(block[i]);
+      if (digit < 0)
+        return false;
+      res_num += order * digit;
+    }
+
+    if (res_num >= (boost::multiprecision::uint128_t(1) << (8 * res_size)))
+      return false;
+
+    base58::uint_64_to_8be(res_num.convert_to<uint64_t>(), res_size, reinterpret_cast<uint8_t*>(res));
+    return true;
+  }
+}
+
+TEST(base58_chunked_block, matches_digit_at_a_time_codec)
+{
+  for (size_t size = 1; size <= base58::full_block_size; ++size)
+  {
+    for (size_t k = 0; k < 2000; ++k)
+    {
+      std::string block(size, '\0');
+      if (k < 2)
+        memset(&block[0], k == 0 ? 0 : 0xff, size);
+      else
+        crypto::generate_random_bytes(size, &block[0]);
+
+      std::string enc(base58::encoded_block_sizes[size], base58::alphabet[0]), ref_enc(enc);
+      base58::encode_block(block.data(), size, &enc[0]);
+      ref_encode_block(block.data(), size, &ref_enc[0]);
+      ASSERT_EQ(ref_enc, enc);
+    }
+  }
+
+  // random digit strings, most of them overflow in the last block digits
+  for (size_t size = 1; size <= base58::full_encoded_block_size; ++size)
+  {
+    for (size_t k = 0; k < 2000; ++k)
+    {
+      std::string enc(size, base58::alphabet[0]);
+      for (size_t i = 0; i < size; ++i)
+        enc[i] = k == 0 ? 'z' : base58::alphabet[crypto::rand<size_t>() % (k % 3 == 0 ? base58::alphabet_size : 3)];
+      if (k % 101 == 0)
+        enc[crypto::rand<size_t>() % size] = '0';
+
+      std::string dec(base58::full_block_size, '\0'), ref_dec(dec);
+      bool r = base58::decode_block(enc.data(), size, &dec[0]);
+      bool ref_r = ref_decode_block(enc.data(), size, &ref_dec[0]);
+      ASSERT_EQ(ref_r, r);
+      if (r)
+        ASSERT_EQ(ref_dec, dec);
+    }
+  }
+}
+
 namespace
 {
   std::string test_serialized_keys = MAKE_STR(
@@ -0,0 +1,107 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "currency_protocol/block_spans_scheduler.h"
+
+namespace
+{
+  std::vector<crypto::hash> make_ids(uint64_t from, uint64_t to)
+  {
+    std::vector<crypto::hash> result;
+    for (uint64_t h = from; h != to; ++h)
+      result.push_back(crypto::cn_fast_hash(&h, sizeof h));
+    return result;
+  }
+
+  currency::block_spans_scheduler::peer_id make_peer(uint8_t n)
+  {
+    currency::block_spans_scheduler::peer_id p = AUTO_VAL_INIT(p);
+    p.data[0] = n;
+    return p;
+  }
+}
+
+TEST(block_spans_scheduler, disjoint_spans_and_stalls)
+{
+  typedef currency::block_spans_scheduler bss;
+  bss s;
+  const bss::peer_id a = make_peer(1), b = make_peer(2);
+  const std::vector<crypto::hash> ids = make_ids(0, 300);
+  const std::vector<crypto::hash> first(ids.begin(), ids.begin() + 100), second(ids.begin() + 100, ids.begin() + 200);
+
+  // a peer gets its span, the other one can't take it
+  ASSERT_EQ(s.claim(a, first, 100000, 0), 100);
+  ASSERT_TRUE(s.is_claimed_by(a, ids[0]));
+  ASSERT_EQ(s.get_claim_state(a, ids[0], 0), bss::claim_free);
+  ASSERT_EQ(s.get_claim_state(b, ids[0], 0), bss::claim_busy);
+  ASSERT_EQ(s.get_claim_state(b, ids[100], 0), bss::claim_free);
+  ASSERT_EQ(s.claim(b, std::vector<crypto::hash>(ids.begin() + 50, ids.end()), 100000, 0), 0);
+  ASSERT_EQ(s.claim(b, second, 100000, 0), 100);
+
+  // a span that overlaps the busy one is given up to it
+  const bss::peer_id c = make_peer(3);
+  ASSERT_EQ(s.claim(c, std::vector<crypto::hash>(ids.begin() + 200, ids.end()), 100000, 0), 100);
+  ASSERT_EQ(s.claim(a, std::vector<crypto::hash>(ids.begin() + 290, ids.end()), 100000, 0), 0);
+
+  // a downloaded span is never stalled, the one that is not is given to another peer after the timeout
+  s.on_received(a, first, 100000, 1000);
+  ASSERT_EQ(s.get_peer_speed(a), 100);
+  ASSERT_EQ(s.get_claim_state(c, ids[0], BLOCKS_SYNCHRONIZING_SPAN_MIN_TIMEOUT * 10), bss::claim_busy);
+  ASSERT_EQ(s.get_claim_state(a, ids[150], BLOCKS_SYNCHRONIZING_SPAN_MIN_TIMEOUT), bss::claim_busy);
+  ASSERT_EQ(s.get_claim_state(a, ids[150], BLOCKS_SYNCHRONIZING_SPAN_MIN_TIMEOUT + 1), bss::claim_stalled);
+  ASSERT_EQ(s.claim(a, second, 100000, BLOCKS_SYNCHRONIZING_SPAN_MIN_TIMEOUT + 1), 100);
+  ASSERT_TRUE(s.is_claimed_by(a, ids[150]));
+  ASSERT_FALSE(s.is_claimed_by(b, ids[150]));
+
+  // a slow peer gets one span at a time
+  s.on_received(c, std::vector<crypto::hash>(), 1000, 1000);
+  ASSERT_EQ(s.get_spans_in_flight_limit(c), 1);
+  ASSERT_EQ(s.get_spans_in_flight_limit(a), BLOCKS_SYNCHRONIZING_MAX_BATCHES_IN_FLIGHT);
+
+  // the spans of a closed connection become free, the downloaded ones stay until they are released
+  s.release_peer(a);
+  ASSERT_EQ(s.get_claim_state(b, ids[150], 0), bss::claim_free);
+  ASSERT_EQ(s.get_claim_state(b, ids[0], 0), bss::claim_busy);
+  s.release(first);
+  ASSERT_EQ(s.get_claim_state(b, ids[0], 0), bss::claim_free);
+  ASSERT_EQ(s.get_claimed_blocks_count(), 100);
+
+  s.set_peer_waiting(b, true);
+  ASSERT_EQ(s.get_waiting_peers().size(), 1);
+  s.release_peer(b);
+  ASSERT_TRUE(s.get_waiting_peers().empty());
+}
+
+TEST(block_spans_scheduler, batch_limits)
+{
+  currency::block_spans_scheduler s;
+  const currency::block_spans_scheduler::peer_id a = make_peer(1);
+  const std::vector<crypto::hash> ids = make_ids(0, 10);
+  size_t max_count = 0;
+  uint64_t max_size = 0;
+
+  // the defaults until the throughput is known
+  s.get_batch_limits(a, max_count, max_size);
+  ASSERT_EQ(max_count, BLOCKS_SYNCHRONIZING_DEFAULT_COUNT);
+  ASSERT_EQ(max_size, BLOCKS_SYNCHRONIZING_DEFAULT_SIZE);
+
+  // a slow link gets small batches, but not smaller than the minimum
+  s.claim(a, ids, 1000, 0);
+  s.on_received(a, ids, 1000, 100);
+  s.get_batch_limits(a, max_count, max_size);
+  ASSERT_EQ(max_count, CURRENCY_PROTOCOL_MAX_BLOCKS_REQUEST_COUNT);
+  ASSERT_EQ(max_size, BLOCKS_SYNCHRONIZING_MIN_SIZE);
+
+  // the batch grows with the throughput, up to the maximum
+  for (uint64_t t = 200; t != 2000; t += 100)
+  {
+    s.claim(a, ids, 1000, t - 100);
+    s.on_received(a, ids, 1000000, t);
+  }
+  s.get_batch_limits(a, max_count, max_size);
+  ASSERT_EQ(max_size, BLOCKS_SYNCHRONIZING_MAX_SIZE);
+}
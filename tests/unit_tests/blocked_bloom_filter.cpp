@@ -0,0 +1,51 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+#include "common/blocked_bloom_filter.h"
+
+namespace
+{
+  crypto::key_image make_ki(uint64_t n)
+  {
+    crypto::hash h = crypto::cn_fast_hash(&n, sizeof(n));
+    return *reinterpret_cast<const crypto::key_image*>(&h);
+  }
+}
+
+TEST(blocked_bloom_filter, insert_false_positives_saturation)
+{
+  const size_t capacity = 10000;
+  tools::blocked_bloom_filter<crypto::key_image> f;
+
+  // not initialized: everything may be there
+  ASSERT_TRUE(f.may_contain(make_ki(0)));
+
+  f.reset(capacity, 0x1234);
+  ASSERT_FALSE(f.may_contain(make_ki(0)));
+  for (uint64_t i = 0; i != capacity; ++i)
+    f.insert(make_ki(i));
+  ASSERT_EQ(f.get_count(), capacity);
+  for (uint64_t i = 0; i != capacity; ++i)
+    ASSERT_TRUE(f.may_contain(make_ki(i)));
+
+  size_t false_positives = 0;
+  for (uint64_t i = 1000000; i != 1000000 + 10 * capacity; ++i)
+    false_positives += f.may_contain(make_ki(i)) ? 1 : 0;
+  ASSERT_LT(false_positives, capacity / 5); // ~0.5%, 2% at most
+
+  // overloaded: gives up filtering
+  for (uint64_t i = capacity; i != 2 * capacity + 1; ++i)
+    f.insert(make_ki(i));
+  for (uint64_t i = 1000000; i != 1000000 + 100; ++i)
+    ASSERT_TRUE(f.may_contain(make_ki(i)));
+
+  f.reset(capacity, 0x4321);
+  ASSERT_EQ(f.get_count(), 0);
+  ASSERT_FALSE(f.may_contain(make_ki(1)));
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "rpc/blocks_feed_utils.h"
+
+TEST(blocks_feed_frames, append_and_parse)
+{
+  std::string frames;
+  for (size_t i = 0; i != 3; ++i)
+  {
+    currency::block_complete_entry bce = AUTO_VAL_INIT(bce);
+    bce.block = std::string(100 * i + 1, static_cast<char>('a' + i)); // the second one needs a 2-byte size
+    for (size_t j = 0; j != i; ++j)
+    {
+      bce.txs.push_back(std::string(10, static_cast<char>('0' + j)));
+      bce.tx_global_outs.emplace_back();
+      bce.tx_global_outs.back().v = { j, j + 1000000 };
+    }
+    bce.coinbase_global_outs = { i, i + 1 };
+    currency::append_blocks_feed_frame(frames, bce);
+  }
+
+  std::list<currency::block_complete_entry> blocks;
+  ASSERT_TRUE(currency::parse_blocks_feed_frames(frames, blocks));
+  ASSERT_EQ(blocks.size(), 3);
+  size_t i = 0;
+  for (const auto& bce : blocks)
+  {
+    ASSERT_EQ(bce.block, std::string(100 * i + 1, static_cast<char>('a' + i)));
+    ASSERT_EQ(bce.txs.size(), i);
+    ASSERT_EQ(bce.tx_global_outs.size(), i);
+    for (size_t j = 0; j != i; ++j)
+      ASSERT_EQ(bce.tx_global_outs[j].v, std::vector<uint64_t>({ j, j + 1000000 }));
+    ASSERT_EQ(bce.coinbase_global_outs, std::vector<uint64_t>({ i, i + 1 }));
+    ++i;
+  }
+
+  // frames are read one by one
+  size_t pos = 0;
+  currency::block_complete_entry bce = AUTO_VAL_INIT(bce);
+  ASSERT_TRUE(currency::read_blocks_feed_frame(frames, pos, bce));
+  ASSERT_EQ(bce.block, "a");
+  ASSERT_TRUE(currency::read_blocks_feed_frame(frames, pos, bce));
+  ASSERT_EQ(bce.block, std::string(101, 'b'));
+  ASSERT_TRUE(bce.coinbase_global_outs == std::vector<uint64_t>({ 1, 2 }));
+
+  // a cut frame is an error
+  blocks.clear();
+  ASSERT_FALSE(currency::parse_blocks_feed_frames(frames.substr(0, frames.size() - 1), blocks));
+  blocks.clear();
+  ASSERT_TRUE(currency::parse_blocks_feed_frames(std::string(), blocks));
+  ASSERT_TRUE(blocks.empty());
+}
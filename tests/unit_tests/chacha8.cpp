@@ -82,3 +82,52 @@ TEST_CHACHA8(0)
 TEST_CHACHA8(1)
 TEST_CHACHA8(2)
 TEST_CHACHA8(3)
+
+TEST(chacha8, multi_block_matches_single_block)
+{
+  // long inputs go through the multi-block code, one block at a time is always the plain one
+  uint8_t key[CHACHA8_KEY_SIZE], iv[CHACHA8_IV_SIZE];
+  for (size_t i = 0; i != sizeof(key); ++i)
+    key[i] = static_cast<uint8_t>(i * 7 + 1);
+  for (size_t i = 0; i != sizeof(iv); ++i)
+    iv[i] = static_cast<uint8_t>(i * 13 + 5);
+
+  std::string plain(64 * 37 + 21, 0);
+  for (size_t i = 0; i != plain.size(); ++i)
+    plain[i] = static_cast<char>(i * 31 + 3);
+
+  for (size_t length : { size_t(64 * 8), size_t(64 * 9 + 1), size_t(64 * 16), plain.size() })
+  {
+    std::string cipher(length, 0);
+    crypto::chacha8(plain.data(), length, key, iv, &cipher[0]);
+
+    uint32_t input[16];
+    memcpy(input, "expand 32-byte k", 16);
+    memcpy(input + 4, key, sizeof(key));
+    input[12] = input[13] = 0;
+    memcpy(input + 14, iv, sizeof(iv));
+    std::string expected(length, 0);
+    for (size_t offset = 0; offset + 64 <= length; offset += 64)
+      crypto::chacha8_blocks(input, plain.data() + offset, 1, &expected[offset]);
+    ASSERT_EQ(input[12], length / 64);
+    ASSERT_EQ(cipher.substr(0, length - length % 64), expected.substr(0, length - length % 64));
+
+    std::string decrypted(length, 0);
+    crypto::chacha8(cipher.data(), length, key, iv, &decrypted[0]);
+    ASSERT_EQ(decrypted, plain.substr(0, length));
+  }
+
+  // the block counter carries over to the next word inside a multi-block run
+  uint32_t input[16], input_single[16];
+  for (size_t i = 0; i != 16; ++i)
+    input[i] = static_cast<uint32_t>(i * 0x9e3779b9);
+  input[12] = 0xfffffffd;
+  memcpy(input_single, input, sizeof(input));
+  std::string cipher(64 * 16, 0), expected(64 * 16, 0);
+  crypto::chacha8_blocks(input, plain.data(), 16, &cipher[0]);
+  for (size_t i = 0; i != 16; ++i)
+    crypto::chacha8_blocks(input_single, plain.data() + i * 64, 1, &expected[i * 64]);
+  ASSERT_EQ(cipher, expected);
+  ASSERT_EQ(input[12], 13);
+  ASSERT_EQ(input[13], input_single[13]);
+}
@@ -0,0 +1,35 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "currency_core/chain_change_notifier.h"
+
+TEST(chain_change_notifier, wait_and_notify)
+{
+  currency::chain_change_notifier n;
+
+  uint64_t counter = n.get_counter();
+  ASSERT_FALSE(n.wait(counter, 10));
+
+  // a notification made after the counter was seen isn't missed even if nobody waits yet
+  n.notify();
+  ASSERT_TRUE(n.wait(counter, 0));
+  counter = n.get_counter();
+  ASSERT_FALSE(n.wait(counter, 0));
+
+  // all the waiters wake up
+  std::atomic<size_t> woken(0);
+  std::vector<std::thread> waiters;
+  for (size_t i = 0; i != 4; ++i)
+    waiters.emplace_back([&]() { if (n.wait(counter, 10000)) ++woken; });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  n.notify();
+  for (auto& t : waiters)
+    t.join();
+  ASSERT_EQ(woken, 4);
+}
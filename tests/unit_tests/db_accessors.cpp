@@ -2,6 +2,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #include <algorithm>
+#include <thread>
 
 #define USE_INSECURE_RANDOM_RPNG_ROUTINES // turns on random manupulation for tests
 
@@ -85,6 +86,239 @@ TEST(db_accessor_tests_2, recoursive_tx_test)
 
 }
 
+TEST(db_accessor_tests_2, value_view_read_test)
+{
+  epee::shared_recursive_mutex m_rw_lock;
+  tools::db::basic_db_accessor m_db(std::shared_ptr<tools::db::i_db_backend>(new tools::db::lmdb_db_backend), m_rw_lock);
+  tools::db::basic_key_value_accessor<uint64_t, std::vector<uint64_t>, true> m_t_container(m_db);
+  tools::db::basic_key_value_accessor<uint64_t, crypto::hash, false> m_pod_container(m_db);
+
+  const std::string folder_name = "./TEST_db_value_view_read";
+  tools::create_directories_if_necessary(folder_name);
+  ASSERT_TRUE(m_db.open(folder_name, CACHE_SIZE));
+  ASSERT_TRUE(m_t_container.init("t_values"));
+  ASSERT_TRUE(m_pod_container.init("pod_values"));
+
+  std::vector<uint64_t> v{ 1, 2, 3, UINT64_MAX, 1000000007 };
+  crypto::hash h = crypto::cn_fast_hash(v.data(), v.size() * sizeof(uint64_t));
+
+  ASSERT_TRUE(m_t_container.begin_transaction());
+  m_t_container.clear();
+  m_pod_container.clear();
+  m_t_container.set(7, v);
+  m_pod_container.set(7, h);
+  m_t_container.commit_transaction();
+
+  // read without explicit transaction
+  auto pv = m_t_container.get(7);
+  ASSERT_TRUE(pv.get() != nullptr);
+  ASSERT_EQ(*pv, v);
+  auto ph = m_pod_container.get(7);
+  ASSERT_TRUE(ph.get() != nullptr);
+  ASSERT_EQ(*ph, h);
+  ASSERT_TRUE(m_t_container.get(8).get() == nullptr);
+  ASSERT_TRUE(m_pod_container.get(8).get() == nullptr);
+
+  // read within a read-only transaction, the view points to the memory map
+  ASSERT_TRUE(m_t_container.begin_transaction(true));
+  size_t k_size = 0;
+  uint64_t k = 7;
+  const char* pk = tools::db::key_to_ptr(k, k_size);
+  auto cb = tools::db::make_value_view_callback([&](const void* p, uint64_t s)
+  {
+    return s == sizeof(h) && memcmp(p, &h, sizeof(h)) == 0;
+  });
+  tools::db::container_handle pod_h = 0;
+  ASSERT_TRUE(m_db.get_backend()->open_container("pod_values", pod_h));
+  ASSERT_TRUE(m_db.get_backend()->get_view(pod_h, pk, k_size, cb));
+  pv = m_t_container.get(7);
+  ASSERT_TRUE(pv.get() != nullptr);
+  ASSERT_EQ(*pv, v);
+  m_t_container.commit_transaction();
+}
+
+TEST(db_accessor_tests_2, get_multiple_test)
+{
+  epee::shared_recursive_mutex m_rw_lock;
+  tools::db::basic_db_accessor m_db(std::shared_ptr<tools::db::i_db_backend>(new tools::db::lmdb_db_backend), m_rw_lock);
+  tools::db::cached_key_value_accessor<crypto::hash, std::vector<uint64_t>, true, false> m_t_container(m_db);
+  tools::db::basic_key_value_accessor<uint64_t, uint64_t, false> m_pod_container(m_db);
+
+  const std::string folder_name = "./TEST_db_get_multiple";
+  tools::create_directories_if_necessary(folder_name);
+  ASSERT_TRUE(m_db.open(folder_name, CACHE_SIZE));
+  ASSERT_TRUE(m_t_container.init("t_values"));
+  ASSERT_TRUE(m_pod_container.init("pod_values"));
+
+  const size_t count = 100;
+  std::vector<crypto::hash> hashes;
+  ASSERT_TRUE(m_t_container.begin_transaction());
+  m_t_container.clear();
+  m_pod_container.clear();
+  for (uint64_t i = 0; i != count; ++i)
+  {
+    hashes.push_back(crypto::cn_fast_hash(&i, sizeof i));
+    if (i % 3 != 0)
+    {
+      m_t_container.set(hashes.back(), std::vector<uint64_t>(i % 7, i));
+      m_pod_container.set(i, i * i);
+    }
+  }
+  m_t_container.commit_transaction();
+
+  // keys in reverse order with a duplicate, so that the db order differs from the requested one
+  std::vector<crypto::hash> t_keys(hashes.rbegin(), hashes.rend());
+  t_keys.push_back(hashes[1]);
+  std::vector<uint64_t> pod_keys;
+  for (uint64_t i = 0; i != count + 10; ++i)
+    pod_keys.push_back(count + 9 - i);
+
+  m_t_container.clear_cache();
+  m_t_container.get(hashes[2]); // make some of the keys cached
+  m_t_container.get(hashes[4]);
+  for (size_t attempt = 0; attempt != 2; ++attempt)
+  {
+    std::vector<std::shared_ptr<const std::vector<uint64_t> > > t_res;
+    m_t_container.get_multiple(t_keys, t_res);
+    ASSERT_EQ(t_res.size(), t_keys.size());
+    for (size_t j = 0; j != t_keys.size(); ++j)
+    {
+      std::shared_ptr<const std::vector<uint64_t> > expected = m_t_container.get(t_keys[j]);
+      ASSERT_EQ(t_res[j].get() == nullptr, expected.get() == nullptr);
+      if (expected)
+        ASSERT_EQ(*t_res[j], *expected);
+    }
+  }
+
+  std::vector<std::shared_ptr<const uint64_t> > pod_res;
+  m_pod_container.get_multiple(pod_keys, pod_res);
+  ASSERT_EQ(pod_res.size(), pod_keys.size());
+  for (size_t j = 0; j != pod_keys.size(); ++j)
+  {
+    uint64_t k = pod_keys[j];
+    bool present = k < count && k % 3 != 0;
+    ASSERT_EQ(pod_res[j].get() != nullptr, present);
+    if (present)
+      ASSERT_EQ(*pod_res[j], k * k);
+  }
+
+  // within a read transaction as well
+  ASSERT_TRUE(m_pod_container.begin_transaction(true));
+  m_pod_container.get_multiple(pod_keys, pod_res);
+  ASSERT_EQ(pod_res.size(), pod_keys.size());
+  ASSERT_TRUE(pod_res[pod_keys.size() - 2].get() != nullptr);
+  ASSERT_EQ(*pod_res[pod_keys.size() - 2], 1);
+  m_pod_container.commit_transaction();
+
+  std::vector<crypto::hash> no_keys;
+  std::vector<std::shared_ptr<const std::vector<uint64_t> > > empty_res;
+  m_t_container.get_multiple(no_keys, empty_res);
+  ASSERT_TRUE(empty_res.empty());
+}
+
+TEST(db_accessor_tests_2, sharded_cache_isolation_test)
+{
+  epee::shared_recursive_mutex m_rw_lock;
+  tools::db::basic_db_accessor m_db(std::shared_ptr<tools::db::i_db_backend>(new tools::db::lmdb_db_backend), m_rw_lock);
+  typedef tools::db::cached_key_value_accessor<uint64_t, uint64_t, false, true> container_t;
+  container_t m_container(m_db);
+
+  const std::string folder_name = "./TEST_db_sharded_cache_isolation";
+  tools::create_directories_if_necessary(folder_name);
+  ASSERT_TRUE(m_db.open(folder_name, CACHE_SIZE));
+  ASSERT_TRUE(m_container.init("values"));
+
+  const uint64_t count = 100;
+  ASSERT_TRUE(m_container.begin_transaction());
+  m_container.clear();
+  for (uint64_t i = 0; i != count; ++i)
+    m_container.set(i, i);
+  m_container.commit_transaction();
+
+  auto get_hits = [&]() -> uint64_t
+  {
+    std::vector<container_t::cache_shard_stats> stats;
+    m_container.get_cache_shards_stats(stats);
+    uint64_t hits = 0;
+    for (auto& st : stats)
+      hits += st.hits;
+    return hits;
+  };
+
+  // reads values in another thread and returns the number of keys with value == i + delta
+  auto read_in_other_thread = [&](uint64_t delta) -> uint64_t
+  {
+    uint64_t matched = 0;
+    std::thread th([&]()
+    {
+      for (uint64_t i = 0; i != count; ++i)
+      {
+        auto p = m_container.get(i);
+        if (p && *p == i + delta)
+          ++matched;
+      }
+    });
+    th.join();
+    return matched;
+  };
+
+  // fill the cache
+  ASSERT_EQ(read_in_other_thread(0), count);
+
+  // a writer stages changes, other readers still see committed values and keep hitting the cache
+  ASSERT_TRUE(m_container.begin_transaction());
+  for (uint64_t i = 0; i != count; ++i)
+    m_container.set(i, i + 1);
+  m_container.erase(0);
+  ASSERT_TRUE(m_container.get(0).get() == nullptr);
+  ASSERT_EQ(*m_container.get(1), 2);
+
+  uint64_t hits_before = get_hits();
+  ASSERT_EQ(read_in_other_thread(0), count);
+  ASSERT_EQ(get_hits() - hits_before, count);
+
+  // nothing changed after abort, cache hits kept
+  m_container.abort_transaction();
+  hits_before = get_hits();
+  ASSERT_EQ(read_in_other_thread(0), count);
+  ASSERT_EQ(get_hits() - hits_before, count);
+
+  // nested abort: the outer tx changes are still visible to the writer
+  ASSERT_TRUE(m_container.begin_transaction());
+  m_container.set(5, 50);
+  ASSERT_TRUE(m_container.begin_transaction());
+  m_container.set(5, 500);
+  m_container.set(6, 600);
+  ASSERT_EQ(*m_container.get(5), 500);
+  m_container.abort_transaction();
+  ASSERT_EQ(*m_container.get(5), 50);
+  ASSERT_EQ(*m_container.get(6), 6);
+  ASSERT_EQ(read_in_other_thread(0), count);
+  m_container.commit_transaction();
+
+  // committed changes are visible to everyone
+  ASSERT_EQ(*m_container.get(5), 50);
+  ASSERT_EQ(read_in_other_thread(0), count - 1);
+
+  ASSERT_TRUE(m_container.begin_transaction());
+  for (uint64_t i = 0; i != count; ++i)
+    m_container.set(i, i + 2);
+  m_container.commit_transaction();
+  hits_before = get_hits();
+  ASSERT_EQ(read_in_other_thread(2), count);
+  ASSERT_EQ(get_hits() - hits_before, count);
+
+  // clear within a tx
+  ASSERT_TRUE(m_container.begin_transaction());
+  m_container.clear();
+  ASSERT_TRUE(m_container.get(1).get() == nullptr);
+  ASSERT_EQ(read_in_other_thread(2), count);
+  m_container.set(1, 7);
+  m_container.commit_transaction();
+  ASSERT_TRUE(m_container.get(2).get() == nullptr);
+  ASSERT_EQ(*m_container.get(1), 7);
+}
+
 template<typename key_t, typename data_t>
 struct naive_median
 {
@@ -450,3 +684,74 @@ TEST(db_accessor_tests, dtor_without_init)
   }
 
 }
+
+TEST(db_accessor_tests_2, copy_compacted_and_replace_storage)
+{
+  epee::shared_recursive_mutex m_rw_lock;
+  tools::db::basic_db_accessor m_db(std::shared_ptr<tools::db::i_db_backend>(new tools::db::lmdb_db_backend), m_rw_lock);
+  tools::db::basic_key_value_accessor<uint64_t, std::string, true> m_container_a(m_db);
+  tools::db::basic_key_value_accessor<uint64_t, uint64_t, false> m_container_b(m_db);
+
+  const std::string folder_name = "./TEST_db_copy_compacted";
+  const std::string compacted_folder_name = folder_name + "_compacted";
+  boost::filesystem::remove_all(folder_name);
+  boost::filesystem::remove_all(compacted_folder_name);
+  tools::create_directories_if_necessary(folder_name);
+  ASSERT_TRUE(m_db.open(folder_name, CACHE_SIZE));
+  ASSERT_TRUE(m_container_a.init("a"));
+  ASSERT_TRUE(m_container_b.init("b"));
+
+  const uint64_t count = 10000;
+  ASSERT_TRUE(m_db.begin_transaction());
+  for (uint64_t i = 0; i != count; ++i)
+  {
+    m_container_a.set(i, std::string(200, 'a' + i % 26));
+    m_container_b.set(i, i * 2);
+  }
+  m_db.commit_transaction();
+  ASSERT_TRUE(m_db.begin_transaction());
+  for (uint64_t i = 0; i != count; ++i)
+    if (i % 10 != 0)
+      m_container_a.erase(i);
+  m_db.commit_transaction();
+
+  std::shared_ptr<tools::db::i_db_backend> backend = m_db.get_backend();
+  tools::db::stat_info si_before = AUTO_VAL_INIT(si_before);
+  ASSERT_TRUE(backend->get_stat_info(si_before));
+  ASSERT_NE(si_before.last_tx_id, 0);
+  ASSERT_TRUE(backend->copy_compacted(compacted_folder_name));
+  uint64_t data_size = boost::filesystem::file_size(folder_name + "/data.mdb");
+  uint64_t compacted_size = boost::filesystem::file_size(compacted_folder_name + "/data.mdb");
+  ASSERT_LT(compacted_size, data_size);
+
+  // can't be replaced while a transaction is open
+  ASSERT_TRUE(m_db.begin_transaction(true));
+  ASSERT_FALSE(backend->replace_storage(compacted_folder_name));
+  m_db.commit_transaction();
+  ASSERT_EQ(m_container_b.size(), count);
+
+  ASSERT_TRUE(backend->replace_storage(compacted_folder_name));
+  ASSERT_EQ(boost::filesystem::file_size(folder_name + "/data.mdb"), compacted_size);
+  ASSERT_FALSE(boost::filesystem::exists(folder_name + "/data.mdb.old"));
+
+  // the very same accessors keep working (tx ids of the compacted copy start over)
+  tools::db::stat_info si_replaced = AUTO_VAL_INIT(si_replaced);
+  ASSERT_TRUE(backend->get_stat_info(si_replaced));
+  ASSERT_EQ(m_container_a.size(), count / 10);
+  ASSERT_EQ(m_container_b.size(), count);
+  ASSERT_EQ(*m_container_a.get(20), std::string(200, 'a' + 20 % 26));
+  ASSERT_FALSE(m_container_a.get(21));
+  ASSERT_EQ(*m_container_b.get(count - 1), (count - 1) * 2);
+  ASSERT_TRUE(m_db.begin_transaction());
+  m_container_b.set(count, 1);
+  m_db.commit_transaction();
+  ASSERT_EQ(m_container_b.size(), count + 1);
+
+  tools::db::stat_info si_after = AUTO_VAL_INIT(si_after);
+  ASSERT_TRUE(backend->get_stat_info(si_after));
+  ASSERT_GT(si_after.last_tx_id, si_replaced.last_tx_id);
+
+  m_db.close();
+  boost::filesystem::remove_all(folder_name);
+  boost::filesystem::remove_all(compacted_folder_name);
+}
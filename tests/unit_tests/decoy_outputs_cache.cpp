@@ -0,0 +1,41 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "currency_core/zc_outputs_index.h"
+
+TEST(decoy_outputs_cache, generations)
+{
+  currency::decoy_outputs_cache cache;
+  crypto::hash top_1 = currency::null_hash, top_2 = currency::null_hash;
+  top_1.data[0] = 1;
+  top_2.data[0] = 2;
+
+  currency::zc_output_index_entry entry = AUTO_VAL_INIT(entry);
+  entry.keeper_block_height = 10;
+  entry.mix_attr = 3;
+
+  uint64_t generation_1 = cache.begin_lookups(top_1);
+  ASSERT_FALSE(cache.get(1000, 5, entry));
+  cache.set(generation_1, 1000, 5, entry);
+  ASSERT_EQ(cache.begin_lookups(top_1), generation_1);
+
+  currency::zc_output_index_entry cached = AUTO_VAL_INIT(cached);
+  ASSERT_TRUE(cache.get(1000, 5, cached));
+  ASSERT_EQ(cached.keeper_block_height, 10);
+  ASSERT_EQ(cached.mix_attr, 3);
+  // the key is both amount and gindex
+  ASSERT_FALSE(cache.get(0, 5, cached));
+  ASSERT_FALSE(cache.get(1000, 6, cached));
+
+  // the next top block drops everything, and the results made for the previous one don't get in anymore
+  uint64_t generation_2 = cache.begin_lookups(top_2);
+  ASSERT_NE(generation_2, generation_1);
+  ASSERT_FALSE(cache.get(1000, 5, cached));
+  cache.set(generation_1, 1000, 5, entry);
+  ASSERT_FALSE(cache.get(1000, 5, cached));
+  cache.set(generation_2, 1000, 5, entry);
+  ASSERT_TRUE(cache.get(1000, 5, cached));
+}
@@ -48,3 +48,29 @@ TEST(decoy_selection_test, decoy_selection_test)
 
 }
 
+
+TEST(decoy_selection_test, unique_reversed_distribution)
+{
+  const uint64_t max_h = 100000;
+  decoy_selection_generator dsg;
+  dsg.init(max_h);
+  ASSERT_TRUE(dsg.is_initialized());
+
+  std::vector<uint64_t> offsets = dsg.generate_unique_reversed_distribution(200, 12345);
+  ASSERT_EQ(offsets.size(), 200);
+  ASSERT_TRUE(std::is_sorted(offsets.begin(), offsets.end()));
+  ASSERT_TRUE(std::adjacent_find(offsets.begin(), offsets.end()) == offsets.end());
+  ASSERT_TRUE(std::binary_search(offsets.begin(), offsets.end(), 12345));
+  ASSERT_LE(offsets.back(), max_h);
+
+  // the same table is used by another generator of the same max_h, and the recent heights are still the most likely ones
+  decoy_selection_generator dsg2;
+  dsg2.init(max_h);
+  std::vector<uint64_t> heights = dsg2.generate_distribution(10000);
+  size_t recent = std::count_if(heights.begin(), heights.end(), [&](uint64_t h) { return h <= max_h / 10; });
+  ASSERT_GT(recent, heights.size() / 2);
+  for (uint64_t h : heights)
+    ASSERT_LE(h, max_h);
+
+  ASSERT_THROW(dsg.generate_unique_reversed_distribution(max_h + 1), std::runtime_error);
+}
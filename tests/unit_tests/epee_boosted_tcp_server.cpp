@@ -5,6 +5,7 @@
 #include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <set>
 #include <thread>
 
 #include "gtest/gtest.h"
@@ -25,6 +26,11 @@ namespace
   struct test_protocol_handler_config
   {
     void on_send_stop_signal() {}
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::set<std::thread::id> recv_threads;
+    size_t recv_count = 0;
   };
 
   struct test_protocol_handler
@@ -32,7 +38,8 @@ namespace
     typedef test_connection_context connection_context;
     typedef test_protocol_handler_config config_type;
 
-    test_protocol_handler(epee::net_utils::i_service_endpoint* /*psnd_hndlr*/, config_type& /*config*/, connection_context& /*conn_context*/)
+    test_protocol_handler(epee::net_utils::i_service_endpoint* /*psnd_hndlr*/, config_type& config, connection_context& /*conn_context*/)
+      : m_config(config)
     {
     }
 
@@ -51,8 +58,14 @@ namespace
 
     bool handle_recv(const void* /*data*/, size_t /*size*/)
     {
+      std::unique_lock<std::mutex> lock(m_config.lock);
+      m_config.recv_threads.insert(std::this_thread::get_id());
+      ++m_config.recv_count;
+      m_config.cond.notify_one();
       return false;
     }
+
+    config_type& m_config;
   };
 
   typedef epee::net_utils::boosted_tcp_server<test_protocol_handler> test_tcp_server;
@@ -108,3 +121,33 @@ TEST(boosted_tcp_server, worker_threads_are_exception_resistant)
   ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
   ASSERT_TRUE(srv.deinit_server());
 }
+
+TEST(boosted_tcp_server, connections_are_spread_over_io_shards)
+{
+  test_tcp_server srv;
+  srv.set_io_shards_count(2);
+  ASSERT_TRUE(srv.init_server(test_server_port, test_server_host));
+  ASSERT_TRUE(srv.run_server(1, false));
+
+  // the connections go to the shards in turn, each shard has its own thread
+  boost::asio::io_service client_io_service;
+  std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> clients;
+  for (size_t i = 0; i != 4; ++i)
+  {
+    clients.emplace_back(new boost::asio::ip::tcp::socket(client_io_service));
+    clients.back()->connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(test_server_host), test_server_port));
+    boost::asio::write(*clients.back(), boost::asio::buffer("x", 1));
+  }
+
+  auto& config = srv.get_config_object();
+  {
+    std::unique_lock<std::mutex> lock(config.lock);
+    ASSERT_TRUE(config.cond.wait_for(lock, std::chrono::seconds(5), [&]() { return config.recv_count == 4; }));
+    ASSERT_EQ(config.recv_threads.size(), 2);
+    ASSERT_EQ(config.recv_threads.count(std::this_thread::get_id()), 0);
+  }
+
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  ASSERT_TRUE(srv.deinit_server());
+}
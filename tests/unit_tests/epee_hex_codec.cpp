@@ -0,0 +1,86 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include "include_base_utils.h"
+#include "string_tools.h"
+
+namespace
+{
+  // the former per character implementations
+  std::string reference_to_hex(const std::string& s)
+  {
+    std::stringstream ss;
+    ss << std::hex << std::noshowbase;
+    for (char c : s)
+      ss << std::setw(2) << std::setfill('0') << static_cast<unsigned int>(static_cast<unsigned char>(c));
+    return ss.str();
+  }
+
+  bool reference_from_hex(const std::string& s, std::string& res)
+  {
+    res.clear();
+    for (size_t i = 0; i < (s.size() + 1) / 2; i++)
+    {
+      char byte_str[3];
+      size_t copied = s.copy(byte_str, 2, 2 * i);
+      byte_str[copied] = 0;
+      char* endptr;
+      long v = strtoul(byte_str, &endptr, 16);
+      if (v < 0 || 0xFF < v || endptr != byte_str + copied)
+        return false;
+      res.push_back(static_cast<unsigned char>(v));
+    }
+    return true;
+  }
+}
+
+TEST(epee_hex_codec, encode_decode_roundtrip)
+{
+  std::mt19937 rng(1);
+  for (size_t size : { 0, 1, 15, 16, 17, 31, 32, 33, 100, 1000 })
+  {
+    std::string blob(size, 0);
+    for (auto& c : blob)
+      c = static_cast<char>(rng());
+    std::string hex = epee::string_tools::buff_to_hex_nodelimer(blob);
+    ASSERT_EQ(hex, reference_to_hex(blob));
+
+    std::string decoded;
+    ASSERT_TRUE(epee::string_tools::parse_hexstr_to_binbuff(hex, decoded));
+    ASSERT_EQ(decoded, blob);
+
+    std::string upper = boost::algorithm::to_upper_copy(hex);
+    ASSERT_TRUE(epee::string_tools::parse_hexstr_to_binbuff(upper, decoded));
+    ASSERT_EQ(decoded, blob);
+  }
+}
+
+TEST(epee_hex_codec, same_validation_as_before)
+{
+  // a bad char at each position of long strings, so both the vectorized and the scalar parts see it
+  const std::string hex = std::string(70, 'a') + "0123456789abcdefABCDEF";
+  std::vector<std::string> samples = { "", "a", "abc", "0x", "x0", " f", "+f", "-1", "g0", "0g", "f ", "12 4" };
+  for (size_t i = 0; i != hex.size(); ++i)
+  {
+    for (char bad : { 'g', 'G', 'x', ' ', '+', '-', '/', ':', '@', '`', '\0', '\xff' })
+    {
+      std::string s = hex;
+      s[i] = bad;
+      samples.push_back(s);
+    }
+    samples.push_back(hex.substr(0, i)); // odd lengths too
+  }
+
+  for (const auto& s : samples)
+  {
+    std::string expected, res;
+    bool expected_r = reference_from_hex(s, expected);
+    ASSERT_EQ(epee::string_tools::parse_hexstr_to_binbuff(s, res), expected_r) << "\"" << s << "\"";
+    if (expected_r)
+      ASSERT_EQ(res, expected);
+  }
+}
@@ -0,0 +1,528 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "net/http_server_impl_base.h"
+#include "net/http_client.h"
+#include "storages/portable_storage_template_helper.h"
+
+namespace
+{
+  const uint32_t test_server_port = 5627;
+  const std::string test_server_host("127.0.0.1");
+
+  // answers with the uri and the body of the request
+  class test_http_server : public epee::http_server_impl_base<test_http_server>
+  {
+  public:
+    virtual bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, epee::net_utils::connection_context_base& /*conn_context*/)
+    {
+      response.m_body = query_info.m_URI + query_info.m_body;
+      return true;
+    }
+
+    bool start()
+    {
+      return init(std::to_string(test_server_port), test_server_host) && run(2, false);
+    }
+
+    void stop()
+    {
+      send_stop_signal();
+      timed_wait_server_stop(5 * 1000);
+      deinit();
+    }
+  };
+
+  struct COMMAND_TEST_ECHO
+  {
+    struct request
+    {
+      std::string text;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(text)
+      END_KV_SERIALIZE_MAP()
+    };
+    struct response
+    {
+      std::string text;
+      uint64_t thread_hash;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(text)
+        KV_SERIALIZE(thread_hash)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  // keeps everything, for one generation
+  struct test_response_cache
+  {
+    std::map<std::string, std::string> results;
+    uint64_t generation = 1;
+
+    bool get(const std::string& key, std::string& result_json, uint64_t& gen)
+    {
+      gen = generation;
+      auto it = results.find(key);
+      if (it == results.end())
+        return false;
+      result_json = it->second;
+      return true;
+    }
+    template<class t_result>
+    void put(const std::string& key, uint64_t gen, const t_result& /*result*/, const std::string& result_json)
+    {
+      if (gen == generation)
+        results[key] = result_json;
+    }
+  };
+
+  class test_json_rpc_server : public epee::http_server_impl_base<test_json_rpc_server>
+  {
+  public:
+    test_response_cache m_cache;
+    std::atomic<uint64_t> m_cached_calls_count{ 0 };
+
+    typedef epee::net_utils::connection_context_base connection_context;
+
+    CHAIN_HTTP_TO_MAP2(connection_context);
+
+    BEGIN_URI_MAP2()
+      MAP_URI_AUTO_JON2("/echo", on_echo, COMMAND_TEST_ECHO)
+      BEGIN_JSON_RPC_MAP("/json_rpc")
+        MAP_JON_RPC   ("echo",      on_echo,      COMMAND_TEST_ECHO)
+        MAP_JON_RPC   ("fail",      on_fail,      COMMAND_TEST_ECHO)
+        MAP_JON_RPC   ("throw",     on_throw,     COMMAND_TEST_ECHO)
+        MAP_JON_RPC_CACHED("cached_echo", on_cached_echo, COMMAND_TEST_ECHO, m_cache)
+        MAP_JON_RPC_WE_CACHED("cached_fail", on_cached_fail, COMMAND_TEST_ECHO, m_cache)
+      END_JSON_RPC_MAP()
+    END_URI_MAP2()
+
+    bool on_echo(const COMMAND_TEST_ECHO::request& req, COMMAND_TEST_ECHO::response& res, connection_context& /*cntx*/)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      res.text = req.text;
+      res.thread_hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+      return true;
+    }
+    bool on_fail(const COMMAND_TEST_ECHO::request& /*req*/, COMMAND_TEST_ECHO::response& /*res*/, connection_context& /*cntx*/)
+    {
+      return false;
+    }
+    bool on_cached_echo(const COMMAND_TEST_ECHO::request& req, COMMAND_TEST_ECHO::response& res, connection_context& /*cntx*/)
+    {
+      ++m_cached_calls_count;
+      res.text = req.text;
+      res.thread_hash = 0;
+      return true;
+    }
+    bool on_cached_fail(const COMMAND_TEST_ECHO::request& /*req*/, COMMAND_TEST_ECHO::response& /*res*/, epee::json_rpc::error& error_resp, connection_context& /*cntx*/)
+    {
+      ++m_cached_calls_count;
+      error_resp.code = -1;
+      error_resp.message = "failed";
+      return false;
+    }
+    bool on_throw(const COMMAND_TEST_ECHO::request& /*req*/, COMMAND_TEST_ECHO::response& /*res*/, connection_context& /*cntx*/)
+    {
+      throw std::runtime_error("test");
+    }
+
+    bool start()
+    {
+      return init(std::to_string(test_server_port), test_server_host) && run(4, false);
+    }
+
+    void stop()
+    {
+      send_stop_signal();
+      timed_wait_server_stop(5 * 1000);
+      deinit();
+    }
+  };
+
+  // rejects the given calls
+  struct test_call_admission : public epee::net_utils::http::i_call_admission
+  {
+    std::map<std::string, result> rejected;
+    std::atomic<uint64_t> running{ 0 };
+
+    virtual result enter(const std::string& call_name, const epee::net_utils::connection_context_base& /*context*/) override
+    {
+      auto it = rejected.find(call_name);
+      if (it != rejected.end())
+        return it->second;
+      ++running;
+      return admitted;
+    }
+    virtual void leave(const std::string& /*call_name*/) override
+    {
+      --running;
+    }
+  };
+
+  struct batch_item_response
+  {
+    std::string jsonrpc;
+    epee::serialization::storage_entry id;
+    COMMAND_TEST_ECHO::response result;
+    epee::json_rpc::error error;
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(jsonrpc)
+      KV_SERIALIZE(id)
+      KV_SERIALIZE(result)
+      KV_SERIALIZE(error)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct batch_response
+  {
+    std::list<batch_item_response> items;
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(items)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  bool post_json_rpc(epee::net_utils::http::http_simple_client& client, const std::string& body, std::list<batch_item_response>& responses)
+  {
+    const epee::net_utils::http::http_response_info* pri = nullptr;
+    if (!client.invoke("/json_rpc", "POST", body, &pri) || !pri)
+      return false;
+    // the array is given a name to be loaded with the kv maps
+    batch_response res = AUTO_VAL_INIT(res);
+    if (!epee::serialization::load_t_from_json(res, std::string("{\"items\": ") + pri->m_body + "}"))
+      return false;
+    responses = res.items;
+    return true;
+  }
+
+  // receives until the connection is closed or the data ends with the given tail
+  std::string recv_until(epee::net_utils::blocked_mode_client& client, const std::string& tail, bool& closed)
+  {
+    std::string result;
+    closed = false;
+    while (result.size() < tail.size() || result.compare(result.size() - tail.size(), tail.size(), tail))
+    {
+      std::string buff;
+      if (!client.recv(buff) || buff.empty())
+      {
+        closed = true;
+        break;
+      }
+      result += buff;
+    }
+    return result;
+  }
+}
+
+TEST(epee_http_server, pipelined_requests)
+{
+  test_http_server srv;
+  ASSERT_TRUE(srv.start());
+
+  epee::net_utils::blocked_mode_client client;
+  ASSERT_TRUE(client.connect(test_server_host, std::to_string(test_server_port), 5000, 5000));
+
+  // all of them in one buffer, the one after a request with body among them
+  ASSERT_TRUE(client.send("GET /a HTTP/1.1\r\n\r\nPOST /b HTTP/1.1\r\nContent-Length: 3\r\n\r\nxyzGET /c HTTP/1.1\r\n\r\n"));
+  bool closed = false;
+  std::string responses = recv_until(client, "/c", closed);
+  ASSERT_FALSE(closed);
+  size_t pos_a = responses.find("\r\n\r\n/a");
+  size_t pos_b = responses.find("\r\n\r\n/bxyz");
+  ASSERT_NE(pos_a, std::string::npos);
+  ASSERT_NE(pos_b, std::string::npos);
+  ASSERT_LT(pos_a, pos_b);
+
+  // the connection is kept
+  ASSERT_TRUE(client.send("GET /d HTTP/1.1\r\n\r\n"));
+  recv_until(client, "/d", closed);
+  ASSERT_FALSE(closed);
+
+  uint64_t connections_count = 0, requests_count = 0, reused_connection_requests_count = 0;
+  srv.get_connections_stat(connections_count, requests_count, reused_connection_requests_count);
+  ASSERT_EQ(connections_count, 1);
+  ASSERT_EQ(requests_count, 4);
+  ASSERT_EQ(reused_connection_requests_count, 3);
+
+  // nothing is answered after a response that closes the connection
+  ASSERT_TRUE(client.send("GET /e HTTP/1.1\r\nConnection: close\r\n\r\nGET /f HTTP/1.1\r\n\r\n"));
+  responses = recv_until(client, "/f", closed);
+  ASSERT_TRUE(closed);
+  ASSERT_NE(responses.find("Connection: close"), std::string::npos);
+  ASSERT_EQ(responses.find("/f"), std::string::npos);
+
+  srv.stop();
+}
+
+TEST(epee_http_server, http_1_0_keep_alive)
+{
+  test_http_server srv;
+  ASSERT_TRUE(srv.start());
+
+  epee::net_utils::blocked_mode_client client;
+  ASSERT_TRUE(client.connect(test_server_host, std::to_string(test_server_port), 5000, 5000));
+  bool closed = false;
+
+  // HTTP/1.0 keeps the connection only when asked to
+  ASSERT_TRUE(client.send("GET /a HTTP/1.0\r\nConnection: keep-alive\r\n\r\n"));
+  std::string response = recv_until(client, "/a", closed);
+  ASSERT_FALSE(closed);
+  ASSERT_NE(response.find("Connection: keep-alive"), std::string::npos);
+
+  ASSERT_TRUE(client.send("GET /b HTTP/1.0\r\n\r\n"));
+  response = recv_until(client, "/b", closed);
+  ASSERT_NE(response.find("Connection: close"), std::string::npos);
+  recv_until(client, "/never", closed);
+  ASSERT_TRUE(closed);
+
+  srv.stop();
+}
+
+TEST(epee_http_server, idle_connections_are_closed)
+{
+  test_http_server srv;
+  srv.set_idle_timeout(300);
+  ASSERT_TRUE(srv.start());
+
+  epee::net_utils::http::http_simple_client client;
+  ASSERT_TRUE(client.connect(test_server_host, std::to_string(test_server_port), 5000));
+  const epee::net_utils::http::http_response_info* pri = nullptr;
+  ASSERT_TRUE(client.invoke("/a", "GET", std::string(), &pri));
+  ASSERT_EQ(pri->m_body, "/a");
+  ASSERT_TRUE(client.invoke("/b", "GET", std::string(), &pri));
+  ASSERT_EQ(pri->m_body, "/b");
+
+  // the server drops the idle connection, the client sends the request again over a new one
+  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  ASSERT_TRUE(client.invoke("/c", "GET", std::string(), &pri));
+  ASSERT_EQ(pri->m_body, "/c");
+
+  uint64_t connections_count = 0, requests_count = 0, reused_connection_requests_count = 0;
+  srv.get_connections_stat(connections_count, requests_count, reused_connection_requests_count);
+  ASSERT_EQ(connections_count, 2);
+  ASSERT_EQ(requests_count, 3);
+  ASSERT_EQ(reused_connection_requests_count, 1);
+
+  srv.stop();
+}
+
+TEST(epee_http_server, json_rpc_batch_split)
+{
+  std::vector<std::string> items;
+  ASSERT_TRUE(epee::json_rpc::split_batch_request(" [ {\"a\": [1, 2], \"b\": \"],\\\"\"} ,{}, 5 ] ", items));
+  ASSERT_EQ(items.size(), 3);
+  ASSERT_EQ(items[0], "{\"a\": [1, 2], \"b\": \"],\\\"\"}");
+  ASSERT_EQ(items[1], "{}");
+  ASSERT_EQ(items[2], "5");
+
+  ASSERT_TRUE(epee::json_rpc::split_batch_request("[]", items));
+  ASSERT_TRUE(items.empty());
+  ASSERT_TRUE(epee::json_rpc::split_batch_request("[{},]", items));
+  ASSERT_EQ(items.size(), 2);
+  ASSERT_TRUE(items[1].empty());
+
+  ASSERT_FALSE(epee::json_rpc::split_batch_request("[{}", items));
+  ASSERT_FALSE(epee::json_rpc::split_batch_request("[{}] x", items));
+  ASSERT_FALSE(epee::json_rpc::split_batch_request("[{}][{}]", items));
+  ASSERT_FALSE(epee::json_rpc::split_batch_request("[{]", items));
+  ASSERT_FALSE(epee::json_rpc::split_batch_request("[\"]", items));
+
+  ASSERT_TRUE(epee::json_rpc::is_batch_request(" \r\n[{}]"));
+  ASSERT_FALSE(epee::json_rpc::is_batch_request(" {\"a\": []}"));
+}
+
+TEST(epee_http_server, json_rpc_batch)
+{
+  test_json_rpc_server srv;
+  srv.get_json_rpc_batch_config().max_batch_size = 20;
+  ASSERT_TRUE(srv.start());
+
+  epee::net_utils::http::http_simple_client client;
+  ASSERT_TRUE(client.connect(test_server_host, std::to_string(test_server_port), 5000));
+
+  // each one gets its own response, in the same order, whatever happens to the others
+  std::list<batch_item_response> responses;
+  ASSERT_TRUE(post_json_rpc(client, "[{\"jsonrpc\": \"2.0\", \"id\": 1, \"method\": \"echo\", \"params\": {\"text\": \"a\"}},"
+    "{\"jsonrpc\": \"2.0\", \"id\": 2, \"method\": \"fail\", \"params\": {}},"
+    "{\"jsonrpc\": \"2.0\", \"id\": 3, \"method\": \"throw\", \"params\": {}},"
+    "{\"jsonrpc\": \"2.0\", \"id\": 4, \"method\": \"nonexistent\", \"params\": {}},"
+    "42,"
+    "{\"jsonrpc\": \"2.0\", \"id\": 6, \"method\": \"echo\", \"params\": {\"text\": \"b\"}}]", responses));
+  ASSERT_EQ(responses.size(), 6);
+  std::vector<batch_item_response> r(responses.begin(), responses.end());
+  ASSERT_EQ(boost::get<uint64_t>(r[0].id), 1);
+  ASSERT_EQ(r[0].result.text, "a");
+  ASSERT_EQ(r[0].error.code, 0);
+  ASSERT_EQ(boost::get<uint64_t>(r[1].id), 2);
+  ASSERT_EQ(r[1].error.code, -32603);
+  ASSERT_EQ(boost::get<uint64_t>(r[2].id), 3);
+  ASSERT_EQ(r[2].error.code, -32603);
+  ASSERT_EQ(boost::get<uint64_t>(r[3].id), 4);
+  ASSERT_EQ(r[3].error.code, -32601);
+  ASSERT_EQ(r[4].error.code, -32600);
+  ASSERT_EQ(boost::get<uint64_t>(r[5].id), 6);
+  ASSERT_EQ(r[5].result.text, "b");
+
+  // a single request is answered as before
+  const epee::net_utils::http::http_response_info* pri = nullptr;
+  ASSERT_TRUE(client.invoke("/json_rpc", "POST", "{\"jsonrpc\": \"2.0\", \"id\": 1, \"method\": \"echo\", \"params\": {\"text\": \"c\"}}", &pri));
+  batch_item_response single = AUTO_VAL_INIT(single);
+  ASSERT_TRUE(epee::serialization::load_t_from_json(single, pri->m_body));
+  ASSERT_EQ(single.result.text, "c");
+
+  // too big or broken batches get one error
+  std::string big_batch = "[";
+  for (size_t i = 0; i != 21; ++i)
+    big_batch += std::string(i ? "," : "") + "{\"jsonrpc\": \"2.0\", \"id\": 1, \"method\": \"echo\", \"params\": {}}";
+  big_batch += "]";
+  ASSERT_TRUE(client.invoke("/json_rpc", "POST", big_batch, &pri));
+  ASSERT_TRUE(epee::serialization::load_t_from_json(single, pri->m_body));
+  ASSERT_EQ(single.error.code, -32600);
+  ASSERT_TRUE(client.invoke("/json_rpc", "POST", "[{}", &pri));
+  ASSERT_TRUE(epee::serialization::load_t_from_json(single, pri->m_body));
+  ASSERT_EQ(single.error.code, -32700);
+  ASSERT_TRUE(client.invoke("/json_rpc", "POST", "[]", &pri));
+  ASSERT_TRUE(epee::serialization::load_t_from_json(single, pri->m_body));
+  ASSERT_EQ(single.error.code, -32600);
+
+  srv.stop();
+}
+
+TEST(epee_http_server, json_rpc_batch_parallel)
+{
+  test_json_rpc_server srv;
+  srv.get_json_rpc_batch_config().max_parallel = 3;
+  srv.get_json_rpc_batch_config().parallel_methods.insert("echo");
+  ASSERT_TRUE(srv.start());
+
+  epee::net_utils::http::http_simple_client client;
+  ASSERT_TRUE(client.connect(test_server_host, std::to_string(test_server_port), 5000));
+
+  std::string batch = "[";
+  for (size_t i = 0; i != 40; ++i)
+    batch += std::string(i ? "," : "") + "{\"jsonrpc\": \"2.0\", \"id\": " + std::to_string(i) + ", \"method\": \"echo\", \"params\": {\"text\": \"" + std::to_string(i) + "\"}}";
+  batch += "]";
+  std::list<batch_item_response> responses;
+  ASSERT_TRUE(post_json_rpc(client, batch, responses));
+  ASSERT_EQ(responses.size(), 40);
+  std::set<uint64_t> threads;
+  uint64_t i = 0;
+  for (const auto& r : responses)
+  {
+    ASSERT_EQ(boost::get<uint64_t>(r.id), i);
+    ASSERT_EQ(r.result.text, std::to_string(i));
+    threads.insert(r.result.thread_hash);
+    ++i;
+  }
+  ASSERT_GT(threads.size(), 1);
+
+  // a method that is not read-only makes the whole batch sequential
+  ASSERT_TRUE(post_json_rpc(client, "[{\"jsonrpc\": \"2.0\", \"id\": 1, \"method\": \"echo\", \"params\": {}},"
+    "{\"jsonrpc\": \"2.0\", \"id\": 2, \"method\": \"echo\", \"params\": {}},"
+    "{\"jsonrpc\": \"2.0\", \"id\": 3, \"method\": \"fail\", \"params\": {}}]", responses));
+  ASSERT_EQ(responses.size(), 3);
+  ASSERT_EQ(responses.front().result.thread_hash, std::next(responses.begin())->result.thread_hash);
+  ASSERT_EQ(responses.back().error.code, -32603);
+
+  srv.stop();
+}
+
+TEST(epee_http_server, json_rpc_cached_results)
+{
+  // the response put together from a cached result is the same as the serialized one
+  for (const epee::serialization::storage_entry& id : { epee::serialization::storage_entry(std::string()), epee::serialization::storage_entry(uint64_t(7)), epee::serialization::storage_entry(std::string("x\"y")) })
+  {
+    epee::json_rpc::response<COMMAND_TEST_ECHO::response, epee::json_rpc::dummy_error> resp = AUTO_VAL_INIT(resp);
+    resp.jsonrpc = "2.0";
+    resp.id = id;
+    resp.result.text = "abc";
+    resp.result.thread_hash = 5;
+    std::string expected, result_json, body;
+    epee::serialization::store_t_to_json_stream(resp, expected);
+    epee::serialization::store_t_to_json_stream(resp.result, result_json, 1);
+    epee::json_rpc::make_response_body(resp.id, result_json, body);
+    ASSERT_EQ(body, expected);
+  }
+
+  test_json_rpc_server srv;
+  ASSERT_TRUE(srv.start());
+  epee::net_utils::http::http_simple_client client;
+  ASSERT_TRUE(client.connect(test_server_host, std::to_string(test_server_port), 5000));
+
+  const epee::net_utils::http::http_response_info* pri = nullptr;
+  batch_item_response r = AUTO_VAL_INIT(r);
+  for (size_t i = 0; i != 3; ++i)
+  {
+    ASSERT_TRUE(client.invoke("/json_rpc", "POST", "{\"jsonrpc\": \"2.0\", \"id\": " + std::to_string(i) + ", \"method\": \"cached_echo\", \"params\": {\"text\": \"a\"}}", &pri));
+    ASSERT_TRUE(epee::serialization::load_t_from_json(r, pri->m_body));
+    ASSERT_EQ(boost::get<uint64_t>(r.id), i);
+    ASSERT_EQ(r.result.text, "a");
+  }
+  ASSERT_EQ(srv.m_cached_calls_count, 1);
+
+  // other params, other entry; the same params written in another way, the same entry
+  ASSERT_TRUE(client.invoke("/json_rpc", "POST", "{\"jsonrpc\": \"2.0\", \"id\": 1, \"method\": \"cached_echo\", \"params\": {\"text\": \"b\"}}", &pri));
+  ASSERT_TRUE(epee::serialization::load_t_from_json(r, pri->m_body));
+  ASSERT_EQ(r.result.text, "b");
+  ASSERT_EQ(srv.m_cached_calls_count, 2);
+  ASSERT_TRUE(client.invoke("/json_rpc", "POST", "{\"params\": {\"text\":\"b\", \"unknown\": 1}, \"method\": \"cached_echo\", \"id\": 1, \"jsonrpc\": \"2.0\"}", &pri));
+  ASSERT_EQ(srv.m_cached_calls_count, 2);
+
+  // errors are not kept
+  for (size_t i = 0; i != 2; ++i)
+  {
+    ASSERT_TRUE(client.invoke("/json_rpc", "POST", "{\"jsonrpc\": \"2.0\", \"id\": 1, \"method\": \"cached_fail\", \"params\": {}}", &pri));
+    ASSERT_TRUE(epee::serialization::load_t_from_json(r, pri->m_body));
+    ASSERT_EQ(r.error.code, -1);
+  }
+  ASSERT_EQ(srv.m_cached_calls_count, 4);
+
+  srv.stop();
+}
+
+TEST(epee_http_server, call_admission)
+{
+  test_json_rpc_server srv;
+  test_call_admission admission;
+  admission.rejected["/echo"] = epee::net_utils::http::i_call_admission::busy;
+  admission.rejected["fail"] = epee::net_utils::http::i_call_admission::rate_limited;
+  srv.set_call_admission(&admission);
+  ASSERT_TRUE(srv.start());
+  epee::net_utils::http::http_simple_client client;
+  ASSERT_TRUE(client.connect(test_server_host, std::to_string(test_server_port), 5000));
+
+  const epee::net_utils::http::http_response_info* pri = nullptr;
+  ASSERT_TRUE(client.invoke("/echo", "POST", "{\"text\": \"a\"}", &pri));
+  ASSERT_EQ(pri->m_response_code, 503);
+
+  batch_item_response r = AUTO_VAL_INIT(r);
+  ASSERT_TRUE(client.invoke("/json_rpc", "POST", "{\"jsonrpc\": \"2.0\", \"id\": 1, \"method\": \"fail\", \"params\": {}}", &pri));
+  ASSERT_EQ(pri->m_response_code, 200);
+  ASSERT_TRUE(epee::serialization::load_t_from_json(r, pri->m_body));
+  ASSERT_EQ(r.error.code, -32002);
+
+  // the admitted ones leave when they're done
+  ASSERT_TRUE(client.invoke("/json_rpc", "POST", "{\"jsonrpc\": \"2.0\", \"id\": 1, \"method\": \"echo\", \"params\": {\"text\": \"b\"}}", &pri));
+  ASSERT_TRUE(epee::serialization::load_t_from_json(r, pri->m_body));
+  ASSERT_EQ(r.result.text, "b");
+  ASSERT_EQ(admission.running, 0);
+
+  // each item of a batch is admitted on its own
+  std::list<batch_item_response> responses;
+  ASSERT_TRUE(post_json_rpc(client, "[{\"jsonrpc\": \"2.0\", \"id\": 1, \"method\": \"echo\", \"params\": {\"text\": \"c\"}},"
+    "{\"jsonrpc\": \"2.0\", \"id\": 2, \"method\": \"fail\", \"params\": {}}]", responses));
+  ASSERT_EQ(responses.size(), 2);
+  ASSERT_EQ(responses.front().result.text, "c");
+  ASSERT_EQ(responses.back().error.code, -32002);
+
+  srv.stop();
+}
@@ -123,7 +123,13 @@ namespace
       return m_send_return;
     }
 
-    virtual bool close()                              { /*std::cout << "test_connection::close()" << std::endl; */return true; }
+    virtual bool do_send_buffer(const epee::net_utils::shared_buffer& buff)
+    {
+      m_last_send_buffer = buff;
+      return do_send(buff->data(), buff->size());
+    }
+
+    virtual bool close()                              { /*std::cout << "test_connection::close()" << std::endl; */m_close_counter.inc(); return true; }
     virtual bool call_run_once_service_io()           { std::cout << "test_connection::call_run_once_service_io()" << std::endl; return true; }
     virtual bool request_callback()                   { std::cout << "test_connection::request_callback()" << std::endl; return true; }
     virtual boost::asio::io_service& get_io_service() { std::cout << "test_connection::get_io_service()" << std::endl; return m_io_service; }
@@ -131,8 +137,10 @@ namespace
     virtual bool release()                            { std::cout << "test_connection::release()" << std::endl; return true; }
 
     size_t send_counter() const { return m_send_counter.get(); }
+    size_t close_counter() const { return m_close_counter.get(); }
 
     const std::string& last_send_data() const { return m_last_send_data; }
+    const epee::net_utils::shared_buffer& last_send_buffer() const { return m_last_send_buffer; }
     void reset_last_send_data() { std::unique_lock<std::mutex> lock(m_mutex); m_last_send_data.clear(); }
 
     bool send_return() const { return m_send_return; }
@@ -146,9 +154,11 @@ namespace
     test_levin_connection_context m_context;
 
     unit_test::call_counter m_send_counter;
+    unit_test::call_counter m_close_counter;
     std::mutex m_mutex;
 
     std::string m_last_send_data;
+    epee::net_utils::shared_buffer m_last_send_buffer;
 
     bool m_send_return;
   };
@@ -504,3 +514,167 @@ TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_unexpe
 
   ASSERT_FALSE(m_conn->m_protocol_handler.handle_recv(m_buf.data(), m_buf.size()));
 }
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_processes_compressed_invoke)
+{
+  const int expected_command = 3185274;
+  const std::string in_data(LEVIN_COMPRESSION_MIN_SIZE * 4, 'c');
+  const std::string expected_out_data(LEVIN_COMPRESSION_MIN_SIZE * 2, 'z');
+
+  test_connection_ptr conn = create_connection();
+  m_handler_config.set_compression(conn->m_protocol_handler.get_connection_id(), true);
+
+  std::string packed_data;
+  ASSERT_TRUE(epee::zlib_helper::pack_fast(in_data, packed_data));
+
+  epee::levin::bucket_head2 req_head;
+  req_head.m_signature = LEVIN_SIGNATURE;
+  req_head.m_cb = packed_data.size();
+  req_head.m_have_to_return_data = true;
+  req_head.m_command = expected_command;
+  req_head.m_flags = LEVIN_PACKET_REQUEST | LEVIN_PACKET_COMPRESSED;
+  req_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+
+  std::string buf(reinterpret_cast<const char*>(&req_head), sizeof(req_head));
+  buf += packed_data;
+
+  m_commands_handler.invoke_out_buf(expected_out_data);
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+  ASSERT_EQ(1, m_commands_handler.invoke_counter());
+  ASSERT_EQ(in_data, m_commands_handler.last_in_buf());
+
+  // the response is compressed as well
+  std::string send_data = conn->last_send_data();
+  epee::levin::bucket_head2 resp_head = *reinterpret_cast<const epee::levin::bucket_head2*>(send_data.data());
+  ASSERT_TRUE(0 != (resp_head.m_flags & LEVIN_PACKET_COMPRESSED));
+  ASSERT_EQ(send_data.size() - sizeof(resp_head), resp_head.m_cb);
+  ASSERT_LT(resp_head.m_cb, expected_out_data.size());
+  std::string out_data;
+  ASSERT_TRUE(epee::zlib_helper::unpack_bounded(send_data.substr(sizeof(resp_head)), out_data, max_packet_size));
+  ASSERT_EQ(expected_out_data, out_data);
+
+  // small ones are sent as is
+  m_commands_handler.invoke_out_buf(std::string(128, 'w'));
+  conn->reset_last_send_data();
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+  send_data = conn->last_send_data();
+  resp_head = *reinterpret_cast<const epee::levin::bucket_head2*>(send_data.data());
+  ASSERT_TRUE(0 == (resp_head.m_flags & LEVIN_PACKET_COMPRESSED));
+  ASSERT_EQ(std::string(128, 'w'), send_data.substr(sizeof(resp_head)));
+}
+
+TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_broken_compressed_body)
+{
+  m_req_head.m_flags = LEVIN_PACKET_REQUEST | LEVIN_PACKET_COMPRESSED;
+  prepare_buf();
+
+  ASSERT_FALSE(m_conn->m_protocol_handler.handle_recv(m_buf.data(), m_buf.size()));
+  ASSERT_EQ(0, m_commands_handler.invoke_counter());
+}
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, shared_notify_body_is_not_copied)
+{
+  const int expected_command = 7702134;
+  const epee::net_utils::shared_buffer body = std::make_shared<const std::string>(256, 'r');
+
+  // test connections share the same id, so they go one after another
+  test_connection_ptr conn = create_connection();
+  ASSERT_EQ(1, m_handler_config.notify(expected_command, body, conn->m_protocol_handler.get_connection_id()));
+  ASSERT_EQ(body.get(), conn->last_send_buffer().get());
+  conn.reset();
+
+  conn = create_connection();
+  ASSERT_EQ(1, m_handler_config.notify(expected_command, body, conn->m_protocol_handler.get_connection_id()));
+  // the very same buffer goes after the header
+  ASSERT_EQ(body.get(), conn->last_send_buffer().get());
+  std::string send_data = conn->last_send_data();
+  epee::levin::bucket_head2 head = *reinterpret_cast<const epee::levin::bucket_head2*>(send_data.data());
+  ASSERT_EQ(expected_command, head.m_command);
+  ASSERT_EQ(body->size(), head.m_cb);
+  ASSERT_EQ(*body, send_data.substr(sizeof(head)));
+}
+
+namespace
+{
+  std::string make_response_frame(int command, const std::string& body)
+  {
+    epee::levin::bucket_head2 head = AUTO_VAL_INIT(head);
+    head.m_signature = LEVIN_SIGNATURE;
+    head.m_cb = body.size();
+    head.m_have_to_return_data = false;
+    head.m_command = command;
+    head.m_return_code = 1;
+    head.m_flags = LEVIN_PACKET_RESPONSE;
+    head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+    return std::string(reinterpret_cast<const char*>(&head), sizeof(head)) + body;
+  }
+}
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, invokes_in_flight_are_answered_in_order_and_can_be_cancelled)
+{
+  const int expected_command = 6823455;
+  test_connection_ptr conn = create_connection();
+  boost::uuids::uuid conn_id = conn->m_protocol_handler.get_connection_id();
+
+  std::vector<std::pair<int, std::string>> results(3, std::make_pair(0, std::string()));
+  std::vector<uint64_t> ids(3, 0);
+  for (size_t i = 0; i != results.size(); ++i)
+  {
+    ASSERT_EQ(1, m_handler_config.invoke_async(expected_command, "req", conn_id, [&results, i](int code, const std::string& buff, test_levin_connection_context&)
+    {
+      ASSERT_EQ(0, results[i].first); // called once
+      results[i] = std::make_pair(code, buff);
+    }, LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED, &ids[i]));
+  }
+  ASSERT_EQ(3, conn->m_protocol_handler.get_invokes_in_flight());
+  ASSERT_TRUE(ids[0] != ids[1] && ids[1] != ids[2]);
+
+  ASSERT_TRUE(m_handler_config.cancel_invoke(conn_id, ids[1]));
+  ASSERT_FALSE(m_handler_config.cancel_invoke(conn_id, ids[1]));
+  ASSERT_EQ(LEVIN_ERROR_INVOKE_CANCELLED, results[1].first);
+
+  // the response to the cancelled invoke still comes in its turn and is dropped
+  for (const char* body : { "r0", "r1", "r2" })
+  {
+    std::string frame = make_response_frame(expected_command, body);
+    ASSERT_TRUE(conn->m_protocol_handler.handle_recv(frame.data(), frame.size()));
+  }
+  ASSERT_EQ(0, conn->m_protocol_handler.get_invokes_in_flight());
+  ASSERT_EQ(1, results[0].first);
+  ASSERT_EQ("r0", results[0].second);
+  ASSERT_EQ(LEVIN_ERROR_INVOKE_CANCELLED, results[1].first);
+  ASSERT_EQ(1, results[2].first);
+  ASSERT_EQ("r2", results[2].second);
+  ASSERT_FALSE(m_handler_config.cancel_invoke(conn_id, ids[2]));
+
+  m_io_service.run(); // the cancelled timers
+  ASSERT_EQ(0, conn->close_counter());
+}
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, short_invoke_timeout_keeps_connection)
+{
+  const int expected_command = 6823456;
+  test_connection_ptr conn = create_connection();
+  boost::uuids::uuid conn_id = conn->m_protocol_handler.get_connection_id();
+
+  std::vector<int> codes;
+  auto cb = [&codes](int code, const std::string& buff, test_levin_connection_context&) { codes.push_back(code); };
+  ASSERT_EQ(1, m_handler_config.invoke_async(expected_command, "req", conn_id, cb, 10));
+  ASSERT_EQ(1, m_handler_config.invoke_async(expected_command, "req", conn_id, cb));
+
+  m_io_service.run_one();
+  ASSERT_EQ(std::vector<int>{ LEVIN_ERROR_CONNECTION_TIMEDOUT }, codes);
+  ASSERT_EQ(0, conn->close_counter());
+
+  // the late response goes to the timed out invoke, the next one gets its own
+  std::string frame = make_response_frame(expected_command, "late");
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(frame.data(), frame.size()));
+  ASSERT_EQ(1, codes.size());
+  frame = make_response_frame(expected_command, "next");
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(frame.data(), frame.size()));
+  ASSERT_EQ(2, codes.size());
+  ASSERT_EQ(1, codes[1]);
+
+  m_io_service.run();
+  ASSERT_EQ(0, conn->close_counter());
+}
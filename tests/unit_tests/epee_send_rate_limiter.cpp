@@ -0,0 +1,44 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "net/send_rate_limiter.h"
+
+TEST(send_rate_limiter, unlimited_never_waits)
+{
+  epee::net_utils::send_rate_limiter limiter;
+  limiter.consume(100 * 1024 * 1024, 1000);
+  ASSERT_EQ(limiter.get_wait_time(1000), 0);
+}
+
+TEST(send_rate_limiter, waits_for_the_debt)
+{
+  epee::net_utils::send_rate_limiter limiter;
+  limiter.set_rate(1000);
+  ASSERT_EQ(limiter.get_rate(), 1000);
+
+  // the bucket fills up to one second of the rate, no more
+  ASSERT_EQ(limiter.get_wait_time(10000), 0);
+  limiter.consume(1000, 10000);
+  ASSERT_GT(limiter.get_wait_time(10000), 0);
+  ASSERT_EQ(limiter.get_wait_time(10100), 0);
+
+  // a big frame goes at once, the next one waits until it is paid off
+  limiter.consume(3000, 10100);
+  uint64_t wait_ms = limiter.get_wait_time(10100);
+  ASSERT_GE(wait_ms, 2900);
+  ASSERT_LE(wait_ms, 2901);
+  ASSERT_GT(limiter.get_wait_time(12900), 0);
+  ASSERT_EQ(limiter.get_wait_time(13100), 0);
+
+  // a long pause doesn't give more than one second of the rate
+  limiter.consume(1, 100000000);
+  ASSERT_EQ(limiter.get_wait_time(100000000), 0);
+  limiter.consume(999, 100000000);
+  ASSERT_GT(limiter.get_wait_time(100000000), 0);
+
+  limiter.set_rate(0);
+  ASSERT_EQ(limiter.get_wait_time(100000000), 0);
+}
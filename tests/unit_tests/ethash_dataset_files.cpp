@@ -0,0 +1,46 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include "currency_core/ethash_dataset_files.h"
+
+TEST(ethash_dataset_files, wrong_files_are_ignored)
+{
+  boost::filesystem::path folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("ethash_datasets_test_%%%%%%%%");
+  boost::filesystem::create_directories(folder);
+
+  currency::ethash_dataset_files files;
+  ASSERT_FALSE(files.is_enabled());
+  files.init(folder.string(), 1);
+  ASSERT_TRUE(files.is_enabled());
+
+  // no file
+  ASSERT_TRUE(files.load(0) == nullptr);
+
+  // wrong size
+  {
+    std::ofstream fs(files.get_file_path(0), std::ios::binary);
+    fs << "not a dataset";
+  }
+  ASSERT_TRUE(files.load(0) == nullptr);
+
+  // right size (a sparse file), but no header
+  uint64_t dataset_size = ethash::get_full_dataset_size(ethash::calculate_full_dataset_num_items(0));
+  boost::filesystem::resize_file(files.get_file_path(0), 4096 + dataset_size);
+  ASSERT_TRUE(files.load(0) == nullptr);
+
+  // the files of the epochs before the previous one are removed
+  for (int epoch : { 1, 2, 3 })
+    std::ofstream(files.get_file_path(epoch), std::ios::binary) << "x";
+  files.remove_obsolete_files(3);
+  ASSERT_FALSE(boost::filesystem::exists(files.get_file_path(0)));
+  ASSERT_FALSE(boost::filesystem::exists(files.get_file_path(1)));
+  ASSERT_TRUE(boost::filesystem::exists(files.get_file_path(2)));
+  ASSERT_TRUE(boost::filesystem::exists(files.get_file_path(3)));
+
+  boost::filesystem::remove_all(folder);
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "currency_core/ethash_epoch_preparer.h"
+#include "ethereum/libethash/ethash/ethash.hpp"
+#include "ethereum/libethash/ethash/progpow.hpp"
+
+TEST(ethash_epoch_preparer, start_conditions)
+{
+  currency::ethash_epoch_preparer p;
+  // disabled
+  ASSERT_FALSE(p.on_new_top_height(ETHASH_EPOCH_LENGTH - 1));
+  ASSERT_FALSE(p.prepare_epoch_of_height(0));
+
+  p.init(100, 1);
+  ASSERT_FALSE(p.on_new_top_height(0));
+  ASSERT_FALSE(p.on_new_top_height(ETHASH_EPOCH_LENGTH - 101));
+  ASSERT_FALSE(p.is_running());
+  p.deinit();
+}
+
+TEST(ethash_epoch_preparer, global_contexts_of_two_latest_epochs_are_kept)
+{
+  ASSERT_TRUE(ethash::get_global_epoch_context_full(0) != nullptr);
+  ASSERT_TRUE(ethash::has_global_epoch_context_full(0));
+  ASSERT_FALSE(ethash::has_global_epoch_context_full(1));
+
+  // the prepared next epoch becomes the current one, the previous is still there for alt chains
+  ethash::set_global_epoch_context_full(ethash::create_epoch_context_full(1));
+  ASSERT_TRUE(ethash::has_global_epoch_context_full(0));
+  ASSERT_TRUE(ethash::has_global_epoch_context_full(1));
+  ASSERT_TRUE(ethash::get_global_epoch_context_full(0) != nullptr);
+  ASSERT_TRUE(ethash::has_global_epoch_context_full(1));
+
+  ethash::set_global_epoch_context_full(ethash::create_epoch_context_full(2));
+  ASSERT_FALSE(ethash::has_global_epoch_context_full(0));
+  ASSERT_TRUE(ethash::has_global_epoch_context_full(1));
+  ASSERT_TRUE(ethash::has_global_epoch_context_full(2));
+
+  // a jump over an epoch releases both
+  ASSERT_TRUE(ethash::get_global_epoch_context_full(4) != nullptr);
+  ASSERT_FALSE(ethash::has_global_epoch_context_full(1));
+  ASSERT_FALSE(ethash::has_global_epoch_context_full(2));
+  ASSERT_TRUE(ethash::has_global_epoch_context_full(4));
+}
+
+TEST(ethash_epoch_preparer, precomputed_dataset_items)
+{
+  std::shared_ptr<ethash::epoch_context_full> p_context = ethash::create_epoch_context_full(0);
+  ASSERT_TRUE(p_context != nullptr);
+  std::atomic<bool> stop(true);
+  ASSERT_FALSE(ethash::init_full_dataset(*p_context, 4, &stop));
+
+  // a part of the dataset is computed in advance, the rest lazily, the hash is the same
+  ethash::init_full_dataset_items(*p_context, 0, 20000);
+  const ethash::epoch_context& light_context = ethash::get_global_epoch_context(0);
+  ethash::hash256 header_hash = {};
+  for (uint64_t nonce = 0; nonce != 10; ++nonce)
+  {
+    ethash::result r_full = progpow::hash(*p_context, 1, header_hash, nonce);
+    ethash::result r_light = progpow::hash(light_context, 1, header_hash, nonce);
+    ASSERT_EQ(memcmp(r_full.final_hash.bytes, r_light.final_hash.bytes, sizeof(r_full.final_hash)), 0);
+  }
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <map>
+#include <sstream>
+#include "include_base_utils.h"
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+#include "common/flat_hash_map.h"
+#include "common/unordered_containers_boost_serialization.h"
+#include "currency_core/currency_boost_serialization.h"
+#include "eos/portable_archive.hpp"
+
+namespace
+{
+  crypto::key_image make_ki(uint64_t n)
+  {
+    crypto::key_image ki = AUTO_VAL_INIT(ki);
+    // low bits only, so the hash mixing is exercised as well
+    *reinterpret_cast<uint64_t*>(&ki) = n;
+    return ki;
+  }
+}
+
+TEST(flat_hash_map, random_against_std_map)
+{
+  // many inserts, updates and erases with grows, long clusters and backward shifts on erase
+  tools::flat_hash_map<crypto::key_image, size_t> m;
+  std::map<uint64_t, size_t> reference;
+  uint64_t rnd = 12345;
+  auto next = [&]() { rnd = rnd * 6364136223846793005ULL + 1442695040888963407ULL; return rnd >> 33; };
+
+  for (size_t i = 0; i != 200000; ++i)
+  {
+    uint64_t key = next() % 5000;
+    if (next() % 3)
+    {
+      size_t value = static_cast<size_t>(next());
+      reference[key] = value;
+      m[make_ki(key)] = value;
+    }
+    else if (next() % 2)
+    {
+      ASSERT_EQ(m.erase(make_ki(key)), reference.erase(key));
+    }
+    else
+    {
+      auto it = m.find(make_ki(key));
+      ASSERT_EQ(it != m.end(), reference.count(key) != 0);
+      if (it != m.end())
+      {
+        m.erase(it);
+        reference.erase(key);
+      }
+    }
+  }
+
+  ASSERT_EQ(m.size(), reference.size());
+  for (uint64_t key = 0; key != 5000; ++key)
+  {
+    auto it = m.find(make_ki(key));
+    auto rit = reference.find(key);
+    ASSERT_EQ(m.count(make_ki(key)), reference.count(key));
+    ASSERT_EQ(it != m.end(), rit != reference.end());
+    if (rit != reference.end())
+      ASSERT_EQ(it->second, rit->second);
+  }
+
+  size_t enumerated = 0;
+  for (const auto& e : m)
+  {
+    ASSERT_EQ(reference[*reinterpret_cast<const uint64_t*>(&e.first)], e.second);
+    ++enumerated;
+  }
+  ASSERT_EQ(enumerated, reference.size());
+
+  m.clear();
+  ASSERT_TRUE(m.empty());
+  ASSERT_TRUE(m.begin() == m.end());
+}
+
+TEST(flat_hash_map, same_boost_format_as_unordered_map)
+{
+  std::unordered_map<crypto::key_image, size_t> um;
+  for (size_t i = 0; i != 1000; ++i)
+    um[make_ki(i * 7)] = i;
+
+  std::stringstream ss;
+  {
+    eos::portable_oarchive a(ss);
+    a << um;
+  }
+  tools::flat_hash_map<crypto::key_image, size_t> m;
+  {
+    eos::portable_iarchive a(ss);
+    a >> m;
+  }
+  ASSERT_EQ(m.size(), um.size());
+  for (const auto& e : um)
+    ASSERT_EQ(m[e.first], e.second);
+
+  std::stringstream ss2;
+  {
+    eos::portable_oarchive a(ss2);
+    a << m;
+  }
+  std::unordered_map<crypto::key_image, size_t> um2;
+  {
+    eos::portable_iarchive a(ss2);
+    a >> um2;
+  }
+  ASSERT_EQ(um2, um);
+}
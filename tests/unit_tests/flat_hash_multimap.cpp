@@ -0,0 +1,103 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <map>
+#include <set>
+#include "include_base_utils.h"
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+#include "common/flat_hash_multimap.h"
+
+namespace
+{
+  crypto::key_image make_ki(uint64_t n)
+  {
+    crypto::key_image ki = AUTO_VAL_INIT(ki);
+    // low bits only, so the hash mixing is exercised as well
+    *reinterpret_cast<uint64_t*>(&ki) = n;
+    return ki;
+  }
+
+  crypto::hash make_id(uint64_t n)
+  {
+    crypto::hash h = AUTO_VAL_INIT(h);
+    *reinterpret_cast<uint64_t*>(&h) = n;
+    return h;
+  }
+
+  std::set<uint64_t> values_of(const tools::flat_hash_multimap<crypto::key_image, crypto::hash>& m, uint64_t key)
+  {
+    std::set<uint64_t> result;
+    m.for_each_value(make_ki(key), [&](const crypto::hash& h) { result.insert(*reinterpret_cast<const uint64_t*>(&h)); return true; });
+    return result;
+  }
+}
+
+TEST(flat_hash_multimap, basic)
+{
+  tools::flat_hash_multimap<crypto::key_image, crypto::hash> m;
+  ASSERT_FALSE(m.contains(make_ki(1)));
+  ASSERT_FALSE(m.erase(make_ki(1), make_id(1)));
+
+  ASSERT_TRUE(m.insert(make_ki(1), make_id(10)));
+  ASSERT_FALSE(m.insert(make_ki(1), make_id(10)));
+  ASSERT_TRUE(m.insert(make_ki(1), make_id(11)));
+  ASSERT_TRUE(m.insert(make_ki(2), make_id(10)));
+  ASSERT_EQ(m.size(), 3);
+  ASSERT_EQ(m.count(make_ki(1)), 2);
+  ASSERT_EQ(values_of(m, 1), std::set<uint64_t>({ 10, 11 }));
+
+  ASSERT_TRUE(m.erase(make_ki(1), make_id(10)));
+  ASSERT_FALSE(m.erase(make_ki(1), make_id(10)));
+  ASSERT_TRUE(m.contains(make_ki(1)));
+  ASSERT_TRUE(m.erase(make_ki(1), make_id(11)));
+  ASSERT_FALSE(m.contains(make_ki(1)));
+  ASSERT_TRUE(m.contains(make_ki(2)));
+  ASSERT_EQ(m.size(), 1);
+
+  m.clear();
+  ASSERT_TRUE(m.empty());
+  ASSERT_FALSE(m.contains(make_ki(2)));
+}
+
+TEST(flat_hash_multimap, random_against_std_multimap)
+{
+  // many inserts and erases with grows, long clusters and backward shifts on erase
+  tools::flat_hash_multimap<crypto::key_image, crypto::hash> m;
+  std::map<uint64_t, std::set<uint64_t>> reference;
+  size_t reference_size = 0;
+  uint64_t rnd = 12345;
+  auto next = [&]() { rnd = rnd * 6364136223846793005ULL + 1442695040888963407ULL; return rnd >> 33; };
+
+  for (size_t i = 0; i != 200000; ++i)
+  {
+    uint64_t key = next() % 5000;
+    uint64_t value = next() % 4;
+    if (next() % 3)
+    {
+      bool inserted = reference[key].insert(value).second;
+      reference_size += inserted ? 1 : 0;
+      ASSERT_EQ(m.insert(make_ki(key), make_id(value)), inserted);
+    }
+    else
+    {
+      bool erased = reference[key].erase(value) != 0;
+      reference_size -= erased ? 1 : 0;
+      ASSERT_EQ(m.erase(make_ki(key), make_id(value)), erased);
+    }
+  }
+
+  ASSERT_EQ(m.size(), reference_size);
+  for (const auto& r : reference)
+  {
+    ASSERT_EQ(values_of(m, r.first), r.second);
+    ASSERT_EQ(m.contains(make_ki(r.first)), !r.second.empty());
+  }
+
+  size_t enumerated = 0;
+  m.for_each([&](const crypto::key_image&, const crypto::hash&) { ++enumerated; return true; });
+  ASSERT_EQ(enumerated, reference_size);
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+#include "common/golomb_coded_set.h"
+
+namespace
+{
+  crypto::key_image make_ki(uint64_t n)
+  {
+    crypto::hash h = crypto::cn_fast_hash(&n, sizeof(n));
+    return *reinterpret_cast<const crypto::key_image*>(&h);
+  }
+
+  std::vector<crypto::key_image> make_kis(uint64_t from, uint64_t to)
+  {
+    std::vector<crypto::key_image> result;
+    for (uint64_t i = from; i != to; ++i)
+      result.push_back(make_ki(i));
+    return result;
+  }
+}
+
+TEST(golomb_coded_set, build_match_false_positives)
+{
+  typedef tools::golomb_coded_set<crypto::key_image> gcs_t;
+
+  // empty set
+  std::string blob = gcs_t::build(std::vector<crypto::key_image>());
+  ASSERT_EQ(blob.size(), 1);
+  ASSERT_FALSE(gcs_t::match_any(blob, make_kis(0, 100)));
+
+  const size_t count = 2000;
+  std::vector<crypto::key_image> items = make_kis(0, count);
+  blob = gcs_t::build(items);
+  ASSERT_LT(blob.size(), count * 23 / 8 + 8); // ~(P + 1.5) bits per item
+
+  ASSERT_FALSE(gcs_t::match_any(blob, std::vector<crypto::key_image>()));
+  for (const auto& ki : items)
+    ASSERT_TRUE(gcs_t::match_any(blob, std::vector<crypto::key_image>({ ki })));
+  std::vector<crypto::key_image> queries = make_kis(1000000, 1000100);
+  queries.push_back(items[count / 2]);
+  ASSERT_TRUE(gcs_t::match_any(blob, queries));
+
+  // 2^-20 per query
+  size_t false_positives = 0;
+  for (uint64_t i = 1000000; i != 1100000; ++i)
+    false_positives += gcs_t::match_any(blob, std::vector<crypto::key_image>({ make_ki(i) })) ? 1 : 0;
+  ASSERT_LT(false_positives, 5);
+
+  // damaged blobs never give false negatives
+  ASSERT_TRUE(gcs_t::match_any(blob.substr(0, blob.size() / 2), std::vector<crypto::key_image>({ items.back() })));
+  ASSERT_TRUE(gcs_t::match_any(std::string(), std::vector<crypto::key_image>({ items.back() })));
+}
@@ -0,0 +1,137 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "currency_core/currency_format_utils.h"
+#include "common/boost_serialization_helper.h"
+#include "currency_core/currency_boost_serialization.h"
+
+using namespace currency;
+
+namespace
+{
+  crypto::hash tx_hash_no_memo(transaction tx)
+  {
+    tx.invalidate_hashes();
+    return get_transaction_hash(tx);
+  }
+
+  crypto::hash block_hash_no_memo(block b)
+  {
+    b.invalidate_hashes();
+    return get_block_hash(b);
+  }
+}
+
+TEST(hash_memo, transaction)
+{
+  block genesis = AUTO_VAL_INIT(genesis);
+  ASSERT_TRUE(generate_genesis_block(genesis));
+  const blobdata tx_blob = t_serializable_object_to_blob(genesis.miner_tx);
+
+  transaction tx = AUTO_VAL_INIT(tx);
+  ASSERT_TRUE(parse_and_validate_tx_from_blob(tx_blob, tx));
+  ASSERT_TRUE(tx.hash_memo.valid);
+  ASSERT_EQ(tx_hash_no_memo(tx), get_transaction_hash(tx));
+  ASSERT_EQ(get_transaction_prefix_hash(tx), get_transaction_hash(tx));
+  transaction tx_no_memo = tx;
+  tx_no_memo.invalidate_hashes();
+  ASSERT_EQ(get_object_blobsize(tx_no_memo), get_object_blobsize(tx));
+
+  // pruning doesn't touch the prefix
+  const crypto::hash id = get_transaction_hash(tx);
+  tx.signatures.clear();
+  tx.attachment.clear();
+  tx.proofs.clear();
+  ASSERT_TRUE(tx.hash_memo.valid);
+  ASSERT_EQ(id, tx_hash_no_memo(tx));
+
+  // prefix changes have to be followed by invalidate_hashes()
+  tx.extra.push_back(extra_user_data{ "memo" });
+  tx.invalidate_hashes();
+  ASSERT_NE(id, get_transaction_hash(tx));
+  ASSERT_EQ(get_transaction_prefix_hash(tx), get_transaction_hash(tx));
+
+  // any deserialization resets the memo
+  ASSERT_TRUE(parse_and_validate_tx_from_blob(tx_blob, tx));
+  ASSERT_TRUE(t_unserializable_object_from_blob(tx, t_serializable_object_to_blob(tx_no_memo)));
+  ASSERT_FALSE(tx.hash_memo.valid);
+
+  std::string buff;
+  ASSERT_TRUE(parse_and_validate_tx_from_blob(tx_blob, tx));
+  ASSERT_TRUE(tools::serialize_obj_to_buff(tx_no_memo, buff));
+  ASSERT_TRUE(tools::unserialize_obj_from_buff(tx, buff));
+  ASSERT_FALSE(tx.hash_memo.valid);
+  ASSERT_EQ(id, get_transaction_hash(tx));
+}
+
+TEST(hash_memo, transaction_prefix_only)
+{
+  block genesis = AUTO_VAL_INIT(genesis);
+  ASSERT_TRUE(generate_genesis_block(genesis));
+  transaction full_tx = genesis.miner_tx;
+  full_tx.version = TRANSACTION_VERSION_POST_HF4;
+  full_tx.attachment.push_back(tx_comment{ "comment" });
+  full_tx.signatures.push_back(NLSAG_sig{ std::vector<crypto::signature>(3) });
+  full_tx.proofs.push_back(zc_balance_proof{});
+  full_tx.invalidate_hashes();
+  const blobdata tx_blob = t_serializable_object_to_blob(full_tx);
+
+  transaction tx = AUTO_VAL_INIT(tx);
+  crypto::hash id = null_hash;
+  ASSERT_TRUE(parse_tx_prefix_from_blob(tx_blob, tx, id));
+  ASSERT_TRUE(tx.hash_memo.valid);
+  ASSERT_EQ(get_transaction_hash(full_tx), id);
+  ASSERT_TRUE(tx.attachment.empty());
+  ASSERT_TRUE(tx.signatures.empty());
+  ASSERT_TRUE(tx.proofs.empty());
+  ASSERT_EQ(get_object_blobsize(full_tx), get_object_blobsize(tx));
+
+  // a truncated prefix is still an error
+  ASSERT_FALSE(parse_tx_prefix_from_blob(tx_blob.substr(0, get_object_blobsize(static_cast<const transaction_prefix&>(full_tx)) - 1), tx, id));
+}
+
+TEST(hash_memo, block)
+{
+  block genesis = AUTO_VAL_INIT(genesis);
+  ASSERT_TRUE(generate_genesis_block(genesis));
+  genesis.tx_hashes.push_back(crypto::cn_fast_hash("tx", 2));
+  const blobdata block_blob = block_to_blob(genesis);
+
+  block b = AUTO_VAL_INIT(b);
+  ASSERT_TRUE(parse_and_validate_block_from_blob(block_blob, b));
+  ASSERT_TRUE(b.hash_memo.valid);
+  ASSERT_TRUE(b.miner_tx.hash_memo.valid);
+  const crypto::hash id = get_block_hash(b);
+  ASSERT_EQ(block_hash_no_memo(genesis), id);
+
+  // nonce and timestamp are changed in place by miners, that bypasses the memo until they're restored
+  b.nonce += 1;
+  ASSERT_NE(id, get_block_hash(b));
+  ASSERT_EQ(block_hash_no_memo(b), get_block_hash(b));
+  b.nonce -= 1;
+  b.timestamp += 1;
+  ASSERT_EQ(block_hash_no_memo(b), get_block_hash(b));
+  b.timestamp -= 1;
+  ASSERT_EQ(id, get_block_hash(b));
+
+  b.tx_hashes.push_back(crypto::cn_fast_hash("tx2", 3));
+  ASSERT_EQ(block_hash_no_memo(b), get_block_hash(b));
+  b.tx_hashes.pop_back();
+
+  // the miner tx memo is a part of the block memo
+  b.miner_tx.extra.push_back(extra_user_data{ "memo" });
+  b.miner_tx.invalidate_hashes();
+  ASSERT_NE(id, get_block_hash(b));
+  ASSERT_EQ(block_hash_no_memo(b), get_block_hash(b));
+
+  ASSERT_TRUE(parse_and_validate_block_from_blob(block_blob, b));
+  block b2 = b;
+  ASSERT_TRUE(b2.hash_memo.valid);
+  ASSERT_TRUE(t_unserializable_object_from_blob(b2, block_blob));
+  ASSERT_FALSE(b2.hash_memo.valid);
+  ASSERT_FALSE(b2.miner_tx.hash_memo.valid);
+  ASSERT_EQ(block_hash_no_memo(b2), get_block_hash(b2));
+}
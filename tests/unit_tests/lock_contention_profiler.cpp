@@ -0,0 +1,76 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include "include_base_utils.h"
+#include "syncobj.h"
+#include "readwrite_lock.h"
+
+namespace
+{
+  epee::critical_section g_test_lock;
+  epee::shared_recursive_mutex g_test_rw_lock;
+
+  void enter_test_lock(uint64_t hold_ms)
+  {
+    CRITICAL_REGION_LOCAL(g_test_lock);
+    std::this_thread::sleep_for(std::chrono::milliseconds(hold_ms));
+  }
+
+  void enter_test_rw_lock()
+  {
+    CRITICAL_REGION_LOCAL(g_test_rw_lock);
+  }
+
+  bool find_site(const char* lock_name, epee::lock_site_stat& st)
+  {
+    std::vector<epee::lock_site_stat> stats;
+    epee::lock_contention_profiler::get_stats(stats);
+    for (const auto& s : stats)
+    {
+      if (s.lock_name == lock_name)
+      {
+        st = s;
+        return true;
+      }
+    }
+    return false;
+  }
+}
+
+TEST(lock_contention_profiler, wait_and_hold_per_site)
+{
+  epee::lock_contention_profiler::enable(false);
+  enter_test_lock(0);
+  epee::lock_site_stat st;
+  ASSERT_FALSE(find_site("g_test_lock", st));
+
+  epee::lock_contention_profiler::enable(true);
+  std::thread t([]() { enter_test_lock(100); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  enter_test_lock(0); // waits for the other thread for about 80 ms
+  t.join();
+  enter_test_rw_lock();
+  epee::lock_contention_profiler::enable(false);
+
+  ASSERT_TRUE(find_site("g_test_lock", st));
+  ASSERT_EQ(st.count, 2);
+  ASSERT_GE(st.wait_max_us, 50000);
+  ASSERT_GE(st.hold_max_us, 90000);
+  ASSERT_EQ(st.wait_buckets.size(), epee::lock_contention_profiler::get_buckets_us().size());
+  uint64_t in_buckets = 0;
+  for (uint64_t b : st.wait_buckets)
+    in_buckets += b;
+  ASSERT_EQ(in_buckets, 2);
+  ASSERT_NE(st.location.find("lock_contention_profiler.cpp"), std::string::npos);
+
+  ASSERT_TRUE(find_site("g_test_rw_lock", st));
+  ASSERT_EQ(st.count, 1);
+  ASSERT_NE(epee::lock_contention_profiler::get_report(10).find("g_test_lock"), std::string::npos);
+
+  epee::lock_contention_profiler::reset();
+  ASSERT_FALSE(find_site("g_test_lock", st));
+}
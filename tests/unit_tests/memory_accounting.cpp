@@ -0,0 +1,67 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include "include_base_utils.h"
+#include "cache_helper.h"
+#include "memory_accounting.h"
+#include "serialization/keyvalue_serialization.h"
+#include "storages/portable_storage_template_helper.h"
+#include "common/memory_usage.h"
+
+TEST(memory_accounting, cache_estimate_bytes)
+{
+  epee::misc_utils::cache_base<false, uint64_t, std::string, 100> cache;
+  auto weigher = [](const uint64_t& k, const std::string& v) -> uint64_t { return v.size(); };
+  ASSERT_EQ(cache.estimate_bytes(10, weigher), 0);
+
+  for (uint64_t i = 0; i != 50; ++i)
+    cache.set(i, std::string(100, 'x'));
+  ASSERT_EQ(cache.estimate_bytes(10, weigher), 50 * 100);
+
+  // only the most recent ones are sampled
+  for (uint64_t i = 50; i != 60; ++i)
+    cache.set(i, std::string(10, 'x'));
+  ASSERT_EQ(cache.estimate_bytes(10, weigher), 60 * 10);
+  ASSERT_EQ(cache.estimate_bytes(100, weigher), 50 * 100 + 10 * 10);
+}
+
+TEST(memory_accounting, scope)
+{
+  epee::memory_accounting::counter& c = epee::memory_accounting::get("test_memory_accounting_scope");
+  {
+    epee::memory_accounting_scope s1;
+    s1.set(c, 100);
+    ASSERT_EQ(c.bytes.load(), 100);
+    ASSERT_EQ(c.items.load(), 1);
+
+    epee::memory_accounting_scope s2(s1); // copies account nothing
+    ASSERT_EQ(c.bytes.load(), 100);
+
+    s1.set(c, 30);
+    ASSERT_EQ(c.bytes.load(), 30);
+    ASSERT_EQ(c.items.load(), 1);
+  }
+  ASSERT_EQ(c.bytes.load(), 0);
+  ASSERT_EQ(c.items.load(), 0);
+
+  std::list<tools::memory_usage_entry> usage;
+  tools::get_epee_memory_usage(usage);
+  ASSERT_TRUE(std::any_of(usage.begin(), usage.end(), [](const tools::memory_usage_entry& e) { return e.name == "test_memory_accounting_scope"; }));
+}
+
+TEST(memory_accounting, portable_storage_parsed_json)
+{
+  epee::memory_accounting::counter& c = epee::memory_accounting::get("portable_storage_parsed_json");
+  int64_t before = c.bytes.load();
+  const std::string json = "{\"a\": 1, \"b\": \"text\"}";
+  {
+    epee::serialization::portable_storage ps;
+    ASSERT_TRUE(ps.load_from_json(json));
+    ASSERT_EQ(c.bytes.load(), before + static_cast<int64_t>(json.size()));
+  }
+  ASSERT_EQ(c.bytes.load(), before);
+}
@@ -96,3 +96,201 @@ TEST(portable_storage_tests, json_string_unescaping_match_string2)
   ASSERT_TRUE(caught);
 }
 
+
+struct test_struct_inner
+{
+  int8_t a;
+  std::vector<uint64_t> b;
+
+  BEGIN_KV_SERIALIZE_MAP()
+    KV_SERIALIZE(a)
+    KV_SERIALIZE(b)
+  END_KV_SERIALIZE_MAP()
+};
+
+// entries go in the name order here, so the tree gives the same
+struct test_struct_2
+{
+  bool a_bool;
+  double b_double;
+  epee::serialization::storage_entry c_id;
+  test_struct_inner d_empty;
+  std::list<test_struct_inner> e_objs;
+  std::vector<std::string> f_empty_strs;
+  test_struct_inner g_obj;
+  std::vector<std::string> h_strs;
+  uint8_t i_byte;
+  int64_t j_negative;
+  boost::optional<uint32_t> k_none;
+  std::string l_str;
+
+  BEGIN_KV_SERIALIZE_MAP()
+    KV_SERIALIZE(a_bool)
+    KV_SERIALIZE(b_double)
+    KV_SERIALIZE(c_id)
+    KV_SERIALIZE(d_empty)
+    KV_SERIALIZE(e_objs)
+    KV_SERIALIZE(f_empty_strs)
+    KV_SERIALIZE(g_obj)
+    KV_SERIALIZE(h_strs)
+    KV_SERIALIZE(i_byte)
+    KV_SERIALIZE(j_negative)
+    KV_SERIALIZE(k_none)
+    KV_SERIALIZE(l_str)
+  END_KV_SERIALIZE_MAP()
+};
+
+struct test_struct_3
+{
+  std::string z;
+  test_struct_2 y;
+  uint64_t x;
+
+  BEGIN_KV_SERIALIZE_MAP()
+    KV_SERIALIZE(z)
+    KV_SERIALIZE(y)
+    KV_SERIALIZE(x)
+  END_KV_SERIALIZE_MAP()
+};
+
+TEST(portable_storage_tests, json_stream_storage)
+{
+  test_struct_2 obj = AUTO_VAL_INIT(obj);
+  obj.a_bool = true;
+  obj.b_double = -3.25;
+  obj.c_id = std::string("id\"1");
+  obj.d_empty.a = 0;
+  obj.e_objs.resize(2);
+  obj.e_objs.front().a = -1;
+  obj.e_objs.front().b = { 1, 2, 3 };
+  obj.e_objs.back().a = 2;
+  obj.g_obj.a = 127;
+  obj.g_obj.b = { UINT64_MAX };
+  obj.h_strs = { "one", "two\n" };
+  obj.i_byte = 255;
+  obj.j_negative = INT64_MIN;
+  obj.l_str = "a/b\\c";
+
+  for (size_t indent = 0; indent != 3; ++indent)
+  {
+    std::string json_stream;
+    ASSERT_TRUE(epee::serialization::store_t_to_json_stream(obj, json_stream, indent));
+    ASSERT_EQ(json_stream, epee::serialization::store_t_to_json(obj, indent));
+  }
+
+  // in other order the entries stay as stored, the content is the same
+  test_struct_3 obj3 = AUTO_VAL_INIT(obj3);
+  obj3.z = "last";
+  obj3.y = obj;
+  obj3.y.g_obj.b = { 5 };    // the parser takes no UINT64_MAX in arrays
+  obj3.y.j_negative = -5;    // and no INT64_MIN
+  obj3.x = 42;
+  std::string json_stream;
+  ASSERT_TRUE(epee::serialization::store_t_to_json_stream(obj3, json_stream));
+  ASSERT_LT(json_stream.find("\"z\""), json_stream.find("\"x\""));
+  epee::serialization::portable_storage ps;
+  ASSERT_TRUE(ps.load_from_json(json_stream));
+  std::string json_from_tree;
+  ps.dump_as_json(json_from_tree);
+  ASSERT_EQ(json_from_tree, epee::serialization::store_t_to_json(obj3));
+}
+
+// the string matching scans 16 bytes at once, try escapes and the closing quote at every position of a block
+TEST(portable_storage_tests, json_string_unescaping_long_runs)
+{
+  for (size_t len = 0; len != 50; ++len)
+  {
+    for (size_t escape_pos = 0; escape_pos <= len; ++escape_pos)
+    {
+      std::string plain(len, 'a');
+      for (size_t i = 0; i != len; ++i)
+        plain[i] = "0123456789abcdef"[i % 16];
+      std::string expected = plain;
+      expected.insert(escape_pos, "\n\"");
+      std::string json = std::string("\"") + plain + "\"";
+      json.insert(1 + escape_pos, "\\n\\\"");
+      std::string json_with_tail = json + ", \"next\": \"x\\\"y\"";
+
+      std::string output_buffer;
+      std::string::const_iterator it = json_with_tail.cbegin();
+      epee::misc_utils::parse::match_string2(it, json_with_tail.cend(), output_buffer);
+      ASSERT_EQ(output_buffer, expected);
+      ASSERT_EQ(static_cast<size_t>(it - json_with_tail.cbegin()), json.size() - 1);
+
+      // not terminated
+      std::string truncated = json.substr(0, json.size() - 1);
+      it = truncated.cbegin();
+      ASSERT_THROW(epee::misc_utils::parse::match_string2(it, truncated.cend(), output_buffer), std::runtime_error);
+      truncated += "\\";
+      it = truncated.cbegin();
+      ASSERT_THROW(epee::misc_utils::parse::match_string2(it, truncated.cend(), output_buffer), std::runtime_error);
+    }
+  }
+}
+
+TEST(portable_storage_tests, binary_load_in_place)
+{
+  using namespace epee::serialization;
+
+  test_struct_3 obj = AUTO_VAL_INIT(obj);
+  obj.z = std::string(1000, 'z');
+  obj.y.e_objs.resize(3);
+  obj.y.e_objs.back().b = { 1, 2, 3 };
+  obj.y.h_strs = { "one", "", std::string(300, 'b') };
+  obj.y.j_negative = INT64_MIN;
+  obj.x = 42;
+
+  // an array of arrays, it has a type byte per nested array
+  array_entry_t<uint16_t> inner_a;
+  inner_a.insert_next_value(7);
+  inner_a.insert_next_value(8);
+  array_entry_t<std::string> inner_b;
+  inner_b.insert_next_value("x");
+  array_entry_t<array_entry> outer;
+  outer.insert_next_value(array_entry(inner_a));
+  outer.insert_next_value(array_entry(inner_b));
+  obj.y.c_id = array_entry(outer);
+
+  std::string buff;
+  ASSERT_TRUE(store_t_to_binary(obj, buff));
+
+  portable_storage ps;
+  ASSERT_TRUE(ps.load_from_binary(buff));
+  std::string buff2;
+  ASSERT_TRUE(ps.store_to_binary(buff2));
+  ASSERT_EQ(buff, buff2);
+
+  test_struct_3 obj2 = AUTO_VAL_INIT(obj2);
+  ASSERT_TRUE(load_t_from_binary(obj2, buff));
+  ASSERT_EQ(obj.z, obj2.z);
+  ASSERT_EQ(obj.y.h_strs, obj2.y.h_strs);
+  ASSERT_EQ(obj.y.e_objs.back().b, obj2.y.e_objs.back().b);
+  ASSERT_EQ(obj.y.j_negative, obj2.y.j_negative);
+  ASSERT_EQ(obj.x, obj2.x);
+
+  // every truncation is rejected
+  for (size_t len = 0; len != buff.size(); ++len)
+  {
+    portable_storage ps_truncated;
+    ASSERT_FALSE(ps_truncated.load_from_binary(buff.substr(0, len))) << len;
+  }
+
+  // a huge array size is rejected before the elements are read
+  std::string huge(buff.substr(0, 9));
+  huge += '\x04';                             // 1 entry
+  huge += '\x01'; huge += 'a';                // "a"
+  huge += char(SERIALIZE_TYPE_UINT8 | SERIALIZE_FLAG_ARRAY);
+  huge.append("\xff\xff\xff\x7f", 4);         // DWORD varint
+  huge += '\x01';
+  ASSERT_FALSE(ps.load_from_binary(huge));
+
+  // the first one of the duplicated names is kept
+  std::string dup(buff.substr(0, 9));
+  dup += '\x08';                              // 2 entries
+  dup += '\x01'; dup += 'a'; dup += char(SERIALIZE_TYPE_UINT8); dup += '\x01';
+  dup += '\x01'; dup += 'a'; dup += char(SERIALIZE_TYPE_OBJECT); dup += '\x00';
+  ASSERT_TRUE(ps.load_from_binary(dup));
+  uint8_t a = 0;
+  ASSERT_TRUE(ps.get_value("a", a, nullptr));
+  ASSERT_EQ(1, a);
+}
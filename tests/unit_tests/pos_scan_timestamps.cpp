@@ -0,0 +1,30 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "wallet/wallet2.h"
+
+TEST(pos_scan, timestamps_from_the_middle)
+{
+  const uint64_t ts_from = 1000 * POS_SCAN_STEP, ts_to = 1011 * POS_SCAN_STEP;
+  std::vector<uint64_t> timestamps;
+  tools::wallet2::get_pos_scan_timestamps(ts_from, ts_to, timestamps);
+
+  // the middle one, then one step to the past and one to the future, and so on, within the window
+  const uint64_t ts_middle = 1005 * POS_SCAN_STEP;
+  ASSERT_EQ(timestamps.size(), 11);
+  ASSERT_EQ(timestamps[0], ts_middle);
+  for (size_t i = 1; i != timestamps.size(); i += 2)
+  {
+    ASSERT_EQ(timestamps[i], ts_middle - (i + 1) / 2 * POS_SCAN_STEP);
+    ASSERT_EQ(timestamps[i + 1], ts_middle + (i + 1) / 2 * POS_SCAN_STEP);
+  }
+  for (uint64_t ts : timestamps)
+  {
+    ASSERT_TRUE(ts >= ts_from && ts <= ts_to);
+    ASSERT_EQ(ts % POS_SCAN_STEP, 0);
+  }
+}
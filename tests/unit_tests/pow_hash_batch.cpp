@@ -0,0 +1,30 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "currency_core/basic_pow_helpers.h"
+
+TEST(pow_hash_batch, same_hashes_as_one_by_one)
+{
+  crypto::hash header_hash = currency::null_hash;
+  for (size_t i = 0; i != sizeof(header_hash.data); ++i)
+    header_hash.data[i] = static_cast<char>(i * 13 + 5);
+
+  // more than one batch, the last one is incomplete
+  const size_t count = CURRENCY_MINER_HASH_BATCH_SIZE * 2 + 3;
+  std::vector<uint64_t> nonces(count);
+  for (size_t i = 0; i != count; ++i)
+    nonces[i] = 0xfeedull + i * 3;
+
+  std::vector<crypto::hash> hashes(count);
+  currency::get_block_longhashes_full(10, header_hash, nonces.data(), count, hashes.data());
+  for (size_t i = 0; i != count; ++i)
+    ASSERT_EQ(hashes[i], currency::get_block_longhash_full(10, header_hash, nonces[i]));
+
+  // just one
+  crypto::hash h = currency::null_hash;
+  currency::get_block_longhashes_full(10, header_hash, &nonces[5], 1, &h);
+  ASSERT_EQ(h, hashes[5]);
+}
@@ -0,0 +1,36 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "currency_core/basic_pow_helpers.h"
+
+TEST(pow_light_verification, same_hash_as_full_dataset)
+{
+  crypto::hash header_hash = currency::null_hash;
+  for (size_t i = 0; i != sizeof(header_hash.data); ++i)
+    header_hash.data[i] = static_cast<char>(i * 7 + 1);
+
+  for (uint64_t nonce : { 0ull, 1ull, 0xdeadbeefcafeull })
+  {
+    crypto::hash full = currency::get_block_longhash_full(10, header_hash, nonce);
+
+    currency::set_pow_light_verification(true, 0);
+    ASSERT_TRUE(currency::is_pow_light_verification());
+    ASSERT_EQ(currency::get_block_longhash(10, header_hash, nonce), full);
+
+    // the second time the items come from the cache
+    currency::set_pow_light_verification(true, 1000);
+    ASSERT_EQ(currency::get_block_longhash(10, header_hash, nonce), full);
+    ASSERT_EQ(currency::get_block_longhash(10, header_hash, nonce), full);
+
+    // a cache too small to keep all the items of one hash
+    currency::set_pow_light_verification(true, 10);
+    ASSERT_EQ(currency::get_block_longhash_light(10, header_hash, nonce), full);
+
+    currency::set_pow_light_verification(false);
+    ASSERT_FALSE(currency::is_pow_light_verification());
+    ASSERT_EQ(currency::get_block_longhash(10, header_hash, nonce), full);
+  }
+}
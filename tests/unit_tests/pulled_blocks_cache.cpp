@@ -0,0 +1,104 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "currency_core/currency_format_utils.h"
+#include "wallet/pulled_blocks_cache.h"
+
+namespace
+{
+  typedef currency::COMMAND_RPC_GET_BLOCKS_DIRECT blocks_direct;
+
+  // blocks of a chain are told apart by nonce, b.nonce = height + fork * 1000000
+  std::vector<std::shared_ptr<currency::block_extended_info>> make_chain(uint64_t count, uint64_t fork_height = UINT64_MAX, uint64_t fork = 0)
+  {
+    std::vector<std::shared_ptr<currency::block_extended_info>> result;
+    for (uint64_t h = 0; h != count; ++h)
+    {
+      auto bei = std::make_shared<currency::block_extended_info>();
+      bei->bl.nonce = h + (h >= fork_height ? fork * 1000000 : 0);
+      bei->bl.prev_id = result.empty() ? currency::null_hash : currency::get_block_hash(result.back()->bl);
+      bei->height = h;
+      result.push_back(bei);
+    }
+    return result;
+  }
+
+  blocks_direct::response make_response(const std::vector<std::shared_ptr<currency::block_extended_info>>& chain, uint64_t from, uint64_t to)
+  {
+    blocks_direct::response rsp = AUTO_VAL_INIT(rsp);
+    for (uint64_t h = from; h != to; ++h)
+    {
+      currency::block_direct_data_entry e = AUTO_VAL_INIT(e);
+      e.block_ptr = chain[h];
+      rsp.blocks.push_back(e);
+    }
+    rsp.start_height = from;
+    rsp.current_height = chain.size();
+    rsp.txs_pruned = true;
+    rsp.status = API_RETURN_CODE_OK;
+    return rsp;
+  }
+
+  blocks_direct::request make_request(const std::vector<std::shared_ptr<currency::block_extended_info>>& chain, uint64_t top_height)
+  {
+    blocks_direct::request rqt = AUTO_VAL_INIT(rqt);
+    rqt.block_ids.push_back(currency::get_block_hash(chain[top_height]->bl));
+    rqt.block_ids.push_back(currency::get_block_hash(chain[0]->bl));
+    rqt.prune_txs = true;
+    return rqt;
+  }
+}
+
+TEST(pulled_blocks_cache, get_put_reorganize)
+{
+  tools::pulled_blocks_cache cache;
+  auto chain = make_chain(100);
+  blocks_direct::response rsp = AUTO_VAL_INIT(rsp);
+
+  ASSERT_FALSE(cache.get(make_request(chain, 10), rsp));
+  cache.put(make_request(chain, 10), make_response(chain, 10, 100));
+
+  // a wallet in the middle gets the rest
+  ASSERT_TRUE(cache.get(make_request(chain, 50), rsp));
+  ASSERT_EQ(rsp.start_height, 50);
+  ASSERT_EQ(rsp.blocks.size(), 50);
+  ASSERT_EQ(rsp.blocks.front().block_ptr, chain[50]);
+  ASSERT_EQ(rsp.current_height, 100);
+  ASSERT_TRUE(rsp.txs_pruned);
+
+  // minimum height is respected
+  blocks_direct::request rqt = make_request(chain, 20);
+  rqt.minimum_height = 30;
+  ASSERT_TRUE(cache.get(rqt, rsp));
+  ASSERT_EQ(rsp.start_height, 30);
+
+  // the top one has to ask the daemon, so does a wallet out of the cache, and the one with other flags
+  ASSERT_FALSE(cache.get(make_request(chain, 99), rsp));
+  ASSERT_FALSE(cache.get(make_request(chain, 5), rsp));
+  rqt = make_request(chain, 50);
+  rqt.key_images_filters = true;
+  ASSERT_FALSE(cache.get(rqt, rsp));
+
+  // a reorganization at 80, the daemon's response replaces the old branch
+  auto alt_chain = make_chain(110, 80, 1);
+  cache.put(make_request(chain, 99), make_response(alt_chain, 70, 110));
+  ASSERT_FALSE(cache.get(make_request(chain, 90), rsp));
+  ASSERT_TRUE(cache.get(make_request(chain, 60), rsp));
+  ASSERT_EQ(rsp.blocks.size(), 50);
+  ASSERT_EQ(rsp.blocks.back().block_ptr, alt_chain[109]);
+  ASSERT_EQ(rsp.blocks.front().block_ptr, chain[60]);
+  ASSERT_TRUE(cache.get(make_request(alt_chain, 90), rsp));
+  ASSERT_EQ(rsp.start_height, 90);
+
+  // a wallet far behind doesn't push the top out
+  cache.put(make_request(chain, 0), make_response(chain, 0, 5));
+  ASSERT_TRUE(cache.get(make_request(chain, 60), rsp));
+  ASSERT_FALSE(cache.get(make_request(chain, 1), rsp));
+
+  cache.clear();
+  ASSERT_FALSE(cache.get(make_request(chain, 60), rsp));
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include "include_base_utils.h"
+#include "common/request_coalescer.h"
+
+TEST(request_coalescer, identical_requests_share_one_call)
+{
+  tools::request_coalescer<uint64_t, std::string> coalescer;
+  std::atomic<size_t> calls(0);
+  std::atomic<bool> release(false);
+
+  std::vector<std::string> results(8);
+  std::vector<bool> rs(8, false);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i != results.size(); ++i)
+  {
+    threads.emplace_back([&, i]()
+    {
+      bool r = coalescer.call(1, results[i], [&](std::string& rsp)
+      {
+        ++calls;
+        while (!release)
+          std::this_thread::yield();
+        rsp = "response";
+        return true;
+      });
+      rs[i] = r;
+    });
+  }
+  // let the others join the one in flight
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  release = true;
+  for (auto& t : threads)
+    t.join();
+
+  ASSERT_LT(calls.load(), results.size());
+  for (size_t i = 0; i != results.size(); ++i)
+  {
+    ASSERT_TRUE(rs[i]);
+    ASSERT_EQ(results[i], "response");
+  }
+
+  // once it's done, the next one is sent again, and a failed one is shared without a response
+  std::string rsp;
+  ASSERT_FALSE(coalescer.call(1, rsp, [&](std::string& r) { ++calls; return false; }));
+  ASSERT_TRUE(coalescer.call(2, rsp, [&](std::string& r) { r = "other"; return true; }));
+  ASSERT_EQ(rsp, "other");
+}
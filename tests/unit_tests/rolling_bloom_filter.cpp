@@ -0,0 +1,53 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+#include "common/rolling_bloom_filter.h"
+
+namespace
+{
+  crypto::hash make_id(uint64_t n)
+  {
+    return crypto::cn_fast_hash(&n, sizeof(n));
+  }
+}
+
+TEST(rolling_bloom_filter, insert_roll_false_positives)
+{
+  const size_t capacity = 1000;
+  tools::rolling_bloom_filter<crypto::hash> f(capacity, 0x1234);
+
+  for (uint64_t i = 0; i != capacity; ++i)
+    f.insert(make_id(i));
+  for (uint64_t i = 0; i != capacity; ++i)
+    ASSERT_TRUE(f.contains(make_id(i)));
+
+  size_t false_positives = 0;
+  for (uint64_t i = 1000000; i != 1000000 + 10 * capacity; ++i)
+    false_positives += f.contains(make_id(i)) ? 1 : 0;
+  ASSERT_LT(false_positives, capacity / 2); // ~2% (both generations), 5% at most
+
+  // the second generation keeps the first one
+  for (uint64_t i = capacity; i != 2 * capacity; ++i)
+    f.insert(make_id(i));
+  for (uint64_t i = 0; i != 2 * capacity; ++i)
+    ASSERT_TRUE(f.contains(make_id(i)));
+
+  // two more rolls: the third generation becomes previous, the first two are dropped
+  for (uint64_t i = 2 * capacity; i != 3 * capacity + 1; ++i)
+    f.insert(make_id(i));
+  size_t old_ones_remembered = 0;
+  for (uint64_t i = 0; i != 2 * capacity; ++i)
+    old_ones_remembered += f.contains(make_id(i)) ? 1 : 0;
+  ASSERT_LT(old_ones_remembered, capacity / 10);
+  for (uint64_t i = 2 * capacity; i != 3 * capacity + 1; ++i)
+    ASSERT_TRUE(f.contains(make_id(i)));
+
+  f.clear();
+  ASSERT_FALSE(f.contains(make_id(3 * capacity)));
+}
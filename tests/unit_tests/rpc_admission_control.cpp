@@ -0,0 +1,128 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include "rpc/rpc_admission_control.h"
+
+using currency::rpc_admission_control;
+
+TEST(rpc_admission_control, method_limits_and_reserved_threads)
+{
+  std::map<std::string, size_t> limits;
+  ASSERT_TRUE(rpc_admission_control::parse_method_limits(" get_blocks_details:1, /getblocks.bin:2,", limits));
+  ASSERT_EQ(limits.size(), 2);
+  ASSERT_EQ(limits["get_blocks_details"], 1);
+  ASSERT_EQ(limits["/getblocks.bin"], 2);
+  ASSERT_FALSE(rpc_admission_control::parse_method_limits("search_by_id", limits));
+  ASSERT_FALSE(rpc_admission_control::parse_method_limits("search_by_id:x", limits));
+
+  rpc_admission_control ac;
+  rpc_admission_control::config cfg;
+  cfg.threads_count = 3;
+  cfg.reserved_threads = 1;
+  cfg.method_limits = limits;
+  ac.set_config(cfg);
+
+  ASSERT_EQ(ac.enter("get_blocks_details", 1, 0), rpc_admission_control::admitted);
+  ASSERT_EQ(ac.enter("get_blocks_details", 1, 0), rpc_admission_control::busy);
+  ASSERT_EQ(ac.enter("getinfo", 1, 0), rpc_admission_control::admitted);
+  // the last thread is for the critical calls only
+  ASSERT_EQ(ac.enter("getinfo", 1, 0), rpc_admission_control::busy);
+  ASSERT_EQ(ac.enter("/sendrawtransaction", 1, 0), rpc_admission_control::admitted);
+  ASSERT_EQ(ac.enter("submitblock", 1, 0), rpc_admission_control::admitted);
+
+  ac.leave("get_blocks_details");
+  ASSERT_EQ(ac.enter("get_blocks_details", 1, 0), rpc_admission_control::admitted);
+
+  rpc_admission_control::stat st = AUTO_VAL_INIT(st);
+  ac.get_stat(st);
+  ASSERT_EQ(st.admitted, 5);
+  ASSERT_EQ(st.rejected_busy, 2);
+  ASSERT_EQ(st.running, 4);
+  ASSERT_EQ(st.waiting, 0);
+}
+
+TEST(rpc_admission_control, waiting_for_a_slot)
+{
+  rpc_admission_control ac;
+  rpc_admission_control::config cfg;
+  cfg.threads_count = 4;
+  cfg.heavy_calls_max = 1;
+  cfg.max_queue_ms = 10000;
+  ac.set_config(cfg);
+
+  ASSERT_EQ(ac.enter("search_by_id", 1, 0), rpc_admission_control::admitted);
+  std::thread t([&]() { std::this_thread::sleep_for(std::chrono::milliseconds(50)); ac.leave("search_by_id"); });
+  // another heavy one waits for the first to finish
+  ASSERT_EQ(ac.enter("/getblocks.bin", 2, 0), rpc_admission_control::admitted);
+  t.join();
+  ac.leave("/getblocks.bin");
+
+  cfg.max_queue_ms = 10;
+  ac.set_config(cfg);
+  ASSERT_EQ(ac.enter("search_by_id", 1, 0), rpc_admission_control::admitted);
+  ASSERT_EQ(ac.enter("search_by_id", 1, 0), rpc_admission_control::busy);
+}
+
+TEST(rpc_admission_control, ip_rate)
+{
+  rpc_admission_control ac;
+  rpc_admission_control::config cfg;
+  cfg.threads_count = 100;
+  cfg.ip_rate = 2;
+  cfg.ip_burst = 3;
+  ac.set_config(cfg);
+
+  for (size_t i = 0; i != 3; ++i)
+  {
+    ASSERT_EQ(ac.enter("getinfo", 1, 1000), rpc_admission_control::admitted);
+    ac.leave("getinfo");
+  }
+  ASSERT_EQ(ac.enter("getinfo", 1, 1000), rpc_admission_control::rate_limited);
+  ASSERT_EQ(ac.enter("/sendrawtransaction", 1, 1000), rpc_admission_control::rate_limited);
+  // other ips have their own buckets
+  ASSERT_EQ(ac.enter("getinfo", 2, 1000), rpc_admission_control::admitted);
+  ac.leave("getinfo");
+
+  // 2 requests per second
+  ASSERT_EQ(ac.enter("getinfo", 1, 1499), rpc_admission_control::rate_limited);
+  ASSERT_EQ(ac.enter("getinfo", 1, 1500), rpc_admission_control::admitted);
+  ac.leave("getinfo");
+  ASSERT_EQ(ac.enter("getinfo", 1, 1500), rpc_admission_control::rate_limited);
+}
+
+TEST(rpc_admission_control, calls_latency)
+{
+  rpc_admission_control ac;
+  const std::vector<uint64_t>& bounds = rpc_admission_control::get_latency_buckets_us();
+  ASSERT_FALSE(bounds.empty());
+
+  ac.add_call_latency("getinfo", 10);
+  ac.add_call_latency("getinfo", bounds.front());
+  ac.add_call_latency("getinfo", bounds.front() + 1);
+  ac.add_call_latency("getinfo", bounds.back() * 2);
+
+  std::map<std::string, rpc_admission_control::call_latency_stat> latency;
+  ac.get_calls_latency(latency);
+  ASSERT_EQ(latency.size(), 1);
+  const rpc_admission_control::call_latency_stat& st = latency["getinfo"];
+  ASSERT_EQ(st.count, 4);
+  ASSERT_EQ(st.sum_us, 10 + bounds.front() + bounds.front() + 1 + bounds.back() * 2);
+  ASSERT_EQ(st.buckets.size(), bounds.size());
+  ASSERT_EQ(st.buckets[0], 2);
+  ASSERT_EQ(st.buckets[1], 1);
+  uint64_t in_buckets = 0;
+  for (uint64_t b : st.buckets)
+    in_buckets += b;
+  ASSERT_EQ(in_buckets, 3); // the slowest one is in +Inf only
+
+  // admitted calls get measured between enter() and leave()
+  epee::net_utils::connection_context_base context;
+  ASSERT_EQ(ac.enter("search_by_id", context), rpc_admission_control::admitted);
+  ac.leave("search_by_id");
+  ac.get_calls_latency(latency);
+  ASSERT_EQ(latency["search_by_id"].count, 1);
+}
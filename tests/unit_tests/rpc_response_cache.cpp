@@ -0,0 +1,133 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "rpc/rpc_response_cache.h"
+
+namespace
+{
+  crypto::hash make_hash(uint8_t b)
+  {
+    crypto::hash h = currency::null_hash;
+    reinterpret_cast<uint8_t*>(&h)[0] = b;
+    return h;
+  }
+}
+
+TEST(rpc_response_cache, lru_and_size_limit)
+{
+  crypto::hash top = make_hash(1);
+  currency::rpc_response_cache cache([&]() { return top; }, 100);
+  currency::COMMAND_RPC_GET_BLOCK_DETAILS::response res = AUTO_VAL_INIT(res);
+  std::string json;
+  uint64_t gen = 0;
+
+  // entries of 2 * 2 + 16 bytes
+  for (char k : std::string("abcde"))
+  {
+    ASSERT_FALSE(cache.get(std::string(2, k), json, gen));
+    cache.put(std::string(2, k), gen, res, std::string(16, k));
+  }
+  currency::rpc_response_cache::stat st = AUTO_VAL_INIT(st);
+  cache.get_stat(st);
+  ASSERT_EQ(st.entries_count, 5);
+  ASSERT_EQ(st.bytes, 100);
+
+  // "aa" is used, "bb" is the least recently used one and goes
+  ASSERT_TRUE(cache.get("aa", json, gen));
+  ASSERT_EQ(json, std::string(16, 'a'));
+  ASSERT_FALSE(cache.get("ff", json, gen));
+  cache.put("ff", gen, res, std::string(16, 'f'));
+  ASSERT_FALSE(cache.get("bb", json, gen));
+  ASSERT_TRUE(cache.get("aa", json, gen));
+  ASSERT_TRUE(cache.get("ff", json, gen));
+
+  // too big for it
+  cache.put("gg", gen, res, std::string(100, 'g'));
+  ASSERT_FALSE(cache.get("gg", json, gen));
+
+  cache.get_stat(st);
+  ASSERT_EQ(st.hits, 3);
+  ASSERT_EQ(st.misses, 8);
+  ASSERT_LE(st.bytes, 100);
+
+  cache.set_max_bytes(40);
+  cache.get_stat(st);
+  ASSERT_EQ(st.entries_count, 2);
+  ASSERT_TRUE(cache.get("ff", json, gen));
+
+  cache.set_max_bytes(0);
+  ASSERT_FALSE(cache.get("ff", json, gen));
+}
+
+TEST(rpc_response_cache, top_block_change)
+{
+  crypto::hash top = make_hash(1);
+  currency::rpc_response_cache cache([&]() { return top; }, 1000);
+  currency::COMMAND_RPC_GET_BLOCK_DETAILS::response res = AUTO_VAL_INIT(res);
+  std::string json;
+  uint64_t gen = 0, gen_before = 0;
+
+  ASSERT_FALSE(cache.get("a", json, gen));
+  cache.put("a", gen, res, "1");
+  ASSERT_TRUE(cache.get("a", json, gen));
+
+  // a new top block drops everything, a result made before it is not taken
+  ASSERT_FALSE(cache.get("b", json, gen_before));
+  top = make_hash(2);
+  ASSERT_FALSE(cache.get("a", json, gen));
+  cache.put("b", gen_before, res, "2");
+  ASSERT_FALSE(cache.get("b", json, gen));
+  cache.put("b", gen, res, "3");
+  ASSERT_TRUE(cache.get("b", json, gen));
+  ASSERT_EQ(json, "3");
+
+  // back to the former top (a reorganization), nothing of the former state is there
+  top = make_hash(1);
+  ASSERT_FALSE(cache.get("b", json, gen));
+}
+
+TEST(rpc_response_cache, pool_txs_are_not_kept)
+{
+  currency::rpc_response_cache cache([]() { return currency::null_hash; }, 1000);
+  currency::COMMAND_RPC_GET_TX_DETAILS::response res = AUTO_VAL_INIT(res);
+  std::string json;
+  uint64_t gen = 0;
+
+  ASSERT_FALSE(cache.get("pool", json, gen));
+  res.tx_info.keeper_block = -1;
+  cache.put("pool", gen, res, "1");
+  ASSERT_FALSE(cache.get("pool", json, gen));
+
+  ASSERT_FALSE(cache.get("chain", json, gen));
+  res.tx_info.keeper_block = 10;
+  cache.put("chain", gen, res, "1");
+  ASSERT_TRUE(cache.get("chain", json, gen));
+}
+
+TEST(rpc_response_cache, versioned)
+{
+  uint64_t version = 1;
+  currency::rpc_versioned_response_cache cache([&]() { return version; });
+  currency::COMMAND_RPC_GET_ALL_ALIASES::response res = AUTO_VAL_INIT(res);
+  std::string json;
+  uint64_t gen = 0, gen_before = 0;
+
+  ASSERT_FALSE(cache.get("all", json, gen));
+  cache.put("all", gen, res, "1");
+  ASSERT_TRUE(cache.get("all", json, gen));
+  ASSERT_EQ(json, "1");
+  ASSERT_FALSE(cache.get("other", json, gen));
+
+  // the state has changed while the result was being made
+  ASSERT_FALSE(cache.get("other", json, gen_before));
+  version = 2;
+  cache.put("other", gen_before, res, "2");
+  ASSERT_FALSE(cache.get("other", json, gen));
+  ASSERT_FALSE(cache.get("all", json, gen));
+  cache.put("all", gen, res, "3");
+  ASSERT_TRUE(cache.get("all", json, gen));
+  ASSERT_EQ(json, "3");
+}
@@ -901,4 +901,93 @@ TEST(Serialization, versioning2)
   r = perform_test_ser_vers<A_v3>(a_3);
   ASSERT_TRUE(r);
 
-}
\ No newline at end of file
+}
+namespace
+{
+  template<class t_object>
+  bool parse_with_stream_archive(t_object& to, const std::string& blob)
+  {
+    istringstream iss(blob);
+    binary_archive<false> iar(iss);
+    return ::serialization::serialize(iar, to);
+  }
+
+  template<class t_object>
+  std::string store_with_stream_archive(const t_object& to)
+  {
+    ostringstream oss;
+    binary_archive<true> oar(oss);
+    if (!::serialization::serialize(oar, const_cast<t_object&>(to)))
+      return std::string();
+    return oss.str();
+  }
+}
+
+TEST(Serialization, memory_ostream_archive_matches_stream_archive)
+{
+  currency::block b = AUTO_VAL_INIT(b);
+  ASSERT_TRUE(currency::generate_genesis_block(b));
+  b.tx_hashes.push_back(crypto::cn_fast_hash("tx", 2));
+
+  const std::string expected = store_with_stream_archive(b);
+  ASSERT_FALSE(expected.empty());
+
+  // the buffer is overwritten, not appended to, and keeps its capacity
+  std::string buff(3 * expected.size(), 'x');
+  const size_t capacity = buff.capacity();
+  ASSERT_TRUE(t_serializable_object_to_blob(b, buff));
+  ASSERT_EQ(expected, buff);
+  ASSERT_EQ(capacity, buff.capacity());
+  ASSERT_TRUE(t_serializable_object_to_blob(b, buff));
+  ASSERT_EQ(expected, buff);
+
+  uint64_t x = 0xff00000000;
+  std::string ints;
+  binary_memory_ostream os(ints);
+  binary_memory_archive<true> oar(os);
+  oar.serialize_int(x);
+  oar.serialize_varint(x);
+  ASSERT_TRUE(os.good());
+  ASSERT_EQ(string("\0\0\0\0\xff\0\0\0" "\x80\x80\x80\x80\xF0\x1F", 14), ints);
+
+  // the hashing helpers serialize into the per-thread scratch buffer
+  const std::string prefix_blob = store_with_stream_archive(static_cast<const currency::transaction_prefix&>(b.miner_tx));
+  ASSERT_EQ(crypto::cn_fast_hash(prefix_blob.data(), prefix_blob.size()), currency::get_transaction_prefix_hash(b.miner_tx));
+  ASSERT_EQ(prefix_blob.size(), currency::get_object_blobsize(b.miner_tx)); // a coinbase is measured by its prefix
+}
+
+TEST(Serialization, memory_archive_matches_stream_archive)
+{
+  currency::block b = AUTO_VAL_INIT(b);
+  ASSERT_TRUE(currency::generate_genesis_block(b));
+  for (size_t i = 0; i != 5; ++i)
+    b.tx_hashes.push_back(crypto::cn_fast_hash(&i, sizeof i));
+  const std::string blob = t_serializable_object_to_blob(b);
+
+  // every truncation and a few corruptions of every byte must be either rejected by both or give the same object
+  const uint8_t corruption_masks[] = { 0x01, 0x80, 0xff };
+  for (size_t pos = 0; pos <= blob.size(); ++pos)
+  {
+    for (size_t k = 0; k <= sizeof corruption_masks && (k == 0 || pos < blob.size()); ++k)
+    {
+      std::string mutated = blob.substr(0, pos);
+      if (k != 0)
+      {
+        mutated = blob;
+        mutated[pos] ^= corruption_masks[k - 1];
+      }
+
+      currency::block b_stream = AUTO_VAL_INIT(b_stream), b_memory = AUTO_VAL_INIT(b_memory);
+      bool r_stream = parse_with_stream_archive(b_stream, mutated);
+      bool r_memory = t_unserializable_object_from_blob(b_memory, mutated);
+      ASSERT_EQ(r_stream, r_memory) << "pos " << pos << ", k " << k;
+      if (r_memory)
+        ASSERT_EQ(t_serializable_object_to_blob(b_stream), t_serializable_object_to_blob(b_memory));
+    }
+  }
+
+  currency::block b_loaded = AUTO_VAL_INIT(b_loaded);
+  ASSERT_TRUE(t_unserializable_object_from_blob(b_loaded, blob));
+  ASSERT_EQ(b.tx_hashes, b_loaded.tx_hashes);
+  ASSERT_EQ(currency::get_block_hash(b), currency::get_block_hash(b_loaded));
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <deque>
+#include <random>
+#include "include_base_utils.h"
+#include "misc_language.h"
+#include "common/sliding_window_median.h"
+
+TEST(sliding_window_median, matches_sorting_median)
+{
+  // a window moving back and forth over a sequence with many equal values, as block sizes and timestamps are
+  std::mt19937_64 rng(1);
+  std::vector<uint64_t> seq(2000);
+  for (auto& v : seq)
+    v = rng() % 50;
+
+  const size_t window_len = 61;
+  tools::sliding_window_median<uint64_t> swm;
+  std::deque<uint64_t> expected;
+  size_t top = 0; // seq[top - expected.size(), top) are in the window
+  for (size_t step = 0; step != 10000; ++step)
+  {
+    bool push = top == 0 || (top < seq.size() && rng() % 3 != 0);
+    if (push)
+    {
+      swm.push_back(seq[top]);
+      expected.push_back(seq[top]);
+      ++top;
+      if (expected.size() > window_len)
+      {
+        swm.pop_front();
+        expected.pop_front();
+      }
+    }
+    else
+    {
+      swm.pop_back();
+      expected.pop_back();
+      --top;
+      if (top >= window_len)
+      {
+        swm.push_front(seq[top - window_len]);
+        expected.push_front(seq[top - window_len]);
+      }
+    }
+
+    std::vector<uint64_t> v(expected.begin(), expected.end());
+    uint64_t sum = 0;
+    for (uint64_t x : v)
+      sum += x;
+    ASSERT_EQ(swm.size(), v.size());
+    ASSERT_EQ(swm.get_avg(), v.empty() ? 0 : sum / v.size());
+    ASSERT_EQ(swm.get_median(), epee::misc_utils::median(v));
+  }
+}
+
+TEST(sliding_window_median, small_windows)
+{
+  tools::sliding_window_median<uint64_t> swm;
+  ASSERT_EQ(swm.get_median(), 0);
+  ASSERT_EQ(swm.get_avg(), 0);
+  swm.pop_back(); // no-op on empty
+  swm.push_back(10);
+  ASSERT_EQ(swm.get_median(), 10);
+  swm.push_back(20);
+  ASSERT_EQ(swm.get_median(), 15);
+  swm.push_front(1);
+  ASSERT_EQ(swm.get_median(), 10);
+  swm.pop_front();
+  swm.pop_front();
+  ASSERT_EQ(swm.get_median(), 20);
+  swm.clear();
+  ASSERT_TRUE(swm.empty());
+  ASSERT_EQ(swm.get_median(), 0);
+}
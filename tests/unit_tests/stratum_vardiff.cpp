@@ -0,0 +1,60 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "stratum/stratum_vardiff.h"
+
+using stratum::vardiff_controller;
+using stratum::vdiff_params_t;
+
+TEST(stratum_vardiff, converges_to_target_share_period)
+{
+  // min 1000, max 10^12, a share per 10 s, retarget after 4 shares or 60 s, 25% variance
+  vdiff_params_t params(1000, 1000000000000ull, 10, 60, 4, 25);
+  vardiff_controller vd;
+  uint64_t now = 1000000;
+  vd.init(params, now);
+  ASSERT_EQ(vd.get_difficulty(), 1000);
+  ASSERT_FALSE(vd.retarget(now));
+
+  // a 1 Mh/s worker shares every 1 ms at difficulty 1000, so the difficulty goes up 4x per retarget till it's on target
+  const uint64_t hashrate = 1000000;
+  for (size_t i = 0; i != 100; ++i)
+  {
+    uint64_t share_period_ms = (vd.get_difficulty() * 1000 / hashrate).convert_to<uint64_t>();
+    now += std::max<uint64_t>(share_period_ms, 1);
+    vd.on_share(vd.get_difficulty(), now);
+    vd.retarget(now);
+  }
+  ASSERT_GE(vd.get_difficulty(), 10000000 * 3 / 4);
+  ASSERT_LE(vd.get_difficulty(), 10000000 * 5 / 4);
+  ASSERT_NEAR(static_cast<double>(vd.get_hashrate(now)), static_cast<double>(hashrate), hashrate * 0.05);
+}
+
+TEST(stratum_vardiff, long_gap_lowers_difficulty)
+{
+  vdiff_params_t params(1000, 1000000000000ull, 10, 60, 4, 25);
+  vardiff_controller vd;
+  uint64_t now = 1000000;
+  vd.init(params, now);
+  vd.set_difficulty(1000000, now);
+
+  // no shares at all: nothing happens before retarget_time, then it goes down by at most 4x at once
+  ASSERT_FALSE(vd.retarget(now + 30000));
+  ASSERT_TRUE(vd.retarget(now + 61000));
+  ASSERT_EQ(vd.get_difficulty(), 250000);
+
+  // the estimate takes the open gap into account
+  now += 61000;
+  ASSERT_LE(vd.get_hashrate(now + 100000), 250000 / 100);
+
+  // never below the minimum
+  for (size_t i = 0; i != 10; ++i)
+  {
+    now += 61000;
+    vd.retarget(now);
+  }
+  ASSERT_EQ(vd.get_difficulty(), 1000);
+}
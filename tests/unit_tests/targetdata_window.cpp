@@ -0,0 +1,111 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "currency_core/currency_format_utils.h"
+#include "currency_core/blockchain_storage_basic.h"
+
+using currency::targetdata_window;
+
+namespace
+{
+  crypto::hash id_for_height(uint64_t h)
+  {
+    crypto::hash id = currency::null_hash;
+    *reinterpret_cast<uint64_t*>(&id) = h + 1;
+    return id;
+  }
+
+  targetdata_window::entry make_entry(uint64_t h)
+  {
+    targetdata_window::entry e = AUTO_VAL_INIT(e);
+    e.height = h;
+    e.timestamp = 1000 + h;
+    e.cumulative_diff_precise = currency::wide_difficulty_type(h) << 70;
+    return e;
+  }
+
+  bool is_pos_height(uint64_t h)
+  {
+    return h % 3 == 0;
+  }
+}
+
+TEST(targetdata_window, push_pop_collect)
+{
+  const size_t capacity = 10;
+  targetdata_window w(capacity);
+  ASSERT_FALSE(w.is_valid_for(id_for_height(0)));
+
+  w.reset(id_for_height(0), 0, std::vector<targetdata_window::entry>(), true);
+  ASSERT_TRUE(w.is_valid_for(id_for_height(0)));
+
+  // PoW window, PoS blocks are every third one
+  for (uint64_t h = 1; h != 40; ++h)
+    w.push_block(id_for_height(h), id_for_height(h - 1), !is_pos_height(h), make_entry(h));
+  ASSERT_TRUE(w.is_valid_for(id_for_height(39)));
+  ASSERT_EQ(w.size(), capacity);
+
+  std::vector<uint64_t> timestamps;
+  std::vector<currency::wide_difficulty_type> cumul_diffs;
+  ASSERT_TRUE(w.collect(40, 5, timestamps, cumul_diffs));
+  ASSERT_EQ(timestamps, std::vector<uint64_t>({ 1038, 1037, 1035, 1034, 1032 }));
+  ASSERT_EQ(cumul_diffs[0], currency::wide_difficulty_type(38) << 70);
+
+  // below a split point
+  timestamps.clear();
+  cumul_diffs.clear();
+  ASSERT_TRUE(w.collect(34, 3, timestamps, cumul_diffs));
+  ASSERT_EQ(timestamps, std::vector<uint64_t>({ 1032, 1031, 1029 }));
+
+  // older entries were dropped, can't serve that many
+  timestamps.clear();
+  cumul_diffs.clear();
+  ASSERT_FALSE(w.collect(34, capacity, timestamps, cumul_diffs));
+
+  // pop a few blocks and push another branch
+  for (uint64_t h = 39; h != 35; --h)
+    w.pop_block(id_for_height(h - 1), h, !is_pos_height(h));
+  ASSERT_TRUE(w.is_valid_for(id_for_height(35)));
+  crypto::hash alt_id = id_for_height(1000);
+  w.push_block(alt_id, id_for_height(35), true, make_entry(36));
+  ASSERT_TRUE(w.is_valid_for(alt_id));
+  timestamps.clear();
+  cumul_diffs.clear();
+  ASSERT_TRUE(w.collect(37, 2, timestamps, cumul_diffs));
+  ASSERT_EQ(timestamps, std::vector<uint64_t>({ 1036, 1035 }));
+
+  // a block which doesn't connect to the top invalidates the window
+  w.push_block(id_for_height(38), id_for_height(37), true, make_entry(38));
+  ASSERT_FALSE(w.is_valid_for(id_for_height(38)));
+  ASSERT_FALSE(w.is_valid_for(alt_id));
+}
+
+TEST(targetdata_window, short_chain)
+{
+  targetdata_window w(10);
+  std::vector<targetdata_window::entry> entries;
+  entries.push_back(make_entry(1));
+  entries.push_back(make_entry(2));
+  w.reset(id_for_height(2), 2, entries, true);
+
+  // all the blocks are in the window, so fewer entries is fine
+  std::vector<uint64_t> timestamps;
+  std::vector<currency::wide_difficulty_type> cumul_diffs;
+  ASSERT_TRUE(w.collect(3, 10, timestamps, cumul_diffs));
+  ASSERT_EQ(timestamps, std::vector<uint64_t>({ 1002, 1001 }));
+
+  w.pop_block(id_for_height(1), 2, true);
+  w.pop_block(id_for_height(0), 1, true);
+  ASSERT_TRUE(w.is_valid_for(id_for_height(0)));
+  ASSERT_EQ(w.size(), 0);
+
+  // block 2 is not of this kind, so nothing should be popped for it
+  entries.pop_back();
+  w.reset(id_for_height(2), 2, entries, true);
+  w.pop_block(id_for_height(1), 2, true);
+  ASSERT_FALSE(w.is_valid_for(id_for_height(1)));
+}
@@ -125,3 +125,178 @@ void force_random(forced_to_pod_t& o)
 //   }
 // 
 // }
+
+TEST(view_tags, construct_and_lookup)
+{
+  currency::account_base alice, bob;
+  alice.generate();
+  bob.generate();
+
+  currency::transaction tx = AUTO_VAL_INIT(tx);
+  tx.version = TRANSACTION_VERSION_POST_HF4;
+  currency::keypair tx_key = currency::keypair::generate();
+  currency::add_tx_pub_key_to_extra(tx, tx_key.pub);
+  tx.extra.push_back(currency::extra_view_tags());
+
+  std::set<uint16_t> deriv_cache;
+  for (size_t i = 0; i != 4; ++i)
+  {
+    currency::tx_destination_entry de(1000 + i, i % 2 ? bob.get_public_address() : alice.get_public_address());
+    ASSERT_TRUE(currency::construct_tx_out(de, tx_key.sec, i, tx, deriv_cache, currency::account_keys()));
+  }
+  const currency::extra_view_tags* pvt = currency::get_type_in_variant_container<const currency::extra_view_tags>(tx.extra);
+  ASSERT_TRUE(pvt != nullptr);
+  ASSERT_EQ(pvt->tags.size(), tx.vout.size());
+
+  std::vector<currency::wallet_out_info> outs;
+  crypto::key_derivation derivation = AUTO_VAL_INIT(derivation);
+  ASSERT_TRUE(currency::lookup_acc_outs(bob.get_keys(), tx, outs, derivation));
+  ASSERT_EQ(outs.size(), 2);
+  ASSERT_EQ(outs[0].index, 1);
+  ASSERT_EQ(outs[1].index, 3);
+  ASSERT_EQ(pvt->tags[1], currency::get_output_view_tag(derivation, 1));
+
+  // an output with a wrong tag is skipped without being checked
+  boost::get<currency::extra_view_tags>(tx.extra.back()).tags[3] ^= 1;
+  outs.clear();
+  ASSERT_TRUE(currency::lookup_acc_outs(bob.get_keys(), tx, outs, derivation));
+  ASSERT_EQ(outs.size(), 1);
+
+  // tags that don't cover all the outputs are ignored
+  boost::get<currency::extra_view_tags>(tx.extra.back()).tags.pop_back();
+  outs.clear();
+  ASSERT_TRUE(currency::lookup_acc_outs(bob.get_keys(), tx, outs, derivation));
+  ASSERT_EQ(outs.size(), 2);
+}
+
+TEST(deposit_addresses, construct_and_lookup)
+{
+  currency::account_base alice, bob;
+  alice.generate();
+  bob.generate();
+
+  currency::deposit_spend_keys_map deposit_spend_keys;
+  for (uint32_t i = 1; i != 100; ++i)
+    deposit_spend_keys[currency::get_deposit_address(alice.get_keys(), i).spend_public_key] = i;
+  ASSERT_EQ(deposit_spend_keys.size(), 99);
+  ASSERT_EQ(currency::get_deposit_address(alice.get_keys(), 0), alice.get_public_address());
+  ASSERT_EQ(currency::get_deposit_address(alice.get_keys(), 7).view_public_key, alice.get_public_address().view_public_key);
+
+  // the spend keys of a deposit address match each other
+  currency::account_keys deposit_keys = currency::get_deposit_account_keys(alice.get_keys(), 7);
+  crypto::public_key spend_pub_key = currency::null_pkey;
+  ASSERT_TRUE(crypto::secret_key_to_public_key(deposit_keys.spend_secret_key, spend_pub_key));
+  ASSERT_EQ(spend_pub_key, deposit_keys.account_address.spend_public_key);
+
+  for (uint64_t tx_version : { TRANSACTION_VERSION_PRE_HF4, TRANSACTION_VERSION_POST_HF4 })
+  {
+    currency::transaction tx = AUTO_VAL_INIT(tx);
+    tx.version = tx_version;
+    currency::keypair tx_key = currency::keypair::generate();
+    currency::add_tx_pub_key_to_extra(tx, tx_key.pub);
+
+    std::set<uint16_t> deriv_cache;
+    const std::vector<currency::account_public_address> destinations = { currency::get_deposit_address(alice.get_keys(), 7), bob.get_public_address(),
+      alice.get_public_address(), currency::get_deposit_address(alice.get_keys(), 99), currency::get_deposit_address(alice.get_keys(), 100) };
+    for (size_t i = 0; i != destinations.size(); ++i)
+    {
+      currency::tx_destination_entry de(1000 + i, destinations[i]);
+      ASSERT_TRUE(currency::construct_tx_out(de, tx_key.sec, i, tx, deriv_cache, currency::account_keys()));
+    }
+
+    // without the map only the account's own address is seen
+    std::vector<currency::wallet_out_info> outs;
+    crypto::key_derivation derivation = AUTO_VAL_INIT(derivation);
+    std::list<currency::htlc_info> htlc_info_list;
+    ASSERT_TRUE(currency::lookup_acc_outs(alice.get_keys(), tx, tx_key.pub, outs, derivation, htlc_info_list));
+    ASSERT_EQ(outs.size(), 1);
+    ASSERT_EQ(outs[0].index, 2);
+
+    // #100 was not created
+    outs.clear();
+    ASSERT_TRUE(currency::lookup_acc_outs(alice.get_keys(), tx, tx_key.pub, outs, derivation, htlc_info_list, &deposit_spend_keys));
+    ASSERT_EQ(outs.size(), 3);
+    ASSERT_EQ(outs[0].index, 0);
+    ASSERT_EQ(outs[0].deposit_index, 7);
+    ASSERT_EQ(outs[0].amount, 1000);
+    ASSERT_EQ(outs[1].index, 2);
+    ASSERT_EQ(outs[1].deposit_index, 0);
+    ASSERT_EQ(outs[2].index, 3);
+    ASSERT_EQ(outs[2].deposit_index, 99);
+    ASSERT_EQ(outs[2].amount, 1003);
+
+    // the output of the deposit address is spent with its keys
+    currency::keypair in_ephemeral = AUTO_VAL_INIT(in_ephemeral);
+    crypto::key_image ki = AUTO_VAL_INIT(ki);
+    ASSERT_TRUE(currency::generate_key_image_helper(currency::get_deposit_account_keys(alice.get_keys(), 99), tx_key.pub, 3, in_ephemeral, ki));
+    if (tx_version == TRANSACTION_VERSION_PRE_HF4)
+      ASSERT_EQ(in_ephemeral.pub, boost::get<currency::txout_to_key>(boost::get<currency::tx_out_bare>(tx.vout[3]).target).key);
+    else
+      ASSERT_EQ(in_ephemeral.pub, boost::get<currency::tx_out_zarcanum>(tx.vout[3]).stealth_address);
+
+    outs.clear();
+    ASSERT_TRUE(currency::lookup_acc_outs(bob.get_keys(), tx, tx_key.pub, outs, derivation, htlc_info_list, &deposit_spend_keys));
+    ASSERT_EQ(outs.size(), 1);
+    ASSERT_EQ(outs[0].index, 1);
+  }
+}
+
+TEST(construct_tx, zc_outs_and_proofs_in_parallel)
+{
+  crypto::random_prng_initialize_with_seed(0);
+  currency::account_base sender, alice;
+  sender.generate();
+  alice.generate();
+
+  // two ZC sources, made right here, that's all construct_tx() looks at
+  std::vector<currency::tx_source_entry> sources;
+  for (size_t i = 0; i != 2; ++i)
+  {
+    currency::transaction src_tx = AUTO_VAL_INIT(src_tx);
+    src_tx.version = TRANSACTION_VERSION_POST_HF4;
+    currency::keypair tx_key = currency::keypair::generate();
+    currency::add_tx_pub_key_to_extra(src_tx, tx_key.pub);
+    std::set<uint16_t> deriv_cache;
+    currency::finalized_tx ftx = AUTO_VAL_INIT(ftx);
+    crypto::scalar_t asset_blinding_mask, amount_blinding_mask;
+    crypto::point_t blinded_asset_id, amount_commitment;
+    currency::tx_destination_entry de(TESTS_DEFAULT_FEE * 10, sender.get_public_address());
+    ASSERT_TRUE(currency::construct_tx_out(de, tx_key.sec, 0, src_tx, deriv_cache, currency::account_keys(), asset_blinding_mask, amount_blinding_mask, blinded_asset_id, amount_commitment, ftx));
+
+    const currency::tx_out_zarcanum& out = boost::get<currency::tx_out_zarcanum>(src_tx.vout[0]);
+    currency::tx_source_entry se = AUTO_VAL_INIT(se);
+    se.outputs.emplace_back(currency::txout_ref_v(uint64_t(i)), out.stealth_address, out.concealing_point, out.amount_commitment, out.blinded_asset_id);
+    se.real_out_tx_key = tx_key.pub;
+    se.real_out_amount_blinding_mask = amount_blinding_mask;
+    se.real_out_asset_id_blinding_mask = asset_blinding_mask;
+    se.amount = de.amount;
+    sources.push_back(se);
+  }
+
+  std::vector<currency::tx_destination_entry> destinations;
+  for (size_t i = 0; i != CURRENCY_TX_MIN_OUTPUTS_FOR_PARALLEL_CONSTRUCTION; ++i)
+    destinations.emplace_back(1000 + i, alice.get_public_address());
+
+  // the outputs and the proofs don't depend on how they were scheduled
+  currency::transaction tx, tx2;
+  crypto::secret_key one_time_key{};
+  crypto::random_prng_initialize_with_seed(1);
+  ASSERT_TRUE(currency::construct_tx(sender.get_keys(), sources, destinations, std::vector<currency::extra_v>(), std::vector<currency::attachment_v>(), tx, TRANSACTION_VERSION_POST_HF4, one_time_key, 0));
+  crypto::random_prng_initialize_with_seed(1);
+  ASSERT_TRUE(currency::construct_tx(sender.get_keys(), sources, destinations, std::vector<currency::extra_v>(), std::vector<currency::attachment_v>(), tx2, TRANSACTION_VERSION_POST_HF4, one_time_key, 0));
+  ASSERT_EQ(t_serializable_object_to_blob(tx), t_serializable_object_to_blob(tx2));
+
+  const crypto::hash tx_id = currency::get_transaction_prefix_hash(tx);
+  ASSERT_TRUE(currency::verify_asset_surjection_proof(tx, tx_id));
+  ASSERT_TRUE(currency::check_tx_balance(tx, tx_id));
+  const currency::zc_outs_range_proof& range_proof = currency::get_type_in_variant_container_by_ref<const currency::zc_outs_range_proof>(tx.proofs);
+  std::vector<currency::zc_outs_range_proofs_with_commitments> range_proofs(1, currency::zc_outs_range_proofs_with_commitments(range_proof));
+  for (const auto& commitment : range_proof.aggregation_proof.amount_commitments_for_rp_aggregation)
+    range_proofs.back().amount_commitments.emplace_back(commitment);
+  ASSERT_TRUE(currency::verify_multiple_zc_outs_range_proofs(range_proofs));
+
+  std::vector<currency::wallet_out_info> outs;
+  crypto::key_derivation derivation = AUTO_VAL_INIT(derivation);
+  ASSERT_TRUE(currency::lookup_acc_outs(alice.get_keys(), tx, outs, derivation));
+  ASSERT_EQ(outs.size(), destinations.size());
+}
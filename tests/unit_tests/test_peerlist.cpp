@@ -56,3 +56,195 @@ TEST(peer_list, merge_peer_lists)
 
 
 }
+
+TEST(peer_list, peer_quality)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  nodetool::net_address fast{ MAKE_IP(123,43,12,1), 8080 };
+  nodetool::net_address slow{ MAKE_IP(123,43,12,2), 8080 };
+  nodetool::net_address unknown{ MAKE_IP(123,43,12,3), 8080 };
+  ADD_WHITE_NODE(fast.ip, fast.port, 1, 34345);
+  ADD_WHITE_NODE(slow.ip, slow.port, 2, 34345);
+
+  plm.on_peer_rtt(fast, 50);
+  plm.on_peer_block_announced(fast, 0);
+  plm.on_peer_sync_speed(fast, 2000);
+  plm.on_peer_rtt(slow, 800);
+  plm.on_peer_block_announced(slow, 1500);
+  plm.on_peer_sync_speed(slow, 20);
+
+  // unknown peers are between the measured good and bad ones
+  ASSERT_LT(plm.get_peer_penalty(fast), plm.get_peer_penalty(unknown));
+  ASSERT_LT(plm.get_peer_penalty(unknown), plm.get_peer_penalty(slow));
+
+  // measurements are smoothed
+  plm.on_peer_rtt(fast, 450);
+  nodetool::peer_quality pq = AUTO_VAL_INIT(pq);
+  ASSERT_TRUE(plm.get_peer_quality(fast, pq));
+  ASSERT_EQ(pq.rtt_ms, 150);
+  ASSERT_EQ(pq.blocks_announced, 1);
+
+  // fails count until the next successful connection
+  uint64_t penalty = plm.get_peer_penalty(fast);
+  plm.on_peer_connect_failed(fast);
+  plm.on_peer_connect_failed(fast);
+  ASSERT_EQ(plm.get_peer_penalty(fast), penalty + 2 * P2P_PEER_QUALITY_FAIL_PENALTY);
+  plm.on_peer_connected(fast);
+  ASSERT_EQ(plm.get_peer_penalty(fast), penalty);
+
+  // and are stored with the peerlist
+  std::stringstream ss;
+  {
+    boost::archive::binary_oarchive a(ss);
+    a << plm;
+  }
+  nodetool::peerlist_manager plm2;
+  {
+    boost::archive::binary_iarchive a(ss);
+    a >> plm2;
+  }
+  ASSERT_EQ(plm2.get_peer_penalty(fast), penalty);
+  ASSERT_EQ(plm2.get_peer_penalty(slow), plm.get_peer_penalty(slow));
+
+  // the peers removed from peerlist are forgotten
+  plm2.remove_peers_by_ip_from_all(slow.ip);
+  ASSERT_FALSE(plm2.get_peer_quality(slow, pq));
+}
+
+TEST(peer_list, journal)
+{
+  boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("peerlist_journal_%%%%%%%%");
+  boost::filesystem::create_directories(dir);
+  auto dir_cleaner = epee::misc_utils::create_scope_leave_handler([&]() { boost::system::error_code ec; boost::filesystem::remove_all(dir, ec); });
+  const std::string journal_path = (dir / "p2pstate.log").string();
+
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  ASSERT_TRUE(plm.open_journal(journal_path, false));
+  ADD_WHITE_NODE(MAKE_IP(123,43,12,1), 8080, 1, 34345);
+  ADD_GRAY_NODE(MAKE_IP(123,43,12,2), 8080, 2, 34345);
+  ADD_GRAY_NODE(MAKE_IP(123,43,12,3), 8080, 3, 34345);
+
+  // the state stored in full, the journal starts over
+  std::stringstream ss;
+  {
+    boost::archive::binary_oarchive a(ss);
+    a << plm;
+  }
+  ASSERT_TRUE(plm.reset_journal());
+  ASSERT_EQ(plm.get_journal_records_count(), 0);
+
+  ADD_WHITE_NODE(MAKE_IP(123,43,12,2), 8080, 2, 34400);
+  ADD_GRAY_NODE(MAKE_IP(123,43,12,4), 8080, 4, 34345);
+  ADD_GRAY_NODE(MAKE_IP(123,43,12,4), 8080, 4, 34300); // older than known, nothing changes
+  plm.remove_peers_by_ip_from_all(MAKE_IP(123,43,12,3));
+  ASSERT_EQ(plm.get_journal_records_count(), 3);
+  ASSERT_TRUE(plm.flush_journal());
+
+  auto load = [&](nodetool::peerlist_manager& p)
+  {
+    std::stringstream ss_copy(ss.str());
+    boost::archive::binary_iarchive a(ss_copy);
+    a >> p;
+    return p.open_journal(journal_path, true);
+  };
+  auto lists_equal = [](nodetool::peerlist_manager& a, nodetool::peerlist_manager& b)
+  {
+    std::list<nodetool::peerlist_entry> gray_a, white_a, gray_b, white_b;
+    a.get_peerlist_full(gray_a, white_a);
+    b.get_peerlist_full(gray_b, white_b);
+    auto same = [](const std::list<nodetool::peerlist_entry>& x, const std::list<nodetool::peerlist_entry>& y)
+    {
+      return x.size() == y.size() && std::equal(x.begin(), x.end(), y.begin(), [](const nodetool::peerlist_entry& l, const nodetool::peerlist_entry& r)
+        { return l.adr == r.adr && l.id == r.id && l.last_seen == r.last_seen; });
+    };
+    return same(gray_a, gray_b) && same(white_a, white_b);
+  };
+
+  {
+    nodetool::peerlist_manager plm2;
+    ASSERT_TRUE(load(plm2));
+    ASSERT_EQ(plm2.get_white_peers_count(), 2);
+    ASSERT_EQ(plm2.get_gray_peers_count(), 1);
+    ASSERT_TRUE(lists_equal(plm, plm2));
+  }
+
+  // a record cut off at the end is dropped, the next ones go after the good ones
+  {
+    boost::filesystem::ofstream f(dir / "p2pstate.log", std::ios_base::binary | std::ios_base::app);
+    f.write("\x01\x02\x03", 3);
+  }
+  {
+    nodetool::peerlist_manager plm3;
+    ASSERT_TRUE(load(plm3));
+    ASSERT_TRUE(lists_equal(plm, plm3));
+    nodetool::peerlist_entry ple = AUTO_VAL_INIT(ple);
+    ple.adr.ip = MAKE_IP(123,43,12,5);
+    ple.adr.port = 8080;
+    ple.id = 5;
+    ple.last_seen = 34345;
+    plm3.append_with_peer_gray(ple);
+    ASSERT_TRUE(plm3.flush_journal());
+  }
+  {
+    nodetool::peerlist_manager plm4;
+    ASSERT_TRUE(load(plm4));
+    ASSERT_EQ(plm4.get_gray_peers_count(), 2);
+  }
+
+  // the journal of an outdated state isn't applied
+  nodetool::peerlist_manager plm5;
+  ASSERT_TRUE(plm5.open_journal(journal_path, false));
+  ASSERT_EQ(plm5.get_white_peers_count(), 0);
+  ASSERT_EQ(plm5.get_gray_peers_count(), 0);
+}
+
+TEST(peer_list, lists_are_trimmed)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  for (uint32_t i = 0; i != P2P_LOCAL_GRAY_PEERLIST_LIMIT + 10; ++i)
+    ADD_GRAY_NODE(MAKE_IP(123,43,12,1) + (i << 8), 8080, i, 34345 + i);
+  ASSERT_EQ(plm.get_gray_peers_count(), P2P_LOCAL_GRAY_PEERLIST_LIMIT);
+
+  // the oldest ones go
+  nodetool::peerlist_entry ple = AUTO_VAL_INIT(ple);
+  ASSERT_TRUE(plm.get_gray_peer_by_index(ple, P2P_LOCAL_GRAY_PEERLIST_LIMIT - 1));
+  ASSERT_EQ(ple.last_seen, 34345 + 10);
+
+  // no more than P2P_MAX_PEERS_TO_MERGE are taken from a remote peerlist
+  nodetool::peerlist_manager plm2;
+  plm2.init(false);
+  std::list<nodetool::peerlist_entry> outer_bs;
+  for (uint32_t i = 0; i != P2P_MAX_PEERS_TO_MERGE * 2; ++i)
+  {
+    ple.adr.ip = MAKE_IP(123,43,12,1) + (i << 8);
+    ple.id = i;
+    outer_bs.push_back(ple);
+  }
+  plm2.merge_peerlist(outer_bs);
+  ASSERT_EQ(plm2.get_gray_peers_count(), P2P_MAX_PEERS_TO_MERGE);
+}
+
+TEST(peer_list, peerlist_head_since)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  ADD_WHITE_NODE(MAKE_IP(123,43,12,1), 8080, 1, 34345);
+  ADD_WHITE_NODE(MAKE_IP(123,43,12,2), 8080, 2, 34400);
+  ADD_WHITE_NODE(MAKE_IP(123,43,12,3), 8080, 3, 34500);
+
+  std::list<nodetool::peerlist_entry> bs_head;
+  ASSERT_TRUE(plm.get_peerlist_head(bs_head, 100, 34400));
+  ASSERT_EQ(bs_head.size(), 2);
+  ASSERT_EQ(bs_head.front().id, 3);
+
+  bs_head.clear();
+  ASSERT_TRUE(plm.get_peerlist_head(bs_head, 100, 34501));
+  ASSERT_TRUE(bs_head.empty());
+
+  bs_head.clear();
+  ASSERT_TRUE(plm.get_peerlist_head(bs_head, 100));
+  ASSERT_EQ(bs_head.size(), 3);
+}
@@ -7,6 +7,9 @@
 #include "include_base_utils.h"
 #include "currency_protocol/currency_protocol_defs.h"
 #include "storages/portable_storage_template_helper.h"
+#include "currency_protocol/raw_block_entries.h"
+#include "currency_core/currency_format_utils.h"
+#include "rpc/core_rpc_server_commands_defs.h"
 
 TEST(protocol_pack, protocol_pack_command) 
 {
@@ -27,3 +30,133 @@ TEST(protocol_pack, protocol_pack_command)
     ASSERT_TRUE(r.total_height == 3);
   }
 }
+
+namespace
+{
+  // NOTIFY_RESPONSE_CHAIN_ENTRY of the nodes without CURRENCY_PROTOCOL_FEATURE_CHAIN_HEADERS
+  struct chain_entry_without_headers
+  {
+    uint64_t start_height;
+    uint64_t total_height;
+    std::list<currency::block_context_info> m_block_ids;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(start_height)
+      KV_SERIALIZE(total_height)
+      KV_SERIALIZE(m_block_ids)
+    END_KV_SERIALIZE_MAP()
+  };
+}
+
+TEST(protocol_pack, chain_entry_headers)
+{
+  std::string buff;
+  currency::NOTIFY_RESPONSE_CHAIN_ENTRY::request r = AUTO_VAL_INIT(r);
+  r.start_height = 1;
+  r.total_height = 3;
+  r.m_block_ids.resize(2, boost::value_initialized<currency::block_context_info>());
+  r.m_block_headers.push_back(std::string(100, 'a'));
+  r.m_block_headers.push_back(std::string(200, 'b'));
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, buff));
+
+  currency::NOTIFY_RESPONSE_CHAIN_ENTRY::request r2 = AUTO_VAL_INIT(r2);
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(r2, buff));
+  ASSERT_EQ(r2.m_block_headers, r.m_block_headers);
+
+  // both ways with the older nodes
+  chain_entry_without_headers old_r = AUTO_VAL_INIT(old_r);
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(old_r, buff));
+  ASSERT_EQ(old_r.m_block_ids.size(), 2);
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(old_r, buff));
+  currency::NOTIFY_RESPONSE_CHAIN_ENTRY::request r3 = AUTO_VAL_INIT(r3);
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(r3, buff));
+  ASSERT_EQ(r3.m_block_ids.size(), 2);
+  ASSERT_TRUE(r3.m_block_headers.empty());
+}
+
+TEST(protocol_pack, raw_block_entries)
+{
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r = AUTO_VAL_INIT(r);
+  for (size_t i = 0; i != 5; ++i)
+  {
+    currency::block_complete_entry bce = AUTO_VAL_INIT(bce);
+    bce.block = std::string(100 + i, char('a' + i));
+    for (size_t j = 0; j != i; ++j)
+      bce.txs.push_back(std::string(j * 200, char('0' + j))); // the first tx blob is empty
+    r.blocks.push_back(bce);
+  }
+  r.current_blockchain_height = 10;
+
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r_raw = r;
+  ASSERT_TRUE(currency::pack_raw_block_entries(r_raw.blocks, r_raw.blocks_raw));
+  r_raw.blocks.clear();
+  std::string buff, buff_raw;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, buff));
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r_raw, buff_raw));
+  ASSERT_LT(buff_raw.size(), buff.size());
+
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r2 = AUTO_VAL_INIT(r2);
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(r2, buff_raw));
+  ASSERT_TRUE(r2.blocks.empty());
+  ASSERT_TRUE(currency::unpack_raw_block_entries(r2.blocks_raw, r2.blocks));
+  ASSERT_EQ(r.blocks.size(), r2.blocks.size());
+  for (auto it = r.blocks.begin(), it2 = r2.blocks.begin(); it != r.blocks.end(); ++it, ++it2)
+  {
+    ASSERT_EQ(it->block, it2->block);
+    ASSERT_EQ(it->txs, it2->txs);
+  }
+
+  // truncated, extended or with the version changed it's rejected and the list is left as is
+  const std::string raw = r_raw.blocks_raw;
+  std::list<currency::block_complete_entry> blocks;
+  for (size_t len = 0; len != raw.size(); ++len)
+    ASSERT_FALSE(currency::unpack_raw_block_entries(raw.substr(0, len), blocks)) << len;
+  ASSERT_FALSE(currency::unpack_raw_block_entries(raw + '\0', blocks));
+  std::string wrong_ver = raw;
+  wrong_ver[0] = 2;
+  ASSERT_FALSE(currency::unpack_raw_block_entries(wrong_ver, blocks));
+  ASSERT_FALSE(currency::unpack_raw_block_entries(std::string("\x01\x01\x00\x01\x80", 5), blocks)); // unterminated tx size
+  ASSERT_TRUE(blocks.empty());
+
+  ASSERT_TRUE(currency::unpack_raw_block_entries(std::string("\x01\x00", 2), blocks));
+  ASSERT_TRUE(blocks.empty());
+
+  // global outputs can't be packed
+  r.blocks.back().coinbase_global_outs.push_back(1);
+  std::string raw_with_outs;
+  ASSERT_FALSE(currency::pack_raw_block_entries(r.blocks, raw_with_outs));
+}
+
+TEST(protocol_pack, compact_global_outs)
+{
+  currency::block genesis = AUTO_VAL_INIT(genesis);
+  ASSERT_TRUE(currency::generate_genesis_block(genesis));
+  const size_t outs_count = genesis.miner_tx.vout.size();
+
+  currency::COMMAND_RPC_GET_BLOCKS_FAST::response serialized = AUTO_VAL_INIT(serialized);
+  serialized.blocks.emplace_back();
+  currency::block_complete_entry& bce = serialized.blocks.back();
+  bce.block = currency::block_to_blob(genesis);
+  for (size_t i = 0; i != outs_count; ++i)
+    bce.global_outs.push_back(100 + i);
+
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(serialized, buff));
+  currency::COMMAND_RPC_GET_BLOCKS_FAST::response loaded = AUTO_VAL_INIT(loaded);
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(loaded, buff));
+  ASSERT_EQ(bce.global_outs, loaded.blocks.back().global_outs);
+
+  currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response unserialized = AUTO_VAL_INIT(unserialized);
+  ASSERT_TRUE(currency::unserialize_block_complete_entry(loaded, unserialized));
+  ASSERT_EQ(1, unserialized.blocks.size());
+  ASSERT_TRUE(unserialized.blocks.back().coinbase_ptr);
+  ASSERT_EQ(bce.global_outs, unserialized.blocks.back().coinbase_ptr->m_global_output_indexes);
+
+  // the count has to match the outputs exactly
+  bce.global_outs.push_back(1);
+  currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response unserialized_more = AUTO_VAL_INIT(unserialized_more);
+  ASSERT_FALSE(currency::unserialize_block_complete_entry(serialized, unserialized_more));
+  bce.global_outs.resize(outs_count - 1);
+  currency::COMMAND_RPC_GET_BLOCKS_DIRECT::response unserialized_less = AUTO_VAL_INIT(unserialized_less);
+  ASSERT_FALSE(currency::unserialize_block_complete_entry(serialized, unserialized_less));
+}
@@ -0,0 +1,123 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <stdexcept>
+#include "include_base_utils.h"
+#include "common/threads_pool.h"
+
+TEST(threads_pool, pool_task_storage)
+{
+  static int alive = 0;
+  struct counted
+  {
+    counted() { ++alive; }
+    counted(const counted&) { ++alive; }
+    counted(counted&&) noexcept { ++alive; }
+    ~counted() { --alive; }
+  };
+
+  int calls = 0;
+  {
+    counted c;
+    utils::pool_task small([&calls, c]() { ++calls; });
+    uint64_t big_array[32] = { 0 };
+    utils::pool_task big([&calls, big_array, c]() { calls += 1 + static_cast<int>(big_array[0]); });
+    utils::pool_task moved(std::move(small));
+    ASSERT_FALSE(static_cast<bool>(small));
+    moved();
+    big();
+    utils::pool_task assigned;
+    assigned = std::move(big);
+    assigned();
+  }
+  ASSERT_EQ(calls, 3);
+  ASSERT_EQ(alive, 0);
+}
+
+TEST(threads_pool, parallel_for_covers_all_indexes)
+{
+  utils::threads_pool pool;
+  pool.init(4);
+  for (size_t grain : { 1, 3, 64, 1000 })
+  {
+    std::vector<std::atomic<int>> hits(1000);
+    for (auto& h : hits)
+      h = 0;
+    pool.parallel_for(hits.size(), [&](size_t i) { ++hits[i]; }, grain);
+    for (auto& h : hits)
+      ASSERT_EQ(h.load(), 1);
+  }
+}
+
+TEST(threads_pool, no_threads_runs_in_caller)
+{
+  utils::threads_pool pool;
+  std::thread::id caller = std::this_thread::get_id();
+  bool all_in_caller = true;
+  pool.parallel_for(10, [&](size_t i) { all_in_caller = all_in_caller && std::this_thread::get_id() == caller; });
+  ASSERT_TRUE(all_in_caller);
+
+  bool job_done = false;
+  pool.add_job([&]() { job_done = true; });
+  ASSERT_TRUE(job_done);
+}
+
+TEST(threads_pool, nested_batches_dont_stall)
+{
+  // each worker waits for its own batch, the callers take part in them
+  utils::threads_pool pool;
+  pool.init(2);
+  std::atomic<size_t> inner_done(0);
+  utils::threads_pool::jobs_container outer;
+  for (size_t i = 0; i != 8; ++i)
+  {
+    utils::threads_pool::add_job_to_container(outer, [&]()
+    {
+      utils::threads_pool::jobs_container inner;
+      for (size_t j = 0; j != 8; ++j)
+        utils::threads_pool::add_job_to_container(inner, [&]() { ++inner_done; });
+      pool.add_batch_and_wait(inner);
+    });
+  }
+  pool.add_batch_and_wait(outer);
+  ASSERT_EQ(inner_done.load(), 64);
+}
+
+TEST(threads_pool, jobs_and_exceptions)
+{
+  utils::threads_pool pool;
+  pool.init(3);
+  std::atomic<size_t> done(0);
+  for (size_t i = 0; i != 100; ++i)
+    pool.add_job([&]() { ++done; });
+  while (done != 100)
+    std::this_thread::yield();
+
+  std::atomic<size_t> processed(0);
+  ASSERT_THROW(pool.parallel_for(100, [&](size_t i)
+  {
+    ++processed;
+    if (i == 50)
+      throw std::runtime_error("test");
+  }), std::runtime_error);
+  ASSERT_EQ(processed.load(), 100);
+}
+
+TEST(threads_pool, stop_runs_what_is_left)
+{
+  utils::threads_pool pool;
+  pool.init(2);
+  std::atomic<size_t> done(0);
+  for (size_t i = 0; i != 50; ++i)
+    pool.add_job([&]() { std::this_thread::sleep_for(std::chrono::microseconds(100)); ++done; });
+  pool.stop();
+  ASSERT_EQ(done.load(), 50);
+
+  std::thread::id caller = std::this_thread::get_id();
+  bool in_caller = false;
+  pool.add_job([&]() { in_caller = std::this_thread::get_id() == caller; });
+  ASSERT_TRUE(in_caller);
+}
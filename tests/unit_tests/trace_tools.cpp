@@ -0,0 +1,56 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include "include_base_utils.h"
+#include "trace_tools.h"
+
+TEST(trace_tools, spans_ring_and_chrome_export)
+{
+  epee::trace_tools::tracer& t = epee::trace_tools::tracer::get();
+  t.stop();
+  {
+    TRACE_SCOPE("test", "not_recorded");
+  }
+
+  t.start();
+  {
+    TRACE_SCOPE_ARG("test", "outer", 12345);
+    TRACE_SCOPE("test", std::string("inner"));
+  }
+  std::thread th([]() { TRACE_SCOPE("test", "other_thread"); });
+  th.join();
+  t.stop();
+  {
+    TRACE_SCOPE("test", "after_stop");
+  }
+
+  std::string json = t.get_chrome_trace();
+  ASSERT_NE(json.find("\"name\":\"outer\""), std::string::npos);
+  ASSERT_NE(json.find("\"args\":{\"arg\":12345}"), std::string::npos);
+  ASSERT_NE(json.find("\"name\":\"inner\""), std::string::npos);
+  ASSERT_NE(json.find("\"name\":\"other_thread\""), std::string::npos);
+  ASSERT_NE(json.find("\"ph\":\"X\""), std::string::npos);
+  ASSERT_EQ(json.find("not_recorded"), std::string::npos);
+  ASSERT_EQ(json.find("after_stop"), std::string::npos);
+
+  // the ring keeps the latest events only, a new session drops the old ones
+  epee::trace_tools::thread_ring ring(1, "[test]");
+  for (uint64_t i = 0; i != TRACE_EVENTS_PER_THREAD + 10; ++i)
+    ring.push("test", "n", 1000 + i, 1, i, true);
+  std::vector<epee::trace_tools::trace_event_data> events;
+  ring.get_events(0, events);
+  ASSERT_EQ(events.size(), TRACE_EVENTS_PER_THREAD);
+  ASSERT_EQ(events.front().arg, 10);
+  ASSERT_EQ(events.back().arg, TRACE_EVENTS_PER_THREAD + 9);
+  events.clear();
+  ring.get_events(1000 + TRACE_EVENTS_PER_THREAD + 5, events);
+  ASSERT_EQ(events.size(), 5);
+
+  t.start();
+  ASSERT_EQ(t.get_chrome_trace().find("\"name\":\"outer\""), std::string::npos);
+  t.stop();
+}
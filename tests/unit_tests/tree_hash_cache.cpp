@@ -0,0 +1,50 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "crypto/tree_hash_cache.h"
+
+namespace
+{
+  crypto::hash make_leaf(size_t i)
+  {
+    return crypto::cn_fast_hash(&i, sizeof i);
+  }
+
+  crypto::hash tree_hash_ref(const std::vector<crypto::hash>& leaves)
+  {
+    crypto::hash h = {};
+    crypto::tree_hash(leaves.data(), leaves.size(), h);
+    return h;
+  }
+}
+
+TEST(tree_hash_cache, same_as_tree_hash)
+{
+  crypto::tree_hash_cache cache;
+  std::vector<crypto::hash> leaves;
+  for (size_t n = 1; n != 70; ++n)
+  {
+    leaves.push_back(make_leaf(n));
+    ASSERT_EQ(cache.calc(leaves), tree_hash_ref(leaves));
+  }
+
+  // a template being rebuilt: a new miner tx, txs coming and going
+  for (size_t i = 0; i != 200; ++i)
+  {
+    leaves[0] = make_leaf(1000 + i);
+    if (i % 3 == 1)
+      leaves.insert(leaves.begin() + 1 + (i * 7) % (leaves.size() - 1), make_leaf(2000 + i));
+    if (i % 5 == 2)
+      leaves.erase(leaves.begin() + 1 + (i * 11) % (leaves.size() - 1));
+    ASSERT_EQ(cache.calc(leaves), tree_hash_ref(leaves));
+  }
+  ASSERT_EQ(cache.get_nodes_count(), leaves.size() - 1); // the interior nodes of a tree with 2 children each
+
+  leaves.resize(1);
+  ASSERT_EQ(cache.calc(leaves), leaves[0]);
+  leaves.push_back(make_leaf(3000));
+  ASSERT_EQ(cache.calc(leaves), tree_hash_ref(leaves));
+}
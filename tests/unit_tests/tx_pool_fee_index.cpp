@@ -0,0 +1,46 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "currency_core/tx_pool.h"
+
+using currency::tx_memory_pool;
+
+namespace
+{
+  tx_memory_pool::fee_index_entry make_entry(uint64_t n, uint64_t fee, uint64_t blob_size)
+  {
+    tx_memory_pool::fee_index_entry e = AUTO_VAL_INIT(e);
+    *reinterpret_cast<uint64_t*>(&e.id) = n;
+    e.fee = fee;
+    e.blob_size = blob_size;
+    return e;
+  }
+}
+
+TEST(tx_pool_fee_index, ordering)
+{
+  tx_memory_pool::fee_index index;
+  index.insert(make_entry(1, 100, 1000));                 // 0.1 per byte
+  index.insert(make_entry(2, 300, 1000));                 // 0.3
+  index.insert(make_entry(3, 200, 500));                  // 0.4
+  index.insert(make_entry(4, 0, 300));                    // zero fee
+  index.insert(make_entry(5, 100, 1000));                 // same rate as 1, ordered by id
+  index.insert(make_entry(6, UINT64_MAX, UINT64_MAX));    // 1.0, products don't overflow
+  ASSERT_EQ(index.size(), 6);
+
+  std::vector<uint64_t> order;
+  for (const auto& e : index)
+    order.push_back(*reinterpret_cast<const uint64_t*>(&e.id));
+  ASSERT_EQ(order, std::vector<uint64_t>({ 6, 3, 2, 1, 5, 4 }));
+
+  // continuing a walk after an entry that has been removed meanwhile
+  tx_memory_pool::fee_index_entry last = *std::next(index.begin(), 2);
+  index.erase(last);
+  auto it = index.upper_bound(last);
+  ASSERT_NE(it, index.end());
+  ASSERT_EQ(*reinterpret_cast<const uint64_t*>(&it->id), 1);
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "currency_core/currency_format_utils.h"
+
+using namespace currency;
+
+TEST(variant_type_check, index_of_alternative)
+{
+  static_assert(tools::variant_type_index<txin_v, txin_gen>::value == 0, "txin_gen is the first alternative of txin_v");
+  static_assert(tools::variant_type_index<txin_v, txin_zc_input>::is_alternative, "txin_zc_input is an alternative of txin_v");
+  static_assert(tools::variant_type_index<extra_v, tx_derivation_hint>::value == 4, "make_variant_over<> alternatives are indexed in order");
+  static_assert(!tools::variant_type_index<txin_v, tx_out_bare>::is_alternative, "tx_out_bare is not an alternative of txin_v");
+  static_assert(!tools::variant_type_index<std::string, std::string>::is_variant, "std::string is not a variant");
+}
+
+TEST(variant_type_check, same_as_typeid)
+{
+  std::vector<txin_v> ins = { txin_gen(), txin_to_key(), txin_multisig(), txin_htlc(), txin_zc_input() };
+  for (const txin_v& in : ins)
+  {
+    ASSERT_EQ(tools::is_variant_type<txin_gen>(in), in.type() == typeid(txin_gen));
+    ASSERT_EQ(tools::is_variant_type<txin_to_key>(in), in.type() == typeid(txin_to_key));
+    ASSERT_EQ(tools::is_variant_type<txin_multisig>(in), in.type() == typeid(txin_multisig));
+    ASSERT_EQ(tools::is_variant_type<txin_htlc>(in), in.type() == typeid(txin_htlc));
+    ASSERT_EQ(tools::is_variant_type<txin_zc_input>(in), in.type() == typeid(txin_zc_input));
+    ASSERT_FALSE(tools::is_variant_type<tx_out_bare>(in));
+  }
+
+  std::vector<extra_v> extra;
+  extra.push_back(crypto::public_key());
+  extra.push_back(extra_user_data());
+  extra.push_back(tx_derivation_hint());
+  extra.push_back(tx_derivation_hint());
+  ASSERT_EQ(count_type_in_variant_container<tx_derivation_hint>(extra), 2);
+  ASSERT_EQ(count_type_in_variant_container<crypto::public_key>(extra), 1);
+  ASSERT_EQ(count_type_in_variant_container<tx_comment>(extra), 0);
+  ASSERT_NE(get_type_in_variant_container<extra_user_data>(extra), nullptr);
+}
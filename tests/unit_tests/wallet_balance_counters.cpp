@@ -0,0 +1,78 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "wallet/wallet2.h"
+
+namespace
+{
+  void add_transfer(tools::wallet2& w, uint64_t amount, uint64_t block_height, uint64_t unlock_time = 0)
+  {
+    tools::transfer_details td = AUTO_VAL_INIT(td);
+    td.m_ptx_wallet_info = std::make_shared<tools::transaction_wallet_info>();
+    td.m_ptx_wallet_info->m_block_height = block_height;
+    td.m_ptx_wallet_info->m_tx.vout.push_back(currency::tx_out_bare{ amount, currency::txout_to_key() });
+    if (unlock_time)
+      td.m_ptx_wallet_info->m_tx.extra.push_back(currency::etc_tx_details_unlock_time{ unlock_time });
+    td.m_amount = amount;
+    td.m_global_output_index = w.m_transfers.size();
+    w.m_transfers.push_back(td);
+  }
+
+  void add_blocks(tools::wallet2& w, uint64_t count)
+  {
+    for (uint64_t i = 0; i != count; ++i)
+    {
+      uint64_t height = w.get_blockchain_current_size();
+      w.m_chain.push_new_block_id(crypto::cn_fast_hash(&height, sizeof height), height);
+    }
+  }
+
+  // the way balance() used to sum it up, over all the transfers
+  void check_balance(const tools::wallet2& w, uint64_t expected_total, uint64_t expected_unlocked)
+  {
+    uint64_t total = 0, unlocked = 0;
+    for (const auto& td : w.m_transfers)
+    {
+      total += td.amount();
+      if (w.is_transfer_unlocked(td))
+        unlocked += td.amount();
+    }
+    ASSERT_EQ(total, expected_total);
+    ASSERT_EQ(unlocked, expected_unlocked);
+
+    uint64_t counted_unlocked = 0;
+    ASSERT_EQ(w.balance(currency::native_coin_asset_id, counted_unlocked), expected_total);
+    ASSERT_EQ(counted_unlocked, expected_unlocked);
+  }
+}
+
+TEST(wallet_balance_counters, unlocking_and_rollback)
+{
+  tools::wallet2 w;
+  add_blocks(w, 20);
+  add_transfer(w, 1, 5);
+  add_transfer(w, 10, 15);
+  add_transfer(w, 100, 18, 40); // locked by height
+  add_transfer(w, 1000, 19, 4000000000); // locked by time, far ahead
+  check_balance(w, 1111, 1);
+
+  // transfers get unlocked one after another as new blocks come
+  add_blocks(w, 5);
+  check_balance(w, 1111, 11);
+  add_blocks(w, 20);
+  check_balance(w, 1111, 111);
+
+  // a new transfer is counted on the next call
+  add_transfer(w, 10000, 44);
+  check_balance(w, 11111, 111);
+  add_blocks(w, WALLET_DEFAULT_TX_SPENDABLE_AGE);
+  check_balance(w, 11111, 10111);
+
+  // the blockchain gets shorter, what was unlocked after that height is locked again
+  w.m_chain.detach(30);
+  check_balance(w, 11111, 11);
+}
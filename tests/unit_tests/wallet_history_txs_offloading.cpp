@@ -0,0 +1,119 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem.hpp>
+#include "include_base_utils.h"
+#include "misc_language.h"
+#include "wallet/wallet2.h"
+
+namespace
+{
+  uint64_t get_gen_height(const currency::transaction& tx)
+  {
+    if (tx.vin.size() != 1 || tx.vin[0].type() != typeid(currency::txin_gen))
+      return UINT64_MAX;
+    return boost::get<currency::txin_gen>(tx.vin[0]).height;
+  }
+}
+
+TEST(wallet_history_txs_offloading, offload_and_materialize)
+{
+  boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("wallet_history_txs_%%%%%%%%");
+  boost::filesystem::create_directories(dir);
+  auto dir_cleaner = epee::misc_utils::create_scope_leave_handler([&]() { boost::system::error_code ec; boost::filesystem::remove_all(dir, ec); });
+  const std::wstring wallet_file = (dir / "alice.wallet").wstring();
+  const std::string password = "password";
+  const uint64_t history_size = WALLET_HISTORY_RESIDENT_TXS_COUNT + 500;
+
+  tools::wallet2 w;
+  w.generate(wallet_file, password, false);
+  for (uint64_t i = 0; i != history_size; ++i)
+  {
+    tools::wallet_public::wallet_transfer_info wti = AUTO_VAL_INIT(wti);
+    wti.height = i + 1;
+    wti.tx.vin.push_back(currency::txin_gen{ i });
+    w.m_transfer_history.push_back(wti);
+  }
+  w.set_offload_history_txs(true);
+  w.store();
+
+  // old entries don't hold their txs anymore, but they are given with them
+  ASSERT_TRUE(w.m_transfer_history[0].tx.vin.empty());
+  ASSERT_TRUE(w.m_transfer_history[history_size - WALLET_HISTORY_RESIDENT_TXS_COUNT - 1].tx.vin.empty());
+  ASSERT_EQ(get_gen_height(w.m_transfer_history[history_size - WALLET_HISTORY_RESIDENT_TXS_COUNT].tx), history_size - WALLET_HISTORY_RESIDENT_TXS_COUNT);
+
+  uint64_t i = 0;
+  w.enumerate_transfers_history([&](const tools::wallet_public::wallet_transfer_info& wti) -> bool {
+    EXPECT_EQ(get_gen_height(wti.tx), i);
+    ++i;
+    return true;
+  }, true);
+  ASSERT_EQ(i, history_size);
+
+  std::vector<tools::wallet_public::wallet_transfer_info> trs;
+  uint64_t total = 0, last_item_index = 0;
+  w.get_recent_transfers_history(trs, 100, 10, total, last_item_index, false, false);
+  ASSERT_EQ(trs.size(), 10);
+  ASSERT_EQ(total, history_size);
+  for (size_t j = 0; j != trs.size(); ++j)
+    ASSERT_EQ(get_gen_height(trs[j].tx), 100 + j);
+
+  // export in parts gives the same as the whole one
+  for (const std::string format : { "csv", "json" })
+  {
+    std::stringstream whole, parts;
+    w.export_transaction_history(whole, format, true);
+    uint64_t cursor = 0;
+    size_t parts_count = 1;
+    while (!w.export_transaction_history_part(parts, format, true, cursor, 333))
+      ++parts_count;
+    ASSERT_EQ(parts_count, (history_size + 332) / 333);
+    ASSERT_EQ(cursor, history_size);
+    ASSERT_EQ(parts.str(), whole.str());
+  }
+
+  // txs offloaded before the store are in the storage the wallet file refers to, so they come back on load
+  w.store();
+  {
+    tools::wallet2 w2;
+    ASSERT_NO_THROW(w2.load(wallet_file, password));
+    ASSERT_EQ(w2.m_transfer_history.size(), history_size);
+    for (uint64_t j = 0; j != history_size; ++j)
+      ASSERT_EQ(get_gen_height(w2.m_transfer_history[j].tx), j);
+  }
+
+  // and stay out of memory with offloading on
+  {
+    tools::wallet2 w2;
+    w2.set_offload_history_txs(true);
+    ASSERT_NO_THROW(w2.load(wallet_file, password));
+    ASSERT_EQ(w2.m_transfer_history.size(), history_size);
+    ASSERT_TRUE(w2.m_transfer_history[0].tx.vin.empty());
+    ASSERT_TRUE(w2.m_transfer_history[0].is_mining);
+    uint64_t k = 0;
+    w2.enumerate_transfers_history([&](const tools::wallet_public::wallet_transfer_info& wti) -> bool {
+      EXPECT_EQ(get_gen_height(wti.tx), k);
+      ++k;
+      return true;
+    }, true);
+    ASSERT_EQ(k, history_size);
+  }
+
+  // turning it off puts the txs back
+  w.set_offload_history_txs(false);
+  for (uint64_t j = 0; j != history_size; ++j)
+    ASSERT_EQ(get_gen_height(w.m_transfer_history[j].tx), j);
+
+  // the next store holds the whole history again, nothing refers to the storage
+  w.store();
+  ASSERT_FALSE(boost::filesystem::exists(dir / "alice.history_txs"));
+  {
+    tools::wallet2 w2;
+    ASSERT_NO_THROW(w2.load(wallet_file, password));
+    for (uint64_t j = 0; j != history_size; ++j)
+      ASSERT_EQ(get_gen_height(w2.m_transfer_history[j].tx), j);
+  }
+}
@@ -6,6 +6,7 @@
 
 #include "include_base_utils.h"
 #include "currency_core/account.h"
+#include "common/mnemonic-encoding.h"
 
 TEST(wallet_seed, store_restore_test) 
 {
@@ -211,3 +212,18 @@ TEST(wallet_seed, basic_test)
   }
 
 }
+
+TEST(wallet_seed, mnemonic_words_lookup)
+{
+  using namespace tools::mnemonic_encoding;
+  for (uint32_t i = 0; i != NUMWORDS; i++)
+  {
+    ASSERT_TRUE(valid_word(word_by_num(i)));
+    ASSERT_EQ(num_by_word(word_by_num(i)), i);
+  }
+  ASSERT_FALSE(valid_word(""));
+  ASSERT_FALSE(valid_word("likes"));
+  ASSERT_FALSE(valid_word("Like"));
+  ASSERT_ANY_THROW(num_by_word("likes"));
+  ASSERT_TRUE(text2binary("like just notaword").empty());
+}
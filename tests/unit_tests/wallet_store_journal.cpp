@@ -0,0 +1,106 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem.hpp>
+#include "include_base_utils.h"
+#include "misc_language.h"
+#include "wallet/wallet2.h"
+
+namespace
+{
+  void add_transfer(tools::wallet2& w, uint64_t amount)
+  {
+    tools::transfer_details td = AUTO_VAL_INIT(td);
+    td.m_ptx_wallet_info = std::make_shared<tools::transaction_wallet_info>();
+    td.m_ptx_wallet_info->m_block_height = w.m_transfers.size();
+    td.m_amount = amount;
+    td.m_global_output_index = w.m_transfers.size();
+    w.m_transfers.push_back(td);
+  }
+
+  void add_history_entry(tools::wallet2& w, uint64_t height)
+  {
+    tools::wallet_public::wallet_transfer_info wti = AUTO_VAL_INIT(wti);
+    wti.height = height;
+    w.m_transfer_history.push_back(wti);
+  }
+
+  void check_same_state(const tools::wallet2& expected, const tools::wallet2& w)
+  {
+    ASSERT_EQ(w.m_transfers.size(), expected.m_transfers.size());
+    for (size_t i = 0; i != w.m_transfers.size(); ++i)
+    {
+      ASSERT_EQ(w.m_transfers[i].m_amount, expected.m_transfers[i].m_amount);
+      ASSERT_EQ(w.m_transfers[i].m_flags, expected.m_transfers[i].m_flags);
+      ASSERT_EQ(w.m_transfers[i].m_spent_height, expected.m_transfers[i].m_spent_height);
+      ASSERT_EQ(w.m_transfers[i].m_ptx_wallet_info->m_block_height, expected.m_transfers[i].m_ptx_wallet_info->m_block_height);
+    }
+    ASSERT_EQ(w.m_transfer_history.size(), expected.m_transfer_history.size());
+    for (size_t i = 0; i != w.m_transfer_history.size(); ++i)
+      ASSERT_EQ(w.m_transfer_history[i].height, expected.m_transfer_history[i].height);
+    ASSERT_EQ(w.m_last_pow_block_h, expected.m_last_pow_block_h);
+  }
+}
+
+TEST(wallet_store_journal, store_changes_and_load)
+{
+  boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("wallet_store_journal_%%%%%%%%");
+  boost::filesystem::create_directories(dir);
+  auto dir_cleaner = epee::misc_utils::create_scope_leave_handler([&]() { boost::system::error_code ec; boost::filesystem::remove_all(dir, ec); });
+  const std::wstring wallet_file = (dir / "alice.wallet").wstring();
+  const boost::filesystem::path journal_file = dir / "alice.journal";
+  const std::string password = "password";
+
+  tools::wallet2 w;
+  w.generate(wallet_file, password, false);
+  w.set_use_store_journal(true);
+
+  // the wallet file is small yet, so the journal outgrows it with the first record, and the next store is a full one
+  for (uint64_t i = 0; i != 300; ++i)
+    add_transfer(w, 1000 + i);
+  for (uint64_t i = 0; i != 100; ++i)
+    add_history_entry(w, i);
+  w.store();
+  ASSERT_TRUE(boost::filesystem::exists(journal_file));
+  w.store();
+  ASSERT_FALSE(boost::filesystem::exists(journal_file));
+
+  // changes only
+  w.m_transfers[10].m_flags |= WALLET_TRANSFER_DETAIL_FLAG_SPENT;
+  w.m_transfers[10].m_spent_height = 777;
+  add_transfer(w, 5000);
+  add_history_entry(w, 100);
+  w.m_last_pow_block_h = 123;
+  w.store();
+  ASSERT_TRUE(boost::filesystem::exists(journal_file));
+  uint64_t journal_size = boost::filesystem::file_size(journal_file);
+  ASSERT_LT(journal_size, boost::filesystem::file_size(wallet_file) / 4);
+
+  w.m_transfers[20].m_flags |= WALLET_TRANSFER_DETAIL_FLAG_BLOCKED;
+  w.store();
+  ASSERT_GT(boost::filesystem::file_size(journal_file), journal_size);
+
+  {
+    tools::wallet2 w2;
+    ASSERT_NO_THROW(w2.load(wallet_file, password));
+    check_same_state(w, w2);
+  }
+
+  // an interrupted append is ignored
+  {
+    std::ofstream f(journal_file.string(), std::ios_base::binary | std::ios_base::app);
+    f << std::string(20, 'x');
+  }
+  {
+    tools::wallet2 w3;
+    ASSERT_NO_THROW(w3.load(wallet_file, password));
+    check_same_state(w, w3);
+    // and the next store starts over
+    w3.set_use_store_journal(true);
+    w3.store();
+    ASSERT_FALSE(boost::filesystem::exists(journal_file));
+  }
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2014-2024 Zano Project
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "currency_core/currency_format_utils.h"
+#include "currency_core/zc_outputs_index.h"
+#include "common/mapped_pod_array_file.h"
+#include "common/db_backend_lmdb.h"
+#include "common/util.h"
+
+using currency::zc_output_index_entry;
+
+namespace
+{
+  zc_output_index_entry make_entry(uint64_t n)
+  {
+    zc_output_index_entry e = AUTO_VAL_INIT(e);
+    *reinterpret_cast<uint64_t*>(&e.stealth_address) = n + 1;
+    e.keeper_block_height = n;
+    return e;
+  }
+
+  uint64_t entry_number(const zc_output_index_entry* p)
+  {
+    return p ? p->keeper_block_height : UINT64_MAX;
+  }
+}
+
+TEST(mapped_pod_array_file, push_truncate_reopen)
+{
+  const std::string filename = "./TEST_mapped_pod_array_file.bin";
+  boost::filesystem::remove(filename);
+  const uint64_t signature = 0x1234;
+  const size_t count = 200 * 1000; // a few remaps
+
+  {
+    tools::mapped_pod_array_file<zc_output_index_entry> f;
+    ASSERT_TRUE(f.open(epee::string_encoding::utf8_to_wstring(filename), signature));
+    ASSERT_EQ(f.size(), 0);
+    for (size_t i = 0; i != count; ++i)
+      ASSERT_TRUE(f.push_back(make_entry(i)));
+    ASSERT_TRUE(f.truncate(count - 10));
+    ASSERT_FALSE(f.truncate(count));
+  }
+
+  {
+    tools::mapped_pod_array_file<zc_output_index_entry> f;
+    ASSERT_TRUE(f.open(epee::string_encoding::utf8_to_wstring(filename), signature));
+    ASSERT_EQ(f.size(), count - 10);
+    for (size_t i = 0; i != f.size(); ++i)
+      ASSERT_EQ(f[i].keeper_block_height, i);
+  }
+
+  {
+    // different signature means different format, the file is recreated
+    tools::mapped_pod_array_file<zc_output_index_entry> f;
+    std::string reason;
+    ASSERT_TRUE(f.open(epee::string_encoding::utf8_to_wstring(filename), signature + 1, &reason));
+    ASSERT_EQ(f.size(), 0);
+    ASSERT_FALSE(reason.empty());
+  }
+
+  boost::filesystem::remove(filename);
+}
+
+TEST(zc_outputs_index, write_tx_staging)
+{
+  epee::shared_recursive_mutex rw_lock;
+  tools::db::basic_db_accessor db(std::shared_ptr<tools::db::i_db_backend>(new tools::db::lmdb_db_backend), rw_lock);
+  const std::string folder_name = "./TEST_zc_outputs_index";
+  boost::filesystem::remove_all(folder_name);
+  tools::create_directories_if_necessary(folder_name);
+  ASSERT_TRUE(db.open(folder_name, CACHE_SIZE));
+
+  currency::zc_outputs_index index(db);
+  ASSERT_TRUE(index.init(folder_name + "/index.bin", 1));
+
+  // outside of a tx changes go directly to the file
+  for (uint64_t i = 0; i != 10; ++i)
+    ASSERT_TRUE(index.push_back(i, make_entry(i)));
+  ASSERT_FALSE(index.push_back(20, make_entry(20)));
+  ASSERT_EQ(index.size(), 10);
+
+  // committed tx: pop two, push three, mark one spent
+  db.begin_transaction();
+  index.truncate(8);
+  for (uint64_t i = 8; i != 11; ++i)
+    ASSERT_TRUE(index.push_back(i, make_entry(100 + i)));
+  index.set_spent_flag(3, true);
+  ASSERT_EQ(index.writer_size(), 11);
+  // readers don't see staged changes
+  ASSERT_EQ(index.size(), 10);
+  ASSERT_EQ(entry_number(index.get(8)), 8);
+  ASSERT_FALSE(index.get(3)->is_spent());
+  db.commit_transaction();
+  ASSERT_EQ(index.size(), 11);
+  ASSERT_EQ(entry_number(index.get(8)), 108);
+  ASSERT_EQ(entry_number(index.get(10)), 110);
+  ASSERT_TRUE(index.get(3)->is_spent());
+
+  // aborted tx leaves the file untouched
+  db.begin_transaction();
+  index.truncate(5);
+  ASSERT_TRUE(index.push_back(5, make_entry(200)));
+  db.abort_transaction();
+  ASSERT_EQ(index.size(), 11);
+  ASSERT_EQ(entry_number(index.get(5)), 5);
+
+  // nested abort: everything touched by the outer tx is dropped, to be caught up later
+  db.begin_transaction();
+  ASSERT_TRUE(index.push_back(11, make_entry(11)));
+  db.begin_transaction();
+  index.truncate(7);
+  db.abort_transaction();
+  db.commit_transaction();
+  ASSERT_EQ(index.size(), 7);
+  ASSERT_EQ(entry_number(index.get(6)), 6);
+
+  index.deinit();
+  db.close();
+  boost::filesystem::remove_all(folder_name);
+}
@@ -4,6 +4,7 @@
 #include "gtest/gtest.h"
 #include "epee/include/misc_log_ex.h"
 #include "epee/include/zlib_helper.h"
+#include "epee/include/gzip_encoding.h"
 #include "crypto/crypto.h"
 
 TEST(zlib_helper, test_0)
@@ -23,3 +24,93 @@ TEST(zlib_helper, test_0)
     }
   }
 }
+
+TEST(zlib_helper, pack_fast_unpack_bounded)
+{
+  std::string original(100000, 'X');
+  crypto::generate_random_bytes(original.size() / 2, &original.front());
+
+  std::string packed, unpacked;
+  ASSERT_TRUE(epee::zlib_helper::pack_fast(original, packed));
+  ASSERT_LT(packed.size(), original.size());
+  ASSERT_TRUE(epee::zlib_helper::unpack_bounded(packed, unpacked, original.size()));
+  ASSERT_EQ(original, unpacked);
+
+  // a bomb bigger than the limit, a truncated stream and garbage are rejected
+  ASSERT_FALSE(epee::zlib_helper::unpack_bounded(packed, unpacked, original.size() - 1));
+  ASSERT_TRUE(unpacked.empty());
+  ASSERT_FALSE(epee::zlib_helper::unpack_bounded(packed.substr(0, packed.size() / 2), unpacked, original.size()));
+  ASSERT_FALSE(epee::zlib_helper::unpack_bounded(std::string(256, 't'), unpacked, original.size()));
+
+  ASSERT_TRUE(epee::zlib_helper::pack_fast(std::string(), packed));
+  ASSERT_TRUE(epee::zlib_helper::unpack_bounded(packed, unpacked, 0));
+  ASSERT_TRUE(unpacked.empty());
+}
+
+TEST(zlib_helper, http_content_encodings)
+{
+  std::string original;
+  for (size_t i = 0; i != 5000; ++i)
+    original += "{\"height\": " + std::to_string(i) + ", \"blob\": \"0123456789abcdef\"},";
+
+  for (bool gzip : { true, false })
+  {
+    std::string packed, unpacked;
+    ASSERT_TRUE(epee::zlib_helper::pack_http(original, packed, 6, gzip));
+    ASSERT_LT(packed.size(), original.size() / 4);
+    ASSERT_EQ(gzip, packed.size() > 2 && packed[0] == '\x1f' && packed[1] == '\x8b');
+    ASSERT_TRUE(epee::zlib_helper::unpack_http_bounded(packed, unpacked, original.size()));
+    ASSERT_EQ(original, unpacked);
+    ASSERT_FALSE(epee::zlib_helper::unpack_http_bounded(packed, unpacked, original.size() - 1));
+    ASSERT_FALSE(epee::zlib_helper::unpack_http_bounded(packed.substr(0, packed.size() - 1), unpacked, original.size()));
+  }
+}
+
+namespace
+{
+  struct collecting_target_handler : public epee::net_utils::i_target_handler
+  {
+    virtual bool handle_target_data(std::string& piece_of_transfer)
+    {
+      collected += piece_of_transfer;
+      piece_of_transfer.clear();
+      return true;
+    }
+    std::string collected;
+  };
+}
+
+TEST(zlib_helper, content_encoding_gzip_bounded)
+{
+  // 4 MB of zeros pack to a few KB
+  const std::string original(4 * 1024 * 1024, '\0');
+
+  for (bool gzip : { true, false })
+  {
+    std::string bomb;
+    ASSERT_TRUE(epee::zlib_helper::pack_http(original, bomb, 9, gzip));
+    ASSERT_LT(bomb.size(), original.size() / 100);
+
+    // fed in pieces, as the http client gets it
+    auto feed = [&](epee::net_utils::content_encoding_gzip& decoder)
+    {
+      for (size_t offset = 0; offset < bomb.size(); offset += 1024)
+      {
+        std::string piece = bomb.substr(offset, 1024);
+        if (!decoder.update_in(piece))
+          return false;
+      }
+      return true;
+    };
+
+    collecting_target_handler within_limit;
+    epee::net_utils::content_encoding_gzip decoder_within_limit(&within_limit, !gzip, Z_DEFAULT_COMPRESSION, original.size());
+    ASSERT_TRUE(feed(decoder_within_limit));
+    ASSERT_EQ(original, within_limit.collected);
+
+    collecting_target_handler over_limit;
+    epee::net_utils::content_encoding_gzip decoder_over_limit(&over_limit, !gzip, Z_DEFAULT_COMPRESSION, original.size() / 4);
+    ASSERT_FALSE(feed(decoder_over_limit));
+    ASSERT_LE(over_limit.collected.size(), original.size() / 4);
+  }
+}